@@ -6,17 +6,41 @@
  
 #include "extract_connecting_graph.hpp"
 
+#include "../vg.hpp"
+#include "../xg.hpp"
+
 //#define debug_vg_algorithms
 
 namespace vg {
 namespace algorithms {
-    unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Graph& g, int64_t max_len,
-                                                       pos_t pos_1, pos_t pos_2,
-                                                       bool include_terminal_positions,
-                                                       bool detect_terminal_cycles,
-                                                       bool no_additional_tips,
-                                                       bool only_paths,
-                                                       bool strict_max_len) {
+    
+    void ConnectingGraphScratch::clear() {
+        graph.clear();
+        observed_edges.clear();
+        queued_traversals.clear();
+        // the queues have no clear, but popping keeps their space
+        while (!queue.empty()) {
+            queue.pop();
+        }
+        local_queued_traversals.clear();
+        while (!local_queue.empty()) {
+            local_queue.pop();
+        }
+        stack.clear();
+        node_ids.clear();
+    }
+    
+    /// Do the extraction from any type of graph, following edges with the
+    /// graph's own follow_edges_inline.
+    template <typename Source>
+    static unordered_map<id_t, id_t> extract_connecting_graph_internal(const Source* source, Graph& g, int64_t max_len,
+                                                                       pos_t pos_1, pos_t pos_2,
+                                                                       ConnectingGraphScratch& scratch,
+                                                                       bool include_terminal_positions,
+                                                                       bool detect_terminal_cycles,
+                                                                       bool no_additional_tips,
+                                                                       bool only_paths,
+                                                                       bool strict_max_len) {
 #ifdef debug_vg_algorithms
         cerr << "[extract_connecting_graph] max len: " << max_len << ", pos 1: " << pos_1 << ", pos 2: " << pos_2 << endl;
 #endif
@@ -26,25 +50,12 @@ namespace algorithms {
             exit(1);
         }
         
-        // a local struct for Nodes that maintains edge lists
-        struct LocalNode {
-            LocalNode() {}
-            LocalNode(string sequence) : sequence(sequence) {}
-            string sequence;
-            // edges are stored as (node id, is reversing?)
-            vector<pair<id_t, bool>> edges_left;
-            vector<pair<id_t, bool>> edges_right;
-        };
+        // Nodes that maintain edge lists, and handles with their distances from the first position
+        typedef ConnectingGraphScratch::LocalNode LocalNode;
+        typedef ConnectingGraphScratch::Traversal Traversal;
         
-        // a local struct that packages a handle with its distance from the first position
-        struct Traversal {
-            Traversal(handle_t handle, int64_t dist) : handle(handle), dist(dist) {}
-            int64_t dist; // distance from pos to the right side of this node
-            handle_t handle; // Oriented node traversal
-            inline bool operator<(const Traversal& other) const {
-                return dist > other.dist; // opposite order so priority queue selects minimum
-            }
-        };
+        // start from empty tables, but keep whatever space the last extraction allocated
+        scratch.clear();
         
         // local enum to keep track of the cases where the positions are on the same node
         enum colocation_t {SeparateNodes, SharedNodeReachable, SharedNodeUnreachable, SharedNodeReverse};
@@ -97,12 +108,12 @@ namespace algorithms {
         unordered_map<id_t, id_t> id_trans;
         
         // the edges we have encountered in the traversal
-        unordered_set<pair<handle_t, handle_t>> observed_edges;
+        unordered_set<pair<handle_t, handle_t>>& observed_edges = scratch.observed_edges;
         
         // the representation of the graph we're going to build up before storing in g (allows easier
         // subsetting operations than Graph, XG, or VG objects)
         // TODO: reduce duplicate get_handle calls!
-        unordered_map<id_t, LocalNode> graph;
+        unordered_map<id_t, LocalNode>& graph = scratch.graph;
         graph[id(pos_1)] = LocalNode(source->get_sequence(source->get_handle(id(pos_1), false)));
         if (id(pos_2) != id(pos_1)) {
             graph[id(pos_2)] = LocalNode(source->get_sequence(source->get_handle(id(pos_2), false)));
@@ -111,14 +122,15 @@ namespace algorithms {
         // keep track of whether we find a path or not
         bool found_target = false;
         
-        unordered_set<handle_t> queued_traversals{source->get_handle(id(pos_1), is_rev(pos_1))};
+        unordered_set<handle_t>& queued_traversals = scratch.queued_traversals;
+        queued_traversals.insert(source->get_handle(id(pos_1), is_rev(pos_1)));
         // mark final position as "queued" so that we won't look for additional traversals unless that's
         // the only way to find terminal cycles
         if (!(colocation == SharedNodeReverse && detect_terminal_cycles)) {
             queued_traversals.insert(source->get_handle(id(pos_2), is_rev(pos_2)));
         }
         // initialize the queue
-        priority_queue<Traversal> queue;
+        priority_queue<Traversal>& queue = scratch.queue;
         
         // the distance to the ends of the starting nodes
         int64_t first_traversal_length = graph[id(pos_1)].sequence.size() - offset(pos_1);
@@ -168,7 +180,7 @@ namespace algorithms {
                 auto& edges_out = source->get_is_reverse(trav.handle) ?
                     graph[source->get_id(trav.handle)].edges_left :
                     graph[source->get_id(trav.handle)].edges_right;
-                source->follow_edges(trav.handle, false, [&](const handle_t& next) {
+                source->follow_edges_inline(trav.handle, false, [&](const handle_t& next) {
                     // get the orientation and id of the other side of the edge
                     
                     id_t next_id = source->get_id(next);
@@ -214,6 +226,7 @@ namespace algorithms {
                         }
                         observed_edges.insert(canonical_edge);
                     }
+                    return true;
                 });
             }
         }
@@ -260,7 +273,7 @@ namespace algorithms {
                     << " orientation at distance " << trav.dist << endl;
 #endif
                 
-                source->follow_edges(trav.handle, false, [&](const handle_t& next) {
+                source->follow_edges_inline(trav.handle, false, [&](const handle_t& next) {
                     // get the orientation and id of the other side of the edge
 #ifdef debug_vg_algorithms
                     cerr << "BACKWARD SEARCH: got edge "
@@ -309,6 +322,7 @@ namespace algorithms {
                         }
                         observed_edges.insert(canonical_edge);
                     }
+                    return true;
                 });
             }
         }
@@ -987,28 +1001,18 @@ namespace algorithms {
         // Now we need traversals and queues for our exploration of this already-extracted graph.
         // We don't need to touch handles anymore
         
-        // Define a traversal for our local-variable-based graph representation
-        struct LocalTraversal {
-            LocalTraversal(id_t id, bool rev, int64_t dist) : id(id), rev(rev), dist(dist) {}
-            int64_t dist; // distance from pos_1 to the right side of this node
-            id_t id;      // node ID
-            bool rev;     // strand
-            inline bool operator<(const LocalTraversal& other) const {
-                return dist > other.dist; // opposite order so priority queue selects minimum
-            }
-        };
+        // Use the traversal for our local-variable-based graph representation
+        typedef ConnectingGraphScratch::LocalTraversal LocalTraversal;
         
         // Define new queue
-        unordered_set<pair<id_t, bool>> local_queued_traversals;
-        priority_queue<LocalTraversal> local_queue;
+        unordered_set<pair<id_t, bool>>& local_queued_traversals = scratch.local_queued_traversals;
+        priority_queue<LocalTraversal>& local_queue = scratch.local_queue;
         
         if (strict_max_len) {
             // OPTION 1: PRUNE TO PATHS UNDER MAX LENGTH
             // some nodes in the current graph may not be on paths, or the paths that they are on may be
             // above the maximum distance, so we do a forward-backward distance search to check
-            
-            unordered_map<pair<id_t, bool>, int64_t> forward_trav_dist;
-            unordered_map<pair<id_t, bool>, int64_t> reverse_trav_dist;
+            // the distances are recorded on the local nodes, so each check is a single lookup
             
             // re-initialize the queue in the forward direction
             local_queue.emplace(id(pos_1), is_rev(pos_1), graph[id(pos_1)].sequence.size());
@@ -1027,7 +1031,7 @@ namespace algorithms {
                 // get the next closest node traversal
                 LocalTraversal trav = local_queue.top();
                 local_queue.pop();
-                forward_trav_dist[make_pair(trav.id, trav.rev)] = trav.dist;
+                graph[trav.id].forward_dist[trav.rev] = trav.dist;
                 
 #ifdef debug_vg_algorithms
                 cerr << "FORWARD PRUNE: traversing node " << trav.id << " in " << (trav.rev ? "reverse" : "forward") << " orientation at distance " << trav.dist << endl;
@@ -1066,7 +1070,7 @@ namespace algorithms {
                 // get the next closest node traversal
                 LocalTraversal trav = local_queue.top();
                 local_queue.pop();
-                reverse_trav_dist[make_pair(trav.id, trav.rev)] = trav.dist;
+                graph[trav.id].reverse_dist[trav.rev] = trav.dist;
                 
 #ifdef debug_vg_algorithms
                 cerr << "BACKWARD PRUNE: traversing node " << trav.id << " in " << (trav.rev ? "reverse" : "forward") << " orientation at distance " << trav.dist << endl;
@@ -1092,74 +1096,53 @@ namespace algorithms {
             // with these, we can compute the shortest path that uses each node and edge to see if it
             // should be included in the final graph
             
+            // did both searches reach the ends of a path, and is it short enough with the extra length?
+            auto short_enough = [&](int64_t forward_dist, int64_t reverse_dist, int64_t extra_len) {
+                return forward_dist >= 0 && reverse_dist >= 0 && forward_dist + reverse_dist + extra_len <= max_len;
+            };
+            
             vector<unordered_map<id_t, LocalNode>::iterator> to_erase;
             for (auto iter = graph.begin(); iter != graph.end(); iter++) {
-                bool erase_node = true;
-                id_t node_id = (*iter).first;
+                LocalNode& node = (*iter).second;
                 // did a short enough path use one or the other traversal directions?
-                if (forward_trav_dist.count(make_pair(node_id, true)) &&
-                    reverse_trav_dist.count(make_pair(node_id, false))) {
-                    if (forward_trav_dist[make_pair(node_id, true)]
-                        + reverse_trav_dist[make_pair(node_id, false)] <= max_len) {
-                        erase_node = false;
-                    }
-                }
-                if (forward_trav_dist.count(make_pair(node_id, false)) &&
-                    reverse_trav_dist.count(make_pair(node_id, true))) {
-                    if (forward_trav_dist[make_pair(node_id, false)]
-                        + reverse_trav_dist[make_pair(node_id, true)] <= max_len) {
-                        erase_node = false;
-                    }
-                }
+                bool erase_node = (!short_enough(node.forward_dist[true], node.reverse_dist[false], 0) &&
+                                   !short_enough(node.forward_dist[false], node.reverse_dist[true], 0));
                 
                 if (erase_node) {
                     // the shortest path using this node is too long
                     to_erase.push_back(iter);
                 }
                 else {
-                    LocalNode& node = (*iter).second;
                     // find which edges are traversed on sufficiently short paths
                     auto new_right_end = std::remove_if(node.edges_right.begin(), node.edges_right.end(),
                                                         [&](const pair<id_t, bool>& edge) {
-                                                            bool erase_edge = true;
-                                                            if (forward_trav_dist.count(make_pair(node_id, false))
-                                                                && reverse_trav_dist.count(make_pair(edge.first, !edge.second))) {
-                                                                if (forward_trav_dist[make_pair(node_id, false)]
-                                                                    + reverse_trav_dist[make_pair(edge.first, !edge.second)]
-                                                                    + graph[edge.first].sequence.size() <= max_len) {
-                                                                    erase_edge = false;
-                                                                }
-                                                            }
-                                                            if (forward_trav_dist.count(make_pair(edge.first, !edge.second))
-                                                                && reverse_trav_dist.count(make_pair(node_id, false))) {
-                                                                if (forward_trav_dist[make_pair(edge.first, !edge.second)]
-                                                                    + reverse_trav_dist[make_pair(node_id, false)]
-                                                                    + graph[node_id].sequence.size() <= max_len) {
-                                                                    erase_edge = false;
-                                                                }
+                                                            auto next_iter = graph.find(edge.first);
+                                                            if (next_iter == graph.end()) {
+                                                                // the search never reached this node
+                                                                return true;
                                                             }
-                                                            return erase_edge;
+                                                            LocalNode& next_node = next_iter->second;
+                                                            return (!short_enough(node.forward_dist[false],
+                                                                                  next_node.reverse_dist[!edge.second],
+                                                                                  next_node.sequence.size()) &&
+                                                                    !short_enough(next_node.forward_dist[!edge.second],
+                                                                                  node.reverse_dist[false],
+                                                                                  node.sequence.size()));
                                                         });
                     auto new_left_end = std::remove_if(node.edges_left.begin(), node.edges_left.end(),
                                                        [&](const pair<id_t, bool>& edge) {
-                                                           bool erase_edge = true;
-                                                           if (forward_trav_dist.count(make_pair(node_id, true))
-                                                               && reverse_trav_dist.count(make_pair(edge.first, edge.second))) {
-                                                               if (forward_trav_dist[make_pair(node_id, true)]
-                                                                   + reverse_trav_dist[make_pair(edge.first, edge.second)]
-                                                                   + graph[edge.first].sequence.size() <= max_len) {
-                                                                   erase_edge = false;
-                                                               }
-                                                           }
-                                                           if (forward_trav_dist.count(make_pair(edge.first, edge.second))
-                                                               && reverse_trav_dist.count(make_pair(node_id, true))) {
-                                                               if (forward_trav_dist[make_pair(edge.first, edge.second)]
-                                                                   + reverse_trav_dist[make_pair(node_id, true)]
-                                                                   + graph[node_id].sequence.size() <= max_len) {
-                                                                   erase_edge = false;
-                                                               }
+                                                           auto next_iter = graph.find(edge.first);
+                                                           if (next_iter == graph.end()) {
+                                                               // the search never reached this node
+                                                               return true;
                                                            }
-                                                           return erase_edge;
+                                                           LocalNode& next_node = next_iter->second;
+                                                           return (!short_enough(node.forward_dist[true],
+                                                                                 next_node.reverse_dist[edge.second],
+                                                                                 next_node.sequence.size()) &&
+                                                                   !short_enough(next_node.forward_dist[edge.second],
+                                                                                 node.reverse_dist[true],
+                                                                                 node.sequence.size()));
                                                        });
                     // remove the edges that only occurred on path that were too long
                     node.edges_right.resize(new_right_end - node.edges_right.begin());
@@ -1181,19 +1164,17 @@ namespace algorithms {
             // some nodes in the current graph may not be on paths, so we do a forward-backward
             // reachability search to check
             
-            list<pair<id_t, bool>> stack;
-            
-            unordered_set<pair<id_t, bool>> forward_reachable;
-            unordered_set<pair<id_t, bool>> reverse_reachable;
+            // reachability is recorded on the local nodes, so each check is a single lookup
+            vector<pair<id_t, bool>>& stack = scratch.stack;
             
             // initialize the stack in the forward direction
             stack.emplace_back(id(pos_1), is_rev(pos_1));
-            forward_reachable.emplace(id(pos_1), is_rev(pos_1));
+            graph[id(pos_1)].forward_reachable[is_rev(pos_1)] = true;
             
             // if we duplicated the start node, add that too
             if (duplicate_node_1) {
                 stack.emplace_back(duplicate_node_1, is_rev(pos_1));
-                forward_reachable.emplace(duplicate_node_1, is_rev(pos_1));
+                graph[duplicate_node_1].forward_reachable[is_rev(pos_1)] = true;
             }
             
             while (!stack.empty()) {
@@ -1207,21 +1188,22 @@ namespace algorithms {
                     
                     // queue up the node traversal if it hasn't been seen before
                     pair<id_t, bool> next_trav = make_pair(edge.first, edge.second != trav.second);
-                    if (!forward_reachable.count(next_trav)) {
+                    bool& reachable = graph[next_trav.first].forward_reachable[next_trav.second];
+                    if (!reachable) {
                         stack.emplace_back(next_trav);
-                        forward_reachable.insert(next_trav);
+                        reachable = true;
                     }
                 }
             }
             
             // re-initialize the stack in the reverse direction
             stack.emplace_back(id(pos_2), !is_rev(pos_2));
-            reverse_reachable.emplace(id(pos_2), !is_rev(pos_2));
+            graph[id(pos_2)].reverse_reachable[!is_rev(pos_2)] = true;
             
             // if we duplicated the second end node, add that too
             if (duplicate_node_2) {
                 stack.emplace_back(duplicate_node_2, !is_rev(pos_2));
-                reverse_reachable.emplace(duplicate_node_2, !is_rev(pos_2));
+                graph[duplicate_node_2].reverse_reachable[!is_rev(pos_2)] = true;
             }
             
             while (!stack.empty()) {
@@ -1235,9 +1217,10 @@ namespace algorithms {
                     
                     // queue up the node traversal if it hasn't been seen before
                     pair<id_t, bool> next_trav = make_pair(edge.first, edge.second != trav.second);
-                    if (!reverse_reachable.count(next_trav)) {
+                    bool& reachable = graph[next_trav.first].reverse_reachable[next_trav.second];
+                    if (!reachable) {
                         stack.emplace_back(next_trav);
-                        reverse_reachable.insert(next_trav);
+                        reachable = true;
                     }
                 }
             }
@@ -1247,31 +1230,40 @@ namespace algorithms {
             
             vector<unordered_map<id_t, LocalNode>::iterator> to_erase;
             for (auto iter = graph.begin(); iter != graph.end(); iter++) {
-                id_t node_id = (*iter).first;
+                LocalNode& node = (*iter).second;
                 // did a path use one or the other traversal directions?
-                if (!(forward_reachable.count(make_pair(node_id, true)) &&
-                      reverse_reachable.count(make_pair(node_id, false))) &&
-                    !(forward_reachable.count(make_pair(node_id, false)) &&
-                      reverse_reachable.count(make_pair(node_id, true)))) {
+                if (!(node.forward_reachable[true] && node.reverse_reachable[false]) &&
+                    !(node.forward_reachable[false] && node.reverse_reachable[true])) {
                         
                     to_erase.push_back(iter);
                 }
                 else {
-                    LocalNode& node = (*iter).second;
                     // find which edges are also on traversed paths
                     auto new_right_end = std::remove_if(node.edges_right.begin(), node.edges_right.end(),
                                                         [&](const pair<id_t, bool>& edge) {
-                                                            return !(forward_reachable.count(make_pair(node_id, false)) &&
-                                                                     reverse_reachable.count(make_pair(edge.first, !edge.second))) &&
-                                                                   !(forward_reachable.count(make_pair(edge.first, !edge.second))
-                                                                     && reverse_reachable.count(make_pair(node_id, false)));
+                                                            auto next_iter = graph.find(edge.first);
+                                                            if (next_iter == graph.end()) {
+                                                                // the search never reached this node
+                                                                return true;
+                                                            }
+                                                            LocalNode& next_node = next_iter->second;
+                                                            return !(node.forward_reachable[false] &&
+                                                                     next_node.reverse_reachable[!edge.second]) &&
+                                                                   !(next_node.forward_reachable[!edge.second]
+                                                                     && node.reverse_reachable[false]);
                                                         });
                     auto new_left_end = std::remove_if(node.edges_left.begin(), node.edges_left.end(),
                                                        [&](const pair<id_t, bool>& edge) {
-                                                           return !(forward_reachable.count(make_pair(node_id, true)) &&
-                                                                    reverse_reachable.count(make_pair(edge.first, edge.second))) &&
-                                                                  !(forward_reachable.count(make_pair(edge.first, edge.second))
-                                                                    && reverse_reachable.count(make_pair(node_id, true)));
+                                                           auto next_iter = graph.find(edge.first);
+                                                           if (next_iter == graph.end()) {
+                                                               // the search never reached this node
+                                                               return true;
+                                                           }
+                                                           LocalNode& next_node = next_iter->second;
+                                                           return !(node.forward_reachable[true] &&
+                                                                    next_node.reverse_reachable[edge.second]) &&
+                                                                  !(next_node.forward_reachable[edge.second]
+                                                                    && node.reverse_reachable[true]);
                                                        });
                     // remove the edges that only occurred on path that were too long
                     node.edges_right.resize(new_right_end - node.edges_right.begin());
@@ -1295,21 +1287,30 @@ namespace algorithms {
             // next we remove all tips (except if the tip is a node with our end position on it)
             
             if (no_additional_tips) {
-                unordered_map<id_t, int64_t> left_degree;
-                unordered_map<id_t, int64_t> right_degree;
-                
-                for (const pair<id_t, LocalNode>& node_record : graph) {
-                    left_degree[node_record.first] = node_record.second.edges_left.size();
-                    right_degree[node_record.first] = node_record.second.edges_right.size();
+                // the degrees are recorded on the local nodes, and we check each node that starts out in
+                // the graph once
+                vector<id_t>& node_ids = scratch.node_ids;
+                for (auto& node_record : graph) {
+                    node_record.second.left_degree = node_record.second.edges_left.size();
+                    node_record.second.right_degree = node_record.second.edges_right.size();
+                    node_ids.push_back(node_record.first);
                 }
                 
+                // reduce the degree on one side of a node if we haven't pruned it yet
+                auto reduce_degree = [&](id_t node_id, bool left_side) {
+                    auto iter = graph.find(node_id);
+                    if (iter != graph.end()) {
+                        (left_side ? iter->second.left_degree : iter->second.right_degree)--;
+                    }
+                };
+                
                 // remove nodes from the graph if they are tips or only connect to tips
                 list<id_t> to_check;
-                for (const pair<id_t, int64_t>& left_deg_record : left_degree) {
+                for (id_t start_id : node_ids) {
                     // check every node in the graph once
-                    to_check.push_front(left_deg_record.first);
+                    to_check.push_front(start_id);
 #ifdef debug_vg_algorithms
-                    cerr << "TIP REMOVAL: initializing queue with node " << left_deg_record.first << endl;
+                    cerr << "TIP REMOVAL: initializing queue with node " << start_id << endl;
 #endif
                     while (!to_check.empty()) {
                         id_t node_id = to_check.back();
@@ -1321,38 +1322,32 @@ namespace algorithms {
                             // have already pruned this node
                             continue;
                         }
-                        if (left_degree[node_id] == 0) {
+                        LocalNode& node = graph[node_id];
+                        // cutting can leave an edge listed on only one of its sides, so a degree can
+                        // go below zero, and we have to treat that as a tip too for the result not to
+                        // depend on the order we check the nodes in
+                        if (node.left_degree <= 0) {
 #ifdef debug_vg_algorithms
                             cerr << "TIP REMOVAL: node " << node_id << " is a left tip" << endl;
 #endif
                             if (id_trans.count(node_id)) {
                                 id_trans.erase(node_id);
                             }
-                            for (pair<id_t, bool>& edge : graph[node_id].edges_right) {
-                                if (edge.second) {
-                                    right_degree[edge.first]--;
-                                }
-                                else {
-                                    left_degree[edge.first]--;
-                                }
+                            for (pair<id_t, bool>& edge : node.edges_right) {
+                                reduce_degree(edge.first, !edge.second);
                                 to_check.push_front(edge.first);
                             }
                             graph.erase(node_id);
                         }
-                        else if (right_degree[node_id] == 0) {
+                        else if (node.right_degree <= 0) {
 #ifdef debug_vg_algorithms
                             cerr << "TIP REMOVAL: node " << node_id << " is a right tip" << endl;
 #endif
                             if (id_trans.count(node_id)) {
                                 id_trans.erase(node_id);
                             }
-                            for (pair<id_t, bool>& edge : graph[node_id].edges_left) {
-                                if (edge.second) {
-                                    left_degree[edge.first]--;
-                                }
-                                else {
-                                    right_degree[edge.first]--;
-                                }
+                            for (pair<id_t, bool>& edge : node.edges_left) {
+                                reduce_degree(edge.first, edge.second);
                                 to_check.push_front(edge.first);
                             }
                             graph.erase(node_id);
@@ -1400,7 +1395,7 @@ namespace algorithms {
             }
         }
         
-        for (const pair<id_t, LocalNode>& node_record : graph) {
+        for (const auto& node_record : graph) {
             // add in each node
             Node* node = g.add_node();
             node->set_id(node_record.first);
@@ -1434,5 +1429,83 @@ namespace algorithms {
         // the function, which are obviously available in the environment that calls it)
         return id_trans;
     }
+
+    unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       bool include_terminal_positions,
+                                                       bool detect_terminal_cycles,
+                                                       bool no_additional_tips,
+                                                       bool only_paths,
+                                                       bool strict_max_len) {
+        ConnectingGraphScratch scratch;
+        return extract_connecting_graph_internal(source, g, max_len, pos_1, pos_2, scratch, include_terminal_positions,
+                                                 detect_terminal_cycles, no_additional_tips, only_paths,
+                                                 strict_max_len);
+    }
+
+    unordered_map<id_t, id_t> extract_connecting_graph(const VG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       bool include_terminal_positions,
+                                                       bool detect_terminal_cycles,
+                                                       bool no_additional_tips,
+                                                       bool only_paths,
+                                                       bool strict_max_len) {
+        ConnectingGraphScratch scratch;
+        return extract_connecting_graph_internal(source, g, max_len, pos_1, pos_2, scratch, include_terminal_positions,
+                                                 detect_terminal_cycles, no_additional_tips, only_paths,
+                                                 strict_max_len);
+    }
+
+    unordered_map<id_t, id_t> extract_connecting_graph(const xg::XG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       bool include_terminal_positions,
+                                                       bool detect_terminal_cycles,
+                                                       bool no_additional_tips,
+                                                       bool only_paths,
+                                                       bool strict_max_len) {
+        ConnectingGraphScratch scratch;
+        return extract_connecting_graph_internal(source, g, max_len, pos_1, pos_2, scratch, include_terminal_positions,
+                                                 detect_terminal_cycles, no_additional_tips, only_paths,
+                                                 strict_max_len);
+    }
+
+    unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ConnectingGraphScratch& scratch,
+                                                       bool include_terminal_positions,
+                                                       bool detect_terminal_cycles,
+                                                       bool no_additional_tips,
+                                                       bool only_paths,
+                                                       bool strict_max_len) {
+        return extract_connecting_graph_internal(source, g, max_len, pos_1, pos_2, scratch, include_terminal_positions,
+                                                 detect_terminal_cycles, no_additional_tips, only_paths,
+                                                 strict_max_len);
+    }
+
+    unordered_map<id_t, id_t> extract_connecting_graph(const VG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ConnectingGraphScratch& scratch,
+                                                       bool include_terminal_positions,
+                                                       bool detect_terminal_cycles,
+                                                       bool no_additional_tips,
+                                                       bool only_paths,
+                                                       bool strict_max_len) {
+        return extract_connecting_graph_internal(source, g, max_len, pos_1, pos_2, scratch, include_terminal_positions,
+                                                 detect_terminal_cycles, no_additional_tips, only_paths,
+                                                 strict_max_len);
+    }
+
+    unordered_map<id_t, id_t> extract_connecting_graph(const xg::XG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ConnectingGraphScratch& scratch,
+                                                       bool include_terminal_positions,
+                                                       bool detect_terminal_cycles,
+                                                       bool no_additional_tips,
+                                                       bool only_paths,
+                                                       bool strict_max_len) {
+        return extract_connecting_graph_internal(source, g, max_len, pos_1, pos_2, scratch, include_terminal_positions,
+                                                 detect_terminal_cycles, no_additional_tips, only_paths,
+                                                 strict_max_len);
+    }
 }
 }
@@ -8,6 +8,8 @@
  */
 
 #include <unordered_map>
+#include <unordered_set>
+#include <queue>
 
 #include "../position.hpp"
 #include "../cached_position.hpp"
@@ -15,9 +17,76 @@
 #include "../vg.pb.h"
 #include "../hash_map.hpp"
 
+namespace xg {
+class XG;
+}
+
 namespace vg {
+
+class VG;
+
 namespace algorithms {
     
+    /// Working space for extract_connecting_graph. Keeping one of these around and passing it to each
+    /// call lets the searches reuse the tables and queues of the previous call instead of allocating
+    /// their own. The contents are only meaningful inside a call.
+    struct ConnectingGraphScratch {
+        
+        /// A node of the graph being extracted, with its edge lists and the per-orientation state of
+        /// the pruning searches
+        struct LocalNode {
+            LocalNode() {}
+            LocalNode(string sequence) : sequence(sequence) {}
+            string sequence;
+            // edges are stored as (node id, is reversing?)
+            vector<pair<id_t, bool>> edges_left;
+            vector<pair<id_t, bool>> edges_right;
+            // shortest distances to each orientation from the first and second positions, or -1 if the
+            // orientation has not been reached
+            int64_t forward_dist[2] = {-1, -1};
+            int64_t reverse_dist[2] = {-1, -1};
+            // whether each orientation is reachable from the first and second positions
+            bool forward_reachable[2] = {false, false};
+            bool reverse_reachable[2] = {false, false};
+            // degrees for tip removal
+            int64_t left_degree = 0;
+            int64_t right_degree = 0;
+        };
+        
+        /// A handle with its distance from the first position
+        struct Traversal {
+            Traversal(handle_t handle, int64_t dist) : dist(dist), handle(handle) {}
+            int64_t dist; // distance from pos to the right side of this node
+            handle_t handle; // Oriented node traversal
+            inline bool operator<(const Traversal& other) const {
+                return dist > other.dist; // opposite order so priority queue selects minimum
+            }
+        };
+        
+        /// A node traversal in the extracted graph with its distance from one of the positions
+        struct LocalTraversal {
+            LocalTraversal(id_t id, bool rev, int64_t dist) : dist(dist), id(id), rev(rev) {}
+            int64_t dist; // distance from pos_1 to the right side of this node
+            id_t id;      // node ID
+            bool rev;     // strand
+            inline bool operator<(const LocalTraversal& other) const {
+                return dist > other.dist; // opposite order so priority queue selects minimum
+            }
+        };
+        
+        /// Empty out everything before a new extraction, keeping the allocated space
+        void clear();
+        
+        unordered_map<id_t, LocalNode> graph;
+        unordered_set<pair<handle_t, handle_t>> observed_edges;
+        unordered_set<handle_t> queued_traversals;
+        priority_queue<Traversal> queue;
+        unordered_set<pair<id_t, bool>> local_queued_traversals;
+        priority_queue<LocalTraversal> local_queue;
+        vector<pair<id_t, bool>> stack;
+        vector<id_t> node_ids;
+    };
+    
     /// Fills Graph g with the subgraph of the VG graph vg that connects two positions. The nodes that contain
     /// the two positions will be "cut" at the position and will be tips in the returned graph. Sometimes it
     /// is necessary to duplicate nodes in order to do this, so a map is returned that translates node IDs in
@@ -50,6 +119,54 @@ namespace algorithms {
                                                        bool no_additional_tips = false,
                                                        bool only_paths = false,
                                                        bool strict_max_len = false);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    unordered_map<id_t, id_t> extract_connecting_graph(const VG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       bool include_terminal_positions = false,
+                                                       bool detect_terminal_cycles = false,
+                                                       bool no_additional_tips = false,
+                                                       bool only_paths = false,
+                                                       bool strict_max_len = false);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    unordered_map<id_t, id_t> extract_connecting_graph(const xg::XG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       bool include_terminal_positions = false,
+                                                       bool detect_terminal_cycles = false,
+                                                       bool no_additional_tips = false,
+                                                       bool only_paths = false,
+                                                       bool strict_max_len = false);
+    
+    /// Same as above, but works in the given scratch space, which can be reused across calls.
+    unordered_map<id_t, id_t> extract_connecting_graph(const HandleGraph* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ConnectingGraphScratch& scratch,
+                                                       bool include_terminal_positions = false,
+                                                       bool detect_terminal_cycles = false,
+                                                       bool no_additional_tips = false,
+                                                       bool only_paths = false,
+                                                       bool strict_max_len = false);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    unordered_map<id_t, id_t> extract_connecting_graph(const VG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ConnectingGraphScratch& scratch,
+                                                       bool include_terminal_positions = false,
+                                                       bool detect_terminal_cycles = false,
+                                                       bool no_additional_tips = false,
+                                                       bool only_paths = false,
+                                                       bool strict_max_len = false);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    unordered_map<id_t, id_t> extract_connecting_graph(const xg::XG* source, Graph& g, int64_t max_len,
+                                                       pos_t pos_1, pos_t pos_2,
+                                                       ConnectingGraphScratch& scratch,
+                                                       bool include_terminal_positions = false,
+                                                       bool detect_terminal_cycles = false,
+                                                       bool no_additional_tips = false,
+                                                       bool only_paths = false,
+                                                       bool strict_max_len = false);
 
 }
 }
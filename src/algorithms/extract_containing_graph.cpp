@@ -11,9 +11,12 @@
 namespace vg {
 namespace algorithms {
 
-    void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions,
-                                  const vector<size_t>& forward_search_lengths,
-                                  const vector<size_t>& backward_search_lengths) {
+    /// Do the extraction from any type of graph, following edges with the
+    /// graph's own follow_edges_inline.
+    template <typename Source>
+    static void extract_containing_graph_internal(const Source* source, Graph& g, const vector<pos_t>& positions,
+                                                  const vector<size_t>& forward_search_lengths,
+                                                  const vector<size_t>& backward_search_lengths) {
         
         if (forward_search_lengths.size() != backward_search_lengths.size()
             || forward_search_lengths.size() != positions.size()) {
@@ -95,7 +98,7 @@ namespace algorithms {
             // mark the node as traversed
             traversed.emplace(trav.handle);
             
-            source->follow_edges(trav.handle, false, [&](const handle_t& next) {
+            source->follow_edges_inline(trav.handle, false, [&](const handle_t& next) {
                 // Look locally right from this position
                 
                 // Get the ID of where we're going.
@@ -118,6 +121,7 @@ namespace algorithms {
                     // we can add more nodes along same path without going over the max length
                     queue.emplace(next, dist_thru);
                 }
+                return true;
             });
         }
         
@@ -131,6 +135,24 @@ namespace algorithms {
         }
     }
 
+    void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions,
+                                  const vector<size_t>& forward_search_lengths,
+                                  const vector<size_t>& backward_search_lengths) {
+        return extract_containing_graph_internal(source, g, positions, forward_search_lengths, backward_search_lengths);
+    }
+
+    void extract_containing_graph(const VG* source, Graph& g, const vector<pos_t>& positions,
+                                  const vector<size_t>& forward_search_lengths,
+                                  const vector<size_t>& backward_search_lengths) {
+        return extract_containing_graph_internal(source, g, positions, forward_search_lengths, backward_search_lengths);
+    }
+
+    void extract_containing_graph(const xg::XG* source, Graph& g, const vector<pos_t>& positions,
+                                  const vector<size_t>& forward_search_lengths,
+                                  const vector<size_t>& backward_search_lengths) {
+        return extract_containing_graph_internal(source, g, positions, forward_search_lengths, backward_search_lengths);
+    }
+
     void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions, size_t max_dist) {
         
         // make a dummy vector for all positions at the same distance
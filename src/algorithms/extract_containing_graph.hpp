@@ -45,6 +45,16 @@ namespace algorithms {
     void extract_containing_graph(const HandleGraph* source, Graph& g, const vector<pos_t>& positions,
                                   const vector<size_t>& position_forward_max_dist,
                                   const vector<size_t>& position_backward_max_dist);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    void extract_containing_graph(const VG* source, Graph& g, const vector<pos_t>& positions,
+                                  const vector<size_t>& position_forward_max_dist,
+                                  const vector<size_t>& position_backward_max_dist);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    void extract_containing_graph(const xg::XG* source, Graph& g, const vector<pos_t>& positions,
+                                  const vector<size_t>& position_forward_max_dist,
+                                  const vector<size_t>& position_backward_max_dist);
 
 }
 }
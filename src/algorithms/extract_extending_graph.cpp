@@ -6,13 +6,19 @@
  
 #include "extract_extending_graph.hpp"
 
+#include "../vg.hpp"
+#include "../xg.hpp"
+
 //#define debug_vg_algorithms
 
 namespace vg {
 namespace algorithms {
 
-    unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Graph& g, int64_t max_dist, pos_t pos,
-                                                      bool backward, bool preserve_cycles_on_src) {
+    /// Do the extraction from any type of graph, following edges with the
+    /// graph's own follow_edges_inline.
+    template <typename Source>
+    static unordered_map<id_t, id_t> extract_extending_graph_internal(const Source* source, Graph& g, int64_t max_dist, pos_t pos,
+                                                                      bool backward, bool preserve_cycles_on_src) {
         
         if (g.node_size() || g.edge_size()) {
             cerr << "error:[extract_extending_graph] must extract into an empty graph" << endl;
@@ -93,7 +99,7 @@ namespace algorithms {
             traversed.emplace(trav.handle);
             
             // Now go out the right local side
-            source->follow_edges(trav.handle, false, [&](const handle_t& next) {
+            source->follow_edges_inline(trav.handle, false, [&](const handle_t& next) {
                 // For each next handle...
                 
 #ifdef debug_vg_algorithms
@@ -132,6 +138,7 @@ namespace algorithms {
                         << (source->get_is_reverse(next) ? "-" : "+") << " at dist " << dist_thru << endl;
 #endif
                 }
+                return true;
             });
         }
         
@@ -252,5 +259,20 @@ namespace algorithms {
         
         return id_trans;
     }
+
+    unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Graph& g, int64_t max_dist, pos_t pos,
+                                                      bool backward, bool preserve_cycles_on_src) {
+        return extract_extending_graph_internal(source, g, max_dist, pos, backward, preserve_cycles_on_src);
+    }
+
+    unordered_map<id_t, id_t> extract_extending_graph(const VG* source, Graph& g, int64_t max_dist, pos_t pos,
+                                                      bool backward, bool preserve_cycles_on_src) {
+        return extract_extending_graph_internal(source, g, max_dist, pos, backward, preserve_cycles_on_src);
+    }
+
+    unordered_map<id_t, id_t> extract_extending_graph(const xg::XG* source, Graph& g, int64_t max_dist, pos_t pos,
+                                                      bool backward, bool preserve_cycles_on_src) {
+        return extract_extending_graph_internal(source, g, max_dist, pos, backward, preserve_cycles_on_src);
+    }
 }
 }
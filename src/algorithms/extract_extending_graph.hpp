@@ -15,7 +15,14 @@
 #include "../hash_map.hpp"
 #include "../handle.hpp"
 
+namespace xg {
+class XG;
+}
+
 namespace vg {
+
+class VG;
+
 namespace algorithms {
     
     /// Fills graph g with the subgraph of the handle graph source that extends in one direction from a given
@@ -31,6 +38,14 @@ namespace algorithms {
     ///  preserve_cycles_on_src  if necessary, duplicate starting node to preserve cycles after cutting it
     unordered_map<id_t, id_t> extract_extending_graph(const HandleGraph* source, Graph& g, int64_t max_dist, pos_t pos,
                                                       bool backward, bool preserve_cycles_on_src);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    unordered_map<id_t, id_t> extract_extending_graph(const VG* source, Graph& g, int64_t max_dist, pos_t pos,
+                                                      bool backward, bool preserve_cycles_on_src);
+    
+    /// Same as above, but follows edges without any virtual calls.
+    unordered_map<id_t, id_t> extract_extending_graph(const xg::XG* source, Graph& g, int64_t max_dist, pos_t pos,
+                                                      bool backward, bool preserve_cycles_on_src);
                                                       
 }
 }
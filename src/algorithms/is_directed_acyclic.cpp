@@ -1,6 +1,7 @@
 #include "is_directed_acyclic.hpp"
+#include "node_ranks.hpp"
 
-#include <unordered_map>
+#include <algorithm>
 
 namespace vg {
 namespace algorithms {
@@ -12,8 +13,21 @@ bool is_directed_acyclic(const HandleGraph* graph) {
     // entries from tips until either we've cleaned up all the nodes or there
     // are only directed cycles left.
 
-    // Build the degrees map
-    unordered_map<id_t, pair<int64_t, int64_t>> degrees;
+    // Number the nodes so we can keep the degrees in vectors
+    vector<id_t> ids;
+    ids.reserve(graph->node_size());
+    graph->for_each_handle([&](const handle_t& here) {
+        ids.push_back(graph->get_id(here));
+    });
+    std::sort(ids.begin(), ids.end());
+    NodeRanks ranks(ids);
+
+    // Build the degrees table
+    vector<pair<int64_t, int64_t>> degrees(ranks.size());
+    // And the flags for the nodes we have cleaned up, which start set for the
+    // ranks that aren't nodes
+    vector<bool> done(ranks.size(), true);
+    size_t remaining = ids.size();
     // And also the stack of tips to start at
     vector<handle_t> stack;
     graph->for_each_handle([&](const handle_t& here) {
@@ -27,7 +41,9 @@ bool is_directed_acyclic(const HandleGraph* graph) {
             end_degree++;
         });
     
-        degrees[graph->get_id(here)] = make_pair(start_degree, end_degree);
+        size_t rank = ranks.rank(graph->get_id(here));
+        degrees[rank] = make_pair(start_degree, end_degree);
+        done[rank] = false;
         
         if (start_degree == 0) {
             // Tip looking forward
@@ -45,21 +61,22 @@ bool is_directed_acyclic(const HandleGraph* graph) {
         handle_t here = stack.back();
         stack.pop_back();
         
-        auto iter = degrees.find(graph->get_id(here));
-        if (iter == degrees.end()) {
+        size_t rank = ranks.rank(graph->get_id(here));
+        if (done[rank]) {
             // Already processed
             continue;
         }
         
-        degrees.erase(iter);
+        done[rank] = true;
+        remaining--;
         
         graph->follow_edges(here, false, [&](const handle_t& next) {
-            auto next_iter = degrees.find(graph->get_id(next));
-            if (next_iter != degrees.end()) {
+            size_t next_rank = ranks.rank(graph->get_id(next));
+            if (!done[next_rank]) {
                 // We have a node next that we haven't finished yet
                 
                 // Reduce its degree on the appropriate side.
-                int64_t& in_degree = graph->get_is_reverse(next) ? next_iter->second.second : next_iter->second.first;
+                int64_t& in_degree = graph->get_is_reverse(next) ? degrees[next_rank].second : degrees[next_rank].first;
                 in_degree--;
                 if (in_degree == 0) {
                     // This is a new tip in this orientation
@@ -70,7 +87,7 @@ bool is_directed_acyclic(const HandleGraph* graph) {
     }
     
     // If we clean up the whole graph, it must have been directed-acyclic.
-    return degrees.empty();
+    return remaining == 0;
 }
 
 }
@@ -0,0 +1,75 @@
+#ifndef VG_ALGORITHMS_NODE_RANKS_HPP_INCLUDED
+#define VG_ALGORITHMS_NODE_RANKS_HPP_INCLUDED
+
+/**
+ * \file node_ranks.hpp
+ *
+ * Defines a dense numbering of a set of node IDs, for algorithms that want to
+ * keep their per-node state in vectors instead of hash tables.
+ */
+
+#include "../handle.hpp"
+#include "../hash_map.hpp"
+
+#include <vector>
+
+namespace vg {
+namespace algorithms {
+
+using namespace std;
+
+/**
+ * Numbers a set of node IDs densely and in ID order. When the IDs are compact
+ * (they fill at least half of the range between the smallest and largest),
+ * the rank is just the offset from the smallest ID and some ranks may not
+ * belong to any node. Otherwise the ranks are looked up in a hash table that
+ * is built once.
+ */
+class NodeRanks {
+public:
+    /// Number the given IDs, which must be sorted and distinct
+    inline NodeRanks(const vector<id_t>& sorted_ids);
+
+    /// Get how big a vector indexed by rank needs to be
+    inline size_t size() const;
+
+    /// Get the rank of one of the IDs
+    inline size_t rank(id_t id) const;
+
+private:
+    id_t min_id = 0;
+    size_t num_ranks = 0;
+    bool compact = true;
+    hash_map<id_t, size_t> ranks;
+};
+
+inline NodeRanks::NodeRanks(const vector<id_t>& sorted_ids) {
+    if (sorted_ids.empty()) {
+        return;
+    }
+    min_id = sorted_ids.front();
+    size_t id_range = sorted_ids.back() - sorted_ids.front() + 1;
+    if (id_range <= 2 * sorted_ids.size()) {
+        num_ranks = id_range;
+    }
+    else {
+        compact = false;
+        num_ranks = sorted_ids.size();
+        for (size_t i = 0; i < sorted_ids.size(); i++) {
+            ranks[sorted_ids[i]] = i;
+        }
+    }
+}
+
+inline size_t NodeRanks::size() const {
+    return num_ranks;
+}
+
+inline size_t NodeRanks::rank(id_t id) const {
+    return compact ? id - min_id : ranks.find(id)->second;
+}
+
+}
+}
+
+#endif
@@ -1,17 +1,27 @@
 #include "topological_sort.hpp"
+#include "node_ranks.hpp"
+#include "weakly_connected_components.hpp"
+
+#include "../vg.hpp"
+#include "../xg.hpp"
+
+#include <algorithm>
 
 namespace vg {
 namespace algorithms {
 
 using namespace std;
 
-vector<handle_t> head_nodes(const HandleGraph* g) {
+/// Find the heads in any type of graph, following edges with the graph's own
+/// follow_edges_inline.
+template <typename Graph>
+static vector<handle_t> head_nodes_internal(const Graph* g) {
     vector<handle_t> to_return;
     g->for_each_handle([&](const handle_t& found) {
         // For each (locally forward) node
         
         bool no_left_edges = true;
-        g->follow_edges(found, true, [&](const handle_t& ignored) {
+        g->follow_edges_inline(found, true, [&](const handle_t& ignored) {
             // We found a left edge!
             no_left_edges = false;
             // We only need one
@@ -27,13 +37,16 @@ vector<handle_t> head_nodes(const HandleGraph* g) {
     
 }
 
-vector<handle_t> tail_nodes(const HandleGraph* g) {
+/// Find the tails in any type of graph, following edges with the graph's own
+/// follow_edges_inline.
+template <typename Graph>
+static vector<handle_t> tail_nodes_internal(const Graph* g) {
     vector<handle_t> to_return;
     g->for_each_handle([&](const handle_t& found) {
         // For each (locally forward) node
         
         bool no_right_edges = true;
-        g->follow_edges(found, false, [&](const handle_t& ignored) {
+        g->follow_edges_inline(found, false, [&](const handle_t& ignored) {
             // We found a right edge!
             no_right_edges = false;
             // We only need one
@@ -49,88 +62,154 @@ vector<handle_t> tail_nodes(const HandleGraph* g) {
     
 }
 
-vector<handle_t> topological_sort(const HandleGraph* g) {
+vector<handle_t> head_nodes(const HandleGraph* g) {
+    return head_nodes_internal(g);
+}
+
+vector<handle_t> tail_nodes(const HandleGraph* g) {
+    return tail_nodes_internal(g);
+}
+
+/// Get the handles of all the nodes of a graph, locally forward and in ID order
+template <typename Graph>
+static vector<handle_t> nodes_in_id_order(const Graph* g) {
+    vector<handle_t> nodes;
+    nodes.reserve(g->node_size());
+    g->for_each_handle([&](const handle_t& found) {
+        nodes.push_back(g->forward(found));
+    });
+    std::sort(nodes.begin(), nodes.end(), [&](const handle_t& a, const handle_t& b) {
+        return g->get_id(a) < g->get_id(b);
+    });
+    return nodes;
+}
+
+/// Topologically sort the given nodes, which must be locally forward, in ID
+/// order, and make up a set of whole components of the graph, in any type of
+/// graph, following edges with the graph's own follow_edges_inline.
+template <typename Graph>
+static vector<handle_t> topological_sort_internal(const Graph* g, const vector<handle_t>& nodes) {
     
     // Make a vector to hold the ordered and oriented nodes.
     vector<handle_t> sorted;
-    sorted.reserve(g->node_size());
+    sorted.reserve(nodes.size());
+    
+    if (nodes.empty()) {
+        return sorted;
+    }
+    
+    // Number the nodes so we can keep track of them in vectors.
+    vector<id_t> ids;
+    ids.reserve(nodes.size());
+    for (auto& node : nodes) {
+        ids.push_back(g->get_id(node));
+    }
+    NodeRanks ranks(ids);
     
     // Instead of actually removing edges, we add them to this set of masked edges.
     unordered_set<pair<handle_t, handle_t>> masked_edges;
     
-    // This (s) is our set of oriented nodes.
-    // using a map instead of a set ensures a stable sort across different systems
-    map<id_t, handle_t> s;
-
-    // We find the head and tails, if there are any
-    vector<handle_t> heads{head_nodes(g)};
-    // No need to fetch the tails since we don't use them
-
-    
-    // Maps from node ID to first orientation we suggested for it.
-    map<id_t, handle_t> seeds;
+    // Heaps of oriented nodes come out smallest ID first, which ensures a
+    // stable sort across different systems
+    auto later_id = [](const pair<id_t, handle_t>& a, const pair<id_t, handle_t>& b) {
+        return a.first > b.first;
+    };
+    auto push = [&](vector<pair<id_t, handle_t>>& heap, const handle_t& handle) {
+        heap.emplace_back(g->get_id(handle), handle);
+        push_heap(heap.begin(), heap.end(), later_id);
+    };
+    auto pop = [&](vector<pair<id_t, handle_t>>& heap) {
+        pop_heap(heap.begin(), heap.end(), later_id);
+        handle_t handle = heap.back().second;
+        heap.pop_back();
+        return handle;
+    };
     
+    // This (s) is our set of oriented nodes.
+    vector<pair<id_t, handle_t>> s;
     
-    for(handle_t& head : heads) {
-        // Dump all the heads into the oriented set, rather than having them as
-        // seeds. We will only go for cycle-breaking seeds when we run out of
-        // heads. This is bad for contiguity/ordering consistency in cyclic
-        // graphs and reversing graphs, but makes sure we work out to just
-        // topological sort on DAGs. It mimics the effect we used to get when we
-        // joined all the head nodes to a new root head node and seeded that. We
-        // ignore tails since we only orient right from nodes we pick.
-        s[g->get_id(head)] = head;
+    // We will track the nodes we have not visited yet by rank. Since nodes
+    // only ever get visited, the first unvisited node in ID order is always
+    // at or after a cursor into the node list.
+    vector<bool> unvisited(ranks.size(), false);
+    for (auto& id : ids) {
+        unvisited[ranks.rank(id)] = true;
     }
-
-    // We will use an ordered map handles by ID for nodes we have not visited
-    // yet. This ensures a consistent sort order across systems.
-    map<id_t, handle_t> unvisited;
-    g->for_each_handle([&](const handle_t& found) {
-        if (!s.count(g->get_id(found))) {
-            // Only nodes that aren't yet in s are unvisited.
-            // Nodes in s are visited but just need to be added tot he ordering.
-            unvisited.emplace(g->get_id(found), found);
+    size_t unvisited_count = nodes.size();
+    size_t first_unvisited = 0;
+    
+    // We find the head and tails, if there are any
+    for (auto& node : nodes) {
+        bool no_left_edges = true;
+        g->follow_edges_inline(node, true, [&](const handle_t& ignored) {
+            // We found a left edge!
+            no_left_edges = false;
+            // We only need one
+            return false;
+        });
+        
+        if (no_left_edges) {
+            // Dump all the heads into the oriented set, rather than having them as
+            // seeds. We will only go for cycle-breaking seeds when we run out of
+            // heads. This is bad for contiguity/ordering consistency in cyclic
+            // graphs and reversing graphs, but makes sure we work out to just
+            // topological sort on DAGs. It mimics the effect we used to get when we
+            // joined all the head nodes to a new root head node and seeded that. We
+            // ignore tails since we only orient right from nodes we pick.
+            push(s, node);
+            // Nodes in s are visited but just need to be added to the ordering.
+            unvisited[ranks.rank(g->get_id(node))] = false;
+            unvisited_count--;
         }
-    });
-
-    while(!unvisited.empty() || !s.empty()) {
+    }
+    
+    // The first orientation we suggested for each node, as a heap, and which
+    // nodes we have suggested.
+    vector<pair<id_t, handle_t>> seeds;
+    vector<bool> seeded(ranks.size(), false);
+    
+    while(unvisited_count > 0 || !s.empty()) {
 
         // Put something in s. First go through seeds until we can find one
         // that's not already oriented.
         while(s.empty() && !seeds.empty()) {
-            // Look at the first seed
-            auto first_seed = (*seeds.begin()).second;
+            // Look at the first seed, and whether we use it or not, don't keep it around
+            auto first_seed = pop(seeds);
+            size_t seed_rank = ranks.rank(g->get_id(first_seed));
 
-            if(unvisited.count(g->get_id(first_seed))) {
+            if(unvisited[seed_rank]) {
                 // We have an unvisited seed. Use it
 #ifdef debug
 #pragma omp critical (cerr)
                 cerr << "Starting from seed " << g->get_id(first_seed) << " orientation " << g->get_is_reverse(first_seed) << endl;
 #endif
 
-                s[g->get_id(first_seed)] = first_seed;
-                unvisited.erase(g->get_id(first_seed));
+                push(s, first_seed);
+                unvisited[seed_rank] = false;
+                unvisited_count--;
             }
-            // Whether we used the seed or not, don't keep it around
-            seeds.erase(seeds.begin());
         }
 
         if(s.empty()) {
             // If we couldn't find a seed, just grab any old node.
-            // Since map order is stable across systems, we can take the first node by id and put it locally forward.
+            // Since ranks are in ID order, we can take the first node by id and put it locally forward.
+            while (!unvisited[ranks.rank(ids[first_unvisited])]) {
+                first_unvisited++;
+            }
+            handle_t arbitrary = nodes[first_unvisited];
 #ifdef debug
 #pragma omp critical (cerr)
-            cerr << "Starting from arbitrary node " << unvisited.begin()->first << " locally forward" << endl;
+            cerr << "Starting from arbitrary node " << g->get_id(arbitrary) << " locally forward" << endl;
 #endif
 
-            s[unvisited.begin()->first] = unvisited.begin()->second;
-            unvisited.erase(unvisited.begin()->first);
+            push(s, arbitrary);
+            unvisited[ranks.rank(ids[first_unvisited])] = false;
+            unvisited_count--;
         }
 
         while (!s.empty()) {
             // Grab an oriented node
-            auto n = s.begin()->second;
-            s.erase(g->get_id(n));
+            auto n = pop(s);
             // Emit it
             sorted.push_back(n);
 #ifdef debug
@@ -142,13 +221,13 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
             // where both were picked as places to break into cycles. A
             // reversing self loop on a cycle entry point is a special case of
             // this.
-            g->follow_edges(n, true, [&](const handle_t& prev_node) {
-                if(!unvisited.count(g->get_id(prev_node))) {
+            g->follow_edges_inline(n, true, [&](const handle_t& prev_node) {
+                if(!unvisited[ranks.rank(g->get_id(prev_node))]) {
                     // Look at the edge
                     auto edge = g->edge_handle(prev_node, n);
                     if (masked_edges.count(edge)) {
                         // We removed this edge, so skip it.
-                        return;
+                        return true;
                     }
                     
 #ifdef debug
@@ -166,18 +245,19 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
                         << " -> " << g->get_id(edge.second) << " " << g->get_is_reverse(edge.second) << endl;
 #endif
                 }
+                return true;
             });
 
             // All other connections and self loops are handled by looking off the right side.
 
             // See what all comes next, minus deleted edges.
-            g->follow_edges(n, false, [&](const handle_t& next_node) {
+            g->follow_edges_inline(n, false, [&](const handle_t& next_node) {
 
                 // Look at the edge
                 auto edge = g->edge_handle(n, next_node);
                 if (masked_edges.count(edge)) {
                     // We removed this edge, so skip it.
-                    return;
+                    return true;
                 }
 
 #ifdef debug
@@ -197,7 +277,8 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
                 // Mask the edge
                 masked_edges.insert(edge);
 
-                if(unvisited.count(g->get_id(next_node))) {
+                size_t next_rank = ranks.rank(g->get_id(next_node));
+                if(unvisited[next_rank]) {
                     // We haven't already started here as an arbitrary cycle entry point
 
 #ifdef debug
@@ -206,7 +287,7 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
 #endif
 
                     bool unmasked_incoming_edge = false;
-                    g->follow_edges(next_node, true, [&](const handle_t& prev_node) {
+                    g->follow_edges_inline(next_node, true, [&](const handle_t& prev_node) {
                         // Get a handle for each incoming edge
                         auto prev_edge = g->edge_handle(prev_node, next_node);
                         
@@ -226,18 +307,20 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
                         cerr << "\t\t\tIs last incoming edge" << endl;
 #endif
                         // Keep this orientation and put it here
-                        s[g->get_id(next_node)] = next_node;
+                        push(s, next_node);
                         // Remember that we've visited and oriented this node, so we
                         // don't need to use it as a seed.
-                        unvisited.erase(g->get_id(next_node));
+                        unvisited[next_rank] = false;
+                        unvisited_count--;
 
-                    } else if(!seeds.count(g->get_id(next_node))) {
+                    } else if(!seeded[next_rank]) {
                         // We came to this node in this orientation; when we need a
                         // new node and orientation to start from (i.e. an entry
                         // point to the node's cycle), we might as well pick this
                         // one.
                         // Only take it if we don't already know of an orientation for this node.
-                        seeds[g->get_id(next_node)] = next_node;
+                        push(seeds, next_node);
+                        seeded[next_rank] = true;
 
 #ifdef debug
 #pragma omp critical (cerr)
@@ -250,6 +333,7 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
                     cerr << "\t\tAnd node was already visited (to break a cycle)" << endl;
 #endif
                 }
+                return true;
             });
         }
     }
@@ -259,7 +343,45 @@ vector<handle_t> topological_sort(const HandleGraph* g) {
 
 }
 
-void sort(MutableHandleGraph* g) {
+vector<handle_t> topological_sort(const HandleGraph* g) {
+    return topological_sort_internal(g, nodes_in_id_order(g));
+}
+
+vector<handle_t> topological_sort(const VG* g) {
+    return topological_sort_internal(g, nodes_in_id_order(g));
+}
+
+vector<handle_t> topological_sort(const xg::XG* g) {
+    return topological_sort_internal(g, nodes_in_id_order(g));
+}
+
+vector<handle_t> topological_sort_by_component(const HandleGraph* g) {
+    
+    // Get the nodes of each component in ID order, with the components in
+    // order by their smallest IDs
+    WeakComponents component_ranks = weakly_connected_component_ranks(g);
+    vector<vector<handle_t>> components(component_ranks.component_count);
+    for (auto& id : component_ranks.ids) {
+        components[component_ranks.component(id)].push_back(g->get_handle(id));
+    }
+    
+    // Sort them all at once
+    vector<vector<handle_t>> sorted_components(components.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < components.size(); i++) {
+        sorted_components[i] = topological_sort_internal(g, components[i]);
+    }
+    
+    // And glue the sorts together
+    vector<handle_t> sorted;
+    sorted.reserve(g->node_size());
+    for (auto& sorted_component : sorted_components) {
+        sorted.insert(sorted.end(), sorted_component.begin(), sorted_component.end());
+    }
+    return sorted;
+}
+
+void sort(MutableHandleGraph* g, bool by_component) {
     if (g->node_size() <= 1) {
         // A graph with <2 nodes has only one sort.
         return;
@@ -268,7 +390,7 @@ void sort(MutableHandleGraph* g) {
     // No need to modify the graph; topological_sort is guaranteed to be stable.
     
     // Topologically sort, which orders and orients all the nodes.
-    vector<handle_t> sorted = topological_sort(g);
+    vector<handle_t> sorted = by_component ? topological_sort_by_component(g) : topological_sort(g);
     
     size_t index = 0;
     g->for_each_handle([&](const handle_t& at_index) {
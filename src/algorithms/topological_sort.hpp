@@ -15,7 +15,14 @@
 #include "../hash_map.hpp"
 #include "../handle.hpp"
 
+namespace xg {
+class XG;
+}
+
 namespace vg {
+
+class VG;
+
 namespace algorithms {
 
 using namespace std;
@@ -57,11 +64,27 @@ vector<handle_t> tail_nodes(const HandleGraph* g);
  */
 vector<handle_t> topological_sort(const HandleGraph* g);
 
+/// Same as above, but follows edges without any virtual calls.
+vector<handle_t> topological_sort(const VG* g);
+
+/// Same as above, but follows edges without any virtual calls.
+vector<handle_t> topological_sort(const xg::XG* g);
+
+/**
+ * Topologically sort each weakly connected component of the given handle
+ * graph on its own, in parallel, and concatenate the sorts, with components in
+ * order of their smallest node IDs. Each component comes out the same as it
+ * would from a topological sort of just that component, which is not in
+ * general the same as its part of a sort of the whole graph.
+ */
+vector<handle_t> topological_sort_by_component(const HandleGraph* g);
+
 /**
  * Topologically sort the given handle graph, and then apply that sort to re-
- * order the nodes of the graph. The sort is guaranteed to be stable.
+ * order the nodes of the graph. The sort is guaranteed to be stable. If
+ * by_component is set, uses topological_sort_by_component.
  */
-void sort(MutableHandleGraph* g);
+void sort(MutableHandleGraph* g, bool by_component = false);
 
 /**
  * Topologically sort the given handle graph, and then apply that sort to orient
@@ -1,54 +1,142 @@
 #include "weakly_connected_components.hpp"
 
+#include "../vg.hpp"
+#include "../xg.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
 namespace vg {
 namespace algorithms {
 
 using namespace std;
 
-vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph) {
-    vector<unordered_set<id_t>> to_return;
+WeakComponents::WeakComponents(const vector<id_t>& sorted_ids) : ids(sorted_ids), ranks(sorted_ids) {
+    // Nothing to do
+}
+
+/// Find the root of the set containing the given rank, halving the path to it
+/// as we go. Safe to run concurrently with itself and with link_sets.
+static size_t find_set(vector<atomic<size_t>>& parent, size_t rank) {
+    while (true) {
+        size_t up = parent[rank].load();
+        if (up == rank) {
+            return rank;
+        }
+        size_t up_up = parent[up].load();
+        if (up != up_up) {
+            // Point past our parent. If someone else moved it first, that's fine.
+            parent[rank].compare_exchange_weak(up, up_up);
+        }
+        rank = up_up;
+    }
+}
+
+/// Merge the sets containing the two given ranks. The root with the larger
+/// rank always goes under the one with the smaller rank, so concurrent links
+/// can't make a cycle, and each root is the member with the smallest ID.
+static void link_sets(vector<atomic<size_t>>& parent, size_t a, size_t b) {
+    while (true) {
+        a = find_set(parent, a);
+        b = find_set(parent, b);
+        if (a == b) {
+            return;
+        }
+        if (a < b) {
+            swap(a, b);
+        }
+        size_t expected = a;
+        if (parent[a].compare_exchange_strong(expected, b)) {
+            return;
+        }
+        // Otherwise a stopped being a root while we were looking, so try again.
+    }
+}
+
+/// Find weakly connected components in any type of graph, following edges
+/// with the graph's own follow_edges_inline.
+template <typename Graph>
+static WeakComponents weakly_connected_component_ranks_internal(const Graph* graph) {
     
-    // This only holds locally forward handles
-    unordered_set<handle_t> traversed;
+    // Number the nodes
+    vector<id_t> ids;
+    ids.reserve(graph->node_size());
+    graph->for_each_handle([&](const handle_t& handle) {
+        ids.push_back(graph->get_id(handle));
+    });
+    std::sort(ids.begin(), ids.end());
+    WeakComponents to_return(ids);
+    const NodeRanks& ranks = to_return.ranks;
     
+    // Everything starts out in its own set
+    vector<atomic<size_t>> parent(ranks.size());
+    for (size_t i = 0; i < parent.size(); i++) {
+        parent[i].store(i, memory_order_relaxed);
+    }
+    
+    // Union across all the edges, in parallel
     graph->for_each_handle([&](const handle_t& handle) {
-        
-        // Only think about it in the forward orientation
-        auto forward = graph->forward(handle);
-        
-        if (traversed.count(forward)) {
-            // Already have this node, so don't start a search from it.
-            return;
+        size_t here = ranks.rank(graph->get_id(handle));
+        auto handle_other = [&](const handle_t& other) {
+            link_sets(parent, here, ranks.rank(graph->get_id(other)));
+            return true;
+        };
+        graph->follow_edges_inline(handle, false, handle_other);
+        graph->follow_edges_inline(handle, true, handle_other);
+    }, true);
+    
+    // Number the components. Each root is its component's first node in ID
+    // order, so it will already be numbered when we get to the other members.
+    to_return.component_of_rank.resize(ranks.size(), numeric_limits<size_t>::max());
+    for (auto& id : to_return.ids) {
+        size_t rank = ranks.rank(id);
+        size_t root = find_set(parent, rank);
+        if (root == rank) {
+            to_return.component_of_rank[rank] = to_return.component_count++;
         }
-        
-        // The stack only holds locally forward handles
-        vector<handle_t> stack{forward};
-        to_return.emplace_back();
-        while (!stack.empty()) {
-            handle_t here = stack.back();
-            stack.pop_back();
-            
-            traversed.insert(here);
-            to_return.back().insert(graph->get_id(here));
-            
-            // We have a function to handle all connected handles
-            auto handle_other = [&](const handle_t& other) {
-                // Again, make it forward
-                auto other_forward = graph->forward(other);
-                
-                if (!traversed.count(other_forward)) {
-                    stack.push_back(other_forward);
-                }
-            };
-            
-            // Look at edges in both directions
-            graph->follow_edges(here, false, handle_other);
-            graph->follow_edges(here, true, handle_other);
-            
+        else {
+            to_return.component_of_rank[rank] = to_return.component_of_rank[root];
         }
-    });
+    }
+    
     return to_return;
 }
 
+WeakComponents weakly_connected_component_ranks(const HandleGraph* graph) {
+    return weakly_connected_component_ranks_internal(graph);
+}
+
+WeakComponents weakly_connected_component_ranks(const VG* graph) {
+    return weakly_connected_component_ranks_internal(graph);
+}
+
+WeakComponents weakly_connected_component_ranks(const xg::XG* graph) {
+    return weakly_connected_component_ranks_internal(graph);
+}
+
+/// Collect the components of any type of graph into sets of IDs
+template <typename Graph>
+static vector<unordered_set<id_t>> weakly_connected_components_internal(const Graph* graph) {
+    WeakComponents components = weakly_connected_component_ranks(graph);
+    vector<unordered_set<id_t>> to_return(components.component_count);
+    for (auto& id : components.ids) {
+        to_return[components.component(id)].insert(id);
+    }
+    return to_return;
+}
+
+vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph) {
+    return weakly_connected_components_internal(graph);
+}
+
+vector<unordered_set<id_t>> weakly_connected_components(const VG* graph) {
+    return weakly_connected_components_internal(graph);
+}
+
+vector<unordered_set<id_t>> weakly_connected_components(const xg::XG* graph) {
+    return weakly_connected_components_internal(graph);
+}
+
 }
 }
@@ -8,22 +8,74 @@
  */
 
 #include "../handle.hpp"
+#include "node_ranks.hpp"
 
 #include <unordered_set>
 #include <vector>
 
+namespace xg {
+class XG;
+}
+
 namespace vg {
+
+class VG;
+
 namespace algorithms {
 
 using namespace std;
 
+/**
+ * Assignment of the nodes of a graph to weakly connected components, kept in
+ * a vector indexed by node rank. Components are numbered from 0 in order of
+ * their smallest node IDs.
+ */
+struct WeakComponents {
+    /// Set up to number the components of the given IDs, which must be
+    /// sorted and distinct
+    WeakComponents(const vector<id_t>& sorted_ids);
+    
+    /// All the node IDs, in order
+    vector<id_t> ids;
+    /// The numbering of the nodes
+    NodeRanks ranks;
+    /// The component of the node at each rank, or numeric_limits<size_t>::max()
+    /// for ranks that aren't nodes
+    vector<size_t> component_of_rank;
+    /// The number of components
+    size_t component_count = 0;
+    
+    /// Get the component of the node with the given ID
+    inline size_t component(id_t id) const {
+        return component_of_rank[ranks.rank(id)];
+    }
+};
+
+/// Find the weakly connected components of a graph with a concurrent
+/// union-find over node ranks, following edges from all the nodes in
+/// parallel.
+WeakComponents weakly_connected_component_ranks(const HandleGraph* graph);
+
+/// Same as above, but follows edges without any virtual calls.
+WeakComponents weakly_connected_component_ranks(const VG* graph);
+
+/// Same as above, but follows edges without any virtual calls.
+WeakComponents weakly_connected_component_ranks(const xg::XG* graph);
+
 /// Returns sets of IDs defining components that are connected by any series
 /// of nodes and edges, even if it is not a valid bidirected walk. TODO: It
 /// might make sense to have a handle-returning version, but the consumers of
 /// weakly connected components right now want IDs, and membership in a weakly
-/// connected component is orientation-independent.
+/// connected component is orientation-independent. Components come in order
+/// of their smallest node IDs.
 vector<unordered_set<id_t>> weakly_connected_components(const HandleGraph* graph);
 
+/// Same as above, but follows edges without any virtual calls.
+vector<unordered_set<id_t>> weakly_connected_components(const VG* graph);
+
+/// Same as above, but follows edges without any virtual calls.
+vector<unordered_set<id_t>> weakly_connected_components(const xg::XG* graph);
+
 
 }
 }
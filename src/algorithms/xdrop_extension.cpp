@@ -0,0 +1,175 @@
+/**
+ * \file xdrop_extension.cpp
+ *
+ * Implementation for the xdrop_extend_ungapped algorithm.
+ */
+
+#include "xdrop_extension.hpp"
+
+#include "../path.hpp"
+#include "../utility.hpp"
+
+//#define debug_vg_algorithms
+
+namespace vg {
+namespace algorithms {
+
+    UngappedExtension xdrop_extend_ungapped(const HandleGraph* graph, pos_t pos, bool backward,
+                                            const string& sequence, int32_t match, int32_t mismatch,
+                                            int32_t end_bonus, int32_t xdrop, size_t max_segments) {
+
+        UngappedExtension extension;
+        if (sequence.empty()) {
+            return extension;
+        }
+
+        // a backward search is a forward search on the other strand with the reverse complement
+        handle_t start = graph->get_handle(id(pos), is_rev(pos) != backward);
+        size_t start_offset = backward ? graph->get_length(start) - offset(pos) : offset(pos);
+        string read = backward ? reverse_complement(sequence) : sequence;
+
+#ifdef debug_vg_algorithms
+        cerr << "[xdrop_extend_ungapped] extending " << read << " from " << graph->get_id(start) << (graph->get_is_reverse(start) ? "-" : "+") << ":" << start_offset << endl;
+#endif
+
+        // the part of a node traversal that a path in the search aligned to
+        struct Segment {
+            handle_t handle;
+            size_t node_offset;
+            size_t read_offset;
+            int64_t parent;
+        };
+
+        // a path in the search that is waiting to go on into a node traversal
+        struct Frontier {
+            handle_t handle;
+            size_t node_offset;
+            size_t read_offset;
+            int32_t score;
+            int32_t max_score;
+            size_t mismatches;
+            int64_t parent;
+        };
+
+        vector<Segment> segments;
+        vector<Frontier> stack{Frontier{start, start_offset, 0, 0, 0, 0, -1}};
+        // holds node sequences for graphs that can't give us views of them
+        string node_seq_buffer;
+
+        // the segment where the best alignment ends (the empty alignment is in none)
+        int64_t best_segment = -1;
+
+        while (!stack.empty() && extension.complete) {
+            if (segments.size() >= max_segments) {
+                extension.complete = false;
+                break;
+            }
+
+            Frontier here = stack.back();
+            stack.pop_back();
+
+            int64_t segment_idx = segments.size();
+            segments.push_back(Segment{here.handle, here.node_offset, here.read_offset, here.parent});
+
+            sequence_view_t node_seq = graph->view_sequence(here.handle, node_seq_buffer);
+            size_t i = here.node_offset;
+            size_t j = here.read_offset;
+            bool dropped = false;
+            while (i < node_seq.size() && j < read.size()) {
+                if (node_seq[i] == 'N' || read[j] == 'N') {
+                    // the aligners don't score these like mismatches, so we can't vouch for the result
+                    extension.complete = false;
+                    dropped = true;
+                    break;
+                }
+                if (node_seq[i] == read[j]) {
+                    here.score += match;
+                }
+                else {
+                    here.score -= mismatch;
+                    here.mismatches++;
+                }
+                i++;
+                j++;
+
+                int32_t score = here.score + (j == read.size() ? end_bonus : 0);
+                if (score > extension.score) {
+                    extension.score = score;
+                    extension.length = j;
+                    extension.mismatches = here.mismatches;
+                    extension.tied = false;
+                    best_segment = segment_idx;
+                }
+                else if (score == extension.score) {
+                    extension.tied = true;
+                }
+
+                here.max_score = max(here.max_score, here.score);
+                if (here.score < here.max_score - xdrop) {
+                    dropped = true;
+                    break;
+                }
+            }
+
+            if (!dropped && j < read.size()) {
+                // we ran off the end of the node, so go on into all of the next ones
+                graph->follow_edges(here.handle, false, [&](const handle_t& next) {
+                    stack.push_back(Frontier{next, 0, j, here.score, here.max_score, here.mismatches, segment_idx});
+                });
+            }
+        }
+
+#ifdef debug_vg_algorithms
+        cerr << "[xdrop_extend_ungapped] best alignment has length " << extension.length << " and score " << extension.score << " after searching " << segments.size() << " segments" << (extension.tied ? ", tied" : "") << (extension.complete ? "" : ", incomplete") << endl;
+#endif
+
+        // trace the segments of the best alignment back to the start
+        vector<int64_t> trace;
+        for (int64_t segment_idx = best_segment; segment_idx >= 0; segment_idx = segments[segment_idx].parent) {
+            trace.push_back(segment_idx);
+        }
+
+        for (auto iter = trace.rbegin(); iter != trace.rend(); iter++) {
+            const Segment& segment = segments[*iter];
+            size_t read_end = iter + 1 != trace.rend() ? segments[*(iter + 1)].read_offset : extension.length;
+            if (read_end == segment.read_offset) {
+                // we started at the end of a node
+                continue;
+            }
+
+            Mapping* mapping = extension.path.add_mapping();
+            Position* position = mapping->mutable_position();
+            position->set_node_id(graph->get_id(segment.handle));
+            position->set_is_reverse(graph->get_is_reverse(segment.handle));
+            position->set_offset(segment.node_offset);
+
+            sequence_view_t node_seq = graph->view_sequence(segment.handle, node_seq_buffer);
+            Edit* edit = nullptr;
+            bool in_match = false;
+            for (size_t j = segment.read_offset, i = segment.node_offset; j < read_end; j++, i++) {
+                bool is_match = node_seq[i] == read[j];
+                if (edit == nullptr || is_match != in_match) {
+                    edit = mapping->add_edit();
+                    in_match = is_match;
+                }
+                edit->set_from_length(edit->from_length() + 1);
+                edit->set_to_length(edit->to_length() + 1);
+                if (!is_match) {
+                    edit->mutable_sequence()->push_back(read[j]);
+                }
+            }
+        }
+
+        if (backward) {
+            reverse_complement_path_in_place(&extension.path, [&](id_t node_id) {
+                                                 return (int64_t) graph->get_length(graph->get_handle(node_id));
+                                             });
+        }
+        for (size_t i = 0; i < extension.path.mapping_size(); i++) {
+            extension.path.mutable_mapping(i)->set_rank(i + 1);
+        }
+
+        return extension;
+    }
+}
+}
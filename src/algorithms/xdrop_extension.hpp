@@ -0,0 +1,61 @@
+#ifndef VG_ALGORITHMS_XDROP_EXTENSION_HPP_INCLUDED
+#define VG_ALGORITHMS_XDROP_EXTENSION_HPP_INCLUDED
+
+/**
+ * \file xdrop_extension.hpp
+ *
+ * Definitions for the xdrop_extend_ungapped algorithm.
+ */
+
+#include <string>
+
+#include "../position.hpp"
+#include "../vg.pb.h"
+#include "../handle.hpp"
+
+namespace vg {
+namespace algorithms {
+
+    using namespace std;
+
+    /// The best ungapped alignment of a sequence extending from a graph position
+    struct UngappedExtension {
+        /// The aligned part of the sequence, with match and mismatch edits
+        Path path;
+        /// The number of bases of the sequence that were aligned
+        size_t length = 0;
+        /// The number of mismatched bases in the alignment
+        size_t mismatches = 0;
+        /// The ungapped score, including the end bonus if the whole sequence was aligned
+        int32_t score = 0;
+        /// Whether some other place in the search got the same score
+        bool tied = false;
+        /// Whether every ungapped path that stayed within the X-drop was scored. This is
+        /// false if the search hit the segment limit or an N in the sequence or graph.
+        bool complete = true;
+    };
+
+    /// Find the highest scoring ungapped alignment of a sequence that abuts a graph position, looking
+    /// through every path out of the position and giving up on a path once its score falls more than
+    /// xdrop below the best score it has had. The alignment may stop before the end of the sequence,
+    /// in which case the rest is soft-clipped, but it is only given the end bonus if it doesn't stop.
+    ///
+    /// Args:
+    ///  graph         graph to align to
+    ///  pos           the sequence abuts this position
+    ///  backward      if false, the first base of the sequence is aligned at pos, and if true, the
+    ///                last base is aligned just before pos
+    ///  sequence      sequence to align
+    ///  match         score for a matching base
+    ///  mismatch      penalty for a mismatched base
+    ///  end_bonus     score for aligning the whole sequence
+    ///  xdrop         stop following a path when it falls this far below its best score
+    ///  max_segments  stop searching after aligning to this many node traversals
+    UngappedExtension xdrop_extend_ungapped(const HandleGraph* graph, pos_t pos, bool backward,
+                                            const string& sequence, int32_t match, int32_t mismatch,
+                                            int32_t end_bonus, int32_t xdrop, size_t max_segments = 256);
+
+}
+}
+
+#endif
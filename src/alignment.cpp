@@ -2,6 +2,11 @@
 #include "stream.hpp"
 
 #include <regex>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace vg {
 
@@ -10,7 +15,7 @@ int hts_for_each(string& filename, function<void(Alignment&)> lambda) {
     samFile *in = hts_open(filename.c_str(), "r");
     if (in == NULL) return 0;
     bam_hdr_t *hdr = sam_hdr_read(in);
-    map<string, string> rg_sample;
+    unordered_map<string, string> rg_sample;
     parse_rg_sample_map(hdr->text, rg_sample);
     bam1_t *b = bam_init1();
     while (sam_read1(in, hdr, b) >= 0) {
@@ -24,44 +29,6 @@ int hts_for_each(string& filename, function<void(Alignment&)> lambda) {
 
 }
 
-int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda) {
-
-    samFile *in = hts_open(filename.c_str(), "r");
-    if (in == NULL) return 0;
-    bam_hdr_t *hdr = sam_hdr_read(in);
-    map<string, string> rg_sample;
-    parse_rg_sample_map(hdr->text, rg_sample);
-
-    int thread_count = get_thread_count();
-    vector<bam1_t*> bs; bs.resize(thread_count);
-    for (auto& b : bs) {
-        b = bam_init1();
-    }
-
-    bool more_data = true;
-#pragma omp parallel shared(in, hdr, more_data, rg_sample)
-    {
-        int tid = omp_get_thread_num();
-        while (more_data) {
-            bam1_t* b = bs[tid];
-#pragma omp critical (hts_input)
-            if (more_data) {
-                more_data = sam_read1(in, hdr, b) >= 0;
-            }
-            if (more_data) {
-                Alignment a = bam_to_alignment(b, rg_sample);
-                lambda(a);
-            }
-        }
-    }
-
-    for (auto& b : bs) bam_destroy1(b);
-    bam_hdr_destroy(hdr);
-    hts_close(in);
-    return 1;
-
-}
-
 bam_hdr_t* hts_file_header(string& filename, string& header) {
     samFile *in = hts_open(filename.c_str(), "r");
     if (in == NULL) {
@@ -142,67 +109,351 @@ bool get_next_alignment_pair_from_fastqs(gzFile fp1, gzFile fp2, char* buffer, s
 }
 
 
-size_t fastq_unpaired_for_each_parallel(const string& filename, function<void(Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+/// FASTQ text holding whole records, and where each record starts. Record i
+/// runs from record_starts[i] up to record_starts[i + 1].
+struct FastqTextBatch {
+    string text;
+    vector<size_t> record_starts;
+    
+    size_t size() const {
+        return record_starts.empty() ? 0 : record_starts.size() - 1;
+    }
+};
+
+/**
+ * Reads a possibly gzipped FASTQ file in big blocks, which a background thread
+ * decompresses ahead of the reader. Hands out batches of whole records as
+ * text, so the records can be parsed on whichever threads process them.
+ * Records must be 4 lines long.
+ */
+class FastqBlockReader {
+public:
+    FastqBlockReader(const string& filename) : filename(filename) {
+        fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
+        if (!fp) {
+            cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
+        }
+        gzbuffer(fp, BLOCK_SIZE);
+        decompressor = thread(&FastqBlockReader::decompress, this);
     }
-    size_t len = 2 << 18; // 256k
-    size_t nLines = 0;
+    
+    ~FastqBlockReader() {
+        {
+            lock_guard<mutex> lock(blocks_mutex);
+            stopping = true;
+        }
+        block_taken.notify_all();
+        decompressor.join();
+        gzclose(fp);
+    }
+    
+    /// Replace the contents of batch with up to max_records whole records.
+    /// Returns false if there were no records left.
+    bool read_records(size_t max_records, FastqTextBatch& batch) {
+        batch.text.clear();
+        batch.record_starts.clear();
+        size_t batch_start = pending_pos;
+        while (batch.record_starts.size() < max_records) {
+            // Look for the end of the 4 lines of the next record
+            const char* record_end = pending.data() + pending_pos;
+            const char* pending_end = pending.data() + pending.size();
+            for (size_t line = 0; line < 4 && record_end != nullptr; line++) {
+                record_end = (const char*) memchr(record_end, '\n', pending_end - record_end);
+                if (record_end != nullptr) {
+                    record_end++;
+                }
+            }
+            if (record_end != nullptr) {
+                batch.record_starts.push_back(pending_pos - batch_start);
+                pending_pos = record_end - pending.data();
+                continue;
+            }
+            
+            // We need more text. Drop what we've already handed out of the
+            // pending text, keeping the records in this batch.
+            if (batch_start > 0) {
+                pending.erase(0, batch_start);
+                pending_pos -= batch_start;
+                batch_start = 0;
+            }
+            if (!append_block()) {
+                // That's the end of the file, which may be missing its last newline
+                if (pending.find_first_not_of(" \t\r\n", pending_pos) != string::npos) {
+                    if (count(pending.begin() + pending_pos, pending.end(), '\n') < 3) {
+                        cerr << "[vg::alignment.cpp] error: incomplete fastq record" << endl; exit(1);
+                    }
+                    batch.record_starts.push_back(pending_pos);
+                    pending.push_back('\n');
+                }
+                pending_pos = pending.size();
+                break;
+            }
+        }
+        batch.text.assign(pending, batch_start, pending_pos - batch_start);
+        batch.record_starts.push_back(batch.text.size());
+        return batch.size() > 0;
+    }
+    
+private:
+    /// How many bytes of decompressed text are in each block?
+    static const size_t BLOCK_SIZE = 1 << 20;
+    /// How many blocks can the decompressor get ahead of the reader?
+    static const size_t MAX_BLOCKS_AHEAD = 4;
+    
+    string filename;
+    gzFile fp;
+    
+    /// Decompressed blocks that haven't been read yet
+    deque<string> blocks;
+    bool at_eof = false;
+    bool stopping = false;
+    mutex blocks_mutex;
+    condition_variable block_taken;
+    condition_variable block_ready;
+    thread decompressor;
+    
+    /// The text we are reading records out of, and how far we have gotten
+    string pending;
+    size_t pending_pos = 0;
+    
+    /// Run in the background, decompressing blocks until the end of the file
+    /// or until we are destroyed.
+    void decompress() {
+        while (true) {
+            string block(BLOCK_SIZE, '\0');
+            int got = gzread(fp, &block[0], BLOCK_SIZE);
+            if (got < 0) {
+                cerr << "[vg::alignment.cpp] error: couldn't read " << filename << endl; exit(1);
+            }
+            block.resize(got);
+            
+            unique_lock<mutex> lock(blocks_mutex);
+            block_taken.wait(lock, [&]() { return stopping || blocks.size() < MAX_BLOCKS_AHEAD; });
+            if (stopping) {
+                return;
+            }
+            if (got == 0) {
+                at_eof = true;
+                block_ready.notify_one();
+                return;
+            }
+            blocks.emplace_back(std::move(block));
+            block_ready.notify_one();
+        }
+    }
+    
+    /// Wait for the next block and add it to the pending text. Returns false
+    /// if there are no more blocks.
+    bool append_block() {
+        string block;
+        {
+            unique_lock<mutex> lock(blocks_mutex);
+            block_ready.wait(lock, [&]() { return at_eof || !blocks.empty(); });
+            if (blocks.empty()) {
+                return false;
+            }
+            block = std::move(blocks.front());
+            blocks.pop_front();
+        }
+        block_taken.notify_one();
+        
+        if (pending.empty()) {
+            // Nothing left over, so we can just take the block
+            pending = std::move(block);
+            pending_pos = 0;
+        } else {
+            pending.append(block);
+        }
+        return true;
+    }
+};
+
+/// Parse one 4-line FASTQ record out of a batch into an Alignment.
+static void parse_fastq_record(const FastqTextBatch& batch, size_t i, Alignment& alignment) {
+    alignment.Clear();
+    
+    // Find the starts of the record's lines, and the end of the last one
+    const char* lines[5];
+    lines[0] = batch.text.data() + batch.record_starts[i];
+    const char* record_end = batch.text.data() + batch.record_starts[i + 1];
+    for (size_t line = 1; line < 5; line++) {
+        lines[line] = (const char*) memchr(lines[line - 1], '\n', record_end - lines[line - 1]) + 1;
+    }
+    
+    // trim off leading @ and keep trailing /1 /2
+    alignment.set_name(lines[0] + 1, lines[1] - lines[0] - 2);
+    alignment.set_sequence(lines[1], lines[2] - lines[1] - 1);
+    string* quality = alignment.mutable_quality();
+    quality->resize(lines[4] - lines[3] - 1);
+    for (size_t j = 0; j < quality->size(); j++) {
+        (*quality)[j] = quality_char_to_short(lines[3][j]);
+    }
+}
+
+// Work out how many reads each task should get. We shrink the tasks while there are fewer of
+// them queued than there are threads, so that a few slow reads can't hold up the rest of a big
+// batch while other threads sit idle, and grow them back while the queue is deep.
+static size_t adapt_task_size(size_t task_size, uint64_t tasks_outstanding, int thread_count, size_t max_task_size) {
+    if (tasks_outstanding < thread_count) {
+        return max<size_t>(task_size / 2, 1);
+    } else if (tasks_outstanding > 4 * thread_count) {
+        return min(task_size * 2, max_task_size);
+    }
+    return task_size;
+}
+
+// Split a batch of item_count items up into tasks of at most task_size items, which idle
+// threads can pick up independently. The last of the tasks to finish deletes the batch and
+// counts it as done. Must be called from the thread generating tasks, inside a parallel region.
+template<typename Batch>
+static void spawn_batch_tasks(Batch* batch, size_t item_count, size_t task_size,
+                              uint64_t* batches_outstanding, uint64_t* tasks_outstanding,
+                              const function<void(Batch&, size_t)>* process) {
+    
+    uint64_t* tasks_left = new uint64_t((item_count + task_size - 1) / task_size);
+    for (size_t begin = 0; begin < item_count; begin += task_size) {
+        size_t end = min(begin + task_size, item_count);
+#pragma omp atomic update
+        (*tasks_outstanding)++;
+#pragma omp task default(none) firstprivate(batch, begin, end, tasks_left, batches_outstanding, tasks_outstanding, process)
+        {
+            for (size_t i = begin; i < end; i++) {
+                (*process)(*batch, i);
+            }
+            uint64_t left;
+#pragma omp atomic capture
+            left = --(*tasks_left);
+            if (left == 0) {
+                delete batch;
+                delete tasks_left;
+#pragma omp atomic update
+                (*batches_outstanding)--;
+            }
+#pragma omp atomic update
+            (*tasks_outstanding)--;
+        }
+    }
+}
+
+// Wait for room for another batch in memory, then count it as outstanding. Must be called
+// from the thread generating tasks.
+static void wait_for_batch_slot(uint64_t* batches_outstanding, uint64_t max_batches_outstanding) {
+    uint64_t b;
+#pragma omp atomic capture
+    b = ++(*batches_outstanding);
+    while (b >= max_batches_outstanding) {
+        usleep(1000);
+#pragma omp atomic read
+        b = *batches_outstanding;
+    }
+}
+
+/// Raw BAM records read on one thread, to be converted on others
+struct BamBatch {
+    vector<bam1_t*> records;
+    
+    ~BamBatch() {
+        for (auto& b : records) {
+            bam_destroy1(b);
+        }
+    }
+};
+
+int hts_for_each_parallel(string& filename, function<void(Alignment&)> lambda) {
+
+    samFile *in = hts_open(filename.c_str(), "r");
+    if (in == NULL) return 0;
     int thread_count = get_thread_count();
-    vector<Alignment> *batch = nullptr;
-    char* buf = new char[len];
-    const uint64_t batch_size = 2 << 8;;
+    // let htslib decompress on its own threads while we read
+    hts_set_threads(in, thread_count);
+    bam_hdr_t *hdr = sam_hdr_read(in);
+    unordered_map<string, string> rg_sample;
+    parse_rg_sample_map(hdr->text, rg_sample);
+
+    const uint64_t batch_size = 2 << 8;
     // max # of such batches to be holding in memory
     const uint64_t max_batches_outstanding = 2 << 8;
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
-    bool more_data = true;
-#pragma omp parallel default(none) shared(fp, more_data, batches_outstanding, batch, len, buf, nLines, lambda)
+    // number of tasks the batches have been split into that haven't finished
+    uint64_t tasks_outstanding = 0;
+    size_t task_size = batch_size;
+    // records are converted to Alignments by the tasks
+    function<void(BamBatch&, size_t)> process = [&](BamBatch& batch, size_t i) {
+        Alignment a = bam_to_alignment(batch.records[i], rg_sample);
+        lambda(a);
+    };
+#pragma omp parallel default(none) shared(in, hdr, batches_outstanding, tasks_outstanding, task_size, thread_count, process)
 #pragma omp single
     {
+        bool more_data = true;
         while (more_data) {
-            if (!batch) {
-                batch = new std::vector<Alignment>();
-                batch->reserve(batch_size);
-            }
-            Alignment aln;
-            bool got_anything = false;
-            {
-                int i = 0;
-                while (more_data && i++ < batch_size) {
-                    //got_anything = more_data = get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
-                    got_anything = more_data = get_next_alignment_from_fastq(fp, buf, len, aln);
-                    if (got_anything) {
-                        batch->push_back(std::move(aln));
-                        nLines++;
-                    }
+            BamBatch* batch = new BamBatch();
+            batch->records.reserve(batch_size);
+            while (batch->records.size() < batch_size) {
+                bam1_t* b = bam_init1();
+                if (sam_read1(in, hdr, b) < 0) {
+                    bam_destroy1(b);
+                    more_data = false;
+                    break;
                 }
+                batch->records.push_back(b);
             }
-            if (batch->size()) {
-                uint64_t b;
-#pragma omp atomic capture
-                b = ++batches_outstanding;
-                while (b >= max_batches_outstanding) {
-                    usleep(1000);
+            if (batch->records.empty()) {
+                delete batch;
+                break;
+            }
+            wait_for_batch_slot(&batches_outstanding, max_batches_outstanding);
+            uint64_t t;
 #pragma omp atomic read
-                    b = batches_outstanding;
-                }
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                {
-                    for (auto& aln : *batch) {
-                        lambda(aln);
-                    }
-                    delete batch;
-#pragma omp atomic update
-                    batches_outstanding--;
-                }
+            t = tasks_outstanding;
+            task_size = adapt_task_size(task_size, t, thread_count, batch_size);
+            spawn_batch_tasks(batch, batch->records.size(), task_size, &batches_outstanding, &tasks_outstanding, &process);
+        }
+    }
+
+    bam_hdr_destroy(hdr);
+    hts_close(in);
+    return 1;
+
+}
+
+size_t fastq_unpaired_for_each_parallel(const string& filename, function<void(Alignment&)> lambda) {
+    FastqBlockReader reader(filename);
+    size_t nLines = 0;
+    int thread_count = get_thread_count();
+    const uint64_t batch_size = 2 << 8;
+    // max # of such batches to be holding in memory
+    const uint64_t max_batches_outstanding = 2 << 8;
+    // number of batches currently being processed
+    uint64_t batches_outstanding = 0;
+    // number of tasks the batches have been split into that haven't finished
+    uint64_t tasks_outstanding = 0;
+    size_t task_size = batch_size;
+    // reads are parsed out of the batch's text by the tasks
+    function<void(FastqTextBatch&, size_t)> process = [&](FastqTextBatch& batch, size_t i) {
+        Alignment aln;
+        parse_fastq_record(batch, i, aln);
+        lambda(aln);
+    };
+#pragma omp parallel default(none) shared(reader, batches_outstanding, tasks_outstanding, task_size, thread_count, nLines, process)
+#pragma omp single
+    {
+        while (true) {
+            FastqTextBatch* batch = new FastqTextBatch();
+            if (!reader.read_records(batch_size, *batch)) {
+                delete batch;
+                break;
             }
-            batch = nullptr; // reset batch pointer
+            nLines += batch->size();
+            wait_for_batch_slot(&batches_outstanding, max_batches_outstanding);
+            uint64_t t;
+#pragma omp atomic read
+            t = tasks_outstanding;
+            task_size = adapt_task_size(task_size, t, thread_count, batch_size);
+            spawn_batch_tasks(batch, batch->size(), task_size, &batches_outstanding, &tasks_outstanding, &process);
         }
     }
-    delete buf;
-    gzclose(fp);
     return nLines;
 }
 
@@ -213,78 +464,55 @@ size_t fastq_paired_interleaved_for_each_parallel(const string& filename, functi
 size_t fastq_paired_interleaved_for_each_parallel_after_wait(const string& filename,
                                                              function<void(Alignment&, Alignment&)> lambda,
                                                              function<bool(void)> single_threaded_until_true) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader(filename);
     size_t nLines = 0;
     int thread_count = get_thread_count();
-    vector<pair<Alignment, Alignment> > *batch = nullptr;
-    char* buf = new char[len];
     const uint64_t batch_size = 2 << 8;
     // max # of such batches to be holding in memory
     uint64_t max_batches_outstanding = 2 << 8;
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
-    bool more_data = true;
-#pragma omp parallel default(none) shared(fp, more_data, max_batches_outstanding, batches_outstanding, single_threaded_until_true, batch, len, buf, nLines, lambda)
+    // number of tasks the batches have been split into that haven't finished
+    uint64_t tasks_outstanding = 0;
+    size_t task_size = batch_size;
+    // mates travel together, so a pair is never split across tasks
+    function<void(FastqTextBatch&, size_t)> process = [&](FastqTextBatch& batch, size_t i) {
+        Alignment mate1, mate2;
+        parse_fastq_record(batch, 2 * i, mate1);
+        parse_fastq_record(batch, 2 * i + 1, mate2);
+        lambda(mate1, mate2);
+    };
+#pragma omp parallel default(none) shared(reader, max_batches_outstanding, batches_outstanding, tasks_outstanding, task_size, thread_count, single_threaded_until_true, nLines, process)
 #pragma omp single
     {
-        while (more_data) {
-            if (!batch) {
-                batch = new std::vector<pair<Alignment, Alignment> >();
-                batch->reserve(batch_size);
+        while (true) {
+            FastqTextBatch* batch = new FastqTextBatch();
+            if (!reader.read_records(2 * batch_size, *batch)) {
+                delete batch;
+                break;
             }
-            Alignment mate1, mate2;
-            bool got_anything = false;
-            {
-                int i = 0;
-                while (more_data && i++ < batch_size) {
-                    got_anything = more_data = get_next_interleaved_alignment_pair_from_fastq(fp, buf, len, mate1, mate2);
-                    if (got_anything) {
-                        batch->emplace_back(std::move(mate1), std::move(mate2));
-                        nLines++;
-                    }
-                }
-            }
-            if (batch->size()) {
-                uint64_t b;
-#pragma omp atomic capture
-                b = ++batches_outstanding;
-                while (b >= max_batches_outstanding) {
-                    usleep(1000);
+            // an unpaired read at the end is dropped
+            size_t pairs = batch->size() / 2;
+            nLines += pairs;
+            wait_for_batch_slot(&batches_outstanding, max_batches_outstanding);
+            if (single_threaded_until_true()) {
+                uint64_t t;
 #pragma omp atomic read
-                    b = batches_outstanding;
+                t = tasks_outstanding;
+                task_size = adapt_task_size(task_size, t, thread_count, batch_size);
+                spawn_batch_tasks(batch, pairs, task_size, &batches_outstanding, &tasks_outstanding, &process);
+            }
+            else {
+                // process this batch in the current thread
+                for (size_t i = 0; i < pairs; i++) {
+                    process(*batch, i);
                 }
-                if (single_threaded_until_true()) {
-                    
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
-                        delete batch;
+                delete batch;
 #pragma omp atomic update
-                        batches_outstanding--;
-                    }
-                }
-                else {
-                    // process this batch in the current thread
-                    {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
-                        delete batch;
-                        batches_outstanding--;
-                    }
-                }
+                batches_outstanding--;
             }
-            batch = nullptr; // reset batch pointer
         }
     }
-    delete buf;
-    gzclose(fp);
     return nLines;
 }
 
@@ -295,148 +523,118 @@ size_t fastq_paired_two_files_for_each_parallel(const string& file1, const strin
 size_t fastq_paired_two_files_for_each_parallel_after_wait(const string& file1, const string& file2,
                                                            function<void(Alignment&, Alignment&)> lambda,
                                                            function<bool(void)> single_threaded_until_true) {
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp1) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
-    }
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp2) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader1(file1);
+    FastqBlockReader reader2(file2);
     size_t nLines = 0;
     int thread_count = get_thread_count();
-    vector<pair<Alignment, Alignment> > *batch = nullptr;
-    char* buf = new char[len];
     const uint64_t batch_size = 2 << 8;
     // max # of such batches to be holding in memory
     uint64_t max_batches_outstanding = 2 << 8;
     // number of batches currently being processed
     uint64_t batches_outstanding = 0;
-    bool more_data = true;
-#pragma omp parallel default(none) shared(fp1, fp2, more_data, max_batches_outstanding, batches_outstanding, single_threaded_until_true, batch, len, buf, nLines, lambda)
+    // number of tasks the batches have been split into that haven't finished
+    uint64_t tasks_outstanding = 0;
+    size_t task_size = batch_size;
+    typedef pair<FastqTextBatch, FastqTextBatch> batch_pair_t;
+    // mates travel together, so a pair is never split across tasks
+    function<void(batch_pair_t&, size_t)> process = [&](batch_pair_t& batches, size_t i) {
+        Alignment mate1, mate2;
+        parse_fastq_record(batches.first, i, mate1);
+        parse_fastq_record(batches.second, i, mate2);
+        lambda(mate1, mate2);
+    };
+#pragma omp parallel default(none) shared(reader1, reader2, max_batches_outstanding, batches_outstanding, tasks_outstanding, task_size, thread_count, single_threaded_until_true, nLines, process)
 #pragma omp single
     {
-        // spinlock until wait function evaluates to true
-        while (more_data) {
-            if (!batch) {
-                batch = new std::vector<pair<Alignment, Alignment> >();
-                batch->reserve(batch_size);
+        while (true) {
+            batch_pair_t* batches = new batch_pair_t();
+            reader1.read_records(batch_size, batches->first);
+            reader2.read_records(batch_size, batches->second);
+            // stop at the end of the shorter file
+            size_t pairs = min(batches->first.size(), batches->second.size());
+            if (pairs == 0) {
+                delete batches;
+                break;
             }
-            Alignment mate1, mate2;
-            bool got_anything = false;
-            {
-                int i = 0;
-                while (more_data && i++ < batch_size) {
-                    got_anything = more_data = get_next_alignment_pair_from_fastqs(fp1, fp2, buf, len, mate1, mate2);
-                    if (got_anything) {
-                        batch->push_back(std::move(make_pair(mate1, mate2)));
-                        nLines++;
-                    }
-                }
-            }
-            if (batch->size()) {
-                uint64_t b;
-#pragma omp atomic capture
-                b = ++batches_outstanding;
-                while (b >= max_batches_outstanding) {
-                    usleep(1000);
+            nLines += pairs;
+            wait_for_batch_slot(&batches_outstanding, max_batches_outstanding);
+            if (single_threaded_until_true()) {
+                uint64_t t;
 #pragma omp atomic read
-                    b = batches_outstanding;
+                t = tasks_outstanding;
+                task_size = adapt_task_size(task_size, t, thread_count, batch_size);
+                spawn_batch_tasks(batches, pairs, task_size, &batches_outstanding, &tasks_outstanding, &process);
+            }
+            else {
+                // process this batch in the current thread
+                for (size_t i = 0; i < pairs; i++) {
+                    process(*batches, i);
                 }
-                if (single_threaded_until_true()) {
-                    
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda)
-                    {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
-                        delete batch;
+                delete batches;
 #pragma omp atomic update
-                        batches_outstanding--;
-                    }
-                }
-                else {
-                    // process this batch in the current thread
-                    {
-                        for (auto& p : *batch) {
-                            lambda(p.first, p.second);
-                        }
-                        delete batch;
-                        batches_outstanding--;
-                    }
-                }
+                batches_outstanding--;
             }
-            batch = nullptr; // reset batch pointer
         }
     }
-    delete buf;
-    gzclose(fp1);
-    gzclose(fp2);
     return nLines;
 }
 
 size_t fastq_unpaired_for_each(const string& filename, function<void(Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader(filename);
     size_t nLines = 0;
-    char *buffer = new char[len];
+    FastqTextBatch batch;
     Alignment alignment;
-    while(get_next_alignment_from_fastq(fp, buffer, len, alignment)) {
-        lambda(alignment);
-        nLines++;
+    while (reader.read_records(2 << 8, batch)) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            parse_fastq_record(batch, i, alignment);
+            lambda(alignment);
+            nLines++;
+        }
     }
-    gzclose(fp);
-    delete buffer;
     return nLines;
 }
 
 size_t fastq_paired_interleaved_for_each(const string& filename, function<void(Alignment&, Alignment&)> lambda) {
-    gzFile fp = (filename != "-") ? gzopen(filename.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp) {
-        cerr << "[vg::alignment.cpp] couldn't open " << filename << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader(filename);
     size_t nLines = 0;
-    char *buffer = new char[len];
+    FastqTextBatch batch;
     Alignment mate1, mate2;
-    while(get_next_interleaved_alignment_pair_from_fastq(fp, buffer, len, mate1, mate2)) {
-        lambda(mate1, mate2);
-        nLines++;
+    while (reader.read_records(2 << 9, batch)) {
+        for (size_t i = 0; i + 1 < batch.size(); i += 2) {
+            parse_fastq_record(batch, i, mate1);
+            parse_fastq_record(batch, i + 1, mate2);
+            lambda(mate1, mate2);
+            nLines++;
+        }
     }
-    gzclose(fp);
-    delete buffer;
     return nLines;
 }
 
 size_t fastq_paired_two_files_for_each(const string& file1, const string& file2, function<void(Alignment&, Alignment&)> lambda) {
-    gzFile fp1 = (file1 != "-") ? gzopen(file1.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp1) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file1 << endl; exit(1);
-    }
-    gzFile fp2 = (file2 != "-") ? gzopen(file2.c_str(), "r") : gzdopen(fileno(stdin), "r");
-    if (!fp2) {
-        cerr << "[vg::alignment.cpp] couldn't open " << file2 << endl; exit(1);
-    }
-    size_t len = 2 << 18; // 256k
+    FastqBlockReader reader1(file1);
+    FastqBlockReader reader2(file2);
     size_t nLines = 0;
-    char *buffer = new char[len];
+    FastqTextBatch batch1, batch2;
     Alignment mate1, mate2;
-    while(get_next_alignment_pair_from_fastqs(fp1, fp2, buffer, len, mate1, mate2)) {
-        lambda(mate1, mate2);
-        nLines++;
+    while (true) {
+        reader1.read_records(2 << 8, batch1);
+        reader2.read_records(2 << 8, batch2);
+        size_t pairs = min(batch1.size(), batch2.size());
+        if (pairs == 0) {
+            break;
+        }
+        for (size_t i = 0; i < pairs; i++) {
+            parse_fastq_record(batch1, i, mate1);
+            parse_fastq_record(batch2, i, mate2);
+            lambda(mate1, mate2);
+            nLines++;
+        }
     }
-    gzclose(fp1);
-    gzclose(fp2);
-    delete buffer;
     return nLines;
 
 }
 
-void parse_rg_sample_map(char* hts_header, map<string, string>& rg_sample) {
+void parse_rg_sample_map(char* hts_header, unordered_map<string, string>& rg_sample) {
     string header(hts_header);
     vector<string> header_lines = split_delims(header, "\n");
 
@@ -535,32 +733,135 @@ string string_quality_char_to_short(const string& quality) {
     return buffer;
 }
 
-// remember to clean up with bam_destroy1(b);
-bam1_t* alignment_to_bam(const string& sam_header,
-                         const Alignment& alignment,
-                         const string& refseq,
-                         const int32_t refpos,
-                         const bool refrev,
-                         const string& cigar,
-                         const string& mateseq,
-                         const int32_t matepos,
-                         const int32_t tlen) {
-
-    assert(!sam_header.empty());
-    string sam_file = "data:," + sam_header + alignment_to_sam(alignment, refseq, refpos, refrev, cigar, mateseq, matepos, tlen);
-    const char* sam = sam_file.c_str();
-    samFile *in = sam_open(sam, "r");
-    bam_hdr_t *header = sam_hdr_read(in);
-    bam1_t *aln = bam_init1();
-    if (sam_read1(in, header, aln) >= 0) {
-        bam_hdr_destroy(header);
-        sam_close(in); // clean up
-        return aln;
+// Pack a read sequence into BAM's 4-bit base codes, two bases to a byte,
+// optionally reverse complementing it on the way.
+static void pack_bam_sequence(const string& sequence, bool reverse_complement, uint8_t* packed) {
+    // complementing a 4-bit code (one bit per base in the set) reverses its bits
+    static const uint8_t complement_code[16] = {0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15};
+    const unsigned char* seq = (const unsigned char*) sequence.data();
+    size_t n = sequence.size();
+    if (!reverse_complement) {
+        size_t i = 0;
+        for (; i + 1 < n; i += 2) {
+            *packed++ = (seq_nt16_table[seq[i]] << 4) | seq_nt16_table[seq[i + 1]];
+        }
+        if (i < n) {
+            *packed = seq_nt16_table[seq[i]] << 4;
+        }
     } else {
-        cerr << "[vg::alignment] Failure to parse SAM record" << endl
-             << sam << endl;
+        size_t i = n;
+        for (; i >= 2; i -= 2) {
+            *packed++ = (complement_code[seq_nt16_table[seq[i - 1]]] << 4)
+                | complement_code[seq_nt16_table[seq[i - 2]]];
+        }
+        if (i > 0) {
+            *packed = complement_code[seq_nt16_table[seq[0]]] << 4;
+        }
+    }
+}
+
+void alignment_to_bam(const Alignment& alignment,
+                      const int32_t tid,
+                      const int32_t refpos,
+                      const bool refrev,
+                      const vector<uint32_t>& cigar,
+                      const int32_t mate_tid,
+                      const int32_t matepos,
+                      const int32_t tlen,
+                      bam1_t* b) {
+    
+    // We need to strip the /1 and /2 from paired reads so the two ends have the same name.
+    const string& name = alignment.name();
+    size_t name_length = name.size();
+    if (name_length >= 2 && name[name_length - 2] == '/'
+        && (name[name_length - 1] == '1' || name[name_length - 1] == '2')) {
+        name_length -= 2;
+    }
+    const char* name_data = name.data();
+    if (name_length == 0) {
+        name_data = "*";
+        name_length = 1;
+    }
+    if (name_length > 254) {
+        cerr << "[vg::alignment] error: read name is too long for BAM: " << name << endl;
         exit(1);
     }
+    
+    size_t n_cigar = alignment.has_path() && alignment.path().mapping_size() ? cigar.size() : 0;
+    const string& sequence = alignment.sequence();
+    const string& quality = alignment.quality();
+    const string& read_group = alignment.read_group();
+    size_t l_qseq = sequence.size();
+    // the RG:Z tag takes its name, its type, and a null terminator
+    size_t l_aux = read_group.empty() ? 0 : read_group.size() + 4;
+    size_t l_data = name_length + 1 + 4 * n_cigar + (l_qseq + 1) / 2 + l_qseq + l_aux;
+    
+    // reuse the record's memory if it's big enough
+    if ((size_t) b->m_data < l_data) {
+        size_t m_data = 1;
+        while (m_data < l_data) {
+            m_data <<= 1;
+        }
+        uint8_t* data = (uint8_t*) realloc(b->data, m_data);
+        if (!data) {
+            cerr << "[vg::alignment] error: could not allocate a BAM record of " << l_data << " bytes" << endl;
+            exit(1);
+        }
+        b->data = data;
+        b->m_data = m_data;
+    }
+    b->l_data = l_data;
+    
+    bam1_core_t& core = b->core;
+    memset(&core, 0, sizeof(bam1_core_t));
+    core.tid = tid;
+    core.pos = refpos;
+    core.qual = min<int32_t>(alignment.mapping_quality(), 255);
+    core.l_qname = name_length + 1;
+    core.flag = sam_flag(alignment, refrev);
+    core.n_cigar = n_cigar;
+    core.l_qseq = l_qseq;
+    core.mtid = mate_tid;
+    core.mpos = matepos;
+    core.isize = tlen;
+    if (n_cigar == 0) {
+        // a record can't be placed by its alignment without a CIGAR
+        core.flag |= BAM_FUNMAP;
+    }
+    
+    uint8_t* data = b->data;
+    memcpy(data, name_data, name_length);
+    data[name_length] = '\0';
+    data += name_length + 1;
+    
+    if (n_cigar) {
+        memcpy(data, cigar.data(), 4 * n_cigar);
+        data += 4 * n_cigar;
+    }
+    int32_t ref_length = n_cigar ? bam_cigar2rlen(n_cigar, cigar.data()) : 0;
+    core.bin = hts_reg2bin(core.pos, core.pos + max(ref_length, 1), 14, 5);
+    
+    // Make sure the sequence and qualities always come out in reference forward orientation.
+    pack_bam_sequence(sequence, refrev, data);
+    data += (l_qseq + 1) / 2;
+    if (quality.size() == l_qseq) {
+        if (refrev) {
+            reverse_copy(quality.begin(), quality.end(), (char*) data);
+        } else {
+            memcpy(data, quality.data(), l_qseq);
+        }
+    } else {
+        // missing qualities
+        memset(data, 0xff, l_qseq);
+    }
+    data += l_qseq;
+    
+    if (!read_group.empty()) {
+        data[0] = 'R';
+        data[1] = 'G';
+        data[2] = 'Z';
+        memcpy(data + 3, read_group.c_str(), read_group.size() + 1);
+    }
 }
 
 string alignment_to_sam(const Alignment& alignment,
@@ -694,32 +995,60 @@ void mapping_cigar(const Mapping& mapping, vector<pair<int, char> >& cigar) {
     }
 }
 
+// Add an operation to a packed CIGAR, merging it into the last one if they match.
+static inline void append_cigar_op(vector<uint32_t>& cigar, uint32_t length, uint32_t op) {
+    if (length == 0) {
+        return;
+    }
+    if (!cigar.empty() && bam_cigar_op(cigar.back()) == op) {
+        cigar.back() += length << BAM_CIGAR_SHIFT;
+    } else {
+        cigar.push_back(bam_cigar_gen(length, op));
+    }
+}
+
 // act like the path this is against is the reference
 // and generate an equivalent cigar
 // Produces CIGAR in forward strand space of the reference sequence.
-string cigar_against_path(const Alignment& alignment, bool on_reverse_strand) {
-    vector<pair<int, char> > cigar;
-    if (!alignment.has_path()) return "";
-    const Path& path = alignment.path();
-    int l = 0;
-    for (const auto& mapping : path.mapping()) {
-        mapping_cigar(mapping, cigar);
+void cigar_against_path(const Alignment& alignment, bool on_reverse_strand, vector<uint32_t>& cigar) {
+    cigar.clear();
+    if (!alignment.has_path()) return;
+    for (const auto& mapping : alignment.path().mapping()) {
+        for (const auto& edit : mapping.edit()) {
+            // matches and mismatches are both M
+            uint32_t eq = min(edit.from_length(), edit.to_length());
+            append_cigar_op(cigar, eq, BAM_CMATCH);
+            if (edit.from_length() > edit.to_length()) {
+                append_cigar_op(cigar, edit.from_length() - edit.to_length(), BAM_CDEL);
+            } else if (edit.from_length() < edit.to_length()) {
+                append_cigar_op(cigar, edit.to_length() - edit.from_length(), BAM_CINS);
+            }
+        }
     }
+    if (cigar.empty()) return;
     
     if(on_reverse_strand) {
         // Flip CIGAR ops into forward strand ordering
         reverse(cigar.begin(), cigar.end());
     }
-
+    
     // handle soft clips, which are just insertions at the start or end
-    if (cigar.front().second == 'I') {
-        cigar.front().second = 'S';
+    if (bam_cigar_op(cigar.front()) == BAM_CINS) {
+        cigar.front() = bam_cigar_gen(bam_cigar_oplen(cigar.front()), BAM_CSOFT_CLIP);
     }
-    if (cigar.back().second == 'I') {
-        cigar.back().second = 'S';
+    if (bam_cigar_op(cigar.back()) == BAM_CINS) {
+        cigar.back() = bam_cigar_gen(bam_cigar_oplen(cigar.back()), BAM_CSOFT_CLIP);
     }
-    
-    return cigar_string(cigar);
+}
+
+string cigar_against_path(const Alignment& alignment, bool on_reverse_strand) {
+    vector<uint32_t> cigar;
+    cigar_against_path(alignment, on_reverse_strand, cigar);
+    stringstream cigarss;
+    for (uint32_t op : cigar) {
+        cigarss << bam_cigar_oplen(op) << bam_cigar_opchr(op);
+    }
+    return cigarss.str();
 }
 
 int32_t sam_flag(const Alignment& alignment, bool on_reverse_strand) {
@@ -754,7 +1083,7 @@ int32_t sam_flag(const Alignment& alignment, bool on_reverse_strand) {
     return flag;
 }
 
-Alignment bam_to_alignment(const bam1_t *b, map<string, string>& rg_sample) {
+Alignment bam_to_alignment(const bam1_t *b, const unordered_map<string, string>& rg_sample) {
 
     Alignment alignment;
 
@@ -774,11 +1103,13 @@ Alignment bam_to_alignment(const bam1_t *b, map<string, string>& rg_sample) {
 
     // get the read group and sample name
     uint8_t *rgptr = bam_aux_get(b, "RG");
-    char* rg = (char*) (rgptr+1);
-    //if (!rg_sample
+    char* rg = rgptr ? (char*) (rgptr+1) : nullptr;
     string sname;
-    if (!rg_sample.empty()) {
-        sname = rg_sample[string(rg)];
+    if (rg && !rg_sample.empty()) {
+        auto found = rg_sample.find(rg);
+        if (found != rg_sample.end()) {
+            sname = found->second;
+        }
     }
 
     // Now name the read after the scaffold
@@ -942,18 +1273,6 @@ Alignment reverse_complement_alignment(const Alignment& aln,
     return reversed;
 }
     
-void reverse_complement_alignment_in_place(Alignment* aln,
-                                           const function<int64_t(id_t)>& node_length) {
-
-    reverse_complement_in_place(*aln->mutable_sequence());
-    string* quality = aln->mutable_quality();
-    std::reverse(quality->begin(), quality->end());
-    
-    if (aln->has_path()) {
-        reverse_complement_path_in_place(aln->mutable_path(), node_length);
-    }
-}
-
 // merge that properly handles long indels
 // assumes that alignments should line up end-to-end
 Alignment merge_alignments(const vector<Alignment>& alns, bool debug) {
@@ -1213,6 +1532,28 @@ pair<string, string> signature(const Alignment& aln1, const Alignment& aln2) {
     return make_pair(signature(aln1), signature(aln2));
 }
 
+// fold a value into a signature hash (the 64-bit version of boost's hash_combine)
+static inline uint64_t combine_signature(uint64_t hash, uint64_t value) {
+    return hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+}
+
+uint64_t signature_hash(const Alignment& aln) {
+    if (!aln.has_path() || !aln.path().mapping_size()) {
+        return 0;
+    }
+    auto& pos1 = aln.path().mapping(0).position();
+    auto& last = aln.path().mapping(aln.path().mapping_size()-1);
+    auto& pos2 = last.position();
+    uint64_t hash = combine_signature(0, 2 * (uint64_t) pos1.node_id() + pos1.is_reverse());
+    hash = combine_signature(hash, pos1.offset());
+    hash = combine_signature(hash, 2 * (uint64_t) pos2.node_id() + pos2.is_reverse());
+    return combine_signature(hash, pos2.offset() + mapping_from_length(last));
+}
+
+uint64_t signature_hash(const Alignment& aln1, const Alignment& aln2) {
+    return combine_signature(signature_hash(aln1), signature_hash(aln2));
+}
+
 void parse_bed_regions(istream& bedstream,
                        xg::XG* xgindex,
                        vector<Alignment>* out_alignments) {
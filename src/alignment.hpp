@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <functional>
+#include <unordered_map>
 #include <zlib.h>
 #include "utility.hpp"
 #include "path.hpp"
@@ -58,17 +59,24 @@ void mapping_cigar(const Mapping& mapping, vector<pair<int, char> >& cigar);
 string cigar_string(vector<pair<int, char> >& cigar);
 string mapping_string(const string& source, const Mapping& mapping);
 
-Alignment bam_to_alignment(const bam1_t *b, map<string, string>& rg_sample);
-
-bam1_t* alignment_to_bam(const string& sam_header,
-                         const Alignment& alignment,
-                         const string& refseq,
-                         const int32_t refpos,
-                         const bool refrev,
-                         const string& cigar,
-                         const string& mateseq,
-                         const int32_t matepos,
-                         const int32_t tlen);
+/// Convert a BAM record to an Alignment, naming its sample with the given
+/// mapping from read group to sample. Safe to call on many threads at once.
+Alignment bam_to_alignment(const bam1_t *b, const unordered_map<string, string>& rg_sample);
+
+/// Fill in a BAM record for the alignment directly, without going through SAM
+/// text. The reference and the mate's reference are given by their target
+/// numbers in the header (-1 for none), positions are 0-based, and the CIGAR
+/// is packed as from cigar_against_path. The record's memory is reused when it
+/// is big enough, so threads can keep their records around between reads.
+void alignment_to_bam(const Alignment& alignment,
+                      const int32_t tid,
+                      const int32_t refpos,
+                      const bool refrev,
+                      const vector<uint32_t>& cigar,
+                      const int32_t mate_tid,
+                      const int32_t matepos,
+                      const int32_t tlen,
+                      bam1_t* b);
 
 string alignment_to_sam(const Alignment& alignment,
                         const string& refseq,
@@ -80,6 +88,9 @@ string alignment_to_sam(const Alignment& alignment,
                         const int32_t tlen);
 
 string cigar_against_path(const Alignment& alignment, bool on_reverse_strand);
+/// Get the CIGAR of the alignment against the path as packed BAM operations,
+/// without building the string.
+void cigar_against_path(const Alignment& alignment, bool on_reverse_strand, vector<uint32_t>& cigar);
 
 int32_t sam_flag(const Alignment& alignment, bool on_reverse_strand);
 short quality_char_to_short(char c);
@@ -88,7 +99,7 @@ string string_quality_char_to_short(const string& quality);
 string string_quality_short_to_char(const string& quality);
 void alignment_quality_char_to_short(Alignment& alignment);
 void alignment_quality_short_to_char(Alignment& alignment);
-void parse_rg_sample_map(char* hts_header, map<string, string>& rg_sample);
+void parse_rg_sample_map(char* hts_header, unordered_map<string, string>& rg_sample);
 int alignment_to_length(const Alignment& a);
 int alignment_from_length(const Alignment& a);
 // Adds a2 onto the end of a1, returns reference to a1
@@ -110,8 +121,13 @@ const string hash_alignment(const Alignment& aln);
 // ends of their nodes. Offsets will be updated to count unused bases from node
 // start when considering the node in its new orientation.
 Alignment reverse_complement_alignment(const Alignment& aln, const function<int64_t(id_t)>& node_length);
-void reverse_complement_alignment_in_place(Alignment* aln, const function<int64_t(id_t)>& node_length);
 vector<Alignment> reverse_complement_alignments(const vector<Alignment>& alns, const function<int64_t(int64_t)>& node_length);
+// The same, but without copying the alignment. The node length lookup can be
+// any callable taking an id_t.
+template<typename NodeLength>
+void reverse_complement_alignment_in_place(Alignment* aln, const NodeLength& node_length);
+template<typename NodeLength>
+void reverse_complement_alignments_in_place(vector<Alignment>* alns, const NodeLength& node_length);
 int non_match_start(const Alignment& alignment);
 int non_match_end(const Alignment& alignment);
 int softclip_start(const Alignment& alignment);
@@ -126,6 +142,11 @@ string signature(const Alignment& aln);
 pair<string, string> signature(const Alignment& aln1, const Alignment& aln2);
 string middle_signature(const Alignment& aln, int len);
 pair<string, string> middle_signature(const Alignment& aln1, const Alignment& aln2, int len);
+// A 64-bit hash of the same start and end positions that signature() describes,
+// for deduplicating alignments without building strings. Unplaced alignments
+// all hash to 0.
+uint64_t signature_hash(const Alignment& aln);
+uint64_t signature_hash(const Alignment& aln1, const Alignment& aln2);
 
 // project the alignment's path back into a different ID space
 void translate_nodes(Alignment& a, const unordered_map<id_t, pair<id_t, bool> >& ids, const std::function<size_t(int64_t)>& node_length);
@@ -147,6 +168,29 @@ void parse_bed_regions(istream& bedstream, xg::XG* xgindex, vector<Alignment>* o
 Position alignment_start(const Alignment& aln);
 Position alignment_end(const Alignment& aln);Position alignment_start(const Alignment& aln);
 
+template<typename NodeLength>
+void reverse_complement_alignment_in_place(Alignment* aln, const NodeLength& node_length) {
+    
+    if (!aln->sequence().empty()) {
+        reverse_complement_in_place(*aln->mutable_sequence());
+    }
+    if (!aln->quality().empty()) {
+        string* quality = aln->mutable_quality();
+        std::reverse(quality->begin(), quality->end());
+    }
+    
+    if (aln->has_path()) {
+        reverse_complement_path_in_place(aln->mutable_path(), node_length);
+    }
+}
+
+template<typename NodeLength>
+void reverse_complement_alignments_in_place(vector<Alignment>* alns, const NodeLength& node_length) {
+    for (Alignment& aln : *alns) {
+        reverse_complement_alignment_in_place(&aln, node_length);
+    }
+}
+
 }
 
 #endif
@@ -239,7 +239,8 @@ BandedGlobalAligner<IntType>::BAMatrix::~BAMatrix() {
 }
 
 template <class IntType>
-void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open,
+void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8_t* nt_table,
+                                                         const int8_t* query_profile, int8_t gap_open,
                                                          int8_t gap_extend, bool qual_adjusted, IntType min_inf) {
     
 #ifdef debug_banded_aligner_fill_matrix
@@ -296,7 +297,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     // initialize with min infs (identity of max function)
     for (int64_t i = iter_start; i < iter_stop; i++) {
-        idx = i * ncols;
+        idx = i;
         match[idx] = min_inf;
         insert_col[idx] = min_inf;
         // can skip insert row since it doesn't cross node boundaries
@@ -304,7 +305,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
     
     // make sure this one insert row value is there so we can use it for checking band boundaries
     // later
-    insert_row[iter_start * ncols] = min_inf;
+    insert_row[iter_start] = min_inf;
     
     // we will allow the alignment to treat this node as a source if it has no seeds or if it
     // is connected to a source node by a length 0 path (which we will check later)
@@ -331,6 +332,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
         
         int64_t seed_node_seq_len = seed->node->sequence().length();
+        int64_t seed_band_height = seed->bottom_diag - seed->top_diag + 1;
         
         if (seed_node_seq_len == 0) {
 #ifdef debug_banded_aligner_fill_matrix
@@ -363,7 +365,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         cerr << "[BAMatrix::fill_matrix]: this seed reaches diagonals " << seed_next_top_diag << " to " << seed_next_bottom_diag << " out of matrix range " << top_diag << " to " << bottom_diag << endl;
 #endif
         // special logic for first row
-        idx = (seed_next_top_diag_iter - top_diag) * ncols;
+        idx = seed_next_top_diag_iter - top_diag;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -394,7 +396,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: top cell in match matrix is reachable without a lead gap" << endl;
 #endif
-            diag_idx = (seed_next_top_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            diag_idx = (seed_node_seq_len - 1) * seed_band_height + (seed_next_top_diag_iter - seed_next_top_diag);
             
             match[idx] = max<IntType>(match_score + max<IntType>(max<IntType>(seed->match[diag_idx],
                                                                               seed->insert_row[diag_idx]),
@@ -405,7 +407,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: seed band is greater than height 1, can extend column gap into first row" << endl;
 #endif
-            left_idx = (seed_next_top_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+            left_idx = (seed_node_seq_len - 1) * seed_band_height + (seed_next_top_diag_iter - seed_next_top_diag + 1);
             insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
                                                                      seed->insert_row[left_idx] - gap_open),
                                                         seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
@@ -413,14 +415,14 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         
         for (int64_t diag = seed_next_top_diag_iter + 1; diag < seed_next_bottom_diag_iter; diag++) {
-            idx = (diag - top_diag) * ncols;
+            idx = diag - top_diag;
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending a match and column gap into matrix coord (" << diag << ", 0)" << ", rectangular coord coord (" << diag - top_diag << ", 0)" << endl;
 #endif
             
             // extend a match
-            diag_idx = (diag - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            diag_idx = (seed_node_seq_len - 1) * seed_band_height + (diag - seed_next_top_diag);
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[diag] + 5 * nt_table[node_seq[0]] + nt_table[read[diag]]];
             }
@@ -437,7 +439,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
                                                                  seed->insert_col[diag_idx]), match[idx]);
             
             // extend a column gap
-            left_idx = (diag - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+            left_idx = (seed_node_seq_len - 1) * seed_band_height + (diag - seed_next_top_diag + 1);
             
 #ifdef debug_banded_aligner_fill_matrix
             cerr << "[BAMatrix::fill_matrix]: extending match from rectangular coord (" << diag - seed_next_top_diag + 1 << ", " << seed_node_seq_len - 1 << ")" << ", scores are " << (int) seed->match[left_idx] << " (M), " << (int) seed->insert_row[left_idx] << " (Ir), and " << (int) seed->insert_col[left_idx] << " (Ic), current score is " << (int) insert_col[idx] << endl;
@@ -459,8 +461,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
             
             // may only be able to extend a match on last iteration
-            idx = (seed_next_bottom_diag_iter - top_diag) * ncols;
-            diag_idx = (seed_next_bottom_diag_iter - seed_next_top_diag) * seed_node_seq_len + seed_node_seq_len - 1;
+            idx = seed_next_bottom_diag_iter - top_diag;
+            diag_idx = (seed_node_seq_len - 1) * seed_band_height + (seed_next_bottom_diag_iter - seed_next_top_diag);
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[seed_next_bottom_diag_iter] + 5 * nt_table[node_seq[0]] + nt_table[read[seed_next_bottom_diag_iter]]];
             }
@@ -480,7 +482,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #ifdef debug_banded_aligner_fill_matrix
                 cerr << "[BAMatrix::fill_matrix]: can also extend a column gap since already reached edge of matrix" << endl;
 #endif
-                left_idx = (seed_next_bottom_diag_iter - seed_next_top_diag + 2) * seed_node_seq_len - 1;
+                left_idx = (seed_node_seq_len - 1) * seed_band_height + (seed_next_bottom_diag_iter - seed_next_top_diag + 1);
                 insert_col[idx] = max<IntType>(max<IntType>(max<IntType>(seed->match[left_idx] - gap_open,
                                                                          seed->insert_row[left_idx] - gap_open),
                                                             seed->insert_col[left_idx] - gap_extend), insert_col[idx]);
@@ -503,7 +505,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // find position of the first cell in the rectangularized band
         int64_t iter_start = -top_diag;
-        idx = iter_start * ncols;
+        idx = iter_start;
         
         // cap stop index if last diagonal is below bottom of matrix
         int64_t iter_stop = bottom_diag > (int64_t) read.length() ? band_height + (int64_t) read.length() - bottom_diag - 1 : band_height;
@@ -525,8 +527,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         insert_col[idx] = max<IntType>(-2 * gap_open, insert_col[idx]);
         
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = idx - ncols;
+            idx = i;
+            up_idx = idx - 1;
             // score of a match in this cell
             IntType match_score;
             if (qual_adjusted) {
@@ -555,8 +557,8 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         // compute the insert row scores without any cases for lead gaps (these can be safely computed after
         // the POA iterations since they do not cross node boundaries)
         for (int64_t i = iter_start + 1; i < iter_stop; i++) {
-            idx = i * ncols;
-            up_idx = (i - 1) * ncols;
+            idx = i;
+            up_idx = i - 1;
             
             insert_row[idx] = max<IntType>(max<IntType>(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
                                            insert_col[up_idx] - gap_open);
@@ -578,7 +580,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         int64_t iter_start = top_diag_outside ? -(top_diag + j) : 0;
         int64_t iter_stop = bottom_diag_outside ? band_height + (int64_t) read.length() - bottom_diag - j - 1 : band_height;
         
-        idx = iter_start * ncols + j;
+        idx = j * band_height + iter_start;
         
         IntType match_score;
         if (qual_adjusted) {
@@ -596,7 +598,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
 #endif
         }
         else {
-            diag_idx = iter_start * ncols + (j - 1);
+            diag_idx = (j - 1) * band_height + iter_start;
             // cells should be present to do normal diagonal iteration
             match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
         }
@@ -612,7 +614,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // normal iteration along row unless band height is 1
         if (band_height != 1) {
-            int64_t left_idx = (iter_start + 1) * ncols + (j - 1);
+            int64_t left_idx = (j - 1) * band_height + iter_start + 1;
             insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
                                   insert_col[left_idx] - gap_extend);
         }
@@ -621,30 +623,37 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         }
         
         
+        // the interior of the column: every cell here has all of its predecessors in the band, and since
+        // the band is stored by column they are all contiguous, so the match and insert column scores
+        // (which only depend on the previous column) are computed in branch-free loops that the compiler
+        // can vectorize, and only the insert row scores, which depend on the cell above, are done in order
+        IntType* col_match = match + j * band_height;
+        IntType* col_insert_row = insert_row + j * band_height;
+        IntType* col_insert_col = insert_col + j * band_height;
+        const IntType* prev_match = match + (j - 1) * band_height;
+        const IntType* prev_insert_row = insert_row + (j - 1) * band_height;
+        const IntType* prev_insert_col = insert_col + (j - 1) * band_height;
+        
+        // the read bases down a column are consecutive, so their match scores are a contiguous run
+        // of the query profile
+        const int8_t* profile_row = query_profile + read.size() * nt_table[node_seq[j]] + top_diag + j;
         for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
-            // indices of the current and previous cells in the rectangularized band
-            idx = i * ncols + j;
-            up_idx = (i - 1) * ncols + j;
-            diag_idx = i * ncols + (j - 1);
-            left_idx = (i + 1) * ncols + (j - 1);
-            
-            if (qual_adjusted) {
-                match_score = score_mat[25 * base_quality[i + top_diag + j] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
-            }
-            else {
-                match_score = score_mat[5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag + j]]];
-            }
-            
-            match[idx] = match_score + max(max(match[diag_idx], insert_row[diag_idx]), insert_col[diag_idx]);
-            
-            insert_row[idx] = max(max(match[up_idx] - gap_open, insert_row[up_idx] - gap_extend),
-                                  insert_col[up_idx] - gap_open);
+            col_match[i] = profile_row[i];
+        }
+        
+        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
+            col_match[i] = col_match[i] + max(max(prev_match[i], prev_insert_row[i]), prev_insert_col[i]);
             
-            insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
-                                  insert_col[left_idx] - gap_extend);
+            col_insert_col[i] = max(max(prev_match[i + 1] - gap_open, prev_insert_row[i + 1] - gap_open),
+                                    prev_insert_col[i + 1] - gap_extend);
+        }
+        
+        for (int64_t i = iter_start + 1; i < iter_stop - 1; i++) {
+            col_insert_row[i] = max(max(col_match[i - 1] - gap_open, col_insert_row[i - 1] - gap_extend),
+                                    col_insert_col[i - 1] - gap_open);
             
 #ifdef debug_banded_aligner_fill_matrix
-            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), match score of node char " << j << " (" << node_seq[j] << ") and read char " << i + top_diag + j << " (" << read[i + top_diag + j] << ") is " << (int) match_score << ", leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) match[idx] << endl;
+            cerr << "[BAMatrix::fill_matrix]: in interior of matrix at rectangle coords (" << i << ", " << j << "), read char " << i + top_diag + j << " (" << read[i + top_diag + j] << "), node char " << j << " (" << node_seq[j] << "), leading gap length is " << cumulative_seq_len + j << " for total match matrix score of " << (int) col_match[i] << endl;
 #endif
         }
         
@@ -652,9 +661,9 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
         
         // skip this step in edge case where read length is 1
         if (iter_stop - 1 > iter_start) {
-            idx = (iter_stop - 1) * ncols + j;
-            up_idx = (iter_stop - 2) * ncols + j;
-            diag_idx = (iter_stop - 1) * ncols + (j - 1);
+            idx = j * band_height + iter_stop - 1;
+            up_idx = j * band_height + iter_stop - 2;
+            diag_idx = (j - 1) * band_height + iter_stop - 1;
             
             if (qual_adjusted) {
                 match_score = score_mat[25 * base_quality[iter_stop + top_diag + j - 1] + 5 * nt_table[node_seq[j]] + nt_table[read[iter_stop + top_diag + j - 1]]];
@@ -670,7 +679,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::fill_matrix(int8_t* score_mat, int8
             
             if (bottom_diag_outside) {
                 // along the bottom edge of the matrix, so the cell to the right is still there
-                left_idx = iter_stop * ncols + (j - 1);
+                left_idx = (j - 1) * band_height + iter_stop;
                 insert_col[idx] = max(max(match[left_idx] - gap_open, insert_row[left_idx] - gap_open),
                                       insert_col[left_idx] - gap_extend);
                 
@@ -782,7 +791,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         }
         
         // find optimal traceback
-        idx = i * ncols + j;
+        idx = j * band_height + i;
         bool found_trace = false;
         switch (curr_mat) {
             case Match:
@@ -800,7 +809,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = match[idx];
-                next_idx = i * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i;
                 
                 IntType match_score;
                 if (qual_adjusted) {
@@ -888,7 +897,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_row[idx];
-                next_idx = (i - 1) * ncols + j;
+                next_idx = j * band_height + i - 1;
                 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -947,7 +956,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 }
                 
                 curr_score = insert_col[idx];
-                next_idx = (i + 1) * ncols + j - 1;
+                next_idx = (j - 1) * band_height + i + 1;
 
                 source_score = match[next_idx];
                 score_diff = curr_score - (source_score - gap_open);
@@ -1203,7 +1212,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
         switch (curr_mat) {
             case Match:
             {
-                curr_score = match[i * ncols];
+                curr_score = match[i];
                 if (qual_adjusted) {
                     match_score = score_mat[25 * base_quality[i + top_diag] + 5 * nt_table[node_seq[j]] + nt_table[read[i + top_diag]]];
                 }
@@ -1215,7 +1224,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
                 
             case InsertCol:
             {
-                curr_score = insert_col[i * ncols];
+                curr_score = insert_col[i];
                 break;
             }
                 
@@ -1294,7 +1303,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::traceback_internal(BABuilder& build
             
             int64_t seed_col = seed_ncols - 1;
             int64_t seed_row = -(seed_extended_top_diag - top_diag) + i + (curr_mat == InsertCol);
-            next_idx = seed_row * seed_ncols + seed_col;
+            next_idx = seed_col * (seed->bottom_diag - seed->top_diag + 1) + seed_row;
             
 #ifdef debug_banded_aligner_traceback
             cerr << "[BAMatrix::traceback_internal] checking seed rectangular coordinates (" << seed_row << ", " << seed_col << "), with indices calculated from current diagonal " << curr_diag << " (top diag " << top_diag << " + offset " << i << "), seed top diagonal " << seed->top_diag << ", seed seq length " << seed_ncols << " with insert column offset " << (curr_mat == InsertCol) << endl;
@@ -1680,7 +1689,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_matrix(matrix_t which_mat) {
                 cerr << "\t.";
             }
             else {
-                cerr << "\t" << (int) band_rect[(diag - top_diag) * ncols + j];
+                cerr << "\t" << (int) band_rect[j * (bottom_diag - top_diag + 1) + diag - top_diag];
             }
         }
         cerr << endl;
@@ -1735,7 +1744,7 @@ void BandedGlobalAligner<IntType>::BAMatrix::print_band(matrix_t which_mat) {
                 cerr << "\t.";
             }
             else {
-                cerr << "\t" << (int) band_rect[i * ncols + j];
+                cerr << "\t" << (int) band_rect[j * band_height + i];
             }
         }
         cerr << endl;
@@ -2222,6 +2231,30 @@ void BandedGlobalAligner<IntType>::shortest_seq_paths(vector<vector<int64_t>>& n
     }
 }
 
+template <class IntType>
+void BandedGlobalAligner<IntType>::build_query_profile(int8_t* score_mat, int8_t* nt_table) {
+    
+    const string& read = alignment.sequence();
+    const string& base_quality = alignment.quality();
+    size_t read_length = read.size();
+    
+    query_profile.resize(5 * read_length);
+    for (int64_t ref = 0; ref < 5; ref++) {
+        int8_t* profile_row = query_profile.data() + ref * read_length;
+        const int8_t* score_row = score_mat + 5 * ref;
+        if (adjust_for_base_quality) {
+            for (size_t i = 0; i < read_length; i++) {
+                profile_row[i] = score_row[25 * base_quality[i] + nt_table[read[i]]];
+            }
+        }
+        else {
+            for (size_t i = 0; i < read_length; i++) {
+                profile_row[i] = score_row[nt_table[read[i]]];
+            }
+        }
+    }
+}
+
 template <class IntType>
 void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend) {
     
@@ -2232,6 +2265,8 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
     }
     IntType min_inf = numeric_limits<IntType>::min() + max<IntType>((IntType) -max_mismatch, max<IntType>(gap_open, gap_extend));
     
+    build_query_profile(score_mat, nt_table);
+    
     
     // fill each nodes matrix in topological order
     for (int64_t i = 0; i < topological_order.size(); i++) {
@@ -2252,7 +2287,8 @@ void BandedGlobalAligner<IntType>::align(int8_t* score_mat, int8_t* nt_table, in
 #ifdef debug_banded_aligner_fill_matrix
         cerr << "[BandedGlobalAligner::align] node is not masked, filling matrix" << endl;
 #endif
-        band_matrix->fill_matrix(score_mat, nt_table, gap_open, gap_extend, adjust_for_base_quality, min_inf);
+        band_matrix->fill_matrix(score_mat, nt_table, query_profile.data(), gap_open, gap_extend,
+                                 adjust_for_base_quality, min_inf);
     }
     
     traceback(score_mat, nt_table, gap_open, gap_extend, min_inf);
@@ -2406,7 +2442,7 @@ BandedGlobalAligner<IntType>::AltTracebackStack::AltTracebackStack(int64_t max_m
                 int64_t final_col = ncols - 1;
                 int64_t final_row = band_matrix->bottom_diag + ncols > read_length ? read_length - band_matrix->top_diag - ncols : band_matrix->bottom_diag - band_matrix->top_diag;
                 
-                int64_t final_idx = final_row * ncols + final_col;
+                int64_t final_idx = final_col * (band_matrix->bottom_diag - band_matrix->top_diag + 1) + final_row;
                 
                 if (band_matrix->alignment.sequence().empty()) {
                     // if the read sequence is empty then we can only insert relative to the graph
@@ -109,6 +109,11 @@ namespace vg {
         int64_t max_multi_alns;
         /// Use base quality adjusted scoring for alignments?
         bool adjust_for_base_quality;
+        /// The match score of each read base against each of the 5 reference characters (ACGTN), with
+        /// the scores against one reference character contiguous in read order, so that filling a
+        /// column of a band reads its match scores with unit stride instead of gathering them from
+        /// the (possibly quality adjusted) score matrix
+        vector<int8_t> query_profile;
         
         /// Dynamic programming matrices for each node
         vector<BAMatrix*> banded_matrices;
@@ -128,6 +133,9 @@ namespace vg {
                             int64_t band_padding, bool permissive_banding = false,
                             bool adjust_for_base_quality = false);
         
+        /// Build the query profile of the read from the score matrix
+        void build_query_profile(int8_t* score_mat, int8_t* nt_table);
+        
         /// Traceback through dynamic programming matrices to compute alignment
         void traceback(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, IntType min_inf);
         
@@ -160,8 +168,8 @@ namespace vg {
         ~BAMatrix();
         
         /// Use DP to fill the band with alignment scores
-        void fill_matrix(int8_t* score_mat, int8_t* nt_table, int8_t gap_open, int8_t gap_extend, bool qual_adjusted,
-                         IntType min_inf);
+        void fill_matrix(int8_t* score_mat, int8_t* nt_table, const int8_t* query_profile, int8_t gap_open,
+                         int8_t gap_extend, bool qual_adjusted, IntType min_inf);
         
         /// Traceback through the band after using DP to fill it
         void traceback(BABuilder& builder, AltTracebackStack& traceback_stack, matrix_t start_mat, int8_t* score_mat,
@@ -0,0 +1,434 @@
+#include "batch_aligner.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VG_BATCH_ALIGNER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vg {
+
+using namespace std;
+
+// Codes for the bases, one for anything else, and one for the padding past
+// the end of a lane's read or graph, which matches nothing real
+static const uint8_t CODE_N = 4;
+static const uint8_t CODE_PAD = 5;
+
+static inline uint8_t base_code(char base) {
+    switch (base) {
+    case 'A':
+        return 0;
+    case 'C':
+        return 1;
+    case 'G':
+        return 2;
+    case 'T':
+        return 3;
+    default:
+        return CODE_N;
+    }
+}
+
+// Reads may be in either case, but the graph is scored as gssw sees it after
+// nonATGCNtoN, with anything else as an N
+static inline uint8_t read_base_code(char base) {
+    return base_code(toupper(base));
+}
+
+// Saturating unsigned byte arithmetic across the lanes. SSE2 is part of
+// x86-64, so it needs no check; elsewhere the lanes are looped over.
+#ifdef VG_BATCH_ALIGNER_SSE2
+
+typedef __m128i Lanes;
+
+static inline Lanes lanes_load(const uint8_t* from) { return _mm_loadu_si128((const __m128i*) from); }
+static inline void lanes_store(uint8_t* to, Lanes a) { _mm_storeu_si128((__m128i*) to, a); }
+static inline Lanes lanes_set(uint8_t value) { return _mm_set1_epi8((char) value); }
+static inline Lanes lanes_adds(Lanes a, Lanes b) { return _mm_adds_epu8(a, b); }
+static inline Lanes lanes_subs(Lanes a, Lanes b) { return _mm_subs_epu8(a, b); }
+static inline Lanes lanes_max(Lanes a, Lanes b) { return _mm_max_epu8(a, b); }
+static inline Lanes lanes_equal(Lanes a, Lanes b) { return _mm_cmpeq_epi8(a, b); }
+static inline Lanes lanes_and(Lanes a, Lanes b) { return _mm_and_si128(a, b); }
+static inline Lanes lanes_or(Lanes a, Lanes b) { return _mm_or_si128(a, b); }
+static inline Lanes lanes_and_not(Lanes a, Lanes b) { return _mm_andnot_si128(a, b); }
+
+#else
+
+struct Lanes {
+    uint8_t lane[BatchAligner::LANES];
+};
+
+static inline Lanes lanes_load(const uint8_t* from) {
+    Lanes a;
+    copy(from, from + BatchAligner::LANES, a.lane);
+    return a;
+}
+static inline void lanes_store(uint8_t* to, Lanes a) { copy(a.lane, a.lane + BatchAligner::LANES, to); }
+static inline Lanes lanes_set(uint8_t value) {
+    Lanes a;
+    fill(a.lane, a.lane + BatchAligner::LANES, value);
+    return a;
+}
+
+#define VG_BATCH_ALIGNER_LANEWISE(name, expression) \
+    static inline Lanes name(Lanes a, Lanes b) { \
+        Lanes c; \
+        for (size_t l = 0; l < BatchAligner::LANES; l++) { \
+            int x = a.lane[l]; \
+            int y = b.lane[l]; \
+            c.lane[l] = (uint8_t) (expression); \
+        } \
+        return c; \
+    }
+
+VG_BATCH_ALIGNER_LANEWISE(lanes_adds, min(x + y, 255))
+VG_BATCH_ALIGNER_LANEWISE(lanes_subs, max(x - y, 0))
+VG_BATCH_ALIGNER_LANEWISE(lanes_max, max(x, y))
+VG_BATCH_ALIGNER_LANEWISE(lanes_equal, x == y ? 255 : 0)
+VG_BATCH_ALIGNER_LANEWISE(lanes_and, x & y)
+VG_BATCH_ALIGNER_LANEWISE(lanes_or, x | y)
+VG_BATCH_ALIGNER_LANEWISE(lanes_and_not, ~x & y)
+
+#undef VG_BATCH_ALIGNER_LANEWISE
+
+#endif
+
+BatchAligner::BatchAligner(int8_t match, int8_t mismatch, int8_t gap_open, int8_t gap_extension,
+                           int8_t full_length_bonus) :
+    match(match), mismatch(mismatch), gap_open(gap_open), gap_extension(gap_extension),
+    full_length_bonus(full_length_bonus) {
+    // nothing else to do
+}
+
+bool BatchAligner::fits(size_t read_length, size_t graph_length) {
+    return read_length > 0 && graph_length > 0 && fits_together(read_length, graph_length);
+}
+
+bool BatchAligner::fits_together(size_t max_read_length, size_t max_graph_length) {
+    return max_read_length <= MAX_CELLS && max_graph_length <= MAX_CELLS / max(max_read_length, (size_t) 1);
+}
+
+void BatchAligner::align(const vector<BatchAlignmentJob>& jobs, vector<BatchAlignmentResult>& results,
+                         bool traceback) const {
+
+    if (jobs.size() > LANES) {
+        throw runtime_error("[vg::BatchAligner] more jobs than lanes");
+    }
+    results.clear();
+    results.resize(jobs.size());
+    if (jobs.empty()) {
+        return;
+    }
+
+    size_t rows = 0;
+    size_t columns = 0;
+    for (auto& job : jobs) {
+        rows = max(rows, job.read_length);
+        columns = max(columns, job.graph_length);
+    }
+    if (rows == 0 || columns == 0 || !fits_together(rows, columns)) {
+        throw runtime_error("[vg::BatchAligner] batch does not fit in the DP matrices");
+    }
+
+    // the working space is kept between batches in each thread, so batches don't allocate
+    thread_local vector<uint8_t> read_codes;
+    thread_local vector<uint8_t> column_codes;
+    thread_local vector<uint8_t> row_end_bonus;
+    thread_local vector<uint8_t> row_mask;
+    thread_local vector<uint8_t> H;
+    thread_local vector<uint8_t> F;
+    thread_local vector<uint8_t> column_max;
+    thread_local vector<uint8_t> pred_H;
+    thread_local vector<uint8_t> pred_F;
+
+    // everything is laid out with the lanes innermost, and the DP matrices
+    // column by column, so each column is a contiguous run of rows
+    read_codes.assign(rows * LANES, CODE_PAD);
+    column_codes.assign(columns * LANES, CODE_PAD);
+    row_end_bonus.assign(rows * LANES, 0);
+    row_mask.assign(rows * LANES, 0);
+    H.resize(rows * columns * LANES);
+    F.resize(rows * columns * LANES);
+    column_max.resize(columns * LANES);
+    pred_H.resize(rows * LANES);
+    pred_F.resize(rows * LANES);
+
+    for (size_t l = 0; l < jobs.size(); l++) {
+        const BatchAlignmentJob& job = jobs[l];
+        for (size_t i = 0; i < job.read_length; i++) {
+            read_codes[i * LANES + l] = read_base_code(job.read[i]);
+            row_mask[i * LANES + l] = 255;
+        }
+        // ending at the last base of the read earns the full length bonus
+        row_end_bonus[(job.read_length - 1) * LANES + l] = full_length_bonus;
+        for (size_t t = 0; t < job.graph_length; t++) {
+            column_codes[t * LANES + l] = base_code(job.graph_sequence[t]);
+        }
+    }
+
+    // the scores as they go into the unsigned cells: every base score is
+    // shifted up by the bias, and the bias is taken off again after adding it
+    uint8_t bias = mismatch;
+    const Lanes lanes_bias = lanes_set(bias);
+    const Lanes lanes_match = lanes_set(match + bias);
+    const Lanes lanes_gap_open = lanes_set(gap_open);
+    const Lanes lanes_gap_extension = lanes_set(gap_extension);
+    const Lanes lanes_full_length_bonus = lanes_set(full_length_bonus);
+    const Lanes lanes_n = lanes_set(CODE_N);
+    const Lanes lanes_zero = lanes_set(0);
+
+    // the graph_sequence position where a node of a lane ends
+    auto node_end = [&](size_t l, size_t node) {
+        const vector<size_t>& starts = *jobs[l].node_starts;
+        return (node + 1 < starts.size() ? starts[node + 1] : jobs[l].graph_length) - 1;
+    };
+
+    // point straight into the buffers, so the loops don't go through the thread locals
+    const uint8_t* read_code_data = read_codes.data();
+    const uint8_t* column_code_data = column_codes.data();
+    const uint8_t* row_end_bonus_data = row_end_bonus.data();
+    const uint8_t* row_mask_data = row_mask.data();
+    uint8_t* H_data = H.data();
+    uint8_t* F_data = F.data();
+    uint8_t* column_max_data = column_max.data();
+
+    // the node each lane is in at the current column
+    vector<size_t> lane_node(jobs.size(), 0);
+    vector<size_t> starting_lanes;
+
+    for (size_t t = 0; t < columns; t++) {
+
+        // find the lanes that start a node here, and so don't just follow on from the last column
+        starting_lanes.clear();
+        for (size_t l = 0; l < jobs.size(); l++) {
+            const vector<size_t>& starts = *jobs[l].node_starts;
+            if (t > 0 && t < jobs[l].graph_length && lane_node[l] + 1 < starts.size()
+                && starts[lane_node[l] + 1] == t) {
+                lane_node[l]++;
+                starting_lanes.push_back(l);
+            }
+        }
+
+        // gather the best of the columns before this one in each lane
+        const uint8_t* column_pred_H;
+        const uint8_t* column_pred_F;
+        if (t == 0) {
+            // the first node of each lane has nothing before it
+            fill(pred_H.begin(), pred_H.end(), 0);
+            fill(pred_F.begin(), pred_F.end(), 0);
+            column_pred_H = pred_H.data();
+            column_pred_F = pred_F.data();
+        } else if (starting_lanes.empty()) {
+            // every lane follows on from the last column
+            column_pred_H = H_data + (t - 1) * rows * LANES;
+            column_pred_F = F_data + (t - 1) * rows * LANES;
+        } else {
+            copy(H_data + (t - 1) * rows * LANES, H_data + t * rows * LANES, pred_H.begin());
+            copy(F_data + (t - 1) * rows * LANES, F_data + t * rows * LANES, pred_F.begin());
+            for (size_t l : starting_lanes) {
+                const vector<size_t>& predecessors = (*jobs[l].predecessors)[lane_node[l]];
+                for (size_t i = 0; i < jobs[l].read_length; i++) {
+                    uint8_t best_H = 0;
+                    uint8_t best_F = 0;
+                    for (size_t predecessor : predecessors) {
+                        size_t cell = (node_end(l, predecessor) * rows + i) * LANES + l;
+                        best_H = max(best_H, H_data[cell]);
+                        best_F = max(best_F, F_data[cell]);
+                    }
+                    pred_H[i * LANES + l] = best_H;
+                    pred_F[i * LANES + l] = best_F;
+                }
+            }
+            column_pred_H = pred_H.data();
+            column_pred_F = pred_F.data();
+        }
+
+        const Lanes column_code = lanes_load(column_code_data + t * LANES);
+        const Lanes column_is_n = lanes_equal(column_code, lanes_n);
+        uint8_t* column_H = H_data + t * rows * LANES;
+        uint8_t* column_F = F_data + t * rows * LANES;
+        // starting at the first base of the read earns the full length bonus
+        Lanes diagonal = lanes_full_length_bonus;
+        Lanes h_above = lanes_zero;
+        Lanes e = lanes_zero;
+        Lanes best = lanes_zero;
+        for (size_t i = 0; i < rows; i++) {
+            const Lanes read_code = lanes_load(read_code_data + i * LANES);
+            const Lanes is_n = lanes_or(column_is_n, lanes_equal(read_code, lanes_n));
+            Lanes profile = lanes_and(lanes_equal(read_code, column_code), lanes_match);
+            profile = lanes_or(lanes_and_not(is_n, profile), lanes_and(is_n, lanes_bias));
+
+            Lanes h = lanes_subs(lanes_adds(diagonal, profile), lanes_bias);
+            // deleting this graph base
+            const Lanes h_left = lanes_load(column_pred_H + i * LANES);
+            const Lanes f = lanes_max(lanes_subs(h_left, lanes_gap_open),
+                                      lanes_subs(lanes_load(column_pred_F + i * LANES), lanes_gap_extension));
+            // inserting this read base, which can't start the alignment
+            e = lanes_max(lanes_subs(h_above, lanes_gap_open), lanes_subs(e, lanes_gap_extension));
+            h = lanes_max(h, lanes_max(e, f));
+
+            lanes_store(column_H + i * LANES, h);
+            lanes_store(column_F + i * LANES, f);
+            best = lanes_max(best, lanes_and(lanes_adds(h, lanes_load(row_end_bonus_data + i * LANES)),
+                                             lanes_load(row_mask_data + i * LANES)));
+            h_above = h;
+            diagonal = h_left;
+        }
+        lanes_store(column_max_data + t * LANES, best);
+    }
+
+    for (size_t l = 0; l < jobs.size(); l++) {
+        const BatchAlignmentJob& job = jobs[l];
+        BatchAlignmentResult& result = results[l];
+
+        // find the best cell and make sure nothing could have saturated
+        int32_t best = 0;
+        size_t best_column = 0;
+        for (size_t t = 0; t < job.graph_length; t++) {
+            if (column_max[t * LANES + l] > best) {
+                best = column_max[t * LANES + l];
+                best_column = t;
+            }
+        }
+        if (best == 0 || best + match + bias > 255) {
+            continue;
+        }
+        size_t best_row = 0;
+        while (H[(best_column * rows + best_row) * LANES + l]
+               + (best_row + 1 == job.read_length ? full_length_bonus : 0) != best) {
+            best_row++;
+        }
+
+        result.score = best;
+        result.read_end = best_row + 1;
+        result.graph_end = best_column;
+
+        if (!traceback) {
+            result.aligned = true;
+            continue;
+        }
+
+        auto cell_H = [&](size_t t, size_t i) -> int32_t {
+            return H[(t * rows + i) * LANES + l];
+        };
+        auto cell_F = [&](size_t t, size_t i) -> int32_t {
+            return F[(t * rows + i) * LANES + l];
+        };
+        auto score = [&](size_t t, size_t i) -> int32_t {
+            uint8_t read_base = read_codes[i * LANES + l];
+            uint8_t graph_base = column_codes[t * LANES + l];
+            if (read_base == CODE_N || graph_base == CODE_N) {
+                return 0;
+            }
+            return read_base == graph_base ? match : -mismatch;
+        };
+        // the columns before column t in its lane
+        vector<size_t> preceding;
+        auto find_preceding = [&](size_t t) {
+            preceding.clear();
+            const vector<size_t>& starts = *job.node_starts;
+            size_t node = upper_bound(starts.begin(), starts.end(), t) - starts.begin() - 1;
+            if (starts[node] != t) {
+                preceding.push_back(t - 1);
+            } else {
+                for (size_t predecessor : (*job.predecessors)[node]) {
+                    preceding.push_back(node_end(l, predecessor));
+                }
+            }
+        };
+
+        // walk back through the cells, knowing the value that the current
+        // one must have in the matrix of the current state
+        enum {IN_H, IN_E, IN_F} state = IN_H;
+        size_t t = best_column;
+        size_t i = best_row;
+        int32_t value = cell_H(t, i);
+        bool started = false;
+        bool lost = false;
+        while (!started && !lost) {
+            if (state == IN_H) {
+                int32_t s = score(t, i);
+                if (i == 0) {
+                    if (full_length_bonus + s == value) {
+                        result.operations.emplace_back('M', t);
+                        started = true;
+                        continue;
+                    }
+                } else {
+                    find_preceding(t);
+                    bool moved = false;
+                    for (size_t p : preceding) {
+                        if (cell_H(p, i - 1) + s == value) {
+                            result.operations.emplace_back('M', t);
+                            if (cell_H(p, i - 1) == 0) {
+                                // nothing before is worth keeping, so the alignment starts here
+                                started = true;
+                            } else {
+                                value = cell_H(p, i - 1);
+                                t = p;
+                                i--;
+                            }
+                            moved = true;
+                            break;
+                        }
+                    }
+                    if (moved) {
+                        continue;
+                    }
+                    if (s == value) {
+                        // starting fresh here
+                        result.operations.emplace_back('M', t);
+                        started = true;
+                        continue;
+                    }
+                }
+                // not from the diagonal, so from one of the gaps
+                state = cell_F(t, i) == value ? IN_F : IN_E;
+            } else if (state == IN_F) {
+                result.operations.emplace_back('D', t);
+                find_preceding(t);
+                lost = true;
+                for (size_t p : preceding) {
+                    if (cell_H(p, i) - gap_open == value) {
+                        state = IN_H;
+                        value = cell_H(p, i);
+                    } else if (cell_F(p, i) - gap_extension == value) {
+                        value = cell_F(p, i);
+                    } else {
+                        continue;
+                    }
+                    t = p;
+                    lost = false;
+                    break;
+                }
+            } else {
+                result.operations.emplace_back('I', t);
+                if (i == 0) {
+                    lost = true;
+                } else if (cell_H(t, i - 1) - gap_open == value) {
+                    state = IN_H;
+                    value = cell_H(t, i - 1);
+                    i--;
+                } else {
+                    value += gap_extension;
+                    i--;
+                }
+            }
+        }
+        if (lost) {
+            // shouldn't happen, but leave it for the caller to redo
+            result.operations.clear();
+            continue;
+        }
+
+        reverse(result.operations.begin(), result.operations.end());
+        result.read_begin = i;
+        result.aligned = true;
+    }
+}
+
+}
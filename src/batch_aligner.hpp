@@ -0,0 +1,100 @@
+#ifndef VG_BATCH_ALIGNER_HPP_INCLUDED
+#define VG_BATCH_ALIGNER_HPP_INCLUDED
+
+/**
+ * \file batch_aligner.hpp: local alignment of many short reads, each against
+ * its own small acyclic graph, with one SIMD lane per read. gssw vectorizes
+ * down the read of a single alignment, which leaves most of its lanes idle
+ * when the read is short, so for batches of short reads it is faster to give
+ * every read a lane of its own and fill the DP matrices of up to 16 of them
+ * at once, in 8-bit cells.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * One local alignment for a BatchAligner: a read against a graph given as the
+ * sequences of its nodes laid end to end, in an order where every edge goes
+ * forward. Nothing is copied, so everything pointed to must outlive the
+ * alignment.
+ */
+struct BatchAlignmentJob {
+    /// The read
+    const char* read = nullptr;
+    size_t read_length = 0;
+    /// The node sequences, concatenated in order
+    const char* graph_sequence = nullptr;
+    size_t graph_length = 0;
+    /// Where each node starts in graph_sequence. The first starts at 0.
+    const vector<size_t>* node_starts = nullptr;
+    /// For each node, the indexes of the nodes with edges into it, which must
+    /// all be smaller than its own
+    const vector<vector<size_t>>* predecessors = nullptr;
+};
+
+/**
+ * The best local alignment of a BatchAlignmentJob, with full length bonuses.
+ */
+struct BatchAlignmentResult {
+    /// False if the lane couldn't do this one, because its score was too big
+    /// for 8 bits or nothing aligned, and it needs doing another way
+    bool aligned = false;
+    int32_t score = 0;
+    /// The part of the read that is aligned, with the rest soft clipped
+    size_t read_begin = 0;
+    size_t read_end = 0;
+    /// The last graph_sequence position aligned
+    size_t graph_end = 0;
+    /// The alignment from its start, if traced back, as operations and the
+    /// graph_sequence positions they are at: 'M' aligns the next read base to
+    /// the position, 'D' deletes the position, and 'I' inserts the next read
+    /// base after it
+    vector<pair<char, size_t>> operations;
+};
+
+/**
+ * Aligns up to LANES jobs at a time with the scoring of an Aligner. Bases
+ * other than ACGT (or acgt in the read) score 0 against anything, and an
+ * alignment can't start with an insertion. The DP matrices are kept so the
+ * alignments can be traced back, which bounds the size of a batch. Needs no
+ * state of its own, so one can be used from many threads at once.
+ */
+class BatchAligner {
+public:
+    /// How many jobs are aligned together
+    static const size_t LANES = 16;
+    /// The most cells of DP matrix a batch can use in each lane (longest read
+    /// times longest graph)
+    static const size_t MAX_CELLS = 1 << 18;
+
+    BatchAligner(int8_t match, int8_t mismatch, int8_t gap_open, int8_t gap_extension, int8_t full_length_bonus);
+
+    /// Could a job of this size go in a batch?
+    static bool fits(size_t read_length, size_t graph_length);
+
+    /// Could jobs with these longest reads and graphs go in one batch?
+    static bool fits_together(size_t max_read_length, size_t max_graph_length);
+
+    /// Align up to LANES jobs, which must fit together, and put their results
+    /// in results. Only finds the score and end of each alignment unless
+    /// traceback is set.
+    void align(const vector<BatchAlignmentJob>& jobs, vector<BatchAlignmentResult>& results, bool traceback) const;
+
+private:
+    int32_t match;
+    int32_t mismatch;
+    int32_t gap_open;
+    int32_t gap_extension;
+    int32_t full_length_bonus;
+};
+
+}
+
+#endif
@@ -187,17 +187,65 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
     
 }
 
+void write_json(ostream& out, const BenchmarkResult& result, const BenchmarkParams& params) {
+    // We report times in fractional us, like the TSV
+    using frac_secs = chrono::duration<double, std::micro>;
+    
+    // Names are our own, but escape them anyway so the output is always valid
+    string escaped_name;
+    for (char c : result.name) {
+        if (c == '"' || c == '\\') {
+            escaped_name.push_back('\\');
+        }
+        escaped_name.push_back(c);
+    }
+    
+    out << "{\"name\": \"" << escaped_name << "\""
+        << ", \"size\": " << params.size
+        << ", \"threads\": " << params.threads
+        << ", \"runs\": " << result.runs
+        << ", \"test_us\": " << chrono::duration_cast<frac_secs>(result.test_mean).count()
+        << ", \"test_stddev_us\": " << chrono::duration_cast<frac_secs>(result.test_stddev).count()
+        << ", \"control_us\": " << chrono::duration_cast<frac_secs>(result.control_mean).count()
+        << ", \"control_stddev_us\": " << chrono::duration_cast<frac_secs>(result.control_stddev).count()
+        << ", \"score\": " << result.score()
+        << ", \"score_error\": " << result.score_error()
+        << "}";
 }
 
+RegisteredBenchmark::RegisteredBenchmark(const string& name, const string& description,
+    const function<BenchmarkResult(const BenchmarkParams&)>& benchmark) : name(name),
+    description(description), benchmark(benchmark) {
+    
+    // Add this benchmark to the registry
+    RegisteredBenchmark::get_registry()[name] = this;
+}
 
+const string& RegisteredBenchmark::get_name() const {
+    return name;
+}
 
+const string& RegisteredBenchmark::get_description() const {
+    return description;
+}
 
+BenchmarkResult RegisteredBenchmark::run(const BenchmarkParams& params) const {
+    BenchmarkResult result = benchmark(params);
+    // Always report under our registered name
+    result.name = name;
+    return result;
+}
 
+void RegisteredBenchmark::for_each(const function<void(const RegisteredBenchmark&)>& lambda) {
+    for (auto& kv : RegisteredBenchmark::get_registry()) {
+        lambda(*kv.second);
+    }
+}
 
+map<string, RegisteredBenchmark*>& RegisteredBenchmark::get_registry() {
+    // We just keep a static local registry, which gets constructed on first use.
+    static map<string, RegisteredBenchmark*> registry;
+    return registry;
+}
 
-
-
-
-
-
-
+}
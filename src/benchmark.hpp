@@ -4,6 +4,7 @@
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <string>
 
 /** 
@@ -64,6 +65,83 @@ BenchmarkResult run_benchmark(const string& name, size_t iterations, const funct
  */
 BenchmarkResult run_benchmark(const string& name, size_t iterations, const function<void(void)>&  setup, const function<void(void)>& under_test);
 
+/**
+ * The parameters that a registered benchmark is run with.
+ */
+struct BenchmarkParams {
+    /// How big a problem to set up. Each benchmark decides what this counts
+    /// (graph bubbles, reads, alignments, ...).
+    size_t size = 100;
+    /// How many OpenMP threads to do the work under test on
+    size_t threads = 1;
+    /// How many times to run the work under test
+    size_t iterations = 100;
+};
+
+/**
+ * Benchmark results can be output as a line of JSON, along with the
+ * parameters they were obtained with, for comparison across commits
+ */
+void write_json(ostream& out, const BenchmarkResult& result, const BenchmarkParams& params);
+
+/**
+ * Represents a named benchmark that can be run at different sizes and thread
+ * counts. Like a Subcommand, it registers itself on construction in a static
+ * registry, so benchmarks are created as static global objects:
+ *
+ *     static RegisteredBenchmark frobnicate_benchmark("frobnicate", "frobnicate a graph",
+ *         [](const BenchmarkParams& params) {
+ *             // set up a graph of params.size nodes...
+ *             return run_benchmark("frobnicate", params.iterations, [&]() {
+ *                 // frobnicate on params.threads threads...
+ *             });
+ *         });
+ *
+ * The benchmark function does its own setup, outside of the timed region, and
+ * is responsible for using the requested number of threads.
+ */
+class RegisteredBenchmark {
+public:
+
+    /**
+     * Make and register a benchmark with the given name and description,
+     * which calls the given function to set up and time a run.
+     */
+    RegisteredBenchmark(const string& name, const string& description,
+                        const function<BenchmarkResult(const BenchmarkParams&)>& benchmark);
+
+    /**
+     * Get the name of a benchmark.
+     */
+    const string& get_name() const;
+
+    /**
+     * Get the description of a benchmark.
+     */
+    const string& get_description() const;
+
+    /**
+     * Set up and run the benchmark with the given parameters.
+     */
+    BenchmarkResult run(const BenchmarkParams& params) const;
+
+    /**
+     * Call the given lambda with each registered benchmark, in order by name.
+     */
+    static void for_each(const function<void(const RegisteredBenchmark&)>& lambda);
+
+private:
+    /**
+     * We keep the registry in a static variable inside a static method, so
+     * that it is constructed before any benchmark tries to register with it.
+     */
+    static map<string, RegisteredBenchmark*>& get_registry();
+
+    string name;
+    string description;
+    function<BenchmarkResult(const BenchmarkParams&)> benchmark;
+};
+
 
 }
 
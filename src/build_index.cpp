@@ -16,13 +16,13 @@ void build_gcsa_lcp(VG& graph,
     Node* head_node = nullptr; Node* tail_node = nullptr;
     // TODO add this for MutableHandleGraphs
     graph.add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
-    string tmpfile = write_gcsa_kmers_to_tmpfile(graph, kmer_size,
-                                                 head_id, tail_id,
-                                                 base_file_name);
+    vector<string> tmpfiles = write_gcsa_kmers_to_tmpfiles(graph, kmer_size,
+                                                           head_id, tail_id,
+                                                           base_file_name);
     graph.destroy_node(head_node);
     graph.destroy_node(tail_node);
     // set up the input graph using the kmers
-    gcsa::InputGraph input_graph({ tmpfile }, true);
+    gcsa::InputGraph input_graph(tmpfiles, true);
     gcsa::ConstructionParameters params;
     params.setSteps(doubling_steps);
     params.setLimit(size_limit);
@@ -30,8 +30,10 @@ void build_gcsa_lcp(VG& graph,
     gcsa = new gcsa::GCSA(input_graph, params);
     // and the LCP array construction
     lcp = new gcsa::LCPArray(input_graph, params);
-    // delete the temporary debruijn graph file
-    remove(tmpfile.c_str());
+    // delete the temporary debruijn graph files
+    for (auto& tmpfile : tmpfiles) {
+        remove(tmpfile.c_str());
+    }
     // results returned by reference
 }
 
@@ -293,4 +293,66 @@ set<pos_t> xg_cached_positions_bp_from(pos_t pos, int64_t distance, bool rev, xg
 }
 
 
+const CachedNode& xg_cached_node_record(id_t id, xg::XG* xgidx, NodeRecordCache& node_cache) {
+    const CachedNode* found = node_cache.find(id);
+    if (found == nullptr) {
+        CachedNode record;
+        record.sequence_start = xgidx->node_start(id);
+        record.length = xgidx->node_length(id);
+        found = &node_cache.put(id, record);
+    }
+    return *found;
+}
+
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, NodeRecordCache& node_cache) {
+    return xg_cached_node_record(id, xgidx, node_cache).length;
+}
+
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, NodeRecordCache& node_cache) {
+    const CachedNode& record = xg_cached_node_record(id(pos), xgidx, node_cache);
+    if (is_rev(pos)) {
+        return reverse_complement(xgidx->sequence_char(record.sequence_start + record.length - offset(pos) - 1));
+    } else {
+        return xgidx->sequence_char(record.sequence_start + offset(pos));
+    }
+}
+
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, NodeRecordCache& node_cache, AdjacencyCache& edge_cache) {
+
+    map<pos_t, char> nexts;
+    size_t length = xg_cached_node_length(id(pos), xgidx, node_cache);
+    // if we are still in the node, return the next position and character
+    if (offset(pos) < length - 1) {
+        ++get_offset(pos);
+        nexts[pos] = xg_cached_pos_char(pos, xgidx, node_cache);
+        return nexts;
+    }
+    
+    const CachedAdjacency* adjacency = edge_cache.find(id(pos));
+    if (adjacency == nullptr) {
+        // Walk the handle graph once for both sides and remember the results
+        CachedAdjacency found;
+        handle_t handle = xgidx->get_handle(id(pos), false);
+        xgidx->follow_edges(handle, false, [&](const handle_t& next) {
+            found.off_end.emplace_back(xgidx->get_id(next), xgidx->get_is_reverse(next));
+            return true;
+        });
+        xgidx->follow_edges(handle, true, [&](const handle_t& prev) {
+            // Reading the reverse strand, we enter these nodes on their other strand
+            found.off_start.emplace_back(xgidx->get_id(prev), !xgidx->get_is_reverse(prev));
+            return true;
+        });
+        adjacency = &edge_cache.put(id(pos), found);
+    }
+    
+    // Copy the traversals out before we look up characters, since that could
+    // disturb the cache.
+    vector<pair<id_t, bool>> traversals = is_rev(pos) ? adjacency->off_start : adjacency->off_end;
+    for (auto& traversal : traversals) {
+        pos_t p = make_pos_t(traversal.first, traversal.second, 0);
+        nexts[p] = xg_cached_pos_char(p, xgidx, node_cache);
+    }
+    return nexts;
+}
+
 }
@@ -5,6 +5,7 @@
 #include "types.hpp"
 #include "xg.hpp"
 #include "lru_cache.h"
+#include "clock_cache.hpp"
 #include "utility.hpp"
 #include "json2pb.h"
 #include <gcsa/gcsa.h>
@@ -38,6 +39,36 @@ vector<Edge> xg_cached_edges_of(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Ed
 vector<Edge> xg_cached_edges_on_start(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 vector<Edge> xg_cached_edges_on_end(id_t id, xg::XG* xgidx, LRUCache<id_t, vector<Edge> >& edge_cache);
 
+/// A packed record of where a node's sequence lives in the xg sequence vector,
+/// which is all we need to read bases off of it.
+struct CachedNode {
+    size_t sequence_start = 0;
+    size_t length = 0;
+};
+
+/// The oriented nodes reachable off each end of a node's forward strand.
+struct CachedAdjacency {
+    /// Next (id, is_reverse) traversals reading forward off the node's end
+    vector<pair<id_t, bool>> off_end;
+    /// Next (id, is_reverse) traversals reading the reverse strand off the node's start
+    vector<pair<id_t, bool>> off_start;
+};
+
+/// Fixed-size, per-thread caches of packed node and adjacency records. These
+/// avoid the list and hash churn of LRUCache and don't copy protobuf messages
+/// around, and they count hits and misses so they can be sized per workload.
+using NodeRecordCache = ClockCache<id_t, CachedNode>;
+using AdjacencyCache = ClockCache<id_t, CachedAdjacency>;
+
+/// Get the packed sequence record for a node, through the cache.
+const CachedNode& xg_cached_node_record(id_t id, xg::XG* xgidx, NodeRecordCache& node_cache);
+/// Get the length of a node, through the cache.
+size_t xg_cached_node_length(id_t id, xg::XG* xgidx, NodeRecordCache& node_cache);
+/// Get the character at a position, through the cache.
+char xg_cached_pos_char(pos_t pos, xg::XG* xgidx, NodeRecordCache& node_cache);
+/// Get the characters at positions after the given position, through the caches.
+map<pos_t, char> xg_cached_next_pos_chars(pos_t pos, xg::XG* xgidx, NodeRecordCache& node_cache, AdjacencyCache& edge_cache);
+
 }
 
 #endif
@@ -0,0 +1,171 @@
+#include "caching_handle_graph.hpp"
+
+#include "utility.hpp"
+
+namespace vg {
+
+using namespace std;
+
+CachingHandleGraph::CachingHandleGraph(const HandleGraph* source, size_t window_width, size_t max_windows) :
+    source(source), window_width(max<size_t>(window_width, 1)), max_windows(max<size_t>(max_windows, 1)) {
+    // Records are handed out by reference, so the windows must never move
+    windows.reserve(this->max_windows);
+}
+
+void CachingHandleGraph::set_source(const HandleGraph* new_source) {
+    if (new_source != source) {
+        source = new_source;
+        clear();
+    }
+}
+
+const HandleGraph* CachingHandleGraph::get_source() const {
+    return source;
+}
+
+void CachingHandleGraph::clear() {
+    windows.clear();
+}
+
+size_t CachingHandleGraph::hits() const {
+    return hit_count;
+}
+
+size_t CachingHandleGraph::misses() const {
+    return miss_count;
+}
+
+const CachingHandleGraph::NodeRecord& CachingHandleGraph::lookup(id_t node_id) const {
+    lookup_count++;
+
+    id_t number = node_id / (id_t) window_width;
+    size_t index = node_id % (id_t) window_width;
+
+    // There are only a few windows, so a scan beats hashing
+    Window* window = nullptr;
+    for (auto& candidate : windows) {
+        if (candidate.number == number) {
+            window = &candidate;
+            break;
+        }
+    }
+
+    if (window == nullptr) {
+        if (windows.size() < max_windows) {
+            windows.emplace_back();
+            window = &windows.back();
+            window->records.resize(window_width);
+        }
+        else {
+            // Reuse the least recently used window
+            window = &windows.front();
+            for (auto& candidate : windows) {
+                if (candidate.last_used < window->last_used) {
+                    window = &candidate;
+                }
+            }
+            for (auto& record : window->records) {
+                record.filled = false;
+            }
+        }
+        window->number = number;
+    }
+    window->last_used = lookup_count;
+
+    NodeRecord& record = window->records[index];
+    if (record.filled) {
+        hit_count++;
+        return record;
+    }
+    miss_count++;
+
+    handle_t handle = source->get_handle(node_id, false);
+    record.sequence = source->get_sequence(handle);
+    record.left.clear();
+    record.right.clear();
+    source->follow_edges(handle, true, [&](const handle_t& prev) {
+        record.left.push_back(prev);
+    });
+    source->follow_edges(handle, false, [&](const handle_t& next) {
+        record.right.push_back(next);
+    });
+    record.filled = true;
+
+    return record;
+}
+
+handle_t CachingHandleGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    return source->get_handle(node_id, is_reverse);
+}
+
+id_t CachingHandleGraph::get_id(const handle_t& handle) const {
+    return source->get_id(handle);
+}
+
+bool CachingHandleGraph::get_is_reverse(const handle_t& handle) const {
+    return source->get_is_reverse(handle);
+}
+
+handle_t CachingHandleGraph::flip(const handle_t& handle) const {
+    return source->flip(handle);
+}
+
+size_t CachingHandleGraph::get_length(const handle_t& handle) const {
+    return lookup(source->get_id(handle)).sequence.size();
+}
+
+string CachingHandleGraph::get_sequence(const handle_t& handle) const {
+    const NodeRecord& record = lookup(source->get_id(handle));
+    return source->get_is_reverse(handle) ? reverse_complement(record.sequence) : record.sequence;
+}
+
+char CachingHandleGraph::get_base(const handle_t& handle, size_t index) const {
+    const string& sequence = lookup(source->get_id(handle)).sequence;
+    return source->get_is_reverse(handle) ? reverse_complement(sequence[sequence.size() - 1 - index]) : sequence[index];
+}
+
+void CachingHandleGraph::copy_sequence(const handle_t& handle, char* buffer) const {
+    const string& sequence = lookup(source->get_id(handle)).sequence;
+    if (source->get_is_reverse(handle)) {
+        for (size_t i = 0; i < sequence.size(); i++) {
+            buffer[i] = reverse_complement(sequence[sequence.size() - 1 - i]);
+        }
+    } else {
+        copy(sequence.begin(), sequence.end(), buffer);
+    }
+}
+
+bool CachingHandleGraph::follow_edges(const handle_t& handle, bool go_left,
+                                      const function<bool(const handle_t&)>& iteratee) const {
+    const NodeRecord& record = lookup(source->get_id(handle));
+    bool is_reverse = source->get_is_reverse(handle);
+    // The iteratee may look up other nodes and evict this one, so work from a copy
+    vector<handle_t> found = (go_left != is_reverse) ? record.left : record.right;
+    if (is_reverse) {
+        // Going one way on the reverse strand is going the other way on the
+        // forward strand, and everything we reach is flipped
+        for (const handle_t& other : found) {
+            if (!iteratee(source->flip(other))) {
+                return false;
+            }
+        }
+    }
+    else {
+        for (const handle_t& other : found) {
+            if (!iteratee(other)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void CachingHandleGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    source->for_each_handle(iteratee, parallel);
+}
+
+size_t CachingHandleGraph::node_size() const {
+    return source->node_size();
+}
+
+}
@@ -0,0 +1,139 @@
+#ifndef VG_CACHING_HANDLE_GRAPH_HPP_INCLUDED
+#define VG_CACHING_HANDLE_GRAPH_HPP_INCLUDED
+
+/**
+ * \file caching_handle_graph.hpp: define a CachingHandleGraph, a read-only
+ * view of another HandleGraph that remembers the sequences and edges it has
+ * looked up, so that repeated subgraph extractions around the same place
+ * don't have to decode them from a succinct index again.
+ */
+
+#include <vector>
+#include <string>
+
+#include "handle.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A HandleGraph that answers queries from another HandleGraph (usually an XG)
+ * and caches the node sequences and edges it has seen. Handles are the
+ * source graph's handles, so they can be passed back and forth freely.
+ *
+ * The cache is kept in windows of consecutive node IDs. When a node from a
+ * new window is needed and all the windows are in use, the least recently
+ * used window is dropped. Sorted input keeps hitting the same few windows, so
+ * neighboring reads reuse each other's lookups.
+ *
+ * Lookups modify the cache, so one of these must only be used by one thread
+ * at a time.
+ */
+class CachingHandleGraph : public HandleGraph {
+public:
+
+    /// Make a cache over the given graph (or over nothing, until set_source()
+    /// is called) with the given number of windows of the given number of
+    /// node IDs each.
+    CachingHandleGraph(const HandleGraph* source = nullptr, size_t window_width = 4096, size_t max_windows = 8);
+
+    /// Start answering queries from a different graph, dropping the cache if
+    /// it is not the graph we already have.
+    void set_source(const HandleGraph* new_source);
+
+    /// Get the graph that queries are answered from
+    const HandleGraph* get_source() const;
+
+    /// Drop everything in the cache
+    void clear();
+
+    /// Return the number of node lookups that were answered from the cache
+    size_t hits() const;
+
+    /// Return the number of node lookups that had to go to the source graph
+    size_t misses() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+    
+    /// Get the base at the given offset in the handle's local forward
+    /// orientation, from the cached sequence. Cached sequences can be evicted,
+    /// so no views are handed out.
+    virtual char get_base(const handle_t& handle, size_t index) const;
+    
+    /// Write the node's sequence, in the handle's orientation, into the buffer.
+    virtual void copy_sequence(const handle_t& handle, char* buffer) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+
+    /// Loop over all the nodes in the source graph. This is not cached.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    /// Return the number of nodes in the source graph
+    virtual size_t node_size() const;
+
+    // We have to pull in the templated versions from HandleGraph
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+    using HandleGraph::get_handle;
+
+private:
+
+    /// Everything we remember about one node, in its forward orientation
+    struct NodeRecord {
+        bool filled = false;
+        string sequence;
+        vector<handle_t> left;
+        vector<handle_t> right;
+    };
+
+    /// The records for one run of consecutive node IDs
+    struct Window {
+        /// The ID of the first node in the window, divided by the width
+        id_t number;
+        /// When the window was last used, in lookups
+        size_t last_used;
+        vector<NodeRecord> records;
+    };
+
+    /// Get the record for the given node, loading it from the source if we
+    /// don't already have it.
+    const NodeRecord& lookup(id_t node_id) const;
+
+    const HandleGraph* source;
+    size_t window_width;
+    size_t max_windows;
+
+    mutable vector<Window> windows;
+    mutable size_t lookup_count = 0;
+    mutable size_t hit_count = 0;
+    mutable size_t miss_count = 0;
+};
+
+}
+
+#endif
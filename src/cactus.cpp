@@ -263,7 +263,8 @@ pair<stCactusGraph*, stList*> vg_to_cactus(VG& graph, const unordered_set<string
     vector<unordered_set<id_t>> weak_components = algorithms::weakly_connected_components(&graph);
        
     // We also want a map so we can efficiently find which component a node lives in.
-    unordered_map<id_t, size_t> node_to_component;
+    id_map<size_t> node_to_component;
+    node_to_component.reserve_ids(graph.min_node_id(), graph.max_node_id(), graph.node_count());
     for (size_t i = 0; i < weak_components.size(); i++) {
         if (weak_components[i].size() == 1) {
             // If we feed this through to Cactus it will crash.
@@ -22,7 +22,8 @@ PathChunker::~PathChunker() {
 void PathChunker::extract_subgraph(const Region& region, int context, int length,
                                    bool forward_only, VG& subgraph, Region& out_region) {
 
-    Graph g;
+    Graph& g = scratch_graph;
+    g.Clear();
 
     // convert to 0-based inclusive
     int64_t start = region.start;
@@ -87,7 +88,8 @@ void PathChunker::extract_subgraph(const Region& region, int context, int length
 void PathChunker::extract_id_range(vg::id_t start, vg::id_t end, int context, int length,
                                    bool forward_only, VG& subgraph, Region& out_region) {
 
-    Graph g;
+    Graph& g = scratch_graph;
+    g.Clear();
 
     for (vg::id_t i = start; i <= end; ++i) {
         *g.add_node() = xg->node(i);
@@ -196,7 +198,32 @@ int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids,
                 graph_ids.push_back(i);
             }
         }
-        index.for_alignment_to_nodes(graph_ids, write_alignment);
+        if (!only_fully_contained && !unsorted_index) {
+            // Nothing needs filtering, so pass the bytes through unparsed
+            vector<string> serialized_buffer;
+            auto flush_serialized = [&]() {
+                if (!serialized_buffer.empty()) {
+#pragma omp critical (stream_out)
+                    stream::write_serialized(*out_stream, serialized_buffer.size(), [&](uint64_t i) -> const string& {
+                            return serialized_buffer[i];
+                        });
+                    serialized_buffer.clear();
+                }
+            };
+            index.for_serialized_alignment_to_nodes(graph_ids, [&](string& bytes) {
+                    serialized_buffer.emplace_back(std::move(bytes));
+                    if (serialized_buffer.size() >= gam_buffer_size) {
+                        flush_serialized();
+                    }
+                });
+            flush_serialized();
+        } else {
+            index.for_serialized_alignment_to_nodes(graph_ids, [&](string& bytes) {
+                    Alignment alignment;
+                    alignment.ParseFromString(bytes);
+                    write_alignment(alignment);
+                });
+        }
     } else {
         if (contiguous) {
             index.for_alignment_in_range(graph_ids[0], graph_ids[graph_ids.size() - 1], write_alignment);
@@ -228,4 +255,80 @@ int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids,
 
 }
 
+int64_t PathChunker::extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index,
+                                              const string& gam_filename,
+                                              ostream* out_stream,
+                                              bool only_fully_contained) {
+    vector<vg::id_t> graph_ids;
+    subgraph.for_each_node([&](Node* node) {
+        graph_ids.push_back(node->id());
+    });
+    return extract_gam_for_ids(graph_ids, index, gam_filename, out_stream, only_fully_contained);
+}
+
+int64_t PathChunker::extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index,
+                                         const string& gam_filename, ostream* out_stream,
+                                         bool only_fully_contained) {
+
+    istream& gam_in = open_sorted_gam(gam_filename);
+
+    std::sort(graph_ids.begin(), graph_ids.end());
+    unordered_set<vg::id_t> id_lookup(graph_ids.begin(), graph_ids.end());
+
+    vector<Alignment> gam_buffer;
+    int64_t gam_count = 0;
+
+    // Query each run of consecutive IDs. A read touching several runs is only
+    // written for the run with its smallest ID.
+    size_t range_start = 0;
+    for (size_t range_end = 1; range_end <= graph_ids.size(); ++range_end) {
+        if (range_end < graph_ids.size() && graph_ids[range_end] <= graph_ids[range_end - 1] + 1) {
+            continue;
+        }
+        vg::id_t first_id = graph_ids[range_start];
+        vg::id_t last_id = graph_ids[range_end - 1];
+
+        index.for_alignment_in_range(gam_in, first_id, last_id, [&](const Alignment& alignment) {
+            vg::id_t smallest_id = numeric_limits<vg::id_t>::max();
+            for (size_t i = 0; i < alignment.path().mapping_size(); ++i) {
+                vg::id_t node_id = alignment.path().mapping(i).position().node_id();
+                if (id_lookup.count(node_id)) {
+                    smallest_id = min(smallest_id, node_id);
+                } else if (only_fully_contained) {
+                    return;
+                }
+            }
+            if (smallest_id >= first_id && smallest_id <= last_id) {
+                gam_buffer.push_back(alignment);
+                ++gam_count;
+                stream::write_buffered(*out_stream, gam_buffer, gam_buffer_size);
+            }
+        });
+
+        range_start = range_end;
+    }
+
+    // flush buffer
+    stream::write_buffered(*out_stream, gam_buffer, 0);
+
+    return gam_count;
+}
+
+istream& PathChunker::open_sorted_gam(const string& gam_filename) {
+    if (!sorted_gam_in.is_open() || sorted_gam_name != gam_filename) {
+        if (sorted_gam_in.is_open()) {
+            sorted_gam_in.close();
+        }
+        sorted_gam_in.open(gam_filename);
+        if (!sorted_gam_in) {
+            cerr << "error:[vg chunk] unable to open sorted gam " << gam_filename << endl;
+            exit(1);
+        }
+        sorted_gam_name = gam_filename;
+    }
+    // Queries seek wherever they need to
+    sorted_gam_in.clear();
+    return sorted_gam_in;
+}
+
 }
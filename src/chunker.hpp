@@ -2,6 +2,7 @@
 #define VG_CHUNKER_HPP_INCLUDED
 
 #include <iostream>
+#include <fstream>
 #include <map>
 #include <chrono>
 #include <ctime>
@@ -11,6 +12,7 @@
 #include "json2pb.h"
 #include "region.hpp"
 #include "index.hpp"
+#include "gam_index.hpp"
 
 namespace vg {
 
@@ -65,6 +67,32 @@ public:
                                 bool only_fully_contained = false,
                                 bool search_all_positions = false,
                                 bool unsorted_index = false);
+
+    /** Extract all alignments that touch a node in a subgraph and write them
+     * to an output stream, using a sorted GAM file and its GAMIndex. Opens
+     * its own stream on the GAM, so may be called from several threads. */
+    int64_t extract_gam_for_subgraph(VG& subgraph, const GAMIndex& index, const string& gam_filename,
+                                     ostream* out_stream, bool only_fully_contained = false);
+
+    /** Like above, but for the given node IDs */
+    int64_t extract_gam_for_ids(vector<vg::id_t>& graph_ids, const GAMIndex& index,
+                                const string& gam_filename, ostream* out_stream,
+                                bool only_fully_contained = false);
+
+private:
+
+    /// Graph that extractions build into before it becomes a VG. It is
+    /// cleared rather than freed between chunks, so Protobuf can reuse the
+    /// messages it already allocated.
+    Graph scratch_graph;
+
+    /// The sorted GAM we last read chunks from, kept open between chunks
+    ifstream sorted_gam_in;
+    string sorted_gam_name;
+
+    /// Get a stream on the given sorted GAM, reusing the open one if it is
+    /// the same file
+    istream& open_sorted_gam(const string& gam_filename);
     
 };
 
@@ -0,0 +1,205 @@
+#ifndef VG_CLOCK_CACHE_HPP_INCLUDED
+#define VG_CLOCK_CACHE_HPP_INCLUDED
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstdint>
+
+/** \file
+ * A small fixed-size cache with open addressing and CLOCK eviction, meant to
+ * be owned by a single thread in a hot loop. It exposes the same
+ * retrieve()/put() interface as LRUCache, so it can stand in for one, but it
+ * never allocates after construction and keeps hit/miss counters so it can be
+ * sized per workload.
+ */
+
+namespace vg {
+
+using namespace std;
+
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class ClockCache {
+public:
+    
+    /// Make a cache that can hold at least the given number of entries. The
+    /// actual capacity is rounded up to a power of two.
+    ClockCache(size_t capacity = 256);
+    
+    /// Look up the value for a key. Returns the value and true if it was
+    /// cached, or a default-constructed value and false if it was not.
+    pair<Value, bool> retrieve(const Key& key);
+    
+    /// Get a pointer to the cached value for a key, or nullptr if it is not
+    /// cached. The pointer is invalidated by the next put().
+    const Value* find(const Key& key);
+    
+    /// Store a value for a key, evicting something if the cache is full.
+    /// Returns a reference to the stored value, which is invalidated by the
+    /// next put().
+    const Value& put(const Key& key, const Value& value);
+    
+    /// Drop everything in the cache, but keep the counters.
+    void clear();
+    
+    /// Return the number of entries the cache can hold.
+    size_t capacity() const;
+    
+    /// Return the number of lookups that found their key.
+    size_t hits() const;
+    
+    /// Return the number of lookups that did not find their key.
+    size_t misses() const;
+    
+    /// Return the fraction of lookups that found their key, or 0 if nothing
+    /// has been looked up.
+    double hit_rate() const;
+    
+    /// Zero out the hit and miss counters.
+    void reset_counters();
+    
+private:
+    
+    /// How far past its home slot will we look for a key?
+    static const size_t MAX_PROBE = 8;
+    
+    struct Slot {
+        Key key;
+        Value value;
+        /// Is anything stored here?
+        bool occupied = false;
+        /// Has this entry been used since the clock hand last passed it?
+        bool referenced = false;
+    };
+    
+    vector<Slot> slots;
+    size_t mask;
+    size_t clock_hand = 0;
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    Hash hasher;
+    
+    /// Find the slot holding the key, or slots.size() if it isn't cached.
+    size_t locate(const Key& key) const;
+};
+
+template<typename Key, typename Value, typename Hash>
+ClockCache<Key, Value, Hash>::ClockCache(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity || size < MAX_PROBE) {
+        size <<= 1;
+    }
+    slots.resize(size);
+    mask = size - 1;
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::locate(const Key& key) const {
+    size_t home = hasher(key) & mask;
+    for (size_t i = 0; i < MAX_PROBE; i++) {
+        const Slot& slot = slots[(home + i) & mask];
+        if (slot.occupied && slot.key == key) {
+            return (home + i) & mask;
+        }
+    }
+    return slots.size();
+}
+
+template<typename Key, typename Value, typename Hash>
+pair<Value, bool> ClockCache<Key, Value, Hash>::retrieve(const Key& key) {
+    const Value* found = find(key);
+    if (found != nullptr) {
+        return make_pair(*found, true);
+    }
+    return make_pair(Value(), false);
+}
+
+template<typename Key, typename Value, typename Hash>
+const Value* ClockCache<Key, Value, Hash>::find(const Key& key) {
+    size_t i = locate(key);
+    if (i == slots.size()) {
+        ++miss_count;
+        return nullptr;
+    }
+    ++hit_count;
+    slots[i].referenced = true;
+    return &slots[i].value;
+}
+
+template<typename Key, typename Value, typename Hash>
+const Value& ClockCache<Key, Value, Hash>::put(const Key& key, const Value& value) {
+    size_t existing = locate(key);
+    if (existing != slots.size()) {
+        slots[existing].value = value;
+        slots[existing].referenced = true;
+        return slots[existing].value;
+    }
+    
+    size_t home = hasher(key) & mask;
+    // Take an empty slot in the probe window if there is one
+    for (size_t i = 0; i < MAX_PROBE; i++) {
+        Slot& slot = slots[(home + i) & mask];
+        if (!slot.occupied) {
+            slot.key = key;
+            slot.value = value;
+            slot.occupied = true;
+            slot.referenced = true;
+            return slot.value;
+        }
+    }
+    
+    // Otherwise sweep the clock hand over the probe window, giving referenced
+    // entries a second chance, until we find a victim. This terminates within
+    // two sweeps because every skipped entry loses its reference bit.
+    while (true) {
+        Slot& slot = slots[(home + clock_hand) & mask];
+        clock_hand = (clock_hand + 1) % MAX_PROBE;
+        if (slot.referenced) {
+            slot.referenced = false;
+        } else {
+            slot.key = key;
+            slot.value = value;
+            slot.referenced = true;
+            return slot.value;
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+void ClockCache<Key, Value, Hash>::clear() {
+    for (auto& slot : slots) {
+        slot.occupied = false;
+        slot.referenced = false;
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::capacity() const {
+    return slots.size();
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::hits() const {
+    return hit_count;
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t ClockCache<Key, Value, Hash>::misses() const {
+    return miss_count;
+}
+
+template<typename Key, typename Value, typename Hash>
+double ClockCache<Key, Value, Hash>::hit_rate() const {
+    size_t total = hit_count + miss_count;
+    return total == 0 ? 0.0 : (double) hit_count / total;
+}
+
+template<typename Key, typename Value, typename Hash>
+void ClockCache<Key, Value, Hash>::reset_counters() {
+    hit_count = 0;
+    miss_count = 0;
+}
+
+}
+
+#endif
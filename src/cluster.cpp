@@ -2,6 +2,8 @@
 #include <algorithm>
 #include <utility>
 #include <cstring>
+#include <queue>
+#include <tuple>
 
 #include "cluster.hpp"
 
@@ -16,11 +18,18 @@ MEMChainModel::MEMChainModel(
     const vector<vector<MaximalExactMatch> >& matches,
     const function<int64_t(pos_t)>& approx_position,
     const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& path_position,
-    const function<double(const MaximalExactMatch&, const MaximalExactMatch&)>& transition_weight,
+    const function<double(const MaximalExactMatch&, const MaximalExactMatch&, const map<string, vector<pair<size_t, bool> > >&, const map<string, vector<pair<size_t, bool> > >&)>& transition_weight,
     int band_width,
     int position_depth,
     int max_connections) {
     // store the MEMs in the model
+    size_t total_hits = 0;
+    for (auto& fragment : matches) {
+        for (auto& mem : fragment) {
+            total_hits += mem.nodes.size();
+        }
+    }
+    model.reserve(total_hits);
     int frag_n = 0;
     for (auto& fragment : matches) {
         ++frag_n;
@@ -28,27 +37,20 @@ MEMChainModel::MEMChainModel(
             // copy the MEM for each specific hit in the base graph
             // and add it in as a vertex
             for (auto& node : mem.nodes) {
-                //model.emplace_back();
-                //auto m = model.back();
                 auto pos = make_pos_t(node);
-                MEMChainModelVertex m;
-                m.mem = mem;
+                model.emplace_back();
+                MEMChainModelVertex& m = model.back();
+                m.mem = MaximalExactMatch(mem, node);
                 m.weight = mem.length();
-                m.prev = nullptr;
-                m.score = 0;
-                m.mem.positions = path_position(pos);
-                m.mem.positions[""].push_back(make_pair(approx_position(pos), is_rev(pos)));
-                m.mem.nodes.clear();
-                m.mem.nodes.push_back(node);
+                m.positions = path_position(pos);
+                m.positions[""].push_back(make_pair(approx_position(pos), is_rev(pos)));
                 m.mem.fragment = frag_n;
-                m.mem.match_count = mem.match_count;
-                model.push_back(m);
             }
         }
     }
     // index the model with the positions
     for (vector<MEMChainModelVertex>::iterator v = model.begin(); v != model.end(); ++v) {
-        for (auto& chr : v->mem.positions) {
+        for (auto& chr : v->positions) {
             auto& chr_positions = positions[chr.first];
             for (auto& pos : chr.second) {
                 chr_positions[pos.first].push_back(v);
@@ -139,7 +141,7 @@ MEMChainModel::MEMChainModel(
                                 || v1->mem.fragment == v2->mem.fragment && v1->mem.begin < v2->mem.begin) {
                                 // Transition is allowable because the first comes before the second
                             
-                                double weight = transition_weight(v1->mem, v2->mem);
+                                double weight = transition_weight(v1->mem, v2->mem, v1->positions, v2->positions);
                                 if (weight > -std::numeric_limits<double>::max()) {
                                     v1->next_cost.push_back(make_pair(&*v2, weight));
                                     v2->prev_cost.push_back(make_pair(&*v1, weight));
@@ -148,7 +150,7 @@ MEMChainModel::MEMChainModel(
                                        || v1->mem.fragment == v2->mem.fragment && v1->mem.begin > v2->mem.begin) {
                                 // Really we want to think about the transition going the other way
                             
-                                double weight = transition_weight(v2->mem, v1->mem);
+                                double weight = transition_weight(v2->mem, v1->mem, v2->positions, v1->positions);
                                 if (weight > -std::numeric_limits<double>::max()) {
                                     v2->next_cost.push_back(make_pair(&*v1, weight));
                                     v1->prev_cost.push_back(make_pair(&*v2, weight));
@@ -162,107 +164,26 @@ MEMChainModel::MEMChainModel(
     }
 }
 
-void MEMChainModel::score(const unordered_set<MEMChainModelVertex*>& exclude) {
-    // propagate the scores in the model
-    for (auto& m : model) {
-        // score is equal to the max inbound + mem.weight
-        if (exclude.count(&m)) continue; // skip if vertex was whole cluster
-        m.score = m.weight;
-        for (auto& p : m.prev_cost) {
-            if (p.first == nullptr) continue; // this transition is masked out
-            double proposal = m.weight + p.second + p.first->score;
-            if (proposal > m.score) {
-                m.prev = p.first;
-                m.score = proposal;
-            }
-        }
-    }
-}
-
-MEMChainModelVertex* MEMChainModel::max_vertex(void) {
-    MEMChainModelVertex* maxv = nullptr;
-    for (auto& m : model) {
-        if (maxv == nullptr || m.score > maxv->score) {
-            maxv = &m;
-        }
-    }
-    return maxv;
-}
-
-void MEMChainModel::clear_scores(void) {
-    for (auto& m : model) {
-        m.score = 0;
-        m.prev = nullptr;
-    }
-}
-
 vector<vector<MaximalExactMatch> > MEMChainModel::traceback(int alt_alns, bool paired, bool debug) {
+    ChainModelDP<MEMChainModelVertex> dp(model);
+    for (auto& v : redundant_vertexes) dp.exclude(v - model.begin());
+    auto vertex_traces = dp.traceback(alt_alns, paired, [&](size_t from, size_t to) {
+        return model[from].mem.fragment != model[to].mem.fragment;
+    });
     vector<vector<MaximalExactMatch> > traces;
-    traces.reserve(alt_alns); // avoid reallocs so we can refer to pointers to the traces
-    unordered_set<MEMChainModelVertex*> exclude;
-    for (auto& v : redundant_vertexes) exclude.insert(&*v);
-    for (int i = 0; i < alt_alns; ++i) {
-        // score the model, accounting for excluded traces
-        clear_scores();
-        score(exclude);
+    traces.reserve(vertex_traces.size());
+    for (auto& vertex_trace : vertex_traces) {
 #ifdef debug_mapper
 #pragma omp critical
         {
-            if (debug) {
-                cerr << "MEMChainModel::traceback " << i << endl;
-                display(cerr);
-            }
+            if (debug) cerr << "MEMChainModel::traceback " << traces.size() << " scored "
+                            << dp.scores[vertex_trace.back()] << " ending at " << model[vertex_trace.back()].mem.sequence() << endl;
         }
 #endif
-        vector<MEMChainModelVertex*> vertex_trace;
-        {
-            // find the maximum score
-            auto* vertex = max_vertex();
-            // check if we've exhausted our MEMs
-            if (vertex == nullptr || vertex->score == 0) break;
-#ifdef debug_mapper
-#pragma omp critical
-            {
-                if (debug) cerr << "maximum score " << vertex->mem.sequence() << " " << vertex << ":" << vertex->score << endl;
-            }
-#endif
-            // make trace
-            while (vertex != nullptr) {
-                vertex_trace.push_back(vertex);
-                if (vertex->prev != nullptr) {
-                    vertex = vertex->prev;
-                } else {
-                    break;
-                }
-            }
-        }
-        // if we have a singular match or reads are not paired, record not to use it again
-        if (paired && vertex_trace.size() == 1) {
-            exclude.insert(vertex_trace.front());
-        }
-        // fill this out when we're paired to help mask out in-fragment transitions
-        unordered_set<MEMChainModelVertex*> chain_members;
-        if (paired) for (auto v : vertex_trace) chain_members.insert(v);
         traces.emplace_back();
         auto& mem_trace = traces.back();
-        for (auto v = vertex_trace.rbegin(); v != vertex_trace.rend(); ++v) {
-            auto& vertex = **v;
-            if (!paired) exclude.insert(&vertex);
-            if (v != vertex_trace.rbegin()) {
-                auto y = v - 1;
-                MEMChainModelVertex* prev = *y;
-                // mask out used transitions
-                for (auto& p : vertex.prev_cost) {
-                    if (p.first == prev) {
-                        p.first = nullptr;
-                    } else if (paired && p.first != nullptr
-                               && p.first->mem.fragment != vertex.mem.fragment
-                               && chain_members.count(p.first)) {
-                        p.first = nullptr;
-                    }
-                }
-            }
-            mem_trace.push_back(vertex.mem);
+        for (size_t v : vertex_trace) {
+            mem_trace.push_back(model[v].mem);
         }
     }
     return traces;
@@ -271,7 +192,7 @@ vector<vector<MaximalExactMatch> > MEMChainModel::traceback(int alt_alns, bool p
 // show model
 void MEMChainModel::display(ostream& out) {
     for (auto& vertex : model) {
-        out << vertex.mem.sequence() << ":" << vertex.mem.fragment << " " << &vertex << ":" << vertex.score << "@";
+        out << vertex.mem.sequence() << ":" << vertex.mem.fragment << " " << &vertex << ":" << vertex.weight << "@";
         for (auto& node : vertex.mem.nodes) {
             id_t id = gcsa::Node::id(node);
             size_t offset = gcsa::Node::offset(node);
@@ -1849,7 +1770,9 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
                                                                                      bool unstranded,
                                                                                      paths_of_node_memo_t* paths_of_node_memo,
                                                                                      oriented_occurences_memo_t* oriented_occurences_memo,
-                                                                                     handle_memo_t* handle_memo) {
+                                                                                     handle_memo_t* handle_memo,
+                                                                                     size_t max_pairs,
+                                                                                     size_t* num_pairs_skipped) {
     
 #ifdef debug_od_clusterer
     cerr << "beginning clustering of MEM cluster pairs for " << left_clusters.size() << " left clusters and " << right_clusters.size() << " right clusters" << endl;
@@ -1858,6 +1781,9 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
     // We will fill this in with all sufficiently close pairs of clusters from different reads.
     vector<pair<pair<size_t, size_t>, int64_t>> to_return;
     
+    // The pairs we had no room for
+    size_t skipped = 0;
+    
     // We think of the clusters as a single linear ordering, with our clusters coming first.
     size_t total_clusters = left_clusters.size() + right_clusters.size();
     
@@ -1915,6 +1841,13 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
         // Sort the list ascending by the first item (relative position)
         std::sort(sorted_pos.begin(), sorted_pos.end());
         
+        // The number of right clusters before each index, so we can count the pairs in a
+        // window without visiting them once we're out of room
+        vector<size_t> right_before(sorted_pos.size() + 1, 0);
+        for (size_t i = 0; i < sorted_pos.size(); i++) {
+            right_before[i + 1] = right_before[i] + (sorted_pos[i].second >= left_clusters.size());
+        }
+        
         // Now scan for opposing pairs within the distance limit.
         // TODO: this is going to be O(n^2) in the number of clusters in range.
         // Note: but only if there are a lot of clusters within the range, if the
@@ -1959,8 +1892,23 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
 #endif
             }
             
+            if (window_start >= sorted_pos.size() || sorted_pos[window_start].first >= coord_interval_end) {
+                // there is nothing inside the window
+                continue;
+            }
+            
+            if (to_return.size() >= max_pairs) {
+                // we're out of room, so just count what we would have paired
+                skipped += right_before[window_last + 1] - right_before[window_start];
+                continue;
+            }
+            
             // add each pair of clusters that's from the two read ends to the return value
             for (size_t j = window_start; j <= window_last; j++) {
+                if (to_return.size() >= max_pairs) {
+                    skipped += right_before[window_last + 1] - right_before[j];
+                    break;
+                }
                 if (sorted_pos[j].second >= left_clusters.size()) {
 #ifdef debug_od_clusterer
                     cerr << "adding pair with cluster relative position " << sorted_pos[j].first << " starting with " << right_clusters[sorted_pos[j].second - left_clusters.size()]->front().second << endl;
@@ -1978,9 +1926,299 @@ vector<pair<pair<size_t, size_t>, int64_t>> OrientedDistanceClusterer::pair_clus
         }
     }
     
+    if (num_pairs_skipped) {
+        *num_pairs_skipped = skipped;
+    }
+    
     return to_return;
 }
 
+/// A segment tree of (value, hit index) pairs that answers range max queries,
+/// for finding chaining predecessors in SparseChainClusterer. Empty leaves
+/// have index -1.
+struct ChainMaxTree {
+    ChainMaxTree(size_t size) : size(size), tree(2 * size, empty()) {}
+    
+    static pair<int64_t, int64_t> empty() {
+        return make_pair(numeric_limits<int64_t>::min(), -1);
+    }
+    
+    void set(size_t leaf, const pair<int64_t, int64_t>& value) {
+        leaf += size;
+        tree[leaf] = value;
+        for (leaf /= 2; leaf > 0; leaf /= 2) {
+            tree[leaf] = max(tree[2 * leaf], tree[2 * leaf + 1]);
+        }
+    }
+    
+    /// Get the max over the leaves in [begin, end)
+    pair<int64_t, int64_t> query(size_t begin, size_t end) const {
+        pair<int64_t, int64_t> best = empty();
+        for (begin += size, end += size; begin < end; begin /= 2, end /= 2) {
+            if (begin & 1) {
+                best = max(best, tree[begin++]);
+            }
+            if (end & 1) {
+                best = max(best, tree[--end]);
+            }
+        }
+        return best;
+    }
+    
+    size_t size;
+    vector<pair<int64_t, int64_t>> tree;
+};
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const QualAdjAligner& aligner,
+                                           xg::XG* xgindex,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length,
+                                           size_t max_hits) :
+    SparseChainClusterer(alignment, mems, nullptr, &aligner, xgindex, max_expected_dist_approx_error,
+                         min_mem_length, max_hits) {
+    // nothing else to do
+}
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const Aligner& aligner,
+                                           xg::XG* xgindex,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length,
+                                           size_t max_hits) :
+    SparseChainClusterer(alignment, mems, &aligner, nullptr, xgindex, max_expected_dist_approx_error,
+                         min_mem_length, max_hits) {
+    // nothing else to do
+}
+
+SparseChainClusterer::SparseChainClusterer(const Alignment& alignment,
+                                           const vector<MaximalExactMatch>& mems,
+                                           const Aligner* aligner,
+                                           const QualAdjAligner* qual_adj_aligner,
+                                           xg::XG* xgindex,
+                                           size_t max_expected_dist_approx_error,
+                                           size_t min_mem_length,
+                                           size_t max_hits) :
+    max_hits(max_hits), aligner(aligner ? (const BaseAligner*) aligner : (const BaseAligner*) qual_adj_aligner) {
+    
+    for (const MaximalExactMatch& mem : mems) {
+        if (mem.length() < min_mem_length) {
+            continue;
+        }
+        
+        int32_t mem_score;
+        if (aligner) {
+            mem_score = aligner->score_exact_match(mem.begin, mem.end);
+        }
+        else {
+            mem_score = qual_adj_aligner->score_exact_match(mem.begin, mem.end, alignment.quality().begin()
+                                                            + (mem.begin - alignment.sequence().begin()));
+        }
+        
+        for (gcsa::node_type mem_hit : mem.nodes) {
+            pos_t pos = make_pos_t(mem_hit);
+            // Measure along the strand the hit is on, so reverse strand hits
+            // also move forward as the read does
+            int64_t forward_pos = xgindex->node_start(id(pos)) + (is_rev(pos) ? xgindex->node_length(id(pos)) - offset(pos) - 1
+                                                                              : offset(pos));
+            Hit hit;
+            hit.read_begin = mem.begin - alignment.sequence().begin();
+            hit.read_end = mem.end - alignment.sequence().begin();
+            hit.position = is_rev(pos) ? -forward_pos : forward_pos;
+            hit.space = is_rev(pos);
+            hit.score = mem_score;
+            hits.push_back(hit);
+            mem_hits.emplace_back(&mem, pos);
+        }
+    }
+    
+    max_gap = this->aligner->longest_detectable_gap(alignment) + max_expected_dist_approx_error;
+}
+
+vector<SparseChainClusterer::cluster_t> SparseChainClusterer::clusters(int32_t max_qual_score,
+                                                                       int32_t log_likelihood_approx_factor) {
+    vector<cluster_t> to_return;
+    auto chains = chain_hits(hits, aligner->match, aligner->gap_open, aligner->gap_extension, max_gap, max_hits);
+    if (chains.empty()) {
+        return to_return;
+    }
+    
+    // estimate the minimum score a cluster must obtain to even affect the mapping quality
+    int32_t suboptimal_score_cutoff = chains.front().first
+                                      - log_likelihood_approx_factor * aligner->mapping_quality_score_diff(max_qual_score);
+    for (auto& chain : chains) {
+        if (chain.first < suboptimal_score_cutoff) {
+            break;
+        }
+        to_return.emplace_back();
+        auto& cluster = to_return.back();
+        for (size_t i : chain.second) {
+            cluster.push_back(mem_hits[i]);
+        }
+        // put the cluster in order by read position as OrientedDistanceClusterer does
+        sort(cluster.begin(), cluster.end(), [](const hit_t& hit_1, const hit_t& hit_2) {
+            return hit_1.first->begin < hit_2.first->begin ||
+                   (hit_1.first->begin == hit_2.first->begin && hit_1.first->end < hit_2.first->end);
+        });
+    }
+    return to_return;
+}
+
+vector<pair<int32_t, vector<size_t>>> SparseChainClusterer::chain_hits(const vector<Hit>& hits,
+                                                                        int32_t match,
+                                                                        int32_t gap_open,
+                                                                        int32_t gap_extension,
+                                                                        int64_t max_gap,
+                                                                        size_t max_hits) {
+    
+    // choose the hits to chain, keeping the highest scoring ones if there are too many
+    vector<size_t> order(hits.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    if (order.size() > max_hits) {
+        stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+            return hits[i].score > hits[j].score;
+        });
+        order.resize(max_hits);
+    }
+    // and put them in order by space and then by read position
+    sort(order.begin(), order.end(), [&](size_t i, size_t j) {
+        return make_tuple(hits[i].space, hits[i].read_begin, i) < make_tuple(hits[j].space, hits[j].read_begin, j);
+    });
+    
+    auto diagonal = [&](size_t i) {
+        return hits[i].position - hits[i].read_begin;
+    };
+    
+    // the DP score of the best chain ending at each hit, and the previous hit in that chain
+    vector<int64_t> dp_score(hits.size(), 0);
+    vector<int64_t> prev(hits.size(), -1);
+    vector<size_t> leaf_of(hits.size(), 0);
+    
+    // a change of diagonal costs gap_open for the first base and gap_extension after
+    int64_t open_cost = gap_open - gap_extension;
+    
+    for (size_t space_begin = 0; space_begin < order.size(); ) {
+        size_t space_end = space_begin;
+        while (space_end < order.size() && hits[order[space_end]].space == hits[order[space_begin]].space) {
+            space_end++;
+        }
+        
+        // give every hit its own leaf in the trees, in order of diagonal
+        vector<pair<int64_t, size_t>> leaves;
+        for (size_t k = space_begin; k < space_end; k++) {
+            leaves.emplace_back(diagonal(order[k]), order[k]);
+        }
+        sort(leaves.begin(), leaves.end());
+        for (size_t l = 0; l < leaves.size(); l++) {
+            leaf_of[leaves[l].second] = l;
+        }
+        auto leaf_bound = [&](int64_t diag, bool upper) {
+            return (upper ? upper_bound(leaves.begin(), leaves.end(), make_pair(diag, numeric_limits<size_t>::max()))
+                          : lower_bound(leaves.begin(), leaves.end(), make_pair(diag, (size_t) 0))) - leaves.begin();
+        };
+        
+        // Predecessors on a lower diagonal are kept with the gap extensions
+        // they would need added in, and ones on a higher diagonal with them
+        // taken out, so one range max finds the best of each. Predecessors
+        // that still overlap the read position also have their read end taken
+        // out, since they only let the next hit score for the bases past it.
+        ChainMaxTree lower_diagonal(leaves.size()), higher_diagonal(leaves.size());
+        ChainMaxTree lower_diagonal_overlapping(leaves.size()), higher_diagonal_overlapping(leaves.size());
+        // the overlapping predecessors, by read end
+        priority_queue<pair<int64_t, size_t>, vector<pair<int64_t, size_t>>, greater<pair<int64_t, size_t>>> overlapping;
+        
+        for (size_t group_begin = space_begin; group_begin < space_end; ) {
+            // hits starting at the same read position cannot chain to each other
+            int64_t read_begin = hits[order[group_begin]].read_begin;
+            size_t group_end = group_begin;
+            while (group_end < space_end && hits[order[group_end]].read_begin == read_begin) {
+                group_end++;
+            }
+            
+            // hits that end by here no longer overlap
+            while (!overlapping.empty() && overlapping.top().first <= read_begin) {
+                size_t j = overlapping.top().second;
+                overlapping.pop();
+                lower_diagonal_overlapping.set(leaf_of[j], ChainMaxTree::empty());
+                higher_diagonal_overlapping.set(leaf_of[j], ChainMaxTree::empty());
+                lower_diagonal.set(leaf_of[j], make_pair(dp_score[j] + gap_extension * diagonal(j), (int64_t) j));
+                higher_diagonal.set(leaf_of[j], make_pair(dp_score[j] - gap_extension * diagonal(j), (int64_t) j));
+            }
+            
+            for (size_t k = group_begin; k < group_end; k++) {
+                size_t i = order[k];
+                const Hit& hit = hits[i];
+                int64_t diag = diagonal(i);
+                size_t low = leaf_bound(diag - max_gap, false);
+                size_t same_begin = leaf_bound(diag, false);
+                size_t same_end = leaf_bound(diag, true);
+                size_t high = leaf_bound(diag + max_gap, true);
+                
+                dp_score[i] = hit.score;
+                auto consider = [&](const pair<int64_t, int64_t>& best, int64_t adjustment) {
+                    if (best.second >= 0 && best.first + adjustment > dp_score[i]) {
+                        dp_score[i] = best.first + adjustment;
+                        prev[i] = best.second;
+                    }
+                };
+                int64_t overlap_gain = match * hit.read_end;
+                consider(lower_diagonal.query(low, same_begin), hit.score - gap_extension * diag - open_cost);
+                consider(lower_diagonal.query(same_begin, same_end), hit.score - gap_extension * diag);
+                consider(higher_diagonal.query(same_end, high), hit.score + gap_extension * diag - open_cost);
+                consider(lower_diagonal_overlapping.query(low, same_begin), overlap_gain - gap_extension * diag - open_cost);
+                consider(lower_diagonal_overlapping.query(same_begin, same_end), overlap_gain - gap_extension * diag);
+                consider(higher_diagonal_overlapping.query(same_end, high), overlap_gain + gap_extension * diag - open_cost);
+            }
+            
+            for (size_t k = group_begin; k < group_end; k++) {
+                size_t i = order[k];
+                int64_t adjusted = dp_score[i] - match * hits[i].read_end;
+                lower_diagonal_overlapping.set(leaf_of[i], make_pair(adjusted + gap_extension * diagonal(i), (int64_t) i));
+                higher_diagonal_overlapping.set(leaf_of[i], make_pair(adjusted - gap_extension * diagonal(i), (int64_t) i));
+                overlapping.emplace(hits[i].read_end, i);
+            }
+            
+            group_begin = group_end;
+        }
+        
+        space_begin = space_end;
+    }
+    
+    // trace back from the best chain ends, stopping at hits already in a chain
+    vector<size_t> ends = order;
+    stable_sort(ends.begin(), ends.end(), [&](size_t i, size_t j) {
+        return dp_score[i] > dp_score[j] || (dp_score[i] == dp_score[j] && i < j);
+    });
+    vector<bool> used(hits.size(), false);
+    vector<pair<int32_t, vector<size_t>>> chains;
+    for (size_t end : ends) {
+        if (used[end]) {
+            continue;
+        }
+        vector<size_t> chain;
+        int64_t i = end;
+        while (i >= 0 && !used[i]) {
+            chain.push_back(i);
+            used[i] = true;
+            i = prev[i];
+        }
+        int64_t chain_score = dp_score[end] - (i >= 0 ? dp_score[i] : 0);
+        if (chain_score <= 0) {
+            continue;
+        }
+        reverse(chain.begin(), chain.end());
+        chains.emplace_back(min<int64_t>(chain_score, numeric_limits<int32_t>::max()), move(chain));
+    }
+    stable_sort(chains.begin(), chains.end(), [](const pair<int32_t, vector<size_t>>& a, const pair<int32_t, vector<size_t>>& b) {
+        return a.first > b.first;
+    });
+    return chains;
+}
+
 Graph cluster_subgraph(const xg::XG& xg, const Alignment& aln, const vector<vg::MaximalExactMatch>& mems, double expansion) {
     assert(mems.size());
     auto& start_mem = mems.front();
@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
 
 
 /**
@@ -109,14 +110,62 @@ private:
     size_t primitive_root;
 };
 
+/**
+ * The dynamic programming state for a chain model (MEMChainModel or
+ * AlignmentChainModel) over a vector of vertices of type Vertex. Each vertex
+ * must have a weight and a prev_cost list of (pointer to a predecessor in the
+ * same vector, transition weight) pairs. The transitions are copied into flat
+ * arrays of vertex indexes, and excluded vertices are kept in a bit vector, so
+ * scoring and tracing back chains does not chase or hash pointers.
+ */
+template<typename Vertex>
+class ChainModelDP {
+public:
+    /// Pack up the weights and transitions of the given model
+    ChainModelDP(const vector<Vertex>& model);
+    
+    /// Never score the vertex at the given index again
+    void exclude(size_t vertex);
+    
+    /**
+     * Find up to alt_alns chains, best first, each as a vector of vertex
+     * indexes in order. Each chain's transitions are masked out before
+     * looking for the next, and only the vertices from the first one the
+     * chain touched onward are scored again. If not paired, each chain's vertices are excluded
+     * from later chains; if paired, only single-vertex chains are excluded,
+     * and transitions into a chain's vertices from other vertices of the chain
+     * that separate(from, to) says are in different parts (such as mates) are
+     * masked out too.
+     */
+    template<typename Separate>
+    vector<vector<size_t>> traceback(int alt_alns, bool paired, const Separate& separate);
+    
+    /// The score of each vertex from the last round of scoring
+    vector<double> scores;
+    
+private:
+    /// Score the vertices from the given index onward in order, from scratch,
+    /// keeping the scores of the ones before it
+    void score(size_t from = 0);
+    
+    vector<double> weights;
+    /// Best predecessor of each vertex in the last round of scoring, or -1
+    vector<int64_t> prevs;
+    /// Where each vertex's transitions start in prev_vertex and prev_weight
+    vector<size_t> prev_begin;
+    /// Predecessor of each transition, or -1 if it is masked out
+    vector<int64_t> prev_vertex;
+    vector<double> prev_weight;
+    vector<bool> excluded;
+};
+
 class MEMChainModelVertex {
 public:
     MaximalExactMatch mem;
     vector<pair<MEMChainModelVertex*, double> > next_cost; // for forward
     vector<pair<MEMChainModelVertex*, double> > prev_cost; // for backward
     double weight;
-    double score;
-    MEMChainModelVertex* prev;
+    map<string, vector<pair<size_t, bool> > > positions;
     MEMChainModelVertex(void) = default;                                      // Copy constructor
     MEMChainModelVertex(const MEMChainModelVertex&) = default;               // Copy constructor
     MEMChainModelVertex(MEMChainModelVertex&&) = default;                    // Move constructor
@@ -135,15 +184,12 @@ public:
         const vector<vector<MaximalExactMatch> >& matches,
         const function<int64_t(pos_t)>& approx_position,
         const function<map<string, vector<pair<size_t, bool> > >(pos_t)>& path_position,
-        const function<double(const MaximalExactMatch&, const MaximalExactMatch&)>& transition_weight,
+        const function<double(const MaximalExactMatch&, const MaximalExactMatch&, const map<string, vector<pair<size_t, bool> > >&, const map<string, vector<pair<size_t, bool> > >&)>& transition_weight,
         int band_width = 10,
         int position_depth = 1,
         int max_connections = 20);
-    void score(const unordered_set<MEMChainModelVertex*>& exclude);
-    MEMChainModelVertex* max_vertex(void);
     vector<vector<MaximalExactMatch> > traceback(int alt_alns, bool paired, bool debug);
     void display(ostream& out);
-    void clear_scores(void);
 };
     
 class OrientedDistanceClusterer {
@@ -196,7 +242,8 @@ public:
     /**
      * Given two vectors of clusters, an xg index, an bounds on the distance between clusters,
      * returns a vector of pairs of cluster numbers (one in each vector) matched with the estimated
-     * distance
+     * distance. At most max_pairs pairs are returned; if num_pairs_skipped is not null, the number
+     * of pairs within the bounds that were left out because of that is stored in it.
      */
     static vector<pair<pair<size_t, size_t>, int64_t>> pair_clusters(const Alignment& alignment_1,
                                                                      const Alignment& alignment_2,
@@ -208,7 +255,9 @@ public:
                                                                      bool unstranded,
                                                                      paths_of_node_memo_t* paths_of_node_memo = nullptr,
                                                                      oriented_occurences_memo_t* oriented_occurences_memo = nullptr,
-                                                                     handle_memo_t* handle_memo = nullptr);
+                                                                     handle_memo_t* handle_memo = nullptr,
+                                                                     size_t max_pairs = numeric_limits<size_t>::max(),
+                                                                     size_t* num_pairs_skipped = nullptr);
     
     //static size_t PRUNE_COUNTER;
     //static size_t CLUSTER_TOTAL;
@@ -411,6 +460,206 @@ public:
     }
 };
 
+/**
+ * A clusterer that chains MEM hits by sparse dynamic programming, for reads
+ * with too many hits for OrientedDistanceClusterer's pairwise distance
+ * estimates. Each hit is placed at an approximate linear position along its
+ * strand, and each hit's best predecessor is found with range-max queries
+ * over the hits' diagonals (linear position minus read position), so a read
+ * with n hits takes O(n log n) time. Only the max_hits highest scoring hits of
+ * a read are chained, which bounds the work on highly repetitive reads.
+ * Produces clusters in the same form as OrientedDistanceClusterer.
+ */
+class SparseChainClusterer {
+public:
+    
+    using hit_t = OrientedDistanceClusterer::hit_t;
+    using cluster_t = OrientedDistanceClusterer::cluster_t;
+    
+    /// An exact match of the read interval [read_begin, read_end) starting at
+    /// position in a linear coordinate system. Hits only chain with other hits
+    /// in the same space, such as the same strand.
+    struct Hit {
+        int64_t read_begin;
+        int64_t read_end;
+        int64_t position;
+        size_t space;
+        int32_t score;
+    };
+    
+    /// Constructor using QualAdjAligner
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const QualAdjAligner& aligner,
+                         xg::XG* xgindex,
+                         size_t max_expected_dist_approx_error = 8,
+                         size_t min_mem_length = 1,
+                         size_t max_hits = 4096);
+    
+    /// Constructor using Aligner
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const Aligner& aligner,
+                         xg::XG* xgindex,
+                         size_t max_expected_dist_approx_error = 8,
+                         size_t min_mem_length = 1,
+                         size_t max_hits = 4096);
+    
+    /// Returns a vector of clusters, best first, skipping any that score too
+    /// low to affect the mapping quality of the best. Each cluster is a vector
+    /// of MEM hits in read order.
+    vector<cluster_t> clusters(int32_t max_qual_score = 60, int32_t log_likelihood_approx_factor = 0);
+    
+    /**
+     * Chain the given hits. Moving from one hit to the next costs nothing if
+     * they are on the same diagonal, and gap_open plus gap_extension for each
+     * base of diagonal change after the first otherwise, up to max_gap.
+     * Overlapping hits may chain, but only score for the read bases past the
+     * earlier one, at match points per base. Only the max_hits highest scoring
+     * hits are used.
+     *
+     * Returns pairs of chain score and the indexes of the hits in the chain,
+     * in read order, best chain first. Each hit is in at most one chain.
+     */
+    static vector<pair<int32_t, vector<size_t>>> chain_hits(const vector<Hit>& hits,
+                                                            int32_t match,
+                                                            int32_t gap_open,
+                                                            int32_t gap_extension,
+                                                            int64_t max_gap,
+                                                            size_t max_hits = 4096);
+    
+private:
+    
+    /// Internal constructor that public constructors filter into
+    SparseChainClusterer(const Alignment& alignment,
+                         const vector<MaximalExactMatch>& mems,
+                         const Aligner* aligner,
+                         const QualAdjAligner* qual_adj_aligner,
+                         xg::XG* xgindex,
+                         size_t max_expected_dist_approx_error,
+                         size_t min_mem_length,
+                         size_t max_hits);
+    
+    /// The MEM hits, in the same order as chain_hits
+    vector<hit_t> mem_hits;
+    
+    /// The hits placed along their strands
+    vector<Hit> hits;
+    
+    size_t max_hits;
+    int64_t max_gap;
+    
+    const BaseAligner* aligner;
+};
+
+template<typename Vertex>
+ChainModelDP<Vertex>::ChainModelDP(const vector<Vertex>& model) :
+    scores(model.size(), 0), weights(model.size()), prevs(model.size(), -1), prev_begin(model.size() + 1, 0),
+    excluded(model.size(), false) {
+    for (size_t i = 0; i < model.size(); i++) {
+        weights[i] = model[i].weight;
+        prev_begin[i] = prev_vertex.size();
+        for (auto& p : model[i].prev_cost) {
+            prev_vertex.push_back(p.first == nullptr ? -1 : p.first - &model.front());
+            prev_weight.push_back(p.second);
+        }
+    }
+    prev_begin[model.size()] = prev_vertex.size();
+}
+
+template<typename Vertex>
+void ChainModelDP<Vertex>::exclude(size_t vertex) {
+    excluded[vertex] = true;
+}
+
+template<typename Vertex>
+void ChainModelDP<Vertex>::score(size_t from) {
+    fill(scores.begin() + from, scores.end(), 0);
+    fill(prevs.begin() + from, prevs.end(), -1);
+    // predecessors later in the model are seen with the scores they have so far
+    for (size_t i = from; i < weights.size(); i++) {
+        if (excluded[i]) {
+            continue;
+        }
+        // score is equal to the max inbound + weight
+        scores[i] = weights[i];
+        for (size_t k = prev_begin[i]; k < prev_begin[i + 1]; k++) {
+            if (prev_vertex[k] < 0) {
+                continue;
+            }
+            double proposal = weights[i] + prev_weight[k] + scores[prev_vertex[k]];
+            if (proposal > scores[i]) {
+                prevs[i] = prev_vertex[k];
+                scores[i] = proposal;
+            }
+        }
+    }
+}
+
+template<typename Vertex>
+template<typename Separate>
+vector<vector<size_t>> ChainModelDP<Vertex>::traceback(int alt_alns, bool paired, const Separate& separate) {
+    vector<vector<size_t>> traces;
+    vector<bool> in_chain(weights.size(), false);
+    // vertices before the first one the last chain excluded or masked
+    // transitions into have the same scores as before
+    size_t rescore_from = 0;
+    for (int i = 0; i < alt_alns; ++i) {
+        score(rescore_from);
+        // find the maximum score
+        int64_t vertex = -1;
+        for (size_t j = 0; j < scores.size(); j++) {
+            if (vertex < 0 || scores[j] > scores[vertex]) {
+                vertex = j;
+            }
+        }
+        // check if we've exhausted our vertices
+        if (vertex < 0 || scores[vertex] == 0) {
+            break;
+        }
+        traces.emplace_back();
+        vector<size_t>& trace = traces.back();
+        for (; vertex >= 0; vertex = prevs[vertex]) {
+            trace.push_back(vertex);
+        }
+        reverse(trace.begin(), trace.end());
+        rescore_from = *min_element(trace.begin(), trace.end());
+        
+        // if we have a singular match or reads are not paired, record not to use it again
+        if (paired && trace.size() == 1) {
+            exclude(trace.front());
+        }
+        if (paired) {
+            for (size_t v : trace) {
+                in_chain[v] = true;
+            }
+        }
+        for (size_t t = 0; t < trace.size(); t++) {
+            size_t v = trace[t];
+            if (!paired) {
+                exclude(v);
+            }
+            if (t > 0) {
+                // mask out used transitions
+                for (size_t k = prev_begin[v]; k < prev_begin[v + 1]; k++) {
+                    if (prev_vertex[k] == (int64_t) trace[t - 1]) {
+                        prev_vertex[k] = -1;
+                    }
+                    else if (paired && prev_vertex[k] >= 0 && in_chain[prev_vertex[k]] && separate(prev_vertex[k], v)) {
+                        prev_vertex[k] = -1;
+                    }
+                }
+            }
+        }
+        if (paired) {
+            for (size_t v : trace) {
+                in_chain[v] = false;
+            }
+        }
+    }
+    return traces;
+}
+
 /// return a subgraph form an xg for a cluster of MEMs from the given alignment
 Graph cluster_subgraph(const xg::XG& xg, const Alignment& aln, const vector<MaximalExactMatch>& mems, double expansion = 1.61803);
 
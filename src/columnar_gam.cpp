@@ -0,0 +1,595 @@
+#include "columnar_gam.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <omp.h>
+#include <zstd.h>
+
+namespace vg {
+
+using namespace std;
+
+/// Magic number at the start of a columnar GAM stream
+static const char COLUMNAR_MAGIC[4] = {'C', 'G', 'A', 'M'};
+/// Version of the format we write
+static const uint32_t COLUMNAR_VERSION = 1;
+/// zstd level for the columns; higher than the stream codec's, since these
+/// are for keeping
+static const int COLUMNAR_ZSTD_LEVEL = 9;
+/// The columns in the order they are written
+static const uint32_t COLUMN_ORDER[] = {COLUMN_NAME, COLUMN_SEQUENCE, COLUMN_QUALITY,
+    COLUMN_PATH, COLUMN_SCORE, COLUMN_OTHER};
+
+/// Append a varint
+static void put_varint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+/// Append a signed value as a zigzag varint
+static void put_signed(string& out, int64_t value) {
+    put_varint(out, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+/// Append a varint length and that many bytes
+static void put_string(string& out, const string& value) {
+    put_varint(out, value.size());
+    out.append(value);
+}
+
+/// Append a fixed-width little-endian value
+template<typename T>
+static void put_fixed(string& out, T value) {
+    for (size_t i = 0; i < sizeof(T); i++) {
+        out.push_back((char) ((uint64_t) value >> (8 * i)));
+    }
+}
+
+/// Reads the values put_* wrote out of an uncompressed column
+class ColumnReader {
+public:
+    ColumnReader(const string& data) : here(data.data()), end(data.data() + data.size()) {}
+
+    uint64_t get_varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            check(1);
+            uint8_t byte = *here++;
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw runtime_error("[vg::ColumnarGAMBlock] corrupt varint in column");
+    }
+
+    int64_t get_signed() {
+        uint64_t zigzag = get_varint();
+        return (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+    }
+
+    string get_string() {
+        size_t length = get_varint();
+        check(length);
+        string value(here, length);
+        here += length;
+        return value;
+    }
+
+    const char* get_bytes(size_t length) {
+        check(length);
+        const char* bytes = here;
+        here += length;
+        return bytes;
+    }
+
+    double get_double() {
+        uint64_t bits = 0;
+        const char* bytes = get_bytes(sizeof(bits));
+        for (size_t i = 0; i < sizeof(bits); i++) {
+            bits |= (uint64_t) (uint8_t) bytes[i] << (8 * i);
+        }
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+private:
+    void check(size_t wanted) {
+        if ((size_t) (end - here) < wanted) {
+            throw runtime_error("[vg::ColumnarGAMBlock] column ends early");
+        }
+    }
+
+    const char* here;
+    const char* end;
+};
+
+/// Read a fixed-width little-endian value from a stream, returning false if
+/// the stream ends first
+template<typename T>
+static bool read_fixed(istream& in, T& value) {
+    char bytes[sizeof(T)];
+    if (!in.read(bytes, sizeof(T))) {
+        return false;
+    }
+    uint64_t assembled = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        assembled |= (uint64_t) (uint8_t) bytes[i] << (8 * i);
+    }
+    value = (T) assembled;
+    return true;
+}
+
+/// 2-bit codes of the bases we pack, or 4 for anything else
+static inline uint8_t base_code(char base) {
+    switch (base) {
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'G': return 2;
+    case 'T': return 3;
+    default: return 4;
+    }
+}
+
+static const char CODE_BASES[4] = {'A', 'C', 'G', 'T'};
+
+/// How the path of each alignment is stored in the PATH column
+static const char PATH_ABSENT = 0;
+static const char PATH_MODELED = 1;
+static const char PATH_SERIALIZED = 2;
+
+/// Can we store the path in our own encoding, without losing anything?
+static bool path_is_modeled(const Path& path) {
+    if (!path.name().empty() || path.is_circular() || path.length() != 0) {
+        return false;
+    }
+    for (auto& mapping : path.mapping()) {
+        if (!mapping.position().name().empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Encode one column for a block of alignments
+static string encode_column(uint32_t column, const vector<Alignment>& alignments) {
+    string data;
+    // node IDs are differences from the previous mapping's throughout the block
+    int64_t prev_node_id = 0;
+    for (auto& aln : alignments) {
+        switch (column) {
+        case COLUMN_NAME:
+            put_string(data, aln.name());
+            break;
+        case COLUMN_SEQUENCE:
+        {
+            const string& sequence = aln.sequence();
+            put_varint(data, sequence.size());
+            string packed((sequence.size() + 3) / 4, 0);
+            vector<size_t> exceptions;
+            for (size_t i = 0; i < sequence.size(); i++) {
+                uint8_t code = base_code(sequence[i]);
+                if (code == 4) {
+                    exceptions.push_back(i);
+                    code = 0;
+                }
+                packed[i / 4] |= code << (2 * (i % 4));
+            }
+            data.append(packed);
+            put_varint(data, exceptions.size());
+            size_t prev = 0;
+            for (size_t i : exceptions) {
+                put_varint(data, i - prev);
+                data.push_back(sequence[i]);
+                prev = i;
+            }
+            break;
+        }
+        case COLUMN_QUALITY:
+            put_string(data, aln.quality());
+            break;
+        case COLUMN_PATH:
+            if (!aln.has_path()) {
+                data.push_back(PATH_ABSENT);
+                break;
+            }
+            if (!path_is_modeled(aln.path())) {
+                data.push_back(PATH_SERIALIZED);
+                put_string(data, aln.path().SerializeAsString());
+                break;
+            }
+            data.push_back(PATH_MODELED);
+            put_varint(data, aln.path().mapping_size());
+            for (size_t i = 0; i < aln.path().mapping_size(); i++) {
+                const Mapping& mapping = aln.path().mapping(i);
+                const Position& position = mapping.position();
+                data.push_back((char) ((mapping.has_position() ? 1 : 0) | (position.is_reverse() ? 2 : 0)));
+                put_signed(data, position.node_id() - prev_node_id);
+                prev_node_id = position.node_id();
+                put_varint(data, position.offset());
+                // ranks are almost always 1-based indexes
+                put_signed(data, mapping.rank() - (int64_t) (i + 1));
+                put_varint(data, mapping.edit_size());
+                for (auto& edit : mapping.edit()) {
+                    put_varint(data, edit.from_length());
+                    put_varint(data, edit.to_length());
+                    put_string(data, edit.sequence());
+                }
+            }
+            break;
+        case COLUMN_SCORE:
+            put_signed(data, aln.score());
+            put_signed(data, aln.mapping_quality());
+            {
+                double identity = aln.identity();
+                uint64_t bits;
+                memcpy(&bits, &identity, sizeof(bits));
+                put_fixed(data, bits);
+            }
+            data.push_back(aln.is_secondary() ? 1 : 0);
+            break;
+        case COLUMN_OTHER:
+        {
+            Alignment rest = aln;
+            rest.clear_name();
+            rest.clear_sequence();
+            rest.clear_quality();
+            rest.clear_path();
+            rest.clear_score();
+            rest.clear_mapping_quality();
+            rest.clear_identity();
+            rest.clear_is_secondary();
+            put_string(data, rest.SerializeAsString());
+            break;
+        }
+        }
+    }
+    return data;
+}
+
+/// Decode one column into a block of alignments
+static void decode_column(uint32_t column, const string& data, vector<Alignment>& alignments) {
+    ColumnReader reader(data);
+    int64_t prev_node_id = 0;
+    for (auto& aln : alignments) {
+        switch (column) {
+        case COLUMN_NAME:
+            aln.set_name(reader.get_string());
+            break;
+        case COLUMN_SEQUENCE:
+        {
+            size_t length = reader.get_varint();
+            const char* packed = reader.get_bytes((length + 3) / 4);
+            string sequence(length, 'A');
+            for (size_t i = 0; i < length; i++) {
+                sequence[i] = CODE_BASES[(packed[i / 4] >> (2 * (i % 4))) & 3];
+            }
+            size_t exceptions = reader.get_varint();
+            size_t i = 0;
+            for (size_t j = 0; j < exceptions; j++) {
+                i += reader.get_varint();
+                const char* base = reader.get_bytes(1);
+                if (i >= length) {
+                    throw runtime_error("[vg::ColumnarGAMBlock] sequence exception out of range");
+                }
+                sequence[i] = *base;
+            }
+            aln.set_sequence(std::move(sequence));
+            break;
+        }
+        case COLUMN_QUALITY:
+            aln.set_quality(reader.get_string());
+            break;
+        case COLUMN_PATH:
+        {
+            char kind = *reader.get_bytes(1);
+            if (kind == PATH_ABSENT) {
+                break;
+            }
+            Path* path = aln.mutable_path();
+            if (kind == PATH_SERIALIZED) {
+                if (!path->ParseFromString(reader.get_string())) {
+                    throw runtime_error("[vg::ColumnarGAMBlock] corrupt path in column");
+                }
+                break;
+            }
+            size_t mappings = reader.get_varint();
+            for (size_t i = 0; i < mappings; i++) {
+                Mapping* mapping = path->add_mapping();
+                uint8_t flags = *reader.get_bytes(1);
+                int64_t node_id = prev_node_id + reader.get_signed();
+                prev_node_id = node_id;
+                int64_t offset = reader.get_varint();
+                if (flags & 1) {
+                    Position* position = mapping->mutable_position();
+                    position->set_node_id(node_id);
+                    position->set_offset(offset);
+                    position->set_is_reverse(flags & 2);
+                }
+                mapping->set_rank(reader.get_signed() + (int64_t) (i + 1));
+                size_t edits = reader.get_varint();
+                for (size_t j = 0; j < edits; j++) {
+                    Edit* edit = mapping->add_edit();
+                    edit->set_from_length(reader.get_varint());
+                    edit->set_to_length(reader.get_varint());
+                    edit->set_sequence(reader.get_string());
+                }
+            }
+            break;
+        }
+        case COLUMN_SCORE:
+            aln.set_score(reader.get_signed());
+            aln.set_mapping_quality(reader.get_signed());
+            aln.set_identity(reader.get_double());
+            aln.set_is_secondary(*reader.get_bytes(1));
+            break;
+        case COLUMN_OTHER:
+            if (!aln.MergeFromString(reader.get_string())) {
+                throw runtime_error("[vg::ColumnarGAMBlock] corrupt alignment in column");
+            }
+            break;
+        default:
+            throw runtime_error("[vg::ColumnarGAMBlock] unknown column " + to_string(column));
+        }
+    }
+}
+
+uint32_t columns_for_fields(const vector<int>& field_numbers) {
+    if (field_numbers.empty()) {
+        return ALL_COLUMNS;
+    }
+    uint32_t columns = 0;
+    for (int field : field_numbers) {
+        switch (field) {
+        case Alignment::kNameFieldNumber:
+            columns |= COLUMN_NAME;
+            break;
+        case Alignment::kSequenceFieldNumber:
+            columns |= COLUMN_SEQUENCE;
+            break;
+        case Alignment::kQualityFieldNumber:
+            columns |= COLUMN_QUALITY;
+            break;
+        case Alignment::kPathFieldNumber:
+            columns |= COLUMN_PATH;
+            break;
+        case Alignment::kScoreFieldNumber:
+        case Alignment::kMappingQualityFieldNumber:
+        case Alignment::kIdentityFieldNumber:
+        case Alignment::kIsSecondaryFieldNumber:
+            columns |= COLUMN_SCORE;
+            break;
+        default:
+            columns |= COLUMN_OTHER;
+            break;
+        }
+    }
+    return columns;
+}
+
+bool is_columnar_gam(istream& in) {
+    return in.peek() == COLUMNAR_MAGIC[0];
+}
+
+ColumnarGAMWriter::ColumnarGAMWriter(ostream& out, size_t block_size) : out(out), block_size(block_size) {
+    if (block_size == 0) {
+        throw runtime_error("[vg::ColumnarGAMWriter] blocks must hold at least one alignment");
+    }
+    string header(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    put_fixed(header, COLUMNAR_VERSION);
+    out.write(header.data(), header.size());
+    buffer.reserve(block_size);
+}
+
+ColumnarGAMWriter::~ColumnarGAMWriter() {
+    finish();
+}
+
+void ColumnarGAMWriter::write(const Alignment& aln) {
+    buffer.push_back(aln);
+    if (buffer.size() >= block_size) {
+        write_block();
+    }
+}
+
+void ColumnarGAMWriter::finish() {
+    if (!buffer.empty()) {
+        write_block();
+    }
+    out.flush();
+}
+
+void ColumnarGAMWriter::write_block() {
+    string block;
+    put_fixed(block, (uint64_t) buffer.size());
+    put_fixed(block, (uint32_t) (sizeof(COLUMN_ORDER) / sizeof(COLUMN_ORDER[0])));
+    for (uint32_t column : COLUMN_ORDER) {
+        string data = encode_column(column, buffer);
+        string compressed(ZSTD_compressBound(data.size()), 0);
+        size_t compressed_size = ZSTD_compress(&compressed[0], compressed.size(), data.data(), data.size(),
+                                               COLUMNAR_ZSTD_LEVEL);
+        if (ZSTD_isError(compressed_size)) {
+            throw runtime_error("[vg::ColumnarGAMWriter] could not compress column: " +
+                                string(ZSTD_getErrorName(compressed_size)));
+        }
+        put_fixed(block, column);
+        put_fixed(block, (uint64_t) data.size());
+        put_fixed(block, (uint64_t) compressed_size);
+        block.append(compressed.data(), compressed_size);
+    }
+    out.write(block.data(), block.size());
+    if (!out) {
+        throw runtime_error("[vg::ColumnarGAMWriter] could not write block");
+    }
+    buffer.clear();
+}
+
+size_t ColumnarGAMBlock::size() const {
+    return count;
+}
+
+bool ColumnarGAMBlock::read(istream& in, uint32_t wanted) {
+    count = 0;
+    columns.clear();
+
+    // skip the headers of any concatenated files
+    while (in.peek() == COLUMNAR_MAGIC[0]) {
+        char header[sizeof(COLUMNAR_MAGIC)];
+        uint32_t version;
+        if (!in.read(header, sizeof(header)) || memcmp(header, COLUMNAR_MAGIC, sizeof(header)) != 0
+            || !read_fixed(in, version)) {
+            throw runtime_error("[vg::ColumnarGAMBlock] input is not columnar GAM");
+        }
+        if (version > COLUMNAR_VERSION) {
+            throw runtime_error("[vg::ColumnarGAMBlock] columnar GAM version " + to_string(version) +
+                                " is newer than this vg can read");
+        }
+    }
+
+    uint64_t alignments;
+    if (!read_fixed(in, alignments)) {
+        return false;
+    }
+    uint32_t column_count;
+    if (!read_fixed(in, column_count)) {
+        throw runtime_error("[vg::ColumnarGAMBlock] truncated block header");
+    }
+    for (uint32_t i = 0; i < column_count; i++) {
+        uint32_t column;
+        uint64_t size, compressed_size;
+        if (!read_fixed(in, column) || !read_fixed(in, size) || !read_fixed(in, compressed_size)) {
+            throw runtime_error("[vg::ColumnarGAMBlock] truncated column header");
+        }
+        if (column & wanted) {
+            columns.emplace_back(column, make_pair(string(compressed_size, 0), size));
+            in.read(&columns.back().second.first[0], compressed_size);
+        } else {
+            // don't even hold on to the columns nobody wants
+            in.ignore(compressed_size);
+        }
+        if (!in) {
+            throw runtime_error("[vg::ColumnarGAMBlock] truncated column");
+        }
+    }
+    count = alignments;
+    return true;
+}
+
+void ColumnarGAMBlock::decode(uint32_t wanted, vector<Alignment>& alignments) const {
+    alignments.resize(count);
+    for (auto& column : columns) {
+        if (!(column.first & wanted)) {
+            continue;
+        }
+        string data(column.second.second, 0);
+        size_t size = ZSTD_decompress(&data[0], data.size(), column.second.first.data(), column.second.first.size());
+        if (ZSTD_isError(size) || size != data.size()) {
+            throw runtime_error("[vg::ColumnarGAMBlock] could not decompress column");
+        }
+        decode_column(column.first, data, alignments);
+    }
+}
+
+void gam_to_columnar(istream& gam_in, ostream& out, size_t block_size) {
+    ColumnarGAMWriter writer(out, block_size);
+    function<void(Alignment&)> lambda = [&](Alignment& aln) {
+        writer.write(aln);
+    };
+    stream::for_each(gam_in, lambda);
+    writer.finish();
+}
+
+void columnar_to_gam(istream& in, ostream& gam_out) {
+    vector<Alignment> buffer;
+    for_each_columnar(in, ALL_COLUMNS, [&](Alignment& aln) {
+        buffer.emplace_back(std::move(aln));
+        stream::write_buffered(gam_out, buffer, 1000);
+    });
+    stream::write_buffered(gam_out, buffer, 0);
+}
+
+void for_each_columnar(istream& in, uint32_t columns, const function<void(Alignment&)>& lambda) {
+    ColumnarGAMBlock block;
+    vector<Alignment> alignments;
+    while (block.read(in, columns)) {
+        alignments.clear();
+        block.decode(columns, alignments);
+        for (auto& aln : alignments) {
+            lambda(aln);
+        }
+    }
+}
+
+void for_each_columnar_block_parallel(istream& in, uint32_t columns,
+                                      const function<void(const ColumnarGAMBlock&)>& lambda) {
+    // hold at most this many blocks per thread in memory
+    const uint64_t max_blocks_per_thread = 2;
+    uint64_t max_blocks_outstanding = max_blocks_per_thread * get_thread_count();
+    uint64_t blocks_outstanding = 0;
+
+#pragma omp parallel default(none) shared(in, columns, lambda, blocks_outstanding, max_blocks_outstanding)
+#pragma omp single
+    {
+        ColumnarGAMBlock* block = new ColumnarGAMBlock();
+        while (block->read(in, columns)) {
+            uint64_t b;
+#pragma omp atomic read
+            b = blocks_outstanding;
+            if (b >= max_blocks_outstanding) {
+                // the other threads have enough to do, so do this one
+                // ourselves, which also stops us reading ahead
+                lambda(*block);
+                delete block;
+            } else {
+#pragma omp atomic update
+                blocks_outstanding++;
+#pragma omp task default(none) firstprivate(block) shared(lambda, blocks_outstanding)
+                {
+                    lambda(*block);
+                    delete block;
+#pragma omp atomic update
+                    blocks_outstanding--;
+                }
+            }
+            block = new ColumnarGAMBlock();
+        }
+        delete block;
+#pragma omp taskwait
+    }
+}
+
+void for_each_columnar_parallel(istream& in, uint32_t columns, const function<void(Alignment&)>& lambda) {
+    for_each_columnar_block_parallel(in, columns, [&](const ColumnarGAMBlock& block) {
+        vector<Alignment> alignments;
+        block.decode(columns, alignments);
+        for (auto& aln : alignments) {
+            lambda(aln);
+        }
+    });
+}
+
+void for_each_alignment_fields_parallel(istream& in, const vector<int>& field_numbers,
+                                        const function<void(Alignment&)>& lambda) {
+    if (is_columnar_gam(in)) {
+        for_each_columnar_parallel(in, columns_for_fields(field_numbers), lambda);
+        return;
+    }
+    function<void(stream::SerializedMessage&)> project = [&](stream::SerializedMessage& message) {
+        Alignment aln;
+        bool ok = field_numbers.empty() ? aln.ParseFromString(message.bytes)
+                                        : stream::FieldView(message.bytes).project(field_numbers, aln);
+        if (!ok) {
+            throw runtime_error("[vg::for_each_alignment_fields_parallel] invalid or corrupt alignment in input");
+        }
+        lambda(aln);
+    };
+    stream::for_each_parallel(in, project);
+}
+
+}
@@ -0,0 +1,140 @@
+#ifndef VG_COLUMNAR_GAM_HPP_INCLUDED
+#define VG_COLUMNAR_GAM_HPP_INCLUDED
+
+/** \file
+ * Columnar GAM: a block-based container for Alignments that stores each kind
+ * of field in its own compressed column, so that like compresses with like and
+ * scans can skip the columns they don't need.
+ *
+ * A file starts with the 4 bytes "CGAM" and a 4-byte little-endian version,
+ * followed by blocks. Each block is an 8-byte alignment count and a 4-byte
+ * column count, then for each column its 4-byte id, 8-byte uncompressed size,
+ * 8-byte compressed size and zstd-compressed data. All sizes are little-endian.
+ * Concatenated columnar GAM files are also a valid columnar GAM file.
+ *
+ * The columns hold, for every alignment of the block:
+ *
+ * - NAME: the name.
+ * - SEQUENCE: the sequence in 2 bits a base, with any other characters listed
+ *   as exceptions.
+ * - QUALITY: the base qualities.
+ * - PATH: the mappings, with node IDs stored as differences from the previous
+ *   mapping's, or the serialized Path if it uses fields this doesn't model.
+ * - SCORE: the score, mapping quality, identity and secondary flag.
+ * - OTHER: every other field, as a serialized Alignment.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/// The columns of a block, as bits so that sets of them can be asked for
+enum AlignmentColumn : uint32_t {
+    COLUMN_NAME = 1,
+    COLUMN_SEQUENCE = 2,
+    COLUMN_QUALITY = 4,
+    COLUMN_PATH = 8,
+    COLUMN_SCORE = 16,
+    COLUMN_OTHER = 32,
+    ALL_COLUMNS = 63
+};
+
+/// Get the set of columns that hold the given Alignment field numbers, or
+/// all the columns if the list is empty.
+uint32_t columns_for_fields(const vector<int>& field_numbers);
+
+/// Return true if the stream is columnar GAM. Only looks at the next byte, so
+/// it works on pipes.
+bool is_columnar_gam(istream& in);
+
+/**
+ * Writes Alignments to a stream as columnar GAM, a block at a time. The header
+ * is written on construction, and the last block on finish() or destruction.
+ */
+class ColumnarGAMWriter {
+public:
+    /// How many alignments go in a block by default
+    static const size_t DEFAULT_BLOCK_SIZE = 10000;
+
+    ColumnarGAMWriter(ostream& out, size_t block_size = DEFAULT_BLOCK_SIZE);
+    ~ColumnarGAMWriter();
+
+    /// Add an alignment
+    void write(const Alignment& aln);
+
+    /// Write out any partial block and flush the stream
+    void finish();
+
+private:
+    /// Encode and write the buffered alignments as a block
+    void write_block();
+
+    ostream& out;
+    size_t block_size;
+    vector<Alignment> buffer;
+};
+
+/**
+ * One block of a columnar GAM file, as read, with the columns that were asked
+ * for still compressed until they are decoded.
+ */
+class ColumnarGAMBlock {
+public:
+    /// How many alignments are in the block
+    size_t size() const;
+
+    /// Decode the given columns, which must have been read, into the
+    /// alignments, which are resized to the size of the block. Fields the
+    /// alignments already have from other columns are left alone.
+    void decode(uint32_t columns, vector<Alignment>& alignments) const;
+
+    /// Read the next block from a columnar GAM stream, keeping only the given
+    /// columns and skipping over the bytes of the rest. Returns false at the
+    /// end of the stream, and throws if it is corrupt.
+    bool read(istream& in, uint32_t columns);
+
+private:
+    size_t count = 0;
+    /// The compressed data and uncompressed size of each column that was
+    /// read, by column bit
+    vector<pair<uint32_t, pair<string, size_t>>> columns;
+};
+
+/// Convert a GAM stream to a columnar GAM stream
+void gam_to_columnar(istream& gam_in, ostream& out, size_t block_size = ColumnarGAMWriter::DEFAULT_BLOCK_SIZE);
+
+/// Convert a columnar GAM stream to a GAM stream
+void columnar_to_gam(istream& in, ostream& gam_out);
+
+/// Call the callback on each alignment of a columnar GAM stream, in order,
+/// with only the given columns decoded
+void for_each_columnar(istream& in, uint32_t columns, const function<void(Alignment&)>& lambda);
+
+/// Call the callback on each block of a columnar GAM stream, read with the
+/// given columns, on all threads. Blocks are read on one thread and handed to
+/// the others as tasks, with only a few per thread waiting at once.
+void for_each_columnar_block_parallel(istream& in, uint32_t columns,
+                                      const function<void(const ColumnarGAMBlock&)>& lambda);
+
+/// Call the callback on each alignment of a columnar GAM stream, on all
+/// threads, with only the given columns decoded.
+void for_each_columnar_parallel(istream& in, uint32_t columns, const function<void(Alignment&)>& lambda);
+
+/// Call the callback on each alignment of a GAM or columnar GAM stream, on all
+/// threads, with only the given fields (or all of them, if none are given)
+/// decoded. Columnar GAM doesn't even decompress the columns that aren't
+/// needed. Some fields that weren't asked for may be filled in too.
+void for_each_alignment_fields_parallel(istream& in, const vector<int>& field_numbers,
+                                        const function<void(Alignment&)>& lambda);
+
+}
+
+#endif
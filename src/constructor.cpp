@@ -419,6 +419,7 @@ namespace vg {
                         // Some VCFs may include multiple variants at the same
                         // position with the same ref and alt. We will only take the
                         // first one.
+#pragma omp critical (cerr)
                         cerr << "warning:[vg::Constructor] Skipping duplicate variant with hash " << variant_name
                             << " at " << variant->sequenceName << ":" << variant->position << endl;
                         duplicates.insert(variant);
@@ -1171,6 +1172,54 @@ namespace vg {
             callback(chunk.graph);
         };
 
+        // Chunks are cut on variant-free boundaries as we read the VCF, and
+        // queued up here with their reference sequence. Since construct_chunk
+        // numbers every chunk from 1, the queued chunks can be constructed in
+        // parallel, and then wired up in order, which is where IDs get
+        // assigned.
+        struct PendingChunk {
+            string reference_sequence;
+            vector<vcflib::Variant> variants;
+            size_t start;
+            size_t end;
+        };
+        vector<PendingChunk> pending;
+
+        // Construct all the queued chunks, and wire up and emit each in order.
+        auto flush_chunks = [&]() {
+            vector<ConstructedChunk> results(pending.size());
+#pragma omp parallel for schedule(dynamic, 1) if(pending.size() > 1)
+            for (size_t i = 0; i < pending.size(); i++) {
+                results[i] = construct_chunk(pending[i].reference_sequence, reference_contig,
+                    pending[i].variants, pending[i].start);
+            }
+
+            for (size_t i = 0; i < pending.size(); i++) {
+                // Wire up and emit the chunk graph
+                wire_and_emit(results[i]);
+
+                // Say we've completed the chunk
+                update_progress(pending[i].end - leading_offset);
+            }
+            pending.clear();
+        };
+
+        // Queue up a chunk covering the given range of the reference, and
+        // build the queue if it is full.
+        auto queue_chunk = [&](size_t start, size_t end, const vector<vcflib::Variant>& variants) {
+            // Get the ref sequence we need. FastaReference isn't thread safe,
+            // so this has to happen here and not in the workers.
+            pending.emplace_back();
+            pending.back().reference_sequence = reference.getSubSequence(reference_contig, start, end - start);
+            pending.back().variants = variants;
+            pending.back().start = start;
+            pending.back().end = end;
+
+            if (pending.size() >= max(chunks_in_flight, (size_t) 1)) {
+                flush_chunks();
+            }
+        };
+
         bool do_external_insertions = false;
         FastaReference* insertion_fasta;
 
@@ -1274,17 +1323,8 @@ namespace vg {
                             min((size_t) reference_end,
                                 (size_t) (chunk_start + bases_per_chunk))));
 
-                // Get the ref sequence we need
-                auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-                // Call the construction
-                auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-                // Wire up and emit the chunk graph
-                wire_and_emit(result);
-
-                // Say we've completed the chunk
-                update_progress(chunk_end - leading_offset);
+                // Queue the chunk up to be constructed
+                queue_chunk(chunk_start, chunk_end, chunk_variants);
 
                 // Set up a new chunk
                 chunk_start = chunk_end;
@@ -1306,17 +1346,8 @@ namespace vg {
                     min((size_t) reference_end,
                         (size_t) (chunk_start + bases_per_chunk)));
 
-            // Get the ref sequence we need
-            auto chunk_ref = reference.getSubSequence(reference_contig, chunk_start, chunk_end - chunk_start);
-
-            // Call the construction
-            auto result = construct_chunk(chunk_ref, reference_contig, chunk_variants, chunk_start);
-
-            // Wire up and emit the chunk graph
-            wire_and_emit(result);
-
-            // Say we've completed the chunk
-            update_progress(chunk_end - leading_offset);
+            // Queue the chunk up to be constructed
+            queue_chunk(chunk_start, chunk_end, chunk_variants);
 
             // Set up a new chunk
             chunk_start = chunk_end;
@@ -1324,6 +1355,9 @@ namespace vg {
             chunk_variants.clear();
         }
 
+        // Construct and emit whatever chunks are left
+        flush_chunks();
+
         // All the chunks have been wired and emitted. Now emit the very last node, if any
         emit_reference_node(last_node_buffer);
         // Update the max ID with that last node, so the next call starts at the next ID
@@ -1363,7 +1397,7 @@ namespace vg {
             }
 
             // These will all get destructed when the vector goes away.
-            buffers.emplace_back(new VcfBuffer(vcf));
+            buffers.emplace_back(new VcfBuffer(vcf, vcf_prefetch));
         }
 
         if (!allowed_vcf_names.empty()) {
@@ -114,6 +114,16 @@ public:
     // load all of chr1 into an std::string, even if we have no variants on it.
     size_t bases_per_chunk = 1024 * 1024;
     
+    // How many chunks should we gather up and construct at once, in parallel,
+    // before wiring them together and emitting them in order? The chunks are
+    // still wired and numbered one at a time, so the output is the same for
+    // any setting. 1 constructs each chunk as soon as it has been read.
+    size_t chunks_in_flight = 1;
+    
+    // How many variants should be read and parsed ahead of construction on a
+    // background thread for each VCF? 0 reads them as they are needed.
+    size_t vcf_prefetch = 0;
+    
     // This set contains the set of VCF sequence names we want to build the
     // graph for. If empty, we will build the graph for all sequences in the
     // FASTA. If nonempty, we build only for the specified sequences. If
@@ -20,111 +20,105 @@ namespace vg {
     * otherwise, hasRef is set to false and all strings are alt alleles.
     */
     pair<bool, vector<string> > Deconstructor::get_alleles(vector<SnarlTraversal> travs, string refpath, vg::VG* graph){
+        // Check if we have a PathIndex for this path
+        if (pindexes.find(refpath) != pindexes.end()){
+            return get_alleles(travs, *pindexes[refpath], graph);
+        }
+
+        // All alleles are alt alleles
+        // Just make our strings and push them back.
         vector<string> ret;
-        vector<SnarlTraversal> ordered_traversals;
+        for (auto t : travs){
+            stringstream t_allele;
+            
+            // Get the middle of the traversal that doesn't include the
+            // boundary nodes
+            auto iter = t.visit().begin();
+            iter++;
+            auto end = t.visit().end();
+            end--;
+            for (; iter != end; iter++){
+                auto v = *iter;
+                t_allele << graph->get_node(v.node_id())->sequence();
+            }
+            ret.push_back(t_allele.str());
+        }
+        return make_pair(false, ret);
+    }
+
+    pair<bool, vector<string> > Deconstructor::get_alleles(const vector<SnarlTraversal>& travs, const PathIndex& pind,
+                                                           const HandleGraph* graph) const {
+        vector<string> ret;
+        vector<const SnarlTraversal*> ordered_traversals;
         bool hasRef = false;
 
         bool normalize_indels = false;
 
-        // Check if we have a PathIndex for this path
-        bool path_indexed = pindexes.find(refpath) != pindexes.end();
-        for (auto t : travs){
+        for (auto& t : travs){
             stringstream t_allele;
 
-            // Get ref path index
-            if (path_indexed){
-                PathIndex* pind = pindexes[refpath];
-                // Check nodes of traversals Visits
-                // if they're all on the ref path,
-                // then this Snarltraversal is the ref allele.
-                bool is_ref = true;
-                
-                // Get the middle of the traversal that doesn't include the
-                // boundary nodes
-                auto iter = t.visit().begin();
-                iter++;
-                auto end = t.visit().end();
-                end--;
-                for (; iter != end; iter++){
-                    auto v = *iter;
-                    if (!pind->path_contains_node(v.node_id())){
-                        is_ref = false;
-                    }
-                    if (v.node_id() == 0){
-                        continue;
-                    }
-                    t_allele << graph->get_node(v.node_id())->sequence();
-                }
-
-                string t_str = t_allele.str();
-                if (t_str == ""){
-                    normalize_indels = true;
-                }
-                if (is_ref){
-                    ret.insert(ret.begin(), t_str);
-                    ordered_traversals.insert(ordered_traversals.begin(), t);
-                    hasRef = true;
+            // Check nodes of traversals Visits
+            // if they're all on the ref path,
+            // then this Snarltraversal is the ref allele.
+            bool is_ref = true;
+            
+            // Get the middle of the traversal that doesn't include the
+            // boundary nodes
+            auto iter = t.visit().begin();
+            iter++;
+            auto end = t.visit().end();
+            end--;
+            for (; iter != end; iter++){
+                auto& v = *iter;
+                if (!pind.by_id.count(v.node_id())){
+                    is_ref = false;
                 }
-                else{
-                    ret.push_back(t_str);
-                    ordered_traversals.push_back(t);
+                if (v.node_id() == 0){
+                    continue;
                 }
-                
+                t_allele << graph->get_sequence(graph->get_handle(v.node_id(), false));
             }
 
+            string t_str = t_allele.str();
+            if (t_str == ""){
+                normalize_indels = true;
+            }
+            if (is_ref){
+                ret.insert(ret.begin(), t_str);
+                ordered_traversals.insert(ordered_traversals.begin(), &t);
+                hasRef = true;
+            }
             else{
-                // All alleles are alt alleles
-                // Just make our strings and push them back.
-                
-                // Get the middle of the traversal that doesn't include the
-                // boundary nodes
-                auto iter = t.visit().begin();
-                iter++;
-                auto end = t.visit().end();
-                end--;
-                for (; iter != end; iter++){
-                    auto v = *iter;
-                    t_allele << graph->get_node(v.node_id())->sequence();
-                }
-                ret.push_back(t_allele.str());
-                ordered_traversals.push_back(t);
+                ret.push_back(t_str);
+                ordered_traversals.push_back(&t);
             }
         }
-            // If we haev indels to normalize, loop over our alleles
-            // normalize each string to VCF-friendly format (i.e. clip one ref base
-            // on the left side and put it in the ref field and the alt field).
-            if (normalize_indels){
-                for (int i = 0; i < ret.size(); ++i){
+        // If we haev indels to normalize, loop over our alleles
+        // normalize each string to VCF-friendly format (i.e. clip one ref base
+        // on the left side and put it in the ref field and the alt field).
+        if (normalize_indels){
+            for (int i = 0; i < ret.size(); ++i){
                 // Get the reference base to the left of the variant.
                 // If our empty allele is the reference (and we have a reference),
                 // put our new-found ref base in the 0th index of alleles vector.
                 // Then, prepend that base to each allele in our alleles vector.
-                    SnarlTraversal t = ordered_traversals[i];
-                    id_t start_id = t.visit(0).node_id();
-                    id_t end_id = t.visit(t.visit_size() - 1).node_id();
-                    pair<size_t, bool> pos_orientation_start = pindexes[refpath]->by_id[start_id];
-                    pair<size_t, bool> pos_orientation_end = pindexes[refpath]->by_id[end_id];
-                    bool use_start = pos_orientation_start.first < pos_orientation_end.first;
-                    bool rev = use_start ? pos_orientation_start.second : pos_orientation_end.second;
-                    string pre_node_seq = use_start ? graph->get_node(start_id)->sequence() :
-                                            graph->get_node(end_id)->sequence();
-                    string pre_variant_base = rev ? string(1, pre_node_seq[0]) : string(1, pre_node_seq[pre_node_seq.length() - 1]);
-                    ret[i].insert(0, pre_variant_base);
-                }
+                const SnarlTraversal& t = *ordered_traversals[i];
+                id_t start_id = t.visit(0).node_id();
+                id_t end_id = t.visit(t.visit_size() - 1).node_id();
+                pair<size_t, bool> pos_orientation_start = pind.by_id.at(start_id);
+                pair<size_t, bool> pos_orientation_end = pind.by_id.at(end_id);
+                bool use_start = pos_orientation_start.first < pos_orientation_end.first;
+                bool rev = use_start ? pos_orientation_start.second : pos_orientation_end.second;
+                string pre_node_seq = graph->get_sequence(graph->get_handle(use_start ? start_id : end_id, false));
+                string pre_variant_base = rev ? string(1, pre_node_seq[0]) : string(1, pre_node_seq[pre_node_seq.length() - 1]);
+                ret[i].insert(0, pre_variant_base);
             }
+        }
         return make_pair(hasRef, ret);
 
     }
 
-    void Deconstructor::deconstruct(string refpath, vg::VG* graph){
-        
-     
-
-        // Create path index for the contig if we don't have one.
-        if (pindexes.find(refpath) == pindexes.end()){
-            pindexes[refpath] = new PathIndex(*graph, refpath, false);
-        }
-
+    void Deconstructor::write_header(){
         // Spit header
         // Set contig to refpath
         // Set program field
@@ -144,58 +138,134 @@ namespace vg {
             cout << outvcf.header << endl;
             this->headered = true;
         }
+    }
+
+    void Deconstructor::deconstruct(string refpath, vg::VG* graph){
+        
+        // Create path index for the contig if we don't have one.
+        if (pindexes.find(refpath) == pindexes.end()){
+            pindexes[refpath] = new PathIndex(*graph, refpath, false);
+        }
+
+        write_header();
 
         // Find snarls
         // Snarls are variant sites ("bubbles")
-        SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph, refpath);
-        SnarlManager snarl_manager = snarl_finder->find_snarls();
-        vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
-        TraversalFinder* trav_finder = new ExhaustiveTraversalFinder(*graph, snarl_manager);
-        for (const Snarl* snarl: snarl_roots){
+        CactusSnarlFinder snarl_finder(*graph, refpath);
+        SnarlManager snarl_manager = snarl_finder.find_snarls();
+        
+        deconstruct_snarls(vector<string>{refpath}, graph, snarl_manager);
+    }
+
+    void Deconstructor::deconstruct(vector<string> refpaths, const xg::XG* index, const SnarlManager& snarl_manager){
+        
+        for (auto& refpath : refpaths){
+            // Create path index for the contig if we don't have one.
+            if (pindexes.find(refpath) == pindexes.end()){
+                pindexes[refpath] = new PathIndex(*index, refpath, false);
+            }
+        }
+        
+        write_header();
+        
+        deconstruct_snarls(refpaths, index, snarl_manager);
+    }
+
+    void Deconstructor::deconstruct_snarls(const vector<string>& refpaths, const HandleGraph* graph,
+                                           const SnarlManager& snarl_manager){
+        
+        // Work out where each top level snarl goes on each reference path that
+        // runs through both its ends, so we can write them out in order.
+        // Entries are the path number, the position, and the snarl.
+        vector<tuple<size_t, size_t, const Snarl*>> sites;
+        for (const Snarl* snarl : snarl_manager.top_level_snarls()){
             // For each top level snarl
             
             // Except the trivial ones
             if (snarl->type() == ULTRABUBBLE) {
-                auto contents = snarl_manager.shallow_contents(snarl, *graph, false);
-                if (contents.first.empty()) {
+                handle_t start = graph->get_handle(snarl->start().node_id(), snarl->start().backward());
+                handle_t end = graph->get_handle(snarl->end().node_id(), snarl->end().backward());
+                bool trivial = graph->follow_edges(start, false, [&](const handle_t& next) {
+                    return next == end;
+                });
+                if (trivial) {
                     // Nothing but the boundary nodes in this snarl
                     continue;
                 }
             }
             
-            vcflib::Variant v;
-            // SnarlTraversals are the (possible) alleles of our variant site.
-            vector<SnarlTraversal> travs = trav_finder->find_traversals(*snarl);
-            // write variant's sequenceName (VCF contig)
-            v.sequenceName = refpath;
-            // Set position based on the lowest position in the snarl.
-            pair<size_t, bool> pos_orientation_start = pindexes[refpath]->by_id[snarl->start().node_id()];
-            pair<size_t, bool> pos_orientation_end = pindexes[refpath]->by_id[snarl->end().node_id()];
-            bool use_start = pos_orientation_start.first < pos_orientation_end.first;
-            size_t node_pos = (use_start ? pos_orientation_start.first : pos_orientation_end.first);
-            v.position = node_pos +(use_start ? graph->get_node(snarl->start().node_id())->sequence().length() : graph->get_node(snarl->end().node_id())->sequence().length());
-            std::pair<bool, vector<string> > t_alleles = get_alleles(travs, refpath, graph);
-            if (t_alleles.first){
-                v.alleles.insert(v.alleles.begin(), t_alleles.second[0]);
-                v.ref = t_alleles.second[0];
-                for (int i = 1; i < t_alleles.second.size(); i++){
-                    v.alleles.push_back(t_alleles.second[i]);
-                    v.alt.push_back(t_alleles.second[i]);
+            for (size_t i = 0; i < refpaths.size(); i++){
+                const PathIndex& pind = *pindexes.at(refpaths[i]);
+                auto found_start = pind.by_id.find(snarl->start().node_id());
+                auto found_end = pind.by_id.find(snarl->end().node_id());
+                if (found_start == pind.by_id.end() || found_end == pind.by_id.end()){
+                    // This path doesn't go through the snarl
+                    continue;
                 }
+                
+                // Set position based on the lowest position in the snarl.
+                bool use_start = found_start->second.first < found_end->second.first;
+                size_t node_pos = (use_start ? found_start->second.first : found_end->second.first);
+                id_t pre_id = use_start ? snarl->start().node_id() : snarl->end().node_id();
+                sites.emplace_back(i, node_pos + graph->get_length(graph->get_handle(pre_id, false)), snarl);
             }
-            else{
-                cerr << "NO REFERENCE ALLELE FOUND" << endl;
-                v.alleles.insert(v.alleles.begin(), ".");
-                for (int i = 0; i < t_alleles.second.size(); i++){
-                    v.alleles.push_back(t_alleles.second[i]);
-                    v.alt.push_back(t_alleles.second[i]);
+        }
+        
+        std::stable_sort(sites.begin(), sites.end(), [](const tuple<size_t, size_t, const Snarl*>& a,
+                                                        const tuple<size_t, size_t, const Snarl*>& b) {
+            return make_pair(get<0>(a), get<1>(a)) < make_pair(get<0>(b), get<1>(b));
+        });
+        
+        // Find traversals without modifying anything, so the threads can share this.
+        HandleTraversalFinder trav_finder(*graph, snarl_manager);
+        
+        // Only hold the records for a batch of snarls at a time
+        vector<string> records;
+        for (size_t batch_start = 0; batch_start < sites.size(); batch_start += batch_size){
+            size_t batch_end = min(sites.size(), batch_start + batch_size);
+            records.clear();
+            records.resize(batch_end - batch_start);
+            
+            #pragma omp parallel for schedule(dynamic, 1)
+            for (size_t i = batch_start; i < batch_end; i++){
+                const string& refpath = refpaths[get<0>(sites[i])];
+                const Snarl* snarl = get<2>(sites[i]);
+                
+                vcflib::Variant v;
+                // SnarlTraversals are the (possible) alleles of our variant site.
+                vector<SnarlTraversal> travs = trav_finder.find_traversals(*snarl);
+                // write variant's sequenceName (VCF contig)
+                v.sequenceName = refpath;
+                v.position = get<1>(sites[i]);
+                std::pair<bool, vector<string> > t_alleles = get_alleles(travs, *pindexes.at(refpath), graph);
+                if (t_alleles.first){
+                    v.alleles.insert(v.alleles.begin(), t_alleles.second[0]);
+                    v.ref = t_alleles.second[0];
+                    for (int j = 1; j < t_alleles.second.size(); j++){
+                        v.alleles.push_back(t_alleles.second[j]);
+                        v.alt.push_back(t_alleles.second[j]);
+                    }
                 }
+                else{
+#pragma omp critical (cerr)
+                    cerr << "NO REFERENCE ALLELE FOUND" << endl;
+                    v.alleles.insert(v.alleles.begin(), ".");
+                    for (int j = 0; j < t_alleles.second.size(); j++){
+                        v.alleles.push_back(t_alleles.second[j]);
+                        v.alt.push_back(t_alleles.second[j]);
+                    }
+                }
+                v.updateAlleleIndexes();
+                
+                stringstream record;
+                record << v;
+                records[i - batch_start] = record.str();
+            }
+            
+            for (auto& record : records){
+                cout << record << endl;
             }
-            v.updateAlleleIndexes();
-            cerr << v << endl;
-
         }
-        
 
     }
 
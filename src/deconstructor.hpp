@@ -10,6 +10,8 @@
 #include "Variant.h"
 #include "path.hpp"
 #include "vg.hpp"
+#include "xg.hpp"
+#include "snarls.hpp"
 #include "genotypekit.hpp"
 #include "vg.pb.h"
 #include "Fasta.h"
@@ -36,10 +38,36 @@ namespace vg{
 
             void deconstruct(string refpath, vg::VG* graph);
             void deconstruct(vector<string> refpaths, vg::VG* graph); 
+            
+            /**
+             * Deconstruct the top-level snarls in the given snarl manager
+             * against each of the given paths in an XG index, without needing
+             * the graph in memory as a VG. Snarls are processed in parallel,
+             * and the records are written in reference order.
+             */
+            void deconstruct(vector<string> refpaths, const xg::XG* index, const SnarlManager& snarl_manager);
+            
             map<string, PathIndex*> pindexes;
+            
+            /// How many snarls to process in parallel before writing their
+            /// records out
+            size_t batch_size = 1024;
 
         private:
             bool headered = false;
+            
+            /// Write the VCF header, if it hasn't been written yet
+            void write_header();
+            
+            /// Deconstruct the top-level snarls against the given paths, which
+            /// must have indexes in pindexes, and write their records to cout.
+            void deconstruct_snarls(const vector<string>& refpaths, const HandleGraph* graph,
+                                    const SnarlManager& snarl_manager);
+            
+            /// Get the alleles of the given traversals, with the one on the
+            /// reference path first, if there is one.
+            pair<bool, vector<string> > get_alleles(const vector<SnarlTraversal>& travs, const PathIndex& pind,
+                                                    const HandleGraph* graph) const;
     };
 }
 #endif
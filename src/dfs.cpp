@@ -1,9 +1,39 @@
 #include "dfs.hpp"
 
+#include <limits>
+
 namespace vg {
 
 using namespace std;
 
+void DFSBuffer::reset(const HandleGraph& graph) {
+    frames.clear();
+    next_handles.clear();
+    sparse_states.clear();
+
+    // find the range of IDs in one pass, and use it directly as the node rank
+    // if it isn't much bigger than the number of nodes
+    id_t found_min = numeric_limits<id_t>::max();
+    id_t found_max = numeric_limits<id_t>::min();
+    size_t node_count = 0;
+    graph.for_each_handle([&](const handle_t& handle) -> bool {
+        id_t id = graph.get_id(handle);
+        found_min = min(found_min, id);
+        found_max = max(found_max, id);
+        node_count++;
+        return true;
+    });
+
+    dense = node_count > 0 && (size_t) (found_max - found_min) < 2 * node_count;
+    if (dense) {
+        min_id = found_min;
+        past_max_id = found_max + 1;
+        dense_states.assign(2 * (past_max_id - min_id), PRE);
+    } else {
+        dense_states.clear();
+    }
+}
+
 // depth first search across node traversals with interface to traversal tree via callback
 void handle_graph_dfs(
     const HandleGraph& graph,
@@ -18,118 +48,19 @@ void handle_graph_dfs(
     const unordered_set<handle_t>& sinks                     // when hitting a sink, don't keep walking
     ) {
 
-    // to maintain search state
-    enum SearchState { PRE = 0, CURR, POST };
-    unordered_map<handle_t, SearchState> state; // implicitly constructed entries will be PRE.
-
-    // to maintain stack frames
-    struct Frame {
-        handle_t handle;
-        vector<edge_t>::iterator begin, end;
-        Frame(handle_t h,
-              vector<edge_t>::iterator b,
-              vector<edge_t>::iterator e)
-            : handle(h), begin(b), end(e) { }
-    };
-
-    // maintains edges while the node traversal's frame is on the stack
-    unordered_map<handle_t, vector<edge_t> > edges;
-
-    // do dfs from given root.  returns true if terminated via break condition, false otherwise
-    function<bool(const handle_t&)> dfs_single_source = [&](const handle_t& root) {
-                
-        // to store the stack frames
-        deque<Frame> todo;
-        if (state[root] == SearchState::PRE) {
-            state[root] = SearchState::CURR;
-                
-            // Collect all the edges attached to the outgoing side of the
-            // traversal.
-            auto& es = edges[root];
-            // follow edges?
-            graph.follow_edges(root, false, [&](const handle_t& next) {
-                    es.push_back(graph.edge_handle(root, next));
-                });
-                
-            todo.push_back(Frame(root, es.begin(), es.end()));
-            // run our discovery-time callback
-            handle_begin_fn(root);
-            // and check if we should break
-            if (break_fn()) {
-                return true;
-            }
-        }
-        // now begin the search rooted at this NodeTraversal
-        while (!todo.empty()) {
-            // get the frame
-            auto& frame = todo.back();
-            todo.pop_back();
-            // and set up reference to it
-            auto& handle = frame.handle;
-            auto& edges_begin = frame.begin;
-            auto& edges_end = frame.end;
-            // run through the edges to handle
-            while (edges_begin != edges_end) {
-                auto& edge = *edges_begin;
-                // run the edge callback
-                edge_fn(edge);
-                    
-                // what's the handle we'd get to following this edge
-                const handle_t& target = edge.second;
-
-                auto search_state = state[target];
-                // if we've not seen it, follow it
-                if (search_state == SearchState::PRE) {
-                    tree_fn(edge);
-                    // save the rest of the search for this handle on the stack
-                    todo.push_back(Frame(handle, ++edges_begin, edges_end));
-                    // switch our focus to the handle at the other end of the edge
-                    handle = target;
-                    // and store it on the stack
-                    state[handle] = SearchState::CURR;
-                    auto& es = edges[handle];
-
-                    // only walk out of handle that are not the sink
-                    if (sinks.empty() || sinks.count(handle) == false) {
-                        // follow edges?
-                        graph.follow_edges(handle, false, [&](const handle_t& next) {
-                                es.push_back(graph.edge_handle(handle, next));
-                            });
-                    }
-                    edges_begin = es.begin();
-                    edges_end = es.end();
-                    // run our discovery-time callback
-                    handle_begin_fn(handle);
-                } else if (search_state == SearchState::CURR) {
-                    // if it's on the stack
-                    edge_curr_fn(edge);
-                    ++edges_begin;
-                } else {
-                    // it's already been handled, so in another part of the tree
-                    edge_cross_fn(edge);
-                    ++edges_begin;
-                }
-            }
-            state[handle] = SearchState::POST;
-            handle_end_fn(handle);
-            edges.erase(handle); // clean up edge cache
-        }
-
-        return false;
-    };
-
-    if (sources.empty()) {
-        // attempt the search rooted at all NodeTraversals
-        graph.for_each_handle([&](const handle_t& handle_fwd) {
-                handle_t handle_rev = graph.flip(handle_fwd);
-                dfs_single_source(handle_fwd);
-                dfs_single_source(handle_rev);
-            });
-    } else {
-        for (auto source : sources) {
-            dfs_single_source(source);
-        }
-    }
+    // callbacks may start searches of their own, so each search gets its own buffer
+    DFSBuffer buffer;
+    handle_graph_dfs(graph,
+                     handle_begin_fn,
+                     handle_end_fn,
+                     break_fn,
+                     edge_fn,
+                     tree_fn,
+                     edge_curr_fn,
+                     edge_cross_fn,
+                     sources,
+                     sinks,
+                     buffer);
 }
 
 void handle_graph_dfs(const HandleGraph& graph,
@@ -138,6 +69,7 @@ void handle_graph_dfs(const HandleGraph& graph,
                       const vector<handle_t>& sources,
                       const unordered_set<handle_t>& sinks) {
     auto edge_noop = [](const edge_t& e) { };
+    DFSBuffer buffer;
     handle_graph_dfs(graph,
                      handle_begin_fn,
                      handle_end_fn,
@@ -147,7 +79,8 @@ void handle_graph_dfs(const HandleGraph& graph,
                      edge_noop,
                      edge_noop,
                      sources,
-                     sinks);
+                     sinks,
+                     buffer);
 }
 
 void handle_graph_dfs(const HandleGraph& graph,
@@ -157,6 +90,7 @@ void handle_graph_dfs(const HandleGraph& graph,
     auto edge_noop = [](const edge_t& e) { };
     vector<handle_t> empty_sources;
     unordered_set<handle_t> empty_sinks;
+    DFSBuffer buffer;
     handle_graph_dfs(graph,
                      handle_begin_fn,
                      handle_end_fn,
@@ -166,7 +100,8 @@ void handle_graph_dfs(const HandleGraph& graph,
                      edge_noop,
                      edge_noop,
                      empty_sources,
-                     empty_sinks);
+                     empty_sinks,
+                     buffer);
 }
 
 }
@@ -5,11 +5,203 @@
 #include <vector>
 #include <set>
 #include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
 
 namespace vg {
 
 using namespace std;
 
+/**
+ * Working space for a depth first search over a handle graph, which can be
+ * kept and handed to search after search so they don't have to allocate.
+ *
+ * Search states are kept in a vector indexed by node rank and orientation when
+ * the graph's node IDs are compact, as they usually are in an XG or a freshly
+ * built VG, and in a hash table otherwise.
+ */
+class DFSBuffer {
+public:
+    /// Where a search has got to with an oriented node
+    enum SearchState : uint8_t { PRE = 0, CURR, POST };
+
+    /// Get ready to search the given graph, forgetting any earlier search
+    void reset(const HandleGraph& graph);
+
+    /// Get the search state of an oriented node in the graph being searched
+    template<typename Graph>
+    inline SearchState get_state(const Graph& graph, const handle_t& handle) const;
+
+    /// Set the search state of an oriented node in the graph being searched
+    template<typename Graph>
+    inline void set_state(const Graph& graph, const handle_t& handle, SearchState new_state);
+
+    /// A node on the search stack, with its unfollowed edges
+    struct Frame {
+        /// The oriented node
+        handle_t handle;
+        /// Index in next_handles where the node's edges start. They run to
+        /// the start of the next frame's, or to the end of next_handles for
+        /// the top frame.
+        size_t first_edge;
+        /// Index in next_handles of the next edge to follow
+        size_t next_edge;
+    };
+
+    /// The search stack
+    vector<Frame> frames;
+    /// The handles reached by the edges out of the nodes on the stack
+    vector<handle_t> next_handles;
+
+private:
+    /// Are we using dense_states?
+    bool dense = false;
+    /// Smallest node ID when dense
+    id_t min_id = 0;
+    /// Smallest ID not covered when dense
+    id_t past_max_id = 0;
+    /// States by 2 * (ID - min_id) + orientation
+    vector<SearchState> dense_states;
+    /// States of nodes outside the dense range, or of all nodes if IDs are sparse
+    unordered_map<handle_t, SearchState> sparse_states;
+};
+
+template<typename Graph>
+inline DFSBuffer::SearchState DFSBuffer::get_state(const Graph& graph, const handle_t& handle) const {
+    id_t id = graph.get_id(handle);
+    if (dense && id >= min_id && id < past_max_id) {
+        return dense_states[2 * (id - min_id) + graph.get_is_reverse(handle)];
+    }
+    auto found = sparse_states.find(handle);
+    return found == sparse_states.end() ? PRE : found->second;
+}
+
+template<typename Graph>
+inline void DFSBuffer::set_state(const Graph& graph, const handle_t& handle, SearchState new_state) {
+    id_t id = graph.get_id(handle);
+    if (dense && id >= min_id && id < past_max_id) {
+        dense_states[2 * (id - min_id) + graph.get_is_reverse(handle)] = new_state;
+    } else {
+        sparse_states[handle] = new_state;
+    }
+}
+
+/**
+ * Depth first search across node traversals, with the search tree reported
+ * through the given callables. The search is iterative, so it can go as deep
+ * as the graph does, and it is templated on the graph and callable types, so
+ * nothing goes through a std::function per node or edge when the concrete
+ * graph type is known.
+ *
+ * handle_begin_fn is called when a node orientation is first encountered, and
+ * handle_end_fn when it goes out of scope. break_fn is checked after each
+ * discovery, and stops the whole search when it returns true. edge_fn is
+ * called for every edge encountered, then tree_fn if it forms part of the
+ * spanning tree, edge_curr_fn if it leads back into the current branch, or
+ * edge_cross_fn if it leads into an already-finished part of the tree. Edges
+ * are passed in the graph's canonical form.
+ *
+ * The search starts from each of the sources in turn, or from every node in
+ * both orientations if there are none, and doesn't walk out of any sinks.
+ * Returns true if it was stopped by break_fn.
+ */
+template<typename Graph, typename BeginFn, typename EndFn, typename BreakFn,
+         typename EdgeFn, typename TreeFn, typename CurrFn, typename CrossFn>
+bool handle_graph_dfs(const Graph& graph,
+                      BeginFn&& handle_begin_fn,
+                      EndFn&& handle_end_fn,
+                      BreakFn&& break_fn,
+                      EdgeFn&& edge_fn,
+                      TreeFn&& tree_fn,
+                      CurrFn&& edge_curr_fn,
+                      CrossFn&& edge_cross_fn,
+                      const vector<handle_t>& sources,
+                      const unordered_set<handle_t>& sinks,
+                      DFSBuffer& buffer) {
+
+    buffer.reset(graph);
+
+    // put a node orientation on the stack, with the edges out of it if we
+    // walk out of it, and say whether to stop
+    auto discover = [&](const handle_t& handle, bool walk_out) {
+        buffer.set_state(graph, handle, DFSBuffer::CURR);
+        size_t first_edge = buffer.next_handles.size();
+        if (walk_out) {
+            graph.follow_edges_inline(handle, false, [&](const handle_t& next) {
+                buffer.next_handles.push_back(next);
+                return true;
+            });
+        }
+        buffer.frames.push_back(DFSBuffer::Frame{handle, first_edge, first_edge});
+        handle_begin_fn(handle);
+        return (bool) break_fn();
+    };
+
+    // do dfs from given root. returns true if terminated via break condition, false otherwise
+    auto dfs_single_source = [&](const handle_t& root) {
+        if (buffer.get_state(graph, root) != DFSBuffer::PRE) {
+            return false;
+        }
+        if (discover(root, true)) {
+            return true;
+        }
+        while (!buffer.frames.empty()) {
+            auto& frame = buffer.frames.back();
+            if (frame.next_edge < buffer.next_handles.size()) {
+                // follow the next edge out of the node on top of the stack
+                handle_t from = frame.handle;
+                handle_t target = buffer.next_handles[frame.next_edge++];
+                edge_t edge = graph.edge_handle(from, target);
+                edge_fn(edge);
+
+                switch (buffer.get_state(graph, target)) {
+                case DFSBuffer::PRE:
+                    // if we've not seen it, follow it, unless it's a sink
+                    tree_fn(edge);
+                    if (discover(target, sinks.empty() || !sinks.count(target))) {
+                        return true;
+                    }
+                    break;
+                case DFSBuffer::CURR:
+                    // it's on the stack
+                    edge_curr_fn(edge);
+                    break;
+                default:
+                    // it's already been handled, so in another part of the tree
+                    edge_cross_fn(edge);
+                    break;
+                }
+            } else {
+                // all the edges are done, so the node goes out of scope
+                handle_t handle = frame.handle;
+                buffer.next_handles.resize(frame.first_edge);
+                buffer.frames.pop_back();
+                buffer.set_state(graph, handle, DFSBuffer::POST);
+                handle_end_fn(handle);
+            }
+        }
+        return false;
+    };
+
+    bool stopped = false;
+    if (sources.empty()) {
+        // attempt the search rooted at all node traversals
+        graph.for_each_handle([&](const handle_t& handle_fwd) -> bool {
+            stopped = dfs_single_source(handle_fwd) || dfs_single_source(graph.flip(handle_fwd));
+            return !stopped;
+        });
+    } else {
+        for (auto& source : sources) {
+            if (dfs_single_source(source)) {
+                stopped = true;
+                break;
+            }
+        }
+    }
+    return stopped;
+}
+
 void handle_graph_dfs(
     const HandleGraph& graph,
     const function<void(const handle_t&)>& handle_begin_fn,  // called when node orientation is first encountered
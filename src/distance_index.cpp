@@ -0,0 +1,321 @@
+#include "distance_index.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace vg {
+
+using namespace std;
+
+const string DistanceIndex::MAGIC = "VGDST";
+
+DistanceIndex::DistanceIndex(const HandleGraph* graph, const SnarlManager* snarl_manager) : graph(graph) {
+
+    // Number the snarls so that parents come before their children
+    unordered_map<const Snarl*, size_t> snarl_number;
+    snarl_manager->for_each_snarl_preorder([&](const Snarl* snarl) {
+        const Snarl* parent = snarl_manager->parent_of(snarl);
+
+        SnarlRecord record;
+        record.start_id = snarl->start().node_id();
+        record.start_rev = snarl->start().backward();
+        record.end_id = snarl->end().node_id();
+        record.end_rev = snarl->end().backward();
+        record.parent = (parent == nullptr) ? NO_SNARL : snarl_number.at(parent);
+        record.start_to_end = numeric_limits<int64_t>::max();
+        record.start_to_start = numeric_limits<int64_t>::max();
+        record.end_to_end = numeric_limits<int64_t>::max();
+        record.end_to_start = numeric_limits<int64_t>::max();
+
+        snarl_number[snarl] = snarls.size();
+        snarls.push_back(record);
+    });
+
+    index_boundaries();
+
+    // Measuring a snarl skips over its children, so they have to go first
+    for (size_t i = snarls.size(); i > 0; i--) {
+        measure_snarl(i - 1);
+    }
+}
+
+DistanceIndex::DistanceIndex(const HandleGraph* graph, istream& in) : graph(graph) {
+    auto read_int = [&](size_t bytes) -> uint64_t {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            int c = in.get();
+            if (c == EOF) {
+                throw runtime_error("[vg::DistanceIndex] index is truncated");
+            }
+            value |= ((uint64_t) (unsigned char) c) << (8 * i);
+        }
+        return value;
+    };
+
+    string magic(MAGIC.size(), '\0');
+    in.read(&magic[0], magic.size());
+    if (!in || magic != MAGIC) {
+        throw runtime_error("[vg::DistanceIndex] not a distance index");
+    }
+    uint32_t version = read_int(4);
+    if (version > VERSION) {
+        throw runtime_error("[vg::DistanceIndex] distance index version " + to_string(version)
+                            + " is newer than supported version " + to_string(VERSION));
+    }
+
+    snarls.resize(read_int(8));
+    for (auto& record : snarls) {
+        record.start_id = read_int(8);
+        record.start_rev = read_int(1);
+        record.end_id = read_int(8);
+        record.end_rev = read_int(1);
+        record.parent = read_int(8);
+        record.start_to_end = read_int(8);
+        record.start_to_start = read_int(8);
+        record.end_to_end = read_int(8);
+        record.end_to_start = read_int(8);
+    }
+
+    size_t node_count = read_int(8);
+    node_snarl.reserve(node_count);
+    for (size_t i = 0; i < node_count; i++) {
+        id_t node_id = read_int(8);
+        node_snarl[node_id] = read_int(8);
+    }
+
+    index_boundaries();
+}
+
+void DistanceIndex::save(ostream& out) const {
+    auto write_int = [&](uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) {
+            out.put((char) ((value >> (8 * i)) & 0xFF));
+        }
+    };
+
+    out.write(MAGIC.data(), MAGIC.size());
+    write_int(VERSION, 4);
+    write_int(snarls.size(), 8);
+    for (auto& record : snarls) {
+        write_int(record.start_id, 8);
+        write_int(record.start_rev, 1);
+        write_int(record.end_id, 8);
+        write_int(record.end_rev, 1);
+        write_int(record.parent, 8);
+        write_int(record.start_to_end, 8);
+        write_int(record.start_to_start, 8);
+        write_int(record.end_to_end, 8);
+        write_int(record.end_to_start, 8);
+    }
+
+    write_int(node_snarl.size(), 8);
+    for (auto& node_and_snarl : node_snarl) {
+        write_int(node_and_snarl.first, 8);
+        write_int(node_and_snarl.second, 8);
+    }
+
+    if (!out) {
+        throw runtime_error("[vg::DistanceIndex] could not write index");
+    }
+}
+
+size_t DistanceIndex::snarl_count() const {
+    return snarls.size();
+}
+
+void DistanceIndex::index_boundaries() {
+    snarl_into.clear();
+    for (size_t i = 0; i < snarls.size(); i++) {
+        snarl_into[make_pair(snarls[i].start_id, snarls[i].start_rev)] = i;
+        snarl_into[make_pair(snarls[i].end_id, !snarls[i].end_rev)] = i;
+    }
+}
+
+size_t DistanceIndex::entered_snarl(const handle_t& handle) const {
+    auto found = snarl_into.find(make_pair(graph->get_id(handle), graph->get_is_reverse(handle)));
+    return found == snarl_into.end() ? NO_SNARL : found->second;
+}
+
+vector<size_t> DistanceIndex::snarls_containing(id_t node_id) const {
+    vector<size_t> containing;
+    auto found = node_snarl.find(node_id);
+    if (found != node_snarl.end()) {
+        for (size_t snarl_number = found->second; snarl_number != NO_SNARL; snarl_number = snarls[snarl_number].parent) {
+            containing.push_back(snarl_number);
+        }
+    }
+    return containing;
+}
+
+void DistanceIndex::measure_snarl(size_t snarl_number) {
+    const SnarlRecord& record = snarls[snarl_number];
+    handle_t start = graph->get_handle(record.start_id, record.start_rev);
+    handle_t end = graph->get_handle(record.end_id, record.end_rev);
+    handle_t start_out = graph->flip(start);
+    handle_t end_in = graph->flip(end);
+
+    // Search the snarl from one of its boundaries going in, and get the
+    // distances to the start of the end and of the start reversed
+    auto measure_from = [&](const handle_t& entry) {
+        pair<int64_t, int64_t> found(numeric_limits<int64_t>::max(), numeric_limits<int64_t>::max());
+
+        search({make_pair(entry, (int64_t) 0)}, numeric_limits<int64_t>::max(), [&](size_t other) {
+            // Children are all measured, and we never leave this snarl
+            return other != snarl_number;
+        }, [&](const handle_t& here, int64_t distance) {
+            if (here == entry && distance == 0) {
+                return EXPAND;
+            }
+            if (here == end) {
+                found.first = distance;
+            }
+            if (here == start_out) {
+                found.second = distance;
+            }
+            if (here == end || here == start_out || here == start || here == end_in) {
+                // Don't wander out of the snarl
+                return STOP;
+            }
+            // The search doesn't go inside children, so this node is ours
+            node_snarl[graph->get_id(here)] = snarl_number;
+            return EXPAND;
+        });
+
+        return found;
+    };
+
+    auto from_start = measure_from(start);
+    auto from_end = measure_from(end_in);
+
+    snarls[snarl_number].start_to_end = from_start.first;
+    snarls[snarl_number].start_to_start = from_start.second;
+    snarls[snarl_number].end_to_end = from_end.first;
+    snarls[snarl_number].end_to_start = from_end.second;
+}
+
+void DistanceIndex::search(const vector<pair<handle_t, int64_t>>& sources, int64_t maximum,
+                           const function<bool(size_t)>& can_skip,
+                           const function<SearchStep(const handle_t&, int64_t)>& reached) const {
+
+    // Queue up handles (as integers) by distance, closest first
+    using queued_t = pair<int64_t, int64_t>;
+    priority_queue<queued_t, vector<queued_t>, greater<queued_t>> queue;
+    unordered_set<handle_t> settled;
+
+    auto enqueue = [&](const handle_t& handle, int64_t distance) {
+        if (distance <= maximum && !settled.count(handle)) {
+            queue.emplace(distance, as_integer(handle));
+        }
+    };
+
+    for (auto& source : sources) {
+        enqueue(source.first, source.second);
+    }
+
+    while (!queue.empty()) {
+        int64_t distance = queue.top().first;
+        handle_t here = as_handle(queue.top().second);
+        queue.pop();
+
+        if (settled.count(here)) {
+            continue;
+        }
+        settled.insert(here);
+
+        SearchStep step = reached(here, distance);
+        if (step == FINISH) {
+            return;
+        }
+        if (step == STOP) {
+            continue;
+        }
+
+        size_t entered = entered_snarl(here);
+        if (entered != NO_SNARL && can_skip(entered)) {
+            // Jump over the snarl's contents to wherever we can come out
+            const SnarlRecord& record = snarls[entered];
+            handle_t start = graph->get_handle(record.start_id, record.start_rev);
+            bool from_start = (here == start);
+            int64_t to_end = from_start ? record.start_to_end : record.end_to_end;
+            int64_t to_start = from_start ? record.start_to_start : record.end_to_start;
+            if (to_end != numeric_limits<int64_t>::max()) {
+                enqueue(graph->get_handle(record.end_id, record.end_rev), distance + to_end);
+            }
+            if (to_start != numeric_limits<int64_t>::max()) {
+                enqueue(graph->flip(start), distance + to_start);
+            }
+            continue;
+        }
+
+        int64_t past = distance + graph->get_length(here);
+        graph->follow_edges(here, false, [&](const handle_t& next) {
+            enqueue(next, past);
+        });
+    }
+}
+
+int64_t DistanceIndex::min_distance(pos_t pos1, pos_t pos2, int64_t maximum, memo_t* memo) const {
+
+    auto key = make_pair(pos1, pos2);
+    if (memo != nullptr) {
+        auto found = memo->find(key);
+        if (found != memo->end()) {
+            if (found->second.second) {
+                // We know the exact distance
+                return found->second.first <= maximum ? found->second.first : numeric_limits<int64_t>::max();
+            } else if (maximum <= found->second.first) {
+                // We already looked at least this far and didn't find it
+                return numeric_limits<int64_t>::max();
+            }
+        }
+    }
+
+    int64_t distance = numeric_limits<int64_t>::max();
+
+    handle_t from = graph->get_handle(id(pos1), is_rev(pos1));
+    handle_t to = graph->get_handle(id(pos2), is_rev(pos2));
+    if (from == to && offset(pos1) <= offset(pos2)) {
+        // Nothing can beat walking along the node
+        distance = offset(pos2) - offset(pos1);
+    } else {
+        // We can skip any snarl we're not looking inside of
+        vector<size_t> containing = snarls_containing(id(pos1));
+        for (size_t snarl_number : snarls_containing(id(pos2))) {
+            containing.push_back(snarl_number);
+        }
+
+        vector<pair<handle_t, int64_t>> sources;
+        int64_t past = graph->get_length(from) - offset(pos1);
+        graph->follow_edges(from, false, [&](const handle_t& next) {
+            sources.emplace_back(next, past);
+        });
+
+        search(sources, maximum, [&](size_t snarl_number) {
+            return find(containing.begin(), containing.end(), snarl_number) == containing.end();
+        }, [&](const handle_t& here, int64_t reached_distance) {
+            if (here == to) {
+                distance = reached_distance + offset(pos2);
+                return FINISH;
+            }
+            return EXPAND;
+        });
+    }
+
+    if (distance > maximum) {
+        distance = numeric_limits<int64_t>::max();
+    }
+
+    if (memo != nullptr) {
+        if (distance != numeric_limits<int64_t>::max()) {
+            (*memo)[key] = make_pair(distance, true);
+        } else {
+            (*memo)[key] = make_pair(maximum, false);
+        }
+    }
+
+    return distance;
+}
+
+}
@@ -0,0 +1,146 @@
+#ifndef VG_DISTANCE_INDEX_HPP_INCLUDED
+#define VG_DISTANCE_INDEX_HPP_INCLUDED
+
+/**
+ * \file distance_index.hpp: define a DistanceIndex, which precomputes the
+ * distances across each snarl in a snarl tree so that minimum distance queries
+ * between graph positions don't have to search through snarls that can't hold
+ * either position.
+ */
+
+#include <iostream>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+#include "handle.hpp"
+#include "snarls.hpp"
+#include "hash_map.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * An index of the minimum distances between the boundaries of every snarl in a
+ * snarl tree, through the snarl's contents.
+ *
+ * Queries run a Dijkstra search forward from the first position. Whenever the
+ * search reads into a snarl that contains neither position, it jumps straight
+ * to the snarl's exits using the stored distances instead of searching its
+ * contents. Distances match the convention of xg_distance(): the number of
+ * bases stepped over to get from the first position to the second.
+ *
+ * Only node IDs and orientations are stored, so an index built against one
+ * HandleGraph (say a VG) can answer queries against any other graph with the
+ * same topology (say the XG made from it). It is read-only once built, so it
+ * can be shared between threads, while each thread keeps its own memo.
+ */
+class DistanceIndex {
+public:
+
+    /// A memo for query results, to be kept by a single thread. Maps a pair
+    /// of positions to a distance and whether that distance is exact, or only
+    /// the maximum of a search that didn't find the second position.
+    using memo_t = unordered_map<pair<pos_t, pos_t>, pair<int64_t, bool>>;
+
+    /// Index the snarls managed by the given SnarlManager, measuring their
+    /// contents in the given graph.
+    DistanceIndex(const HandleGraph* graph, const SnarlManager* snarl_manager);
+
+    /// Load an index from a stream, for answering queries in the given graph.
+    /// Throws if it isn't a distance index.
+    DistanceIndex(const HandleGraph* graph, istream& in);
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Get the minimum distance walking forward from the first position to
+    /// the second, or numeric_limits<int64_t>::max() if the second position
+    /// can't be reached within the given maximum distance. If a memo is
+    /// given, results are looked up in and saved to it.
+    int64_t min_distance(pos_t pos1, pos_t pos2, int64_t maximum = numeric_limits<int64_t>::max(),
+                         memo_t* memo = nullptr) const;
+
+    /// Get the number of indexed snarls
+    size_t snarl_count() const;
+
+private:
+
+    /// What a search should do with a handle it has just reached
+    enum SearchStep {
+        /// Carry on from this handle
+        EXPAND,
+        /// Don't go any further from this handle, but keep searching
+        STOP,
+        /// End the whole search
+        FINISH
+    };
+
+    /// The distances we know across one snarl
+    struct SnarlRecord {
+        /// The snarl's start traversal, reading in
+        id_t start_id;
+        bool start_rev;
+        /// The snarl's end traversal, reading out
+        id_t end_id;
+        bool end_rev;
+        /// The number of the parent snarl, or NO_SNARL for a top level snarl
+        size_t parent;
+        /// Distance from the start of the start traversal to the start of the
+        /// end traversal, or to the start of the start traversal reversed
+        int64_t start_to_end;
+        int64_t start_to_start;
+        /// Distance from the start of the end traversal reversed to the start
+        /// of the end traversal, or to the start of the start traversal reversed
+        int64_t end_to_end;
+        int64_t end_to_start;
+    };
+
+    /// Measure the distances across the given snarl, whose children must all
+    /// have been measured already, and claim its nodes.
+    void measure_snarl(size_t snarl_number);
+
+    /// Fill in the index of which snarl each boundary traversal reads into
+    void index_boundaries();
+
+    /// Get the number of the snarl that the given handle reads into, or
+    /// NO_SNARL if it doesn't read into one.
+    size_t entered_snarl(const handle_t& handle) const;
+
+    /// Get the numbers of the snarls that contain the given node, deepest
+    /// first, not counting snarls it is only a boundary of.
+    vector<size_t> snarls_containing(id_t node_id) const;
+
+    /// Run a Dijkstra search from the starts of the given handles at the given
+    /// distances, up to the given maximum. The reached function is called on
+    /// each handle as it is settled, with its distance. Snarls read into that
+    /// can_skip approves of are jumped over instead of searched.
+    void search(const vector<pair<handle_t, int64_t>>& sources, int64_t maximum,
+                const function<bool(size_t)>& can_skip,
+                const function<SearchStep(const handle_t&, int64_t)>& reached) const;
+
+    /// The graph that queries run in
+    const HandleGraph* graph;
+    /// All the indexed snarls, parents before children
+    vector<SnarlRecord> snarls;
+    /// Which snarl each inward-reading boundary traversal reads into
+    unordered_map<pair<id_t, bool>, size_t> snarl_into;
+    /// The deepest snarl that each node is inside of and not a boundary of.
+    /// Nodes not in any snarl are left out.
+    unordered_map<id_t, size_t> node_snarl;
+
+    /// Marker for no snarl
+    static const size_t NO_SNARL = numeric_limits<size_t>::max();
+    /// Magic bytes at the start of an index file
+    static const string MAGIC;
+    /// Format version we write
+    static const uint32_t VERSION = 1;
+};
+
+}
+
+#endif
@@ -6,6 +6,9 @@
 
 #include <map>
 #include <cmath>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
 
 #include "utility.hpp"
 
@@ -17,10 +20,49 @@ using namespace std;
 // to change later.
 using real_t = long double;
 
+/// How many log factorials, from 0!, to keep in a table
+const int FACTORIAL_LN_TABLE_SIZE = 1024;
+
+/**
+ * Get the table of the natural logs of the factorials of 0 through
+ * FACTORIAL_LN_TABLE_SIZE - 1. It is filled in the first time it is needed;
+ * static initialization makes that safe to race on from several threads.
+ */
+inline const vector<real_t>& factorial_ln_table() {
+    static const vector<real_t> table = []() {
+        vector<real_t> to_return(FACTORIAL_LN_TABLE_SIZE);
+        to_return[0] = 0;
+        for (int n = 1; n < FACTORIAL_LN_TABLE_SIZE; n++) {
+            to_return[n] = to_return[n - 1] + log((real_t) n);
+        }
+        return to_return;
+    }();
+    return table;
+}
+
+/**
+ * Calculate the natural log of the factorial of an integer too big for the
+ * table, with Stirling's series. Past the end of the table the first terms
+ * left out are far below real_t precision.
+ */
+inline real_t factorial_ln_stirling(int n) {
+    real_t x = n;
+    real_t inverse = 1.0 / x;
+    real_t inverse_squared = inverse * inverse;
+    return x * log(x) - x + 0.5 * log(2.0 * M_PI * x)
+        + inverse * (1.0 / 12.0 - inverse_squared * (1.0 / 360.0 - inverse_squared / 1260.0));
+}
+
 /**
  * Calculate the natural log of the gamma function of the given argument.
+ * Integer arguments are looked up as factorials.
  */
 inline real_t gamma_ln(real_t x) {
+    
+    if (x >= 1.0 && x <= FACTORIAL_LN_TABLE_SIZE && x == floor(x)) {
+        // Gamma(x) = (x - 1)!
+        return factorial_ln_table()[(int) x - 1];
+    }
 
     real_t cofactors[] = {76.18009173, 
         -86.50532033,
@@ -43,18 +85,18 @@ inline real_t gamma_ln(real_t x) {
 }
 
 /**
- * Calculate the natural log of the factorial of the given integer. TODO:
- * replace with a cache or giant lookup table from Freebayes.
+ * Calculate the natural log of the factorial of the given integer, from a
+ * table for small arguments and Stirling's series for the rest.
  */
 inline real_t factorial_ln(int n) {
     if (n < 0) {
         return (long double)-1.0;
     }
-    else if (n == 0) {
-        return (long double)0.0;
+    else if (n < FACTORIAL_LN_TABLE_SIZE) {
+        return factorial_ln_table()[n];
     }
     else {
-        return gamma_ln(n + 1.0);
+        return factorial_ln_stirling(n);
     }
 }
 
@@ -122,17 +164,20 @@ inline real_t poisson_prob_ln(int observed, real_t expected) {
  */
 template <typename ProbIn>
 real_t multinomial_sampling_prob_ln(const vector<ProbIn>& probs, const vector<int>& obs) {
-    vector<real_t> factorials;
-    vector<real_t> probsPowObs;
-    factorials.resize(obs.size());
-    transform(obs.begin(), obs.end(), factorials.begin(), factorial_ln);
+    // Sum up the terms as we go instead of collecting them
+    int total = 0;
+    real_t factorials_sum = 0;
+    for (auto& o : obs) {
+        total += o;
+        factorials_sum += factorial_ln(o);
+    }
+    real_t probs_pow_obs_sum = 0;
     typename vector<ProbIn>::const_iterator p = probs.begin();
     vector<int>::const_iterator o = obs.begin();
     for (; p != probs.end() && o != obs.end(); ++p, ++o) {
-        probsPowObs.push_back(pow_ln(log(*p), *o));
+        probs_pow_obs_sum += pow_ln(log(*p), *o);
     }
-    // Use the collection sum defined in utility.hpp
-    return factorial_ln(sum(obs)) - sum(factorials) + sum(probsPowObs);
+    return factorial_ln(total) - factorials_sum + probs_pow_obs_sum;
 }
 
 /**
@@ -247,13 +292,31 @@ bool advance_split(Iter start, Iter end) {
 }
 
 
+/**
+ * Check whether an ambiguity class, given as per-category flags, includes a
+ * category.
+ */
+inline bool class_has_category(const vector<bool>& ambiguity_class, size_t category) {
+    return category < ambiguity_class.size() && ambiguity_class[category];
+}
+
+/**
+ * Check whether an ambiguity class, packed into a bitmask with category i in
+ * bit i, includes a category.
+ */
+inline bool class_has_category(uint64_t ambiguity_class, size_t category) {
+    return category < 64 && ((ambiguity_class >> category) & 1);
+}
+
 /**
  * Get the log probability for sampling any actual set of category counts that
  * is consistent with the constraints specified by obs, using the per-category
  * probabilities defined in probs.
  *
  * Obs maps from a vector of per-category flags (called a "class") to a number
- * of items that might be in any of the flagged categories.
+ * of items that might be in any of the flagged categories. The classes can
+ * also be packed into uint64_t bitmasks, with category i in bit i, when there
+ * are at most 64 categories; that keeps hashing and copying them cheap.
  *
  * For example, if there are two equally likely categories, and one item flagged
  * as potentially from either category, the probability of sampling a set of
@@ -262,12 +325,19 @@ bool advance_split(Iter start, Iter end) {
  * of the three but not the third, the probability of sampling a set of category
  * counts consistent with that constraint is 2/3.
  */
-template<typename ProbIn>
-real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const unordered_map<vector<bool>, int>& obs) {
+template<typename ProbIn, typename ClassKey>
+real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const unordered_map<ClassKey, int>& obs) {
     // We fill this with logprobs for all the different cases and then sum them
     // up.
     vector<real_t> case_logprobs;
     
+    // Every case needs the log of each category's probability
+    vector<real_t> log_probs;
+    log_probs.reserve(probs.size());
+    for (auto& prob : probs) {
+        log_probs.push_back(log(prob));
+    }
+    
     // We have a state. We advance this state until we can't anymore.
     //
     // The state is, for each ambiguity class, a vector of length equal to
@@ -277,7 +347,7 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
     // We start with all the reads in the first spot in each class, and
     // advance/reset until we have iterated over all combinations of category
     // assignments for all classes.
-    unordered_map<vector<bool>, vector<int>> splits_by_class;
+    unordered_map<ClassKey, vector<int>> splits_by_class;
     
     // Prepare the state
     for (auto& kv : obs) {
@@ -290,8 +360,8 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
         
         // Work out if it actually matches any categories
         bool has_any_categories = false;
-        for (const auto& bit : kv.first) {
-            if (bit) {
+        for (size_t i = 0; i < probs.size(); i++) {
+            if (class_has_category(kv.first, i)) {
                 has_any_categories = true;
                 break;
             }
@@ -308,9 +378,9 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
         // category assignments.
         auto& class_state = splits_by_class[kv.first];
         
-        for (const auto& bit : kv.first) {
+        for (size_t i = 0; i < probs.size(); i++) {
             // Allocate a spot for each set bit
-            if (bit) {
+            if (class_has_category(kv.first, i)) {
                 class_state.push_back(0);
             }
         }
@@ -326,7 +396,7 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
     }
     
     // Now we loop over all the combinations of class states using a stack thing.
-    list<decltype(splits_by_class)::iterator> stack;
+    list<typename decltype(splits_by_class)::iterator> stack;
     
     // And maintain this vector of category counts for the state we are in. We
     // incrementally update it so we aren't always looping over all the classes
@@ -334,11 +404,11 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
     vector<int> category_counts(probs.size());
     
     // We have a function to add in the contribution of a class's state
-    auto add_class_state = [&](const pair<vector<bool>, vector<int>>& class_state) {
+    auto add_class_state = [&](const typename decltype(splits_by_class)::value_type& class_state) {
         auto count_it = class_state.second.begin();
         for (size_t i = 0; i < category_counts.size(); i++) {
             // For each category
-            if (class_state.first.at(i)) {
+            if (class_has_category(class_state.first, i)) {
                 // If this ambiguity class touches it
                 
                 assert(count_it != class_state.second.end());
@@ -354,11 +424,11 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
     };
     
     // And a function to back it out again
-    auto remove_class_state = [&](const pair<vector<bool>, vector<int>>& class_state) {
+    auto remove_class_state = [&](const typename decltype(splits_by_class)::value_type& class_state) {
         auto count_it = class_state.second.begin();
         for (size_t i = 0; i < category_counts.size(); i++) {
             // For each category
-            if (class_state.first.at(i)) {
+            if (class_has_category(class_state.first, i)) {
                 // If this ambiguity class touches it
                 
                 assert(count_it != class_state.second.end());
@@ -391,7 +461,16 @@ real_t multinomial_censored_sampling_prob_ln(const vector<ProbIn>& probs, const
         }
 #endif
 
-        auto case_logprob = multinomial_sampling_prob_ln(probs, category_counts);
+        // Same as multinomial_sampling_prob_ln, without taking the logs again
+        int total = 0;
+        real_t factorials_sum = 0;
+        real_t probs_pow_obs_sum = 0;
+        for (size_t i = 0; i < category_counts.size(); i++) {
+            total += category_counts[i];
+            factorials_sum += factorial_ln(category_counts[i]);
+            probs_pow_obs_sum += pow_ln(log_probs[i], category_counts[i]);
+        }
+        real_t case_logprob = factorial_ln(total) - factorials_sum + probs_pow_obs_sum;
         
 #ifdef debug
         cerr << "Case probability: " << logprob_to_prob(case_logprob) << endl;
@@ -0,0 +1,147 @@
+#ifndef VG_DUPLICATE_READ_CACHE_HPP_INCLUDED
+#define VG_DUPLICATE_READ_CACHE_HPP_INCLUDED
+
+/**
+ * \file duplicate_read_cache.hpp
+ * A bounded cache of mapping results shared by all the mapping threads, so
+ * that reads with the same sequence (PCR duplicates, amplicons) are only
+ * mapped once.
+ */
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clock_cache.hpp"
+#include "stage_profiler.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Maps the key of a read (see read_key()) to the results of mapping it. The
+ * entries are spread over shards by hash, each a ClockCache behind its own
+ * lock, so threads mostly don't wait on each other. Each lookup is counted in
+ * the DuplicateReadCache profiler stage, with hits as its items.
+ */
+template<typename Value>
+class DuplicateReadCache {
+public:
+
+    /// Make a cache that holds at least the given number of reads' results
+    DuplicateReadCache(size_t capacity, size_t shard_count = 64);
+
+    /// Get the key for a read, from its sequence and, if the alignment depends
+    /// on base qualities, its qualities rounded down to multiples of
+    /// quality_bucket, so reads whose qualities only differ a little share a
+    /// key. The settings, which the results also depend on, are made part of
+    /// the key too.
+    static string read_key(const Alignment& read, bool use_quality, size_t quality_bucket,
+                           const string& settings);
+
+    /// Copy the cached results for the key into value and return true, or
+    /// return false if there are none.
+    bool retrieve(const string& key, Value& value);
+
+    /// Cache the results for a key
+    void put(const string& key, const Value& value);
+
+    /// Return the number of lookups that found their key
+    size_t hits();
+
+    /// Return the number of lookups that did not find their key
+    size_t misses();
+
+private:
+
+    struct Shard {
+        mutex lock;
+        ClockCache<string, Value> cache;
+        Shard(size_t capacity) : cache(capacity) {}
+    };
+
+    vector<unique_ptr<Shard>> shards;
+
+    Shard& shard_for(const string& key);
+};
+
+template<typename Value>
+DuplicateReadCache<Value>::DuplicateReadCache(size_t capacity, size_t shard_count) {
+    for (size_t i = 0; i < shard_count; i++) {
+        shards.emplace_back(new Shard((capacity + shard_count - 1) / shard_count));
+    }
+}
+
+template<typename Value>
+string DuplicateReadCache<Value>::read_key(const Alignment& read, bool use_quality, size_t quality_bucket,
+                                           const string& settings) {
+    string key = read.sequence();
+    key.push_back('\0');
+    if (use_quality) {
+        for (char quality : read.quality()) {
+            key.push_back(quality_bucket > 1 ? quality - quality % quality_bucket : quality);
+        }
+    }
+    key.push_back('\0');
+    key.append(settings);
+    return key;
+}
+
+template<typename Value>
+typename DuplicateReadCache<Value>::Shard& DuplicateReadCache<Value>::shard_for(const string& key) {
+    // use different bits of the hash than the ClockCache uses for its slots
+    size_t hash = std::hash<string>()(key);
+    return *shards[(hash >> 32 ^ hash >> 16) % shards.size()];
+}
+
+template<typename Value>
+bool DuplicateReadCache<Value>::retrieve(const string& key, Value& value) {
+    Shard& shard = shard_for(key);
+    bool found = false;
+    {
+        std::lock_guard<mutex> guard(shard.lock);
+        const Value* cached = shard.cache.find(key);
+        if (cached != nullptr) {
+            value = *cached;
+            found = true;
+        }
+    }
+    if (StageProfiler::is_enabled()) {
+        StageProfiler::record(MappingStage::DuplicateReadCache, 0, found ? 1 : 0);
+    }
+    return found;
+}
+
+template<typename Value>
+void DuplicateReadCache<Value>::put(const string& key, const Value& value) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<mutex> guard(shard.lock);
+    shard.cache.put(key, value);
+}
+
+template<typename Value>
+size_t DuplicateReadCache<Value>::hits() {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<mutex> guard(shard->lock);
+        total += shard->cache.hits();
+    }
+    return total;
+}
+
+template<typename Value>
+size_t DuplicateReadCache<Value>::misses() {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<mutex> guard(shard->lock);
+        total += shard->cache.misses();
+    }
+    return total;
+}
+
+}
+
+#endif
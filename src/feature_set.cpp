@@ -1,12 +1,19 @@
 #include "feature_set.hpp"
 
 #include <sstream>
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <tuple>
 
 namespace vg {
 
 using namespace std;
 
 void FeatureSet::load_bed(istream& in) {
+    // Remember which paths got new features, so we sort them in once at the end
+    set<string> loaded_paths;
+
     // We want to read the BED line by line
     string line;
     while (getline(in, line)) {
@@ -34,15 +41,25 @@ void FeatureSet::load_bed(istream& in) {
         
         // TODO: extra data
         
-        features[feature.path_name].push_back(feature);
+        auto& path_features = features[feature.path_name];
+        if (loaded_paths.insert(feature.path_name).second) {
+            // Bring the existing features up to date before adding to them
+            path_features.update();
+        }
+        path_features.features.push_back(feature);
         
     }
+    
+    for (auto& path_name : loaded_paths) {
+        features[path_name].build();
+    }
 }
 
 void FeatureSet::save_bed(ostream& out) const {
     for (auto& kv : features) {
         // For all the contigs
-        for (auto& feature : kv.second) {
+        kv.second.update();
+        for (auto& feature : kv.second.features) {
             // For all the features, dump each one
             out << feature.path_name << "\t" << feature.first << "\t" << feature.last << "\t" << feature.feature_name << endl;
         }
@@ -54,103 +71,262 @@ void FeatureSet::on_path_edit(const string& path, size_t start, size_t old_lengt
     cerr << "Edit at " << path << " " << start << " from length " << old_length << " to length " << new_length << endl;
 #endif
 
-    // Grab the path vector so we can erase if necessary
     auto& path_features = features[path];
-    bool erase = false;
-    for (auto i = path_features.begin(); i != path_features.end(); i = (erase ? path_features.erase(i) : ++i)) {
-        // Go through all the features on the path
-        auto& feature = *i;
-        
-        // Set to true to erase the feature we are on
-        erase = false;
-        
-        if (feature.last < start) {
-            // If the feature ends before the start of the edit, do nothing
-            continue;
-        }
-        
-        if (feature.first <= start) {
-            // Else if it starts at or before the start of the edit
-        
-            
+    
+    int64_t edit_start = start;
+    int64_t edit_end = start + old_length;
+    int64_t delta = (int64_t) new_length - (int64_t) old_length;
+    
+    // Features that start at or before the start of the edit only change if
+    // they reach into it. Features that start inside the edit get clipped or
+    // deleted, and features that start after it just move.
+    size_t after_start = path_features.lower_bound(edit_start + 1);
+    size_t after_edit = path_features.lower_bound(max(edit_start + 1, edit_end));
+    
+    // Find everything that needs individual attention before shifting
+    vector<size_t> overlapping;
+    path_features.find_reaching(0, after_edit, edit_start, overlapping);
+    
+    path_features.shift(after_edit, path_features.features.size(), delta);
+    
+    for (size_t i : overlapping) {
+        int64_t first, last;
+        tie(first, last) = path_features.get(i);
         
-            if (feature.last + 1 < start + old_length) {
-                // If it ends before the end of the edit
-                
-                if (feature.first < start) {
-                    // And actually started before the edit
-                    
-                    // Do some weird interpolation on its end
+        if (i < after_start) {
+            // It starts at or before the start of the edit
+            if (last + 1 < edit_end) {
+                // And it ends before the end of the edit
+                if (first < edit_start) {
+                    // And actually started before the edit, so clip its end.
                     // TODO: interpolate end
-                    // Clip for now
-                    feature.last = start - 1;
-                
+                    path_features.set(i, first, edit_start - 1);
 #ifdef debug
-                    cerr << "\tRight clip feature " << feature.feature_name << " to "
-                        << feature.first << " - " << feature.last << endl;
+                    cerr << "\tRight clip feature " << path_features.features[i].feature_name << " to "
+                        << first << " - " << edit_start - 1 << endl;
 #endif
                 } else {
-                    // It ends before the edit ends but started at the start of
-                    // the edit. We ought to still interpolate, but we're just
-                    // going to delete it. TODO: interpolate end.
-                    
+                    // It started at the start of the edit. We ought to still
+                    // interpolate, but we're just going to delete it.
+                    // TODO: interpolate end.
+                    path_features.erase(i);
 #ifdef debug
-                    cerr << "\tDelete feature " << feature.feature_name << endl;
+                    cerr << "\tDelete feature " << path_features.features[i].feature_name << endl;
 #endif
-                    erase = true;
-                    continue;
                 }
             } else {
-                // If it ends at or after the end of the edit, shift its end up or down by the length difference
-                feature.last += ((int64_t) new_length - (int64_t) old_length);
-                
+                // It ends at or after the end of the edit, so shift its end
+                // up or down by the length difference
+                path_features.set(i, first, last + delta);
 #ifdef debug
-                cerr << "\tShift end of feature " << feature.feature_name << " by "
-                    << ((int64_t) new_length - (int64_t) old_length) << endl;
+                cerr << "\tShift end of feature " << path_features.features[i].feature_name << " by "
+                    << delta << endl;
 #endif
             }
-            
-        } else if (feature.first < start + old_length) {
-            // Else if it starts after the start of the edit and before or at the end of the edit
-            
-            if (feature.last + 1 >= start + old_length) {
-                // If it ends after the end of the edit, do some weird
-                // interpolation on the start, and shift the end up or down by
-                // the length difference. TODO: interpolate start
-                
-                // Clip for now
-                feature.first = start + new_length;
-                
-                // Adjust end
-                feature.last += ((int64_t) new_length - (int64_t) old_length);
-                
+        } else {
+            // It starts after the start of the edit and before the end of it
+            if (last + 1 >= edit_end) {
+                // If it ends after the end of the edit, clip the start and
+                // shift the end up or down by the length difference. TODO:
+                // interpolate start
+                path_features.set(i, edit_start + new_length, last + delta);
 #ifdef debug
-                cerr << "\tLeft clip and shift feature " << feature.feature_name << " to "
-                    << feature.first << " - " << feature.last << endl;
+                cerr << "\tLeft clip and shift feature " << path_features.features[i].feature_name << " to "
+                    << edit_start + new_length << " - " << last + delta << endl;
 #endif
             } else {
-                // If it ends at or before the end of the edit, do weird interpolation on the start and end (or just delete it)
+                // If it ends at or before the end of the edit, delete it.
                 // TODO: interpolate start and end
-                // Clip for now
+                path_features.erase(i);
 #ifdef debug
-                cerr << "\tDelete feature " << feature.feature_name << endl;
+                cerr << "\tDelete feature " << path_features.features[i].feature_name << endl;
 #endif
-                erase = true;
-                continue;
             }
-        } else {
-            feature.first += ((int64_t) new_length - (int64_t) old_length);
-            feature.last += ((int64_t) new_length - (int64_t) old_length);
-#ifdef debug
-            // Else if it starts after the end of the edit, shift its start and end up or down by the length difference
-            cerr << "\tShift feature " << feature.feature_name << " by " << ((int64_t) new_length - (int64_t) old_length) << endl;
-#endif
         }
     }
 }
 
 const vector<FeatureSet::Feature>& FeatureSet::get_features(const string& path) const {
-    return features.at(path);
+    auto& path_features = features.at(path);
+    path_features.update();
+    return path_features.features;
+}
+
+vector<FeatureSet::Feature> FeatureSet::get_features(const string& path, size_t first, size_t last) const {
+    vector<Feature> found;
+    
+    auto it = features.find(path);
+    if (it == features.end()) {
+        return found;
+    }
+    auto& path_features = it->second;
+    
+    // Everything that starts by the end of the range and ends after its start
+    vector<size_t> indexes;
+    path_features.find_reaching(0, path_features.lower_bound((int64_t) last + 1), first, indexes);
+    
+    for (size_t i : indexes) {
+        found.push_back(path_features.features[i]);
+        tie(found.back().first, found.back().last) = path_features.get(i);
+    }
+    return found;
+}
+
+/// Marks a tree node with no live features under it
+static const int64_t NO_FEATURE = numeric_limits<int64_t>::min();
+
+void FeatureSet::PathFeatures::build() {
+    std::stable_sort(features.begin(), features.end(), [](const Feature& a, const Feature& b) {
+        return a.first < b.first;
+    });
+    live.assign(features.size(), true);
+    
+    leaves = 1;
+    while (leaves < features.size()) {
+        leaves *= 2;
+    }
+    max_first.assign(2 * leaves, NO_FEATURE);
+    max_last.assign(2 * leaves, NO_FEATURE);
+    offset.assign(leaves, 0);
+    for (size_t i = 0; i < features.size(); i++) {
+        max_first[leaves + i] = features[i].first;
+        max_last[leaves + i] = features[i].last;
+    }
+    for (size_t node = leaves - 1; node > 0; node--) {
+        pull(node);
+    }
+    
+    stale = false;
+}
+
+void FeatureSet::PathFeatures::update() {
+    if (!stale) {
+        return;
+    }
+    
+    vector<Feature> kept;
+    kept.reserve(features.size());
+    for (size_t i = 0; i < features.size(); i++) {
+        if (live[i]) {
+            tie(features[i].first, features[i].last) = get(i);
+            kept.emplace_back(std::move(features[i]));
+        }
+    }
+    features = std::move(kept);
+    
+    build();
+}
+
+void FeatureSet::PathFeatures::pull(size_t node) {
+    int64_t first = max(max_first[2 * node], max_first[2 * node + 1]);
+    int64_t last = max(max_last[2 * node], max_last[2 * node + 1]);
+    max_first[node] = first == NO_FEATURE ? NO_FEATURE : first + offset[node];
+    max_last[node] = last == NO_FEATURE ? NO_FEATURE : last + offset[node];
+}
+
+size_t FeatureSet::PathFeatures::lower_bound(int64_t position) const {
+    if (features.empty() || max_first[1] == NO_FEATURE || max_first[1] < position) {
+        return features.size();
+    }
+    
+    // The live features are sorted by first position, so the leftmost one
+    // that starts late enough is the one we want
+    size_t node = 1;
+    int64_t above = 0;
+    while (node < leaves) {
+        above += offset[node];
+        size_t left = 2 * node;
+        node = (max_first[left] != NO_FEATURE && max_first[left] + above >= position) ? left : left + 1;
+    }
+    return node - leaves;
+}
+
+void FeatureSet::PathFeatures::find_reaching(size_t range_begin, size_t range_end, int64_t position,
+                                             vector<size_t>& found) const {
+    if (range_begin < range_end) {
+        find_reaching(1, 0, leaves, 0, range_begin, range_end, position, found);
+    }
+}
+
+void FeatureSet::PathFeatures::find_reaching(size_t node, size_t node_begin, size_t node_end, int64_t above,
+                                             size_t range_begin, size_t range_end, int64_t position,
+                                             vector<size_t>& found) const {
+    if (range_end <= node_begin || node_end <= range_begin ||
+        max_last[node] == NO_FEATURE || max_last[node] + above < position) {
+        // Nothing under here can be in the range and reach the position
+        return;
+    }
+    if (node >= leaves) {
+        found.push_back(node - leaves);
+        return;
+    }
+    above += offset[node];
+    size_t node_middle = (node_begin + node_end) / 2;
+    find_reaching(2 * node, node_begin, node_middle, above, range_begin, range_end, position, found);
+    find_reaching(2 * node + 1, node_middle, node_end, above, range_begin, range_end, position, found);
+}
+
+pair<int64_t, int64_t> FeatureSet::PathFeatures::get(size_t i) const {
+    size_t node = leaves + i;
+    pair<int64_t, int64_t> positions(max_first[node], max_last[node]);
+    for (node /= 2; node > 0; node /= 2) {
+        positions.first += offset[node];
+        positions.second += offset[node];
+    }
+    return positions;
+}
+
+void FeatureSet::PathFeatures::set(size_t i, int64_t first, int64_t last) {
+    // Store the positions relative to the shifts above the leaf
+    int64_t above = 0;
+    for (size_t node = (leaves + i) / 2; node > 0; node /= 2) {
+        above += offset[node];
+    }
+    max_first[leaves + i] = first - above;
+    max_last[leaves + i] = last - above;
+    for (size_t node = (leaves + i) / 2; node > 0; node /= 2) {
+        pull(node);
+    }
+    stale = true;
+}
+
+void FeatureSet::PathFeatures::erase(size_t i) {
+    live[i] = false;
+    max_first[leaves + i] = NO_FEATURE;
+    max_last[leaves + i] = NO_FEATURE;
+    for (size_t node = (leaves + i) / 2; node > 0; node /= 2) {
+        pull(node);
+    }
+    stale = true;
+}
+
+void FeatureSet::PathFeatures::shift(size_t range_begin, size_t range_end, int64_t delta) {
+    if (range_begin < range_end && delta != 0) {
+        shift(1, 0, leaves, range_begin, range_end, delta);
+        stale = true;
+    }
+}
+
+void FeatureSet::PathFeatures::shift(size_t node, size_t node_begin, size_t node_end,
+                                     size_t range_begin, size_t range_end, int64_t delta) {
+    if (range_end <= node_begin || node_end <= range_begin) {
+        return;
+    }
+    if (range_begin <= node_begin && node_end <= range_end) {
+        // Shift this whole subtree at once
+        if (node < leaves) {
+            offset[node] += delta;
+        }
+        if (max_first[node] != NO_FEATURE) {
+            max_first[node] += delta;
+            max_last[node] += delta;
+        }
+        return;
+    }
+    size_t node_middle = (node_begin + node_end) / 2;
+    shift(2 * node, node_begin, node_middle, range_begin, range_end, delta);
+    shift(2 * node + 1, node_middle, node_end, range_begin, range_end, delta);
+    pull(node);
 }
 
 }
@@ -11,6 +11,7 @@
 #include <vector>
 #include <map>
 #include <iostream>
+#include <cstdint>
  
 namespace vg {
 
@@ -67,22 +68,88 @@ public:
      * given number of bases. Can handle pure inserts, pure deletions, length-
      * preserving substitutions, and general length-changing substitutions.
      *
-     * Updates the contained features that need to change.
-     *
-     * Note that this is currently O(n) in features on the path. TODO: come up
-     * with a truly efficient algorithm to back this using some kind of skip
-     * list or rope or something.
+     * Updates the contained features that need to change. Takes O(log n)
+     * time in features on the path, plus O(log n) for each feature that
+     * overlaps the edit. Features after the edit are shifted lazily, and only
+     * have their positions worked out when they are next read.
      */
     void on_path_edit(const string& path, size_t start, size_t old_length, size_t new_length);
     
     /**
-     * Get the features on a path. Generally used for testing.
+     * Get the features on a path, sorted by their first base. Generally used
+     * for testing.
      */
     const vector<Feature>& get_features(const string& path) const;
+    
+    /**
+     * Get the features on a path that overlap the given inclusive range of
+     * positions, sorted by their first base. Takes O(log n) time in features
+     * on the path for each feature found.
+     */
+    vector<Feature> get_features(const string& path, size_t first, size_t last) const;
 
 private:
-    /// Stores all the loaded features by path name
-    map<string, vector<Feature>> features;
+
+    /**
+     * Holds the features on one path, sorted by their first bases, which no
+     * edit can reorder. A segment tree over the features tracks the greatest
+     * first and last positions of the features under each node, so the
+     * features overlapping a position can be found without a scan. Shifts of
+     * ranges of features are stored as offsets on the tree nodes that cover
+     * them, and features that have been edited away are just marked dead
+     * until the vector is next brought up to date.
+     */
+    struct PathFeatures {
+        /// The features, whose positions are out of date if stale is set
+        vector<Feature> features;
+        /// Which features have not been deleted by edits
+        vector<bool> live;
+        /// Are there shifted or deleted features not reflected in features?
+        bool stale = false;
+        
+        /// How many leaves the tree has, a power of 2
+        size_t leaves = 0;
+        /// The greatest first position of a live feature under each node,
+        /// counting the offsets at the node and below it
+        vector<int64_t> max_first;
+        /// The greatest last position of a live feature under each node
+        vector<int64_t> max_last;
+        /// The shift applied to everything under each internal node
+        vector<int64_t> offset;
+        
+        /// Sort the features and build the tree over them.
+        void build();
+        /// Make the features vector reflect all edits, and drop dead features.
+        void update();
+        
+        /// Get the index of the first live feature with a first position at or
+        /// after the given position, or the number of features if there is none.
+        size_t lower_bound(int64_t position) const;
+        /// Find the live features in the given range of indexes that have a
+        /// last position at or after the given position, in order.
+        void find_reaching(size_t range_begin, size_t range_end, int64_t position, vector<size_t>& found) const;
+        /// Get the current first and last positions of the feature at an index.
+        pair<int64_t, int64_t> get(size_t i) const;
+        /// Set the current first and last positions of the feature at an index.
+        void set(size_t i, int64_t first, int64_t last);
+        /// Mark the feature at an index deleted.
+        void erase(size_t i);
+        /// Shift the positions of all features in the given range of indexes.
+        void shift(size_t range_begin, size_t range_end, int64_t delta);
+        
+    private:
+        /// Recompute a node's maxima from its children.
+        void pull(size_t node);
+        void find_reaching(size_t node, size_t node_begin, size_t node_end, int64_t above,
+                           size_t range_begin, size_t range_end, int64_t position,
+                           vector<size_t>& found) const;
+        void shift(size_t node, size_t node_begin, size_t node_end,
+                   size_t range_begin, size_t range_end, int64_t delta);
+    };
+
+    /// Stores all the loaded features by path name. Reading features brings
+    /// them up to date, so this changes even in const methods.
+    mutable map<string, PathFeatures> features;
 
 };
 
@@ -0,0 +1,333 @@
+#include "flat_graph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+#include "utility.hpp"
+
+namespace vg {
+
+using namespace std;
+
+FlatGraph::FlatGraph(const Graph& graph) {
+    // Lay out the records for the whole ID range at once
+    if (graph.node_size()) {
+        id_t low = graph.node(0).id();
+        id_t high = low;
+        size_t total_length = 0;
+        for (size_t i = 0; i < graph.node_size(); i++) {
+            low = min<id_t>(low, graph.node(i).id());
+            high = max<id_t>(high, graph.node(i).id());
+            total_length += graph.node(i).sequence().size();
+        }
+        min_id = low;
+        nodes.resize(high - low + 1);
+        sequences.reserve(total_length);
+        order.reserve(graph.node_size());
+        edge_records.reserve(2 * graph.edge_size());
+    }
+
+    for (size_t i = 0; i < graph.node_size(); i++) {
+        create_handle(graph.node(i).sequence(), graph.node(i).id());
+    }
+    for (size_t i = 0; i < graph.edge_size(); i++) {
+        const Edge& edge = graph.edge(i);
+        create_edge(get_handle(edge.from(), edge.from_start()), get_handle(edge.to(), edge.to_end()));
+    }
+}
+
+void FlatGraph::to_graph(Graph& graph) const {
+    for (id_t node_id : order) {
+        const NodeRecord& node = record(node_id);
+        Node* added = graph.add_node();
+        added->set_id(node_id);
+        added->set_sequence(sequences.substr(node.sequence_start, node.sequence_length));
+    }
+
+    for (id_t node_id : order) {
+        for (auto& edge : edges_of(node_id)) {
+            // Every edge is in the lists of both of its sides (unless the
+            // sides are the same), so only take the one in canonical form.
+            if (edge_handle(edge.first, edge.second) == edge) {
+                Edge* added = graph.add_edge();
+                added->set_from(get_id(edge.first));
+                added->set_from_start(get_is_reverse(edge.first));
+                added->set_to(get_id(edge.second));
+                added->set_to_end(get_is_reverse(edge.second));
+            }
+        }
+    }
+}
+
+id_t FlatGraph::max_node_id() const {
+    return max_id;
+}
+
+string FlatGraph::get_sequence(const handle_t& handle) const {
+    const NodeRecord& node = record(get_id(handle));
+    string sequence = sequences.substr(node.sequence_start, node.sequence_length);
+    return get_is_reverse(handle) ? reverse_complement(sequence) : sequence;
+}
+
+bool FlatGraph::get_sequence_view(const handle_t& handle, sequence_view_t& view_out) const {
+    const NodeRecord& node = record(get_id(handle));
+    view_out.bases = sequences.data() + node.sequence_start;
+    view_out.length = node.sequence_length;
+    view_out.is_reverse = get_is_reverse(handle);
+    return true;
+}
+
+char FlatGraph::get_base(const handle_t& handle, size_t index) const {
+    sequence_view_t view;
+    get_sequence_view(handle, view);
+    return view[index];
+}
+
+bool FlatGraph::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    return follow_edges_inline(handle, go_left, iteratee);
+}
+
+void FlatGraph::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
+    if (parallel) {
+#pragma omp parallel for schedule(dynamic,1)
+        for (size_t i = 0; i < order.size(); i++) {
+            // We can't stop early in parallel
+            iteratee(get_handle(order[i], false));
+        }
+    }
+    else {
+        for (size_t i = 0; i < order.size(); i++) {
+            if (!iteratee(get_handle(order[i], false))) {
+                return;
+            }
+        }
+    }
+}
+
+size_t FlatGraph::node_size() const {
+    return order.size();
+}
+
+handle_t FlatGraph::create_handle(const string& sequence) {
+    return create_handle(sequence, max_id + 1);
+}
+
+handle_t FlatGraph::create_handle(const string& sequence, const id_t& id) {
+    size_t sequence_start = sequences.size();
+    sequences.append(sequence);
+    return create_node_record(id, sequence_start, sequence.size());
+}
+
+handle_t FlatGraph::create_node_record(id_t node_id, size_t sequence_start, size_t sequence_length) {
+    if (nodes.empty()) {
+        min_id = node_id;
+    }
+    else if (node_id < min_id) {
+        // Make room at the front
+        nodes.insert(nodes.begin(), min_id - node_id, NodeRecord());
+        min_id = node_id;
+    }
+    if (node_id - min_id >= (id_t) nodes.size()) {
+        nodes.resize(node_id - min_id + 1);
+    }
+
+    NodeRecord& node = record(node_id);
+    if (node.present) {
+        cerr << "error:[FlatGraph] cannot create a second node with ID " << node_id << endl;
+        exit(1);
+    }
+    node = NodeRecord();
+    node.sequence_start = sequence_start;
+    node.sequence_length = sequence_length;
+    node.order_rank = order.size();
+    node.present = true;
+
+    order.push_back(node_id);
+    max_id = max(max_id, node_id);
+
+    return get_handle(node_id, false);
+}
+
+void FlatGraph::add_edge_record(size_t& list_head, const handle_t& target) {
+    for (size_t i = list_head; i != 0; i = edge_records[i - 1].next) {
+        if (edge_records[i - 1].target == target) {
+            // We already have it
+            return;
+        }
+    }
+
+    size_t added;
+    if (free_edges) {
+        // Reuse a record
+        added = free_edges;
+        free_edges = edge_records[added - 1].next;
+    }
+    else {
+        edge_records.emplace_back();
+        added = edge_records.size();
+    }
+    edge_records[added - 1].target = target;
+    edge_records[added - 1].next = list_head;
+    list_head = added;
+}
+
+void FlatGraph::remove_edge_record(size_t& list_head, const handle_t& target) {
+    for (size_t* link = &list_head; *link != 0; link = &edge_records[*link - 1].next) {
+        size_t found = *link;
+        if (edge_records[found - 1].target == target) {
+            // Unlink it and put it on the free list
+            *link = edge_records[found - 1].next;
+            edge_records[found - 1].next = free_edges;
+            free_edges = found;
+            return;
+        }
+    }
+}
+
+vector<pair<handle_t, handle_t>> FlatGraph::edges_of(id_t node_id) const {
+    vector<pair<handle_t, handle_t>> edges;
+    for (bool is_reverse : {false, true}) {
+        handle_t leaving = get_handle(node_id, is_reverse);
+        for (size_t i = right_side_edges(leaving); i != 0; i = edge_records[i - 1].next) {
+            edges.emplace_back(leaving, edge_records[i - 1].target);
+        }
+    }
+    return edges;
+}
+
+void FlatGraph::destroy_handle(const handle_t& handle) {
+    id_t node_id = get_id(handle);
+    for (auto& edge : edges_of(node_id)) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    // Fill the node's place in the order with the last node, like VG does
+    NodeRecord& node = record(node_id);
+    id_t moved = order.back();
+    order[node.order_rank] = moved;
+    record(moved).order_rank = node.order_rank;
+    order.pop_back();
+
+    node.present = false;
+}
+
+void FlatGraph::create_edge(const handle_t& left, const handle_t& right) {
+    add_edge_record(right_side_edges(left), right);
+    if (right != flip(left)) {
+        // The other end of the edge is on a different side
+        add_edge_record(right_side_edges(flip(right)), flip(left));
+    }
+}
+
+void FlatGraph::destroy_edge(const handle_t& left, const handle_t& right) {
+    remove_edge_record(right_side_edges(left), right);
+    if (right != flip(left)) {
+        remove_edge_record(right_side_edges(flip(right)), flip(left));
+    }
+}
+
+void FlatGraph::swap_handles(const handle_t& a, const handle_t& b) {
+    NodeRecord& node_a = record(get_id(a));
+    NodeRecord& node_b = record(get_id(b));
+    swap(order[node_a.order_rank], order[node_b.order_rank]);
+    swap(node_a.order_rank, node_b.order_rank);
+}
+
+handle_t FlatGraph::apply_orientation(const handle_t& handle) {
+    id_t node_id = get_id(handle);
+    if (!get_is_reverse(handle)) {
+        // Nothing to do
+        return handle;
+    }
+
+    // Take off all the edges
+    vector<pair<handle_t, handle_t>> edges = edges_of(node_id);
+    for (auto& edge : edges) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    // Flip the sequence where it is
+    NodeRecord& node = record(node_id);
+    auto begin = sequences.begin() + node.sequence_start;
+    auto end = begin + node.sequence_length;
+    reverse(begin, end);
+    for (auto iter = begin; iter != end; iter++) {
+        *iter = reverse_complement(*iter);
+    }
+
+    // Put the edges back on with this node's orientations swapped
+    auto flip_if_here = [&](const handle_t& other) {
+        return get_id(other) == node_id ? flip(other) : other;
+    };
+    for (auto& edge : edges) {
+        create_edge(flip_if_here(edge.first), flip_if_here(edge.second));
+    }
+
+    return get_handle(node_id, false);
+}
+
+vector<handle_t> FlatGraph::divide_handle(const handle_t& handle, const vector<size_t>& offsets) {
+    id_t node_id = get_id(handle);
+    size_t length = get_length(handle);
+
+    // Work out the division points along the forward strand
+    vector<size_t> forward_offsets;
+    if (get_is_reverse(handle)) {
+        for (auto iter = offsets.rbegin(); iter != offsets.rend(); iter++) {
+            forward_offsets.push_back(length - *iter);
+        }
+    }
+    else {
+        forward_offsets = offsets;
+    }
+
+    // Take off all the edges
+    vector<pair<handle_t, handle_t>> edges = edges_of(node_id);
+    for (auto& edge : edges) {
+        destroy_edge(edge.first, edge.second);
+    }
+
+    // The first part keeps the record, and the rest get new records over the
+    // rest of the same sequence.
+    size_t sequence_start = record(node_id).sequence_start;
+    vector<handle_t> parts{get_handle(node_id, false)};
+    size_t part_start = 0;
+    for (size_t i = 0; i <= forward_offsets.size(); i++) {
+        size_t part_end = i < forward_offsets.size() ? forward_offsets[i] : length;
+        assert(part_end >= part_start && part_end <= length);
+        if (i == 0) {
+            record(node_id).sequence_length = part_end;
+        }
+        else {
+            parts.push_back(create_node_record(max_id + 1, sequence_start + part_start, part_end - part_start));
+            create_edge(parts[parts.size() - 2], parts.back());
+        }
+        part_start = part_end;
+    }
+
+    // Put the edges back on. Edges on the end of the node go to the last part.
+    for (auto& edge : edges) {
+        handle_t leaving = edge.first;
+        if (get_id(leaving) == node_id) {
+            leaving = get_is_reverse(leaving) ? flip(parts.front()) : parts.back();
+        }
+        handle_t entering = edge.second;
+        if (get_id(entering) == node_id) {
+            entering = get_is_reverse(entering) ? flip(parts.back()) : parts.front();
+        }
+        create_edge(leaving, entering);
+    }
+
+    if (get_is_reverse(handle)) {
+        // Present the parts along the reverse strand
+        reverse(parts.begin(), parts.end());
+        for (auto& part : parts) {
+            part = flip(part);
+        }
+    }
+
+    return parts;
+}
+
+}
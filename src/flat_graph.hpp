@@ -0,0 +1,263 @@
+#ifndef VG_FLAT_GRAPH_HPP_INCLUDED
+#define VG_FLAT_GRAPH_HPP_INCLUDED
+
+/**
+ * \file flat_graph.hpp: define a FlatGraph, a compact MutableHandleGraph that
+ * keeps its nodes in arrays indexed by ID and its edges in packed linked
+ * lists, for whole-graph transforms that would spend their time hashing and
+ * chasing pointers in a VG.
+ */
+
+#include <vector>
+#include <string>
+
+#include "handle.hpp"
+#include "vg.pb.h"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A MutableHandleGraph with no hash tables. Node records live in one vector
+ * indexed by node ID (offset by the smallest ID), all the sequence lives in
+ * one string, and each side of each node has a singly linked list of edges in
+ * one shared vector of edge records, with freed records reused. IDs are
+ * assumed to be reasonably dense, as they are in graphs that vg builds.
+ *
+ * Handles hold the node ID and orientation, so they stay valid across
+ * swap_handles() and divide_handle() on other nodes.
+ *
+ * Sequence space of destroyed nodes is not reclaimed, so this is meant for a
+ * pass of transforms over a graph, after which it is converted back with
+ * to_graph().
+ *
+ * There are no paths; callers that need them have to keep them elsewhere.
+ */
+class FlatGraph : public MutableHandleGraph {
+public:
+
+    /// Make an empty graph
+    FlatGraph() = default;
+
+    /// Make a graph with the nodes and edges of a Protobuf graph. Paths are
+    /// not copied.
+    FlatGraph(const Graph& graph);
+
+    /// Add the nodes, in for_each_handle order, and then the edges of this
+    /// graph to a Protobuf graph.
+    void to_graph(Graph& graph) const;
+
+    /// Create a new node with the given sequence and ID, which must not be in
+    /// use, and return the handle.
+    handle_t create_handle(const string& sequence, const id_t& id);
+
+    /// Get the largest node ID that has been used
+    id_t max_node_id() const;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Look up the handle for the node with the given ID in the given orientation
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse = false) const final;
+
+    /// Get the ID from a handle
+    virtual id_t get_id(const handle_t& handle) const final;
+
+    /// Get the orientation of a handle
+    virtual bool get_is_reverse(const handle_t& handle) const final;
+
+    /// Invert the orientation of a handle (potentially without getting its ID)
+    virtual handle_t flip(const handle_t& handle) const final;
+
+    /// Get the length of a node
+    virtual size_t get_length(const handle_t& handle) const final;
+
+    /// Get the sequence of a node, presented in the handle's local forward
+    /// orientation.
+    virtual string get_sequence(const handle_t& handle) const;
+    
+    /// Point the view at the node's stored sequence, without copying it.
+    virtual bool get_sequence_view(const handle_t& handle, sequence_view_t& view_out) const;
+    
+    /// Get the base at the given offset in the handle's local forward orientation.
+    virtual char get_base(const handle_t& handle, size_t index) const;
+
+    /// Loop over all the handles to next/previous (right/left) nodes. Passes
+    /// them to a callback which returns false to stop iterating and true to
+    /// continue. Returns true if we finished and false if we stopped early.
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const final;
+
+    /// Loop over all the handles to next/previous (right/left) nodes with an
+    /// iteratee of any type that returns false to stop, without going through
+    /// a virtual call or a std::function. Hides the HandleGraph version for
+    /// algorithms templated on the graph type.
+    template <typename Iteratee>
+    inline bool follow_edges_inline(const handle_t& handle, bool go_left, Iteratee&& iteratee) const;
+
+    /// Loop over all the nodes in the graph in their local forward
+    /// orientations, in their internal stored order. Stop if the iteratee returns false.
+    virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
+
+    /// Return the number of nodes in the graph
+    virtual size_t node_size() const;
+
+    // We have to pull in the templated versions from HandleGraph
+    using HandleGraph::follow_edges;
+    using HandleGraph::for_each_handle;
+    using HandleGraph::get_handle;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Mutable handle-based interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Create a new node with the given sequence and return the handle.
+    virtual handle_t create_handle(const string& sequence);
+
+    /// Remove the node belonging to the given handle and all of its edges.
+    virtual void destroy_handle(const handle_t& handle);
+
+    /// Create an edge connecting the given handles in the given order and orientations.
+    /// Ignores existing edges.
+    virtual void create_edge(const handle_t& left, const handle_t& right);
+
+    /// Remove the edge connecting the given handles in the given order and orientations.
+    /// Ignores nonexistent edges.
+    virtual void destroy_edge(const handle_t& left, const handle_t& right);
+
+    /// Swap the nodes corresponding to the given handles, in the ordering used
+    /// by for_each_handle when looping over the graph.
+    virtual void swap_handles(const handle_t& a, const handle_t& b);
+
+    /// Alter the node that the given handle corresponds to so the orientation
+    /// indicated by the handle becomes the node's local forward orientation.
+    /// Rewrites all edges pointing to the node and the node's sequence to
+    /// reflect this. The node keeps its ID. Returns a handle to the node in
+    /// its new forward orientation.
+    virtual handle_t apply_orientation(const handle_t& handle);
+
+    /// Split a handle's underlying node at the given offsets in the handle's
+    /// orientation. The first part keeps the node's ID, and the others get new
+    /// IDs. Returns all of the handles to the parts, in the order and
+    /// orientation appropriate for the handle passed in.
+    virtual vector<handle_t> divide_handle(const handle_t& handle, const vector<size_t>& offsets);
+
+    // We have to pull in the single offset version
+    using MutableHandleGraph::divide_handle;
+
+private:
+
+    /// Everything we store about a node, in its forward orientation
+    struct NodeRecord {
+        /// Where the node's sequence starts in the sequence storage
+        size_t sequence_start = 0;
+        size_t sequence_length = 0;
+        /// Index + 1 of the first edge record for each side (0 for no edges).
+        /// Each record holds the handle reached by leaving the node out of
+        /// that side, with the node oriented so that the side is on its right.
+        size_t start_edges = 0;
+        size_t end_edges = 0;
+        /// Where the node is in the for_each_handle order
+        size_t order_rank = 0;
+        bool present = false;
+    };
+
+    /// One entry in a node side's edge list
+    struct EdgeRecord {
+        handle_t target;
+        /// Index + 1 of the next record in the list (0 at the end)
+        size_t next;
+    };
+
+    /// Get the record for a node that exists
+    inline NodeRecord& record(id_t node_id);
+    inline const NodeRecord& record(id_t node_id) const;
+
+    /// Get the head of the edge list for the side on the right of a handle
+    inline size_t& right_side_edges(const handle_t& handle);
+    inline const size_t& right_side_edges(const handle_t& handle) const;
+
+    /// Add a node record for the given ID with the given stored sequence
+    handle_t create_node_record(id_t node_id, size_t sequence_start, size_t sequence_length);
+
+    /// Add a target to an edge list, unless it is already there
+    void add_edge_record(size_t& list_head, const handle_t& target);
+
+    /// Remove a target from an edge list, if it is there
+    void remove_edge_record(size_t& list_head, const handle_t& target);
+
+    /// Get all of the edges on a node, as pairs of (leaving handle, entering
+    /// handle). Self loops may appear twice.
+    vector<pair<handle_t, handle_t>> edges_of(id_t node_id) const;
+
+    /// The smallest node ID, which goes with the first record
+    id_t min_id = 0;
+    /// The largest node ID ever used
+    id_t max_id = 0;
+    /// Node records indexed by ID - min_id
+    vector<NodeRecord> nodes;
+    /// Node IDs in for_each_handle order
+    vector<id_t> order;
+    /// All of the node sequences, end to end
+    string sequences;
+    /// All of the edge list records
+    vector<EdgeRecord> edge_records;
+    /// Index + 1 of the first reusable edge record (0 if there are none)
+    size_t free_edges = 0;
+};
+
+inline handle_t FlatGraph::get_handle(const id_t& node_id, bool is_reverse) const {
+    // Handle is ID shifted up and orientation in the low bit
+    return as_handle((node_id << 1) | (is_reverse ? 1 : 0));
+}
+
+inline id_t FlatGraph::get_id(const handle_t& handle) const {
+    return as_integer(handle) >> 1;
+}
+
+inline bool FlatGraph::get_is_reverse(const handle_t& handle) const {
+    return as_integer(handle) & 1;
+}
+
+inline handle_t FlatGraph::flip(const handle_t& handle) const {
+    return as_handle(as_integer(handle) ^ 1);
+}
+
+inline size_t FlatGraph::get_length(const handle_t& handle) const {
+    return record(get_id(handle)).sequence_length;
+}
+
+inline FlatGraph::NodeRecord& FlatGraph::record(id_t node_id) {
+    return nodes[node_id - min_id];
+}
+
+inline const FlatGraph::NodeRecord& FlatGraph::record(id_t node_id) const {
+    return nodes[node_id - min_id];
+}
+
+inline size_t& FlatGraph::right_side_edges(const handle_t& handle) {
+    NodeRecord& node = record(get_id(handle));
+    return get_is_reverse(handle) ? node.start_edges : node.end_edges;
+}
+
+inline const size_t& FlatGraph::right_side_edges(const handle_t& handle) const {
+    const NodeRecord& node = record(get_id(handle));
+    return get_is_reverse(handle) ? node.start_edges : node.end_edges;
+}
+
+template <typename Iteratee>
+inline bool FlatGraph::follow_edges_inline(const handle_t& handle, bool go_left, Iteratee&& iteratee) const {
+    // Looking left is looking right from the other orientation, and flipping what we find
+    for (size_t i = right_side_edges(go_left ? flip(handle) : handle); i != 0; i = edge_records[i - 1].next) {
+        const handle_t& target = edge_records[i - 1].target;
+        if (!iteratee(go_left ? flip(target) : target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+#endif
@@ -3,7 +3,13 @@
 #include "gssw_aligner.hpp"
 #include "vg.pb.h"
 #include "flow_sort.hpp"
+#include "algorithms/weakly_connected_components.hpp"
+#include "utility.hpp"
 #include <raptor2/raptor2.h>
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <memory>
 
 namespace vg {
 
@@ -123,6 +129,271 @@ void FlowSort::fast_linear_sort(const string& ref_name, bool isGrooming)
     vg.rebuild_indexes();
 }
 
+void FlowSort::sort_by_component(const vector<string>& ref_names, bool fast, bool isGrooming)
+{
+    if (vg.size() <= 1) return;
+    vg.paths.sort_by_mapping_rank();
+
+    // Deal the nodes and edges out to the components. An edge always joins
+    // two nodes of the same component.
+    algorithms::WeakComponents components = algorithms::weakly_connected_component_ranks(&vg);
+    size_t component_count = components.component_count;
+    vector<vector<int>> component_nodes(component_count);
+    vector<vector<int>> component_edges(component_count);
+    for (int i = 0; i < vg.graph.node_size(); i++) {
+        component_nodes[components.component(vg.graph.node(i).id())].push_back(i);
+    }
+    for (int i = 0; i < vg.graph.edge_size(); i++) {
+        component_edges[components.component(vg.graph.edge(i).from())].push_back(i);
+    }
+    // And note which paths visit each component
+    Graph path_graph;
+    vg.paths.to_graph(path_graph);
+    vector<vector<int>> component_paths(component_count);
+    for (int i = 0; i < path_graph.path_size(); i++) {
+        for (auto const &mapping : path_graph.path(i).mapping()) {
+            vector<int>& paths = component_paths[components.component(mapping.position().node_id())];
+            if (paths.empty() || paths.back() != i) {
+                paths.push_back(i);
+            }
+        }
+    }
+
+    // Start the biggest components first so one big one doesn't run alone
+    // at the end
+    vector<size_t> order(component_count);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return component_nodes[a].size() > component_nodes[b].size();
+    });
+
+    vector<Graph> sorted(component_count);
+    create_progress("flow sorting components", component_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t j = 0; j < order.size(); j++) {
+        size_t c = order[j];
+        Graph& chunk = sorted[c];
+        for (int i : component_nodes[c]) {
+            *chunk.add_node() = vg.graph.node(i);
+        }
+        for (int i : component_edges[c]) {
+            *chunk.add_edge() = vg.graph.edge(i);
+        }
+
+        // Find the reference to sort this component along
+        string ref_name;
+        for (auto const &name : ref_names) {
+            for (int i : component_paths[c]) {
+                if (path_graph.path(i).name() == name) {
+                    ref_name = name;
+                    break;
+                }
+            }
+            if (!ref_name.empty()) break;
+        }
+
+        if (!ref_name.empty() && chunk.node_size() > 1) {
+            // Give the component its own pieces of the paths and sort it
+            // in a graph of its own
+            for (int i : component_paths[c]) {
+                const Path& path = path_graph.path(i);
+                Path* chunk_path = chunk.add_path();
+                chunk_path->set_name(path.name());
+                chunk_path->set_is_circular(path.is_circular());
+                for (auto const &mapping : path.mapping()) {
+                    if (components.component(mapping.position().node_id()) == c) {
+                        *chunk_path->add_mapping() = mapping;
+                    }
+                }
+            }
+            VG chunk_graph;
+            chunk_graph.extend(chunk);
+            FlowSort chunk_sort(chunk_graph);
+            if (fast) {
+                chunk_sort.fast_linear_sort(ref_name, isGrooming);
+            } else {
+                chunk_sort.max_flow_sort(ref_name, isGrooming);
+            }
+            chunk.Clear();
+            chunk.mutable_node()->Swap(chunk_graph.graph.mutable_node());
+            chunk.mutable_edge()->Swap(chunk_graph.graph.mutable_edge());
+        }
+        increment_progress();
+    }
+    destroy_progress();
+
+    // Put the components back in order. The paths refer to nodes by ID, so
+    // they stay as they are.
+    vg.graph.clear_node();
+    vg.graph.clear_edge();
+    for (auto &chunk : sorted) {
+        for (auto &node : *chunk.mutable_node()) {
+            vg.graph.add_node()->Swap(&node);
+        }
+        for (auto &edge : *chunk.mutable_edge()) {
+            vg.graph.add_edge()->Swap(&edge);
+        }
+        chunk.Clear();
+    }
+    vg.rebuild_indexes();
+}
+
+void FlowSort::sort_out_of_core(const string& file_name, ostream& out, const vector<string>& ref_names,
+                                bool fast, bool isGrooming, size_t max_bin_nodes, bool show_progress)
+{
+    auto for_each_chunk = [&](const function<void(Graph&)>& lambda) {
+        ifstream in(file_name);
+        if (!in) {
+            throw runtime_error("[FlowSort] could not open " + file_name);
+        }
+        stream::for_each<Graph>(in, lambda);
+    };
+
+    // First pass: collect the node IDs, so we can refer to nodes by rank
+    vector<id_t> node_ids;
+    for_each_chunk([&](Graph& chunk) {
+        for (auto const &node : chunk.node()) {
+            node_ids.push_back(node.id());
+        }
+    });
+    sort(node_ids.begin(), node_ids.end());
+    node_ids.erase(unique(node_ids.begin(), node_ids.end()), node_ids.end());
+    size_t node_count = node_ids.size();
+    if (node_count == 0) {
+        return;
+    }
+    // The rank of a node, or node_count if it isn't in the graph
+    auto rank_of = [&](id_t id) {
+        auto found = lower_bound(node_ids.begin(), node_ids.end(), id);
+        return (found == node_ids.end() || *found != id) ? node_count : size_t(found - node_ids.begin());
+    };
+
+    // Second pass: union-find over the edges
+    vector<size_t> parent(node_count);
+    iota(parent.begin(), parent.end(), 0);
+    auto find_root = [&](size_t x) {
+        while (parent[x] != x) {
+            // path halving
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+    for_each_chunk([&](Graph& chunk) {
+        for (auto const &edge : chunk.edge()) {
+            size_t from = rank_of(edge.from());
+            size_t to = rank_of(edge.to());
+            if (from == node_count || to == node_count) {
+                // dangling edge
+                continue;
+            }
+            from = find_root(from);
+            to = find_root(to);
+            // Keep the smaller rank as the root, so roots are the components'
+            // smallest node IDs
+            if (from < to) {
+                parent[to] = from;
+            } else if (to < from) {
+                parent[from] = to;
+            }
+        }
+    });
+
+    // The roots come in rank order, so walking the ranks finds the components
+    // in order of their smallest node IDs. Deal them out to bins in that
+    // order, and reuse the parent array for the bin of each node.
+    vector<size_t> component_size(node_count, 0);
+    size_t largest = 0;
+    for (size_t i = 0; i < node_count; i++) {
+        parent[i] = find_root(parent[i]);
+        largest = max(largest, ++component_size[parent[i]]);
+    }
+    // Don't make so many bins that we run out of file handles
+    size_t bin_target = max(max(max_bin_nodes, largest), node_count / 1000 + 1);
+    vector<size_t> bin_nodes;
+    for (size_t i = 0; i < node_count; i++) {
+        if (parent[i] == i) {
+            // This is a new component
+            if (bin_nodes.empty() || bin_nodes.back() + component_size[i] > bin_target) {
+                bin_nodes.push_back(0);
+            }
+            bin_nodes.back() += component_size[i];
+            component_size[i] = bin_nodes.size() - 1;
+        }
+        parent[i] = component_size[parent[i]];
+    }
+    vector<size_t>().swap(component_size);
+    vector<size_t>& bin_of = parent;
+    size_t bin_count = bin_nodes.size();
+    // Things on nodes not in the graph go with the first bin
+    auto bin_of_id = [&](id_t id) {
+        size_t rank = rank_of(id);
+        return rank == node_count ? 0 : bin_of[rank];
+    };
+
+    // Third pass: split the graph into the bins' temporary files
+    vector<string> bin_files(bin_count);
+    vector<unique_ptr<ofstream>> bin_streams(bin_count);
+    for (size_t b = 0; b < bin_count; b++) {
+        bin_files[b] = tmpfilename(find_temp_dir() + "/vg-sort");
+        bin_streams[b].reset(new ofstream(bin_files[b]));
+    }
+    for_each_chunk([&](Graph& chunk) {
+        map<size_t, Graph> pieces;
+        for (auto &node : *chunk.mutable_node()) {
+            pieces[bin_of_id(node.id())].add_node()->Swap(&node);
+        }
+        for (auto &edge : *chunk.mutable_edge()) {
+            size_t rank = rank_of(edge.from());
+            pieces[rank == node_count ? bin_of_id(edge.to()) : bin_of[rank]].add_edge()->Swap(&edge);
+        }
+        for (auto &path : *chunk.mutable_path()) {
+            // The mappings keep their ranks, so the pieces of each path put
+            // themselves back together when the bin is loaded
+            map<size_t, Path*> path_pieces;
+            for (auto &mapping : *path.mutable_mapping()) {
+                size_t b = bin_of_id(mapping.position().node_id());
+                Path*& piece = path_pieces[b];
+                if (piece == nullptr) {
+                    piece = pieces[b].add_path();
+                    piece->set_name(path.name());
+                    piece->set_is_circular(path.is_circular());
+                }
+                piece->add_mapping()->Swap(&mapping);
+            }
+        }
+        for (auto &piece : pieces) {
+            stream::write<Graph>(*bin_streams[piece.first], 1, [&](uint64_t i) {
+                return piece.second;
+            });
+        }
+    });
+    bin_streams.clear();
+    vector<size_t>().swap(bin_of);
+    vector<id_t>().swap(node_ids);
+
+    // Sort each bin and write it out with its nodes numbered after the last
+    // bin's
+    id_t next_id = 1;
+    for (size_t b = 0; b < bin_count; b++) {
+        if (show_progress) {
+            cerr << "[FlowSort] sorting bin " << b + 1 << " of " << bin_count
+                 << " (" << bin_nodes[b] << " nodes)" << endl;
+        }
+        {
+            ifstream in(bin_files[b]);
+            VG bin_graph(in);
+            FlowSort bin_sort(bin_graph);
+            bin_sort.sort_by_component(ref_names, fast, isGrooming);
+            bin_graph.compact_ids();
+            bin_graph.increment_node_ids(next_id - 1);
+            next_id += bin_graph.graph.node_size();
+            bin_graph.serialize_to_ostream(out);
+        }
+        remove(bin_files[b].c_str());
+    }
+}
+
 void FlowSort::flow_sort_nodes(list<NodeTraversal>& sorted_nodes, 
         const string& ref_name, bool isGrooming) 
 {
@@ -676,9 +947,10 @@ void FlowSort::find_in_out_web(list<NodeTraversal>& sorted_nodes,
     EdgeMapping& edges_in_nodes = w_graph.edges_in_nodes;
     map<Edge*, int>& edge_weight = w_graph.edge_weight;
 
-    //add source and sink nodes
-    id_t source = vg.graph.node_size() + 1;
-    id_t sink = vg.graph.node_size() + 2;
+    //add source and sink nodes, past the largest ID since the IDs need not
+    //start at 1 when sorting a single component
+    id_t source = vg.max_node_id() + 1;
+    id_t sink = source + 1;
     id_t graph_size = sink + 1;
 
     set<Edge*> out_joins;
@@ -2,6 +2,7 @@
 #define VG_FLOW_SORT_HPP_INCLUDED
 
 #include "vg.pb.h"
+#include "progressive.hpp"
 
 namespace vg {
     
@@ -18,7 +19,7 @@ static const map<char, char> COMPLEMENTARY_NUCLEOTIDES = {
     };
 
 
-class FlowSort {
+class FlowSort : public Progressive {
 public:
     /*
      * Value for nodes on ref path
@@ -34,6 +35,30 @@ public:
      * Fast linear sort
      */
     void fast_linear_sort(const string& ref_name, bool isGrooming = true);
+    /*
+     * Sorts each weakly connected component of the graph on its own, in
+     * parallel, and puts the components back together in order of their
+     * smallest node IDs. Each component is sorted along the first of the
+     * given reference paths that visits it; components that none of them
+     * visit keep their nodes in the order they are in now. Uses the fast
+     * linear sort if fast is set, and the max-flow sort otherwise. Shows a
+     * progress bar over the components if show_progress is set.
+     */
+    void sort_by_component(const vector<string>& ref_names, bool fast = false, bool isGrooming = true);
+    
+    /*
+     * Sorts the serialized graph in the given file without loading it all,
+     * writing the result to out with its nodes renumbered from 1 in sorted
+     * order. The weakly connected components are found from the node IDs and
+     * edges in two streaming passes, and then dealt out, in order of their
+     * smallest node IDs, to temporary files of at most max_bin_nodes nodes
+     * (or one component, if that is bigger). Each of those is then loaded and
+     * sorted with sort_by_component in turn. Memory use is proportional to
+     * the biggest bin, plus a few bytes per node.
+     */
+    static void sort_out_of_core(const string& file_name, ostream& out, const vector<string>& ref_names,
+                                 bool fast = false, bool isGrooming = true, size_t max_bin_nodes = 1000000,
+                                 bool show_progress = false);
     
 
     //Structure for holding weighted edges of the graph
@@ -0,0 +1,185 @@
+#include "gam_index.hpp"
+#include "stream.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace vg {
+
+using namespace std;
+
+const string GAMIndex::MAGIC = "VGGAI";
+
+pair<id_t, id_t> GAMIndex::get_id_range(const Alignment& aln) {
+    id_t min_id = numeric_limits<id_t>::max();
+    id_t max_id = numeric_limits<id_t>::min();
+    for (size_t i = 0; i < aln.path().mapping_size(); i++) {
+        id_t node_id = aln.path().mapping(i).position().node_id();
+        min_id = min(min_id, node_id);
+        max_id = max(max_id, node_id);
+    }
+    if (min_id > max_id) {
+        // No nodes touched
+        return make_pair(0, -1);
+    }
+    return make_pair(min_id, max_id);
+}
+
+void GAMIndex::index(istream& gam_in) {
+    blocks.clear();
+
+    // Offsets are relative to the start of the file, so work out where we are
+    int64_t base_offset = max<int64_t>(gam_in.tellg(), 0);
+
+    ::google::protobuf::io::IstreamInputStream raw_in(&gam_in);
+    if (!stream::is_blocked_stream(&raw_in)) {
+        throw runtime_error("[vg::GAMIndex] GAM must be a blocked stream to be indexed "
+                            "(write it with VG_STREAM_BLOCKED=1)");
+    }
+
+    string block;
+    int64_t block_offset = base_offset + raw_in.ByteCount();
+    while (stream::read_block(&raw_in, block)) {
+        Block record { numeric_limits<id_t>::max(), numeric_limits<id_t>::min(), block_offset };
+
+        function<void(Alignment&)> note_range = [&](Alignment& aln) {
+            auto range = get_id_range(aln);
+            if (range.first <= range.second) {
+                record.min_id = min(record.min_id, range.first);
+                record.max_id = max(record.max_id, range.second);
+            }
+        };
+        stream::for_each_in_block<Alignment>(block, note_range);
+
+        if (record.min_id <= record.max_id) {
+            // Only blocks with mapped reads are interesting
+            blocks.push_back(record);
+        }
+
+        block_offset = base_offset + raw_in.ByteCount();
+    }
+
+    update_bounds();
+}
+
+void GAMIndex::update_bounds() {
+    prefix_max.resize(blocks.size());
+    suffix_min.resize(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        prefix_max[i] = (i == 0) ? blocks[i].max_id : max(prefix_max[i - 1], blocks[i].max_id);
+    }
+    for (size_t i = blocks.size(); i > 0; i--) {
+        suffix_min[i - 1] = (i == blocks.size()) ? blocks[i - 1].min_id : min(suffix_min[i], blocks[i - 1].min_id);
+    }
+}
+
+vector<int64_t> GAMIndex::find(id_t min_id, id_t max_id) const {
+    vector<int64_t> found;
+
+    // Every block before this one ends before the range starts
+    auto first = lower_bound(prefix_max.begin(), prefix_max.end(), min_id) - prefix_max.begin();
+    // Every block from this one on starts after the range ends
+    auto past_last = upper_bound(suffix_min.begin(), suffix_min.end(), max_id) - suffix_min.begin();
+
+    for (size_t i = first; i < past_last; i++) {
+        if (blocks[i].min_id <= max_id && blocks[i].max_id >= min_id) {
+            found.push_back(blocks[i].virtual_offset);
+        }
+    }
+
+    return found;
+}
+
+void GAMIndex::for_alignment_in_range(istream& gam_in, id_t min_id, id_t max_id,
+                                      const function<void(const Alignment&)>& lambda) const {
+
+    function<void(Alignment&)> filter = [&](Alignment& aln) {
+        // Blocks also hold reads outside the range, so check each read
+        for (size_t i = 0; i < aln.path().mapping_size(); i++) {
+            id_t node_id = aln.path().mapping(i).position().node_id();
+            if (node_id >= min_id && node_id <= max_id) {
+                lambda(aln);
+                return;
+            }
+        }
+    };
+
+    string block;
+    for (auto& virtual_offset : find(min_id, max_id)) {
+        gam_in.clear();
+        gam_in.seekg(virtual_offset);
+        if (!gam_in) {
+            throw runtime_error("[vg::GAMIndex] could not seek to offset " + to_string(virtual_offset));
+        }
+
+        // The stream reads ahead, so we make a new one for every block we seek to
+        ::google::protobuf::io::IstreamInputStream raw_in(&gam_in);
+        if (!stream::read_block(&raw_in, block)) {
+            throw runtime_error("[vg::GAMIndex] no block at offset " + to_string(virtual_offset)
+                                + "; is this the indexed GAM?");
+        }
+        stream::for_each_in_block<Alignment>(block, filter);
+    }
+}
+
+void GAMIndex::save(ostream& out) const {
+    auto write_int = [&](uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) {
+            out.put((char) ((value >> (8 * i)) & 0xFF));
+        }
+    };
+
+    out.write(MAGIC.data(), MAGIC.size());
+    write_int(VERSION, 4);
+    write_int(blocks.size(), 8);
+    for (auto& block : blocks) {
+        write_int(block.min_id, 8);
+        write_int(block.max_id, 8);
+        write_int(block.virtual_offset, 8);
+    }
+
+    if (!out) {
+        throw runtime_error("[vg::GAMIndex] could not write index");
+    }
+}
+
+void GAMIndex::load(istream& in) {
+    auto read_int = [&](size_t bytes) -> uint64_t {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            int c = in.get();
+            if (c == EOF) {
+                throw runtime_error("[vg::GAMIndex] index is truncated");
+            }
+            value |= ((uint64_t) (unsigned char) c) << (8 * i);
+        }
+        return value;
+    };
+
+    string magic(MAGIC.size(), '\0');
+    in.read(&magic[0], magic.size());
+    if (!in || magic != MAGIC) {
+        throw runtime_error("[vg::GAMIndex] not a GAM index");
+    }
+    uint32_t version = read_int(4);
+    if (version > VERSION) {
+        throw runtime_error("[vg::GAMIndex] GAM index version " + to_string(version)
+                            + " is newer than supported version " + to_string(VERSION));
+    }
+
+    blocks.resize(read_int(8));
+    for (auto& block : blocks) {
+        block.min_id = read_int(8);
+        block.max_id = read_int(8);
+        block.virtual_offset = read_int(8);
+    }
+
+    update_bounds();
+}
+
+size_t GAMIndex::block_count() const {
+    return blocks.size();
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef VG_GAM_INDEX_HPP_INCLUDED
+#define VG_GAM_INDEX_HPP_INCLUDED
+
+/**
+ * \file gam_index.hpp: define a GAMIndex, a small sidecar index that maps node
+ * ID ranges to the blocks of a sorted GAM file that hold reads touching them.
+ */
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <utility>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * An index of a sorted GAM file, written as a blocked stream (see
+ * stream::set_output_blocked()), that remembers the range of node IDs touched
+ * by the reads in each block, and the virtual offset of that block in the
+ * file. Since each block can be decompressed on its own, the virtual offset is
+ * just the block's byte offset.
+ *
+ * Lets us pull out all the reads touching a node range by seeking straight to
+ * the relevant blocks, without having to load the reads into RocksDB. Queries
+ * are fastest when the GAM is sorted, but are correct on any blocked GAM.
+ * Unmapped reads are not indexed.
+ */
+class GAMIndex {
+public:
+
+    GAMIndex() = default;
+
+    /// Index the blocked GAM on the given stream, from its current position
+    /// to the end. Throws if the GAM is not a blocked stream.
+    void index(istream& gam_in);
+
+    /// Get the virtual offsets of the blocks that might have reads touching
+    /// any node in the given inclusive range, in file order.
+    vector<int64_t> find(id_t min_id, id_t max_id) const;
+
+    /// Call the given function on each read in the given GAM that touches any
+    /// node in the given inclusive range, in file order. The GAM stream must be
+    /// seekable and must be the one this index was made from.
+    void for_alignment_in_range(istream& gam_in, id_t min_id, id_t max_id,
+                                const function<void(const Alignment&)>& lambda) const;
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load an index from a stream. Throws if it isn't a GAM index.
+    void load(istream& in);
+
+    /// Get the number of indexed blocks
+    size_t block_count() const;
+
+    /// Get the inclusive range of node IDs touched by a read, or (0, -1) if it
+    /// touches no nodes.
+    static pair<id_t, id_t> get_id_range(const Alignment& aln);
+
+private:
+
+    /// Information about one block of reads
+    struct Block {
+        /// Smallest node ID touched by any read in the block
+        id_t min_id;
+        /// Largest node ID touched by any read in the block
+        id_t max_id;
+        /// Position of the block's header in the file
+        int64_t virtual_offset;
+    };
+
+    /// Recompute the search bounds after the blocks have changed
+    void update_bounds();
+
+    /// All the indexed blocks, in file order
+    vector<Block> blocks;
+    /// For each block, the max of max_id over it and all blocks before it
+    vector<id_t> prefix_max;
+    /// For each block, the min of min_id over it and all blocks after it
+    vector<id_t> suffix_min;
+
+    /// Magic bytes at the start of an index file
+    static const string MAGIC;
+    /// Format version we write
+    static const uint32_t VERSION = 1;
+};
+
+}
+
+#endif
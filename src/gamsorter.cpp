@@ -1,4 +1,9 @@
 #include "gamsorter.hpp"
+#include "utility.hpp"
+
+#include <cstdio>
+#include <limits>
+#include <omp.h>
 /*
 *  GAMSorter: sort a gam by position and offset
 *  dumbly store unmapped reads at the end.
@@ -8,133 +13,18 @@ using namespace std;
 using namespace vg;
 
 
-class AlnSorter{
-    bool invert = false;
-public:
-  bool mycomparison(const bool& reverse=false)
-  {invert = reverse;}
-  bool operator() (const Alignment& a_one, const Alignment& a_two) const
-  {
-
-        // Unmapped case
-        int xf_size = a_one.path().mapping_size();
-        int xb_size = a_two.path().mapping_size();
-        
-        if (xf_size == 0 || xb_size == 0){
-            bool both_zero = (xf_size == xb_size);
-            if (both_zero){
-                return false;
-            }
-            else{
-                return (xf_size > xb_size) ? false : true;
-            }
-        }
-
-        Position x_front = a_one.path().mapping(0).position();
-        Position x_back = a_one.path().mapping(a_one.path().mapping_size() - 1).position();
-
-        Position lhs;
-        Position rhs;
-        if (x_front.node_id() < x_back.node_id())
-        {
-            lhs = x_front;
-        }
-        else
-        {
-            lhs = x_back;
-        }
-        Position y_front = a_two.path().mapping(0).position();
-        Position y_back = a_two.path().mapping(a_two.path().mapping_size() - 1).position();
-        if (y_front.node_id() < y_back.node_id())
-        {
-            rhs = y_front;
-        }
-        else
-        {
-            rhs = y_back;
-        }
-
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
-        }
-  }
-};
-
-
-struct custom_pos_sort_key
-{
-    bool operator()(const Position lhs, const Position rhs)
-    {
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
-        }
-    }
-} possortkey;
-
-struct custom_aln_sort_key
+void GAMSorter::sort(vector<Alignment> &alns)
 {
-    bool operator()(const Alignment a_one, const Alignment a_two)
+    // Compute each key once, sort the keys, and then move the alignments
+    vector<pair<SortKey, size_t>> order = sort_order(alns.size(), [&](size_t i) {
+        return get_sort_key(alns[i]);
+    });
+    vector<Alignment> sorted(alns.size());
+    for (size_t i = 0; i < order.size(); i++)
     {
-        int xf_size = a_one.path().mapping_size();
-        int xb_size = a_two.path().mapping_size();
-        
-        if (xf_size == 0 || xb_size == 0){
-            bool both_zero = (xf_size == xb_size);
-            if (both_zero){
-                return false;
-            }
-            else{
-                return (xf_size > xb_size) ? false : true;
-            }
-        }
-        Position x_front = a_one.path().mapping(0).position();
-        Position x_back = a_one.path().mapping(a_one.path().mapping_size() - 1).position();
-
-        Position lhs;
-        Position rhs;
-        if (x_front.node_id() < x_back.node_id())
-        {
-            lhs = x_front;
-        }
-        else
-        {
-            lhs = x_back;
-        }
-        Position y_front = a_two.path().mapping(0).position();
-        Position y_back = a_two.path().mapping(a_two.path().mapping_size() - 1).position();
-        if (y_front.node_id() < y_back.node_id())
-        {
-            rhs = y_front;
-        }
-        else
-        {
-            rhs = y_back;
-        }
-
-        if (lhs.node_id() == rhs.node_id())
-        {
-            return lhs.offset() < rhs.offset();
-        }
-        else
-        {
-            return lhs.node_id() < rhs.node_id();
-        }
+        sorted[i].Swap(&alns[order[i].second]);
     }
-} alnsortkey;
-
-void GAMSorter::sort(vector<Alignment> &alns)
-{
-    std::sort(alns.begin(), alns.end(), alnsortkey);
+    alns.swap(sorted);
 }
 
 void GAMSorter::paired_sort(string gamfile)
@@ -181,212 +71,415 @@ void GAMSorter::paired_sort(string gamfile)
     }
 }
 
-void GAMSorter::write_temp(vector<Alignment>& alns)
-{
-    string t_name = "tmp_sort_" + std::to_string(tmp_filenames.size());
-    tmp_filenames.push_back(t_name);
-    ofstream t_file;
-    t_file.open(t_name);
-    stream::write_buffered(t_file, alns, 0);
-    t_file.close();
-}
-
 void GAMSorter::dumb_sort(string gamfile)
 {
     std::vector<Alignment> buf;
     buf.reserve(1000000);
 
     std::function<void(Alignment&)> presort = [&](Alignment &aln) {
-        buf.push_back(aln);
+        buf.emplace_back();
+        buf.back().Swap(&aln);
     };
     ifstream gammy;
     gammy.open(gamfile);
     stream::for_each(gammy, presort);
 
-    std::sort(buf.begin(), buf.end(), alnsortkey);
-
-    std::function<void(uint64_t)> x_buf_func = [&](uint64_t) {
-
-    };
+    sort(buf);
 
     ofstream outfi;
     outfi.open(gamfile + ".sorted.gam");
-    stream::write_buffered(outfi, buf, buf.size());
+    // Write in pieces, so a GAMIndex of the output has blocks to point at
+    const size_t piece_length = 1000;
+    for (size_t i = 0; i < buf.size(); i += piece_length)
+    {
+        size_t piece_size = std::min(piece_length, buf.size() - i);
+        std::function<Alignment&(uint64_t)> piece = [&](uint64_t n) -> Alignment& {
+            return buf[i + n];
+        };
+        stream::write(outfi, piece_size, piece);
+    }
 }
 
-void GAMSorter::stream_sort(string gamfile){
-
-    std::vector<Alignment> buffer;
-    buffer.reserve(1000);
-    std::function<void(Alignment&)> firstpass_bufsort = [&](Alignment& a){
-        #pragma omp critical
-        buffer.push_back(a);
-        if (buffer.size() == max_buf_size){
-                sort(buffer);
-                write_temp(buffer);
-                buffer.clear();
-        }
-    };
+GAMSorter::SortKey GAMSorter::get_sort_key(const Alignment& aln)
+{
+    const Path& path = aln.path();
+    if (path.mapping_size() == 0)
+    {
+        // Unmapped reads go at the end
+        return SortKey{numeric_limits<int64_t>::max(), numeric_limits<int64_t>::max()};
+    }
+    const Position& front = path.mapping(0).position();
+    const Position& back = path.mapping(path.mapping_size() - 1).position();
+    const Position& min_pos = (front.node_id() < back.node_id()) ? front : back;
+    return SortKey{min_pos.node_id(), min_pos.offset()};
+}
 
-    
+vector<pair<GAMSorter::SortKey, size_t>> GAMSorter::sort_order(size_t count,
+                                                               const function<SortKey(size_t)>& get_key)
+{
+    vector<pair<SortKey, size_t>> order;
+    order.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        order.emplace_back(get_key(i), i);
+    }
+    // Ties keep their input order
+    std::stable_sort(order.begin(), order.end(), [](const pair<SortKey, size_t>& a, const pair<SortKey, size_t>& b) {
+        return a.first < b.first;
+    });
+    return order;
+}
 
+/**
+ * Writes a temporary run: a compressed stream of records, each a sort key
+ * followed by a serialized alignment, so merging never has to parse them.
+ */
+class GAMSorter::RunWriter
+{
+public:
+    RunWriter(ostream& out) : raw_out(&out), codec_out(&raw_out), coded_out(&codec_out) {}
 
-    ifstream gammy;
-    gammy.open(gamfile);
-    stream::for_each(gammy, firstpass_bufsort);
+    void write(const SortKey& key, const string& message)
+    {
+        coded_out.WriteVarint64((uint64_t) key.node_id);
+        coded_out.WriteVarint64((uint64_t) key.offset);
+        coded_out.WriteVarint32(message.size());
+        coded_out.WriteRaw(message.data(), message.size());
+        if (coded_out.HadError())
+        {
+            throw runtime_error("[vg::GAMSorter] I/O error writing temporary run");
+        }
+    }
 
-    sort(buffer);
-    write_temp(buffer);
-    buffer.clear();
+private:
+    ::google::protobuf::io::OstreamOutputStream raw_out;
+    stream::CodecOutputStream codec_out;
+    ::google::protobuf::io::CodedOutputStream coded_out;
+};
 
+/// Reads back what a RunWriter wrote
+class GAMSorter::RunReader
+{
+public:
+    RunReader(istream& in) : raw_in(&in), codec_in(&raw_in), coded_in(&codec_in) {}
 
+    /// Read the next record, moving its message into the given string.
+    /// Returns false at the end of the run.
+    bool read(SortKey& key, string& message)
+    {
+        // Reset the bytes-ever-read counter, as stream::for_each does
+        coded_in.~CodedInputStream();
+        new (&coded_in) ::google::protobuf::io::CodedInputStream(&codec_in);
+        coded_in.SetTotalBytesLimit(stream::MAX_PROTOBUF_SIZE * 2, stream::MAX_PROTOBUF_SIZE * 2);
+
+        uint64_t node_id, offset;
+        uint32_t size;
+        if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &node_id))
+        {
+            return false;
+        }
+        if (!coded_in.ReadVarint64((::google::protobuf::uint64*) &offset) ||
+            !coded_in.ReadVarint32(&size) ||
+            !coded_in.ReadString(&message, size))
+        {
+            throw runtime_error("[vg::GAMSorter] temporary run is truncated");
+        }
+        key.node_id = (int64_t) node_id;
+        key.offset = (int64_t) offset;
+        return true;
+    }
 
-   
-    int num_valid = tmp_filenames.size();
-    vector<bool> still_valid(tmp_filenames.size());
-    vector<uint64_t> curr_file_count (tmp_filenames.size());
-    typedef priority_queue<Alignment,std::vector<Alignment>, AlnSorter> AlnHeap;
-    
+private:
+    ::google::protobuf::io::IstreamInputStream raw_in;
+    stream::CodecInputStream codec_in;
+    ::google::protobuf::io::CodedInputStream coded_in;
+};
 
-    for (int i = 0; i < tmp_filenames.size(); ++i){
-        ifstream tfile;
-        tfile.open(tmp_filenames[i]);
-        tmp_files.emplace_back(&tfile);
+string GAMSorter::write_run(vector<string>& messages)
+{
+    // Parse each read once, just to get its key
+    RunBuffer buffer;
+    buffer.keys.resize(messages.size());
+    Alignment aln;
+    for (size_t i = 0; i < messages.size(); i++)
+    {
+        if (!aln.ParseFromString(messages[i]))
+        {
+            throw runtime_error("[vg::GAMSorter] invalid alignment in input GAM");
+        }
+        buffer.keys[i] = get_sort_key(aln);
     }
+    buffer.messages = std::move(messages);
+    messages.clear();
 
+    return write_run(buffer);
+}
 
-    
+string GAMSorter::write_run(RunBuffer& buffer)
+{
+    vector<SortKey>& keys = buffer.keys;
+    vector<string>& messages = buffer.messages;
+    vector<pair<SortKey, size_t>> order = sort_order(messages.size(), [&](size_t i) {
+        return keys[i];
+    });
 
-    vector<::google::protobuf::io::CodedInputStream*> protostreams;
-    vector<::google::protobuf::io::GzipInputStream*> zipstreams;
+    string run_name = tmpfilename(find_temp_dir() + "/vg-gamsort-run");
+    {
+        ofstream run_out(run_name);
+        if (!run_out)
+        {
+            throw runtime_error("[vg::GAMSorter] could not write temporary run " + run_name);
+        }
+        RunWriter writer(run_out);
+        for (auto& entry : order)
+        {
+            writer.write(entry.first, messages[entry.second]);
+        }
+    }
+    keys.clear();
+    messages.clear();
 
-    for (auto x : tmp_files){
-        ::google::protobuf::io::ZeroCopyInputStream *raw_in =
-          new ::google::protobuf::io::IstreamInputStream(x);
-        ::google::protobuf::io::GzipInputStream *gzip_in =
-          new ::google::protobuf::io::GzipInputStream(raw_in);
-        ::google::protobuf::io::CodedInputStream *pstream =
-          new ::google::protobuf::io::CodedInputStream(gzip_in);
+    return run_name;
+}
 
-        protostreams.push_back(pstream);
-        zipstreams.push_back(gzip_in);
+void GAMSorter::merge_runs(const vector<string>& runs, ostream& out, bool to_gam)
+{
+    // Open a reader on every run
+    vector<ifstream*> run_files;
+    vector<RunReader*> run_readers;
+    for (auto& run_name : runs)
+    {
+        run_files.push_back(new ifstream(run_name));
+        if (!*run_files.back())
+        {
+            throw runtime_error("[vg::GAMSorter] could not read temporary run " + run_name);
+        }
+        run_readers.push_back(new RunReader(*run_files.back()));
     }
 
-    std::function<bool(int)> handle_count_line = [&](int tmp_index){
-        uint64_t count;
-        protostreams[tmp_index]->ReadVarint64((::google::protobuf::uint64*) &count);
-        curr_file_count[tmp_index] = count;
-        cerr << std::to_string(count) << endl;
-        if (!count){
-            return false;
+    // A min-heap of the next key in each run, breaking ties by run number so
+    // that equal reads stay in input order
+    typedef pair<SortKey, size_t> heap_entry_t;
+    auto greater = [](const heap_entry_t& a, const heap_entry_t& b) {
+        return b.first < a.first || (!(a.first < b.first) && a.second > b.second);
+    };
+    priority_queue<heap_entry_t, vector<heap_entry_t>, decltype(greater)> heap(greater);
+    vector<string> heads(runs.size());
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        SortKey key;
+        if (run_readers[i]->read(key, heads[i]))
+        {
+            heap.emplace(key, i);
         }
-        return true;
+    }
+
+    // Where merged reads go
+    RunWriter* run_out = to_gam ? nullptr : new RunWriter(out);
+    vector<string> out_buf;
+    out_buf.reserve(output_chunk_size);
+    auto flush = [&]() {
+        std::function<const string&(uint64_t)> lambda = [&](uint64_t n) -> const string& {
+            return out_buf[n];
+        };
+        stream::write_serialized(out, out_buf.size(), lambda);
+        out_buf.clear();
     };
 
-    for (int i = 0; i < protostreams.size(); i++){
-        handle_count_line(i);
+    while (!heap.empty())
+    {
+        SortKey key = heap.top().first;
+        size_t run = heap.top().second;
+        heap.pop();
+
+        if (to_gam)
+        {
+            out_buf.emplace_back(std::move(heads[run]));
+            if (out_buf.size() >= output_chunk_size)
+            {
+                flush();
+            }
+        }
+        else
+        {
+            run_out->write(key, heads[run]);
+        }
+
+        if (run_readers[run]->read(key, heads[run]))
+        {
+            heap.emplace(key, run);
+        }
+    }
+    if (to_gam && !out_buf.empty())
+    {
+        flush();
     }
+    delete run_out;
 
-    
-    
-    std::function<bool(int, Alignment&)> read_dat_buf = [&](int tmp_index, Alignment& ret){
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        delete run_readers[i];
+        delete run_files[i];
+        std::remove(runs[i].c_str());
+    }
+}
 
-        // Read our message of size count.
-        std::string s;
-        //for (uint64_t i = 0; i < count; ++i) {
-            (curr_file_count[tmp_index])--;
-            if (curr_file_count[tmp_index] <= 0){
-                return handle_count_line(tmp_index);
-            }
-            uint32_t msgSize = 0;
-            delete (protostreams[tmp_index]);
-            (protostreams[tmp_index]) = new ::google::protobuf::io::CodedInputStream( (zipstreams[tmp_index]));
-            // the messages are prefixed by their size
-            (protostreams[tmp_index])->ReadVarint32(&msgSize);
-            if ((msgSize > 0) &&
-                (protostreams[tmp_index]->ReadString(&s, msgSize))) {
-                ret.ParseFromString(s);
-                return true;
+void GAMSorter::stream_sort(istream& gam_in, ostream& gam_out)
+{
+    // Run generation: the reading thread only pulls out serialized reads, and
+    // tasks parse, sort and write out each buffer as a run. At most one
+    // buffer per thread is in flight, so memory use is bounded by
+    // threads * max_buf_size reads.
+    int thread_count = get_thread_count();
+    vector<string> runs;
+
+#pragma omp parallel shared(gam_in, runs)
+#pragma omp single
+    {
+        vector<string>* buffer = new vector<string>();
+        int buffers_outstanding = 0;
+        // Tasks would copy a vector seen through a lambda capture, so they use a pointer
+        vector<string>* all_runs = &runs;
+        std::function<void(string&)> add_to_run = [&](string& message) {
+            buffer->emplace_back(std::move(message));
+            if (buffer->size() >= max_buf_size)
+            {
+                if (buffers_outstanding >= thread_count)
+                {
+                    // Wait for (or help with) the runs in flight
+#pragma omp taskwait
+                    buffers_outstanding = 0;
+                }
+
+                vector<string>* full_buffer = buffer;
+                buffers_outstanding++;
+#pragma omp task firstprivate(full_buffer, all_runs)
+                {
+                    string run_name = write_run(*full_buffer);
+                    delete full_buffer;
+#pragma omp critical (GAMSorter_runs)
+                    all_runs->push_back(run_name);
+                }
+                buffer = new vector<string>();
             }
-        //}
-     };
+        };
+        stream::for_each_serialized(gam_in, add_to_run);
 
+        if (!buffer->empty())
+        {
+            string run_name = write_run(*buffer);
+#pragma omp critical (GAMSorter_runs)
+            runs.push_back(run_name);
+        }
+        delete buffer;
 
-    // Heap of size (tmp_files.size())
-    AlnHeap lil_heap;
-    for(int i = 0; i < tmp_files.size(); i++){
-        Alignment a;
-        read_dat_buf(i, a);
-        lil_heap.push( a );
+#pragma omp taskwait
     }
 
-    
-    // Rotating index within the tmp_files array,
-    // for accessing the ifstream and associated Proto readers/writers
-    int tmp_file_index = 0;
-
-    // This is just an output buffer.
-    vector<Alignment> sorted_out_buf;
-    sorted_out_buf.reserve(1000);
+    merge_all_runs(runs, gam_out);
+}
 
-    // Our output stream
-    string outname = gamfile + ".sorted.gam";
-    ofstream ofile;
-    ofile.open(outname);
+void GAMSorter::merge_all_runs(vector<string>& runs, ostream& gam_out)
+{
+    // Merge passes: while there are too many runs to merge at once, merge
+    // groups of them into bigger runs, in parallel.
+    while (runs.size() > max_fan_in)
+    {
+        size_t group_count = (runs.size() + max_fan_in - 1) / max_fan_in;
+        vector<string> merged(group_count);
+#pragma omp parallel for schedule(dynamic)
+        for (size_t i = 0; i < group_count; i++)
+        {
+            vector<string> group(runs.begin() + i * max_fan_in,
+                                 runs.begin() + std::min(runs.size(), (i + 1) * max_fan_in));
+            merged[i] = tmpfilename(find_temp_dir() + "/vg-gamsort-run");
+            ofstream merged_out(merged[i]);
+            merge_runs(group, merged_out, false);
+        }
+        runs = std::move(merged);
+    }
 
-    cerr << "in the loop" << endl;
+    // Final merge into the output
+    merge_runs(runs, gam_out, true);
+    runs.clear();
+    gam_out.flush();
+}
 
-    while(!lil_heap.empty()){
+void GAMSorter::begin_incremental_sort()
+{
+    size_t thread_count = get_thread_count();
+    incremental_buffers.clear();
+    incremental_buffers.resize(thread_count);
+    incremental_buf_size = std::max<size_t>(max_buf_size / thread_count, 1);
+    incremental_runs.clear();
+}
 
-        Alignment a;
-        bool valid = read_dat_buf(tmp_file_index, a);
-        if (valid){
-            lil_heap.push(a);
-        }
-        else{
-            //handle_count_line(tmp_file_index);
-        }
-        
+void GAMSorter::add_to_sort(const Alignment& aln)
+{
+    RunBuffer& buffer = incremental_buffers.at(omp_get_thread_num());
+    buffer.keys.push_back(get_sort_key(aln));
+    buffer.messages.emplace_back();
+    if (!aln.SerializeToString(&buffer.messages.back()))
+    {
+        throw runtime_error("[vg::GAMSorter] could not serialize alignment " + aln.name());
+    }
+    if (buffer.messages.size() >= incremental_buf_size)
+    {
+        string run_name = write_run(buffer);
+#pragma omp critical (GAMSorter_runs)
+        incremental_runs.push_back(run_name);
+    }
+}
 
-        
-        sorted_out_buf.push_back(lil_heap.top());
-        cerr << "writing " << lil_heap.top().name() << endl;
-        if (sorted_out_buf.size() % 100 == 0){
-            cerr << "Done " << sorted_out_buf.size() << " records" << endl;
+void GAMSorter::finish_incremental_sort(ostream& gam_out)
+{
+    // What's left in the buffers makes the last runs
+    vector<string> runs = std::move(incremental_runs);
+    incremental_runs.clear();
+    for (RunBuffer& buffer : incremental_buffers)
+    {
+        if (!buffer.messages.empty())
+        {
+            runs.push_back(write_run(buffer));
         }
-        lil_heap.pop();
-        stream::write_buffered(ofile, sorted_out_buf, 1000);
-        tmp_file_index = (tmp_file_index + 1) % tmp_files.size();
-
     }
-    cerr << "out the loop" << endl;
+    incremental_buffers.clear();
 
-    // write any remaining records in our buffer
-    stream::write_buffered(ofile, sorted_out_buf, 0);
+    merge_all_runs(runs, gam_out);
+}
 
+void GAMSorter::stream_sort(string gamfile)
+{
+    ifstream gam_in(gamfile);
+    if (!gam_in)
+    {
+        throw runtime_error("[vg::GAMSorter] could not open " + gamfile);
+    }
+    ofstream gam_out(gamfile + ".sorted.gam");
+    stream_sort(gam_in, gam_out);
 }
 
 void GAMSorter::write_index(string gamfile, string outfile, bool isSorted)
 {
+    if (!isSorted)
+    {
+        cerr << "warning:[vg::GAMSorter] indexing a GAM that may not be sorted; queries will be slow" << endl;
+    }
 
-    map<int64_t, vector<string>> node_to_alns;
+    ifstream gam_in(gamfile);
+    if (!gam_in)
+    {
+        throw runtime_error("[vg::GAMSorter] could not open " + gamfile + " for indexing");
+    }
 
-    std::function<void(Alignment &)> node_grabber = [&](Alignment &aln) {
-        vector<int64_t> ret;
-        Path p = aln.path();
-        for (int i = 0; i < p.mapping_size(); i++)
-        {
-            Mapping m = p.mapping(i);
-            ret.push_back(m.position().node_id());
-        }
-        for (auto x : ret)
-        {
-            node_to_alns[x].push_back(aln.name());
-        }
-    };
+    GAMIndex index;
+    index.index(gam_in);
+
+    ofstream index_out(outfile);
+    index.save(index_out);
 }
 
-bool GAMSorter::min_aln_first(Alignment &a, Alignment &b)
+bool GAMSorter::min_aln_first(const Alignment &a, const Alignment &b)
 {
 
     if (less_than(get_min_position(a), get_min_position(b)))
@@ -399,19 +492,19 @@ bool GAMSorter::min_aln_first(Alignment &a, Alignment &b)
     }
 }
 
-Position GAMSorter::get_min_position(Alignment a)
+Position GAMSorter::get_min_position(const Alignment& a)
 {
     return get_min_position(a.path());
 }
 
-Position GAMSorter::get_min_position(Path pat)
+Position GAMSorter::get_min_position(const Path& pat)
 {
-    Position p = pat.mapping(0).position();
-    Position p_prime = pat.mapping(pat.mapping_size() - 1).position();
+    const Position& p = pat.mapping(0).position();
+    const Position& p_prime = pat.mapping(pat.mapping_size() - 1).position();
     return less_than(p, p_prime) ? p : p_prime;
 }
 
-bool GAMSorter::equal_to(Position a, Position b)
+bool GAMSorter::equal_to(const Position& a, const Position& b)
 {
     if (a.node_id() == b.node_id() &&
         a.offset() == b.offset())
@@ -421,7 +514,7 @@ bool GAMSorter::equal_to(Position a, Position b)
     return false;
 }
 
-bool GAMSorter::less_than(Position a, Position b)
+bool GAMSorter::less_than(const Position& a, const Position& b)
 {
     if (a.node_id() > b.node_id())
     {
@@ -433,7 +526,7 @@ bool GAMSorter::less_than(Position a, Position b)
     }
 }
 
-bool GAMSorter::greater_than(Position a, Position b)
+bool GAMSorter::greater_than(const Position& a, const Position& b)
 {
     if (a.node_id() < b.node_id())
     {
@@ -3,6 +3,7 @@
 
 #include "vg.pb.h"
 #include "stream.hpp"
+#include "gam_index.hpp"
 #include <string>
 #include <queue>
 #include <sstream>
@@ -34,6 +35,27 @@ class GAMSorter
 
   
   public:
+
+    /**
+     * A compact sort key for an alignment: the node ID and offset of its
+     * minimum position. Unmapped reads get the largest key, so they sort last.
+     * The sort works on these keys and the reads' serialized bytes, so reads
+     * are parsed only once and never copied to be compared.
+     */
+    struct SortKey
+    {
+        int64_t node_id;
+        int64_t offset;
+
+        inline bool operator<(const SortKey& other) const
+        {
+            return node_id < other.node_id || (node_id == other.node_id && offset < other.offset);
+        }
+    };
+
+    /// Compute the sort key of an alignment, ordering reads as sort() does
+    static SortKey get_sort_key(const Alignment& aln);
+
     // vector<Alignment> merge(vector<vector<Alignment>> a);
 
     // void merge(map<int, vector<Alignment>> m, map<int, int> split_to_sz);
@@ -42,33 +64,100 @@ class GAMSorter
 
     void paired_sort(string gamfile);
 
-    void write_temp(vector<Alignment>& alns);
-
+    /**
+     * Sort a GAM of any size in bounded memory. Buffers of up to max_buf_size
+     * serialized reads are sorted in parallel and written to compressed
+     * temporary runs; the runs are then merged with a heap, max_fan_in at a
+     * time, and the sorted reads are written to gam_out.
+     */
+    void stream_sort(istream& gam_in, ostream& gam_out);
+
+    /// Sort the given GAM file into <gamfile>.sorted.gam with stream_sort()
     void stream_sort(string gamfile);
 
+    /**
+     * Get ready to sort reads handed over one at a time with add_to_sort(),
+     * as a mapper produces them, so they never have to be written out unsorted
+     * and read back. Each OpenMP thread gets its own buffer, with max_buf_size
+     * shared out between them.
+     */
+    void begin_incremental_sort();
+
+    /// Add a read to the sort started with begin_incremental_sort(). Any
+    /// number of threads can call this at once. A thread's buffer is written
+    /// out as a sorted run when it fills.
+    void add_to_sort(const Alignment& aln);
+
+    /// Merge all the reads added since begin_incremental_sort() and write them
+    /// to gam_out in sorted order, as stream_sort() would.
+    void finish_incremental_sort(ostream& gam_out);
+
     void dumb_sort(string gamfile);
 
     // vector<Alignment> split(vector<Alignment> a, int s);
 
-    bool min_aln_first(Alignment& a, Alignment& b);
+    bool min_aln_first(const Alignment& a, const Alignment& b);
 
-    Position get_min_position(Alignment a);
+    Position get_min_position(const Alignment& a);
 
-    Position get_min_position(Path p);
+    Position get_min_position(const Path& p);
 
+    /// Write a GAMIndex for the given blocked GAM to the given file
     void write_index(string gamfile, string outfile, bool isSorted = false);
 
-    bool equal_to(Position a, Position b);
+    bool equal_to(const Position& a, const Position& b);
 
-    bool less_than(Position a, Position b);
+    bool less_than(const Position& a, const Position& b);
 
-    bool greater_than(Position a, Position b);
+    bool greater_than(const Position& a, const Position& b);
+
+    /// How many reads each thread holds in memory before writing a run
+    size_t max_buf_size = 1000000;
+    /// How many runs to merge at once
+    size_t max_fan_in = 64;
+    /// How many reads to write to the output at a time
+    size_t output_chunk_size = 1000;
 
   private:
+
+    class RunWriter;
+    class RunReader;
+
+    /// Serialized reads waiting to go into a run, with their sort keys
+    struct RunBuffer
+    {
+        vector<SortKey> keys;
+        vector<string> messages;
+    };
+
+    /// Get the order that sorts count items with the given keys, as (key,
+    /// original index) pairs. Ties keep their original order.
+    static vector<pair<SortKey, size_t>> sort_order(size_t count, const function<SortKey(size_t)>& get_key);
+
+    /// Sort a buffer of serialized reads by key and write it to a new
+    /// temporary run, returning the run's file name. Clears the buffer.
+    string write_run(vector<string>& messages);
+
+    /// Sort and write out a buffer whose keys are already known. Clears the
+    /// buffer.
+    string write_run(RunBuffer& buffer);
+
+    /// Merge sorted runs, max_fan_in at a time, until they can be merged into
+    /// the output, and then do so, deleting them all.
+    void merge_all_runs(vector<string>& runs, ostream& gam_out);
+
+    /// Per-thread buffers for add_to_sort()
+    vector<RunBuffer> incremental_buffers;
+    /// How many reads each of those holds before writing a run
+    size_t incremental_buf_size = 0;
+    /// Runs written so far by add_to_sort()
+    vector<string> incremental_runs;
+
+    /// Merge the given sorted runs into the given output stream, deleting
+    /// them. Writes a GAM if to_gam is set, and another run otherwise.
+    void merge_runs(const vector<string>& runs, ostream& out, bool to_gam);
+
     map<int, int> split_to_split_size;
-    vector<string> tmp_filenames;
-    vector<ifstream*> tmp_files;
-    int max_buf_size = 20000;
     /**
     * We want to keep pairs together, with the lowest-coordinate pair coming first.
     * If one read is unmapped, it follows its partner in the sorted GAM file.
@@ -253,10 +253,11 @@ const vector<pair<handle_t, size_t>>& SnarlState::insert(size_t overall_lane, co
 }
 
 vector<pair<handle_t, size_t>> SnarlState::erase(size_t overall_lane) {
-    // Copy what we're erasing
-    auto copy = haplotypes.at(overall_lane);
+    // Take what we're erasing. Moving the vector keeps its storage, so the
+    // iterators into it in net_node_lanes stay good while we clean them up.
+    auto erased = std::move(haplotypes.at(overall_lane));
     
-    for (auto it = copy.rbegin(); it != copy.rend(); ++it) {
+    for (auto it = erased.rbegin(); it != erased.rend(); ++it) {
         // Trace from end to start and remove from the net node lanes collections.
         // We have to do it backward so we can handle duplicate visits properly.
         auto& node_lanes = net_node_lanes[graph->forward(it->first)];
@@ -273,11 +274,10 @@ vector<pair<handle_t, size_t>> SnarlState::erase(size_t overall_lane) {
         }
     }
 
-    // Drop the actual haplotype
+    // Drop the now-empty haplotype slot
     haplotypes.erase(haplotypes.begin() + overall_lane);
     
-    // Return the copy
-    return copy;
+    return erased;
 }
 
 void SnarlState::swap(size_t lane1, size_t lane2) {
@@ -1,6 +1,7 @@
 #include "genotypekit.hpp"
 #include "cactus.hpp"
 #include "traversal_finder.hpp"
+#include "packer.hpp"
 
 //#define debug
 
@@ -142,6 +143,11 @@ void AugmentedGraph::clear() {
     *this = AugmentedGraph();
 }
 
+void AugmentedGraph::clear_alignments() {
+    embedded_alignments.clear();
+    alignments_by_node.clear();
+}
+
 void AugmentedGraph::augment_from_alignment_edits(vector<Alignment>& alignments,
                                                   bool unique_names, bool leave_edits) {
 
@@ -266,11 +272,117 @@ bool SupportAugmentedGraph::has_supports() {
 }
 
 Support SupportAugmentedGraph::get_support(Node* node) {
-    return node_supports.count(node) ? node_supports.at(node) : Support();
+    auto found = node_supports.find(node);
+    return found != node_supports.end() ? found->second : Support();
 }
 
 Support SupportAugmentedGraph::get_support(Edge* edge) {
-    return edge_supports.count(edge) ? edge_supports.at(edge) : Support();
+    auto found = edge_supports.find(edge);
+    return found != edge_supports.end() ? found->second : Support();
+}
+
+PackedSupport SupportAugmentedGraph::get_packed_support(Node* node) const {
+    auto found = node_supports.find(node);
+    return found != node_supports.end() ? PackedSupport(found->second) : PackedSupport();
+}
+
+PackedSupport SupportAugmentedGraph::get_packed_support(Edge* edge) const {
+    auto found = edge_supports.find(edge);
+    return found != edge_supports.end() ? PackedSupport(found->second) : PackedSupport();
+}
+
+void SupportAugmentedGraph::load_pack_supports(const Packer& packer) {
+    node_supports.clear();
+    edge_supports.clear();
+
+    auto to_support = [](double coverage) {
+        Support support;
+        support.set_forward(coverage / 2);
+        support.set_reverse(coverage / 2);
+        support.set_quality(coverage);
+        return support;
+    };
+
+    graph.for_each_node([&](Node* node) {
+        node_supports[node] = to_support(packer.node_coverage(node->id()).mean());
+    });
+
+    // the coverage of the base at a node side is the reads leaving over its edges
+    auto side_coverage = [&](const NodeSide& side) {
+        size_t length = graph.get_node(side.node)->sequence().size();
+        Position pos = make_position(side.node, false, side.is_end ? length - 1 : 0);
+        return (double) packer.coverage_at_position(packer.position_in_basis(pos));
+    };
+    map<NodeSide, vector<Edge*>> side_edges;
+    graph.for_each_edge([&](Edge* edge) {
+        auto sides = NodeSide::pair_from_edge(edge);
+        side_edges[sides.first].push_back(edge);
+        if (sides.second != sides.first) {
+            side_edges[sides.second].push_back(edge);
+        }
+    });
+    auto clamp_to_sides = [&](Edge* edge, double coverage) {
+        auto sides = NodeSide::pair_from_edge(edge);
+        return max(0.0, min(coverage, min(side_coverage(sides.first), side_coverage(sides.second))));
+    };
+
+    // An edge alone on a side takes all of its coverage, and then the last
+    // edge without an estimate on a side takes what the others leave. So in a
+    // deletion bubble, the edge into the deleted node takes that node's
+    // coverage, and the deletion edge gets the rest.
+    map<Edge*, double> estimates;
+    deque<NodeSide> queue;
+    for (auto& side : side_edges) {
+        queue.push_back(side.first);
+    }
+    while (!queue.empty()) {
+        NodeSide side = queue.front();
+        queue.pop_front();
+        Edge* unknown = nullptr;
+        size_t unknowns = 0;
+        double known = 0;
+        for (Edge* edge : side_edges[side]) {
+            auto found = estimates.find(edge);
+            if (found == estimates.end()) {
+                unknown = edge;
+                unknowns++;
+            } else {
+                known += found->second;
+            }
+        }
+        if (unknowns == 1) {
+            estimates[unknown] = clamp_to_sides(unknown, side_coverage(side) - known);
+            auto sides = NodeSide::pair_from_edge(unknown);
+            queue.push_back(sides.first == side ? sides.second : sides.first);
+        }
+    }
+
+    // Edges still left share what their sides have left evenly
+    map<Edge*, double> shared;
+    for (auto& side : side_edges) {
+        vector<Edge*> unknown;
+        double known = 0;
+        for (Edge* edge : side.second) {
+            auto found = estimates.find(edge);
+            if (found == estimates.end()) {
+                unknown.push_back(edge);
+            } else {
+                known += found->second;
+            }
+        }
+        for (Edge* edge : unknown) {
+            double share = (side_coverage(side.first) - known) / unknown.size();
+            auto found = shared.find(edge);
+            shared[edge] = found == shared.end() ? share : min(found->second, share);
+        }
+    }
+    for (auto& edge_share : shared) {
+        estimates[edge_share.first] = clamp_to_sides(edge_share.first, edge_share.second);
+    }
+
+    for (auto& edge_estimate : estimates) {
+        edge_supports[edge_estimate.first] = to_support(edge_estimate.second);
+    }
 }
 
 void SupportAugmentedGraph::load_supports(istream& in_file) {
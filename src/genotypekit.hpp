@@ -29,6 +29,8 @@ namespace vg {
 
 using namespace std;
 
+class Packer;
+
 /**
  * Given a path (which may run either direction through a snarl, or not touch
  * the ends at all), collect a list of NodeTraversals in order for the part
@@ -217,6 +219,14 @@ struct AugmentedGraph {
     void augment_from_alignment_edits(vector<Alignment>& alignments, bool unique_names = true,
                                       bool leave_edits = false);
 
+    /**
+     * Drop all the embedded alignments, leaving the graph and translations
+     * alone. After this, augment_from_alignment_edits() may be called again,
+     * but only with leave_edits set, to embed another batch of reads in the
+     * same graph.
+     */
+    void clear_alignments();
+
     /**
      * Load the translations from a file
      */
@@ -238,6 +248,102 @@ protected:
     unordered_map<id_t, vector<Alignment*>> alignments_by_node;
 };
 
+/**
+ * A plain-old-data copy of a Support, for arithmetic in inner loops, where
+ * building a new protobuf message for every sum or min would dominate. Convert
+ * back to a Support when it needs to go into a Locus or a VCF record.
+ */
+struct PackedSupport {
+    double forward = 0;
+    double reverse = 0;
+    double left = 0;
+    double right = 0;
+    double quality = 0;
+    
+    PackedSupport() = default;
+    
+    inline PackedSupport(double forward, double reverse, double quality) :
+        forward(forward), reverse(reverse), quality(quality) {}
+        
+    inline explicit PackedSupport(const Support& support) :
+        forward(support.forward()), reverse(support.reverse()), left(support.left()),
+        right(support.right()), quality(support.quality()) {}
+    
+    /// Make a protobuf Support with the same values
+    inline Support to_support() const {
+        Support support;
+        support.set_forward(forward);
+        support.set_reverse(reverse);
+        support.set_left(left);
+        support.set_right(right);
+        support.set_quality(quality);
+        return support;
+    }
+    
+    inline PackedSupport& operator+=(const PackedSupport& other) {
+        forward += other.forward;
+        reverse += other.reverse;
+        left += other.left;
+        right += other.right;
+        // log-scaled quality can just be added
+        quality += other.quality;
+        return *this;
+    }
+    
+    inline PackedSupport& operator*=(double scale) {
+        forward *= scale;
+        reverse *= scale;
+        left *= scale;
+        right *= scale;
+        // log-scaled quality can just be multiplied
+        quality *= scale;
+        return *this;
+    }
+    
+    inline PackedSupport& operator/=(double scale) {
+        forward /= scale;
+        reverse /= scale;
+        left /= scale;
+        right /= scale;
+        // log-scaled quality can just be divided
+        quality /= scale;
+        return *this;
+    }
+};
+
+inline PackedSupport operator+(PackedSupport one, const PackedSupport& other) {
+    return one += other;
+}
+
+inline PackedSupport operator*(PackedSupport support, double scale) {
+    return support *= scale;
+}
+
+inline PackedSupport operator*(double scale, PackedSupport support) {
+    return support *= scale;
+}
+
+inline PackedSupport operator/(PackedSupport support, double scale) {
+    return support /= scale;
+}
+
+/// Get the total read support in a PackedSupport.
+inline double total(const PackedSupport& support) {
+    return support.forward + support.reverse;
+}
+
+/// Like support_min for Supports, takes the min of the coverage on each strand
+/// and of the quality, and leaves left and right at 0.
+inline PackedSupport support_min(const PackedSupport& a, const PackedSupport& b) {
+    return PackedSupport(min(a.forward, b.forward), min(a.reverse, b.reverse), min(a.quality, b.quality));
+}
+
+/// Like support_max for Supports, takes the max of the coverage on each strand
+/// and of the quality, and leaves left and right at 0.
+inline PackedSupport support_max(const PackedSupport& a, const PackedSupport& b) {
+    return PackedSupport(max(a.forward, b.forward), max(a.reverse, b.reverse), max(a.quality, b.quality));
+}
+
 /// Augmented Graph that holds some Support annotation data specific to vg call
 struct SupportAugmentedGraph : public AugmentedGraph {
         
@@ -263,11 +369,33 @@ struct SupportAugmentedGraph : public AugmentedGraph {
      */
     Support get_support(Edge* edge);    
     
+    /**
+     * Get the support for a given Node as a PackedSupport, without copying a
+     * protobuf message, or 0 if it has no recorded support.
+     */
+    PackedSupport get_packed_support(Node* node) const;
+    
+    /**
+     * Get the support for a given Edge as a PackedSupport, without copying a
+     * protobuf message, or 0 if it has no recorded support.
+     */
+    PackedSupport get_packed_support(Edge* edge) const;
+    
     /**
      * Clear the contents.
      */
     virtual void clear();
 
+    /**
+     * Set the supports from the coverage in a compact Packer, for a graph that
+     * has not been augmented and has the node IDs of the Packer's XG. Node
+     * supports are mean coverages. The Packer has no edge coverage, so edge
+     * supports are estimated from the coverage at the node sides they join.
+     * Coverage is unstranded and has no base qualities, so it is split evenly
+     * over the strands and the quality is the count.
+     */
+    void load_pack_supports(const Packer& packer);
+
     /**
     * Read the supports from protobuf.
     */
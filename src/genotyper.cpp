@@ -1,4 +1,5 @@
 #include <cstdint>
+#include <memory>
 #include "genotyper.hpp"
 #include "algorithms/topological_sort.hpp"
 #include "traversal_finder.hpp"
@@ -282,213 +283,244 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
 
         int tid = omp_get_thread_num();
 
-        // Get all the paths through the snarl supported by real named paths
-        PathRestrictedTraversalFinder path_trav_finder(graph, manager, reads_by_name);
-        vector<SnarlTraversal> paths = path_trav_finder.find_traversals(*snarl);
-        // Or by reads
-        ReadRestrictedTraversalFinder read_trav_finder(augmented_graph, manager);
-        vector<SnarlTraversal> read_paths = read_trav_finder.find_traversals(*snarl);
-        if (!read_paths.empty()) {
-            // We want to log stats on reads that read all the
-            // way through snarls. But since we may be called
-            // multiple times we need to send the unique read
-            // name too.            
-            report_snarl_traversal(snarl, manager, graph);
-        }
-        
-        // Deduplicate into "paths"
-        unordered_set<string> seen_sequences;
-        for (auto& trav : paths) {
-            // Make a set of the sequences already represented in paths
-            seen_sequences.insert(traversal_to_string(graph, trav));
-        }
-        for (auto& trav : read_paths) {
-            if (!seen_sequences.count(traversal_to_string(graph, trav))) {
-                // If the sequence of a traversal from read_paths isn't shared with
-                // something in paths, take it. We already know it's unique in
-                // read_paths.
-                paths.push_back(trav);
-            }
+        Locus genotyped;
+        if (!genotype_snarl_from_reads(augmented_graph, manager, reads_by_name, snarl, show_progress,
+                                       total_affinities, genotyped)) {
+            // No alleles to genotype
+            return;
         }
-        // TODO: combine these ways of getting traversals?
 
+        if (output_vcf) {
+            // Get 0 or more variants from the ultrabubble
+            vector<vcflib::Variant> variants =
+                locus_to_variant(graph, snarl, manager, *reference_index, *vcf, genotyped, sample_name);
+            for(auto& variant : variants) {
+                // Fix up all the variants
+                if(!contig_name.empty()) {
+                    // Override path name
+                    variant.sequenceName = contig_name;
+                } else {
+                    // Keep path name
+                    variant.sequenceName = ref_path_name;
+                }
+                variant.position += variant_offset;
 
-        // Even if it looks like there's only one path, it might not be the
-        // reference path. TODO: ref path should always be present now that we
-        // get paths from reads and path separately. So maybe we can short
-        // circuit here?
-        if(paths.empty()) {
-            // Don't do anything for ultrabubbles with no routes through
-            if(show_progress) {
-#pragma omp critical (cerr)
-                cerr << "Snarl " << snarl->start() << " - " << snarl->end() << " has " << paths.size() <<
-                    " alleles: skipped for having no alleles" << endl;
+#pragma omp critical(cout)
+                cout << variant << endl;
             }
         } else {
+            // project into original graph (only need to do if we augmented with edit)
+            if (!translator.translations.empty()) {
+                genotyped = translator.translate(genotyped);
+            }
+            // record a consistent name based on the start and end position of the first allele
+            stringstream name;
+            if (genotyped.allele_size() && genotyped.allele(0).mapping_size()) {
+                name << make_pos_t(genotyped.allele(0).mapping(0).position())
+                     << "_"
+                     << make_pos_t(genotyped
+                                   .allele(0)
+                                   .mapping(genotyped.allele(0).mapping_size()-1)
+                                   .position());
+            }
+            genotyped.set_name(name.str());
+            if (output_json) {
+                // Dump in JSON
+#pragma omp critical (cout)
+                cout << pb2json(genotyped) << endl;
+            } else {
+                // Write out in Protobuf
+                buffer[tid].push_back(genotyped);
+                stream::write_buffered(cout, buffer[tid], 100);
+            }
+        }
+    });
 
-            if(show_progress) {
-#pragma omp critical (cerr)
-                cerr << "Snarl " << snarl->start() << " - " << snarl->end() << " has " << paths.size() << " alleles" << endl;
-                for(auto& path : paths) {
-                    // Announce each allele in turn
+    if(!output_json && !output_vcf) {
+        // Flush the protobuf output buffers
+        for(int i = 0; i < buffer.size(); i++) {
+            stream::write_buffered(cout, buffer[i], 0);
+        }
+    } 
+
+
+    if(show_progress) {
 #pragma omp critical (cerr)
-                    cerr << "\t" << traversal_to_string(graph, path) << endl;
-                }
-            }
+        cerr << "Computed " << total_affinities << " affinities" << endl;
+    }
 
-            // Compute the lengths of all the alleles
-            set<size_t> allele_lengths;
-            for(auto& path : paths) {
-                allele_lengths.insert(traversal_to_string(graph, path).size());
-            }
+    // Dump statistics before the snarls go away, so the pointers won't be dangling
+    print_statistics(cerr);
 
-            // Get the affinities for all the paths
-            map<const Alignment*, vector<Genotyper::Affinity>> affinities;
+    if(output_vcf) {
+        delete vcf;
+        delete reference_index;
+    }
 
-            if(allele_lengths.size() > 1 && realign_indels) {
-                // This is an indel, because we can change lengths. Use the slow route to do indel realignment.
-                affinities = get_affinities(augmented_graph, reads_by_name, snarl, manager, paths);
-            } else {
-                // Just use string comparison. Don't re-align when
-                // length can't change, or when indle realignment is
-                // off.
-                affinities = get_affinities_fast(augmented_graph, reads_by_name, snarl, manager, paths);
-            }
+}
 
-            if(show_progress) {
-                // Sum up all the affinity counts by consistency flags
-                map<string, size_t> consistency_combo_counts;
-
-                // And average raw scores by alleles they are
-                // consistent with, for things consistent with just
-                // one allele.
-                vector<double> score_totals(paths.size());
-                vector<size_t> score_counts(paths.size());
-
-                for(auto& alignment_and_affinities : affinities) {
-                    // For every alignment, make a string describing which alleles it is consistent with.
-                    string consistency;
-
-                    // How many alleles are we consstent with?
-                    size_t consistent_allele_count = 0;
-                    // And which one is it, if it's only one?
-                    int chosen = -1;
-
-                    for(size_t i = 0; i < alignment_and_affinities.second.size(); i++) {
-                        auto& affinity = alignment_and_affinities.second.at(i);
-                        if(affinity.consistent) {
-                            // Consistent alleles get marked with a 1
-                            consistency.push_back('1');
-
-                            // Say we're consistent with an allele
-                            chosen = i;
-                            consistent_allele_count++;
-
-                        } else {
-                            // Inconsistent ones get marked with a 0
-                            consistency.push_back('0');
-                        }
-                    }
 
-                    if(consistent_allele_count == 1) {
-                        // Add in the non-normalized score for the average
-                        score_totals.at(chosen) += alignment_and_affinities.second.at(chosen).score;
-                        score_counts.at(chosen)++;
-                    }
+void Genotyper::run_streaming(AugmentedGraph& augmented_graph,
+                              istream& gam_in,
+                              const GAMIndex& gam_index,
+                              ostream& out,
+                              string ref_path_name,
+                              string contig_name,
+                              string sample_name,
+                              bool show_progress,
+                              int length_override,
+                              int variant_offset,
+                              size_t window_bases) {
 
-#ifdef debug
+    // Unpack the graph. It must already contain any edits the reads have.
+    VG& graph = augmented_graph.graph;
+
+    if(sample_name.empty()) {
+        // Set a default sample name
+        sample_name = "SAMPLE";
+    }
+
+    if(!graph.paths.has_path(ref_path_name)) {
+        throw runtime_error("Reference path " + ref_path_name + " is required to genotype in path order");
+    }
+
+    // Make sure that we actually have an index for traversing along paths.
+    graph.paths.rebuild_mapping_aux();
+
+    if(show_progress) {
 #pragma omp critical (cerr)
-                    cerr << consistency << ": " << alignment_and_affinities.first->sequence() << endl;
-#endif
+        cerr << "Looking at graph of " << graph.size() << " nodes" << endl;
+    }
 
+    // Find the ultrabubbles
+    algorithms::sort(&graph);
+    SnarlManager manager = CactusSnarlFinder(graph, ref_path_name).find_snarls();
 
-                    // Increment the count for that pattern
-                    consistency_combo_counts[consistency]++;
-                }
+    // Index the reference, capturing the sequence, and start the VCF
+    PathIndex reference_index(graph, ref_path_name, true);
+    vcflib::VariantCallFile* vcf = start_vcf(out, reference_index, sample_name, contig_name, length_override);
 
+    // Put the ultrabubbles on the reference in order by where they start
+    // along it. Anything off the reference has nowhere to go in the VCF.
+    vector<pair<int64_t, const Snarl*>> ordered_snarls;
+    manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+        if (snarl->type() != ULTRABUBBLE) {
+            // We only work on ultrabubbles right now
+            return;
+        }
+        auto bounds = get_snarl_reference_bounds(snarl, reference_index, &graph);
+        if (bounds.first.first != -1) {
+            ordered_snarls.emplace_back(bounds.first.first, snarl);
+        }
+    });
+    stable_sort(ordered_snarls.begin(), ordered_snarls.end(),
+                [](const pair<int64_t, const Snarl*>& a, const pair<int64_t, const Snarl*>& b) {
+        return a.first < b.first;
+    });
+
+    if(show_progress) {
 #pragma omp critical (cerr)
-                {
-                    cerr << "Support patterns:" << endl;
-                    for(auto& combo_and_count : consistency_combo_counts) {
-                        // Spit out all the counts for all the combos
-                        cerr << "\t" << combo_and_count.first << ": " << combo_and_count.second << endl;
-                    }
+        cerr << "Found " << ordered_snarls.size() << " ultrabubbles on the reference" << endl;
+    }
 
-                    cerr << "Average scores for unique support:" << endl;
-                    for(size_t i = 0; i < score_totals.size(); i++) {
-                        // Spit out average scores of uniquely supporting reads for each allele that has them.
-                        if(score_counts.at(i) > 0) {
-                            cerr << "\t" << traversal_to_string(graph, paths.at(i)) << ": "
-                                 << score_totals.at(i) / score_counts.at(i) << endl;
-                        } else {
-                            cerr << "\t" << traversal_to_string(graph, paths.at(i)) << ": --" << endl;
-                        }
-                    }
+    size_t total_affinities = 0;
 
-                }
+    // Reuse one buffer for the contents of all the snarls
+    SnarlContents snarl_contents;
+
+    size_t window_start = 0;
+    while (window_start < ordered_snarls.size()) {
+        // Take all the snarls that start within window_bases of the first one
+        size_t window_end = window_start + 1;
+        while (window_end < ordered_snarls.size() &&
+               ordered_snarls[window_end].first < ordered_snarls[window_start].first + (int64_t) window_bases) {
+            window_end++;
+        }
+
+        // Find all the nodes the reads for this window could touch
+        unordered_set<id_t> window_nodes;
+        id_t min_id = numeric_limits<id_t>::max();
+        id_t max_id = 0;
+        for (size_t i = window_start; i < window_end; i++) {
+            manager.deep_contents(ordered_snarls[i].second, graph, true, snarl_contents);
+            for (const handle_t& handle : snarl_contents.nodes) {
+                id_t node_id = graph.get_id(handle);
+                window_nodes.insert(node_id);
+                min_id = min(min_id, node_id);
+                max_id = max(max_id, node_id);
             }
+        }
 
-            for(auto& alignment_and_affinities : affinities) {
-#pragma omp critical (total_affinities)
-                total_affinities += alignment_and_affinities.second.size();
+        // Pull just those reads out of the sorted GAM
+        vector<Alignment> window_reads;
+        gam_index.for_alignment_in_range(gam_in, min_id, max_id, [&](const Alignment& alignment) {
+            bool touches_window = false;
+            for (size_t i = 0; i < alignment.path().mapping_size(); i++) {
+                id_t node_id = alignment.path().mapping(i).position().node_id();
+                if (!graph.has_node(node_id)) {
+                    // Only take alignments that don't visit nodes not in the graph
+                    return;
+                }
+                touches_window = touches_window || window_nodes.count(node_id);
             }
+            if (touches_window) {
+                window_reads.push_back(alignment);
+            }
+        });
+        size_t read_count = window_reads.size();
+
+        // Embed them in place of the last window's reads
+        augmented_graph.clear_alignments();
+        augmented_graph.augment_from_alignment_edits(window_reads, true, true);
+        map<string, const Alignment*> reads_by_name;
+        for (const Alignment* alignment : augmented_graph.get_alignments()) {
+            reads_by_name[alignment->name()] = alignment;
+        }
 
-            // Get a genotyped locus in the original frame
-            Locus genotyped = genotype_snarl(graph, snarl, paths, affinities);
-            if (output_vcf) {
-                // Get 0 or more variants from the ultrabubble
-                vector<vcflib::Variant> variants =
-                    locus_to_variant(graph, snarl, manager, *reference_index, *vcf, genotyped, sample_name);
-                for(auto& variant : variants) {
-                    // Fix up all the variants
-                    if(!contig_name.empty()) {
-                        // Override path name
-                        variant.sequenceName = contig_name;
-                    } else {
-                        // Keep path name
-                        variant.sequenceName = ref_path_name;
-                    }
-                    variant.position += variant_offset;
+        // Genotype the window's snarls in parallel, keeping the variants for
+        // each snarl separate so they can go out in order
+        vector<vector<vcflib::Variant>> window_variants(window_end - window_start);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = window_start; i < window_end; i++) {
+            const Snarl* snarl = ordered_snarls[i].second;
+
+            // Report the snarl to our statistics code
+            report_snarl(snarl, manager, &reference_index, graph);
+
+            Locus genotyped;
+            if (genotype_snarl_from_reads(augmented_graph, manager, reads_by_name, snarl, show_progress,
+                                          total_affinities, genotyped)) {
+                window_variants[i - window_start] =
+                    locus_to_variant(graph, snarl, manager, reference_index, *vcf, genotyped, sample_name);
+            }
+        }
 
-#pragma omp critical(cout)
-                    cout << variant << endl;
-                }
-            } else {
-                // project into original graph (only need to do if we augmented with edit)
-                if (!translator.translations.empty()) {
-                    genotyped = translator.translate(genotyped);
-                }
-                // record a consistent name based on the start and end position of the first allele
-                stringstream name;
-                if (genotyped.allele_size() && genotyped.allele(0).mapping_size()) {
-                    name << make_pos_t(genotyped.allele(0).mapping(0).position())
-                         << "_"
-                         << make_pos_t(genotyped
-                                       .allele(0)
-                                       .mapping(genotyped.allele(0).mapping_size()-1)
-                                       .position());
-                }
-                genotyped.set_name(name.str());
-                if (output_json) {
-                    // Dump in JSON
-#pragma omp critical (cout)
-                    cout << pb2json(genotyped) << endl;
+        // Nothing later can change these records, so write them now
+        for (auto& variants : window_variants) {
+            for (auto& variant : variants) {
+                if(!contig_name.empty()) {
+                    // Override path name
+                    variant.sequenceName = contig_name;
                 } else {
-                    // Write out in Protobuf
-                    buffer[tid].push_back(genotyped);
-                    stream::write_buffered(cout, buffer[tid], 100);
+                    // Keep path name
+                    variant.sequenceName = ref_path_name;
                 }
+                variant.position += variant_offset;
+                out << variant << endl;
             }
         }
-    });
 
-    if(!output_json && !output_vcf) {
-        // Flush the protobuf output buffers
-        for(int i = 0; i < buffer.size(); i++) {
-            stream::write_buffered(cout, buffer[i], 0);
+        if(show_progress) {
+#pragma omp critical (cerr)
+            cerr << "Genotyped " << window_end << "/" << ordered_snarls.size() << " ultrabubbles, last "
+                 << (window_end - window_start) << " with " << read_count << " reads" << endl;
         }
-    } 
 
+        window_start = window_end;
+    }
+
+    // Drop the last window's reads
+    augmented_graph.clear_alignments();
 
     if(show_progress) {
 #pragma omp critical (cerr)
@@ -498,11 +530,171 @@ void Genotyper::run(AugmentedGraph& augmented_graph,
     // Dump statistics before the snarls go away, so the pointers won't be dangling
     print_statistics(cerr);
 
-    if(output_vcf) {
-        delete vcf;
-        delete reference_index;
+    delete vcf;
+}
+
+bool Genotyper::genotype_snarl_from_reads(AugmentedGraph& augmented_graph, SnarlManager& manager,
+                                          const map<string, const Alignment*>& reads_by_name,
+                                          const Snarl* snarl, bool show_progress,
+                                          size_t& total_affinities, Locus& genotyped) {
+
+    VG& graph = augmented_graph.graph;
+
+    // Get all the paths through the snarl supported by real named paths
+    PathRestrictedTraversalFinder path_trav_finder(graph, manager, reads_by_name);
+    vector<SnarlTraversal> paths = path_trav_finder.find_traversals(*snarl);
+    // Or by reads
+    ReadRestrictedTraversalFinder read_trav_finder(augmented_graph, manager);
+    vector<SnarlTraversal> read_paths = read_trav_finder.find_traversals(*snarl);
+    if (!read_paths.empty()) {
+        // We want to log stats on reads that read all the
+        // way through snarls. But since we may be called
+        // multiple times we need to send the unique read
+        // name too.            
+        report_snarl_traversal(snarl, manager, graph);
+    }
+
+    // Deduplicate into "paths"
+    unordered_set<string> seen_sequences;
+    for (auto& trav : paths) {
+        // Make a set of the sequences already represented in paths
+        seen_sequences.insert(traversal_to_string(graph, trav));
+    }
+    for (auto& trav : read_paths) {
+        if (!seen_sequences.count(traversal_to_string(graph, trav))) {
+            // If the sequence of a traversal from read_paths isn't shared with
+            // something in paths, take it. We already know it's unique in
+            // read_paths.
+            paths.push_back(trav);
+        }
+    }
+    // TODO: combine these ways of getting traversals?
+
+
+    // Even if it looks like there's only one path, it might not be the
+    // reference path. TODO: ref path should always be present now that we
+    // get paths from reads and path separately. So maybe we can short
+    // circuit here?
+    if(paths.empty()) {
+        // Don't do anything for ultrabubbles with no routes through
+        if(show_progress) {
+#pragma omp critical (cerr)
+            cerr << "Snarl " << snarl->start() << " - " << snarl->end() << " has " << paths.size() <<
+                " alleles: skipped for having no alleles" << endl;
+        }
+        return false;
+    }
+
+    if(show_progress) {
+#pragma omp critical (cerr)
+        cerr << "Snarl " << snarl->start() << " - " << snarl->end() << " has " << paths.size() << " alleles" << endl;
+        for(auto& path : paths) {
+            // Announce each allele in turn
+#pragma omp critical (cerr)
+            cerr << "\t" << traversal_to_string(graph, path) << endl;
+        }
     }
 
+    // Compute the lengths of all the alleles
+    set<size_t> allele_lengths;
+    for(auto& path : paths) {
+        allele_lengths.insert(traversal_to_string(graph, path).size());
+    }
+
+    // Get the affinities for all the paths
+    map<const Alignment*, vector<Genotyper::Affinity>> affinities;
+
+    if(allele_lengths.size() > 1 && realign_indels) {
+        // This is an indel, because we can change lengths. Use the slow route to do indel realignment.
+        affinities = get_affinities(augmented_graph, reads_by_name, snarl, manager, paths);
+    } else {
+        // Just use string comparison. Don't re-align when
+        // length can't change, or when indle realignment is
+        // off.
+        affinities = get_affinities_fast(augmented_graph, reads_by_name, snarl, manager, paths);
+    }
+
+    if(show_progress) {
+        // Sum up all the affinity counts by consistency flags
+        map<string, size_t> consistency_combo_counts;
+
+        // And average raw scores by alleles they are
+        // consistent with, for things consistent with just
+        // one allele.
+        vector<double> score_totals(paths.size());
+        vector<size_t> score_counts(paths.size());
+
+        for(auto& alignment_and_affinities : affinities) {
+            // For every alignment, make a string describing which alleles it is consistent with.
+            string consistency;
+
+            // How many alleles are we consstent with?
+            size_t consistent_allele_count = 0;
+            // And which one is it, if it's only one?
+            int chosen = -1;
+
+            for(size_t i = 0; i < alignment_and_affinities.second.size(); i++) {
+                auto& affinity = alignment_and_affinities.second.at(i);
+                if(affinity.consistent) {
+                    // Consistent alleles get marked with a 1
+                    consistency.push_back('1');
+
+                    // Say we're consistent with an allele
+                    chosen = i;
+                    consistent_allele_count++;
+
+                } else {
+                    // Inconsistent ones get marked with a 0
+                    consistency.push_back('0');
+                }
+            }
+
+            if(consistent_allele_count == 1) {
+                // Add in the non-normalized score for the average
+                score_totals.at(chosen) += alignment_and_affinities.second.at(chosen).score;
+                score_counts.at(chosen)++;
+            }
+
+#ifdef debug
+#pragma omp critical (cerr)
+            cerr << consistency << ": " << alignment_and_affinities.first->sequence() << endl;
+#endif
+
+
+            // Increment the count for that pattern
+            consistency_combo_counts[consistency]++;
+        }
+
+#pragma omp critical (cerr)
+        {
+            cerr << "Support patterns:" << endl;
+            for(auto& combo_and_count : consistency_combo_counts) {
+                // Spit out all the counts for all the combos
+                cerr << "\t" << combo_and_count.first << ": " << combo_and_count.second << endl;
+            }
+
+            cerr << "Average scores for unique support:" << endl;
+            for(size_t i = 0; i < score_totals.size(); i++) {
+                // Spit out average scores of uniquely supporting reads for each allele that has them.
+                if(score_counts.at(i) > 0) {
+                    cerr << "\t" << traversal_to_string(graph, paths.at(i)) << ": "
+                         << score_totals.at(i) / score_counts.at(i) << endl;
+                } else {
+                    cerr << "\t" << traversal_to_string(graph, paths.at(i)) << ": --" << endl;
+                }
+            }
+
+        }
+    }
+
+    for(auto& alignment_and_affinities : affinities) {
+#pragma omp critical (total_affinities)
+        total_affinities += alignment_and_affinities.second.size();
+    }
+
+    // Get a genotyped locus in the original frame
+    genotyped = genotype_snarl(graph, snarl, paths, affinities);
+    return true;
 }
 
 
@@ -783,9 +975,6 @@ map<const Alignment*, vector<Genotyper::Affinity>>
                               const SnarlManager& manager,
                               const vector<SnarlTraversal>& snarl_paths) {
 
-    // Grab our thread ID, which determines which aligner we get.
-    int tid = omp_get_thread_num();
-
     // We're going to build this up gradually, appending to all the vectors.
     map<const Alignment*, vector<Affinity>> to_return;
 
@@ -853,9 +1042,20 @@ map<const Alignment*, vector<Genotyper::Affinity>>
         surrounding.add_edges(aug.graph.edges_of(aug.graph.get_node(id)));
     }
 
+    // Build the graph for each snarl path once, with the path in it, and get
+    // it ready to align to. Simple DAGs are sorted up front so they can be
+    // aligned to directly; anything else goes through VG::align to be
+    // unfolded and dagified.
+    vector<VG> allele_graphs;
+    allele_graphs.reserve(snarl_paths.size());
+    vector<bool> allele_is_dag;
+    // The sequences of the paths we are trying the reads against, so we can
+    // check for identity across the snarl and not just globally for the read.
+    vector<string> path_seqs;
     for(auto& path : snarl_paths) {
         // Now for each snarl path, make a copy of that graph with it in
-        VG allele_graph(surrounding);
+        allele_graphs.emplace_back(surrounding);
+        VG& allele_graph = allele_graphs.back();
 
         for (size_t i = 0; i < path.visit_size(); i++) {
             // Add in every node on the path to the new allele graph
@@ -883,163 +1083,226 @@ map<const Alignment*, vector<Genotyper::Affinity>>
 
         // Get rid of dangling edges
         allele_graph.remove_orphan_edges();
+        
+        allele_graph.flip_doubly_reversed_edges();
+        allele_is_dag.push_back(allele_graph.is_acyclic() && !allele_graph.has_inverting_edges());
+        if (allele_is_dag.back()) {
+            algorithms::sort(&allele_graph);
+        }
 
 #ifdef debug_verbose
 #pragma omp critical (cerr)
         cerr << "Align to " << pb2json(allele_graph.graph) << endl;
 #endif
 
-        // Grab the sequence of the path we are trying the reads against, so we
-        // can check for identity across the snarl and not just globally for the
-        // read.
-        auto path_seq = traversal_to_string(aug.graph, path);
-
-        for(auto& name : relevant_read_names) {
-            // For every read that touched the ultrabubble, grab its original
-            // Alignment pointer.
-            const Alignment* read = reads_by_name.at(name);
-
-            // Look to make sure it touches more than one node actually in the
-            // ultrabubble, or a non-start, non-end node. If it just touches the
-            // start or just touches the end, it can't be informative.
-            set<id_t> touched_set;
-            // Will this read be informative?
-            bool informative = false;            
-            for(size_t i = 0; i < read->path().mapping_size(); i++) {
-                // Look at every node the read touches
-                id_t touched = read->path().mapping(i).position().node_id();
-                if(contents.first.count(aug.graph.get_node(touched))) {
-                    // If it's in the ultrabubble, keep it
-                    touched_set.insert(touched);
-                }
-            }
+        path_seqs.push_back(traversal_to_string(aug.graph, path));
+    }
+    
+    // Find the reads that are informative about this snarl. Reads with the
+    // same sequence come out the same against every allele, so we only align
+    // the first one with each sequence and copy its affinities to the rest.
+    vector<const Alignment*> informative_reads;
+    vector<size_t> aligned_as;
+    unordered_map<string, size_t> first_with_sequence;
+    for(auto& name : relevant_read_names) {
+        // For every read that touched the ultrabubble, grab its original
+        // Alignment pointer.
+        const Alignment* read = reads_by_name.at(name);
 
-            if(touched_set.size() >= 2) {
-                // We touch both the start and end, or an internal node.
-                informative = true;
-            } else {
-                // Throw out the start and end nodes, if we touched them.
-                touched_set.erase(snarl->start().node_id());
-                touched_set.erase(snarl->end().node_id());
-                if(!touched_set.empty()) {
-                    // We touch an internal node
-                    informative = true;
-                }
+        // Look to make sure it touches more than one node actually in the
+        // ultrabubble, or a non-start, non-end node. If it just touches the
+        // start or just touches the end, it can't be informative.
+        set<id_t> touched_set;
+        // Will this read be informative?
+        bool informative = false;            
+        for(size_t i = 0; i < read->path().mapping_size(); i++) {
+            // Look at every node the read touches
+            id_t touched = read->path().mapping(i).position().node_id();
+            if(contents.first.count(aug.graph.get_node(touched))) {
+                // If it's in the ultrabubble, keep it
+                touched_set.insert(touched);
             }
+        }
 
-            if(!informative) {
-                // We only touch one of the start and end nodes, and can say nothing about the ultrabubble. Try the next read.
-                // TODO: mark these as ambiguous/consistent with everything (but strand?)
-                continue;
+        if(touched_set.size() >= 2) {
+            // We touch both the start and end, or an internal node.
+            informative = true;
+        } else {
+            // Throw out the start and end nodes, if we touched them.
+            touched_set.erase(snarl->start().node_id());
+            touched_set.erase(snarl->end().node_id());
+            if(!touched_set.empty()) {
+                // We touch an internal node
+                informative = true;
             }
+        }
 
-            // If we get here, we know this read is informative as to the internal status of this ultrabubble.
-            Alignment aligned_fwd;
-            Alignment aligned_rev;
-            // We need a way to get graph node sizes to reverse these alignments
-            auto get_node_size = [&](id_t id) {
-                return aug.graph.get_node(id)->sequence().size();
-            };
-            if(read->sequence().size() == read->quality().size()) {
-                // Re-align a copy to this graph (using quality-adjusted alignment).
-                // TODO: actually use quality-adjusted alignment
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
-            } else {
-                // If we don't have the right number of quality scores, use un-adjusted alignment instead.
-                aligned_fwd = allele_graph.align(*read);
-                aligned_rev = allele_graph.align(reverse_complement_alignment(*read, get_node_size));
-            }
-            // Pick the best alignment, and emit in original orientation
-            Alignment aligned = (aligned_rev.score() > aligned_fwd.score()) ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
+        if(!informative) {
+            // We only touch one of the start and end nodes, and can say nothing about the ultrabubble. Try the next read.
+            // TODO: mark these as ambiguous/consistent with everything (but strand?)
+            continue;
+        }
+        
+        // We score differently depending on whether we have qualities
+        string key = read->sequence();
+        key.push_back(read->sequence().size() == read->quality().size() ? 'Q' : '-');
+        auto found = first_with_sequence.find(key);
+        if (found == first_with_sequence.end()) {
+            found = first_with_sequence.emplace(key, informative_reads.size()).first;
+        }
+        aligned_as.push_back(found->second);
+        informative_reads.push_back(read);
+    }
+    
+    // We need a way to get graph node sizes to reverse these alignments
+    auto get_node_size = [&](id_t id) {
+        return aug.graph.get_node(id)->sequence().size();
+    };
+    
+    // Work out the affinity of a read for an allele, aligning to the given
+    // graph
+    auto get_affinity = [&](const Alignment* read, size_t allele, const function<Alignment(const Alignment&)>& align) {
+        const string& path_seq = path_seqs[allele];
+        
+        // If we get here, we know this read is informative as to the internal status of this ultrabubble.
+        // Re-align a copy to this graph. TODO: actually use quality-adjusted
+        // alignment when we have the right number of quality scores.
+        Alignment aligned_fwd = align(*read);
+        Alignment aligned_rev = align(reverse_complement_alignment(*read, get_node_size));
+        // Pick the best alignment, and emit in original orientation
+        Alignment aligned = (aligned_rev.score() > aligned_fwd.score()) ? reverse_complement_alignment(aligned_rev, get_node_size) : aligned_fwd;
 
 #ifdef debug
 #pragma omp critical (cerr)
-            cerr << path_seq << " vs " << aligned.sequence() << ": " << aligned.score() << endl;
+        cerr << path_seq << " vs " << aligned.sequence() << ": " << aligned.score() << endl;
 
 #endif
 
 #ifdef debug_verbose
 #pragma omp critical (cerr)
-            cerr << "\t" << pb2json(aligned) << endl;
+        cerr << "\t" << pb2json(aligned) << endl;
 #endif
 
-            // Compute the score per base. TODO: is this at all comparable
-            // between quality-adjusted and non-quality-adjusted reads?
-            double score_per_base = (double)aligned.score() / aligned.sequence().size();
+        // Compute the score per base. TODO: is this at all comparable
+        // between quality-adjusted and non-quality-adjusted reads?
+        double score_per_base = (double)aligned.score() / aligned.sequence().size();
 
-            // Save the score (normed per read base) and orientation
-            // We'll normalize the affinities later to enforce the max of 1.0.
-            Affinity affinity(score_per_base, aligned_rev.score() > aligned_fwd.score());
+        // Save the score (normed per read base) and orientation
+        // We'll normalize the affinities later to enforce the max of 1.0.
+        Affinity affinity(score_per_base, aligned_rev.score() > aligned_fwd.score());
 
-            // Compute the unnormalized likelihood of the read given the allele graph.
-            if(read->sequence().size() == read->quality().size()) {
-                // Use the quality-adjusted default scoring system
-                affinity.likelihood_ln = quality_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
-            } else {
-                // We will have aligned without quality adjustment, so interpret
-                // score in terms of the normal scoring parameters.
-                affinity.likelihood_ln = normal_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
-            }
+        // Compute the unnormalized likelihood of the read given the allele graph.
+        if(read->sequence().size() == read->quality().size()) {
+            // Use the quality-adjusted default scoring system
+            affinity.likelihood_ln = quality_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
+        } else {
+            // We will have aligned without quality adjustment, so interpret
+            // score in terms of the normal scoring parameters.
+            affinity.likelihood_ln = normal_aligner.score_to_unnormalized_likelihood_ln(aligned.score());
+        }
 
-            // Get the NodeTraversals for the winning alignment through the snarl.
-            auto read_traversal = get_traversal_of_snarl(aug.graph, snarl, manager, aligned.path());
-
-            if(affinity.is_reverse) {
-                // We really traversed this snarl backward. Flip it around.
-                std::reverse(read_traversal.mutable_visit()->begin(), read_traversal.mutable_visit()->end());
-                for (size_t i = 0; i < read_traversal.visit_size(); i++) {
-                    // Flip around every traversal as well as reversing their order.
-                    read_traversal.mutable_visit(i)->set_backward(!read_traversal.visit(i).backward());
-                }
+        // Get the NodeTraversals for the winning alignment through the snarl.
+        auto read_traversal = get_traversal_of_snarl(aug.graph, snarl, manager, aligned.path());
 
+        if(affinity.is_reverse) {
+            // We really traversed this snarl backward. Flip it around.
+            std::reverse(read_traversal.mutable_visit()->begin(), read_traversal.mutable_visit()->end());
+            for (size_t i = 0; i < read_traversal.visit_size(); i++) {
+                // Flip around every traversal as well as reversing their order.
+                read_traversal.mutable_visit(i)->set_backward(!read_traversal.visit(i).backward());
             }
 
-            // Decide we're consistent if the alignment's string across the snarl
-            // matches the string for the allele, anchored at the appropriate
-            // ends.
+        }
 
-            // Get the string this read spells out in its best alignment to this allele
-            auto seq = traversal_to_string(aug.graph, read_traversal);
+        // Decide we're consistent if the alignment's string across the snarl
+        // matches the string for the allele, anchored at the appropriate
+        // ends.
 
-            // Now decide if the read's seq supports this path.
-            if(read_traversal.visit(0) == snarl->start() &&
-               read_traversal.visit(read_traversal.visit_size() - 1) == snarl->end()) {
-                // Anchored at both ends.
-                // Need an exact match. Record if we have one or not.
-                affinity.consistent = (seq == path_seq);
-            } else if(read_traversal.visit(0) == snarl->start()) {
-                // Anchored at start only.
-                // seq needs to be a prefix of path_seq
-                auto difference = std::mismatch(seq.begin(), seq.end(), path_seq.begin());
-                // If the first difference is the past-the-end of the prefix, then it's a prefix
-                affinity.consistent = (difference.first == seq.end());
-            } else if(read_traversal.visit(read_traversal.visit_size() - 1) == snarl->end()) {
-                // Anchored at end only.
-                // seq needs to be a suffix of path_seq
-                auto difference = std::mismatch(seq.rbegin(), seq.rend(), path_seq.rbegin());
-                // If the first difference is the past-the-rend of the suffix, then it's a suffix
-                affinity.consistent = (difference.first == seq.rend());
-            } else {
-                // This read doesn't touch either end. This might happen if the
-                // snarl is very large. Just assume it's consistent and let
-                // scoring work it out.
-#pragma omp critical (cerr)
-                cerr << "Warning: realigned read " << aligned.sequence() << " doesn't touch either end of its snarl!" << endl;
-                affinity.consistent = true;
-            }
-
-            if(score_per_base < min_score_per_base) {
-                // Say we can't really be consistent with this if we have such a
-                // terrible score.
-                affinity.consistent = false;
-            }
+        // Get the string this read spells out in its best alignment to this allele
+        auto seq = traversal_to_string(aug.graph, read_traversal);
 
-            // Grab the identity and save it for this read and ultrabubble path
-            to_return[read].push_back(affinity);
+        // Now decide if the read's seq supports this path.
+        if(read_traversal.visit(0) == snarl->start() &&
+           read_traversal.visit(read_traversal.visit_size() - 1) == snarl->end()) {
+            // Anchored at both ends.
+            // Need an exact match. Record if we have one or not.
+            affinity.consistent = (seq == path_seq);
+        } else if(read_traversal.visit(0) == snarl->start()) {
+            // Anchored at start only.
+            // seq needs to be a prefix of path_seq
+            auto difference = std::mismatch(seq.begin(), seq.end(), path_seq.begin());
+            // If the first difference is the past-the-end of the prefix, then it's a prefix
+            affinity.consistent = (difference.first == seq.end());
+        } else if(read_traversal.visit(read_traversal.visit_size() - 1) == snarl->end()) {
+            // Anchored at end only.
+            // seq needs to be a suffix of path_seq
+            auto difference = std::mismatch(seq.rbegin(), seq.rend(), path_seq.rbegin());
+            // If the first difference is the past-the-rend of the suffix, then it's a suffix
+            affinity.consistent = (difference.first == seq.rend());
+        } else {
+            // This read doesn't touch either end. This might happen if the
+            // snarl is very large. Just assume it's consistent and let
+            // scoring work it out.
+#pragma omp critical (cerr)
+            cerr << "Warning: realigned read " << aligned.sequence() << " doesn't touch either end of its snarl!" << endl;
+            affinity.consistent = true;
+        }
 
+        if(score_per_base < min_score_per_base) {
+            // Say we can't really be consistent with this if we have such a
+            // terrible score.
+            affinity.consistent = false;
+        }
+        
+        return affinity;
+    };
+    
+    // Align the distinct reads in parallel. Each thread gets its own gssw
+    // graph for each allele, made the first time it needs it, since they
+    // hold the DP state, and its own copy of any allele graph that VG::align
+    // has to rearrange.
+    vector<size_t> to_align;
+    for (size_t i = 0; i < informative_reads.size(); i++) {
+        if (aligned_as[i] == i) {
+            to_align.push_back(i);
+        }
+    }
+    vector<vector<Affinity>> read_affinities(informative_reads.size());
+    int thread_count = omp_get_max_threads();
+    vector<vector<unique_ptr<AlignableGraph>>> thread_alignables(thread_count);
+    vector<vector<unique_ptr<VG>>> thread_allele_graphs(thread_count);
+#pragma omp parallel for schedule(dynamic, 1) if(to_align.size() > 1)
+    for (size_t j = 0; j < to_align.size(); j++) {
+        size_t i = to_align[j];
+        int tid = omp_get_thread_num();
+        auto& alignables = thread_alignables[tid];
+        auto& copies = thread_allele_graphs[tid];
+        alignables.resize(allele_graphs.size());
+        copies.resize(allele_graphs.size());
+        
+        for (size_t allele = 0; allele < allele_graphs.size(); allele++) {
+            read_affinities[i].push_back(get_affinity(informative_reads[i], allele, [&](const Alignment& aln) -> Alignment {
+                if (allele_is_dag[allele]) {
+                    if (!alignables[allele]) {
+                        alignables[allele] = unique_ptr<AlignableGraph>(new AlignableGraph(allele_graphs[allele].graph));
+                    }
+                    Alignment aligned = aln;
+                    normal_aligner.align(aligned, *alignables[allele], true, false);
+                    return aligned;
+                } else {
+                    if (!copies[allele]) {
+                        copies[allele] = unique_ptr<VG>(new VG(allele_graphs[allele]));
+                    }
+                    return copies[allele]->align(aln, &normal_aligner);
+                }
+            }));
         }
     }
+    
+    for (size_t i = 0; i < informative_reads.size(); i++) {
+        // Grab the identity and save it for this read and ultrabubble path
+        to_return[informative_reads[i]] = read_affinities[aligned_as[i]];
+    }
 
     for(auto& name : relevant_read_names) {
         // For every read that touched the ultrabubble, mark it consistent only
@@ -1128,6 +1391,10 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
         // TODO: We populate relevant_read_names and then get the alignments by
         // name. Maybe we can just use alignment pointers?
     }
+    
+    // Reads that take the same walk through the snarl on the same strand have
+    // the same affinities, so keep them by walk rather than respelling it
+    unordered_map<string, vector<Affinity>> affinities_by_traversal;
 
     for(auto name : relevant_read_names) {
         // For each relevant read, work out a string for the ultrabubble and whether
@@ -1168,6 +1435,22 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
 
             continue;
         }
+        
+        string traversal_key(1, base_affinity.is_reverse ? '-' : '+');
+        for (auto& visit : read_traversal.visit()) {
+            if (visit.node_id() != 0) {
+                traversal_key += to_string(visit.node_id());
+            } else {
+                // a visit to a child snarl
+                traversal_key += "s" + to_string(visit.snarl().start().node_id()) + "_" + to_string(visit.snarl().end().node_id());
+            }
+            traversal_key.push_back(visit.backward() ? '<' : '>');
+        }
+        auto cached = affinities_by_traversal.find(traversal_key);
+        if (cached != affinities_by_traversal.end()) {
+            to_return[reads_by_name.at(name)] = cached->second;
+            continue;
+        }
 
         size_t total_supported = 0;
 
@@ -1227,6 +1510,8 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
 #pragma omp critical (cerr)
             cerr << "Warning! Bubble sequence " << seq << " supports nothing!" << endl;
         }
+        
+        affinities_by_traversal[traversal_key] = to_return[reads_by_name.at(name)];
 
 
     }
@@ -1238,6 +1523,59 @@ Genotyper::get_affinities_fast(AugmentedGraph& aug,
 }
 
 double Genotyper::get_genotype_log_likelihood(VG& graph, const Snarl* snarl, const vector<int>& genotype, const vector<pair<const Alignment*, vector<Affinity>>>& alignment_consistency) {
+    // Find out how many alleles we have support data for
+    size_t allele_count = 0;
+    for (int allele : genotype) {
+        allele_count = max(allele_count, (size_t) allele + 1);
+    }
+    for (auto& read_and_consistency : alignment_consistency) {
+        allele_count = max(allele_count, read_and_consistency.second.size());
+    }
+    return get_genotype_log_likelihood(genotype, get_snarl_read_terms(graph, snarl, allele_count, alignment_consistency));
+}
+
+Genotyper::SnarlReadTerms Genotyper::get_snarl_read_terms(VG& graph, const Snarl* snarl, size_t allele_count,
+                                                          const vector<pair<const Alignment*, vector<Affinity>>>& alignment_consistency) {
+    SnarlReadTerms terms;
+    terms.read_count = alignment_consistency.size();
+    terms.consistent.assign(allele_count, vector<uint8_t>(terms.read_count, 0));
+    terms.consistent_reverse.assign(allele_count, vector<uint8_t>(terms.read_count, 0));
+    terms.logprob_wrong.resize(terms.read_count);
+    
+    for (size_t i = 0; i < alignment_consistency.size(); i++) {
+        auto& read = *alignment_consistency[i].first;
+        auto& consistency = alignment_consistency[i].second;
+        
+        // Reads with no consistency info calculated for an allele count as
+        // inconsistent with it
+        for (size_t allele = 0; allele < consistency.size() && allele < allele_count; allele++) {
+            if (consistency[allele].consistent) {
+                terms.consistent[allele][i] = 1;
+                terms.consistent_reverse[allele][i] = consistency[allele].is_reverse;
+            }
+        }
+        
+        auto read_qual = alignment_qual_score(graph, snarl, read);
+        
+        if(use_mapq) {
+            // Compute P(mapped wrong or called wrong) = P(not (mapped right and called right)) = P(not (not mapped wrong and not called wrong))
+            terms.logprob_wrong[i] = logprob_invert(logprob_invert(phred_to_logprob(read.mapping_quality())) +
+                                                    logprob_invert(phred_to_logprob(read_qual)));
+        } else {
+            // Compute P(called wrong).
+            terms.logprob_wrong[i] = phred_to_logprob(read_qual);
+        }
+        
+#ifdef debug
+#pragma omp critical (cerr)
+        cerr << "Read (qual score " << read_qual << ") has P(wrong) = " << logprob_to_prob(terms.logprob_wrong[i]) << endl;
+#endif
+    }
+    
+    return terms;
+}
+
+double Genotyper::get_genotype_log_likelihood(const vector<int>& genotype, const SnarlReadTerms& terms) {
     // For each genotype, calculate P(observed reads | genotype) as P(all reads
     // that don't support an allele from the genotype are mismapped or
     // miscalled) * P(all reads that do support alleles from the genotype ended
@@ -1262,111 +1600,62 @@ double Genotyper::get_genotype_log_likelihood(VG& graph, const Snarl* snarl, con
         cerr << "Calculating P(a" << genotype[0] << "/a" << genotype[1] << ")" << endl;
     }
 #endif
-
-    // We want to keep count of how many reads support each allele in each
-    // orientation. TODO: we might be sort of double-counting reads that support
-    // multiple alleles, because we'll be treating them as having independent
-    // orientations per allele, when really they're very likely to be oriented
-    // the same way.
-
-    // Maps from int allele number (as appears in Genotype) to total reads
-    // forward and reverse giving support.
-    map<int, pair<int, int>> strand_count_by_allele_and_orientation;
-
-    for(auto& read_and_consistency : alignment_consistency) {
-        // For each read, work out if it supports a genotype we have or not.
-
-        // Split out the alignment from its consistency flags
-        auto& read = *read_and_consistency.first;
-        auto& consistency = read_and_consistency.second;
-
-        // How many of the alleles in our genotype is it consistent with?
-        int consistent_alleles = 0;
-        // We only count each allele in the genotype once.
-        set<int> alleles_seen;
-        for(int allele : genotype) {
-            if(alleles_seen.count(allele)) {
-                // Counted up consistency with this allele already.
-                continue;
-            }
-            alleles_seen.insert(allele);
-
-            // For each unique allele in the genotype...
-
-            if(consistency.size() > allele && consistency.at(allele).consistent) {
-                // We're consistent with this allele
-                consistent_alleles++;
-            }
-        }
-        
-        // Now we know how many alleles this read is consistent with.
-        
-        if (consistent_alleles == 1) {
-            // If it supports exactly one allele, we add it to the per-strand support counts for that allele
-            for(int allele : genotype) {
-                if(consistency.size() > allele && consistency.at(allele).consistent) {
-                    // We found the consustent allele again.
-                    
-                    if(consistency.at(allele).is_reverse) {
-                        // Consistent with reverse
-                        strand_count_by_allele_and_orientation[allele].second++;
-                        break;
-                    } else {
-                        // Consistent with forward
-                        strand_count_by_allele_and_orientation[allele].first++;
-                        break;
-                    }
-                }
-            }
+    
+    // The distinct alleles in the genotype, in order, that we have support
+    // data for. Reads are inconsistent with any others.
+    size_t allele_count = terms.consistent.size();
+    vector<int> unique_genotype_alleles;
+    for (int allele : genotype) {
+        if (allele >= 0 && allele < allele_count &&
+            find(unique_genotype_alleles.begin(), unique_genotype_alleles.end(), allele) == unique_genotype_alleles.end()) {
+            unique_genotype_alleles.push_back(allele);
         }
+    }
+    sort(unique_genotype_alleles.begin(), unique_genotype_alleles.end());
 
-        auto read_qual = alignment_qual_score(graph, snarl, read);
-
-#ifdef debug
-#pragma omp critical (cerr)
-        cerr << "Read (qual score " << read_qual << ") consistent with " << consistent_alleles
-             << " genotype alleles observed." << endl;
-#endif
-
-        if(consistent_alleles == 0) {
-            // This read is inconsistent with all the alleles in the genotype,
-            // so, given the genotype, the read must be sequenced or mapped
-            // wrong.
-
-            double logprob_wrong;
-            if(use_mapq) {
-                // Compute P(mapped wrong or called wrong) = P(not (mapped right and called right)) = P(not (not mapped wrong and not called wrong))
-                logprob_wrong = logprob_invert(logprob_invert(phred_to_logprob(read.mapping_quality())) +
-                                               logprob_invert(phred_to_logprob(read_qual)));
-            } else {
-                // Compute P(called wrong).
-                logprob_wrong = phred_to_logprob(read_qual);
-            }
-
-#ifdef debug
-#pragma omp critical (cerr)
-            cerr << "P(wrong) = " << logprob_to_prob(logprob_wrong) << endl;
-#endif
-            all_non_supporting_wrong += logprob_wrong;
-        } else {
-            // This read is consistent with some of the alleles in the genotype,
-            // so we must have drawn one of those alleles when sequencing.
-
-            // We account for this in a framework where we consider the reads
-            // indistinguishable, so ignore it for now.
+    // How many of the alleles in our genotype each read is consistent with,
+    // counting each allele in the genotype once.
+    vector<uint8_t> consistent_alleles(terms.read_count, 0);
+    for (int allele : unique_genotype_alleles) {
+        const uint8_t* consistent = terms.consistent[allele].data();
+        for (size_t i = 0; i < terms.read_count; i++) {
+            consistent_alleles[i] += consistent[i];
+        }
+    }
+    
+    // Reads inconsistent with all the alleles in the genotype must, given
+    // the genotype, be sequenced or mapped wrong. Reads consistent with some
+    // of them are accounted for below, where we consider the reads
+    // indistinguishable.
+    for (size_t i = 0; i < terms.read_count; i++) {
+        if (consistent_alleles[i] == 0) {
+            all_non_supporting_wrong += terms.logprob_wrong[i];
         }
-
     }
 
     // Multiply in in the probability that the supporting reads all came from
-    // the strands they are on.
+    // the strands they are on. We count how many reads support each allele in
+    // each orientation, using only the reads that support exactly one allele.
+    // TODO: reads that support multiple alleles would be counted as having
+    // independent orientations per allele, when really they're very likely
+    // to be oriented the same way.
     double strands_as_specified = prob_to_logprob(1);
     // Each strand is equally likely
     vector<double> probs_by_orientation = {0.5, 0.5};
-    for(auto& kv : strand_count_by_allele_and_orientation) {
-        // For the forward and reverse strand counts for all the alleles
-        auto& forward_count = kv.second.first;
-        auto& reverse_count = kv.second.second;
+    for (int allele : unique_genotype_alleles) {
+        const uint8_t* consistent = terms.consistent[allele].data();
+        const uint8_t* consistent_reverse = terms.consistent_reverse[allele].data();
+        int forward_count = 0;
+        int reverse_count = 0;
+        for (size_t i = 0; i < terms.read_count; i++) {
+            int unique_support = consistent[i] & (consistent_alleles[i] == 1);
+            reverse_count += unique_support & consistent_reverse[i];
+            forward_count += unique_support & !consistent_reverse[i];
+        }
+        if (forward_count == 0 && reverse_count == 0) {
+            // No reads support only this allele
+            continue;
+        }
 
         // Convert to a vector to satisfy the multinomial PMF function.
         vector<int> obs = {forward_count, reverse_count};
@@ -1381,12 +1670,10 @@ double Genotyper::get_genotype_log_likelihood(VG& graph, const Snarl* snarl, con
 
 #ifdef debug
 #pragma omp critical (cerr)
-        cerr << "Allele "  << kv.first << " supported by " << forward_count << " forward, "
+        cerr << "Allele "  << allele << " supported by " << forward_count << " forward, "
              << reverse_count << " reverse (P=" << logprob_to_prob(logprob) << ")" << endl;
 #endif
         strands_as_specified += logprob;
-
-
     }
 
     // Multiply in probability that the reads came from alleles they support,
@@ -1411,39 +1698,30 @@ double Genotyper::get_genotype_log_likelihood(VG& graph, const Snarl* snarl, con
         int ambiguous_reads = 0;
         // And how many total reads there are (# of trials).
         int total_reads = 0;
-
-        for(auto& read_and_consistency : alignment_consistency) {
-            auto& consistency = read_and_consistency.second;
-
-            if(consistency.size() <= max(genotype.at(0), genotype.at(1))) {
-                // No consistency info calculated for this useless uninformative
-                // read.
-                continue;
+        
+        // Reads with no consistency info for an allele are inconsistent with it
+        static const vector<uint8_t> no_support;
+        auto allele_support = [&](int allele) -> const vector<uint8_t>& {
+            return allele >= 0 && allele < allele_count ? terms.consistent[allele] : no_support;
+        };
+        const vector<uint8_t>& first = allele_support(genotype.at(0));
+        const vector<uint8_t>& second = allele_support(genotype.at(1));
+        if (!first.empty() && !second.empty()) {
+            for (size_t i = 0; i < terms.read_count; i++) {
+                ambiguous_reads += first[i] & second[i];
+                first_only_reads += first[i] & !second[i];
+                // Don't count reads inconsistent with the genotype in this analysis.
+                total_reads += first[i] | second[i];
             }
-
-            if(consistency.at(genotype.at(0)).consistent) {
-                // Read is consistent with first allele
-                if(consistency.at(genotype.at(1)).consistent) {
-                    // And also second, so it's ambiguous
-                    ambiguous_reads++;
-#ifdef debug
-#pragma omp critical (cerr)
-                    cerr << "Ambiguous read: " << read_and_consistency.first->sequence() << endl;
-                    for(int i = 0; i < consistency.size(); i++) {
-#pragma omp critical (cerr)
-                        cerr << "\t" << i << ": " << consistency[i].consistent << endl;
-                    }
-#endif
-                } else {
-                    // And only first allele
-                    first_only_reads++;
-                }
-                total_reads++;
-            } else if(consistency.at(genotype.at(1)).consistent) {
-                // It's consistent with only the second allele.
-                total_reads++;
+        } else if (!first.empty() || !second.empty()) {
+            // Only one allele has any consistent reads
+            const vector<uint8_t>& supported = first.empty() ? second : first;
+            for (size_t i = 0; i < terms.read_count; i++) {
+                total_reads += supported[i];
+            }
+            if (!first.empty()) {
+                first_only_reads = total_reads;
             }
-            // Don't count reads inconsistent with the genotype in this analysis.
         }
 
         // Now do the likelihood. We know each atom will be weighted by the same
@@ -1492,7 +1770,7 @@ double Genotyper::get_genotype_log_likelihood(VG& graph, const Snarl* snarl, con
         
         // We'll put unique alleles in this set and store the total probability
         // of each under it.
-        unordered_map<int, double> unique_alleles;
+        map<int, double> unique_alleles;
         
         for (auto& allele : genotype) {
             unique_alleles[allele] += per_allele_prob;
@@ -1500,27 +1778,29 @@ double Genotyper::get_genotype_log_likelihood(VG& graph, const Snarl* snarl, con
         
         // Now convert to probs format (vector)
         vector<double> probs;
+        // And collect the consistency of the reads with each, in the same
+        // order, with nothing for alleles we have no support data for
+        vector<const uint8_t*> allele_consistency;
         for (auto& kv : unique_alleles) {
             // For each allele in whatever order the set gave them, put in the probability.
             probs.push_back(kv.second);
+            allele_consistency.push_back(kv.first >= 0 && kv.first < allele_count ? terms.consistent[kv.first].data() : nullptr);
         }
         
         // Now we will assign reads to ambiguity classes and count them in here.
-        unordered_map<vector<bool>, int> reads_by_class;
+        // The classes are packed as bitmasks over the unique alleles, of which
+        // there are at most as many as the ploidy.
+        assert(allele_consistency.size() <= 64);
+        unordered_map<uint64_t, int> reads_by_class;
         
-        for(auto& read_and_consistency : alignment_consistency) {
-            // For each read, look at what it is consistent with
-            auto& consistency = read_and_consistency.second;
-            
-            // Compute an ambiguity class for it
-            vector<bool> ambiguity_class;
-
-            for (auto& kv : unique_alleles) {
-                // For each unique allele number in the genotype, in their assigned order
-                const auto& allele_number = kv.first;
-                
-                // Add the consistency bit for this read against this allele to the class
-                ambiguity_class.push_back(consistency.at(allele_number).consistent);
+        for (size_t i = 0; i < terms.read_count; i++) {
+            // Compute an ambiguity class for each read from the consistency
+            // bit for this read against each unique allele
+            uint64_t ambiguity_class = 0;
+            for (size_t j = 0; j < allele_consistency.size(); j++) {
+                if (allele_consistency[j] != nullptr && allele_consistency[j][i]) {
+                    ambiguity_class |= (uint64_t) 1 << j;
+                }
             }
             
             // Count the read as being in its class.
@@ -1816,6 +2096,9 @@ Locus Genotyper::genotype_snarl(VG& graph,
     // We'll go through all the genotypes, fill in their probabilities, put them
     // in here, and then sort them to find the best.
     vector<Genotype> genotypes_sorted;
+    
+    // Work out everything about the reads that doesn't depend on the genotype once
+    SnarlReadTerms read_terms = get_snarl_read_terms(graph, snarl, snarl_paths.size(), alignment_consistency);
 
     for(int allele1 = 0; allele1 < snarl_paths.size(); allele1++) {
         // For each first allele in the genotype
@@ -1826,7 +2109,7 @@ Locus Genotyper::genotype_snarl(VG& graph,
             vector<int> genotype_vector = {allele1, allele2};
 
             // Compute the log probability of the data given the genotype
-            double log_likelihood = get_genotype_log_likelihood(graph, snarl, genotype_vector, alignment_consistency);
+            double log_likelihood = get_genotype_log_likelihood(genotype_vector, read_terms);
 
             // Compute the prior
             double log_prior = get_genotype_log_prior(genotype_vector);
@@ -26,6 +26,7 @@
 #include "srpe.hpp"
 #include "path_index.hpp"
 #include "index.hpp"
+#include "gam_index.hpp"
 #include "distributions.hpp"
 
 namespace vg {
@@ -64,6 +65,22 @@ public:
         }
         
     };
+    
+    /**
+     * The parts of the genotype likelihoods of a snarl that depend only on
+     * the reads, worked out once for all the genotypes. Consistency is kept
+     * allele by allele in flat arrays over the reads, so each genotype's
+     * likelihood is a few passes over contiguous memory.
+     */
+    struct SnarlReadTerms {
+        size_t read_count = 0;
+        // For each allele, 1 for each read consistent with it, and 0 otherwise
+        vector<vector<uint8_t>> consistent;
+        // For each allele, 1 for each read consistent with it on the reverse strand
+        vector<vector<uint8_t>> consistent_reverse;
+        // For each read, the log probability that it was sequenced or mapped wrong
+        vector<double> logprob_wrong;
+    };
 
 
 
@@ -158,6 +175,40 @@ public:
              bool output_json = false,
              int length_override = 0,
              int variant_offset = 0);
+
+    /**
+     * Genotype the ultrabubbles on the reference path in reference order,
+     * writing VCF to out, without holding all the reads in memory. The graph
+     * must already be augmented with the reads' edits, and must have no
+     * reads embedded. Reads come from the sorted, blocked GAM on gam_in via
+     * its GAMIndex: the ultrabubbles are taken in windows of window_bases of
+     * reference, only the reads touching each window are embedded while it
+     * is genotyped, and each window's records are written as soon as it is
+     * done. Snarls within a window are genotyped in parallel.
+     */
+    void run_streaming(AugmentedGraph& graph,
+                       istream& gam_in,
+                       const GAMIndex& gam_index,
+                       ostream& out,
+                       string ref_path_name,
+                       string contig_name = "",
+                       string sample_name = "",
+                       bool show_progress = false,
+                       int length_override = 0,
+                       int variant_offset = 0,
+                       size_t window_bases = 100000);
+
+    /**
+     * Find the alleles of the given snarl supported by named paths and by the
+     * reads embedded in the AugmentedGraph, and genotype it with those reads.
+     * Puts the result in genotyped and returns true, or returns false if the
+     * snarl has no alleles. Adds the number of affinities computed to
+     * total_affinities.
+     */
+    bool genotype_snarl_from_reads(AugmentedGraph& augmented_graph, SnarlManager& manager,
+                                   const map<string, const Alignment*>& reads_by_name,
+                                   const Snarl* snarl, bool show_progress,
+                                   size_t& total_affinities, Locus& genotyped);
     
     /**
      * Given an Alignment and a Snarl, compute a phred score for the quality of
@@ -254,6 +305,22 @@ public:
      */
     double get_genotype_log_likelihood(VG& graph, const Snarl* snarl, const vector<int>& genotype, const vector<pair<const Alignment*, vector<Affinity>>>& alignment_consistency);
     
+    /**
+     * Work out the per-read terms of the genotype likelihoods for a snarl with
+     * the given number of alleles, from the same support data as
+     * get_genotype_log_likelihood.
+     */
+    SnarlReadTerms get_snarl_read_terms(VG& graph, const Snarl* snarl, size_t allele_count,
+                                        const vector<pair<const Alignment*, vector<Affinity>>>& alignment_consistency);
+    
+    /**
+     * Compute the probability of the observed alignments given the genotype,
+     * as above, from the snarl's precomputed per-read terms.
+     *
+     * Returns a natural log likelihood.
+     */
+    double get_genotype_log_likelihood(const vector<int>& genotype, const SnarlReadTerms& terms);
+    
     /**
      * Compute the prior probability of the given genotype.
      *
@@ -0,0 +1,185 @@
+#include "gfa.hpp"
+#include "stream.hpp"
+#include "utility.hpp"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/// Split a GFA line into its tab-separated fields
+static vector<string> split_fields(const string& line) {
+    vector<string> fields;
+    size_t start = 0;
+    while (start <= line.size()) {
+        size_t end = line.find('\t', start);
+        if (end == string::npos) {
+            end = line.size();
+        }
+        fields.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    return fields;
+}
+
+size_t gfa_to_graph_callback(istream& in, const function<void(Graph&)>& lambda, size_t chunk_size) {
+
+    // Name segments the way VG::from_gfa does
+    id_t next_id = 1;
+    unordered_map<string, id_t> id_names;
+    auto get_id = [&](const string& name) -> id_t {
+        if (is_number(name)) {
+            return stol(name);
+        }
+        auto found = id_names.find(name);
+        if (found == id_names.end()) {
+            id_names[name] = next_id;
+            return next_id++;
+        }
+        return found->second;
+    };
+
+    Graph chunk;
+    size_t buffered = 0;
+    // Count an item in the current chunk, and send the chunk if it is full.
+    // Returns true if a new chunk was started.
+    auto count_item = [&]() -> bool {
+        if (++buffered >= chunk_size) {
+            lambda(chunk);
+            chunk.Clear();
+            buffered = 0;
+            return true;
+        }
+        return false;
+    };
+
+    size_t overlaps = 0;
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        vector<string> fields = split_fields(line);
+        if (fields[0] == "S" && fields.size() >= 3) {
+            Node* node = chunk.add_node();
+            node->set_id(get_id(fields[1]));
+            node->set_sequence(fields[2]);
+            node->set_name(fields[1]);
+            count_item();
+        } else if (fields[0] == "L" && fields.size() >= 6) {
+            Edge* edge = chunk.add_edge();
+            edge->set_from(get_id(fields[1]));
+            edge->set_from_start(fields[2] == "-");
+            edge->set_to(get_id(fields[3]));
+            edge->set_to_end(fields[4] == "-");
+            // Only a single match is an overlap we can represent
+            const string& cigar = fields[5];
+            if (cigar.size() > 1 && cigar.back() == 'M' && is_number(cigar.substr(0, cigar.size() - 1))) {
+                size_t overlap = stoull(cigar.substr(0, cigar.size() - 1));
+                if (overlap > 0) {
+                    edge->set_overlap(overlap);
+                    overlaps++;
+                }
+            }
+            count_item();
+        } else if (fields[0] == "P" && fields.size() >= 3) {
+            // Walk the steps in place; a P line can be huge
+            const string& steps = fields[2];
+            Path* path = nullptr;
+            size_t rank = 1;
+            size_t start = 0;
+            while (start < steps.size()) {
+                size_t end = steps.find(',', start);
+                if (end == string::npos) {
+                    end = steps.size();
+                }
+                if (end - start < 2) {
+                    cerr << "error:[vg::gfa_to_graph_stream] bad step in path " << fields[1] << endl;
+                    exit(1);
+                }
+                if (path == nullptr) {
+                    path = chunk.add_path();
+                    path->set_name(fields[1]);
+                }
+                Mapping* mapping = path->add_mapping();
+                mapping->mutable_position()->set_node_id(get_id(steps.substr(start, end - start - 1)));
+                mapping->mutable_position()->set_is_reverse(steps[end - 1] == '-');
+                mapping->set_rank(rank++);
+                if (count_item()) {
+                    // The rest of the path goes in the new chunk
+                    path = nullptr;
+                }
+                start = end + 1;
+            }
+        }
+        // Headers and other record types have nothing we keep
+    }
+
+    if (buffered > 0) {
+        lambda(chunk);
+    }
+
+    return overlaps;
+}
+
+size_t gfa_to_graph_stream(istream& in, ostream& out, size_t chunk_size) {
+    vector<Graph> buffer;
+    return gfa_to_graph_callback(in, [&](Graph& chunk) {
+        buffer.push_back(chunk);
+        stream::write_buffered(out, buffer, 0);
+    }, chunk_size);
+}
+
+void graph_stream_to_gfa(istream& in, ostream& out) {
+    out << "H\tVN:Z:1.0" << "\n";
+
+    // For each path, the rank, node ID, and orientation of each step
+    map<string, vector<tuple<int64_t, id_t, bool>>> path_steps;
+
+    function<void(Graph&)> lambda = [&](Graph& graph) {
+        for (size_t i = 0; i < graph.node_size(); i++) {
+            const Node& node = graph.node(i);
+            out << "S\t" << node.id() << "\t" << node.sequence() << "\n";
+        }
+        for (size_t i = 0; i < graph.edge_size(); i++) {
+            const Edge& edge = graph.edge(i);
+            out << "L\t" << edge.from() << "\t" << (edge.from_start() ? "-" : "+")
+                << "\t" << edge.to() << "\t" << (edge.to_end() ? "-" : "+")
+                << "\t" << edge.overlap() << "M" << "\n";
+        }
+        for (size_t i = 0; i < graph.path_size(); i++) {
+            const Path& path = graph.path(i);
+            auto& steps = path_steps[path.name()];
+            for (size_t j = 0; j < path.mapping_size(); j++) {
+                const Mapping& mapping = path.mapping(j);
+                // Unranked mappings keep the order they came in
+                int64_t rank = mapping.rank() ? mapping.rank() : steps.size() + 1;
+                steps.emplace_back(rank, mapping.position().node_id(), mapping.position().is_reverse());
+            }
+        }
+    };
+    stream::for_each(in, lambda);
+
+    for (auto& name_and_steps : path_steps) {
+        auto& steps = name_and_steps.second;
+        stable_sort(steps.begin(), steps.end(), [](const tuple<int64_t, id_t, bool>& a,
+                                                   const tuple<int64_t, id_t, bool>& b) {
+            return get<0>(a) < get<0>(b);
+        });
+        out << "P\t" << name_and_steps.first << "\t";
+        for (size_t i = 0; i < steps.size(); i++) {
+            if (i != 0) {
+                out << ",";
+            }
+            out << get<1>(steps[i]) << (get<2>(steps[i]) ? "-" : "+");
+        }
+        out << "\t*" << "\n";
+    }
+}
+
+}
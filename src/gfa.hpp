@@ -0,0 +1,54 @@
+#ifndef VG_GFA_HPP_INCLUDED
+#define VG_GFA_HPP_INCLUDED
+
+/**
+ * \file gfa.hpp: conversion between GFA 1 and chunked VG graphs that works a
+ * line or a chunk at a time, instead of going through a whole VG in memory.
+ */
+
+#include <iostream>
+#include <string>
+#include <functional>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/// How many nodes, edges, and path steps go in each Graph chunk written by
+/// gfa_to_graph_stream by default
+const size_t GFA_STREAM_CHUNK_SIZE = 1000;
+
+/**
+ * Read GFA 1 from in, one line at a time, and pass it to the callback as Graph
+ * chunks, each with at most chunk_size nodes, edges, and path steps. Segments
+ * with numeric names use them as node IDs and keep no state; other names get
+ * IDs counted up from 1, as in VG::from_gfa, which needs a table of those
+ * names. Long paths are split across chunks by rank.
+ *
+ * Overlapping links are passed along as edges with their overlaps set,
+ * because resolving them needs the whole graph. Returns the number of such
+ * links, so a caller that can't use them can refuse the output.
+ */
+size_t gfa_to_graph_callback(istream& in, const function<void(Graph&)>& lambda,
+                             size_t chunk_size = GFA_STREAM_CHUNK_SIZE);
+
+/**
+ * Read GFA 1 from in as gfa_to_graph_callback does, and write the chunks to
+ * out in the stream::write format. Returns the number of overlapping links.
+ */
+size_t gfa_to_graph_stream(istream& in, ostream& out, size_t chunk_size = GFA_STREAM_CHUNK_SIZE);
+
+/**
+ * Read a chunked VG graph from in and write it to out as GFA 1. Segments and
+ * links are written as each chunk is read; only the path steps, which have to
+ * be gathered from all the chunks and put in rank order for their P lines,
+ * are kept until the end.
+ */
+void graph_stream_to_gfa(istream& in, ostream& out);
+
+}
+
+#endif
@@ -1,7 +1,57 @@
 #include "graph.hpp"
 
+#include <omp.h>
+#include <vector>
+
+#include "utility.hpp"
+
 namespace vg {
 
+// below this many elements, sorting on one thread is faster than splitting it up
+static const size_t PARALLEL_SORT_MIN_SIZE = 64 * 1024;
+
+/// Sort the pointers in [begin, end) with less_than. Large ranges, outside of
+/// any parallel region, are sorted in a block per thread and then merged
+/// pairwise, a round of merges at a time.
+template<typename T, typename Compare>
+static void parallel_sort_pointers(T** begin, T** end, const Compare& less_than) {
+    size_t size = end - begin;
+    size_t blocks = omp_in_parallel() ? 1 : min<size_t>(get_thread_count(), size / PARALLEL_SORT_MIN_SIZE);
+    if (blocks <= 1) {
+        std::sort(begin, end, less_than);
+        return;
+    }
+    vector<size_t> bounds(blocks + 1);
+    for (size_t i = 0; i <= blocks; ++i) {
+        bounds[i] = size * i / blocks;
+    }
+#pragma omp parallel for schedule(static, 1)
+    for (size_t i = 0; i < blocks; ++i) {
+        std::sort(begin + bounds[i], begin + bounds[i + 1], less_than);
+    }
+    for (size_t width = 1; width < blocks; width *= 2) {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < blocks - width; i += 2 * width) {
+            std::inplace_merge(begin + bounds[i], begin + bounds[i + width],
+                               begin + bounds[min(i + 2 * width, blocks)], less_than);
+        }
+    }
+}
+
+/// Delete the elements of a sorted repeated field that are equal to the one
+/// before them, by moving the pointers of the ones to keep forward.
+template<typename T, typename Equal>
+static void erase_adjacent_duplicates(google::protobuf::RepeatedPtrField<T>& field, const Equal& equal) {
+    T** elements = field.mutable_data();
+    int kept = 0;
+    for (int i = 0; i < field.size(); ++i) {
+        if (kept == 0 || !equal(*elements[kept - 1], *elements[i])) {
+            std::swap(elements[kept++], elements[i]);
+        }
+    }
+    field.DeleteSubrange(kept, field.size() - kept);
+}
+
 void sort_by_id_dedup_and_clean(Graph& graph) {
     remove_duplicates(graph); // graph is sorted here
     remove_orphan_edges(graph);
@@ -14,34 +64,40 @@ void remove_duplicates(Graph& graph) {
 
 void remove_duplicate_edges(Graph& graph) {
     sort_edges_by_id(graph);
-    graph.mutable_edge()->erase(std::unique(graph.mutable_edge()->begin(),
-                                            graph.mutable_edge()->end(),
-                                            [](const Edge& a, const Edge& b) {
-                                                return make_tuple(a.from(), a.to(), a.from_start(), a.to_end())
-                                                    == make_tuple(b.from(), b.to(), b.from_start(), b.to_end());
-                                            }), graph.mutable_edge()->end());
-
+    erase_adjacent_duplicates(*graph.mutable_edge(), [](const Edge& a, const Edge& b) {
+        return make_tuple(a.from(), a.to(), a.from_start(), a.to_end())
+            == make_tuple(b.from(), b.to(), b.from_start(), b.to_end());
+    });
 }
 
 void remove_duplicate_nodes(Graph& graph) {
     sort_nodes_by_id(graph);
-    graph.mutable_node()->erase(std::unique(graph.mutable_node()->begin(),
-                                            graph.mutable_node()->end(),
-                                            [](const Node& a, const Node& b) {
-                                                return a.id() == b.id();
-                                            }), graph.mutable_node()->end());
+    erase_adjacent_duplicates(*graph.mutable_node(), [](const Node& a, const Node& b) {
+        return a.id() == b.id();
+    });
 }
 
 void remove_orphan_edges(Graph& graph) {
-    set<id_t> ids;
+    vector<id_t> ids;
+    ids.reserve(graph.node_size());
     for (auto& node : graph.node()) {
-        ids.insert(node.id());
+        ids.push_back(node.id());
+    }
+    // the nodes are usually sorted already, by sort_by_id_dedup_and_clean
+    if (!std::is_sorted(ids.begin(), ids.end())) {
+        std::sort(ids.begin(), ids.end());
+    }
+    auto has_node = [&ids](id_t id) {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    };
+    Edge** edges = graph.mutable_edge()->mutable_data();
+    int kept = 0;
+    for (int i = 0; i < graph.edge_size(); ++i) {
+        if (has_node(edges[i]->from()) && has_node(edges[i]->to())) {
+            std::swap(edges[kept++], edges[i]);
+        }
     }
-    graph.mutable_edge()->erase(std::remove_if(graph.mutable_edge()->begin(),
-                                               graph.mutable_edge()->end(),
-                                               [&ids](const Edge& e) {
-                                                   return !ids.count(e.from()) || !ids.count(e.to());
-                                               }), graph.mutable_edge()->end());
+    graph.mutable_edge()->DeleteSubrange(kept, graph.edge_size() - kept);
 }
 
 void sort_by_id(Graph& graph) {
@@ -50,20 +106,19 @@ void sort_by_id(Graph& graph) {
 }
 
 void sort_nodes_by_id(Graph& graph) {
-    std::sort(graph.mutable_node()->begin(),
-              graph.mutable_node()->end(),
-              [](const Node& a, const Node& b) {
-                  return a.id() < b.id();
-              });
+    // sort the pointers, so no Node is copied
+    Node** nodes = graph.mutable_node()->mutable_data();
+    parallel_sort_pointers(nodes, nodes + graph.node_size(), [](const Node* a, const Node* b) {
+        return a->id() < b->id();
+    });
 }
 
 void sort_edges_by_id(Graph& graph) {
-    std::sort(graph.mutable_edge()->begin(),
-              graph.mutable_edge()->end(),
-              [](const Edge& a, const Edge& b) {
-                  return make_tuple(a.from(), a.to(), a.from_start(), a.to_end())
-                      < make_tuple(b.from(), b.to(), b.from_start(), b.to_end());
-              });
+    Edge** edges = graph.mutable_edge()->mutable_data();
+    parallel_sort_pointers(edges, edges + graph.edge_size(), [](const Edge* a, const Edge* b) {
+        return make_tuple(a->from(), a->to(), a->from_start(), a->to_end())
+            < make_tuple(b->from(), b->to(), b->from_start(), b->to_end());
+    });
 }
 
 bool is_id_sortable(const Graph& graph) {
@@ -0,0 +1,201 @@
+#include "graph_stream_merge.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+
+#include "stream.hpp"
+#include "utility.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/// Call the lambda on each chunk of the serialized graph in the file.
+static void for_each_graph_chunk(const string& file_name, const function<void(Graph&)>& lambda) {
+    ifstream in(file_name);
+    if (!in) {
+        throw runtime_error("could not open graph " + file_name);
+    }
+    stream::for_each<Graph>(in, lambda);
+}
+
+/// Write a single chunk to the output stream.
+static void write_graph_chunk(ostream& out, Graph& chunk) {
+    stream::write<Graph>(out, 1, [&](uint64_t i) {
+        return chunk;
+    });
+}
+
+/// Copy standard input to a temporary file, so it can be read more than once,
+/// and replace "-" in the file names with it. Returns the name of the
+/// temporary file, or "" if none was needed.
+static string spool_stdin(vector<string>& file_names) {
+    string spooled;
+    for (auto& file_name : file_names) {
+        if (file_name == "-") {
+            if (spooled.empty()) {
+                spooled = tmpfilename();
+                ofstream spool(spooled);
+                spool << cin.rdbuf();
+            }
+            file_name = spooled;
+        }
+    }
+    return spooled;
+}
+
+GraphEnds find_graph_ends(const string& file_name) {
+    // Each node's start and end usage, by ID, as the chunks go past. Edges
+    // can come before the nodes they attach to.
+    vector<id_t> node_ids;
+    vector<pair<id_t, bool>> used_sides;
+    for_each_graph_chunk(file_name, [&](Graph& chunk) {
+        for (auto const& node : chunk.node()) {
+            node_ids.push_back(node.id());
+        }
+        for (auto const& edge : chunk.edge()) {
+            // An edge uses the end of its from node, unless it leaves from the
+            // start, and the start of its to node, unless it arrives at the end
+            used_sides.emplace_back(edge.from(), !edge.from_start());
+            used_sides.emplace_back(edge.to(), edge.to_end());
+        }
+    });
+
+    GraphEnds ends;
+    vector<id_t> sorted_ids = node_ids;
+    sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(unique(sorted_ids.begin(), sorted_ids.end()), sorted_ids.end());
+    if (!sorted_ids.empty()) {
+        ends.max_id = sorted_ids.back();
+    }
+    vector<bool> start_used(sorted_ids.size(), false);
+    vector<bool> end_used(sorted_ids.size(), false);
+    for (auto const& side : used_sides) {
+        auto found = lower_bound(sorted_ids.begin(), sorted_ids.end(), side.first);
+        if (found != sorted_ids.end() && *found == side.first) {
+            (side.second ? end_used : start_used)[found - sorted_ids.begin()] = true;
+        }
+    }
+    vector<pair<id_t, bool>>().swap(used_sides);
+
+    // Report the ends in the order the nodes came in, once each
+    vector<bool> reported(sorted_ids.size(), false);
+    for (id_t id : node_ids) {
+        size_t rank = lower_bound(sorted_ids.begin(), sorted_ids.end(), id) - sorted_ids.begin();
+        if (reported[rank]) {
+            continue;
+        }
+        reported[rank] = true;
+        if (!start_used[rank]) {
+            ends.heads.push_back(id);
+        }
+        if (!end_used[rank]) {
+            ends.tails.push_back(id);
+        }
+    }
+    return ends;
+}
+
+void concat_graph_files(const vector<string>& file_names, ostream& out) {
+    vector<string> to_read = file_names;
+    string spooled = spool_stdin(to_read);
+
+    // The largest ID written so far, which the next graph's IDs go after
+    id_t max_id = 0;
+    // The tails of the last graph, in output IDs
+    vector<id_t> last_tails;
+    // How far to offset the ranks of each path's mappings in the next graph
+    unordered_map<string, int64_t> rank_offset;
+
+    for (auto& file_name : to_read) {
+        GraphEnds ends = find_graph_ends(file_name);
+        id_t id_offset = max_id;
+
+        unordered_map<string, int64_t> max_rank;
+        for_each_graph_chunk(file_name, [&](Graph& chunk) {
+            for (auto& node : *chunk.mutable_node()) {
+                node.set_id(node.id() + id_offset);
+            }
+            for (auto& edge : *chunk.mutable_edge()) {
+                edge.set_from(edge.from() + id_offset);
+                edge.set_to(edge.to() + id_offset);
+            }
+            for (auto& path : *chunk.mutable_path()) {
+                int64_t offset = rank_offset.count(path.name()) ? rank_offset[path.name()] : 0;
+                int64_t& path_max_rank = max_rank[path.name()];
+                for (auto& mapping : *path.mutable_mapping()) {
+                    Position* position = mapping.mutable_position();
+                    position->set_node_id(position->node_id() + id_offset);
+                    if (mapping.rank() != 0) {
+                        // Unranked mappings just go on the end when loaded
+                        path_max_rank = max<int64_t>(path_max_rank, mapping.rank());
+                        mapping.set_rank(mapping.rank() + offset);
+                    }
+                }
+            }
+            write_graph_chunk(out, chunk);
+        });
+
+        // Join the last graph's tails to this one's heads
+        Graph joins;
+        for (id_t tail : last_tails) {
+            for (id_t head : ends.heads) {
+                Edge* edge = joins.add_edge();
+                edge->set_from(tail);
+                edge->set_to(head + id_offset);
+            }
+        }
+        if (joins.edge_size() > 0) {
+            write_graph_chunk(out, joins);
+        }
+
+        last_tails.clear();
+        for (id_t tail : ends.tails) {
+            last_tails.push_back(tail + id_offset);
+        }
+        max_id = max(max_id, ends.max_id + id_offset);
+        for (auto& path_rank : max_rank) {
+            rank_offset[path_rank.first] += path_rank.second;
+        }
+    }
+
+    if (!spooled.empty()) {
+        remove(spooled.c_str());
+    }
+}
+
+void join_graph_files(const vector<string>& file_names, ostream& out) {
+    vector<string> to_read = file_names;
+    string spooled = spool_stdin(to_read);
+
+    id_t max_id = 0;
+    vector<id_t> heads;
+    for (auto& file_name : to_read) {
+        GraphEnds ends = find_graph_ends(file_name);
+        max_id = max(max_id, ends.max_id);
+        heads.insert(heads.end(), ends.heads.begin(), ends.heads.end());
+        for_each_graph_chunk(file_name, [&](Graph& chunk) {
+            write_graph_chunk(out, chunk);
+        });
+    }
+
+    // Add the root and wire it to all the heads
+    Graph root;
+    Node* root_node = root.add_node();
+    root_node->set_id(max_id + 1);
+    root_node->set_sequence("N");
+    for (id_t head : heads) {
+        Edge* edge = root.add_edge();
+        edge->set_from(root_node->id());
+        edge->set_to(head);
+    }
+    write_graph_chunk(out, root);
+
+    if (!spooled.empty()) {
+        remove(spooled.c_str());
+    }
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef VG_GRAPH_STREAM_MERGE_HPP_INCLUDED
+#define VG_GRAPH_STREAM_MERGE_HPP_INCLUDED
+
+/** \file
+ *
+ * Functions to concatenate and join serialized graphs by passing their chunks
+ * through, instead of loading them all into one VG. Each input is read twice:
+ * once to find its heads, tails and largest node ID, and once to copy it to
+ * the output with any ID and rank offsets applied. Only one chunk, and the node
+ * IDs and edge sides of one input, are in memory at a time.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "vg.pb.h"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/// The ends of a serialized graph, as VG::head_nodes and VG::tail_nodes would
+/// find them, and its node ID range.
+struct GraphEnds {
+    /// Nodes with nothing attached to their starts, in the order they appear
+    vector<id_t> heads;
+    /// Nodes with nothing attached to their ends, in the order they appear
+    vector<id_t> tails;
+    /// The largest node ID, or 0 for an empty graph
+    id_t max_id = 0;
+};
+
+/// Find the ends of the serialized graph in the given file in one streaming
+/// pass.
+GraphEnds find_graph_ends(const string& file_name);
+
+/// Stream out the graphs in the given files in order, offsetting each one's
+/// node IDs past the largest ID written so far and connecting the tails of
+/// each graph to the heads of the next, as VG::append does. Paths with the
+/// same name in successive graphs are concatenated, with their mapping ranks
+/// offset to follow on from the previous graph's. "-" reads standard input,
+/// which is spooled to a temporary file first.
+void concat_graph_files(const vector<string>& file_names, ostream& out);
+
+/// Stream out the graphs in the given files, which share one ID space, and a
+/// new root node with sequence "N" after the largest ID, connected to the
+/// heads of all of them, as VG::extend and VG::join_heads do. "-" reads
+/// standard input, which is spooled to a temporary file first.
+void join_graph_files(const vector<string>& file_names, ostream& out);
+
+}
+
+#endif
@@ -14,16 +14,50 @@ GraphSynchronizer::GraphSynchronizer(VG& graph) : graph(graph) {
 void GraphSynchronizer::with_path_index(const string& path_name, const function<void(const PathIndex&)>& to_run) {
     // Get a reader lock on the graph
     std::lock_guard<std::mutex> guard(whole_graph_lock);
+    // We don't know what the function will look at, so it needs the whole
+    // index up to date.
+    flush_translations();
     to_run(get_path_index(path_name));
 }
 
+pair<size_t, size_t> GraphSynchronizer::round_outward(const string& path_name, size_t start, size_t past_end) {
+    std::lock_guard<std::mutex> guard(whole_graph_lock);
+    
+    // Rounding only looks at the nodes holding the first and last bases, so
+    // make sure those are up to date.
+    at_position(path_name, start);
+    if (past_end != 0) {
+        at_position(path_name, past_end - 1);
+    }
+    
+    return get_path_index(path_name).round_outward(start, past_end);
+}
+
 const string& GraphSynchronizer::get_path_sequence(const string& path_name) {
+    {
+        // See if we have already found it
+        std::lock_guard<std::mutex> guard(path_sequences_lock);
+        auto found = path_sequences.find(path_name);
+        if (found != path_sequences.end()) {
+            return *found->second;
+        }
+    }
+    
     // Lock the whole graph
     std::lock_guard<std::mutex> guard(whole_graph_lock);
     
     // Get (and possibly generate from the graph) the index, and return its
-    // sequence string (which won't change)
-    return get_path_index(path_name).sequence;
+    // sequence string (which won't change). The index lives as long as we do
+    // and is only ever updated in place, so the string won't move.
+    const string* sequence = &get_path_index(path_name).sequence;
+    
+    std::lock_guard<std::mutex> sequences_guard(path_sequences_lock);
+    path_sequences[path_name] = sequence;
+    return *sequence;
+}
+
+GraphSynchronizer::RangeShard& GraphSynchronizer::get_range_shard(const string& path_name) {
+    return range_shards[std::hash<string>()(path_name) % RANGE_SHARDS];
 }
 
     
@@ -31,7 +65,9 @@ const string& GraphSynchronizer::get_path_sequence(const string& path_name) {
 PathIndex& GraphSynchronizer::get_path_index(const string& path_name) {
 
     if (!indexes.count(path_name)) {
-        // Not already made. Generate it.
+        // Not already made. Generate it. It will come from the graph as it is
+        // now, so the other indexes need to catch up to the same edits.
+        flush_translations();
         indexes.emplace(piecewise_construct,
             forward_as_tuple(path_name), // Make the key
             forward_as_tuple(graph, path_name, true)); // Make the PathIndex
@@ -49,6 +85,51 @@ void GraphSynchronizer::update_path_indexes(const vector<Translation>& translati
     }
 }
 
+void GraphSynchronizer::queue_translations(const vector<Translation>& translations) {
+    for (auto& translation : translations) {
+        if (translation.from().mapping_size() == 0 ||
+            mapping_from_length(translation.from().mapping(0)) == 0) {
+            // Novel nodes aren't on any path we have indexed
+            continue;
+        }
+        
+        auto& from_mapping = translation.from().mapping(0);
+        id_t from_id = from_mapping.position().node_id();
+        if (translation.to().mapping_size() == 1 &&
+            translation.to().mapping(0).position().node_id() == from_id &&
+            from_mapping.position().offset() == 0 &&
+            graph.has_node(from_id) &&
+            mapping_from_length(from_mapping) == graph.get_node(from_id)->sequence().size()) {
+            // The node came through the edit whole.
+            continue;
+        }
+        
+        dirty_nodes.insert(from_id);
+    }
+    
+    pending_translations.insert(pending_translations.end(), translations.begin(), translations.end());
+}
+
+void GraphSynchronizer::flush_translations() {
+    if (pending_translations.empty()) {
+        return;
+    }
+    
+    update_path_indexes(pending_translations);
+    pending_translations.clear();
+    dirty_nodes.clear();
+}
+
+NodeSide GraphSynchronizer::at_position(const string& path_name, size_t position) {
+    NodeSide found = get_path_index(path_name).at_position(position);
+    if (dirty_nodes.count(found.node)) {
+        // This node has been edited since the index was last updated
+        flush_translations();
+        found = get_path_index(path_name).at_position(position);
+    }
+    return found;
+}
+
 GraphSynchronizer::Lock::Lock(GraphSynchronizer& synchronizer,
     const string& path_name, size_t path_offset, size_t context_bases, bool reflect) : 
     synchronizer(synchronizer), path_name(path_name), path_offset(path_offset), 
@@ -71,6 +152,24 @@ void GraphSynchronizer::Lock::lock() {
         return;
     }
     
+    if (start != 0 || past_end != 0) {
+        // Claim our range of the path first, waiting for anyone with an
+        // overlapping range to be done with it.
+        auto& shard = synchronizer.get_range_shard(path_name);
+        std::unique_lock<std::mutex> shard_lk(shard.shard_lock);
+        shard.range_freed.wait(shard_lk, [&]{
+            for (auto& range : shard.claimed) {
+                if (get<0>(range) == path_name && get<1>(range) < past_end && start < get<2>(range)) {
+                    // Someone else is working here
+                    return false;
+                }
+            }
+            return true;
+        });
+        shard.claimed.emplace_back(path_name, start, past_end);
+        claimed_range = true;
+    }
+    
     // What we do is, we lock the graph and wait on the condition variable, with
     // the check code being that we find the subgraph and immediate neighbors
     // and verify none of its nodes are locked
@@ -93,8 +192,8 @@ void GraphSynchronizer::Lock::lock() {
             Graph context_graph;
             
             // Find the outer ends of this range
-            NodeSide start_left = synchronizer.get_path_index(path_name).at_position(start);
-            NodeSide end_right = synchronizer.get_path_index(path_name).at_position(past_end == 0 ? 0 : past_end - 1).flip();
+            NodeSide start_left = synchronizer.at_position(path_name, start);
+            NodeSide end_right = synchronizer.at_position(path_name, past_end == 0 ? 0 : past_end - 1).flip();
             
             // Fill in the endpoints pair
             endpoints = make_pair(start_left, end_right);
@@ -157,7 +256,7 @@ void GraphSynchronizer::Lock::lock() {
             // We want to extract a radius
             
             // Find the center node, at the position we want to lock out from
-            NodeSide center = synchronizer.get_path_index(path_name).at_position(path_offset);
+            NodeSide center = synchronizer.at_position(path_name, path_offset);
             
             synchronizer.graph.nonoverlapping_node_context_without_paths(synchronizer.graph.get_node(center.node), context);
             synchronizer.graph.expand_context_by_length(context, context_bases, false, reflect);
@@ -247,6 +346,8 @@ void GraphSynchronizer::Lock::lock() {
     // We should have actually grabbed something.
     if (locked_nodes.empty()) {
         cerr << "error:[vg::GraphSynchronizer] No nodes locked for " << path_name << ":" << start << "-" << past_end << endl;
+        lk.unlock();
+        release_range();
         throw runtime_error("No nodes locked!");
     }
     
@@ -269,6 +370,29 @@ void GraphSynchronizer::Lock::unlock() {
     // Notify anyone waiting, so they can all check to see if now they can go.
     lk.unlock();
     synchronizer.wait_for_region.notify_all();
+    
+    // Let locks on overlapping ranges go ahead
+    release_range();
+}
+
+void GraphSynchronizer::Lock::release_range() {
+    if (!claimed_range) {
+        return;
+    }
+    
+    auto& shard = synchronizer.get_range_shard(path_name);
+    {
+        std::lock_guard<std::mutex> shard_guard(shard.shard_lock);
+        for (auto it = shard.claimed.begin(); it != shard.claimed.end(); ++it) {
+            if (get<0>(*it) == path_name && get<1>(*it) == start && get<2>(*it) == past_end) {
+                // Ranges are only claimed once at a time, so this is ours
+                shard.claimed.erase(it);
+                break;
+            }
+        }
+    }
+    claimed_range = false;
+    shard.range_freed.notify_all();
 }
 
 VG& GraphSynchronizer::Lock::get_subgraph() {
@@ -336,16 +460,16 @@ vector<Translation> GraphSynchronizer::Lock::apply_edit(const Path& path, set<No
             // For every mapping to a node on that path
             auto node_id = new_path.mapping(i).position().node_id();
             
-            if (!locked_nodes.count(i)) {
+            if (!locked_nodes.count(node_id)) {
                 // If it's not already locked, lock it.
-                locked_nodes.insert(i);
-                synchronizer.locked_nodes.insert(i);
+                locked_nodes.insert(node_id);
+                synchronizer.locked_nodes.insert(node_id);
             }
         }
     }
     
-    // Apply the edits to the path indexes
-    synchronizer.update_path_indexes(translations);
+    // Apply the edits to the path indexes, once someone needs them
+    synchronizer.queue_translations(translations);
     
     // Spit out the translations to the caller. Maybe they can use them on their subgraph or something?
     return translations;
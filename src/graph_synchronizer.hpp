@@ -12,6 +12,7 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <tuple>
 
 namespace vg {
 
@@ -38,7 +39,9 @@ public:
     
     /**
      * Since internally we keep PathIndexes for paths in the graph, we expose
-     * this method for getting the strings for paths.
+     * this method for getting the strings for paths. Path sequences never
+     * change, so after the first call for a path this doesn't have to wait
+     * for anyone working on the graph.
      */
     const string& get_path_sequence(const string& path_name);
     
@@ -49,6 +52,13 @@ public:
      */
     void with_path_index(const string& path_name, const function<void(const PathIndex&)>& to_run);
     
+    /**
+     * Round a range along a path outward to node boundaries, as
+     * PathIndex::round_outward does, with the guarantee that the graph won't
+     * change while we're working.
+     */
+    pair<size_t, size_t> round_outward(const string& path_name, size_t start, size_t past_end);
+    
     /**
      * This represents a request to lock a particular context on a particular
      * GraphSynchronizer. It fulfils the BasicLockable concept requirements, so
@@ -175,6 +185,12 @@ public:
         
         /// This is the set of nodes that this lock has currently locked.
         set<id_t> locked_nodes;
+        
+        /// Set if we hold a claim on our path range in the range table.
+        bool claimed_range = false;
+        
+        /// Release our claim on our path range, if we have one.
+        void release_range();
     };
     
 protected:
@@ -214,8 +230,68 @@ protected:
      */
     void update_path_indexes(const vector<Translation>& translations);
     
+    /// Translations from edits that haven't been applied to the path indexes
+    /// yet. Updating a PathIndex costs a pass over the whole path, so we save
+    /// them up and apply them together.
+    vector<Translation> pending_translations;
+    
+    /// The nodes that the pending translations divide or replace. Lookups in
+    /// the path indexes are only out of date if they land on these.
+    set<id_t> dirty_nodes;
+    
+    /**
+     * Save the translations from an edit to apply to the path indexes later.
+     * Lock on the indexes and graph must be held already.
+     */
+    void queue_translations(const vector<Translation>& translations);
+    
+    /**
+     * Apply all the pending translations to the path indexes. Lock on the
+     * indexes and graph must be held already.
+     */
+    void flush_translations();
+    
+    /**
+     * Get the NodeSide at the given position along the given path, bringing
+     * the path index up to date first if the position is on a node that has
+     * been edited. Lock on the indexes and graph must be held already.
+     */
+    NodeSide at_position(const string& path_name, size_t position);
+    
     /// This holds all the node IDs that are currently locked by someone
     set<id_t> locked_nodes;
+    
+    /// We cache pointers to the path sequences, which never change, so
+    /// readers don't need the whole graph lock.
+    map<string, const string*> path_sequences;
+    
+    /// This protects path_sequences.
+    mutex path_sequences_lock;
+    
+    /**
+     * Locks on path ranges first claim their range in a table, so that locks
+     * on overlapping ranges wait for each other here instead of all waking up
+     * and retrying their subgraph extraction under the whole graph lock. Only
+     * once a range is claimed does a lock go on to claim its nodes, which also
+     * catches conflicts off the path or between adjacent ranges. The table is
+     * sharded by path name, so locks on different paths don't contend.
+     */
+    struct RangeShard {
+        mutex shard_lock;
+        /// Notified whenever a range in this shard is released
+        condition_variable range_freed;
+        /// The claimed ranges, as path name, start, and past-end position
+        vector<tuple<string, size_t, size_t>> claimed;
+    };
+    
+    /// How many shards should the range table have?
+    static const size_t RANGE_SHARDS = 16;
+    
+    /// The shards of the range table
+    RangeShard range_shards[RANGE_SHARDS];
+    
+    /// Get the range table shard for the given path.
+    RangeShard& get_range_shard(const string& path_name);
 
 
 };
@@ -1,5 +1,11 @@
 #include "gssw_aligner.hpp"
 #include "json2pb.h"
+#include "scoring_kernels.hpp"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 static const double quality_scale_factor = 10.0 / log(10.0);
 static const double exp_overflow_limit = log(std::numeric_limits<double>::max());
@@ -67,6 +73,114 @@ gssw_graph* BaseAligner::create_gssw_graph(Graph& g) {
     
 }
 
+AlignableGraph::AlignableGraph(Graph& g) : source(g) {
+    // nothing to do until we know which aligner wants it
+}
+
+AlignableGraph::~AlignableGraph() {
+    for (auto& prepared : gssw_graphs) {
+        if (prepared.graph) {
+            gssw_graph_destroy(prepared.graph);
+        }
+    }
+}
+
+Graph& AlignableGraph::graph() {
+    return source;
+}
+
+gssw_graph* BaseAligner::prepare_gssw_graph(AlignableGraph& alignable, bool reversed) {
+    
+    AlignableGraph::Prepared& prepared = alignable.gssw_graphs[reversed ? 1 : 0];
+    
+    if (prepared.graph && prepared.score_matrix != score_matrix) {
+        // a different aligner built this one, so its scoring tables are wrong for us
+        gssw_graph_destroy(prepared.graph);
+        prepared.graph = nullptr;
+    }
+    
+    if (prepared.graph) {
+        // reuse the nodes and edges, but throw away the last alignment's DP state
+        gssw_graph_clear(prepared.graph);
+    }
+    else {
+        if (reversed && alignable.reversed.node_size() == 0) {
+            reverse_graph(alignable.source, alignable.reversed);
+        }
+        prepared.graph = create_gssw_graph(reversed ? alignable.reversed : alignable.source);
+        prepared.score_matrix = score_matrix;
+    }
+    
+    return prepared.graph;
+}
+
+/// Run a banded global alignment with DP matrices of the given integer type
+template<class IntType>
+static void banded_global_align(Alignment& alignment, Graph& g, vector<Alignment>* alt_alignments,
+                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                bool qual_adjusted, int8_t* score_matrix, int8_t* nt_table,
+                                int8_t gap_open, int8_t gap_extension) {
+    if (alt_alignments) {
+        BandedGlobalAligner<IntType> band_graph(alignment,
+                                                g,
+                                                *alt_alignments,
+                                                max_alt_alns,
+                                                band_padding,
+                                                permissive_banding,
+                                                qual_adjusted);
+        
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    }
+    else {
+        BandedGlobalAligner<IntType> band_graph(alignment,
+                                                g,
+                                                band_padding,
+                                                permissive_banding,
+                                                qual_adjusted);
+        
+        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    }
+}
+
+/// Can every score between the bounds, and the DP's sentinel values below them, be held in IntType?
+template<class IntType>
+static bool scores_fit(int64_t best_score, int64_t worst_score, int64_t max_base_penalty) {
+    // the DP keeps an "infinitely" bad sentinel one penalty above the minimum
+    return best_score <= numeric_limits<IntType>::max()
+        && worst_score - max_base_penalty >= numeric_limits<IntType>::min();
+}
+
+void BaseAligner::align_global_banded_narrowest(Alignment& alignment, Graph& g, vector<Alignment>* alt_alignments,
+                                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                                bool qual_adjusted, int32_t max_base_score, int32_t max_base_penalty) {
+    
+    // We need to figure out what size ints we need to use. Narrower ints mean more DP cells in
+    // each vector register, so we want the narrowest that can't overflow.
+    // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
+    int64_t best_score = alignment.sequence().size() * (int64_t) max_base_score;
+    size_t total_bases = 0;
+    for(size_t i = 0; i < g.node_size(); i++) {
+        total_bases += g.node(i).sequence().size();
+    }
+    // lead gaps open twice, once each way
+    int64_t worst_score = ((int64_t) max(alignment.sequence().size(), total_bases) + 2) * -(int64_t) max_base_penalty;
+    
+    if (scores_fit<int8_t>(best_score, worst_score, max_base_penalty)) {
+        banded_global_align<int8_t>(alignment, g, alt_alignments, max_alt_alns, band_padding, permissive_banding,
+                                    qual_adjusted, score_matrix, nt_table, gap_open, gap_extension);
+    } else if (scores_fit<int16_t>(best_score, worst_score, max_base_penalty)) {
+        banded_global_align<int16_t>(alignment, g, alt_alignments, max_alt_alns, band_padding, permissive_banding,
+                                     qual_adjusted, score_matrix, nt_table, gap_open, gap_extension);
+    } else if (scores_fit<int32_t>(best_score, worst_score, max_base_penalty)) {
+        banded_global_align<int32_t>(alignment, g, alt_alignments, max_alt_alns, band_padding, permissive_banding,
+                                     qual_adjusted, score_matrix, nt_table, gap_open, gap_extension);
+    } else {
+        // Fall back to int64
+        banded_global_align<int64_t>(alignment, g, alt_alignments, max_alt_alns, band_padding, permissive_banding,
+                                     qual_adjusted, score_matrix, nt_table, gap_open, gap_extension);
+    }
+}
+
 
 
 void BaseAligner::gssw_mapping_to_alignment(gssw_graph* graph,
@@ -318,7 +432,27 @@ string BaseAligner::graph_cigar(gssw_graph_mapping* gm) {
 }
 
 void BaseAligner::init_mapping_quality(double gc_content) {
-    log_base = gssw_dna_recover_log_base(match, mismatch, gc_content, 1e-12);
+    // Recovering the log base is a root search, and every thread's mapper builds
+    // aligners with the same parameters, so the answers are kept for all of them.
+    static mutex log_base_mutex;
+    static map<tuple<int8_t, int8_t, double>, double> log_bases;
+    auto key = make_tuple(match, mismatch, gc_content);
+    {
+        lock_guard<mutex> lock(log_base_mutex);
+        auto found = log_bases.find(key);
+        if (found != log_bases.end()) {
+            log_base = found->second;
+        }
+        else {
+            log_base = gssw_dna_recover_log_base(match, mismatch, gc_content, 1e-12);
+            log_bases[key] = log_base;
+        }
+    }
+    
+    // the best-case mapping qualities are linear in the read length and the
+    // difference in mismatches, so their coefficients are all we need to keep
+    max_mapping_quality_per_base = max(0.0, quality_scale_factor * log_base * match);
+    mapping_quality_per_diff = quality_scale_factor * log_base * (match + mismatch);
 }
 
 int32_t BaseAligner::score_gap(size_t gap_length) {
@@ -333,11 +467,10 @@ double BaseAligner::maximum_mapping_quality_exact(vector<double>& scaled_scores,
     }
     
     // work in log transformed values to avoid risk of overflow
-    double log_sum_exp = numeric_limits<double>::lowest();
+    double log_sum_exp = vg::log_sum_exp(scaled_scores.data(), scaled_scores.size());
     double max_score = numeric_limits<double>::lowest();
-    // go in reverse order because this has fewer numerical problems when the scores are sorted (as usual)
+    // take the last of any tied maximums
     for (int64_t i = scaled_scores.size() - 1; i >= 0; i--) {
-        log_sum_exp = add_log(log_sum_exp, scaled_scores[i]);
         if (scaled_scores[i] > max_score) {
             *max_idx_out = i;
             max_score = scaled_scores[i];
@@ -429,21 +562,22 @@ double BaseAligner::group_mapping_quality_exact(vector<double>& scaled_scores, v
         scaled_scores.push_back(0.0);
     }
     
-    // work in log transformed values to avoid risk of overflow
-    double total_log_sum_exp = numeric_limits<double>::lowest();
-    double non_group_log_sum_exp = numeric_limits<double>::lowest();
-    
-    // go in reverse order because this has fewer numerical problems when the scores are sorted (as usual)
-    int64_t group_idx = group.size() - 1;
-    for (int64_t i = scaled_scores.size() - 1; i >= 0; i--) {
-        total_log_sum_exp = add_log(total_log_sum_exp, scaled_scores[i]);
-        if (group_idx >= 0 ? i == group[group_idx] : false) {
-            group_idx--;
+    // collect the scores outside the group
+    vector<double> non_group_scores;
+    non_group_scores.reserve(scaled_scores.size());
+    size_t group_idx = 0;
+    for (size_t i = 0; i < scaled_scores.size(); i++) {
+        if (group_idx < group.size() && i == group[group_idx]) {
+            group_idx++;
         }
         else {
-            non_group_log_sum_exp = add_log(non_group_log_sum_exp, scaled_scores[i]);
+            non_group_scores.push_back(scaled_scores[i]);
         }
     }
+    
+    // work in log transformed values to avoid risk of overflow
+    double total_log_sum_exp = vg::log_sum_exp(scaled_scores.data(), scaled_scores.size());
+    double non_group_log_sum_exp = vg::log_sum_exp(non_group_scores.data(), non_group_scores.size());
     double direct_mapq = quality_scale_factor * (total_log_sum_exp - non_group_log_sum_exp);
     return (std::isinf(direct_mapq) || direct_mapq > numeric_limits<int32_t>::max()) ?
            (double) numeric_limits<int32_t>::max() : direct_mapq;
@@ -657,19 +791,15 @@ double BaseAligner::estimate_next_best_score(int length, double min_diffs) {
     return ((length - min_diffs) * match - min_diffs * mismatch);
 }
 
-double BaseAligner::max_possible_mapping_quality(int length) {
-    double max_score = log_base * length * match;
-    vector<double> v = { max_score };
-    size_t max_idx;
-    return maximum_mapping_quality_approx(v, &max_idx);
+double BaseAligner::max_possible_mapping_quality(int length) const {
+    // the approximation against a null alignment of score 0
+    return max(0, length) * max_mapping_quality_per_base;
 }
 
-double BaseAligner::estimate_max_possible_mapping_quality(int length, double min_diffs, double next_min_diffs) {
-    double max_score = log_base * ((length - min_diffs) * match - min_diffs * mismatch);
-    double next_max_score = log_base * ((length - next_min_diffs) * match - next_min_diffs * mismatch);
-    vector<double> v = { max_score, next_max_score };
-    size_t max_idx;
-    return maximum_mapping_quality_approx(v, &max_idx);
+double BaseAligner::estimate_max_possible_mapping_quality(int length, double min_diffs, double next_min_diffs) const {
+    // the approximation between perfect alignments with this many mismatches,
+    // where the length cancels out
+    return mapping_quality_per_diff * fabs(next_min_diffs - min_diffs);
 }
 
 double BaseAligner::score_to_unnormalized_likelihood_ln(double score) {
@@ -699,13 +829,19 @@ int32_t BaseAligner::score_gappy_alignment(const Alignment& aln, const function<
     
     int score = 0;
     int read_offset = 0;
+    // whether the read is soft clipped on each end, found as we pass the first and last edits
+    bool clipped_start = false;
+    bool clipped_end = false;
     auto& path = aln.path();
     for (int i = 0; i < path.mapping_size(); ++i) {
         // For each mapping
         auto& mapping = path.mapping(i);
+        int from_length = 0;
         for (int j = 0; j < mapping.edit_size(); ++j) {
             // For each edit in the mapping
             auto& edit = mapping.edit(j);
+            bool is_first = i == 0 && j == 0;
+            bool is_last = i == path.mapping_size() - 1 && j == mapping.edit_size() - 1;
             
             // Score the edit according to its type
             if (edit_is_match(edit)) {
@@ -714,19 +850,24 @@ int32_t BaseAligner::score_gappy_alignment(const Alignment& aln, const function<
                 score -= mismatch * edit.sequence().size();
             } else if (edit_is_deletion(edit)) {
                 score -= edit.from_length() ? gap_open + (edit.from_length() - 1) * gap_extension : 0;
-            } else if (edit_is_insertion(edit) && !((i == 0 && j == 0) ||
-                                                    (i == path.mapping_size()-1 && j == mapping.edit_size()-1))) {
+            } else if (edit_is_insertion(edit) && !(is_first || is_last)) {
                 // todo how do we score this qual adjusted?
                 score -= edit.to_length() ? gap_open + (edit.to_length() - 1) * gap_extension : 0;
             }
+            
+            if (edit.from_length() == 0 && edit.to_length() > 0) {
+                clipped_start = clipped_start || is_first;
+                clipped_end = clipped_end || is_last;
+            }
             read_offset += edit.to_length();
+            from_length += edit.from_length();
         }
         // score any intervening gaps in mappings using approximate distances
         if (i+1 < path.mapping_size()) {
             // what is the distance between the last position of this mapping
             // and the first of the next
             Position last_pos = mapping.position();
-            last_pos.set_offset(last_pos.offset() + mapping_from_length(mapping));
+            last_pos.set_offset(last_pos.offset() + from_length);
             Position next_pos = path.mapping(i+1).position();
             // Estimate the distance
             int dist = estimate_distance(make_pos_t(last_pos), make_pos_t(next_pos), aln.sequence().size());
@@ -739,10 +880,10 @@ int32_t BaseAligner::score_gappy_alignment(const Alignment& aln, const function<
     
     if (!strip_bonuses) {
         // We should report any bonuses used in the DP in the final score
-        if (!softclip_start(aln)) {
+        if (!clipped_start) {
             score += full_length_bonus;
         }
-        if (!softclip_end(aln)) {
+        if (!clipped_end) {
             score += full_length_bonus;
         }
     }
@@ -767,6 +908,12 @@ int32_t BaseAligner::remove_bonuses(const Alignment& aln, bool pinned, bool pin_
     return score;
 }
 
+void BaseAligner::align_batch(const vector<pair<Alignment*, AlignableGraph*>>& jobs, bool traceback_aln) {
+    for (auto& job : jobs) {
+        align(*job.first, *job.second, traceback_aln, false);
+    }
+}
+
 
 Aligner::Aligner(int8_t _match,
                  int8_t _mismatch,
@@ -787,7 +934,7 @@ Aligner::Aligner(int8_t _match,
 }
 
 
-void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
+void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, AlignableGraph& alignable,
                              bool pinned, bool pin_left, int32_t max_alt_alns,
                              bool traceback_aln, bool print_score_matrices) {
 
@@ -808,23 +955,16 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
     
-    // create reversed graph if necessary
-    Graph reversed_graph;
-    if (pin_left) {
-        reverse_graph(g, reversed_graph);
-    }
-
     // choose forward or reversed objects
     // note: have to make a copy of the sequence because we will modify it to add a pinning point
-    Graph* align_graph = &g;
+    Graph& g = alignable.graph();
     string align_sequence = alignment.sequence();
     if (pin_left) {
-        align_graph = &reversed_graph;
         reverse(align_sequence.begin(), align_sequence.end());
     }
     
-    // convert into gssw graph
-    gssw_graph* graph = create_gssw_graph(*align_graph);
+    // get the gssw graph, reversed if necessary
+    gssw_graph* graph = prepare_gssw_graph(alignable, pin_left);
     
     // perform dynamic programming
     gssw_graph_fill_pinned(graph, align_sequence.c_str(),
@@ -850,7 +990,7 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
         
             if (pin_left) {
                 // translate graph and mappings into original node space
-                unreverse_graph(reversed_graph);
+                unreverse_graph(alignable.reversed);
                 for (int32_t i = 0; i < max_alt_alns; i++) {
                     unreverse_graph_mapping(gms[i]);
                 }
@@ -926,6 +1066,11 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
                 gssw_graph_mapping_destroy(gms[i]);
             }
             free(gms);
+            
+            if (pin_left) {
+                // put the reversed sequences back for the next alignment
+                unreverse_graph(alignable.reversed);
+            }
         }
         else {
             // trace back local alignment
@@ -952,17 +1097,243 @@ void Aligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alig
     }
     
     //gssw_graph_print_score_matrices(graph, sequence.c_str(), sequence.size(), stderr);
-    
-    gssw_graph_destroy(graph);
 }
 
 void Aligner::align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices) {
     
+    AlignableGraph alignable(g);
+    align_internal(alignment, nullptr, alignable, false, false, 1, traceback_aln, print_score_matrices);
+}
+
+void Aligner::align(Alignment& alignment, AlignableGraph& g, bool traceback_aln, bool print_score_matrices) {
+    
     align_internal(alignment, nullptr, g, false, false, 1, traceback_aln, print_score_matrices);
 }
 
+/// A graph laid out for a BatchAligner
+struct BatchGraph {
+    string sequence;
+    vector<size_t> node_starts;
+    vector<vector<size_t>> predecessors;
+};
+
+/// Lay out a graph for a BatchAligner, or return false if it can't be, because
+/// it has empty nodes, or edges that reverse or don't go forward in node order
+static bool make_batch_graph(const Graph& g, BatchGraph& out) {
+    unordered_map<int64_t, size_t> node_index;
+    for (size_t i = 0; i < g.node_size(); i++) {
+        const Node& node = g.node(i);
+        if (node.sequence().empty()) {
+            return false;
+        }
+        node_index[node.id()] = i;
+        out.node_starts.push_back(out.sequence.size());
+        // score the graph as gssw does
+        out.sequence += nonATGCNtoN(node.sequence());
+    }
+    out.predecessors.resize(g.node_size());
+    for (auto& edge : g.edge()) {
+        int64_t from;
+        int64_t to;
+        if (!edge.from_start() && !edge.to_end()) {
+            from = edge.from();
+            to = edge.to();
+        } else if (edge.from_start() && edge.to_end()) {
+            from = edge.to();
+            to = edge.from();
+        } else {
+            return false;
+        }
+        auto from_index = node_index.find(from);
+        auto to_index = node_index.find(to);
+        if (from_index == node_index.end() || to_index == node_index.end()
+            || from_index->second >= to_index->second) {
+            return false;
+        }
+        out.predecessors[to_index->second].push_back(from_index->second);
+    }
+    return true;
+}
+
+/// Fill in an Alignment from a BatchAligner's result, as gssw_mapping_to_alignment would
+static void batch_result_to_alignment(const BatchAlignmentResult& result, const Graph& g,
+                                      const BatchGraph& batch_graph, Alignment& alignment, bool traceback_aln) {
+    alignment.clear_path();
+    alignment.set_score(result.score);
+    Path* path = alignment.mutable_path();
+    
+    const vector<size_t>& node_starts = batch_graph.node_starts;
+    auto node_at = [&](size_t position) {
+        return (size_t) (upper_bound(node_starts.begin(), node_starts.end(), position) - node_starts.begin() - 1);
+    };
+    
+    if (!traceback_aln) {
+        // just the end position, as gssw gives, for de-duplication
+        size_t node = node_at(result.graph_end);
+        Position* position = path->add_mapping()->mutable_position();
+        position->set_node_id(g.node(node).id());
+        position->set_offset(result.graph_end - node_starts[node]);
+        return;
+    }
+    
+    alignment.set_query_position(0);
+    const string& read = alignment.sequence();
+    size_t read_pos = result.read_begin;
+    Mapping* mapping = nullptr;
+    size_t mapping_node = 0;
+    for (auto& operation : result.operations) {
+        size_t node = node_at(operation.second);
+        if (operation.first != 'I' && (!mapping || node != mapping_node)) {
+            mapping = path->add_mapping();
+            mapping->mutable_position()->set_node_id(g.node(node).id());
+            mapping->mutable_position()->set_offset(operation.second - node_starts[node]);
+            mapping->set_rank(path->mapping_size());
+            mapping_node = node;
+            if (path->mapping_size() == 1 && result.read_begin > 0) {
+                // soft clip the start
+                Edit* edit = mapping->add_edit();
+                edit->set_to_length(result.read_begin);
+                edit->set_sequence(read.substr(0, result.read_begin));
+            }
+        }
+        
+        Edit* last = mapping->edit_size() ? mapping->mutable_edit(mapping->edit_size() - 1) : nullptr;
+        switch (operation.first) {
+        case 'M':
+            if (g.node(node).sequence()[operation.second - node_starts[node]] != read[read_pos]) {
+                // a SNP
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(1);
+                edit->set_sequence(read.substr(read_pos, 1));
+            } else if (last && last->from_length() == last->to_length() && last->sequence().empty()) {
+                last->set_from_length(last->from_length() + 1);
+                last->set_to_length(last->to_length() + 1);
+            } else {
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(1);
+                edit->set_to_length(1);
+            }
+            read_pos++;
+            break;
+        case 'D':
+            if (last && last->to_length() == 0) {
+                last->set_from_length(last->from_length() + 1);
+            } else {
+                mapping->add_edit()->set_from_length(1);
+            }
+            break;
+        default:
+            if (last && last->from_length() == 0) {
+                last->set_to_length(last->to_length() + 1);
+                last->mutable_sequence()->push_back(read[read_pos]);
+            } else {
+                Edit* edit = mapping->add_edit();
+                edit->set_to_length(1);
+                edit->set_sequence(read.substr(read_pos, 1));
+            }
+            read_pos++;
+            break;
+        }
+    }
+    if (read_pos < read.size()) {
+        // soft clip the end
+        Edit* edit = mapping->add_edit();
+        edit->set_to_length(read.size() - read_pos);
+        edit->set_sequence(read.substr(read_pos));
+    }
+    
+    alignment.set_identity(identity(alignment.path()));
+}
+
+void Aligner::align_batch(const vector<pair<Alignment*, AlignableGraph*>>& jobs, bool traceback_aln) {
+    
+    // lay out each graph once, however many jobs share it
+    unordered_map<AlignableGraph*, size_t> graph_index;
+    vector<BatchGraph> batch_graphs;
+    vector<bool> graph_ok;
+    // the jobs that could be batched, by graph length and then order
+    vector<pair<size_t, size_t>> batchable;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        auto found = graph_index.find(jobs[i].second);
+        if (found == graph_index.end()) {
+            found = graph_index.emplace(jobs[i].second, batch_graphs.size()).first;
+            batch_graphs.emplace_back();
+            graph_ok.push_back(make_batch_graph(jobs[i].second->graph(), batch_graphs.back()));
+        }
+        const BatchGraph& batch_graph = batch_graphs[found->second];
+        if (graph_ok[found->second] && BatchAligner::fits(jobs[i].first->sequence().size(),
+                                                          batch_graph.sequence.size())) {
+            batchable.emplace_back(batch_graph.sequence.size(), i);
+        } else {
+            align(*jobs[i].first, *jobs[i].second, traceback_aln, false);
+        }
+    }
+    // graphs of about the same size waste the least of the lanes
+    sort(batchable.begin(), batchable.end());
+    
+    BatchAligner batch_aligner(match, mismatch, gap_open, gap_extension, full_length_bonus);
+    vector<BatchAlignmentJob> batch;
+    vector<size_t> batch_jobs;
+    vector<BatchAlignmentResult> results;
+    size_t next = 0;
+    while (next < batchable.size()) {
+        // take as many as will fit together
+        batch.clear();
+        batch_jobs.clear();
+        size_t max_read_length = 0;
+        size_t max_graph_length = 0;
+        for (; next < batchable.size() && batch.size() < BatchAligner::LANES; next++) {
+            size_t i = batchable[next].second;
+            const string& read = jobs[i].first->sequence();
+            const BatchGraph& batch_graph = batch_graphs[graph_index[jobs[i].second]];
+            if (!BatchAligner::fits_together(max(max_read_length, read.size()),
+                                             max(max_graph_length, batch_graph.sequence.size()))) {
+                break;
+            }
+            max_read_length = max(max_read_length, read.size());
+            max_graph_length = max(max_graph_length, batch_graph.sequence.size());
+            
+            batch.emplace_back();
+            BatchAlignmentJob& job = batch.back();
+            job.read = read.c_str();
+            job.read_length = read.size();
+            job.graph_sequence = batch_graph.sequence.c_str();
+            job.graph_length = batch_graph.sequence.size();
+            job.node_starts = &batch_graph.node_starts;
+            job.predecessors = &batch_graph.predecessors;
+            batch_jobs.push_back(i);
+        }
+        
+        if (batch.size() < MIN_BATCH_SIZE) {
+            for (size_t i : batch_jobs) {
+                align(*jobs[i].first, *jobs[i].second, traceback_aln, false);
+            }
+            continue;
+        }
+        
+        batch_aligner.align(batch, results, traceback_aln);
+        for (size_t j = 0; j < batch_jobs.size(); j++) {
+            size_t i = batch_jobs[j];
+            if (results[j].aligned) {
+                batch_result_to_alignment(results[j], jobs[i].second->graph(),
+                                          batch_graphs[graph_index[jobs[i].second]], *jobs[i].first, traceback_aln);
+            } else {
+                // it overflowed the lane, or aligned nothing, so let gssw say what it does
+                align(*jobs[i].first, *jobs[i].second, traceback_aln, false);
+            }
+        }
+    }
+}
+
 void Aligner::align_pinned(Alignment& alignment, Graph& g, bool pin_left) {
     
+    AlignableGraph alignable(g);
+    align_internal(alignment, nullptr, alignable, true, pin_left, 1, true, false);
+}
+
+void Aligner::align_pinned(Alignment& alignment, AlignableGraph& g, bool pin_left) {
+    
     align_internal(alignment, nullptr, g, true, pin_left, 1, true, false);
 }
 
@@ -974,120 +1345,22 @@ void Aligner::align_pinned_multi(Alignment& alignment, vector<Alignment>& alt_al
         exit(EXIT_FAILURE);
     }
     
-    align_internal(alignment, &alt_alignments, g, true, pin_left, max_alt_alns, true, false);
+    AlignableGraph alignable(g);
+    align_internal(alignment, &alt_alignments, alignable, true, pin_left, max_alt_alns, true, false);
 }
 
 void Aligner::align_global_banded(Alignment& alignment, Graph& g,
                                   int32_t band_padding, bool permissive_banding) {
     
-    // We need to figure out what size ints we need to use.
-    // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
-    int64_t best_score = alignment.sequence().size() * match;
-    size_t total_bases = 0;
-    for(size_t i = 0; i < g.node_size(); i++) {
-        total_bases += g.node(i).sequence().size();
-    }
-    int64_t worst_score = max(alignment.sequence().size(), total_bases) * -max(max(mismatch, gap_open), gap_extension);
-    
-    // TODO: put this all into another template somehow?
-    
-    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()) {
-        // We'll fit in int8
-        BandedGlobalAligner<int8_t> band_graph(alignment,
-                                               g,
-                                               band_padding,
-                                               permissive_banding,
-                                               false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
-        // We'll fit in int16
-        BandedGlobalAligner<int16_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
-        // We'll fit in int32
-        BandedGlobalAligner<int32_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else {
-        // Fall back to int64
-        BandedGlobalAligner<int64_t> band_graph(alignment,
-                                                g,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    }
-
+    align_global_banded_narrowest(alignment, g, nullptr, 1, band_padding, permissive_banding, false,
+                                  match, max(max(mismatch, gap_open), gap_extension));
 }
 
 void Aligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                         int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
-                                        
-    // We need to figure out what size ints we need to use.
-    // Get upper and lower bounds on the scores. TODO: if these overflow int64 we're out of luck
-    int64_t best_score = alignment.sequence().size() * match;
-    size_t total_bases = 0;
-    for(size_t i = 0; i < g.node_size(); i++) {
-        total_bases += g.node(i).sequence().size();
-    }
-    int64_t worst_score = max(alignment.sequence().size(), total_bases) * -max(max(mismatch, gap_open), gap_extension);
-    
-    if (best_score <= numeric_limits<int8_t>::max() && worst_score >= numeric_limits<int8_t>::min()) {
-        // We'll fit in int8
-        BandedGlobalAligner<int8_t> band_graph(alignment,
-                                               g,
-                                               alt_alignments,
-                                               max_alt_alns,
-                                               band_padding,
-                                               permissive_banding,
-                                               false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int16_t>::max() && worst_score >= numeric_limits<int16_t>::min()) {
-        // We'll fit in int16
-        BandedGlobalAligner<int16_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else if (best_score <= numeric_limits<int32_t>::max() && worst_score >= numeric_limits<int32_t>::min()) {
-        // We'll fit in int32
-        BandedGlobalAligner<int32_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    } else {
-        // Fall back to int64
-        BandedGlobalAligner<int64_t> band_graph(alignment,
-                                                g,
-                                                alt_alignments,
-                                                max_alt_alns,
-                                                band_padding,
-                                                permissive_banding,
-                                                false);
-        
-        band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
-    }
+    
+    align_global_banded_narrowest(alignment, g, &alt_alignments, max_alt_alns, band_padding, permissive_banding, false,
+                                  match, max(max(mismatch, gap_open), gap_extension));
 }
 
 // Scoring an exact match is very simple in an ordinary Aligner
@@ -1141,10 +1414,23 @@ QualAdjAligner::QualAdjAligner(int8_t _match,
     mismatch *= scale_factor;
     full_length_bonus *= scale_factor;
     
+    // the vectorized exact match scoring wants 32 bit tables
+    wide_score_matrix.assign(score_matrix, score_matrix + 25 * ((size_t) max_qual_score + 1));
+    wide_nt_table.assign(256, 4);
+    for (size_t i = 0; i < 128; i++) {
+        wide_nt_table[i] = nt_table[i];
+    }
+    
+    // the banded aligner picks its integer width from these, so don't scan the matrix on every alignment
+    max_base_score = *max_element(wide_score_matrix.begin(), wide_score_matrix.end());
+    max_base_penalty = max<int32_t>(max<int32_t>(-*min_element(wide_score_matrix.begin(), wide_score_matrix.end()),
+                                                 gap_open),
+                                    gap_extension);
+    
     BaseAligner::init_mapping_quality(gc_content);
 }
 
-void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
+void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, AlignableGraph& alignable,
                                     bool pinned, bool pin_left, int32_t max_alt_alns, bool traceback_aln, bool print_score_matrices) {
     
     // check input integrity
@@ -1164,30 +1450,24 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
     // alignment pinning algorithm is based on pinning in bottom right corner, if pinning in top
     // left we need to reverse all the sequences first and translate the alignment back later
     
-    // create reversed graph if necessary
-    Graph reversed_graph;
+    // choose forward or reversed objects, only copying the read if we need to reverse it
+    Graph& g = alignable.graph();
+    string reversed_sequence;
+    string reversed_quality;
     if (pin_left) {
-        reverse_graph(g, reversed_graph);
-    }
-    
-    // choose forward or reversed objects
-    // note: have to make copies of the strings because we will modify them to add a pinning point
-    Graph* align_graph = &g;
-    string align_sequence = alignment.sequence();
-    string align_quality = alignment.quality();
-    if (pin_left) {
-        align_graph = &reversed_graph;
-        reverse(align_sequence.begin(), align_sequence.end());
-        reverse(align_quality.begin(), align_quality.end());
+        reversed_sequence.assign(alignment.sequence().rbegin(), alignment.sequence().rend());
+        reversed_quality.assign(alignment.quality().rbegin(), alignment.quality().rend());
     }
+    const string& align_sequence = pin_left ? reversed_sequence : alignment.sequence();
+    const string& align_quality = pin_left ? reversed_quality : alignment.quality();
     
     if (align_quality.length() != align_sequence.length()) {
         cerr << "error:[QualAdjAligner] Read " << alignment.name() << " has sequence and quality strings with different lengths. Cannot perform base quality adjusted alignment. Consider toggling off base quality adjusted alignment at the command line." << endl;
         exit(EXIT_FAILURE);
     }
     
-    // convert into gssw graph and get dummy pinned node (if pinning)
-    gssw_graph* graph = create_gssw_graph(*align_graph);
+    // get the gssw graph, reversed if necessary
+    gssw_graph* graph = prepare_gssw_graph(alignable, pin_left);
     
     // perform dynamic programming
     // offer a full length bonus on each end, or only on the left if the right end is pinned.
@@ -1215,7 +1495,7 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
         
             if (pin_left) {
                 // translate graph and mappings into original node space
-                unreverse_graph(reversed_graph);
+                unreverse_graph(alignable.reversed);
                 for (int32_t i = 0; i < max_alt_alns; i++) {
                     unreverse_graph_mapping(gms[i]);
                 }
@@ -1290,6 +1570,11 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
                 gssw_graph_mapping_destroy(gms[i]);
             }
             free(gms);
+            
+            if (pin_left) {
+                // put the reversed sequences back for the next alignment
+                unreverse_graph(alignable.reversed);
+            }
         }
         else {
             // trace back local alignment
@@ -1318,83 +1603,68 @@ void QualAdjAligner::align_internal(Alignment& alignment, vector<Alignment>* mul
     
     //gssw_graph_print_score_matrices(graph, sequence.c_str(), sequence.size(), stderr);
     
-    gssw_graph_destroy(graph);
-    
 }
 
 void QualAdjAligner::align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices) {
     
+    AlignableGraph alignable(g);
+    align_internal(alignment, nullptr, alignable, false, false, 1, traceback_aln, print_score_matrices);
+}
+
+void QualAdjAligner::align(Alignment& alignment, AlignableGraph& g, bool traceback_aln, bool print_score_matrices) {
+    
     align_internal(alignment, nullptr, g, false, false, 1, traceback_aln, print_score_matrices);
 }
 
 void QualAdjAligner::align_pinned(Alignment& alignment, Graph& g, bool pin_left) {
 
+    AlignableGraph alignable(g);
+    align_internal(alignment, nullptr, alignable, true, pin_left, 1, true, false);
+
+}
+
+void QualAdjAligner::align_pinned(Alignment& alignment, AlignableGraph& g, bool pin_left) {
+
     align_internal(alignment, nullptr, g, true, pin_left, 1, true, false);
 
 }
 
 void QualAdjAligner::align_pinned_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                         bool pin_left, int32_t max_alt_alns) {
-    align_internal(alignment, &alt_alignments, g, true, pin_left, max_alt_alns, true, false);
+    AlignableGraph alignable(g);
+    align_internal(alignment, &alt_alignments, alignable, true, pin_left, max_alt_alns, true, false);
 }
 
 void QualAdjAligner::align_global_banded(Alignment& alignment, Graph& g,
                                          int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
-    
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    align_global_banded_narrowest(alignment, g, nullptr, 1, band_padding, permissive_banding, true,
+                                  max_base_score, max_base_penalty);
 }
 
 void QualAdjAligner::align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                                int32_t max_alt_alns, int32_t band_padding, bool permissive_banding) {
     
-    BandedGlobalAligner<int16_t> band_graph = BandedGlobalAligner<int16_t>(alignment,
-                                                                           g,
-                                                                           alt_alignments,
-                                                                           max_alt_alns,
-                                                                           band_padding,
-                                                                           permissive_banding,
-                                                                           true);
-    
-    band_graph.align(score_matrix, nt_table, gap_open, gap_extension);
+    align_global_banded_narrowest(alignment, g, &alt_alignments, max_alt_alns, band_padding, permissive_banding, true,
+                                  max_base_score, max_base_penalty);
 }
 
+// index 5 x 5 score matrices (ACGTN)
+// always have match so that row and column index are same and can combine algebraically
+
 int32_t QualAdjAligner::score_exact_match(const Alignment& aln, size_t read_offset, size_t length) {
-    auto& sequence = aln.sequence();
-    auto& base_quality = aln.quality();
-    int32_t score = 0;
-    for (int32_t i = 0; i < length; i++) {
-        // index 5 x 5 score matrices (ACGTN)
-        // always have match so that row and column index are same and can combine algebraically
-        score += score_matrix[25 * base_quality[read_offset + i] + 6 * nt_table[sequence[read_offset + i]]];
-    }
-    return score;
+    return sum_qual_adj_match_scores(aln.sequence().data() + read_offset, aln.quality().data() + read_offset, length,
+                                     wide_score_matrix.data(), wide_nt_table.data());
 }
 
 int32_t QualAdjAligner::score_exact_match(const string& sequence, const string& base_quality) const {
-    int32_t score = 0;
-    for (int32_t i = 0; i < sequence.length(); i++) {
-        // index 5 x 5 score matrices (ACGTN)
-        // always have match so that row and column index are same and can combine algebraically
-        score += score_matrix[25 * base_quality[i] + 6 * nt_table[sequence[i]]];
-    }
-    return score;
+    return sum_qual_adj_match_scores(sequence.data(), base_quality.data(), sequence.size(),
+                                     wide_score_matrix.data(), wide_nt_table.data());
 }
 
 
 int32_t QualAdjAligner::score_exact_match(string::const_iterator seq_begin, string::const_iterator seq_end,
                                           string::const_iterator base_qual_begin) const {
-    int32_t score = 0;
-    for (auto seq_iter = seq_begin, qual_iter = base_qual_begin; seq_iter != seq_end; seq_iter++) {
-        // index 5 x 5 score matrices (ACGTN)
-        // always have match so that row and column index are same and can combine algebraically
-        score += score_matrix[25 * (*qual_iter) + 6 * nt_table[*seq_iter]];
-        qual_iter++;
-    }
-    return score;
+    return sum_qual_adj_match_scores(&(*seq_begin), &(*base_qual_begin), seq_end - seq_begin,
+                                     wide_score_matrix.data(), wide_nt_table.data());
 }
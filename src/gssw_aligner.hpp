@@ -15,6 +15,7 @@
 #include "path.hpp"
 #include "utility.hpp"
 #include "banded_global_aligner.hpp"
+#include "batch_aligner.hpp"
 
 namespace vg {
 
@@ -27,6 +28,42 @@ namespace vg {
     static const uint8_t default_max_qual_score = 255;
     static const double default_gc_content = 0.5;
 
+    /**
+     * A Graph prepared for alignment with gssw. Converting a Graph copies and
+     * encodes every node sequence, so code that aligns to the same subgraph more
+     * than once (both orientations of a read, or a rescue and its traceback) can
+     * keep one of these to do the conversion only once per direction. The Graph
+     * must outlive it and must not change while it is in use. Not thread safe.
+     */
+    class AlignableGraph {
+    public:
+        AlignableGraph(Graph& g);
+        ~AlignableGraph();
+        
+        AlignableGraph(const AlignableGraph& other) = delete;
+        AlignableGraph& operator=(const AlignableGraph& other) = delete;
+        
+        /// Get the Graph that is being aligned to
+        Graph& graph();
+        
+    private:
+        friend class BaseAligner;
+        friend class Aligner;
+        friend class QualAdjAligner;
+        
+        /// A gssw graph and the score matrix of the aligner it was built for
+        struct Prepared {
+            gssw_graph* graph = nullptr;
+            const int8_t* score_matrix = nullptr;
+        };
+        
+        Graph& source;
+        /// The source graph reversed, for left-pinned alignment, made on demand
+        Graph reversed;
+        /// The forward and the reversed gssw graphs, built on demand
+        Prepared gssw_graphs[2];
+    };
+
     /**
      * The interface that any Aligner should implement, with some default implementations.
      */
@@ -38,11 +75,19 @@ namespace vg {
         // for construction
         // needed when constructing an alignable graph from the nodes
         gssw_graph* create_gssw_graph(Graph& g);
+        // get the (possibly reversed) gssw graph for an AlignableGraph, ready to be filled
+        gssw_graph* prepare_gssw_graph(AlignableGraph& alignable, bool reversed);
         void visit_node(gssw_node* node,
                         list<gssw_node*>& sorted_nodes,
                         set<gssw_node*>& unmarked_nodes,
                         set<gssw_node*>& temporary_marks);
         
+        // banded global alignment with the narrowest DP integer type that can hold the scores, given the
+        // best score and the worst penalty possible for a single base
+        void align_global_banded_narrowest(Alignment& alignment, Graph& g, vector<Alignment>* alt_alignments,
+                                           int32_t max_alt_alns, int32_t band_padding, bool permissive_banding,
+                                           bool qual_adjusted, int32_t max_base_score, int32_t max_base_penalty);
+        
         // create a reversed graph for left-pinned alignment
         void reverse_graph(Graph& g, Graph& reversed_graph_out);
         // reverse all node sequences (other aspects of graph object not unreversed)
@@ -72,14 +117,26 @@ namespace vg {
         
     public:
 
-        double max_possible_mapping_quality(int length);
-        double estimate_max_possible_mapping_quality(int length, double min_diffs, double next_min_diffs);
+        /// The fast approximate mapping quality of a perfect match of this length,
+        /// which is just a lookup of coefficients set up in init_mapping_quality
+        double max_possible_mapping_quality(int length) const;
+        /// The fast approximate mapping quality of an alignment with min_diffs mismatches
+        /// over one with next_min_diffs mismatches, costing the same as above
+        double estimate_max_possible_mapping_quality(int length, double min_diffs, double next_min_diffs) const;
         
         /// Store optimal local alignment against a graph in the Alignment object.
         /// Gives the full length bonus separately on each end of the alignment.
         /// Assumes that graph is topologically sorted by node index.
         virtual void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices) = 0;
         
+        /// Same as above, but reuses the gssw graph in an AlignableGraph.
+        virtual void align(Alignment& alignment, AlignableGraph& g, bool traceback_aln, bool print_score_matrices) = 0;
+        
+        /// Store the optimal local alignment of each of a batch of alignments against its own graph, as
+        /// align() would. Aligners that can align short reads to small graphs many at a time, a SIMD lane
+        /// each, do so, and the rest are aligned one by one. Several jobs may share a graph.
+        virtual void align_batch(const vector<pair<Alignment*, AlignableGraph*>>& jobs, bool traceback_aln);
+        
         // store optimal alignment against a graph in the Alignment object with one end of the sequence
         // guaranteed to align to a source/sink node
         //
@@ -92,6 +149,9 @@ namespace vg {
         // assumes that graph is topologically sorted by node index
         virtual void align_pinned(Alignment& alignment, Graph& g, bool pin_left) = 0;
         
+        // same as above, but reuses the gssw graph in an AlignableGraph
+        virtual void align_pinned(Alignment& alignment, AlignableGraph& g, bool pin_left) = 0;
+        
         // store the top scoring pinned alignments in the vector in descending score order up to a maximum
         // number of alignments (including the optimal one). if there are fewer than the maximum number in
         // the return value, then it includes all alignments with a positive score. the optimal alignment
@@ -211,6 +271,11 @@ namespace vg {
         // log of the base of the logarithm underlying the log-odds interpretation of the scores
         double log_base = 0.0;
         
+        // the approximate mapping quality of each base of a perfect match, and of
+        // each mismatch between two otherwise perfect alignments
+        double max_mapping_quality_per_base = 0.0;
+        double mapping_quality_per_diff = 0.0;
+        
     };
     
     /**
@@ -220,7 +285,7 @@ namespace vg {
     private:
         
         // internal function interacting with gssw for pinned and local alignment
-        void align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
+        void align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, AlignableGraph& alignable,
                             bool pinned, bool pin_left, int32_t max_alt_alns,
                             bool traceback_aln,
                             bool print_score_matrices);
@@ -238,6 +303,14 @@ namespace vg {
         /// Gives the full length bonus separately on each end of the alignment.
         /// Assumes that graph is topologically sorted by node index.
         void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices);
+        void align(Alignment& alignment, AlignableGraph& g, bool traceback_aln, bool print_score_matrices);
+        
+        /// Aligns the jobs whose reads and graphs are small enough in batches with a BatchAligner, and
+        /// the rest, or any the batches couldn't score in 8 bits, with gssw.
+        void align_batch(const vector<pair<Alignment*, AlignableGraph*>>& jobs, bool traceback_aln);
+        
+        /// Batches of fewer jobs than this are left to gssw, which is faster for them
+        static const size_t MIN_BATCH_SIZE = 4;
         
         // store optimal alignment against a graph in the Alignment object with one end of the sequence
         // guaranteed to align to a source/sink node
@@ -250,6 +323,7 @@ namespace vg {
         //
         // assumes that graph is topologically sorted by node index
         void align_pinned(Alignment& alignment, Graph& g, bool pin_left);
+        void align_pinned(Alignment& alignment, AlignableGraph& g, bool pin_left);
                 
         // store the top scoring pinned alignments in the vector in descending score order up to a maximum
         // number of alignments (including the optimal one). if there are fewer than the maximum number in
@@ -302,9 +376,11 @@ namespace vg {
 
         // base quality adjusted counterparts to functions of same name from Aligner
         void align(Alignment& alignment, Graph& g, bool traceback_aln, bool print_score_matrices);
+        void align(Alignment& alignment, AlignableGraph& g, bool traceback_aln, bool print_score_matrices);
         void align_global_banded(Alignment& alignment, Graph& g,
                                  int32_t band_padding = 0, bool permissive_banding = true);
         void align_pinned(Alignment& alignment, Graph& g, bool pin_left);
+        void align_pinned(Alignment& alignment, AlignableGraph& g, bool pin_left);
         void align_global_banded_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
                                        int32_t max_alt_alns, int32_t band_padding = 0, bool permissive_banding = true);
         void align_pinned_multi(Alignment& alignment, vector<Alignment>& alt_alignments, Graph& g,
@@ -322,8 +398,17 @@ namespace vg {
         int8_t scale_factor;
         
     private:
+        
+        /// The score matrix and nucleotide table widened to 32 bits, for vectorized lookups
+        vector<int32_t> wide_score_matrix;
+        vector<int32_t> wide_nt_table;
+        
+        /// The best score and the worst penalty for any base at any quality, found once from the
+        /// score matrix when it is built
+        int32_t max_base_score;
+        int32_t max_base_penalty;
 
-        void align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, Graph& g,
+        void align_internal(Alignment& alignment, vector<Alignment>* multi_alignments, AlignableGraph& alignable,
                             bool pinned, bool pin_left, int32_t max_alt_alns,
                             bool traceback_aln,
                             bool print_score_matrices);
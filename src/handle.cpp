@@ -21,6 +21,43 @@ handle_t HandleGraph::forward(const handle_t& handle) const {
     return this->get_is_reverse(handle) ? this->flip(handle) : handle;
 }
 
+string sequence_view_t::substr(size_t pos, size_t len) const {
+    len = min(len, length - pos);
+    if (!is_reverse) {
+        return string(bases + pos, len);
+    }
+    string piece(len, '\0');
+    for (size_t i = 0; i < len; i++) {
+        piece[i] = (*this)[pos + i];
+    }
+    return piece;
+}
+
+bool HandleGraph::get_sequence_view(const handle_t& handle, sequence_view_t& view_out) const {
+    return false;
+}
+
+char HandleGraph::get_base(const handle_t& handle, size_t index) const {
+    return this->get_sequence(handle)[index];
+}
+
+void HandleGraph::copy_sequence(const handle_t& handle, char* buffer) const {
+    string sequence = this->get_sequence(handle);
+    copy(sequence.begin(), sequence.end(), buffer);
+}
+
+sequence_view_t HandleGraph::view_sequence(const handle_t& handle, string& buffer) const {
+    sequence_view_t view;
+    if (!this->get_sequence_view(handle, view)) {
+        buffer.resize(this->get_length(handle));
+        this->copy_sequence(handle, &buffer[0]);
+        view.bases = buffer.data();
+        view.length = buffer.size();
+        view.is_reverse = false;
+    }
+    return view;
+}
+
 pair<handle_t, handle_t> HandleGraph::edge_handle(const handle_t& left, const handle_t& right) const {
     // The degeneracy is between any pair and a pair of the same nodes but reversed in order and orientation.
     // We compare those two pairs and construct the smaller one.
@@ -9,6 +9,7 @@
  */
 
 #include "types.hpp"
+#include "utility.hpp"
 #include "vg.pb.h"
 #include <functional>
 #include <cstdint>
@@ -84,6 +85,29 @@ namespace vg {
 
 using namespace std;
 
+/**
+ * A view of a node's bases without a copy: a span of the stored forward
+ * strand sequence, plus whether to read it reverse complemented. Only valid
+ * until the graph that made it is modified.
+ */
+struct sequence_view_t {
+    const char* bases = nullptr;
+    size_t length = 0;
+    bool is_reverse = false;
+    
+    inline size_t size() const {
+        return length;
+    }
+    
+    /// Get the base at the given offset in the viewed orientation.
+    inline char operator[](size_t i) const {
+        return is_reverse ? reverse_complement(bases[length - 1 - i]) : bases[i];
+    }
+    
+    /// Copy out part of the sequence in the viewed orientation.
+    string substr(size_t pos, size_t len = string::npos) const;
+};
+
 /**
  * This is the interface that a graph that uses handles needs to support.
  * It is also the interface that users should code against.
@@ -119,6 +143,25 @@ public:
     /// continue. Returns true if we finished and false if we stopped early.
     virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const = 0;
     
+    ////////////////////////////////////////////////////////////////////////////
+    // Sequence access without copies, which implementations can speed up
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// Point the view at the node's bases, in the handle's orientation,
+    /// without copying them. Returns false and leaves the view alone if the
+    /// graph doesn't store sequences as plain characters. By default, no
+    /// views are available.
+    virtual bool get_sequence_view(const handle_t& handle, sequence_view_t& view_out) const;
+    
+    /// Get the base at the given offset in the handle's local forward
+    /// orientation. By default this goes through get_sequence.
+    virtual char get_base(const handle_t& handle, size_t index) const;
+    
+    /// Write the node's sequence, in the handle's orientation, into a buffer
+    /// with room for get_length(handle) characters. By default this goes
+    /// through get_sequence.
+    virtual void copy_sequence(const handle_t& handle, char* buffer) const;
+    
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const = 0;
@@ -181,6 +224,20 @@ public:
         for_each_handle(lambda, parallel);
     }
     
+    /// Loop over all the handles to next/previous (right/left) nodes, with an
+    /// iteratee of any type that returns false to stop. Through a HandleGraph
+    /// this just calls the virtual follow_edges. Implementations hide it with
+    /// their own inline version, so that algorithms templated on the concrete
+    /// graph type can follow edges without a virtual call or a
+    /// std::function call per edge.
+    template <typename Iteratee>
+    inline bool follow_edges_inline(const handle_t& handle, bool go_left, Iteratee&& iteratee) const {
+        const function<bool(const handle_t&)> lambda = [&](const handle_t& found) {
+            return iteratee(found);
+        };
+        return follow_edges(handle, go_left, lambda);
+    }
+    
     ////////////////////////////////////////////////////////////////////////////
     // Concrete utility methods
     ////////////////////////////////////////////////////////////////////////////
@@ -195,6 +252,11 @@ public:
     /// Get the locally forward version of a handle
     handle_t forward(const handle_t& handle) const;
     
+    /// Get a view of the node's bases in the handle's orientation, using the
+    /// graph's own storage if it can, and otherwise copying them into the
+    /// given buffer. Reusing one buffer across calls avoids allocating.
+    sequence_view_t view_sequence(const handle_t& handle, string& buffer) const;
+    
     // A pair of handles can be used as an edge. When so used, the handles have a
     // cannonical order and orientation.
     edge_t edge_handle(const handle_t& left, const handle_t& right) const;
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include "vg.hpp"
 #include "haplotype_extracter.hpp"
 #include "json2pb.h"
@@ -11,10 +12,13 @@ void trace_haplotypes_and_paths(xg::XG& index,
                                 vg::id_t start_node, int extend_distance,
                                 Graph& out_graph,
                                 map<string, int>& out_thread_frequencies,
-                                bool expand_graph) {
+                                bool expand_graph,
+                                const gbwt::GBWT* haplotype_index) {
   // get our haplotypes
   xg::XG::ThreadMapping n = {start_node, false};
-  vector<pair<thread_t,int> > haplotypes = list_haplotypes(index, n, extend_distance);
+  vector<pair<thread_t,int> > haplotypes = haplotype_index ?
+    list_haplotypes(index, *haplotype_index, n, extend_distance) :
+    list_haplotypes(index, n, extend_distance);
 
   if (expand_graph) {
     // get our subgraph and "regular" paths by expanding forward
@@ -46,11 +50,11 @@ void output_haplotype_counts(ostream& annotation_ostream,
 
 Graph output_graph_with_embedded_paths(vector<pair<thread_t,int>>& haplotype_list, xg::XG& index) {
   Graph g;
-  set<int64_t> nodes;
-  set<pair<int,int> > edges;
+  vector<int64_t> nodes;
+  vector<pair<xg::side_t, xg::side_t> > edges;
   for(int i = 0; i < haplotype_list.size(); i++) {
-    add_thread_nodes_to_set(haplotype_list[i].first, nodes);
-    add_thread_edges_to_set(haplotype_list[i].first, edges);
+    add_thread_nodes(haplotype_list[i].first, nodes);
+    add_thread_edges(haplotype_list[i].first, edges);
   }
   construct_graph_from_nodes_and_edges(g, index, nodes, edges);
   for(int i = 0; i < haplotype_list.size(); i++) {
@@ -75,52 +79,41 @@ void output_graph_with_embedded_paths(ostream& subgraph_ostream,
 }
 
 void thread_to_graph_spanned(thread_t& t, Graph& g, xg::XG& index) {
-  set<int64_t> nodes;
-  set<pair<int,int> > edges;
-  nodes.insert(t[0].node_id);
-  for(int i = 1; i < t.size(); i++) {
-    nodes.insert(t[i].node_id);
-    edges.insert(make_pair(xg::make_side(t[i-1].node_id,t[i-1].is_reverse), 
-              xg::make_side(t[i].node_id,t[i].is_reverse)));
-	}
- 	for (auto& n : nodes) {
-    *g.add_node() = index.node(n);
- 	}
-  for (auto& e : edges) {
-    Edge edge;
-    edge.set_from(xg::side_id(e.first));
-    edge.set_from_start(xg::side_is_end(e.first));
-    edge.set_to(xg::side_id(e.second));
-    edge.set_to_end(xg::side_is_end(e.second));
-    *g.add_edge() = edge;
-  }
+  vector<int64_t> nodes;
+  vector<pair<xg::side_t, xg::side_t> > edges;
+  add_thread_nodes(t, nodes);
+  add_thread_edges(t, edges);
+  construct_graph_from_nodes_and_edges(g, index, nodes, edges);
 }
 
-void add_thread_nodes_to_set(thread_t& t, set<int64_t>& nodes) {
+void add_thread_nodes(thread_t& t, vector<int64_t>& nodes) {
   for(int i = 0; i < t.size(); i++) {
-    nodes.insert(t[i].node_id);
+    nodes.push_back(t[i].node_id);
   }
 }
 
-void add_thread_edges_to_set(thread_t& t, set<pair<int,int> >& edges) {
+void add_thread_edges(thread_t& t, vector<pair<xg::side_t, xg::side_t> >& edges) {
   for(int i = 1; i < t.size(); i++) {
-    edges.insert(make_pair(xg::make_side(t[i-1].node_id,t[i-1].is_reverse), 
+    edges.push_back(make_pair(xg::make_side(t[i-1].node_id,t[i-1].is_reverse),
               xg::make_side(t[i].node_id,t[i].is_reverse)));
   }
 }
 
 void construct_graph_from_nodes_and_edges(Graph& g, xg::XG& index,
-            set<int64_t>& nodes, set<pair<int,int> >& edges) {
+            vector<int64_t>& nodes, vector<pair<xg::side_t, xg::side_t> >& edges) {
+  sort(nodes.begin(), nodes.end());
+  nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+  sort(edges.begin(), edges.end());
+  edges.erase(unique(edges.begin(), edges.end()), edges.end());
   for (auto& n : nodes) {
-	   *g.add_node() = index.node(n);
- 	}
+    *g.add_node() = index.node(n);
+  }
   for (auto& e : edges) {
-    Edge edge;
-    edge.set_from(xg::side_id(e.first));
-    edge.set_from_start(xg::side_is_end(e.first));
-    edge.set_to(xg::side_id(e.second));
-    edge.set_to_end(xg::side_is_end(e.second));
-    *g.add_edge() = edge;
+    Edge* edge = g.add_edge();
+    edge->set_from(xg::side_id(e.first));
+    edge->set_from_start(xg::side_is_end(e.first));
+    edge->set_to(xg::side_id(e.second));
+    edge->set_to_end(xg::side_is_end(e.second));
   }
 }
 
@@ -141,13 +134,18 @@ Path path_from_thread_t(thread_t& t) {
   return toReturn;
 }
 
-vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
+// Walk forward from start_node through the xg's edges, following the
+// haplotypes with a search state that can be from the gPBWT or a GBWT. The
+// search backend provides find(node) to start a search, extend(state, node),
+// empty(state) and count(state).
+template<class Search>
+static vector<pair<thread_t,int> > list_haplotypes_with(xg::XG& index, const Search& search,
             xg::XG::ThreadMapping start_node, int extend_distance) {
-  vector<pair<thread_t,xg::XG::ThreadSearchState> > search_intermediates;
+  typedef typename Search::State State;
+  vector<pair<thread_t,State> > search_intermediates;
   vector<pair<thread_t,int> > search_results;
   thread_t first_thread = {start_node};
-  xg::XG::ThreadSearchState first_state;
-  index.extend_search(first_state,first_thread);
+  State first_state = search.find(start_node);
   vector<Edge> edges = start_node.is_reverse ?
             index.edges_on_start(start_node.node_id) :
             index.edges_on_end(start_node.node_id);
@@ -155,37 +153,33 @@ vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
     xg::XG::ThreadMapping next_node;
     next_node.node_id = edges[i].to();
     next_node.is_reverse = edges[i].to_end();
-    xg::XG::ThreadSearchState new_state = first_state;
-    thread_t t = {next_node};
-    index.extend_search(new_state, t);
+    State new_state = search.extend(first_state, next_node);
     thread_t new_thread = first_thread;
     new_thread.push_back(next_node);
-    if(!new_state.is_empty()) {
+    if(!search.empty(new_state)) {
       search_intermediates.push_back(make_pair(new_thread,new_state));
     }
   }
   while(search_intermediates.size() > 0) {
-    pair<thread_t,xg::XG::ThreadSearchState> last = search_intermediates.back();
+    pair<thread_t,State> last = search_intermediates.back();
     search_intermediates.pop_back();
     int check_size = search_intermediates.size();
     vector<Edge> edges = last.first.back().is_reverse ?
               index.edges_on_start(last.first.back().node_id) :
               index.edges_on_end(last.first.back().node_id);
     if(edges.size() == 0) {
-      search_results.push_back(make_pair(last.first,last.second.count()));
+      search_results.push_back(make_pair(last.first,search.count(last.second)));
     } else {
       for(int i = 0; i < edges.size(); i++) {
         xg::XG::ThreadMapping next_node;
         next_node.node_id = edges[i].to();
         next_node.is_reverse = edges[i].to_end();
-        xg::XG::ThreadSearchState new_state = last.second;
-        thread_t next_thread = {next_node};
-        index.extend_search(new_state,next_thread);
+        State new_state = search.extend(last.second, next_node);
         thread_t new_thread = last.first;
         new_thread.push_back(next_node);
-        if(!new_state.is_empty()) {
+        if(!search.empty(new_state)) {
           if(new_thread.size() >= extend_distance) {
-            search_results.push_back(make_pair(new_thread,new_state.count()));
+            search_results.push_back(make_pair(new_thread,search.count(new_state)));
           } else {
             search_intermediates.push_back(make_pair(new_thread,new_state));
           }
@@ -193,9 +187,60 @@ vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
       }
       if(check_size == search_intermediates.size() &&
                 last.first.size() < extend_distance - 1) {
-        search_results.push_back(make_pair(last.first,last.second.count()));
+        search_results.push_back(make_pair(last.first,search.count(last.second)));
       }
     }
   }
   return search_results;
 }
+
+// Haplotype search in the xg's gPBWT
+struct XGThreadSearch {
+  typedef xg::XG::ThreadSearchState State;
+  xg::XG& index;
+  State find(const xg::XG::ThreadMapping& node) const {
+    State state;
+    thread_t t = {node};
+    index.extend_search(state, t);
+    return state;
+  }
+  State extend(State state, const xg::XG::ThreadMapping& node) const {
+    thread_t t = {node};
+    index.extend_search(state, t);
+    return state;
+  }
+  bool empty(const State& state) const {
+    return state.is_empty();
+  }
+  int count(const State& state) const {
+    return state.count();
+  }
+};
+
+// Haplotype search in a GBWT
+struct GBWTThreadSearch {
+  typedef gbwt::SearchState State;
+  const gbwt::GBWT& index;
+  State find(const xg::XG::ThreadMapping& node) const {
+    return index.find(gbwt::Node::encode(node.node_id, node.is_reverse));
+  }
+  State extend(const State& state, const xg::XG::ThreadMapping& node) const {
+    return index.extend(state, gbwt::Node::encode(node.node_id, node.is_reverse));
+  }
+  bool empty(const State& state) const {
+    return state.empty();
+  }
+  int count(const State& state) const {
+    return state.size();
+  }
+};
+
+vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
+            xg::XG::ThreadMapping start_node, int extend_distance) {
+  return list_haplotypes_with(index, XGThreadSearch{index}, start_node, extend_distance);
+}
+
+vector<pair<thread_t,int> > list_haplotypes(xg::XG& index, const gbwt::GBWT& haplotype_index,
+            xg::XG::ThreadMapping start_node, int extend_distance) {
+  return list_haplotypes_with(index, GBWTThreadSearch{haplotype_index}, start_node, extend_distance);
+}
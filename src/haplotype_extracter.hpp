@@ -6,6 +6,8 @@
 #include <iostream>
 #include <vector>
 
+#include <gbwt/gbwt.h>
+
 #include "vg.pb.h"
 #include "xg.hpp"
 
@@ -17,11 +19,13 @@ using thread_t = vector<xg::XG::ThreadMapping>;
 // subgraph search for all the paths too.  Haplotype thread i will be
 // embedded as Paths a path with name thread_i.
 // Each path name (including threads) is mapped to a frequency in out_thread_frequencies
+// If a GBWT is given, the haplotypes are searched in it instead of the xg's gPBWT.
 void trace_haplotypes_and_paths(xg::XG& index,
                                 vg::id_t start_node, int extend_distance,
                                 Graph& out_graph,
                                 map<string, int>& out_thread_frequencies,
-                                bool expand_graph = true);
+                                bool expand_graph = true,
+                                const gbwt::GBWT* haplotype_index = nullptr);
 
 // Turns an (xg-based) thread_t into a (vg-based) Path
 Path path_from_thread_t(thread_t& t);
@@ -32,6 +36,10 @@ Path path_from_thread_t(thread_t& t);
 // subhaplotype
 vector<pair<thread_t,int> > list_haplotypes(xg::XG& index,
             xg::XG::ThreadMapping start_node, int extend_distance);
+// The same, but searching for the haplotypes in a GBWT. The graph topology
+// still comes from the xg index.
+vector<pair<thread_t,int> > list_haplotypes(xg::XG& index, const gbwt::GBWT& haplotype_index,
+            xg::XG::ThreadMapping start_node, int extend_distance);
 
 // writes to subgraph_ostream the subgraph covered by
 // the haplotypes in haplotype_list, as well as these haplotypes embedded as
@@ -48,12 +56,13 @@ void output_haplotype_counts(ostream& annotation_ostream,
 
 // Adds to a Graph the nodes and edges touched by a thread_t
 void thread_to_graph_spanned(thread_t& t, Graph& graph, xg::XG& index);
-// Adds to a set of nodes all those touched by thread_t t
-void add_thread_nodes_to_set(thread_t& t, set<int64_t>& nodes);
-// Adds to a set of edges all those touched by thread_t t
-void add_thread_edges_to_set(thread_t& t, set<pair<int,int> >& edges);
-// Turns a set of nodes and a set of edges into a Graph
+// Adds to a vector of nodes all those touched by thread_t t
+void add_thread_nodes(thread_t& t, vector<int64_t>& nodes);
+// Adds to a vector of edges (as pairs of sides) all those touched by thread_t t
+void add_thread_edges(thread_t& t, vector<pair<xg::side_t, xg::side_t> >& edges);
+// Turns a vector of nodes and a vector of edges, which may contain duplicates
+// in any order, into a Graph. Sorts and deduplicates the vectors.
 void construct_graph_from_nodes_and_edges(Graph& g, xg::XG& index,
-            set<int64_t>& nodes, set<pair<int,int> >& edges);
+            vector<int64_t>& nodes, vector<pair<xg::side_t, xg::side_t> >& edges);
 
 #endif
@@ -253,6 +253,27 @@ int_itvl_t int_itvl_t::intersection(const int_itvl_t& A, const int_itvl_t& B) {
 haplo_DP_column
 *******************************************************************************/
 
+haplo_DP_column::haplo_DP_column(const haplo_DP_column& other) {
+  *this = other;
+}
+
+haplo_DP_column& haplo_DP_column::operator=(const haplo_DP_column& other) {
+  if(this != &other) {
+    previous_values = other.previous_values;
+    previous_sizes = other.previous_sizes;
+    previous_sum = other.previous_sum;
+    sum = other.sum;
+    length = other.length;
+    // the rectangles are extended in place, so each copy needs its own
+    entries.clear();
+    entries.reserve(other.entries.size());
+    for(auto& entry : other.entries) {
+      entries.push_back(make_shared<haplo_DP_rectangle>(*entry));
+    }
+  }
+  return *this;
+}
+
 haplo_DP_column::~haplo_DP_column() {
 }
 
@@ -403,6 +424,21 @@ haplo_DP_column* haplo_DP::get_current_column() {
   return &DP_column;
 }
 
+/*******************************************************************************
+haplo_DP_prefix_cache
+*******************************************************************************/
+
+const size_t haplo_DP_prefix_cache::NO_PREFIX;
+
+void haplo_DP_prefix_cache::clear() {
+  children.clear();
+  columns.clear();
+}
+
+size_t haplo_DP_prefix_cache::size() const {
+  return columns.size();
+}
+
 /*******************************************************************************
 path conversion
 *******************************************************************************/
@@ -435,11 +471,19 @@ RRMemo::RRMemo(double recombination_penalty, size_t population_size) :
 
   // log versions
   logT_base = log1p(-exp_rho);
+  log_population = log(population_size);
+  logS_bases.reserve(population_size);
+  log_heights.reserve(population_size);
   for(int i = 0; i < population_size; i++) {
     logS_bases.push_back(log1p(i*exp_rho));
+    log_heights.push_back(log(i + 1));
   }
 }
 
+size_t RRMemo::get_population_size() const {
+  return population_size;
+}
+
 double logdiff(double a, double b) {
   if(b > a) {
     double c = a;
@@ -520,7 +564,7 @@ double RRMemo::logS(int height, int width) {
 }
 
 double RRMemo::logRRDiff(int height, int width) {
-  return haploMath::logdiff(logS(height,width),logT(width)) - log(height);
+  return haploMath::logdiff(logS(height,width),logT(width)) - log_heights[height-1];
 }
 
 double RRMemo::log_continue_factor(int64_t totwidth) {
@@ -532,7 +576,7 @@ double RRMemo::log_recombination_penalty() {
 }
 
 double RRMemo::log_population_size() {
-  return log(population_size);
+  return log_population;
 }
 
 } // namespace haploMath
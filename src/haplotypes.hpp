@@ -4,6 +4,8 @@
 #include <cmath>
 #include <vector>
 #include <iostream>
+#include <limits>
+#include <unordered_map>
 
 #include "vg.pb.h"
 #include "xg.hpp"
@@ -11,6 +13,8 @@
 #include <gbwt/gbwt.h>
 #include <gbwt/dynamic_gbwt.h>
 
+#include "hash_map.hpp"
+
 using namespace std;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -36,6 +40,9 @@ using namespace std;
 //             b. gbwt::GBWT
 //             c. gbwt::DynamicGBWT
 //        iii. haploMath::RRMemo
+//        iv.  optionally, a haplo_DP_prefix_cache, to reuse the work done on
+//             any prefix that earlier queries (ie other candidate alignments
+//             of the same read) had in common with this one; a GBWT only
 //    and returns an output
 //        pair<double, bool> where
 //             arg 1  double  log(calculate probability)
@@ -59,8 +66,10 @@ namespace haploMath{
   //  RRMemo
   //  Created by Jordan Eizenga on 6/21/16
   // ---------------------------------------------------------------------------
-  //  Stores memoized values of constants and scaling factors which are used in
-  //  the forward matrix extension
+  //  Stores precomputed values of constants and scaling factors which are used
+  //  in the forward matrix extension. Every table is filled in up front for the
+  //  population size, so one RRMemo can be kept and reused for every query
+  //  against the same population.
   // ---------------------------------------------------------------------------
   //
   //
@@ -73,11 +82,15 @@ namespace haploMath{
     // LOG SPACE CONSTANTS -----------------------------------------------------
     double rho;                              // log space recombination penalty
     double log_continue_probability;         // 
+    double log_population;                   // log(population_size)
     std::vector<double> logS_bases;
+    std::vector<double> log_heights;         // log(i + 1) for each height i + 1
 
   public:
     RRMemo(double recombination_penalty, size_t population_size);
 
+    size_t get_population_size() const;
+
     double log_population_size();
     double log_recombination_penalty();
     double log_continue_factor(int64_t totwidth);
@@ -240,9 +253,9 @@ private:
   vector<double> previous_values;
   vector<int64_t> previous_sizes;
   vector<shared_ptr<haplo_DP_rectangle>> entries;
-  double previous_sum;
-  double sum;
-  double length;
+  double previous_sum = 0.0;
+  double sum = 0.0;
+  double length = 0.0;
   template<class accessorType>
   void binary_extend_intervals(accessorType& ga, 
                                int_itvl_t indices, 
@@ -256,6 +269,9 @@ private:
 public:
   template<class accessorType>
   haplo_DP_column(accessorType& ga);
+  // copies are deep, so that extending a copy leaves the original alone
+  haplo_DP_column(const haplo_DP_column& other);
+  haplo_DP_column& operator=(const haplo_DP_column& other);
   ~haplo_DP_column();
   template<class accessorType>
   void extend(accessorType& ga);
@@ -278,6 +294,25 @@ thread_t path_to_thread_t(const vg::Path& path);
 typedef pair<double, bool> haplo_score_type;
 //------------------------------------------------------------------------------
 
+// Remembers the DP column after each prefix of the GBWT threads scored with
+// it, as a trie, so that scoring a thread that shares a prefix with an earlier
+// one starts from the end of the shared prefix. Meant to be kept by one thread
+// and cleared between reads.
+struct haplo_DP_prefix_cache {
+  // the trie parent of a first node
+  static const size_t NO_PREFIX = numeric_limits<size_t>::max();
+  
+  // the trie index of each (parent prefix, (node, node length)) extension
+  unordered_map<pair<size_t, pair<gbwt::node_type, size_t>>, size_t> children;
+  // the DP column after each prefix, by trie index
+  vector<haplo_DP_column> columns;
+  
+  void clear();
+  size_t size() const;
+};
+
+//------------------------------------------------------------------------------
+
 struct haplo_DP {
 private:
   haplo_DP_column DP_column;
@@ -287,6 +322,9 @@ public:
   static haplo_score_type score(const vg::Path& path, xg::XG& graph, haploMath::RRMemo& memo);
   template<class GBWTType>
   static haplo_score_type score(const vg::Path& path, GBWTType& graph, haploMath::RRMemo& memo);
+  template<class GBWTType>
+  static haplo_score_type score(const vg::Path& path, GBWTType& graph, haploMath::RRMemo& memo,
+                                haplo_DP_prefix_cache& cache);
 //------------------------------------------------------------------------------
 
 // public member functions which are not part of the API
@@ -296,6 +334,9 @@ public:
   static haplo_score_type score(const thread_t& thread, xg::XG& graph, haploMath::RRMemo& memo);
   template<class GBWTType>
   static haplo_score_type score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo);
+  template<class GBWTType>
+  static haplo_score_type score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo,
+                                haplo_DP_prefix_cache& cache);
 };
 
 
@@ -481,6 +522,76 @@ haplo_score_type haplo_DP::score(const gbwt_thread_t& thread, GBWTType& graph, h
   return pair<double, bool>(hdp.DP_column.current_sum(), true);
 }
 
+template<class GBWTType>
+haplo_score_type haplo_DP::score(const vg::Path& path, GBWTType& graph, haploMath::RRMemo& memo,
+                                 haplo_DP_prefix_cache& cache) {
+  return score(path_to_gbwt_thread_t(path), graph, memo, cache);
+}
+
+template<class GBWTType>
+haplo_score_type haplo_DP::score(const gbwt_thread_t& thread, GBWTType& graph, haploMath::RRMemo& memo,
+                                 haplo_DP_prefix_cache& cache) {
+  // walk down the trie as far as this thread has been scored before
+  size_t prefix = haplo_DP_prefix_cache::NO_PREFIX;
+  size_t scored = 0;
+  while(scored < thread.size()) {
+    auto found = cache.children.find(make_pair(prefix, make_pair(thread[scored], thread.nodelength(scored))));
+    if(found == cache.children.end()) {
+      break;
+    }
+    prefix = found->second;
+    scored++;
+  }
+  if(scored == thread.size()) {
+    return pair<double, bool>(cache.columns[prefix].current_sum(), true);
+  }
+  
+  // remember each prefix as we score it
+  auto remember = [&](const haplo_DP_column& column, size_t i) {
+    cache.children[make_pair(prefix, make_pair(thread[i], thread.nodelength(i)))] = cache.columns.size();
+    prefix = cache.columns.size();
+    cache.columns.push_back(column);
+  };
+  
+  if(scored == 0) {
+    if (!graph.contains(thread[0])) {
+      // We start on a node that has no haplotype index entry
+      cerr << "[WARNING] Path starts outside of haplotype index and cannot be scored" << endl;
+      cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+      return pair<double, bool>(nan(""), false);
+    }
+    hDP_gbwt_graph_accessor<GBWTType> ga_i(graph, thread[0], thread.nodelength(0), memo);
+    if(ga_i.new_height() == 0) {
+      cerr << "[WARNING] Initial node in path is visited by 0 reference haplotypes" << endl;
+      cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+      ga_i.print(cerr);
+      return pair<double, bool>(nan(""), false);
+    }
+    remember(haplo_DP_column(ga_i), 0);
+    scored = 1;
+  }
+  
+  haplo_DP_column column = cache.columns[prefix];
+  for(size_t i = scored; i < thread.size(); i++) {
+    if (!graph.contains(thread[i])) {
+      cerr << "[WARNING] Node " << i + 1 << " in path leaves haplotype index and cannot be scored" << endl;
+      cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+      return pair<double, bool>(nan(""), false);
+    }
+    hDP_gbwt_graph_accessor<GBWTType> ga(graph, thread[i-1], thread[i], thread.nodelength(i), memo);
+    if(ga.new_height() == 0) {
+      cerr << "[WARNING] Node " << i + 1 << " in path is visited by 0 reference haplotypes" << endl;
+      cerr << "Cannot compute a meaningful haplotype likelihood score" << endl;
+      ga.print(cerr);
+      return pair<double, bool>(nan(""), false);
+    } else {
+      column.extend(ga);
+      remember(column, i);
+    }
+  }
+  return pair<double, bool>(column.current_sum(), true);
+}
+
 } // namespace haplo
 
 #endif
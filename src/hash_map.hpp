@@ -5,6 +5,9 @@
 #include "sparsehash/dense_hash_map"
 
 #include <tuple>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 
 // http://stackoverflow.com/questions/4870437/pairint-int-pair-as-key-of-unordered-map-issue#comment5439557_4870467
 // https://github.com/Revolutionary-Games/Thrive/blob/fd8ab943dd4ced59a8e7d1e4a7b725468b7c2557/src/util/pair_hash.h
@@ -145,6 +148,124 @@ public:
     }
 };
 
+/**
+ * A map keyed by node ID. When the IDs are dense, as they are after
+ * compact_ids(), values live in a vector indexed by their offset from the
+ * smallest ID, so lookups don't hash. IDs that don't fit in the vector go to
+ * a hash_map instead. Call reserve_ids() with the range of IDs to be stored
+ * to pick the layout; otherwise everything is hashed.
+ */
+template<typename V>
+class id_map {
+public:
+    id_map() = default;
+    
+    /// Plan to store count distinct IDs between min_id and max_id inclusive.
+    /// Uses a vector when they fill at least half of that range. Clears the map.
+    void reserve_ids(int64_t min_id, int64_t max_id, size_t count) {
+        clear();
+        dense_values.clear();
+        dense_present.clear();
+        if (count != 0 && max_id >= min_id && uint64_t(max_id - min_id) < 2 * uint64_t(count)) {
+            dense_min = min_id;
+            dense_values.resize(max_id - min_id + 1);
+            dense_present.resize(max_id - min_id + 1, false);
+        }
+    }
+    
+    /// Get the value for an ID, default-constructing it if it isn't there
+    V& operator[](int64_t id) {
+        if (in_dense(id)) {
+            size_t i = id - dense_min;
+            if (!dense_present[i]) {
+                dense_present[i] = true;
+                dense_count++;
+            }
+            return dense_values[i];
+        }
+        return sparse_values[id];
+    }
+    
+    /// Get a pointer to the value for an ID, or null if it isn't there
+    V* find(int64_t id) {
+        return const_cast<V*>(static_cast<const id_map<V>*>(this)->find(id));
+    }
+    
+    /// Get a pointer to the value for an ID, or null if it isn't there
+    const V* find(int64_t id) const {
+        if (in_dense(id)) {
+            size_t i = id - dense_min;
+            return dense_present[i] ? &dense_values[i] : nullptr;
+        }
+        auto found = sparse_values.find(id);
+        return found == sparse_values.end() ? nullptr : &found->second;
+    }
+    
+    /// Return 1 if the ID is in the map and 0 otherwise
+    size_t count(int64_t id) const {
+        return find(id) != nullptr;
+    }
+    
+    /// Remove an ID, returning the number of entries removed
+    size_t erase(int64_t id) {
+        if (in_dense(id)) {
+            size_t i = id - dense_min;
+            if (!dense_present[i]) {
+                return 0;
+            }
+            dense_present[i] = false;
+            dense_values[i] = V();
+            dense_count--;
+            return 1;
+        }
+        return sparse_values.erase(id);
+    }
+    
+    size_t size() const {
+        return dense_count + sparse_values.size();
+    }
+    
+    bool empty() const {
+        return size() == 0;
+    }
+    
+    /// Remove everything, keeping the layout chosen by reserve_ids()
+    void clear() {
+        if (dense_count != 0) {
+            std::fill(dense_present.begin(), dense_present.end(), false);
+            std::fill(dense_values.begin(), dense_values.end(), V());
+            dense_count = 0;
+        }
+        sparse_values.clear();
+    }
+    
+    /// Call the given function with each ID and its value. IDs stored in the
+    /// vector come first, in order, followed by the hashed ones.
+    template<typename Lambda>
+    void for_each(const Lambda& lambda) const {
+        for (size_t i = 0; i < dense_values.size(); i++) {
+            if (dense_present[i]) {
+                lambda(dense_min + int64_t(i), dense_values[i]);
+            }
+        }
+        for (auto& id_and_value : sparse_values) {
+            lambda(id_and_value.first, id_and_value.second);
+        }
+    }
+    
+private:
+    
+    inline bool in_dense(int64_t id) const {
+        return id >= dense_min && uint64_t(id - dense_min) < dense_values.size();
+    }
+    
+    int64_t dense_min = 0;
+    std::vector<V> dense_values;
+    std::vector<bool> dense_present;
+    size_t dense_count = 0;
+    hash_map<int64_t, V> sparse_values;
+};
+
 }
 
 #endif
@@ -0,0 +1,130 @@
+#include "huge_pages.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace vg {
+
+using namespace std;
+
+#ifdef __linux__
+
+// From the kernel's mman-common.h, for systems with older headers
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+
+HugePageLoader::HugePageLoader() : before(anonymous_mappings()) {
+    // nothing else to do
+}
+
+vector<pair<uintptr_t, uintptr_t>> HugePageLoader::anonymous_mappings() {
+    vector<pair<uintptr_t, uintptr_t>> mappings;
+    ifstream maps("/proc/self/maps");
+    string line;
+    while (getline(maps, line)) {
+        // start-end perms offset dev inode [name]
+        stringstream fields(line);
+        string range, perms, offset, device, name;
+        size_t inode;
+        fields >> range >> perms >> offset >> device >> inode >> name;
+        if (inode != 0 || !(name.empty() || name == "[heap]") || perms.size() < 4
+            || perms[1] != 'w' || perms[3] != 'p') {
+            // file backed, a stack, or memory nobody writes to
+            continue;
+        }
+        size_t dash = range.find('-');
+        mappings.emplace_back(stoull(range.substr(0, dash), nullptr, 16),
+                              stoull(range.substr(dash + 1), nullptr, 16));
+    }
+    sort(mappings.begin(), mappings.end());
+    return mappings;
+}
+
+bool HugePageLoader::back_new_mappings() {
+    ifstream thp_setting("/sys/kernel/mm/transparent_hugepage/enabled");
+    string setting;
+    getline(thp_setting, setting);
+    if (setting.empty() || setting.find("[never]") != string::npos) {
+        return false;
+    }
+
+    for (auto& mapping : anonymous_mappings()) {
+        if (mapping.second - mapping.first < MIN_MAPPING_SIZE
+            || binary_search(before.begin(), before.end(), mapping)) {
+            continue;
+        }
+        if (madvise((void*) mapping.first, mapping.second - mapping.first, MADV_HUGEPAGE) != 0) {
+            continue;
+        }
+        // Collapse the pages now if the kernel is new enough, rather than
+        // waiting for khugepaged to get to them
+        madvise((void*) mapping.first, mapping.second - mapping.first, MADV_COLLAPSE);
+        moved.push_back(mapping);
+    }
+    return true;
+}
+
+size_t HugePageLoader::mapped_bytes() const {
+    size_t total = 0;
+    for (auto& mapping : moved) {
+        total += mapping.second - mapping.first;
+    }
+    return total;
+}
+
+size_t HugePageLoader::huge_page_bytes() const {
+    size_t total = 0;
+    ifstream smaps("/proc/self/smaps");
+    string line;
+    bool counting = false;
+    while (getline(smaps, line)) {
+        size_t dash = line.find('-');
+        size_t space = line.find(' ');
+        if (dash != string::npos && space != string::npos && dash < space
+            && line.find(':') > space) {
+            // the header of a new mapping
+            uintptr_t start = stoull(line.substr(0, dash), nullptr, 16);
+            auto next = upper_bound(moved.begin(), moved.end(), make_pair(start, UINTPTR_MAX));
+            counting = next != moved.begin() && (next - 1)->second > start;
+        } else if (counting && line.compare(0, 14, "AnonHugePages:") == 0) {
+            total += stoull(line.substr(14)) * 1024;
+        }
+    }
+    return total;
+}
+
+#else
+
+HugePageLoader::HugePageLoader() {
+    // nothing to note
+}
+
+vector<pair<uintptr_t, uintptr_t>> HugePageLoader::anonymous_mappings() {
+    return vector<pair<uintptr_t, uintptr_t>>();
+}
+
+bool HugePageLoader::back_new_mappings() {
+    return false;
+}
+
+size_t HugePageLoader::mapped_bytes() const {
+    return 0;
+}
+
+size_t HugePageLoader::huge_page_bytes() const {
+    return 0;
+}
+
+#endif
+
+}
@@ -0,0 +1,55 @@
+#ifndef VG_HUGE_PAGES_HPP_INCLUDED
+#define VG_HUGE_PAGES_HPP_INCLUDED
+
+/**
+ * \file huge_pages.hpp: moving big, randomly accessed indexes into transparent
+ * huge pages once they are loaded. At 4 KB pages nearly every lookup in a
+ * multi-gigabyte XG, GCSA or LCP array misses the TLB; at 2 MB pages far fewer
+ * do. The index classes allocate their own arrays, so rather than reaching into
+ * each of them this works on the memory mappings that loading leaves behind.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * Notes the anonymous memory mappings of the process when it is made, and
+ * later asks the kernel to back the big ones that have appeared since, which
+ * are where the arrays of any indexes loaded in between live, with huge pages.
+ */
+class HugePageLoader {
+public:
+    /// Mappings smaller than this aren't worth moving
+    static const size_t MIN_MAPPING_SIZE = 2 * 1024 * 1024;
+
+    /// Note the mappings that exist now
+    HugePageLoader();
+
+    /// Ask for huge pages for every big anonymous mapping made since
+    /// construction, collapsing them into huge pages right away if the kernel
+    /// can. Returns false if huge pages can't be had at all.
+    bool back_new_mappings();
+
+    /// How many bytes are in the mappings that were moved
+    size_t mapped_bytes() const;
+
+    /// How many bytes of them the kernel reports are in huge pages now
+    size_t huge_page_bytes() const;
+
+private:
+    /// The ranges of anonymous, writable mappings, sorted
+    static vector<pair<uintptr_t, uintptr_t>> anonymous_mappings();
+
+    vector<pair<uintptr_t, uintptr_t>> before;
+    vector<pair<uintptr_t, uintptr_t>> moved;
+};
+
+}
+
+#endif
@@ -1,5 +1,8 @@
 #include "index.hpp"
 
+#include <memory>
+#include <queue>
+
 namespace vg {
 
 using namespace std;
@@ -7,6 +10,9 @@ using namespace std;
 // convenience macro for RocksDB error handling
 #define S(x) { rocksdb::Status __s = (x); if (!__s.ok()) throw std::runtime_error("RocksDB operation failed: " + __s.ToString()); }
 
+const size_t Index::KEY_PREFIX_LENGTH;
+const int Index::KEY_FORMAT_VERSION;
+
 Index::Index(void) {
 
     start_sep = '\x00';
@@ -28,7 +34,6 @@ Index::Index(void) {
 
 rocksdb::Options Index::GetOptions(bool read_only) {
     // TODO: make the following configurable
-    const size_t block_cache_bytes = 1<<30;
     const size_t memtable_bytes = 4 * size_t(1<<30);
 
     rocksdb::Options options;
@@ -48,10 +53,18 @@ rocksdb::Options Index::GetOptions(bool read_only) {
     // set up table format
     rocksdb::BlockBasedTableOptions topt;
     topt.format_version = 2;
-    topt.block_size = 4 << 20;
+    topt.block_size = block_size;
     topt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+    // the filters hold both whole keys, for get_node and friends, and key
+    // prefixes, for scans over one node's records
+    topt.whole_key_filtering = true;
     topt.block_cache = rocksdb::NewLRUCache(block_cache_bytes);
+    // keep the filters and indexes in the cache with the data blocks, so
+    // that the cache size bounds them too
+    topt.cache_index_and_filter_blocks = true;
     options.table_factory.reset(NewBlockBasedTableFactory(topt));
+    // Keys shorter than the prefix (like metadata) are their own prefixes.
+    options.prefix_extractor.reset(rocksdb::NewCappedPrefixTransform(KEY_PREFIX_LENGTH));
 
     // set up concurrency
     options.IncreaseParallelism(threads);
@@ -142,20 +155,55 @@ void Index::open(const std::string& dir, bool read_only) {
     } else if (!s.IsNotFound()) {
         throw indexOpenException("couldn't read metadata");
     }
+
+    // Indexes from before the key format was recorded use version 1
+    s = get_metadata("key_format", data);
+    if (s.ok()) {
+        if (data != to_string(KEY_FORMAT_VERSION)) {
+            throw indexOpenException("index uses key format " + data + " but only " + to_string(KEY_FORMAT_VERSION) + " is supported");
+        }
+    } else if (!s.IsNotFound()) {
+        throw indexOpenException("couldn't read metadata");
+    } else if (!read_only) {
+        put_metadata("key_format", to_string(KEY_FORMAT_VERSION));
+    }
+}
+
+rocksdb::ReadOptions Index::read_options_for_range(const string& start, const string& end) {
+    rocksdb::ReadOptions read_options;
+    if (start.size() >= KEY_PREFIX_LENGTH && end.size() >= KEY_PREFIX_LENGTH
+        && start.compare(0, KEY_PREFIX_LENGTH, end, 0, KEY_PREFIX_LENGTH) == 0) {
+        // every key in the range has the same prefix
+        read_options.prefix_same_as_start = true;
+    } else {
+        read_options.total_order_seek = true;
+    }
+    return read_options;
 }
 
 void Index::open_read_only(string& dir) {
     bulk_load = false;
+    ingesting = false;
     open(dir, true);
 }
 
 void Index::open_for_write(string& dir) {
     bulk_load = false;
+    ingesting = false;
     open(dir, false);
 }
 
 void Index::open_for_bulk_load(string& dir) {
     bulk_load = true;
+    ingesting = false;
+    open(dir, false);
+}
+
+void Index::open_for_ingest(string& dir) {
+    bulk_load = true;
+    ingesting = true;
+    ingest_buffers.clear();
+    ingest_buffers.resize(max(threads, omp_get_max_threads()));
     open(dir, false);
 }
 
@@ -185,6 +233,9 @@ void Index::close(void) {
 }
 
 void Index::flush(void) {
+    if (ingesting) {
+        ingest();
+    }
     db->Flush(rocksdb::FlushOptions());
 
     if (bulk_load) {
@@ -210,6 +261,135 @@ void Index::compact(void) {
     db->CompactRange(rocksdb::CompactRangeOptions(), NULL, NULL);
 }
 
+void Index::put(const string& key, const string& value) {
+    if (!ingesting) {
+        S(db->Put(write_options, key, value));
+        return;
+    }
+    // no other thread uses this buffer
+    IngestBuffer& buffer = ingest_buffers[omp_get_thread_num()];
+    buffer.items.emplace_back(key, value);
+    buffer.bytes += key.size() + value.size();
+    if (buffer.bytes >= ingest_buffer_bytes) {
+        write_ingest_run(buffer);
+    }
+}
+
+// write a length-prefixed string to a run
+static void write_run_string(ofstream& out, const string& s) {
+    uint64_t length = s.size();
+    out.write((const char*) &length, sizeof(length));
+    out.write(s.data(), s.size());
+}
+
+// read a length-prefixed string from a run, returning false at the end
+static bool read_run_string(ifstream& in, string& s) {
+    uint64_t length;
+    if (!in.read((char*) &length, sizeof(length))) {
+        return false;
+    }
+    s.resize(length);
+    if (!in.read(&s[0], length)) {
+        throw std::runtime_error("truncated index ingest run");
+    }
+    return true;
+}
+
+void Index::write_ingest_run(IngestBuffer& buffer) {
+    if (buffer.items.empty()) {
+        return;
+    }
+    // RocksDB's default comparator orders keys bytewise, as string does
+    std::sort(buffer.items.begin(), buffer.items.end());
+    string run_name = tmpfilename(name + "/ingest-run");
+    ofstream out(run_name, std::ios_base::binary);
+    for (auto& item : buffer.items) {
+        write_run_string(out, item.first);
+        write_run_string(out, item.second);
+    }
+    out.close();
+    if (!out) {
+        throw std::runtime_error("couldn't write index ingest run " + run_name);
+    }
+    buffer.items.clear();
+    buffer.items.shrink_to_fit();
+    buffer.bytes = 0;
+    std::lock_guard<std::mutex> guard(ingest_runs_mutex);
+    ingest_runs.push_back(run_name);
+}
+
+void Index::ingest(void) {
+    // sort what is still buffered, one thread per buffer
+#pragma omp parallel for
+    for (size_t i = 0; i < ingest_buffers.size(); ++i) {
+        write_ingest_run(ingest_buffers[i]);
+    }
+    if (ingest_runs.empty()) {
+        return;
+    }
+
+    // merge the runs, so that the SST files don't overlap and can all be
+    // placed straight into the bottom level
+    vector<unique_ptr<ifstream>> runs;
+    vector<pair<string, string>> heads(ingest_runs.size());
+    auto later = [&](size_t a, size_t b) {
+        return heads[a].first > heads[b].first || (heads[a].first == heads[b].first && a > b);
+    };
+    priority_queue<size_t, vector<size_t>, decltype(later)> queue(later);
+    for (size_t i = 0; i < ingest_runs.size(); ++i) {
+        runs.emplace_back(new ifstream(ingest_runs[i], std::ios_base::binary));
+        if (read_run_string(*runs[i], heads[i].first) && read_run_string(*runs[i], heads[i].second)) {
+            queue.push(i);
+        }
+    }
+
+    vector<string> sst_files;
+    unique_ptr<rocksdb::SstFileWriter> writer;
+    size_t file_bytes = 0;
+    string last_key;
+    while (!queue.empty()) {
+        size_t i = queue.top();
+        queue.pop();
+        if (sst_files.empty() || heads[i].first != last_key) {
+            // keys must be unique in the SST files; the first put wins
+            if (writer && file_bytes >= ingest_file_bytes) {
+                S(writer->Finish());
+                writer.reset();
+            }
+            if (!writer) {
+                sst_files.push_back(name + "/ingest-" + to_string(ingested_files++) + ".sst");
+                writer.reset(new rocksdb::SstFileWriter(rocksdb::EnvOptions(), db_options));
+                S(writer->Open(sst_files.back()));
+                file_bytes = 0;
+            }
+            S(writer->Put(heads[i].first, heads[i].second));
+            file_bytes += heads[i].first.size() + heads[i].second.size();
+            last_key = heads[i].first;
+        }
+        if (read_run_string(*runs[i], heads[i].first) && read_run_string(*runs[i], heads[i].second)) {
+            queue.push(i);
+        }
+    }
+    if (writer) {
+        S(writer->Finish());
+        writer.reset();
+    }
+
+    runs.clear();
+    for (auto& run_name : ingest_runs) {
+        std::remove(run_name.c_str());
+    }
+    ingest_runs.clear();
+
+    rocksdb::IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = true;
+    S(db->IngestExternalFile(sst_files, ingest_options));
+    for (auto& sst_file : sst_files) {
+        // in case they were copied rather than moved
+        std::remove(sst_file.c_str());
+    }
+}
+
 // todo: replace with union / struct
 const string Index::key_for_node(int64_t id) {
     string key;
@@ -798,7 +978,9 @@ string Index::traversal_entry_to_string(const string& key, const string& value)
 }
 
 void Index::dump(ostream& out) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    rocksdb::Iterator* it = db->NewIterator(read_options);
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
         out << entry_to_string(it->key().ToString(), it->value().ToString()) << endl;
     }
@@ -894,37 +1076,37 @@ void Index::put_metadata(const string& tag, const string& data) {
 void Index::put_node_path(int64_t node_id, int64_t path_id, int64_t path_pos, bool backward, const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    S(db->Put(write_options, key_for_node_path_position(node_id, path_id, path_pos, backward), data));
+    put(key_for_node_path_position(node_id, path_id, path_pos, backward), data);
 }
 
 void Index::put_path_position(int64_t path_id, int64_t path_pos, bool backward, int64_t node_id, const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    S(db->Put(write_options, key_for_path_position(path_id, path_pos, backward, node_id), data));
+    put(key_for_path_position(path_id, path_pos, backward, node_id), data);
 }
 
 void Index::put_mapping(const Mapping& mapping) {
     string data;
     mapping.SerializeToString(&data);
-    S(db->Put(write_options, key_for_mapping(mapping), data));
+    put(key_for_mapping(mapping), data);
 }
 
 void Index::put_alignment(const Alignment& alignment) {
     static std::atomic<bool> warned_unmapped(false);
     string data;
     alignment.SerializeToString(&data);
-    S(db->Put(write_options, key_for_alignment(alignment), data));
+    put(key_for_alignment(alignment), data);
 }
 
 void Index::put_base(int64_t aln_id, const Alignment& alignment) {
     string data;
     alignment.SerializeToString(&data);
-    S(db->Put(write_options, key_for_base(aln_id), data));
+    put(key_for_base(aln_id), data);
 }
 
 void Index::put_traversal(int64_t aln_id, const Mapping& mapping) {
     string data; // empty data
-    S(db->Put(write_options, key_for_traversal(aln_id, mapping), data));
+    put(key_for_traversal(aln_id, mapping), data);
 }
 
 void Index::cross_alignment(int64_t aln_id, const Alignment& alignment) {
@@ -1170,33 +1352,135 @@ void Index::for_alignment_in_range(int64_t id1, int64_t id2, std::function<void(
 }
 
 void Index::for_alignment_to_nodes(const vector<int64_t>& ids, std::function<void(const Alignment&)> lambda) {
-    set<int64_t> aln_ids;
-    for (auto id : ids) {
-        string start = key_prefix_for_traversal(id);
-        string end = start + end_sep;
-        for_range(start, end, [this, &lambda, &aln_ids](string& key, string& value) {
-                // parse the alignment id out
-                int64_t node_id;
-                int16_t rank;
-                bool backward;
-                int64_t aln_id;
-                parse_traversal(key, value, node_id, rank, backward, aln_id);
-                aln_ids.insert(aln_id);
-            });
-    }
-    for_base_alignments(aln_ids, lambda);
+    for_serialized_alignment_to_nodes(ids, [&](string& bytes) {
+            Alignment alignment;
+            alignment.ParseFromString(bytes);
+            lambda(alignment);
+        });
 }
 
 void Index::for_base_alignments(const set<int64_t>& aln_ids, std::function<void(const Alignment&)> lambda) {
+    rocksdb::ReadOptions read_options;
+    read_options.prefix_same_as_start = true;
+    unique_ptr<rocksdb::Iterator> it(db->NewIterator(read_options));
     for (auto id : aln_ids) {
         string start = key_for_base(id);
-        string end = start + end_sep;
-        for_range(start, end, [this, &lambda](string& key, string& value) {
-                Alignment alignment;
+        for (it->Seek(start); it->Valid() && it->key().starts_with(start); it->Next()) {
+            Alignment alignment;
+            int64_t aln_id;
+            parse_base(it->key().ToString(), it->value().ToString(), aln_id, alignment);
+            lambda(alignment);
+        }
+        S(it->status());
+    }
+}
+
+void Index::for_serialized_alignment_to_nodes(const vector<int64_t>& ids,
+                                              const std::function<void(string&)>& lambda,
+                                              int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = threads;
+    }
+
+    // Split the nodes into runs of consecutive IDs, whose traversals sit
+    // next to each other in the key space
+    vector<int64_t> node_ids(ids);
+    sort(node_ids.begin(), node_ids.end());
+    node_ids.erase(unique(node_ids.begin(), node_ids.end()), node_ids.end());
+    vector<pair<int64_t, int64_t>> runs;
+    for (auto id : node_ids) {
+        if (!runs.empty() && runs.back().second + 1 == id) {
+            runs.back().second = id;
+        } else {
+            runs.emplace_back(id, id);
+        }
+    }
+
+    // We can't throw out of a parallel loop, so remember the first error
+    rocksdb::Status error;
+    std::mutex error_mutex;
+    auto check = [&](const rocksdb::Status& status) {
+        if (!status.ok()) {
+            std::lock_guard<std::mutex> guard(error_mutex);
+            if (error.ok()) {
+                error = status;
+            }
+        }
+    };
+
+    // Scan the runs in a few blocks per thread, so that each block can reuse
+    // its iterators: one for single nodes, which can use the prefix bloom
+    // filters, and one for longer runs, which reads ahead.
+    size_t block_count = min(runs.size(), (size_t) thread_count * 4);
+    vector<vector<int64_t>> block_aln_ids(block_count);
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic,1)
+    for (size_t b = 0; b < block_count; b++) {
+        unique_ptr<rocksdb::Iterator> node_it;
+        unique_ptr<rocksdb::Iterator> run_it;
+        for (size_t i = runs.size() * b / block_count; i < runs.size() * (b + 1) / block_count; i++) {
+            string start = key_prefix_for_traversal(runs[i].first);
+            string end = key_prefix_for_traversal(runs[i].second) + end_sep;
+            rocksdb::Iterator* it;
+            if (runs[i].first == runs[i].second) {
+                if (!node_it) {
+                    node_it.reset(db->NewIterator(read_options_for_range(start, end)));
+                }
+                it = node_it.get();
+            } else {
+                if (!run_it) {
+                    rocksdb::ReadOptions read_options;
+                    read_options.total_order_seek = true;
+                    read_options.readahead_size = scan_readahead_bytes;
+                    run_it.reset(db->NewIterator(read_options));
+                }
+                it = run_it.get();
+            }
+            for (it->Seek(start); it->Valid() && it->key().compare(end) < 0; it->Next()) {
+                int64_t node_id;
+                int16_t rank;
+                bool backward;
                 int64_t aln_id;
-                parse_base(key, value, aln_id, alignment);
-                lambda(alignment);
-            });
+                parse_traversal(it->key().ToString(), "", node_id, rank, backward, aln_id);
+                block_aln_ids[b].push_back(aln_id);
+            }
+            check(it->status());
+        }
+    }
+    S(error);
+
+    vector<int64_t> aln_ids;
+    for (auto& found : block_aln_ids) {
+        aln_ids.insert(aln_ids.end(), found.begin(), found.end());
+    }
+    block_aln_ids.clear();
+    sort(aln_ids.begin(), aln_ids.end());
+    aln_ids.erase(unique(aln_ids.begin(), aln_ids.end()), aln_ids.end());
+
+    // Look the alignments up in parallel a batch at a time, so we don't hold
+    // all of their bytes at once, and hand each batch over in order.
+    size_t batch_size = 1024 * thread_count;
+    vector<string> batch;
+    vector<char> batch_found;
+    for (size_t batch_start = 0; batch_start < aln_ids.size(); batch_start += batch_size) {
+        size_t batch_end = min(aln_ids.size(), batch_start + batch_size);
+        batch.clear();
+        batch.resize(batch_end - batch_start);
+        batch_found.assign(batch_end - batch_start, false);
+#pragma omp parallel for num_threads(thread_count)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            rocksdb::Status status = db->Get(rocksdb::ReadOptions(), key_for_base(aln_ids[i]), &batch[i - batch_start]);
+            if (status.ok()) {
+                batch_found[i - batch_start] = true;
+            } else if (!status.IsNotFound()) {
+                check(status);
+            }
+        }
+        S(error);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch_found[i]) {
+                lambda(batch[i]);
+            }
+        }
     }
 }
 
@@ -1516,7 +1800,7 @@ map<string, int64_t> Index::paths_by_id(void) {
 pair<int64_t, bool> Index::path_first_node(int64_t path_id) {
     string k = key_for_path_position(path_id, 0, false, 0);
     k = k.substr(0, 4 + sizeof(int64_t));
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(k, k+end_sep));
     rocksdb::Slice start = rocksdb::Slice(k);
     rocksdb::Slice end = rocksdb::Slice(k+end_sep);
     int64_t node_id = 0;
@@ -1536,7 +1820,10 @@ pair<int64_t, bool> Index::path_last_node(int64_t path_id, int64_t& path_length)
     // we aim to seek to the first item in the next path, then step back
     string key_start = key_for_path_position(path_id, 0, false, 0);
     string key_end = key_for_path_position(path_id+1, 0, false, 0);
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    // stepping back from the next path crosses prefixes
+    rocksdb::ReadOptions read_options;
+    read_options.total_order_seek = true;
+    rocksdb::Iterator* it = db->NewIterator(read_options);
     //rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     int64_t node_id = 0;
@@ -1632,10 +1919,10 @@ void Index::get_connected_nodes(VG& graph) {
 }
 
 void Index::get_context(int64_t id, VG& graph) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_for_node(id).substr(0,3+sizeof(int64_t));
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
@@ -1809,10 +2096,10 @@ void Index::get_edges_of(int64_t node, vector<Edge>& edges) {
 }
 
 void Index::get_edges_on_start(int64_t node_id, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_on_node_start(node_id);
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
@@ -1866,10 +2153,10 @@ void Index::get_edges_on_start(int64_t node_id, vector<Edge>& edges) {
 }
 
 void Index::get_edges_on_end(int64_t node_id, vector<Edge>& edges) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
     string key_start = key_prefix_for_edges_on_node_end(node_id);
     rocksdb::Slice start = rocksdb::Slice(key_start);
     string key_end = key_start+end_sep;
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
          it->Valid() && it->key().ToString() < key_end;
@@ -2058,7 +2345,7 @@ void Index::for_all(std::function<void(string&, string&)> lambda) {
 
 void Index::for_range(string& key_start, string& key_end,
                       std::function<void(string&, string&)> lambda) {
-    rocksdb::Iterator* it = db->NewIterator(rocksdb::ReadOptions());
+    rocksdb::Iterator* it = db->NewIterator(read_options_for_range(key_start, key_end));
     rocksdb::Slice start = rocksdb::Slice(key_start);
     rocksdb::Slice end = rocksdb::Slice(key_end);
     for (it->Seek(start);
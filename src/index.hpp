@@ -5,11 +5,13 @@
 #include <exception>
 #include <sstream>
 #include <climits>
+#include <mutex>
 
 #include "rocksdb/db.h"
 #include "rocksdb/env.h"
 #include "rocksdb/options.h"
 #include "rocksdb/write_batch.h"
+#include "rocksdb/sst_file_writer.h"
 #include "rocksdb/memtablerep.h"
 #include "rocksdb/statistics.h"
 #include "rocksdb/cache.h"
@@ -95,6 +97,11 @@ public:
     void open_read_only(string& dir);
     void open_for_write(string& dir);
     void open_for_bulk_load(string& dir);
+    // Open for loading many keys with the put_* functions. Each thread sorts
+    // the keys it puts into runs, and on flush() the runs are merged into
+    // non-overlapping SST files that are ingested directly, without going
+    // through the memtables or compaction.
+    void open_for_ingest(string& dir);
 
     void reset_options(void);
     void flush(void);
@@ -114,6 +121,47 @@ public:
     bool bulk_load;
     std::atomic<uint64_t> next_nonce;
 
+    // table tuning, which must be set before the index is opened
+    size_t block_cache_bytes = size_t(1) << 30;
+    // small blocks so that a point or prefix lookup reads little from disk
+    size_t block_size = size_t(64) << 10;
+    // how far ahead to read in scans over runs of many nodes
+    size_t scan_readahead_bytes = size_t(2) << 20;
+    // All the keys for one node (or path, or alignment) agree on their
+    // separator, type, separator and 8-byte ID, so this is what the prefix
+    // extractor and the prefix bloom filters look at.
+    static const size_t KEY_PREFIX_LENGTH = 3 + sizeof(int64_t);
+    // The version of the key layout, stored in the metadata so that an index
+    // is never read with the wrong one
+    static const int KEY_FORMAT_VERSION = 1;
+    // Get read options for a scan over [start, end): scans inside one key
+    // prefix can skip files using the prefix bloom filters, and anything
+    // wider has to ask for total order.
+    rocksdb::ReadOptions read_options_for_range(const string& start, const string& end);
+
+    // ingest mode
+    bool ingesting = false;
+    // how many bytes of keys and values each thread holds before sorting them into a run
+    size_t ingest_buffer_bytes = size_t(1) << 28;
+    // how large each SST file we ingest should be
+    size_t ingest_file_bytes = size_t(1) << 30;
+    struct IngestBuffer {
+        vector<pair<string, string>> items;
+        size_t bytes = 0;
+    };
+    // keys put by each thread that are not in a run yet
+    vector<IngestBuffer> ingest_buffers;
+    // temporary files of sorted keys and values, waiting to be merged
+    vector<string> ingest_runs;
+    std::mutex ingest_runs_mutex;
+    size_t ingested_files = 0;
+    // put a key straight into the database, or into this thread's ingest buffer
+    void put(const string& key, const string& value);
+    // sort a buffer and write it out as a run
+    void write_ingest_run(IngestBuffer& buffer);
+    // merge all the runs into SST files and ingest them
+    void ingest(void);
+
     void load_graph(VG& graph);
     void dump(std::ostream& out);
     void for_all(std::function<void(string&, string&)> lambda);
@@ -160,6 +208,15 @@ public:
     void for_alignment_to_node(int64_t node_id, std::function<void(const Alignment&)> lambda);
     void for_alignment_to_nodes(const vector<int64_t>& ids, std::function<void(const Alignment&)> lambda);
     void for_base_alignments(const set<int64_t>& aln_ids, std::function<void(const Alignment&)> lambda);
+    // Call the lambda on the serialized bytes of each alignment touching any
+    // of the nodes, once each, in alignment ID order, without parsing them.
+    // Runs of consecutive node IDs are scanned as single key ranges, and the
+    // scans and the alignment lookups are split across up to thread_count
+    // threads (or one per core, if 0), each with its own iterators. The
+    // lambda is only called on the calling thread, and may move the bytes.
+    void for_serialized_alignment_to_nodes(const vector<int64_t>& ids,
+                                           const std::function<void(string&)>& lambda,
+                                           int thread_count = 0);
 
     // obtain the key corresponding to each entity
     const string key_for_node(int64_t id);
@@ -23,6 +23,9 @@
 
 #include <stdexcept>
 #include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <unordered_map>
 
 namespace {
 #include "bin2ascii.h"
@@ -148,15 +151,154 @@ static json_t * _pb2json(const Message& msg)
 	return _auto.release();
 }
 
-static void _json2pb(Message& msg, json_t *root);
-static void _json2field(Message &msg, const FieldDescriptor *field, json_t *jf)
+// JSON is read straight into the message as it is parsed, without building a
+// jansson DOM first.
+static inline bool is_digit(char c)
 {
-	const Reflection *ref = msg.GetReflection();
-	const bool repeated = field->is_repeated();
-	json_error_t error;
+	return c >= '0' && c <= '9';
+}
+
+class json_reader {
+	const char *_pos;
+	const char *_end;
+
+	void fail(const std::string &e) {
+		throw j2pb_error(std::string("Load failed: ") + e);
+	}
+
+	void skip_space() {
+		while (_pos != _end && (*_pos == ' ' || *_pos == '\n' || *_pos == '\t' || *_pos == '\r'))
+			++_pos;
+	}
+
+	char peek() {
+		skip_space();
+		if (_pos == _end) fail("unexpected end of input");
+		return *_pos;
+	}
+
+	void expect(char c) {
+		if (peek() != c) fail(std::string("expected '") + c + "'");
+		++_pos;
+	}
+
+	bool consume(char c) {
+		if (peek() != c) return false;
+		++_pos;
+		return true;
+	}
+
+	bool consume_literal(const char *literal) {
+		size_t length = strlen(literal);
+		if ((size_t) (_end - _pos) < length || strncmp(_pos, literal, length) != 0)
+			return false;
+		_pos += length;
+		return true;
+	}
+
+	void append_utf8(std::string &out, uint32_t code) {
+		if (code < 0x80) {
+			out.push_back(code);
+		} else if (code < 0x800) {
+			out.push_back(0xc0 | (code >> 6));
+			out.push_back(0x80 | (code & 0x3f));
+		} else if (code < 0x10000) {
+			out.push_back(0xe0 | (code >> 12));
+			out.push_back(0x80 | ((code >> 6) & 0x3f));
+			out.push_back(0x80 | (code & 0x3f));
+		} else {
+			out.push_back(0xf0 | (code >> 18));
+			out.push_back(0x80 | ((code >> 12) & 0x3f));
+			out.push_back(0x80 | ((code >> 6) & 0x3f));
+			out.push_back(0x80 | (code & 0x3f));
+		}
+	}
+
+	uint32_t read_hex4() {
+		if (_end - _pos < 4) fail("invalid \\u escape");
+		uint32_t code = 0;
+		for (int i = 0; i < 4; i++) {
+			char c = *_pos++;
+			code <<= 4;
+			if (c >= '0' && c <= '9') code |= c - '0';
+			else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+			else fail("invalid \\u escape");
+		}
+		return code;
+	}
+
+	// A number's text, checked to be a JSON number, and whether it is an integer
+	std::string read_number(bool &is_integer) {
+		skip_space();
+		const char *start = _pos;
+		if (_pos != _end && *_pos == '-') ++_pos;
+		if (_pos == _end || !is_digit(*_pos)) fail("invalid number");
+		while (_pos != _end && is_digit(*_pos)) ++_pos;
+		is_integer = true;
+		if (_pos != _end && *_pos == '.') {
+			is_integer = false;
+			++_pos;
+			if (_pos == _end || !is_digit(*_pos)) fail("invalid number");
+			while (_pos != _end && is_digit(*_pos)) ++_pos;
+		}
+		if (_pos != _end && (*_pos == 'e' || *_pos == 'E')) {
+			is_integer = false;
+			++_pos;
+			if (_pos != _end && (*_pos == '+' || *_pos == '-')) ++_pos;
+			if (_pos == _end || !is_digit(*_pos)) fail("invalid number");
+			while (_pos != _end && is_digit(*_pos)) ++_pos;
+		}
+		return std::string(start, _pos);
+	}
+
+	// Skip over any value, for checking the syntax of values we reject
+	void skip_value() {
+		char c = peek();
+		std::string scratch;
+		bool is_integer;
+		if (c == '{') {
+			++_pos;
+			if (consume('}')) return;
+			do {
+				read_string(scratch);
+				expect(':');
+				skip_value();
+			} while (consume(','));
+			expect('}');
+		} else if (c == '[') {
+			++_pos;
+			if (consume(']')) return;
+			do {
+				skip_value();
+			} while (consume(','));
+			expect(']');
+		} else if (c == '"') {
+			read_string(scratch);
+		} else if (!consume_literal("true") && !consume_literal("false") && !consume_literal("null")) {
+			read_number(is_integer);
+		}
+	}
+
+	const FieldDescriptor *find_field(const Descriptor *d, const Reflection *ref, const std::string &name) {
+		// Each thread keeps a table of the fields of each message type it
+		// has seen, so keys are found with one hash lookup
+		thread_local std::unordered_map<const Descriptor *, std::unordered_map<std::string, const FieldDescriptor *>> tables;
+		auto table = tables.find(d);
+		if (table == tables.end()) {
+			table = tables.emplace(d, std::unordered_map<std::string, const FieldDescriptor *>()).first;
+			for (int i = 0; i < d->field_count(); i++)
+				table->second.emplace(d->field(i)->name(), d->field(i));
+		}
+		auto found = table->second.find(name);
+		if (found != table->second.end()) return found->second;
+		return ref->FindKnownExtensionByName(name);
+	}
+
+	void read_field(Message &msg, const FieldDescriptor *field) {
+		const Reflection *ref = msg.GetReflection();
+		const bool repeated = field->is_repeated();
 
-	switch (field->cpp_type())
-	{
 #define _SET_OR_ADD(sfunc, afunc, value)			\
 		do {						\
 			if (repeated)				\
@@ -165,47 +307,82 @@ static void _json2field(Message &msg, const FieldDescriptor *field, json_t *jf)
 				ref->sfunc(&msg, field, value);	\
 		} while (0)
 
-#define _CONVERT(type, ctype, fmt, sfunc, afunc) 		\
+		if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+			Message *mf = (repeated)?
+				ref->AddMessage(&msg, field):
+				ref->MutableMessage(&msg, field);
+			// A null message is left empty
+			if (!consume_literal("null"))
+				read_message(*mf);
+			return;
+		}
+
+		char c = peek();
+		bool is_integer;
+		switch (field->cpp_type())
+		{
+#define _CONVERT_INTEGER(type, ctype, sfunc, afunc)		\
 		case FieldDescriptor::type: {			\
-			ctype value;				\
-			int r = json_unpack_ex(jf, &error, JSON_STRICT, fmt, &value); \
-			if (r) throw j2pb_error(field, std::string("Failed to unpack: ") + error.text); \
-			_SET_OR_ADD(sfunc, afunc, value);	\
+			if (c != '-' && !is_digit(c))		\
+				throw j2pb_error(field, "Failed to unpack: expected integer"); \
+			std::string text = read_number(is_integer); \
+			if (!is_integer)			\
+				throw j2pb_error(field, "Failed to unpack: expected integer"); \
+			_SET_OR_ADD(sfunc, afunc, (ctype) strtoll(text.c_str(), nullptr, 10)); \
 			break;					\
 		}
 
-		_CONVERT(CPPTYPE_DOUBLE, double, "F", SetDouble, AddDouble);
-		_CONVERT(CPPTYPE_FLOAT, double, "F", SetFloat, AddFloat);
-		_CONVERT(CPPTYPE_INT64, json_int_t, "I", SetInt64, AddInt64);
-		_CONVERT(CPPTYPE_UINT64, json_int_t, "I", SetUInt64, AddUInt64);
-		_CONVERT(CPPTYPE_INT32, json_int_t, "I", SetInt32, AddInt32);
-		_CONVERT(CPPTYPE_UINT32, json_int_t, "I", SetUInt32, AddUInt32);
-		_CONVERT(CPPTYPE_BOOL, int, "b", SetBool, AddBool);
-
+		_CONVERT_INTEGER(CPPTYPE_INT64, google::protobuf::int64, SetInt64, AddInt64);
+		_CONVERT_INTEGER(CPPTYPE_UINT64, google::protobuf::uint64, SetUInt64, AddUInt64);
+		_CONVERT_INTEGER(CPPTYPE_INT32, google::protobuf::int32, SetInt32, AddInt32);
+		_CONVERT_INTEGER(CPPTYPE_UINT32, google::protobuf::uint32, SetUInt32, AddUInt32);
+#undef _CONVERT_INTEGER
+
+		case FieldDescriptor::CPPTYPE_DOUBLE:
+		case FieldDescriptor::CPPTYPE_FLOAT: {
+			if (c != '-' && !is_digit(c))
+				throw j2pb_error(field, "Failed to unpack: expected real");
+			double value = strtod(read_number(is_integer).c_str(), nullptr);
+			if (field->cpp_type() == FieldDescriptor::CPPTYPE_DOUBLE)
+				_SET_OR_ADD(SetDouble, AddDouble, value);
+			else
+				_SET_OR_ADD(SetFloat, AddFloat, value);
+			break;
+		}
+		case FieldDescriptor::CPPTYPE_BOOL: {
+			bool value;
+			if (consume_literal("true"))
+				value = true;
+			else if (consume_literal("false"))
+				value = false;
+			else
+				throw j2pb_error(field, "Failed to unpack: expected true or false");
+			_SET_OR_ADD(SetBool, AddBool, value);
+			break;
+		}
 		case FieldDescriptor::CPPTYPE_STRING: {
-			if (!json_is_string(jf))
+			if (c != '"')
 				throw j2pb_error(field, "Not a string");
-			const char * value = json_string_value(jf);
+			std::string value;
+			read_string(value);
 			if(field->type() == FieldDescriptor::TYPE_BYTES)
 				_SET_OR_ADD(SetString, AddString, b64_decode(value));
 			else
 				_SET_OR_ADD(SetString, AddString, value);
 			break;
 		}
-		case FieldDescriptor::CPPTYPE_MESSAGE: {
-			Message *mf = (repeated)?
-				ref->AddMessage(&msg, field):
-				ref->MutableMessage(&msg, field);
-			_json2pb(*mf, jf);
-			break;
-		}
 		case FieldDescriptor::CPPTYPE_ENUM: {
 			const EnumDescriptor *ed = field->enum_type();
 			const EnumValueDescriptor *ev = 0;
-			if (json_is_integer(jf)) {
-				ev = ed->FindValueByNumber(json_integer_value(jf));
-			} else if (json_is_string(jf)) {
-				ev = ed->FindValueByName(json_string_value(jf));
+			if (c == '"') {
+				std::string name;
+				read_string(name);
+				ev = ed->FindValueByName(name);
+			} else if (c == '-' || is_digit(c)) {
+				std::string text = read_number(is_integer);
+				if (!is_integer)
+					throw j2pb_error(field, "Not an integer or string");
+				ev = ed->FindValueByNumber(strtoll(text.c_str(), nullptr, 10));
 			} else
 				throw j2pb_error(field, "Not an integer or string");
 			if (!ev)
@@ -214,73 +391,142 @@ static void _json2field(Message &msg, const FieldDescriptor *field, json_t *jf)
 			break;
 		}
 		default:
+			skip_value();
 			break;
+		}
+#undef _SET_OR_ADD
 	}
-}
 
-static void _json2pb(Message& msg, json_t *root)
-{
-	const Descriptor *d = msg.GetDescriptor();
-	const Reflection *ref = msg.GetReflection();
-	if (!d || !ref) throw j2pb_error("No descriptor or reflection");
+public:
+	json_reader(const char *buf, size_t size) : _pos(buf), _end(buf + size) {}
+
+	void read_string(std::string &out) {
+		expect('"');
+		out.clear();
+		while (true) {
+			if (_pos == _end) fail("unterminated string");
+			// copy runs of plain characters at once
+			const char *run = _pos;
+			while (_pos != _end && *_pos != '"' && *_pos != '\\') ++_pos;
+			out.append(run, _pos);
+			if (_pos == _end) fail("unterminated string");
+			if (*_pos++ == '"') return;
+			if (_pos == _end) fail("unterminated string");
+			switch (*_pos++) {
+				case '"': out.push_back('"'); break;
+				case '\\': out.push_back('\\'); break;
+				case '/': out.push_back('/'); break;
+				case 'b': out.push_back('\b'); break;
+				case 'f': out.push_back('\f'); break;
+				case 'n': out.push_back('\n'); break;
+				case 'r': out.push_back('\r'); break;
+				case 't': out.push_back('\t'); break;
+				case 'u': {
+					uint32_t code = read_hex4();
+					if (code >= 0xd800 && code < 0xdc00) {
+						// a surrogate pair
+						if (_end - _pos < 6 || _pos[0] != '\\' || _pos[1] != 'u') fail("invalid \\u escape");
+						_pos += 2;
+						uint32_t low = read_hex4();
+						if (low < 0xdc00 || low >= 0xe000) fail("invalid \\u escape");
+						code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					}
+					append_utf8(out, code);
+					break;
+				}
+				default:
+					fail("invalid escape");
+			}
+		}
+	}
 
-	for (void *i = json_object_iter(root); i; i = json_object_iter_next(root, i))
-	{
-		const char *name = json_object_iter_key(i);
-		json_t *jf = json_object_iter_value(i);
-
-		const FieldDescriptor *field = d->FindFieldByName(name);
-		if (!field)
-			field = ref->FindKnownExtensionByName(name);
-			//field = d->file()->FindExtensionByName(name);
-
-		if (!field) throw j2pb_error("Unknown field: " + std::string(name));
-
-		int r = 0;
-		if (field->is_repeated()) {
-			if (!json_is_array(jf))
-				throw j2pb_error(field, "Not array");
-			for (size_t j = 0; j < json_array_size(jf); j++)
-				_json2field(msg, field, json_array_get(jf, j));
-		} else
-			_json2field(msg, field, jf);
+	void read_message(Message &msg) {
+		const Descriptor *d = msg.GetDescriptor();
+		const Reflection *ref = msg.GetReflection();
+		if (!d || !ref) throw j2pb_error("No descriptor or reflection");
+
+		if (peek() != '{')
+			throw j2pb_error("Malformed JSON: not an object");
+		++_pos;
+		if (consume('}')) return;
+		std::string name;
+		do {
+			read_string(name);
+			expect(':');
+
+			const FieldDescriptor *field = find_field(d, ref, name);
+			if (!field) throw j2pb_error("Unknown field: " + name);
+
+			if (field->is_repeated()) {
+				if (peek() != '[')
+					throw j2pb_error(field, "Not array");
+				++_pos;
+				if (!consume(']')) {
+					do {
+						read_field(msg, field);
+					} while (consume(','));
+					expect(']');
+				}
+			} else
+				read_field(msg, field);
+		} while (consume(','));
+		expect('}');
 	}
-}
+
+	void finish() {
+		skip_space();
+		if (_pos != _end) fail("end of file expected");
+	}
+};
 
 void json2pb(Message &msg, const char *buf, size_t size)
 {
-	json_t *root;
-	json_error_t error;
-
-	root = json_loadb(buf, size, 0, &error);
-
-	if (!root)
-		throw j2pb_error(std::string("Load failed: ") + error.text);
-
-	json_autoptr _auto(root);
+	json_reader reader(buf, size);
+	reader.read_message(msg);
+	reader.finish();
+}
 
-	if (!json_is_object(root))
+bool json_read_record(FILE *fp, std::string &record)
+{
+	record.clear();
+	int c;
+	do {
+		c = getc_unlocked(fp);
+		if (c == EOF) return false;
+	} while (isspace(c));
+	if (c != '{')
 		throw j2pb_error("Malformed JSON: not an object");
 
-	_json2pb(msg, root);
+	// Find the end of the object by matching braces outside of strings
+	size_t depth = 0;
+	bool in_string = false;
+	bool escaped = false;
+	do {
+		record.push_back(c);
+		if (in_string) {
+			if (escaped) escaped = false;
+			else if (c == '\\') escaped = true;
+			else if (c == '"') in_string = false;
+		} else if (c == '"') {
+			in_string = true;
+		} else if (c == '{' || c == '[') {
+			depth++;
+		} else if (c == '}' || c == ']') {
+			depth--;
+		}
+		if (depth == 0) return true;
+		c = getc_unlocked(fp);
+	} while (c != EOF);
+
+	throw j2pb_error("Load failed: unexpected end of input");
 }
 
 void json2pb(Message &msg, FILE *fp)
 {
-    json_t *root;
-	json_error_t error;
-
-	root = json_loadf(fp, JSON_DISABLE_EOF_CHECK, &error);
-
-	if (!root)
-		throw j2pb_error(std::string("Load failed: ") + error.text);
-
-	json_autoptr _auto(root);
-
-	if (!json_is_object(root))
-		throw j2pb_error("Malformed JSON: not an object");
-
-	_json2pb(msg, root);
+	std::string record;
+	if (!json_read_record(fp, record))
+		throw j2pb_error("Load failed: unexpected end of input");
+	json2pb(msg, record.data(), record.size());
 }
 
 int json_dump_std_string(const char *buf, size_t size, void *data)
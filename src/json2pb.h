@@ -14,6 +14,7 @@
 #include <vector>
 #include <stream.hpp>
 #include <iostream>
+#include <exception>
 
 namespace google {
 namespace protobuf {
@@ -25,6 +26,11 @@ void json2pb(google::protobuf::Message &msg, const char *buf, size_t size);
 void json2pb(google::protobuf::Message &msg, FILE *fp);
 std::string pb2json(const google::protobuf::Message &msg);
 
+// Read the text of the next JSON object in fp into record, without parsing
+// it, so records can be parsed in parallel. Returns false at the end of the
+// file.
+bool json_read_record(FILE *fp, std::string &record);
+
 // It's handy to be able to stream in JSON via vg view for testing.
 // This helper class takes this functionality from vg view -J and
 // makes it more generic, so it can be used for other types than Graph.
@@ -77,23 +83,14 @@ inline std::function<bool(T&)> JSONStreamHelper<T>::get_read_fn() {
     return [&](T& obj) -> bool {
         // zap protobuf object, since we want to overwrite and not append
         obj = T();
-      
-        // Check if the file ends now, and skip whitespace between records.
-        char peeked;
-        do {
-            peeked = fgetc(this->_fp);
-            if(peeked == EOF) {
-                // File ended or otherwise errored. TODO: check for other
-                // errors and complain.
-                return false;
-            }
-        } while(isspace(peeked));
-        // Put it back
-        ungetc(peeked, this->_fp);
         
-        // Now we know we have non-whitespace between here and EOF.
-        // If it's not JSON, we want to die. So read it as JSON.
-        json2pb(obj, this->_fp);
+        // Skip whitespace to the next record, if there is one. If it's not
+        // JSON, we want to die.
+        std::string record;
+        if (!json_read_record(this->_fp, record)) {
+            return false;
+        }
+        json2pb(obj, record.data(), record.size());
         
         // We read it successfully!
         return true;
@@ -102,19 +99,38 @@ inline std::function<bool(T&)> JSONStreamHelper<T>::get_read_fn() {
 
 template<class T>
 inline int64_t JSONStreamHelper<T>::write(std::ostream& out, bool json_out,
-                                          int64_t buf_size) {    
-    std::function<bool(T&)> reader = get_read_fn();        
+                                          int64_t buf_size) {
+    // Read the text of a buffer of records at a time, and parse them in parallel
+    std::vector<std::string> records;
     std::vector<T> buf;
     int64_t total = 0;
     bool good = true;
     std::function<T(uint64_t)> lambda = [&](uint64_t i) -> T {return buf[i];};
     while (good) {
-        T obj;
-        good = reader(obj);
-        if (good) {
-            buf.push_back(obj);
+        records.emplace_back();
+        good = json_read_record(_fp, records.back());
+        if (!good) {
+            records.pop_back();
         }
-        if (!good || buf.size() >= buf_size) {
+        if (!good || records.size() >= buf_size) {
+            buf.clear();
+            buf.resize(records.size());
+            // we can't throw out of the loop, so keep the first error for after it
+            std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic, 64)
+            for (size_t i = 0; i < records.size(); ++i) {
+                try {
+                    json2pb(buf[i], records[i].data(), records[i].size());
+                } catch (...) {
+#pragma omp critical (json_stream_error)
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
             if (!json_out) {
                 stream::write(out, buf.size(), lambda);
             } else {
@@ -123,7 +139,7 @@ inline int64_t JSONStreamHelper<T>::write(std::ostream& out, bool json_out,
                 }
             }
             total += buf.size();
-            buf.clear();
+            records.clear();
         }
     }
     out.flush();
@@ -1,14 +1,19 @@
 #include "kmer.hpp"
 
+#include <memory>
+#include <limits>
+
 namespace vg {
 
 void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id, id_t tail_id) {
     // for each position on the forward and reverse of the graph
-    // TODO -- add parallel interface in handlegraph
     bool using_head_tail = head_id + tail_id > 0;
-    graph.for_each_handle([&](const handle_t& h) {
+    auto visit = [&](const handle_t& h) {
+            // buffers for graphs that can't give us views of their sequences
+            string handle_buffer;
+            string curr_buffer;
             // for the forward and reverse of this handle
             // walk k bases from the end, so that any kmer starting on the node will be represented in the tree we build
             for (auto handle_is_rev : { false, true }) {
@@ -19,7 +24,7 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                 // determine next positions
                 id_t handle_id = graph.get_id(handle);
                 size_t handle_length = graph.get_length(handle);
-                string handle_seq = graph.get_sequence(handle);
+                sequence_view_t handle_seq = graph.view_sequence(handle, handle_buffer);
                 for (size_t i = 0; i < handle_length;  ++i) {
                     pos_t begin = make_pos_t(handle_id, handle_is_rev, i);
                     pos_t end = make_pos_t(handle_id, handle_is_rev, min(handle_length, i+k));
@@ -31,16 +36,16 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                         graph.follow_edges(handle, true, [&](const handle_t& prev) {
                                 size_t prev_length = graph.get_length(prev);
                                 kmer.prev_pos.emplace_back(graph.get_id(prev), graph.get_is_reverse(prev), prev_length-1);
-                                kmer.prev_char.emplace_back(graph.get_sequence(prev).substr(prev_length-1, 1)[0]);
+                                kmer.prev_char.emplace_back(graph.get_base(prev, prev_length-1));
                             });
                         // if we're on the forward head or reverse tail, we need to point to the end of the opposite node
                         if (kmer.prev_pos.empty() && using_head_tail) {
                             if (id(begin) == head_id) {
                                 kmer.prev_pos.emplace_back(tail_id, false, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, false))[0]);
+                                kmer.prev_char.emplace_back(graph.get_base(graph.get_handle(tail_id, false), 0));
                             } else if (id(begin) == tail_id) {
                                 kmer.prev_pos.emplace_back(head_id, true, 0);
-                                kmer.prev_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, true))[0]);
+                                kmer.prev_char.emplace_back(graph.get_base(graph.get_handle(head_id, true), 0));
                             }
                         }
                     } else {
@@ -77,22 +82,22 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                                 // have to check which nodes are next
                                 graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
                                         kmer.next_pos.emplace_back(graph.get_id(next), graph.get_is_reverse(next), 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(next)[0]);
+                                        kmer.next_char.emplace_back(graph.get_base(next, 0));
                                     });
                                 if (kmer.next_pos.empty() && using_head_tail) {
                                     if (id(kmer.begin) == head_id) {
                                         kmer.next_pos.emplace_back(tail_id, true, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(tail_id, true))[0]);
+                                        kmer.next_char.emplace_back(graph.get_base(graph.get_handle(tail_id, true), 0));
                                     } else if (id(kmer.begin) == tail_id) {
                                         kmer.next_pos.emplace_back(head_id, false, 0);
-                                        kmer.next_char.emplace_back(graph.get_sequence(graph.get_handle(head_id, false))[0]);
+                                        kmer.next_char.emplace_back(graph.get_base(graph.get_handle(head_id, false), 0));
                                     }
                                     //cerr << "done head or tail" << endl;
                                 }
                             } else {
                                 // on node
                                 kmer.next_pos.push_back(kmer.end);
-                                kmer.next_char.push_back(graph.get_sequence(end_handle)[offset(kmer.end)]);
+                                kmer.next_char.push_back(graph.get_base(end_handle, offset(kmer.end)));
                             }
                             // if we have head and tail ids set, iterate through our positions and do the flip
                             if (using_head_tail) {
@@ -146,10 +151,12 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                             id_t curr_id = graph.get_id(kmer.curr);
                             size_t curr_length = graph.get_length(kmer.curr);
                             bool curr_is_rev = graph.get_is_reverse(kmer.curr);
-                            string curr_seq = graph.get_sequence(kmer.curr);
+                            sequence_view_t curr_seq = graph.view_sequence(kmer.curr, curr_buffer);
                             size_t take = min(curr_length, k-kmer.seq.size());
                             kmer.end = make_pos_t(curr_id, curr_is_rev, take);
-                            kmer.seq.append(curr_seq.substr(0,take));
+                            for (size_t j = 0; j < take; ++j) {
+                                kmer.seq.push_back(curr_seq[j]);
+                            }
                             if (kmer.seq.size() < k) {
                                 // if not, we need to expand through the node then follow on
                                 graph.follow_edges(kmer.curr, false, [&](const handle_t& next) {
@@ -167,7 +174,20 @@ void for_each_kmer(const HandleGraph& graph, size_t k,
                     }
                 }
             }
-        }, true);
+        };
+
+    // Hand the nodes out to the threads in blocks of neighbors in the graph's
+    // own order (which is topological for a sorted graph), so that each
+    // thread walks from a node into nodes it has just looked at.
+    vector<handle_t> handles;
+    handles.reserve(graph.node_size());
+    graph.for_each_handle([&](const handle_t& h) {
+            handles.push_back(h);
+        });
+#pragma omp parallel for schedule(dynamic, KMER_NODE_BLOCK_SIZE)
+    for (size_t i = 0; i < handles.size(); i++) {
+        visit(handles[i]);
+    }
 }
 
 ostream& operator<<(ostream& out, const kmer_t& kmer) {
@@ -219,45 +239,46 @@ gcsa::byte_type encode_chars(const vector<char>& chars, const gcsa::Alphabet& al
     return val;
 }
 
-void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, id_t head_id, id_t tail_id) {
-
+/// Convert the graph's kmers to GCSA2 binary kmers, in a buffer per thread.
+/// Each buffer is passed to the callback, along with the number of the thread
+/// it belongs to, when it holds more than buffer_limit kmers, and again at the
+/// end if it is not empty. The callback is responsible for clearing it.
+static void for_each_gcsa_kmer_buffer(const HandleGraph& graph, int kmer_size, id_t head_id, id_t tail_id,
+                                      size_t buffer_limit,
+                                      const function<void(vector<gcsa::KMer>&, size_t)>& handle_kmers) {
     // We need an alphabet to parse the internal string format
     const gcsa::Alphabet alpha;
-    // Each thread is going to make its own KMers, then we'll concatenate these all together at the end.
-    vector<vector<gcsa::KMer> > thread_outputs;
-#pragma omp parallel
-    {
-#pragma omp single
-        {
-            // Set up our write buffers at the given parallelism we expect
-            thread_outputs.resize(omp_get_num_threads());
-        }
-    }
-    // This handles the buffered writing for each thread
-    size_t buffer_limit = 1e5; // max 100k kmers per buffer
-    auto handle_kmers = [&](vector<gcsa::KMer>& kmers, bool more) {
-        if (!more || kmers.size() > buffer_limit) {
-#pragma omp critical (gcsa_kmer_out)
-            gcsa::writeBinary(out, kmers, kmer_size);
-            kmers.clear();
-        }
-    };
+    // Each thread is going to make its own KMers
+    vector<vector<gcsa::KMer> > thread_outputs(omp_get_max_threads());
     // Here we convert our kmer_t to gcsa::KMer
-    auto convert_kmer = [&thread_outputs, &alpha, &head_id, &tail_id, &handle_kmers](const kmer_t& kmer) {
+    auto convert_kmer = [&](const kmer_t& kmer) {
         // Convert this KmerPosition to several gcsa::KMers, and save them in thread_outputs
-        vector<gcsa::KMer>& thread_output = thread_outputs[omp_get_thread_num()];
+        size_t thread_num = omp_get_thread_num();
+        vector<gcsa::KMer>& thread_output = thread_outputs[thread_num];
         kmer_to_gcsa_kmers(kmer, alpha, [&thread_output](const gcsa::KMer& k) { thread_output.push_back(k); });
-        // Handle kmer buffered writes, indicating we're not yet done
-        handle_kmers(thread_output, true);
+        if (thread_output.size() > buffer_limit) {
+            handle_kmers(thread_output, thread_num);
+        }
     };
     // Run on each KmerPosition. This populates start_end_id, if it was 0, before calling convert_kmer.
     for_each_kmer(graph, kmer_size, convert_kmer, head_id, tail_id);
-    for(auto& thread_output : thread_outputs) {
+    for (size_t i = 0; i < thread_outputs.size(); i++) {
         // Flush our buffers
-        handle_kmers(thread_output, false);
+        if (!thread_outputs[i].empty()) {
+            handle_kmers(thread_outputs[i], i);
+        }
     }
 }
 
+void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, id_t head_id, id_t tail_id) {
+    for_each_gcsa_kmer_buffer(graph, kmer_size, head_id, tail_id, GCSA_KMER_BUFFER_SIZE,
+                              [&](vector<gcsa::KMer>& kmers, size_t thread_num) {
+#pragma omp critical (gcsa_kmer_out)
+            gcsa::writeBinary(out, kmers, kmer_size);
+            kmers.clear();
+        });
+}
+
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, id_t head_id, id_t tail_id,
                                    const string& base_file_name) {
     // open a temporary file for the kmers
@@ -269,6 +290,233 @@ string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, id_t
     return tmpfile;
 }
 
+vector<string> write_gcsa_kmers_to_tmpfiles(const HandleGraph& graph, int kmer_size, id_t head_id, id_t tail_id,
+                                            const string& base_file_name) {
+    // Each thread gets its own file when it first has kmers to write, so
+    // threads never wait on each other to write.
+    vector<string> tmpfiles(omp_get_max_threads());
+    vector<unique_ptr<ofstream>> outs(tmpfiles.size());
+    for_each_gcsa_kmer_buffer(graph, kmer_size, head_id, tail_id, GCSA_KMER_BUFFER_SIZE,
+                              [&](vector<gcsa::KMer>& kmers, size_t thread_num) {
+            if (!outs[thread_num]) {
+                tmpfiles[thread_num] = tmpfilename(base_file_name);
+                outs[thread_num].reset(new ofstream(tmpfiles[thread_num]));
+                if (!*outs[thread_num]) {
+                    cerr << "error[vg::write_gcsa_kmers_to_tmpfiles]: could not open " << tmpfiles[thread_num] << endl;
+                    exit(1);
+                }
+            }
+            gcsa::writeBinary(*outs[thread_num], kmers, kmer_size);
+            kmers.clear();
+        });
+    vector<string> written;
+    for (size_t i = 0; i < tmpfiles.size(); i++) {
+        if (outs[i]) {
+            outs[i]->close();
+            written.push_back(tmpfiles[i]);
+        }
+    }
+    if (written.empty()) {
+        // GCSA2 still wants a file, even with no kmers in it
+        written.push_back(tmpfilename(base_file_name));
+        ofstream out(written.back());
+        vector<gcsa::KMer> no_kmers;
+        gcsa::writeBinary(out, no_kmers, kmer_size);
+    }
+    return written;
+}
+
+const string KmerCounter::MAGIC = "VGKC";
+
+KmerCounter::KmerCounter(size_t kmer_size, size_t disk_partitions) : kmer_size(kmer_size) {
+    if (kmer_size == 0 || kmer_size > MAX_COUNTED_KMER_SIZE) {
+        throw runtime_error("KmerCounter can only count kmers of 1 to " + to_string(MAX_COUNTED_KMER_SIZE) + " bases");
+    }
+    if (disk_partitions > 1) {
+        for (size_t i = 0; i < disk_partitions; i++) {
+            disk_files.push_back(tmpfilename(".vg-kmer-counts-"));
+            disk_streams.emplace_back(new ofstream(disk_files.back(), ios::binary));
+            if (!*disk_streams.back()) {
+                cerr << "error[vg::KmerCounter]: could not open " << disk_files.back() << endl;
+                exit(1);
+            }
+        }
+    }
+    else {
+        tables.resize(KMER_COUNT_PARTITIONS);
+    }
+    partition_locks = vector<mutex>(disk_files.empty() ? tables.size() : disk_files.size());
+}
+
+KmerCounter::~KmerCounter() {
+    disk_streams.clear();
+    for (auto& disk_file : disk_files) {
+        remove(disk_file.c_str());
+    }
+}
 
+bool KmerCounter::pack_kmer(const string& seq, uint64_t& packed) {
+    packed = 0;
+    for (char c : seq) {
+        packed <<= 2;
+        switch (c) {
+        case 'A': case 'a':
+            break;
+        case 'C': case 'c':
+            packed |= 1;
+            break;
+        case 'G': case 'g':
+            packed |= 2;
+            break;
+        case 'T': case 't':
+            packed |= 3;
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+string KmerCounter::unpack_kmer(uint64_t packed, size_t kmer_size) {
+    string seq(kmer_size, 'A');
+    for (size_t i = kmer_size; i > 0; i--) {
+        seq[i - 1] = "ACGT"[packed & 3];
+        packed >>= 2;
+    }
+    return seq;
+}
+
+size_t KmerCounter::partition_of(uint64_t packed) const {
+    if (disk_files.empty()) {
+        // Spread the kmers over the tables by a hash
+        return (packed * 0x9E3779B97F4A7C15ull) >> 58 & (KMER_COUNT_PARTITIONS - 1);
+    }
+    else {
+        // Keep each file to a range of kmers, so the files come out in order
+        uint64_t width = (((uint64_t) 1) << (2 * kmer_size)) / disk_files.size() + 1;
+        return packed / width;
+    }
+}
+
+void KmerCounter::flush(size_t partition, vector<uint64_t>& buffer) {
+    lock_guard<mutex> guard(partition_locks[partition]);
+    if (disk_files.empty()) {
+        auto& table = tables[partition];
+        for (uint64_t packed : buffer) {
+            uint32_t& count = table[packed];
+            if (count != numeric_limits<uint32_t>::max()) {
+                count++;
+            }
+        }
+    }
+    else {
+        disk_streams[partition]->write((const char*) buffer.data(), buffer.size() * sizeof(uint64_t));
+    }
+    buffer.clear();
+}
+
+void KmerCounter::add_kmers(const HandleGraph& graph) {
+    size_t partitions = partition_locks.size();
+    // Each thread saves up kmers for each partition
+    vector<vector<vector<uint64_t>>> buffers(omp_get_max_threads(), vector<vector<uint64_t>>(partitions));
+    vector<size_t> thread_skipped(buffers.size(), 0);
+    for_each_kmer(graph, kmer_size, [&](const kmer_t& kmer) {
+            size_t thread_num = omp_get_thread_num();
+            uint64_t packed;
+            if (!pack_kmer(kmer.seq, packed)) {
+                thread_skipped[thread_num]++;
+                return;
+            }
+            size_t partition = partition_of(packed);
+            vector<uint64_t>& buffer = buffers[thread_num][partition];
+            buffer.push_back(packed);
+            if (buffer.size() >= KMER_COUNT_BUFFER_SIZE) {
+                flush(partition, buffer);
+            }
+        });
+    for (size_t i = 0; i < buffers.size(); i++) {
+        // Flush our buffers
+        for (size_t partition = 0; partition < partitions; partition++) {
+            if (!buffers[i][partition].empty()) {
+                flush(partition, buffers[i][partition]);
+            }
+        }
+        skipped += thread_skipped[i];
+    }
+}
+
+size_t KmerCounter::skipped_kmers() const {
+    return skipped;
+}
+
+size_t KmerCounter::write_counts(ostream& out) {
+    out.write(MAGIC.c_str(), MAGIC.size());
+    uint32_t size = kmer_size;
+    out.write((const char*) &size, sizeof(size));
+    
+    size_t written = 0;
+    auto write_count = [&](uint64_t packed, uint32_t count) {
+        out.write((const char*) &packed, sizeof(packed));
+        out.write((const char*) &count, sizeof(count));
+        written++;
+    };
+    
+    if (disk_files.empty()) {
+        // The tables aren't in any order, so sort everything together
+        vector<pair<uint64_t, uint32_t>> counts;
+        for (auto& table : tables) {
+            counts.insert(counts.end(), table.begin(), table.end());
+            table.clear();
+        }
+        sort(counts.begin(), counts.end());
+        for (auto& count : counts) {
+            write_count(count.first, count.second);
+        }
+    }
+    else {
+        // Count each file's range of kmers in turn
+        disk_streams.clear();
+        for (auto& disk_file : disk_files) {
+            vector<uint64_t> kmers;
+            {
+                ifstream in(disk_file, ios::binary);
+                in.seekg(0, ios::end);
+                kmers.resize(in.tellg() / sizeof(uint64_t));
+                in.seekg(0, ios::beg);
+                in.read((char*) kmers.data(), kmers.size() * sizeof(uint64_t));
+            }
+            remove(disk_file.c_str());
+            
+            sort(kmers.begin(), kmers.end());
+            for (size_t i = 0; i < kmers.size();) {
+                size_t j = i + 1;
+                while (j < kmers.size() && kmers[j] == kmers[i]) {
+                    j++;
+                }
+                write_count(kmers[i], min<size_t>(j - i, numeric_limits<uint32_t>::max()));
+                i = j;
+            }
+        }
+        disk_files.clear();
+    }
+    
+    return written;
+}
+
+void KmerCounter::for_each_kmer_count(istream& in, const function<void(const string&, uint32_t)>& lambda) {
+    string magic(MAGIC.size(), '\0');
+    uint32_t size = 0;
+    in.read(&magic[0], magic.size());
+    in.read((char*) &size, sizeof(size));
+    if (!in || magic != MAGIC || size == 0 || size > MAX_COUNTED_KMER_SIZE) {
+        throw runtime_error("Not a kmer count table");
+    }
+    uint64_t packed;
+    uint32_t count;
+    while (in.read((char*) &packed, sizeof(packed)) && in.read((char*) &count, sizeof(count))) {
+        lambda(unpack_kmer(packed, size), count);
+    }
+}
 
 }
@@ -7,6 +7,11 @@
 #include "handle.hpp"
 #include "position.hpp"
 #include "gcsa/gcsa.h"
+#include "hash_map.hpp"
+
+#include <mutex>
+#include <memory>
+#include <fstream>
 
 /** \file 
  * Functions for working with `kmers_t`'s in HandleGraphs.
@@ -40,7 +45,15 @@ struct kmer_t {
     vector<char> next_char;
 };
 
-/// Iterate over all the kmers in the graph, running lambda on each
+/// How many consecutive nodes each thread takes at a time in for_each_kmer
+const size_t KMER_NODE_BLOCK_SIZE = 64;
+
+/// How many GCSA2 binary kmers each thread buffers before writing them out
+const size_t GCSA_KMER_BUFFER_SIZE = 100000;
+
+/// Iterate over all the kmers in the graph, running lambda on each. The
+/// lambda is called in parallel, on nodes handed out to the threads in blocks
+/// in the graph's for_each_handle order.
 void for_each_kmer(const HandleGraph& graph, size_t k,
                    const function<void(const kmer_t&)>& lambda,
                    id_t head_id = 0, id_t tail_id = 0);
@@ -61,6 +74,94 @@ void write_gcsa_kmers(const HandleGraph& graph, int kmer_size, ostream& out, id_
 string write_gcsa_kmers_to_tmpfile(const HandleGraph& graph, int kmer_size, id_t head_id, id_t tail_id,
                                    const string& base_file_name = ".vg-kmers-tmp-");
 
+/// Write the same kmers as write_gcsa_kmers_to_tmpfile, but into a separate
+/// temporary file for each thread that found any, so that no thread waits to
+/// write. Each thread holds at most GCSA_KMER_BUFFER_SIZE kmers at a time.
+/// Returns the file names; the calling context should remove them.
+vector<string> write_gcsa_kmers_to_tmpfiles(const HandleGraph& graph, int kmer_size, id_t head_id, id_t tail_id,
+                                            const string& base_file_name = ".vg-kmers-tmp-");
+
+/// The longest kmer a KmerCounter can count
+const size_t MAX_COUNTED_KMER_SIZE = 31;
+
+/// How many hash tables, each with its own lock, a KmerCounter splits its
+/// counts between
+const size_t KMER_COUNT_PARTITIONS = 64;
+
+/// How many packed kmers each thread of a KmerCounter saves up for each
+/// partition before taking its lock
+const size_t KMER_COUNT_BUFFER_SIZE = 1024;
+
+/**
+ * Counts the kmers of one or more graphs, as enumerated by for_each_kmer.
+ * Kmers are packed 2 bits per base, so only kmers of ACGT are counted; the
+ * rest are skipped. The threads of for_each_kmer buffer up kmers and add them
+ * to a set of partitioned hash tables. For graphs with too many kmers to count
+ * in memory, the packed kmers can instead be spilled to temporary files by
+ * kmer range and counted one file at a time when the counts are written.
+ *
+ * The table written is a 4-byte magic string and a uint32_t kmer size,
+ * followed by a uint64_t packed kmer and a uint32_t count for each distinct
+ * kmer, in packed kmer order. Counts saturate at the largest uint32_t.
+ */
+class KmerCounter {
+public:
+    
+    /// Count kmers of the given size, in memory, or using the given number
+    /// of temporary files if it is more than 1
+    KmerCounter(size_t kmer_size, size_t disk_partitions = 0);
+    
+    /// Remove any temporary files left over
+    ~KmerCounter();
+    
+    /// Count all the kmers in a graph. Can be called on several graphs before
+    /// writing the counts.
+    void add_kmers(const HandleGraph& graph);
+    
+    /// Write the table of counts to the given stream. The counts are used up.
+    /// Returns the number of distinct kmers written.
+    size_t write_counts(ostream& out);
+    
+    /// Get the number of kmers skipped because they weren't all ACGT
+    size_t skipped_kmers() const;
+    
+    /// Pack a kmer 2 bits per base. Returns false if it has anything but ACGT
+    /// in it.
+    static bool pack_kmer(const string& seq, uint64_t& packed);
+    
+    /// Unpack a kmer of the given size
+    static string unpack_kmer(uint64_t packed, size_t kmer_size);
+    
+    /// Call the lambda with each kmer and count in a table written by
+    /// write_counts, in order. Throws if the stream isn't a count table.
+    static void for_each_kmer_count(istream& in, const function<void(const string&, uint32_t)>& lambda);
+    
+    /// Starts every count table
+    static const string MAGIC;
+    
+private:
+    
+    /// Put a buffer of packed kmers into their partition, and clear it
+    void flush(size_t partition, vector<uint64_t>& buffer);
+    
+    /// Which partition does a packed kmer belong to?
+    size_t partition_of(uint64_t packed) const;
+    
+    size_t kmer_size;
+    
+    /// The partitioned counts, when counting in memory
+    vector<hash_map<uint64_t, uint32_t>> tables;
+    
+    /// The temporary files of packed kmers, when counting on disk
+    vector<string> disk_files;
+    vector<unique_ptr<ofstream>> disk_streams;
+    
+    /// One lock for each table or file
+    vector<mutex> partition_locks;
+    
+    size_t skipped = 0;
+};
+
 }
 
 #endif
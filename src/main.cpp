@@ -8,11 +8,20 @@
 #include <csignal>
 #include <getopt.h>
 #include <sys/stat.h>
+#include <cstring>
+#include <vector>
+
+#ifdef VG_GPERFTOOLS
+#include <gperftools/profiler.h>
+#include <gperftools/heap-profiler.h>
+#include <gperftools/malloc_extension.h>
+#endif
 
 #include "google/protobuf/stubs/common.h"
 #include "version.hpp"
 #include "utility.hpp"
 #include "crash.hpp"
+#include "stream_codec.hpp"
 
 // New subcommand system provides all the subcommands that used to live here
 #include "subcommand/subcommand.hpp"
@@ -39,8 +48,27 @@ void vg_help(char** argv) {
      });
      
      cerr << endl << "For more commands, type `vg help`." << endl;
+     cerr << endl << "global options (given before the command):" << endl
+          << "    --profile-cpu FILE     write a gperftools CPU profile of the command to FILE" << endl
+          << "    --profile-heap PREFIX  write gperftools heap profiles of the command to PREFIX.*.heap" << endl
+          << "    --malloc-stats         report tcmalloc allocation stats when the command finishes" << endl;
  }
 
+/// Report the tcmalloc allocation stats for the subcommand that just ran.
+void report_malloc_stats(const string& command) {
+#ifdef VG_GPERFTOOLS
+    size_t allocated = 0;
+    size_t heap_size = 0;
+    MallocExtension::instance()->GetNumericProperty("generic.current_allocated_bytes", &allocated);
+    MallocExtension::instance()->GetNumericProperty("generic.heap_size", &heap_size);
+    cerr << "[vg " << command << "] allocated " << allocated << " bytes in a heap of " << heap_size << " bytes" << endl;
+    
+    char stats[8192];
+    MallocExtension::instance()->GetStats(stats, sizeof(stats));
+    cerr << stats;
+#endif
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -63,6 +91,59 @@ int main(int argc, char *argv[])
     // set a higher value for tcmalloc warnings
     setenv("TCMALLOC_LARGE_ALLOC_REPORT_THRESHOLD", "1000000000000000", 1);
 
+    // Let the user pick how protobuf streams we write are compressed (for
+    // example, "none" when piping between vg processes).
+    const char* codec_name = getenv("VG_STREAM_CODEC");
+    if (codec_name != nullptr) {
+        try {
+            stream::set_output_codec(stream::parse_codec(codec_name));
+        } catch (const invalid_argument& e) {
+            cerr << "error:[vg] " << e.what() << " (VG_STREAM_CODEC should be none, gzip, or zstd)" << endl;
+            return 1;
+        }
+    }
+    
+    const char* blocked = getenv("VG_STREAM_BLOCKED");
+    if (blocked != nullptr && string(blocked) != "0" && string(blocked) != "") {
+        // Write independently compressed blocks that readers can inflate in parallel
+        stream::set_output_blocked(true);
+    }
+
+    // Pull off the global options that come before the subcommand name
+    string cpu_profile;
+    string heap_profile;
+    bool malloc_stats = false;
+    int first_arg = 1;
+    while (first_arg < argc && strncmp(argv[first_arg], "--", 2) == 0) {
+        string option = argv[first_arg];
+        if ((option == "--profile-cpu" || option == "--profile-heap") && first_arg + 1 < argc) {
+            (option == "--profile-cpu" ? cpu_profile : heap_profile) = argv[first_arg + 1];
+            first_arg += 2;
+        } else if (option == "--malloc-stats") {
+            malloc_stats = true;
+            first_arg++;
+        } else {
+            cerr << "error:[vg] unknown or incomplete global option " << option << endl;
+            vg_help(argv);
+            return 1;
+        }
+    }
+    
+#ifndef VG_GPERFTOOLS
+    if (!cpu_profile.empty() || !heap_profile.empty() || malloc_stats) {
+        cerr << "error:[vg] profiling options need a vg built with gperftools" << endl;
+        return 1;
+    }
+#endif
+    
+    // The subcommand sees the program name followed by its own arguments
+    vector<char*> args;
+    args.push_back(argv[0]);
+    args.insert(args.end(), argv + first_arg, argv + argc);
+    args.push_back(nullptr);
+    argc = args.size() - 1;
+    argv = args.data();
+
     if (argc == 1) {
         vg_help(argv);
         return 1;
@@ -70,8 +151,35 @@ int main(int argc, char *argv[])
     
     auto* subcommand = vg::subcommand::Subcommand::get(argc, argv);
     if (subcommand != nullptr) {
-        // We found a matching subcommand, so run it
-        return (*subcommand)(argc, argv);
+        // We found a matching subcommand, so run it, under the profilers if
+        // we were asked for them
+#ifdef VG_GPERFTOOLS
+        if (!cpu_profile.empty() && !ProfilerStart(cpu_profile.c_str())) {
+            cerr << "error:[vg] could not start CPU profiling to " << cpu_profile << endl;
+            return 1;
+        }
+        if (!heap_profile.empty()) {
+            HeapProfilerStart(heap_profile.c_str());
+        }
+#endif
+        
+        int return_code = (*subcommand)(argc, argv);
+        
+#ifdef VG_GPERFTOOLS
+        if (!heap_profile.empty()) {
+            // Capture the final state before stopping
+            HeapProfilerDump("exit");
+            HeapProfilerStop();
+        }
+        if (!cpu_profile.empty()) {
+            ProfilerStop();
+        }
+        if (malloc_stats) {
+            report_malloc_stats(subcommand->get_name());
+        }
+#endif
+        
+        return return_code;
     } else {
         // No subcommand found
         string command = argv[1];
@@ -0,0 +1,134 @@
+#include "mapped_file.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace vg {
+
+using namespace std;
+
+MappedFileBuffer::MappedFileBuffer(const string& filename) {
+    map(filename);
+}
+
+MappedFileBuffer::~MappedFileBuffer() {
+    unmap();
+}
+
+bool MappedFileBuffer::map(const string& filename) {
+    unmap();
+    
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    
+    struct stat file_stats;
+    if (fstat(fd, &file_stats) != 0 || !S_ISREG(file_stats.st_mode) || file_stats.st_size == 0) {
+        // We can only map nonempty regular files. Pipes and the like have to
+        // go through a normal stream.
+        close(fd);
+        return false;
+    }
+    
+    void* mapped = mmap(nullptr, file_stats.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file.
+    close(fd);
+    
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    
+    // Loading is a front-to-back scan, so tell the kernel to read ahead.
+    madvise(mapped, file_stats.st_size, MADV_SEQUENTIAL);
+    
+    mapping = (char*) mapped;
+    mapping_size = file_stats.st_size;
+    setg(mapping, mapping, mapping + mapping_size);
+    
+    return true;
+}
+
+void MappedFileBuffer::unmap() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+    setg(nullptr, nullptr, nullptr);
+}
+
+bool MappedFileBuffer::is_mapped() const {
+    return mapping != nullptr;
+}
+
+const char* MappedFileBuffer::data() const {
+    return mapping;
+}
+
+size_t MappedFileBuffer::size() const {
+    return mapping_size;
+}
+
+auto MappedFileBuffer::seekoff(off_type off, ios_base::seekdir dir,
+                               ios_base::openmode which) -> pos_type {
+    if (!(which & ios_base::in) || mapping == nullptr) {
+        return pos_type(off_type(-1));
+    }
+    
+    off_type base;
+    switch (dir) {
+    case ios_base::beg:
+        base = 0;
+        break;
+    case ios_base::cur:
+        base = gptr() - eback();
+        break;
+    case ios_base::end:
+        base = mapping_size;
+        break;
+    default:
+        return pos_type(off_type(-1));
+    }
+    
+    off_type target = base + off;
+    if (target < 0 || target > (off_type) mapping_size) {
+        return pos_type(off_type(-1));
+    }
+    
+    setg(mapping, mapping + target, mapping + mapping_size);
+    return pos_type(target);
+}
+
+auto MappedFileBuffer::seekpos(pos_type pos, ios_base::openmode which) -> pos_type {
+    return seekoff(off_type(pos), ios_base::beg, which);
+}
+
+streamsize MappedFileBuffer::xsgetn(char* s, streamsize n) {
+    // Copy straight out of the mapping in one go.
+    streamsize available = egptr() - gptr();
+    streamsize to_copy = min(n, available);
+    if (to_copy > 0) {
+        memcpy(s, gptr(), to_copy);
+        // gbump() only takes an int, and big vectors can be read in one go.
+        setg(eback(), gptr() + to_copy, egptr());
+    }
+    return to_copy;
+}
+
+MappedFileStream::MappedFileStream(const string& filename) : istream(nullptr), buffer(filename) {
+    rdbuf(&buffer);
+    if (!buffer.is_mapped()) {
+        setstate(ios_base::failbit);
+    }
+}
+
+bool MappedFileStream::is_mapped() const {
+    return buffer.is_mapped();
+}
+
+}
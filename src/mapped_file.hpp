@@ -0,0 +1,86 @@
+#ifndef VG_MAPPED_FILE_HPP_INCLUDED
+#define VG_MAPPED_FILE_HPP_INCLUDED
+
+/** \file
+ * Read-only memory mapping of index files, presented as a std::istream so
+ * that the existing SDSL-style load() functions can consume the mapping
+ * directly out of the page cache.
+ */
+
+#include <string>
+#include <istream>
+#include <streambuf>
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A streambuf over a read-only, shared memory mapping of a whole file.
+ *
+ * All the bytes of the file are exposed as the get area at once, so reads
+ * through it are plain memcpy()s out of the mapping with no read() syscalls
+ * and no intermediate stream buffer. Because the mapping is shared, many
+ * processes on one machine loading the same index all read from a single
+ * page-cached copy of the file.
+ */
+class MappedFileBuffer : public streambuf {
+public:
+    /// Make an unmapped buffer
+    MappedFileBuffer() = default;
+    /// Map the given file. Check is_mapped() to see if it worked.
+    MappedFileBuffer(const string& filename);
+    ~MappedFileBuffer();
+    
+    // We own the mapping, so we can't be copied.
+    MappedFileBuffer(const MappedFileBuffer& other) = delete;
+    MappedFileBuffer& operator=(const MappedFileBuffer& other) = delete;
+    
+    /// Map the given file, replacing any existing mapping. Returns true on
+    /// success, and false (leaving the buffer unmapped) if the file could not
+    /// be opened or mapped.
+    bool map(const string& filename);
+    
+    /// Drop the mapping, if any.
+    void unmap();
+    
+    /// Return true if a file is currently mapped.
+    bool is_mapped() const;
+    
+    /// Get the start of the mapped bytes.
+    const char* data() const;
+    
+    /// Get the number of mapped bytes.
+    size_t size() const;
+    
+protected:
+    
+    virtual pos_type seekoff(off_type off, ios_base::seekdir dir,
+                             ios_base::openmode which = ios_base::in);
+    virtual pos_type seekpos(pos_type pos, ios_base::openmode which = ios_base::in);
+    virtual streamsize xsgetn(char* s, streamsize n);
+    
+private:
+    char* mapping = nullptr;
+    size_t mapping_size = 0;
+};
+
+/**
+ * An istream reading from a read-only memory mapping of a file.
+ *
+ * Evaluates to false (like an ifstream) if the file could not be mapped.
+ */
+class MappedFileStream : public istream {
+public:
+    MappedFileStream(const string& filename);
+    
+    /// Return true if the file was mapped.
+    bool is_mapped() const;
+    
+private:
+    MappedFileBuffer buffer;
+};
+
+}
+
+#endif
@@ -2,6 +2,9 @@
 #include "mapper.hpp"
 #include "haplotypes.hpp"
 #include "algorithms/extract_containing_graph.hpp"
+#include "algorithms/extract_connecting_graph.hpp"
+#include "algorithms/extract_extending_graph.hpp"
+#include "scoring_kernels.hpp"
 
 //#define debug_mapper
 
@@ -9,6 +12,7 @@ namespace vg {
 
 // init the static memo
 thread_local vector<size_t> BaseMapper::adaptive_reseed_length_memo;
+thread_local BaseMapper::GCSAQueryCache BaseMapper::gcsa_query_cache;
 
 BaseMapper::BaseMapper(xg::XG* xidex,
                        gcsa::GCSA* g,
@@ -292,6 +296,12 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     }
 #endif
 
+    if (minimizer_index) {
+        // minimizers all have the same length, and there is no LCP to consult
+        longest_lcp = minimizer_index->k();
+        return find_minimizer_seeds(seq_begin, seq_end, fraction_filtered);
+    }
+
     if (!gcsa) {
         cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
         exit(1);
@@ -301,14 +311,197 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
         exit(1);
     }
-    vector<MaximalExactMatch> mems;
+    
+    StageTimer timer(MappingStage::MEMs);
+    
+    gcsa_query_cache.clear();
+    
+    SMEMSearch search(seq_begin, seq_end, gcsa::range_type(0, gcsa->size() - 1));
+    while (extend_smem_search(search, max_mem_length, min_mem_length, record_max_lcp)) {
+        // step until we run off the start of the read
+    }
+    
+    vector<MaximalExactMatch> mems = finish_mems_deep(search, longest_lcp, fraction_filtered, min_mem_length, reseed_length,
+                                                      use_lcp_reseed_heuristic, use_diff_based_fast_reseed,
+                                                      include_parent_in_sub_mem_count, record_max_lcp, reseed_below);
+    finish_gcsa_query_cache();
+    timer.add_items(mems.size());
+    return mems;
+}
+
+// Find the MEMs for several reads, searching along all of them together.
+vector<vector<MaximalExactMatch>> BaseMapper::find_mems_deep_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                                                                   vector<double>& longest_lcps,
+                                                                   vector<double>& fractions_filtered,
+                                                                   int max_mem_length,
+                                                                   int min_mem_length,
+                                                                   int reseed_length,
+                                                                   bool use_lcp_reseed_heuristic,
+                                                                   bool use_diff_based_fast_reseed,
+                                                                   bool include_parent_in_sub_mem_count,
+                                                                   bool record_max_lcp,
+                                                                   int reseed_below) {
+    
+    if (minimizer_index) {
+        longest_lcps.assign(seqs.size(), minimizer_index->k());
+        fractions_filtered.resize(seqs.size());
+        vector<vector<MaximalExactMatch>> seeds(seqs.size());
+        for (size_t i = 0; i < seqs.size(); i++) {
+            seeds[i] = find_minimizer_seeds(seqs[i].first, seqs[i].second, fractions_filtered[i]);
+        }
+        return seeds;
+    }
+    
+    if (!gcsa) {
+        cerr << "error:[vg::Mapper] a GCSA2 index is required to query MEMs" << endl;
+        exit(1);
+    }
+    
+    if (min_mem_length > reseed_length && reseed_length) {
+        cerr << "error:[vg::Mapper] minimimum reseed length for MEMs cannot be less than minimum MEM length" << endl;
+        exit(1);
+    }
+    
+    StageTimer timer(MappingStage::MEMs);
     
     gcsa::range_type full_range = gcsa::range_type(0, gcsa->size() - 1);
+    
+    gcsa_query_cache.clear();
+    
+    vector<SMEMSearch> searches;
+    searches.reserve(seqs.size());
+    for (auto& seq : seqs) {
+        searches.emplace_back(seq.first, seq.second, full_range);
+    }
+    
+    // advance all the searches one step at a time in lockstep, so that the LF lookups of the different
+    // reads (which don't depend on each other) can have their cache misses in flight at the same time
+    vector<size_t> active(searches.size());
+    for (size_t i = 0; i < active.size(); i++) {
+        active[i] = i;
+    }
+    while (!active.empty()) {
+        size_t num_still_active = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            if (extend_smem_search(searches[active[i]], max_mem_length, min_mem_length, record_max_lcp)) {
+                active[num_still_active++] = active[i];
+            }
+        }
+        active.resize(num_still_active);
+    }
+    
+    // the reseeding and filling happen one read at a time
+    longest_lcps.resize(seqs.size());
+    fractions_filtered.resize(seqs.size());
+    vector<vector<MaximalExactMatch>> mems(seqs.size());
+    for (size_t i = 0; i < searches.size(); i++) {
+        mems[i] = finish_mems_deep(searches[i], longest_lcps[i], fractions_filtered[i], min_mem_length,
+                                   reseed_length, use_lcp_reseed_heuristic, use_diff_based_fast_reseed,
+                                   include_parent_in_sub_mem_count, record_max_lcp, reseed_below);
+        timer.add_items(mems[i].size());
+    }
+    finish_gcsa_query_cache();
+    
+    return mems;
+}
 
+vector<MaximalExactMatch> BaseMapper::find_minimizer_seeds(string::const_iterator seq_begin,
+                                                           string::const_iterator seq_end,
+                                                           double& fraction_filtered) {
+    
+    StageTimer timer(MappingStage::MEMs);
+    
+    vector<MaximalExactMatch> seeds;
+    size_t filtered_hits = 0;
+    size_t total_hits = 0;
+    size_t k = minimizer_index->k();
+    for (auto& minimizer : minimizer_index->minimizers(seq_begin, seq_end)) {
+        size_t count = minimizer_index->count(minimizer.key);
+        if (count == 0) {
+            continue;
+        }
+        total_hits += count;
+        // there's no suffix array range behind a minimizer, so leave it empty
+        seeds.emplace_back(seq_begin + minimizer.offset, seq_begin + minimizer.offset + k,
+                           gcsa::range_type(1, 0), count);
+        MaximalExactMatch& seed = seeds.back();
+        seed.primary = true;
+        seed.fragment = 0;
+        if (!hit_max || count <= hit_max) {
+            seed.nodes = minimizer_index->find(minimizer.key);
+        } else {
+            filtered_hits += count;
+        }
+    }
+    fraction_filtered = total_hits ? (double) filtered_hits / (double) total_hits : 0.0;
+    
+    timer.add_items(seeds.size());
+    return seeds;
+}
+
+void BaseMapper::GCSAQueryCache::clear() {
+    ranges.clear();
+    counts.clear();
+    parents.clear();
+    hits = 0;
+}
+
+gcsa::range_type BaseMapper::cached_LF(const gcsa::range_type& range, string::const_iterator cursor,
+                                       string::const_iterator end) {
+    const char* begin_base = &*cursor;
+    auto key = make_pair(begin_base, begin_base + (end - cursor));
+    auto found = gcsa_query_cache.ranges.find(key);
+    if (found != gcsa_query_cache.ranges.end()) {
+        gcsa_query_cache.hits++;
+        return found->second;
+    }
+    gcsa::range_type extended = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+    gcsa_query_cache.ranges.emplace(key, extended);
+    return extended;
+}
+
+size_t BaseMapper::cached_count(const gcsa::range_type& range) {
+    auto found = gcsa_query_cache.counts.find(range);
+    if (found != gcsa_query_cache.counts.end()) {
+        gcsa_query_cache.hits++;
+        return found->second;
+    }
+    size_t count = gcsa->count(range);
+    gcsa_query_cache.counts.emplace(range, count);
+    return count;
+}
+
+gcsa::STNode BaseMapper::cached_parent(const gcsa::range_type& range) {
+    auto found = gcsa_query_cache.parents.find(range);
+    if (found != gcsa_query_cache.parents.end()) {
+        gcsa_query_cache.hits++;
+        return found->second;
+    }
+    gcsa::STNode parent = lcp->parent(range);
+    gcsa_query_cache.parents.emplace(range, parent);
+    return parent;
+}
+
+void BaseMapper::finish_gcsa_query_cache() {
+    if (StageProfiler::is_enabled()) {
+        StageProfiler::record(MappingStage::GCSAQueryCache, 0, gcsa_query_cache.hits);
+    }
+    gcsa_query_cache.clear();
+}
+
+BaseMapper::SMEMSearch::SMEMSearch(string::const_iterator seq_begin,
+                                   string::const_iterator seq_end,
+                                   gcsa::range_type full_range) :
+    seq_begin(seq_begin), seq_end(seq_end), full_range(full_range), cursor(seq_end - 1),
+    last_range(full_range), match(seq_end - 1, seq_end, full_range) {
+    
     // an empty sequence matches the entire bwt
     if (seq_begin == seq_end) {
         mems.push_back(MaximalExactMatch(seq_begin, seq_end, full_range));
     }
+}
+
+bool BaseMapper::extend_smem_search(SMEMSearch& search, int max_mem_length, int min_mem_length, bool record_max_lcp) {
     
     // find SMEMs using GCSA+LCP array
     // algorithm sketch:
@@ -325,37 +518,106 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     //           and calculate the new end point using the LCP of the parent node
     // emit the final MEM, if we finished in a matching state
     
-    // next position we will extend matches to
-    string::const_iterator cursor = seq_end - 1;
+    const string::const_iterator& seq_begin = search.seq_begin;
+    const gcsa::range_type& full_range = search.full_range;
     
+    // next position we will extend matches to
+    string::const_iterator& cursor = search.cursor;
     // range of the last iteration
-    gcsa::range_type last_range = full_range;
-    
+    gcsa::range_type& last_range = search.last_range;
     // the temporary MEM we'll build up in this process
-    MaximalExactMatch match(cursor, seq_end, full_range);
-    
+    MaximalExactMatch& match = search.match;
     // did we move the cursor or the end of the match last iteration?
-    bool prev_iter_jumped_lcp = false;
-
-    int filtered_mems = 0;
-    int total_mems = 0;
-    int max_lcp = 0;
-    size_t mem_length = 0;
-    vector<int> lcp_maxima;
+    bool& prev_iter_jumped_lcp = search.prev_iter_jumped_lcp;
+    int& max_lcp = search.max_lcp;
+    size_t& mem_length = search.mem_length;
+    vector<MaximalExactMatch>& mems = search.mems;
+    vector<int>& lcp_maxima = search.lcp_maxima;
     
+    // maintains invariant that match.range contains the hits for seq[cursor+1:match.end]
+    if (cursor < seq_begin) {
+        return false;
+    }
+    
+    // break the MEM on N; which for DNA we assume is non-informative
+    // this *will* match many places in assemblies, but it isn't helpful
+    if (*cursor == 'N') {
+        match.begin = cursor + 1;
+        
+        mem_length = match.length();
+        
+        if (mem_length >= min_mem_length) {
 
-    // loop maintains invariant that match.range contains the hits for seq[cursor+1:match.end]
-    while (cursor >= seq_begin) {
+            mems.push_back(match);
+            lcp_maxima.push_back(max_lcp);
+            
+#ifdef debug_mapper
+#pragma omp critical
+            {
+                vector<gcsa::node_type> locations;
+                gcsa->locate(match.range, locations);
+                cerr << "adding MEM " << match.sequence() << " at positions ";
+                for (auto nt : locations) {
+                    cerr << make_pos_t(nt) << " ";
+                }
+                cerr << endl;
+            }
+#endif
+        }
+        
+        match.end = cursor;
+        match.range = full_range;
+        --cursor;
         
-        // break the MEM on N; which for DNA we assume is non-informative
-        // this *will* match many places in assemblies, but it isn't helpful
-        if (*cursor == 'N') {
+        prev_iter_jumped_lcp = false;
+
+        max_lcp = 0;
+
+        // skip looking for matches since they are non-informative
+        return cursor >= seq_begin;
+    }
+    
+    // hold onto our previous range
+    last_range = match.range;
+    
+    // execute one step of LF mapping, remembering the result for reseeding
+    match.range = cached_LF(match.range, cursor, match.end);
+    
+    if (gcsa::Range::empty(match.range)
+        || (max_mem_length && match.end - cursor > max_mem_length)
+        || match.end - cursor > gcsa->order()) {
+        
+        // we've exhausted our BWT range, so the last match range was maximal
+        // or: we have exceeded the order of the graph (FPs if we go further)
+        // or: we have run over our parameter-defined MEM limit
+        
+        if (cursor + 1 == match.end) {
+            // avoid getting caught in infinite loop when a single character mismatches
+            // entire index (b/c then advancing the LCP doesn't move the search forward
+            // at all, need to move the cursor instead)
             match.begin = cursor + 1;
+            match.range = last_range;
+            
+            if (match.end - match.begin >= min_mem_length) {
+                mems.push_back(match);
+                lcp_maxima.push_back(max_lcp);
+            }
             
-            mem_length = match.length();
+            match.end = cursor;
+            match.range = full_range;
+            --cursor;
             
-            if (mem_length >= min_mem_length) {
-
+            // don't reseed in empty MEMs
+            prev_iter_jumped_lcp = false;
+            max_lcp = 0;
+        }
+        else {
+            match.begin = cursor + 1;
+            match.range = last_range;
+            mem_length = match.end - match.begin;
+            // record the last MEM, but check to make sure were not actually still searching
+            // for the end of the next MEM
+            if (mem_length >= min_mem_length && !prev_iter_jumped_lcp) {
                 mems.push_back(match);
                 lcp_maxima.push_back(max_lcp);
                 
@@ -373,95 +635,50 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
 #endif
             }
             
-            match.end = cursor;
-            match.range = full_range;
-            --cursor;
-            
-            prev_iter_jumped_lcp = false;
-
-            max_lcp = 0;
-
-            // skip looking for matches since they are non-informative
-            continue;
-        }
-        
-        // hold onto our previous range
-        last_range = match.range;
-        
-        // execute one step of LF mapping
-        match.range = gcsa->LF(match.range, gcsa->alpha.char2comp[*cursor]);
-        
-        if (gcsa::Range::empty(match.range)
-            || (max_mem_length && match.end - cursor > max_mem_length)
-            || match.end - cursor > gcsa->order()) {
-            
-            // we've exhausted our BWT range, so the last match range was maximal
-            // or: we have exceeded the order of the graph (FPs if we go further)
-            // or: we have run over our parameter-defined MEM limit
-            
-            if (cursor + 1 == match.end) {
-                // avoid getting caught in infinite loop when a single character mismatches
-                // entire index (b/c then advancing the LCP doesn't move the search forward
-                // at all, need to move the cursor instead)
-                match.begin = cursor + 1;
-                match.range = last_range;
-                
-                if (match.end - match.begin >= min_mem_length) {
-                    mems.push_back(match);
-                    lcp_maxima.push_back(max_lcp);
-                }
-                
-                match.end = cursor;
-                match.range = full_range;
-                --cursor;
-                
-                // don't reseed in empty MEMs
-                prev_iter_jumped_lcp = false;
-                max_lcp = 0;
-            }
-            else {
-                match.begin = cursor + 1;
-                match.range = last_range;
-                mem_length = match.end - match.begin;
-                // record the last MEM, but check to make sure were not actually still searching
-                // for the end of the next MEM
-                if (mem_length >= min_mem_length && !prev_iter_jumped_lcp) {
-                    mems.push_back(match);
-                    lcp_maxima.push_back(max_lcp);
-                    
-#ifdef debug_mapper
-#pragma omp critical
-                    {
-                        vector<gcsa::node_type> locations;
-                        gcsa->locate(match.range, locations);
-                        cerr << "adding MEM " << match.sequence() << " at positions ";
-                        for (auto nt : locations) {
-                            cerr << make_pos_t(nt) << " ";
-                        }
-                        cerr << endl;
-                    }
-#endif
-                }
-                
-                // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
-                gcsa::STNode parent = lcp->parent(last_range);
-                // set the MEM to be the longest prefix that is shared with another MEM
-                match.end = match.begin + parent.lcp();
-                // and set up the next MEM using the parent node range
-                match.range = parent.range();
-                // record our max lcp
-                if (record_max_lcp) max_lcp = (int)parent.lcp();
-                prev_iter_jumped_lcp = true;
-            }
-        }
-        else {
-            prev_iter_jumped_lcp = false;
-            if (record_max_lcp) max_lcp = max(max_lcp, (int)lcp->parent(match.range).lcp());
-            ++mem_length;
-            // just step to the next position
-            --cursor;
+            // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
+            gcsa::STNode parent = cached_parent(last_range);
+            // set the MEM to be the longest prefix that is shared with another MEM
+            match.end = match.begin + parent.lcp();
+            // and set up the next MEM using the parent node range
+            match.range = parent.range();
+            // record our max lcp
+            if (record_max_lcp) max_lcp = (int)parent.lcp();
+            prev_iter_jumped_lcp = true;
         }
     }
+    else {
+        prev_iter_jumped_lcp = false;
+        if (record_max_lcp) max_lcp = max(max_lcp, (int)cached_parent(match.range).lcp());
+        ++mem_length;
+        // just step to the next position
+        --cursor;
+    }
+    
+    return cursor >= seq_begin;
+}
+
+vector<MaximalExactMatch> BaseMapper::finish_mems_deep(SMEMSearch& search,
+                                                       double& longest_lcp,
+                                                       double& fraction_filtered,
+                                                       int min_mem_length,
+                                                       int reseed_length,
+                                                       bool use_lcp_reseed_heuristic,
+                                                       bool use_diff_based_fast_reseed,
+                                                       bool include_parent_in_sub_mem_count,
+                                                       bool record_max_lcp,
+                                                       int reseed_below) {
+    
+    string::const_iterator seq_begin = search.seq_begin;
+    string::const_iterator seq_end = search.seq_end;
+    MaximalExactMatch& match = search.match;
+    int max_lcp = search.max_lcp;
+    size_t mem_length;
+    vector<MaximalExactMatch> mems = std::move(search.mems);
+    vector<int> lcp_maxima = std::move(search.lcp_maxima);
+    
+    int filtered_mems = 0;
+    int total_mems = 0;
+    
     // TODO: is this where the bug with the duplicated MEMs is occurring? (when the prefix of a read
     // contains multiple non SMEM hits so that the iteration will loop through the LCP routine multiple
     // times before escaping out of the loop?
@@ -470,7 +687,7 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     match.begin = seq_begin;
     mem_length = match.end - match.begin;
     if (mem_length >= min_mem_length) {
-        if (record_max_lcp) max_lcp = (int)lcp->parent(match.range).lcp();
+        if (record_max_lcp) max_lcp = (int)cached_parent(match.range).lcp();
         mems.push_back(match);
         lcp_maxima.push_back(max_lcp);
 #ifdef debug_mapper
@@ -495,7 +712,7 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     for (MaximalExactMatch& mem : mems) {
         // invalid mem
         if (mem.begin < seq_begin || mem.end > seq_end) continue;
-        mem.match_count = gcsa->count(mem.range);
+        mem.match_count = cached_count(mem.range);
         mem.primary = true;
         // if we aren't filtering on hit count, or if we have up to the max allowed hits
         if (mem.match_count > 0 && (!hit_max || mem.match_count <= hit_max)) {
@@ -507,6 +724,9 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                 total_mems += mem.nodes.size();
                 mem.nodes.clear();
             }
+        } else if (hit_max > 0 && hit_max_sample > 0 && mem.match_count > hit_max) {
+            // keep a spread of the repeat's hits without locating all of them
+            locate_bounded(mem.range, hit_max_sample, mem.nodes);
         }
 #ifdef debug_mapper
 #pragma omp critical
@@ -521,6 +741,8 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
     }
 
     if (reseed_length) {
+        StageTimer timer(MappingStage::Reseeding);
+        
         // get the sub_mem_and_parents
         vector<pair<MaximalExactMatch, vector<size_t> > > sub_mems;
 
@@ -574,7 +796,7 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
         // determine counts of matches
         for (pair<MaximalExactMatch, vector<size_t> >& sub_mem_and_parents : sub_mems) {
             // count in entire range, including parents
-            sub_mem_and_parents.first.match_count = gcsa->count(sub_mem_and_parents.first.range);
+            sub_mem_and_parents.first.match_count = cached_count(sub_mem_and_parents.first.range);
             if (!include_parent_in_sub_mem_count) {
                 // remove parents from count
                 for (size_t parent_idx : sub_mem_and_parents.second) {
@@ -595,6 +817,8 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
                     total_mems += mem.nodes.size();
                     mem.nodes.clear();
                 }
+            } else if (hit_max > 0 && hit_max_sample > 0 && mem.match_count > hit_max) {
+                locate_bounded(mem.range, hit_max_sample, mem.nodes);
             }
 #ifdef debug_mapper
 #pragma omp critical
@@ -608,7 +832,10 @@ vector<MaximalExactMatch> BaseMapper::find_mems_deep(string::const_iterator seq_
 #endif
         }
         
+        timer.add_items(sub_mems.size());
+        
         // combine the MEM and sub-MEM lists
+        mems.reserve(mems.size() + sub_mems.size());
         for (auto iter = sub_mems.begin(); iter != sub_mems.end(); iter++) {
             mems.push_back(std::move(iter->first));
         }
@@ -665,7 +892,7 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
 #endif
     
     // how many times does the parent MEM occur in the index?
-    size_t parent_count = gcsa->count(mem.range);
+    size_t parent_count = cached_count(mem.range);
     
     // next position where we will look for a match
     string::const_iterator cursor = mem.end - 1;
@@ -688,9 +915,9 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
         // hold onto our previous range
         gcsa::range_type last_range = range;
         // execute one step of LF mapping
-        range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+        range = cached_LF(range, cursor, sub_mem_end);
         
-        if (gcsa->count(range) <= parent_count) {
+        if (cached_count(range) <= parent_count) {
             // there are no more hits outside of parent MEM hits, record the previous
             // interval as a sub MEM
             string::const_iterator sub_mem_begin = cursor + 1;
@@ -741,7 +968,7 @@ void BaseMapper::find_sub_mems(const vector<MaximalExactMatch>& mems,
 #endif
             
             // get the parent suffix tree node corresponding to the parent of the last MEM's STNode
-            gcsa::STNode parent = lcp->parent(last_range);
+            gcsa::STNode parent = cached_parent(last_range);
             // set the MEM to be the longest prefix that is shared with another MEM
             sub_mem_end = sub_mem_begin + parent.lcp();
             // and get the next range as parent node range
@@ -847,10 +1074,10 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
         bool probe_string_more_frequent = true;
         while (cursor >= probe_string_begin) {
             
-            range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+            range = cached_LF(range, cursor, probe_string_end);
             
             if (cursor == probe_string_begin || ((cursor - mem.begin) % sub_mem_count_thinning == 0)) {
-                if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : gcsa->count(range)) <= parent_range_count) {
+                if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : cached_count(range)) <= parent_range_count) {
                     probe_string_more_frequent = false;
                     break;
                 }
@@ -870,9 +1097,9 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
                 // extend match until beginning of SMEM or until the end of the independent hit
                 while (cursor >= leftmost_bound) {
                     gcsa::range_type last_range = range;
-                    range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+                    range = cached_LF(range, cursor, probe_string_end);
                     
-                    if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : gcsa->count(range)) <= parent_range_count) {
+                    if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : cached_count(range)) <= parent_range_count) {
                         range = last_range;
                         break;
                     }
@@ -917,10 +1144,10 @@ void BaseMapper::find_sub_mems_fast(const vector<MaximalExactMatch>& mems,
                 bool contained_in_independent_match = true;
                 while (cursor >= probe_string_begin) {
                     
-                    range = gcsa->LF(range, gcsa->alpha.char2comp[*cursor]);
+                    range = cached_LF(range, cursor, middle);
                     
                     if (cursor == probe_string_begin || ((cursor - mem.begin) % sub_mem_count_thinning == 0)) {
-                        if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : gcsa->count(range)) <= parent_range_count) {
+                        if ((use_approx_sub_mem_count ? gcsa::Range::length(range) : cached_count(range)) <= parent_range_count) {
                             // this probe is too long and it no longer is contained in the indendent hit
                             // that we detected
                             contained_in_independent_match = false;
@@ -1027,11 +1254,40 @@ void BaseMapper::rescue_high_count_order_length_mems(vector<MaximalExactMatch>&
             cerr << "found unfilled order length tract from MEM indexes " << mem_range.first << ":" << mem_range.second << ", filling with representative " << mems[min_hit_mem] << " with " << min_hit_count << " hits" << endl;
 #endif
             
-            gcsa->locate(mems[min_hit_mem].range, mems[min_hit_mem].nodes);
+            locate_bounded(mems[min_hit_mem].range, max_rescue_hit_count, mems[min_hit_mem].nodes);
           
         }
     }
 }
+
+size_t BaseMapper::locate_bounded(const gcsa::range_type& range, size_t max_hits,
+                                  vector<gcsa::node_type>& locations) {
+    locations.clear();
+    if (gcsa::Range::empty(range)) {
+        return 0;
+    }
+    size_t range_size = gcsa::Range::length(range);
+    if (max_hits == 0 || range_size <= max_hits) {
+        gcsa->locate(range, locations);
+        return range_size;
+    }
+    
+    // take the middle of each of max_hits equal strata of the range, so that the sample
+    // isn't clustered at the lexicographically smallest suffixes
+    for (size_t i = 0; i < max_hits && locations.size() < max_hits; i++) {
+        size_t offset = ((2 * i + 1) * range_size) / (2 * max_hits);
+        gcsa->locate(range.first + offset, locations, true, false);
+    }
+    
+    // one SA position can have several nodes, and different positions can share nodes
+    sort(locations.begin(), locations.end());
+    locations.erase(unique(locations.begin(), locations.end()), locations.end());
+    if (locations.size() > max_hits) {
+        locations.resize(max_hits);
+    }
+    
+    return range_size;
+}
     
 size_t BaseMapper::get_adaptive_min_reseed_length(size_t parent_mem_length) {
     // extend memo until it contains this parent MEM length
@@ -1092,7 +1348,7 @@ void BaseMapper::fill_nonredundant_sub_mem_nodes(vector<MaximalExactMatch>& pare
         for (size_t parent_idx : parent_idxs) {
             // get the parent MEM
             MaximalExactMatch& parent_mem = parent_mems[parent_idx];
-            num_parent_hits.push_back(gcsa->count(parent_mem.range));
+            num_parent_hits.push_back(cached_count(parent_mem.range));
             
             if (positions_by_index[parent_idx].empty()) {
                 // the parent MEM's positions by index haven't been calculated yet, so do it
@@ -1295,6 +1551,46 @@ void BaseMapper::set_alignment_threads(int new_thread_count) {
     alignment_threads = new_thread_count;
 }
 
+// allocation statistics, accumulated over all threads' scratch arenas
+static atomic<size_t> scratch_arena_resets(0);
+static atomic<size_t> scratch_arena_total_bytes(0);
+static atomic<size_t> scratch_arena_peak_bytes(0);
+
+google::protobuf::Arena& BaseMapper::scratch_arena() {
+    static thread_local google::protobuf::Arena arena;
+    return arena;
+}
+
+void BaseMapper::reset_scratch_arena() {
+    size_t bytes = scratch_arena().Reset();
+    
+    scratch_arena_resets++;
+    scratch_arena_total_bytes += bytes;
+    size_t peak = scratch_arena_peak_bytes.load();
+    while (bytes > peak && !scratch_arena_peak_bytes.compare_exchange_weak(peak, bytes)) {
+        // another thread raised the peak, try again against its value
+    }
+}
+
+BaseMapper::ScratchArenaStats BaseMapper::get_scratch_arena_stats() {
+    ScratchArenaStats stats;
+    stats.resets = scratch_arena_resets.load();
+    stats.total_bytes = scratch_arena_total_bytes.load();
+    stats.peak_bytes = scratch_arena_peak_bytes.load();
+    return stats;
+}
+
+/// Most queries a thread remembers in its distance memo before it starts over
+static const size_t MAX_DISTANCE_MEMO_SIZE = 100000;
+
+int64_t BaseMapper::indexed_distance(pos_t pos1, pos_t pos2, int64_t maximum) const {
+    static thread_local DistanceIndex::memo_t memo;
+    if (memo.size() >= MAX_DISTANCE_MEMO_SIZE) {
+        memo.clear();
+    }
+    return distance_index->min_distance(pos1, pos2, maximum, &memo);
+}
+
 bool BaseMapper::has_fixed_fragment_length_distr() {
     return fragment_length_distr.is_finalized();
 }
@@ -1368,8 +1664,17 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
     // always in order to choose between alignments.
     
     // Build Yohei's recombination probability calculator. Feed it the haplotype
-    // count from the XG index that was generated alongside the GBWT.
-    haplo::haploMath::RRMemo haplo_memo(NEG_LOG_PER_BASE_RECOMB_PROB, haplotype_count);
+    // count from the XG index that was generated alongside the GBWT. Its tables
+    // only depend on the count, so each thread keeps one until the count changes.
+    static thread_local unique_ptr<haplo::haploMath::RRMemo> haplo_memo;
+    if (!haplo_memo || haplo_memo->get_population_size() != haplotype_count) {
+        haplo_memo.reset(new haplo::haploMath::RRMemo(NEG_LOG_PER_BASE_RECOMB_PROB, haplotype_count));
+    }
+    
+    // Candidate alignments (of this read and its mate) mostly visit the same
+    // nodes, so share the GBWT search work for their common prefixes
+    static thread_local haplo::haplo_DP_prefix_cache prefix_cache;
+    prefix_cache.clear();
     
     // This holds all the computed haplotype logprobs
     vector<double> haplotype_logprobs;
@@ -1395,7 +1700,7 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
         // This is a logprob (so, negative), and expresses the probability of the haplotype path being followed
         double haplotype_logprob;
         bool path_valid;
-        std::tie(haplotype_logprob, path_valid) = haplo::haplo_DP::score(aln->path(), *gbwt, haplo_memo);
+        std::tie(haplotype_logprob, path_valid) = haplo::haplo_DP::score(aln->path(), *gbwt, *haplo_memo, prefix_cache);
         
         if (!path_valid) {
             // Our path does something the scorer doesn't like.
@@ -1433,6 +1738,10 @@ void BaseMapper::apply_haplotype_consistency_scores(const vector<Alignment*>& al
     }
 }
     
+int BaseMapper::seed_order(void) const {
+    return minimizer_index ? minimizer_index->k() : gcsa->order();
+}
+    
 double BaseMapper::estimate_gc_content(void) {
     
     uint64_t at = 0, gc = 0;
@@ -1442,6 +1751,13 @@ double BaseMapper::estimate_gc_content(void) {
         gc = gcsa::Range::length(gcsa->find(string("G"))) + gcsa::Range::length(gcsa->find(string("C")));
     }
     
+    if ((at == 0 || gc == 0) && xindex) {
+        // Fall back on the base composition stored in the XG
+        auto& counts = xindex->base_counts();
+        at = counts[0] + counts[3];
+        gc = counts[1] + counts[2];
+    }
+    
     if (at == 0 || gc == 0) {
         return default_gc_content;
     }
@@ -1503,6 +1819,9 @@ Mapper::Mapper(xg::XG* xidex,
     , always_rescue(false)
     , max_cluster_mapping_quality(1024)
     , use_cluster_mq(false)
+    , use_sparse_chaining(false)
+    , max_chaining_hits(4096)
+    , long_read_chaining(false)
     , simultaneous_pair_alignment(true)
     , drop_chain(0.2)
     , mq_overlap(0.2)
@@ -1514,6 +1833,7 @@ Mapper::Mapper(xg::XG* xidex,
     , identity_weight(2)
     , pair_rescue_hang_threshold(0.7)
     , pair_rescue_retry_threshold(0.5)
+    , rescue_seed_length(12)
     , include_full_length_bonuses(true)
 {
     
@@ -1528,9 +1848,7 @@ Mapper::~Mapper(void) {
 }
 
 double Mapper::graph_entropy(void) {
-    const size_t seq_bytes = xindex->sequence_bit_size() / 8;
-    char* seq = (char*) xindex->sequence_data();
-    return entropy(seq, seq_bytes);
+    return xindex->sequence_entropy();
 }
 
 // todo add options for aligned global and pinned
@@ -1541,7 +1859,8 @@ Alignment Mapper::align_to_graph(const Alignment& aln,
                                  bool pinned_alignment,
                                  bool pin_left,
                                  bool banded_global,
-                                 bool keep_bonuses) {
+                                 bool keep_bonuses,
+                                 AlignableGraph* alignable) {
     // check if we need to make a vg graph to handle this graph
     Alignment aligned;
     if (!is_id_sortable(graph) || has_inversion(graph)) {
@@ -1580,9 +1899,17 @@ Alignment Mapper::align_to_graph(const Alignment& aln,
             size_t band_padding = permissive_banding ? max(max_span, (size_t) 1) : band_padding_override;
             get_aligner(!aln.quality().empty())->align_global_banded(aligned, graph, band_padding, false);
         } else if (pinned_alignment) {
-            get_aligner(!aln.quality().empty())->align_pinned(aligned, graph, pin_left);
+            if (alignable) {
+                get_aligner(!aln.quality().empty())->align_pinned(aligned, *alignable, pin_left);
+            } else {
+                get_aligner(!aln.quality().empty())->align_pinned(aligned, graph, pin_left);
+            }
         } else {
-            get_aligner(!aln.quality().empty())->align(aligned, graph, traceback, false);
+            if (alignable) {
+                get_aligner(!aln.quality().empty())->align(aligned, *alignable, traceback, false);
+            } else {
+                get_aligner(!aln.quality().empty())->align(aligned, graph, traceback, false);
+            }
         }
     }
     if (traceback && !keep_bonuses && aligned.score()) {
@@ -1645,22 +1972,27 @@ pos_t Mapper::likely_mate_position(const Alignment& aln, bool is_first_mate) {
     }
 }
 
-map<string, vector<pair<size_t, bool> > > Mapper::alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby) {
-    map<string, vector<pair<size_t, bool> > > offsets;
+vector<pair<size_t, vector<pair<size_t, bool> > > > Mapper::alignment_path_rank_offsets(const Alignment& aln, bool just_min, bool nearby) {
+    vector<pair<size_t, vector<pair<size_t, bool> > > > offsets;
+    // reads touch few paths, so a scan over the ones seen so far is cheaper than a map
+    auto record = [&](size_t path_rank, size_t offset, bool is_rev) {
+        auto it = offsets.begin();
+        while (it != offsets.end() && it->first < path_rank) ++it;
+        if (it == offsets.end() || it->first != path_rank) {
+            it = offsets.insert(it, make_pair(path_rank, vector<pair<size_t, bool> >()));
+        }
+        it->second.push_back(make_pair(offset, is_rev));
+    };
     for (auto& mapping : aln.path().mapping()) {
-        auto pos_offs = (nearby ?
-                         xindex->nearest_offsets_in_paths(make_pos_t(mapping.position()), aln.sequence().size())
-                         : xindex->offsets_in_paths(make_pos_t(mapping.position())));
-        for (auto& p : pos_offs) {
-            auto& v = offsets[p.first];
-            auto& y = p.second;
-            v.reserve(v.size() + distance(y.begin(),y.end()));
-            v.insert(v.end(),y.begin(),y.end());
+        if (nearby) {
+            xindex->for_each_nearest_offset_in_paths(make_pos_t(mapping.position()), aln.sequence().size(), record);
+        } else {
+            xindex->for_each_offset_in_paths(make_pos_t(mapping.position()), record);
         }
         //if (just_first && offsets.size()) break; // find a single node that has a path position
     }
     if (!nearby && offsets.empty()) { // find the nearest if we couldn't find any before
-        return alignment_path_offsets(aln, just_min, true);
+        return alignment_path_rank_offsets(aln, just_min, true);
     }
     if (just_min) {
         // take the min offset in each path
@@ -1677,6 +2009,14 @@ map<string, vector<pair<size_t, bool> > > Mapper::alignment_path_offsets(const A
     return offsets;
 }
 
+map<string, vector<pair<size_t, bool> > > Mapper::alignment_path_offsets(const Alignment& aln, bool just_min, bool nearby) {
+    map<string, vector<pair<size_t, bool> > > offsets;
+    for (auto& p : alignment_path_rank_offsets(aln, just_min, nearby)) {
+        offsets[xindex->path_name(p.first)] = std::move(p.second);
+    }
+    return offsets;
+}
+
 map<string ,vector<pair<size_t, bool> > > Mapper::alignment_refpos_to_path_offsets(const Alignment& aln) {
     map<string, vector<pair<size_t, bool> > > offsets;
     for (auto& refpos : aln.refpos()) {
@@ -1690,14 +2030,15 @@ vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_
     if (xindex->path_count == 0) {
         return { likely_mate_position(aln, is_first_mate) };
     }
-    map<string, vector<pair<size_t, bool> > > offsets;
+    vector<pair<size_t, vector<pair<size_t, bool> > > > offsets;
     for (auto& mapping : aln.path().mapping()) {
-        auto pos_offs = xindex->nearest_offsets_in_paths(make_pos_t(mapping.position()), aln.sequence().size());
-        for (auto& p : pos_offs) {
-            if (offsets.find(p.first)  == offsets.end()) {
-                offsets[p.first] = p.second;
-            }
-        }
+        xindex->for_each_nearest_offset_in_paths(make_pos_t(mapping.position()), aln.sequence().size(),
+                                                 [&](size_t path_rank, size_t offset, bool is_rev) {
+                if (offsets.empty() || offsets.back().first != path_rank) {
+                    offsets.push_back(make_pair(path_rank, vector<pair<size_t, bool> >()));
+                }
+                offsets.back().second.push_back(make_pair(offset, is_rev));
+            });
         if (offsets.size()) break; // find a single node that has a path position
     }
     // get our fragment model on the stack
@@ -1708,7 +2049,7 @@ vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_
     for (auto& seq : offsets) {
         // find the likely position
         // then direction
-        auto& seq_name = seq.first;
+        string seq_name = xindex->path_name(seq.first);
         for (auto& p : seq.second) { 
             size_t path_pos = p.first;
             bool on_reverse_path = p.second;
@@ -1755,8 +2096,167 @@ vector<pos_t> Mapper::likely_mate_positions(const Alignment& aln, bool is_first_
     return likely;
 }
 
+/// Return true if some k-mer of seq can be read along either strand of the
+/// graph, following edges between nodes. Also returns true if walking over
+/// the node boundaries takes more than max_steps steps, so that the caller
+/// doesn't skip anything on account of a search that gave up.
+static bool shares_kmer(const Graph& graph, const string& seq, size_t k, size_t max_steps) {
+    
+    if (k == 0 || k > 32 || seq.size() < k) {
+        return true;
+    }
+    
+    // pack the k-mers 2 bits to a base, leaving out any with Ns
+    auto encode = [](char c) -> int {
+        switch (c) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return -1;
+        }
+    };
+    uint64_t mask = k == 32 ? numeric_limits<uint64_t>::max() : (uint64_t(1) << (2 * k)) - 1;
+    unordered_set<uint64_t> seq_kmers;
+    uint64_t kmer = 0;
+    size_t run = 0;
+    for (char c : seq) {
+        int code = encode(c);
+        if (code < 0) {
+            run = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | code) & mask;
+        if (++run >= k) {
+            seq_kmers.insert(kmer);
+        }
+    }
+    if (seq_kmers.empty()) {
+        return true;
+    }
+    
+    // the sequences of the node strands, as forward/reverse pairs by node
+    vector<string> strand_seqs;
+    unordered_map<id_t, size_t> node_rank;
+    strand_seqs.reserve(graph.node_size() * 2);
+    for (size_t i = 0; i < graph.node_size(); i++) {
+        node_rank[graph.node(i).id()] = i;
+        strand_seqs.push_back(graph.node(i).sequence());
+        strand_seqs.push_back(reverse_complement(graph.node(i).sequence()));
+    }
+    // which strands follow each strand
+    vector<vector<size_t>> next_strands(strand_seqs.size());
+    for (auto& edge : graph.edge()) {
+        auto from = node_rank.find(edge.from());
+        auto to = node_rank.find(edge.to());
+        if (from == node_rank.end() || to == node_rank.end()) {
+            continue;
+        }
+        size_t from_strand = 2 * from->second + edge.from_start();
+        size_t to_strand = 2 * to->second + edge.to_end();
+        next_strands[from_strand].push_back(to_strand);
+        // and the same edge read along the other strands
+        next_strands[to_strand ^ 1].push_back(from_strand ^ 1);
+    }
+    
+    size_t steps = 0;
+    // continue a partial k-mer of the given length into the strand, and
+    // onward; return true if we find one of the sequence's k-mers
+    function<bool(size_t, uint64_t, size_t)> extend = [&](size_t strand, uint64_t partial, size_t length) {
+        if (++steps > max_steps) {
+            return true;
+        }
+        const string& strand_seq = strand_seqs[strand];
+        for (size_t i = 0; i < strand_seq.size(); i++) {
+            int code = encode(strand_seq[i]);
+            if (code < 0) {
+                return false;
+            }
+            partial = ((partial << 2) | code) & mask;
+            if (++length == k) {
+                return seq_kmers.count(partial) != 0;
+            }
+        }
+        for (size_t next : next_strands[strand]) {
+            if (extend(next, partial, length)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    
+    for (size_t strand = 0; strand < strand_seqs.size(); strand++) {
+        const string& strand_seq = strand_seqs[strand];
+        // the k-mers inside the strand
+        kmer = 0;
+        run = 0;
+        for (char c : strand_seq) {
+            int code = encode(c);
+            if (code < 0) {
+                run = 0;
+                continue;
+            }
+            kmer = ((kmer << 2) | code) & mask;
+            if (++run >= k && seq_kmers.count(kmer)) {
+                return true;
+            }
+        }
+        // and the ones that start here and run off the end
+        for (size_t start = strand_seq.size() > k - 1 ? strand_seq.size() - (k - 1) : 0;
+             start < strand_seq.size(); start++) {
+            uint64_t partial = 0;
+            size_t length = 0;
+            for (size_t i = start; i < strand_seq.size(); i++) {
+                int code = encode(strand_seq[i]);
+                if (code < 0) {
+                    break;
+                }
+                partial = ((partial << 2) | code) & mask;
+                length++;
+            }
+            if (length != strand_seq.size() - start) {
+                // there's an N in the way
+                continue;
+            }
+            for (size_t next : next_strands[strand]) {
+                if (extend(next, partial, length)) {
+                    return true;
+                }
+            }
+        }
+    }
+    
+    return false;
+}
+
+Graph Mapper::rescue_window(const vector<pos_t>& mate_positions, int get_at_least) {
+    StageTimer timer(MappingStage::RescueWindow);
+    
+    // windows are the same if they're around the same node strands
+    string key = to_string(get_at_least);
+    for (auto& mate_pos : mate_positions) {
+        key += (is_rev(mate_pos) ? '-' : '+') + to_string(id(mate_pos));
+    }
+    const Graph* cached = rescue_window_cache.find(key);
+    if (cached != nullptr) {
+        timer.add_items(1);
+        return *cached;
+    }
+    
+    Graph graph;
+    for (auto& mate_pos : mate_positions) {
+#ifdef debug_rescue
+        if (debug) cerr << "aiming for " << mate_pos << endl;
+#endif
+        graph.MergeFrom(xindex->graph_context_id(mate_pos, get_at_least/2, get_at_least/2));
+        //if (debug) cerr << "rescue got graph " << pb2json(graph) << endl;
+    }
+    sort_by_id_dedup_and_clean(graph);
+    return rescue_window_cache.put(key, graph);
+}
+
 pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2, int match_score, int full_length_bonus, bool traceback) {
-    auto pair_sig = signature(mate1, mate2);
+    StageTimer timer(MappingStage::PairRescue);
     // bail out if we can't figure out how far to go
     bool rescued1 = false;
     bool rescued2 = false;
@@ -1803,35 +2303,41 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2, int mat
         return make_pair(false, false);
     }
     if (mate_positions.empty()) return make_pair(false, false); // can't rescue because the selected mate is unaligned
-    Graph graph;
     set<bool> orientations;
 #ifdef debug_rescue
     if (debug) cerr << "got " << mate_positions.size() << " mate positions" << endl;
 #endif
     for (auto& mate_pos : mate_positions) {
+        orientations.insert(is_rev(mate_pos));
+    }
+    int get_at_least = (!frag_stats.cached_fragment_length_mean ? frag_stats.fragment_max
+                        : min(frag_stats.fragment_max/2,
+                              (int64_t)max((double)frag_stats.cached_fragment_length_stdev * 6.0,
+                                           mate1.sequence().size() * 3.0)));
+    //cerr << "Getting at least " << get_at_least << endl;
+    Graph graph = rescue_window(mate_positions, get_at_least);
+    
+    if (rescue_seed_length > 0) {
+        // don't bother aligning if the mate has no seed in the window at all
+        StageTimer filter_timer(MappingStage::RescueSeedFilter);
+        const string& rescued_seq = rescue_off_first ? mate2.sequence() : mate1.sequence();
+        if (!shares_kmer(graph, rescued_seq, rescue_seed_length, 100 * graph.node_size() + 1000)) {
 #ifdef debug_rescue
-        if (debug) cerr << "aiming for " << mate_pos << endl;
+            if (debug) cerr << "no seeds for the mate in the rescue window" << endl;
 #endif
-        orientations.insert(is_rev(mate_pos));
-        int get_at_least = (!frag_stats.cached_fragment_length_mean ? frag_stats.fragment_max
-                            : min(frag_stats.fragment_max/2,
-                                  (int64_t)max((double)frag_stats.cached_fragment_length_stdev * 6.0,
-                                               mate1.sequence().size() * 3.0)));
-        //cerr << "Getting at least " << get_at_least << endl;
-        graph.MergeFrom(xindex->graph_context_id(mate_pos, get_at_least/2));
-        graph.MergeFrom(xindex->graph_context_id(reverse(mate_pos, get_node_length(id(mate_pos))), get_at_least/2));
-        //if (debug) cerr << "rescue got graph " << pb2json(graph) << endl;
-        // if we're reversed, align the reverse sequence and flip it back
-        // align against it
+            filter_timer.add_items(1);
+            return make_pair(false, false);
+        }
     }
-    sort_by_id_dedup_and_clean(graph);
     //VG g; g.extend(graph);string h = g.hash();
     //g.serialize_to_file("rescue-" + h + ".vg");
     int max_mate1_score = mate1.score();
     int max_mate2_score = mate2.score();
+    // all the rescue alignments are against the same graph
+    AlignableGraph alignable(graph);
     for (auto& orientation : orientations) {
         if (rescue_off_first) {
-            Alignment aln2 = align_maybe_flip(mate2, graph, orientation, traceback);
+            Alignment aln2 = align_maybe_flip(mate2, graph, orientation, traceback, false, &alignable);
             //write_alignment_to_file(aln2, "rescue-" + h + ".gam");
 #ifdef debug_rescue
             if (debug) cerr << "aln2 score/ident vs " << aln2.score() << "/" << aln2.identity()
@@ -1839,7 +2345,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2, int mat
 #endif
             if (aln2.score() > max_mate2_score && (double)aln2.score()/perfect_score > min_threshold && pair_consistent(mate1, aln2, accept_pval)) {
                 if (!traceback) { // now get the traceback
-                    aln2 = align_maybe_flip(mate2, graph, orientation, true);
+                    aln2 = align_maybe_flip(mate2, graph, orientation, true, false, &alignable);
                 }
 #ifdef debug_rescue
                 if (debug) cerr << "rescued aln2 " << pb2json(aln2) << endl;
@@ -1849,7 +2355,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2, int mat
                 rescued2 = true;
             }
         } else if (rescue_off_second) {
-            Alignment aln1 = align_maybe_flip(mate1, graph, orientation, traceback);
+            Alignment aln1 = align_maybe_flip(mate1, graph, orientation, traceback, false, &alignable);
             //write_alignment_to_file(aln1, "rescue-" + h + ".gam");
 #ifdef debug_rescue
             if (debug) cerr << "aln1 score/ident vs " << aln1.score() << "/" << aln1.identity()
@@ -1857,7 +2363,7 @@ pair<bool, bool> Mapper::pair_rescue(Alignment& mate1, Alignment& mate2, int mat
 #endif
             if (aln1.score() > max_mate1_score && (double)aln1.score()/perfect_score > min_threshold && pair_consistent(aln1, mate2, accept_pval)) {
                 if (!traceback) { // now get the traceback
-                    aln1 = align_maybe_flip(mate1, graph, orientation, true);
+                    aln1 = align_maybe_flip(mate1, graph, orientation, true, false, &alignable);
                 }
 #ifdef debug_rescue
                 if (debug) cerr << "rescued aln1 " << pb2json(aln1) << endl;
@@ -1879,9 +2385,7 @@ Alignment Mapper::realign_from_start_position(const Alignment& aln, int extra, i
     int score = aln.score();
     pos_t pos = make_pos_t(aln.path().mapping(0).position());
     int get_at_least = 1.61803 * aln.sequence().size() + extra;
-    Graph graph = xindex->graph_context_id(pos, get_at_least/1.61803);
-    graph.MergeFrom(xindex->graph_context_id(reverse(pos, get_node_length(id(pos))), get_at_least*(1-1/1.61803)));
-    sort_by_id_dedup_and_clean(graph);
+    Graph graph = xindex->graph_context_id(pos, get_at_least/1.61803, get_at_least*(1-1/1.61803));
     Alignment result = align_maybe_flip(aln, graph, is_rev(pos), true);
     if (result.score() >= score) {
         return result;
@@ -2026,24 +2530,22 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
 
     pair<vector<Alignment>, vector<Alignment>> results;
     double longest_lcp1, longest_lcp2, fraction_filtered1, fraction_filtered2;
-    // find the MEMs for the alignments
-    vector<MaximalExactMatch> mems1 = find_mems_deep(read1.sequence().begin(),
-                                                     read1.sequence().end(),
-                                                     longest_lcp1,
-                                                     fraction_filtered1,
-                                                     max_mem_length,
-                                                     min_mem_length,
-                                                     mem_reseed_length,
-                                                     true, false, false, true, 2);
-
-    vector<MaximalExactMatch> mems2 = find_mems_deep(read2.sequence().begin(),
-                                                     read2.sequence().end(),
-                                                     longest_lcp2,
-                                                     fraction_filtered2,
-                                                     max_mem_length,
-                                                     min_mem_length,
-                                                     mem_reseed_length,
-                                                     true, false, false, true, 2);
+    // find the MEMs for the alignments, searching along both reads together
+    vector<double> longest_lcps, fractions_filtered;
+    auto pair_mems = find_mems_deep_batch({make_pair(read1.sequence().cbegin(), read1.sequence().cend()),
+                                           make_pair(read2.sequence().cbegin(), read2.sequence().cend())},
+                                          longest_lcps,
+                                          fractions_filtered,
+                                          max_mem_length,
+                                          min_mem_length,
+                                          mem_reseed_length,
+                                          true, false, false, true, 2);
+    vector<MaximalExactMatch>& mems1 = pair_mems[0];
+    vector<MaximalExactMatch>& mems2 = pair_mems[1];
+    longest_lcp1 = longest_lcps[0];
+    longest_lcp2 = longest_lcps[1];
+    fraction_filtered1 = fractions_filtered[0];
+    fraction_filtered2 = fractions_filtered[1];
 
     double mq_cap1, mq_cap2;
     mq_cap1 = mq_cap2 = max_mapping_quality;
@@ -2055,7 +2557,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     double mem_read_ratio1 = min(1.0, (double)total_mem_length1 / (double)read1.sequence().size());
     double mem_read_ratio2 = min(1.0, (double)total_mem_length2 / (double)read2.sequence().size());
 
-    int basis_length = min((int)read1.sequence().size(), (int)gcsa->order());
+    int basis_length = min((int)read1.sequence().size(), seed_order());
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     int mem_max_length1 = 0;
@@ -2089,7 +2591,9 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
     if (debug) cerr << "mems for read 1 " << mems_to_json(mems1) << endl;
     if (debug) cerr << "mems for read 2 " << mems_to_json(mems2) << endl;
 
-    auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+    auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2,
+                                 const map<string, vector<pair<size_t, bool> > >& pos1,
+                                 const map<string, vector<pair<size_t, bool> > >& pos2) {
 
 #ifdef debug_mapper
 #pragma omp critical
@@ -2106,7 +2610,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
         // we handle the distance metric differently in these cases
         if (m1.fragment < m2.fragment) {
             int64_t max_length = frag_stats.fragment_max;
-            pair<int64_t, int64_t> d = mem_min_oriented_distances(m1, m2);
+            pair<int64_t, int64_t> d = min_oriented_distances(pos1, pos2);
             // if we have a cached fragment orientation, use it to pick the min distance with the correct path relative orientation
             int64_t approx_dist = (!frag_stats.fragment_size ? min(d.first, d.second)
                                    : (frag_stats.cached_fragment_orientation_same ? d.first : d.second));
@@ -2128,7 +2632,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
             return -std::numeric_limits<double>::max();
         } else {
             int max_length = max(read1.sequence().size(), read2.sequence().size());
-            pair<int64_t, int64_t> d = mem_min_oriented_distances(m1, m2);
+            pair<int64_t, int64_t> d = min_oriented_distances(pos1, pos2);
             int64_t approx_dist = d.first; // take the "same orientation" distance
             /*if (approx_dist < 32) {
                 approx_dist = min(approx_dist, graph_distance(m1_pos, m2_pos, max_length));
@@ -2167,7 +2671,8 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
             }
         }
 #endif
-    
+        
+        StageTimer timer(MappingStage::Clustering);
         MEMChainModel chainer({ read1.sequence().size(), read2.sequence().size() },
                               { mems1, mems2 },
                               [&](pos_t n) -> int64_t {
@@ -2179,6 +2684,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
                               transition_weight,
                               band_width);
         clusters = chainer.traceback(total_multimaps, false, debug);
+        timer.add_items(clusters.size());
     }
 
     auto show_clusters = [&](void) {
@@ -2285,7 +2791,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
         show_paired_clusters();
     }
     
-    set<pair<string, string> > seen_alignments;
+    unordered_set<uint64_t> seen_alignments;
     int filled1 = 0, filled2 = 0;
 
     for (auto& cluster_ptr : cluster_ptrs) {
@@ -2314,7 +2820,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
             p.second.clear_identity();
             p.second.clear_path();
         }
-        auto pair_sig = signature(p.first, p.second);
+        uint64_t pair_sig = signature_hash(p.first, p.second);
         if (seen_alignments.count(pair_sig)) {
             alns.pop_back();
             alns.emplace_back();
@@ -2379,7 +2885,7 @@ pair<vector<Alignment>, vector<Alignment>> Mapper::align_paired_multi(
         aln_ptrs.erase(
             std::remove_if(aln_ptrs.begin(), aln_ptrs.end(),
                            [&](pair<Alignment, Alignment>* p) {
-                               auto pair_sig = signature(p->first, p->second);
+                               uint64_t pair_sig = signature_hash(p->first, p->second);
                                if (seen_alignments.count(pair_sig)) {
                                    return true;
                                } else {
@@ -2802,7 +3308,7 @@ Mapper::align_mem_multi(const Alignment& aln,
     int total_mem_length = 0;
     for (auto& mem : mems) total_mem_length += mem.length(); // * mem.nodes.size();
     double mem_read_ratio = min(1.0, (double)total_mem_length / (double)aln.sequence().size());
-    int basis_length = min((int)aln.sequence().size(), (int)gcsa->order());
+    int basis_length = min((int)aln.sequence().size(), seed_order());
     double max_possible_mq = max_possible_mapping_quality(basis_length);
 
     // Estimate the maximum mapping quality we can get if the alignments based on the good MEMs are the best ones.
@@ -2826,11 +3332,13 @@ Mapper::align_mem_multi(const Alignment& aln,
     // go through the ordered single-hit MEMs
     // build the clustering model
     // find the alignments that are the best-scoring walks through it
-    auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
+    auto transition_weight = [&](const MaximalExactMatch& m1, const MaximalExactMatch& m2,
+                                 const map<string, vector<pair<size_t, bool> > >& pos1,
+                                 const map<string, vector<pair<size_t, bool> > >& pos2) {
         pos_t m1_pos = make_pos_t(m1.nodes.front());
         pos_t m2_pos = make_pos_t(m2.nodes.front());
         int64_t max_length = aln.sequence().size();
-        pair<int64_t, int64_t> d = mem_min_oriented_distances(m1, m2);
+        pair<int64_t, int64_t> d = min_oriented_distances(pos1, pos2);
         int64_t approx_dist = d.first;// same orientation
         /*if (approx_dist < 32 && same_orientation) {
             approx_dist = min(approx_dist, graph_distance(m1_pos, m2_pos, max_length));
@@ -2854,21 +3362,55 @@ Mapper::align_mem_multi(const Alignment& aln,
                 return 0.0;
             }
         }
-    };
-
-    // establish the chains
-    vector<vector<MaximalExactMatch> > clusters;
-    if (total_multimaps) {
-        MEMChainModel chainer({ aln.sequence().size() }, { mems },
-                              [&](pos_t n) {
-                                  return approx_position(n);
-                              },
-                              [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
-                                  return xindex->offsets_in_paths(n);
-                              },
-                              transition_weight,
-                              aln.sequence().size());
-        clusters = chainer.traceback(total_multimaps, false, debug);
+    };
+
+    // establish the chains
+    vector<vector<MaximalExactMatch> > clusters;
+    if (total_multimaps) {
+        StageTimer timer(MappingStage::Clustering);
+        if (use_sparse_chaining) {
+            // place each hit along its strand, so the chainer never has to
+            // compare hits pairwise
+            vector<SparseChainClusterer::Hit> hits;
+            vector<MaximalExactMatch> hit_mems;
+            for (auto& mem : mems) {
+                for (auto& node : mem.nodes) {
+                    pos_t pos = make_pos_t(node);
+                    SparseChainClusterer::Hit hit;
+                    hit.read_begin = mem.begin - aln.sequence().begin();
+                    hit.read_end = mem.end - aln.sequence().begin();
+                    hit.position = is_rev(pos) ? -approx_position(pos) : approx_position(pos);
+                    hit.space = is_rev(pos);
+                    hit.score = match * mem.length();
+                    hits.push_back(hit);
+                    hit_mems.emplace_back(mem, node);
+                    hit_mems.back().fragment = 1;
+                }
+            }
+            for (auto& chain : SparseChainClusterer::chain_hits(hits, match, gap_open, gap_extension,
+                                                                aln.sequence().size(), max_chaining_hits)) {
+                if (clusters.size() == total_multimaps) {
+                    break;
+                }
+                clusters.emplace_back();
+                for (size_t i : chain.second) {
+                    clusters.back().push_back(hit_mems[i]);
+                }
+            }
+        }
+        else {
+            MEMChainModel chainer({ aln.sequence().size() }, { mems },
+                                  [&](pos_t n) {
+                                      return approx_position(n);
+                                  },
+                                  [&](pos_t n) -> map<string, vector<pair<size_t, bool> > > {
+                                      return xindex->offsets_in_paths(n);
+                                  },
+                                  transition_weight,
+                                  aln.sequence().size());
+            clusters = chainer.traceback(total_multimaps, false, debug);
+        }
+        timer.add_items(clusters.size());
     }
     
     /*
@@ -2931,35 +3473,52 @@ Mapper::align_mem_multi(const Alignment& aln,
     // then fix it up with DP on the little bits between the alignments
     vector<Alignment> alns;
     vector<vector<MaximalExactMatch>*> used_clusters;
-    set<string> seen_alignments;
+    unordered_set<uint64_t> seen_alignments;
     int multimaps = 0;
     int filled = 0;
-    for (auto& cluster : clusters) {
-        if (alns.size() >= total_multimaps) { break; }
-        // skip if we've filtered the cluster
-        if (to_drop.count(&cluster) && filled >= min_multimaps*4) {
-            alns.push_back(aln);
-            used_clusters.push_back(&cluster);
-            continue;
+    auto next_cluster = clusters.begin();
+    vector<Alignment> batch_alns;
+    while (next_cluster != clusters.end() && alns.size() < total_multimaps) {
+        // align the clusters that we would go on to align if they all gave new
+        // alignments together, so that the aligner can batch them
+        vector<const vector<MaximalExactMatch>*> to_align;
+        auto batch_end = next_cluster;
+        for (int planned = alns.size(), planned_filled = filled;
+             batch_end != clusters.end() && planned < total_multimaps; ++batch_end, ++planned) {
+            if (!(to_drop.count(&*batch_end) && planned_filled >= min_multimaps*4)) {
+                to_align.push_back(&*batch_end);
+                ++planned_filled;
+            }
         }
-        ++filled;
-        Alignment candidate = align_cluster(aln, cluster, true);
-        string sig = signature(candidate);
+        batch_alns = align_clusters(aln, to_align, true);
+        auto batch_aln = batch_alns.begin();
+        for (; next_cluster != batch_end; ++next_cluster) {
+            auto& cluster = *next_cluster;
+            // skip if we've filtered the cluster
+            if (to_drop.count(&cluster) && filled >= min_multimaps*4) {
+                alns.push_back(aln);
+                used_clusters.push_back(&cluster);
+                continue;
+            }
+            ++filled;
+            Alignment candidate = std::move(*batch_aln++);
+            uint64_t sig = signature_hash(candidate);
 
 #ifdef debug_mapper
 #pragma omp critical
-        {
-            if (debug) {
-                cerr << "Alignment with signature " << sig << " (seen: " << seen_alignments.count(sig) << ")" << endl;
-                cerr << "\t" << pb2json(candidate) << endl;
+            {
+                if (debug) {
+                    cerr << "Alignment with signature " << sig << " (seen: " << seen_alignments.count(sig) << ")" << endl;
+                    cerr << "\t" << pb2json(candidate) << endl;
+                }
             }
-        }
 #endif
 
-        if (!seen_alignments.count(sig)) {
-            alns.push_back(candidate);
-            used_clusters.push_back(&cluster);
-            seen_alignments.insert(sig);
+            if (!seen_alignments.count(sig)) {
+                alns.push_back(std::move(candidate));
+                used_clusters.push_back(&cluster);
+                seen_alignments.insert(sig);
+            }
         }
     }
     
@@ -3009,12 +3568,13 @@ Mapper::align_mem_multi(const Alignment& aln,
     if (aln_ptrs.size()) {
         vector<Alignment> best_alns;
         int i = 0;
+        best_alns.reserve(aln_ptrs.size());
         for ( ; i < min((int)aln_ptrs.size(), keep_multimaps); ++i) {
             Alignment* alnp = aln_ptrs.at(i);
-            best_alns.push_back(*alnp);
+            best_alns.push_back(std::move(*alnp));
         }
         for ( ; i < aln_ptrs.size(); ++i) {
-            best_alns.push_back(*aln_ptrs[i]);
+            best_alns.push_back(std::move(*aln_ptrs[i]));
         }
         alns = score_sort_and_deduplicate_alignments(best_alns, aln);
     }
@@ -3036,25 +3596,9 @@ Mapper::align_mem_multi(const Alignment& aln,
     return alns;
 }
 
-Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, bool flip, bool traceback, bool banded_global) {
-    Alignment aln = base;
-    map<id_t, int64_t> node_length;
-    if (flip) {
-        for (auto& node : graph.node()) {
-            node_length[node.id()] = node.sequence().size();
-        }
-        aln.set_sequence(reverse_complement(base.sequence()));
-        if (!base.quality().empty()) {
-            aln.set_quality(base.quality());
-            reverse(aln.mutable_quality()->begin(),
-                    aln.mutable_quality()->end());
-        }
-    } else {
-        aln.set_sequence(base.sequence());
-        if (!base.quality().empty()) {
-            aln.set_quality(base.quality());
-        }
-    }
+Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, bool flip, bool traceback, bool banded_global,
+                                   AlignableGraph* alignable) {
+    Alignment aln = flip_for_alignment(base, flip);
     bool pinned_alignment = false;
     bool pinned_reverse = false;
 
@@ -3065,20 +3609,48 @@ Alignment Mapper::align_maybe_flip(const Alignment& base, Graph& graph, bool fli
                          pinned_alignment,
                          pinned_reverse,
                          banded_global,
-                         include_full_length_bonuses);
+                         include_full_length_bonuses,
+                         alignable);
+
+    finish_flipped_alignment(aln, graph, flip, traceback, banded_global);
+    return aln;
+}
+
+Alignment Mapper::flip_for_alignment(const Alignment& base, bool flip) {
+    Alignment aln = base;
+    if (flip) {
+        reverse_complement_in_place(*aln.mutable_sequence());
+        if (!aln.quality().empty()) {
+            reverse(aln.mutable_quality()->begin(),
+                    aln.mutable_quality()->end());
+        }
+    }
+    return aln;
+}
 
+void Mapper::finish_flipped_alignment(Alignment& aln, Graph& graph, bool flip, bool traceback, bool banded_global) {
     if (strip_bonuses && !banded_global && traceback) {
         // We want to remove the bonuses
         aln.set_score(get_aligner()->remove_bonuses(aln));
     }
     if (flip) {
-        aln = reverse_complement_alignment(
-            aln,
-            (function<int64_t(int64_t)>) ([&](int64_t id) {
-                    return node_length[id];
-                }));
+        id_map<int64_t> node_length;
+        if (graph.node_size()) {
+            id_t min_id = graph.node(0).id();
+            id_t max_id = min_id;
+            for (auto& node : graph.node()) {
+                min_id = min(min_id, node.id());
+                max_id = max(max_id, node.id());
+            }
+            node_length.reserve_ids(min_id, max_id, graph.node_size());
+        }
+        for (auto& node : graph.node()) {
+            node_length[node.id()] = node.sequence().size();
+        }
+        reverse_complement_alignment_in_place(&aln, [&](id_t id) {
+                return node_length[id];
+            });
     }
-    return aln;
 }
 
 double Mapper::compute_uniqueness(const Alignment& aln, const vector<MaximalExactMatch>& mems) {
@@ -3100,41 +3672,84 @@ double Mapper::compute_uniqueness(const Alignment& aln, const vector<MaximalExac
 }
 
 Alignment Mapper::align_cluster(const Alignment& aln, const vector<MaximalExactMatch>& mems, bool traceback) {
-    // poll the mems to see if we should flip
-    int count_fwd = 0, count_rev = 0;
-    for (auto& mem : mems) {
-        bool is_rev = gcsa::Node::rc(mem.nodes.front());
-        if (is_rev) {
-            ++count_rev;
+    return align_clusters(aln, vector<const vector<MaximalExactMatch>*>{&mems}, traceback).front();
+}
+
+vector<Alignment> Mapper::align_clusters(const Alignment& aln, const vector<const vector<MaximalExactMatch>*>& clusters,
+                                         bool traceback) {
+    StageTimer timer(MappingStage::ClusterAlignment);
+    timer.add_items(clusters.size());
+    
+    // the graphs have to stay put while the aligner works on them together
+    vector<Graph> graphs(clusters.size());
+    vector<unique_ptr<AlignableGraph>> alignables(clusters.size());
+    // the forward and reverse alignments to each cluster
+    vector<pair<Alignment, Alignment>> cluster_alns(clusters.size());
+    // the ones that align_to_graph would hand straight to gssw, which can go in a batch
+    vector<pair<Alignment*, AlignableGraph*>> jobs;
+    vector<pair<size_t, bool>> job_clusters;
+    
+    for (size_t i = 0; i < clusters.size(); i++) {
+        // poll the mems to see if we should flip
+        int count_fwd = 0, count_rev = 0;
+        for (auto& mem : *clusters[i]) {
+            bool is_rev = gcsa::Node::rc(mem.nodes.front());
+            if (is_rev) {
+                ++count_rev;
+            } else {
+                ++count_fwd;
+            }
+        }
+        // get the graph with cluster.hpp's cluster_subgraph
+        graphs[i] = cluster_subgraph(*xindex, aln, *clusters[i]);
+        // and test each direction for which we have MEM hits, converting the graph only once
+        alignables[i].reset(new AlignableGraph(graphs[i]));
+        bool batchable = is_id_sortable(graphs[i]) && !has_inversion(graphs[i]);
+        for (bool flip : {false, true}) {
+            if (!(flip ? count_rev : count_fwd)) {
+                continue;
+            }
+            Alignment& cluster_aln = flip ? cluster_alns[i].second : cluster_alns[i].first;
+            if (batchable) {
+                cluster_aln = flip_for_alignment(aln, flip);
+                jobs.emplace_back(&cluster_aln, alignables[i].get());
+                job_clusters.emplace_back(i, flip);
+            } else {
+                cluster_aln = align_maybe_flip(aln, graphs[i], flip, traceback, false, alignables[i].get());
+            }
+        }
+    }
+    
+    get_aligner(!aln.quality().empty())->align_batch(jobs, traceback);
+    for (size_t j = 0; j < jobs.size(); j++) {
+        // finish off as align_to_graph and align_maybe_flip would
+        Alignment& aligned = *jobs[j].first;
+        if (traceback && !include_full_length_bonuses && aligned.score()) {
+            remove_full_length_bonuses(aligned);
+        }
+        finish_flipped_alignment(aligned, graphs[job_clusters[j].first], job_clusters[j].second, traceback, false);
+    }
+    
+    vector<Alignment> results;
+    results.reserve(clusters.size());
+    for (auto& cluster_aln : cluster_alns) {
+        Alignment& aln_fwd = cluster_aln.first;
+        Alignment& aln_rev = cluster_aln.second;
+        // TODO check if we have soft clipping on the end of the graph and if so try to expand the context
+        if (aln_fwd.score() + aln_rev.score() == 0) {
+            // abject failure, nothing aligned with score > 0
+            results.push_back(aln);
+            results.back().clear_path();
+            results.back().clear_score();
+        } else if (aln_rev.score() > aln_fwd.score()) {
+            // reverse won
+            results.push_back(std::move(aln_rev));
         } else {
-            ++count_fwd;
-        }
-    }
-    // get the graph with cluster.hpp's cluster_subgraph
-    Graph graph = cluster_subgraph(*xindex, aln, mems);
-    // and test each direction for which we have MEM hits
-    Alignment aln_fwd;
-    Alignment aln_rev;
-    if (count_fwd) {
-        aln_fwd = align_maybe_flip(aln, graph, false, traceback);
-    }
-    if (count_rev) {
-        aln_rev = align_maybe_flip(aln, graph, true, traceback);
-    }
-    // TODO check if we have soft clipping on the end of the graph and if so try to expand the context
-    if (aln_fwd.score() + aln_rev.score() == 0) {
-        // abject failure, nothing aligned with score > 0
-        Alignment result = aln;
-        result.clear_path();
-        result.clear_score();
-        return result;
-    } else if (aln_rev.score() > aln_fwd.score()) {
-        // reverse won
-        return aln_rev;
-    } else {
-        // forward won
-        return aln_fwd;
+            // forward won
+            results.push_back(std::move(aln_fwd));
+        }
     }
+    return results;
 }
 
 VG Mapper::cluster_subgraph_strict(const Alignment& aln, const vector<MaximalExactMatch>& mems) {
@@ -3202,9 +3817,8 @@ VG Mapper::alignment_subgraph(const Alignment& aln, int context_size) {
         nodes.insert(path.mapping(i).position().node_id());
     }
     VG graph;
-    for (auto& node : nodes) {
-        *graph.graph.add_node() = xindex->node(node);
-    }
+    // The set is sorted, so this walks the index in order.
+    xindex->add_nodes_to_graph(vector<id_t>(nodes.begin(), nodes.end()), graph.graph);
     xindex->expand_context(graph.graph, max(1, context_size), false); // get connected edges
     graph.rebuild_indexes();
     return graph;
@@ -3213,12 +3827,14 @@ VG Mapper::alignment_subgraph(const Alignment& aln, int context_size) {
 // estimate the fragment length as the difference in mean positions of both alignments
 map<string, int64_t> Mapper::min_pair_fragment_length(const Alignment& aln1, const Alignment& aln2) {
     map<string, int64_t> lengths;
-    auto pos1 = alignment_path_offsets(aln1);
-    auto pos2 = alignment_path_offsets(aln2);
+    auto pos1 = alignment_path_rank_offsets(aln1);
+    auto pos2 = alignment_path_rank_offsets(aln2);
+    // both are sorted by path rank, so walk them together
+    auto x = pos2.begin();
     for (auto& p : pos1) {
-        auto x = pos2.find(p.first);
-        if (x != pos2.end()) {
-            auto& d = lengths[p.first];
+        while (x != pos2.end() && x->first < p.first) ++x;
+        if (x != pos2.end() && x->first == p.first) {
+            int64_t d = 0;
             int64_t l = std::numeric_limits<int64_t>::max();
             for (auto& pos1 : p.second) {
                 for (auto& pos2 : x->second) {
@@ -3228,6 +3844,7 @@ map<string, int64_t> Mapper::min_pair_fragment_length(const Alignment& aln1, con
                     }
                 }
             }
+            lengths[xindex->path_name(p.first)] = d;
         }
     }
     //cerr << "got lengths "; for (auto& c : lengths) cerr << c.first << ":" << c.second << " "; cerr << endl;
@@ -3269,12 +3886,14 @@ void FragmentLengthStatistics::save_frag_lens_to_alns(Alignment& aln1, Alignment
 void FragmentLengthStatistics::record_fragment_configuration(const Alignment& aln1, const Alignment& aln2, Mapper* mapper) {
     if (fixed_fragment_model) return;
     assert(aln1.path().mapping(0).has_position() && aln2.path().mapping(0).has_position());    
-    map<string, tuple<int64_t, bool, bool> > lengths;
-    auto pos1 = mapper->alignment_path_offsets(aln1);
-    auto pos2 = mapper->alignment_path_offsets(aln2);
+    map<size_t, tuple<int64_t, bool, bool> > lengths;
+    auto pos1 = mapper->alignment_path_rank_offsets(aln1);
+    auto pos2 = mapper->alignment_path_rank_offsets(aln2);
+    // both are sorted by path rank, so walk them together
+    auto x = pos2.begin();
     for (auto& p : pos1) {
-        auto x = pos2.find(p.first);
-        if (x != pos2.end()) {
+        while (x != pos2.end() && x->first < p.first) ++x;
+        if (x != pos2.end() && x->first == p.first) {
             auto& d = lengths[p.first];
             int64_t l = std::numeric_limits<int64_t>::max();
             for (auto& pos1 : p.second) {
@@ -3615,6 +4234,10 @@ vector<Alignment> Mapper::make_bands(const Alignment& read, int band_width, vect
 
 vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int stride, int max_mem_length, int band_width) {
 
+    if (long_read_chaining) {
+        return align_long_read(read, max_mem_length, band_width);
+    }
+
     auto aligner = get_aligner(!read.quality().empty());
     int8_t match = aligner->match;
     int8_t gap_extension = aligner->gap_extension;
@@ -3739,6 +4362,305 @@ vector<Alignment> Mapper::align_banded(const Alignment& read, int kmer_size, int
     return alignments;
 }
 
+/// Remove the nodes with no sequence that cutting an extracted graph at a
+/// node boundary leaves behind, along with their edges, since the aligners
+/// can't handle them.
+static void remove_empty_nodes(Graph& graph) {
+    unordered_set<id_t> empty;
+    for (auto& node : graph.node()) {
+        if (node.sequence().empty()) {
+            empty.insert(node.id());
+        }
+    }
+    if (empty.empty()) {
+        return;
+    }
+    Graph kept;
+    for (auto& node : graph.node()) {
+        if (!empty.count(node.id())) {
+            *kept.add_node() = node;
+        }
+    }
+    for (auto& edge : graph.edge()) {
+        if (!empty.count(edge.from()) && !empty.count(edge.to())) {
+            *kept.add_edge() = edge;
+        }
+    }
+    graph = move(kept);
+}
+
+vector<Alignment> Mapper::align_long_read(const Alignment& read, int max_mem_length, int band_width) {
+
+    auto aligner = get_aligner(!read.quality().empty());
+    int8_t match = aligner->match;
+    int8_t gap_extension = aligner->gap_extension;
+    int8_t gap_open = aligner->gap_open;
+    int64_t read_length = read.sequence().size();
+    
+    // find the seeds of the whole read at once, rather than band by band
+    double longest_lcp, fraction_filtered;
+    vector<MaximalExactMatch> mems = find_mems_deep(read.sequence().begin(),
+                                                    read.sequence().end(),
+                                                    longest_lcp,
+                                                    fraction_filtered,
+                                                    max_mem_length,
+                                                    min_mem_length,
+                                                    mem_reseed_length,
+                                                    true, false, false, true, 2);
+    
+    // chain their hits across the whole read, as in align_mem_multi's sparse chaining
+    vector<SparseChainClusterer::Hit> hits;
+    vector<pair<const MaximalExactMatch*, pos_t>> hit_mems;
+    for (auto& mem : mems) {
+        for (auto& node : mem.nodes) {
+            pos_t pos = make_pos_t(node);
+            SparseChainClusterer::Hit hit;
+            hit.read_begin = mem.begin - read.sequence().begin();
+            hit.read_end = mem.end - read.sequence().begin();
+            hit.position = is_rev(pos) ? -approx_position(pos) : approx_position(pos);
+            hit.space = is_rev(pos);
+            hit.score = match * mem.length();
+            hits.push_back(hit);
+            hit_mems.emplace_back(&mem, pos);
+        }
+    }
+    vector<pair<int32_t, vector<size_t>>> chains;
+    {
+        StageTimer timer(MappingStage::Clustering);
+        chains = SparseChainClusterer::chain_hits(hits, match, gap_open, gap_extension,
+                                                  read_length, max_chaining_hits);
+        if (chains.size() > (size_t) max(max_multimaps, 1)) {
+            chains.resize(max(max_multimaps, 1));
+        }
+        timer.add_items(chains.size());
+    }
+    
+    auto node_length = [&](id_t id) {
+        return (int64_t) get_node_length(id);
+    };
+    
+    // a piece of the read that we couldn't align, placed at pos
+    auto unaligned_piece = [&](const string& seq, pos_t pos) {
+        Alignment piece;
+        piece.set_sequence(seq);
+        Mapping* mapping = piece.mutable_path()->add_mapping();
+        *mapping->mutable_position() = make_position(pos);
+        Edit* edit = mapping->add_edit();
+        edit->set_sequence(seq);
+        edit->set_to_length(seq.size());
+        return piece;
+    };
+    
+    // put an alignment to an extracted graph back in the node IDs of the index,
+    // where the first node may have been cut at the given position
+    auto translate_piece = [&](Alignment& piece, const unordered_map<id_t, id_t>& trans, pos_t cut_pos) {
+        Path path;
+        for (auto& mapping : piece.path().mapping()) {
+            // the alignment can begin and end with empty mappings on the anchoring nodes
+            if (mapping_from_length(mapping) || mapping_to_length(mapping)) {
+                *path.add_mapping() = mapping;
+            }
+        }
+        translate_node_ids(path, trans);
+        if (path.mapping_size() && path.mapping(0).position().node_id() == id(cut_pos)
+            && path.mapping(0).position().is_reverse() == is_rev(cut_pos)) {
+            path.mutable_mapping(0)->mutable_position()->set_offset(offset(cut_pos) + path.mapping(0).position().offset());
+        }
+        *piece.mutable_path() = path;
+    };
+    
+    // align the read along one chain, working on the strand of the read that
+    // the chain's hits are forward on
+    auto align_chain = [&](const vector<size_t>& chain) -> Alignment {
+        bool rev = hits[chain.front()].space;
+        Alignment strand_read;
+        strand_read.set_sequence(rev ? reverse_complement(read.sequence()) : read.sequence());
+        if (!read.quality().empty()) {
+            strand_read.set_quality(read.quality());
+            if (rev) {
+                reverse(strand_read.mutable_quality()->begin(), strand_read.mutable_quality()->end());
+            }
+        }
+        const string& sequence = strand_read.sequence();
+        
+        // the exact matches of the anchors, in strand order, with at least one
+        // base of the read between each of them so every gap has something to
+        // align
+        vector<Alignment> anchors;
+        vector<pair<int64_t, int64_t>> anchor_intervals;
+        for (size_t j = 0; j < chain.size(); j++) {
+            size_t i = rev ? chain[chain.size() - j - 1] : chain[j];
+            const MaximalExactMatch& mem = *hit_mems[i].first;
+            Alignment anchor = walk_match(mem.sequence(), hit_mems[i].second);
+            if (!anchor.has_path()) {
+                continue;
+            }
+            int64_t begin = hits[i].read_begin;
+            int64_t end = hits[i].read_end;
+            if (rev) {
+                anchor = reverse_complement_alignment(anchor, node_length);
+                begin = read_length - hits[i].read_end;
+                end = read_length - hits[i].read_begin;
+            }
+            if (!anchor_intervals.empty() && begin <= anchor_intervals.back().second) {
+                int64_t overlap = anchor_intervals.back().second + 1 - begin;
+                if (overlap >= end - begin) {
+                    continue;
+                }
+                anchor = strip_from_start(anchor, overlap);
+                begin += overlap;
+            }
+            anchors.push_back(simplify(anchor));
+            anchor_intervals.emplace_back(begin, end);
+        }
+        if (anchors.empty()) {
+            return Alignment();
+        }
+        
+        // gap k is between anchors k - 1 and k, and the first and last are the tails
+        vector<Alignment> gaps(anchors.size() + 1);
+        auto do_gap = [&](size_t k) {
+            int64_t gap_begin = k ? anchor_intervals[k - 1].second : 0;
+            int64_t gap_end = k < anchors.size() ? anchor_intervals[k].first : read_length;
+            Alignment& gap = gaps[k];
+            if (gap_begin == gap_end) {
+                return;
+            }
+            gap.set_sequence(sequence.substr(gap_begin, gap_end - gap_begin));
+            if (!strand_read.quality().empty()) {
+                gap.set_quality(strand_read.quality().substr(gap_begin, gap_end - gap_begin));
+            }
+            
+            // the last base of the anchor before the gap, and the first one after it
+            pos_t before = make_pos_t(0, false, 0);
+            if (k) {
+                const Mapping& last = anchors[k - 1].path().mapping(anchors[k - 1].path().mapping_size() - 1);
+                before = make_pos_t(last.position());
+                get_offset(before) += mapping_from_length(last) - 1;
+            }
+            pos_t after = k < anchors.size() ? make_pos_t(anchors[k].path().mapping(0).position()) : make_pos_t(0, false, 0);
+            
+            // alignments to the extracted graphs come back in its coordinates,
+            // where the node at cut_pos may only keep what comes after it
+            Graph graph;
+            unordered_map<id_t, id_t> trans;
+            pos_t cut_pos = make_pos_t(0, false, 0);
+            if (k == 0 || k == anchors.size()) {
+                // a tail, which we pin to the anchor next to it
+                bool left = k == 0;
+                pos_t tail_pos = after;
+                if (!left) {
+                    tail_pos = before;
+                    get_offset(tail_pos)++;
+                }
+                if (gap.sequence().size() <= (size_t) band_width) {
+                    trans = algorithms::extract_extending_graph(xindex, graph, gap.sequence().size() * 2,
+                                                                tail_pos, left, false);
+                    remove_empty_nodes(graph);
+                }
+                if (graph.node_size() == 0) {
+                    // the read runs off the graph, or the tail is too long to pin
+                    gap = unaligned_piece(gap.sequence(), tail_pos);
+                    return;
+                }
+                gap = align_to_graph(gap, graph, max_query_graph_ratio, true, true, !left, false,
+                                     include_full_length_bonuses);
+                if (!left) {
+                    // extending backward keeps the start of the node, so only
+                    // extending forward moves its offsets
+                    cut_pos = tail_pos;
+                }
+            } else {
+                // between two anchors, which we align end to end
+                if (gap.sequence().size() <= (size_t) band_width) {
+                    trans = algorithms::extract_connecting_graph(xindex, graph, gap.sequence().size() + max_band_jump,
+                                                                 before, after, false, false, true, true, true);
+                    remove_empty_nodes(graph);
+                }
+                if (graph.node_size() == 0) {
+                    // the anchors are adjacent, too far apart, or don't connect, so
+                    // the gap is an insertion
+                    gap = unaligned_piece(gap.sequence(), after);
+                    return;
+                }
+                gap = align_to_graph(gap, graph, max_query_graph_ratio, true, false, false, true,
+                                     include_full_length_bonuses);
+                cut_pos = before;
+                get_offset(cut_pos)++;
+            }
+            translate_piece(gap, trans, cut_pos);
+            if (gap.path().mapping_size() == 0) {
+                gap = unaligned_piece(gap.sequence(), k < anchors.size() ? after : cut_pos);
+            }
+        };
+        
+        {
+            StageTimer timer(MappingStage::ClusterAlignment);
+            timer.add_items(gaps.size());
+            if (alignment_threads > 1) {
+#pragma omp parallel for schedule(dynamic)
+                for (size_t k = 0; k < gaps.size(); ++k) {
+                    do_gap(k);
+                }
+            } else {
+                for (size_t k = 0; k < gaps.size(); ++k) {
+                    do_gap(k);
+                }
+            }
+        }
+        
+        // stitch the gaps and anchors together along the strand, and then put
+        // the alignment back on the read's strand
+        Alignment aln;
+        for (size_t k = 0; k < gaps.size(); ++k) {
+            extend_path(*aln.mutable_path(), gaps[k].path());
+            if (k < anchors.size()) {
+                extend_path(*aln.mutable_path(), anchors[k].path());
+            }
+        }
+        aln.set_sequence(sequence);
+        aln = simplify(aln);
+        if (rev) {
+            aln = reverse_complement_alignment(aln, node_length);
+        }
+        aln.set_name(read.name());
+        aln.set_sequence(read.sequence());
+        aln.set_quality(read.quality());
+        aln.set_score(score_alignment(aln));
+        aln.set_identity(identity(aln.path()));
+        return aln;
+    };
+    
+    vector<Alignment> alignments;
+    for (auto& chain : chains) {
+        Alignment aln = align_chain(chain.second);
+        if (aln.has_path()) {
+            alignments.push_back(move(aln));
+        }
+    }
+    if (alignments.empty()) {
+        // report the read as unaligned
+        alignments.push_back(read);
+        alignments.back().clear_path();
+        alignments.back().set_score(0);
+        return alignments;
+    }
+    if (patch_alignments) {
+        for (auto& aln : alignments) {
+            // patch in the gaps we left unaligned
+            aln = patch_alignment(aln, band_width);
+        }
+    }
+    std::sort(alignments.begin(), alignments.end(), [](const Alignment& aln1, const Alignment& aln2) { return aln1.score() > aln2.score(); });
+    if (alignments.size() == 1) {
+        alignments.front().set_mapping_quality(max_mapping_quality);
+    } else {
+        compute_mapping_qualities(alignments, 0, max_mapping_quality, max_mapping_quality);
+        filter_and_process_multimaps(alignments, max_multimaps);
+    }
+    return alignments;
+}
+
 bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
     // are they the same id, with offset differing by 1?
     if (pos1.node_id() == pos2.node_id()
@@ -3765,6 +4687,8 @@ bool Mapper::adjacent_positions(const Position& pos1, const Position& pos2) {
 
 void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_mq, double mq_estimate, double mq_cap) {
     if (alns.empty()) return;
+    StageTimer timer(MappingStage::MappingQuality);
+    timer.add_items(alns.size());
     double max_mq = min(mq_cap, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
     int sub_overlaps = sub_overlaps_of_first_aln(alns, mq_overlap);
@@ -3782,6 +4706,8 @@ void Mapper::compute_mapping_qualities(vector<Alignment>& alns, double cluster_m
     
 void Mapper::compute_mapping_qualities(pair<vector<Alignment>, vector<Alignment>>& pair_alns, double cluster_mq, double mq_estimate1, double mq_estimate2, double mq_cap1, double mq_cap2) {
     if (pair_alns.first.empty() || pair_alns.second.empty()) return;
+    StageTimer timer(MappingStage::MappingQuality);
+    timer.add_items(pair_alns.first.size());
     double max_mq1 = min(mq_cap1, (double)max_mapping_quality);
     double max_mq2 = min(mq_cap2, (double)max_mapping_quality);
     BaseAligner* aligner = get_aligner();
@@ -3846,7 +4772,7 @@ vector<Alignment> Mapper::score_sort_and_deduplicate_alignments(vector<Alignment
                 // This alignment hasn't been produced yet. Produce it. The
                 // order in the alignment vector doesn't matter for things with
                 // the same score.
-                sorted_unique_alignments.push_back(*pointer);
+                sorted_unique_alignments.push_back(std::move(*pointer));
                 
                 // Save it so we can avoid putting it in the vector again
                 serializedAlignmentsUsed.insert(serialized);
@@ -3875,7 +4801,27 @@ vector<Alignment> Mapper::align_multi(const Alignment& aln, int kmer_size, int s
     clean_aln.set_name(aln.name());
     clean_aln.set_sequence(aln.sequence());
     clean_aln.set_quality(aln.quality());
-    return align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, cluster_mq, max_multimaps, extra_multimaps, nullptr);
+    
+    if (duplicate_cache == nullptr) {
+        return align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, cluster_mq, max_multimaps, extra_multimaps, nullptr);
+    }
+    
+    // reads that only differ in the low bits of their qualities get the same alignments
+    string key = DuplicateReadCache<vector<Alignment>>::read_key(clean_aln, adjust_alignments_for_base_quality, 4,
+                                                                to_string(kmer_size) + ":" + to_string(stride) + ":"
+                                                                + to_string(max_mem_length) + ":" + to_string(band_width));
+    vector<Alignment> alignments;
+    if (duplicate_cache->retrieve(key, alignments)) {
+        // the paths and scores carry over, but the name and qualities are this read's own
+        for (auto& alignment : alignments) {
+            alignment.set_name(aln.name());
+            alignment.set_quality(aln.quality());
+        }
+        return alignments;
+    }
+    alignments = align_multi_internal(true, clean_aln, kmer_size, stride, max_mem_length, band_width, cluster_mq, max_multimaps, extra_multimaps, nullptr);
+    duplicate_cache->put(key, alignments);
+    return alignments;
 }
     
 vector<Alignment> Mapper::align_multi_internal(bool compute_unpaired_quality,
@@ -4000,6 +4946,9 @@ set<pos_t> gcsa_nodes_to_positions(const vector<gcsa::node_type>& nodes) {
 
 
 int64_t Mapper::graph_distance(pos_t pos1, pos_t pos2, int64_t maximum) {
+    if (distance_index) {
+        return indexed_distance(pos1, pos2, maximum);
+    }
     return xg_distance(pos1, pos2, maximum, xindex);
 }
 
@@ -4117,12 +5066,21 @@ vector<Alignment> Mapper::walk_match(const Alignment& base, const string& seq, p
         auto nexts = next_pos_chars(pos);
         // we can have a match on the current node
         if (nexts.size() == 1 && id(nexts.begin()->first) == id(pos)) {
-            pos_t npos = nexts.begin()->first;
-            // check that the next position would match
+            // check that the rest of the node matches, as far as we can see
+            // without stepping off it
+            size_t span = 0;
             if (i+1 < seq.size()) {
+                string node_seq = xindex->node_sequence(id(pos));
+                if (is_rev(pos)) {
+                    node_seq = reverse_complement(node_seq);
+                }
+                if (offset(pos) + 1 < node_seq.size()) {
+                    span = min(seq.size() - (i+1), node_seq.size() - offset(pos) - 1);
+                }
                 // we can't step, so we break
-                //cerr << "Checking if " << pos_char(npos) << " != " << seq[i+1] << endl;
-                if (pos_char(npos) != seq[i+1]) {
+                bool mismatch = span ? matching_prefix_length(seq.data() + i + 1, node_seq.data() + offset(pos) + 1, span) < span
+                                     : pos_char(nexts.begin()->first) != seq[i+1];
+                if (mismatch) {
 #ifdef debug_mapper
 #pragma omp critical
                     if (debug) cerr << "MEM does not match position, returning without creating alignment" << endl;
@@ -4130,9 +5088,11 @@ vector<Alignment> Mapper::walk_match(const Alignment& base, const string& seq, p
                     return alns;
                 }
             }
-            // otherwise we step our counters
-            ++match_len;
-            ++get_offset(pos);
+            // otherwise we step our counters over everything we checked
+            size_t step = max(span, (size_t) 1);
+            match_len += step;
+            get_offset(pos) += step;
+            i += step - 1;
         } else { // or we go into the next node
             // we must be going into another node
             // emit the mapping for this node
@@ -4216,17 +5176,18 @@ Position Mapper::alignment_end_position(const Alignment& aln) {
     if (!aln.has_path()) { Position pos; return pos; }
     Alignment b;
     *b.mutable_path()->add_mapping() = aln.path().mapping(aln.path().mapping_size()-1);
-    b = reverse_complement_alignment(b,
-                                     (function<int64_t(int64_t)>) ([&](int64_t id) {
-                                             return (int64_t)get_node_length(id);
-                                         }));
+    reverse_complement_alignment_in_place(&b, [&](id_t id) {
+            return (int64_t)get_node_length(id);
+        });
     return reverse(b.path().mapping(0).position(),
                    get_node_length(b.path().mapping(0).position().node_id()));
 }
 
 Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length) {
     //cerr << "top of patch_alignment" << endl;
-    Alignment patched;
+    // we build up the patched alignment piece by piece and only keep its simplified copy,
+    // so build it in the scratch arena
+    Alignment& patched = *google::protobuf::Arena::CreateMessage<Alignment>(&scratch_arena());
     // walk along the alignment and find the portions that are unaligned
     int read_pos = 0;
     auto& path = aln.path();
@@ -4281,10 +5242,8 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length) {
                         int max_score = -std::numeric_limits<int>::max();
                         for (auto& pos : band_ref_pos) {
                             //cerr << "trying position " << pos << endl;
-                            pos_t pos_rev = reverse(pos, xg_node_length(id(pos), xindex));
-                            Graph graph = xindex->graph_context_id(pos_rev, band.sequence().size()*4);
-                            graph.MergeFrom(xindex->graph_context_id(pos, band.sequence().size()*2));
-                            sort_by_id_dedup_and_clean(graph);
+                            Graph graph = xindex->graph_context_id(pos, band.sequence().size()*2,
+                                                                   band.sequence().size()*4);
                             auto proposed_band = align_maybe_flip(band, graph, is_rev(pos), true);
                             if (proposed_band.score() > max_score) { band = proposed_band; max_score = band.score(); }
                         }
@@ -4298,10 +5257,8 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length) {
                         int max_score = -std::numeric_limits<int>::max();
                         for (auto& pos : band_ref_pos) {
                             //cerr << "trying position " << pos << endl;
-                            Graph graph = xindex->graph_context_id(pos, band.sequence().size()*4);
-                            pos_t pos_rev = reverse(pos, xg_node_length(id(pos), xindex));
-                            graph.MergeFrom(xindex->graph_context_id(pos_rev, band.sequence().size()*2));
-                            sort_by_id_dedup_and_clean(graph);
+                            Graph graph = xindex->graph_context_id(pos, band.sequence().size()*4,
+                                                                   band.sequence().size()*2);
                             //cerr << "on graph " << pb2json(graph) << endl;
                             auto proposed_band = align_maybe_flip(band, graph, is_rev(pos), true);
                             if (proposed_band.score() > max_score) { band = proposed_band; max_score = band.score(); }
@@ -4311,10 +5268,8 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length) {
                         int max_score = -std::numeric_limits<int>::max();
                         for (auto& pos : band_ref_pos) {
                             //cerr << "trying position " << pos << endl;
-                            Graph graph = xindex->graph_context_id(pos, band.sequence().size()*4);
-                            pos_t pos_rev = reverse(pos, xg_node_length(id(pos), xindex));
-                            graph.MergeFrom(xindex->graph_context_id(pos_rev, band.sequence().size()*2));
-                            sort_by_id_dedup_and_clean(graph);
+                            Graph graph = xindex->graph_context_id(pos, band.sequence().size()*4,
+                                                                   band.sequence().size()*2);
                             //cerr << "on graph " << pb2json(graph) << endl;
                             auto proposed_band = align_maybe_flip(band, graph, is_rev(pos), true);
                             if (proposed_band.score() > max_score) { band = proposed_band; max_score = band.score(); }
@@ -4441,20 +5396,16 @@ Alignment Mapper::patch_alignment(const Alignment& aln, int max_patch_length) {
     }
 #endif
     // simplify the mapping representation
-    patched = simplify(patched);
+    Alignment simplified = simplify(patched);
     // set the identity
-    patched.set_identity(identity(patched.path()));
+    simplified.set_identity(identity(simplified.path()));
     // recompute the score
-    patched.set_score(score_alignment(patched, false));
-    return patched;
+    simplified.set_score(score_alignment(simplified, false));
+    return simplified;
 }
 
 void Mapper::remove_full_length_bonuses(Alignment& aln) {
-    int32_t score = aln.score();
-    int8_t bonus = get_aligner(!aln.quality().empty())->full_length_bonus;
-    if (softclip_start(aln) == 0) score -= bonus;
-    if (softclip_end(aln) == 0) score -= bonus;
-    aln.set_score(score);
+    aln.set_score(get_aligner(!aln.quality().empty())->remove_bonuses(aln));
 }
 
 // generate a score from the alignment without realigning
@@ -4550,12 +5501,95 @@ Alignment Mapper::mem_to_alignment(MaximalExactMatch& mem) {
 // realign to this graph
 // cross fingers
 
+Mapper::NodePathOccurrences Mapper::node_path_occurrences(id_t node_id) {
+    const NodePathOccurrences* cached = path_occurrence_cache.find(node_id);
+    if (cached != nullptr) {
+        return *cached;
+    }
+    NodePathOccurrences found;
+    found.length = xindex->node_length(node_id);
+    xindex->for_each_path_occurrence(node_id, [&](size_t path_rank, size_t start, bool on_reverse) {
+            found.occurrences.emplace_back(path_rank, start, on_reverse);
+        });
+    return path_occurrence_cache.put(node_id, found);
+}
+
+bool Mapper::alignment_on_path(const Alignment& aln,
+                               const set<string>& path_names,
+                               string& path_name,
+                               int64_t& path_pos,
+                               bool& path_reverse) {
+    const Path& path = aln.path();
+    if (path.mapping_size() == 0 || softclip_start(aln) > 0 || softclip_end(aln) > 0) {
+        return false;
+    }
+    vector<NodePathOccurrences> occurrences;
+    occurrences.reserve(path.mapping_size());
+    for (auto& mapping : path.mapping()) {
+        if (mapping_from_length(mapping) == 0) {
+            // we can't place pure insertions on the path
+            return false;
+        }
+        occurrences.push_back(node_path_occurrences(mapping.position().node_id()));
+    }
+    
+    // Get where a mapping's first base falls on an occurrence of its node,
+    // and if the mapping runs against the path there
+    auto offset_on_path = [](const Mapping& mapping, size_t node_length, const tuple<int64_t, size_t, bool>& occurrence) {
+        const Position& pos = mapping.position();
+        size_t forward_offset = pos.is_reverse() ? node_length - pos.offset() - 1 : pos.offset();
+        bool backward = pos.is_reverse() != get<2>(occurrence);
+        size_t offset = get<2>(occurrence) ? get<1>(occurrence) + node_length - forward_offset - 1
+            : get<1>(occurrence) + forward_offset;
+        return make_pair(offset, backward);
+    };
+    
+    for (const string& name : path_names) {
+        int64_t path_rank = xindex->path_rank(name);
+        // try each place the read could start on this path
+        for (auto& start : occurrences.front().occurrences) {
+            if (get<0>(start) != path_rank) {
+                continue;
+            }
+            auto first = offset_on_path(path.mapping(0), occurrences.front().length, start);
+            size_t consumed = mapping_from_length(path.mapping(0));
+            bool unbroken = true;
+            for (size_t i = 1; i < path.mapping_size() && unbroken; ++i) {
+                // the next mapping has to start right where the path goes after the last one ended
+                int64_t expected = first.second ? (int64_t) first.first - (int64_t) consumed
+                    : (int64_t) (first.first + consumed);
+                unbroken = false;
+                for (auto& occurrence : occurrences[i].occurrences) {
+                    if (get<0>(occurrence) == path_rank) {
+                        auto here = offset_on_path(path.mapping(i), occurrences[i].length, occurrence);
+                        if (here.second == first.second && (int64_t) here.first == expected) {
+                            unbroken = true;
+                            break;
+                        }
+                    }
+                }
+                consumed += mapping_from_length(path.mapping(i));
+            }
+            if (unbroken) {
+                path_name = name;
+                path_reverse = first.second;
+                path_pos = first.second ? first.first - (consumed - 1) : first.first;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 Alignment Mapper::surject_alignment(const Alignment& source,
                                     set<string>& path_names,
                                     string& path_name,
                                     int64_t& path_pos,
                                     bool& path_reverse) {
 
+    StageTimer timer(MappingStage::Surjection);
+    timer.add_items(1);
+    
     Alignment surjection = source;
     // Leave the original mapping quality in place (because that's the quality
     // on the placement of this read in this region at all)
@@ -4587,14 +5621,17 @@ Alignment Mapper::surject_alignment(const Alignment& source,
         return surjection;
     }
 
+    // Reads that already lie along a target path are their own surjection
+    if (alignment_on_path(source, path_names, path_name, path_pos, path_reverse)) {
+        return source;
+    }
+
     set<id_t> nodes;
     for (int i = 0; i < source.path().mapping_size(); ++ i) {
         nodes.insert(source.path().mapping(i).position().node_id());
     }
     VG graph;
-    for (auto& node : nodes) {
-        *graph.graph.add_node() = xindex->node(node);
-    }
+    xindex->add_nodes_to_graph(vector<id_t>(nodes.begin(), nodes.end()), graph.graph);
     xindex->expand_context(graph.graph, context_depth, true); // get connected edges and path
     graph.paths.append(graph.graph);
     graph.rebuild_indexes();
@@ -4759,7 +5796,7 @@ Alignment Mapper::surject_alignment(const Alignment& source,
 #endif
 
     Alignment surjection_rc = surjection;
-    surjection_rc.set_sequence(reverse_complement(surjection.sequence()));
+    reverse_complement_in_place(*surjection_rc.mutable_sequence());
 
     Alignment surjection_forward, surjection_reverse;
     // global align to the trimmed graph, and simplify without removal of internal deletions, as we'll need these for BAM reconstruction
@@ -4781,7 +5818,7 @@ Alignment Mapper::surject_alignment(const Alignment& source,
 
     graph = base_graph;
     // We need this for inverting mappings to the correct strand
-    function<int64_t(id_t)> node_length = [&graph](id_t node) {
+    auto node_length = [&graph](id_t node) -> int64_t {
         return graph.get_node(node)->sequence().size();
     };
 
@@ -4792,13 +5829,15 @@ Alignment Mapper::surject_alignment(const Alignment& source,
 
     if (count_reverse && count_forward) {
         if (surjection_reverse.score() > surjection_forward.score()) {
-             surjection = reverse_complement_alignment(translator.translate(surjection_reverse), node_length);
+             surjection = translator.translate(surjection_reverse);
+             reverse_complement_alignment_in_place(&surjection, node_length);
         } else {
             surjection = translator.translate(surjection_forward);
         }
     } else {
         if (count_reverse) {
-            surjection = reverse_complement_alignment(translator.translate(surjection_reverse), node_length);
+            surjection = translator.translate(surjection_reverse);
+            reverse_complement_alignment_in_place(&surjection, node_length);
         } else {
             surjection = translator.translate(surjection_forward);
         }
@@ -4842,7 +5881,8 @@ Alignment Mapper::surject_alignment(const Alignment& source,
             if (hit_backward) {
                 path_pos = path_posns.front() + first_pos.offset();
             } else {
-                auto pos = reverse_complement_alignment(surjection, node_length).path().mapping(0).position();
+                auto pos = reverse_complement_mapping(surjection.path().mapping(surjection.path().mapping_size() - 1),
+                                                      node_length).position();
                 path_pos = xindex->position_in_path(pos.node_id(), path_name).front() + pos.offset();
             }
             path_reverse = !hit_backward;
@@ -4850,7 +5890,8 @@ Alignment Mapper::surject_alignment(const Alignment& source,
             if (!hit_backward) {
                 path_pos = path_posns.front() + first_pos.offset();
             } else {
-                auto pos = reverse_complement_alignment(surjection, node_length).path().mapping(0).position();
+                auto pos = reverse_complement_mapping(surjection.path().mapping(surjection.path().mapping_size() - 1),
+                                                      node_length).position();
                 path_pos = xindex->position_in_path(pos.node_id(), path_name).front() + pos.offset();
             }
             path_reverse = hit_backward;
@@ -4922,8 +5963,6 @@ AlignmentChainModel::AlignmentChainModel(
             v.band_begin = offset;
             v.band_idx = idx;
             v.weight = aln.sequence().size() + aln.score() + aln.mapping_quality();
-            v.prev = nullptr;
-            v.score = 0;
             v.positions = mapper->alignment_path_offsets(aln);
             v.positions[""].push_back(make_pair(mapper->approx_alignment_position(aln), false));
             model.push_back(v);
@@ -4936,122 +5975,46 @@ AlignmentChainModel::AlignmentChainModel(
         offset += band.front().sequence().length();
         ++idx;
     }
+    // only link vertices within vertex_band_width bands of each other, so the
+    // number of transitions grows with the number of bands rather than its
+    // square; vertices are in band order, so the window ends at the first
+    // vertex that is too far along
     for (vector<AlignmentChainModelVertex>::iterator v = model.begin(); v != model.end(); ++v) {
-        for (auto u = v+1; u != model.end(); ++u) {
-            if (v->next_cost.size() < max_connections && u->prev_cost.size() < max_connections) {
-                if (v->band_idx + vertex_band_width >= u->band_idx) {
-                    double weight = transition_weight(*v->aln, *u->aln, v->positions, u->positions);
-                    if (weight > -std::numeric_limits<double>::max()) {
-                        v->next_cost.push_back(make_pair(&*u, weight));
-                        u->prev_cost.push_back(make_pair(&*v, weight));
-                    }
-                } else {
-                    break;
-                }
+        for (auto u = v+1; u != model.end() && v->next_cost.size() < max_connections; ++u) {
+            if (v->band_idx + vertex_band_width < u->band_idx) {
+                break;
             }
-        }
-    }
-}
-
-void AlignmentChainModel::score(const unordered_set<AlignmentChainModelVertex*>& exclude) {
-    // propagate the scores in the model
-    for (auto& m : model) {
-        // score is equal to the max inbound + mem.weight
-        if (exclude.count(&m)) continue; // skip if vertex was whole cluster
-        m.score = m.weight;
-        for (auto& p : m.prev_cost) {
-            if (p.first == nullptr) continue; // this transition is masked out
-            double proposal = m.weight + p.second + p.first->score;
-            if (proposal > m.score) {
-                m.prev = p.first;
-                m.score = proposal;
+            if (u->prev_cost.size() < max_connections) {
+                double weight = transition_weight(*v->aln, *u->aln, v->positions, u->positions);
+                if (weight > -std::numeric_limits<double>::max()) {
+                    v->next_cost.push_back(make_pair(&*u, weight));
+                    u->prev_cost.push_back(make_pair(&*v, weight));
+                }
             }
         }
     }
 }
 
-AlignmentChainModelVertex* AlignmentChainModel::max_vertex(void) {
-    AlignmentChainModelVertex* maxv = nullptr;
-    for (auto& m : model) {
-        if (maxv == nullptr || m.score > maxv->score) {
-            maxv = &m;
-        }
-    }
-    return maxv;
-}
-
-void AlignmentChainModel::clear_scores(void) {
-    for (auto& m : model) {
-        m.score = 0;
-        m.prev = nullptr;
-    }
-}
-
 vector<Alignment> AlignmentChainModel::traceback(const Alignment& read, int alt_alns, bool paired, bool debug) {
     debug = true;
+    ChainModelDP<AlignmentChainModelVertex> dp(model);
+    for (auto& v : redundant_vertexes) dp.exclude(v - model.begin());
+    auto vertex_traces = dp.traceback(alt_alns, paired, [&](size_t from, size_t to) {
+        return model[from].band_begin != model[to].band_begin;
+    });
     vector<vector<Alignment> > traces;
-    traces.reserve(alt_alns); // avoid reallocs so we can refer to pointers to the traces
-    unordered_set<AlignmentChainModelVertex*> exclude;
-    for (auto& v : redundant_vertexes) exclude.insert(&*v);
-    for (int i = 0; i < alt_alns; ++i) {
-        // score the model, accounting for excluded traces
-        clear_scores();
-        score(exclude);
-#ifdef debug_mapper
-#pragma omp critical
-        if (debug) {
-            cerr << "AlignmentChainModel::traceback " << i << endl;
-            display(cerr);
-        }
-#endif
-        vector<AlignmentChainModelVertex*> vertex_trace;
-        {
-            // find the maximum score
-            auto* vertex = max_vertex();
-            // check if we've exhausted our Alignments
-            if (vertex == nullptr || vertex->score == 0) break;
+    traces.reserve(vertex_traces.size());
+    for (auto& vertex_trace : vertex_traces) {
 #ifdef debug_mapper
 #pragma omp critical
-            if (debug) cerr << "maximum score " << vertex->aln->sequence() << " " << vertex << ":" << vertex->score << endl;
+        if (debug) cerr << "AlignmentChainModel::traceback " << traces.size() << " scored "
+                        << dp.scores[vertex_trace.back()] << " ending at " << model[vertex_trace.back()].aln->sequence() << endl;
 #endif
-            // make trace
-            while (vertex != nullptr) {
-                vertex_trace.push_back(vertex);
-                if (vertex->prev != nullptr) {
-                    vertex = vertex->prev;
-                } else {
-                    break;
-                }
-            }
-        }
-        // if we have a singular match or reads are not paired, record not to use it again
-        if (paired && vertex_trace.size() == 1) {
-            exclude.insert(vertex_trace.front());
-        }
-        // fill this out when we're paired to help mask out in-fragment transitions
-        unordered_set<AlignmentChainModelVertex*> chain_members;
-        if (paired) for (auto v : vertex_trace) chain_members.insert(v);
         traces.emplace_back();
         auto& aln_trace = traces.back();
         aln_trace = unaligned_bands;
-        for (auto v = vertex_trace.rbegin(); v != vertex_trace.rend(); ++v) {
-            auto& vertex = **v;
-            if (!paired) exclude.insert(&vertex);
-            if (v != vertex_trace.rbegin()) {
-                auto y = v - 1;
-                AlignmentChainModelVertex* prev = *y;
-                // mask out used transitions
-                for (auto& p : vertex.prev_cost) {
-                    if (p.first == prev) {
-                        p.first = nullptr;
-                    } else if (paired && p.first != nullptr
-                               && p.first->band_begin != vertex.band_begin
-                               && chain_members.count(p.first)) {
-                        p.first = nullptr;
-                    }
-                }
-            }
-            aln_trace[vertex.band_idx] = *vertex.aln;
+        for (size_t v : vertex_trace) {
+            aln_trace[model[v].band_idx] = *model[v].aln;
         }
     }
     vector<Alignment> alns;
@@ -5069,7 +6032,7 @@ vector<Alignment> AlignmentChainModel::traceback(const Alignment& read, int alt_
 // show model
 void AlignmentChainModel::display(ostream& out) {
     for (auto& vertex : model) {
-        out << &vertex << ":" << vertex.band_begin << ":" << vertex.aln->sequence() << ":" << vertex.score << "@";
+        out << &vertex << ":" << vertex.band_begin << ":" << vertex.aln->sequence() << ":" << vertex.weight << "@";
         out << "prev: ";
         for (auto& p : vertex.prev_cost) {
             auto& next = p.first;
@@ -5093,9 +6056,13 @@ FragmentLengthDistribution::FragmentLengthDistribution(size_t maximum_sample_siz
                                                        double robust_estimation_fraction) :
     maximum_sample_size(maximum_sample_size),
     reestimation_frequency(reestimation_frequency),
-    robust_estimation_fraction(robust_estimation_fraction)
+    robust_estimation_fraction(robust_estimation_fraction),
+    lengths(new atomic<double>[maximum_sample_size])
 {
     assert(0.0 < robust_estimation_fraction && robust_estimation_fraction < 1.0);
+    for (size_t i = 0; i < maximum_sample_size; i++) {
+        lengths[i].store(numeric_limits<double>::quiet_NaN());
+    }
 }
 
 FragmentLengthDistribution::FragmentLengthDistribution() : FragmentLengthDistribution(0, 1, 0.5)
@@ -5107,6 +6074,19 @@ FragmentLengthDistribution::~FragmentLengthDistribution() {
     
 }
 
+FragmentLengthDistribution& FragmentLengthDistribution::operator=(FragmentLengthDistribution&& other) {
+    lengths = std::move(other.lengths);
+    next_slot.store(other.next_slot.load());
+    num_samples.store(other.num_samples.load());
+    is_fixed.store(other.is_fixed.load());
+    robust_estimation_fraction = other.robust_estimation_fraction;
+    maximum_sample_size = other.maximum_sample_size;
+    reestimation_frequency = other.reestimation_frequency;
+    mu.store(other.mu.load());
+    sigma.store(other.sigma.load());
+    return *this;
+}
+
 void FragmentLengthDistribution::force_parameters(double mean, double stddev) {
     mu = mean;
     sigma = stddev;
@@ -5119,34 +6099,42 @@ void FragmentLengthDistribution::register_fragment_length(int64_t length) {
     if (is_fixed) {
         return;
     }
-#pragma omp critical
-    {
-        // in case the distribution became fixed while this thread was waiting
-        // to execute the critical block
-        if (!is_fixed) {
-            lengths.insert((double) length);
-            if (lengths.size() == maximum_sample_size) {
-                // we've reached the maximum sample we wanted, so fix the estimation
-                estimate_distribution();
-                is_fixed = true;
-            }
-            else if (lengths.size() % reestimation_frequency == 0) {
-                estimate_distribution();
-            }
+    
+    // claim a slot for the sample
+    size_t slot = next_slot++;
+    if (slot >= maximum_sample_size) {
+        // other threads already have all the samples we want
+        return;
+    }
+    lengths[slot].store((double) length);
+    size_t count = ++num_samples;
+    
+    if (count == maximum_sample_size) {
+        // we've reached the maximum sample we wanted, and every slot has been written, so
+        // fix the estimation (after any reestimate in progress)
+        lock_guard<mutex> lock(estimation_mutex);
+        estimate_distribution();
+        is_fixed = true;
+    }
+    else if (count % reestimation_frequency == 0) {
+        // the running estimate isn't worth waiting for, so skip it if someone else is estimating
+        unique_lock<mutex> lock(estimation_mutex, try_to_lock);
+        if (lock.owns_lock() && !is_fixed) {
+            estimate_distribution();
         }
     }
 }
     
 void FragmentLengthDistribution::estimate_distribution() {
-    // remove the tails from the estimation
-    size_t to_skip = (size_t) (lengths.size() * (1.0 - robust_estimation_fraction) * 0.5);
-    auto begin = lengths.begin();
-    auto end = lengths.end();
-    for (size_t i = 0; i < to_skip; i++) {
-        begin++;
-        end--;
-        
+    vector<double> sorted_lengths = measurements();
+    if (sorted_lengths.empty()) {
+        return;
     }
+    
+    // remove the tails from the estimation
+    size_t to_skip = (size_t) (sorted_lengths.size() * (1.0 - robust_estimation_fraction) * 0.5);
+    auto begin = sorted_lengths.begin() + to_skip;
+    auto end = sorted_lengths.end() - to_skip;
     // compute cumulants
     double count = 0.0;
     double sum = 0.0;
@@ -5157,10 +6145,11 @@ void FragmentLengthDistribution::estimate_distribution() {
         sum_of_sqs += (*iter) * (*iter);
     }
     // use cumulants to compute moments
-    mu = sum / count;
-    double raw_var = sum_of_sqs / count - mu * mu;
+    double mean = sum / count;
+    double raw_var = sum_of_sqs / count - mean * mean;
     // apply method of moments estimation using the appropriate truncated normal distribution
     double a = normal_inverse_cdf(1.0 - 0.5 * (1.0 - robust_estimation_fraction));
+    mu = mean;
     sigma = sqrt(raw_var / (1.0 - 2.0 * a * normal_pdf(a, 0.0, 1.0)));
 }
     
@@ -5181,14 +6170,21 @@ size_t FragmentLengthDistribution::max_sample_size() const {
 }
     
 size_t FragmentLengthDistribution::curr_sample_size() const {
-    return lengths.size();
+    return num_samples.load();
 }
     
-multiset<double>::const_iterator FragmentLengthDistribution::measurements_begin() const {
-    return lengths.begin();
-}
-
-multiset<double>::const_iterator FragmentLengthDistribution::measurements_end() const {
-    return lengths.end();
+vector<double> FragmentLengthDistribution::measurements() const {
+    vector<double> collected;
+    size_t slots = min(next_slot.load(), maximum_sample_size);
+    collected.reserve(slots);
+    for (size_t i = 0; i < slots; i++) {
+        double length = lengths[i].load();
+        // skip the slots whose samples are still being written
+        if (!std::isnan(length)) {
+            collected.push_back(length);
+        }
+    }
+    sort(collected.begin(), collected.end());
+    return collected;
 }
 }
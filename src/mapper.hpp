@@ -5,6 +5,9 @@
 #include <map>
 #include <chrono>
 #include <ctime>
+#include <atomic>
+#include <mutex>
+#include <memory>
 #include "omp.h"
 #include "vg.hpp"
 #include "xg.hpp"
@@ -17,13 +20,18 @@
 #include "position.hpp"
 #include "xg_position.hpp"
 #include "lru_cache.h"
+#include "clock_cache.hpp"
+#include "duplicate_read_cache.hpp"
 #include "json2pb.h"
 #include "entropy.hpp"
 #include "gssw_aligner.hpp"
 #include "mem.hpp"
+#include "minimizer_index.hpp"
 #include "cluster.hpp"
+#include "distance_index.hpp"
 #include "graph.hpp"
 #include "translator.hpp"
+#include "stage_profiler.hpp"
 
 namespace vg {
 
@@ -44,11 +52,9 @@ public:
     vector<pair<AlignmentChainModelVertex*, double> > next_cost; // for forward
     vector<pair<AlignmentChainModelVertex*, double> > prev_cost; // for backward
     double weight;
-    double score;
     map<string, vector<pair<size_t, bool> > > positions;
     int band_begin;
     int band_idx;
-    AlignmentChainModelVertex* prev;
     AlignmentChainModelVertex(void) = default;                                      // Copy constructor
     AlignmentChainModelVertex(const AlignmentChainModelVertex&) = default;               // Copy constructor
     AlignmentChainModelVertex(AlignmentChainModelVertex&&) = default;                    // Move constructor
@@ -70,11 +76,8 @@ public:
         int vertex_band_width = 10,
         int position_depth = 1,
         int max_connections = 30);
-    void score(const unordered_set<AlignmentChainModelVertex*>& exclude);
-    AlignmentChainModelVertex* max_vertex(void);
     vector<Alignment> traceback(const Alignment& read, int alt_alns, bool paired, bool debug);
     void display(ostream& out);
-    void clear_scores(void);
 };
 
 /*
@@ -96,11 +99,16 @@ public:
     FragmentLengthDistribution(void);
     ~FragmentLengthDistribution();
     
+    /// Replace this distribution with another one. Not safe to call while other threads are
+    /// registering fragment lengths.
+    FragmentLengthDistribution& operator=(FragmentLengthDistribution&& other);
     
     /// Instead of estimating anything, just use these parameters.
     void force_parameters(double mean, double stddev);
     
-    /// Record an observed fragment length
+    /// Record an observed fragment length. Safe to call from many threads at once: each sample
+    /// goes into its own slot without locking, and only the periodic reestimates take a lock,
+    /// which no thread waits on except the one that finalizes the distribution.
     void register_fragment_length(int64_t length);
 
     /// Robust mean of the distribution observed so far
@@ -120,24 +128,27 @@ public:
     /// Returns the number of samples that have been collected so far
     size_t curr_sample_size() const;
     
-    /// Begin iterator to the measurements that the distribution has used to estimate the
-    /// parameters
-    multiset<double>::const_iterator measurements_begin() const;
-    
-    /// End iterator to the measurements that the distribution has used to estimate the
-    /// parameters
-    multiset<double>::const_iterator measurements_end() const;
+    /// Returns the measurements that have been collected so far, in sorted order
+    vector<double> measurements() const;
     
 private:
-    multiset<double> lengths;
-    bool is_fixed = false;
+    /// One slot per sample, claimed in order through next_slot. Slots that haven't been
+    /// written yet hold NaN.
+    unique_ptr<atomic<double>[]> lengths;
+    atomic<size_t> next_slot{0};
+    /// Number of slots that have been written
+    atomic<size_t> num_samples{0};
+    atomic<bool> is_fixed{false};
     
     double robust_estimation_fraction;
     size_t maximum_sample_size;
     size_t reestimation_frequency;
     
-    double mu = 0.0;
-    double sigma = 1.0;
+    atomic<double> mu{0.0};
+    atomic<double> sigma{1.0};
+    
+    /// Held while reestimating the parameters
+    mutex estimation_mutex;
     
     void estimate_distribution();
 };
@@ -152,6 +163,9 @@ public:
     
     double estimate_gc_content(void);
     
+    /// The longest seed the seed index can find: the GCSA2 order, or the minimizer length
+    int seed_order(void) const;
+    
     int random_match_length(double chance_random);
     
     void set_alignment_scores(int8_t match, int8_t mismatch, int8_t gap_open, int8_t gap_extend, int8_t full_length_bonus,
@@ -167,6 +181,23 @@ public:
     
     void set_cache_size(int new_cache_size);
     
+    /// Statistics about the per-thread protobuf arenas that hold scratch messages
+    struct ScratchArenaStats {
+        /// Number of times a thread's arena was reset
+        size_t resets = 0;
+        /// Total bytes allocated in the arenas over all resets
+        size_t total_bytes = 0;
+        /// Most bytes allocated on one thread between two resets
+        size_t peak_bytes = 0;
+    };
+    
+    /// Free all the scratch messages the calling thread built while mapping its last read or
+    /// pair. Call this once the read or pair has been emitted.
+    static void reset_scratch_arena();
+    
+    /// Get the allocation statistics for the scratch arenas of all threads
+    static ScratchArenaStats get_scratch_arena_stats();
+    
     /// Returns true if fragment length distribution has been fixed
     bool has_fixed_fragment_length_distr();
     
@@ -196,6 +227,30 @@ public:
                    bool record_max_lcp = false,
                    int reseed_below_count = 0);
     
+    /// Find seeds with the minimizer index instead of the GCSA2: one MEM per minimizer of the
+    /// sequence, with the minimizer's hits as its nodes if there are at most hit_max of them.
+    /// Fills in the fraction of hits that were filtered.
+    vector<MaximalExactMatch> find_minimizer_seeds(string::const_iterator seq_begin,
+                                                   string::const_iterator seq_end,
+                                                   double& fraction_filtered);
+    
+    /// Same as find_mems_deep, but for a batch of reads at once. The backward searches for all of the
+    /// reads are advanced in lockstep, one step per read per round, so that the GCSA2 lookups of
+    /// different reads can overlap instead of each one waiting on the last. Fills in the LCP and
+    /// filtered fraction for each read, and returns the MEMs for each read in the order given.
+    vector<vector<MaximalExactMatch>>
+    find_mems_deep_batch(const vector<pair<string::const_iterator, string::const_iterator>>& seqs,
+                         vector<double>& lcp_avgs,
+                         vector<double>& fractions_filtered,
+                         int max_mem_length = 0,
+                         int min_mem_length = 1,
+                         int reseed_length = 0,
+                         bool use_lcp_reseed_heuristic = false,
+                         bool use_diff_based_fast_reseed = false,
+                         bool include_parent_in_sub_mem_count = false,
+                         bool record_max_lcp = false,
+                         int reseed_below_count = 0);
+    
     // Use the GCSA2 index to find super-maximal exact matches.
     vector<MaximalExactMatch>
     find_mems_simple(string::const_iterator seq_begin,
@@ -210,6 +265,13 @@ public:
     void rescue_high_count_order_length_mems(vector<MaximalExactMatch>& mems,
                                              size_t max_rescue_hit_count);
     
+    /// Locate up to max_hits graph nodes in a GCSA2 range, sampling SA positions evenly across it
+    /// when it is larger than that so the hits come from throughout the range rather than its start.
+    /// A max_hits of 0 locates the whole range. Returns the size of the range, which callers can also
+    /// get from gcsa::Range::length before deciding whether to pay for a locate at all.
+    size_t locate_bounded(const gcsa::range_type& range, size_t max_hits,
+                          vector<gcsa::node_type>& locations);
+    
     int sub_mem_count_thinning = 1; // count every this many bases to verify sub-MEM count
     int min_mem_length; // a mem must be >= this length
     int mem_reseed_length; // the length above which we reseed MEMs to get potentially missed hits
@@ -220,6 +282,7 @@ public:
     int hit_max;       // ignore or MEMs with more than this many hits
     bool use_approx_sub_mem_count = true;
     size_t order_length_repeat_hit_max = 0; // in tracts of order-length MEMs above the hit max, fill one
+    size_t hit_max_sample = 0; // fill MEMs above the hit max with this many sampled hits instead of none
     
     // Remove any bonuses used by the aligners from the final reported scores.
     // Does NOT (yet) remove the haplotype consistency bonus.
@@ -230,10 +293,93 @@ public:
     MappingQualityMethod mapping_quality_method; // how to compute mapping qualities
     int max_mapping_quality; // the cap for mapping quality
     
+    /// Snarl tree distance index to measure graph distances with, if any. It must be built
+    /// from the same graph as the xg index.
+    DistanceIndex* distance_index = nullptr;
+    
     /// Set to enable debugging messages to cerr from the mapper, so a user can understand why a read maps the way it does.
     bool debug = false;
     
 protected:
+    /// Get the calling thread's arena for scratch messages. Messages made in it must not outlive
+    /// the read or pair being mapped.
+    static google::protobuf::Arena& scratch_arena();
+    
+    /// Get the minimum distance from one position to another using the distance index and the
+    /// calling thread's memo of earlier queries. Only call this if there is a distance index.
+    int64_t indexed_distance(pos_t pos1, pos_t pos2, int64_t maximum) const;
+    
+    /// The state of the backward search for the SMEMs of one read, so that searches along several
+    /// reads can be interleaved
+    struct SMEMSearch {
+        SMEMSearch(string::const_iterator seq_begin,
+                   string::const_iterator seq_end,
+                   gcsa::range_type full_range);
+        
+        string::const_iterator seq_begin;
+        string::const_iterator seq_end;
+        gcsa::range_type full_range;
+        /// next position we will extend matches to
+        string::const_iterator cursor;
+        /// range of the last step
+        gcsa::range_type last_range;
+        /// the MEM we are building up
+        MaximalExactMatch match;
+        /// did we move the cursor or the end of the match last step?
+        bool prev_iter_jumped_lcp = false;
+        int max_lcp = 0;
+        size_t mem_length = 0;
+        /// the SMEMs found so far, from the end of the read backward
+        vector<MaximalExactMatch> mems;
+        vector<int> lcp_maxima;
+    };
+    
+    /// GCSA2 and LCP query results for the reads being searched on this thread, so that reseeding
+    /// doesn't repeat the queries the SMEM search (or reseeding of an overlapping MEM) already made.
+    /// Cleared at the start of each MEM search.
+    struct GCSAQueryCache {
+        /// Ranges of read substrings, keyed by pointers to their first and past-the-last bases
+        unordered_map<pair<const char*, const char*>, gcsa::range_type> ranges;
+        unordered_map<gcsa::range_type, size_t> counts;
+        unordered_map<gcsa::range_type, gcsa::STNode> parents;
+        /// How many queries were answered from the cache
+        size_t hits = 0;
+        
+        void clear();
+    };
+    thread_local static GCSAQueryCache gcsa_query_cache;
+    
+    /// Get the range of the read substring [cursor, end) by one step of LF mapping from range, the
+    /// range of [cursor + 1, end), using the calling thread's query cache.
+    gcsa::range_type cached_LF(const gcsa::range_type& range, string::const_iterator cursor,
+                               string::const_iterator end);
+    
+    /// Count the hits in a range, using the calling thread's query cache.
+    size_t cached_count(const gcsa::range_type& range);
+    
+    /// Get the parent suffix tree node of a range, using the calling thread's query cache.
+    gcsa::STNode cached_parent(const gcsa::range_type& range);
+    
+    /// Report the calling thread's query cache hits to the profiler and clear the cache.
+    void finish_gcsa_query_cache();
+    
+    /// Execute one step of LF mapping in an SMEM search, recording an SMEM if the step ends one.
+    /// Returns false once the search has run off the start of the read.
+    bool extend_smem_search(SMEMSearch& search, int max_mem_length, int min_mem_length, bool record_max_lcp);
+    
+    /// Record the final SMEM of a finished search, then fill, reseed and sort the MEMs as described
+    /// for find_mems_deep
+    vector<MaximalExactMatch> finish_mems_deep(SMEMSearch& search,
+                                               double& longest_lcp,
+                                               double& fraction_filtered,
+                                               int min_mem_length,
+                                               int reseed_length,
+                                               bool use_lcp_reseed_heuristic,
+                                               bool use_diff_based_fast_reseed,
+                                               bool include_parent_in_sub_mem_count,
+                                               bool record_max_lcp,
+                                               int reseed_below);
+    
     /// Locate the sub-MEMs contained in the last MEM of the mems vector that have ending positions
     /// before the end the next SMEM, label each of the sub-MEMs with the indices of all of the SMEMs
     /// that contain it
@@ -308,6 +454,9 @@ protected:
     gcsa::GCSA* gcsa = nullptr;
     gcsa::LCPArray* lcp = nullptr;
     
+    // minimizer index, if any, which replaces the GCSA2 as the source of seeds
+    MinimizerIndex* minimizer_index = nullptr;
+    
     // GBWT index, if any, for determining haplotype concordance
     gbwt::GBWT* gbwt = nullptr;
     
@@ -400,7 +549,8 @@ private:
                              bool pinned_alignment = false,
                              bool pin_left = false,
                              bool global = false,
-                             bool keep_bonuses = true);
+                             bool keep_bonuses = true,
+                             AlignableGraph* alignable = nullptr);
     vector<Alignment> align_multi_internal(bool compute_unpaired_qualities,
                                            const Alignment& aln,
                                            int kmer_size,
@@ -423,6 +573,12 @@ private:
                                    int stride = 0,
                                    int max_mem_length = 0,
                                    int band_width = 1000);
+    // Map a long read by finding seeds for the whole read once, chaining them
+    // with the sparse chainer, and aligning only the gaps between the chained
+    // anchors. Returns the alignments of the best chains, best first.
+    vector<Alignment> align_long_read(const Alignment& read,
+                                      int max_mem_length = 0,
+                                      int band_width = 1000);
     // alignment based on the MEM approach
 //    vector<Alignment> align_mem_multi(const Alignment& alignment, vector<MaximalExactMatch>& mems, double& cluster_mq, double lcp_avg, int max_mem_length, int additional_multimaps = 0);
     // uses approximate-positional clustering based on embedded paths in the xg index to find and align against alignment targets
@@ -434,6 +590,25 @@ private:
                                       int max_mem_length,
                                       int keep_multimaps,
                                       int additional_multimaps);
+
+    // Where a node falls on the embedded paths, as remembered for surjection
+    struct NodePathOccurrences {
+        size_t length = 0;
+        // (path rank, offset of the node's start on the path, whether the path visits the node's reverse strand)
+        vector<tuple<int64_t, size_t, bool>> occurrences;
+    };
+    // Look up where a node falls on the embedded paths, through the cache
+    NodePathOccurrences node_path_occurrences(id_t node_id);
+    // Each thread surjects with its own Mapper, so this doesn't need a lock
+    ClockCache<id_t, NodePathOccurrences> path_occurrence_cache{4096};
+    
+    // Get the graph around the likely positions of a mate that we rescue in,
+    // reusing the last windows extracted around the same nodes, since pairs
+    // near each other in sorted input rescue in the same places
+    Graph rescue_window(const vector<pos_t>& mate_positions, int get_at_least);
+    // The recent rescue windows, by the nodes and orientations they were
+    // centered on and their size
+    ClockCache<string, Graph> rescue_window_cache{32};
     
 public:
     // Make a Mapper that pulls from an XG succinct graph, a GCSA2 kmer index +
@@ -501,10 +676,19 @@ public:
     VG cluster_subgraph_strict(const Alignment& aln, const vector<MaximalExactMatch>& mems);
     // for aligning to a particular MEM cluster
     Alignment align_cluster(const Alignment& aln, const vector<MaximalExactMatch>& mems, bool traceback);
+    // align to each of several MEM clusters as align_cluster does, handing the local alignments to the
+    // aligner together so it can batch them
+    vector<Alignment> align_clusters(const Alignment& aln, const vector<const vector<MaximalExactMatch>*>& clusters,
+                                     bool traceback);
     // compute the uniqueness metric based on the MEMs in the cluster
     double compute_uniqueness(const Alignment& aln, const vector<MaximalExactMatch>& mems);
     // wraps align_to_graph with flipping
-    Alignment align_maybe_flip(const Alignment& base, Graph& graph, bool flip, bool traceback, bool banded_global = false);
+    // if given, the AlignableGraph must be for the same graph, and is reused instead of converting it again
+    Alignment align_maybe_flip(const Alignment& base, Graph& graph, bool flip, bool traceback, bool banded_global = false,
+                               AlignableGraph* alignable = nullptr);
+    // the parts of align_maybe_flip before and after the alignment itself
+    Alignment flip_for_alignment(const Alignment& base, bool flip);
+    void finish_flipped_alignment(Alignment& aln, Graph& graph, bool flip, bool traceback, bool banded_global);
 
     bool adjacent_positions(const Position& pos1, const Position& pos2);
     int64_t get_node_length(int64_t node_id);
@@ -560,6 +744,16 @@ public:
                                 string& path_name,
                                 int64_t& path_pos,
                                 bool& path_reverse);
+
+    // If the alignment already runs unbroken along one of the named paths,
+    // with no soft clips, find which path, the leftmost path position it
+    // covers, and if it runs against the path. Surjecting such an alignment
+    // needs no realignment.
+    bool alignment_on_path(const Alignment& aln,
+                           const set<string>& path_names,
+                           string& path_name,
+                           int64_t& path_pos,
+                           bool& path_reverse);
     
     // compute a mapping quality component based only on the MEMs we've obtained
     double compute_cluster_mapping_quality(const vector<vector<MaximalExactMatch> >& clusters, int read_length);
@@ -579,6 +773,8 @@ public:
     int64_t approx_alignment_position(const Alignment& aln);
     // get the full path offsets for the alignment, considering every mapping if just_first is not set
     map<string, vector<pair<size_t, bool> > > alignment_path_offsets(const Alignment& aln, bool just_min = true, bool nearby = false);
+    // the same, keyed by path rank in ascending order, without building path names
+    vector<pair<size_t, vector<pair<size_t, bool> > > > alignment_path_rank_offsets(const Alignment& aln, bool just_min = true, bool nearby = false);
     // return the path offsets as cached in the alignment
     map<string ,vector<pair<size_t, bool> > > alignment_refpos_to_path_offsets(const Alignment& aln);
     // get the end position of the alignment
@@ -629,6 +825,9 @@ public:
     double maybe_mq_threshold; // quality below which we let the estimated mq kick in
     int max_cluster_mapping_quality; // the cap for cluster mapping quality
     bool use_cluster_mq; // should we use the cluster-based mapping quality component
+    bool use_sparse_chaining; // chain MEMs with SparseChainClusterer instead of MEMChainModel
+    size_t max_chaining_hits; // the most MEM hits per read that sparse chaining will use
+    bool long_read_chaining; // map reads longer than the band width with align_long_read instead of aligning bands
     double identity_weight; // scale mapping quality by the alignment score identity to this power
 
     bool always_rescue; // Should rescue be attempted for all imperfect alignments?
@@ -642,6 +841,10 @@ public:
 
     double pair_rescue_hang_threshold;
     double pair_rescue_retry_threshold;
+    // skip aligning a mate in a rescue window that shares no k-mer of this length with it (0 to always align)
+    int rescue_seed_length;
+    // results of align_multi for reads seen before, shared between the mappers of all the threads (null to not cache)
+    DuplicateReadCache<vector<Alignment>>* duplicate_cache = nullptr;
     
     // Keep track of fragment length distribution statistics
     FragmentLengthStatistics frag_stats;
@@ -34,10 +34,6 @@ size_t MaximalExactMatch::count_Ns(void) const {
     return std::count(begin, end, 'N');
 }
 
-pair<int64_t, int64_t> mem_min_oriented_distances(const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
-    return min_oriented_distances(m1.positions, m2.positions);
-}
-
 bool operator==(const MaximalExactMatch& m1, const MaximalExactMatch& m2) {
     return m1.begin == m2.begin && m1.end == m2.end && m1.nodes == m2.nodes;
 }
@@ -34,13 +34,17 @@ public:
     int fragment;
     bool primary; // if not a sub-MEM
     std::vector<gcsa::node_type> nodes;
-    map<string, vector<pair<size_t, bool> > > positions;
     
     MaximalExactMatch(string::const_iterator b,
                       string::const_iterator e,
                       gcsa::range_type r,
                       size_t m = 0)
         : begin(b), end(e), range(r), match_count(m) { }
+    
+    // copy a MEM, keeping only one of its hits (avoids copying the whole hit list)
+    MaximalExactMatch(const MaximalExactMatch& other, gcsa::node_type hit)
+        : begin(other.begin), end(other.end), range(other.range), match_count(other.match_count),
+          fragment(other.fragment), primary(other.primary), nodes(1, hit) { }
 
     // construct the sequence of the MEM; useful in debugging
     string sequence(void) const;
@@ -81,10 +85,6 @@ int clusters_overlap_length(const vector<MaximalExactMatch>& cluster1,
                             const vector<MaximalExactMatch>& cluster2);
 vector<pos_t> cluster_nodes(const vector<MaximalExactMatch>& cluster);
 
-// returns the min distance and the relative orientation implied by the position annotations on the mems
-pair<int64_t, int64_t> mem_min_oriented_distances(const MaximalExactMatch& m1, const MaximalExactMatch& m2);
-
-
 }
 
 #endif
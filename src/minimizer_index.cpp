@@ -0,0 +1,324 @@
+#include "minimizer_index.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+
+#include "utility.hpp"
+
+namespace vg {
+
+using namespace std;
+
+const uint64_t MinimizerIndex::EMPTY = numeric_limits<uint64_t>::max();
+const string MinimizerIndex::MAGIC = "VGMIN";
+const uint32_t MinimizerIndex::VERSION = 1;
+
+/// Order k-mers by a mix of their bits, so the minimizers aren't biased towards
+/// poly-A and other low complexity sequence. This is the 64-bit finalizer from
+/// MurmurHash3.
+static inline uint64_t minimizer_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/// Get the 2-bit code of a base, or -1 if it isn't ACGT
+static inline int base_code(char base) {
+    switch (base) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return -1;
+    }
+}
+
+MinimizerIndex::MinimizerIndex(size_t k, size_t w) : kmer_length(k), window_length(w) {
+    if (k == 0 || k > 31 || w == 0) {
+        throw runtime_error("[vg::MinimizerIndex] k must be between 1 and 31 and w must be positive");
+    }
+}
+
+void MinimizerIndex::add_paths(const xg::XG& graph) {
+#pragma omp parallel for schedule(dynamic,1)
+    for (size_t rank = 1; rank <= graph.max_path_rank(); rank++) {
+        Path path = graph.path(graph.path_name(rank));
+        vector<pair<id_t, bool>> walk;
+        walk.reserve(path.mapping_size());
+        for (auto& mapping : path.mapping()) {
+            walk.emplace_back(mapping.position().node_id(), mapping.position().is_reverse());
+        }
+        add_walk(graph, walk);
+    }
+}
+
+void MinimizerIndex::add_haplotypes(const xg::XG& graph, const gbwt::GBWT& haplotypes) {
+    // Haplotypes are stored in both orientations, and add_walk does both, so
+    // take every other sequence. Only the parts of them in this graph matter.
+#pragma omp parallel for schedule(dynamic,1)
+    for (gbwt::size_type sequence = 0; sequence < haplotypes.sequences(); sequence += 2) {
+        vector<pair<id_t, bool>> walk;
+        for (auto node : haplotypes.extract(sequence)) {
+            id_t node_id = gbwt::Node::id(node);
+            if (graph.has_node(node_id)) {
+                walk.emplace_back(node_id, gbwt::Node::is_reverse(node));
+            } else if (!walk.empty()) {
+                add_walk(graph, walk);
+                walk.clear();
+            }
+        }
+        add_walk(graph, walk);
+    }
+}
+
+void MinimizerIndex::add_walk(const xg::XG& graph, const vector<pair<id_t, bool>>& walk) {
+    vector<pair<uint64_t, gcsa::node_type>> walk_hits;
+    for (bool reverse : {false, true}) {
+        // spell out the walk in this orientation, remembering where each node starts
+        vector<pair<id_t, bool>> oriented;
+        if (reverse) {
+            for (auto it = walk.rbegin(); it != walk.rend(); ++it) {
+                oriented.emplace_back(it->first, !it->second);
+            }
+        } else {
+            oriented = walk;
+        }
+        string sequence;
+        vector<size_t> node_starts;
+        for (auto& step : oriented) {
+            node_starts.push_back(sequence.size());
+            string node_sequence = graph.node_sequence(step.first);
+            sequence += step.second ? reverse_complement(node_sequence) : node_sequence;
+        }
+
+        for_each_minimizer(sequence.begin(), sequence.end(), [&](const Minimizer& minimizer) {
+            size_t i = upper_bound(node_starts.begin(), node_starts.end(), minimizer.offset) - node_starts.begin() - 1;
+            walk_hits.emplace_back(minimizer.key, gcsa::Node::encode(oriented[i].first,
+                                                                     minimizer.offset - node_starts[i],
+                                                                     oriented[i].second));
+        });
+    }
+
+#pragma omp critical (minimizer_index_add)
+    {
+        for (auto& hit : walk_hits) {
+            unpacked[hit.first].push_back(hit.second);
+        }
+    }
+}
+
+void MinimizerIndex::finish() {
+    // take back anything already packed, so walks can be added to a loaded index
+    for (size_t slot = 0; slot < keys.size(); slot++) {
+        if (keys[slot] != EMPTY) {
+            auto& key_hits = unpacked[keys[slot]];
+            key_hits.insert(key_hits.end(), hits.begin() + hit_starts[slot],
+                            hits.begin() + hit_starts[slot] + hit_counts[slot]);
+        }
+    }
+
+    // keep the table at most half full so probes stay short
+    size_t capacity = 1;
+    while (capacity < 2 * unpacked.size()) {
+        capacity *= 2;
+    }
+    keys.assign(capacity, EMPTY);
+    hit_starts.assign(capacity, 0);
+    hit_counts.assign(capacity, 0);
+    hits.clear();
+
+    for (auto& entry : unpacked) {
+        // overlapping walks, like a path and the haplotypes through it, find the same hits
+        auto& key_hits = entry.second;
+        sort(key_hits.begin(), key_hits.end());
+        key_hits.erase(unique(key_hits.begin(), key_hits.end()), key_hits.end());
+
+        size_t slot = find_slot(entry.first);
+        keys[slot] = entry.first;
+        hit_starts[slot] = hits.size();
+        hit_counts[slot] = key_hits.size();
+        hits.insert(hits.end(), key_hits.begin(), key_hits.end());
+    }
+    unordered_map<uint64_t, vector<gcsa::node_type>>().swap(unpacked);
+}
+
+void MinimizerIndex::for_each_minimizer(string::const_iterator begin, string::const_iterator end,
+                                        const function<void(const Minimizer&)>& lambda) const {
+    size_t length = end - begin;
+    uint64_t mask = (uint64_t(1) << (2 * kmer_length)) - 1;
+    uint64_t code = 0;
+    // how many valid bases end at the current one
+    size_t valid = 0;
+    // the k-mers that could still be the minimizer of a window, in order along
+    // the sequence and with increasing hashes, so the front is the minimizer
+    deque<pair<uint64_t, Minimizer>> candidates;
+    size_t last_reported = numeric_limits<size_t>::max();
+
+    for (size_t i = 0; i < length; i++) {
+        int base = base_code(*(begin + i));
+        if (base < 0) {
+            valid = 0;
+            code = 0;
+        } else {
+            code = ((code << 2) | base) & mask;
+            valid++;
+        }
+        if (i + 1 < kmer_length) {
+            continue;
+        }
+        // the k-mer ending here, and the window of w k-mers ending with it
+        size_t start = i + 1 - kmer_length;
+        while (!candidates.empty() && candidates.front().second.offset + window_length <= start) {
+            candidates.pop_front();
+        }
+        if (valid >= kmer_length) {
+            uint64_t hash = minimizer_hash(code);
+            // ties go to the leftmost k-mer
+            while (!candidates.empty() && candidates.back().first > hash) {
+                candidates.pop_back();
+            }
+            candidates.emplace_back(hash, Minimizer{code, start});
+        }
+        // report each window's minimizer once it's full, or at the end of a
+        // sequence too short to fill one
+        bool window_full = start + 1 >= window_length;
+        if ((window_full || i + 1 == length) && !candidates.empty()
+            && candidates.front().second.offset != last_reported) {
+            last_reported = candidates.front().second.offset;
+            lambda(candidates.front().second);
+        }
+    }
+}
+
+vector<MinimizerIndex::Minimizer> MinimizerIndex::minimizers(string::const_iterator begin,
+                                                             string::const_iterator end) const {
+    vector<Minimizer> found;
+    for_each_minimizer(begin, end, [&](const Minimizer& minimizer) {
+        found.push_back(minimizer);
+    });
+    return found;
+}
+
+size_t MinimizerIndex::find_slot(uint64_t key) const {
+    size_t mask = keys.size() - 1;
+    size_t slot = minimizer_hash(key) & mask;
+    while (keys[slot] != key && keys[slot] != EMPTY) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+size_t MinimizerIndex::count(uint64_t key) const {
+    if (keys.empty()) {
+        return 0;
+    }
+    size_t slot = find_slot(key);
+    return keys[slot] == key ? hit_counts[slot] : 0;
+}
+
+vector<gcsa::node_type> MinimizerIndex::find(uint64_t key) const {
+    if (keys.empty()) {
+        return vector<gcsa::node_type>();
+    }
+    size_t slot = find_slot(key);
+    if (keys[slot] != key) {
+        return vector<gcsa::node_type>();
+    }
+    return vector<gcsa::node_type>(hits.begin() + hit_starts[slot],
+                                   hits.begin() + hit_starts[slot] + hit_counts[slot]);
+}
+
+size_t MinimizerIndex::k() const {
+    return kmer_length;
+}
+
+size_t MinimizerIndex::w() const {
+    return window_length;
+}
+
+size_t MinimizerIndex::size() const {
+    return keys.size() - count_if(keys.begin(), keys.end(), [](uint64_t key) { return key == EMPTY; });
+}
+
+void MinimizerIndex::save(ostream& out) const {
+    if (!unpacked.empty()) {
+        throw runtime_error("[vg::MinimizerIndex] index must be finished before it is saved");
+    }
+
+    auto write_int = [&](uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) {
+            out.put((char) ((value >> (8 * i)) & 0xFF));
+        }
+    };
+
+    out.write(MAGIC.data(), MAGIC.size());
+    write_int(VERSION, 4);
+    write_int(kmer_length, 4);
+    write_int(window_length, 4);
+    write_int(keys.size(), 8);
+    for (size_t slot = 0; slot < keys.size(); slot++) {
+        write_int(keys[slot], 8);
+        write_int(hit_starts[slot], 8);
+        write_int(hit_counts[slot], 4);
+    }
+    write_int(hits.size(), 8);
+    for (auto& hit : hits) {
+        write_int(hit, 8);
+    }
+
+    if (!out) {
+        throw runtime_error("[vg::MinimizerIndex] could not write index");
+    }
+}
+
+void MinimizerIndex::load(istream& in) {
+    auto read_int = [&](size_t bytes) -> uint64_t {
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            int c = in.get();
+            if (c == EOF) {
+                throw runtime_error("[vg::MinimizerIndex] index is truncated");
+            }
+            value |= ((uint64_t) (unsigned char) c) << (8 * i);
+        }
+        return value;
+    };
+
+    string magic(MAGIC.size(), '\0');
+    in.read(&magic[0], magic.size());
+    if (!in || magic != MAGIC) {
+        throw runtime_error("[vg::MinimizerIndex] not a minimizer index");
+    }
+    uint32_t version = read_int(4);
+    if (version > VERSION) {
+        throw runtime_error("[vg::MinimizerIndex] minimizer index version " + to_string(version)
+                            + " is newer than supported version " + to_string(VERSION));
+    }
+
+    kmer_length = read_int(4);
+    window_length = read_int(4);
+    size_t capacity = read_int(8);
+    if (capacity & (capacity - 1)) {
+        throw runtime_error("[vg::MinimizerIndex] minimizer index table is corrupt");
+    }
+    keys.resize(capacity);
+    hit_starts.resize(capacity);
+    hit_counts.resize(capacity);
+    for (size_t slot = 0; slot < capacity; slot++) {
+        keys[slot] = read_int(8);
+        hit_starts[slot] = read_int(8);
+        hit_counts[slot] = read_int(4);
+    }
+    hits.resize(read_int(8));
+    for (auto& hit : hits) {
+        hit = read_int(8);
+    }
+    unpacked.clear();
+}
+
+}
@@ -0,0 +1,131 @@
+#ifndef VG_MINIMIZER_INDEX_HPP_INCLUDED
+#define VG_MINIMIZER_INDEX_HPP_INCLUDED
+
+/**
+ * \file minimizer_index.hpp: define a MinimizerIndex, a hash table from the
+ * (w, k)-minimizers of walks through the graph to the graph positions where
+ * they occur, which can stand in for a GCSA2 index as a source of seeds.
+ */
+
+#include <iostream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <gcsa/gcsa.h>
+#include <gbwt/gbwt.h>
+
+#include "xg.hpp"
+#include "types.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * An index of the minimizers of the embedded paths or GBWT haplotypes of a
+ * graph. A minimizer is the k-mer with the smallest hash among w consecutive
+ * k-mers of a sequence, so any exact match of at least w + k - 1 bases between
+ * a read and an indexed walk shares a minimizer with it. Walks are indexed in
+ * both orientations, so the k-mers of the read can be looked up as they are.
+ *
+ * Hits are stored as GCSA2 node_type positions of the first base of the k-mer,
+ * so they can be used as the nodes of a MaximalExactMatch. Building the index
+ * only takes a pass over the walks, and each lookup is a single hash probe,
+ * but unlike a GCSA2 index only sequence on the indexed walks can be found.
+ */
+class MinimizerIndex {
+public:
+
+    /// A minimizer of a sequence
+    struct Minimizer {
+        /// The k-mer, 2 bits per base, first base most significant
+        uint64_t key;
+        /// Offset of the k-mer in the sequence
+        size_t offset;
+    };
+
+    /// Make an empty index of minimizers of k-mers, in windows of w k-mers.
+    /// k can be at most 31.
+    MinimizerIndex(size_t k = 21, size_t w = 11);
+
+    /// Add the minimizers of each embedded path in the graph.
+    void add_paths(const xg::XG& graph);
+
+    /// Add the minimizers of each haplotype in the GBWT, which must be over
+    /// the graph's node IDs.
+    void add_haplotypes(const xg::XG& graph, const gbwt::GBWT& haplotypes);
+
+    /// Add the minimizers of a walk through the graph, given as oriented node
+    /// IDs, and of its reverse complement.
+    void add_walk(const xg::XG& graph, const vector<pair<id_t, bool>>& walk);
+
+    /// Pack the minimizers added so far into the lookup table. Must be called
+    /// after adding walks and before looking anything up or saving.
+    void finish();
+
+    /// Get the minimizers of a sequence, in order along it. Windows of w
+    /// k-mers that share their minimizer only report it once, and k-mers
+    /// containing anything other than ACGT are skipped.
+    vector<Minimizer> minimizers(string::const_iterator begin, string::const_iterator end) const;
+
+    /// Get the number of places a minimizer occurs in the indexed walks.
+    size_t count(uint64_t key) const;
+
+    /// Get the positions of the first bases of the occurrences of a minimizer.
+    vector<gcsa::node_type> find(uint64_t key) const;
+
+    /// Get the k-mer length
+    size_t k() const;
+
+    /// Get the window length, in k-mers
+    size_t w() const;
+
+    /// Get the number of distinct minimizers indexed
+    size_t size() const;
+
+    /// Save the index to a stream
+    void save(ostream& out) const;
+
+    /// Load an index from a stream. Throws if it isn't a minimizer index.
+    void load(istream& in);
+
+private:
+
+    /// Find the minimizers of a sequence, and call the function with each one.
+    void for_each_minimizer(string::const_iterator begin, string::const_iterator end,
+                            const function<void(const Minimizer&)>& lambda) const;
+
+    /// Get the slot in the table where a key is, or would go
+    size_t find_slot(uint64_t key) const;
+
+    /// The k-mer length
+    size_t kmer_length;
+    /// The window length, in k-mers
+    size_t window_length;
+
+    /// Hits of each key added since the table was last packed
+    unordered_map<uint64_t, vector<gcsa::node_type>> unpacked;
+
+    /// Open addressed table of keys, with EMPTY in unused slots. Its size is a
+    /// power of two.
+    vector<uint64_t> keys;
+    /// For each slot, where its key's hits start in hits
+    vector<uint64_t> hit_starts;
+    /// For each slot, how many hits its key has
+    vector<uint32_t> hit_counts;
+    /// Hits of all the keys, grouped by key
+    vector<gcsa::node_type> hits;
+
+    /// Marks an unused slot; never a valid key since k is at most 31
+    static const uint64_t EMPTY;
+    /// Magic number at the start of a saved index
+    static const string MAGIC;
+    /// Format version we write
+    static const uint32_t VERSION;
+};
+
+}
+
+#endif
@@ -94,6 +94,7 @@ namespace vg {
         }
     }
     
+    /// Do the dynamic programming for the optimal alignment and trace it back into aln_out
     int32_t optimal_alignment_internal(const MultipathAlignment& multipath_aln, Alignment* aln_out) {
         
         // initialize DP structures
@@ -132,20 +133,22 @@ namespace vg {
             }
         }
         
-        // are we constructing the alignment, or just getting the score?
-        if (aln_out && opt_subpath >= 0) {
+        if (opt_subpath >= 0) {
             
             // traceback the optimal subpaths until hitting sentinel (-1)
             vector<const Path*> optimal_path_chunks;
             int64_t curr = opt_subpath;
             int64_t prev = -1;
+            size_t total_mappings = 1;
             while (curr >= 0) {
                 optimal_path_chunks.push_back(&(multipath_aln.subpath(curr).path()));
+                total_mappings += optimal_path_chunks.back()->mapping_size();
                 prev = curr;
                 curr = prev_subpath[curr];
             }
             
             Path* opt_path = aln_out->mutable_path();
+            opt_path->mutable_mapping()->Reserve(total_mappings);
             
             // check for a softclip of entire subpaths on the beginning
             if (prefix_length[prev]) {
@@ -189,7 +192,7 @@ namespace vg {
                         
                         last_edit->set_from_length(last_edit->from_length() + first_edit.from_length());
                         last_edit->set_to_length(last_edit->to_length() + first_edit.to_length());
-                        last_edit->set_sequence(last_edit->sequence() + first_edit.sequence());
+                        last_edit->mutable_sequence()->append(first_edit.sequence());
                         
                         edit_start_idx++;
                     }
@@ -240,8 +243,19 @@ namespace vg {
     
     
     int32_t optimal_alignment_score(const MultipathAlignment& multipath_aln){
-        // do dynamic programming without traceback
-        return optimal_alignment_internal(multipath_aln, nullptr);
+        // do dynamic programming without traceback, which only needs the subpath scores
+        // and edges, so we never have to look inside the subpaths' Paths
+        vector<int32_t> prefix_score(multipath_aln.subpath_size(), 0);
+        int32_t opt_score = 0;
+        for (size_t i = 0; i < multipath_aln.subpath_size(); i++) {
+            const Subpath& subpath = multipath_aln.subpath(i);
+            int32_t extended_score = prefix_score[i] + subpath.score();
+            for (int64_t next : subpath.next()) {
+                prefix_score[next] = max(prefix_score[next], extended_score);
+            }
+            opt_score = max(opt_score, extended_score);
+        }
+        return opt_score;
     }
     
     /// Stores the reverse complement of a Subpath in another Subpath
@@ -316,92 +330,6 @@ namespace vg {
         }
     }
     
-    void rev_comp_multipath_alignment_in_place(MultipathAlignment* multipath_aln,
-                                               const function<int64_t(int64_t)>& node_length) {
-        
-        // reverse complement sequence
-        reverse_complement_in_place(*multipath_aln->mutable_sequence());
-        // reverse base qualities
-        string* quality = multipath_aln->mutable_quality();
-        std::reverse(quality->begin(), quality->end());
-        
-        // current reverse edges
-        vector< vector<int64_t> > reverse_edge_lists(multipath_aln->subpath_size());
-        // current sink nodes (will be starts)
-        vector<int64_t> reverse_starts;
-        
-        int64_t subpath_swap_size = multipath_aln->subpath_size() / 2;
-        int64_t last = multipath_aln->subpath_size() - 1;
-        for (int64_t i = 0, j = last; i < subpath_swap_size; i++, j--) {
-            Subpath* subpath_1 = multipath_aln->mutable_subpath(i);
-            Subpath* subpath_2 = multipath_aln->mutable_subpath(j);
-            
-            // add reverse edges for first subpath
-            if (subpath_1->next_size() > 0) {
-                for (int64_t k = 0; k < subpath_1->next_size(); k++) {
-                    reverse_edge_lists[subpath_1->next(k)].push_back(i);
-                }
-            }
-            else {
-                reverse_starts.push_back(i);
-            }
-            
-            // add reverse edges for second subpath
-            if (subpath_2->next_size() > 0) {
-                for (int64_t k = 0; k < subpath_2->next_size(); k++) {
-                    reverse_edge_lists[subpath_2->next(k)].push_back(j);
-                }
-            }
-            else {
-                reverse_starts.push_back(j);
-            }
-            
-            // clear current edges
-            subpath_1->clear_next();
-            subpath_2->clear_next();
-            
-            // reverse complement the paths
-            reverse_complement_path_in_place(subpath_1->mutable_path(), node_length);
-            reverse_complement_path_in_place(subpath_2->mutable_path(), node_length);
-            
-            // swap their positions (to maintain topological ordering)
-            std::swap(*subpath_1, *subpath_2);
-        }
-        
-        // repeat process for the middle subpath if there is an odd number
-        if (multipath_aln->subpath_size() % 2) {
-            Subpath* subpath = multipath_aln->mutable_subpath(subpath_swap_size);
-            if (subpath->next_size() > 0) {
-                for (int64_t k = 0; k < subpath->next_size(); k++) {
-                    reverse_edge_lists[subpath->next(k)].push_back(subpath_swap_size);
-                }
-            }
-            else {
-                reverse_starts.push_back(subpath_swap_size);
-            }
-            
-            subpath->clear_next();
-            reverse_complement_path_in_place(subpath->mutable_path(), node_length);
-        }
-        
-        // add reversed edges
-        for (int64_t i = 0, j = last; i < multipath_aln->subpath_size(); i++, j--) {
-            vector<int64_t> edges = reverse_edge_lists[j];
-            Subpath* subpath = multipath_aln->mutable_subpath(i);
-            for (int64_t k : edges) {
-                subpath->add_next(last - k);
-            }
-        }
-        
-        // if we had starts labeled before, label them again
-        if (multipath_aln->start_size() > 0) {
-            multipath_aln->clear_start();
-            for (int64_t i : reverse_starts) {
-                multipath_aln->add_start(last - i);
-            }
-        }
-    }
-    
     void to_multipath_alignment(const Alignment& aln, MultipathAlignment& multipath_aln_out) {
         
         // clear repeated fields
@@ -38,7 +38,9 @@ namespace vg {
     ///
     void optimal_alignment(const MultipathAlignment& multipath_aln, Alignment& aln_out);
     
-    /// Returns the score of the highest scoring alignment contained in the MultipathAlignment
+    /// Returns the score of the highest scoring alignment contained in the MultipathAlignment.
+    /// Only looks at the subpaths' scores and edges, so it is much cheaper than finding the
+    /// optimal alignment itself.
     ///
     /// Note: Assumes that each subpath's Path object uses one Mapping per node and that
     /// start subpaths have been identified
@@ -60,14 +62,15 @@ namespace vg {
                                       const function<int64_t(int64_t)>& node_length,
                                       MultipathAlignment& rev_comp_out);
     
-    /// Stores the reverse complement of a MultipathAlignment in another MultipathAlignment
+    /// Reverse complements a MultipathAlignment in place, without copying its Subpaths
     ///
     ///  Args:
     ///    multipath_aln     multipath alignment to reverse complement in place
-    ///    node_length       a function that returns the length of a node sequence from its node ID
+    ///    node_length       a callable that returns the length of a node sequence from its node ID
     ///
+    template<typename NodeLength>
     void rev_comp_multipath_alignment_in_place(MultipathAlignment* multipath_aln,
-                                               const function<int64_t(int64_t)>& node_length);
+                                               const NodeLength& node_length);
     
     /// Converts a Alignment into a Multipath alignment with one Subpath and stores it in an object
     ///
@@ -113,6 +116,63 @@ namespace vg {
                                          MultipathAlignment& sub_multipath_aln);
     
     // TODO: function for adding a graph augmentation to an existing multipath alignment
+    
+    template<typename NodeLength>
+    void rev_comp_multipath_alignment_in_place(MultipathAlignment* multipath_aln,
+                                               const NodeLength& node_length) {
+        
+        // reverse complement sequence
+        if (!multipath_aln->sequence().empty()) {
+            reverse_complement_in_place(*multipath_aln->mutable_sequence());
+        }
+        // reverse base qualities
+        if (!multipath_aln->quality().empty()) {
+            string* quality = multipath_aln->mutable_quality();
+            std::reverse(quality->begin(), quality->end());
+        }
+        
+        int64_t last = multipath_aln->subpath_size() - 1;
+        
+        // the edges in reverse, as (from, to) in the reversed subpath indexes
+        vector<pair<int64_t, int64_t>> reverse_edges;
+        // current sink nodes (will be starts), in the reversed subpath indexes
+        vector<int64_t> reverse_starts;
+        
+        for (int64_t i = last; i >= 0; i--) {
+            Subpath* subpath = multipath_aln->mutable_subpath(i);
+            if (subpath->next_size() > 0) {
+                for (int64_t k = 0; k < subpath->next_size(); k++) {
+                    reverse_edges.emplace_back(last - subpath->next(k), last - i);
+                }
+                subpath->clear_next();
+            }
+            else {
+                reverse_starts.push_back(last - i);
+            }
+            
+            reverse_complement_path_in_place(subpath->mutable_path(), node_length);
+        }
+        
+        // reverse the order of the subpaths (to maintain topological ordering)
+        auto* subpaths = multipath_aln->mutable_subpath();
+        for (int64_t i = 0, j = last; i < j; i++, j--) {
+            subpaths->SwapElements(i, j);
+        }
+        
+        // add reversed edges
+        std::sort(reverse_edges.begin(), reverse_edges.end());
+        for (const pair<int64_t, int64_t>& edge : reverse_edges) {
+            subpaths->Mutable(edge.first)->add_next(edge.second);
+        }
+        
+        // if we had starts labeled before, label them again
+        if (multipath_aln->start_size() > 0) {
+            multipath_aln->clear_start();
+            for (int64_t i : reverse_starts) {
+                multipath_aln->add_start(i);
+            }
+        }
+    }
 }
 
 
@@ -9,6 +9,9 @@
 //#define debug_validate_multipath_alignments
 //#define debug_report_startup_training
 
+#include <omp.h>
+#include <cstring>
+
 #include "multipath_mapper.hpp"
 
 #include "algorithms/extract_containing_graph.hpp"
@@ -16,11 +19,16 @@
 #include "algorithms/extract_extending_graph.hpp"
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/weakly_connected_components.hpp"
+#include "algorithms/xdrop_extension.hpp"
 
 namespace vg {
     
     //size_t MultipathMapper::PRUNE_COUNTER = 0;
     //size_t MultipathMapper::SUBGRAPH_TOTAL = 0;
+    size_t MultipathMapper::UNGAPPED_TAIL_COUNTER = 0;
+    size_t MultipathMapper::TAIL_TOTAL = 0;
+    const string MultipathMapper::CALIBRATION_MAGIC = "VGMPCAL";
+    const uint32_t MultipathMapper::CALIBRATION_VERSION = 1;
     
     MultipathMapper::MultipathMapper(xg::XG* xg_index, gcsa::GCSA* gcsa_index, gcsa::LCPArray* lcp_array,
                                      SnarlManager* snarl_manager) :
@@ -37,7 +45,23 @@ namespace vg {
     void MultipathMapper::multipath_map(const Alignment& alignment,
                                         vector<MultipathAlignment>& multipath_alns_out,
                                         size_t max_alt_mappings) {
+        if (duplicate_cache == nullptr) {
+            multipath_map_internal(alignment, mapping_quality_method, multipath_alns_out, max_alt_mappings);
+            return;
+        }
+        
+        // reads that only differ in the low bits of their qualities get the same alignments
+        string key = DuplicateReadCache<vector<MultipathAlignment>>::read_key(alignment, adjust_alignments_for_base_quality,
+                                                                             4, to_string(max_alt_mappings));
+        if (duplicate_cache->retrieve(key, multipath_alns_out)) {
+            // the subpaths and scores carry over, but the fields about the read itself are its own
+            for (MultipathAlignment& multipath_aln : multipath_alns_out) {
+                transfer_read_metadata(alignment, multipath_aln);
+            }
+            return;
+        }
         multipath_map_internal(alignment, mapping_quality_method, multipath_alns_out, max_alt_mappings);
+        duplicate_cache->put(key, multipath_alns_out);
     }
     
     void MultipathMapper::multipath_map_internal(const Alignment& alignment,
@@ -58,7 +82,7 @@ namespace vg {
         
 #ifdef debug_multipath_mapper_mapping
         cerr << "obtained MEMs:" << endl;
-        for (MaximalExactMatch mem : mems) {
+        for (const MaximalExactMatch& mem : mems) {
             cerr << "\t" << mem << " (" << mem.nodes.size() << " hits)" << endl;
         }
         cerr << "clustering MEMs..." << endl;
@@ -72,9 +96,22 @@ namespace vg {
         OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
         OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
         OrientedDistanceClusterer::handle_memo_t handle_memo;
+        StageTimer clustering_timer(MappingStage::Clustering);
         // TODO: Making OrientedDistanceClusterers is the only place we actually
         // need to distinguish between regular_aligner and qual_adj_aligner
-        if (adjust_alignments_for_base_quality) {
+        if (use_sparse_chaining) {
+            if (adjust_alignments_for_base_quality) {
+                SparseChainClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                               min_clustering_mem_length, max_chaining_hits);
+                clusters = clusterer.clusters(max_mapping_quality, log_likelihood_approx_factor);
+            }
+            else {
+                SparseChainClusterer clusterer(alignment, mems, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                               min_clustering_mem_length, max_chaining_hits);
+                clusters = clusterer.clusters(max_mapping_quality, log_likelihood_approx_factor);
+            }
+        }
+        else if (adjust_alignments_for_base_quality) {
             OrientedDistanceClusterer clusterer(alignment, mems, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
                                                 min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
             clusters = clusterer.clusters(max_mapping_quality, log_likelihood_approx_factor);
@@ -84,6 +121,8 @@ namespace vg {
                                                 min_clustering_mem_length, unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
             clusters = clusterer.clusters(max_mapping_quality, log_likelihood_approx_factor);
         }
+        clustering_timer.add_items(clusters.size());
+        clustering_timer.stop();
         
 #ifdef debug_multipath_mapper_mapping
         cerr << "obtained clusters:" << endl;
@@ -162,7 +201,7 @@ namespace vg {
 //#pragma omp atomic
 //        SUBGRAPH_TOTAL += cluster_graphs.size();
         
-        // align to each cluster subgraph
+        // decide which cluster subgraphs to align to
         size_t num_mappings = 0;
         for (auto& cluster_graph : cluster_graphs) {
             // if we have a cluster graph with small enough MEM coverage compared to the best one or we've made
@@ -177,16 +216,22 @@ namespace vg {
 //                PRUNE_COUNTER += cluster_graphs.size() - num_mappings;
                 break;
             }
-            
+            num_mappings++;
+        }
+        
+        // align to each of them
+        multipath_alns_out.resize(num_mappings);
+        vector<function<void(void)>> alignment_jobs;
+        alignment_jobs.reserve(num_mappings);
+        for (size_t i = 0; i < num_mappings; i++) {
+            alignment_jobs.emplace_back([&, i]() {
 #ifdef debug_multipath_mapper_alignment
-            cerr << "performing alignment to subgraph " << pb2json(get<0>(cluster_graph)->graph) << endl;
+                cerr << "performing alignment to subgraph " << pb2json(get<0>(cluster_graphs[i])->graph) << endl;
 #endif
-            
-            multipath_alns_out.emplace_back();
-            multipath_align(alignment, get<0>(cluster_graph), get<1>(cluster_graph), multipath_alns_out.back());
-            
-            num_mappings++;
+                multipath_align(alignment, get<0>(cluster_graphs[i]), get<1>(cluster_graphs[i]), multipath_alns_out[i]);
+            });
         }
+        run_alignment_jobs(alignment_jobs);
         
         // split up any alignments that ended up being disconnected
         split_multicomponent_alignments(multipath_alns_out);
@@ -295,6 +340,8 @@ namespace vg {
             cerr << "couldn't find unambiguous mapping, adding pair to ambiguous buffer" << endl;
 #endif
             
+            // other threads may be looking for unambiguous pairs at the same time
+#pragma omp critical (ambiguous_pair_buffer)
             ambiguous_pair_buffer.emplace_back(alignment1, alignment2);
         }
         
@@ -311,13 +358,9 @@ namespace vg {
                 cerr << "\t" << aln_pair.first.name() << ", " << aln_pair.second.name() << endl;
             }
             cerr << "distance measurements:" << endl;
-            auto iter = fragment_length_distr.measurements_begin();
-            if (iter != fragment_length_distr.measurements_end()) {
-                cerr << *iter;
-                iter++;
-            }
-            for (; iter != fragment_length_distr.measurements_end(); iter++) {
-                cerr << ", " << *iter;
+            vector<double> measurements = fragment_length_distr.measurements();
+            for (size_t i = 0; i < measurements.size(); i++) {
+                cerr << (i ? ", " : "") << measurements[i];
             }
             cerr << endl;
         }
@@ -327,6 +370,8 @@ namespace vg {
     bool MultipathMapper::attempt_rescue(const MultipathAlignment& multipath_aln, const Alignment& other_aln,
                                          bool rescue_forward, MultipathAlignment& rescue_multipath_aln) {
         
+        StageTimer timer(MappingStage::PairRescue);
+        
 #ifdef debug_multipath_mapper_mapping
         cerr << "attemping pair rescue in " << (rescue_forward ? "forward" : "backward") << " direction from " << pb2json(multipath_aln) << endl;
 #endif
@@ -354,7 +399,7 @@ namespace vg {
         VG rescue_graph;
         vector<size_t> backward_dist(jump_positions.size(), 6 * fragment_length_distr.stdev());
         vector<size_t> forward_dist(jump_positions.size(), 6 * fragment_length_distr.stdev() + other_aln.sequence().size());
-        algorithms::extract_containing_graph(xindex, rescue_graph.graph, jump_positions, backward_dist, forward_dist);
+        algorithms::extract_containing_graph(extraction_graph(), rescue_graph.graph, jump_positions, backward_dist, forward_dist);
         rescue_graph.build_indexes();
         
 #ifdef debug_multipath_mapper_mapping
@@ -447,6 +492,31 @@ namespace vg {
     
     // make the memo live in this .o file
     thread_local unordered_map<pair<size_t, size_t>, double> MultipathMapper::p_value_memo;
+    thread_local CachingHandleGraph MultipathMapper::extraction_cache;
+    
+    const HandleGraph* MultipathMapper::extraction_graph() const {
+        extraction_cache.set_source(xindex);
+        return &extraction_cache;
+    }
+    
+    void MultipathMapper::run_alignment_jobs(vector<function<void(void)>>& jobs) const {
+        if (!parallel_cluster_alignment || jobs.size() < 2 || !omp_in_parallel() || omp_get_num_threads() < 2) {
+            for (auto& job : jobs) {
+                job();
+            }
+            return;
+        }
+        
+        // only hand off all but the first job, which we can do ourselves while the other threads pick
+        // up the rest
+        for (size_t i = 1; i < jobs.size(); i++) {
+            function<void(void)>* job = &jobs[i];
+#pragma omp task default(none) firstprivate(job)
+            (*job)();
+        }
+        jobs.front()();
+#pragma omp taskwait
+    }
     
     double MultipathMapper::random_match_p_value(size_t match_length, size_t read_length) {
         // memoized to avoid transcendental functions (at least in cases where read lengths don't vary too much)
@@ -558,6 +628,78 @@ namespace vg {
         adjust_alignments_for_base_quality = reset_quality_adjustments;
     }
     
+    void MultipathMapper::save_calibration(ostream& out, const string& key) const {
+        auto write_int = [&](uint64_t value, size_t bytes) {
+            for (size_t i = 0; i < bytes; i++) {
+                out.put((char) ((value >> (8 * i)) & 0xFF));
+            }
+        };
+        
+        out.write(CALIBRATION_MAGIC.data(), CALIBRATION_MAGIC.size());
+        write_int(CALIBRATION_VERSION, 4);
+        write_int(key.size(), 8);
+        out.write(key.data(), key.size());
+        write_int(min_clustering_mem_length, 8);
+        // store the multiplier's bits so it comes back exactly
+        uint64_t multiplier_bits;
+        static_assert(sizeof(multiplier_bits) == sizeof(pseudo_length_multiplier), "double must be 64 bits");
+        memcpy(&multiplier_bits, &pseudo_length_multiplier, sizeof(multiplier_bits));
+        write_int(multiplier_bits, 8);
+        
+        if (!out) {
+            throw runtime_error("[vg::MultipathMapper] could not write calibration");
+        }
+    }
+    
+    bool MultipathMapper::load_calibration(istream& in, const string& key) {
+        bool truncated = false;
+        auto read_int = [&](size_t bytes) -> uint64_t {
+            uint64_t value = 0;
+            for (size_t i = 0; i < bytes && !truncated; i++) {
+                int c = in.get();
+                if (c == EOF) {
+                    truncated = true;
+                    break;
+                }
+                value |= ((uint64_t) (unsigned char) c) << (8 * i);
+            }
+            return value;
+        };
+        
+        string magic(CALIBRATION_MAGIC.size(), '\0');
+        in.read(&magic[0], magic.size());
+        if (!in || magic != CALIBRATION_MAGIC) {
+            return false;
+        }
+        uint32_t version = read_int(4);
+        if (truncated || version != CALIBRATION_VERSION) {
+            return false;
+        }
+        
+        // a calibration for other indexes or settings is stale, not an error
+        size_t key_length = read_int(8);
+        if (truncated || key_length != key.size()) {
+            return false;
+        }
+        string saved_key(key_length, '\0');
+        in.read(&saved_key[0], key_length);
+        if (!in || saved_key != key) {
+            return false;
+        }
+        
+        size_t saved_clustering_length = read_int(8);
+        uint64_t multiplier_bits = read_int(8);
+        if (truncated) {
+            return false;
+        }
+        
+        min_clustering_mem_length = saved_clustering_length;
+        memcpy(&pseudo_length_multiplier, &multiplier_bits, sizeof(multiplier_bits));
+        // p-values memoized under the old multiplier no longer hold
+        p_value_memo.clear();
+        return true;
+    }
+    
     int64_t MultipathMapper::distance_between(const MultipathAlignment& multipath_aln_1,
                                               const MultipathAlignment& multipath_aln_2,
                                               bool full_fragment, bool forward_strand) const {
@@ -571,9 +713,15 @@ namespace vg {
 #ifdef debug_multipath_mapper_mapping
         cerr << "measuring left-to-" << (full_fragment ? "right" : "left") << " end distance between " << pos_1 << " and " << pos_2 << endl;
 #endif
-        return xindex->closest_shared_path_oriented_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
-                                                             id(pos_2), offset(pos_2), is_rev(pos_2),
-                                                             forward_strand);
+        int64_t dist = xindex->closest_shared_path_oriented_distance(id(pos_1), offset(pos_1), is_rev(pos_1),
+                                                                     id(pos_2), offset(pos_2), is_rev(pos_2),
+                                                                     forward_strand);
+        if (dist == numeric_limits<int64_t>::max() && distance_index && fragment_length_distr.is_finalized()) {
+            // the ends don't share a path, so fall back on the graph distance as far as it could
+            // still be consistent with the fragment length distribution
+            dist = indexed_distance(pos_1, pos_2, fragment_length_distr.mean() + 10.0 * fragment_length_distr.stdev());
+        }
+        return dist;
     }
     
     bool MultipathMapper::is_consistent(int64_t distance) const {
@@ -1101,19 +1249,20 @@ namespace vg {
         // the fragment length distribution has been estimated, so we can do full-fledged paired mode
     
         // query MEMs using GCSA2
-        double dummy1, dummy2;
-        vector<MaximalExactMatch> mems1 = find_mems_deep(alignment1.sequence().begin(), alignment1.sequence().end(), dummy1, dummy2,
-                                                         0, min_mem_length, mem_reseed_length, false, true, true, false);
-        vector<MaximalExactMatch> mems2 = find_mems_deep(alignment2.sequence().begin(), alignment2.sequence().end(), dummy1, dummy2,
-                                                         0, min_mem_length, mem_reseed_length, false, true, true, false);
+        vector<double> dummy1, dummy2;
+        auto pair_mems = find_mems_deep_batch({make_pair(alignment1.sequence().cbegin(), alignment1.sequence().cend()),
+                                               make_pair(alignment2.sequence().cbegin(), alignment2.sequence().cend())},
+                                              dummy1, dummy2, 0, min_mem_length, mem_reseed_length, false, true, true, false);
+        vector<MaximalExactMatch>& mems1 = pair_mems[0];
+        vector<MaximalExactMatch>& mems2 = pair_mems[1];
         
 #ifdef debug_multipath_mapper_mapping
         cerr << "obtained read1 MEMs:" << endl;
-        for (MaximalExactMatch mem : mems1) {
+        for (const MaximalExactMatch& mem : mems1) {
             cerr << "\t" << mem << " (" << mem.nodes.size() << " hits filled out of " << mem.match_count << ")" << endl;
         }
         cerr << "obtained read2 MEMs:" << endl;
-        for (MaximalExactMatch mem : mems2) {
+        for (const MaximalExactMatch& mem : mems2) {
             cerr << "\t" << mem << " (" << mem.nodes.size() << " hits filled out of " << mem.match_count << ")" << endl;
         }
         cerr << "clustering MEMs..." << endl;
@@ -1127,9 +1276,28 @@ namespace vg {
         OrientedDistanceClusterer::paths_of_node_memo_t paths_of_node_memo;
         OrientedDistanceClusterer::oriented_occurences_memo_t oriented_occurences_memo;
         OrientedDistanceClusterer::handle_memo_t handle_memo;
+        StageTimer clustering_timer(MappingStage::Clustering);
         // TODO: Making OrientedDistanceClusterers is the only place we actually
         // need to distinguish between regular_aligner and qual_adj_aligner
-        if (adjust_alignments_for_base_quality) {
+        if (use_sparse_chaining) {
+            if (adjust_alignments_for_base_quality) {
+                SparseChainClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, max_chaining_hits);
+                clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
+                SparseChainClusterer clusterer2(alignment2, mems2, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, max_chaining_hits);
+                clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
+            }
+            else {
+                SparseChainClusterer clusterer1(alignment1, mems1, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, max_chaining_hits);
+                clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
+                SparseChainClusterer clusterer2(alignment2, mems2, *get_regular_aligner(), xindex, max_expected_dist_approx_error,
+                                                min_clustering_mem_length, max_chaining_hits);
+                clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
+            }
+        }
+        else if (adjust_alignments_for_base_quality) {
             OrientedDistanceClusterer clusterer1(alignment1, mems1, *get_qual_adj_aligner(), xindex, max_expected_dist_approx_error, min_clustering_mem_length,
                                                  unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
             clusters1 = clusterer1.clusters(max_mapping_quality, log_likelihood_approx_factor);
@@ -1145,6 +1313,8 @@ namespace vg {
                                                  unstranded_clustering, &paths_of_node_memo, &oriented_occurences_memo, &handle_memo);
             clusters2 = clusterer2.clusters(max_mapping_quality, log_likelihood_approx_factor);
         }
+        clustering_timer.add_items(clusters1.size() + clusters2.size());
+        clustering_timer.stop();
         
         // extract graphs around the clusters and get the assignments of MEMs to these graphs
         auto cluster_graphs1 = query_cluster_graphs(alignment1, mems1, clusters1);
@@ -1190,6 +1360,8 @@ namespace vg {
         }
         
         // Compute the pairs of cluster graphs and their approximate distances from each other
+        StageTimer pairing_timer(MappingStage::ClusterPairing);
+        size_t num_pairs_skipped = 0;
         vector<pair<pair<size_t, size_t>, int64_t>> cluster_pairs = OrientedDistanceClusterer::pair_clusters(alignment1,
                                                                                                              alignment2,
                                                                                                              cluster_mems_1,
@@ -1200,7 +1372,11 @@ namespace vg {
                                                                                                              unstranded_clustering,
                                                                                                              &paths_of_node_memo,
                                                                                                              &oriented_occurences_memo,
-                                                                                                             &handle_memo);
+                                                                                                             &handle_memo,
+                                                                                                             max_cluster_pairs,
+                                                                                                             &num_pairs_skipped);
+        pairing_timer.add_items(num_pairs_skipped);
+        pairing_timer.stop();
 #ifdef debug_multipath_mapper_mapping
         cerr << "obtained cluster pairs:" << endl;
         for (int i = 0; i < cluster_pairs.size(); i++) {
@@ -1566,8 +1742,7 @@ namespace vg {
         // TODO: some cluster pairs will produce redundant subgraph pairs.
         // We'll end up with redundant pairs being output.
         
-        // align to each cluster pair
-        multipath_aln_pairs_out.reserve(min(num_mappings_to_compute, cluster_pairs.size()));
+        // decide which cluster pairs to align to
         size_t num_mappings = 0;
         for (size_t i = 0; i < cluster_pairs.size(); ++i) {
             // For each cluster pair
@@ -1586,24 +1761,46 @@ namespace vg {
                 break;
             }
             
-            VG* vg1 = get<0>(cluster_graphs1[cluster_pair.first.first]);
-            VG* vg2 = get<0>(cluster_graphs2[cluster_pair.first.second]);
-            
-            memcluster_t& graph_mems1 = get<1>(cluster_graphs1[cluster_pair.first.first]);
-            memcluster_t& graph_mems2 = get<1>(cluster_graphs2[cluster_pair.first.second]);
-            
+            num_mappings++;
+        }
+        
+        // a cluster graph can be in several pairs, so we give each graph one job that does all of
+        // its alignments, which keeps concurrent jobs off of the same graph
+        multipath_aln_pairs_out.resize(num_mappings);
+        vector<vector<size_t>> pairs_of_graph1(cluster_graphs1.size()), pairs_of_graph2(cluster_graphs2.size());
+        for (size_t i = 0; i < num_mappings; i++) {
+            pairs_of_graph1[cluster_pairs[i].first.first].push_back(i);
+            pairs_of_graph2[cluster_pairs[i].first.second].push_back(i);
+        }
+        
+        vector<function<void(void)>> alignment_jobs;
+        for (size_t j = 0; j < cluster_graphs1.size(); j++) {
+            if (!pairs_of_graph1[j].empty()) {
+                alignment_jobs.emplace_back([&, j]() {
+                    for (size_t i : pairs_of_graph1[j]) {
 #ifdef debug_multipath_mapper_mapping
-            cerr << "doing pair " << cluster_pair.first.first << " " << cluster_pair.first.second << endl;
-            cerr << "performing alignments to subgraphs " << pb2json(vg1->graph) << " and " << pb2json(vg2->graph) << endl;
+                        cerr << "performing alignment of read 1 to subgraph " << pb2json(get<0>(cluster_graphs1[j])->graph) << " for pair " << i << endl;
 #endif
-            
-            // Do the two alignments
-            multipath_aln_pairs_out.emplace_back();
-            multipath_align(alignment1, vg1, graph_mems1, multipath_aln_pairs_out.back().first);
-            multipath_align(alignment2, vg2, graph_mems2, multipath_aln_pairs_out.back().second);
-            
-            num_mappings++;
+                        multipath_align(alignment1, get<0>(cluster_graphs1[j]), get<1>(cluster_graphs1[j]),
+                                        multipath_aln_pairs_out[i].first);
+                    }
+                });
+            }
+        }
+        for (size_t j = 0; j < cluster_graphs2.size(); j++) {
+            if (!pairs_of_graph2[j].empty()) {
+                alignment_jobs.emplace_back([&, j]() {
+                    for (size_t i : pairs_of_graph2[j]) {
+#ifdef debug_multipath_mapper_mapping
+                        cerr << "performing alignment of read 2 to subgraph " << pb2json(get<0>(cluster_graphs2[j])->graph) << " for pair " << i << endl;
+#endif
+                        multipath_align(alignment2, get<0>(cluster_graphs2[j]), get<1>(cluster_graphs2[j]),
+                                        multipath_aln_pairs_out[i].second);
+                    }
+                });
+            }
         }
+        run_alignment_jobs(alignment_jobs);
         
         // split up any multi-component multipath alignments
         split_multicomponent_alignments(multipath_aln_pairs_out, cluster_pairs);
@@ -1647,6 +1844,9 @@ namespace vg {
                                                const vector<MaximalExactMatch>& mems,
                                                const vector<memcluster_t>& clusters) -> vector<clustergraph_t> {
         
+        StageTimer timer(MappingStage::SubgraphExtraction);
+        timer.add_items(clusters.size());
+        
         // Figure out the aligner to use
         BaseAligner* aligner = get_aligner();
         
@@ -1699,7 +1899,7 @@ namespace vg {
             Graph& graph = cluster_graph->graph;
             
             // extract the protobuf Graph in place in the VG
-            algorithms::extract_containing_graph(xindex, graph, positions, forward_max_dist,
+            algorithms::extract_containing_graph(extraction_graph(), graph, positions, forward_max_dist,
                                                  backward_max_dist);
             
             // check if this subgraph overlaps with any previous subgraph (indicates a probable clustering failure where
@@ -1913,6 +2113,9 @@ namespace vg {
                                           memcluster_t& graph_mems,
                                           MultipathAlignment& multipath_aln_out) const {
 
+        StageTimer timer(MappingStage::ClusterAlignment);
+        timer.add_items(1);
+        
 #ifdef debug_multipath_mapper_alignment
         cerr << "constructing alignment graph" << endl;
 #endif
@@ -2046,6 +2249,9 @@ namespace vg {
         cerr << "doing DP between MEMs" << endl;
 #endif
         
+        // working space for extracting the graphs between the matches, shared by all the extractions
+        algorithms::ConnectingGraphScratch connecting_scratch;
+        
         // perform alignment in the intervening sections
         for (int64_t j = 0; j < multi_aln_graph.match_nodes.size(); j++) {
 #ifdef debug_multipath_mapper_alignment
@@ -2112,6 +2318,7 @@ namespace vg {
                                                                                                max_dist,         // longest distance necessary
                                                                                                src_pos,          // end of earlier match
                                                                                                dest_pos,         // beginning of later match
+                                                                                               connecting_scratch, // reused working space
                                                                                                false,            // do not extract the end positions in the matches
                                                                                                false,            // do not bother finding all cycles (it's a DAG)
                                                                                                true,             // remove tips
@@ -2285,7 +2492,16 @@ namespace vg {
             }
             
             // associate node ids with their index
-            unordered_map<id_t, size_t> node_idx;
+            id_map<size_t> node_idx;
+            if (graph.node_size()) {
+                id_t min_id = graph.node(0).id();
+                id_t max_id = min_id;
+                for (size_t i = 1; i < graph.node_size(); i++) {
+                    min_id = min(min_id, graph.node(i).id());
+                    max_id = max(max_id, graph.node(i).id());
+                }
+                node_idx.reserve_ids(min_id, max_id, graph.node_size());
+            }
             for (size_t i = 0; i < graph.node_size(); i++) {
                 node_idx[graph.node(i).id()] = i;
             }
@@ -2354,17 +2570,6 @@ namespace vg {
                     // want past-the-last instead of last index here
                     get_offset(end_pos)++;
                     
-                    Graph tail_graph;
-                    unordered_map<id_t, id_t> tail_trans = algorithms::extract_extending_graph(&align_graph,
-                                                                                               tail_graph,
-                                                                                               target_length,
-                                                                                               end_pos,
-                                                                                               false,         // search forward
-                                                                                               false);        // no need to preserve cycles (in a DAG)
-                    
-                    // ensure invariants that gssw-based alignment expects
-                    groom_graph_for_gssw(tail_graph);
-                    
                     // get the sequence remaining in the right tail
                     Alignment right_tail_sequence;
                     right_tail_sequence.set_sequence(alignment.sequence().substr(match_node.end - alignment.sequence().begin(),
@@ -2374,40 +2579,64 @@ namespace vg {
                                                                                    alignment.sequence().end() - match_node.end));
                     }
                     
+                    vector<Alignment> alt_alignments;
+                    unordered_map<id_t, id_t> tail_trans;
+                    Alignment ungapped_alignment;
+                    if (align_tail_ungapped(right_tail_sequence, align_graph, end_pos, false, ungapped_alignment)) {
+                        // the alignment is already in the alignment graph's node IDs
+                        for (const Mapping& mapping : ungapped_alignment.path().mapping()) {
+                            tail_trans[mapping.position().node_id()] = mapping.position().node_id();
+                        }
 #ifdef debug_multipath_mapper_alignment
-                    cerr << "aligning sequence: " << right_tail_sequence.sequence() << endl << "to right tail graph: " << pb2json(tail_graph) << endl;
+                        cerr << "aligned right tail with ungapped extension: " << pb2json(ungapped_alignment) << endl;
 #endif
+                        alt_alignments.push_back(move(ungapped_alignment));
+                    }
+                    else {
+                        Graph tail_graph;
+                        tail_trans = algorithms::extract_extending_graph(&align_graph,
+                                                                         tail_graph,
+                                                                         target_length,
+                                                                         end_pos,
+                                                                         false,         // search forward
+                                                                         false);        // no need to preserve cycles (in a DAG)
                     
-                    vector<Alignment> alt_alignments;
-                    if (tail_graph.node_size() == 0) {
-                        // edge case for when a read keeps going past the end of a graph
-                        alt_alignments.emplace_back();
-                        Alignment& tail_alignment = alt_alignments.back();
-                        tail_alignment.set_score(get_aligner()->score_gap(right_tail_sequence.sequence().size()));
-                        Mapping* insert_mapping = tail_alignment.mutable_path()->add_mapping();
+                        // ensure invariants that gssw-based alignment expects
+                        groom_graph_for_gssw(tail_graph);
+                        
+#ifdef debug_multipath_mapper_alignment
+                        cerr << "aligning sequence: " << right_tail_sequence.sequence() << endl << "to right tail graph: " << pb2json(tail_graph) << endl;
+#endif
+                        if (tail_graph.node_size() == 0) {
+                            // edge case for when a read keeps going past the end of a graph
+                            alt_alignments.emplace_back();
+                            Alignment& tail_alignment = alt_alignments.back();
+                            tail_alignment.set_score(get_aligner()->score_gap(right_tail_sequence.sequence().size()));
+                            Mapping* insert_mapping = tail_alignment.mutable_path()->add_mapping();
                         
-                        // add a soft clip
-                        Edit* edit = insert_mapping->add_edit();
-                        edit->set_to_length(right_tail_sequence.sequence().size());
-                        edit->set_sequence(right_tail_sequence.sequence());
+                            // add a soft clip
+                            Edit* edit = insert_mapping->add_edit();
+                            edit->set_to_length(right_tail_sequence.sequence().size());
+                            edit->set_sequence(right_tail_sequence.sequence());
                         
-                        // make it at the correct position
-                        const Path& anchoring_path = multi_aln_graph.match_nodes[j].path;
-                        const Mapping& anchoring_mapping = anchoring_path.mapping(anchoring_path.mapping_size() - 1);
-                        Position* anchoring_position = insert_mapping->mutable_position();
-                        anchoring_position->set_node_id(anchoring_mapping.position().node_id());
-                        anchoring_position->set_is_reverse(anchoring_mapping.position().is_reverse());
-                        anchoring_position->set_offset(anchoring_mapping.position().offset() + mapping_from_length(anchoring_mapping));
+                            // make it at the correct position
+                            const Path& anchoring_path = multi_aln_graph.match_nodes[j].path;
+                            const Mapping& anchoring_mapping = anchoring_path.mapping(anchoring_path.mapping_size() - 1);
+                            Position* anchoring_position = insert_mapping->mutable_position();
+                            anchoring_position->set_node_id(anchoring_mapping.position().node_id());
+                            anchoring_position->set_is_reverse(anchoring_mapping.position().is_reverse());
+                            anchoring_position->set_offset(anchoring_mapping.position().offset() + mapping_from_length(anchoring_mapping));
 #ifdef debug_multipath_mapper_alignment
-                        cerr << "read overhangs end of graph, manually added softclip: " << pb2json(tail_alignment) << endl;
+                            cerr << "read overhangs end of graph, manually added softclip: " << pb2json(tail_alignment) << endl;
 #endif
-                        // the ID translator is empty, so add this ID here so it doesn't give an out of index error
-                        id_t node_id = insert_mapping->position().node_id();
-                        tail_trans[node_id] = node_id;
-                    }
-                    else {
-                        // align against the graph
-                        get_aligner()->align_pinned_multi(right_tail_sequence, alt_alignments, tail_graph, true, num_alt_alns);
+                            // the ID translator is empty, so add this ID here so it doesn't give an out of index error
+                            id_t node_id = insert_mapping->position().node_id();
+                            tail_trans[node_id] = node_id;
+                        }
+                        else {
+                            // align against the graph
+                            get_aligner()->align_pinned_multi(right_tail_sequence, alt_alignments, tail_graph, true, num_alt_alns);
+                        }
                     }
                     
 #ifdef debug_multipath_mapper_alignment
@@ -2463,51 +2692,64 @@ namespace vg {
                     pos_t begin_pos = initial_position(match_node.path);
 
                     
-                    Graph tail_graph;
-                    unordered_map<id_t, id_t> tail_trans = algorithms::extract_extending_graph(&align_graph,
-                                                                                               tail_graph,
-                                                                                               target_length,
-                                                                                               begin_pos,
-                                                                                               true,          // search backward
-                                                                                               false);        // no need to preserve cycles (in a DAG)
-                    
-                    // ensure invariants that gssw-based alignment expects
-                    groom_graph_for_gssw(tail_graph);
-                    
                     Alignment left_tail_sequence;
                     left_tail_sequence.set_sequence(alignment.sequence().substr(0, match_node.begin - alignment.sequence().begin()));
                     if (!alignment.quality().empty()) {
                         left_tail_sequence.set_quality(alignment.quality().substr(0, match_node.begin - alignment.sequence().begin()));
                     }
                     
-                    
+                    vector<Alignment> alt_alignments;
+                    unordered_map<id_t, id_t> tail_trans;
+                    Alignment ungapped_alignment;
+                    if (align_tail_ungapped(left_tail_sequence, align_graph, begin_pos, true, ungapped_alignment)) {
+                        // the alignment is already in the alignment graph's node IDs
+                        for (const Mapping& mapping : ungapped_alignment.path().mapping()) {
+                            tail_trans[mapping.position().node_id()] = mapping.position().node_id();
+                        }
 #ifdef debug_multipath_mapper_alignment
-                    cerr << "aligning sequence: " << left_tail_sequence.sequence() << endl << "to left tail graph: " << pb2json(tail_graph) << endl;
+                        cerr << "aligned left tail with ungapped extension: " << pb2json(ungapped_alignment) << endl;
 #endif
-                    vector<Alignment> alt_alignments;
-                    if (tail_graph.node_size() == 0) {
-                        // edge case for when a read keeps going past the end of a graph
-                        alt_alignments.emplace_back();
-                        Alignment& tail_alignment = alt_alignments.back();
-                        tail_alignment.set_score(get_aligner()->score_gap(left_tail_sequence.sequence().size()));
-                        Mapping* insert_mapping = tail_alignment.mutable_path()->add_mapping();
+                        alt_alignments.push_back(move(ungapped_alignment));
+                    }
+                    else {
+                        Graph tail_graph;
+                        tail_trans = algorithms::extract_extending_graph(&align_graph,
+                                                                         tail_graph,
+                                                                         target_length,
+                                                                         begin_pos,
+                                                                         true,          // search backward
+                                                                         false);        // no need to preserve cycles (in a DAG)
+                    
+                        // ensure invariants that gssw-based alignment expects
+                        groom_graph_for_gssw(tail_graph);
+                        
+#ifdef debug_multipath_mapper_alignment
+                        cerr << "aligning sequence: " << left_tail_sequence.sequence() << endl << "to left tail graph: " << pb2json(tail_graph) << endl;
+#endif
+                        if (tail_graph.node_size() == 0) {
+                            // edge case for when a read keeps going past the end of a graph
+                            alt_alignments.emplace_back();
+                            Alignment& tail_alignment = alt_alignments.back();
+                            tail_alignment.set_score(get_aligner()->score_gap(left_tail_sequence.sequence().size()));
+                            Mapping* insert_mapping = tail_alignment.mutable_path()->add_mapping();
                         
-                        // add a soft clip
-                        Edit* edit = insert_mapping->add_edit();
-                        edit->set_to_length(left_tail_sequence.sequence().size());
-                        edit->set_sequence(left_tail_sequence.sequence());
+                            // add a soft clip
+                            Edit* edit = insert_mapping->add_edit();
+                            edit->set_to_length(left_tail_sequence.sequence().size());
+                            edit->set_sequence(left_tail_sequence.sequence());
                         
-                        // make it at the correct position
-                        *insert_mapping->mutable_position() = multi_aln_graph.match_nodes[j].path.mapping(0).position();
+                            // make it at the correct position
+                            *insert_mapping->mutable_position() = multi_aln_graph.match_nodes[j].path.mapping(0).position();
 #ifdef debug_multipath_mapper_alignment
-                        cerr << "read overhangs end of graph, manually added softclip: " << pb2json(tail_alignment) << endl;
+                            cerr << "read overhangs end of graph, manually added softclip: " << pb2json(tail_alignment) << endl;
 #endif
-                        // the ID translator is empty, so add this ID here so it doesn't give an out of index error
-                        id_t node_id = insert_mapping->position().node_id();
-                        tail_trans[node_id] = node_id;
-                    }
-                    else {
-                        get_aligner()->align_pinned_multi(left_tail_sequence, alt_alignments, tail_graph, false, num_alt_alns);
+                            // the ID translator is empty, so add this ID here so it doesn't give an out of index error
+                            id_t node_id = insert_mapping->position().node_id();
+                            tail_trans[node_id] = node_id;
+                        }
+                        else {
+                            get_aligner()->align_pinned_multi(left_tail_sequence, alt_alignments, tail_graph, false, num_alt_alns);
+                        }
                     }
                     
 #ifdef debug_multipath_mapper_alignment
@@ -2582,7 +2824,56 @@ namespace vg {
         }
         return total + (curr_end - curr_begin);
     }
-    
+
+    bool MultipathMapper::align_tail_ungapped(const Alignment& tail_sequence, const HandleGraph& align_graph, pos_t pos,
+                                              bool backward, Alignment& tail_aln_out) const {
+        if (!ungapped_tail_alignment) {
+            return false;
+        }
+
+#pragma omp atomic
+        TAIL_TOTAL++;
+
+        BaseAligner* aligner = get_aligner();
+        bool qual_adjusted = adjust_alignments_for_base_quality;
+        if (aligner->full_length_bonus <= 0 || (qual_adjusted && tail_sequence.quality().empty())) {
+            return false;
+        }
+
+        // a gapped alignment loses at least a gap open to a perfect match, and a soft-clipped one loses at least
+        // a match and the full length bonus, so an ungapped alignment that loses less than both to mismatches
+        // is the best there is (and an X-drop this big can't cut off any path that could tie it)
+        int32_t max_loss = min<int32_t>(aligner->gap_open, aligner->match + aligner->full_length_bonus);
+
+        algorithms::UngappedExtension extension = algorithms::xdrop_extend_ungapped(&align_graph, pos, backward,
+                                                                                   tail_sequence.sequence(),
+                                                                                   aligner->match, aligner->mismatch,
+                                                                                   aligner->full_length_bonus,
+                                                                                   max_loss);
+
+        if (!extension.complete || extension.tied || extension.length != tail_sequence.sequence().size()) {
+            return false;
+        }
+        if (extension.mismatches > 0) {
+            // base qualities change what a mismatch costs, so we can only vouch for perfect matches then
+            if (qual_adjusted || (int32_t) extension.mismatches * (aligner->match + aligner->mismatch) >= max_loss) {
+                return false;
+            }
+        }
+
+#pragma omp atomic
+        UNGAPPED_TAIL_COUNTER++;
+
+        tail_aln_out.set_sequence(tail_sequence.sequence());
+        tail_aln_out.set_quality(tail_sequence.quality());
+        *tail_aln_out.mutable_path() = move(extension.path);
+        // the pinned end doesn't get a full length bonus, so there's only one of them
+        tail_aln_out.set_score(qual_adjusted ? aligner->score_exact_match(tail_sequence.sequence(), tail_sequence.quality())
+                                               + aligner->full_length_bonus
+                                             : extension.score);
+        return true;
+    }
+
     void MultipathMapper::strip_full_length_bonuses(MultipathAlignment& mulipath_aln) const {
         
         int32_t full_length_bonus = get_aligner()->full_length_bonus;
@@ -2634,6 +2925,9 @@ namespace vg {
             return;
         }
         
+        StageTimer timer(MappingStage::MappingQuality);
+        timer.add_items(multipath_alns.size());
+        
         // query the scores of the optimal alignments
         vector<double> scores(multipath_alns.size(), 0.0);
         for (size_t i = 0; i < multipath_alns.size(); i++) {
@@ -2689,6 +2983,9 @@ namespace vg {
             return;
         }
         
+        StageTimer timer(MappingStage::MappingQuality);
+        timer.add_items(multipath_aln_pairs.size());
+        
         double log_base = get_aligner()->log_base;
         double min_frag_score = numeric_limits<double>::max();
         
@@ -4767,45 +5064,44 @@ namespace vg {
             }
         }
         
-        list<size_t> source_queue;
+        // the output doubles as the queue of sources: everything before next has been visited and
+        // everything from next to queued is waiting
+        size_t queued = 0;
         for (size_t i = 0; i < match_nodes.size(); i++) {
             if (in_degree[i] == 0) {
-                source_queue.push_back(i);
+                order_out[queued] = i;
+                queued++;
             }
         }
         
-        size_t next = 0;
-        while (!source_queue.empty()) {
-            size_t src = source_queue.front();
-            source_queue.pop_front();
-            
-            for (const pair<size_t, size_t>& edge : match_nodes[src].edges) {
+        for (size_t next = 0; next < queued; next++) {
+            for (const pair<size_t, size_t>& edge : match_nodes[order_out[next]].edges) {
                 in_degree[edge.first]--;
                 if (in_degree[edge.first] == 0) {
-                    source_queue.push_back(edge.first);
+                    order_out[queued] = edge.first;
+                    queued++;
                 }
             }
-            
-            order_out[next] = src;
-            next++;
         }
     }
     
     void MultipathAlignmentGraph::reorder_adjacency_lists(const vector<size_t>& order) {
-        vector<vector<pair<size_t, size_t>>> reverse_graph(match_nodes.size());
-        for (size_t i = 0; i < match_nodes.size(); i++) {
-            for (const pair<size_t, size_t>& edge : match_nodes[i].edges) {
-                reverse_graph[edge.first].emplace_back(i, edge.second);
-            }
+        // rank each node by its place in the order, and sort each adjacency list in place by the rank
+        // of its targets (keeping the edges to any one target in the same order)
+        vector<size_t> rank(match_nodes.size(), numeric_limits<size_t>::max());
+        for (size_t i = 0; i < order.size(); i++) {
+            rank[order[i]] = i;
         }
         for (ExactMatchNode& match_node : match_nodes) {
-            size_t out_degree = match_node.edges.size();
-            match_node.edges.clear();
-            match_node.edges.reserve(out_degree);
-        }
-        for (size_t i : order) {
-            for (const pair<size_t, size_t>& edge : reverse_graph[i]) {
-                match_nodes[edge.first].edges.emplace_back(i, edge.second);
+            vector<pair<size_t, size_t>>& edges = match_node.edges;
+            // adjacency lists are short, so an insertion sort beats anything that allocates
+            for (size_t j = 1; j < edges.size(); j++) {
+                pair<size_t, size_t> edge = edges[j];
+                size_t k = j;
+                for (; k > 0 && rank[edges[k - 1].first] > rank[edge.first]; k--) {
+                    edges[k] = edges[k - 1];
+                }
+                edges[k] = edge;
             }
         }
     }
@@ -4815,6 +5111,12 @@ namespace vg {
         // traverse a path that reveals an edge as transitive before actually traversing the transitive edge
         reorder_adjacency_lists(topological_order);
         
+        // a node has been traversed from the current node if its mark is the current node's stamp,
+        // which lets us reuse the marks and the DFS stack for every node
+        vector<size_t> traversed_stamp(match_nodes.size(), 0);
+        size_t stamp = 0;
+        vector<size_t> stack;
+        
         for (size_t i : topological_order) {
             vector<pair<size_t, size_t>>& edges = match_nodes[i].edges;
             
@@ -4824,42 +5126,33 @@ namespace vg {
                 continue;
             }
             
-            vector<bool> keep(edges.size(), true);
-            unordered_set<size_t> traversed;
+            stamp++;
             
+            // keep each edge whose target we can't already reach, compacting the list as we go
+            size_t next_idx = 0;
             for (size_t j = 0; j < edges.size(); j++) {
-                const pair<size_t, size_t>& edge = edges[j];
-                if (traversed.count(edge.first)) {
+                const pair<size_t, size_t> edge = edges[j];
+                if (traversed_stamp[edge.first] == stamp) {
                     // we can reach the target of this edge by another path, so it is transitive
-                    keep[j] = false;
                     continue;
                 }
                 
                 // DFS to mark all reachable nodes from this edge
-                vector<size_t> stack{edge.first};
-                traversed.insert(edge.first);
+                stack.push_back(edge.first);
+                traversed_stamp[edge.first] = stamp;
                 while (!stack.empty()) {
                     size_t idx = stack.back();
                     stack.pop_back();
                     for (const pair<size_t, size_t>& edge_from : match_nodes[idx].edges) {
-                        if (!traversed.count(edge_from.first)) {
+                        if (traversed_stamp[edge_from.first] != stamp) {
                             stack.push_back(edge_from.first);
-                            traversed.insert(edge_from.first);
+                            traversed_stamp[edge_from.first] = stamp;
                         }
                     }
                 }
-            }
-            
-            // remove the transitive edges we found
-            size_t next_idx = 0;
-            for (size_t j = 0; j < edges.size(); j++) {
-                if (keep[j] && j != next_idx) {
-                    edges[next_idx] = edges[j];
-                    next_idx++;
-                }
-                else if (keep[j]) {
-                    next_idx++;
-                }
+                
+                edges[next_idx] = edge;
+                next_idx++;
             }
             edges.resize(next_idx);
         }
@@ -4876,7 +5169,13 @@ namespace vg {
             return;
         }
         
-        unordered_map<pair<size_t, size_t>, int32_t> edge_weights;
+        // the edge weights are laid out in one array following the adjacency lists, so that edge j
+        // out of node i is at edge_offset[i] + j
+        vector<size_t> edge_offset(match_nodes.size() + 1, 0);
+        for (size_t i = 0; i < match_nodes.size(); i++) {
+            edge_offset[i + 1] = edge_offset[i] + match_nodes[i].edges.size();
+        }
+        vector<int32_t> edge_weights(edge_offset.back());
 
         vector<int32_t> node_weights(match_nodes.size());
     
@@ -4889,7 +5188,8 @@ namespace vg {
                               + aligner->full_length_bonus * ((from_node.begin == alignment.sequence().begin())
                                                              + (from_node.end == alignment.sequence().end()));
             
-            for (const pair<size_t, size_t>& edge : from_node.edges) {
+            for (size_t j = 0; j < from_node.edges.size(); j++) {
+                const pair<size_t, size_t>& edge = from_node.edges[j];
                 ExactMatchNode& to_node = match_nodes[edge.first];
                 
                 int64_t graph_dist = edge.second;
@@ -4899,19 +5199,19 @@ namespace vg {
                     // the read length in between the MEMs is longer than the distance, suggesting a read insert
                     // and potentially another mismatch on the other end
                     int64_t gap_length = read_dist - graph_dist;
-                    edge_weights[make_pair(i, edge.first)] = -(gap_length - 1) * aligner->gap_extension - aligner->gap_open
-                                                             - (graph_dist > 0) * aligner->mismatch;
+                    edge_weights[edge_offset[i] + j] = -(gap_length - 1) * aligner->gap_extension - aligner->gap_open
+                                                       - (graph_dist > 0) * aligner->mismatch;
                 }
                 else if (read_dist < graph_dist) {
                     // the read length in between the MEMs is shorter than the distance, suggesting a read deletion
                     // and potentially another mismatch on the other end
                     int64_t gap_length = graph_dist - read_dist;
-                    edge_weights[make_pair(i, edge.first)] = -(gap_length - 1) * aligner->gap_extension - aligner->gap_open
-                                                             - (read_dist > 0) * aligner->mismatch;
+                    edge_weights[edge_offset[i] + j] = -(gap_length - 1) * aligner->gap_extension - aligner->gap_open
+                                                       - (read_dist > 0) * aligner->mismatch;
                 }
                 else {
                     // the read length in between the MEMs is the same as the distance, suggesting a pure mismatch
-                    edge_weights[make_pair(i, edge.first)] = -((graph_dist > 0) + (graph_dist > 1)) * aligner->mismatch;
+                    edge_weights[edge_offset[i] + j] = -((graph_dist > 0) + (graph_dist > 1)) * aligner->mismatch;
                 }
             }
         }
@@ -4923,9 +5223,10 @@ namespace vg {
         for (int64_t i = 0; i < topological_order.size(); i++) {
             size_t idx = topological_order[i];
             int32_t from_score = forward_scores[idx];
-            for (const pair<size_t, size_t>& edge : match_nodes[idx].edges) {
-                forward_scores[edge.first] = std::max(forward_scores[edge.first],
-                                                      node_weights[edge.first] + from_score + edge_weights[make_pair(idx, edge.first)]);
+            const vector<pair<size_t, size_t>>& edges = match_nodes[idx].edges;
+            for (size_t j = 0; j < edges.size(); j++) {
+                forward_scores[edges[j].first] = std::max(forward_scores[edges[j].first],
+                                                          node_weights[edges[j].first] + from_score + edge_weights[edge_offset[idx] + j]);
             }
         }
         
@@ -4933,49 +5234,41 @@ namespace vg {
         for (int64_t i = topological_order.size() - 1; i >= 0; i--) {
             size_t idx = topological_order[i];
             int32_t score_here = node_weights[idx];
-            for (const pair<size_t, size_t>& edge : match_nodes[idx].edges) {
+            const vector<pair<size_t, size_t>>& edges = match_nodes[idx].edges;
+            for (size_t j = 0; j < edges.size(); j++) {
                 backward_scores[idx] = std::max(backward_scores[idx],
-                                                score_here + backward_scores[edge.first] + edge_weights[make_pair(idx, edge.first)]);
+                                                score_here + backward_scores[edges[j].first] + edge_weights[edge_offset[idx] + j]);
             }
         }
         
         // compute the minimum score we will require of a node or edge
         int32_t min_path_score = *std::max_element(forward_scores.begin(), forward_scores.end()) / max_suboptimal_score_ratio;
         
-        // use forward-backward to find nodes/edges on some path with a score above the minimum
-        unordered_set<size_t> keep_nodes;
-        unordered_set<pair<size_t, size_t>> keep_edges;
+        // use forward-backward to find nodes on some path with a score above the minimum
+        vector<bool> keep_node(match_nodes.size());
         vector<size_t> removed_in_prefix(match_nodes.size() + 1, 0);
         for (size_t i = 0; i < match_nodes.size(); i++) {
-            if (forward_scores[i] + backward_scores[i] - node_weights[i] >= min_path_score) {
-                keep_nodes.insert(i);
-                for (const pair<size_t, size_t>& edge : match_nodes[i].edges) {
-                    if (forward_scores[i] + backward_scores[edge.first] + edge_weights[make_pair(i, edge.first)] >= min_path_score) {
-                        keep_edges.emplace(i, edge.first);
-                    }
-                }
-                removed_in_prefix[i + 1] = removed_in_prefix[i];
-            }
-            else {
-                removed_in_prefix[i + 1] = removed_in_prefix[i] + 1;
-            }
+            keep_node[i] = (forward_scores[i] + backward_scores[i] - node_weights[i] >= min_path_score);
+            removed_in_prefix[i + 1] = removed_in_prefix[i] + !keep_node[i];
         }
         
-        // prune down to these nodes and edges
+        // prune down to these nodes and the edges between them that are also on such a path, in place
         size_t next = 0;
         for (size_t i = 0; i < match_nodes.size(); i++) {
-            if (keep_nodes.count(i)) {
+            if (keep_node[i]) {
                 if (i != next) {
                     match_nodes[next] = std::move(match_nodes[i]);
                 }
                 vector<pair<size_t, size_t>>& edges = match_nodes[next].edges;
+                int32_t* weights = edge_weights.data() + edge_offset[i];
                 
                 size_t new_end = edges.size();
                 for (size_t j = 0; j < new_end;) {
                     pair<size_t, size_t>& edge = edges[j];
-                    if (!keep_edges.count(make_pair(i, edge.first))) {
+                    if (forward_scores[i] + backward_scores[edge.first] + weights[j] < min_path_score) {
                         new_end--;
                         edge = edges[new_end];
+                        weights[j] = weights[new_end];
                     }
                     else {
                         edge.first -= removed_in_prefix[edge.first];
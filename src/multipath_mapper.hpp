@@ -8,7 +8,7 @@
 #define multipath_mapper_hpp
 
 #include "hash_map.hpp"
-#include "suffix_tree.hpp"
+#include "suffix_array.hpp"
 #include "mapper.hpp"
 #include "gssw_aligner.hpp"
 #include "types.hpp"
@@ -19,6 +19,7 @@
 #include "path.hpp"
 #include "edit.hpp"
 #include "snarls.hpp"
+#include "caching_handle_graph.hpp"
 
 using namespace std;
 
@@ -45,7 +46,7 @@ namespace vg {
         /// Map a paired read to the graph and make paired multipath alignments. Assumes reads are on the
         /// same strand of the DNA/RNA molecule. If the fragment length distribution is still being estimated
         /// and the pair cannot be mapped unambiguously, adds the reads to a buffer for ambiguous pairs and
-        /// does not output any multipath alignments.
+        /// does not output any multipath alignments. The buffer may be shared by all the mapping threads.
         void multipath_map_paired(const Alignment& alignment1, const Alignment& alignment2,
                                   vector<pair<MultipathAlignment, MultipathAlignment>>& multipath_aln_pairs_out,
                                   vector<pair<Alignment, Alignment>>& ambiguous_pair_buffer,
@@ -64,6 +65,15 @@ namespace vg {
         /// when mappings are likely to have occurred by chance
         void calibrate_mismapping_detection(size_t num_simulations = 1000, size_t simulated_read_length = 150);
         
+        /// Write the automatically calibrated parameters (the minimum clustering MEM length and the
+        /// mismapping detection multiplier) to a stream, labeled with a key that describes the indexes
+        /// and settings they were calibrated for
+        void save_calibration(ostream& out, const string& key) const;
+        
+        /// Read calibrated parameters written by save_calibration. Returns false, leaving the parameters
+        /// as they were, if the stream doesn't hold a calibration or holds one saved under a different key.
+        bool load_calibration(istream& in, const string& key);
+        
         // parameters
         
         int64_t max_snarl_cut_size = 5;
@@ -78,13 +88,37 @@ namespace vg {
         size_t max_p_value_memo_size = 500;
         double pseudo_length_multiplier = 1.65;
         bool unstranded_clustering = true;
+        /// Cluster MEMs with SparseChainClusterer instead of OrientedDistanceClusterer
+        bool use_sparse_chaining = false;
+        /// The most MEM hits per read that sparse chaining will use
+        size_t max_chaining_hits = 4096;
+        /// The most pairs of clusters to consider for a read pair
+        size_t max_cluster_pairs = 1024;
         size_t secondary_rescue_attempts = 4;
         double secondary_rescue_score_diff = 1.0;
         double mapq_scaling_factor = 1.0 / 4.0;
+        /// Align a read's cluster graphs as OpenMP tasks when called inside a parallel region, so that
+        /// idle threads can help finish an expensive read
+        bool parallel_cluster_alignment = false;
+        /// Try an X-drop ungapped extension on read tails before aligning them to their tail graphs
+        /// with gssw, and keep it when it must be the best pinned alignment
+        bool ungapped_tail_alignment = true;
+        /// Results of multipath_map for reads seen before, shared between the mappers of all the
+        /// threads (null to not cache)
+        DuplicateReadCache<vector<MultipathAlignment>>* duplicate_cache = nullptr;
         
         //static size_t PRUNE_COUNTER;
         //static size_t SUBGRAPH_TOTAL;
         
+        /// How many read tails were aligned by ungapped extension, out of how many tried
+        static size_t UNGAPPED_TAIL_COUNTER;
+        static size_t TAIL_TOTAL;
+        
+        /// Magic string at the start of a saved calibration
+        static const string CALIBRATION_MAGIC;
+        /// Calibration format version we write
+        static const uint32_t CALIBRATION_VERSION;
+        
         /// We often pass around clusters of MEMs and their graph positions.
         using memcluster_t = vector<pair<const MaximalExactMatch*, pos_t>>;
         
@@ -189,6 +223,14 @@ namespace vg {
                              memcluster_t& graph_mems,
                              MultipathAlignment& multipath_aln_out) const;
         
+        /// Try to align a read tail that abuts a position in the alignment graph with an X-drop ungapped
+        /// extension, searching backward from the position for a left tail. If the ungapped alignment
+        /// reaches the end of the read and no gapped, soft-clipped, or tied alignment could score as
+        /// well, store it with its pinned alignment score and return true. Otherwise return false, and
+        /// the tail needs a full pinned alignment.
+        bool align_tail_ungapped(const Alignment& tail_sequence, const HandleGraph& align_graph, pos_t pos,
+                                 bool backward, Alignment& tail_aln_out) const;
+        
         /// Remove the full length bonus from all source or sink subpaths that received it
         void strip_full_length_bonuses(MultipathAlignment& mulipath_aln) const;
         
@@ -245,6 +287,18 @@ namespace vg {
         
         // a memo for the transcendental p-value function (thread local to maintain threadsafety)
         static thread_local unordered_map<pair<size_t, size_t>, double> p_value_memo;
+        
+        /// Get this thread's cached view of the XG, which keeps the sequences and edges pulled out for
+        /// earlier subgraph extractions so that nearby reads don't decode them again
+        const HandleGraph* extraction_graph() const;
+        
+        /// Run a read's alignment jobs, as tasks if parallel_cluster_alignment is set and we are in a
+        /// parallel region with other threads to share them with, and otherwise one after another.
+        /// No two jobs may touch the same cluster graph.
+        void run_alignment_jobs(vector<function<void(void)>>& jobs) const;
+        
+        // the view behind extraction_graph() (thread local to maintain threadsafety)
+        static thread_local CachingHandleGraph extraction_cache;
     };
     
     // TODO: put in MultipathAlignmentGraph namespace
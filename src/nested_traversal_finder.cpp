@@ -17,8 +17,70 @@ NestedTraversalFinder::NestedTraversalFinder(SupportAugmentedGraph& augmented,
 
 vector<SnarlTraversal> NestedTraversalFinder::find_traversals(const Snarl& site) {
     
-    // We will populate this
-    set<SnarlTraversal> to_return;
+    const Snarl* managed_site = snarl_manager.manage(site);
+    
+    {
+        std::lock_guard<mutex> guard(traversal_cache_lock);
+        auto found = traversal_cache.find(managed_site);
+        if (found != traversal_cache.end() && found->second.complete) {
+            // We already found all of them as a child of some other site
+            return found->second.traversals;
+        }
+    }
+    
+    auto traversals_and_supports = search_traversals(site);
+    cache_traversals(managed_site, traversals_and_supports.first, traversals_and_supports.second);
+    return traversals_and_supports.first;
+}
+
+const NestedTraversalFinder::CachedTraversals& NestedTraversalFinder::cache_traversals(const Snarl* snarl,
+    const vector<SnarlTraversal>& traversals, const vector<Support>& supports) {
+    
+    // Keep the best-supported traversals, but in their original order
+    vector<size_t> order(traversals.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return total(supports[a]) > total(supports[b]);
+    });
+    
+    CachedTraversals cached;
+    if (!order.empty()) {
+        cached.best_support = supports[order.front()];
+    }
+    cached.complete = order.size() <= max_cached_traversals;
+    order.resize(min(order.size(), max_cached_traversals));
+    sort(order.begin(), order.end());
+    for (size_t i : order) {
+        cached.traversals.push_back(traversals[i]);
+        cached.supports.push_back(supports[i]);
+    }
+    
+    std::lock_guard<mutex> guard(traversal_cache_lock);
+    // If another thread searched the snarl at the same time, theirs is as good
+    return traversal_cache.emplace(snarl, std::move(cached)).first->second;
+}
+
+const NestedTraversalFinder::CachedTraversals& NestedTraversalFinder::get_cached_traversals(const Snarl* snarl) {
+    
+    {
+        std::lock_guard<mutex> guard(traversal_cache_lock);
+        auto found = traversal_cache.find(snarl);
+        if (found != traversal_cache.end()) {
+            return found->second;
+        }
+    }
+    
+    // Search without holding the lock, since this recurses into the children
+    auto traversals_and_supports = search_traversals(*snarl);
+    return cache_traversals(snarl, traversals_and_supports.first, traversals_and_supports.second);
+}
+
+pair<vector<SnarlTraversal>, vector<Support>> NestedTraversalFinder::search_traversals(const Snarl& site) {
+    
+    // We will populate this, with the support of each traversal
+    map<SnarlTraversal, Support> to_return;
     
     // We need a function to check supports and convert things to
     // SnarlTraversals
@@ -56,7 +118,7 @@ vector<SnarlTraversal> NestedTraversalFinder::find_traversals(const Snarl& site)
         }
             
         // Now emit the actual traversal
-        to_return.insert(trav);
+        to_return.emplace(trav, bubble.first);
     };
     
     // Get our contained nodes and edges
@@ -97,8 +159,13 @@ vector<SnarlTraversal> NestedTraversalFinder::find_traversals(const Snarl& site)
         emit_path(find_bubble(nullptr, nullptr, child, site));
     }
     
-    // Convert to a vector and return
-    return vector<SnarlTraversal> {to_return.begin(), to_return.end()};
+    // Convert to vectors and return
+    pair<vector<SnarlTraversal>, vector<Support>> traversals_and_supports;
+    for (auto& traversal_and_support : to_return) {
+        traversals_and_supports.first.push_back(traversal_and_support.first);
+        traversals_and_supports.second.push_back(traversal_and_support.second);
+    }
+    return traversals_and_supports;
     
 }
 
@@ -188,11 +255,9 @@ Support NestedTraversalFinder::min_support_in_path(const vector<Visit>& path) {
             return augmented.node_supports.count(node) ? augmented.node_supports.at(node) : Support();
         } else {
             // It's a snarl visit. We assume it goes in one side and out the
-            // other.
-            
-            // We don't inspect the whole snarl, but we know you have to visit
-            // the start and end nodes, so we look at them.
-            return support_min(support_for_visit(v.snarl().start()), support_for_visit(v.snarl().end()));
+            // other, along the child's best-supported traversal, which is
+            // only searched for the first time any parent visits it.
+            return get_cached_traversals(snarl_manager.manage(v.snarl())).best_support;
         }
     }; 
     
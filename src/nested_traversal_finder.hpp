@@ -4,6 +4,9 @@
 /// \file nested_traversal_finder.hpp: Defines a TraversalFinder that produces
 /// covering paths, with an awareness of nested Snarls.
 
+#include <mutex>
+#include <unordered_map>
+
 #include "traversal_finder.hpp"
 
 namespace vg {
@@ -23,6 +26,46 @@ protected:
     /// The SnarlManager managiung the snarls we use
     SnarlManager& snarl_manager;
     
+    /// The traversals found for a snarl, kept so each snarl is only searched
+    /// once however many parents visit it.
+    struct CachedTraversals {
+        /// The best-supported traversals, in the order find_traversals
+        /// returns them
+        vector<SnarlTraversal> traversals;
+        /// The support of each traversal
+        vector<Support> supports;
+        /// The support of the best-supported traversal
+        Support best_support;
+        /// True if no traversals were left out for being poorly supported
+        bool complete = false;
+    };
+    
+    /// Traversals of the snarls searched so far, by managed snarl, shared by
+    /// all the sites and threads using this finder.
+    unordered_map<const Snarl*, CachedTraversals> traversal_cache;
+    /// Guards traversal_cache. Entries are not changed once added.
+    mutex traversal_cache_lock;
+    
+    /**
+     * Search the snarl for traversals covering its nodes, edges, and
+     * children, and return them with their supports.
+     */
+    pair<vector<SnarlTraversal>, vector<Support>> search_traversals(const Snarl& site);
+    
+    /**
+     * Keep the best-supported of the given traversals of the given managed
+     * snarl in the cache, unless another thread got there first, and return
+     * the cache entry.
+     */
+    const CachedTraversals& cache_traversals(const Snarl* snarl, const vector<SnarlTraversal>& traversals,
+        const vector<Support>& supports);
+    
+    /**
+     * Get the cached traversals of the given managed snarl, searching it (and,
+     * through it, its children) first if it has not been searched yet.
+     */
+    const CachedTraversals& get_cached_traversals(const Snarl* snarl);
+    
     /**
      * Given an edge or node or child snarl in the augmented graph, look out
      * from the edge or node or child in both directions to find a shortest
@@ -43,7 +86,8 @@ protected:
         
     /**
      * Get the minimum support of all nodes and edges used in the given path
-     * that are not inside child snarls.
+     * that are not inside child snarls. A visit to a child snarl has the
+     * support of the child's best-supported traversal.
      */
     Support min_support_in_path(const vector<Visit>& path);
         
@@ -78,11 +122,16 @@ public:
     /// Should we emit verbose debugging info?
     bool verbose = false;
     
+    /// How many of each snarl's best-supported traversals should we keep
+    /// cached? Snarls with more are searched again if asked for directly.
+    size_t max_cached_traversals = 10;
+    
     virtual ~NestedTraversalFinder() = default;
     
     /**
      * Find traversals to cover the nodes, edges, and children of the snarl.
-     * Always emits the primary path traversal first, if applicable.
+     * Always emits the primary path traversal first, if applicable. Can be
+     * called from multiple threads at once.
      */
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
     
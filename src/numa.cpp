@@ -0,0 +1,171 @@
+#include "numa.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <omp.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace vg {
+
+using namespace std;
+
+#ifdef __linux__
+
+// From the kernel's mempolicy.h, which not every system has headers for
+static const int VG_MPOL_DEFAULT = 0;
+static const int VG_MPOL_INTERLEAVE = 3;
+
+/// Parse a list like "0-3,8,10-11" as /sys gives it
+static vector<int> parse_id_list(const string& list) {
+    vector<int> ids;
+    stringstream stream(list);
+    string range;
+    while (getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = stoi(range.substr(0, dash));
+        int last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        for (int id = first; id <= last; id++) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+/// Read the one line of a /sys file, or give the empty string
+static string read_sys_line(const string& path) {
+    ifstream in(path);
+    string line;
+    getline(in, line);
+    return line;
+}
+
+/// Get the NUMA nodes that have memory
+static vector<int> memory_nodes() {
+    string online = read_sys_line("/sys/devices/system/node/has_memory");
+    if (online.empty()) {
+        online = read_sys_line("/sys/devices/system/node/online");
+    }
+    return online.empty() ? vector<int>() : parse_id_list(online);
+}
+
+vector<vector<int>> numa_node_cpus() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return vector<vector<int>>();
+    }
+
+    vector<vector<int>> node_cpus;
+    vector<bool> placed(CPU_SETSIZE, false);
+    string online = read_sys_line("/sys/devices/system/node/online");
+    if (!online.empty()) {
+        for (int node : parse_id_list(online)) {
+            vector<int> cpus;
+            string cpu_list = read_sys_line("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            for (int cpu : cpu_list.empty() ? vector<int>() : parse_id_list(cpu_list)) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !placed[cpu]) {
+                    cpus.push_back(cpu);
+                    placed[cpu] = true;
+                }
+            }
+            if (!cpus.empty()) {
+                node_cpus.push_back(cpus);
+            }
+        }
+    }
+
+    // anything we couldn't place goes together at the end
+    vector<int> unplaced;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && !placed[cpu]) {
+            unplaced.push_back(cpu);
+        }
+    }
+    if (!unplaced.empty()) {
+        node_cpus.push_back(unplaced);
+    }
+    return node_cpus;
+}
+
+bool interleave_numa_allocations() {
+    vector<int> nodes = memory_nodes();
+    if (nodes.size() < 2) {
+        // nothing to spread over
+        return false;
+    }
+    const size_t word_bits = 8 * sizeof(unsigned long);
+    vector<unsigned long> node_mask(*max_element(nodes.begin(), nodes.end()) / word_bits + 1, 0);
+    for (int node : nodes) {
+        node_mask[node / word_bits] |= 1UL << (node % word_bits);
+    }
+    // the kernel wants one more than the number of bits in the mask
+    return syscall(SYS_set_mempolicy, VG_MPOL_INTERLEAVE, node_mask.data(), node_mask.size() * word_bits + 1) == 0;
+}
+
+void local_numa_allocations() {
+    syscall(SYS_set_mempolicy, VG_MPOL_DEFAULT, nullptr, 0);
+}
+
+bool pin_omp_threads() {
+    vector<vector<int>> node_cpus = numa_node_cpus();
+    // deal the CPUs out from the nodes in turn
+    vector<int> cpu_order;
+    for (size_t i = 0; !node_cpus.empty(); i++) {
+        bool any = false;
+        for (auto& cpus : node_cpus) {
+            if (i < cpus.size()) {
+                cpu_order.push_back(cpus[i]);
+                any = true;
+            }
+        }
+        if (!any) {
+            break;
+        }
+    }
+    if (cpu_order.empty()) {
+        return false;
+    }
+
+    bool pinned = true;
+#pragma omp parallel reduction(&&:pinned)
+    {
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(cpu_order[omp_get_thread_num() % cpu_order.size()], &cpu);
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu) == 0;
+    }
+    return pinned;
+}
+
+#else
+
+vector<vector<int>> numa_node_cpus() {
+    return vector<vector<int>>();
+}
+
+bool interleave_numa_allocations() {
+    return false;
+}
+
+void local_numa_allocations() {
+    // nothing to undo
+}
+
+bool pin_omp_threads() {
+    return false;
+}
+
+#endif
+
+}
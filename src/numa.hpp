@@ -0,0 +1,40 @@
+#ifndef VG_NUMA_HPP_INCLUDED
+#define VG_NUMA_HPP_INCLUDED
+
+/**
+ * \file numa.hpp: placing memory and threads on machines with more than one
+ * NUMA node, like multi-socket servers, so that the threads of every socket get
+ * the same share of the memory bandwidth. Uses the kernel directly rather than
+ * libnuma, and does nothing on systems without NUMA support.
+ */
+
+#include <cstddef>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+/// The CPUs of each NUMA node that the process may run on, with nodes that
+/// have none left out. All the CPUs are put in one node if the NUMA layout
+/// isn't known, and there are no nodes if the CPUs can't be found either.
+vector<vector<int>> numa_node_cpus();
+
+/// Spread the pages of memory allocated from now on, including file pages
+/// mapped in, across all the NUMA nodes, so that data every thread reads (the
+/// indexes) isn't all on one node. Returns false if that isn't possible.
+bool interleave_numa_allocations();
+
+/// Go back to allocating each page on the NUMA node of the thread that first
+/// touches it, which suits memory each thread keeps to itself.
+void local_numa_allocations();
+
+/// Pin each thread of the OpenMP thread pool to a CPU of its own, dealing
+/// them out across the NUMA nodes in turn, so threads don't wander away from
+/// the memory they have touched. Threads beyond the number of CPUs share them.
+/// Returns false if threads can't be pinned here.
+bool pin_omp_threads();
+
+}
+
+#endif
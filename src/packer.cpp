@@ -1,18 +1,35 @@
 #include "packer.hpp"
 
+#include <zstd.h>
+
 namespace vg {
 
+const size_t Packer::OVERFLOW_SHARDS;
+const size_t Packer::EDIT_BUFFER_SIZE;
+const size_t Packer::COVERAGE_BLOCK_SIZE;
+const size_t Packer::MERGE_BLOCK_SIZE;
+
+double CoverageSummary::mean(void) const {
+    return bases ? (double) total / bases : 0.0;
+}
+
 Packer::Packer(void) : xgidx(nullptr) { }
 
-Packer::Packer(xg::XG* xidx, size_t binsz) : xgidx(xidx), bin_size(binsz) {
-    coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+Packer::Packer(xg::XG* xidx, size_t binsz, bool shared) :
+    xgidx(xidx),
+    shared(shared),
+    coverage_shared(shared ? xidx->seq_length : 0),
+    overflow_shards(shared ? OVERFLOW_SHARDS : 0),
+    bin_size(binsz) {
     if (binsz) n_bins = xgidx->seq_length / bin_size + 1;
+    if (!shared) {
+        coverage_dynamic = gcsa::CounterArray(xgidx->seq_length, 8);
+    }
+    // all threads can record edits, so set up their buffers up front
+    ensure_edit_storage();
 }
 
-Packer::~Packer(void) {
-    close_edit_tmpfiles();
-    remove_edit_tmpfiles();
-}
+Packer::~Packer(void) { }
 
 void Packer::load_from_file(const string& file_name) {
     ifstream in(file_name);
@@ -28,6 +45,7 @@ void Packer::load(istream& in) {
     sdsl::read_member(bin_size, in);
     sdsl::read_member(n_bins, in);
     coverage_civ.load(in);
+    build_coverage_summaries();
     edit_csas.resize(n_bins);
     for (size_t i = 0; i < n_bins; ++i) {
         edit_csas[i].load(in);
@@ -41,24 +59,64 @@ void Packer::merge_from_files(const vector<string>& file_names) {
     cerr << "Merging " << file_names.size() << " pack files" << endl;
 #endif
     
-    // load into our dynamic structures, then compact
-    bool first = true;
-    for (auto& file_name : file_names) {
-        Packer c;
-        ifstream f(file_name);
-        c.load(f);
-        // take bin size and counts from the first, assume they are all the same
-        if (first) {
-            bin_size = c.get_bin_size();
-            n_bins = c.get_n_bins();
-            ensure_edit_tmpfiles_open();
-            first = false;
-        } else {
-            assert(bin_size == c.get_bin_size());
-            assert(n_bins == c.get_n_bins());
+    if (file_names.empty()) {
+        return;
+    }
+    assert(!is_compacted);
+    // take bin size and counts from the first, and check the rest against it
+    {
+        ifstream f(file_names.front());
+        sdsl::read_member(bin_size, f);
+        sdsl::read_member(n_bins, f);
+    }
+    // nothing has been recorded yet, so set the edit storage up for those bins
+    edit_runs.clear();
+    ensure_edit_storage();
+
+    size_t basis_length = graph_length();
+    if (coverage_merged.size() != basis_length) {
+        util::assign(coverage_merged, int_vector<64>(basis_length, 0));
+    }
+    // only a pack per thread is in memory at once
+    size_t batch_size = get_thread_count();
+    for (size_t batch_start = 0; batch_start < file_names.size(); batch_start += batch_size) {
+        vector<Packer> batch(min(batch_size, file_names.size() - batch_start));
+        // load the packs, taking over their edits as compressed runs; the
+        // edit CSAs are only built once, for the sum, on compaction
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t j = 0; j < batch.size(); ++j) {
+            const string& file_name = file_names[batch_start + j];
+            Packer& c = batch[j];
+            ifstream f(file_name);
+            c.load(f);
+            if (c.get_bin_size() != bin_size || c.get_n_bins() != n_bins || c.graph_length() != basis_length) {
+#pragma omp critical (cerr)
+                cerr << "error:[vg::Packer] " << file_name << " does not have the same graph and bins as "
+                     << file_names.front() << endl;
+                exit(1);
+            }
+            for (size_t i = 0; i < n_bins; ++i) {
+                stringstream edits;
+                c.write_edits(edits, i);
+                append_edit_run(i, edits.str());
+            }
+        }
+        // then sum their coverage, a block of positions per thread
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t start = 0; start < basis_length; start += MERGE_BLOCK_SIZE) {
+            size_t length = min(MERGE_BLOCK_SIZE, basis_length - start);
+            uint64_t* sums = coverage_merged.data() + start;
+            vector<uint64_t> decoded(length);
+            for (auto& c : batch) {
+                for (size_t i = 0; i < length; ++i) {
+                    decoded[i] = c.coverage_civ[start + i];
+                }
+                // contiguous and branch free, so this vectorizes
+                for (size_t i = 0; i < length; ++i) {
+                    sums[i] += decoded[i];
+                }
+            }
         }
-        c.write_edits(tmpfstreams);
-        collect_coverage(c);
     }
 }
 
@@ -67,18 +125,21 @@ void Packer::merge_from_dynamic(vector<Packer*>& packers) {
     bool first = true;
     for (auto& p : packers) {
         auto& c = *p;
-        c.close_edit_tmpfiles(); // flush and close temporaries
+        c.flush_edit_buffers(); // compress everything they have buffered
         // take bin size and counts from the first, assume they are all the same
         if (first) {
             bin_size = c.get_bin_size();
             n_bins = c.get_n_bins();
-            ensure_edit_tmpfiles_open();
+            ensure_edit_storage();
             first = false;
         } else {
             assert(bin_size == c.get_bin_size());
             assert(n_bins == c.get_n_bins());
         }
-        c.write_edits(tmpfstreams);
+        // the runs can be taken over still compressed
+        for (size_t i = 0; i < c.edit_runs.size(); ++i) {
+            edit_runs[i].insert(edit_runs[i].end(), c.edit_runs[i].begin(), c.edit_runs[i].end());
+        }
         collect_coverage(c);
     }
 }
@@ -99,21 +160,12 @@ size_t Packer::bin_for_position(size_t i) const {
     }
 }
 
-void Packer::write_edits(vector<ofstream*>& out) const {
-    for (size_t i = 0; i < n_bins; ++i) {
-        write_edits(*out[i], i);
-    }
-}
-
 void Packer::write_edits(ostream& out, size_t bin) const {
     if (is_compacted) {
         out << extract(edit_csas[bin], 0, edit_csas[bin].size()-2) << delim1; // chomp trailing null, add back delim        
-    } else {
-        // uncompacted, so just cat the edit file for this bin onto out
-        if (edit_tmpfile_names.size()) {
-            ifstream edits(edit_tmpfile_names[bin], std::ios_base::binary);
-            out << edits.rdbuf() << delim1;
-        }
+    } else if (bin < edit_runs.size()) {
+        // uncompacted, so decompress the runs for this bin onto out
+        out << bin_edits(bin) << delim1;
     }
 }
 
@@ -121,10 +173,106 @@ void Packer::collect_coverage(const Packer& c) {
     // assume the same basis vector
     assert(!is_compacted);
     for (size_t i = 0; i < c.graph_length(); ++i) {
-        coverage_dynamic.increment(i, c.coverage_at_position(i));
+        increment_coverage(i, c.coverage_at_position(i));
     }
 }
 
+void Packer::increment_coverage(size_t i, size_t count) {
+    if (!shared) {
+        coverage_dynamic.increment(i, count);
+        return;
+    }
+    auto& counter = coverage_shared[i];
+    uint8_t have = counter.load(std::memory_order_relaxed);
+    while (have + count <= numeric_limits<uint8_t>::max()) {
+        if (counter.compare_exchange_weak(have, (uint8_t) (have + count), std::memory_order_relaxed)) {
+            return;
+        }
+    }
+    // the small counter would saturate, so carry into the overflow
+    auto& shard = overflow_shards[i % OVERFLOW_SHARDS];
+    std::lock_guard<mutex> guard(shard.lock);
+    shard.counts[i] += count;
+}
+
+void Packer::record_edit(size_t i, const Edit& edit, bool revcomp) {
+    size_t bin = bin_for_position(i);
+    // each thread has its own buffers, so there's nothing to synchronize here
+    EditBuffer& buffer = edit_buffers[shared ? omp_get_thread_num() : 0][bin];
+    buffer.starts.emplace_back(i, buffer.records.size());
+    buffer.records.append(pos_key(i));
+    buffer.records.append(edit_value(edit, revcomp));
+    if (buffer.records.size() >= EDIT_BUFFER_SIZE) {
+        flush_edit_buffer(buffer, bin);
+    }
+}
+
+void Packer::flush_edit_buffer(EditBuffer& buffer, size_t bin) {
+    if (buffer.starts.empty()) {
+        return;
+    }
+    // sort the records by position, so like records compress together
+    buffer.starts.emplace_back(numeric_limits<size_t>::max(), buffer.records.size());
+    vector<size_t> order(buffer.starts.size() - 1);
+    for (size_t j = 0; j < order.size(); ++j) {
+        order[j] = j;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buffer.starts[a].first < buffer.starts[b].first;
+    });
+    string sorted;
+    sorted.reserve(buffer.records.size());
+    for (auto j : order) {
+        sorted.append(buffer.records, buffer.starts[j].second, buffer.starts[j + 1].second - buffer.starts[j].second);
+    }
+    buffer.records.clear();
+    buffer.starts.clear();
+    append_edit_run(bin, sorted);
+}
+
+void Packer::flush_edit_buffers(void) {
+    for (auto& thread_buffers : edit_buffers) {
+        for (size_t i = 0; i < thread_buffers.size(); ++i) {
+            flush_edit_buffer(thread_buffers[i], i);
+        }
+    }
+}
+
+void Packer::append_edit_run(size_t bin, const string& records) {
+    if (records.empty()) {
+        return;
+    }
+    // compress outside the lock, so only the append is serialized
+    string run(ZSTD_compressBound(records.size()), '\0');
+    size_t compressed = ZSTD_compress(&run[0], run.size(), records.data(), records.size(), 1);
+    if (ZSTD_isError(compressed)) {
+        cerr << "error:[vg::Packer] could not compress edits: " << ZSTD_getErrorName(compressed) << endl;
+        exit(1);
+    }
+    run.resize(compressed);
+    std::lock_guard<mutex> guard(edit_bin_locks[bin]);
+    edit_runs[bin].push_back(std::move(run));
+}
+
+string Packer::bin_edits(size_t bin) const {
+    string edits;
+    for (auto& run : edit_runs[bin]) {
+        unsigned long long size = ZSTD_getFrameContentSize(run.data(), run.size());
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+            cerr << "error:[vg::Packer] corrupt compressed edits" << endl;
+            exit(1);
+        }
+        size_t start = edits.size();
+        edits.resize(start + size);
+        size_t decompressed = ZSTD_decompress(&edits[start], size, run.data(), run.size());
+        if (ZSTD_isError(decompressed) || decompressed != size) {
+            cerr << "error:[vg::Packer] could not decompress edits" << endl;
+            exit(1);
+        }
+    }
+    return edits;
+}
+
 size_t Packer::serialize(std::ostream& out,
                           sdsl::structure_tree_node* s,
                           std::string name) {
@@ -153,24 +301,36 @@ void Packer::make_compact(void) {
         cerr << "Need to make packer compact" << endl;
 #endif
     }
-    // sync edit file
-    close_edit_tmpfiles();
+    // compress whatever the threads still have buffered
+    flush_edit_buffers();
     // temporaries for construction
-    size_t basis_length = coverage_dynamic.size();
+    size_t basis_length = graph_length();
     int_vector<> coverage_iv;
     util::assign(coverage_iv, int_vector<>(basis_length));
-    for (size_t i = 0; i < coverage_dynamic.size(); ++i) {
-        coverage_iv[i] = coverage_dynamic[i];
+    for (size_t i = 0; i < basis_length; ++i) {
+        coverage_iv[i] = coverage_at_position(i);
     }
-    edit_csas.resize(edit_tmpfile_names.size());
+    if (shared) {
+        // free the shared counts
+        vector<atomic<uint8_t>>().swap(coverage_shared);
+        for (auto& shard : overflow_shards) {
+            shard.counts.clear();
+        }
+    }
+    util::clear(coverage_merged);
+    edit_csas.resize(edit_runs.size());
     util::assign(coverage_civ, coverage_iv);
+    build_coverage_summaries();
     construct_config::byte_algo_sa = SE_SAIS;
-#pragma omp parallel for
-    for (size_t i = 0; i < edit_tmpfile_names.size(); ++i) {
-        construct(edit_csas[i], edit_tmpfile_names[i], 1);
+    // each bin is built in memory from its runs, independently of the others
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < edit_runs.size(); ++i) {
+        string edits = bin_edits(i);
+        edits.push_back(delim1); // pad
+        vector<string>().swap(edit_runs[i]);
+        construct_im(edit_csas[i], edits, 1);
     }
-    // construct the record marker bitvector
-    remove_edit_tmpfiles();
+    edit_runs.clear();
     is_compacted = true;
 }
 
@@ -185,46 +345,22 @@ bool Packer::is_dynamic(void) {
     return !is_compacted;
 }
 
-void Packer::ensure_edit_tmpfiles_open(void) {
-    if (tmpfstreams.empty()) {
-        string base = ".vg-pack_";
-        string edit_tmpfile_name = tmpfilename(base);
-        std::remove(edit_tmpfile_name.c_str()); // remove this; we'll use it as a base name
-        // for as many bins as we have, make a temp file
-        tmpfstreams.resize(n_bins);
-        edit_tmpfile_names.resize(n_bins);
-        for (size_t i = 0; i < n_bins; ++i) {
-            edit_tmpfile_names[i] = edit_tmpfile_name+"_"+convert(i);
-            tmpfstreams[i] = new ofstream;
-            tmpfstreams[i]->open(edit_tmpfile_names[i], std::ios_base::binary);
-            assert(tmpfstreams[i]->is_open());
-        }
-    }
+bool Packer::is_shared(void) const {
+    return shared;
 }
 
-void Packer::close_edit_tmpfiles(void) {
-    if (!tmpfstreams.empty()) {
-        for (auto& tmpfstream : tmpfstreams) {
-            *tmpfstream << delim1; // pad
-            tmpfstream->close();
-            delete tmpfstream;
+void Packer::ensure_edit_storage(void) {
+    if (edit_runs.empty()) {
+        edit_runs.resize(n_bins);
+        edit_bin_locks = vector<mutex>(n_bins);
+        edit_buffers.resize(shared ? get_thread_count() : 1);
+        for (auto& thread_buffers : edit_buffers) {
+            thread_buffers.resize(n_bins);
         }
-        tmpfstreams.clear();
-    }
-}
-
-void Packer::remove_edit_tmpfiles(void) {
-    if (!edit_tmpfile_names.empty()) {
-        for (auto& name : edit_tmpfile_names) {
-            std::remove(name.c_str());
-        }
-        edit_tmpfile_names.clear();
     }
 }
 
 void Packer::add(const Alignment& aln, bool record_edits) {
-    // open tmpfile if needed
-    ensure_edit_tmpfiles_open();
     // count the nodes, edges, and edits
     for (auto& mapping : aln.path().mapping()) {
         if (!mapping.has_position()) {
@@ -241,19 +377,16 @@ void Packer::add(const Alignment& aln, bool record_edits) {
 #endif
                 if (mapping.position().is_reverse()) {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i-j);
+                        increment_coverage(i-j);
                     }
                 } else {
                     for (size_t j = 0; j < edit.from_length(); ++j) {
-                        coverage_dynamic.increment(i+j);
+                        increment_coverage(i+j);
                     }
                 }
             } else if (record_edits) {
                 // we represent things on the forward strand
-                string pos_repr = pos_key(i);
-                string edit_repr = edit_value(edit, mapping.position().is_reverse());
-                size_t bin = bin_for_position(i);
-                *tmpfstreams[bin] << pos_repr << edit_repr;
+                record_edit(i, edit, mapping.position().is_reverse());
             }
             if (mapping.position().is_reverse()) {
                 i -= edit.from_length();
@@ -281,9 +414,9 @@ string Packer::pos_key(size_t i) const {
     pos.set_node_id(i+offset);
     string pos_repr;
     pos.SerializeToString(&pos_repr);
-    stringstream s;
-    s << delim1 << delim2 << delim1 << escape_delims(pos_repr);
-    return s.str();
+    string key{delim1, delim2, delim1};
+    key.append(escape_delims(pos_repr));
+    return key;
 }
 
 string Packer::edit_value(const Edit& edit, bool revcomp) const {
@@ -293,9 +426,9 @@ string Packer::edit_value(const Edit& edit, bool revcomp) const {
     } else {
         edit.SerializeToString(&edit_repr);
     }
-    stringstream s;
-    s << delim1 << escape_delims(edit_repr);
-    return s.str();
+    string value(1, delim1);
+    value.append(escape_delims(edit_repr));
+    return value;
 }
 
 string Packer::escape_delims(const string& s) const {
@@ -334,6 +467,8 @@ string Packer::unescape_delim(const string& s, char d) const {
 size_t Packer::graph_length(void) const {
     if (is_compacted) {
         return coverage_civ.size();
+    } else if (shared) {
+        return coverage_shared.size();
     } else {
         return coverage_dynamic.size();
     }
@@ -342,9 +477,120 @@ size_t Packer::graph_length(void) const {
 size_t Packer::coverage_at_position(size_t i) const {
     if (is_compacted) {
         return coverage_civ[i];
+    }
+    size_t merged = coverage_merged.empty() ? 0 : coverage_merged[i];
+    if (shared) {
+        size_t count = merged + coverage_shared[i].load(std::memory_order_relaxed);
+        auto& shard = overflow_shards[i % OVERFLOW_SHARDS];
+        std::lock_guard<mutex> guard(shard.lock);
+        auto found = shard.counts.find(i);
+        if (found != shard.counts.end()) {
+            count += found->second;
+        }
+        return count;
     } else {
-        return coverage_dynamic[i];
+        return merged + coverage_dynamic[i];
+    }
+}
+
+void Packer::build_coverage_summaries(void) {
+    size_t n_blocks = coverage_civ.size() / COVERAGE_BLOCK_SIZE + 1;
+    util::assign(block_coverage_sums, int_vector<>(n_blocks + 1, 0, 64));
+    int_vector<> block_max(n_blocks, 0, 64);
+    size_t sum = 0;
+    for (size_t i = 0; i < coverage_civ.size(); ++i) {
+        if (i % COVERAGE_BLOCK_SIZE == 0) {
+            block_coverage_sums[i / COVERAGE_BLOCK_SIZE] = sum;
+        }
+        size_t coverage = coverage_civ[i];
+        sum += coverage;
+        size_t block = i / COVERAGE_BLOCK_SIZE;
+        if (coverage > block_max[block]) block_max[block] = coverage;
+    }
+    for (size_t j = coverage_civ.size() / COVERAGE_BLOCK_SIZE + (coverage_civ.size() % COVERAGE_BLOCK_SIZE != 0);
+         j <= n_blocks; ++j) {
+        block_coverage_sums[j] = sum;
+    }
+    util::bit_compress(block_coverage_sums);
+    // sparse table of maxima over power-of-two runs of blocks
+    block_coverage_max.clear();
+    block_coverage_max.push_back(block_max);
+    for (size_t width = 1; width * 2 <= n_blocks; width *= 2) {
+        const int_vector<>& prev = block_coverage_max.back();
+        int_vector<> next(n_blocks - width * 2 + 1, 0, 64);
+        for (size_t j = 0; j < next.size(); ++j) {
+            next[j] = max<uint64_t>(prev[j], prev[j + width]);
+        }
+        block_coverage_max.push_back(next);
+    }
+    for (auto& level : block_coverage_max) {
+        util::bit_compress(level);
+    }
+}
+
+CoverageSummary Packer::coverage_in_range(size_t start, size_t end) const {
+    assert(is_compacted);
+    CoverageSummary summary;
+    end = min(end, coverage_civ.size());
+    if (start >= end) {
+        return summary;
+    }
+    summary.bases = end - start;
+    // whole blocks inside the range
+    size_t first_block = (start + COVERAGE_BLOCK_SIZE - 1) / COVERAGE_BLOCK_SIZE;
+    size_t past_block = end / COVERAGE_BLOCK_SIZE;
+    if (first_block >= past_block) {
+        // no whole blocks, so just look at every base
+        for (size_t i = start; i < end; ++i) {
+            size_t coverage = coverage_civ[i];
+            summary.total += coverage;
+            summary.max = max(summary.max, coverage);
+        }
+        return summary;
+    }
+    summary.total = block_coverage_sums[past_block] - block_coverage_sums[first_block];
+    size_t level = 0;
+    while (((size_t) 2 << level) <= past_block - first_block) ++level;
+    summary.max = max<size_t>(block_coverage_max[level][first_block],
+                              block_coverage_max[level][past_block - ((size_t) 1 << level)]);
+    // and the partial blocks at either end
+    for (size_t i = start; i < first_block * COVERAGE_BLOCK_SIZE; ++i) {
+        size_t coverage = coverage_civ[i];
+        summary.total += coverage;
+        summary.max = max(summary.max, coverage);
+    }
+    for (size_t i = past_block * COVERAGE_BLOCK_SIZE; i < end; ++i) {
+        size_t coverage = coverage_civ[i];
+        summary.total += coverage;
+        summary.max = max(summary.max, coverage);
+    }
+    return summary;
+}
+
+CoverageSummary Packer::node_coverage(id_t node_id) const {
+    size_t start = xg_node_start(node_id, xgidx);
+    return coverage_in_range(start, start + xg_node_length(node_id, xgidx));
+}
+
+CoverageSummary Packer::path_window_coverage(const string& path_name, size_t start, size_t end) const {
+    CoverageSummary summary;
+    end = min(end, xgidx->path_length(path_name));
+    size_t pos = start;
+    while (pos < end) {
+        // find the part of the next node visit that is in the window
+        pos_t graph_pos = xgidx->graph_pos_at_path_position(path_name, pos);
+        size_t node_length = xg_node_length(id(graph_pos), xgidx);
+        size_t visited = min(node_length - offset(graph_pos), end - pos);
+        // and where it is in the basis, which runs along the forward strand
+        size_t node_start = xg_node_start(id(graph_pos), xgidx);
+        size_t forward_offset = is_rev(graph_pos) ? node_length - offset(graph_pos) - visited : offset(graph_pos);
+        CoverageSummary visit = coverage_in_range(node_start + forward_offset, node_start + forward_offset + visited);
+        summary.bases += visit.bases;
+        summary.total += visit.total;
+        summary.max = max(summary.max, visit.max);
+        pos += visited;
     }
+    return summary;
 }
 
 vector<Edit> Packer::edits_at_position(size_t i) const {
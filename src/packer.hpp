@@ -3,6 +3,10 @@
 
 #include <iostream>
 #include <map>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
 #include <chrono>
 #include <ctime>
 #include "omp.h"
@@ -20,12 +24,32 @@ namespace vg {
 
 using namespace sdsl;
 
+/// Coverage over a set of bases
+struct CoverageSummary {
+    /// How many bases were looked at
+    size_t bases = 0;
+    /// The coverage summed over them
+    size_t total = 0;
+    /// The highest coverage of any of them
+    size_t max = 0;
+    /// The mean coverage per base, or 0 for no bases
+    double mean(void) const;
+};
+
 class Packer {
 public:
     Packer(void);
-    Packer(xg::XG* xidx, size_t bin_size);
+    /// Make a packer over the sequence of the given XG index, with edits kept
+    /// in bins of bin_size bases (0 for one bin). A shared packer can have
+    /// add() called on it from all OpenMP threads at once, keeping one
+    /// coverage array for all of them instead of one packer per thread.
+    Packer(xg::XG* xidx, size_t bin_size, bool shared = false);
     ~Packer(void);
     xg::XG* xgidx;
+    /// Add the coverage and edits of the given compact pack files, loading a
+    /// pack per thread at a time and summing their coverage straight into one
+    /// array, rather than counting it up in the dynamic structures. The
+    /// packer stays dynamic, so alignments can be added on top.
     void merge_from_files(const vector<string>& file_names);
     void merge_from_dynamic(vector<Packer*>& packers);
     void load_from_file(const string& file_name);
@@ -43,23 +67,65 @@ public:
     string edit_value(const Edit& edit, bool revcomp) const;
     vector<Edit> edits_at_position(size_t i) const;
     size_t coverage_at_position(size_t i) const;
+    /// Summarize coverage over the basis positions in [start, end). Needs the
+    /// packer to be compact; takes constant time plus at most two blocks of
+    /// direct lookups.
+    CoverageSummary coverage_in_range(size_t start, size_t end) const;
+    /// Summarize coverage over a whole node. Needs the packer to be compact.
+    CoverageSummary node_coverage(id_t node_id) const;
+    /// Summarize coverage over the bases at offsets [start, end) along a path,
+    /// counting bases the path visits more than once each time. Needs the
+    /// packer to be compact.
+    CoverageSummary path_window_coverage(const string& path_name, size_t start, size_t end) const;
     void collect_coverage(const Packer& c);
     ostream& as_table(ostream& out, bool show_edits = true);
     ostream& show_structure(ostream& out); // debugging
-    void write_edits(vector<ofstream*>& out) const; // for merge
     void write_edits(ostream& out, size_t bin) const; // for merge
     size_t get_bin_size(void) const;
     size_t get_n_bins(void) const;
     bool is_dynamic(void);
+    bool is_shared(void) const;
 private:
-    void ensure_edit_tmpfiles_open(void);
-    void close_edit_tmpfiles(void);
-    void remove_edit_tmpfiles(void);
+    void ensure_edit_storage(void);
     bool is_compacted = false;
     // dynamic model
     gcsa::CounterArray coverage_dynamic;
-    vector<string> edit_tmpfile_names;
-    vector<ofstream*> tmpfstreams;
+    // shared dynamic model, used instead of coverage_dynamic when shared
+    bool shared = false;
+    // saturating 8-bit counts, which carry into the overflow shards
+    vector<atomic<uint8_t>> coverage_shared;
+    struct OverflowShard {
+        mutable mutex lock;
+        unordered_map<size_t, size_t> counts;
+    };
+    static const size_t OVERFLOW_SHARDS = 64;
+    vector<OverflowShard> overflow_shards;
+    // coverage merged in from pack files, which the dynamic counts are on top of
+    int_vector<64> coverage_merged;
+    // how many positions of coverage each thread sums at a time when merging
+    static const size_t MERGE_BLOCK_SIZE = 64 * 1024;
+    // edit records for a bin that one thread has not yet compressed, with the
+    // basis position and start of each record so they can be sorted
+    struct EditBuffer {
+        string records;
+        vector<pair<size_t, size_t>> starts;
+    };
+    // per-thread, per-bin buffers, compressed into a run for the bin when
+    // they fill up
+    static const size_t EDIT_BUFFER_SIZE = 1024 * 1024;
+    vector<vector<EditBuffer>> edit_buffers;
+    // zstd-compressed runs of edit records sorted by position, per bin
+    vector<vector<string>> edit_runs;
+    vector<mutex> edit_bin_locks;
+    void increment_coverage(size_t i, size_t count = 1);
+    void record_edit(size_t i, const Edit& edit, bool revcomp);
+    // compress a thread's buffered edits for a bin into a run
+    void flush_edit_buffer(EditBuffer& buffer, size_t bin);
+    void flush_edit_buffers(void);
+    // add already-serialized records to a bin as a run
+    void append_edit_run(size_t bin, const string& records);
+    // get all the edit records of a bin, uncompressed
+    string bin_edits(size_t bin) const;
     // which bin should we use
     size_t bin_for_position(size_t i) const;
     size_t n_bins = 1;
@@ -67,6 +133,11 @@ private:
     size_t edit_length = 0;
     size_t edit_count = 0;
     dac_vector<> coverage_civ; // graph coverage (compacted coverage_dynamic)
+    // summaries of coverage_civ for range queries, rebuilt on compaction or load
+    static const size_t COVERAGE_BLOCK_SIZE = 256;
+    int_vector<> block_coverage_sums; // coverage before the start of each block
+    vector<int_vector<>> block_coverage_max; // [k][j] is the max over 2^k blocks from j
+    void build_coverage_summaries(void);
     //
     vector<csa_sada<enc_vector<>, 32, 32, sa_order_sa_sampling<>, isa_sampling<>, succinct_byte_alphabet<> > > edit_csas;
     // make separators that are somewhat unusual, as we escape these
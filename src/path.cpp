@@ -241,8 +241,7 @@ void Paths::append_mapping(const string& name, const Mapping& m) {
         ms[name].insert(mp);
         // and record its position in this list
         list<Mapping>::iterator mi = pt.end(); --mi;
-        mapping_itr[mp] = mi;
-        mapping_path[mp] = name;
+        index_place(mi, name);
         if(mp->rank()) {
             // Only if we actually end up with a rank (i.e. all the existing
             // ranks weren't cleared) do we really index by rank.
@@ -284,8 +283,7 @@ void Paths::prepend_mapping(const string& name, const Mapping& m) {
         ms[name].insert(mp);
         // and record its position in this list
         list<Mapping>::iterator mi = pt.begin();
-        mapping_itr[mp] = mi;
-        mapping_path[mp] = name;
+        index_place(mi, name);
         mappings_by_rank[name][mp->rank()] = mp;
     }
 }
@@ -327,36 +325,57 @@ pair<Mapping*, Mapping*> Paths::divide_mapping(Mapping* m, size_t offset) {
 }
 
 pair<Mapping*, Mapping*> Paths::replace_mapping(Mapping* m, pair<Mapping, Mapping> n) {
-    // then we remove it from the node it's pointing to
-    // and replace it with the other two mappings
     // we'll give them the same rank, but record them in the right order
     // this leaves an invalid graph
     // there are a few ways to fix this--- they involve changing the way we record ranks
     // but for now it's going to be simplest if the calling context manages this
-    auto& path_name = mapping_path_name(m);
     n.first.set_rank(m->rank());
     n.second.set_rank(m->rank());
-    // remove the mapping, getting an iterator pointing to the element that was after it
     if (!m->position().is_reverse()) {
-        auto i = remove_mapping(m);
-        // the insertion will happen in reverse order
-        // because insert puts the position before the iterator it's given
-        // so we first insert the second element
-        auto j = insert_mapping(i, path_name, n.second);
-        // and then the first
-        auto k = insert_mapping(j, path_name, n.first);
-        // and we return them in proper order
-        return make_pair(&*j, &*k);
+        auto parts = replace_mapping(m, vector<Mapping>{n.first, n.second});
+        return make_pair(parts[1], parts[0]);
     } else {
         // things get flipped around for reversed mappings
-        auto i = remove_mapping(m);
-        auto j = insert_mapping(i, path_name, n.first);
-        auto k = insert_mapping(j, path_name, n.second);
-        // and we return them in proper order
-        return make_pair(&*k, &*j);
+        auto parts = replace_mapping(m, vector<Mapping>{n.second, n.first});
+        return make_pair(parts[0], parts[1]);
     }
 }
 
+vector<Mapping*> Paths::replace_mapping(Mapping* m, const vector<Mapping>& parts) {
+    assert(!parts.empty());
+    auto place = mapping_place.find(m);
+    assert(place != mapping_place.end());
+    const string& path_name = *place->second.path_name;
+    list<Mapping>::iterator i = place->second.itr;
+    
+    // Reuse the old mapping's storage for the first part, so its place in the
+    // path stays where it is
+    unindex_node_mapping(m->position().node_id(), path_name, m);
+    if (m->rank() != parts.front().rank()) {
+        auto ranks = mappings_by_rank.find(path_name);
+        if (ranks != mappings_by_rank.end()) {
+            auto r = ranks->second.find(m->rank());
+            if (r != ranks->second.end() && r->second == m) {
+                ranks->second.erase(r);
+            }
+        }
+    }
+    *m = parts.front();
+    node_mapping[m->position().node_id()][path_name].insert(m);
+    
+    // and splice the rest in after it
+    vector<Mapping*> replaced{m};
+    replaced.reserve(parts.size());
+    list<Mapping>& path = _paths.at(path_name);
+    for (size_t j = 1; j < parts.size(); j++) {
+        i = path.insert(std::next(i), parts[j]);
+        node_mapping[i->position().node_id()][path_name].insert(&*i);
+        mapping_place[&*i] = MappingPlace{i, &path_name};
+        replaced.push_back(&*i);
+    }
+    return replaced;
+}
+
 bool Paths::has_path(const string& name) {
     return _paths.find(name) != _paths.end();
 }
@@ -373,10 +392,16 @@ void Paths::increment_node_ids(id_t inc) {
 }
 
 void Paths::swap_node_ids(hash_map<id_t, id_t>& id_mapping) {
+    // The paths are independent, and we only read the ID mapping, so do them
+    // in parallel
+    vector<list<Mapping>*> all_paths;
+    all_paths.reserve(_paths.size());
     for (auto& p : _paths) {
-        const string& name = p.first;
-        list<Mapping>& path = p.second;
-        for (auto& m : path) {
+        all_paths.push_back(&p.second);
+    }
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < all_paths.size(); i++) {
+        for (auto& m : *all_paths[i]) {
             // Look up the replacement ID
             auto replacement = id_mapping.find(m.position().node_id());
             if(replacement != id_mapping.end()) {
@@ -390,7 +415,7 @@ void Paths::swap_node_ids(hash_map<id_t, id_t>& id_mapping) {
 
 void Paths::reassign_node(id_t new_id, Mapping* m) {
     // erase the old node id
-    node_mapping[m->position().node_id()][mapping_path_name(m)].erase(m);
+    unindex_node_mapping(m->position().node_id(), mapping_path_name(m), m);
     // set the new node id
     m->mutable_position()->set_node_id(new_id);
     // and record it in the new node record
@@ -400,15 +425,40 @@ void Paths::reassign_node(id_t new_id, Mapping* m) {
 void Paths::rebuild_node_mapping(void) {
     // starts with paths and rebuilds the index
     node_mapping.clear();
+    mapping_place.clear();
     for (auto& p : _paths) {
         const string& path_name = p.first;
         list<Mapping>& path = p.second;
-        for (auto& m : path) {
-            get_node_mapping(m.position().node_id())[path_name].insert(&m);
+        for (list<Mapping>::iterator i = path.begin(); i != path.end(); ++i) {
+            get_node_mapping(i->position().node_id())[path_name].insert(&*i);
+            mapping_place[&*i] = MappingPlace{i, &path_name};
         }
     }
 }
 
+void Paths::index_place(list<Mapping>::iterator i, const string& path_name) {
+    // point at the name stored as the key of the path, which lives as long as
+    // the path does
+    mapping_place[&*i] = MappingPlace{i, &_paths.find(path_name)->first};
+}
+
+void Paths::unindex_node_mapping(id_t id, const string& path_name, Mapping* m) {
+    auto node_paths = node_mapping.find(id);
+    if (node_paths == node_mapping.end()) {
+        return;
+    }
+    auto path_mappings = node_paths->second.find(path_name);
+    if (path_mappings != node_paths->second.end()) {
+        path_mappings->second.erase(m);
+        if (path_mappings->second.empty()) {
+            node_paths->second.erase(path_mappings);
+        }
+    }
+    if (node_paths->second.empty()) {
+        node_mapping.erase(node_paths);
+    }
+}
+
 // attempt to sort the paths based on the recorded ranks of the mappings
 void Paths::sort_by_mapping_rank(void) {
     for (auto p = _paths.begin(); p != _paths.end(); ++p) {
@@ -431,16 +481,14 @@ void Paths::compact_ranks(void) {
 }
 
 void Paths::rebuild_mapping_aux(void) {
-    mapping_itr.clear();
-    mapping_path.clear();
+    mapping_place.clear();
     mappings_by_rank.clear();
     for (auto& p : _paths) {
         const string& path_name = p.first;
         list<Mapping>& path = p.second;
         size_t order_in_path = 0;
         for (list<Mapping>::iterator i = path.begin(); i != path.end(); ++i) {
-            mapping_itr[&*i] = i;
-            mapping_path[&*i] = path_name;
+            mapping_place[&*i] = MappingPlace{i, &path_name};
             
             if(i->rank() > order_in_path + 1) {
                 // Make sure that if we have to assign a rank to a node after
@@ -471,35 +519,33 @@ void Paths::remove_node(id_t id) {
 }
 
 list<Mapping>::iterator Paths::find_mapping(Mapping* m) {
-    return mapping_itr[m];
+    return mapping_place.at(m).itr;
 }
 
 list<Mapping>::iterator Paths::remove_mapping(Mapping* m) {
     // The mapping has to exist
-    assert(mapping_path.find(m) != mapping_path.end());
-    const string& path_name = mapping_path[m];
-    id_t id = m->position().node_id();
-    auto& x = _paths[path_name];
+    auto place = mapping_place.find(m);
+    assert(place != mapping_place.end());
+    const string& path_name = *place->second.path_name;
+    list<Mapping>::iterator i = place->second.itr;
     
     // This gets tricky because we're going to deallocate the storage pointed to
     // by m. We need to remove it from other things first.
-    if(m->rank() && mappings_by_rank[path_name].count(m->rank()) && 
-        mappings_by_rank[path_name][m->rank()] == m) {
-        // If we have this node stored for its path and rank, kick it out.
-        mappings_by_rank[path_name].erase(m->rank());
+    if (m->rank()) {
+        auto ranks = mappings_by_rank.find(path_name);
+        if (ranks != mappings_by_rank.end()) {
+            auto r = ranks->second.find(m->rank());
+            if (r != ranks->second.end() && r->second == m) {
+                // If we have this node stored for its path and rank, kick it out.
+                ranks->second.erase(r);
+            }
+        }
     }
+    unindex_node_mapping(m->position().node_id(), path_name, m);
+    mapping_place.erase(place);
     
     // Actually deallocate the mapping
-    list<Mapping>::iterator p = _paths[path_name].erase(mapping_itr[m]);
-    if (has_node_mapping(id)) {
-        auto& node_path_mapping = get_node_mapping(id);
-        node_path_mapping[path_name].erase(m);
-        if (node_path_mapping.empty()) node_mapping.erase(id);
-    }
-    mapping_path.erase(m);
-    mapping_itr.erase(m);
-    
-    return p;
+    return _paths.at(path_name).erase(i);
 }
 
 list<Mapping>::iterator Paths::insert_mapping(list<Mapping>::iterator w, const string& path_name, const Mapping& m) {
@@ -513,9 +559,8 @@ list<Mapping>::iterator Paths::insert_mapping(list<Mapping>::iterator w, const s
     } else {
         p = path.insert(w, m);
     }
-    get_node_mapping(m.position().node_id())[path_name].insert(&*p);
-    mapping_path[&*p] = path_name;
-    mapping_itr[&*p] = p;
+    get_node_mapping(m.position().node_id())[px->first].insert(&*p);
+    mapping_place[&*p] = MappingPlace{p, &px->first};
     return p;
 }
 
@@ -537,7 +582,7 @@ bool Paths::empty(void) const {
 void Paths::clear(void) {
     _paths.clear();
     node_mapping.clear();
-    mapping_path.clear();
+    mapping_place.clear();
     mappings_by_rank.clear();
 }
 
@@ -569,11 +614,14 @@ void Paths::remove_path(const string& name) {
     
     for(auto& mapping : path) {
         // Unindex all the mappings
-        mapping_itr.erase(&mapping);
-        mapping_path.erase(&mapping);
-        if(node_mapping.count(mapping.position().node_id())) {
+        mapping_place.erase(&mapping);
+        auto node_paths = node_mapping.find(mapping.position().node_id());
+        if (node_paths != node_mapping.end()) {
             // Throw out all the mappings for this path on this node
-            node_mapping[mapping.position().node_id()].erase(name);
+            node_paths->second.erase(name);
+            if (node_paths->second.empty()) {
+                node_mapping.erase(node_paths);
+            }
         }
     }
 
@@ -644,14 +692,12 @@ map<string, map<int, Mapping>> Paths::get_node_mapping_copies_by_rank(id_t id) {
 }
 
 Mapping* Paths::traverse_left(Mapping* mapping) {
-    // Get the iterator for this Mapping*
-    list<Mapping>::iterator place = mapping_itr.at(mapping);
-
-    // Get the path name for this Mapping*
-    string path_name = mapping_path_name(mapping);
+    // Get where this Mapping* is stored
+    const MappingPlace& stored = mapping_place.at(mapping);
+    list<Mapping>::iterator place = stored.itr;
 
     // Get the list that the iterator is in
-    list<Mapping>& path_list = _paths.at(path_name);
+    list<Mapping>& path_list = _paths.at(*stored.path_name);
 
     // If we're already the beginning, return null.
     if(place == path_list.begin()) {
@@ -665,14 +711,12 @@ Mapping* Paths::traverse_left(Mapping* mapping) {
 }
 
 Mapping* Paths::traverse_right(Mapping* mapping) {
-    // Get the iterator for this Mapping*
-    list<Mapping>::iterator place = mapping_itr.at(mapping);
-
-    // Get the path name for this Mapping*
-    string path_name = mapping_path_name(mapping);
+    // Get where this Mapping* is stored
+    const MappingPlace& stored = mapping_place.at(mapping);
+    list<Mapping>::iterator place = stored.itr;
 
     // Get the list that the iterator is in
-    list<Mapping>& path_list = _paths.at(path_name);
+    list<Mapping>& path_list = _paths.at(*stored.path_name);
 
     // Advance the iterator right.
     place++;
@@ -698,12 +742,13 @@ bool Paths::is_head_or_tail_node(id_t id) {
     return head_tail_nodes.count(id);
 }
 
-const string Paths::mapping_path_name(Mapping* m) {
-    auto n = mapping_path.find(m);
-    if (n == mapping_path.end()) {
-        return "";
+const string& Paths::mapping_path_name(Mapping* m) {
+    static const string no_path;
+    auto n = mapping_place.find(m);
+    if (n == mapping_place.end()) {
+        return no_path;
     } else {
-        return n->second;
+        return *n->second.path_name;
     }
 }
 
@@ -752,10 +797,10 @@ bool Paths::are_consecutive_nodes_in_path(id_t id1, id_t id2, const string& path
         // note that this will get the first mapping in each path, not an arbitrary one
         // (we can have looping paths, so there could be several mappings per path)
         for (auto& mp : p1[path_name]) {
-            i1s.push_back(mapping_itr[mp]);
+            i1s.push_back(mapping_place.at(mp).itr);
         }
         for (auto& mp : p2[path_name]) {
-            i2s.push_back(mapping_itr[mp]);
+            i2s.push_back(mapping_place.at(mp).itr);
         }
         for (auto i1 : i1s) {
             ++i1; // increment the first node's mapping iterator
@@ -1496,38 +1541,6 @@ Mapping reverse_complement_mapping(const Mapping& m,
     return reversed;
 }
     
-void reverse_complement_mapping_in_place(Mapping* m,
-                                         const function<int64_t(id_t)>& node_length) {
-        
-    Position* pos = m->mutable_position();
-    pos->set_is_reverse(!pos->is_reverse());
-    pos->set_offset(node_length(pos->node_id()) - pos->offset() - mapping_from_length(*m));
-    
-    size_t swap_size = m->edit_size() / 2;
-    for (size_t i = 0, j = m->edit_size() - 1; i < swap_size; i++, j--) {
-        Edit* e1 = m->mutable_edit(i);
-        Edit* e2 = m->mutable_edit(j);
-        
-        int64_t from_length_tmp = e1->from_length();
-        int64_t to_length_tmp = e1->to_length();
-        string sequence_tmp = e1->sequence();
-        
-        e1->set_from_length(e2->from_length());
-        e1->set_to_length(e2->to_length());
-        e1->set_sequence(reverse_complement(e2->sequence()));
-        
-        e2->set_from_length(from_length_tmp);
-        e2->set_to_length(to_length_tmp);
-        e2->set_sequence(reverse_complement(sequence_tmp));
-    }
-    
-    
-    if (m->edit_size() % 2) {
-        Edit* e = m->mutable_edit(swap_size);
-        reverse_complement_in_place(*e->mutable_sequence());
-    }
-}
-
 Path reverse_complement_path(const Path& path,
                              const function<int64_t(id_t)>& node_length) {
 
@@ -1549,29 +1562,6 @@ Path reverse_complement_path(const Path& path,
     return reversed;
 }
 
-void reverse_complement_path_in_place(Path* path,
-                                      const function<int64_t(id_t)>& node_length) {
-    
-    size_t swap_size = path->mapping_size() / 2;
-    for (size_t i = 0, j = path->mapping_size() - 1; i < swap_size; i++, j--) {
-        Mapping* m1 = path->mutable_mapping(i);
-        Mapping* m2 = path->mutable_mapping(j);
-        
-        reverse_complement_mapping_in_place(m1, node_length);
-        reverse_complement_mapping_in_place(m2, node_length);
-        
-        int64_t rank_tmp = m1->rank();
-        m1->set_rank(m2->rank());
-        m2->set_rank(rank_tmp);
-        
-        std::swap(*m1, *m2);
-    }
-    
-    if (path->mapping_size() % 2) {
-        reverse_complement_mapping_in_place(path->mutable_mapping(swap_size), node_length);
-    }
-}
-    
 // ref-relative
 pair<Mapping, Mapping> cut_mapping(const Mapping& m, const Position& pos) {
     Mapping left, right;
@@ -7,6 +7,7 @@
 #include <set>
 #include <list>
 #include <sstream>
+#include <unordered_map>
 #include "json2pb.h"
 #include "vg.pb.h"
 #include "edit.hpp"
@@ -36,7 +37,7 @@ public:
     }
     // move constructor
     Paths(Paths&& other) noexcept {
-        _paths = other._paths;
+        _paths = std::move(other._paths);
         other.clear();
         rebuild_node_mapping();
     }
@@ -57,13 +58,17 @@ public:
 
     // This maps from path name to the list of Mappings for that path.
     map<string, list<Mapping> > _paths;
-    // This maps from Mapping* pointer to its iterator in its list of Mappings
-    // for its path. The list in question is stored above in _paths. Recall that
-    // std::list iterators are bidirectional.
-    map<Mapping*, list<Mapping>::iterator > mapping_itr;
-    // This maps from Mapping* pointer to the name of the path it belongs to
-    // (which can then be used to get the list its iterator belongs to).
-    map<Mapping*, string> mapping_path;
+    // Where a Mapping is stored: its iterator in the list of Mappings for its
+    // path, and the name of that path, which points at the key in _paths so
+    // that the name is not copied for every mapping.
+    struct MappingPlace {
+        list<Mapping>::iterator itr;
+        const string* path_name;
+    };
+    // This maps from Mapping* pointer to where it is stored, so we can step
+    // along its path in constant time. Recall that std::list iterators are
+    // bidirectional.
+    hash_map<Mapping*, MappingPlace> mapping_place;
     void sort_by_mapping_rank(void);
     /// Reassign ranks and rebuild indexes, treating the mapping lists in _paths as the truth.
     void rebuild_mapping_aux(void);
@@ -72,8 +77,10 @@ public:
     // Mapping pointer.
     map<string, map<size_t, Mapping*>> mappings_by_rank;
     // This maps from node ID, then path name, then rank and orientation, to
-    // Mapping pointers for the mappings on that path to that node.
-    map<id_t, map<string, set<Mapping*>>> node_mapping;
+    // Mapping pointers for the mappings on that path to that node. The per-node
+    // maps have to stay put when other nodes are added, because we hand out
+    // references to them.
+    unordered_map<id_t, map<string, set<Mapping*>>> node_mapping;
     // record which head nodes we have
     // we'll use this when determining path edge crossings--- all paths implicitly cross these nodes
     set<id_t> head_tail_nodes;
@@ -102,6 +109,12 @@ public:
     pair<Mapping*, Mapping*> divide_mapping(Mapping* m, size_t offset);
     // replace the mapping with two others in the order provided
     pair<Mapping*, Mapping*> replace_mapping(Mapping* m, pair<Mapping, Mapping> n);
+    // Replace the mapping with the given mappings, which are in the order they
+    // occur along the path. The first one is stored in place of the old
+    // mapping, so the path is only spliced once per extra piece and the old
+    // mapping's indexes are updated instead of rebuilt. Returns the new
+    // mappings in path order.
+    vector<Mapping*> replace_mapping(Mapping* m, const vector<Mapping>& parts);
     // Note that this clears and rebuilds all the indexes
     void remove_paths(const set<string>& names);
     // This one actually unthreads the path from the indexes. It's O(path
@@ -136,8 +149,9 @@ public:
     // Go right along the path that this Mapping* belongs to, and return the
     // Mapping* there, or null if this Mapping* is the last in its path.
     Mapping* traverse_right(Mapping* mapping);
-    // TODO: should this be a reference?
-    const string mapping_path_name(Mapping* m);
+    // Get the name of the path the mapping is on, or the empty string if it
+    // is not on a path.
+    const string& mapping_path_name(Mapping* m);
     // the patsh of the node
     set<string> of_node(id_t id);
     // get the paths on this node and the number of mappings from each one
@@ -193,6 +207,13 @@ public:
     // erases current (old index information)
     void reassign_node(id_t new_id, Mapping* m);
     void for_each_mapping(const function<void(Mapping*)>& lambda);
+    
+private:
+    // Remember where the mapping at the iterator is stored
+    void index_place(list<Mapping>::iterator i, const string& path_name);
+    // Drop the mapping from the index of mappings on its node, dropping the
+    // index entries that are left empty
+    void unindex_node_mapping(id_t id, const string& path_name, Mapping* m);
 };
 
 string  path_to_string(Path p);
@@ -225,12 +246,16 @@ Mapping reverse_complement_mapping(const Mapping& m,
 // from the other ends of their nodes.
 Path reverse_complement_path(const Path& path,
                              const function<int64_t(id_t)>& node_length);
-// Reverse-complement a Mapping and all the Edits in it in place.
-void reverse_complement_mapping_in_place(Mapping* m,
-                                         const function<int64_t(id_t)>& node_length);
-// Reverse-complement a Path and all the Mappings in it in place.
-void reverse_complement_path_in_place(Path* path,
-                                      const function<int64_t(id_t)>& node_length);
+// Reverse-complement a Mapping and all the Edits in it in place. Edits are
+// reordered by swapping, so nothing is copied or allocated. The node length
+// lookup can be any callable taking an id_t, so hot callers can pass a lambda
+// and avoid going through a std::function for every Mapping.
+template<typename NodeLength>
+void reverse_complement_mapping_in_place(Mapping* m, const NodeLength& node_length);
+// Reverse-complement a Path and all the Mappings in it in place. Mappings keep
+// the ranks of the slots they are moved into.
+template<typename NodeLength>
+void reverse_complement_path_in_place(Path* path, const NodeLength& node_length);
 /// Simplify the path for addition as new material in the graph. Remove any
 /// mappings that are merely single deletions, merge adjacent edits of the same
 /// type, strip leading and trailing deletion edits on mappings, and make sure no
@@ -290,6 +315,47 @@ pos_t final_position(const Path& path);
 // Turn a list of node traversals into a path
 Path path_from_node_traversals(const list<NodeTraversal>& traversals);
 
+template<typename NodeLength>
+void reverse_complement_mapping_in_place(Mapping* m, const NodeLength& node_length) {
+    
+    // like the copying version, leave unplaced mappings where they are
+    if (m->has_position() && m->position().node_id() != 0) {
+        Position* pos = m->mutable_position();
+        pos->set_is_reverse(!pos->is_reverse());
+        pos->set_offset(node_length(pos->node_id()) - pos->offset() - mapping_from_length(*m));
+    }
+    
+    auto* edits = m->mutable_edit();
+    for (int i = 0, j = edits->size() - 1; i < j; i++, j--) {
+        edits->SwapElements(i, j);
+    }
+    for (Edit& edit : *edits) {
+        // don't ask for a mutable empty string, since that would allocate one
+        if (!edit.sequence().empty()) {
+            reverse_complement_in_place(*edit.mutable_sequence());
+        }
+    }
+}
+
+template<typename NodeLength>
+void reverse_complement_path_in_place(Path* path, const NodeLength& node_length) {
+    
+    auto* mappings = path->mutable_mapping();
+    for (int i = 0, j = mappings->size() - 1; i < j; i++, j--) {
+        mappings->SwapElements(i, j);
+        
+        // the ranks stay where they were
+        Mapping* m1 = mappings->Mutable(i);
+        Mapping* m2 = mappings->Mutable(j);
+        int64_t rank_tmp = m1->rank();
+        m1->set_rank(m2->rank());
+        m2->set_rank(rank_tmp);
+    }
+    for (Mapping& mapping : *mappings) {
+        reverse_complement_mapping_in_place(&mapping, node_length);
+    }
+}
+
 }
 
 #endif
@@ -1,37 +1,71 @@
 #include "path_index.hpp"
 
+#include <omp.h>
+
 namespace vg {
 
+/// Turn a vector of values into their running totals, in blocks on each
+/// thread when there are enough of them.
+static void prefix_sum(vector<size_t>& values) {
+    if (values.size() < (1 << 16) || omp_get_max_threads() == 1) {
+        for (size_t i = 1; i < values.size(); i++) {
+            values[i] += values[i - 1];
+        }
+        return;
+    }
+    
+    // The total of each thread's block, then the total of all blocks before it
+    vector<size_t> block_totals;
+    
+#pragma omp parallel
+    {
+        size_t num_blocks = omp_get_num_threads();
+        size_t block = omp_get_thread_num();
+#pragma omp single
+        block_totals.resize(num_blocks + 1, 0);
+        
+        size_t begin = values.size() * block / num_blocks;
+        size_t end = values.size() * (block + 1) / num_blocks;
+        for (size_t i = begin + 1; i < end; i++) {
+            values[i] += values[i - 1];
+        }
+        block_totals[block + 1] = end > begin ? values[end - 1] : 0;
+        
+#pragma omp barrier
+#pragma omp single
+        for (size_t i = 1; i < block_totals.size(); i++) {
+            block_totals[i] += block_totals[i - 1];
+        }
+        
+        for (size_t i = begin; i < end; i++) {
+            values[i] += block_totals[block];
+        }
+    }
+}
+
 PathIndex::PathIndex(const Path& path) {
     // Just trace the path, which we assume has mapping lengths filled in.
     
-    // What base are we at in the path?
-    size_t path_base = 0;
-    
-    // What was the last rank? Ranks must always go up.
-    int64_t last_rank = -1;
+    // Find where each mapping starts
+    vector<size_t> starts(path.mapping_size() + 1, 0);
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < path.mapping_size(); i++) {
+        starts[i + 1] = mapping_from_length(path.mapping(i));
+    }
+    prefix_sum(starts);
     
+    by_start.reserve(path.mapping_size());
     for (size_t i = 0; i < path.mapping_size(); i++) {
         // For every mapping
-        auto& mapping = path.mapping(i);
-    
-        if (!by_id.count(mapping.position().node_id())) {
-            // This is the first time we have visited this node in the path.
-            
-            // Add in a mapping.
-            by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
-        }
+        auto& position = path.mapping(i).position();
+        
+        // Add in a mapping, if this is the first time we have visited this
+        // node in the path.
+        by_id.emplace(position.node_id(), std::make_pair(starts[i], position.is_reverse()));
         
         // Say that this node appears here along the reference in this
         // orientation.
-        by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
-        
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
-        
-        // Just advance and don't grab sequence.
-        path_base += mapping_from_length(mapping);
+        add_occurrence(starts[i], NodeSide(position.node_id(), position.is_reverse()));
     }
     
     // Record the length of the last mapping, since there's no next mapping to work it out from
@@ -40,141 +74,121 @@ PathIndex::PathIndex(const Path& path) {
 #ifdef debug    
     // Announce progress.
     #pragma omp critical (cerr)
-    std::cerr << "Traced " << path_base << " bp path of " << path.mapping_size() << " mappings." << std::endl;
+    std::cerr << "Traced " << starts.back() << " bp path of " << path.mapping_size() << " mappings." << std::endl;
 #endif
     
 }
 
 PathIndex::PathIndex(const list<Mapping>& mappings, VG& vg) {
     // Trace the given path in the given VG graph, collecting sequence
-    
-    // We're going to build the sequence string
-    std::stringstream seq_stream;
-    
-    // What base are we at in the path?
-    size_t path_base = 0;
-    
-    // What was the last rank? Ranks must always go up.
-    int64_t last_rank = -1;
-    
+    vector<const Mapping*> in_order;
+    in_order.reserve(mappings.size());
     for (auto& mapping : mappings) {
+        in_order.push_back(&mapping);
+    }
     
-        if (!by_id.count(mapping.position().node_id())) {
-            // This is the first time we have visited this node in the path.
-            
-            // Add in a mapping.
-            by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
-#ifdef debug
-            #pragma omp critical (cerr)
-            std::cerr << "Node " << mapping.position().node_id() << " rank " << mapping.rank()
-                << " starts at base " << path_base << " with "
-                << vg.get_node(mapping.position().node_id())->sequence() << std::endl;
-#endif
-            
-            // Make sure ranks are monotonically increasing along the path, or
-            // unset.
-            assert(mapping.rank() > last_rank || (mapping.rank() == 0 && last_rank == 0));
-            last_rank = mapping.rank();
-        }
-        
-        // Say that this node appears here along the reference in this
-        // orientation.
-        by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
-    
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
-    
-        // Say this Mapping happens at this base along the path
-        mapping_positions[&mapping] = path_base;
-    
-        // Find the node's sequence
-        std::string node_sequence = vg.get_node(mapping.position().node_id())->sequence();
+    index_mappings(in_order, [&](id_t id) {
+        return vg.get_node(id)->sequence();
+    }, [&](id_t id) {
+        return vg.get_node(id)->sequence().size();
+    }, true);
+}
+
+PathIndex::PathIndex(const Path& path, const xg::XG& index) {
+    // Trace the given path in the given XG graph, collecting sequence
+    vector<const Mapping*> in_order;
+    in_order.reserve(path.mapping_size());
+    for (size_t i = 0; i < path.mapping_size(); i++) {
+        in_order.push_back(&path.mapping(i));
+    }
     
-        while(path_base == 0 && node_sequence.size() > 0 &&
-            (node_sequence[0] != 'A' && node_sequence[0] != 'T' && node_sequence[0] != 'C' &&
-            node_sequence[0] != 'G' && node_sequence[0] != 'N')) {
-            
-            // If the path leads with invalid characters (like "X"), throw them
-            // out when computing path positions.
+    index_mappings(in_order, [&](id_t id) {
+        return index.node_sequence(id);
+    }, [&](id_t id) {
+        return (size_t) index.node_length(id);
+    }, false);
+}
+
+void PathIndex::index_mappings(const vector<const Mapping*>& mappings,
+                               const function<string(id_t)>& get_sequence,
+                               const function<size_t(id_t)>& get_length,
+                               bool record_mapping_positions) {
+    
+    // How many bases of each mapping's node go into the path, after a 0 for the
+    // start; we will sum these up to get the mapping start positions.
+    vector<size_t> starts(mappings.size() + 1, 0);
+    
+    // How many invalid leading characters to leave off of each mapping's node
+    vector<size_t> dropped(mappings.size(), 0);
+    
+    // If the path leads with invalid characters (like "X"), throw them out
+    // when computing path positions. This can only happen at the very start,
+    // so we look at those nodes first.
+    // TODO: this is a hack to deal with the debruijn-brca1-k63 graph, which
+    // leads with an X.
+    size_t first_counted = 0;
+    while (first_counted < mappings.size()) {
+        id_t node_id = mappings[first_counted]->position().node_id();
+        std::string node_sequence = get_sequence(node_id);
+        size_t& to_drop = dropped[first_counted];
+        while (to_drop < node_sequence.size() &&
+            (node_sequence[to_drop] != 'A' && node_sequence[to_drop] != 'T' && node_sequence[to_drop] != 'C' &&
+            node_sequence[to_drop] != 'G' && node_sequence[to_drop] != 'N')) {
             
-            // TODO: this is a hack to deal with the debruijn-brca1-k63 graph,
-            // which leads with an X.
             #pragma omp critical (cerr)
             std::cerr << "Warning: dropping invalid leading character "
-                << node_sequence[0] << " from node " << mapping.position().node_id()
+                << node_sequence[to_drop] << " from node " << node_id
                 << std::endl;
                 
-            node_sequence.erase(node_sequence.begin());
+            to_drop++;
         }
-        
-        if (mapping.position().is_reverse()) {
-            // Put the reverse sequence in the path
-            seq_stream << reverse_complement(node_sequence);
-        } else {
-            // Put the forward sequence in the path
-            seq_stream << node_sequence;
+        starts[first_counted + 1] = node_sequence.size() - to_drop;
+        first_counted++;
+        if (starts[first_counted] > 0) {
+            // We're past the start of the path
+            break;
         }
-        
-        // Whether we found the right place for this node in the reference or
-        // not, we still need to advance along the reference path. We assume the
-        // whole node (except any leading bogus characters) is included in the
-        // path (since it sort of has to be, syntactically, unless it's the
-        // first or last node).
-        path_base += node_sequence.size();
-        
-        // TODO: handle leading bogus characters in calls on the first node.
     }
     
-    // Record the length of the last mapping's node, since there's no next mapping to work it out from
-    last_node_length = mappings.empty() ?
-        0 : 
-        vg.get_node(mappings.back().position().node_id())->sequence().size();
-    
-    // Create the actual reference sequence we will use
-    sequence = seq_stream.str();
-    
-#ifdef debug
-    // Announce progress.
-    #pragma omp critical (cerr)
-    std::cerr << "Traced " << path_base << " bp path." << std::endl;
-    
-    if (sequence.size() < 100) {
-        #pragma omp critical (cerr)
-        std::cerr << "Sequence: " << sequence << std::endl;
+    // We assume the whole node (except any leading bogus characters) is
+    // included in the path (since it sort of has to be, syntactically, unless
+    // it's the first or last node).
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = first_counted; i < mappings.size(); i++) {
+        starts[i + 1] = get_length(mappings[i]->position().node_id());
+    }
+    prefix_sum(starts);
+    
+    // Now each node can put its sequence in its own part of the path's
+    sequence.resize(starts.back());
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < mappings.size(); i++) {
+        auto& position = mappings[i]->position();
+        std::string node_sequence = get_sequence(position.node_id()).substr(dropped[i]);
+        if (position.is_reverse()) {
+            // Put the reverse sequence in the path
+            node_sequence = reverse_complement(node_sequence);
+        }
+        std::copy(node_sequence.begin(), node_sequence.end(), sequence.begin() + starts[i]);
     }
-#endif
-
-    // Follow the path (again) and place all its Mappings
-    
-}
-
-PathIndex::PathIndex(const Path& path, const xg::XG& index) {
-    // Trace the given path in the given XG graph, collecting sequence
-    
-    // We're going to build the sequence string
-    std::stringstream seq_stream;
-    
-    // What base are we at in the path?
-    size_t path_base = 0;
     
     // What was the last rank? Ranks must always go up.
     int64_t last_rank = -1;
     
-    for (size_t i = 0; i < path.mapping_size(); i++) {
-        auto& mapping = path.mapping(i);
-    
+    by_start.reserve(mappings.size());
+    for (size_t i = 0; i < mappings.size(); i++) {
+        auto& mapping = *mappings[i];
+        
         if (!by_id.count(mapping.position().node_id())) {
             // This is the first time we have visited this node in the path.
             
             // Add in a mapping.
             by_id[mapping.position().node_id()] = 
-                std::make_pair(path_base, mapping.position().is_reverse());
+                std::make_pair(starts[i], mapping.position().is_reverse());
 #ifdef debug
             #pragma omp critical (cerr)
             std::cerr << "Node " << mapping.position().node_id() << " rank " << mapping.rank()
-                << " starts at base " << path_base << " with "
-                << index.node_sequence(mapping.position().node_id()) << std::endl;
+                << " starts at base " << starts[i] << std::endl;
 #endif
             
             // Make sure ranks are monotonically increasing along the path, or
@@ -185,68 +199,35 @@ PathIndex::PathIndex(const Path& path, const xg::XG& index) {
         
         // Say that this node appears here along the reference in this
         // orientation.
-        by_start[path_base] = NodeSide(mapping.position().node_id(), mapping.position().is_reverse());
-    
-        // Remember that occurrence by node ID.
-        node_occurrences[mapping.position().node_id()].push_back(by_start.find(path_base));
-    
-        // Find the node's sequence
-        std::string node_sequence = index.node_sequence(mapping.position().node_id());
-    
-        while(path_base == 0 && node_sequence.size() > 0 &&
-            (node_sequence[0] != 'A' && node_sequence[0] != 'T' && node_sequence[0] != 'C' &&
-            node_sequence[0] != 'G' && node_sequence[0] != 'N')) {
-            
-            // If the path leads with invalid characters (like "X"), throw them
-            // out when computing path positions.
-            
-            // TODO: this is a hack to deal with the debruijn-brca1-k63 graph,
-            // which leads with an X.
-            #pragma omp critical (cerr)
-            std::cerr << "Warning: dropping invalid leading character "
-                << node_sequence[0] << " from node " << mapping.position().node_id()
-                << std::endl;
-                
-            node_sequence.erase(node_sequence.begin());
-        }
+        add_occurrence(starts[i], NodeSide(mapping.position().node_id(), mapping.position().is_reverse()));
         
-        if (mapping.position().is_reverse()) {
-            // Put the reverse sequence in the path
-            seq_stream << reverse_complement(node_sequence);
-        } else {
-            // Put the forward sequence in the path
-            seq_stream << node_sequence;
+        if (record_mapping_positions) {
+            // Say this Mapping happens at this base along the path
+            mapping_positions[&mapping] = starts[i];
         }
-        
-        // Whether we found the right place for this node in the reference or
-        // not, we still need to advance along the reference path. We assume the
-        // whole node (except any leading bogus characters) is included in the
-        // path (since it sort of has to be, syntactically, unless it's the
-        // first or last node).
-        path_base += node_sequence.size();
-        
-        // TODO: handle leading bogus characters in calls on the first node.
     }
     
     // Record the length of the last mapping's node, since there's no next mapping to work it out from
-    last_node_length = path.mapping_size() > 0 ?
-        index.node_length(path.mapping(path.mapping_size() - 1).position().node_id()) :
-        0;
-    
-    // Create the actual reference sequence we will use
-    sequence = seq_stream.str();
+    last_node_length = mappings.empty() ? 0 : get_length(mappings.back()->position().node_id());
     
 #ifdef debug
     // Announce progress.
     #pragma omp critical (cerr)
-    std::cerr << "Traced " << path_base << " bp path." << std::endl;
+    std::cerr << "Traced " << starts.back() << " bp path." << std::endl;
     
     if (sequence.size() < 100) {
         #pragma omp critical (cerr)
         std::cerr << "Sequence: " << sequence << std::endl;
     }
 #endif
+}
 
+void PathIndex::add_occurrence(size_t start, const NodeSide& side) {
+    if (!by_start.empty() && by_start.back().first == start) {
+        by_start.back().second = side;
+    } else {
+        by_start.emplace_back(start, side);
+    }
 }
 
 PathIndex::PathIndex(VG& vg, const string& path_name, bool extract_sequence) {
@@ -319,7 +300,10 @@ PathIndex::iterator PathIndex::find_position(size_t position) const {
     assert(!by_start.empty());
     
     // Look up the iterator to whatever starts after here
-    auto starts_next = by_start.upper_bound(position);
+    auto starts_next = std::upper_bound(by_start.begin(), by_start.end(), position,
+        [](size_t position, const pair<size_t, NodeSide>& occurrence) {
+        return position < occurrence.first;
+    });
     
     // This can't work if we try to look before the first node.
     assert(starts_next != by_start.begin());
@@ -338,6 +322,13 @@ PathIndex::iterator PathIndex::find_position(size_t position) const {
     return starts_next;
 }
 
+PathIndex::iterator PathIndex::find_start(size_t position) const {
+    return std::lower_bound(by_start.begin(), by_start.end(), position,
+        [](const pair<size_t, NodeSide>& occurrence, size_t position) {
+        return occurrence.first < position;
+    });
+}
+
 size_t PathIndex::node_length(const iterator& here) const {
     assert(here != by_start.end());
     
@@ -451,37 +442,8 @@ map<id_t, vector<Mapping>> PathIndex::parse_translation(const Translation& trans
 void PathIndex::apply_translation(const Translation& translation) {
     
     // Parse the translation, to get a map form old node ID to vector of
-    // replacement mappings.
-    auto old_node_to_new_nodes = parse_translation(translation);
-    
-    
-    // TODO: we would like to update mapping_positions efficiently, but we
-    // can't, because it's full of potentially invalidated pointers.
-    mapping_positions.clear();
-    
-    for (auto kv : old_node_to_new_nodes) {
-        // For every node that needs to be replaced with other nodes
-        auto& old_id = kv.first;
-        auto& replacements = kv.second;
-        
-        // Pull out all the occurrences of the old node.
-        vector<iterator> occurrences{std::move(node_occurrences[old_id])};
-        node_occurrences.erase(old_id);
-        
-        for (auto& occurrence : occurrences) {
-            // Each time the old node appeared, replace it (and log occurrences
-            // of the new nodes that partition it, one of which may re-use the
-            // ID)
-            replace_occurrence(occurrence, replacements);
-        }
-        
-#ifdef debug
-        cerr << "by_start is now: " << endl;
-        for (auto kv2 : by_start) {
-            cerr << "\t" << kv2.first << ": " << kv2.second << endl;
-        }
-#endif
-    }
+    // replacement mappings, and do the replacements.
+    replace_nodes(parse_translation(translation));
 }
 
 void PathIndex::apply_translations(const vector<Translation>& translations) {
@@ -514,6 +476,10 @@ void PathIndex::apply_translations(const vector<Translation>& translations) {
         collated[t.from().mapping(0).position().node_id()].push_back(make_pair(t.from().mapping(0), t.to().mapping(0)));
     }
     
+    // Every original node on the path gets its replacement mappings in here,
+    // so we can replace them all at once.
+    map<id_t, vector<Mapping>> old_node_to_new_nodes;
+    
     for (auto& kv : collated) {
         // For every original node and its replacement nodes
         
@@ -539,71 +505,93 @@ void PathIndex::apply_translations(const vector<Translation>& translations) {
         from_edit->set_from_length(path_from_length(covering.to()));
         from_edit->set_to_length(from_edit->from_length());
         
-        // Apply this (single node) translation.
-        // TODO: batch up a bit?
-        apply_translation(covering);
+        // Parse this (single node) translation.
+        for (auto& parsed : parse_translation(covering)) {
+            old_node_to_new_nodes[parsed.first] = std::move(parsed.second);
+        }
     }
+    
+    replace_nodes(old_node_to_new_nodes);
 }
 
-void PathIndex::replace_occurrence(iterator to_replace, const vector<Mapping>& replacements) {
-    // Grab the node ID
-    auto node_id = to_replace->second.node;
-    
-    // Grab it's start
-    auto start = to_replace->first;
+void PathIndex::replace_nodes(const map<id_t, vector<Mapping>>& replacements) {
     
-    // Determine if we want to insert replacement nodes forward or backward
-    bool reverse = to_replace->second.is_end;
+    // TODO: we would like to update mapping_positions efficiently, but we
+    // can't, because it's full of potentially invalidated pointers.
+    mapping_positions.clear();
     
-    // Peek ahead at whatever's next (so we know if we're replacing the last
-    // node in the path).
-    auto comes_next = to_replace;
-    comes_next++;
+    if (replacements.empty()) {
+        return;
+    }
     
-    if (by_id.count(node_id) && by_id.at(node_id).first == start) {
-        // We're removing the first occurrence of this node, so we need to
-        // clean up by_id. But since we're removing all occurreences of this
-        // node we don't have to point it at the second occurrence.
-        by_id.erase(node_id);
+    // We're removing all occurrences of the old nodes, so they come out of
+    // by_id entirely. Replacements that re-use an ID will put it back.
+    for (auto& kv : replacements) {
+        by_id.erase(kv.first);
     }
     
-    for (int64_t i = reverse ? (replacements.size() - 1) : 0;
-        i != (reverse ? -1 : replacements.size());
-        i += (reverse ? -1 : 1)) {
-        
-        // For each replacement mapping in the appropriate order
-        auto& mapping = replacements.at(i);
-        
-        // What ID do we put?
-        auto new_id = mapping.position().node_id();
-        
-        // What orientation doies it go in?
-        auto new_orientation = mapping.position().is_reverse() != reverse;
-        
-        // Stick the replacements in the map
-        by_start[start] = NodeSide(new_id, new_orientation);
-        
-        // Remember that occurrence by node ID.
-        node_occurrences[new_id].push_back(by_start.find(start));
-        
-        if (!by_id.count(new_id) || by_id.at(new_id).first > start) {
-            // We've created a new first mapping to this new node.
-            // Record it.
-            by_id[new_id] = make_pair(start, new_orientation);
+    // Rebuild the occurrences along the path in one pass
+    vector<pair<size_t, NodeSide>> old_by_start;
+    std::swap(old_by_start, by_start);
+    by_start.reserve(old_by_start.size());
+    
+    for (size_t i = 0; i < old_by_start.size(); i++) {
+        auto& occurrence = old_by_start[i];
+        auto found = replacements.find(occurrence.second.node);
+        if (found == replacements.end()) {
+            // This node stays as it is
+            by_start.push_back(occurrence);
+            continue;
         }
         
-        // Budge start up so the next mapping gets inserted after this one.
-        start += mapping_from_length(mapping);
+        // Grab it's start
+        auto start = occurrence.first;
+        
+        // Determine if we want to insert replacement nodes forward or backward
+        bool reverse = occurrence.second.is_end;
         
-        if (comes_next == by_start.end() && i == (reverse ? 0 : replacements.size() - 1)) {
-            // We just added the last mapping replacing what the old last
-            // mapping was. So update the length of the last node to reflect
-            // this new last node.
-            last_node_length = mapping_from_length(mapping);
+        auto& mappings = found->second;
+        for (size_t j = 0; j < mappings.size(); j++) {
+            // For each replacement mapping in the appropriate order
+            auto& mapping = mappings[reverse ? mappings.size() - 1 - j : j];
+            
+            // What ID do we put?
+            auto new_id = mapping.position().node_id();
+            
+            // What orientation doies it go in?
+            auto new_orientation = mapping.position().is_reverse() != reverse;
+            
+            // Stick the replacement in the path
+            add_occurrence(start, NodeSide(new_id, new_orientation));
+            
+            auto first = by_id.find(new_id);
+            if (first == by_id.end() || first->second.first > start) {
+                // We've created a new first mapping to this new node.
+                // Record it.
+                by_id[new_id] = make_pair(start, new_orientation);
+            }
+            
+            // Budge start up so the next mapping gets inserted after this one.
+            start += mapping_from_length(mapping);
+            
+            if (i + 1 == old_by_start.size() && j + 1 == mappings.size()) {
+                // We just added the last mapping replacing what the old last
+                // mapping was. So update the length of the last node to reflect
+                // this new last node.
+                last_node_length = mapping_from_length(mapping);
+            }
         }
     }
+    
+#ifdef debug
+    cerr << "by_start is now: " << endl;
+    for (auto kv2 : by_start) {
+        cerr << "\t" << kv2.first << ": " << kv2.second << endl;
+    }
+#endif
 }
 
+
 }
 
 
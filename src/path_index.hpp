@@ -12,6 +12,8 @@
 #include <map>
 #include <utility>
 #include <string>
+#include <vector>
+#include <functional>
 
 #include "vg.hpp"
 #include "xg.hpp"
@@ -30,10 +32,10 @@ struct PathIndex {
     /// orientation it occurs there.
     map<int64_t, pair<size_t, bool>> by_id;
     
-    /// Index from start position on the reference to the side of the node that
-    /// begins there. If it is a right side, the node occurs on the path in a
-    /// reverse orientation.
-    map<size_t, NodeSide> by_start;
+    /// Start positions on the reference of the node occurrences along it, in
+    /// order, with the side of the node that begins there. If it is a right
+    /// side, the node occurs on the path in a reverse orientation.
+    vector<pair<size_t, NodeSide>> by_start;
     
     /// The actual sequence of the path, if desired.
     std::string sequence;
@@ -75,7 +77,7 @@ struct PathIndex {
     bool path_contains_node(int64_t node_id);
     
     /// We keep iterators to node occurrences along the ref path.
-    using iterator = map<size_t, vg::NodeSide>::const_iterator;
+    using iterator = vector<pair<size_t, vg::NodeSide>>::const_iterator;
     
     /// Get the iterator to the first node occurrence on the indexed path.
     iterator begin() const;
@@ -86,6 +88,10 @@ struct PathIndex {
     /// must not be greater than the path length.
     iterator find_position(size_t position) const;
     
+    /// Find the iterator to the first node occurrence that starts at or after
+    /// the given position, or end() if there is none.
+    iterator find_start(size_t position) const;
+    
     /// Get the length of the node occurrence on the path represented by this
     /// iterator.
     size_t node_length(const iterator& here) const;
@@ -113,7 +119,7 @@ struct PathIndex {
      * produced by VG::edit() which is one to Mapping per translation. The
      * vector may include both forward and reverse versions of each to node, and
      * may also include translations mapping nodes that did not change to
-     * themselves.
+     * themselves. All the translations are applied in one pass over the path.
      */
     void apply_translations(const vector<Translation>& translations);
     
@@ -123,20 +129,26 @@ protected:
     /// indexed path.
     size_t last_node_length;
     
-    /// This holds all the places that a particular node occurs, in order.
-    /// TODO: use this to replace by_id
-    map<id_t, vector<iterator>> node_occurrences;
+    /// Index the given mappings, in order, and pull their sequence. The
+    /// sequence and length functions must be safe to call from multiple
+    /// threads. Optionally also records the mapping positions.
+    void index_mappings(const vector<const Mapping*>& mappings,
+                        const function<string(id_t)>& get_sequence,
+                        const function<size_t(id_t)>& get_length,
+                        bool record_mapping_positions);
+    
+    /// Add a node occurrence at the end of by_start. An occurrence at the same
+    /// position as the last one (after an empty mapping) replaces it.
+    void add_occurrence(size_t start, const NodeSide& side);
     
     /// Convert a Translation that partitions old nodes into a map from old node
     /// ID to the Mappings that replace it in its forward orientation.
     map<id_t, vector<Mapping>> parse_translation(const Translation& translation);
     
-    /// Given an iterator into by_start, replace the occurrence of the node
-    /// there with occurrences of the nodes given in the vector of mappings,
-    /// which partition the forward strand of the node being replaced.
-    void replace_occurrence(iterator to_replace, const vector<Mapping>& replacements);
-    
-    
+    /// Replace every occurrence of each old node with occurrences of the nodes
+    /// given in its vector of mappings, which partition the forward strand of
+    /// the node being replaced.
+    void replace_nodes(const map<id_t, vector<Mapping>>& replacements);
     
 };
 
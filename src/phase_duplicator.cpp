@@ -9,6 +9,42 @@ PhaseDuplicator::PhaseDuplicator(const xg::XG& index) : index(index) {
 }
 
 pair<Graph, vector<Translation>> PhaseDuplicator::duplicate(const set<id_t>& subgraph, id_t& next_id) const {
+    // Find all the traversals and duplicate them out
+    return duplicate_haplotypes(list_haplotypes(subgraph), subgraph, next_id);
+}
+
+vector<pair<Graph, vector<Translation>>> PhaseDuplicator::duplicate(const vector<set<id_t>>& subgraphs,
+    id_t& next_id) const {
+    
+    // Searching the haplotypes is the expensive part, and each subgraph can be
+    // searched on its own.
+    vector<vector<pair<xg::XG::thread_t, int>>> haplotypes(subgraphs.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < subgraphs.size(); i++) {
+        haplotypes[i] = list_haplotypes(subgraphs[i]);
+    }
+    
+    // Every visit of every haplotype gets a new node, so now we know where
+    // each subgraph's IDs start.
+    vector<id_t> start_ids(subgraphs.size());
+    for (size_t i = 0; i < subgraphs.size(); i++) {
+        start_ids[i] = next_id;
+        for (auto& thread_and_count : haplotypes[i]) {
+            next_id += thread_and_count.first.size();
+        }
+    }
+    
+    vector<pair<Graph, vector<Translation>>> duplicated(subgraphs.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < subgraphs.size(); i++) {
+        duplicated[i] = duplicate_haplotypes(haplotypes[i], subgraphs[i], start_ids[i]);
+    }
+    
+    return duplicated;
+}
+
+pair<Graph, vector<Translation>> PhaseDuplicator::duplicate_haplotypes(
+    const vector<pair<xg::XG::thread_t, int>>& haplotypes, const set<id_t>& subgraph, id_t& next_id) const {
 
     // Allocate space for the result
     pair<Graph, vector<Translation>> to_return;
@@ -18,10 +54,7 @@ pair<Graph, vector<Translation>> PhaseDuplicator::duplicate(const set<id_t>& sub
     
     // The duplicated graph is produced assuming the original nodes and their edges are all deleted.
     
-    // Find all the traversals
-    vector<pair<xg::XG::thread_t, int>> observed_threads = list_haplotypes(subgraph);
-    
-    for (auto& thread_and_count : observed_threads) {
+    for (auto& thread_and_count : haplotypes) {
         // For every unique haplotype in the subgraph
         
         // Grab it
@@ -42,12 +42,18 @@ public:
      *
      * New IDs will be generated startign with next_id, and next_id will be
      * updated to the next ID after the IDs of all generated material.
-     * 
-     * TODO: invent some kind of thread safe ID allocator so we can do multiple
-     * subgraphs in parallel without renumbering later.
      */
     pair<Graph, vector<Translation>> duplicate(const set<id_t>& subgraph, id_t& next_id) const;
     
+    /**
+     * Duplicate out each of a collection of disjoint subgraphs, working on
+     * several of them at once. New IDs are handed out as if duplicate() had
+     * been called on each subgraph in turn, so the results don't depend on the
+     * number of threads, and next_id is updated past all the generated
+     * material.
+     */
+    vector<pair<Graph, vector<Translation>>> duplicate(const vector<set<id_t>>& subgraphs, id_t& next_id) const;
+    
     /**
      * List all the distinct haplotypes within a subgraph and their counts.
      * Reports each haplotype in only one direction.
@@ -104,6 +110,13 @@ public:
     static xg::XG::thread_t canonicalize(const xg::XG::thread_t& thread);
     
 private:
+    /**
+     * Generate the duplicated nodes, edges and Translations for the given
+     * haplotypes of the given subgraph, numbering new nodes from next_id.
+     */
+    pair<Graph, vector<Translation>> duplicate_haplotypes(const vector<pair<xg::XG::thread_t, int>>& haplotypes,
+        const set<id_t>& subgraph, id_t& next_id) const;
+
     /// What XG index describes the graph we operate on?
     const xg::XG& index;
 };
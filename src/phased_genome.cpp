@@ -17,20 +17,14 @@ namespace vg {
         // nothing to do
     }
     
-    PhasedGenome::Haplotype::Haplotype(NodeTraversal node_traversal) {
+    PhasedGenome::Haplotype::Haplotype(PhasedGenome& genome, NodeTraversal node_traversal) : genome(genome) {
         // construct seed node
-        left_telomere_node = new HaplotypeNode(node_traversal, nullptr, nullptr);
+        left_telomere_node = genome.new_haplotype_node(node_traversal, nullptr, nullptr);
         right_telomere_node = left_telomere_node;
     }
     
     PhasedGenome::Haplotype::~Haplotype() {
-        // destruct nodes
-        HaplotypeNode* haplo_node = this->left_telomere_node;
-        while (haplo_node) {
-            HaplotypeNode* next = haplo_node->next;
-            delete haplo_node;
-            haplo_node = next;
-        }
+        // the nodes belong to the genome's blocks
     }
     
     PhasedGenome::PhasedGenome(SnarlManager& snarl_manager) : snarl_manager(snarl_manager) {
@@ -43,6 +37,10 @@ namespace vg {
             delete haplotype;
         }
         
+        for (HaplotypeNode* node_block : node_blocks) {
+            delete[] node_block;
+        }
+        
     }
     
     void PhasedGenome::build_indices() {
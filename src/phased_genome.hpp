@@ -117,8 +117,8 @@ namespace vg {
         /// All haplotypes in the genome (generally 2 per chromosome)
         vector<Haplotype*> haplotypes;
         
-        /// Index of where nodes from the graph occur in the phased genome
-        unordered_map<int64_t, list<HaplotypeNode*> > node_locations;
+        /// Index of where nodes from the graph occur in the phased genome, in no particular order
+        unordered_map<int64_t, vector<HaplotypeNode*> > node_locations;
         
         /// Index of which nodes are starts of Snarls
         unordered_map<int64_t, const Snarl*> site_starts;
@@ -127,6 +127,20 @@ namespace vg {
         // note: sufficient for these purposes to maintain only node ids instead of node sides
         // since the path must go through the site either before or after entering here
         
+        /// Haplotype nodes are handed out of blocks of this many, so that
+        /// walks sit mostly contiguous in memory and edits don't need the allocator
+        static const size_t NODE_BLOCK_SIZE = 1024;
+        /// The blocks that own all the haplotype nodes
+        vector<HaplotypeNode*> node_blocks;
+        /// How many nodes of the last block have been handed out
+        size_t last_block_used = NODE_BLOCK_SIZE;
+        /// Nodes that have been removed from their haplotypes and can be reused
+        vector<HaplotypeNode*> free_nodes;
+        
+        /// Get a haplotype node from the blocks, reusing a removed one if we can
+        inline HaplotypeNode* new_haplotype_node(NodeTraversal node_traversal, HaplotypeNode* next,
+                                                 HaplotypeNode* prev);
+        
         // Helper function
         void build_site_indices_internal(const Snarl* snarl);
         
@@ -160,10 +174,12 @@ namespace vg {
         /// Node and strand
         NodeTraversal node_traversal;
         /// Next node in walk
-        HaplotypeNode* next;
+        HaplotypeNode* next = nullptr;
         /// Previous node in walk
-        HaplotypeNode* prev;
+        HaplotypeNode* prev = nullptr;
         
+        /// Default constructor, for allocating blocks of nodes
+        HaplotypeNode() = default;
         /// Constructor
         HaplotypeNode(NodeTraversal node_traversal, HaplotypeNode* next, HaplotypeNode* prev);
         /// Destructor
@@ -194,6 +210,9 @@ namespace vg {
     class PhasedGenome::Haplotype {
         
     private:
+        /// The genome whose blocks hold the nodes of this haplotype
+        PhasedGenome& genome;
+        
         /// Leftmost node in walk
         PhasedGenome::HaplotypeNode* left_telomere_node;
         /// Rightmost node in walk
@@ -206,12 +225,13 @@ namespace vg {
         unordered_map<const Snarl*, pair<HaplotypeNode*, HaplotypeNode*> > sites;
         
     public:
-        /// Construct a haplotype with a single node
-        Haplotype(NodeTraversal node_traversal);
+        /// Construct a haplotype with a single node, in the given genome's node blocks
+        Haplotype(PhasedGenome& genome, NodeTraversal node_traversal);
         
-        /// Construct a haplotype with an iterator that yields NodeTraversals
+        /// Construct a haplotype with an iterator that yields NodeTraversals,
+        /// in the given genome's node blocks
         template <typename NodeTraversalIterator>
-        Haplotype(NodeTraversalIterator first, NodeTraversalIterator last);
+        Haplotype(PhasedGenome& genome, NodeTraversalIterator first, NodeTraversalIterator last);
         
         ~Haplotype();
         
@@ -306,7 +326,7 @@ namespace vg {
         cerr << "[PhasedGenome::add_haplotype]: adding haplotype number " << haplotypes.size() << endl;
 #endif
         
-        Haplotype* haplotype = new Haplotype(first, last);
+        Haplotype* haplotype = new Haplotype(*this, first, last);
         haplotypes.push_back(haplotype);
         
         return haplotypes.size() - 1;
@@ -443,7 +463,8 @@ namespace vg {
     }
     
     template <typename NodeTraversalIterator>
-    PhasedGenome::Haplotype::Haplotype(NodeTraversalIterator first, NodeTraversalIterator last) {
+    PhasedGenome::Haplotype::Haplotype(PhasedGenome& genome, NodeTraversalIterator first,
+                                       NodeTraversalIterator last) : genome(genome) {
         
 #ifdef debug_phased_genome
         cerr << "[Haplotype::Haplotype]: constructing Haplotype at " << this << endl;
@@ -455,7 +476,7 @@ namespace vg {
         }
         
         // construct seed node
-        left_telomere_node = new HaplotypeNode(*first, nullptr, nullptr);
+        left_telomere_node = genome.new_haplotype_node(*first, nullptr, nullptr);
         right_telomere_node = left_telomere_node;
         first++;
         
@@ -473,14 +494,36 @@ namespace vg {
      *   INLINE FUNCTIONS
      */
     
+    inline PhasedGenome::HaplotypeNode* PhasedGenome::new_haplotype_node(NodeTraversal node_traversal,
+                                                                         HaplotypeNode* next,
+                                                                         HaplotypeNode* prev) {
+        HaplotypeNode* haplo_node;
+        if (!free_nodes.empty()) {
+            haplo_node = free_nodes.back();
+            free_nodes.pop_back();
+        }
+        else {
+            if (last_block_used == NODE_BLOCK_SIZE) {
+                node_blocks.push_back(new HaplotypeNode[NODE_BLOCK_SIZE]);
+                last_block_used = 0;
+            }
+            haplo_node = node_blocks.back() + last_block_used;
+            last_block_used++;
+        }
+        haplo_node->node_traversal = node_traversal;
+        haplo_node->next = next;
+        haplo_node->prev = prev;
+        return haplo_node;
+    }
+    
     inline PhasedGenome::HaplotypeNode* PhasedGenome::Haplotype::append_left(NodeTraversal node_traversal) {
-        left_telomere_node = new HaplotypeNode(node_traversal, left_telomere_node, nullptr);
+        left_telomere_node = genome.new_haplotype_node(node_traversal, left_telomere_node, nullptr);
         left_telomere_node->next->prev = left_telomere_node;
         return left_telomere_node;
     }
     
     inline PhasedGenome::HaplotypeNode* PhasedGenome::Haplotype::append_right(NodeTraversal node_traversal) {
-        right_telomere_node = new HaplotypeNode(node_traversal, nullptr, right_telomere_node);
+        right_telomere_node = genome.new_haplotype_node(node_traversal, nullptr, right_telomere_node);
         right_telomere_node->prev->next = right_telomere_node;
         
 #ifdef debug_phased_genome
@@ -492,7 +535,7 @@ namespace vg {
     
     inline void PhasedGenome::insert_left(NodeTraversal node_traversal, HaplotypeNode* haplo_node) {
         
-        HaplotypeNode* new_node = new HaplotypeNode(node_traversal, haplo_node, haplo_node->prev);
+        HaplotypeNode* new_node = new_haplotype_node(node_traversal, haplo_node, haplo_node->prev);
         haplo_node->prev->next = new_node;
         haplo_node->prev = new_node;
         
@@ -505,7 +548,7 @@ namespace vg {
     
     inline void PhasedGenome::insert_right(NodeTraversal node_traversal, HaplotypeNode* haplo_node) {
         
-        HaplotypeNode* new_node = new HaplotypeNode(node_traversal, haplo_node->next, haplo_node);
+        HaplotypeNode* new_node = new_haplotype_node(node_traversal, haplo_node->next, haplo_node);
         haplo_node->next->prev = new_node;
         haplo_node->next = new_node;
         
@@ -524,18 +567,21 @@ namespace vg {
         // remove the node from the node locations index
         int64_t node_id = haplo_node->node_traversal.node->id();
         
-        list<HaplotypeNode*>& node_occurrences = node_locations[node_id];
+        vector<HaplotypeNode*>& node_occurrences = node_locations[node_id];
 #ifdef debug_phased_genome
         cerr << "[PhasedGenome::remove]: node " << node_id << " occurs in " << node_occurrences.size() << " places, must search through each to find which to delete from indices" << endl;
 #endif
         for (auto iter = node_occurrences.begin(); iter != node_occurrences.end(); iter++) {
             if (*iter == haplo_node) {
-                node_occurrences.erase(iter);
+                // order doesn't matter, so fill the hole with the last occurrence
+                *iter = node_occurrences.back();
+                node_occurrences.pop_back();
                 break;
             }
         }
         
-        delete haplo_node;
+        // keep the node's slot in its block for the next insert
+        free_nodes.push_back(haplo_node);
     }
 }
 
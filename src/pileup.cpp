@@ -1,6 +1,8 @@
 #include <cstdlib>
 #include <stdexcept>
 #include <regex>
+#include <algorithm>
+#include <limits>
 #include "json2pb.h"
 #include "pileup.hpp"
 #include "stream.hpp"
@@ -9,6 +11,37 @@ using namespace std;
 
 namespace vg {
 
+const string CompactNodePileup::COMMON_TOKENS = ".,ACGTacgt";
+const size_t CompactNodePileup::COMMON_TOKEN_COUNT;
+const char CompactNodePileup::NO_QUALITY;
+const size_t CompactNodePileup::MAX_DEPTH;
+
+CompactNodePileup::CompactNodePileup(const string& sequence) {
+    grow(sequence.size());
+    ref_bases = sequence;
+}
+
+size_t CompactNodePileup::size() const {
+    return depths.size();
+}
+
+void CompactNodePileup::grow(size_t length, char ref_base) {
+    if (length > size()) {
+        ref_bases.resize(length, ref_base);
+        depths.resize(length, 0);
+        counts.resize(length * COMMON_TOKEN_COUNT, 0);
+        qualities.resize(length);
+    }
+}
+
+int CompactNodePileup::common_token_code(const string& token) {
+    if (token.size() != 1) {
+        return -1;
+    }
+    size_t found = COMMON_TOKENS.find(token[0]);
+    return found == string::npos ? -1 : (int) found;
+}
+
 void Pileups::clear() {
     for (auto& p : _node_pileups) {
         delete p.second;
@@ -26,8 +59,10 @@ void Pileups::clear() {
 
 void Pileups::to_json(ostream& out) {
     out << "{\"node_pileups\": [";
+    NodePileup node_pileup;
     for (NodePileupHash::iterator i = _node_pileups.begin(); i != _node_pileups.end();) {
-        out << pb2json(*i->second);
+        to_node_pileup(i->first, *i->second, node_pileup);
+        out << pb2json(node_pileup);
         ++i;
         if (i != _node_pileups.end()) {
             out << ",";
@@ -69,7 +104,7 @@ void Pileups::write(ostream& out, uint64_t chunk_size) {
         pileup.clear_edge_pileups();
         for (int j = 0; j < chunk_size && node_it != _node_pileups.end(); ++j, ++node_it) {
             NodePileup* np = pileup.add_node_pileups();
-            *np = *node_it->second;
+            to_node_pileup(node_it->first, *node_it->second, *np);
         }
         // unlike for Graph, we don't bother to try to group edges with nodes they attach
         for (int j = 0; j < chunk_size && edge_it != _edge_pileups.end(); ++j, ++edge_it) {
@@ -84,9 +119,85 @@ void Pileups::write(ostream& out, uint64_t chunk_size) {
 }
 
 void Pileups::for_each_node_pileup(const function<void(NodePileup&)>& lambda) {
+    NodePileup node_pileup;
     for (auto& p : _node_pileups) {
-        lambda(*p.second);
+        to_node_pileup(p.first, *p.second, node_pileup);
+        lambda(node_pileup);
+    }
+}
+
+bool Pileups::get_node_pileup(int64_t node_id, NodePileup& out) const {
+    auto p = _node_pileups.find(node_id);
+    if (p == _node_pileups.end()) {
+        return false;
     }
+    to_node_pileup(node_id, *p->second, out);
+    return true;
+}
+
+void Pileups::to_node_pileup(int64_t node_id, const CompactNodePileup& pileup, NodePileup& out) {
+    out.Clear();
+    out.set_node_id(node_id);
+
+    // rare tokens go after the common ones at their offset, in the order
+    // they were added
+    vector<const CompactNodePileup::RareToken*> rare;
+    rare.reserve(pileup.rare_tokens.size());
+    for (auto& rare_token : pileup.rare_tokens) {
+        rare.push_back(&rare_token);
+    }
+    stable_sort(rare.begin(), rare.end(), [](const CompactNodePileup::RareToken* a,
+                                             const CompactNodePileup::RareToken* b) {
+            return a->offset < b->offset;
+        });
+    auto next_rare = rare.begin();
+
+    for (size_t i = 0; i < pileup.size(); ++i) {
+        BasePileup* bp = out.add_base_pileup();
+        bp->set_ref_base((int)pileup.ref_bases[i]);
+        bp->set_num_bases(pileup.depths[i]);
+        string& bases = *bp->mutable_bases();
+        string& quals = *bp->mutable_qualities();
+        const string& common_quals = pileup.qualities[i];
+        size_t q = 0;
+        for (size_t code = 0; code < CompactNodePileup::COMMON_TOKEN_COUNT; ++code) {
+            uint16_t count = pileup.counts[i * CompactNodePileup::COMMON_TOKEN_COUNT + code];
+            bases.append(count, CompactNodePileup::COMMON_TOKENS[code]);
+            for (uint16_t j = 0; j < count; ++j, ++q) {
+                if (common_quals[q] != CompactNodePileup::NO_QUALITY) {
+                    quals += common_quals[q];
+                }
+            }
+        }
+        for (; next_rare != rare.end() && (*next_rare)->offset == i; ++next_rare) {
+            bases += (*next_rare)->token;
+            if ((*next_rare)->quality != CompactNodePileup::NO_QUALITY) {
+                quals += (*next_rare)->quality;
+            }
+        }
+    }
+}
+
+bool Pileups::add_token(CompactNodePileup& pileup, int64_t offset, const string& token, char quality) {
+    if (pileup.depths[offset] >= depth_limit()) {
+        return false;
+    }
+    int code = CompactNodePileup::common_token_code(token);
+    if (code >= 0) {
+        // keep the qualities grouped by token: this one goes after all the
+        // qualities for its token and the ones before it
+        uint16_t* counts = &pileup.counts[offset * CompactNodePileup::COMMON_TOKEN_COUNT];
+        size_t quality_offset = 0;
+        for (int i = 0; i <= code; ++i) {
+            quality_offset += counts[i];
+        }
+        pileup.qualities[offset].insert(quality_offset, 1, quality);
+        ++counts[code];
+    } else {
+        pileup.rare_tokens.push_back(CompactNodePileup::RareToken{(uint32_t)offset, quality, token});
+    }
+    ++pileup.depths[offset];
+    return true;
 }
 
 void Pileups::for_each_edge_pileup(const function<void(EdgePileup&)>& lambda) {
@@ -123,20 +234,39 @@ EdgePileup* Pileups::get_create_edge_pileup(pair<NodeSide, NodeSide> sides) {
 
 void Pileups::extend(Pileup& pileup) {
     for (int i = 0; i < pileup.node_pileups_size(); ++i) {
-        insert_node_pileup(new NodePileup(pileup.node_pileups(i)));
+        extend(pileup.node_pileups(i));
     }
     for (int i = 0; i < pileup.edge_pileups_size(); ++i) {
         insert_edge_pileup(new EdgePileup(pileup.edge_pileups(i)));
     }
 }
 
-bool Pileups::insert_node_pileup(NodePileup* pileup) {
-    NodePileup* existing = get_node_pileup(pileup->node_id());
+void Pileups::extend(const NodePileup& pileup) {
+    CompactNodePileup* compact = new CompactNodePileup();
+    compact->grow(pileup.base_pileup_size());
+    vector<pair<int64_t, int64_t> > offsets;
+    for (int i = 0; i < pileup.base_pileup_size(); ++i) {
+        const BasePileup& bp = pileup.base_pileup(i);
+        compact->ref_bases[i] = (char)bp.ref_base();
+        parse_base_offsets(bp, offsets);
+        for (size_t j = 0; j < offsets.size(); ++j) {
+            // pull out the token as it was written
+            int64_t token_end = j + 1 < offsets.size() ? offsets[j + 1].first : bp.bases().size();
+            string token = bp.bases().substr(offsets[j].first, token_end - offsets[j].first);
+            char quality = offsets[j].second >= 0 ? bp.qualities()[offsets[j].second] : CompactNodePileup::NO_QUALITY;
+            add_token(*compact, i, token, quality);
+        }
+    }
+    insert_node_pileup(pileup.node_id(), compact);
+}
+
+bool Pileups::insert_node_pileup(int64_t node_id, CompactNodePileup* pileup) {
+    CompactNodePileup* existing = get_node_pileup(node_id);
     if (existing != NULL) {
         merge_node_pileups(*existing, *pileup);
         delete pileup;
     } else {
-        _node_pileups[pileup->node_id()] = pileup;
+        _node_pileups[node_id] = pileup;
     }
     return existing == NULL;
 }
@@ -172,7 +302,7 @@ void Pileups::compute_from_alignment(Alignment& alignment) {
         int rank = mapping.rank() <= 0 ? i + 1 : mapping.rank(); 
         if (_graph->has_node(mapping.position().node_id())) {
             const Node* node = _graph->get_node(mapping.position().node_id());
-            NodePileup* pileup = get_create_node_pileup(node);
+            CompactNodePileup* pileup = owns_node(node->id()) ? get_create_node_pileup(node) : NULL;
             int64_t node_offset = mapping.position().offset();
             // utilize forward-relative node offset (old way), which
             // is not consistent with current protobuf.  conversion here.  
@@ -192,7 +322,7 @@ void Pileups::compute_from_alignment(Alignment& alignment) {
                 }
                 // process all pileups in edit.
                 // update the offsets as we go
-                compute_from_edit(*pileup, node_offset, read_offset, *node,
+                compute_from_edit(pileup, node_offset, read_offset, *node,
                                   alignment, mapping, edit, next_edit, mismatch_counts,
                                   last_match, last_del, open_del);
             }
@@ -235,7 +365,7 @@ void Pileups::compute_from_alignment(Alignment& alignment) {
                     char to_qual = alignment.quality()[in_read_offsets[rank2_idx]];
                     edge_qual = combined_quality(min(from_qual, to_qual), alignment.mapping_quality());
                 }
-                if (edge_qual >= _min_quality) {
+                if (edge_qual >= _min_quality && owns_node(min(s1, s2).node)) {
                     EdgePileup* edge_pileup = get_create_edge_pileup(pair<NodeSide, NodeSide>(s1, s2));
                     if (edge_pileup->num_reads() < _max_depth) {
                         edge_pileup->set_num_reads(edge_pileup->num_reads() + 1);
@@ -257,7 +387,7 @@ void Pileups::compute_from_alignment(Alignment& alignment) {
 
 }
 
-void Pileups::compute_from_edit(NodePileup& pileup, int64_t& node_offset,
+void Pileups::compute_from_edit(CompactNodePileup* pileup, int64_t& node_offset,
                                 int64_t& read_offset,
                                 const Node& node, const Alignment& alignment,
                                 const Mapping& mapping, const Edit& edit,
@@ -279,28 +409,16 @@ void Pileups::compute_from_edit(NodePileup& pileup, int64_t& node_offset,
         for (int64_t i = 0; i < edit.from_length(); ++i) {
             if (pass_filter(alignment, read_offset, 1, mismatch_counts)) {
                 // Don't go outside the node
-                if (node_offset >= _graph->get_node(pileup.node_id())->sequence().size()) {
-                    cerr << "error [vg::Pileups] node_offset of " << node_offset << " on " << pileup.node_id() << " is too big for node of size " << _graph->get_node(pileup.node_id())->sequence().size() << endl;
+                if (node_offset >= node.sequence().size()) {
+                    cerr << "error [vg::Pileups] node_offset of " << node_offset << " on " << node.id() << " is too big for node of size " << node.sequence().size() << endl;
                     cerr << "Alignment: " << pb2json(alignment) << endl;
                     throw runtime_error("Node offset too large in alignment");
                 }
-                BasePileup* base_pileup = get_create_base_pileup(pileup, node_offset);
-                if (base_pileup->num_bases() < _max_depth) {
-                    // reference_base if empty
-                    if (base_pileup->num_bases() == 0) {
-                        base_pileup->set_ref_base(node.sequence()[node_offset]);
-                    } else {
-                        assert(base_pileup->ref_base() == node.sequence()[node_offset]);
-                    }
-                    // add base to bases field (converting to ,. if match)
-                    char base = seq[i];
-                    *base_pileup->mutable_bases() += base;
-                    // add quality if there
-                    if (!alignment.quality().empty()) {
-                        *base_pileup->mutable_qualities() += alignment.quality()[read_offset];
-                    }
-                    // pileup size increases by 1
-                    base_pileup->set_num_bases(base_pileup->num_bases() + 1);
+                if (pileup != NULL) {
+                    assert(pileup->ref_bases[node_offset] == node.sequence()[node_offset]);
+                    // add base (converted to ,. if match), with its quality if there
+                    add_token(*pileup, node_offset, string(1, seq[i]),
+                              alignment.quality().empty() ? CompactNodePileup::NO_QUALITY : alignment.quality()[read_offset]);
                 }
                 // close off any open deletion
                 if (open_del.first != NULL) {
@@ -319,25 +437,15 @@ void Pileups::compute_from_edit(NodePileup& pileup, int64_t& node_offset,
                         dp_node_id = open_del.first->position().node_id();
                         dp_node_offset = open_del.second;
                     }
-                    Node* dp_node = _graph->get_node(dp_node_id);
-                    // Don't go outside the node
-                    assert(dp_node_offset < dp_node->sequence().size());
-                    NodePileup* dp_node_pileup = get_create_node_pileup(dp_node);
-                    BasePileup* dp_base_pileup = get_create_base_pileup(*dp_node_pileup, dp_node_offset);
-                    if (dp_base_pileup->num_bases() < _max_depth) {
-                        // reference_base if empty
-                        if (dp_base_pileup->num_bases() == 0) {
-                            dp_base_pileup->set_ref_base(dp_node->sequence()[dp_node_offset]);
-                        } else {
-                            assert(dp_base_pileup->ref_base() == dp_node->sequence()[dp_node_offset]);
-                        }
-                        *dp_base_pileup->mutable_bases() += del_seq;
-                        if (!alignment.quality().empty()) {
-                            // we only use quality of one endpoint here.  should average
-                            *dp_base_pileup->mutable_qualities() += combined_quality(alignment.quality()[read_offset],
-                                                                                     alignment.mapping_quality());
-                        }
-                        dp_base_pileup->set_num_bases(dp_base_pileup->num_bases() + 1);
+                    if (owns_node(dp_node_id)) {
+                        Node* dp_node = _graph->get_node(dp_node_id);
+                        // Don't go outside the node
+                        assert(dp_node_offset < dp_node->sequence().size());
+                        CompactNodePileup* dp_node_pileup = get_create_node_pileup(dp_node);
+                        // we only use quality of one endpoint here.  should average
+                        add_token(*dp_node_pileup, dp_node_offset, del_seq,
+                                  alignment.quality().empty() ? CompactNodePileup::NO_QUALITY :
+                                  combined_quality(alignment.quality()[read_offset], alignment.mapping_quality()));
                     }
                     open_del = make_pair((Mapping*)NULL, -1);
                     last_del = make_pair((Mapping*)NULL, -1);
@@ -359,29 +467,16 @@ void Pileups::compute_from_edit(NodePileup& pileup, int64_t& node_offset,
             // position (on forward node coordinates). this means an insertion before
             // offset 0 is invalid! 
             int64_t insert_offset =  map_reverse ? node_offset : node_offset - 1;
-            if (insert_offset >= 0 &&
+            if (pileup != NULL && insert_offset >= 0 &&
                 // make sure we have a match before and after the insert to take it seriously
                 next_edit != NULL && last_match.first != NULL &&
                 next_edit->from_length() == next_edit->to_length()) { 
                 // Don't go outside the node
-                assert(insert_offset < _graph->get_node(pileup.node_id())->sequence().size());       
-                BasePileup* base_pileup = get_create_base_pileup(pileup, insert_offset);
-                if (base_pileup->num_bases() < _max_depth) {
-                    // reference_base if empty
-                    if (base_pileup->num_bases() == 0) {
-                        base_pileup->set_ref_base(node.sequence()[insert_offset]);
-                    } else {
-                        assert(base_pileup->ref_base() == node.sequence()[insert_offset]);
-                    }
-                    // add insertion string to bases field
-                    base_pileup->mutable_bases()->append(seq);
-                    if (!alignment.quality().empty()) {
-                        *base_pileup->mutable_qualities() += combined_quality(alignment.quality()[read_offset],
-                                                                              alignment.mapping_quality());
-                    }
-                    // pileup size increases by 1
-                    base_pileup->set_num_bases(base_pileup->num_bases() + 1);
-                }
+                assert(insert_offset < node.sequence().size());       
+                // add insertion string
+                add_token(*pileup, insert_offset, seq,
+                          alignment.quality().empty() ? CompactNodePileup::NO_QUALITY :
+                          combined_quality(alignment.quality()[read_offset], alignment.mapping_quality()));
             }
             else {
                 // need to check with aligner to make sure this doesn't happen, ie
@@ -545,19 +640,21 @@ bool Pileups::pass_filter(const Alignment& alignment, int64_t read_offset,
             }
         }
     }
-    if (max_mismatch_fail) {
-        _max_mismatch_count += length;
-    }
-    if (min_quality_fail) {
-        _min_quality_count += length;
+    if (_count_filtered) {
+        if (max_mismatch_fail) {
+            _max_mismatch_count += length;
+        }
+        if (min_quality_fail) {
+            _min_quality_count += length;
+        }
+        _bases_count += length;
     }
-    _bases_count += length;
     return !max_mismatch_fail && !min_quality_fail;
 }
 
 Pileups& Pileups::merge(Pileups& other) {
     for (auto& p : other._node_pileups) {
-        insert_node_pileup(p.second);
+        insert_node_pileup(p.first, p.second);
     }
     other._node_pileups.clear();
     for (auto& p : other._edge_pileups) {
@@ -573,43 +670,44 @@ Pileups& Pileups::merge(Pileups& other) {
     return *this;
 }
 
-BasePileup& Pileups::merge_base_pileups(BasePileup& p1, BasePileup& p2) {
-    assert(p1.num_bases() == 0 || p2.num_bases() == 0 ||
-           p1.ref_base() == p2.ref_base());
-    if (p1.num_bases() == 0) {
-        p1.set_ref_base(p2.ref_base());
-    }
-    int merge_size = min(p2.num_bases(), _max_depth - p1.num_bases());
-    p1.set_num_bases(p1.num_bases() + merge_size);
-    if (merge_size == p2.num_bases()) {    
-        p1.mutable_bases()->append(p2.bases());
-        p1.mutable_qualities()->append(p2.qualities());
-    } else if (merge_size > 0) {
-        vector<pair<int64_t, int64_t> > offsets;
-        parse_base_offsets(p2, offsets);
-        int merge_length = offsets[merge_size].first;
-        p1.mutable_bases()->append(p2.bases().substr(0, merge_length));
-        if (!p2.qualities().empty()) {
-            p1.mutable_qualities()->append(p2.qualities().substr(0, merge_size));
+CompactNodePileup& Pileups::merge_node_pileups(CompactNodePileup& p1, CompactNodePileup& p2) {
+    p1.grow(p2.size());
+    size_t limit = depth_limit();
+    for (size_t i = 0; i < p2.size(); ++i) {
+        if (p2.depths[i] == 0) {
+            continue;
+        }
+        if (p1.depths[i] == 0) {
+            p1.ref_bases[i] = p2.ref_bases[i];
+        }
+        assert(p1.ref_bases[i] == p2.ref_bases[i]);
+        // interleave the qualities of each token, taking as many of p2's as fit
+        size_t room = limit > p1.depths[i] ? limit - p1.depths[i] : 0;
+        uint16_t* counts1 = &p1.counts[i * CompactNodePileup::COMMON_TOKEN_COUNT];
+        uint16_t* counts2 = &p2.counts[i * CompactNodePileup::COMMON_TOKEN_COUNT];
+        string merged;
+        merged.reserve(p1.qualities[i].size() + min(room, p2.qualities[i].size()));
+        size_t q1 = 0;
+        size_t q2 = 0;
+        for (size_t code = 0; code < CompactNodePileup::COMMON_TOKEN_COUNT; ++code) {
+            size_t take = min((size_t)counts2[code], room);
+            merged.append(p1.qualities[i], q1, counts1[code]);
+            merged.append(p2.qualities[i], q2, take);
+            q1 += counts1[code];
+            q2 += counts2[code];
+            counts1[code] += take;
+            p1.depths[i] += take;
+            room -= take;
         }
+        p1.qualities[i].swap(merged);
     }
-    p2.set_num_bases(0);
-    p2.clear_bases();
-    p2.clear_qualities();
-    return p1;
-}
-
-NodePileup& Pileups::merge_node_pileups(NodePileup& p1, NodePileup& p2) {
-    assert(p1.node_id() == p2.node_id());
-    // Don't go outside the node
-    assert(p1.base_pileup_size() <= _graph->get_node(p1.node_id())->sequence().size());
-    assert(p2.base_pileup_size() <= _graph->get_node(p2.node_id())->sequence().size());
-    for (int i = 0; i < p2.base_pileup_size(); ++i) {
-        BasePileup* bp1 = get_create_base_pileup(p1, i);
-        BasePileup* bp2 = get_base_pileup(p2, i);
-        merge_base_pileups(*bp1, *bp2);
+    for (auto& rare_token : p2.rare_tokens) {
+        if (p1.depths[rare_token.offset] < limit) {
+            ++p1.depths[rare_token.offset];
+            p1.rare_tokens.push_back(move(rare_token));
+        }
     }
-    p2.clear_base_pileup();
+    p2 = CompactNodePileup();
     return p1;
 }
 
@@ -824,4 +922,97 @@ string Pileups::extract(const BasePileup& bp, int64_t offset) {
     }
 }
 
+PileupShards::PileupShards(VG* graph, size_t shard_count, int min_quality, int max_mismatches,
+                           int window_size, int max_depth, bool use_mapq) : graph(graph) {
+    vector<int64_t> node_ids;
+    graph->for_each_node([&](Node* node) {
+            node_ids.push_back(node->id());
+        });
+    sort(node_ids.begin(), node_ids.end());
+    
+    shard_count = max(min(shard_count, node_ids.size()), (size_t)1);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shard_starts.push_back(node_ids.empty() ? 0 : node_ids[i * node_ids.size() / shard_count]);
+    }
+    
+    Pileups prototype(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards.emplace_back(new Shard(prototype));
+        // the first and last shards also take any IDs outside the graph
+        shards.back()->pileups.set_owned_nodes(i == 0 ? numeric_limits<int64_t>::min() : shard_starts[i],
+                                               i + 1 == shard_count ? numeric_limits<int64_t>::max() :
+                                               shard_starts[i + 1] - 1);
+    }
+}
+
+size_t PileupShards::shard_of(int64_t node_id) const {
+    auto next = upper_bound(shard_starts.begin(), shard_starts.end(), node_id);
+    return next == shard_starts.begin() ? 0 : next - shard_starts.begin() - 1;
+}
+
+void PileupShards::add_alignment(const Alignment& alignment) {
+    // find the distinct shards the alignment visits
+    vector<size_t> touched;
+    for (size_t i = 0; i < alignment.path().mapping_size(); ++i) {
+        touched.push_back(shard_of(alignment.path().mapping(i).position().node_id()));
+    }
+    sort(touched.begin(), touched.end());
+    touched.erase(unique(touched.begin(), touched.end()), touched.end());
+    
+    for (size_t shard_number : touched) {
+        Shard& shard = *shards[shard_number];
+        bool full;
+        {
+            lock_guard<mutex> guard(shard.queue_mutex);
+            shard.queue.push_back(alignment);
+            full = shard.queue.size() >= queue_size;
+        }
+        // if someone else is already working on this shard, they will get
+        // to our alignment
+        if (full && shard.work_mutex.try_lock()) {
+            drain(shard_number);
+            shard.work_mutex.unlock();
+        }
+    }
+}
+
+void PileupShards::drain(size_t shard_number) {
+    Shard& shard = *shards[shard_number];
+    vector<Alignment> work;
+    while (true) {
+        {
+            lock_guard<mutex> guard(shard.queue_mutex);
+            if (shard.queue.empty()) {
+                break;
+            }
+            swap(work, shard.queue);
+        }
+        for (Alignment& alignment : work) {
+            // only count filtered bases in one of the shards each alignment
+            // goes to
+            shard.pileups._count_filtered = alignment.path().mapping_size() == 0 ||
+                shard_of(alignment.path().mapping(0).position().node_id()) == shard_number;
+            shard.pileups.compute_from_alignment(alignment);
+        }
+        work.clear();
+    }
+}
+
+Pileups* PileupShards::finish() {
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < shards.size(); ++i) {
+        lock_guard<mutex> guard(shards[i]->work_mutex);
+        drain(i);
+    }
+
+    const Pileups& first = shards.front()->pileups;
+    Pileups* combined = new Pileups(graph, first._min_quality, first._max_mismatches, first._window_size,
+                                    first._max_depth, first._use_mapq);
+    for (auto& shard : shards) {
+        // no keys are shared, so this only moves pointers
+        combined->merge(shard->pileups);
+    }
+    return combined;
+}
+
 }
@@ -4,6 +4,11 @@
 #include <iostream>
 #include <algorithm>
 #include <functional>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
 #include "vg.pb.h"
 #include "vg.hpp"
 #include "hash_map.hpp"
@@ -13,8 +18,56 @@ namespace vg {
 
 using namespace std;
 
-/// This is a collection of protobuf NodePileup records that are indexed
-/// on their position, as well as EdgePileup records.
+/// The piled-up bases for one node, stored by column instead of as a
+/// NodePileup with a BasePileup (and two strings) per base. The ten common
+/// tokens (matches and SNPs on either strand) are just counted at each
+/// offset, with their qualities kept grouped by token. Everything else
+/// (inserts, deletes, Ns) goes in a side table. Pileups only builds the
+/// protobuf version when it is asked for.
+struct CompactNodePileup {
+    /// The tokens that are counted instead of stored
+    static const string COMMON_TOKENS;
+    /// How many of them there are
+    static const size_t COMMON_TOKEN_COUNT = 10;
+    /// Stands in for the quality of a token from a read without qualities
+    static const char NO_QUALITY = (char) 0xFF;
+    /// The most tokens any offset can hold
+    static const size_t MAX_DEPTH = UINT16_MAX;
+
+    /// A token that isn't one of the common ones
+    struct RareToken {
+        uint32_t offset;
+        char quality;
+        string token;
+    };
+
+    /// Make an empty pileup for the given node sequence
+    CompactNodePileup(const string& sequence = "");
+
+    /// Get the number of offsets
+    size_t size() const;
+    /// Make sure there are at least the given number of offsets, with the
+    /// given reference base for any new ones
+    void grow(size_t length, char ref_base = 'N');
+
+    /// Get the index of the given token in COMMON_TOKENS, or -1 if it is rare
+    static int common_token_code(const string& token);
+
+    /// Reference base at each offset
+    string ref_bases;
+    /// Number of tokens at each offset
+    vector<uint16_t> depths;
+    /// Count of each common token at each offset, COMMON_TOKEN_COUNT per offset
+    vector<uint16_t> counts;
+    /// For each offset, the qualities of its common tokens, grouped by token
+    /// in COMMON_TOKENS order
+    vector<string> qualities;
+    /// All the other tokens, in the order they were added
+    vector<RareToken> rare_tokens;
+};
+
+/// This is a collection of node pileups, kept as CompactNodePileups and
+/// indexed on their node ID, as well as EdgePileup records.
 /// Pileups can be merged and streamed, and computed
 /// from Alignments.  The pileup records themselves are essentially
 /// protobuf versions of lines in Samtools pileup format, with deletions
@@ -32,7 +85,10 @@ public:
         _min_quality_count(0),
         _max_mismatch_count(0),
         _bases_count(0),
-        _use_mapq(use_mapq)
+        _use_mapq(use_mapq),
+        _min_owned_id(numeric_limits<int64_t>::min()),
+        _max_owned_id(numeric_limits<int64_t>::max()),
+        _count_filtered(true)
 {}
     
     /// copy constructor
@@ -40,7 +96,7 @@ public:
         if (this != &other) {
             _graph = other._graph;
             for (auto& p : other._node_pileups) {
-                insert_node_pileup(new NodePileup(*p.second));
+                insert_node_pileup(p.first, new CompactNodePileup(*p.second));
             }
             _min_quality = other._min_quality;
             _max_mismatches = other._max_mismatches;
@@ -50,6 +106,12 @@ public:
             _max_mismatch_count = other._max_mismatch_count;
             _bases_count = other._bases_count;
             _use_mapq = other._use_mapq;
+        _min_owned_id = other._min_owned_id;
+        _max_owned_id = other._max_owned_id;
+        _count_filtered = other._count_filtered;
+            _min_owned_id = other._min_owned_id;
+            _max_owned_id = other._max_owned_id;
+            _count_filtered = other._count_filtered;
         }
     }
 
@@ -66,6 +128,9 @@ public:
         _max_mismatch_count = other._max_mismatch_count;
         _bases_count = other._bases_count;
         _use_mapq = other._use_mapq;
+        _min_owned_id = other._min_owned_id;
+        _max_owned_id = other._max_owned_id;
+        _count_filtered = other._count_filtered;
     }
 
     /// copy assignment operator
@@ -88,6 +153,9 @@ public:
         _max_mismatch_count = other._max_mismatch_count;
         _bases_count = other._bases_count;
         _use_mapq = other._use_mapq;
+        _min_owned_id = other._min_owned_id;
+        _max_owned_id = other._max_owned_id;
+        _count_filtered = other._count_filtered;
         return *this;
     }
 
@@ -97,12 +165,12 @@ public:
     }
     void clear();
 
-    typedef hash_map<int64_t, NodePileup*> NodePileupHash;
+    typedef hash_map<int64_t, CompactNodePileup*> NodePileupHash;
     typedef pair_hash_map<pair<NodeSide, NodeSide>, EdgePileup*> EdgePileupHash;
 
     VG* _graph;
     
-    /// This maps from Position to Pileup.
+    /// This maps from node ID to Pileup.
     NodePileupHash _node_pileups;
     EdgePileupHash _edge_pileups;
 
@@ -122,6 +190,25 @@ public:
     mutable uint64_t _max_mismatch_count;
     /// overall count for perspective on above
     mutable uint64_t _bases_count;
+    /// only record tokens on nodes with IDs in this range, and edges whose
+    /// canonical first side is on one of them
+    int64_t _min_owned_id;
+    int64_t _max_owned_id;
+    /// toggle whether pass_filter updates the counts above
+    bool _count_filtered;
+
+    /// restrict these pileups to the nodes with IDs in [min_id, max_id]. the
+    /// whole of each alignment is still walked, so deletions and edges that
+    /// leave the range are seen the same way as without a restriction.
+    void set_owned_nodes(int64_t min_id, int64_t max_id) {
+        _min_owned_id = min_id;
+        _max_owned_id = max_id;
+    }
+
+    /// are tokens on the given node recorded here?
+    bool owns_node(int64_t node_id) const {
+        return node_id >= _min_owned_id && node_id <= _max_owned_id;
+    }
 
     /// write to JSON
     void to_json(ostream& out);
@@ -130,31 +217,41 @@ public:
     /// write to protobuf
     void write(ostream& out, uint64_t buffer_size = 5);
 
-    /// apply function to each pileup in table
+    /// apply function to each pileup in table, converted to a NodePileup.
+    /// The NodePileup is reused between calls.
     void for_each_node_pileup(const function<void(NodePileup&)>& lambda);
 
     /// search hash table for node id
-    NodePileup* get_node_pileup(int64_t node_id) {
+    CompactNodePileup* get_node_pileup(int64_t node_id) {
         auto p = _node_pileups.find(node_id);
         return p != _node_pileups.end() ? p->second : NULL;
     }
         
     /// get a pileup.  if it's null, create a new one and insert it.
-    NodePileup* get_create_node_pileup(const Node* node) {
-      NodePileup* p = get_node_pileup(node->id());
+    CompactNodePileup* get_create_node_pileup(const Node* node) {
+        CompactNodePileup* p = get_node_pileup(node->id());
         if (p == NULL) {
-            p = new NodePileup();
-            p->set_node_id(node->id());
-            for (int i = 0; i < node->sequence().length(); ++i) {
-                BasePileup* b = p->add_base_pileup();
-                b->set_num_bases(0);
-                b->set_ref_base((int)node->sequence()[i]);
-            }
+            p = new CompactNodePileup(node->sequence());
             _node_pileups[node->id()] = p;
         }
         return p;
     }
 
+    /// convert the pileup for the given node to protobuf form. returns false
+    /// if there is no pileup for the node.
+    bool get_node_pileup(int64_t node_id, NodePileup& out) const;
+
+    /// convert a compact pileup to protobuf form
+    static void to_node_pileup(int64_t node_id, const CompactNodePileup& pileup, NodePileup& out);
+
+    /// add a compact pileup for the given node, made from a protobuf one
+    void extend(const NodePileup& pileup);
+
+    /// add a token to the given offset of a pileup, unless it is already at
+    /// the max depth. quality is CompactNodePileup::NO_QUALITY if the read
+    /// has none. returns true if the token was added.
+    bool add_token(CompactNodePileup& pileup, int64_t offset, const string& token, char quality);
+
     void for_each_edge_pileup(const function<void(EdgePileup&)>& lambda);
 
     /// search hash table for edge id
@@ -167,15 +264,16 @@ public:
 
     /// insert a pileup into the table. it will be deleted by ~Pileups()!!!
     /// return true if new pileup inserted, false if merged into existing one
-    bool insert_node_pileup(NodePileup* pileup);
+    bool insert_node_pileup(int64_t node_id, CompactNodePileup* pileup);
     bool insert_edge_pileup(EdgePileup* edge_pileup);
     
     /// create / update all pileups from a single alignment
     void compute_from_alignment(Alignment& alignment);
 
     /// create / update all pileups from an edit (called by above).
-    /// query stores the current position (and nothing else).  
-    void compute_from_edit(NodePileup& pileup, int64_t& node_offset, int64_t& read_offset,
+    /// query stores the current position (and nothing else).  pileup is
+    /// null if the node isn't owned.
+    void compute_from_edit(CompactNodePileup* pileup, int64_t& node_offset, int64_t& read_offset,
                            const Node& node, const Alignment& alignment,
                            const Mapping& mapping, const Edit& edit,
                            const Edit* next_edit,
@@ -200,15 +298,18 @@ public:
     /// other will be left empty. this is returned
     Pileups& merge(Pileups& other);
 
-    /// merge p2 into p1 and return 1. p2 is left an empty husk
-    BasePileup& merge_base_pileups(BasePileup& p1, BasePileup& p2);
-
-    /// merge p2 into p1 and return 1. p2 is lef an empty husk
-    NodePileup& merge_node_pileups(NodePileup& p1, NodePileup& p2);
+    /// merge p2 into p1 and return 1. p2 is lef an empty husk. when an offset
+    /// would go over the max depth, common tokens are kept before rare ones.
+    CompactNodePileup& merge_node_pileups(CompactNodePileup& p1, CompactNodePileup& p2);
     
     /// merge p2 into p1 and return 1. p2 is lef an empty husk
     EdgePileup& merge_edge_pileups(EdgePileup& p1, EdgePileup& p2);
 
+    /// get the most tokens we keep at any offset
+    size_t depth_limit() const {
+        return min((size_t)max(_max_depth, 0), CompactNodePileup::MAX_DEPTH);
+    }
+
     /// create combine map quality (optionally) with base quality
     char combined_quality(char base_quality, int map_quality) const {
         if (!_use_mapq) {
@@ -275,7 +376,56 @@ public:
     static string extract(const BasePileup& bp, int64_t offset);
 };
 
+/// Computes Pileups from many threads at once without keeping a full Pileups
+/// per thread and merging them at the end. The graph's node IDs are split
+/// into ranges, each with its own Pileups that only records tokens on its
+/// own nodes. Each alignment is queued for every shard whose nodes it visits,
+/// and a thread that fills a shard's queue drains it, if no other thread is
+/// already working on that shard. Since the shards share no nodes, combining
+/// them at the end just moves their records.
+class PileupShards {
+public:
 
+    /// make shard_count shards over the nodes of the graph, with about the
+    /// same number of nodes in each. the other arguments are as for Pileups.
+    PileupShards(VG* graph, size_t shard_count, int min_quality = 0, int max_mismatches = 1,
+                 int window_size = 0, int max_depth = 1000, bool use_mapq = false);
+
+    /// queue an alignment for all the shards it touches, and do some of the
+    /// queued work. safe to call from multiple threads.
+    void add_alignment(const Alignment& alignment);
+
+    /// do all the remaining work, in parallel over the shards, and return a
+    /// Pileups holding everything, which the caller owns. the shards are left
+    /// empty.
+    Pileups* finish();
+
+    /// how many alignments may wait on a shard before it gets drained
+    size_t queue_size = 256;
+
+private:
+
+    struct Shard {
+        Shard(const Pileups& pileups) : pileups(pileups) {}
+        Pileups pileups;
+        /// alignments waiting to be added, protected by queue_mutex
+        vector<Alignment> queue;
+        mutex queue_mutex;
+        /// held by the thread adding alignments to pileups
+        mutex work_mutex;
+    };
+
+    /// get the shard that owns the given node
+    size_t shard_of(int64_t node_id) const;
+
+    /// add all the queued alignments to the shard. work_mutex must be held.
+    void drain(size_t shard_number);
+
+    VG* graph;
+    /// the first node ID of each shard
+    vector<int64_t> shard_starts;
+    vector<unique_ptr<Shard>> shards;
+};
 
 }
 
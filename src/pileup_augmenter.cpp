@@ -145,66 +145,71 @@ void PileupAugmenter::update_augmented_graph() {
                               support);
     };            
 
-    function<void(bool)> process_augmented_edges = [&](bool pass1) {
-        for (auto& i : _augmented_edges) {
-            auto& sides = i.first;
-            char cat = i.second;
-            NodeOffSide os1 = sides.first;
-            Node* node1;
-            bool aug1;
-            if (_graph->has_node(os1.first.node)) {
-                node1 = _graph->get_node(os1.first.node);
-                aug1 = true;
-            } else {
-                // snp or isnert node -- need to get from call grpah
-                // note : that we should never break these as they aren't in
-                // the divider structure (will be caught down the road)
-                node1 = _augmented_graph.graph.get_node(os1.first.node);
-                aug1 = false;
-            }
-            int from_offset = os1.second;
-            bool left1 = !os1.first.is_end;
-            NodeOffSide os2 = sides.second;
-            Node* node2;
-            bool aug2;
-            if (_graph->has_node(os2.first.node)) {
-                node2 = _graph->get_node(os2.first.node);
-                aug2 = true;
-            } else {
-                // snp or insert node -- need to get from call graph
-                node2 = _augmented_graph.graph.get_node(os2.first.node);
-                aug2 = false;
-            }
-            // only need to pass support for here insertions, other cases handled elsewhere
-            StrandSupport support(-1, -1);
-            if (cat == 'I') {
-                auto ins_it = _inserted_nodes.find(os1.first.node);
-                if (ins_it != _inserted_nodes.end()) {
-                    support = ins_it->second.sup;
-                } else {
-                    ins_it = _inserted_nodes.find(os2.first.node);
-                    assert(ins_it != _inserted_nodes.end());
-                    support = ins_it->second.sup;
-                }
-                assert(support.fs >= 0 && support.rs >= 0);
-            }
-            int to_offset = os2.second;
-            bool left2 = !os2.first.is_end;
-            // todo: clean this up
-            if (!pass1) {
-              create_augmented_edge(node1, from_offset, left1, aug1,  node2, to_offset, left2, aug2, cat, support);
-            } else {
-                _node_divider.break_end(node1, &_augmented_graph.graph, from_offset, left1);
-                _node_divider.break_end(node2, &_augmented_graph.graph, to_offset, left2);
+    // find every place an augmented edge attaches to the middle of a
+    // fragment, so each fragment can be divided once up front instead of
+    // once per edge end.  ordered so node ids come out the same every time.
+    map<int64_t, set<int>> fragment_starts;
+    for (auto& i : _augmented_edges) {
+        for (const NodeOffSide* os : {&i.first.first, &i.first.second}) {
+            // snp and insert nodes are never divided
+            if (_graph->has_node(os->first.node)) {
+                // a left side starts a fragment, a right side ends one
+                fragment_starts[os->first.node].insert(!os->first.is_end ? os->second : os->second + 1);
             }
         }
-    };
+    }
+    for (auto& i : fragment_starts) {
+        _node_divider.break_at(_graph->get_node(i.first), &_augmented_graph.graph, i.second);
+    }
 
-    // two passes here is a hack to make sure break_end is called on all edge ends
-    // before processing any of them. 
-    process_augmented_edges(true);
     _graph->for_each_edge(map_edge);
-    process_augmented_edges(false);
+
+    for (auto& i : _augmented_edges) {
+        auto& sides = i.first;
+        char cat = i.second;
+        NodeOffSide os1 = sides.first;
+        Node* node1;
+        bool aug1;
+        if (_graph->has_node(os1.first.node)) {
+            node1 = _graph->get_node(os1.first.node);
+            aug1 = true;
+        } else {
+            // snp or isnert node -- need to get from call grpah
+            // note : that we should never break these as they aren't in
+            // the divider structure (will be caught down the road)
+            node1 = _augmented_graph.graph.get_node(os1.first.node);
+            aug1 = false;
+        }
+        int from_offset = os1.second;
+        bool left1 = !os1.first.is_end;
+        NodeOffSide os2 = sides.second;
+        Node* node2;
+        bool aug2;
+        if (_graph->has_node(os2.first.node)) {
+            node2 = _graph->get_node(os2.first.node);
+            aug2 = true;
+        } else {
+            // snp or insert node -- need to get from call graph
+            node2 = _augmented_graph.graph.get_node(os2.first.node);
+            aug2 = false;
+        }
+        // only need to pass support for here insertions, other cases handled elsewhere
+        StrandSupport support(-1, -1);
+        if (cat == 'I') {
+            auto ins_it = _inserted_nodes.find(os1.first.node);
+            if (ins_it != _inserted_nodes.end()) {
+                support = ins_it->second.sup;
+            } else {
+                ins_it = _inserted_nodes.find(os2.first.node);
+                assert(ins_it != _inserted_nodes.end());
+                support = ins_it->second.sup;
+            }
+            assert(support.fs >= 0 && support.rs >= 0);
+        }
+        int to_offset = os2.second;
+        bool left2 = !os2.first.is_end;
+        create_augmented_edge(node1, from_offset, left1, aug1,  node2, to_offset, left2, aug2, cat, support);
+    }
 
     // Annotate all the nodes in the divider structure in the AugmentedGraph
     annotate_augmented_nodes();
@@ -1079,6 +1084,68 @@ NodeDivider::Entry NodeDivider::break_end(const Node* orig_node, VG* graph, int
     return ret;
 }
 
+void NodeDivider::break_at(const Node* orig_node, VG* graph, const set<int>& starts) {
+    NodeHash::iterator i = index.find(orig_node->id());
+    if (i == index.end()) {
+        return;
+    }
+    NodeMap& node_map = i->second;
+
+    // new fragments get added to the map after we're done walking it
+    struct Piece {
+        int offset;
+        EntryCat cat;
+        Node* node;
+        vector<StrandSupport> sup;
+    };
+    vector<Piece> pieces;
+
+    for (auto& j : node_map) {
+        int sub_offset = j.first;
+        for (int c = 0; c < (int)EntryCat::Last; ++c) {
+            Node* fragment = j.second[c];
+            if (fragment == NULL) {
+                continue;
+            }
+            int frag_len = fragment->sequence().length();
+            set<int>::const_iterator start = starts.upper_bound(sub_offset);
+            if (start == starts.end() || *start >= sub_offset + frag_len) {
+                // nothing to cut
+                continue;
+            }
+            string frag_seq = fragment->sequence();
+            vector<StrandSupport>& sup = j.second.sup(c);
+            vector<StrandSupport> frag_sup = sup;
+
+            // the existing node keeps the leftmost piece
+            int piece_start = sub_offset;
+            int piece_end = *start;
+            *fragment->mutable_sequence() = frag_seq.substr(0, piece_end - sub_offset);
+            if (!sup.empty()) {
+                sup.resize(piece_end - sub_offset);
+            }
+            // and we make new nodes for the rest
+            while (piece_end < sub_offset + frag_len) {
+                piece_start = piece_end;
+                ++start;
+                piece_end = start == starts.end() ? sub_offset + frag_len : min(*start, sub_offset + frag_len);
+                Node* new_node = graph->create_node(frag_seq.substr(piece_start - sub_offset, piece_end - piece_start),
+                                                    ++(*_max_id));
+                vector<StrandSupport> new_sup;
+                if (!frag_sup.empty()) {
+                    new_sup.assign(frag_sup.begin() + (piece_start - sub_offset),
+                                   frag_sup.begin() + (piece_end - sub_offset));
+                }
+                pieces.push_back(Piece{piece_start, (EntryCat)c, new_node, new_sup});
+            }
+        }
+    }
+
+    for (auto& piece : pieces) {
+        add_fragment(orig_node, piece.offset, piece.node, piece.cat, piece.sup);
+    }
+}
+
 // this function only works if node is completely covered in divider structure,
 list<Mapping> NodeDivider::map_node(int64_t node_id, int64_t start_offset, int64_t length, bool reverse){
     NodeHash::iterator i = index.find(node_id);
@@ -1181,4 +1248,65 @@ ostream& operator<<(ostream& os, const PileupAugmenter::NodeOffSide& no) {
     return os;
 }
 
+void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
+                          bool show_progress) {
+    
+    if (show_progress) {
+        cerr << "Computing augmented graph from the pileup" << endl;
+    }
+
+    pileups.for_each_node_pileup([&](const NodePileup& node_pileup) {
+            if (!augmenter._graph->has_node(node_pileup.node_id())) {
+                // This pileup doesn't belong in this graph
+                if(!expect_subgraph) {
+                    throw runtime_error("Found pileup for nonexistent node " + to_string(node_pileup.node_id()));
+                }
+                // If that's expected, just skip it
+                return;
+            }
+            // Send approved pileups to the augmenter
+            augmenter.call_node_pileup(node_pileup);
+            
+        });
+
+    pileups.for_each_edge_pileup([&](const EdgePileup& edge_pileup) {
+            if (!augmenter._graph->has_edge(edge_pileup.edge())) {
+                // This pileup doesn't belong in this graph
+                if(!expect_subgraph) {
+                    throw runtime_error("Found pileup for nonexistent edge " + pb2json(edge_pileup.edge()));
+                }
+                // If that's expected, just skip it
+                return;
+            }
+            // Send approved pileups to the augmenter
+            augmenter.call_edge_pileup(edge_pileup);            
+        });
+
+    // map the edges from original graph
+    if (show_progress) {
+        cerr << "Mapping edges into augmented graph" << endl;
+    }
+    augmenter.update_augmented_graph();
+
+    // map the paths from the original graph
+    if (show_progress) {
+        cerr << "Mapping paths into augmented graph" << endl;
+    }
+    augmenter.map_paths();
+}
+
+void add_trivial_edits(VG& graph) {
+    for (auto& name_and_mappings : graph.paths._paths) {
+        for (auto& mapping : name_and_mappings.second) {
+            if (mapping.edit_size() == 0) {
+                Edit* edit = mapping.add_edit();
+                int64_t offset = mapping.position().offset();
+                int64_t length = graph.get_node(mapping.position().node_id())->sequence().length();
+                edit->set_from_length(length);
+                edit->set_to_length(length);
+            }
+        }
+    }
+}
+
 }
@@ -9,6 +9,8 @@
 #include <cmath>
 #include <limits>
 #include <unordered_set>
+#include <set>
+#include <map>
 #include <tuple>
 #include "vg.pb.h"
 #include "vg.hpp"
@@ -137,6 +139,10 @@ struct NodeDivider {
     // break node if necessary so that we can attach edge at specified side
     // this function wil return NULL if there's no node covering the given location
     Entry break_end(const Node* orig_node, VG* graph, int offset, bool left_side);
+    // break all fragments of a node so that a fragment starts at each of the given offsets,
+    // splitting each fragment only once.  doing this for all edge ends before linking
+    // anything means break_end never has to split anything afterwards
+    void break_at(const Node* orig_node, VG* graph, const set<int>& starts);
     // assuming input node is fully covered, list of nodes that correspond to it in call graph
     // if node not in structure at all, just return input (assumption uncalled nodes kept as is)
     list<Mapping> map_node(int64_t node_id, int64_t start_offset, int64_t length, bool reverse);
@@ -320,6 +326,16 @@ public:
 
 ostream& operator<<(ostream& os, const PileupAugmenter::NodeOffSide& no);
 
+/// Augment the augmenter's graph with all the given pileups. If expect_subgraph
+/// is set, pileups for nodes and edges not in the graph are skipped rather than
+/// being an error.
+void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
+                          bool show_progress = false);
+
+/// The pileup augmenter assumes even trivial from/to lengths are set for each
+/// mapping, so fill them in on all the graph's paths.
+void add_trivial_edits(VG& graph);
+
 
 }
 
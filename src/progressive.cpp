@@ -6,8 +6,26 @@ namespace vg {
 
 using namespace std;
 
+/// How often does the reporter thread redraw the progress bar?
+static const chrono::milliseconds REPORT_INTERVAL(200);
+
+Progressive::Progressive(const Progressive& other) : show_progress(other.show_progress) {
+    // Nothing else to copy
+}
+
+Progressive& Progressive::operator=(const Progressive& other) {
+    show_progress = other.show_progress;
+    return *this;
+}
+
+Progressive::~Progressive() {
+    stop_reporter();
+    delete progress;
+}
+
 void Progressive::create_progress(const string& message, long count) {
     if (show_progress) {
+        stop_reporter();
         progress_message = message;
         create_progress(count);
     }
@@ -15,16 +33,23 @@ void Progressive::create_progress(const string& message, long count) {
 
 void Progressive::create_progress(long count) {
     if (show_progress) {
-        progress_count = count;
-        last_progress = 0;
-        progress_seen = 0;
+        stop_reporter();
         if (progress) {
             // Get rid of the old one.
             delete progress;
         }
+        
+        progress_count = count;
+        progress_updated.store(0, memory_order_relaxed);
+        thread_progress = vector<ThreadProgress>(omp_get_max_threads());
+        progress_start = chrono::steady_clock::now();
+        
         progress_message.resize(30, ' ');
         progress = new ProgressBar(progress_count, progress_message.c_str());
         progress->Progressed(0);
+        
+        reporter_stop = false;
+        reporter = thread(&Progressive::run_reporter, this);
     }
 }
 
@@ -37,54 +62,53 @@ void Progressive::preload_progress(const string& message) {
     }
 }
 
-void Progressive::update_progress(long i) {
-    if (show_progress && progress) {
-        if ((i <= progress_count
-             && (long double) (i - last_progress) / (long double) progress_count >= 0.001)
-            || i == progress_count) {
-#pragma omp critical (progress)
-            {
-                progress->Progressed(i);
-                last_progress = i;
-            }
-        }
-#pragma omp critical (progress_seen)
-        {
-            // Remember the amout of progress we have seen.
-            progress_seen = i;
+long Progressive::progress_done() const {
+    if (!progress) {
+        return 0;
+    }
+    long done = progress_updated.load(memory_order_relaxed);
+    for (auto& counter : thread_progress) {
+        done += counter.increments.load(memory_order_relaxed);
+    }
+    return done;
+}
+
+double Progressive::progress_rate() const {
+    if (!progress) {
+        return 0;
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - progress_start;
+    return elapsed.count() > 0 ? progress_done() / elapsed.count() : 0;
+}
+
+void Progressive::run_reporter() {
+    long last_progress = 0;
+    unique_lock<mutex> lock(reporter_mutex);
+    while (!reporter_stop) {
+        reporter_wakeup.wait_for(lock, REPORT_INTERVAL);
+        long done = min(progress_done(), progress_count);
+        if (done > last_progress) {
+            progress->Progressed(done);
+            last_progress = done;
         }
     }
 }
 
-void Progressive::increment_progress() {
-#pragma omp critical (increment_progress)
-    {
-        // Only one increment can happen at a time, so we don't get lower values
-        // coming after higher values because the increments and the displays
-        // interleaved.
-
-        // What should we set the progress bar to?
-        size_t new_progress;
-
-#pragma omp critical (progress_seen)
-        {   
-            // We need to synchronize with update calls.
-            
-            // Bump up whatever we have to 1 more than that.
-            new_progress = progress_seen + 1;
+void Progressive::stop_reporter() {
+    if (reporter.joinable()) {
+        {
+            lock_guard<mutex> lock(reporter_mutex);
+            reporter_stop = true;
         }
-        
-        // TODO: interleaving updates and increments from different threads will
-        // be weird, and progress may go backward. But that makes no real sense
-        // anyway, so we just have to not explode/deadlock when it happens.
-    
-        update_progress(new_progress);
+        reporter_wakeup.notify_one();
+        reporter.join();
     }
 }
 
 void Progressive::destroy_progress(void) {
+    stop_reporter();
     if (show_progress && progress) {
-        update_progress(progress_count);
+        progress->Progressed(progress_count);
         cerr << endl;
         progress_message = "progress";
         progress_count = 0;
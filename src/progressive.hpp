@@ -5,6 +5,13 @@
 // progress bar that can be turned on and off.
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <omp.h>
 
 #include "progress_bar.hpp"
 
@@ -17,7 +24,11 @@ using namespace std;
  * update_progress(), and destroy_progress() methods, and a public show_progress
  * field that can be toggled on and off.
  *
- * Must not be destroyed while a progress bar is active.
+ * Progress is counted in relaxed atomics, with a separate counter for each
+ * OpenMP thread, so the update methods are cheap enough to call from inside
+ * parallel loops. While a progress bar exists, a background thread wakes up a
+ * few times a second to draw it, so no thread doing the work ever has to wait
+ * on the terminal.
  */
 class Progressive {
 
@@ -25,6 +36,14 @@ public:
     // Should progress bars be shown when the progress methods are called?
     bool show_progress = false;
     
+    Progressive() = default;
+    /// Copies only whether progress should be shown, not any progress bar.
+    Progressive(const Progressive& other);
+    /// Copies only whether progress should be shown, not any progress bar.
+    Progressive& operator=(const Progressive& other);
+    /// Stops drawing any progress bar that still exists.
+    ~Progressive();
+    
     /**
      * If no progress bar is currently displayed, set the message to use for
      * the next progress bar to be created. Does nothing if show_progress is
@@ -49,32 +68,87 @@ public:
     void create_progress(long count);
     /**
      * Update the progress bar, noting that the given number of items have been
-     * processed. Does nothing if no progress bar is displayed.
+     * processed. Progress never goes backward, so threads can report their
+     * counts out of order. Does nothing if no progress bar is displayed.
+     * Safe to call from multiple threads.
      */
-    void update_progress(long i);
+    inline void update_progress(long i);
     /**
      * Update the progress bar, noting that one additional item has been
-     * processed. Does nothing if no progress bar is displayed.
+     * processed, on top of the largest count passed to update_progress().
+     * Does nothing if no progress bar is displayed. Safe to call from
+     * multiple threads.
      */
-    void increment_progress();
+    inline void increment_progress();
     /**
      * Destroy the current progress bar, if it exists.
      */
     void destroy_progress(void);
     
+    /**
+     * Get how many items the current progress bar has counted, or 0 if there
+     * is no progress bar.
+     */
+    long progress_done() const;
+    /**
+     * Get how many items per second the current progress bar has counted
+     * since it was created, or 0 if there is no progress bar.
+     */
+    double progress_rate() const;
+    
 private:
+    /// Counts increments from one thread, padded so threads don't share
+    /// cache lines
+    struct ThreadProgress {
+        atomic<long> increments;
+        char padding[64];
+        
+        ThreadProgress() : increments(0) {}
+    };
+    
     string progress_message = "progress";
     // How many total ticks of progress are there?
-    long progress_count;
-    // What's the last progress value we displayed?
-    long last_progress;
-    // What's the last progress value we've actually seen, either through an
-    // explicit update or an increment?
-    long progress_seen;
-    // What;s the actual progress bar renderer we're using?
+    long progress_count = 0;
+    // What's the largest value passed to update_progress()?
+    atomic<long> progress_updated{0};
+    // How many increments has each thread made?
+    vector<ThreadProgress> thread_progress;
+    // When was the progress bar created?
+    chrono::steady_clock::time_point progress_start;
+    // What's the actual progress bar renderer we're using? Only drawn on by
+    // the reporter thread while that is running.
     ProgressBar* progress = nullptr;
+    
+    // The thread that draws the progress bar, and what it waits on
+    thread reporter;
+    mutex reporter_mutex;
+    condition_variable reporter_wakeup;
+    bool reporter_stop = false;
+    
+    /// Redraw the progress bar until told to stop.
+    void run_reporter();
+    /// Stop the reporter thread, if it is running.
+    void stop_reporter();
 };
 
+inline void Progressive::update_progress(long i) {
+    if (progress) {
+        long seen = progress_updated.load(memory_order_relaxed);
+        while (i > seen && !progress_updated.compare_exchange_weak(seen, i, memory_order_relaxed)) {
+            // Someone else got in first; try again unless they went further
+        }
+    }
+}
+
+inline void Progressive::increment_progress() {
+    if (progress) {
+        size_t thread_num = omp_get_thread_num();
+        // Threads that we didn't count on at creation share the first counter
+        auto& counter = thread_progress[thread_num < thread_progress.size() ? thread_num : 0];
+        counter.increments.fetch_add(1, memory_order_relaxed);
+    }
+}
+
 }
 
 #endif
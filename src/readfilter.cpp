@@ -1,5 +1,7 @@
 #include "readfilter.hpp"
 #include "IntervalTree.h"
+#include "stream_emitter.hpp"
+#include "columnar_gam.hpp"
 
 #include <fstream>
 #include <sstream>
@@ -386,8 +388,9 @@ bool ReadFilter::has_repeat(Alignment& aln, int k) {
         bool ffound = true;
         bool bfound = true;
         for (int j = 1; (ffound || bfound) && (j + 1) * i < s.length(); ++j) {
-            ffound = ffound && s.substr(0, i) == s.substr(j * i, i);
-            bfound = bfound && s.substr(s.length() - i, i) == s.substr(s.length() - i - j * i, i);
+            // compare in place rather than making substrings
+            ffound = ffound && s.compare(j * i, i, s, 0, i) == 0;
+            bfound = bfound && s.compare(s.length() - i - j * i, i, s, s.length() - i, i) == 0;
             if (ffound || bfound) {
                 covered += i;
             }
@@ -445,6 +448,159 @@ bool ReadFilter::is_split(xg::XG* index, Alignment& alignment) {
     return false;
 }
 
+ReadFilter::PathStats ReadFilter::get_path_stats(const Alignment& aln) const {
+    PathStats stats;
+    const Path& path = aln.path();
+    if (path.mapping_size() == 0) {
+        stats.overhang = aln.sequence().length();
+        return stats;
+    }
+    
+    // the current run of exact matches, and whether it's the first one
+    int run = 0;
+    bool at_left = true;
+    for (size_t i = 0; i < path.mapping_size(); ++i) {
+        const Mapping& mapping = path.mapping(i);
+        stats.min_node_id = min(stats.min_node_id, (id_t) mapping.position().node_id());
+        stats.max_node_id = max(stats.max_node_id, (id_t) mapping.position().node_id());
+        for (size_t j = 0; j < mapping.edit_size(); ++j) {
+            const Edit& edit = mapping.edit(j);
+            if (edit.from_length() == edit.to_length() && edit.sequence().empty()) {
+                run += edit.to_length();
+            } else {
+                if (at_left) {
+                    stats.left_end_matches = run;
+                    at_left = false;
+                }
+                run = 0;
+            }
+        }
+    }
+    if (at_left) {
+        // all matches
+        stats.left_end_matches = run;
+    }
+    stats.right_end_matches = run;
+    
+    const Mapping& left_mapping = path.mapping(0);
+    if (left_mapping.edit_size() > 0) {
+        stats.overhang = left_mapping.edit(0).to_length() - left_mapping.edit(0).from_length();
+    }
+    const Mapping& right_mapping = path.mapping(path.mapping_size() - 1);
+    if (right_mapping.edit_size() > 0) {
+        const Edit& edit = right_mapping.edit(right_mapping.edit_size() - 1);
+        stats.overhang = max(stats.overhang, edit.to_length() - edit.from_length());
+    }
+    
+    return stats;
+}
+
+/**
+ * Parse only the fields of a serialized Alignment that the filters look at
+ * into the given Alignment. Throws if the bytes can't be parsed.
+ */
+static void parse_filtered_fields(const string& bytes, Alignment& aln, bool with_name) {
+    vector<int> wanted{Alignment::kSequenceFieldNumber, Alignment::kPathFieldNumber,
+        Alignment::kMappingQualityFieldNumber, Alignment::kScoreFieldNumber,
+        Alignment::kIsSecondaryFieldNumber, Alignment::kIdentityFieldNumber};
+    if (with_name) {
+        // names are only used in warnings
+        wanted.push_back(Alignment::kNameFieldNumber);
+    }
+    if (!stream::FieldView(bytes).project(wanted, aln)) {
+        throw runtime_error("[vg filter] invalid or corrupt alignment in input");
+    }
+}
+
+template<typename T>
+void ReadFilter::write_kept(istream* alignment_stream, const vector<string>& chunk_names,
+                            const function<bool(T&, vector<int>&)>& keep) {
+    function<void(const function<void(T&, const vector<int>&)>&)> for_each_kept =
+        [&](const function<void(T&, const vector<int>&)>& emit) {
+        function<void(T&)> lambda = [&](T& item) {
+            vector<int> aln_chunks;
+            if (keep(item, aln_chunks)) {
+                emit(item, aln_chunks);
+            }
+        };
+        stream::for_each_parallel(*alignment_stream, lambda);
+    };
+    write_items(chunk_names, for_each_kept);
+}
+
+template<typename T>
+void ReadFilter::write_items(const vector<string>& chunk_names,
+                             const function<void(const function<void(T&, const vector<int>&)>&)>& for_each_kept) {
+
+    // buffered output (one buffer per chunk), one set of chunks per thread
+    // buffer[THREAD][CHUNK] = vector<T>
+    vector<vector<vector<T> > > buffer(threads);
+    for (int i = 0; i < buffer.size(); ++i) {
+        buffer[i].resize(chunk_names.size());
+    }
+    
+    static const int buffer_size = 1000; // we let this be off by 1
+
+    // remember if write or append
+    vector<bool> chunk_append(chunk_names.size(), append_regions);
+
+    // anything going to stdout is compressed and written in the background
+    stream::AsyncEmitter<T> emitter(cout);
+
+    // flush a buffer specified by cur_buffer to target in chunk_names, and clear it
+    function<void(int, int)> flush_buffer = [&buffer, &chunk_names, &chunk_append, &emitter](int tid, int cur_buffer) {
+        if (chunk_names[cur_buffer] == "-") {
+            // the emitter does its own locking
+            emitter.emit(std::move(buffer[tid][cur_buffer]));
+            return;
+        }
+        ofstream outfile(chunk_names[cur_buffer], chunk_append[cur_buffer] ? ios::app : ios_base::out);
+        chunk_append[cur_buffer] = true;
+        function<T&(uint64_t)> write_buffer = [&buffer, &tid, &cur_buffer](uint64_t i) -> T& {
+            return buffer[tid][cur_buffer][i];
+        };
+        stream::write(outfile, buffer[tid][cur_buffer].size(), write_buffer);
+        buffer[tid][cur_buffer].clear();
+    };
+
+    // add item to all appropriate buffers, flushing as necessary
+    function<void(int, T&, const vector<int>&)> update_buffers = [&buffer, &chunk_names, &flush_buffer](int tid, T& item,
+                                                                   const vector<int>& aln_chunks) {
+        for (auto chunk : aln_chunks) {
+            buffer[tid][chunk].push_back(item);
+            if (buffer[tid][chunk].size() >= buffer_size) {
+                if (chunk_names[chunk] == "-") {
+                    // stdout is written in the background, so don't hold up other threads
+                    flush_buffer(tid, chunk);
+                } else {
+                    // flush buffer (could get fancier and allow parallel writes to different
+                    // files, but unlikely to be worth effort as we're mostly trying to
+                    // speed up defray and not write IO)
+#pragma omp critical (ReadFilter_flush_buffer)
+                    {
+                        flush_buffer(tid, chunk);
+                    }
+                }
+            }
+        }
+    };
+
+    for_each_kept([&](T& item, const vector<int>& aln_chunks) {
+        update_buffers(omp_get_thread_num(), item, aln_chunks);
+    });
+
+    for (int tid = 0; tid < buffer.size(); ++tid) {
+        for (int chunk = 0; chunk < buffer[tid].size(); ++chunk) {
+            if (buffer[tid][chunk].size() > 0 || 
+                // we deliberately write empty gams at this point for empty chunks:
+                (chunk_append[chunk] == false && chunk_names[chunk] != "-" )) {
+                flush_buffer(tid, chunk);
+            }
+        }
+    }
+    emitter.finish();
+}
+
 int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
 
     // name helper for output
@@ -533,79 +689,29 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
     IntervalTree<int, int64_t> region_map(interval_list);
 
     // which chunk(s) does a gam belong to?
-    function<void(Alignment&, vector<int>&)> get_chunks = [&region_map, &regions](Alignment& aln, vector<int>& chunks) {
+    function<void(const PathStats&, vector<int>&)> get_chunks = [&region_map, &regions](const PathStats& stats,
+                                                                                        vector<int>& chunks) {
         // speed up case where no chunking
         if (regions.empty()) {
             chunks.push_back(0);
         } else {
-            int64_t min_aln_id = numeric_limits<int64_t>::max();
-            int64_t max_aln_id = -1;
-            for (int i = 0; i < aln.path().mapping_size(); ++i) {
-                const Mapping& mapping = aln.path().mapping(i);
-                min_aln_id = min(min_aln_id, (int64_t)mapping.position().node_id());
-                max_aln_id = max(max_aln_id, (int64_t)mapping.position().node_id());
-            }
             vector<Interval<int, int64_t> > found_ranges;
-            region_map.findOverlapping(min_aln_id, max_aln_id, found_ranges);
+            region_map.findOverlapping(stats.min_node_id, stats.max_node_id, found_ranges);
             for (auto& interval : found_ranges) {
                 chunks.push_back(interval.value);
             }
         }
     };
 
-    // buffered output (one buffer per chunk), one set of chunks per thread
-    // buffer[THREAD][CHUNK] = vector<Alignment>
-    vector<vector<vector<Alignment> > > buffer(threads);
-    for (int i = 0; i < buffer.size(); ++i) {
-        buffer[i].resize(chunk_names.size());
-    }
-    
-    static const int buffer_size = 1000; // we let this be off by 1
-
-    // remember if write or append
-    vector<bool> chunk_append(chunk_names.size(), append_regions);
-
-    // flush a buffer specified by cur_buffer to target in chunk_names, and clear it
-    function<void(int, int)> flush_buffer = [&buffer, &chunk_names, &chunk_append](int tid, int cur_buffer) {
-        ofstream outfile;
-        auto& outbuf = chunk_names[cur_buffer] == "-" ? cout : outfile;
-        if (chunk_names[cur_buffer] != "-") {
-            outfile.open(chunk_names[cur_buffer], chunk_append[cur_buffer] ? ios::app : ios_base::out);
-            chunk_append[cur_buffer] = true;
-        }
-        function<Alignment&(uint64_t)> write_buffer = [&buffer, &tid, &cur_buffer](uint64_t i) -> Alignment& {
-            return buffer[tid][cur_buffer][i];
-        };
-        stream::write(outbuf, buffer[tid][cur_buffer].size(), write_buffer);
-        buffer[tid][cur_buffer].clear();
-    };
-
-    // add alignment to all appropriate buffers, flushing as necessary
-    function<void(int, Alignment&, const vector<int>&)> update_buffers = [
-        &buffer, &region_map, &get_chunks, &flush_buffer](int tid, Alignment& aln,
-                                                          const vector<int>& aln_chunks) {
-        for (auto chunk : aln_chunks) {
-            buffer[tid][chunk].push_back(aln);
-            if (buffer[tid][chunk].size() >= buffer_size) {
-                // flush buffer (could get fancier and allow parallel writes to different
-                // files, but unlikely to be worth effort as we're mostly trying to
-                // speed up defray and not write IO)
-#pragma omp critical (ReadFilter_flush_buffer)
-                {
-                    flush_buffer(tid, chunk);
-                }
-            }
-        }
-    };
-
     // keep counts of what's filtered to report (in verbose mode)
     vector<Counts> counts_vec(threads);
             
+    // Apply every filter but defraying to an alignment, and find the chunks
+    // it goes to. Returns true if it should be kept.
     // we assume that every primary alignment has 0 or 1 secondary alignment
     // immediately following in the stream
-    function<void(Alignment&)> lambda = [&](Alignment& aln) {
-        int tid = omp_get_thread_num();        
-        Counts& counts = counts_vec[tid];
+    function<bool(Alignment&, vector<int>&)> apply_filters = [&](Alignment& aln, vector<int>& aln_chunks) {
+        Counts& counts = counts_vec[omp_get_thread_num()];
         double score = (double)aln.score();
         double denom = aln.sequence().length();
         // toggle substitution score
@@ -623,50 +729,8 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
                 assert(score == 0.);
             }
         }
-        // compute overhang
-        int overhang = 0;
-        if (aln.path().mapping_size() > 0) {
-            const auto& left_mapping = aln.path().mapping(0);
-            if (left_mapping.edit_size() > 0) {
-                overhang = left_mapping.edit(0).to_length() - left_mapping.edit(0).from_length();
-            }
-            const auto& right_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
-            if (right_mapping.edit_size() > 0) {
-                const auto& edit = right_mapping.edit(right_mapping.edit_size() - 1);
-                overhang = max(overhang, edit.to_length() - edit.from_length());
-            }
-        } else {
-            overhang = aln.sequence().length();
-        }
-        // compute end matches.
-        int end_matches = 0;
-        // from the left
-        for (int i = 0; i < aln.path().mapping_size() && end_matches < min_end_matches; ++i) {
-            for (int j = 0; j < aln.path().mapping(i).edit_size() && end_matches < min_end_matches; ++j) {
-                const Edit& edit = aln.path().mapping(i).edit(j);
-                if (edit.from_length() == edit.to_length() && edit.sequence().empty()) {
-                    end_matches += edit.to_length();
-                } else {
-                    i = aln.path().mapping_size();
-                    break;
-                }
-            }
-        }
-        if (end_matches >= min_end_matches) {
-            end_matches = 0;
-            // from the right
-            for (int i = aln.path().mapping_size() - 1; i >= 0 && end_matches < min_end_matches; --i) {
-                for (int j = aln.path().mapping(i).edit_size() - 1; j >= 0 && end_matches < min_end_matches; --j) {
-                    const Edit& edit = aln.path().mapping(i).edit(j);
-                    if (edit.from_length() == edit.to_length() && edit.sequence().empty()) {
-                        end_matches += edit.to_length();
-                    } else {
-                        i = -1;
-                        break;
-                    }
-                }
-            }
-        }                
+        // work out the overhang, end matches, and node range together
+        PathStats stats = get_path_stats(aln);
 
         // offset in count tuples
         int co = aln.is_secondary() ? 1 : 0;
@@ -679,11 +743,11 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             ++counts.min_score[co];
             keep = false;
         }
-        if ((keep || verbose) && overhang > max_overhang) {
+        if ((keep || verbose) && stats.overhang > max_overhang) {
             ++counts.max_overhang[co];
             keep = false;
         }
-        if ((keep || verbose) && end_matches < min_end_matches) {
+        if ((keep || verbose) && min(stats.left_end_matches, stats.right_end_matches) < min_end_matches) {
             ++counts.min_end_matches[co];
             keep = false;
         }
@@ -693,9 +757,8 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
         }
 
         // do region check before heavier filters
-        vector<int> aln_chunks;
         if (keep || verbose) {
-            get_chunks(aln, aln_chunks);
+            get_chunks(stats, aln_chunks);
             if (aln_chunks.empty()) {
                 keep = false;
             }
@@ -709,29 +772,92 @@ int ReadFilter::filter(istream* alignment_stream, xg::XG* xindex) {
             ++counts.repeat[co];
             keep = false;
         }
+        return keep;
+    };
+    
+    // Defray an alignment that the other filters have seen, if we are
+    // defraying. Returns true if it was changed.
+    function<bool(Alignment&, bool)> defray = [&](Alignment& aln, bool keep) {
         if ((keep || verbose) && defray_length && trim_ambiguous_ends(xindex, aln, defray_length)) {
-            ++counts.defray[co];
+            ++counts_vec[omp_get_thread_num()].defray[aln.is_secondary() ? 1 : 0];
             // We keep these, because the alignments get modified.
+            return true;
         }
-        if (!keep) {
-            ++counts.filtered[co];
-        }
-
-        // add to write buffer
-        if (keep) {
-            update_buffers(tid, aln, aln_chunks);
-        }
+        return false;
+    };
+    
+    // Count a filtered alignment
+    function<void(const Alignment&)> count_filtered = [&](const Alignment& aln) {
+        ++counts_vec[omp_get_thread_num()].filtered[aln.is_secondary() ? 1 : 0];
     };
-    stream::for_each_parallel(*alignment_stream, lambda);
 
-    for (int tid = 0; tid < buffer.size(); ++tid) {
-        for (int chunk = 0; chunk < buffer[tid].size(); ++chunk) {
-            if (buffer[tid][chunk].size() > 0 || 
-                // we deliberately write empty gams at this point for empty chunks:
-                (chunk_append[chunk] == false && chunk_names[chunk] != "-" )) {
-                flush_buffer(tid, chunk);
+    if (is_columnar_gam(*alignment_stream)) {
+        // Decompress just the columns the filters need, and the rest only for
+        // blocks where we keep something. Defraying changes the sequence and
+        // quality along with the path, so then everything has to be there.
+        uint32_t filter_columns = COLUMN_SEQUENCE | COLUMN_PATH | COLUMN_SCORE | (verbose ? COLUMN_NAME : 0);
+        if (defray_length) {
+            filter_columns = ALL_COLUMNS;
+        }
+        function<void(const function<void(Alignment&, const vector<int>&)>&)> for_each_kept =
+            [&](const function<void(Alignment&, const vector<int>&)>& emit) {
+            for_each_columnar_block_parallel(*alignment_stream, ALL_COLUMNS, [&](const ColumnarGAMBlock& block) {
+                vector<Alignment> alns;
+                block.decode(filter_columns, alns);
+                vector<vector<int>> aln_chunks(alns.size());
+                vector<bool> kept(alns.size());
+                bool any_kept = false;
+                for (size_t i = 0; i < alns.size(); i++) {
+                    kept[i] = apply_filters(alns[i], aln_chunks[i]);
+                    defray(alns[i], kept[i]);
+                    if (!kept[i]) {
+                        count_filtered(alns[i]);
+                    }
+                    any_kept = any_kept || kept[i];
+                }
+                if (any_kept) {
+                    block.decode(ALL_COLUMNS & ~filter_columns, alns);
+                }
+                for (size_t i = 0; i < alns.size(); i++) {
+                    if (kept[i]) {
+                        emit(alns[i], aln_chunks[i]);
+                    }
+                }
+            });
+        };
+        write_items(chunk_names, for_each_kept);
+    } else if (lazy_parse) {
+        // Parse just what the filters need, and only parse everything if
+        // defraying changes a read we keep.
+        function<bool(stream::SerializedMessage&, vector<int>&)> keep_message = [&](stream::SerializedMessage& message,
+                                                                                     vector<int>& aln_chunks) {
+            Alignment aln;
+            parse_filtered_fields(message.bytes, aln, verbose);
+            bool keep = apply_filters(aln, aln_chunks);
+            if (defray(aln, keep) && keep) {
+                Alignment full;
+                if (!full.ParseFromString(message.bytes)) {
+                    throw runtime_error("[vg filter] invalid or corrupt alignment in input");
+                }
+                trim_ambiguous_ends(xindex, full, defray_length);
+                full.SerializeToString(&message.bytes);
             }
-        }
+            if (!keep) {
+                count_filtered(aln);
+            }
+            return keep;
+        };
+        write_kept(alignment_stream, chunk_names, keep_message);
+    } else {
+        function<bool(Alignment&, vector<int>&)> keep_alignment = [&](Alignment& aln, vector<int>& aln_chunks) {
+            bool keep = apply_filters(aln, aln_chunks);
+            defray(aln, keep);
+            if (!keep) {
+                count_filtered(aln);
+            }
+            return keep;
+        };
+        write_kept(alignment_stream, chunk_names, keep_alignment);
     }
 
     if (verbose) {
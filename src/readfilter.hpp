@@ -5,6 +5,8 @@
 #include <cstdlib>
 #include <iostream>
 #include <string>
+#include <limits>
+#include <functional>
 #include "vg.hpp"
 #include "xg.hpp"
 #include "vg.pb.h"
@@ -41,6 +43,9 @@ public:
     bool drop_split = false;
     // default to 1 thread (as opposed to all)
     int threads = 1;
+    // Should we only parse the fields the filters look at, and write the
+    // reads we keep back out as the bytes they came in as?
+    bool lazy_parse = false;
 
     // Keep some basic counts for when verbose mode is enabled
     struct Counts {
@@ -107,6 +112,41 @@ public:
     
 private:
 
+    /**
+     * Everything the cheap filters need to know about an alignment's path,
+     * gathered in one pass over its edits.
+     */
+    struct PathStats {
+        // Longest insert at either end
+        int overhang = 0;
+        // Bases of exact match before the first difference from either end
+        int left_end_matches = 0;
+        int right_end_matches = 0;
+        // Range of node IDs visited, for finding chunks
+        id_t min_node_id = numeric_limits<id_t>::max();
+        id_t max_node_id = -1;
+    };
+    
+    /// Compute the PathStats for the given alignment.
+    PathStats get_path_stats(const Alignment& aln) const;
+    
+    /**
+     * Run the given function on each item in the stream in parallel, and
+     * write each item it keeps to the chunks it lists. Items can be
+     * Alignments, or stream::SerializedMessages holding Alignments.
+     */
+    template<typename T>
+    void write_kept(istream* alignment_stream, const vector<string>& chunk_names,
+                    const function<bool(T&, vector<int>&)>& keep);
+
+    /**
+     * Write each item that the given function, running on many threads,
+     * passes to its callback along with the chunks it goes to.
+     */
+    template<typename T>
+    void write_items(const vector<string>& chunk_names,
+                     const function<void(const function<void(T&, const vector<int>&)>&)>& for_each_kept);
+
     /**
      * quick and dirty filter to see if removing reads that can slip around
      * and still map perfectly helps vg call.  returns true if at either
@@ -323,10 +323,9 @@ vector<Alignment> Sampler::alignment_pair(size_t read_length, size_t fragment_le
     aln1.mutable_fragment_next()->set_name(aln2.name());
     aln2.mutable_fragment_prev()->set_name(aln1.name());
     // reverse complement the back fragment
-    fragments.back() = reverse_complement_alignment(fragments.back(),
-                                                  (function<int64_t(int64_t)>) ([&](int64_t id) {
-                                                          return (int64_t)node_length(id);
-                                                      }));
+    reverse_complement_alignment_in_place(&fragments.back(), [&](id_t id) {
+            return (int64_t)node_length(id);
+        });
     return fragments;
 }
 
@@ -556,35 +555,40 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
                            bool retry_on_Ns,
                            size_t seed) :
       xg_index(xg_index)
-    , node_cache(100)
-    , edge_cache(100)
     , sub_poly_rate(substition_polymorphism_rate)
     , indel_poly_rate(indel_polymorphism_rate)
     , indel_error_prop(indel_error_proportion)
     , insert_mean(insert_length_mean)
     , insert_sd(insert_length_stdev)
     , retry_on_Ns(retry_on_Ns)
-    , prng(seed ? seed : random_device()())
     , strand_sampler(0, 1)
     , background_sampler(0, alphabet.size() - 1)
     , mut_sampler(0, alphabet.size() - 2)
     , prob_sampler(0.0, 1.0)
-    , insert_sampler(insert_length_mean, insert_length_stdev)
     , seed(seed)
+    , base_seed(seed ? seed : random_device()())
     , source_paths(source_paths)
-    , joint_initial_distr(seed - 1)
 {
     if (source_paths.empty()) {
-        start_pos_samplers.emplace_back(1, xg_index.seq_length);
+        start_pos_sampler = uniform_int_distribution<size_t>(1, xg_index.seq_length);
     } else {
-        vector<size_t> path_sizes;
+        // lay the paths end to end, so that a uniform position picks a path
+        // weighted by its length
+        path_starts.push_back(0);
         for (const auto& source_path : source_paths) {
-            path_sizes.push_back(xg_index.path_length(source_path));
-            start_pos_samplers.emplace_back(0, path_sizes.back() - 1);
+            source_path_lengths[source_path] = xg_index.path_length(source_path);
+            path_starts.push_back(path_starts.back() + source_path_lengths[source_path]);
+        }
+        if (path_starts.back() == 0) {
+            cerr << "error:[NGSSimulator] Source paths contain no sequence" << endl;
+            exit(1);
         }
-        path_sampler = discrete_distribution<>(path_sizes.begin(), path_sizes.end());
+        start_pos_sampler = uniform_int_distribution<size_t>(0, path_starts.back() - 1);
     }
     
+    // give each thread its own caches and random number stream
+    thread_states.resize(max(omp_get_max_threads(), 1), ThreadState(insert_length_mean, insert_length_stdev));
+    
     if (substition_polymorphism_rate < 0.0 || substition_polymorphism_rate > 1.0
         || indel_polymorphism_rate < 0.0 || indel_polymorphism_rate > 1.0
         || indel_error_proportion < 0.0 || indel_error_proportion > 1.0) {
@@ -680,7 +684,27 @@ NGSSimulator::NGSSimulator(xg::XG& xg_index,
 #endif
 }
 
+void NGSSimulator::reseed(size_t read_number) {
+    // mix the seed and the read number so nearby reads get unrelated streams
+    seed_seq mixed{(uint32_t) base_seed, (uint32_t) ((uint64_t) base_seed >> 32),
+                   (uint32_t) read_number, (uint32_t) ((uint64_t) read_number >> 32)};
+    ThreadState& thread_state = state();
+    thread_state.prng.seed(mixed);
+    // forget any normal sample saved from the last read
+    thread_state.insert_sampler.reset();
+}
+
 Alignment NGSSimulator::sample_read() {
+    return sample_read(sample_counter++);
+}
+
+pair<Alignment, Alignment> NGSSimulator::sample_read_pair() {
+    return sample_read_pair(sample_counter++);
+}
+
+Alignment NGSSimulator::sample_read(size_t read_number) {
+    
+    reseed(read_number);
     
     Alignment aln;
     // sample a quality string based on the trained distribution
@@ -715,12 +739,15 @@ Alignment NGSSimulator::sample_read() {
         }
     }
     
-    aln.set_name(get_read_name());
+    aln.set_name(get_read_name(read_number));
     
     return aln;
 }
 
-pair<Alignment, Alignment> NGSSimulator::sample_read_pair() {
+pair<Alignment, Alignment> NGSSimulator::sample_read_pair(size_t read_number) {
+    
+    reseed(read_number);
+    
     pair<Alignment, Alignment> aln_pair;
     pair<string, string> qual_pair = sample_read_quality_pair();
     aln_pair.first.set_quality(qual_pair.first);
@@ -733,7 +760,8 @@ pair<Alignment, Alignment> NGSSimulator::sample_read_pair() {
     
     
     while (!aln_pair.first.has_path() || !aln_pair.second.has_path()) {
-        int64_t insert_length = (int64_t) round(insert_sampler(prng));
+        ThreadState& thread_state = state();
+        int64_t insert_length = (int64_t) round(thread_state.insert_sampler(thread_state.prng));
         if (insert_length < (int64_t) transition_distrs_1.size()) {
             // don't make reads where the insert length is shorter than one end of the read
             continue;
@@ -794,11 +822,11 @@ pair<Alignment, Alignment> NGSSimulator::sample_read_pair() {
     }
     
     // unreverse the second read in the pair
-    aln_pair.second = reverse_complement_alignment(aln_pair.second, [&](id_t node_id) {
+    reverse_complement_alignment_in_place(&aln_pair.second, [&](id_t node_id) {
         return xg_index.node_length(node_id);
     });
     
-    string name = get_read_name();
+    string name = get_read_name(read_number);
     aln_pair.first.set_name(name + "_1");
     aln_pair.second.set_name(name + "_2");
     
@@ -811,7 +839,9 @@ void NGSSimulator::sample_read_internal(Alignment& aln, size_t& offset, bool& is
     aln.clear_path();
     aln.clear_sequence();
     
-    char graph_char = xg_cached_pos_char(curr_pos, &xg_index, node_cache);
+    default_random_engine& prng = state().prng;
+    
+    char graph_char = xg_cached_pos_char(curr_pos, &xg_index, state().node_cache);
     bool hit_end = false;
     
     // walk a path and generate a read sequence at the same time
@@ -922,17 +952,19 @@ bool NGSSimulator::advance(size_t& offset, bool& is_reverse, pos_t& pos, char& g
 
 bool NGSSimulator::advance_on_graph(pos_t& pos, char& graph_char) {
     
+    ThreadState& thread_state = state();
+    
     // choose a next position at random
     map<pos_t, char> next_pos_chars = xg_cached_next_pos_chars(pos,
                                                                &xg_index,
-                                                               node_cache,
-                                                               edge_cache);
+                                                               thread_state.node_cache,
+                                                               thread_state.edge_cache);
     if (next_pos_chars.empty()) {
         return true;
     }
     
     uniform_int_distribution<size_t> pos_distr(0, next_pos_chars.size() - 1);
-    size_t next = pos_distr(prng);
+    size_t next = pos_distr(thread_state.prng);
     auto iter = next_pos_chars.begin();
     for (size_t i = 0; i != next; i++) {
         iter++;
@@ -954,7 +986,7 @@ bool NGSSimulator::advance_on_path(size_t& offset, bool& is_reverse, pos_t& pos,
         offset--;
     } else {
         // Go right on the path
-        if (offset == xg_index.path_length(source_path) - 1) {
+        if (offset == source_path_lengths.at(source_path) - 1) {
             // We hit the end
             return true;
         }
@@ -965,7 +997,7 @@ bool NGSSimulator::advance_on_path(size_t& offset, bool& is_reverse, pos_t& pos,
     pos = position_at(&xg_index, source_path, offset, is_reverse);
     
     // And look up the character
-    graph_char = xg_cached_pos_char(pos, &xg_index, node_cache);
+    graph_char = xg_cached_pos_char(pos, &xg_index, state().node_cache);
     
     return false;
 }
@@ -989,7 +1021,7 @@ bool NGSSimulator::advance_on_graph_by_distance(pos_t& pos, size_t distance) {
         if (edges.empty()) {
             return true;
         }
-        size_t choice = uniform_int_distribution<size_t>(0, edges.size() - 1)(prng);
+        size_t choice = uniform_int_distribution<size_t>(0, edges.size() - 1)(state().prng);
         Edge& edge = edges[choice];
         if (id(pos) == edge.from() && is_rev(pos) == edge.from_start()) {
             get_id(pos) = edge.to();
@@ -1020,7 +1052,7 @@ bool NGSSimulator::advance_on_path_by_distance(size_t& offset, bool& is_reverse,
         offset -= distance;
     } else {
         // Go right on the path
-        if (offset + distance >= xg_index.path_length(source_path)) {
+        if (offset + distance >= source_path_lengths.at(source_path)) {
             // We hit the end
             return true;
         }
@@ -1177,7 +1209,7 @@ void NGSSimulator::apply_deletion(Alignment& aln, const pos_t& pos) {
 
 void NGSSimulator::apply_insertion(Alignment& aln, const pos_t& pos) {
     Path* path = aln.mutable_path();
-    char insert_char = alphabet[background_sampler(prng)];
+    char insert_char = alphabet[background_sampler(state().prng)];
     aln.mutable_sequence()->push_back(insert_char);
     
     if (path->mapping_size() == 0) {
@@ -1221,8 +1253,9 @@ void NGSSimulator::sample_start_pos(size_t& offset, bool& is_reverse, pos_t& pos
 
 pos_t NGSSimulator::sample_start_graph_pos() {
     // The start pos sampler has been set up in graph space, 1-based
-    assert(start_pos_samplers.size() == 1);
-    size_t idx = start_pos_samplers[0](prng);
+    assert(path_starts.empty());
+    default_random_engine& prng = state().prng;
+    size_t idx = start_pos_sampler(prng);
     
     id_t id = xg_index.node_at_seq_pos(idx);
     bool rev = strand_sampler(prng);
@@ -1232,21 +1265,24 @@ pos_t NGSSimulator::sample_start_graph_pos() {
 }
 
 tuple<size_t, bool, pos_t, string> NGSSimulator::sample_start_path_pos() {
-    // choose a path
-    size_t source_path_idx = path_sampler(prng);
-    string source_path = source_paths[source_path_idx];
-    // The start pos sampler hasd been set up in path space, 0-based
-    size_t offset = start_pos_samplers[source_path_idx](prng);
+    default_random_engine& prng = state().prng;
+    // The start pos sampler has been set up along all the paths, 0-based, so
+    // find the path it landed in. Empty paths share their start with the
+    // next path, so we never land in them.
+    size_t concatenated_offset = start_pos_sampler(prng);
+    size_t source_path_idx = upper_bound(path_starts.begin(), path_starts.end(), concatenated_offset)
+        - path_starts.begin() - 1;
+    const string& source_path = source_paths[source_path_idx];
+    size_t offset = concatenated_offset - path_starts[source_path_idx];
     bool rev = strand_sampler(prng);
     pos_t pos = position_at(&xg_index, source_path, offset, rev);
     
     return make_tuple(offset, rev, pos, source_path);
 }
 
-string NGSSimulator::get_read_name() {
+string NGSSimulator::get_read_name(size_t read_number) {
     stringstream sstrm;
-    sstrm << "seed_" << seed << "_fragment_" << sample_counter;
-    sample_counter++;
+    sstrm << "seed_" << seed << "_fragment_" << read_number;
     return sstrm.str();
 }
 
@@ -1257,7 +1293,7 @@ void NGSSimulator::record_read_quality(const Alignment& aln, bool read_2) {
         return;
     }
     while (transition_distrs.size() < quality.size()) {
-        transition_distrs.emplace_back(seed ? seed + transition_distrs.size() + 1 : random_device()());
+        transition_distrs.emplace_back();
     }
     transition_distrs[0].record_transition(0, quality[0]);
     for (size_t i = 1; i < transition_distrs.size(); i++) {
@@ -1286,7 +1322,7 @@ void NGSSimulator::finalize() {
 string NGSSimulator::sample_read_quality() {
     // only use the first trained distribution (on the assumption that it better reflects the properties of
     // single-ended sequencing)
-    return sample_read_quality_internal(transition_distrs_1[0].sample_transition(0),  transition_distrs_1);
+    return sample_read_quality_internal(transition_distrs_1[0].sample_transition(0, state().prng),  transition_distrs_1);
 }
     
 pair<string, string> NGSSimulator::sample_read_quality_pair() {
@@ -1296,28 +1332,24 @@ pair<string, string> NGSSimulator::sample_read_quality_pair() {
     }
     else {
         // paired training data, sample the start quality jointly
-        pair<uint8_t, uint8_t> first_quals = joint_initial_distr.sample_transition(0);
+        pair<uint8_t, uint8_t> first_quals = joint_initial_distr.sample_transition(0, state().prng);
         return make_pair(sample_read_quality_internal(first_quals.first, transition_distrs_1),
                          sample_read_quality_internal(first_quals.second, transition_distrs_2));
     }
 }
     
 string NGSSimulator::sample_read_quality_internal(uint8_t first,
-                                                  vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs) {
+                                                  const vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs) {
+    default_random_engine& prng = state().prng;
     string quality(transition_distrs.size(), first);
     uint8_t at = first;
     for (size_t i = 1; i < transition_distrs.size(); i++) {
-        at = transition_distrs[i].sample_transition(at);
+        at = transition_distrs[i].sample_transition(at, prng);
         quality[i] = at;
     }
     return quality;
 }
     
-template<class From, class To>
-NGSSimulator::MarkovDistribution<From, To>::MarkovDistribution(size_t seed) : prng(seed) {
-    // nothing to do
-}
-
 template<class From, class To>
 void NGSSimulator::MarkovDistribution<From, To>::record_transition(From from, To to) {
     if (!cond_distrs.count(from)) {
@@ -1338,42 +1370,64 @@ void NGSSimulator::MarkovDistribution<From, To>::record_transition(From from, To
 template<class From, class To>
 void NGSSimulator::MarkovDistribution<From, To>::finalize() {
     for (pair<const From, vector<size_t>>& cond_distr : cond_distrs) {
-        for (size_t i = 1; i < cond_distr.second.size(); i++) {
-            cond_distr.second[i] += cond_distr.second[i - 1];
+        const vector<size_t>& counts = cond_distr.second;
+        size_t n = counts.size();
+        
+        AliasTable& table = alias_tables[cond_distr.first];
+        table.threshold.assign(n, 0);
+        table.alias.assign(n, 0);
+        table.total = 0;
+        for (size_t count : counts) {
+            table.total += count;
         }
         
-        samplers[cond_distr.first] = uniform_int_distribution<size_t>(0, cond_distr.second.back() - 1);
+        // Scale the counts so that an even share is total, and pair up
+        // columns with less than a share with columns with more than one
+        vector<size_t> scaled(n);
+        vector<size_t> small;
+        vector<size_t> large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = counts[i] * n;
+            (scaled[i] < table.total ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            size_t under = small.back();
+            small.pop_back();
+            size_t over = large.back();
+            
+            table.threshold[under] = scaled[under];
+            table.alias[under] = over;
+            scaled[over] -= table.total - scaled[under];
+            if (scaled[over] < table.total) {
+                large.pop_back();
+                small.push_back(over);
+            }
+        }
+        // Whatever is left has exactly a share
+        for (size_t i : large) {
+            table.threshold[i] = table.total;
+            table.alias[i] = i;
+        }
+        for (size_t i : small) {
+            table.threshold[i] = table.total;
+            table.alias[i] = i;
+        }
     }
 }
 
 template<class From, class To>
-To NGSSimulator::MarkovDistribution<From, To>::sample_transition(From from) {
+To NGSSimulator::MarkovDistribution<From, To>::sample_transition(From from, default_random_engine& prng) const {
     // return randomly if a transition has never been observed
-    if (!cond_distrs.count(from)) {
+    auto found = alias_tables.find(from);
+    if (found == alias_tables.end()) {
         return value_at[uniform_int_distribution<size_t>(0, value_at.size() - 1)(prng)];
     }
     
-    size_t sample_val = samplers[from](prng);
-    
-    vector<size_t>& cdf = cond_distrs[from];
-    
-    if (sample_val <= cdf[0]) {
-        return value_at[0];
-    }
-    
-    size_t low = 0;
-    size_t hi = cdf.size() - 1;
-    while (hi > low + 1) {
-        int64_t mid = (hi + low) / 2;
-        
-        if (sample_val <= cdf[mid]) {
-            hi = mid;
-        }
-        else {
-            low = mid;
-        }
-    }
-    return value_at[hi];
+    // one draw picks both the column and where we land within it
+    const AliasTable& table = found->second;
+    size_t sample_val = uniform_int_distribution<size_t>(0, table.threshold.size() * table.total - 1)(prng);
+    size_t column = sample_val / table.total;
+    return value_at[sample_val % table.total < table.threshold[column] ? column : table.alias[column]];
 }
 
 }
@@ -39,8 +39,8 @@ public:
     xg::XG* xgidx;
     // We need this so we don't re-load the node for every character we visit in
     // it.
-    LRUCache<id_t, Node> node_cache;
-    LRUCache<id_t, vector<Edge> > edge_cache;
+    NodeRecordCache node_cache;
+    AdjacencyCache edge_cache;
     mt19937 rng;
     int64_t nonce;
     // If set, only sample positions/start reads on the forward strands of their
@@ -154,23 +154,43 @@ public:
     /// Sample a pair of reads an alignments
     pair<Alignment, Alignment> sample_read_pair();
     
+    /// Sample the read with the given number. Its random number stream comes
+    /// from the seed and the number alone, so a read comes out the same no
+    /// matter which thread samples it or in what order. Can be called from
+    /// multiple threads at once, up to the number of OMP threads when the
+    /// simulator was made.
+    Alignment sample_read(size_t read_number);
+    
+    /// Sample the read pair with the given number. Thread-safe and
+    /// reproducible, like sample_read(size_t).
+    pair<Alignment, Alignment> sample_read_pair(size_t read_number);
+    
 private:
     template<class From, class To>
     class MarkovDistribution {
     public:
-        MarkovDistribution(size_t seed);
+        MarkovDistribution() = default;
         
         /// record a transition from the input data
         void record_transition(From from, To to);
         /// indicate that there is no more data and prepare for sampling
         void finalize();
-        /// sample according to the training data
-        To sample_transition(From from);
+        /// sample according to the training data, using the given random number stream
+        To sample_transition(From from, default_random_engine& prng) const;
         
     private:
         
-        default_random_engine prng;
-        unordered_map<From, uniform_int_distribution<size_t>> samplers;
+        /// A Walker alias table over the columns of one conditional
+        /// distribution, kept in integer counts so it samples exactly. Each
+        /// column is worth total counts; a draw landing below the column's
+        /// threshold takes the column and otherwise takes its alias.
+        struct AliasTable {
+            vector<size_t> threshold;
+            vector<size_t> alias;
+            size_t total = 0;
+        };
+        
+        unordered_map<From, AliasTable> alias_tables;
         
         unordered_map<To, size_t> column_of;
         vector<To> value_at;
@@ -197,7 +217,11 @@ private:
     pair<string, string> sample_read_quality_pair();
     /// Wrapped internal function for quality sampling
     string sample_read_quality_internal(uint8_t first,
-                                        vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs);
+                                        const vector<MarkovDistribution<uint8_t, uint8_t>>& transition_distrs);
+    
+    /// Restart the calling thread's random number stream for the read with
+    /// the given number
+    void reseed(size_t read_number);
     
     /// Internal method called by paired and unpaired samplers for both whole-
     /// graph and path sources. Offset and is_reverse are only used (and drive
@@ -215,8 +239,8 @@ private:
     /// Get a random position along the source path
     tuple<size_t, bool, pos_t, string> sample_start_path_pos();
     
-    /// Get an unclashing read name
-    string get_read_name();
+    /// Get an unclashing read name for the read with the given number
+    string get_read_name(size_t read_number);
     
     /// Move forward one position in either the source path or the graph,
     /// depending on mode. Update the arguments. Return true if we can't because
@@ -266,17 +290,36 @@ private:
     
     xg::XG& xg_index;
     
-    LRUCache<id_t, Node> node_cache;
-    LRUCache<id_t, vector<Edge> > edge_cache;
+    /// Everything that changes while a thread samples reads. The
+    /// distributions below keep no state between samples, so they are shared.
+    struct ThreadState {
+        ThreadState(double insert_mean, double insert_sd) : node_cache(100), edge_cache(100),
+            insert_sampler(insert_mean, insert_sd) {}
+        NodeRecordCache node_cache;
+        AdjacencyCache edge_cache;
+        default_random_engine prng;
+        normal_distribution<double> insert_sampler;
+    };
+    /// One state per OMP thread
+    vector<ThreadState> thread_states;
+    /// Get the calling thread's state
+    ThreadState& state() {
+        return thread_states.at(omp_get_thread_num());
+    }
     
-    default_random_engine prng;
-    discrete_distribution<> path_sampler;
-    vector<uniform_int_distribution<size_t> > start_pos_samplers;
+    /// Picks a start position in the graph (1-based), or along the
+    /// concatenation of the source paths (0-based)
+    uniform_int_distribution<size_t> start_pos_sampler;
+    /// Where each source path starts in the concatenation, with its total
+    /// length at the end
+    vector<size_t> path_starts;
     uniform_int_distribution<uint8_t> strand_sampler;
     uniform_int_distribution<size_t> background_sampler;
     uniform_int_distribution<size_t> mut_sampler;
     uniform_real_distribution<double> prob_sampler;
-    normal_distribution<double> insert_sampler;
+    
+    /// The length of each source path, so we don't look it up every base
+    unordered_map<string, size_t> source_path_lengths;
     
     const double sub_poly_rate;
     const double indel_poly_rate;
@@ -284,8 +327,12 @@ private:
     const double insert_mean;
     const double insert_sd;
     
+    /// The number of the next read for sample_read() and sample_read_pair()
     size_t sample_counter = 0;
+    /// The seed we were given, for read names
     size_t seed;
+    /// The seed all the read streams are made from (random if seed is 0)
+    size_t base_seed;
     
     const bool retry_on_Ns;
     
@@ -0,0 +1,236 @@
+#include "scoring_kernels.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VG_SCORING_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace vg {
+
+using namespace std;
+
+static size_t matching_prefix_length_scalar(const char* a, const char* b, size_t length) {
+    size_t i = 0;
+    while (i < length && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int32_t sum_qual_adj_match_scores_scalar(const char* sequence, const char* quality, size_t length,
+                                                const int32_t* score_matrix, const int32_t* nt_table) {
+    int32_t score = 0;
+    for (size_t i = 0; i < length; i++) {
+        score += score_matrix[25 * (uint8_t) quality[i] + 6 * nt_table[(uint8_t) sequence[i]]];
+    }
+    return score;
+}
+
+// Below this, exp() underflows to a subnormal, and next to the exp(0) = 1 of
+// the maximum it contributes nothing to a sum anyway
+static const double MIN_EXP_ARG = -708.0;
+
+// Constants for exp(x) = 2^n * exp(r) with n = floor(x / ln(2) + 1/2) and
+// |r| <= ln(2) / 2, where ln(2) is split in two so that n * LN2_HI is exact
+static const double LOG2_E = 1.4426950408889634;
+static const double LN2_HI = 0.693145751953125;
+static const double LN2_LO = 1.42860682030941723212e-6;
+
+// Taylor coefficients 1 / k! for k = 12 down to 2, which bound the error of
+// exp(r) to about 2e-16 of its value
+static const double EXP_COEFFICIENTS[11] = {
+    2.08767569878680989792e-9,
+    2.50521083854417187751e-8,
+    2.75573192239858906526e-7,
+    2.75573192239858906526e-6,
+    2.48015873015873015873e-5,
+    1.98412698412698412698e-4,
+    1.38888888888888888889e-3,
+    8.33333333333333333333e-3,
+    4.16666666666666666667e-2,
+    1.66666666666666666667e-1,
+    0.5
+};
+
+// The vector kernels sum in this many lanes, and the scalar one mimics them
+// so that both give the same answer
+static const size_t LOG_SUM_EXP_LANES = 4;
+
+/// exp(x) for MIN_EXP_ARG <= x <= 0, using only arithmetic that the vector
+/// kernel repeats exactly
+static inline double exp_nonpositive(double x) {
+    double n = floor(x * LOG2_E + 0.5);
+    double r = (x - n * LN2_HI) - n * LN2_LO;
+    double p = EXP_COEFFICIENTS[0];
+    for (size_t k = 1; k < 11; k++) {
+        p = p * r + EXP_COEFFICIENTS[k];
+    }
+    p = (p * r + 1.0) * r + 1.0;
+    int64_t bits = ((int64_t) n + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(double));
+    return p * scale;
+}
+
+static double sum_exp_below_scalar(const double* values, size_t length, double max_value) {
+    double sums[LOG_SUM_EXP_LANES] = {0.0, 0.0, 0.0, 0.0};
+    for (size_t i = 0; i < length; i++) {
+        double x = values[i] - max_value;
+        sums[i % LOG_SUM_EXP_LANES] += x < MIN_EXP_ARG ? 0.0 : exp_nonpositive(x);
+    }
+    return (sums[0] + sums[2]) + (sums[1] + sums[3]);
+}
+
+#ifdef VG_SCORING_KERNELS_X86
+
+// SSE2 is part of x86-64, so this one needs no check
+static size_t matching_prefix_length_sse2(const char* a, const char* b, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (a + i)),
+                                       _mm_loadu_si128((const __m128i*) (b + i)));
+        uint32_t differ = ~((uint32_t) _mm_movemask_epi8(equal)) & 0xFFFF;
+        if (differ) {
+            return i + __builtin_ctz(differ);
+        }
+    }
+    return i + matching_prefix_length_scalar(a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t matching_prefix_length_avx2(const char* a, const char* b, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) (a + i)),
+                                          _mm256_loadu_si256((const __m256i*) (b + i)));
+        uint32_t differ = ~((uint32_t) _mm256_movemask_epi8(equal));
+        if (differ) {
+            return i + __builtin_ctz(differ);
+        }
+    }
+    return i + matching_prefix_length_sse2(a + i, b + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static int32_t sum_qual_adj_match_scores_avx2(const char* sequence, const char* quality, size_t length,
+                                              const int32_t* score_matrix, const int32_t* nt_table) {
+    // Eight bases at a time: widen to 32 bits, look up their nucleotide codes,
+    // then look up their scores
+    const __m256i row_stride = _mm256_set1_epi32(25);
+    const __m256i diagonal_stride = _mm256_set1_epi32(6);
+    __m256i sums = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256i bases = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (sequence + i)));
+        __m256i quals = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (quality + i)));
+        __m256i nts = _mm256_i32gather_epi32((const int*) nt_table, bases, 4);
+        __m256i indexes = _mm256_add_epi32(_mm256_mullo_epi32(quals, row_stride),
+                                           _mm256_mullo_epi32(nts, diagonal_stride));
+        sums = _mm256_add_epi32(sums, _mm256_i32gather_epi32((const int*) score_matrix, indexes, 4));
+    }
+
+    __m128i half_sums = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    half_sums = _mm_add_epi32(half_sums, _mm_shuffle_epi32(half_sums, _MM_SHUFFLE(1, 0, 3, 2)));
+    half_sums = _mm_add_epi32(half_sums, _mm_shuffle_epi32(half_sums, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(half_sums) + sum_qual_adj_match_scores_scalar(sequence + i, quality + i, length - i,
+                                                                          score_matrix, nt_table);
+}
+
+__attribute__((target("avx2")))
+static double sum_exp_below_avx2(const double* values, size_t length, double max_value) {
+    const __m256d maxes = _mm256_set1_pd(max_value);
+    const __m256d min_arg = _mm256_set1_pd(MIN_EXP_ARG);
+    const __m256i exponent_bias = _mm256_set1_epi64x(1023);
+    __m256d sums = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + LOG_SUM_EXP_LANES <= length; i += LOG_SUM_EXP_LANES) {
+        __m256d x = _mm256_sub_pd(_mm256_loadu_pd(values + i), maxes);
+        __m256d underflow = _mm256_cmp_pd(x, min_arg, _CMP_LT_OQ);
+        // keep the arithmetic in range for the lanes we will zero out
+        x = _mm256_max_pd(x, min_arg);
+        __m256d n = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2_E)), _mm256_set1_pd(0.5)));
+        __m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(LN2_HI))),
+                                  _mm256_mul_pd(n, _mm256_set1_pd(LN2_LO)));
+        __m256d p = _mm256_set1_pd(EXP_COEFFICIENTS[0]);
+        for (size_t k = 1; k < 11; k++) {
+            p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(EXP_COEFFICIENTS[k]));
+        }
+        p = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(1.0)), r), _mm256_set1_pd(1.0));
+        __m256i bits = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n)), exponent_bias), 52);
+        __m256d terms = _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+        sums = _mm256_add_pd(sums, _mm256_andnot_pd(underflow, terms));
+    }
+    
+    double lanes[LOG_SUM_EXP_LANES];
+    _mm256_storeu_pd(lanes, sums);
+    // pick up the tail in the lanes that the scalar kernel would have put it in
+    for (; i < length; i++) {
+        double x = values[i] - max_value;
+        lanes[i % LOG_SUM_EXP_LANES] += x < MIN_EXP_ARG ? 0.0 : exp_nonpositive(x);
+    }
+    return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+}
+
+/// Check once whether we can use AVX2
+static bool have_avx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+size_t matching_prefix_length(const char* a, const char* b, size_t length) {
+#ifdef VG_SCORING_KERNELS_X86
+    if (have_avx2()) {
+        return matching_prefix_length_avx2(a, b, length);
+    }
+    return matching_prefix_length_sse2(a, b, length);
+#else
+    return matching_prefix_length_scalar(a, b, length);
+#endif
+}
+
+int32_t sum_qual_adj_match_scores(const char* sequence, const char* quality, size_t length,
+                                  const int32_t* score_matrix, const int32_t* nt_table) {
+#ifdef VG_SCORING_KERNELS_X86
+    if (have_avx2()) {
+        return sum_qual_adj_match_scores_avx2(sequence, quality, length, score_matrix, nt_table);
+    }
+#endif
+    return sum_qual_adj_match_scores_scalar(sequence, quality, length, score_matrix, nt_table);
+}
+
+double log_sum_exp(const double* values, size_t length) {
+    if (length == 0) {
+        return numeric_limits<double>::lowest();
+    }
+    
+    // factor out the maximum so that every term is at most 1
+    double max_value = values[0];
+    for (size_t i = 1; i < length; i++) {
+        max_value = values[i] > max_value ? values[i] : max_value;
+    }
+    if (std::isinf(max_value)) {
+        return max_value;
+    }
+    
+    double sum;
+#ifdef VG_SCORING_KERNELS_X86
+    if (have_avx2()) {
+        sum = sum_exp_below_avx2(values, length, max_value);
+    }
+    else {
+        sum = sum_exp_below_scalar(values, length, max_value);
+    }
+#else
+    sum = sum_exp_below_scalar(values, length, max_value);
+#endif
+    return max_value + log(sum);
+}
+
+}
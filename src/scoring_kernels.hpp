@@ -0,0 +1,33 @@
+#ifndef VG_SCORING_KERNELS_HPP_INCLUDED
+#define VG_SCORING_KERNELS_HPP_INCLUDED
+
+/**
+ * \file scoring_kernels.hpp: vectorized inner loops for scoring exact matches,
+ * for extending matches along a node, and for summing alignment likelihoods
+ * into mapping qualities. On x86 the widest kernel the CPU supports is picked
+ * when the program runs, so the binary stays portable.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vg {
+
+/// Get the number of leading characters that two buffers of the given length
+/// have in common.
+size_t matching_prefix_length(const char* a, const char* b, size_t length);
+
+/// Sum the quality adjusted scores of an exact match, which are
+/// score_matrix[25 * quality[i] + 6 * nt_table[sequence[i]]] as in a
+/// QualAdjAligner, but with the tables widened to 32 bits.
+int32_t sum_qual_adj_match_scores(const char* sequence, const char* quality, size_t length,
+                                  const int32_t* score_matrix, const int32_t* nt_table);
+
+/// Get the log of the sum of the exponentials of some values, or the lowest
+/// double if there are none. Uses a polynomial exp that is accurate to about
+/// one part in 10^15 and gives the same bits with or without vectorization.
+double log_sum_exp(const double* values, size_t length);
+
+}
+
+#endif
@@ -24,8 +24,10 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         exit(1);
     }
 
-    // Make a list of leaf sites
-    list<const Snarl*> leaves;
+    // Make a list of leaf sites. A site counts as a leaf once all the sites
+    // inside it have been popped, so we can keep using the snarl
+    // decomposition we found at the start as the graph gets simpler.
+    vector<const Snarl*> leaves;
     
     if (show_progress) {
         cerr << "Iteration " << iteration << ": Scanning " << graph.node_count() << " nodes and "
@@ -39,13 +41,28 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
             const Snarl* site = queue.front();
             queue.pop_front();
             
-            if (site_manager.is_leaf(site)) {
+            if (popped.count(site)) {
+                // We already simplified this site away
+                continue;
+            }
+            
+            bool is_leaf = true;
+            for (const Snarl* child_site : site_manager.children_of(site)) {
+                if (!popped.count(child_site)) {
+                    is_leaf = false;
+                    break;
+                }
+            }
+            
+            if (is_leaf) {
                 // It's a leaf. Filter it out if it is trivial
                 
                 if (site->type() == ULTRABUBBLE) {
                     auto contents = site_manager.shallow_contents(site, graph, false);
                     if (contents.first.empty()) {
-                        // Nothing but the boundary nodes in this snarl
+                        // Nothing but the boundary nodes in this snarl, so
+                        // it's already as simple as it gets
+                        popped.insert(site);
                         continue;
                     }
                 }
@@ -77,25 +94,29 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
     
     // We can't use the SnarlManager after we modify the graph, so we load the
     // contents of all the leaves we're going to modify first.
-    map<const Snarl*, pair<unordered_set<Node*>, unordered_set<Edge*>>> leaf_contents;
+    vector<pair<unordered_set<Node*>, unordered_set<Edge*>>> leaf_contents(leaves.size());
     
     // How big is each leaf in bp
-    map<const Snarl*, size_t> leaf_sizes;
+    vector<size_t> leaf_sizes(leaves.size(), 0);
     
     // We also need to pre-calculate the traversals for the snarls that are the
     // right size, since the traversal finder uses the snarl manager amd might
     // not work if we modify the graph.
-    map<const Snarl*, vector<SnarlTraversal>> leaf_traversals;
+    vector<vector<SnarlTraversal>> leaf_traversals(leaves.size());
     
-    for (const Snarl* leaf : leaves) {
+    // The leaves don't share any material but their boundary nodes, and we
+    // aren't modifying the graph yet, so we can look at them all in parallel.
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < leaves.size(); i++) {
         // Look at all the leaves
+        const Snarl* leaf = leaves[i];
         
         // Get the contents of the bubble, excluding the boundary nodes
-        leaf_contents[leaf] = site_manager.deep_contents(leaf, graph, false);
+        leaf_contents[i] = site_manager.deep_contents(leaf, graph, false);
         
         // For each leaf, calculate its total size.
-        unordered_set<Node*>& nodes = leaf_contents[leaf].first;
-        size_t& total_size = leaf_sizes[leaf];
+        unordered_set<Node*>& nodes = leaf_contents[i].first;
+        size_t& total_size = leaf_sizes[i];
         for (Node* node : nodes) {
             // For each node include it in the size figure
             total_size += node->sequence().size();
@@ -114,23 +135,43 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         
         // Identify the replacement traversal for the bubble if it's the right size.
         // We can't necessarily do this after we've modified the graph.
-        vector<SnarlTraversal>& traversals = leaf_traversals[leaf];
+        vector<SnarlTraversal>& traversals = leaf_traversals[i];
         traversals = traversal_finder.find_traversals(*leaf);
     }
     
-    for (const Snarl* leaf : leaves) {
+    // Rather than retracing a whole path after every site we splice into it,
+    // we save up the edits to the BED features, with their positions in the
+    // path as of the last time we traced it. The sites don't overlap, so
+    // applying the edits from right to left puts each one in the right place.
+    map<string, vector<tuple<size_t, size_t, size_t>>> pending_path_edits;
+    
+    auto apply_path_edits = [&](const string& path_name) {
+        auto& edits = pending_path_edits[path_name];
+        std::sort(edits.begin(), edits.end(), [](const tuple<size_t, size_t, size_t>& a,
+                                                 const tuple<size_t, size_t, size_t>& b) {
+            return get<0>(a) > get<0>(b);
+        });
+        for (auto& edit : edits) {
+            features.on_path_edit(path_name, get<0>(edit), get<1>(edit), get<2>(edit));
+        }
+        edits.clear();
+    };
+    
+    for (size_t leaf_number = 0; leaf_number < leaves.size(); leaf_number++) {
         // Look at all the leaves
+        const Snarl* leaf = leaves[leaf_number];
         
         // Get the contents of the bubble, excluding the boundary nodes
-        unordered_set<Node*>& nodes = leaf_contents[leaf].first;
-        unordered_set<Edge*>& edges = leaf_contents[leaf].second;
+        unordered_set<Node*>& nodes = leaf_contents[leaf_number].first;
+        unordered_set<Edge*>& edges = leaf_contents[leaf_number].second;
         
         // For each leaf, grab its total size.
-        size_t& total_size = leaf_sizes[leaf];
+        size_t& total_size = leaf_sizes[leaf_number];
         
         if (total_size == 0) {
             // This site is just the start and end nodes, so it doesn't make
             // sense to try and remove it.
+            popped.insert(leaf);
             continue;
         }
         
@@ -149,7 +190,7 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         // Otherwise we want to simplify this site away
         
         // Grab the replacement traversal for the bubble
-        vector<SnarlTraversal>& traversals = leaf_traversals[leaf];
+        vector<SnarlTraversal>& traversals = leaf_traversals[leaf_number];
         
         if (traversals.empty()) {
             // We couldn't find any paths through the site.
@@ -440,8 +481,10 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                     
                     // TODO: let it stay if it matches the one true traversal.
                                  
+                    PathIndex& path_index = *path_indexes.at(path_name).get();
                     for(auto* mapping : existing_mappings) {
                         // Trim the path out of the site
+                        path_index.mapping_positions.erase(mapping);
                         graph.paths.remove_mapping(mapping);
                     }
                     
@@ -472,6 +515,13 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                 PathIndex& path_index = *path_indexes.at(path_name).get();
                 Mapping* mapping_after_first = existing_mappings.empty() ?
                     (backward ? start_mapping : end_mapping) : existing_mappings.front();
+                if (!path_index.mapping_positions.count(mapping_after_first)) {
+                    // This mapping was put in by splicing an earlier site, so
+                    // we need to catch up on the edits and retrace the path.
+                    // TODO: right now this means retracing the entire path.
+                    apply_path_edits(path_name);
+                    path_index.update_mapping_positions(graph, path_name);
+                }
                 assert(path_index.mapping_positions.count(mapping_after_first));
                 size_t variable_start = path_index.mapping_positions.at(mapping_after_first); 
                 
@@ -489,8 +539,8 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                     << " with " << new_site_length << " bp" << endl;
 #endif
 
-                // Actually update any BED features
-                features.on_path_edit(path_name, variable_start, old_site_length, new_site_length);
+                // Save the edit for any BED features
+                pending_path_edits[path_name].emplace_back(variable_start, old_site_length, new_site_length);
                 
                 // Where will we insert the new site traversal into the path?
                 list<Mapping>::iterator insert_position;
@@ -508,6 +558,9 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                         cerr << path_name << ": Drop mapping " << pb2json(*mapping) << endl;
 #endif
                         
+                        // Forget its position, since its memory may get
+                        // reused for a new mapping.
+                        path_index.mapping_positions.erase(mapping);
                         insert_position = graph.paths.remove_mapping(mapping);
                     }
                 } else {
@@ -558,10 +611,6 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                     insert_position = graph.paths.insert_mapping(insert_position, path_name, new_mapping);
                     
                 }
-                
-                // Now we've corrected this site on this path. Update its index.
-                // TODO: right now this means retracing the entire path.
-                path_indexes[path_name].get()->update_mapping_positions(graph, path_name);
             }
             
             if (kill_path) {
@@ -632,8 +681,10 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
                     break;
                 }
                 
+                PathIndex& path_index = *path_indexes.at(path_name).get();
                 for (auto* mapping: to_remove) {
                     // Get rid of all the mappings once we're done tracing them out.
+                    path_index.mapping_positions.erase(mapping);
                     graph.paths.remove_mapping(mapping);
                 }
                 
@@ -737,11 +788,17 @@ pair<size_t, size_t> Simplifier::simplify_once(size_t iteration) {
         }
         
         // OK we finished a leaf
+        popped.insert(leaf);
         increment_progress();
     }
     
     destroy_progress();
     
+    // Catch the BED features up on all the edits
+    for (auto& kv : pending_path_edits) {
+        apply_path_edits(kv.first);
+    }
+    
     // Reset the ranks in the graph, since we rewrote paths
     graph.paths.clear_mapping_ranks();
     
@@ -65,6 +65,10 @@ protected:
     /// This keeps track of the sites to simplify
     SnarlManager site_manager;
     
+    /// These are the sites we have already simplified away, so their parents
+    /// can be treated as leaves without finding the snarls again
+    set<const Snarl*> popped;
+    
     /// This is used to find traversals of those sites
     TrivialTraversalFinder traversal_finder;
     
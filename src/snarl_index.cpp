@@ -0,0 +1,246 @@
+#include "snarl_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+const uint64_t SnarlIndex::NO_INDEX = numeric_limits<uint64_t>::max();
+const uint64_t SnarlIndex::VERSION = 1;
+
+/// Every snarl index starts with these 8 bytes
+static const char SNARL_INDEX_MAGIC[8] = {'V', 'G', 'S', 'N', 'A', 'R', 'L', 'X'};
+
+/// The header is the magic, then the version, snarl count, chain count,
+/// boundary count, and record bytes.
+static const size_t SNARL_INDEX_HEADER_SIZE = sizeof(SNARL_INDEX_MAGIC) + 5 * sizeof(uint64_t);
+
+/// Pack a node and orientation into a single sortable boundary key
+static inline uint64_t boundary_key(id_t node_id, bool backward) {
+    return ((uint64_t) node_id << 1) | (backward ? 1 : 0);
+}
+
+/// Write a vector of integers out raw
+static void write_array(ostream& out, const vector<uint64_t>& data) {
+    out.write((const char*) data.data(), data.size() * sizeof(uint64_t));
+}
+
+void SnarlIndex::write(const SnarlManager& manager, ostream& out) {
+
+    // Number the snarls and chains level by level, starting from the root
+    // chains.
+    vector<const Snarl*> snarl_order;
+    unordered_map<const Snarl*, uint64_t> snarl_number;
+    vector<uint64_t> snarl_parents;
+    vector<uint64_t> snarl_chains;
+    vector<uint64_t> chain_parents;
+    vector<uint64_t> chain_offsets{0};
+
+    deque<const Snarl*> to_visit{nullptr};
+    while (!to_visit.empty()) {
+        const Snarl* parent = to_visit.front();
+        to_visit.pop_front();
+        uint64_t parent_number = parent == nullptr ? NO_INDEX : snarl_number.at(parent);
+
+        for (auto& chain : manager.chains_of(parent)) {
+            uint64_t chain_number = chain_parents.size();
+            chain_parents.push_back(parent_number);
+            for (const Snarl* snarl : chain) {
+                snarl_number[snarl] = snarl_order.size();
+                snarl_order.push_back(snarl);
+                snarl_parents.push_back(parent_number);
+                snarl_chains.push_back(chain_number);
+                to_visit.push_back(snarl);
+            }
+            chain_offsets.push_back(snarl_order.size());
+        }
+    }
+
+    // Work out where each snarl reads into, the way SnarlManager does
+    map<uint64_t, uint64_t> boundaries;
+    for (size_t i = 0; i < snarl_order.size(); i++) {
+        const Snarl* snarl = snarl_order[i];
+        boundaries[boundary_key(snarl->start().node_id(), snarl->start().backward())] = i;
+        boundaries[boundary_key(snarl->end().node_id(), !snarl->end().backward())] = i;
+    }
+    vector<uint64_t> boundary_keys;
+    vector<uint64_t> boundary_snarls;
+    boundary_keys.reserve(boundaries.size());
+    boundary_snarls.reserve(boundaries.size());
+    for (auto& kv : boundaries) {
+        boundary_keys.push_back(kv.first);
+        boundary_snarls.push_back(kv.second);
+    }
+
+    // Serialize all the records
+    string records;
+    vector<uint64_t> record_offsets{0};
+    for (const Snarl* snarl : snarl_order) {
+        records += snarl->SerializeAsString();
+        record_offsets.push_back(records.size());
+    }
+
+    out.write(SNARL_INDEX_MAGIC, sizeof(SNARL_INDEX_MAGIC));
+    write_array(out, {VERSION, snarl_order.size(), chain_parents.size(), boundary_keys.size(), records.size()});
+    write_array(out, record_offsets);
+    write_array(out, snarl_parents);
+    write_array(out, snarl_chains);
+    write_array(out, chain_parents);
+    write_array(out, chain_offsets);
+    write_array(out, boundary_keys);
+    write_array(out, boundary_snarls);
+    out.write(records.data(), records.size());
+}
+
+bool SnarlIndex::is_snarl_index(const string& filename) {
+    ifstream in(filename);
+    char magic[sizeof(SNARL_INDEX_MAGIC)];
+    if (!in.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return memcmp(magic, SNARL_INDEX_MAGIC, sizeof(magic)) == 0;
+}
+
+SnarlIndex::SnarlIndex(const string& filename) : file(filename) {
+    if (!file.is_mapped() || file.size() < SNARL_INDEX_HEADER_SIZE ||
+        memcmp(file.data(), SNARL_INDEX_MAGIC, sizeof(SNARL_INDEX_MAGIC)) != 0) {
+        // Not a snarl index
+        return;
+    }
+
+    const uint64_t* header = (const uint64_t*) (file.data() + sizeof(SNARL_INDEX_MAGIC));
+    if (header[0] != VERSION) {
+        return;
+    }
+    snarls = header[1];
+    chains = header[2];
+    boundaries = header[3];
+    uint64_t record_bytes = header[4];
+
+    // Make sure the arrays fit before we do any arithmetic with the counts
+    size_t max_entries = file.size() / sizeof(uint64_t);
+    if (snarls > max_entries || chains > max_entries || boundaries > max_entries || record_bytes > file.size()) {
+        return;
+    }
+    size_t entries = (snarls + 1) + snarls + snarls + chains + (chains + 1) + boundaries + boundaries;
+    if (SNARL_INDEX_HEADER_SIZE + entries * sizeof(uint64_t) + record_bytes != file.size()) {
+        return;
+    }
+
+    const uint64_t* cursor = header + 5;
+    record_offsets = cursor;
+    cursor += snarls + 1;
+    snarl_parents = cursor;
+    cursor += snarls;
+    snarl_chains = cursor;
+    cursor += snarls;
+    chain_parents = cursor;
+    cursor += chains;
+    chain_offsets = cursor;
+    cursor += chains + 1;
+    boundary_keys = cursor;
+    cursor += boundaries;
+    boundary_snarls = cursor;
+    cursor += boundaries;
+    records = (const char*) cursor;
+
+    valid = record_offsets[snarls] == record_bytes && chain_offsets[chains] == snarls;
+}
+
+bool SnarlIndex::is_valid() const {
+    return valid;
+}
+
+size_t SnarlIndex::snarl_count() const {
+    return snarls;
+}
+
+size_t SnarlIndex::chain_count() const {
+    return chains;
+}
+
+Snarl SnarlIndex::get_snarl(size_t snarl) const {
+    Snarl parsed;
+    if (!parsed.ParseFromArray(records + record_offsets[snarl], record_offsets[snarl + 1] - record_offsets[snarl])) {
+        throw runtime_error("Could not parse snarl " + to_string(snarl) + " from snarl index");
+    }
+    return parsed;
+}
+
+size_t SnarlIndex::parent_of(size_t snarl) const {
+    return snarl_parents[snarl];
+}
+
+size_t SnarlIndex::chain_of(size_t snarl) const {
+    return snarl_chains[snarl];
+}
+
+size_t SnarlIndex::chain_parent(size_t chain) const {
+    return chain_parents[chain];
+}
+
+size_t SnarlIndex::chain_size(size_t chain) const {
+    return chain_offsets[chain + 1] - chain_offsets[chain];
+}
+
+size_t SnarlIndex::chain_member(size_t chain, size_t position) const {
+    // Chains hold consecutively numbered snarls
+    return chain_offsets[chain] + position;
+}
+
+size_t SnarlIndex::into_which_snarl(id_t node_id, bool backward) const {
+    uint64_t key = boundary_key(node_id, backward);
+    const uint64_t* found = lower_bound(boundary_keys, boundary_keys + boundaries, key);
+    if (found == boundary_keys + boundaries || *found != key) {
+        return NO_INDEX;
+    }
+    return boundary_snarls[found - boundary_keys];
+}
+
+SnarlManager SnarlIndex::to_snarl_manager() const {
+
+    vector<Snarl> parsed(snarls);
+
+    // We can't throw out of the parallel loop, so remember the first error.
+    string error;
+#pragma omp parallel for schedule(static, 1024)
+    for (size_t i = 0; i < snarls; i++) {
+        try {
+            parsed[i] = get_snarl(i);
+        } catch (const exception& e) {
+#pragma omp critical (snarl_index_error)
+            if (error.empty()) {
+                error = e.what();
+            }
+        }
+    }
+    if (!error.empty()) {
+        throw runtime_error(error);
+    }
+
+    SnarlManager manager;
+    vector<const Snarl*> managed(snarls);
+    for (size_t i = 0; i < snarls; i++) {
+        managed[i] = manager.add_snarl(parsed[i]);
+    }
+    // We're done with the copies
+    vector<Snarl>().swap(parsed);
+
+    for (size_t i = 0; i < chains; i++) {
+        Chain chain(managed.begin() + chain_offsets[i], managed.begin() + chain_offsets[i + 1]);
+        manager.add_chain(chain, chain_parents[i] == NO_INDEX ? nullptr : managed[chain_parents[i]]);
+    }
+    manager.index_child_connectivity();
+
+    return manager;
+}
+
+}
@@ -0,0 +1,125 @@
+#ifndef VG_SNARL_INDEX_HPP_INCLUDED
+#define VG_SNARL_INDEX_HPP_INCLUDED
+
+/** \file
+ * snarl_index.hpp: a binary, memory-mappable snarl file that stores the snarl
+ * tree, the chains, and the node-to-snarl index precomputed in flat arrays,
+ * so they don't have to be rebuilt from a stream of Snarls on every load.
+ */
+
+#include <string>
+#include <ostream>
+#include <cstdint>
+
+#include "snarls.hpp"
+#include "mapped_file.hpp"
+
+namespace vg {
+
+using namespace std;
+
+/**
+ * A read-only view of a snarl index file.
+ *
+ * The file holds a small header, then arrays of 64-bit integers giving each
+ * snarl's parent and chain, each chain's parent and extent, and the boundary
+ * (node, orientation) pairs sorted for binary search, then the serialized
+ * Snarl records. Everything is used straight out of the mapping; Snarl
+ * records are only parsed when asked for.
+ *
+ * Snarls and chains are numbered in the order write() visits them, level by
+ * level, so the snarls of each chain are numbered consecutively, each chain
+ * comes before the chains inside its snarls, and chains keep the order they
+ * have in the SnarlManager.
+ */
+class SnarlIndex {
+public:
+
+    /// Stands in for "no snarl" or "no chain"
+    static const uint64_t NO_INDEX;
+
+    /// Format version we read and write
+    static const uint64_t VERSION;
+
+    /**
+     * Write the snarls, chains, and boundary index of the given SnarlManager
+     * to the given stream as a snarl index.
+     */
+    static void write(const SnarlManager& manager, ostream& out);
+
+    /**
+     * Return true if the given file starts like a snarl index, and false if
+     * it doesn't (for example, if it is a stream of Snarls) or can't be read.
+     */
+    static bool is_snarl_index(const string& filename);
+
+    /**
+     * Map the snarl index in the given file. Check is_valid() to see if it
+     * worked.
+     */
+    SnarlIndex(const string& filename);
+
+    /// Return true if a well-formed snarl index is mapped.
+    bool is_valid() const;
+
+    /// Get the number of snarls.
+    size_t snarl_count() const;
+
+    /// Get the number of chains, including trivial ones.
+    size_t chain_count() const;
+
+    /// Parse out the Snarl with the given number.
+    Snarl get_snarl(size_t snarl) const;
+
+    /// Get the number of the parent of the given snarl, or NO_INDEX for a
+    /// top-level snarl.
+    size_t parent_of(size_t snarl) const;
+
+    /// Get the number of the chain the given snarl is in.
+    size_t chain_of(size_t snarl) const;
+
+    /// Get the number of the snarl the given chain is in, or NO_INDEX for a
+    /// root chain.
+    size_t chain_parent(size_t chain) const;
+
+    /// Get the number of snarls in the given chain.
+    size_t chain_size(size_t chain) const;
+
+    /// Get the number of the snarl at the given position in the given chain.
+    size_t chain_member(size_t chain, size_t position) const;
+
+    /// Get the number of the snarl that reading onto the given node in the
+    /// given orientation enters, or NO_INDEX if it doesn't enter one. Works
+    /// like SnarlManager::into_which_snarl().
+    size_t into_which_snarl(id_t node_id, bool backward) const;
+
+    /**
+     * Make a SnarlManager with all the snarls and chains, without
+     * recomputing the tree or the chains. Snarls are parsed in parallel.
+     */
+    SnarlManager to_snarl_manager() const;
+
+private:
+    MappedFileBuffer file;
+
+    // Counts read from the header
+    uint64_t snarls = 0;
+    uint64_t chains = 0;
+    uint64_t boundaries = 0;
+
+    // Pointers to the arrays in the mapping
+    const uint64_t* record_offsets = nullptr;
+    const uint64_t* snarl_parents = nullptr;
+    const uint64_t* snarl_chains = nullptr;
+    const uint64_t* chain_parents = nullptr;
+    const uint64_t* chain_offsets = nullptr;
+    const uint64_t* boundary_keys = nullptr;
+    const uint64_t* boundary_snarls = nullptr;
+    const char* records = nullptr;
+
+    bool valid = false;
+};
+
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include "json2pb.h"
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/is_directed_acyclic.hpp"
+#include "algorithms/weakly_connected_components.hpp"
 
 namespace vg {
 
@@ -27,6 +28,13 @@ CactusSnarlFinder::CactusSnarlFinder(VG& graph, const string& hint_path) :
     // TODO: actually use it
 }
 
+CactusSnarlFinder::CactusSnarlFinder(VG& graph, const unordered_set<string>& hint_paths) :
+    CactusSnarlFinder(graph) {
+    
+    // Save the hint paths
+    this->hint_paths = hint_paths;
+}
+
 SnarlManager CactusSnarlFinder::find_snarls() {
     
     if (graph.size() == 0) {
@@ -53,6 +61,7 @@ SnarlManager CactusSnarlFinder::find_snarls() {
     
     // Fill the manager with all of the snarls, recursively.
     recursively_emit_snarls(Visit(), Visit(), Visit(), Visit(), cactus_chains_list, cactus_unary_snarls_list, snarl_manager);
+    snarl_manager.index_child_connectivity();
     
     // Free the decomposition
     stSnarlDecomposition_destruct(snarls);
@@ -68,6 +77,137 @@ SnarlManager CactusSnarlFinder::find_snarls() {
     
 }
 
+/// Copy the given snarl (or the root, if null) and everything under it from
+/// one SnarlManager to another, keeping the chains. Returns the copy of the
+/// snarl, or null for the root.
+static const Snarl* copy_snarl_tree(const SnarlManager& source, const Snarl* snarl, SnarlManager& destination) {
+    // Children have to be added before their parent, and their chains after.
+    vector<Chain> child_chains;
+    for (auto& chain : source.chains_of(snarl)) {
+        child_chains.emplace_back();
+        for (const Snarl* child : chain) {
+            child_chains.back().push_back(copy_snarl_tree(source, child, destination));
+        }
+    }
+    
+    const Snarl* managed = snarl == nullptr ? nullptr : destination.add_snarl(*snarl);
+    for (auto& chain : child_chains) {
+        destination.add_chain(chain, managed);
+    }
+    return managed;
+}
+
+ComponentCactusSnarlFinder::ComponentCactusSnarlFinder(const HandleGraph* graph, Paths* paths,
+    const unordered_set<string>& hint_paths) : graph(graph), paths(paths), hint_paths(hint_paths) {
+    // Nothing to do!
+}
+
+SnarlManager ComponentCactusSnarlFinder::find_snarls() {
+    
+    vector<unordered_set<id_t>> components = algorithms::weakly_connected_components(graph);
+    
+    // Assign the paths to components up front, since Paths can't be read from
+    // multiple threads.
+    vector<vector<Path>> component_paths(components.size());
+    if (paths != nullptr) {
+        unordered_map<id_t, size_t> node_to_component;
+        for (size_t i = 0; i < components.size(); i++) {
+            for (auto& id : components[i]) {
+                node_to_component[id] = i;
+            }
+        }
+        
+        paths->for_each([&](const Path& path) {
+            if (path.mapping_size() == 0) {
+                // Not a real useful path, so skip it.
+                return;
+            }
+            size_t component = node_to_component.at(path.mapping(0).position().node_id());
+            for (size_t i = 0; i < path.mapping_size(); i++) {
+                if (node_to_component.at(path.mapping(i).position().node_id()) != component) {
+                    // Cactus can't use a path like this to pick telomeres.
+                    throw runtime_error("Path " + path.name() + " spans multiple connected components!");
+                }
+            }
+            component_paths[component].push_back(path);
+        });
+    }
+    
+    // Do the biggest components first, so they don't hold up the end.
+    vector<size_t> order(components.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&](const size_t& a, const size_t& b) {
+        return components[a].size() > components[b].size();
+    });
+    
+    // Each component gets its own snarls, which we combine at the end.
+    vector<SnarlManager> component_snarls(components.size());
+    
+    // We can't throw out of the parallel loop, so remember the first error.
+    string error;
+    
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < order.size(); i++) {
+        size_t component = order[i];
+        if (components[component].size() < 2) {
+            // If we feed this through to Cactus it will crash.
+            continue;
+        }
+        
+        try {
+            // Copy the component into a VG, with the nodes in ID order so the
+            // graph we decompose doesn't depend on hash order.
+            vector<id_t> ids(components[component].begin(), components[component].end());
+            sort(ids.begin(), ids.end());
+            // We're done with the ID set
+            unordered_set<id_t>().swap(components[component]);
+            
+            VG piece;
+            for (auto& id : ids) {
+                piece.create_node(graph->get_sequence(graph->get_handle(id, false)), id);
+            }
+            for (auto& id : ids) {
+                handle_t handle = graph->get_handle(id, false);
+                graph->follow_edges(handle, false, [&](const handle_t& next) {
+                    piece.create_edge(id, graph->get_id(next), false, graph->get_is_reverse(next));
+                });
+                graph->follow_edges(handle, true, [&](const handle_t& prev) {
+                    piece.create_edge(graph->get_id(prev), id, graph->get_is_reverse(prev), false);
+                });
+            }
+            for (auto& path : component_paths[component]) {
+                piece.paths.extend(path);
+            }
+            vector<Path>().swap(component_paths[component]);
+            
+            CactusSnarlFinder finder(piece, hint_paths);
+            component_snarls[component] = finder.find_snarls();
+        } catch (const exception& e) {
+#pragma omp critical (component_snarl_error)
+            if (error.empty()) {
+                error = e.what();
+            }
+        }
+    }
+    
+    if (!error.empty()) {
+        throw runtime_error(error);
+    }
+    
+    // Put all the snarls together in component order
+    SnarlManager snarl_manager;
+    for (auto& found : component_snarls) {
+        copy_snarl_tree(found, nullptr, snarl_manager);
+        // Free each component's copy as we go
+        found = SnarlManager();
+    }
+    snarl_manager.index_child_connectivity();
+    
+    return snarl_manager;
+}
+
 const Snarl* CactusSnarlFinder::recursively_emit_snarls(const Visit& start, const Visit& end,
                                                         const Visit& parent_start, const Visit& parent_end,
                                                         stList* chains_list, stList* unary_snarls_list, SnarlManager& destination) {
@@ -659,10 +799,44 @@ const deque<Chain>& SnarlManager::chains_of(const Snarl* snarl) const {
 }
     
 NetGraph SnarlManager::net_graph_of(const Snarl* snarl, const HandleGraph* graph, bool use_internal_connectivity) const {
+    if (use_internal_connectivity) {
+        auto found = child_connectivity.find(key_form(snarl));
+        if (found != child_connectivity.end()) {
+            // Reuse the summary of the children's connectivity
+            return NetGraph(snarl->start(), snarl->end(), chains_of(snarl), graph, &found->second);
+        }
+    }
     // Just get the chains and forward them on to the NetGraph.
     // TODO: The NetGraph ends up computing its own indexes.
     return NetGraph(snarl->start(), snarl->end(), chains_of(snarl), graph, use_internal_connectivity);
 }
+
+void SnarlManager::index_child_connectivity() {
+    // Make all the entries first, so filling them in parallel doesn't change the map
+    child_connectivity.clear();
+    for (auto& kv : child_chains) {
+        child_connectivity[kv.first];
+    }
+    
+    // A summary only depends on the flags of the children themselves, so the
+    // snarls can be done in any order
+    for_each_snarl_parallel([&](const Snarl* snarl) {
+        auto found = child_connectivity.find(key_form(snarl));
+        if (found == child_connectivity.end()) {
+            return;
+        }
+        for (auto& chain : chains_of(snarl)) {
+            if (chain.size() == 1 && chain.front()->type() == UNARY) {
+                const Snarl* unary = chain.front();
+                found->second[unary->start().node_id()] = make_tuple(unary->start_self_reachable(),
+                                                                     unary->end_self_reachable(),
+                                                                     unary->start_end_reachable());
+            } else {
+                found->second[get_start_of(chain).node_id()] = NetGraph::chain_connectivity(chain);
+            }
+        }
+    });
+}
     
 bool SnarlManager::is_leaf(const Snarl* snarl) const {
     return children.at(key_form(snarl)).size() == 0;
@@ -726,6 +900,21 @@ void SnarlManager::flip(const Snarl* snarl) {
         
     // save the key used in the indices before editing the snarl
     auto old_key = key_form(snarl);
+    
+    // The summaries of this snarl's children, and of its parent's, depend on its orientation
+    child_connectivity.erase(old_key);
+    if (parent.count(old_key) && parent[old_key] != nullptr) {
+        child_connectivity.erase(key_form(parent[old_key]));
+    }
+    
+    // The deep contents don't depend on orientation, so just move them to the new key
+    auto contents_range = deep_content_ranges.find(old_key);
+    bool had_contents = contents_range != deep_content_ranges.end();
+    pair<size_t, size_t> old_contents_range;
+    if (had_contents) {
+        old_contents_range = contents_range->second;
+        deep_content_ranges.erase(contents_range);
+    }
         
     // Get a non-const reference to the cannonical snarl.
     // TODO: Can't we use a const cast and save a lookup?
@@ -760,6 +949,10 @@ void SnarlManager::flip(const Snarl* snarl) {
     // Update self index
     self[key_form(snarl)] = std::move(self[old_key]);
     self.erase(old_key);
+    
+    if (had_contents) {
+        deep_content_ranges[key_form(snarl)] = old_contents_range;
+    }
         
     // note: snarl_into index is invariant to flipping
 }
@@ -830,6 +1023,8 @@ void SnarlManager::add_chain(const Chain& new_chain, const Snarl* chain_parent)
         
         // Save a copy of the chain as a child chain
         child_chains[key_form(chain_parent)].push_back(new_chain);
+        // The parent has a new child, so any summary of its children is stale
+        child_connectivity.erase(key_form(chain_parent));
             
         for (const Snarl* child : new_chain) {
             // Save it as a child of the parent
@@ -982,6 +1177,8 @@ void SnarlManager::build_indexes() {
                 
         }
     }
+    
+    index_child_connectivity();
 }
     
 deque<Chain> SnarlManager::compute_chains(const vector<const Snarl*>& input_snarls) {
@@ -1342,6 +1539,24 @@ const Snarl* SnarlManager::manage(const Snarl& not_owned) const {
 }
     
 vector<Visit> SnarlManager::visits_right(const Visit& visit, VG& graph, const Snarl* in_snarl) const {
+    return visits_right(visit, in_snarl, [&](const NodeSide& side, const function<void(const NodeSide&)>& iteratee) {
+        for (auto attached : graph.sides_of(side)) {
+            iteratee(attached);
+        }
+    });
+}
+    
+vector<Visit> SnarlManager::visits_right(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const {
+    return visits_right(visit, in_snarl, [&](const NodeSide& side, const function<void(const NodeSide&)>& iteratee) {
+        // Read out of the side, and see what we read into
+        graph.follow_edges(graph.get_handle(side.node, !side.is_end), false, [&](const handle_t& next) {
+            iteratee(NodeSide(graph.get_id(next), graph.get_is_reverse(next)));
+        });
+    });
+}
+    
+vector<Visit> SnarlManager::visits_right(const Visit& visit, const Snarl* in_snarl,
+                                         const function<void(const NodeSide&, const function<void(const NodeSide&)>&)>& for_each_attached) const {
         
 #ifdef debug
     cerr << "Look right from " << visit << endl;
@@ -1383,7 +1598,7 @@ vector<Visit> SnarlManager::visits_right(const Visit& visit, VG& graph, const Sn
             
     }
         
-    for (auto attached : graph.sides_of(right_side)) {
+    for_each_attached(right_side, [&](const NodeSide& attached) {
         // For every NodeSide attached to the right side of this visit
             
 #ifdef debug
@@ -1442,7 +1657,7 @@ vector<Visit> SnarlManager::visits_right(const Visit& visit, VG& graph, const Sn
 #endif
                 
         }
-    }
+    });
         
     return to_return;
         
@@ -1463,6 +1678,148 @@ vector<Visit> SnarlManager::visits_left(const Visit& visit, VG& graph, const Sna
         
 }
     
+vector<Visit> SnarlManager::visits_left(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const {
+        
+    // Get everything right of the reversed visit
+    vector<Visit> to_return = visits_right(reverse(visit), graph, in_snarl);
+        
+    // Un-reverse them so they are in the correct orientation to be seen
+    // left of here.
+    for (auto& v : to_return) {
+        v = reverse(v);
+    }
+        
+    return to_return;
+        
+}
+    
+void SnarlContents::clear() {
+    nodes.clear();
+    edges.clear();
+    seen_nodes.clear();
+    seen_edges.clear();
+    stack.clear();
+}
+    
+void SnarlManager::shallow_contents(const Snarl* snarl, const HandleGraph& graph, bool include_boundary_nodes,
+                                    SnarlContents& contents) const {
+    fill_contents(snarl, graph, include_boundary_nodes, false, contents);
+}
+    
+void SnarlManager::deep_contents(const Snarl* snarl, const HandleGraph& graph, bool include_boundary_nodes,
+                                 SnarlContents& contents) const {
+    fill_contents(snarl, graph, include_boundary_nodes, true, contents);
+}
+    
+void SnarlManager::fill_contents(const Snarl* snarl, const HandleGraph& graph, bool include_boundary_nodes,
+                                 bool deep, SnarlContents& contents) const {
+    
+    contents.clear();
+    
+    id_t start_id = snarl->start().node_id();
+    id_t end_id = snarl->end().node_id();
+    
+    // mark the boundary nodes as already stacked so that paths will terminate on them
+    contents.seen_nodes.insert(start_id);
+    contents.seen_nodes.insert(end_id);
+    
+    if (include_boundary_nodes) {
+        contents.nodes.push_back(graph.get_handle(start_id, false));
+        if (end_id != start_id) {
+            contents.nodes.push_back(graph.get_handle(end_id, false));
+        }
+    }
+    
+    // record an edge, and stack up the node it leads to if it is new
+    auto take_edge = [&](const handle_t& from, const handle_t& to, const handle_t& next) {
+        edge_t edge = graph.edge_handle(from, to);
+        if (!contents.seen_edges.count(edge)) {
+            contents.seen_edges.insert(edge);
+            contents.edges.push_back(edge);
+        }
+        if (!contents.seen_nodes.count(graph.get_id(next))) {
+            contents.seen_nodes.insert(graph.get_id(next));
+            contents.stack.push_back(graph.forward(next));
+        }
+    };
+    
+    // stack up the nodes one edge inside the snarl from either end
+    for (handle_t inward : {graph.get_handle(start_id, snarl->start().backward()),
+                            graph.get_handle(end_id, !snarl->end().backward())}) {
+        graph.follow_edges(inward, false, [&](const handle_t& next) {
+            take_edge(inward, next, next);
+        });
+    }
+    
+    // traverse the snarl with DFS, skipping over any child snarls unless we
+    // are going deep; do not pay attention to valid walks since we also want
+    // to discover any tips
+    while (!contents.stack.empty()) {
+        handle_t handle = contents.stack.back();
+        contents.stack.pop_back();
+        contents.nodes.push_back(handle);
+        
+        id_t id = graph.get_id(handle);
+        const Snarl* forward_snarl = deep ? nullptr : into_which_snarl(id, false);
+        const Snarl* backward_snarl = deep ? nullptr : into_which_snarl(id, true);
+        
+        for (const Snarl* child : {forward_snarl, backward_snarl}) {
+            if (child) {
+                // stack up the node on the opposite side of the child snarl
+                // rather than traversing it
+                id_t other_id = child->start().node_id() == id ? child->end().node_id() : child->start().node_id();
+                if (!contents.seen_nodes.count(other_id)) {
+                    contents.seen_nodes.insert(other_id);
+                    contents.stack.push_back(graph.get_handle(other_id, false));
+                }
+            }
+        }
+        
+        if (!forward_snarl) {
+            graph.follow_edges(handle, false, [&](const handle_t& next) {
+                take_edge(handle, next, next);
+            });
+        }
+        if (!backward_snarl) {
+            graph.follow_edges(handle, true, [&](const handle_t& prev) {
+                take_edge(prev, handle, prev);
+            });
+        }
+    }
+}
+    
+void SnarlManager::index_deep_contents(const HandleGraph& graph) {
+    deep_content_index.clear();
+    deep_content_ranges.clear();
+    
+    // A snarl's deep contents are its shallow contents plus the deep contents
+    // of its children, which don't overlap, so lay each snarl's shallow
+    // contents out right before the runs of its children.
+    SnarlContents contents;
+    function<void(const Snarl*)> lay_out = [&](const Snarl* snarl) {
+        size_t run_start = deep_content_index.size();
+        shallow_contents(snarl, graph, false, contents);
+        for (auto& handle : contents.nodes) {
+            deep_content_index.push_back(graph.get_id(handle));
+        }
+        for (const Snarl* child : children_of(snarl)) {
+            lay_out(child);
+        }
+        deep_content_ranges[key_form(snarl)] = make_pair(run_start, deep_content_index.size());
+    };
+    
+    for_each_top_level_snarl(lay_out);
+}
+    
+pair<vector<id_t>::const_iterator, vector<id_t>::const_iterator> SnarlManager::deep_content_ids(const Snarl* snarl) const {
+    auto found = deep_content_ranges.find(key_form(snarl));
+    if (found == deep_content_ranges.end()) {
+        throw runtime_error("[vg::SnarlManager] snarl " + pb2json(*snarl) + " is not in the deep contents index");
+    }
+    return make_pair(deep_content_index.begin() + found->second.first,
+                     deep_content_index.begin() + found->second.second);
+}
+    
 NetGraph::NetGraph(const Visit& start, const Visit& end, const HandleGraph* graph, bool use_internal_connectivity) :
     graph(graph),
     start(graph->get_handle(start.node_id(), start.backward())),
@@ -1495,7 +1852,9 @@ void NetGraph::add_unary_child(const Snarl* unary) {
     // Save it as a unary snarl
     unary_boundaries.insert(snarl_bound);
         
-    if (use_internal_connectivity) {
+    if (shared_connectivity) {
+        // Its connectivity was summarized ahead of time
+    } else if (use_internal_connectivity) {
         // Save its connectivity
         connectivity[snarl_id] = make_tuple(unary->start_self_reachable(), unary->end_self_reachable(),
                                             unary->start_end_reachable());
@@ -1517,75 +1876,82 @@ void NetGraph::add_chain_child(const Chain& chain) {
     chain_ends_by_start[chain_start_handle] = chain_end_handle;
     chain_end_rewrites[graph->flip(chain_end_handle)] = graph->flip(chain_start_handle);
         
-    if (use_internal_connectivity) {
+    if (shared_connectivity) {
+        // Its connectivity was summarized ahead of time
+    } else if (use_internal_connectivity) {
+        connectivity[graph->get_id(chain_start_handle)] = chain_connectivity(chain);
+    } else {
+        // Act like a normal connected-through node.
+        connectivity[graph->get_id(chain_start_handle)] = make_tuple(false, false, true);
+    }
+}
+    
+tuple<bool, bool, bool> NetGraph::chain_connectivity(const Chain& chain) {
+    // Determine child snarl connectivity.
+    bool connected_left_left = false;
+    bool connected_right_right = false;
+    bool connected_left_right = true;
         
-        // Determine child snarl connectivity.
-        bool connected_left_left = false;
-        bool connected_right_right = false;
-        bool connected_left_right = true;
+    for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
+        // Go through the oriented child snarls from left to right
+        const Snarl* child = it->first;
+        bool backward = it->second;
             
-        for (auto it = chain_begin(chain); it != chain_end(chain); ++it) {
-            // Go through the oriented child snarls from left to right
-            const Snarl* child = it->first;
-            bool backward = it->second;
-                
-            // Unpack the child's connectivity
-            bool start_self_reachable = child->start_self_reachable();
-            bool end_self_reachable = child->end_self_reachable();
-            bool start_end_reachable = child->start_end_reachable();
-                
-            if (backward) {
-                // Look at the connectivity in reverse
-                std::swap(start_self_reachable, end_self_reachable);
-            }
-                
-            if (start_self_reachable) {
-                // We found a turnaround from the left
-                connected_left_left = true;
-            }
-                
-            if (!start_end_reachable) {
-                // There's an impediment to getting through.
-                connected_left_right = false;
-                // Don't keep looking for turnarounds
-                break;
-            }
+        // Unpack the child's connectivity
+        bool start_self_reachable = child->start_self_reachable();
+        bool end_self_reachable = child->end_self_reachable();
+        bool start_end_reachable = child->start_end_reachable();
+            
+        if (backward) {
+            // Look at the connectivity in reverse
+            std::swap(start_self_reachable, end_self_reachable);
         }
             
-        for (auto it = chain_rbegin(chain); it != chain_rend(chain); ++it) {
-            // Go through the oriented child snarls from left to right
-            const Snarl* child = it->first;
-            bool backward = it->second;
-                
-            // Unpack the child's connectivity
-            bool start_self_reachable = child->start_self_reachable();
-            bool end_self_reachable = child->end_self_reachable();
-            bool start_end_reachable = child->start_end_reachable();
-                
-            if (backward) {
-                // Look at the connectivity in reverse
-                std::swap(start_self_reachable, end_self_reachable);
-            }
-                
-            if (end_self_reachable) {
-                // We found a turnaround from the right
-                connected_right_right = true;
-                break;
-            }
-                
-            if (!start_end_reachable) {
-                // Don't keep looking for turnarounds
-                break;
-            }
+        if (start_self_reachable) {
+            // We found a turnaround from the left
+            connected_left_left = true;
         }
             
-        // Save the connectivity
-        connectivity[graph->get_id(chain_start_handle)] = tie(connected_left_left,
-                                                              connected_right_right, connected_left_right);
-    } else {
-        // Act like a normal connected-through node.
-        connectivity[graph->get_id(chain_start_handle)] = make_tuple(false, false, true);
+        if (!start_end_reachable) {
+            // There's an impediment to getting through.
+            connected_left_right = false;
+            // Don't keep looking for turnarounds
+            break;
+        }
     }
+        
+    for (auto it = chain_rbegin(chain); it != chain_rend(chain); ++it) {
+        // Go through the oriented child snarls from left to right
+        const Snarl* child = it->first;
+        bool backward = it->second;
+            
+        // Unpack the child's connectivity
+        bool start_self_reachable = child->start_self_reachable();
+        bool end_self_reachable = child->end_self_reachable();
+        bool start_end_reachable = child->start_end_reachable();
+            
+        if (backward) {
+            // Look at the connectivity in reverse
+            std::swap(start_self_reachable, end_self_reachable);
+        }
+            
+        if (end_self_reachable) {
+            // We found a turnaround from the right
+            connected_right_right = true;
+            break;
+        }
+            
+        if (!start_end_reachable) {
+            // Don't keep looking for turnarounds
+            break;
+        }
+    }
+        
+    return make_tuple(connected_left_left, connected_right_right, connected_left_right);
+}
+
+const tuple<bool, bool, bool>& NetGraph::connectivity_of(id_t child_id) const {
+    return shared_connectivity ? shared_connectivity->at(child_id) : connectivity.at(child_id);
 }
     
 handle_t NetGraph::get_handle(const id_t& node_id, bool is_reverse) const {
@@ -1721,7 +2087,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
         bool connected_start_start;
         bool connected_end_end;
         bool connected_start_end;
-        tie(connected_start_start, connected_end_end, connected_start_end) = connectivity.at(graph->get_id(handle));
+        tie(connected_start_start, connected_end_end, connected_start_end) = connectivity_of(graph->get_id(handle));
             
 #ifdef debug
         cerr << "Connectivity: " << connected_start_start << " " << connected_end_end << " " << connected_start_end << endl;
@@ -1893,7 +2259,7 @@ bool NetGraph::follow_edges(const handle_t& handle, bool go_left, const function
         bool connected_start_start;
         bool connected_end_end;
         bool connected_start_end;
-        tie(connected_start_start, connected_end_end, connected_start_end) = connectivity.at(graph->get_id(handle));
+        tie(connected_start_start, connected_end_end, connected_start_end) = connectivity_of(graph->get_id(handle));
             
         if (unary_boundaries.count(handle)) {
             // We point into a unary snarl
@@ -82,6 +82,12 @@ public:
      */
     CactusSnarlFinder(VG& graph, const string& hint_path);
     
+    /**
+     * Make a new CactusSnarlFinder with a set of hinted paths to base the
+     * decomposition on.
+     */
+    CactusSnarlFinder(VG& graph, const unordered_set<string>& hint_paths);
+    
     /**
      * Find all the snarls with Cactus, and put them into a SnarlManager.
      */
@@ -89,6 +95,46 @@ public:
     
 };
 
+/**
+ * Class for finding all snarls with Cactus one weakly connected component at a
+ * time, in parallel. Only the components being worked on are copied into VG
+ * and Cactus graphs, so memory is bounded by a few of the largest components
+ * instead of the whole graph, and the backing graph can be any HandleGraph,
+ * such as an XG.
+ *
+ * Single-node components, which Cactus can't decompose, have no snarls found
+ * in them.
+ */
+class ComponentCactusSnarlFinder : public SnarlFinder {
+    
+    /// Holds the graph we are looking for sites in.
+    const HandleGraph* graph;
+    
+    /// Holds the paths to use for picking telomeres, if any
+    Paths* paths;
+    
+    /// Holds the names of reference path hints
+    unordered_set<string> hint_paths;
+    
+public:
+    /**
+     * Make a new ComponentCactusSnarlFinder to find snarls in the given graph.
+     * If paths are given, they are used to pick the ends of each component as
+     * CactusSnarlFinder would, preferring the hinted paths. Each path must
+     * stay within one component.
+     */
+    ComponentCactusSnarlFinder(const HandleGraph* graph, Paths* paths = nullptr,
+        const unordered_set<string>& hint_paths = unordered_set<string>());
+    
+    /**
+     * Find all the snarls in all the components with Cactus, and put them
+     * into a SnarlManager. Components are put into the SnarlManager in the
+     * order they were found, whatever order they finish in.
+     */
+    virtual SnarlManager find_snarls();
+    
+};
+
 /**
  * Snarls are defined at the Protobuf level, but here is how we define
  * chains as real objects.
@@ -234,17 +280,22 @@ public:
              bool use_internal_connectivity = false) : NetGraph(start, end, graph, use_internal_connectivity) {
             
         // All we need to do is index the children. They come mixed as real chains and unary snarls.
-            
-        for (auto& chain : child_chains_mixed) {
-            if (chain.size() == 1 && chain.front()->type() == UNARY) {
-                // This is a unary snarl wrapped in a chain
-                add_unary_child(chain.front());
-            } else {
-                // This is a real (but possibly trivial) chain
-                add_chain_child(chain);
-            }
-        }
-            
+        add_mixed_children(child_chains_mixed);
+    }
+    
+    /// Make a new NetGraph that uses internal connectivity for the given
+    /// snarl, taking the connectivity of each child chain or unary snarl from
+    /// the given summaries, keyed by the ID of the child's start node, instead
+    /// of working it out again. The summaries must outlive the NetGraph.
+    template<typename ChainContainer>
+    NetGraph(const Visit& start, const Visit& end,
+             const ChainContainer& child_chains_mixed,
+             const HandleGraph* graph,
+             const unordered_map<id_t, tuple<bool, bool, bool>>* child_connectivity) :
+        NetGraph(start, end, graph, true) {
+        
+        shared_connectivity = child_connectivity;
+        add_mixed_children(child_chains_mixed);
     }
         
     /// Make a net graph from the given chains and unary snarls (as pointers) in the given backing graph.
@@ -331,6 +382,10 @@ public:
     /// unary snarl in the orientation represented by this handle to a node
     /// representing a child chain or unary snarl.
     handle_t get_inward_backing_handle(const handle_t& child_handle) const;
+    
+    /// Work out whether a chain is left-left, right-right, and left-right
+    /// connected, from the connectivity of its snarls.
+    static tuple<bool, bool, bool> chain_connectivity(const Chain& chain);
         
 protected:
     
@@ -343,6 +398,23 @@ protected:
     /// Add a chain of one or more non-unary snarls to the index.
     void add_chain_child(const Chain& chain);
     
+    /// Add children that come mixed as real chains and unary snarls wrapped in chains.
+    template<typename ChainContainer>
+    void add_mixed_children(const ChainContainer& child_chains_mixed) {
+        for (auto& chain : child_chains_mixed) {
+            if (chain.size() == 1 && chain.front()->type() == UNARY) {
+                // This is a unary snarl wrapped in a chain
+                add_unary_child(chain.front());
+            } else {
+                // This is a real (but possibly trivial) chain
+                add_chain_child(chain);
+            }
+        }
+    }
+    
+    /// Get the connectivity of the child with the given start node ID.
+    const tuple<bool, bool, bool>& connectivity_of(id_t child_id) const;
+    
     // Save the backing graph
     const HandleGraph* graph;
         
@@ -372,9 +444,36 @@ protected:
     // Stores whether a chain or unary snarl, identified by the ID of its
     // start handle, is left-left, right-right, or left-right connected.
     unordered_map<id_t, tuple<bool, bool, bool>> connectivity;
+    
+    // Or, if set, the same information computed ahead of time by the
+    // SnarlManager, which we use instead of filling in connectivity.
+    const unordered_map<id_t, tuple<bool, bool, bool>>* shared_connectivity = nullptr;
         
 };
     
+/**
+ * A reusable buffer for the contents of a snarl in a HandleGraph. Filling it
+ * again keeps the memory it already has, so looking at the contents of many
+ * snarls in turn doesn't allocate for each one.
+ */
+struct SnarlContents {
+    /// The nodes, as locally forward handles
+    vector<handle_t> nodes;
+    /// The edges, in the graph's canonical form
+    vector<edge_t> edges;
+    
+    /// Empty the buffer, keeping its memory
+    void clear();
+    
+private:
+    friend class SnarlManager;
+    
+    // Scratch space for the traversal
+    unordered_set<id_t> seen_nodes;
+    unordered_set<edge_t> seen_edges;
+    vector<handle_t> stack;
+};
+    
 /**
  * A structure to keep track of the tree relationships between Snarls and perform utility algorithms
  * on them
@@ -471,6 +570,15 @@ public:
     /// allowed to be reallocated until the last child chain of a snarl is
     /// added.
     void add_chain(const Chain& new_chain, const Snarl* chain_parent);
+    
+    /// Summarize, for every snarl in parallel, how each of its child chains
+    /// and unary snarls connects its sides, so every net graph of the snarl
+    /// that uses internal connectivity can share the summary instead of
+    /// working it out again. Done automatically for snarls loaded from a
+    /// stream or iterator; call it after assembling a SnarlManager with
+    /// add_snarl() and add_chain(). Later changes to the tree drop the
+    /// summaries they affect.
+    void index_child_connectivity();
         
     /// Returns the Nodes and Edges contained in this Snarl but not in any child Snarls (always includes the
     /// Nodes that form the boundaries of child Snarls, optionally includes this Snarl's own boundary Nodes)
@@ -489,6 +597,36 @@ public:
     /// Look left from the given visit in the given graph and gets all the
     /// attached Visits to nodes or snarls.
     vector<Visit> visits_right(const Visit& visit, VG& graph, const Snarl* in_snarl) const;
+    
+    /// Fill the buffer with the nodes and edges contained in this Snarl but
+    /// not in any child Snarls, like the VG version, in any HandleGraph.
+    void shallow_contents(const Snarl* snarl, const HandleGraph& graph, bool include_boundary_nodes,
+                          SnarlContents& contents) const;
+    
+    /// Fill the buffer with the nodes and edges contained in this Snarl,
+    /// including those in child Snarls, like the VG version, in any
+    /// HandleGraph.
+    void deep_contents(const Snarl* snarl, const HandleGraph& graph, bool include_boundary_nodes,
+                       SnarlContents& contents) const;
+    
+    /// Look left from the given visit in any HandleGraph and get all the
+    /// attached Visits to nodes or snarls.
+    vector<Visit> visits_left(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const;
+    
+    /// Look right from the given visit in any HandleGraph and get all the
+    /// attached Visits to nodes or snarls.
+    vector<Visit> visits_right(const Visit& visit, const HandleGraph& graph, const Snarl* in_snarl) const;
+    
+    /// Lay out the node IDs of the deep contents of every snarl in a graph
+    /// that won't change, so each snarl's contents are one contiguous run
+    /// that deep_content_ids() can hand out without a traversal. Snarls added
+    /// afterwards aren't covered until this is called again.
+    void index_deep_contents(const HandleGraph& graph);
+    
+    /// Get the IDs of the nodes in the deep contents of a snarl, not
+    /// counting its own boundary nodes, from the layout made by
+    /// index_deep_contents(). Throws if the snarl isn't in the layout.
+    pair<vector<id_t>::const_iterator, vector<id_t>::const_iterator> deep_content_ids(const Snarl* snarl) const;
         
     /// Returns a map from all Snarl boundaries to the Snarl they point into. Note that this means that
     /// end boundaries will be reversed.
@@ -547,10 +685,30 @@ private:
         
     /// Map of node traversals to the snarls they point into
     unordered_map<pair<int64_t, bool>, const Snarl*> snarl_into;
+    
+    /// Map of snarls to the connectivity of their child chains and unary
+    /// snarls, by the ID of each child's start node
+    unordered_map<key_t, unordered_map<id_t, tuple<bool, bool, bool>>> child_connectivity;
+    
+    /// Node IDs of the deep contents of all the indexed snarls, with each
+    /// snarl's run holding its own nodes followed by the runs of its children
+    vector<id_t> deep_content_index;
+    /// Map of snarls to where their runs start and end in deep_content_index
+    unordered_map<key_t, pair<size_t, size_t>> deep_content_ranges;
         
     /// Converts Snarl to the form used as keys in internal data structures
     inline key_t key_form(const Snarl* snarl) const;
         
+    /// Get the Visits attached to the right side of a visit, given a function
+    /// to loop over the node sides the graph attaches to a node side
+    vector<Visit> visits_right(const Visit& visit, const Snarl* in_snarl,
+                               const function<void(const NodeSide&, const function<void(const NodeSide&)>&)>& for_each_attached) const;
+    
+    /// Fill the buffer with the contents of a snarl, skipping over child
+    /// snarls if deep is false
+    void fill_contents(const Snarl* snarl, const HandleGraph& graph, bool include_boundary_nodes,
+                       bool deep, SnarlContents& contents) const;
+        
     /// Builds tree indexes after Snarls have been added to the snarls vector
     void build_indexes();
         
@@ -1,8 +1,107 @@
 #include "srpe.hpp"
+#include "stream.hpp"
+#include <omp.h>
 
 using namespace std;
 namespace vg{
 
+    SVSignalCollector::SVSignalCollector() :
+        thread_signals(omp_get_max_threads()), thread_depths(omp_get_max_threads()) {
+    }
+
+    bool SVSignalCollector::is_discordant(const Alignment& first, const Alignment& second) const {
+        if (first.path().mapping_size() == 0 || second.path().mapping_size() == 0){
+            return false;
+        }
+        if (first.fragment_size() > 0 && abs(first.fragment(0).length()) > max_fragment_length){
+            return true;
+        }
+        // Properly paired reads point toward each other: --->  <---
+        return first.path().mapping(0).position().is_reverse() ==
+            second.path().mapping(0).position().is_reverse();
+    }
+
+    void SVSignalCollector::add_read(const Alignment& aln, bool discordant){
+        const Path& path = aln.path();
+        if (path.mapping_size() == 0){
+            return;
+        }
+        int thread_num = omp_get_thread_num();
+        unordered_map<int64_t, NodeSignals>& node_signals = thread_signals[thread_num];
+        thread_depths[thread_num].fill_depth(path);
+
+        int64_t last_node = 0;
+        for (int i = 0; i < path.mapping_size(); i++){
+            int64_t node_id = path.mapping(i).position().node_id();
+            if (node_id == last_node){
+                continue;
+            }
+            NodeSignals& here = node_signals[node_id];
+            here.reads += 1;
+            if (discordant){
+                here.discordant += 1;
+            }
+            last_node = node_id;
+        }
+
+        // Soft clips show up as insertions at the ends of the path
+        const Mapping& first_mapping = path.mapping(0);
+        const Mapping& last_mapping = path.mapping(path.mapping_size() - 1);
+        if (first_mapping.edit_size() > 0){
+            const Edit& left_edit = first_mapping.edit(0);
+            if ((int) (left_edit.to_length() - left_edit.from_length()) > soft_clip_limit){
+                node_signals[first_mapping.position().node_id()].split += 1;
+            }
+        }
+        if (last_mapping.edit_size() > 0){
+            const Edit& right_edit = last_mapping.edit(last_mapping.edit_size() - 1);
+            if ((int) (right_edit.to_length() - right_edit.from_length()) > soft_clip_limit){
+                node_signals[last_mapping.position().node_id()].split += 1;
+            }
+        }
+    }
+
+    void SVSignalCollector::add_read(const Alignment& aln){
+        add_read(aln, false);
+    }
+
+    void SVSignalCollector::add_pair(const Alignment& first, const Alignment& second){
+        bool discordant = is_discordant(first, second);
+        add_read(first, discordant);
+        add_read(second, discordant);
+    }
+
+    void SVSignalCollector::add_reads(istream& in, bool paired){
+        if (paired){
+            function<void(Alignment&, Alignment&)> lambda = [&](Alignment& first, Alignment& second){
+                add_pair(first, second);
+            };
+            stream::for_each_interleaved_pair_parallel(in, lambda);
+        }
+        else{
+            function<void(Alignment&)> lambda = [&](Alignment& aln){
+                add_read(aln);
+            };
+            stream::for_each_parallel(in, lambda);
+        }
+    }
+
+    void SVSignalCollector::finish(){
+        for (auto& node_signals : thread_signals){
+            for (auto& node : node_signals){
+                NodeSignals& total = signals[node.first];
+                total.reads += node.second.reads;
+                total.discordant += node.second.discordant;
+                total.split += node.second.split;
+            }
+            node_signals.clear();
+        }
+        for (auto& thread_depth : thread_depths){
+            depth.merge(thread_depth);
+            thread_depth.node_depths.clear();
+        }
+    }
+
     double SRPE::discordance_score(vector<Alignment> alns, VG* subgraph){
     // Sum up the mapping scores
     // subtract the soft clips
@@ -84,54 +84,112 @@ namespace vg{
           
 class DepthMap {
     /**
-    *  Map <node_id : offset : depth>
-    *  or
-    *  Map <SnarlTraversal : support count>
+    *  Map <node_id : offset : depth>, holding only the nodes that
+    *  reads actually cover, so memory grows with the covered part of
+    *  the graph rather than the whole graph.
     */
 public:
-  int8_t* depths;
-  uint64_t size;
-  map<int64_t, uint64_t> node_pos;
-  vg::VG* g_graph;
-  inline DepthMap(int64_t sz) { depths = new int8_t[sz]; };
+  unordered_map<int64_t, vector<uint32_t>> node_depths;
   inline DepthMap() {};
-  inline DepthMap(vg::VG* graph){
-    g_graph = graph;
-    int64_t tot_size = 0;
-    std::function<void(Node*)> count_size = [&](Node* n){
-        #pragma omp critical
-        {
-            node_pos[n->id()] = tot_size;
-            tot_size += n->sequence().length();
-        }
-    };
-    graph->for_each_node(count_size);
-    size = tot_size;
-    depths = new int8_t(size);
+  inline uint32_t get_depth(int64_t node_id, int64_t offset) const {
+    auto found = node_depths.find(node_id);
+    if (found == node_depths.end() || offset >= found->second.size()){
+        return 0;
+    }
+    return found->second[offset];
+  };
+  inline void set_depth(int64_t node_id, int64_t offset, uint32_t d) {
+    vector<uint32_t>& depths = node_depths[node_id];
+    if (offset >= depths.size()){
+        depths.resize(offset + 1, 0);
+    }
+    depths[offset] = d;
   };
-  inline int8_t get_depth(int64_t node_id, int64_t offset) { return depths[node_id + offset]; };
-  inline void set_depth(int64_t node_id, int64_t offset, int8_t d) { depths[node_id + offset] = d; };
   inline void increment_depth(int64_t node_id, int64_t offset) {
-    
-    depths[node_pos [node_id] + offset] += 1;
-};
+    vector<uint32_t>& depths = node_depths[node_id];
+    if (offset >= depths.size()){
+        depths.resize(offset + 1, 0);
+    }
+    depths[offset] += 1;
+  };
   inline void fill_depth(const vg::Path& p){
     for (int i = 0; i < p.mapping_size(); i++){
-        Mapping m = p.mapping(i);
-        Position p = m.position();
-        int64_t nodeid = p.node_id();
-        int offset = p.offset();
+        const Mapping& m = p.mapping(i);
+        int64_t nodeid = m.position().node_id();
+        int64_t offset = m.position().offset();
         for (int j = 0; j < m.edit_size(); j++){
-            Edit e = m.edit(j);
+            const Edit& e = m.edit(j);
             if (e.from_length() == e.to_length() && e.sequence().empty()){
                 for (int x = 0; x < e.from_length(); ++x){
                     increment_depth(nodeid, offset + x);
                 }
             }
+            offset += e.from_length();
         }
     }
   };
+  // Add in all the depths from another map
+  inline void merge(const DepthMap& other){
+    for (auto& node : other.node_depths){
+        vector<uint32_t>& depths = node_depths[node.first];
+        if (node.second.size() > depths.size()){
+            depths.resize(node.second.size(), 0);
+        }
+        for (size_t i = 0; i < node.second.size(); i++){
+            depths[i] += node.second[i];
+        }
+    }
+  };
+
+};
+
+/**
+ * The SV signals seen on one node: how many reads touch it, how many of
+ * those are in discordant pairs, and how many are soft-clipped there the
+ * way split reads are.
+ */
+struct NodeSignals {
+    uint32_t reads = 0;
+    uint32_t discordant = 0;
+    uint32_t split = 0;
+};
+
+/**
+ * Collects read depth, discordant pairs, and split reads together in one
+ * parallel pass over a GAM. Each thread fills its own sparse accumulators,
+ * which are merged when the pass is done.
+ */
+class SVSignalCollector {
+public:
+    // Set the thread count before making a collector; it keeps one set of
+    // accumulators per thread.
+    SVSignalCollector();
+
+    // Pairs whose fragment is longer than this are discordant
+    int64_t max_fragment_length = 10000;
+    // Reads soft-clipped by more than this many bases at an end count as split there
+    int soft_clip_limit = 20;
+
+    // Add the signals from a single read. Safe to call from several threads.
+    void add_read(const Alignment& aln);
+    // Add the signals from a read pair. Safe to call from several threads.
+    void add_pair(const Alignment& first, const Alignment& second);
+    // Add all the reads in a GAM, which holds interleaved pairs if paired is set
+    void add_reads(istream& in, bool paired);
+
+    // Merge the per-thread accumulators. Call once all reads are added.
+    void finish();
+
+    // The merged signals, after finish()
+    unordered_map<int64_t, NodeSignals> signals;
+    DepthMap depth;
+
+private:
+    void add_read(const Alignment& aln, bool discordant);
+    bool is_discordant(const Alignment& first, const Alignment& second) const;
 
+    vector<unordered_map<int64_t, NodeSignals>> thread_signals;
+    vector<DepthMap> thread_depths;
 };
 
     class SRPE{
@@ -0,0 +1,140 @@
+#include "stage_profiler.hpp"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vg {
+
+using namespace std;
+
+static const size_t NUM_STAGES = (size_t) MappingStage::NumStages;
+
+/// One thread's counters. Only the owning thread writes to them, so the
+/// atomics are just there to make reading them from another thread defined.
+struct ThreadStageCounters {
+    atomic<uint64_t> calls[NUM_STAGES];
+    atomic<uint64_t> nanoseconds[NUM_STAGES];
+    atomic<uint64_t> items[NUM_STAGES];
+    // keep other threads' counters off of our cache lines
+    char padding[64];
+
+    ThreadStageCounters() {
+        for (size_t i = 0; i < NUM_STAGES; i++) {
+            calls[i].store(0, memory_order_relaxed);
+            nanoseconds[i].store(0, memory_order_relaxed);
+            items[i].store(0, memory_order_relaxed);
+        }
+    }
+};
+
+/// Every thread's counters, kept after the threads exit so they can be totaled
+static mutex registry_mutex;
+static vector<unique_ptr<ThreadStageCounters>> registry;
+
+/// Get the calling thread's counters, making them on the first call
+static ThreadStageCounters& local_counters() {
+    static thread_local ThreadStageCounters* counters = nullptr;
+    if (counters == nullptr) {
+        lock_guard<mutex> lock(registry_mutex);
+        registry.emplace_back(new ThreadStageCounters());
+        counters = registry.back().get();
+    }
+    return *counters;
+}
+
+/// Add to a counter that only this thread writes to, without a locked instruction
+static inline void bump(atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+atomic<bool> StageProfiler::enabled(false);
+
+void StageProfiler::set_enabled(bool enable) {
+    enabled.store(enable);
+}
+
+void StageProfiler::record(MappingStage stage, uint64_t nanoseconds, uint64_t items) {
+    ThreadStageCounters& counters = local_counters();
+    size_t i = (size_t) stage;
+    bump(counters.calls[i], 1);
+    bump(counters.nanoseconds[i], nanoseconds);
+    bump(counters.items[i], items);
+}
+
+StageProfiler::StageTotals StageProfiler::totals(MappingStage stage) {
+    size_t i = (size_t) stage;
+    StageTotals stage_totals;
+    lock_guard<mutex> lock(registry_mutex);
+    for (auto& counters : registry) {
+        stage_totals.calls += counters->calls[i].load(memory_order_relaxed);
+        stage_totals.nanoseconds += counters->nanoseconds[i].load(memory_order_relaxed);
+        stage_totals.items += counters->items[i].load(memory_order_relaxed);
+    }
+    return stage_totals;
+}
+
+const char* StageProfiler::stage_name(MappingStage stage) {
+    switch (stage) {
+    case MappingStage::MEMs:
+        return "mems";
+    case MappingStage::Reseeding:
+        return "reseeding";
+    case MappingStage::Clustering:
+        return "clustering";
+    case MappingStage::SubgraphExtraction:
+        return "subgraph_extraction";
+    case MappingStage::ClusterAlignment:
+        return "cluster_alignment";
+    case MappingStage::ClusterPairing:
+        return "cluster_pairing";
+    case MappingStage::PairRescue:
+        return "pair_rescue";
+    case MappingStage::MappingQuality:
+        return "mapping_quality";
+    case MappingStage::Surjection:
+        return "surjection";
+    case MappingStage::RescueWindow:
+        return "rescue_window";
+    case MappingStage::RescueSeedFilter:
+        return "rescue_seed_filter";
+    case MappingStage::GCSAQueryCache:
+        return "gcsa_query_cache";
+    case MappingStage::DuplicateReadCache:
+        return "duplicate_read_cache";
+    default:
+        return "unknown";
+    }
+}
+
+void StageProfiler::write_json(ostream& out) {
+    size_t num_threads;
+    {
+        lock_guard<mutex> lock(registry_mutex);
+        num_threads = registry.size();
+    }
+
+    out << "{\"threads\": " << num_threads << ", \"stages\": {";
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+        MappingStage stage = (MappingStage) i;
+        StageTotals stage_totals = totals(stage);
+        out << (i ? ", " : "") << "\"" << stage_name(stage) << "\": {"
+            << "\"calls\": " << stage_totals.calls << ", "
+            << "\"seconds\": " << stage_totals.nanoseconds / 1e9 << ", "
+            << "\"items\": " << stage_totals.items << "}";
+    }
+    out << "}}" << endl;
+}
+
+void StageProfiler::clear() {
+    lock_guard<mutex> lock(registry_mutex);
+    for (auto& counters : registry) {
+        for (size_t i = 0; i < NUM_STAGES; i++) {
+            counters->calls[i].store(0, memory_order_relaxed);
+            counters->nanoseconds[i].store(0, memory_order_relaxed);
+            counters->items[i].store(0, memory_order_relaxed);
+        }
+    }
+}
+
+}
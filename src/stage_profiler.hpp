@@ -0,0 +1,150 @@
+#ifndef VG_STAGE_PROFILER_HPP_INCLUDED
+#define VG_STAGE_PROFILER_HPP_INCLUDED
+
+/**
+ * \file stage_profiler.hpp
+ * Contains cheap per-thread timers and counters for the stages of read
+ * mapping, so that a production run can report where its time went.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+namespace vg {
+
+using namespace std;
+
+/// The stages of read mapping that the profiler keeps track of
+enum class MappingStage : size_t {
+    /// Finding MEMs with the GCSA2 index, including reseeding
+    MEMs = 0,
+    /// Finding sub-MEMs inside long MEMs (also counted in MEMs)
+    Reseeding,
+    /// Chaining or clustering MEMs into candidate alignments
+    Clustering,
+    /// Extracting subgraphs around clusters
+    SubgraphExtraction,
+    /// Aligning a read to the graph around one cluster
+    ClusterAlignment,
+    /// Pairing up the clusters of two mates (items are pairs skipped for being over budget)
+    ClusterPairing,
+    /// Looking for a mate near its partner
+    PairRescue,
+    /// Computing mapping qualities
+    MappingQuality,
+    /// Projecting an alignment onto a path
+    Surjection,
+    /// Getting the graph to rescue a mate in (items are windows reused from the cache)
+    RescueWindow,
+    /// Checking the mate for seeds in the rescue window (items are rescues skipped for having none)
+    RescueSeedFilter,
+    /// Hits in the cache of GCSA2 queries shared by the MEM search and reseeding (items are hits)
+    GCSAQueryCache,
+    /// Looking up a read in the cache of results for duplicate reads (items are hits)
+    DuplicateReadCache,
+    /// The number of stages (not a stage)
+    NumStages
+};
+
+/**
+ * Global switch and aggregation for the mapping stage timers. Each thread
+ * accumulates into its own counters, which nobody else writes to, so timing
+ * a stage costs two clock reads and no synchronization. When profiling is
+ * not enabled, timing a stage costs a single check of a flag.
+ */
+class StageProfiler {
+public:
+
+    /// Totals for one stage
+    struct StageTotals {
+        /// How many times the stage ran
+        uint64_t calls = 0;
+        /// How long it ran for, summed over threads
+        uint64_t nanoseconds = 0;
+        /// How many things it produced or processed (MEMs, clusters, alignments, ...)
+        uint64_t items = 0;
+    };
+
+    /// Start or stop recording
+    static void set_enabled(bool enabled);
+
+    /// Are we recording?
+    static inline bool is_enabled();
+
+    /// Add a run of a stage to the calling thread's counters
+    static void record(MappingStage stage, uint64_t nanoseconds, uint64_t items);
+
+    /// Get the totals for a stage across all threads. Should be called when
+    /// no other thread is recording.
+    static StageTotals totals(MappingStage stage);
+
+    /// Get the name of a stage, as used in the JSON output
+    static const char* stage_name(MappingStage stage);
+
+    /// Write the totals for every stage and the number of threads that
+    /// recorded anything as a JSON object.
+    static void write_json(ostream& out);
+
+    /// Forget everything that has been recorded
+    static void clear();
+
+private:
+    static atomic<bool> enabled;
+};
+
+/**
+ * Times a stage from its construction to its destruction (or to when it is
+ * stopped) and adds the time to the StageProfiler, if it is enabled.
+ */
+class StageTimer {
+public:
+    inline StageTimer(MappingStage stage);
+    inline ~StageTimer();
+
+    StageTimer(const StageTimer& other) = delete;
+    StageTimer& operator=(const StageTimer& other) = delete;
+
+    /// Also count some items for the stage
+    inline void add_items(uint64_t count);
+
+    /// End the stage now instead of at destruction
+    inline void stop();
+
+private:
+    MappingStage stage;
+    bool running;
+    uint64_t items = 0;
+    chrono::steady_clock::time_point start;
+};
+
+inline bool StageProfiler::is_enabled() {
+    return enabled.load(memory_order_relaxed);
+}
+
+inline StageTimer::StageTimer(MappingStage stage) : stage(stage), running(StageProfiler::is_enabled()) {
+    if (running) {
+        start = chrono::steady_clock::now();
+    }
+}
+
+inline StageTimer::~StageTimer() {
+    stop();
+}
+
+inline void StageTimer::stop() {
+    if (running) {
+        auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+        StageProfiler::record(stage, elapsed.count(), items);
+        running = false;
+    }
+}
+
+inline void StageTimer::add_items(uint64_t count) {
+    items += count;
+}
+
+}
+
+#endif
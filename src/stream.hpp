@@ -1,8 +1,10 @@
 #ifndef VG_STREAM_HPP_INCLUDED
 #define VG_STREAM_HPP_INCLUDED
 
-// de/serialization of protobuf objects from/to a length-prefixed, gzipped binary stream
+// de/serialization of protobuf objects from/to a length-prefixed, compressed binary stream
 // from http://www.mail-archive.com/protobuf@googlegroups.com/msg03417.html
+// The compression codec is chosen with stream::set_output_codec() and detected on read;
+// see stream_codec.hpp.
 
 #include <cassert>
 #include <iostream>
@@ -11,11 +13,16 @@
 #include <functional>
 #include <vector>
 #include <list>
+#include <string>
+#include <cstring>
+#include <algorithm>
 #include "google/protobuf/stubs/common.h"
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/io/gzip_stream.h"
 #include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "stream_codec.hpp"
 
 namespace stream {
 
@@ -39,8 +46,8 @@ bool write(std::ostream& out, uint64_t element_count, uint64_t chunk_elements,
     size_t serialized = 0;
     
     ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    CodecOutputStream codec_out(&raw_out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&codec_out);
 
     auto handle = [](bool ok) {
         if (!ok) throw std::runtime_error("stream::write: I/O error writing protobuf");
@@ -106,8 +113,8 @@ bool write(std::ostream& out, uint64_t count, const std::function<T(uint64_t)>&
 
     // Make all our streams on the stack, in case of error.
     ::google::protobuf::io::OstreamOutputStream raw_out(&out);
-    ::google::protobuf::io::GzipOutputStream gzip_out(&raw_out);
-    ::google::protobuf::io::CodedOutputStream coded_out(&gzip_out);
+    CodecOutputStream codec_out(&raw_out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&codec_out);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -150,6 +157,291 @@ bool write_buffered(std::ostream& out, std::vector<T>& buffer, uint64_t buffer_l
     return wrote;
 }
 
+/// Stands in for a protobuf message while holding only its serialized bytes.
+/// It can be read with the for_each functions and written with write() or an
+/// AsyncEmitter, so messages can be passed through without being parsed and
+/// reserialized.
+struct SerializedMessage {
+    std::string bytes;
+    
+    bool ParseFromString(const std::string& data) {
+        bytes = data;
+        return true;
+    }
+    
+    bool SerializeToString(std::string* output) const {
+        *output = bytes;
+        return true;
+    }
+};
+
+/// Parse a message out of the given bytes, which may be left empty.
+template <typename T>
+inline bool parse_from(T& message, std::string& bytes) {
+    return message.ParseFromString(bytes);
+}
+
+/// Give a SerializedMessage the given bytes without copying them.
+inline bool parse_from(SerializedMessage& message, std::string& bytes) {
+    message.bytes.swap(bytes);
+    return true;
+}
+
+/**
+ * A read-only view of the top-level fields of one serialized protobuf
+ * message, for readers that only need a few of them. Making the view finds
+ * where each field is in one scan over the tags; sub-messages are only
+ * scanned when they are viewed themselves, and nothing is copied. The view
+ * points into the bytes it was made from, which must outlive it.
+ */
+class FieldView {
+public:
+    /// Make an empty view, with no fields
+    FieldView() = default;
+    
+    /// View the message serialized in the given bytes. Throws
+    /// std::runtime_error if they aren't a well-formed message.
+    FieldView(const char* data, size_t size);
+    
+    /// View the message serialized in the given string.
+    explicit FieldView(const std::string& bytes) : FieldView(bytes.data(), bytes.size()) {}
+    
+    /// Return true if the message has the given field.
+    bool has(int field) const;
+    
+    /// Get a varint (integer, bool, or enum) field, or the given default if
+    /// it is missing. Cast the result to the field's type. Zigzag-encoded
+    /// sint fields are not decoded.
+    uint64_t get_varint(int field, uint64_t missing = 0) const;
+    
+    /// Get a double field, or the given default if it is missing.
+    double get_double(int field, double missing = 0.0) const;
+    
+    /// Get a string or bytes field, or the empty string if it is missing.
+    std::string get_string(int field) const;
+    
+    /// View the sub-message in the given field, or the first one if the field
+    /// is repeated. Returns an empty view if it is missing.
+    FieldView get_message(int field) const;
+    
+    /// Call the given function on a view of each sub-message in the given
+    /// repeated field, in order.
+    void for_each_message(int field, const std::function<void(const FieldView&)>& lambda) const;
+    
+    /// Parse only the given fields into the given message, leaving the
+    /// others unset. Returns false if they can't be parsed.
+    template <typename T>
+    bool project(const std::vector<int>& field_numbers, T& message) const;
+    
+private:
+    
+    struct Field {
+        int number;
+        int wire_type;
+        /// The whole field, tag and all
+        const char* start;
+        size_t size;
+        /// The value of a varint or fixed-width field
+        uint64_t value;
+        /// The payload of a length-delimited field
+        const char* payload;
+        size_t payload_size;
+    };
+    
+    /// Get the last occurrence of the given field, or null
+    const Field* find_last(int field) const;
+    
+    std::vector<Field> fields;
+};
+
+inline FieldView::FieldView(const char* data, size_t size) {
+    using ::google::protobuf::internal::WireFormatLite;
+    
+    ::google::protobuf::io::CodedInputStream coded_in((const ::google::protobuf::uint8*) data, size);
+    while (true) {
+        size_t start = coded_in.CurrentPosition();
+        uint32_t tag = coded_in.ReadTag();
+        if (tag == 0) {
+            if (start != size) {
+                // a 0 tag is only allowed as the end of the message
+                throw std::runtime_error("[stream::FieldView] invalid or corrupt protobuf message");
+            }
+            break;
+        }
+        
+        Field field{WireFormatLite::GetTagFieldNumber(tag), WireFormatLite::GetTagWireType(tag),
+                    data + start, 0, 0, nullptr, 0};
+        bool ok;
+        switch (field.wire_type) {
+        case WireFormatLite::WIRETYPE_VARINT:
+            ok = coded_in.ReadVarint64((::google::protobuf::uint64*) &field.value);
+            break;
+        case WireFormatLite::WIRETYPE_FIXED64:
+            ok = coded_in.ReadLittleEndian64((::google::protobuf::uint64*) &field.value);
+            break;
+        case WireFormatLite::WIRETYPE_FIXED32:
+            {
+                uint32_t value = 0;
+                ok = coded_in.ReadLittleEndian32((::google::protobuf::uint32*) &value);
+                field.value = value;
+            }
+            break;
+        case WireFormatLite::WIRETYPE_LENGTH_DELIMITED:
+            {
+                uint32_t length = 0;
+                ok = coded_in.ReadVarint32((::google::protobuf::uint32*) &length);
+                field.payload = data + coded_in.CurrentPosition();
+                field.payload_size = length;
+                ok = ok && coded_in.Skip(length);
+            }
+            break;
+        default:
+            // groups
+            ok = WireFormatLite::SkipField(&coded_in, tag);
+            break;
+        }
+        if (!ok) {
+            throw std::runtime_error("[stream::FieldView] invalid or corrupt protobuf message");
+        }
+        field.size = coded_in.CurrentPosition() - start;
+        fields.push_back(field);
+    }
+}
+
+inline const FieldView::Field* FieldView::find_last(int field) const {
+    for (auto it = fields.rbegin(); it != fields.rend(); ++it) {
+        if (it->number == field) {
+            return &*it;
+        }
+    }
+    return nullptr;
+}
+
+inline bool FieldView::has(int field) const {
+    return find_last(field) != nullptr;
+}
+
+inline uint64_t FieldView::get_varint(int field, uint64_t missing) const {
+    const Field* found = find_last(field);
+    return found ? found->value : missing;
+}
+
+inline double FieldView::get_double(int field, double missing) const {
+    const Field* found = find_last(field);
+    if (!found) {
+        return missing;
+    }
+    double value;
+    memcpy(&value, &found->value, sizeof(value));
+    return value;
+}
+
+inline std::string FieldView::get_string(int field) const {
+    const Field* found = find_last(field);
+    return found ? std::string(found->payload, found->payload_size) : std::string();
+}
+
+inline FieldView FieldView::get_message(int field) const {
+    for (auto& found : fields) {
+        if (found.number == field) {
+            return FieldView(found.payload, found.payload_size);
+        }
+    }
+    return FieldView();
+}
+
+inline void FieldView::for_each_message(int field, const std::function<void(const FieldView&)>& lambda) const {
+    for (auto& found : fields) {
+        if (found.number == field) {
+            lambda(FieldView(found.payload, found.payload_size));
+        }
+    }
+}
+
+template <typename T>
+bool FieldView::project(const std::vector<int>& field_numbers, T& message) const {
+    // Copy the wanted fields, tags and all, into a smaller message to parse
+    std::string wanted;
+    for (auto& field : fields) {
+        if (std::find(field_numbers.begin(), field_numbers.end(), field.number) != field_numbers.end()) {
+            wanted.append(field.start, field.size);
+        }
+    }
+    return message.ParseFromString(wanted);
+}
+
+/// Write already-serialized messages as one chunk, without parsing them.
+/// Returns false if not all messages were written.
+inline bool write_serialized(std::ostream& out, uint64_t count,
+                             const std::function<const std::string&(uint64_t)>& lambda) {
+
+    ::google::protobuf::io::OstreamOutputStream raw_out(&out);
+    CodecOutputStream codec_out(&raw_out);
+    ::google::protobuf::io::CodedOutputStream coded_out(&codec_out);
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("stream::write_serialized: I/O error writing protobuf");
+        }
+    };
+
+    if (count > 0) {
+        coded_out.WriteVarint64(count);
+        handle(!coded_out.HadError());
+    }
+
+    uint64_t written = 0;
+    for (uint64_t n = 0; n < count; ++n, ++written) {
+        const std::string& s = lambda(n);
+        if (s.size() > MAX_PROTOBUF_SIZE) {
+            throw std::runtime_error("stream::write_serialized: message too large error writing protobuf");
+        }
+        coded_out.WriteVarint32(s.size());
+        handle(!coded_out.HadError());
+        coded_out.WriteRaw(s.data(), s.size());
+        handle(!coded_out.HadError());
+    }
+
+    return !count || written == count;
+}
+
+/// Call the callback on the serialized bytes of each message in the stream,
+/// without parsing them. The callback may move the bytes out of the string.
+inline void for_each_serialized(std::istream& in, const std::function<void(std::string&)>& lambda) {
+
+    ::google::protobuf::io::IstreamInputStream raw_in(&in);
+    CodecInputStream codec_in(&raw_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&codec_in);
+
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_serialized] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+
+    uint64_t count;
+    while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t msgSize = 0;
+            // Reset the bytes-ever-read counter, as in for_each
+            coded_in.~CodedInputStream();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&codec_in);
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+
+            handle(coded_in.ReadVarint32(&msgSize));
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_serialized] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+            if (msgSize) {
+                std::string s;
+                handle(coded_in.ReadString(&s, msgSize));
+                lambda(s);
+            }
+        }
+    }
+}
+
 // deserialize the input stream into the objects
 // skips over groups of objects with count 0
 // takes a callback function to be called on the objects, and another to be called per object group.
@@ -160,8 +452,8 @@ void for_each(std::istream& in,
               const std::function<void(uint64_t)>& handle_count) {
 
     ::google::protobuf::io::IstreamInputStream raw_in(&in);
-    ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-    ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+    CodecInputStream codec_in(&raw_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&codec_in);
 
     auto handle = [](bool ok) {
         if (!ok) {
@@ -183,7 +475,7 @@ void for_each(std::istream& in,
             // bytes-ever-read counter, because it thinks it's reading a single
             // message.
             coded_in.~CodedInputStream();
-            new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&codec_in);
             // Alot space for size, and for reading next chunk's length
             coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
             
@@ -198,7 +490,7 @@ void for_each(std::istream& in,
             if (msgSize) {
                 handle(coded_in.ReadString(&s, msgSize));
                 T object;
-                handle(object.ParseFromString(s));
+                handle(parse_from(object, s));
                 lambda(object);
             }
         }
@@ -216,6 +508,112 @@ void for_each(std::istream& in,
 
 // Parallelized versions of for_each
 
+/// Decode one whole block of a blocked stream (see stream_codec.hpp) and call
+/// the callback on each object in it, in order.
+template <typename T>
+void for_each_in_block(const std::string& block, const std::function<void(T&)>& lambda) {
+    
+    auto handle = [](bool ok) {
+        if (!ok) {
+            throw std::runtime_error("[stream::for_each_in_block] obsolete, invalid, or corrupt protobuf input");
+        }
+    };
+    
+    ::google::protobuf::io::ArrayInputStream raw_in(block.data(), block.size());
+    CodecInputStream codec_in(&raw_in);
+    ::google::protobuf::io::CodedInputStream coded_in(&codec_in);
+    
+    uint64_t count;
+    while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+        std::string s;
+        for (uint64_t i = 0; i < count; ++i) {
+            uint32_t msgSize = 0;
+            // Reset the bytes-ever-read counter, as in for_each
+            coded_in.~CodedInputStream();
+            new (&coded_in) ::google::protobuf::io::CodedInputStream(&codec_in);
+            coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+            
+            handle(coded_in.ReadVarint32(&msgSize));
+            if (msgSize > MAX_PROTOBUF_SIZE) {
+                throw std::runtime_error("[stream::for_each_in_block] protobuf message of " +
+                    std::to_string(msgSize) + " bytes is too long");
+            }
+            if (msgSize) {
+                handle(coded_in.ReadString(&s, msgSize));
+                T object;
+                handle(parse_from(object, s));
+                lambda(object);
+            }
+        }
+    }
+}
+
+/// Parallel iteration over a blocked stream, where whole compressed blocks
+/// are handed to worker tasks that inflate and parse them, so the reading
+/// thread only has to copy bytes. Pairs for lambda2 are formed within each
+/// block, and an odd object at the end of a block goes to lambda1, so writers
+/// of interleaved pairs must keep mates in the same block (which
+/// write_buffered() does, as long as pairs are buffered together). Must be
+/// called from inside an omp single region.
+template <typename T>
+void for_each_block_parallel(::google::protobuf::io::ZeroCopyInputStream& raw_in,
+                             const std::function<void(T&,T&)>& lambda2,
+                             const std::function<void(T&)>& lambda1,
+                             const std::function<void(uint64_t)>& handle_count,
+                             const std::function<bool(void)>& single_threaded_until_true,
+                             uint64_t max_blocks_outstanding) {
+    
+    uint64_t blocks_outstanding = 0;
+    
+    // Run the callbacks on all the objects in a block, in pairs where possible
+    auto process_block = [&](const std::string& block) {
+        std::vector<T> objects;
+        std::function<void(T&)> collect = [&](T& object) {
+            objects.emplace_back(std::move(object));
+        };
+        for_each_in_block<T>(block, collect);
+        handle_count(objects.size());
+        size_t i = 0;
+        for (; i + 1 < objects.size(); i += 2) {
+            lambda2(objects[i], objects[i + 1]);
+        }
+        if (i < objects.size()) {
+            lambda1(objects[i]);
+        }
+    };
+    
+    std::string* block = new std::string();
+    while (read_block(&raw_in, *block)) {
+        uint64_t b;
+        #pragma omp atomic capture
+        b = ++blocks_outstanding;
+        while (b >= max_blocks_outstanding) {
+            usleep(1000);
+            #pragma omp atomic read
+            b = blocks_outstanding;
+        }
+        
+        if (single_threaded_until_true()) {
+#pragma omp task default(none) firstprivate(block) shared(blocks_outstanding, process_block)
+            {
+                process_block(*block);
+                delete block;
+#pragma omp atomic update
+                blocks_outstanding--;
+            }
+        } else {
+            process_block(*block);
+            delete block;
+#pragma omp atomic update
+            blocks_outstanding--;
+        }
+        block = new std::string();
+    }
+    delete block;
+    
+    #pragma omp taskwait
+}
+
 // First, an internal implementation underlying several variants below.
 // lambda2 is invoked on interleaved pairs of elements from the stream. The
 // elements of each pair are in order, but the overall order in which lambda2
@@ -246,111 +644,119 @@ void for_each_parallel_impl(std::istream& in,
         };
 
         ::google::protobuf::io::IstreamInputStream raw_in(&in);
-        ::google::protobuf::io::GzipInputStream gzip_in(&raw_in);
-        ::google::protobuf::io::CodedInputStream coded_in(&gzip_in);
+        
+        if (is_blocked_stream(&raw_in)) {
+            // The stream is made of independently compressed blocks, so we
+            // can hand whole blocks to the workers to inflate.
+            for_each_block_parallel(raw_in, lambda2, lambda1, handle_count,
+                                    single_threaded_until_true, max_batches_outstanding);
+        } else {
+            CodecInputStream codec_in(&raw_in);
+            ::google::protobuf::io::CodedInputStream coded_in(&codec_in);
 
-        std::vector<std::string> *batch = nullptr;
+            std::vector<std::string> *batch = nullptr;
         
-        // process chunks prefixed by message count
-        uint64_t count;
-        while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
-            handle_count(count);
-            for (uint64_t i = 0; i < count; ++i) {
-                if (!batch) {
-                     batch = new std::vector<std::string>();
-                     batch->reserve(batch_size);
-                }
+            // process chunks prefixed by message count
+            uint64_t count;
+            while (coded_in.ReadVarint64((::google::protobuf::uint64*) &count)) {
+                handle_count(count);
+                for (uint64_t i = 0; i < count; ++i) {
+                    if (!batch) {
+                         batch = new std::vector<std::string>();
+                         batch->reserve(batch_size);
+                    }
                 
-                // Reconstruct the CodedInputStream in place to reset its maximum-
-                // bytes-ever-read counter, because it thinks it's reading a single
-                // message.
-                coded_in.~CodedInputStream();
-                new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
-                // Alot space for size, and for reading next chunk's length
-                coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
+                    // Reconstruct the CodedInputStream in place to reset its maximum-
+                    // bytes-ever-read counter, because it thinks it's reading a single
+                    // message.
+                    coded_in.~CodedInputStream();
+                    new (&coded_in) ::google::protobuf::io::CodedInputStream(&codec_in);
+                    // Alot space for size, and for reading next chunk's length
+                    coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
                 
-                uint32_t msgSize = 0;
-                // the messages are prefixed by their size
-                handle(coded_in.ReadVarint32(&msgSize));
+                    uint32_t msgSize = 0;
+                    // the messages are prefixed by their size
+                    handle(coded_in.ReadVarint32(&msgSize));
                 
-                if (msgSize > MAX_PROTOBUF_SIZE) {
-                    throw std::runtime_error("[stream::for_each] protobuf message of " +
-                        std::to_string(msgSize) + " bytes is too long");
-                }
+                    if (msgSize > MAX_PROTOBUF_SIZE) {
+                        throw std::runtime_error("[stream::for_each] protobuf message of " +
+                            std::to_string(msgSize) + " bytes is too long");
+                    }
                 
-                if (msgSize) {
-                    // pick off the message (serialized protobuf object)
-                    std::string s;
-                    handle(coded_in.ReadString(&s, msgSize));
-                    batch->push_back(std::move(s));
-                }
-
-                if (batch->size() == batch_size) {
-                    // time to enqueue this batch for processing. first, block if
-                    // we've hit max_batches_outstanding.
-                    uint64_t b;
-                    #pragma omp atomic capture
-                    b = ++batches_outstanding;
-                    while (b >= max_batches_outstanding) {
-                        usleep(1000);
-                        #pragma omp atomic read
-                        b = batches_outstanding;
+                    if (msgSize) {
+                        // pick off the message (serialized protobuf object)
+                        std::string s;
+                        handle(coded_in.ReadString(&s, msgSize));
+                        batch->push_back(std::move(s));
                     }
-                    if (single_threaded_until_true()) {
-                        // spawn a task in another thread to process this batch
-#pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda2, handle, single_threaded_until_true)
-                        {
+
+                    if (batch->size() == batch_size) {
+                        // time to enqueue this batch for processing. first, block if
+                        // we've hit max_batches_outstanding.
+                        uint64_t b;
+                        #pragma omp atomic capture
+                        b = ++batches_outstanding;
+                        while (b >= max_batches_outstanding) {
+                            usleep(1000);
+                            #pragma omp atomic read
+                            b = batches_outstanding;
+                        }
+                        if (single_threaded_until_true()) {
+                            // spawn a task in another thread to process this batch
+    #pragma omp task default(none) firstprivate(batch) shared(batches_outstanding, lambda2, handle, single_threaded_until_true)
+                            {
+                                {
+                                    T obj1, obj2;
+                                    for (int i = 0; i<batch_size; i+=2) {
+                                        // parse protobuf objects and invoke lambda on the pair
+                                        handle(parse_from(obj1, batch->at(i)));
+                                        handle(parse_from(obj2, batch->at(i+1)));
+                                        lambda2(obj1,obj2);
+                                    }
+                                } // scope obj1 & obj2
+                                delete batch;
+    #pragma omp atomic update
+                                batches_outstanding--;
+                            }
+                        }
+                        else {
+                            // process this batch in the current thread
                             {
                                 T obj1, obj2;
                                 for (int i = 0; i<batch_size; i+=2) {
                                     // parse protobuf objects and invoke lambda on the pair
-                                    handle(obj1.ParseFromString(batch->at(i)));
-                                    handle(obj2.ParseFromString(batch->at(i+1)));
+                                    handle(parse_from(obj1, batch->at(i)));
+                                    handle(parse_from(obj2, batch->at(i+1)));
                                     lambda2(obj1,obj2);
                                 }
                             } // scope obj1 & obj2
                             delete batch;
-#pragma omp atomic update
                             batches_outstanding--;
                         }
-                    }
-                    else {
-                        // process this batch in the current thread
-                        {
-                            T obj1, obj2;
-                            for (int i = 0; i<batch_size; i+=2) {
-                                // parse protobuf objects and invoke lambda on the pair
-                                handle(obj1.ParseFromString(batch->at(i)));
-                                handle(obj2.ParseFromString(batch->at(i+1)));
-                                lambda2(obj1,obj2);
-                            }
-                        } // scope obj1 & obj2
-                        delete batch;
-                        batches_outstanding--;
-                    }
 
-                    batch = nullptr;
+                        batch = nullptr;
+                    }
                 }
             }
-        }
 
-        #pragma omp taskwait
-        // process final batch
-        if (batch) {
-            {
-                T obj1, obj2;
-                int i = 0;
-                for (; i < batch->size()-1; i+=2) {
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    handle(obj2.ParseFromString(batch->at(i+1)));
-                    lambda2(obj1, obj2);
-                }
-                if (i == batch->size()-1) { // odd last object
-                    handle(obj1.ParseFromString(batch->at(i)));
-                    lambda1(obj1);
-                }
-            } // scope obj1 & obj2
-            delete batch;
+            #pragma omp taskwait
+            // process final batch
+            if (batch) {
+                {
+                    T obj1, obj2;
+                    int i = 0;
+                    for (; i < batch->size()-1; i+=2) {
+                        handle(parse_from(obj1, batch->at(i)));
+                        handle(parse_from(obj2, batch->at(i+1)));
+                        lambda2(obj1, obj2);
+                    }
+                    if (i == batch->size()-1) { // odd last object
+                        handle(parse_from(obj1, batch->at(i)));
+                        lambda1(obj1);
+                    }
+                } // scope obj1 & obj2
+                delete batch;
+            }
         }
     }
 }
@@ -408,8 +814,8 @@ public:
         chunk_count(0),
         chunk_idx(0),
         raw_in(&in),
-        gzip_in(&raw_in),
-        coded_in(&gzip_in)
+        codec_in(&raw_in),
+        coded_in(&codec_in)
     {
         get_next();
     }
@@ -422,7 +828,7 @@ public:
 //        chunk_count = other.chunk_count;
 //        chunk_idx = other.chunk_idx;
 //        raw_in = other.raw_in;
-//        gzip_in = other.gzip_in;
+//        codec_in = other.codec_in;
 //        coded_in = other.coded_in;
 //    }
 
@@ -449,7 +855,7 @@ public:
         // bytes-ever-read counter, because it thinks it's reading a single
         // message.
         coded_in.~CodedInputStream();
-        new (&coded_in) ::google::protobuf::io::CodedInputStream(&gzip_in);
+        new (&coded_in) ::google::protobuf::io::CodedInputStream(&codec_in);
         // Alot space for size, and for reading next chunk's length
         coded_in.SetTotalBytesLimit(MAX_PROTOBUF_SIZE * 2, MAX_PROTOBUF_SIZE * 2);
         
@@ -495,7 +901,7 @@ private:
     uint64_t chunk_idx;
     
     ::google::protobuf::io::IstreamInputStream raw_in;
-    ::google::protobuf::io::GzipInputStream gzip_in;
+    CodecInputStream codec_in;
     ::google::protobuf::io::CodedInputStream coded_in;
     
     void handle(bool ok) {
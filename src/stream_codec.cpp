@@ -0,0 +1,498 @@
+#include "stream_codec.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <zstd.h>
+
+namespace stream {
+
+using namespace std;
+
+/// Magic number marking an uncompressed stream
+static const char UNCOMPRESSED_MAGIC[4] = {'V', 'G', 'U', 'C'};
+/// Magic number at the start of each zstd frame
+static const unsigned char ZSTD_MAGIC[4] = {0x28, 0xb5, 0x2f, 0xfd};
+/// Magic number at the start of each block
+static const char BLOCK_MAGIC[4] = {'V', 'G', 'B', 'K'};
+/// Size of a block header: magic and 8-byte length
+static const size_t BLOCK_HEADER_SIZE = sizeof(BLOCK_MAGIC) + 8;
+
+/// How big a block do we buffer before encoding it?
+static const size_t CODEC_BLOCK_SIZE = 1 << 16;
+/// What zstd compression level do we use?
+static const int ZSTD_LEVEL = 3;
+
+/// The codec that new streams are written with
+static Codec output_codec = Codec::GZIP;
+/// Are new streams written as blocks?
+static bool output_blocked = false;
+
+Codec get_output_codec() {
+    return output_codec;
+}
+
+void set_output_codec(Codec codec) {
+    output_codec = codec;
+}
+
+Codec parse_codec(const string& name) {
+    if (name == "none") {
+        return Codec::NONE;
+    } else if (name == "gzip") {
+        return Codec::GZIP;
+    } else if (name == "zstd") {
+        return Codec::ZSTD;
+    }
+    throw invalid_argument("unknown stream codec: " + name);
+}
+
+bool get_output_blocked() {
+    return output_blocked;
+}
+
+void set_output_blocked(bool blocked) {
+    output_blocked = blocked;
+}
+
+/// Read up to count bytes from a raw stream, returning how many we got.
+static size_t read_raw_bytes(::google::protobuf::io::ZeroCopyInputStream* raw_in, char* dest, size_t count) {
+    size_t got = 0;
+    while (got < count) {
+        const void* data;
+        int size;
+        if (!raw_in->Next(&data, &size)) {
+            break;
+        }
+        size_t to_copy = min(count - got, (size_t) size);
+        memcpy(dest + got, data, to_copy);
+        if (to_copy < size) {
+            raw_in->BackUp(size - to_copy);
+        }
+        got += to_copy;
+    }
+    return got;
+}
+
+/// Write bytes to a raw stream, returning false on error.
+static bool write_raw_bytes(::google::protobuf::io::ZeroCopyOutputStream* raw_out, const char* data, size_t size) {
+    while (size > 0) {
+        void* raw_data;
+        int raw_size;
+        if (!raw_out->Next(&raw_data, &raw_size)) {
+            return false;
+        }
+        size_t to_copy = min(size, (size_t) raw_size);
+        memcpy(raw_data, data, to_copy);
+        if (to_copy < raw_size) {
+            raw_out->BackUp(raw_size - to_copy);
+        }
+        data += to_copy;
+        size -= to_copy;
+    }
+    return true;
+}
+
+bool is_blocked_stream(::google::protobuf::io::ZeroCopyInputStream* raw_in) {
+    const void* data;
+    int size;
+    if (!raw_in->Next(&data, &size)) {
+        return false;
+    }
+    raw_in->BackUp(size);
+    return size >= sizeof(BLOCK_MAGIC) && memcmp(data, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) == 0;
+}
+
+bool read_block(::google::protobuf::io::ZeroCopyInputStream* raw_in, string& block_out) {
+    block_out.resize(BLOCK_HEADER_SIZE);
+    size_t got = read_raw_bytes(raw_in, &block_out[0], BLOCK_HEADER_SIZE);
+    if (got == 0) {
+        block_out.clear();
+        return false;
+    }
+    if (got < BLOCK_HEADER_SIZE || memcmp(block_out.data(), BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) != 0) {
+        throw runtime_error("stream::read_block: corrupt or truncated block header");
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < 8; i++) {
+        length |= ((size_t) (unsigned char) block_out[sizeof(BLOCK_MAGIC) + i]) << (8 * i);
+    }
+    block_out.resize(BLOCK_HEADER_SIZE + length);
+    if (read_raw_bytes(raw_in, &block_out[BLOCK_HEADER_SIZE], length) != length) {
+        throw runtime_error("stream::read_block: truncated block");
+    }
+    return true;
+}
+
+string codec_name(Codec codec) {
+    switch (codec) {
+    case Codec::NONE:
+        return "none";
+    case Codec::GZIP:
+        return "gzip";
+    case Codec::ZSTD:
+        return "zstd";
+    }
+    return "unknown";
+}
+
+CodecOutputStream::CodecOutputStream(::google::protobuf::io::ZeroCopyOutputStream* raw_out, Codec codec) :
+    codec(codec), raw_out(raw_out), blocked(get_output_blocked()), sink(raw_out) {
+    
+    if (blocked) {
+        // Collect the compressed data so we can measure it
+        block_out = unique_ptr<::google::protobuf::io::StringOutputStream>(
+            new ::google::protobuf::io::StringOutputStream(&block_data));
+        sink = block_out.get();
+    }
+    
+    switch (codec) {
+    case Codec::GZIP:
+        gzip_out = unique_ptr<::google::protobuf::io::GzipOutputStream>(
+            new ::google::protobuf::io::GzipOutputStream(sink));
+        break;
+    case Codec::ZSTD:
+        {
+            ZSTD_CStream* context = ZSTD_createCStream();
+            if (context == nullptr || ZSTD_isError(ZSTD_initCStream(context, ZSTD_LEVEL))) {
+                throw runtime_error("stream::CodecOutputStream: could not set up zstd compression");
+            }
+            zstd_context = context;
+            buffer.resize(CODEC_BLOCK_SIZE);
+        }
+        break;
+    case Codec::NONE:
+        buffer.resize(CODEC_BLOCK_SIZE);
+        had_error = !write_raw(UNCOMPRESSED_MAGIC, sizeof(UNCOMPRESSED_MAGIC));
+        break;
+    }
+}
+
+CodecOutputStream::~CodecOutputStream() {
+    Close();
+    if (zstd_context != nullptr) {
+        ZSTD_freeCStream((ZSTD_CStream*) zstd_context);
+    }
+}
+
+bool CodecOutputStream::Next(void** data, int* size) {
+    if (gzip_out) {
+        return gzip_out->Next(data, size);
+    }
+    if (closed || had_error) {
+        return false;
+    }
+    if (buffer_used == buffer.size()) {
+        if (!flush_buffer(false)) {
+            return false;
+        }
+    }
+    *data = buffer.data() + buffer_used;
+    *size = buffer.size() - buffer_used;
+    byte_count += *size;
+    buffer_used = buffer.size();
+    return true;
+}
+
+void CodecOutputStream::BackUp(int count) {
+    if (gzip_out) {
+        gzip_out->BackUp(count);
+        return;
+    }
+    buffer_used -= count;
+    byte_count -= count;
+}
+
+::google::protobuf::int64 CodecOutputStream::ByteCount() const {
+    if (gzip_out) {
+        return gzip_out->ByteCount();
+    }
+    return byte_count;
+}
+
+bool CodecOutputStream::Close() {
+    if (closed) {
+        return !had_error;
+    }
+    if (gzip_out) {
+        had_error = !gzip_out->Close();
+        if (blocked) {
+            // Make sure it can't touch the block after we send it
+            gzip_out.reset();
+        }
+    } else if (!had_error) {
+        had_error = !flush_buffer(true);
+    }
+    closed = true;
+    
+    if (blocked && !had_error) {
+        // Now we know how big the block is, so send it along with its header
+        block_out.reset();
+        string header(BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+        for (size_t i = 0; i < 8; i++) {
+            header.push_back((char) ((block_data.size() >> (8 * i)) & 0xFF));
+        }
+        had_error = !write_raw_bytes(raw_out, header.data(), header.size()) ||
+            !write_raw_bytes(raw_out, block_data.data(), block_data.size());
+        string().swap(block_data);
+    }
+    return !had_error;
+}
+
+bool CodecOutputStream::flush_buffer(bool finish) {
+    if (codec == Codec::NONE) {
+        if (buffer_used > 0 || finish) {
+            // Write a block header, which is a zero length terminator if we
+            // are finishing with nothing pending.
+            for (size_t length : {buffer_used, (size_t) 0}) {
+                unsigned char header[4];
+                for (size_t i = 0; i < 4; i++) {
+                    header[i] = (length >> (8 * i)) & 0xFF;
+                }
+                if (!write_raw((const char*) header, sizeof(header)) || !write_raw(buffer.data(), length)) {
+                    return false;
+                }
+                if (!finish || length == 0) {
+                    break;
+                }
+            }
+        }
+    } else {
+        // Feed the buffer through zstd
+        ZSTD_CStream* context = (ZSTD_CStream*) zstd_context;
+        vector<char> compressed(ZSTD_CStreamOutSize());
+        ZSTD_inBuffer in_buffer = {buffer.data(), buffer_used, 0};
+        while (in_buffer.pos < in_buffer.size) {
+            ZSTD_outBuffer out_buffer = {compressed.data(), compressed.size(), 0};
+            size_t result = ZSTD_compressStream(context, &out_buffer, &in_buffer);
+            if (ZSTD_isError(result) || !write_raw(compressed.data(), out_buffer.pos)) {
+                return false;
+            }
+        }
+        if (finish) {
+            size_t remaining;
+            do {
+                ZSTD_outBuffer out_buffer = {compressed.data(), compressed.size(), 0};
+                remaining = ZSTD_endStream(context, &out_buffer);
+                if (ZSTD_isError(remaining) || !write_raw(compressed.data(), out_buffer.pos)) {
+                    return false;
+                }
+            } while (remaining > 0);
+        }
+    }
+    buffer_used = 0;
+    return true;
+}
+
+bool CodecOutputStream::write_raw(const char* data, size_t size) {
+    return write_raw_bytes(sink, data, size);
+}
+
+CodecInputStream::CodecInputStream(::google::protobuf::io::ZeroCopyInputStream* raw_in) :
+    raw_in(raw_in) {
+    
+    // Peek at the start of the stream to work out what it is
+    const void* data;
+    int size;
+    if (!raw_in->Next(&data, &size)) {
+        // Empty stream. Nothing to decode, whatever it was.
+        codec = Codec::NONE;
+        at_end = true;
+        return;
+    }
+    const unsigned char* bytes = (const unsigned char*) data;
+    raw_in->BackUp(size);
+    
+    if (size >= sizeof(BLOCK_MAGIC) && memcmp(bytes, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) == 0) {
+        // Each block has its own codec, which we find when we open it.
+        blocked = true;
+        codec = Codec::GZIP;
+    } else if (size >= sizeof(ZSTD_MAGIC) && memcmp(bytes, ZSTD_MAGIC, sizeof(ZSTD_MAGIC)) == 0) {
+        codec = Codec::ZSTD;
+        ZSTD_DStream* context = ZSTD_createDStream();
+        if (context == nullptr || ZSTD_isError(ZSTD_initDStream(context))) {
+            throw runtime_error("stream::CodecInputStream: could not set up zstd decompression");
+        }
+        zstd_context = context;
+        buffer.resize(ZSTD_DStreamOutSize());
+    } else if (size >= sizeof(UNCOMPRESSED_MAGIC) && memcmp(bytes, UNCOMPRESSED_MAGIC, sizeof(UNCOMPRESSED_MAGIC)) == 0) {
+        codec = Codec::NONE;
+        buffer.resize(CODEC_BLOCK_SIZE);
+    } else {
+        // Everything else is treated as gzip, as it always was. If it isn't
+        // really gzip, the parser will complain.
+        codec = Codec::GZIP;
+        gzip_in = unique_ptr<::google::protobuf::io::GzipInputStream>(
+            new ::google::protobuf::io::GzipInputStream(raw_in));
+    }
+}
+
+CodecInputStream::~CodecInputStream() {
+    if (zstd_context != nullptr) {
+        ZSTD_freeDStream((ZSTD_DStream*) zstd_context);
+    }
+    if (raw_pending_size > 0) {
+        // Hand back anything we didn't use
+        raw_in->BackUp(raw_pending_size);
+    }
+}
+
+Codec CodecInputStream::get_codec() const {
+    return codec;
+}
+
+bool CodecInputStream::Next(const void** data, int* size) {
+    if (blocked) {
+        while (!block_in || !block_in->Next(data, size)) {
+            if (!next_block()) {
+                return false;
+            }
+        }
+        byte_count += *size;
+        return true;
+    }
+    if (gzip_in) {
+        return gzip_in->Next(data, size);
+    }
+    while (buffer_read == buffer_filled) {
+        if (at_end || !refill()) {
+            at_end = true;
+            return false;
+        }
+    }
+    *data = buffer.data() + buffer_read;
+    *size = buffer_filled - buffer_read;
+    byte_count += *size;
+    buffer_read = buffer_filled;
+    return true;
+}
+
+void CodecInputStream::BackUp(int count) {
+    if (blocked) {
+        block_in->BackUp(count);
+        byte_count -= count;
+        return;
+    }
+    if (gzip_in) {
+        gzip_in->BackUp(count);
+        return;
+    }
+    buffer_read -= count;
+    byte_count -= count;
+}
+
+bool CodecInputStream::Skip(int count) {
+    if (gzip_in && !blocked) {
+        return gzip_in->Skip(count);
+    }
+    const void* data;
+    int size;
+    while (count > 0) {
+        if (!Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            BackUp(size - count);
+            size = count;
+        }
+        count -= size;
+    }
+    return true;
+}
+
+::google::protobuf::int64 CodecInputStream::ByteCount() const {
+    if (gzip_in && !blocked) {
+        return gzip_in->ByteCount();
+    }
+    return byte_count;
+}
+
+bool CodecInputStream::refill() {
+    buffer_read = 0;
+    buffer_filled = 0;
+    if (codec == Codec::NONE) {
+        return refill_none();
+    } else {
+        return refill_zstd();
+    }
+}
+
+bool CodecInputStream::refill_none() {
+    unsigned char header[4];
+    while (true) {
+        size_t got = read_raw((char*) header, sizeof(header));
+        if (got == 0) {
+            // Clean end of input between concatenated streams
+            return false;
+        } else if (got < sizeof(header)) {
+            throw runtime_error("stream::CodecInputStream: truncated uncompressed stream");
+        }
+        if (memcmp(header, UNCOMPRESSED_MAGIC, sizeof(UNCOMPRESSED_MAGIC)) == 0) {
+            // This is the start of a concatenated stream
+            continue;
+        }
+        size_t length = 0;
+        for (size_t i = 0; i < 4; i++) {
+            length |= ((size_t) header[i]) << (8 * i);
+        }
+        if (length == 0) {
+            // End of one stream; there may be another after it.
+            continue;
+        }
+        if (length > buffer.size()) {
+            buffer.resize(length);
+        }
+        if (read_raw(buffer.data(), length) != length) {
+            throw runtime_error("stream::CodecInputStream: truncated uncompressed stream");
+        }
+        buffer_filled = length;
+        return true;
+    }
+}
+
+bool CodecInputStream::refill_zstd() {
+    ZSTD_DStream* context = (ZSTD_DStream*) zstd_context;
+    while (buffer_filled == 0) {
+        if (raw_pending_size == 0) {
+            const void* data;
+            if (!raw_in->Next(&data, &raw_pending_size)) {
+                raw_pending_size = 0;
+                return false;
+            }
+            raw_pending = (const char*) data;
+        }
+        ZSTD_inBuffer in_buffer = {raw_pending, (size_t) raw_pending_size, 0};
+        ZSTD_outBuffer out_buffer = {buffer.data(), buffer.size(), 0};
+        // This moves on to the next frame automatically when one ends, so
+        // concatenated streams just work.
+        size_t result = ZSTD_decompressStream(context, &out_buffer, &in_buffer);
+        if (ZSTD_isError(result)) {
+            throw runtime_error(string("stream::CodecInputStream: corrupt zstd stream: ") + ZSTD_getErrorName(result));
+        }
+        raw_pending += in_buffer.pos;
+        raw_pending_size -= in_buffer.pos;
+        buffer_filled = out_buffer.pos;
+    }
+    return true;
+}
+
+size_t CodecInputStream::read_raw(char* dest, size_t count) {
+    return read_raw_bytes(raw_in, dest, count);
+}
+
+bool CodecInputStream::next_block() {
+    // Drop the old block's decoder before its input
+    block_in.reset();
+    block_raw_in.reset();
+    if (!read_block(raw_in, block_data)) {
+        return false;
+    }
+    block_raw_in = unique_ptr<::google::protobuf::io::ArrayInputStream>(
+        new ::google::protobuf::io::ArrayInputStream(block_data.data() + BLOCK_HEADER_SIZE,
+                                                     block_data.size() - BLOCK_HEADER_SIZE));
+    block_in = unique_ptr<CodecInputStream>(new CodecInputStream(block_raw_in.get()));
+    codec = block_in->get_codec();
+    return true;
+}
+
+}
@@ -0,0 +1,193 @@
+#ifndef VG_STREAM_CODEC_HPP_INCLUDED
+#define VG_STREAM_CODEC_HPP_INCLUDED
+
+/** \file
+ * Compression codecs for the length-prefixed protobuf stream format used for
+ * GAM and VG files.
+ *
+ * Historically every stream was gzipped. A stream may now instead be zstd
+ * compressed, or not compressed at all (which is handy for pipes between vg
+ * processes on one machine). The codec is detected automatically on read:
+ *
+ * - gzip streams start with the gzip magic number (0x1f 0x8b), and are read
+ *   exactly as before, so existing files keep working.
+ * - zstd streams start with the zstd frame magic number (0x28 0xb5 0x2f 0xfd).
+ * - Uncompressed streams start with the 4 bytes "VGUC", followed by blocks of a
+ *   4-byte little-endian length and that many bytes of data, terminated by a
+ *   zero length.
+ *
+ * Concatenating streams written with the same codec (as multithreaded writers
+ * do) produces a valid stream.
+ *
+ * Optionally, each stream (i.e. each stream::write() call) can be wrapped in a
+ * block with the 4 bytes "VGBK" and its 8-byte little-endian compressed size.
+ * A file made of such blocks can be split up without decompressing it, so the
+ * blocks can be inflated and parsed in parallel, and block start offsets can
+ * be used to seek into it. Sequential readers handle blocks transparently.
+ */
+
+#include <string>
+#include <memory>
+#include <vector>
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/io/gzip_stream.h"
+
+namespace stream {
+
+/// The compression codecs a protobuf stream can use
+enum class Codec {
+    NONE,
+    GZIP,
+    ZSTD
+};
+
+/// Get the codec that new streams are written with. Defaults to GZIP.
+Codec get_output_codec();
+
+/// Set the codec that new streams are written with, for the whole process.
+void set_output_codec(Codec codec);
+
+/// Parse a codec name ("none", "gzip" or "zstd"). Throws
+/// std::invalid_argument for anything else.
+Codec parse_codec(const std::string& name);
+
+/// Get the name of a codec
+std::string codec_name(Codec codec);
+
+/// Return true if new streams are written as independently decodable blocks.
+/// Defaults to false, since older versions of vg can't read blocks.
+bool get_output_blocked();
+
+/// Set whether new streams are written as blocks, for the whole process.
+void set_output_blocked(bool blocked);
+
+/// Return true if the given raw stream starts with a block. Doesn't consume
+/// anything.
+bool is_blocked_stream(::google::protobuf::io::ZeroCopyInputStream* raw_in);
+
+/// Read the next whole block, header included, from a blocked raw stream into
+/// the given string, without decompressing it. Returns false at the end of the
+/// stream. A CodecInputStream over the block's bytes will decode it.
+bool read_block(::google::protobuf::io::ZeroCopyInputStream* raw_in, std::string& block_out);
+
+/**
+ * A ZeroCopyOutputStream that compresses what is written to it with a codec
+ * and writes it to an underlying raw stream. The codec header is written on
+ * construction, and the stream is finished on Close() or destruction.
+ */
+class CodecOutputStream : public ::google::protobuf::io::ZeroCopyOutputStream {
+public:
+    CodecOutputStream(::google::protobuf::io::ZeroCopyOutputStream* raw_out,
+                      Codec codec = get_output_codec());
+    virtual ~CodecOutputStream();
+    
+    virtual bool Next(void** data, int* size);
+    virtual void BackUp(int count);
+    virtual ::google::protobuf::int64 ByteCount() const;
+    
+    /// Finish the compressed stream. Returns false on an I/O error.
+    bool Close();
+    
+private:
+    Codec codec;
+    ::google::protobuf::io::ZeroCopyOutputStream* raw_out;
+    
+    /// If we are writing a block, the compressed data is collected here until
+    /// we know how big it is.
+    bool blocked;
+    std::string block_data;
+    std::unique_ptr<::google::protobuf::io::StringOutputStream> block_out;
+    /// Where the compressed data goes (raw_out or block_out)
+    ::google::protobuf::io::ZeroCopyOutputStream* sink;
+    
+    /// Used for the GZIP codec, which we delegate to wholesale
+    std::unique_ptr<::google::protobuf::io::GzipOutputStream> gzip_out;
+    
+    /// Uncompressed data waiting to be encoded, for the other codecs
+    std::vector<char> buffer;
+    /// How much of the buffer is in use (the last Next() hands out the rest)
+    size_t buffer_used = 0;
+    /// Total bytes written to us
+    ::google::protobuf::int64 byte_count = 0;
+    /// Have we been closed, or hit an error?
+    bool closed = false;
+    bool had_error = false;
+    /// ZSTD_CStream*, kept opaque so the zstd header stays in the .cpp
+    void* zstd_context = nullptr;
+    
+    /// Encode and pass along everything in the buffer. If finish is set, also
+    /// end the compressed stream.
+    bool flush_buffer(bool finish);
+    
+    /// Copy bytes out to the sink.
+    bool write_raw(const char* data, size_t size);
+};
+
+/**
+ * A ZeroCopyInputStream that detects the codec of an underlying raw stream
+ * and decompresses it.
+ */
+class CodecInputStream : public ::google::protobuf::io::ZeroCopyInputStream {
+public:
+    CodecInputStream(::google::protobuf::io::ZeroCopyInputStream* raw_in);
+    virtual ~CodecInputStream();
+    
+    virtual bool Next(const void** data, int* size);
+    virtual void BackUp(int count);
+    virtual bool Skip(int count);
+    virtual ::google::protobuf::int64 ByteCount() const;
+    
+    /// Get the codec that was detected.
+    Codec get_codec() const;
+    
+private:
+    Codec codec;
+    ::google::protobuf::io::ZeroCopyInputStream* raw_in;
+    
+    /// If the input is made of blocks, we decode them one at a time with a
+    /// nested CodecInputStream.
+    bool blocked = false;
+    std::string block_data;
+    std::unique_ptr<::google::protobuf::io::ArrayInputStream> block_raw_in;
+    std::unique_ptr<CodecInputStream> block_in;
+    
+    /// Load the next block. Returns false at the end of the input.
+    bool next_block();
+    
+    /// Used for the GZIP codec, which we delegate to wholesale
+    std::unique_ptr<::google::protobuf::io::GzipInputStream> gzip_in;
+    
+    /// Decoded data for the other codecs
+    std::vector<char> buffer;
+    /// How much of the buffer holds data
+    size_t buffer_filled = 0;
+    /// How much of the buffer has been handed out
+    size_t buffer_read = 0;
+    /// Total bytes handed out
+    ::google::protobuf::int64 byte_count = 0;
+    /// Have we run out of input?
+    bool at_end = false;
+    
+    /// ZSTD_DStream*, kept opaque so the zstd header stays in the .cpp
+    void* zstd_context = nullptr;
+    /// Raw input we have been given but not yet decompressed
+    const char* raw_pending = nullptr;
+    int raw_pending_size = 0;
+    
+    /// Refill the buffer with the next decoded data. Returns false at the end
+    /// of the stream.
+    bool refill();
+    /// Refill for uncompressed input
+    bool refill_none();
+    /// Refill for zstd input
+    bool refill_zstd();
+    
+    /// Read exactly the given number of bytes from the raw stream, returning
+    /// how many we actually got.
+    size_t read_raw(char* dest, size_t count);
+};
+
+}
+
+#endif
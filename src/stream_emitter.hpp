@@ -0,0 +1,234 @@
+#ifndef VG_STREAM_EMITTER_HPP_INCLUDED
+#define VG_STREAM_EMITTER_HPP_INCLUDED
+
+/**
+ * \file stream_emitter.hpp: define an AsyncEmitter that lets many producer
+ * threads hand batches of protobuf objects off to background writer threads,
+ * which compress and write them to a single output stream.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "stream.hpp"
+
+namespace stream {
+
+/**
+ * Collects finished batches of protobuf objects from any number of threads and
+ * writes them to an output stream as chunks in the format produced by
+ * stream::write(). Serialization and compression happen on the emitter's own
+ * worker threads, so producers only pay for moving their batch into a queue.
+ *
+ * In unordered mode, batches are written in the order they are handed in. In
+ * ordered mode, every batch carries a sequence number, and batches are written
+ * in sequence number order starting from 0, so producers can restore the order
+ * of their input by numbering their input batches. Every sequence number must
+ * be used exactly once.
+ *
+ * Producers are blocked when too many batches are waiting, which keeps memory
+ * bounded if the output can't keep up.
+ */
+template<typename T>
+class AsyncEmitter {
+public:
+
+    /**
+     * Make an emitter writing to the given stream, using the given number of
+     * worker threads to compress batches, and holding at most max_queued
+     * batches in memory before blocking producers.
+     */
+    AsyncEmitter(std::ostream& out, bool ordered = false, size_t worker_count = 1,
+                 size_t max_queued = 64);
+
+    /**
+     * Write out everything outstanding and stop the workers.
+     */
+    ~AsyncEmitter();
+
+    // Can't be copied or moved, since the workers point back at us
+    AsyncEmitter(const AsyncEmitter& other) = delete;
+    AsyncEmitter& operator=(const AsyncEmitter& other) = delete;
+
+    /**
+     * Hand a batch off to be written. The batch is left empty. In ordered
+     * mode, sequence_number gives the batch's place in the output. Empty
+     * batches are not written, but they still use up their sequence number.
+     */
+    void emit(std::vector<T>&& batch, size_t sequence_number = 0);
+
+    /**
+     * Hand a batch off to be written, if it has at least buffer_limit objects
+     * in it. Can be used like stream::write_buffered() in unordered mode.
+     */
+    void emit_buffered(std::vector<T>& batch, size_t buffer_limit);
+
+    /**
+     * Block until everything handed in so far has been written, then stop the
+     * workers and flush the output stream. No more batches may be emitted
+     * afterward. Called automatically on destruction.
+     */
+    void finish();
+
+private:
+
+    /// Worker thread main loop
+    void run_worker();
+
+    /// Where we write to
+    std::ostream& out;
+    /// Whether we are putting batches into sequence number order
+    bool ordered;
+    /// How many batches we can hold before producers have to wait
+    size_t max_queued;
+
+    /// Batches ready to be compressed, in output order, with their output ticket
+    std::deque<std::pair<size_t, std::vector<T>>> ready;
+    /// Batches that arrived in ordered mode before the batches preceding them
+    std::map<size_t, std::vector<T>> waiting;
+    /// The next sequence number we need to move from waiting to ready
+    size_t next_sequence = 0;
+    /// The next output ticket to give to a batch entering the ready queue
+    size_t next_ticket = 0;
+    /// The output ticket of the next batch to be written to the stream
+    size_t next_write = 0;
+    /// How many batches have been handed in but not yet written
+    size_t outstanding = 0;
+    /// Set when the workers should stop once the queue is empty
+    bool finishing = false;
+
+    /// Protects all of the above
+    std::mutex state_mutex;
+    /// Signaled when there is work in the ready queue, or when finishing
+    std::condition_variable work_available;
+    /// Signaled when a batch has been written
+    std::condition_variable batch_written;
+
+    /// The worker threads
+    std::vector<std::thread> workers;
+};
+
+template<typename T>
+AsyncEmitter<T>::AsyncEmitter(std::ostream& out, bool ordered, size_t worker_count, size_t max_queued) :
+    out(out), ordered(ordered), max_queued(std::max<size_t>(max_queued, 1)) {
+
+    for (size_t i = 0; i < std::max<size_t>(worker_count, 1); i++) {
+        workers.emplace_back(&AsyncEmitter<T>::run_worker, this);
+    }
+}
+
+template<typename T>
+AsyncEmitter<T>::~AsyncEmitter() {
+    finish();
+}
+
+template<typename T>
+void AsyncEmitter<T>::emit(std::vector<T>&& batch, size_t sequence_number) {
+    std::unique_lock<std::mutex> lock(state_mutex);
+
+    // Wait for room. In ordered mode we always let in the batch that the
+    // output is waiting on, or we could deadlock.
+    batch_written.wait(lock, [&]() {
+        return outstanding < max_queued || (ordered && sequence_number == next_sequence);
+    });
+
+    outstanding++;
+    if (!ordered) {
+        ready.emplace_back(next_ticket++, std::move(batch));
+    } else {
+        waiting.emplace(sequence_number, std::move(batch));
+        // Release everything that is now next in line
+        auto found = waiting.find(next_sequence);
+        while (found != waiting.end()) {
+            ready.emplace_back(next_ticket++, std::move(found->second));
+            waiting.erase(found);
+            next_sequence++;
+            found = waiting.find(next_sequence);
+        }
+    }
+    batch.clear();
+
+    lock.unlock();
+    work_available.notify_all();
+}
+
+template<typename T>
+void AsyncEmitter<T>::emit_buffered(std::vector<T>& batch, size_t buffer_limit) {
+    if (!batch.empty() && batch.size() >= buffer_limit) {
+        emit(std::move(batch));
+    }
+}
+
+template<typename T>
+void AsyncEmitter<T>::finish() {
+    {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        if (workers.empty()) {
+            // Already done
+            return;
+        }
+        if (!waiting.empty()) {
+            std::cerr << "warning:[stream::AsyncEmitter] " << waiting.size()
+                      << " batches never became next in order and were not written" << std::endl;
+            outstanding -= waiting.size();
+            waiting.clear();
+        }
+        finishing = true;
+    }
+    work_available.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    out.flush();
+}
+
+template<typename T>
+void AsyncEmitter<T>::run_worker() {
+    while (true) {
+        size_t ticket;
+        std::vector<T> batch;
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            work_available.wait(lock, [&]() { return !ready.empty() || finishing; });
+            if (ready.empty()) {
+                // Finishing and nothing left to do
+                return;
+            }
+            ticket = ready.front().first;
+            batch = std::move(ready.front().second);
+            ready.pop_front();
+        }
+
+        // Serialize and compress outside the lock, so workers overlap
+        std::stringstream chunk;
+        if (!batch.empty()) {
+            std::function<T&(uint64_t)> lambda = [&batch](uint64_t n) -> T& {
+                return batch[n];
+            };
+            write(chunk, batch.size(), lambda);
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+        // Wait for our turn to write
+        batch_written.wait(lock, [&]() { return next_write == ticket; });
+        if (!batch.empty()) {
+            out << chunk.rdbuf();
+        }
+        next_write++;
+        outstanding--;
+        lock.unlock();
+        batch_written.notify_all();
+    }
+}
+
+}
+
+#endif
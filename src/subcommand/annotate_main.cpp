@@ -4,13 +4,99 @@
 #include "../mapper.hpp"
 #include "../stream.hpp"
 #include "../alignment.hpp"
+#include "IntervalTree.h"
 
+#include <omp.h>
 #include <unistd.h>
 #include <getopt.h>
 
 using namespace vg;
 using namespace vg::subcommand;
 
+// a named feature on a path, in 0-based inclusive coordinates
+struct Feature {
+    string seq;
+    size_t start;
+    size_t end;
+    string name;
+};
+
+// read the features from a BED file, or from a GFF file if it's named like one
+static bool parse_features(const string& filename, vector<Feature>& features) {
+    ifstream in(filename);
+    if (!in) {
+        cerr << "error [vg annotate]: could not open feature file " << filename << endl;
+        return false;
+    }
+    bool is_gff = false;
+    for (const string& ext : {".gff", ".gff3", ".gtf"}) {
+        if (filename.size() >= ext.size()
+            && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0) {
+            is_gff = true;
+        }
+    }
+    string row;
+    for (int line = 1; getline(in, row); ++line) {
+        if (row.size() < 2 || row[0] == '#') {
+            continue;
+        }
+        vector<string> cols;
+        istringstream ss(row);
+        string col;
+        while (getline(ss, col, '\t')) {
+            cols.push_back(col);
+        }
+        Feature feature;
+        int64_t start, end;
+        try {
+            if (is_gff) {
+                if (cols.size() < 5) {
+                    throw invalid_argument("too few columns");
+                }
+                // 1-based inclusive
+                start = stoll(cols[3]) - 1;
+                end = stoll(cols[4]) - 1;
+                // name it by its ID or Name attribute, or else by its type
+                feature.name = cols[2];
+                if (cols.size() > 8) {
+                    istringstream attrs(cols[8]);
+                    string attr;
+                    while (getline(attrs, attr, ';')) {
+                        size_t b = attr.find_first_not_of(' ');
+                        if (b == string::npos) {
+                            continue;
+                        }
+                        if (attr.compare(b, 3, "ID=") == 0 || attr.compare(b, 5, "Name=") == 0) {
+                            feature.name = attr.substr(attr.find('=', b) + 1);
+                            break;
+                        }
+                    }
+                }
+            } else {
+                if (cols.size() < 3) {
+                    throw invalid_argument("too few columns");
+                }
+                // 0-based half-open
+                start = stoll(cols[1]);
+                end = stoll(cols[2]) - 1;
+                feature.name = cols.size() > 3 ? cols[3] : cols[0] + ":" + cols[1] + "-" + cols[2];
+            }
+        } catch (const logic_error& e) {
+            cerr << "error [vg annotate]: could not parse feature line " << line << ": " << row << endl;
+            return false;
+        }
+        if (start < 0 || end < start) {
+            cerr << "error [vg annotate]: empty or negative feature on line " << line << ": " << row << endl;
+            return false;
+        }
+        feature.seq = cols[0];
+        feature.start = start;
+        feature.end = end;
+        features.push_back(feature);
+    }
+    return true;
+}
+
 void help_annotate(char** argv) {
     cerr << "usage: " << argv[0] << " annotate [options] >output.{gam,vg}" << endl
          << "    -x, --xg-name FILE     an xg index describing a graph" << endl
@@ -20,7 +106,10 @@ void help_annotate(char** argv) {
          << "    -g, --gcsa FILE        a GCSA2 index file base name" << endl
          << "    -a, --gam FILE         alignments to annotate" << endl
          << "    -p, --positions        annotate alignments with reference positions" << endl
-         << "    -n, --novelty          table for each read: name, bp not in xg, nodes not in xg" << endl;
+         << "    -f, --features FILE    annotate alignments with the BED (or .gff/.gff3/.gtf) features they" << endl
+         << "                           overlap on the xg paths, adding a locus named for each one" << endl
+         << "    -n, --novelty          table for each read: name, bp not in xg, nodes not in xg" << endl
+         << "    -t, --threads N        number of threads to use when annotating alignments [1]" << endl;
 }
 
 int main_annotate(int argc, char** argv) {
@@ -36,9 +125,12 @@ int main_annotate(int argc, char** argv) {
     string vg_name;
     string bed_name;
     string gam_name;
+    string features_name;
     bool add_positions = false;
     bool novelty = false;
 
+    omp_set_num_threads(1);
+
     int c;
     optind = 2; // force optind past command positional argument
     while (true) {
@@ -52,11 +144,13 @@ int main_annotate(int argc, char** argv) {
             {"bed-name", required_argument, 0, 'b'},
             {"db-name", required_argument, 0, 'd'},
             {"novelty", no_argument, 0, 'n'},
+            {"features", required_argument, 0, 'f'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:d:v:g:a:pb:n",
+        c = getopt_long (argc, argv, "hx:d:v:g:a:pb:nf:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -97,6 +191,14 @@ int main_annotate(int argc, char** argv) {
             novelty = true;
             break;
 
+        case 'f':
+            features_name = optarg;
+            break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_annotate(argv);
@@ -119,18 +221,80 @@ int main_annotate(int argc, char** argv) {
     Mapper mapper(xg_index, nullptr, nullptr);
     
     if (!gam_name.empty()) {
-        vector<Alignment> buffer;
-        if (add_positions) {
-            //map<string, double> Mapper::alignment_mean_path_positions(const Alignment& aln, bool first_hit_only);
+        if (add_positions || !features_name.empty()) {
+            // index the features by path rank and their inclusive range on the path
+            vector<Feature> features;
+            if (!features_name.empty() && !parse_features(features_name, features)) {
+                return 1;
+            }
+            vector<vector<Interval<size_t, size_t> > > path_intervals(xg_index->max_path_rank() + 1);
+            for (size_t i = 0; i < features.size(); ++i) {
+                size_t rank = xg_index->path_rank(features[i].seq);
+                if (rank == 0) {
+                    cerr << "warning [vg annotate]: feature " << features[i].name << " is on "
+                         << features[i].seq << ", which is not a path in the xg index" << endl;
+                    continue;
+                }
+                path_intervals[rank].push_back(Interval<size_t, size_t>(features[i].start, features[i].end, i));
+            }
+            vector<IntervalTree<size_t, size_t> > feature_index;
+            feature_index.reserve(path_intervals.size());
+            for (auto& intervals : path_intervals) {
+                feature_index.emplace_back(intervals);
+            }
+            
+            int thread_count = get_thread_count();
+            vector<vector<Alignment> > buffer(thread_count);
             function<void(Alignment&)> lambda = [&](Alignment& aln) {
-                mapper.annotate_with_initial_path_positions(aln);
-                buffer.push_back(aln);
-                stream::write_buffered(cout, buffer, 100);
+                if (add_positions) {
+                    mapper.annotate_with_initial_path_positions(aln);
+                }
+                if (!features.empty()) {
+                    // find where the alignment runs along each path it touches
+                    vector<pair<size_t, pair<size_t, size_t> > > spans;
+                    for (auto& mapping : aln.path().mapping()) {
+                        size_t length = max<size_t>(mapping_from_length(mapping), 1);
+                        xg_index->for_each_offset_in_paths(make_pos_t(mapping.position()),
+                                                           [&](size_t rank, size_t offset, bool is_rev) {
+                                auto it = spans.begin();
+                                while (it != spans.end() && it->first != rank) ++it;
+                                if (it == spans.end()) {
+                                    spans.emplace_back(rank, make_pair(offset, offset + length - 1));
+                                } else {
+                                    it->second.first = min(it->second.first, offset);
+                                    it->second.second = max(it->second.second, offset + length - 1);
+                                }
+                            });
+                    }
+                    vector<size_t> overlapping;
+                    vector<Interval<size_t, size_t> > found;
+                    for (auto& span : spans) {
+                        found.clear();
+                        feature_index[span.first].findOverlapping(span.second.first, span.second.second, found);
+                        for (auto& interval : found) {
+                            overlapping.push_back(interval.value);
+                        }
+                    }
+                    // report each feature once, in file order
+                    sort(overlapping.begin(), overlapping.end());
+                    overlapping.erase(unique(overlapping.begin(), overlapping.end()), overlapping.end());
+                    for (auto i : overlapping) {
+                        aln.add_locus()->set_name(features[i].name);
+                    }
+                }
+                auto& thread_buffer = buffer[omp_get_thread_num()];
+                thread_buffer.push_back(aln);
+                if (thread_buffer.size() >= 100) {
+#pragma omp critical (cout)
+                    stream::write_buffered(cout, thread_buffer, 100);
+                }
             };
             get_input_file(gam_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    stream::for_each_parallel(in, lambda);
                 });
-            stream::write_buffered(cout, buffer, 0); // flush
+            for (auto& thread_buffer : buffer) {
+                stream::write_buffered(cout, thread_buffer, 0); // flush
+            }
         } else if (novelty) {
             cout << "name\tlength.bp\tunaligned.bp\tknown.nodes\tknown.bp\tnovel.nodes\tnovel.bp" << endl;
             function<void(Alignment&)> lambda = [&](Alignment& aln) {
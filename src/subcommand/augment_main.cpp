@@ -19,6 +19,7 @@
 
 #include <list>
 #include <fstream>
+#include <memory>
 
 #include "subcommand.hpp"
 
@@ -37,12 +38,6 @@ static Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thre
                                 int max_mismatches, int window_size, int max_depth, bool use_mapq,
                                 bool show_progress);
 
-// this used to be the first half of call_main()
-static void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
-                                 bool show_progress);
-
-// the pileup augmenter assumes even trivial from/to lengths set for each mappings
-static void add_trivial_edits(VG& graph);
 
 
 void help_augment(char** argv, ConfigurableParser& parser) {
@@ -294,35 +289,76 @@ int main_augment(int argc, char** argv) {
             pileups = nullptr;
         }
     
-        // Load all the reads
-        vector<Alignment> reads;
-        // And pull out their paths
-        vector<Path> read_paths;
-        get_input_file(gam_in_file_name, [&](istream& alignment_stream) {
-            stream::for_each<Alignment>(alignment_stream, [&](Alignment& alignment) {
-                // Trim the softclips off of every read
-                // Work out were to cut
-                int cut_start = softclip_start(alignment);
-                int cut_end = softclip_end(alignment);
-                // Cut the sequence and quality
-                alignment.set_sequence(alignment.sequence().substr(cut_start, alignment.sequence().size() - cut_start - cut_end));
-                if (alignment.quality().size() != 0) {
-                    alignment.set_quality(alignment.quality().substr(cut_start, alignment.quality().size() - cut_start - cut_end));
-                }
-                // Trim the path
-                *alignment.mutable_path() = trim_hanging_ends(alignment.path());
-                
-                // Save every read
-                reads.push_back(alignment);
-                // And the path for the read, separately
-                // TODO: Make edit use callbacks or something so it doesn't need a vector of paths necessarily
-                read_paths.push_back(alignment.path());
-            });
-        });
+        // The reads get read twice, so standard input has to be saved
+        string spooled_gam;
+        if (gam_in_file_name == "-") {
+            spooled_gam = tmpfilename();
+            ofstream spool(spooled_gam);
+            spool << cin.rdbuf();
+            gam_in_file_name = spooled_gam;
+        }
+        
+        // Trim the softclips off of every read
+        auto trim_read = [](Alignment& alignment) {
+            // Work out were to cut
+            int cut_start = softclip_start(alignment);
+            int cut_end = softclip_end(alignment);
+            // Cut the sequence and quality
+            alignment.set_sequence(alignment.sequence().substr(cut_start, alignment.sequence().size() - cut_start - cut_end));
+            if (alignment.quality().size() != 0) {
+                alignment.set_quality(alignment.quality().substr(cut_start, alignment.quality().size() - cut_start - cut_end));
+            }
+            // Trim the path
+            *alignment.mutable_path() = trim_hanging_ends(alignment.path());
+        };
+        
+        // Write the reads with their paths in the augmented graph here, if
+        // asked to
+        unique_ptr<ofstream> gam_out_file;
+        if (!gam_out_file_name.empty()) {
+            gam_out_file.reset(new ofstream(gam_out_file_name));
+            if (!*gam_out_file) {
+                cerr << "[vg augment]: Error opening output GAM file: " << gam_out_file_name << endl;
+                return 1;
+            }
+        }
+        vector<Alignment> gam_buffer;
+        
+        // Augment the graph, streaming the reads through once in parallel to
+        // find the breakpoints, and once more to add their sequence and
+        // rewrite their paths. Don't embed paths or break at ends.
+        auto translation = graph->edit([&](const function<void(Path&)>& lambda, bool parallel) {
+            ifstream alignment_stream(gam_in_file_name);
+            if (!alignment_stream) {
+                cerr << "[vg augment]: Error opening GAM file: " << gam_in_file_name << endl;
+                exit(1);
+            }
+            if (parallel) {
+                stream::for_each_parallel<Alignment>(alignment_stream, [&](Alignment& alignment) {
+                    trim_read(alignment);
+                    lambda(*alignment.mutable_path());
+                });
+            } else {
+                stream::for_each<Alignment>(alignment_stream, [&](Alignment& alignment) {
+                    trim_read(alignment);
+                    lambda(*alignment.mutable_path());
+                    if (gam_out_file) {
+                        // Write it back out with its corrected embedded path
+                        gam_buffer.push_back(alignment);
+                        stream::write_buffered(*gam_out_file, gam_buffer, 100);
+                    }
+                });
+            }
+        }, !gam_out_file_name.empty(), false);
         
-        // Augment the graph, rewriting the paths.
-        // Don't embed paths or break at ends.
-        auto translation = graph->edit(read_paths, false, true, false);
+        if (gam_out_file) {
+            // Flush the buffer
+            stream::write_buffered(*gam_out_file, gam_buffer, 0);
+            gam_out_file->close();
+        }
+        if (!spooled_gam.empty()) {
+            remove(spooled_gam.c_str());
+        }
         
         // Write the augmented graph
         if (show_progress) {
@@ -343,31 +379,6 @@ int main_augment(int argc, char** argv) {
             stream::write_buffered(translation_file, translation, 0);
             translation_file.close();
         }        
-        
-        if (!gam_out_file_name.empty()) {
-            // Write out the modified GAM
-            
-            ofstream gam_out_file(gam_out_file_name);
-            if (!gam_out_file) {
-                cerr << "[vg augment]: Error opening output GAM file: " << gam_out_file_name << endl;
-                return 1;
-            }
-            
-            // We use this buffer and do a buffered write
-            vector<Alignment> gam_buffer;
-            for (size_t i = 0; i < reads.size(); i++) {
-                // Say we are going to write out the alignment
-                gam_buffer.push_back(reads[i]);
-                
-                // Set its path to the corrected embedded path
-                *gam_buffer.back().mutable_path() = read_paths[i];
-                
-                // Write it back out
-                stream::write_buffered(gam_out_file, gam_buffer, 100);
-            }
-            // Flush the buffer
-            stream::write_buffered(gam_out_file, gam_buffer, 0);
-        }
     } else if (augmentation_mode == "pileup") {
         // We want to augment with pileups
         
@@ -462,11 +473,10 @@ Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thread_coun
                          int max_mismatches, int window_size, int max_depth, bool use_mapq,
                          bool show_progress) {
 
-    // Make Pileups makers for each thread.
-    vector<Pileups*> pileups;
-    for (int i = 0; i < thread_count; ++i) {
-        pileups.push_back(new Pileups(graph, min_quality, max_mismatches, window_size, max_depth, use_mapq));
-    }
+    // Split the nodes into shards so no two threads compute the same
+    // node's pileup, and there is nothing to merge at the end. Use a few
+    // shards per thread so threads rarely wait on each other.
+    PileupShards shards(graph, thread_count * 4, min_quality, max_mismatches, window_size, max_depth, use_mapq);
     
     // setup alignment stream
     get_input_file(gam_file_name, [&](istream& alignment_stream) {
@@ -475,83 +485,13 @@ Pileups* compute_pileups(VG* graph, const string& gam_file_name, int thread_coun
             cerr << "Computing pileups" << endl;
         }
         
-        function<void(Alignment&)> lambda = [&pileups, &graph](Alignment& aln) {
-            int tid = omp_get_thread_num();
-            pileups[tid]->compute_from_alignment(aln);
+        function<void(Alignment&)> lambda = [&shards](Alignment& aln) {
+            shards.add_alignment(aln);
         };
         stream::for_each_parallel(alignment_stream, lambda);
     });
 
-    // single-threaded (!) merge
-    if (show_progress && pileups.size() > 1) {
-        cerr << "Merging pileups" << endl;
-    }
-    for (int i = 1; i < pileups.size(); ++i) {
-        pileups[0]->merge(*pileups[i]);
-        delete pileups[i];
-    }
-    return pileups[0];
-}
-
-void augment_with_pileups(PileupAugmenter& augmenter, Pileups& pileups, bool expect_subgraph,
-                          bool show_progress) {
-    
-    if (show_progress) {
-        cerr << "Computing augmented graph from the pileup" << endl;
-    }
-
-    pileups.for_each_node_pileup([&](const NodePileup& node_pileup) {
-            if (!augmenter._graph->has_node(node_pileup.node_id())) {
-                // This pileup doesn't belong in this graph
-                if(!expect_subgraph) {
-                    throw runtime_error("Found pileup for nonexistent node " + to_string(node_pileup.node_id()));
-                }
-                // If that's expected, just skip it
-                return;
-            }
-            // Send approved pileups to the augmenter
-            augmenter.call_node_pileup(node_pileup);
-            
-        });
-
-    pileups.for_each_edge_pileup([&](const EdgePileup& edge_pileup) {
-            if (!augmenter._graph->has_edge(edge_pileup.edge())) {
-                // This pileup doesn't belong in this graph
-                if(!expect_subgraph) {
-                    throw runtime_error("Found pileup for nonexistent edge " + pb2json(edge_pileup.edge()));
-                }
-                // If that's expected, just skip it
-                return;
-            }
-            // Send approved pileups to the augmenter
-            augmenter.call_edge_pileup(edge_pileup);            
-        });
-
-    // map the edges from original graph
-    if (show_progress) {
-        cerr << "Mapping edges into augmented graph" << endl;
-    }
-    augmenter.update_augmented_graph();
-
-    // map the paths from the original graph
-    if (show_progress) {
-        cerr << "Mapping paths into augmented graph" << endl;
-    }
-    augmenter.map_paths();
-}
-
-void add_trivial_edits(VG& graph) {
-    for (auto& name_and_mappings : graph.paths._paths) {
-        for (auto& mapping : name_and_mappings.second) {
-            if (mapping.edit_size() == 0) {
-                Edit* edit = mapping.add_edit();
-                int64_t offset = mapping.position().offset();
-                int64_t length = graph.get_node(mapping.position().node_id())->sequence().length();
-                edit->set_from_length(length);
-                edit->set_to_length(length);
-            }
-        }
-    }
+    return shards.finish();
 }
 
 // Register subcommand
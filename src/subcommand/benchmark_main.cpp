@@ -7,7 +7,12 @@
 #include <unistd.h>
 #include <getopt.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
 
 #include "subcommand.hpp"
 
@@ -16,6 +21,12 @@
 
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../gssw_aligner.hpp"
+#include "../mapper.hpp"
+#include "../build_index.hpp"
+#include "../packer.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
 #include "../algorithms/extract_connecting_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 #include "../algorithms/weakly_connected_components.hpp"
@@ -26,28 +37,315 @@ using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+/// How many reads the read-based benchmarks process per run, spread over the threads
+const size_t READS_PER_RUN = 32;
+/// How long the simulated reads are
+const size_t READ_LENGTH = 150;
+
+/// Make a chain of the given number of SNP bubbles, with pseudorandom
+/// sequence between them. Node IDs are in topological order.
+static void make_bubble_graph(size_t bubbles, VG& graph) {
+    mt19937 rng(bubbles);
+    uniform_int_distribution<size_t> random_base(0, 3);
+    uniform_int_distribution<size_t> random_length(8, 24);
+    const string bases = "ACGT";
+    
+    auto random_sequence = [&]() {
+        string sequence(random_length(rng), 'A');
+        for (char& base : sequence) {
+            base = bases[random_base(rng)];
+        }
+        return sequence;
+    };
+    
+    Node* prev = graph.create_node(random_sequence());
+    for (size_t i = 0; i < bubbles; i++) {
+        size_t ref_base = random_base(rng);
+        Node* ref = graph.create_node(string(1, bases[ref_base]));
+        Node* alt = graph.create_node(string(1, bases[(ref_base + 1) % 4]));
+        Node* next = graph.create_node(random_sequence());
+        graph.create_edge(prev, ref);
+        graph.create_edge(prev, alt);
+        graph.create_edge(ref, next);
+        graph.create_edge(alt, next);
+        prev = next;
+    }
+}
+
+/// Walk forward through the graph from the start of the given node, picking
+/// branches at random, to make a perfectly matching alignment of up to the
+/// given length.
+static Alignment walk_read(const HandleGraph& graph, id_t start, size_t length, mt19937& rng) {
+    Alignment aln;
+    handle_t here = graph.get_handle(start, false);
+    while (aln.sequence().size() < length) {
+        string node_seq = graph.get_sequence(here);
+        size_t take = min(node_seq.size(), length - aln.sequence().size());
+        
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(graph.get_id(here));
+        mapping->set_rank(aln.path().mapping_size());
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(take);
+        edit->set_to_length(take);
+        aln.mutable_sequence()->append(node_seq.substr(0, take));
+        
+        vector<handle_t> nexts;
+        graph.follow_edges(here, false, [&](const handle_t& next) {
+            nexts.push_back(next);
+        });
+        if (nexts.empty()) {
+            break;
+        }
+        here = nexts[rng() % nexts.size()];
+    }
+    return aln;
+}
+
+/// Make some reads from a bubble graph, with a mismatch every so often
+static vector<Alignment> simulate_reads(const VG& graph, size_t count, size_t length) {
+    mt19937 rng(count);
+    // start on the nodes between bubbles, leaving room for a full read if we can
+    size_t starts = max<size_t>(graph.node_size() / 3, 1);
+    starts = starts > length / 8 ? starts - length / 8 : starts;
+    vector<Alignment> reads;
+    for (size_t i = 0; i < count; i++) {
+        reads.push_back(walk_read(graph, 3 * (rng() % starts) + 1, length, rng));
+        string& sequence = *reads.back().mutable_sequence();
+        for (size_t j = 37; j < sequence.size(); j += 50) {
+            sequence[j] = sequence[j] == 'A' ? 'C' : 'A';
+        }
+    }
+    return reads;
+}
+
+// Benchmarks that can be run at different sizes and thread counts. Each one
+// interprets the size parameter as it sees fit and does its setup outside of
+// the timed region.
+
+static RegisteredBenchmark gssw_benchmark("Aligner::align",
+    "local alignment of reads to a graph of SIZE bubbles with gssw",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(params.size, graph);
+    vector<Alignment> reads = simulate_reads(graph, READS_PER_RUN, READ_LENGTH);
+    // everyone gets their own copy of the graph to align against
+    vector<Graph> graphs(params.threads, graph.graph);
+    Aligner aligner;
+    
+    return run_benchmark("", params.iterations, [&]() {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < reads.size(); i++) {
+            Alignment aln = reads[i];
+            aligner.align(aln, graphs[omp_get_thread_num()], true, false);
+        }
+    });
+});
+
+static RegisteredBenchmark banded_global_benchmark("BandedGlobalAligner",
+    "banded global alignment of reads through a graph of SIZE bubbles",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(params.size, graph);
+    // a read has to span the whole graph to be aligned globally
+    mt19937 rng(params.size);
+    vector<Alignment> reads;
+    for (size_t i = 0; i < READS_PER_RUN; i++) {
+        reads.push_back(walk_read(graph, 1, numeric_limits<size_t>::max(), rng));
+    }
+    vector<Graph> graphs(params.threads, graph.graph);
+    Aligner aligner;
+    
+    return run_benchmark("", params.iterations, [&]() {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < reads.size(); i++) {
+            Alignment aln = reads[i];
+            aligner.align_global_banded(aln, graphs[omp_get_thread_num()], 0, true);
+        }
+    });
+});
+
+static RegisteredBenchmark find_mems_benchmark("Mapper::find_mems_deep",
+    "MEM finding for reads in the GCSA2 index of a graph of SIZE bubbles",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(params.size, graph);
+    vector<Alignment> reads = simulate_reads(graph, READS_PER_RUN, READ_LENGTH);
+    
+    gcsa::TempFile::setDirectory(find_temp_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsa_index = nullptr;
+    gcsa::LCPArray* lcp_index = nullptr;
+    build_gcsa_lcp(graph, gcsa_index, lcp_index, 16, 3);
+    xg::XG xg_index(graph.graph);
+    
+    // like vg map, every thread gets its own mapper
+    vector<unique_ptr<Mapper>> mappers;
+    for (size_t i = 0; i < params.threads; i++) {
+        mappers.emplace_back(new Mapper(&xg_index, gcsa_index, lcp_index));
+    }
+    
+    BenchmarkResult result = run_benchmark("", params.iterations, [&]() {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < reads.size(); i++) {
+            double lcp_avg, fraction_filtered;
+            const string& sequence = reads[i].sequence();
+            mappers[omp_get_thread_num()]->find_mems_deep(sequence.begin(), sequence.end(), lcp_avg,
+                                                          fraction_filtered, 0, 8, 28);
+        }
+    });
+    
+    mappers.clear();
+    delete gcsa_index;
+    delete lcp_index;
+    return result;
+});
+
+static RegisteredBenchmark follow_edges_benchmark("XG::follow_edges",
+    "following the edges on both sides of every node of an xg of SIZE bubbles",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(params.size, graph);
+    const xg::XG xg_index(graph.graph);
+    id_t max_id = graph.max_node_id();
+    
+    return run_benchmark("", params.iterations, [&]() {
+        atomic<size_t> total(0);
+#pragma omp parallel for
+        for (id_t id = 1; id <= max_id; id++) {
+            size_t edges = 0;
+            handle_t handle = xg_index.get_handle(id, false);
+            for (bool go_left : {false, true}) {
+                xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+                    edges++;
+                });
+            }
+            total += edges;
+        }
+        assert(total == 8 * params.size);
+    });
+});
+
+static RegisteredBenchmark for_each_parallel_benchmark("stream::for_each_parallel",
+    "reading a stream of 100 * SIZE alignments in parallel",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(100, graph);
+    vector<Alignment> reads = simulate_reads(graph, 100 * params.size, READ_LENGTH);
+    size_t count = reads.size();
+    
+    stringstream serialized;
+    stream::write_buffered(serialized, reads, 0);
+    string bytes = serialized.str();
+    
+    return run_benchmark("", params.iterations, [&]() {
+        stringstream in(bytes);
+        atomic<size_t> seen(0);
+        function<void(Alignment&)> lambda = [&](Alignment& aln) {
+            seen++;
+        };
+        stream::for_each_parallel(in, lambda);
+        assert(seen == count);
+    });
+});
+
+static RegisteredBenchmark packer_benchmark("Packer::add",
+    "adding the coverage of 10 * SIZE alignments to per-thread packers",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(100, graph);
+    vector<Alignment> reads = simulate_reads(graph, 10 * params.size, READ_LENGTH);
+    xg::XG xg_index(graph.graph);
+    
+    // every thread gets its own packer
+    vector<unique_ptr<Packer>> packers;
+    for (size_t i = 0; i < params.threads; i++) {
+        packers.emplace_back(new Packer(&xg_index, 0));
+    }
+    
+    return run_benchmark("", params.iterations, [&]() {
+#pragma omp parallel for
+        for (size_t i = 0; i < reads.size(); i++) {
+            packers[omp_get_thread_num()]->add(reads[i]);
+        }
+    });
+});
+
+static RegisteredBenchmark shared_packer_benchmark("Packer::add shared",
+    "adding the coverage of 10 * SIZE alignments to one packer shared by all threads",
+    [](const BenchmarkParams& params) {
+    VG graph;
+    make_bubble_graph(100, graph);
+    vector<Alignment> reads = simulate_reads(graph, 10 * params.size, READ_LENGTH);
+    xg::XG xg_index(graph.graph);
+    
+    // like vg pack, all the threads use the same packer
+    Packer packer(&xg_index, 0, true);
+    
+    return run_benchmark("", params.iterations, [&]() {
+#pragma omp parallel for
+        for (size_t i = 0; i < reads.size(); i++) {
+            packer.add(reads[i]);
+        }
+    });
+});
+
 void help_benchmark(char** argv) {
     cerr << "usage: " << argv[0] << " benchmark [options] >report.tsv" << endl
          << "options:" << endl
+         << "    -b, --benchmark NAME   run this registered benchmark instead of the default suite (may repeat)" << endl
+         << "    -a, --all              run all registered benchmarks as well as the default suite" << endl
+         << "    -s, --sizes N,M,...    run registered benchmarks at these sizes [100]" << endl
+         << "    -t, --threads N,M,...  run registered benchmarks with these thread counts [1]" << endl
+         << "    -i, --iterations N     run registered benchmarks this many times [100]" << endl
+         << "    -j, --json             write results as JSON instead of TSV" << endl
+         << "    -l, --list             list the registered benchmarks and exit" << endl
          << "    -p, --progress         show progress" << endl;
 }
 
+/// Parse a comma-separated list of positive numbers
+static vector<size_t> parse_size_list(const string& list) {
+    vector<size_t> parsed;
+    for (auto& item : split_delims(list, ",")) {
+        parsed.push_back(stoull(item));
+        if (parsed.back() == 0) {
+            cerr << "error:[vg benchmark] sizes and thread counts must be positive" << endl;
+            exit(1);
+        }
+    }
+    return parsed;
+}
+
 int main_benchmark(int argc, char** argv) {
 
     bool show_progress = false;
+    bool run_all = false;
+    bool output_json = false;
+    bool list_only = false;
+    vector<string> benchmark_names;
+    vector<size_t> sizes{100};
+    vector<size_t> thread_counts{1};
+    size_t iterations = 100;
     
     int c;
     optind = 2; // force optind past command positional argument
     while (true) {
         static struct option long_options[] =
             {
+                {"benchmark", required_argument, 0, 'b'},
+                {"all", no_argument, 0, 'a'},
+                {"sizes", required_argument, 0, 's'},
+                {"threads", required_argument, 0, 't'},
+                {"iterations", required_argument, 0, 'i'},
+                {"json", no_argument, 0, 'j'},
+                {"list", no_argument, 0, 'l'},
                 {"progress",  no_argument, 0, 'p'},
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "ph?",
+        c = getopt_long (argc, argv, "b:as:t:i:jlph?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -57,6 +355,34 @@ int main_benchmark(int argc, char** argv) {
         switch (c)
         {
 
+        case 'b':
+            benchmark_names.push_back(optarg);
+            break;
+            
+        case 'a':
+            run_all = true;
+            break;
+            
+        case 's':
+            sizes = parse_size_list(optarg);
+            break;
+            
+        case 't':
+            thread_counts = parse_size_list(optarg);
+            break;
+            
+        case 'i':
+            iterations = stoull(optarg);
+            break;
+            
+        case 'j':
+            output_json = true;
+            break;
+            
+        case 'l':
+            list_only = true;
+            break;
+            
         case 'p':
             show_progress = true;
             break;
@@ -80,100 +406,160 @@ int main_benchmark(int argc, char** argv) {
         exit(1);
     }
     
+    if (list_only) {
+        RegisteredBenchmark::for_each([](const RegisteredBenchmark& benchmark) {
+            cout << benchmark.get_name() << "\t" << benchmark.get_description() << endl;
+        });
+        return 0;
+    }
+    
+    // Work out which registered benchmarks to run
+    vector<const RegisteredBenchmark*> to_run;
+    RegisteredBenchmark::for_each([&](const RegisteredBenchmark& benchmark) {
+        if (run_all || find(benchmark_names.begin(), benchmark_names.end(), benchmark.get_name()) != benchmark_names.end()) {
+            to_run.push_back(&benchmark);
+        }
+    });
+    if (to_run.size() < benchmark_names.size() && !run_all) {
+        cerr << "error:[vg benchmark] unknown benchmark name; see vg benchmark --list" << endl;
+        exit(1);
+    }
+    // The fixed suite runs unless some particular benchmarks were asked for
+    bool run_default_suite = benchmark_names.empty();
+    
     // Do all benchmarking on one thread
     omp_set_num_threads(1);
     
     // Turn on nested parallelism, so we can parallelize over VCFs and over alignment bands
     omp_set_nested(1);
     
-    // Generate a test graph
-    VG vg_mut;
-    for (size_t i = 1; i < 101; i++) {
-        // It will have 100 nodes
-        vg_mut.create_node("ACGTACGT", i);
-    }
-    size_t bits = 1;
-    for (size_t i = 1; i < 101; i++) {
-        for (size_t j = 1; j < 101; j++) {
-            if ((bits ^ (i + (j << 3))) % 50 == 0) {
-                // Make some arbitrary edges
-                vg_mut.create_edge(i, j, false, false);
+    vector<BenchmarkResult> results;
+    vector<BenchmarkParams> results_params;
+    
+    if (run_default_suite) {
+        // Generate a test graph
+        VG vg_mut;
+        for (size_t i = 1; i < 101; i++) {
+            // It will have 100 nodes
+            vg_mut.create_node("ACGTACGT", i);
+        }
+        size_t bits = 1;
+        for (size_t i = 1; i < 101; i++) {
+            for (size_t j = 1; j < 101; j++) {
+                if ((bits ^ (i + (j << 3))) % 50 == 0) {
+                    // Make some arbitrary edges
+                    vg_mut.create_edge(i, j, false, false);
+                }
+                // Shifts and xors make good PRNGs right?
+                bits = bits ^ (bits << 13) ^ j;            
             }
-            // Shifts and xors make good PRNGs right?
-            bits = bits ^ (bits << 13) ^ j;            
         }
-    }
     
-    const VG vg(vg_mut);
+        const VG vg(vg_mut);
     
-    // And a test XG of it
-    const xg::XG xg_index(vg_mut.graph);
+        // And a test XG of it
+        const xg::XG xg_index(vg_mut.graph);
+    
+        results.push_back(run_benchmark("vg::algorithms topological_sort", 1000, [&]() {
+            vector<handle_t> order = algorithms::topological_sort(&vg);
+            assert(order.size() == vg.node_size());
+        }));
+    
+        results.push_back(run_benchmark("vg::algorithms sort", 1000, [&]() {
+            vg_mut = vg;
+        }, [&]() {
+            algorithms::sort(&vg_mut);
+        }));
+    
+        results.push_back(run_benchmark("vg::algorithms orient_nodes_forward", 1000, [&]() {
+            vg_mut = vg;
+        }, [&]() {
+            algorithms::orient_nodes_forward(&vg_mut);
+        }));
     
-    vector<BenchmarkResult> results;
     
-    results.push_back(run_benchmark("vg::algorithms topological_sort", 1000, [&]() {
-        vector<handle_t> order = algorithms::topological_sort(&vg);
-        assert(order.size() == vg.node_size());
-    }));
-    
-    results.push_back(run_benchmark("vg::algorithms sort", 1000, [&]() {
-        vg_mut = vg;
-    }, [&]() {
-        algorithms::sort(&vg_mut);
-    }));
-    
-    results.push_back(run_benchmark("vg::algorithms orient_nodes_forward", 1000, [&]() {
-        vg_mut = vg;
-    }, [&]() {
-        algorithms::orient_nodes_forward(&vg_mut);
-    }));
-    
-    
-    results.push_back(run_benchmark("vg::algorithms weakly_connected_components", 1000, [&]() {
-        auto components = algorithms::weakly_connected_components(&vg);
-        assert(components.size() == 1);
-        assert(components.front().size() == vg.node_size());
-    }));
-    
-    results.push_back(run_benchmark("VG::get_node", 1000, [&]() {
-        for (size_t rep = 0; rep < 100; rep++) {
-            for (size_t i = 1; i < 101; i++) {
-                vg_mut.get_node(i);
+        results.push_back(run_benchmark("vg::algorithms weakly_connected_components", 1000, [&]() {
+            auto components = algorithms::weakly_connected_components(&vg);
+            assert(components.size() == 1);
+            assert(components.front().size() == vg.node_size());
+        }));
+    
+        results.push_back(run_benchmark("VG::get_node", 1000, [&]() {
+            for (size_t rep = 0; rep < 100; rep++) {
+                for (size_t i = 1; i < 101; i++) {
+                    vg_mut.get_node(i);
+                }
             }
-        }
-    }));
+        }));
     
-    results.push_back(run_benchmark("algorithms::extract_connecting_graph on xg", 1000, [&]() {
-        pos_t pos_1 = make_pos_t(55, false, 0);
-        pos_t pos_2 = make_pos_t(32, false, 0);
+        results.push_back(run_benchmark("algorithms::extract_connecting_graph on xg", 1000, [&]() {
+            pos_t pos_1 = make_pos_t(55, false, 0);
+            pos_t pos_2 = make_pos_t(32, false, 0);
         
-        int64_t max_len = 500;
+            int64_t max_len = 500;
         
-        Graph g;
+            Graph g;
         
-        auto trans = algorithms::extract_connecting_graph(&xg_index, g, max_len, pos_1, pos_2, false, false, true, true, true);
+            auto trans = algorithms::extract_connecting_graph(&xg_index, g, max_len, pos_1, pos_2, false, false, true, true, true);
     
-    }));
+        }));
     
-    results.push_back(run_benchmark("algorithms::extract_connecting_graph on vg", 1000, [&]() {
-        pos_t pos_1 = make_pos_t(55, false, 0);
-        pos_t pos_2 = make_pos_t(32, false, 0);
+        results.push_back(run_benchmark("algorithms::extract_connecting_graph on vg", 1000, [&]() {
+            pos_t pos_1 = make_pos_t(55, false, 0);
+            pos_t pos_2 = make_pos_t(32, false, 0);
         
-        int64_t max_len = 500;
+            int64_t max_len = 500;
         
-        Graph g;
+            Graph g;
         
-        auto trans = algorithms::extract_connecting_graph(&vg, g, max_len, pos_1, pos_2, false, false, true, true, true);
+            auto trans = algorithms::extract_connecting_graph(&vg, g, max_len, pos_1, pos_2, false, false, true, true, true);
+    
+        }));
     
-    }));
+        // Do the control against itself
+        results.push_back(run_benchmark("control", 1000, benchmark_control));
     
-    // Do the control against itself
-    results.push_back(run_benchmark("control", 1000, benchmark_control));
+        // These all ran on the fixed 100 node graph on one thread
+        BenchmarkParams default_params;
+        default_params.iterations = 1000;
+        results_params.resize(results.size(), default_params);
+    }
+    
+    for (auto benchmark : to_run) {
+        for (size_t size : sizes) {
+            for (size_t threads : thread_counts) {
+                BenchmarkParams params;
+                params.size = size;
+                params.threads = threads;
+                params.iterations = iterations;
+                
+                if (show_progress) {
+                    cerr << "Running " << benchmark->get_name() << " at size " << size << " on "
+                         << threads << " threads" << endl;
+                }
+                
+                omp_set_num_threads(threads);
+                results.push_back(benchmark->run(params));
+                results_params.push_back(params);
+                omp_set_num_threads(1);
+            }
+        }
+    }
 
-    cout << "# Benchmark results for vg " << VG_VERSION_STRING << endl;
-    cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\tname" << endl;
-    for (auto& result : results) {
-        cout << result << endl;
+    if (output_json) {
+        cout << "{\"vg_version\": \"" << VG_VERSION_STRING << "\", \"benchmarks\": [" << endl;
+        for (size_t i = 0; i < results.size(); i++) {
+            write_json(cout, results[i], results_params[i]);
+            cout << (i + 1 < results.size() ? "," : "") << endl;
+        }
+        cout << "]}" << endl;
+    }
+    else {
+        cout << "# Benchmark results for vg " << VG_VERSION_STRING << endl;
+        cout << "# runs\ttest(us)\tstddev(us)\tcontrol(us)\tstddev(us)\tscore\terr\tname\tsize\tthreads" << endl;
+        for (size_t i = 0; i < results.size(); i++) {
+            cout << results[i] << "\t" << results_params[i].size << "\t" << results_params[i].threads << endl;
+        }
     }
 
     return 0;
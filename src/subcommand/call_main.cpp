@@ -15,7 +15,11 @@
 #include "../option.hpp"
 
 #include "../vg.hpp"
+#include "../xg.hpp"
+#include "../gam_index.hpp"
+#include "../pileup_augmenter.hpp"
 #include "../support_caller.hpp"
+#include "../packer.hpp"
 
 
 
@@ -25,10 +29,21 @@ using namespace vg::subcommand;
 
 void help_call(char** argv, ConfigurableParser& parser) {
     cerr << "usage: " << argv[0] << " call [options] <augmented-graph.vg> > output.vcf" << endl
+         << "       " << argv[0] << " call [options] --xg index.xg --gam sorted.gam -r PATH > output.vcf" << endl
+         << "       " << argv[0] << " call [options] --xg index.xg --pack coverage.pack -r PATH > output.vcf" << endl
          << "Output variant calls in VCF or Loci format given a graph and pileup" << endl
          << endl
          << "genotyper options:" << endl
         
+         << "chunked calling options:" << endl
+         << "    --xg FILE                   call windows of the reference paths (-r) of this graph, augmenting each" << endl
+         << "                                from the pileup of its reads, instead of taking an augmented graph" << endl
+         << "    --gam FILE                  take each window's reads from this sorted GAM, indexed by vg gamsort -i" << endl
+         << "    --pack FILE                 instead of reads, genotype the alleles already in each window from the" << endl
+         << "                                coverage in this pack (from vg pack on the same XG), without augmenting" << endl
+         << "    --chunk-size N              call windows of N bases along each path [10000000]" << endl
+         << "    --overlap N                 overlap consecutive windows by N bases, keeping each call from the" << endl
+         << "                                window it is further into [2000]" << endl
          << "general options:" << endl
          << "    -z, --translation FILE      input translation table" << endl
          << "    -b, --base-graph FILE       base graph.  currently needed for XREF tag" << endl
@@ -41,6 +56,194 @@ void help_call(char** argv, ConfigurableParser& parser) {
      parser.print_help(cerr);
 }
 
+/**
+ * Cut one window of a reference path out of the XG into window_graph, as
+ * scripts/chunked_call does, with the path starting at the window's first
+ * node. Returns the offset along the path of that node, which the calls'
+ * positions are relative to.
+ */
+static size_t make_window(const xg::XG& xg_index, const string& path_name, size_t start, size_t end,
+                          VG& window_graph) {
+
+    // take the nodes in the window's ID range, and their neighbors, as scripts/chunked_call does
+    int64_t first_node = xg_index.node_at_path_position(path_name, start);
+    int64_t last_node = xg_index.node_at_path_position(path_name, end - 1);
+    Graph window_chunk;
+    xg_index.get_id_range(min(first_node, last_node), max(first_node, last_node), window_chunk);
+    xg_index.expand_context(window_chunk, 1, true);
+    window_graph.extend(window_chunk);
+
+    // the context can run the path back before the window, so cut that off to
+    // make the path start at the window's first node
+    vector<id_t> before_window;
+    for (auto& mapping : window_graph.paths.get_path(path_name)) {
+        if (mapping.position().node_id() == first_node) {
+            break;
+        }
+        before_window.push_back(mapping.position().node_id());
+    }
+    for (id_t id : before_window) {
+        if (window_graph.has_node(id)) {
+            window_graph.destroy_node(id);
+        }
+    }
+    window_graph.remove_orphan_edges();
+
+    return xg_index.position_in_path(first_node, path_name).front();
+}
+
+/**
+ * Call the variants in one window of a reference path: cut the window out of
+ * the XG, pile up the reads that touch it, augment it from the pileup as vg
+ * augment would, and call the augmented window into window_vcf. Returns the
+ * offset along the path of the window's first node.
+ */
+static size_t call_window_from_reads(SupportCaller& support_caller, const xg::XG& xg_index,
+                                     const GAMIndex& gam_index, istream& gam_stream, const string& path_name,
+                                     size_t start, size_t end, int thread_count, ostream& window_vcf) {
+
+    VG window_graph;
+    size_t window_offset = make_window(xg_index, path_name, start, end, window_graph);
+
+    // pile up the reads touching the window, with vg augment's default settings
+    vector<Alignment> reads;
+    gam_index.for_alignment_in_range(gam_stream, window_graph.min_node_id(), window_graph.max_node_id(),
+                                     [&](const Alignment& aln) {
+        reads.push_back(aln);
+    });
+    PileupShards shards(&window_graph, thread_count * 4, 10, 1, 0, 1000, true);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < reads.size(); i++) {
+        shards.add_alignment(reads[i]);
+    }
+    reads.clear();
+    unique_ptr<Pileups> pileups(shards.finish());
+
+    // augment the window, ignoring the parts of reads that leave it
+    add_trivial_edits(window_graph);
+    PileupAugmenter augmenter(&window_graph, PileupAugmenter::Default_default_quality,
+                              PileupAugmenter::Default_min_aug_support);
+    augment_with_pileups(augmenter, *pileups, true);
+    pileups.reset();
+
+    SupportAugmentedGraph& augmented = augmenter._augmented_graph;
+    augmented.base_graph = &window_graph;
+    augmented.translator.build_position_table();
+
+    support_caller.call(augmented, "", window_vcf);
+
+    return window_offset;
+}
+
+/**
+ * Genotype the alleles already in the graph in one window of a reference
+ * path, without augmenting it: cut the window out of the XG, take its
+ * supports from the coverage in the pack, and call it into window_vcf.
+ * Returns the offset along the path of the window's first node.
+ */
+static size_t call_window_from_pack(SupportCaller& support_caller, const xg::XG& xg_index, const Packer& packer,
+                                    const string& path_name, size_t start, size_t end, ostream& window_vcf) {
+
+    VG window_graph;
+    size_t window_offset = make_window(xg_index, path_name, start, end, window_graph);
+
+    // the "augmented" graph is the window itself, translating to itself
+    SupportAugmentedGraph augmented;
+    // (assigning a VG leaves its paths behind, so copy those too)
+    augmented.graph = window_graph;
+    augmented.graph.paths = window_graph.paths;
+    augmented.graph.paths.rebuild_node_mapping();
+    augmented.graph.paths.rebuild_mapping_aux();
+    augmented.base_graph = &window_graph;
+    augmented.translator.load(augmented.graph.make_translation({}, {}, {}));
+    augmented.load_pack_supports(packer);
+
+    support_caller.call(augmented, "", window_vcf);
+
+    return window_offset;
+}
+
+/**
+ * Call the reference paths the support caller is set up for in overlapping
+ * windows of the XG, writing one VCF to stdout. Each window is called with
+ * call_window, which writes its calls and returns the path offset they are
+ * relative to. The windows are called one at a time, each with all the
+ * threads. Where windows overlap, each call is kept from the window whose
+ * middle it is nearer, so every position is called from exactly one window.
+ */
+static int call_chunked(SupportCaller& support_caller, const xg::XG& xg_index,
+                        size_t chunk_size, size_t chunk_overlap, bool show_progress,
+                        const function<size_t(const string&, size_t, size_t, ostream&)>& call_window) {
+
+    // each window is called as one path of its own, so keep the settings for all of them
+    vector<string> path_names = support_caller.ref_path_names;
+    vector<string> contig_names = support_caller.contig_name_overrides;
+    vector<size_t> contig_lengths = support_caller.length_overrides;
+    int64_t user_offset = support_caller.variant_offset;
+    for (size_t i = 0; i < path_names.size(); i++) {
+        if (xg_index.path_rank(path_names[i]) == 0) {
+            cerr << "[vg call]: Reference path " << path_names[i] << " is not in the XG index" << endl;
+            return 1;
+        }
+        if (i >= contig_names.size()) {
+            contig_names.push_back(path_names[i]);
+        }
+        if (i >= contig_lengths.size()) {
+            contig_lengths.push_back(xg_index.path_length(path_names[i]));
+        }
+    }
+
+    write_vcf_header(cout, {support_caller.sample_name}, contig_names, contig_lengths,
+        support_caller.min_mad_for_filter, support_caller.max_dp_for_filter,
+        support_caller.max_dp_multiple_for_filter, support_caller.max_local_dp_multiple_for_filter,
+        support_caller.min_ad_log_likelihood_for_filter);
+
+    for (size_t i = 0; i < path_names.size(); i++) {
+        size_t path_length = xg_index.path_length(path_names[i]);
+        support_caller.ref_path_names = vector<string>{path_names[i]};
+        support_caller.contig_name_overrides = vector<string>{contig_names[i]};
+        support_caller.length_overrides = vector<size_t>{contig_lengths[i]};
+
+        // windows as made by scripts/chunked_call
+        size_t covered = 0;
+        size_t core_start = 0;
+        while (covered < path_length) {
+            size_t start = covered > chunk_overlap ? covered - chunk_overlap : 0;
+            size_t end = min(path_length, start + chunk_size);
+            size_t core_end = (end == path_length) ? end : end - chunk_overlap / 2;
+            covered = end;
+
+            if (show_progress) {
+                cerr << "Calling " << path_names[i] << ":" << start << "-" << end << endl;
+            }
+
+            // the calls are placed by the offset of the window's start
+            stringstream window_vcf;
+            support_caller.variant_offset = 0;
+            size_t window_offset = call_window(path_names[i], start, end, window_vcf);
+
+            // keep the records whose path position falls in this window's share
+            string line;
+            while (getline(window_vcf, line)) {
+                if (line.empty() || line[0] == '#') {
+                    continue;
+                }
+                size_t pos_start = line.find('\t') + 1;
+                size_t path_pos = window_offset + stoull(line.substr(pos_start, line.find('\t', pos_start) - pos_start)) - 1;
+                if (path_pos < core_start || path_pos >= core_end) {
+                    continue;
+                }
+                // shift the position by the user's offset
+                cout << line.substr(0, pos_start) << (path_pos + 1 + user_offset)
+                     << line.substr(line.find('\t', pos_start)) << "\n";
+            }
+            core_start = core_end;
+        }
+    }
+    cout.flush();
+    return 0;
+}
+
 int main_call(int argc, char** argv) {
 
     string translation_file_name;
@@ -56,6 +259,20 @@ int main_call(int argc, char** argv) {
     bool show_progress = false;
     int thread_count = 0;
 
+    // chunked calling from an XG and a GAM
+    string xg_file_name;
+    string gam_file_name;
+    string pack_file_name;
+    size_t chunk_size = 10000000;
+    size_t chunk_overlap = 2000;
+
+    // long options with no short form
+    const int OPT_XG = 1000;
+    const int OPT_GAM = 1001;
+    const int OPT_CHUNK_SIZE = 1002;
+    const int OPT_OVERLAP = 1003;
+    const int OPT_PACK = 1004;
+
     static const struct option long_options[] = {
         {"base-graph", required_argument, 0, 'b'},
         {"translation", required_argument, 0, 'z'},
@@ -63,6 +280,11 @@ int main_call(int argc, char** argv) {
         {"verbose", no_argument, 0, 'v'},
         {"threads", required_argument, 0, 't'},
         {"help", no_argument, 0, 'h'},
+        {"xg", required_argument, 0, OPT_XG},
+        {"gam", required_argument, 0, OPT_GAM},
+        {"pack", required_argument, 0, OPT_PACK},
+        {"chunk-size", required_argument, 0, OPT_CHUNK_SIZE},
+        {"overlap", required_argument, 0, OPT_OVERLAP},
         {0, 0, 0, 0}
     };
     static const char* short_options = "z:b:pvt:h";
@@ -88,6 +310,21 @@ int main_call(int argc, char** argv) {
         case 't':
             thread_count = atoi(optarg);
             break;
+        case OPT_XG:
+            xg_file_name = optarg;
+            break;
+        case OPT_GAM:
+            gam_file_name = optarg;
+            break;
+        case OPT_PACK:
+            pack_file_name = optarg;
+            break;
+        case OPT_CHUNK_SIZE:
+            chunk_size = atoll(optarg);
+            break;
+        case OPT_OVERLAP:
+            chunk_overlap = atoll(optarg);
+            break;
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -115,6 +352,77 @@ int main_call(int argc, char** argv) {
     }
     thread_count = get_thread_count();
 
+    if (!xg_file_name.empty() || !gam_file_name.empty() || !pack_file_name.empty()) {
+        // Chunked calling makes its own augmented graphs, or genotypes the
+        // graph as it is from a pack
+        if (xg_file_name.empty() || gam_file_name.empty() == pack_file_name.empty()) {
+            cerr << "[vg call]: Chunked calling needs an XG index (--xg) and either a sorted GAM (--gam) or a pack (--pack)" << endl;
+            return 1;
+        }
+        if (optind < argc) {
+            cerr << "[vg call]: Chunked calling (--xg) does not take an augmented graph" << endl;
+            return 1;
+        }
+        if (!support_caller.convert_to_vcf) {
+            cerr << "[vg call]: Chunked calling (--xg) only writes VCF" << endl;
+            return 1;
+        }
+        if (((vector<string>&) support_caller.ref_path_names).empty()) {
+            cerr << "[vg call]: Chunked calling (--xg) needs the reference paths to call given with -r" << endl;
+            return 1;
+        }
+        if (chunk_size <= chunk_overlap) {
+            cerr << "[vg call]: Chunk size (--chunk-size) must be bigger than the overlap (--overlap)" << endl;
+            return 1;
+        }
+
+        ifstream xg_stream(xg_file_name);
+        if (!xg_stream) {
+            cerr << "[vg call]: Unable to load XG index: " << xg_file_name << endl;
+            return 1;
+        }
+        xg::XG xg_index(xg_stream);
+
+        if (!pack_file_name.empty()) {
+            ifstream pack_stream(pack_file_name);
+            if (!pack_stream) {
+                cerr << "[vg call]: Unable to load pack: " << pack_file_name << endl;
+                return 1;
+            }
+            // a loaded packer is already compact, so don't make it dynamic storage first
+            Packer packer;
+            packer.xgidx = &xg_index;
+            packer.load(pack_stream);
+            if (packer.graph_length() != xg_index.seq_length) {
+                cerr << "[vg call]: Pack " << pack_file_name << " was not made from XG index " << xg_file_name << endl;
+                return 1;
+            }
+            return call_chunked(support_caller, xg_index, chunk_size, chunk_overlap, show_progress,
+                                [&](const string& path_name, size_t start, size_t end, ostream& window_vcf) {
+                return call_window_from_pack(support_caller, xg_index, packer, path_name, start, end, window_vcf);
+            });
+        }
+
+        ifstream gam_stream(gam_file_name);
+        if (!gam_stream) {
+            cerr << "[vg call]: Unable to load GAM: " << gam_file_name << endl;
+            return 1;
+        }
+        ifstream gam_index_stream(gam_file_name + ".gai");
+        if (!gam_index_stream) {
+            cerr << "[vg call]: Unable to load GAM index: " << gam_file_name << ".gai (make it with vg gamsort -i)" << endl;
+            return 1;
+        }
+        GAMIndex gam_index;
+        gam_index.load(gam_index_stream);
+
+        return call_chunked(support_caller, xg_index, chunk_size, chunk_overlap, show_progress,
+                            [&](const string& path_name, size_t start, size_t end, ostream& window_vcf) {
+            return call_window_from_reads(support_caller, xg_index, gam_index, gam_stream, path_name,
+                                          start, end, thread_count, window_vcf);
+        });
+    }
+
     // Parse the arguments
     if (optind >= argc) {
         help_call(argv, parser);
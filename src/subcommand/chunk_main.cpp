@@ -31,6 +31,7 @@ void help_chunk(char** argv) {
          << "options:" << endl
          << "    -x, --xg-name FILE       use this xg index to chunk subgraphs" << endl
          << "    -a, --gam-index FILE     chunk this gam index (made with vg index -a) instead of the graph" << endl
+         << "                             (or a sorted gam with a FILE.gai index made with vg gamsort -i)" << endl
          << "    -g, --gam-and-graph      when used in combination with -a, both gam and graph will be chunked" << endl 
          << "path chunking:" << endl
          << "    -p, --path TARGET        write the chunk in the specified (0-based inclusive)\n"
@@ -269,8 +270,17 @@ int main_chunk(int argc, char** argv) {
 
     // This holds the RocksDB index that has all our reads, indexed by the nodes they visit.
     Index gam_index;
+    // Or, if we were given a sorted GAM with a sidecar index, we use that instead.
+    GAMIndex sorted_gam_index;
+    bool use_sorted_gam = false;
     if (chunk_gam) {
-        gam_index.open_read_only(gam_file);
+        ifstream sorted_gam_index_in(gam_file + ".gai");
+        if (sorted_gam_index_in) {
+            sorted_gam_index.load(sorted_gam_index_in);
+            use_sorted_gam = true;
+        } else {
+            gam_index.open_read_only(gam_file);
+        }
     }
     
     // parse the regions into a list
@@ -423,8 +433,9 @@ int main_chunk(int argc, char** argv) {
         chunker.xg = &xindex;
     }
 
-    // extract chunks in parallel
-#pragma omp parallel for
+    // extract chunks in parallel, writing each one out as soon as it is done.
+    // Chunks vary a lot in size, so threads take them one at a time.
+#pragma omp parallel for schedule(dynamic,1)
     for (int i = 0; i < num_regions; ++i) {
         int tid = omp_get_thread_num();
         Region& region = regions[i];
@@ -500,7 +511,17 @@ int main_chunk(int argc, char** argv) {
                 cerr << "error[vg chunk]: can't open output gam file " << gam_name << endl;
                 exit(1);
             }
-            if (subgraph != NULL) {
+            if (use_sorted_gam && subgraph != NULL) {
+                chunker.extract_gam_for_subgraph(*subgraph, sorted_gam_index, gam_file,
+                                                 &out_gam_file, fully_contained);
+            } else if (use_sorted_gam) {
+                vector<vg::id_t> region_id_range;
+                for (vg::id_t id = region.start; id <= region.end; ++id) {
+                    region_id_range.push_back(id);
+                }
+                chunker.extract_gam_for_ids(region_id_range, sorted_gam_index, gam_file,
+                                            &out_gam_file, fully_contained);
+            } else if (subgraph != NULL) {
                 chunker.extract_gam_for_subgraph(*subgraph, gam_index, &out_gam_file,
                                                  fully_contained, search_all_positions);
             } else {
@@ -9,11 +9,13 @@
 #include <getopt.h>
 
 #include <iostream>
+#include <fstream>
 
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
 #include "../index.hpp"
+#include "../stream.hpp"
 
 using namespace std;
 using namespace vg;
@@ -26,9 +28,188 @@ void help_compare(char** argv) {
         << "options:" << endl
         << "    -d, --db-name1 FILE  use this db for graph1 (defaults to <graph1>.index/)" << endl
         << "    -e, --db-name2 FILE  use this db for graph2 (defaults to <graph1>.index/)" << endl
+        << "    -g, --graphs         compare the nodes and edges of two .vg graphs, which must be" << endl
+        << "                         sorted by node id (see vg ids -s), instead of kmer indexes" << endl
+        << "    -D, --diffs FILE     with -g, write a TSV record for each node or edge that differs" << endl
         << "    -t, --threads N      number of threads to use" << endl;
 }
 
+/// One side of an edge, as a node ID and whether it is the end of the node
+using edge_side_t = pair<id_t, bool>;
+/// An edge as its two sides, in sorted order
+using edge_sides_t = pair<edge_side_t, edge_side_t>;
+
+/**
+ * Reads the nodes and edges of a graph sorted by node ID a chunk at a time,
+ * keeping only the ones that have not been compared yet. Node sequences are
+ * kept as hashes. Edges are kept under the lower of the IDs they touch, which
+ * is the node whose chunk they are serialized in.
+ */
+struct SortedGraphReader {
+    SortedGraphReader(const string& filename) : filename(filename), in(filename), chunks(in) {
+        if (!in) {
+            cerr << "error:[vg compare] could not open " << filename << endl;
+            exit(1);
+        }
+    }
+    
+    /// Read the next chunk. Returns false if there are none left.
+    bool read_chunk() {
+        if (!chunks.has_next()) {
+            done = true;
+            return false;
+        }
+        Graph chunk = *chunks;
+        chunks.get_next();
+        
+        // Hash the sequences on all threads
+        vector<size_t> hashes(chunk.node_size());
+#pragma omp parallel for
+        for (size_t i = 0; i < chunk.node_size(); i++) {
+            hashes[i] = std::hash<string>()(chunk.node(i).sequence());
+        }
+        for (size_t i = 0; i < chunk.node_size(); i++) {
+            id_t id = chunk.node(i).id();
+            if (id <= read_through) {
+                cerr << "error:[vg compare] nodes in " << filename << " are not sorted by id at node "
+                     << id << "; sort it with vg ids -s first" << endl;
+                exit(1);
+            }
+            read_through = id;
+            nodes[id] = hashes[i];
+        }
+        for (size_t i = 0; i < chunk.edge_size(); i++) {
+            const Edge& edge = chunk.edge(i);
+            edge_sides_t sides = minmax(edge_side_t(edge.from(), !edge.from_start()),
+                                        edge_side_t(edge.to(), edge.to_end()));
+            edges[sides.first.first].insert(sides);
+        }
+        return true;
+    }
+    
+    /// How far through the IDs we have read, counting everything once we are done
+    id_t frontier() const {
+        return done ? numeric_limits<id_t>::max() : read_through;
+    }
+    
+    string filename;
+    ifstream in;
+    stream::ProtobufIterator<Graph> chunks;
+    bool done = false;
+    id_t read_through = 0;
+    map<id_t, size_t> nodes;
+    map<id_t, set<edge_sides_t>> edges;
+};
+
+/// Compare two graphs that are sorted by node ID, holding only the chunks that
+/// are being compared in memory, and print the summary as JSON.
+void compare_sorted_graphs(const string& filename1, const string& filename2, ostream* diffs) {
+    SortedGraphReader graph1(filename1);
+    SortedGraphReader graph2(filename2);
+    
+    size_t nodes1 = 0, nodes2 = 0, nodes_shared = 0, nodes_changed = 0, nodes_only1 = 0, nodes_only2 = 0;
+    size_t edges1 = 0, edges2 = 0, edges_shared = 0, edges_only1 = 0, edges_only2 = 0;
+    
+    auto report_edge = [&](const edge_sides_t& sides, const string& which) {
+        if (diffs != nullptr) {
+            *diffs << "edge\t" << sides.first.first << "\t" << (sides.first.second ? "end" : "start")
+                   << "\t" << sides.second.first << "\t" << (sides.second.second ? "end" : "start")
+                   << "\t" << which << "\n";
+        }
+    };
+    
+    // Compare everything up to the given ID, which both graphs have read past
+    auto compare_through = [&](id_t frontier) {
+        auto n1 = graph1.nodes.begin();
+        auto n2 = graph2.nodes.begin();
+        while ((n1 != graph1.nodes.end() && n1->first <= frontier) ||
+               (n2 != graph2.nodes.end() && n2->first <= frontier)) {
+            bool have1 = n1 != graph1.nodes.end() && n1->first <= frontier;
+            bool have2 = n2 != graph2.nodes.end() && n2->first <= frontier;
+            if (have1 && (!have2 || n1->first < n2->first)) {
+                nodes1++;
+                nodes_only1++;
+                if (diffs != nullptr) *diffs << "node\t" << n1->first << "\tgraph1\n";
+                n1 = graph1.nodes.erase(n1);
+            } else if (have2 && (!have1 || n2->first < n1->first)) {
+                nodes2++;
+                nodes_only2++;
+                if (diffs != nullptr) *diffs << "node\t" << n2->first << "\tgraph2\n";
+                n2 = graph2.nodes.erase(n2);
+            } else {
+                nodes1++;
+                nodes2++;
+                if (n1->second == n2->second) {
+                    nodes_shared++;
+                } else {
+                    nodes_changed++;
+                    if (diffs != nullptr) *diffs << "node\t" << n1->first << "\tsequence\n";
+                }
+                n1 = graph1.nodes.erase(n1);
+                n2 = graph2.nodes.erase(n2);
+            }
+        }
+        
+        auto e1 = graph1.edges.begin();
+        auto e2 = graph2.edges.begin();
+        static const set<edge_sides_t> no_edges;
+        while ((e1 != graph1.edges.end() && e1->first <= frontier) ||
+               (e2 != graph2.edges.end() && e2->first <= frontier)) {
+            bool have1 = e1 != graph1.edges.end() && e1->first <= frontier;
+            bool have2 = e2 != graph2.edges.end() && e2->first <= frontier;
+            // Compare the edges kept under the lowest ID either graph has left
+            id_t owner = !have2 || (have1 && e1->first < e2->first) ? e1->first : e2->first;
+            const set<edge_sides_t>& set1 = have1 && e1->first == owner ? e1->second : no_edges;
+            const set<edge_sides_t>& set2 = have2 && e2->first == owner ? e2->second : no_edges;
+            edges1 += set1.size();
+            edges2 += set2.size();
+            for (auto& sides : set1) {
+                if (set2.count(sides)) {
+                    edges_shared++;
+                } else {
+                    edges_only1++;
+                    report_edge(sides, "graph1");
+                }
+            }
+            for (auto& sides : set2) {
+                if (!set1.count(sides)) {
+                    edges_only2++;
+                    report_edge(sides, "graph2");
+                }
+            }
+            if (have1 && e1->first == owner) e1 = graph1.edges.erase(e1);
+            if (have2 && e2->first == owner) e2 = graph2.edges.erase(e2);
+        }
+    };
+    
+    while (!graph1.done || !graph2.done) {
+        // Read from whichever graph is behind
+        if (!graph1.done && (graph2.done || graph1.read_through <= graph2.read_through)) {
+            graph1.read_chunk();
+        } else {
+            graph2.read_chunk();
+        }
+        compare_through(min(graph1.frontier(), graph2.frontier()));
+    }
+    compare_through(numeric_limits<id_t>::max());
+    
+    cout << "{\n"
+         << "\"graph1_path\": " << "\"" << filename1 << "\"" << ",\n"
+         << "\"graph2_path\": " << "\"" << filename2 << "\"" << ",\n"
+         << "\"graph1_nodes\": " << nodes1 << ",\n"
+         << "\"graph2_nodes\": " << nodes2 << ",\n"
+         << "\"nodes_shared\": " << nodes_shared << ",\n"
+         << "\"nodes_changed\": " << nodes_changed << ",\n"
+         << "\"nodes_only1\": " << nodes_only1 << ",\n"
+         << "\"nodes_only2\": " << nodes_only2 << ",\n"
+         << "\"graph1_edges\": " << edges1 << ",\n"
+         << "\"graph2_edges\": " << edges2 << ",\n"
+         << "\"edges_shared\": " << edges_shared << ",\n"
+         << "\"edges_only1\": " << edges_only1 << ",\n"
+         << "\"edges_only2\": " << edges_only2 << "\n"
+         << "}" << endl;
+}
+
 int main_compare(int argc, char** argv) {
 
     if (argc <= 3) {
@@ -38,6 +219,8 @@ int main_compare(int argc, char** argv) {
 
     string db_name1;
     string db_name2;
+    bool compare_graphs = false;
+    string diffs_name;
     int num_threads = 1;
 
     int c;
@@ -48,12 +231,14 @@ int main_compare(int argc, char** argv) {
             {"help", no_argument, 0, 'h'},
             {"db-name1", required_argument, 0, 'd'},
             {"db-name2", required_argument, 0, 'e'},
+            {"graphs", no_argument, 0, 'g'},
+            {"diffs", required_argument, 0, 'D'},
             {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hd:e:t:",
+        c = getopt_long (argc, argv, "hd:e:gD:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -71,6 +256,14 @@ int main_compare(int argc, char** argv) {
                 db_name2 = optarg;
                 break;
 
+            case 'g':
+                compare_graphs = true;
+                break;
+
+            case 'D':
+                diffs_name = optarg;
+                break;
+
             case 't':
                 num_threads = atoi(optarg);
                 break;
@@ -88,6 +281,25 @@ int main_compare(int argc, char** argv) {
 
     omp_set_num_threads(num_threads);
 
+    if (compare_graphs) {
+        string graph1_name = get_input_file_name(optind, argc, argv);
+        string graph2_name = get_input_file_name(optind, argc, argv);
+        ofstream diffs;
+        if (!diffs_name.empty()) {
+            diffs.open(diffs_name);
+            if (!diffs) {
+                cerr << "error:[vg compare] could not open " << diffs_name << endl;
+                exit(1);
+            }
+        }
+        compare_sorted_graphs(graph1_name, graph2_name, diffs_name.empty() ? nullptr : &diffs);
+        return 0;
+    }
+    if (!diffs_name.empty()) {
+        cerr << "error:[vg compare] -D only works when comparing graphs with -g" << endl;
+        exit(1);
+    }
+
     if (db_name1.empty()) {
         db_name1 = get_input_file_name(optind, argc, argv);
     }
@@ -144,5 +356,5 @@ int main_compare(int argc, char** argv) {
 }
 
 // Register subcommand
-static Subcommand vg_compare("compare", "compare the kmer space of two graphs", main_compare);
+static Subcommand vg_compare("compare", "compare the kmer space or the nodes and edges of two graphs", main_compare);
 
@@ -13,6 +13,7 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../graph_stream_merge.hpp"
 
 using namespace std;
 using namespace vg;
@@ -22,7 +23,8 @@ void help_concat(char** argv) {
     cerr << "usage: " << argv[0] << " concat [options] <graph1.vg> [graph2.vg ...] >merged.vg" << endl
         << "Concatenates graphs in order by adding edges from the tail nodes of the" << endl
         << "predecessor to the head nodes of the following graph. Node IDs are" << endl
-        << "compacted, so care should be taken if consistent IDs are required." << endl;
+        << "offset past those of the preceding graphs, so care should be taken if" << endl
+        << "consistent IDs are required." << endl;
 }
 
 int main_concat(int argc, char** argv) {
@@ -62,23 +64,13 @@ int main_concat(int argc, char** argv) {
         }
     }
 
-    list<VG*> graphs;
-
+    vector<string> file_names;
     while (optind < argc) {
-        VG* graph;
-        get_input_file(optind, argc, argv, [&](istream& in) {
-            graph = new VG(in);
-        });
-        graphs.push_back(graph);
-    }
-
-    VG merged;
-    for (list<VG*>::iterator g = graphs.begin(); g != graphs.end(); ++g) {
-        merged.append(**g);
+        file_names.push_back(get_input_file_name(optind, argc, argv));
     }
 
-    // output
-    merged.serialize_to_ostream(std::cout);
+    // Pass the graphs' chunks straight through to the output
+    concat_graph_files(file_names, std::cout);
 
     return 0;
 }
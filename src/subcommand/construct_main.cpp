@@ -282,6 +282,12 @@ int main_construct(int argc, char** argv) {
         exit(1);
     }
 
+    // Build a couple of chunks per thread at a time, so the threads stay busy
+    // while finished chunks are wired up and written out in order.
+    constructor.chunks_in_flight = omp_get_max_threads() * 2;
+    // And parse the VCFs in the background while we do it.
+    constructor.vcf_prefetch = 256;
+
     // Construct the graph.
     constructor.construct_graph(fasta_pointers, vcf_pointers,
                                 ins_pointers, callback);
@@ -13,6 +13,8 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../xg.hpp"
+#include "../snarl_index.hpp"
 #include "../deconstructor.hpp"
 
 using namespace std;
@@ -21,9 +23,13 @@ using namespace vg::subcommand;
 
 void help_deconstruct(char** argv){
     cerr << "usage: " << argv[0] << " deconstruct [options] -p <PATH> <my_graph>.vg" << endl
+         << "       " << argv[0] << " deconstruct [options] -p <PATH> -x <my_graph>.xg -r <my_graph>.snarls" << endl
          << "Outputs VCF records for Snarls present in a graph (relative to a chosen reference path)." << endl
          << "options: " << endl
          << "--path / -p     REQUIRED: A reference path to deconstruct against." << endl
+         << "--xg / -x       use this XG index instead of a vg graph" << endl
+         << "--snarls / -r   use these snarls (or snarl index) from vg snarls (required with -x)" << endl
+         << "--threads / -t  number of threads to use" << endl
          << endl;
 }
 
@@ -37,6 +43,8 @@ int main_deconstruct(int argc, char** argv){
     vector<string> refpaths;
     string graphname;
     string outfile = "";
+    string xg_name;
+    string snarls_name;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -45,12 +53,15 @@ int main_deconstruct(int argc, char** argv){
             {
                 {"help", no_argument, 0, 'h'},
                 {"path", required_argument, 0, 'p'},
+                {"xg", required_argument, 0, 'x'},
+                {"snarls", required_argument, 0, 'r'},
+                {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}
 
             };
 
             int option_index = 0;
-            c = getopt_long (argc, argv, "hp:",
+            c = getopt_long (argc, argv, "hp:x:r:t:",
                     long_options, &option_index);
 
             // Detect the end of the options.
@@ -62,6 +73,15 @@ int main_deconstruct(int argc, char** argv){
                 case 'p':
                     refpaths = split(optarg, ",");
                     break;
+                case 'x':
+                    xg_name = optarg;
+                    break;
+                case 'r':
+                    snarls_name = optarg;
+                    break;
+                case 't':
+                    omp_set_num_threads(atoi(optarg));
+                    break;
                 case '?':
                 case 'h':
                     help_deconstruct(argv);
@@ -72,6 +92,51 @@ int main_deconstruct(int argc, char** argv){
             }
 
         }
+        if (!xg_name.empty()) {
+            if (snarls_name.empty()) {
+                cerr << "error:[vg deconstruct] Snarls (-r) are required to deconstruct an XG index" << endl;
+                return 1;
+            }
+            
+            // load the index and the snarls
+            xg::XG xg_index;
+            xg_index.load_mapped(xg_name);
+            for (auto& refpath : refpaths) {
+                if (xg_index.path_rank(refpath) == 0) {
+                    cerr << "error:[vg deconstruct] Path " << refpath << " is not in the XG index" << endl;
+                    return 1;
+                }
+            }
+            
+            SnarlManager* snarl_manager;
+            if (SnarlIndex::is_snarl_index(snarls_name)) {
+                // Load the precomputed tree and chains from a binary snarl index
+                SnarlIndex snarl_index(snarls_name);
+                if (!snarl_index.is_valid()) {
+                    cerr << "error:[vg deconstruct] Snarl index " << snarls_name << " is corrupt or from another version" << endl;
+                    return 1;
+                }
+                snarl_manager = new SnarlManager(snarl_index.to_snarl_manager());
+            } else {
+                ifstream snarl_stream(snarls_name);
+                if (!snarl_stream) {
+                    cerr << "error:[vg deconstruct] Cannot open Snarls file " << snarls_name << endl;
+                    return 1;
+                }
+                snarl_manager = new SnarlManager(snarl_stream);
+            }
+            
+            // Deconstruct
+            Deconstructor dd;
+            dd.deconstruct(refpaths, &xg_index, *snarl_manager);
+            delete snarl_manager;
+            return 0;
+        }
+        
+        if (optind >= argc) {
+            help_deconstruct(argv);
+            return 1;
+        }
         graphname = argv[optind];
         vg::VG* graph;
         if (!graphname.empty()){
@@ -23,7 +23,7 @@ void help_explode(char** argv) {
          << endl
          << "options:" << endl
          << "general:" << endl
-         << "    -t, --threads N          for tasks that can be done in parallel, use this many threads [1]" << endl
+         << "    -t, --threads N          decode the graph and write components with this many threads [1]" << endl
          << "    -h, --help" << endl;
 }
 
@@ -59,7 +59,7 @@ int main_explode(int argc, char** argv) {
         {
 
         case 't':
-            omp_set_num_threads(atoi(optarg));
+            threads = atoi(optarg);
             break;
 
         case 'h':
@@ -71,9 +71,70 @@ int main_explode(int argc, char** argv) {
         }
     }
 
-    VG* graph;
+    omp_set_num_threads(threads);
+
+    // We don't load the graph into a VG. We just keep its nodes, edges and
+    // path mappings, and work out which component everything is in.
+    vector<Node> nodes;
+    vector<Edge> edges;
+    // Path mappings, with the index of the path name they belong to
+    vector<pair<size_t, Mapping>> mappings;
+    vector<string> path_names;
+    map<string, size_t> path_name_index;
+    
+    // Read the chunks, decoding a batch of them in parallel at a time
+    size_t batch_size = 16 * get_thread_count();
+    vector<stream::SerializedMessage> serialized;
+    vector<Graph> chunks;
+    auto take_batch = [&]() {
+        chunks.resize(serialized.size());
+        bool parsed = true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < serialized.size(); i++) {
+            if (!chunks[i].ParseFromString(serialized[i].bytes)) {
+                parsed = false;
+            }
+            string().swap(serialized[i].bytes);
+        }
+        if (!parsed) {
+            cerr << "error:[vg explode] could not parse graph chunk" << endl;
+            exit(1);
+        }
+        for (auto& chunk : chunks) {
+            for (size_t i = 0; i < chunk.node_size(); i++) {
+                nodes.emplace_back();
+                nodes.back().Swap(chunk.mutable_node(i));
+            }
+            for (size_t i = 0; i < chunk.edge_size(); i++) {
+                edges.emplace_back();
+                edges.back().Swap(chunk.mutable_edge(i));
+            }
+            for (size_t i = 0; i < chunk.path_size(); i++) {
+                Path* path = chunk.mutable_path(i);
+                auto found = path_name_index.find(path->name());
+                if (found == path_name_index.end()) {
+                    found = path_name_index.emplace(path->name(), path_names.size()).first;
+                    path_names.push_back(path->name());
+                }
+                for (size_t j = 0; j < path->mapping_size(); j++) {
+                    mappings.emplace_back(found->second, Mapping());
+                    mappings.back().second.Swap(path->mutable_mapping(j));
+                }
+            }
+        }
+        serialized.clear();
+        chunks.clear();
+    };
     get_input_file(optind, argc, argv, [&](istream& in) {
-        graph = new VG(in);
+        function<void(stream::SerializedMessage&)> lambda = [&](stream::SerializedMessage& message) {
+            serialized.emplace_back();
+            serialized.back().bytes.swap(message.bytes);
+            if (serialized.size() == batch_size) {
+                take_batch();
+            }
+        };
+        stream::for_each(in, lambda);
+        take_batch();
     });
 
     // Grab the directory name to put stuff in
@@ -83,75 +144,126 @@ int main_explode(int argc, char** argv) {
     mkdir(output_dir.c_str(), 0755);
     // Ignore failure
     
-    // Now we explode the VG
+    // Now we explode the graph. Find the connected components with union-find
+    // over the nodes, in the order they are stored. Duplicate nodes count once.
+    hash_map<id_t, size_t> node_number;
+    node_number.resize(nodes.size());
+    vector<size_t> parent;
+    parent.reserve(nodes.size());
+    vector<bool> first_copy(nodes.size(), false);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (node_number.find(nodes[i].id()) == node_number.end()) {
+            node_number[nodes[i].id()] = parent.size();
+            parent.push_back(parent.size());
+            first_copy[i] = true;
+        }
+    }
+    auto find_root = [&](size_t x) {
+        while (parent[x] != x) {
+            // halve the path as we go
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+    auto number_of = [&](id_t id) -> int64_t {
+        auto found = node_number.find(id);
+        return found == node_number.end() ? -1 : (int64_t) found->second;
+    };
+    for (auto& edge : edges) {
+        int64_t from = number_of(edge.from());
+        int64_t to = number_of(edge.to());
+        if (from != -1 && to != -1) {
+            size_t from_root = find_root(from);
+            size_t to_root = find_root(to);
+            if (from_root != to_root) {
+                // keep the earlier node as the root, so roots are stable
+                parent[max(from_root, to_root)] = min(from_root, to_root);
+            }
+        }
+    }
     
-    // Count through the components we build
-    size_t component_index = 0;
+    // Number the components in the order their first nodes are stored
+    vector<size_t> component_of(parent.size());
+    vector<size_t> component_of_root(parent.size(), numeric_limits<size_t>::max());
+    size_t component_count = 0;
+    for (size_t i = 0; i < parent.size(); i++) {
+        size_t root = find_root(i);
+        if (component_of_root[root] == numeric_limits<size_t>::max()) {
+            component_of_root[root] = component_count++;
+        }
+        component_of[i] = component_of_root[root];
+    }
     
-    // Track all the nodes we've already assigned to subgraphs
-    set<Node*> used;
+    // Group everything by component. Edges go with a node they touch, and
+    // mappings with the node they visit. Anything dangling is dropped.
+    vector<vector<size_t>> component_nodes(component_count);
+    vector<vector<size_t>> component_edges(component_count);
+    vector<vector<size_t>> component_mappings(component_count);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (first_copy[i]) {
+            component_nodes[component_of[node_number[nodes[i].id()]]].push_back(i);
+        }
+    }
+    for (size_t i = 0; i < edges.size(); i++) {
+        int64_t number = number_of(edges[i].from());
+        if (number == -1) {
+            number = number_of(edges[i].to());
+        }
+        if (number != -1) {
+            component_edges[component_of[number]].push_back(i);
+        }
+    }
+    for (size_t i = 0; i < mappings.size(); i++) {
+        int64_t number = number_of(mappings[i].second.position().node_id());
+        if (number != -1) {
+            component_mappings[component_of[number]].push_back(i);
+        }
+    }
     
-    graph->for_each_node([&](Node* start) {
-        if (!used.count(start)) {
-            // It's a new connected component!
-            VG component;
-            
-            // We want to track the path names in each component
-            set<string> path_names;
-            
-            graph->for_each_connected_node(start, [&](Node* n) {
-                // Mark this connected node as used in a component.
-                used.insert(n);
-                
-                // Copy node over
-                component.create_node(n->sequence(), n->id());
-                
-                // Copy over its edges
-                for (auto* e : graph->edges_of(n)) {
-                    component.add_edge(*e);
-                }
-                
-                // Copy paths over
-                for (auto& path : graph->paths.get_node_mapping(n)) {
-                    // Some paths might not actually touch this node at all.
-                    bool nonempty = false;
-                    for (auto& m : path.second) {
-                        component.paths.append_mapping(path.first, *m);
-                        nonempty = true;
-                    }
-                    if (nonempty) {
-                        // This path had mappings, so it qualifies for the component
-                        path_names.insert(path.first);
-                    }
-                }
-            });
-            
-            // We inserted mappings into the component in more or less arbitrary
-            // order, so sort them by rank.
-            component.paths.sort_by_mapping_rank();
-            // Then rebuild the other path indexes
-            component.paths.rebuild_mapping_aux();
-            
-            // Save the component
-            string filename = output_dir + "/component" + to_string(component_index) + ".vg";
-            
-            // Now report what paths went into the component in parseable TSV
-            cout << filename;
-            for (auto& path_name : path_names) {
-                cout << "\t" << path_name;
-            }
-            cout << endl;
-            
-            component.serialize_to_file(filename);
-            
-            
-            
-            component_index++;
+    // Each thread builds and writes whole components, and we report them in
+    // order in parseable TSV: the file and then the paths that went into it.
+    vector<string> reports(component_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c = 0; c < component_count; c++) {
+        VG component;
+        
+        for (auto i : component_nodes[c]) {
+            // Copy node over
+            component.create_node(nodes[i].sequence(), nodes[i].id());
         }
-    });
+        for (auto i : component_edges[c]) {
+            component.add_edge(edges[i]);
+        }
+        
+        // We want to track the path names in each component
+        set<string> component_path_names;
+        for (auto i : component_mappings[c]) {
+            const string& path_name = path_names[mappings[i].first];
+            component.paths.append_mapping(path_name, mappings[i].second);
+            component_path_names.insert(path_name);
+        }
+        
+        // We inserted mappings into the component in more or less arbitrary
+        // order, so sort them by rank.
+        component.paths.sort_by_mapping_rank();
+        // Then rebuild the other path indexes
+        component.paths.rebuild_mapping_aux();
+        
+        // Save the component
+        string filename = output_dir + "/component" + to_string(c) + ".vg";
+        component.serialize_to_file(filename);
+        
+        stringstream report;
+        report << filename;
+        for (auto& path_name : component_path_names) {
+            report << "\t" << path_name;
+        }
+        reports[c] = report.str();
+    }
     
-    if (graph != nullptr) {
-        delete graph;
+    for (auto& report : reports) {
+        cout << report << endl;
     }
     
     return 0;
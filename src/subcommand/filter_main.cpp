@@ -42,6 +42,7 @@ void help_filter(char** argv) {
          << "    -E, --repeat-ends N     filter reads with tandem repeat (motif size <= 2N, spanning >= N bases) at either end" << endl
          << "    -D, --defray-ends N     clip back the ends of reads that are ambiguously aligned, up to N bases" << endl
          << "    -C, --defray-count N    stop defraying after N nodes visited (used to keep runtime in check) [default=99999]" << endl
+         << "    -L, --lazy-parse        only parse the fields the filters use, and copy kept reads through unchanged" << endl
          << "    -t, --threads N         number of threads [1]" << endl;
 }
 
@@ -83,12 +84,13 @@ int main_filter(int argc, char** argv) {
                 {"repeat-ends", required_argument, 0, 'E'},
                 {"defray-ends", required_argument, 0, 'D'},
                 {"defray-count", required_argument, 0, 'C'},
+                {"lazy-parse", no_argument, 0, 'L'},
                 {"threads", required_argument, 0, 't'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "s:r:d:e:fauo:m:Sx:R:B:Ac:vq:E:D:C:t:",
+        c = getopt_long (argc, argv, "s:r:d:e:fauo:m:Sx:R:B:Ac:vq:E:D:C:Lt:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -147,6 +149,9 @@ int main_filter(int argc, char** argv) {
         case 'C':
             filter.defray_count = atoi(optarg);
             break;          
+        case 'L':
+            filter.lazy_parse = true;
+            break;
         case 't':
             filter.threads = atoi(optarg);
             break;
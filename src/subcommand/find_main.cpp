@@ -3,6 +3,8 @@
 #include "../utility.hpp"
 #include "../mapper.hpp"
 #include "../stream.hpp"
+#include "../gam_index.hpp"
+#include "../region.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -28,11 +30,16 @@ void help_find(char** argv) {
          << "    -X, --approx-pos ID    get the approximate position of this node" << endl
          << "    -r, --node-range N:M   get nodes from N to M" << endl
          << "    -G, --gam GAM          accumulate the graph touched by the alignments in the GAM" << endl
+         << "batch queries: (xg only)" << endl
+         << "    -E, --batch-bed FILE   write the subgraph of each (0-based end-exclusive) BED region as its own chunk" << endl
+         << "    -I, --batch-ids FILE   write the context of each node in this white space or line delimited list as its own chunk" << endl
+         << "    --threads N            answer batch queries with N threads, keeping the output in input order" << endl
          << "alignments: (rocksdb only)" << endl
          << "    -a, --alignments       writes alignments from index, sorted by node id" << endl
          << "    -i, --alns-in N:M      writes alignments whose start nodes is between N and M (inclusive)" << endl
          << "    -o, --alns-on N:M      writes alignments which align to any of the nodes between N and M (inclusive)" << endl
          << "    -A, --to-graph VG      get alignments to the provided subgraph" << endl
+         << "    -l, --sorted-gam GAM   use this sorted GAM, indexed with vg gamsort -i, for -o instead of rocksdb" << endl
          << "sequences:" << endl
          << "    -g, --gcsa FILE        use this GCSA2 index of the sequence space of the graph" << endl
          << "    -z, --kmer-size N      split up --sequence into kmers of size N" << endl
@@ -57,6 +64,8 @@ void help_find(char** argv) {
 
 int main_find(int argc, char** argv) {
 
+    const int OPT_THREADS = 1000;
+
     if (argc == 2) {
         help_find(argv);
         return 1;
@@ -95,9 +104,12 @@ int main_find(int argc, char** argv) {
     int max_mem_length = 0;
     int min_mem_length = 1;
     string to_graph_file;
+    string sorted_gam_name;
     bool extract_threads = false;
     vector<string> extract_patterns;
     vg::id_t approx_id = 0;
+    string batch_bed_file;
+    string batch_ids_file;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -125,6 +137,9 @@ int main_find(int argc, char** argv) {
                 {"kmer-count", no_argument, 0, 'C'},
                 {"path", required_argument, 0, 'p'},
                 {"position-in", required_argument, 0, 'P'},
+                {"batch-bed", required_argument, 0, 'E'},
+                {"batch-ids", required_argument, 0, 'I'},
+                {"threads", required_argument, 0, OPT_THREADS},
                 {"rank-in", required_argument, 0, 'R'},
                 {"node-range", required_argument, 0, 'r'},
                 {"alignments", no_argument, 0, 'a'},
@@ -135,6 +150,7 @@ int main_find(int argc, char** argv) {
                 {"haplotypes", required_argument, 0, 'H'},
                 {"gam", required_argument, 0, 'G'},
                 {"to-graph", required_argument, 0, 'A'},
+                {"sorted-gam", required_argument, 0, 'l'},
                 {"max-mem", required_argument, 0, 'Y'},
                 {"min-mem", required_argument, 0, 'Z'},
                 {"extract-threads", no_argument, 0, 't'},
@@ -144,7 +160,7 @@ int main_find(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:",
+        c = getopt_long (argc, argv, "d:x:n:e:s:o:k:hc:LS:z:j:CTp:P:r:amg:M:R:B:fi:DH:G:N:A:Y:Z:tq:X:l:E:I:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -297,6 +313,22 @@ int main_find(int argc, char** argv) {
             to_graph_file = optarg;
             break;
 
+        case 'l':
+            sorted_gam_name = optarg;
+            break;
+
+        case 'E':
+            batch_bed_file = optarg;
+            break;
+
+        case 'I':
+            batch_ids_file = optarg;
+            break;
+
+        case OPT_THREADS:
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_find(argv);
@@ -322,6 +354,11 @@ int main_find(int argc, char** argv) {
         exit(1);
     }
     
+    if (xg_name.empty() && (!batch_bed_file.empty() || !batch_ids_file.empty())) {
+        cerr << "error:[vg find] Batch queries (-E, -I) require an XG index. Provide XG index with -x." << endl;
+        exit(1);
+    }
+    
     if (xg_name.empty() && mem_reseed_length) {
         cerr << "error:[vg find] SMEM reseeding requires an XG index. Provide XG index with -x." << endl;
         exit(1);
@@ -347,7 +384,7 @@ int main_find(int argc, char** argv) {
     // open index
     Index* vindex = nullptr;
     if (db_name.empty()) {
-        assert(!gcsa_in.empty() || !xg_name.empty());
+        assert(!gcsa_in.empty() || !xg_name.empty() || !sorted_gam_name.empty());
     } else {
         vindex = new Index;
         vindex->open_read_only(db_name);
@@ -389,7 +426,33 @@ int main_find(int argc, char** argv) {
         stream::write_buffered(cout, output_buf, 0);
     }
 
-    if (!aln_on_id_range.empty()) {
+    if (!aln_on_id_range.empty() && !sorted_gam_name.empty()) {
+        // Seek straight to the reads with the sorted GAM's index
+        vector<string> parts = split_delims(aln_on_id_range, ":");
+        if (parts.size() == 1) {
+            convert(parts.front(), start_id);
+            end_id = start_id;
+        } else {
+            convert(parts.front(), start_id);
+            convert(parts.back(), end_id);
+        }
+        ifstream gam_in(sorted_gam_name);
+        ifstream index_in(sorted_gam_name + ".gai");
+        if (!gam_in || !index_in) {
+            cerr << "[vg find] error: could not open sorted GAM " << sorted_gam_name
+                 << " and its index " << sorted_gam_name << ".gai" << endl;
+            exit(1);
+        }
+        GAMIndex gam_index;
+        gam_index.load(index_in);
+        vector<Alignment> output_buf;
+        auto lambda = [&output_buf](const Alignment& aln) {
+            output_buf.push_back(aln);
+            stream::write_buffered(cout, output_buf, 100);
+        };
+        gam_index.for_alignment_in_range(gam_in, start_id, end_id, lambda);
+        stream::write_buffered(cout, output_buf, 0);
+    } else if (!aln_on_id_range.empty()) {
         assert(!db_name.empty());
         vector<string> parts = split_delims(aln_on_id_range, ":");
         if (parts.size() == 1) {
@@ -553,6 +616,69 @@ int main_find(int argc, char** argv) {
             vgg.remove_orphan_edges();
             vgg.serialize_to_ostream(cout);
         }
+        if (!batch_bed_file.empty() || !batch_ids_file.empty()) {
+            // Answer each query on its own, so they can go in parallel, and
+            // write each subgraph as its own chunk in the order we read them
+            vector<Region> regions;
+            if (!batch_bed_file.empty()) {
+                parse_bed_regions(batch_bed_file, regions);
+                for (auto& region : regions) {
+                    if (xindex.path_rank(region.seq) == 0) {
+                        cerr << "[vg find] error, path " << region.seq << " not found in index" << endl;
+                        exit(1);
+                    }
+                }
+            }
+            vector<vg::id_t> batch_ids;
+            if (!batch_ids_file.empty()) {
+                ifstream in(batch_ids_file);
+                if (!in.good()) {
+                    cerr << "[vg find] error, unable to open the batch node list input file." << endl;
+                    exit(1);
+                }
+                string line;
+                while (getline(in, line)) {
+                    for (auto& idstr : split_delims(line, " \t")) {
+                        batch_ids.push_back(atol(idstr.c_str()));
+                    }
+                }
+            }
+            
+            // Only hold the results for this many queries per thread at once
+            size_t query_count = regions.size() + batch_ids.size();
+            size_t batch_size = 64 * get_thread_count();
+            vector<string> results;
+            for (size_t batch_start = 0; batch_start < query_count; batch_start += batch_size) {
+                size_t batch_end = min(query_count, batch_start + batch_size);
+                results.clear();
+                results.resize(batch_end - batch_start);
+#pragma omp parallel for schedule(dynamic, 1)
+                for (size_t i = batch_start; i < batch_end; i++) {
+                    Graph graph;
+                    if (i < regions.size()) {
+                        // Grab the region, like -p
+                        auto& region = regions[i];
+                        xindex.get_path_range(region.seq, region.start, region.end, graph);
+                        if (context_size > 0) {
+                            xindex.expand_context(graph, context_size, true, !use_length);
+                        }
+                    } else {
+                        // Grab the node's context, like -n
+                        xindex.neighborhood(batch_ids[i - regions.size()], context_size, graph, !use_length);
+                    }
+                    VG vgg; vgg.extend(graph); // removes dupes
+                    vgg.remove_orphan_edges();
+                    vgg.paths.sort_by_mapping_rank();
+                    
+                    stringstream result;
+                    vgg.serialize_to_ostream(result);
+                    results[i - batch_start] = result.str();
+                }
+                for (auto& result : results) {
+                    cout << result;
+                }
+            }
+        }
         if(!haplotype_alignments.empty()) {
             // What should we do with each alignment?
             function<void(Alignment&)> lambda = [&xindex](Alignment& aln) {
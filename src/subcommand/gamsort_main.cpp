@@ -19,7 +19,7 @@ void help_gamsort(char **argv)
          << "Options:" << endl
          << "  -p / --paired           Index a paired-end GAM." << endl
          << "  -s / --sorted           Input GAM is already sorted." << endl
-         << "  -i / --index <INDEX>    produce a node-to-alignment index" << endl
+         << "  -i / --index            produce a node-range index (<sorted GAM>.gai) of the sorted GAM" << endl
          << "  -d / --dumb-sort        use naive sorting algorithm (no tmp files, faster for small GAMs)" << endl
          << "  -r / --rocks            Just use the old RocksDB-style indexing scheme for sorting." << endl
          << "  -a / --aln-index        Create the old RocksDB-style node-to-alignment index." << endl
@@ -94,6 +94,12 @@ int main_gamsort(int argc, char **argv)
 
     GAMSorter gs;
 
+    if (do_index && !just_use_rocks && !is_sorted)
+    {
+        // The node-range index points at blocks, so write the sorted GAM in blocks
+        stream::set_output_blocked(true);
+    }
+
     if (just_use_rocks && !do_index)
     {
         // Do the sort the old way - write a big ol'
@@ -124,7 +130,11 @@ int main_gamsort(int argc, char **argv)
         index.close();
     }
 
-    if (dumb_sort)
+    if (is_sorted && do_index && !just_use_rocks)
+    {
+        // Nothing to sort; we just index the GAM we were given
+    }
+    else if (dumb_sort)
     {
         gs.dumb_sort(gamfile);
     }
@@ -161,9 +171,9 @@ int main_gamsort(int argc, char **argv)
     }
     
     else if (do_index){
-        // Write a super simple index file of format
-        // node_d \tab firstAlnLineNumber \tab secondAlnLineNumber ...
-        gs.write_index(gamfile, gamfile + ".gai", false);
+        // Write a GAMIndex of node ranges to block offsets next to the sorted GAM
+        string sorted_gam = is_sorted ? gamfile : gamfile + ".sorted.gam";
+        gs.write_index(sorted_gam, sorted_gam + ".gai", true);
     }
 
     return 1;
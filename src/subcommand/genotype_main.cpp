@@ -4,6 +4,7 @@
 #include "index.hpp"
 #include "stream.hpp"
 #include "genotyper.hpp"
+#include "gam_index.hpp"
 #include "genotypekit.hpp"
 #include "variant_recall.hpp"
 #include "stream.hpp"
@@ -23,6 +24,9 @@ void help_genotype(char** argv) {
          << "    -v, --vcf               output in VCF" << endl
          << "    -G, --gam   GAM         a GAM file to use with variant recall (or in place of index)" << endl
          << "    -V, --recall-vcf VCF    recall variants in a specific VCF file." << endl
+         << "    -X, --recall-xg FILE    with -V, -F and -G, recall against this xg index of the graph" << endl
+         << "                            with the variants' alt paths instead of loading the graph," << endl
+         << "                            streaming the reads and only counting those on the variants" << endl
          << "    -F, --fasta  FASTA" << endl
          << "    -I, --insertions INS" << endl
          << "    -r, --ref PATH          use the given path name as the reference path" << endl
@@ -37,6 +41,10 @@ void help_genotype(char** argv) {
          << "    -d, --het_prior_denom   denominator for prior probability of heterozygousness" << endl
          << "    -P, --min_per_strand    min unique reads per strand for a called allele to accept a call" << endl
          << "    -E, --no_embed          dont embed gam edits into grpah" << endl
+         << "    -x, --stream            stream reads from the sorted GAM given with -G, using its FILE.gai" << endl
+         << "                            index, and genotype in reference order with bounded memory" << endl
+         << "                            (needs -v, and a graph already augmented with the reads)" << endl
+         << "    -w, --window N          with -x, genotype N bp of reference at a time [100000]" << endl
          << "    -p, --progress          show progress" << endl
          << "    -t, --threads N         number of threads to use" << endl;
 }
@@ -76,6 +84,8 @@ int main_genotype(int argc, char** argv) {
     string fasta;
     string insertions_file;
     bool useindex = true;
+    // Should we recall against an xg index instead of the whole graph?
+    string recall_xg;
 
     // Should we use mapping qualities?
     bool use_mapq = false;
@@ -93,6 +103,12 @@ int main_genotype(int argc, char** argv) {
     size_t min_unique_per_strand = 2;
 
     bool just_call = false;
+
+    // Should we stream reads for a window of the reference at a time from a
+    // sorted, indexed GAM?
+    bool stream_reads = false;
+    // How many reference bases should each window cover?
+    size_t window_bases = 100000;
     int c;
     optind = 2; // force optind past command positional arguments
     while (true) {
@@ -114,16 +130,19 @@ int main_genotype(int argc, char** argv) {
                 {"progress", no_argument, 0, 'p'},
                 {"threads", required_argument, 0, 't'},
                 {"recall-vcf", required_argument, 0, 'V'},
+                {"recall-xg", required_argument, 0, 'X'},
                 {"gam", required_argument, 0, 'G'},
                 {"fasta", required_argument, 0, 'F'},
                 {"insertions", required_argument, 0, 'I'},
                 {"call", no_argument, 0, 'z'},
                 {"no_embed", no_argument, 0, 'E'},
+                {"stream", no_argument, 0, 'x'},
+                {"window", required_argument, 0, 'w'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hjvr:c:s:o:l:a:qSid:P:pt:V:I:G:F:zE",
+        c = getopt_long (argc, argv, "hjvr:c:s:o:l:a:qSid:P:pt:V:X:I:G:F:zExw:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -194,6 +213,9 @@ int main_genotype(int argc, char** argv) {
         case 'V':
             recall_vcf = optarg;
             break;
+        case 'X':
+            recall_xg = optarg;
+            break;
         case 'I':
             insertions_file = optarg;
             break;
@@ -207,6 +229,12 @@ int main_genotype(int argc, char** argv) {
         case 'E':
             embed_gam_edits = false;
             break;
+        case 'x':
+            stream_reads = true;
+            break;
+        case 'w':
+            window_bases = std::stoull(optarg);
+            break;
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -222,6 +250,43 @@ int main_genotype(int argc, char** argv) {
         omp_set_num_threads(thread_count);
     }
 
+    if (stream_reads && (gam_file.empty() || !output_vcf)) {
+        cerr << "[vg genotype] Streaming with -x needs a sorted GAM given with -G and VCF output with -v" << endl;
+        return 1;
+    }
+    if (stream_reads && window_bases == 0) {
+        cerr << "[vg genotype] Window must be at least 1 bp" << endl;
+        return 1;
+    }
+
+    if (!recall_xg.empty()) {
+        if (recall_vcf.empty() || fasta.empty() || gam_file.empty()) {
+            cerr << "[vg genotype] Recalling against an xg index with -X needs -V, -F and -G" << endl;
+            return 1;
+        }
+        
+        if (show_progress) {
+            cerr << "Reading xg index..." << endl;
+        }
+        ifstream xg_stream(recall_xg);
+        if (!xg_stream) {
+            cerr << "[vg genotype] Could not open xg index " << recall_xg << endl;
+            return 1;
+        }
+        xg::XG xg_index(xg_stream);
+        
+        FastaReference lin_ref;
+        lin_ref.open(fasta);
+        vector<FastaReference*> insertions;
+        FastaReference ins;
+        if (!insertions_file.empty()){
+            ins.open(insertions_file);
+            insertions.push_back(&ins);
+        }
+        variant_recall_xg(xg_index, recall_vcf, &lin_ref, insertions, gam_file);
+        return 0;
+    }
+
     // read the graph
     if (optind >= argc) {
         help_genotype(argv);
@@ -289,7 +354,7 @@ int main_genotype(int argc, char** argv) {
     // Load all the reads matching the graph into memory
     vector<Alignment> alignments;
 
-    if(show_progress) {
+    if(show_progress && !stream_reads) {
         cerr << "Loading reads..." << endl;
     }
 
@@ -302,7 +367,9 @@ int main_genotype(int argc, char** argv) {
         return alignment.path().mapping_size() > 0;
     };
 
-    if (useindex) {
+    if (stream_reads) {
+        // The reads will be read a window at a time as we genotype
+    } else if (useindex) {
         // Extract all the alignments
         index.for_alignment_to_nodes(graph_ids, [&](const Alignment& alignment) {
                 // Only take alignments that don't visit nodes not in the graph
@@ -326,7 +393,7 @@ int main_genotype(int argc, char** argv) {
             });
     }
     
-    if(show_progress) {
+    if(show_progress && !stream_reads) {
         cerr << "Loaded " << alignments.size() << " alignments" << endl;
     }
     
@@ -361,6 +428,38 @@ int main_genotype(int argc, char** argv) {
     augmented_graph.graph.paths.rebuild_mapping_aux();
     augmented_graph.graph.paths.to_graph(augmented_graph.graph.graph);    
 
+    if (stream_reads) {
+        // The graph must already be augmented; reads are embedded a window at a time.
+        ifstream gam_reads(gam_file.c_str());
+        if (!gam_reads) {
+            cerr << "[vg genotype] Error opening gam: " << gam_file << endl;
+            return 1;
+        }
+        ifstream gam_index_in(gam_file + ".gai");
+        if (!gam_index_in) {
+            cerr << "[vg genotype] Error opening gam index: " << gam_file << ".gai"
+                 << " (make it with vg gamsort -i)" << endl;
+            return 1;
+        }
+        GAMIndex gam_index;
+        gam_index.load(gam_index_in);
+
+        genotyper.run_streaming(augmented_graph,
+                                gam_reads,
+                                gam_index,
+                                cout,
+                                ref_path_name,
+                                contig_name,
+                                sample_name,
+                                show_progress,
+                                length_override,
+                                variant_offset,
+                                window_bases);
+
+        delete graph;
+        return 0;
+    }
+
     // Do the actual augmentation using vg edit. If augmentation was already
     // done, just embeds the reads. Reads will be taken by the AugmentedGraph
     // and stored in it.
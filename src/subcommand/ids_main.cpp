@@ -29,7 +29,9 @@ void help_ids(char** argv) {
         << "    -j, --join           make a joint id space for all the graphs that are supplied" << endl
         << "                         by iterating through the supplied graphs and incrementing" << endl
         << "                         their ids to be non-conflicting (modifies original files)" << endl
-        << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl;
+        << "    -s, --sort           assign new node IDs in (generalized) topological sort order" << endl
+        << "    -C, --components     with -s, sort each weakly connected component on its own, in parallel" << endl
+        << "    -t, --threads N      number of threads to use for -C and -j" << endl;
 }
 
 int main_ids(int argc, char** argv) {
@@ -42,6 +44,7 @@ int main_ids(int argc, char** argv) {
     bool join = false;
     bool compact = false;
     bool sort = false;
+    bool by_component = false;
     int64_t increment = 0;
     int64_t decrement = 0;
 
@@ -55,12 +58,14 @@ int main_ids(int argc, char** argv) {
             {"decrement", required_argument, 0, 'd'},
             {"join", no_argument, 0, 'j'},
             {"sort", no_argument, 0, 's'},
+            {"components", no_argument, 0, 'C'},
+            {"threads", required_argument, 0, 't'},
             {"help", no_argument, 0, 'h'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hci:d:js",
+        c = getopt_long (argc, argv, "hci:d:jsCt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -89,6 +94,14 @@ int main_ids(int argc, char** argv) {
                 sort = true;
                 break;
 
+            case 'C':
+                by_component = true;
+                break;
+
+            case 't':
+                omp_set_num_threads(atoi(optarg));
+                break;
+
             case 'h':
             case '?':
                 help_ids(argv);
@@ -108,7 +121,7 @@ int main_ids(int argc, char** argv) {
 
         if (sort) {
             // Set up the nodes so we go through them in topological order
-            algorithms::sort(graph);
+            algorithms::sort(graph, by_component);
         }
 
         if (compact || sort) {
@@ -2,6 +2,7 @@
 
 #include <omp.h>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <getopt.h>
 
 #include <string>
@@ -16,6 +17,7 @@
 #include "../vg_set.hpp"
 #include "../utility.hpp"
 #include "../path_index.hpp"
+#include "../vcf_buffer.hpp"
 
 #include <gcsa/gcsa.h>
 #include <gcsa/algorithms.h>
@@ -30,16 +32,24 @@ void help_index(char** argv) {
          << "Creates an index on the specified graph or graphs. All graphs indexed must " << endl
          << "already be in a joint ID space, and the graph containing the highest-ID node " << endl
          << "must come first." << endl
-         << "xg options:" << endl
+         << "xg options (xg indexes can also be built from GFA files ending in .gfa):" << endl
          << "    -x, --xg-name FILE     use this file to store a succinct, queryable version of" << endl
          << "                           the graph(s) (effectively replaces rocksdb)" << endl
          << "    -v, --vcf-phasing FILE import phasing blocks from the given VCF file as threads" << endl
          << "    -r, --rename V=P       rename contig V in the VCFs to path P in the graph (may repeat)" << endl
          << "    -T, --store-threads    use gPBWT to store the embedded paths as threads" << endl
+         << "    -W, --path-sample N    store the node at every Nth base of each path for faster" << endl
+         << "                           path position queries (default off)" << endl
          << "    -B, --batch-size N     number of samples per batch (default 200)" << endl
          << "    -R, --range X..Y       process samples X to Y (inclusive)" << endl
          << "    -G, --gbwt-name FILE   write the paths generated from the VCF file as GBWT to FILE (don't write gPBWT)" << endl
          << "    -H, --write-haps FILE  write the paths generated from the VCF file in binary to FILE (don't write gPBWT)" << endl
+         << "    --gbwt-buffer N        insert haplotypes into the GBWT in batches of N million nodes (default "
+         << (gbwt::DynamicGBWT::INSERT_BATCH_SIZE / gbwt::MILLION) << ")" << endl
+         << "    --gbwt-merge-batch N   merge per-contig GBWTs N haplotypes at a time (default "
+         << gbwt::DynamicGBWT::MERGE_BATCH_SIZE << ")" << endl
+         << "                           (with -G, more than one thread and a tabix-indexed VCF, every contig gets" << endl
+         << "                           its own GBWT on its own thread, and so its own insertion buffer)" << endl
          << "gcsa options:" << endl
          << "    -g, --gcsa-out FILE    output a GCSA2 index instead of a rocksdb index" << endl
          << "    -i, --dbg-in FILE      optionally use deBruijn graph encoded in FILE rather than an input VG (multiple allowed" << endl
@@ -54,6 +64,11 @@ void help_index(char** argv) {
          << "    -t, --threads N        number of threads to use" << endl
          << "    -p, --progress         show progress" << endl
          << "    -V, --verify-index     validate the GCSA2 index using the input kmers (important for testing)" << endl
+         << "    -K, --gcsa-prune N     before GCSA2 construction, prune each graph like vg mod -p -l N" << endl
+         << "                           followed by vg mod -S -l N (the input files are not changed)" << endl
+         << "    -E, --gcsa-edge-max N  with -K, cut paths making more than N edge choices (default 3)" << endl
+         << "    -U, --restore-gbwt FILE with -K, restore the nodes and edges used by the haplotypes in FILE" << endl
+         << "    -q, --restore-paths    with -K, restore the nodes and edges used by embedded paths" << endl
          << "rocksdb options (ignored with -g):" << endl
          << "    -d, --db-name  <X>     store the database in <X>" << endl
          << "    -m, --store-mappings   input is .gam format, store the mappings in alignments by node" << endl
@@ -132,6 +147,10 @@ int main_index(int argc, char** argv) {
     int edge_max = 0;
     int kmer_stride = 1;
     int prune_kb = -1;
+    int gcsa_prune_length = 0;
+    int gcsa_prune_edge_max = 3;
+    string restore_gbwt_name;
+    bool restore_paths = false;
     bool dump_index = false;
     bool describe_index = false;
     bool show_progress = false;
@@ -150,9 +169,15 @@ int main_index(int argc, char** argv) {
     size_t samples_in_batch = 200; // Samples per batch in GBWT construction.
     std::pair<size_t, size_t> sample_range(0, ~(size_t)0);  // The semiopen range of samples to process.
     bool store_threads = false; // use gPBWT to store paths
+    size_t path_sample_rate = 0; // sample path offset to node lookups every this many bases
     bool discard_overlaps = false;
     string binary_haplotype_output;
     string tmp_db_base;
+    size_t gbwt_buffer_size = gbwt::DynamicGBWT::INSERT_BATCH_SIZE; // Nodes per GBWT insertion batch.
+    size_t gbwt_merge_batch = gbwt::DynamicGBWT::MERGE_BATCH_SIZE; // Haplotypes per GBWT merge batch.
+
+    const int OPT_GBWT_BUFFER = 1000;
+    const int OPT_GBWT_MERGE_BATCH = 1001;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -187,6 +212,7 @@ int main_index(int argc, char** argv) {
             {"size-limit", required_argument, 0, 'Z'},
             {"path-only", no_argument, 0, 'O'},
             {"store-threads", no_argument, 0, 'T'},
+            {"path-sample", required_argument, 0, 'W'},
             {"node-alignments", no_argument, 0, 'N'},
             {"dbg-in", required_argument, 0, 'i'},
             {"discard-overlaps", no_argument, 0, 'o'},
@@ -195,11 +221,17 @@ int main_index(int argc, char** argv) {
             {"gbwt-name", required_argument, 0, 'G'},
             {"write-haps", required_argument, 0, 'H'},
             {"tmp-db-base", required_argument, 0, 'b'},
+            {"gcsa-prune", required_argument, 0, 'K'},
+            {"gcsa-edge-max", required_argument, 0, 'E'},
+            {"restore-gbwt", required_argument, 0, 'U'},
+            {"restore-paths", no_argument, 0, 'q'},
+            {"gbwt-buffer", required_argument, 0, OPT_GBWT_BUFFER},
+            {"gbwt-merge-batch", required_argument, 0, OPT_GBWT_MERGE_BATCH},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCnAg:X:x:v:r:VFZ:Oi:TNoB:R:G:H:",
+        c = getopt_long (argc, argv, "d:k:j:pDshMt:b:e:SP:LmaCnAg:X:x:v:r:VFZ:Oi:TW:NoB:R:G:H:K:E:U:q",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -245,6 +277,14 @@ int main_index(int argc, char** argv) {
         case 'H':
             binary_haplotype_output = optarg;
             break;
+
+        case OPT_GBWT_BUFFER:
+            gbwt_buffer_size = std::stoul(optarg) * gbwt::MILLION;
+            break;
+
+        case OPT_GBWT_MERGE_BATCH:
+            gbwt_merge_batch = std::stoul(optarg);
+            break;
             
         case 'r':
             {
@@ -267,6 +307,22 @@ int main_index(int argc, char** argv) {
             prune_kb = atoi(optarg);
             break;
 
+        case 'K':
+            gcsa_prune_length = atoi(optarg);
+            break;
+
+        case 'E':
+            gcsa_prune_edge_max = atoi(optarg);
+            break;
+
+        case 'U':
+            restore_gbwt_name = optarg;
+            break;
+
+        case 'q':
+            restore_paths = true;
+            break;
+
         case 'k':
             kmer_size = atoi(optarg);
             break;
@@ -359,6 +415,10 @@ int main_index(int argc, char** argv) {
             store_threads = true;
             break;
 
+        case 'W':
+            path_sample_rate = std::stoul(optarg);
+            break;
+
         case 'o':
             discard_overlaps = true;
             break;
@@ -405,6 +465,16 @@ int main_index(int argc, char** argv) {
         return 1;
     }
 
+    if (gcsa_prune_length < 0 || gcsa_prune_edge_max <= 0) {
+        cerr << "error:[vg index] GCSA2 pruning length and edge max must be positive" << endl;
+        return 1;
+    }
+
+    if ((!restore_gbwt_name.empty() || restore_paths) && gcsa_prune_length == 0) {
+        cerr << "error:[vg index] restoring haplotypes or paths (-U, -q) requires pruning (-K)" << endl;
+        return 1;
+    }
+
     if (kmer_stride <= 0) {
         // kmer strides of 0 (or negative) are silly.
         cerr << "error:[vg index] kmer stride must be positive and nonzero" << endl;
@@ -416,6 +486,11 @@ int main_index(int argc, char** argv) {
         return 1;
     }
 
+    if (gbwt_buffer_size == 0 || gbwt_merge_batch == 0) {
+        cerr << "error:[vg index] GBWT buffer size and merge batch size must be positive and nonzero" << endl;
+        return 1;
+    }
+
     if (!vcf_name.empty() && !gbwt_name.empty() && !binary_haplotype_output.empty()) {
         cerr << "error:[vg index] Cannot use both --gbwt-name and --write-haps" << endl;
         return 1;
@@ -475,10 +550,16 @@ int main_index(int argc, char** argv) {
         VGset graphs(file_names);
         // Turn into an XG index, except for the alt paths which we pull out and load into RAM instead.
         xg::XG index;
+        index.path_sample_rate = path_sample_rate;
         graphs.to_xg(index, store_threads, is_alt, alt_paths);
 
         if (show_progress) {
-            cerr << "Built base XG index" << endl;
+            // Construction runs in parallel stages, so report how much memory
+            // it took to get here.
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            cerr << "Built base XG index using " << omp_get_max_threads() << " threads (peak memory "
+                 << usage.ru_maxrss / 1024 << " MB)" << endl;
         }
 
         // Build gPBWT / GBWT or output the threads in binary.
@@ -496,12 +577,22 @@ int main_index(int argc, char** argv) {
                 cerr << "Node id width: " << id_width << endl;
             }
 
+            // Contigs don't share haplotypes, so if we can seek to each of
+            // them in the VCF, we can build a GBWT for every contig on its own
+            // thread and merge them at the end.
+            bool parallel_gbwt = !gbwt_name.empty() && omp_get_max_threads() > 1 &&
+                                 variant_file.usingTabix && index.max_path_rank() > 1;
+
             // Do we build GBWT?
             gbwt::GBWTBuilder* gbwt_builder = 0;
             if (!gbwt_name.empty()) {
-                if (show_progress) { cerr << "Building GBWT index" << endl; }
+                if (show_progress) {
+                    cerr << "Building GBWT index" << (parallel_gbwt ? " by contig" : "") << endl;
+                }
                 gbwt::Verbosity::set(gbwt::Verbosity::SILENT);  // Make the construction thread silent.
-                gbwt_builder = new gbwt::GBWTBuilder(id_width);
+                if (!parallel_gbwt) {
+                    gbwt_builder = new gbwt::GBWTBuilder(id_width, gbwt_buffer_size);
+                }
             }
 
             // Do we output the threads in binary instead of building GBWT?
@@ -538,7 +629,17 @@ int main_index(int argc, char** argv) {
                 cerr << "Processing samples " << sample_range.first << " to " << (sample_range.second - 1) << " with batch size " << samples_in_batch << endl;
             }
 
-            for (size_t path_rank = 1; path_rank <= index.max_path_rank(); path_rank++) {
+            // Read and parse the variants on a background thread, while we
+            // trace the phases through them here. Shared across paths, so that
+            // without a tabix index the variants already read for the next
+            // contig are kept.
+            VcfBuffer variant_source(&variant_file, 256);
+
+            // Trace the phases of all the samples through one path, reading
+            // its variants from the given buffer and inserting the threads
+            // into the given GBWT builder and names, if we build a GBWT.
+            auto process_path = [&](size_t path_rank, VcfBuffer& variant_source, NodeLengthBuffer& node_length,
+                                    gbwt::GBWTBuilder* gbwt_builder, vector<string>& thread_names) {
                 // Find all the reference paths and loop over them. We'll just
                 // assume paths that don't start with "_" might appear in the
                 // VCF. We need to use the xg path functions, since we didn't
@@ -548,7 +649,7 @@ int main_index(int argc, char** argv) {
                 string path_name = index.path_name(path_rank);
                 
                 // Convert to VCF space if applicable
-                string vcf_contig_name = path_to_vcf.count(path_name) ? path_to_vcf[path_name] : path_name;
+                string vcf_contig_name = path_to_vcf.count(path_name) ? path_to_vcf.at(path_name) : path_name;
                 
                 if (show_progress) {
                     cerr << "Processing path " << path_name << " as VCF contig " << vcf_contig_name << endl;
@@ -725,7 +826,7 @@ int main_index(int argc, char** argv) {
                         // For each sample
 
                         // What sample is it?
-                        string& sample_name = variant_file.sampleNames[sample_number];
+                        const string& sample_name = sample_names[sample_number];
 
                         // Parse it out and see if it's phased.
                         string genotype = variant.getGenotype(sample_name);
@@ -947,7 +1048,7 @@ int main_index(int argc, char** argv) {
 
                     // Look for variants only on this path; seek back if this
                     // is not the first batch.
-                    variant_file.setRegion(vcf_contig_name);
+                    variant_source.set_region(vcf_contig_name);
 
                     // Set up progress bar
                     ProgressBar* progress = nullptr;
@@ -960,32 +1061,31 @@ int main_index(int argc, char** argv) {
                         progress->Progressed(0);*/
                     }
 
-                    // Allocate a place to store actual variants
-                    vcflib::Variant var(variant_file);
-
                     // How many variants have we done?
                     size_t variants_processed = 0;
-                    while (variant_file.is_open() && variant_file.getNextVariant(var) && var.sequenceName == vcf_contig_name) {
+                    variant_source.fill_buffer();
+                    while (variant_source.get() != nullptr && variant_source.get()->sequenceName == vcf_contig_name) {
+                        // The buffer has already converted to 0-based
+                        vcflib::Variant& var = *variant_source.get();
+
                         // this ... maybe we should remove it as for when we have calls against N
                         bool isDNA = allATGC(var.ref);
                         for (vector<string>::iterator a = var.alt.begin(); a != var.alt.end(); ++a) {
                             if (!allATGC(*a)) isDNA = false;
                         }
                         // only work with DNA sequences
-                        if (!isDNA) {
-                            continue;
-                        }
-                    
-                        var.position -= 1; // convert to 0-based
-                    
-                        // Handle the variant
-                        handle_variant(var);
-
+                        if (isDNA) {
+                            // Handle the variant
+                            handle_variant(var);
 
-                        if (variants_processed++ % 1000 == 0 && progress != nullptr) {
-                            // Say we made progress
-                            progress->Progressed(var.position);
+                            if (variants_processed++ % 1000 == 0 && progress != nullptr) {
+                                // Say we made progress
+                                progress->Progressed(var.position);
+                            }
                         }
+
+                        variant_source.handle_buffer();
+                        variant_source.fill_buffer();
                     }
 
                     if (variants_processed > 0) {
@@ -1025,16 +1125,90 @@ int main_index(int argc, char** argv) {
                     diploid_region = std::vector<bool>(samples_in_batch, true);
                     nonvariant_starts = std::vector<size_t>(phases_in_batch, 0);
                 }
+            };
+
+            if (!parallel_gbwt) {
+                for (size_t path_rank = 1; path_rank <= index.max_path_rank(); path_rank++) {
+                    process_path(path_rank, variant_source, node_length, gbwt_builder, thread_names);
+                }
+            } else {
+                // Build a GBWT for each contig, each thread reading the VCF
+                // through its own file and buffer.
+                size_t path_count = index.max_path_rank();
+                vector<gbwt::GBWT> contig_gbwts(path_count);
+                vector<vector<string>> contig_thread_names(path_count);
+#pragma omp parallel for schedule(dynamic, 1)
+                for (size_t i = 0; i < path_count; i++) {
+                    vcflib::VariantCallFile contig_file;
+                    contig_file.open(vcf_name);
+                    if (!contig_file.is_open()) {
+#pragma omp critical (cerr)
+                        cerr << "error:[vg index] could not open " << vcf_name << endl;
+                        exit(1);
+                    }
+                    VcfBuffer contig_source(&contig_file, 256);
+                    NodeLengthBuffer contig_node_length(index);
+                    gbwt::GBWTBuilder contig_builder(id_width, gbwt_buffer_size);
+
+                    process_path(i + 1, contig_source, contig_node_length, &contig_builder, contig_thread_names[i]);
+
+                    contig_builder.finish();
+                    contig_gbwts[i] = gbwt::GBWT(contig_builder.index);
+                }
+
+                // Merge in path order, so that the haplotypes stay in the same
+                // order as their names. If the contigs' node ranges follow one
+                // another, which they do for graphs built by vg construct, the
+                // GBWTs can just be concatenated; otherwise we have to insert
+                // them into one another.
+                vector<gbwt::GBWT> nonempty_gbwts;
+                bool ranges_in_order = true;
+                for (size_t i = 0; i < path_count; i++) {
+                    if (contig_gbwts[i].empty()) {
+                        continue;
+                    }
+                    if (!nonempty_gbwts.empty() && contig_gbwts[i].firstNode() < nonempty_gbwts.back().sigma()) {
+                        ranges_in_order = false;
+                    }
+                    nonempty_gbwts.push_back(std::move(contig_gbwts[i]));
+                    thread_names.insert(thread_names.end(), contig_thread_names[i].begin(), contig_thread_names[i].end());
+                }
+                contig_gbwts.clear();
+
+                if (show_progress) {
+                    cerr << "Merging " << nonempty_gbwts.size() << " contig GBWTs"
+                         << (ranges_in_order || nonempty_gbwts.size() < 2 ? "" : " by insertion") << endl;
+                }
+                if (nonempty_gbwts.empty()) {
+                    if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                    sdsl::store_to_file(gbwt::GBWT(), gbwt_name);
+                } else if (ranges_in_order) {
+                    gbwt::GBWT merged(nonempty_gbwts);
+                    nonempty_gbwts.clear();
+                    if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                    sdsl::store_to_file(merged, gbwt_name);
+                } else {
+                    gbwt::DynamicGBWT merged;
+                    for (size_t i = 0; i < nonempty_gbwts.size(); i++) {
+                        merged.merge(nonempty_gbwts[i], gbwt_merge_batch);
+                        nonempty_gbwts[i] = gbwt::GBWT();
+                    }
+                    nonempty_gbwts.clear();
+                    if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                    sdsl::store_to_file(merged, gbwt_name);
+                }
             }
 
             // Flush the buffers and do whatever work is still left.
             if (!gbwt_name.empty()) {
-                // Build a GBWT
+                // Build a GBWT, unless we built one by contig already
                 
-                gbwt_builder->finish();
-                if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
-                sdsl::store_to_file(gbwt_builder->index, gbwt_name);
-                delete gbwt_builder; gbwt_builder = 0;
+                if (gbwt_builder != 0) {
+                    gbwt_builder->finish();
+                    if (show_progress) { cerr << "Saving GBWT to disk..." << endl; }
+                    sdsl::store_to_file(gbwt_builder->index, gbwt_name);
+                    delete gbwt_builder; gbwt_builder = 0;
+                }
                 
                 // The XG keeps the thread names
                 index.set_thread_names(thread_names);
@@ -1091,6 +1265,20 @@ int main_index(int argc, char** argv) {
         if (dbg_names.empty()) {
             VGset graphs(file_names);
             graphs.show_progress = show_progress;
+            // Prune each graph as we go, if asked
+            graphs.prune_length = gcsa_prune_length;
+            graphs.prune_edge_max = gcsa_prune_edge_max;
+            graphs.restore_paths = restore_paths;
+            gbwt::GBWT restore_gbwt;
+            if (!restore_gbwt_name.empty()) {
+                ifstream gbwt_stream(restore_gbwt_name);
+                if (!gbwt_stream) {
+                    cerr << "error:[vg index] could not open GBWT " << restore_gbwt_name << endl;
+                    return 1;
+                }
+                restore_gbwt.load(gbwt_stream);
+                graphs.restore_gbwt = &restore_gbwt;
+            }
             // Go get the kmers of the correct size
             tmpfiles = graphs.write_gcsa_kmers_binary(kmer_size);
         } else {
@@ -1145,8 +1333,9 @@ int main_index(int argc, char** argv) {
         }
 
         if (store_node_alignments && file_names.size() > 0) {
-            index.open_for_bulk_load(rocksdb_name);
-            int64_t aln_idx = 0;
+            index.open_for_ingest(rocksdb_name);
+            // alignments come in on many threads, and each needs its own ID
+            std::atomic<int64_t> aln_idx(0);
             function<void(Alignment&)> lambda = [&index,&aln_idx](Alignment& aln) {
                 index.cross_alignment(aln_idx++, aln);
             };
@@ -1160,7 +1349,7 @@ int main_index(int argc, char** argv) {
         }
 
         if (store_alignments && file_names.size() > 0) {
-            index.open_for_bulk_load(rocksdb_name);
+            index.open_for_ingest(rocksdb_name);
             function<void(Alignment&)> lambda = [&index](Alignment& aln) {
                 index.put_alignment(aln);
             };
@@ -1186,7 +1375,7 @@ int main_index(int argc, char** argv) {
         }
 
         if (store_mappings && file_names.size() > 0) {
-            index.open_for_bulk_load(rocksdb_name);
+            index.open_for_ingest(rocksdb_name);
             function<void(Alignment&)> lambda = [&index](Alignment& aln) {
                 const Path& path = aln.path();
                 for (int i = 0; i < path.mapping_size(); ++i) {
@@ -13,6 +13,7 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../graph_stream_merge.hpp"
 
 using namespace std;
 using namespace vg;
@@ -62,27 +63,13 @@ int main_join(int argc, char** argv) {
         }
     }
 
-    list<VG*> graphs;
-
+    vector<string> file_names;
     while (optind < argc) {
-        VG* graph;
-        get_input_file(optind, argc, argv, [&](istream& in) {
-            graph = new VG(in);
-        });
-        graphs.push_back(graph);
-    }
-
-    VG joined;
-    for (list<VG*>::iterator g = graphs.begin(); g != graphs.end(); ++g) {
-        // Stick all the graphs together, complaining if they use the same node IDs (since they probably shouldn't).
-        joined.extend(**g, true);
+        file_names.push_back(get_input_file_name(optind, argc, argv));
     }
 
-    // combine all subgraphs
-    joined.join_heads();
-
-    // output
-    joined.serialize_to_ostream(std::cout);
+    // Pass the graphs' chunks straight through to the output
+    join_graph_files(file_names, std::cout);
 
     return 0;
 }
@@ -40,10 +40,14 @@ void help_kmers(char** argv) {
          << "    -P, --path-only       Only consider kmers if they occur in a path embedded in the graph" << endl
          << "    -H, --head-id N       use the specified ID for the GCSA2 head sentinel node" << endl
          << "    -T, --tail-id N       use the specified ID for the GCSA2 tail sentinel node" << endl
+         << "    -c, --count           write a binary table of the count of each kmer (of at most " << MAX_COUNTED_KMER_SIZE << " bases)" << endl
+         << "    --count-partitions N  when counting, spill kmers to N temporary files and count them one at a time" << endl
          << "    -p, --progress        show progress" << endl;
 }
 
 int main_kmers(int argc, char** argv) {
+    
+    const int OPT_COUNT_PARTITIONS = 1000;
 
     if (argc == 2) {
         help_kmers(argv);
@@ -64,6 +68,8 @@ int main_kmers(int argc, char** argv) {
     bool forward_only = false;
     bool gcsa_binary = false;
     bool handle_alg = false;
+    bool count_kmers = false;
+    size_t count_partitions = 0;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -85,11 +91,13 @@ int main_kmers(int argc, char** argv) {
             {"forward-only", no_argument, 0, 'F'},
             {"gcsa-binary", no_argument, 0, 'B'},
             {"path-only", no_argument, 0, 'P'},
+            {"count", no_argument, 0, 'c'},
+            {"count-partitions", required_argument, 0, OPT_COUNT_PARTITIONS},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:j:pt:e:gdnH:T:FBP",
+        c = getopt_long (argc, argv, "hk:j:pt:e:gdnH:T:FBPc",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -152,6 +160,14 @@ int main_kmers(int argc, char** argv) {
                 gcsa_binary = true;
                 break;
 
+            case 'c':
+                count_kmers = true;
+                break;
+
+            case OPT_COUNT_PARTITIONS:
+                count_partitions = atoi(optarg);
+                break;
+
             case 'h':
             case '?':
                 help_kmers(argv);
@@ -173,7 +189,28 @@ int main_kmers(int argc, char** argv) {
 
     graphs.show_progress = show_progress;
 
-    if (gcsa_out) {
+    if (count_kmers) {
+        if (gcsa_out) {
+            cerr << "error:[vg kmers] Cannot count kmers (-c) and generate GCSA kmers (-g) at the same time." << endl;
+            exit(1);
+        }
+        if (kmer_size < 1 || (size_t) kmer_size > MAX_COUNTED_KMER_SIZE) {
+            cerr << "error:[vg kmers] Can only count kmers of 1 to " << MAX_COUNTED_KMER_SIZE << " bases." << endl;
+            exit(1);
+        }
+        KmerCounter counter(kmer_size, count_partitions);
+        graphs.for_each([&](VG* g) {
+            counter.add_kmers(*g);
+        });
+        size_t distinct = counter.write_counts(cout);
+        if (show_progress) {
+            cerr << "counted " << distinct << " distinct kmers";
+            if (counter.skipped_kmers() > 0) {
+                cerr << ", skipped " << counter.skipped_kmers() << " with characters other than ACGT";
+            }
+            cerr << endl;
+        }
+    } else if (gcsa_out) {
         if (edge_max != 0) {
             // I have been passing this option to vg index -g for months
             // thinking it worked. But it can't work. So we should tell the user
@@ -23,18 +23,21 @@ using namespace vg::subcommand;
 void help_locify(char** argv){
     cerr << "usage: " << argv[0] << " locify [options] " << endl
          << "    -l, --loci FILE      input loci over which to locify the alignments" << endl
-         << "    -a, --aln-idx DIR    use this rocksdb alignment index (from vg index -N)" << endl
+         << "    -g, --gam-idx DIR    use this rocksdb alignment index (from vg index -N)" << endl
+         << "    -G, --gam FILE       stream the alignments from this GAM instead of using an index" << endl
          << "    -x, --xg-idx FILE    use this xg index" << endl
          << "    -n, --name-alleles   generate names for each allele rather than using full Paths" << endl
          << "    -f, --forwardize     flip alignments on the reverse strand to the forward" << endl
          << "    -s, --sorted-loci FILE  write the non-nested loci out in their sorted order" << endl
          << "    -b, --n-best N       keep only the N-best alleles by alignment support" << endl
-         << "    -o, --out-loci FILE  rewrite the loci with only N-best alleles kept" << endl;
+         << "    -o, --out-loci FILE  rewrite the loci with only N-best alleles kept" << endl
+         << "    -t, --threads N      number of threads to use when streaming a GAM [all available]" << endl;
         // TODO -- add some basic filters that are useful downstream in whatshap
 }
 
 int main_locify(int argc, char** argv){
     string gam_idx_name;
+    string gam_name;
     string loci_file;
     Index gam_idx;
     string xg_idx_name;
@@ -55,6 +58,8 @@ int main_locify(int argc, char** argv){
         {
             {"help", no_argument, 0, 'h'},
             {"gam-idx", required_argument, 0, 'g'},
+            {"gam", required_argument, 0, 'G'},
+            {"threads", required_argument, 0, 't'},
             {"loci", required_argument, 0, 'l'},
             {"xg-idx", required_argument, 0, 'x'},
             {"name-alleles", no_argument, 0, 'n'},
@@ -66,7 +71,7 @@ int main_locify(int argc, char** argv){
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:x:g:nfo:b:s:",
+        c = getopt_long (argc, argv, "hl:x:g:G:nfo:b:s:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -79,6 +84,14 @@ int main_locify(int argc, char** argv){
             gam_idx_name = optarg;
             break;
 
+        case 'G':
+            gam_name = optarg;
+            break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'l':
             loci_file = optarg;
             break;
@@ -119,6 +132,10 @@ int main_locify(int argc, char** argv){
         }
     }
 
+    if (gam_idx_name.empty() == gam_name.empty()) {
+        cerr << "[vg locify] Error: exactly one of an alignment index (-g) or a GAM (-G) is required" << endl;
+        return 1;
+    }
     if (!gam_idx_name.empty()) {
         gam_idx.open_read_only(gam_idx_name);
     }
@@ -150,11 +167,20 @@ int main_locify(int argc, char** argv){
     map<string, map<int, int> > locus_allele_support;
     map<string, vector<int> > locus_to_best_n_alleles;
     map<string, set<int> > locus_to_keep;
-    int count = 0;
+    
+    // the loci in file order, with the nodes each one touches and the name of each of its alleles
+    vector<Locus> loci;
+    vector<vector<vg::id_t>> locus_nodes;
+    vector<vector<int>> locus_allele_ids;
+    // the loci touching each node, in file order
+    hash_map<vg::id_t, vector<size_t>> node_to_loci;
 
     std::function<void(Locus&)> lambda = [&](Locus& l){
+        size_t locus_idx = loci.size();
         locus_names.push_back(l.name());
         set<vg::id_t> nodes_in_locus;
+        auto& l_names = locus_allele_names[l.name()];
+        vector<int> allele_ids;
         for (int i = 0; i < l.allele_size(); ++i) {
             auto& allele = l.allele(i);
             for (int j = 0; j < allele.mapping_size(); ++j) {
@@ -170,60 +196,26 @@ int main_locify(int argc, char** argv){
                 pos_to_loci[pos.first].insert(l.name());
                 locus_to_pos[l.name()].insert(pos.first);
             }
-        }
-        // void for_alignment_in_range(int64_t id1, int64_t id2, std::function<void(const Alignment&)> lambda);
-        std::function<void(const Alignment&)> fill_alns = [&](const Alignment& a){
-            // TODO reverse complementing alleles ?
-            // overlap is stranded
-            //matching
-            // find the most-matching allele
-            map<double, vector<int> > matches;
-            for (int i = 0; i < l.allele_size(); ++i) {
-                auto& allele = l.allele(i);
-                matches[overlap(a.path(), allele)].push_back(i);
-            }
-            assert(l.allele_size());
-            int best = matches.rbegin()->second.front();
-            Locus matching;
-            matching.set_name(l.name());
             if (name_alleles) {
-                //map<string, map<string, int > > locus_allele_names;
-                auto& allele = l.allele(best);
+                // name identical alleles the same, numbering them in the order they first occur, so
+                // the names don't depend on the order the alignments are seen in
                 string s;
                 allele.SerializeToString(&s);
-                auto& l_names = locus_allele_names[l.name()];
                 auto f = l_names.find(s);
-                int name_int = 0;
                 if (f == l_names.end()) {
                     int next_id = l_names.size() + 1;
-                    l_names[s] = next_id;
-                    name_int = next_id;
-                } else {
-                    name_int = f->second;
-                }
-                string allele_name = vg::convert(name_int);
-                Path p;
-                p.set_name(allele_name);
-                *matching.add_allele() = p;
-                if (n_best) {
-                    // record support for this allele
-                    // we'll use to filter the locus records later
-                    locus_allele_support[l.name()][name_int]++;
+                    f = l_names.insert(make_pair(s, next_id)).first;
                 }
-            } else {
-                *matching.add_allele() = l.allele(best);
-                // TODO get quality score relative to this specific allele / alignment
-                // record in the alignment we'll save
-            }
-            if (alignments_with_loci.find(a.name()) == alignments_with_loci.end()) {
-                alignments_with_loci[a.name()] = a;
+                allele_ids.push_back(f->second);
             }
-            Alignment& aln = alignments_with_loci[a.name()];
-            *aln.add_locus() = matching;
-        };
-        vector<vg::id_t> nodes_vec;
-        for (auto& id : nodes_in_locus) nodes_vec.push_back(id);
-        gam_idx.for_alignment_to_nodes(nodes_vec, fill_alns);
+        }
+        assert(l.allele_size());
+        locus_nodes.emplace_back(nodes_in_locus.begin(), nodes_in_locus.end());
+        for (auto& id : nodes_in_locus) {
+            node_to_loci[id].push_back(locus_idx);
+        }
+        locus_allele_ids.push_back(move(allele_ids));
+        loci.push_back(move(l));
     };
 
     if (!loci_file.empty()){
@@ -233,6 +225,116 @@ int main_locify(int argc, char** argv){
         cerr << "[vg locify] Warning: empty locus file given, could not annotate alignments with loci." << endl;
     }
 
+    // find the allele that an alignment best matches at a locus, and add it to the alignment as a
+    // locus; returns the allele's name if we're naming them
+    auto add_matching_locus = [&](Alignment& aln, size_t locus_idx) {
+        // TODO reverse complementing alleles ?
+        // overlap is stranded
+        // find the most-matching allele, the first one in case of ties
+        const Locus& l = loci[locus_idx];
+        int best = 0;
+        double best_overlap = overlap(aln.path(), l.allele(0));
+        for (int i = 1; i < l.allele_size(); ++i) {
+            double allele_overlap = overlap(aln.path(), l.allele(i));
+            if (allele_overlap > best_overlap) {
+                best = i;
+                best_overlap = allele_overlap;
+            }
+        }
+        Locus* matching = aln.add_locus();
+        matching->set_name(l.name());
+        int name_int = 0;
+        if (name_alleles) {
+            name_int = locus_allele_ids[locus_idx][best];
+            matching->add_allele()->set_name(vg::convert(name_int));
+        } else {
+            *matching->add_allele() = l.allele(best);
+            // TODO get quality score relative to this specific allele / alignment
+            // record in the alignment we'll save
+        }
+        return name_int;
+    };
+    
+    // add an alignment's loci to the one we're saving under its name
+    auto save_alignment = [&](Alignment& a) {
+        auto f = alignments_with_loci.find(a.name());
+        if (f == alignments_with_loci.end()) {
+            alignments_with_loci[a.name()] = move(a);
+        } else {
+            for (auto& locus : a.locus()) {
+                *f->second.add_locus() = locus;
+            }
+        }
+    };
+
+    if (!gam_idx_name.empty()) {
+        // find the alignments to each locus in the index
+        for (size_t i = 0; i < loci.size(); i++) {
+            std::function<void(const Alignment&)> fill_alns = [&](const Alignment& a){
+                auto f = alignments_with_loci.find(a.name());
+                if (f == alignments_with_loci.end()) {
+                    f = alignments_with_loci.insert(make_pair(a.name(), a)).first;
+                    f->second.clear_locus();
+                }
+                int name_int = add_matching_locus(f->second, i);
+                if (n_best) {
+                    // record support for this allele
+                    // we'll use to filter the locus records later
+                    locus_allele_support[loci[i].name()][name_int]++;
+                }
+            };
+            gam_idx.for_alignment_to_nodes(locus_nodes[i], fill_alns);
+        }
+    } else {
+        // stream the alignments, looking up the loci they touch by their nodes
+        int thread_count = get_thread_count();
+        vector<vector<Alignment>> thread_alignments(thread_count);
+        vector<map<size_t, map<int, int>>> thread_support(thread_count);
+        function<void(Alignment&)> locify_aln = [&](Alignment& a) {
+            vector<size_t> touched;
+            for (auto& mapping : a.path().mapping()) {
+                auto f = node_to_loci.find(mapping.position().node_id());
+                if (f != node_to_loci.end()) {
+                    touched.insert(touched.end(), f->second.begin(), f->second.end());
+                }
+            }
+            if (touched.empty()) {
+                return;
+            }
+            // add the loci in file order, like the index does
+            sort(touched.begin(), touched.end());
+            touched.erase(unique(touched.begin(), touched.end()), touched.end());
+            
+            int tid = omp_get_thread_num();
+            a.clear_locus();
+            for (size_t locus_idx : touched) {
+                int name_int = add_matching_locus(a, locus_idx);
+                if (n_best) {
+                    thread_support[tid][locus_idx][name_int]++;
+                }
+            }
+            thread_alignments[tid].push_back(move(a));
+        };
+        ifstream gam_in(gam_name);
+        if (!gam_in) {
+            cerr << "[vg locify] Error: could not open GAM " << gam_name << endl;
+            return 1;
+        }
+        stream::for_each_parallel(gam_in, locify_aln);
+        
+        for (int i = 0; i < thread_count; i++) {
+            for (auto& a : thread_alignments[i]) {
+                save_alignment(a);
+            }
+            for (auto& locus_support : thread_support[i]) {
+                auto& support = locus_allele_support[loci[locus_support.first].name()];
+                for (auto& allele_support : locus_support.second) {
+                    support[allele_support.first] += allele_support.second;
+                }
+            }
+        }
+    }
+
     // find the non-nested loci
     vector<string> non_nested_loci;
     for (auto& name : locus_names) {
@@ -2,10 +2,23 @@
 #include "../vg.hpp"
 #include "../utility.hpp"
 #include "../mapper.hpp"
+#include "../packer.hpp"
+#include "../gamsorter.hpp"
 #include "../stream.hpp"
+#include "../stream_emitter.hpp"
+#include "../numa.hpp"
+#include "../huge_pages.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <zlib.h>
 
 using namespace vg;
 using namespace vg::subcommand;
@@ -19,10 +32,16 @@ void help_map(char** argv) {
          << "    -x, --xg-name FILE      use this xg index (defaults to <graph>.vg.xg)" << endl
          << "    -g, --gcsa-name FILE    use this GCSA2 index (defaults to <graph>" << gcsa::GCSA::EXTENSION << ")" << endl
          << "    -1, --gbwt-name         use this GBWT haplotype index (defaults to <graph>"<<gbwt::GBWT::EXTENSION << ")" << endl
+         << "    -2, --dist-index FILE   measure graph distances with this distance index (from vg snarls -d)" << endl
+         << "    --minimizer-name FILE   seed with this minimizer index (from vg minimizer) instead of the GCSA2" << endl
          << "algorithm:" << endl
          << "    -t, --threads N         number of compute threads to use" << endl
+         << "    --numa                  on multi-socket machines, spread the indexes over the NUMA nodes, pin each" << endl
+         << "                            thread to a CPU, and build each thread's mapper on its own node" << endl
+         << "    --hugepages             back the loaded indexes with transparent huge pages, for fewer TLB misses" << endl
          << "    -k, --min-seed INT      minimum seed (MEM) length (set to -1 to estimate given -e) [-1]" << endl
          << "    -c, --hit-max N         ignore MEMs who have >N hits in our index [1024]" << endl
+         << "    --hit-sample N          fill MEMs over the hit max with N hits sampled across their range [0]" << endl
          << "    -e, --seed-chance FLOAT set {-k} such that this fraction of {-k} length hits will by chance [1e-4]" << endl
          << "    -Y, --max-seed INT      ignore seeds longer than this length [0]" << endl
          << "    -r, --reseed-x FLOAT    look for internal seeds inside a seed longer than {-k} * FLOAT [1.5]" << endl
@@ -32,6 +51,11 @@ void help_map(char** argv) {
          << "    --id-mq-weight N        scale mapping quality by the alignment score identity to this power [2]" << endl
          << "    -W, --min-chain INT     discard a chain if seeded bases shorter than INT [0]" << endl
          << "    -C, --drop-chain FLOAT  drop chains shorter than FLOAT fraction of the longest overlapping chain [0]" << endl
+         << "    --sparse-chain          chain seeds by sparse dynamic programming along their approximate positions," << endl
+         << "                            which scales better to reads with many hits (single reads only)" << endl
+         << "    --chain-max-hits INT    chain at most this many of the highest scoring seed hits of a read [4096]" << endl
+         << "    --long-read-chain       map reads longer than the band width by chaining the seeds of the whole read and" << endl
+         << "                            aligning only between them, rather than mapping each band" << endl
          << "    -n, --mq-overlap FLOAT  scale MQ by count of alignments with this overlap in the query with the primary [0]" << endl
          << "    -P, --min-ident FLOAT   accept alignment only if the alignment identity is >= FLOAT [0]" << endl
          << "    -H, --max-target-x N    skip cluster subgraphs with length > N*read_length [100]" << endl
@@ -45,7 +69,10 @@ void help_map(char** argv) {
          << "    -F, --frag-calc INT     update the fragment model every INT perfect pairs [10]" << endl
          << "    -S, --fragment-x FLOAT  calculate max fragment size as frag_mean+frag_sd*FLOAT [10]" << endl
          << "    -O, --mate-rescues INT  attempt up to INT mate rescues per pair [64]" << endl
+         << "    --rescue-seed-len INT   only align a rescued mate where it shares an INT-mer with the graph (0 to always align) [12]" << endl
          << "    --patch-aln             patch banded alignments by attempting to align unaligned regions" << endl 
+         << "    --dup-cache N           reuse the alignments of up to N recently seen read sequences for duplicate reads" << endl
+         << "                            (single reads only, 0 to not cache) [0]" << endl
          << "scoring:" << endl
          << "    -q, --match INT         use this match score [1]" << endl
          << "    -z, --mismatch INT      use this mismatch penalty [4]" << endl
@@ -67,17 +94,222 @@ void help_map(char** argv) {
          << "output:" << endl
          << "    -j, --output-json       output JSON rather than an alignment stream (helpful for debugging)" << endl
          << "    --surject-to TYPE       surject the output into the graph's paths, writing TYPE := bam |sam | cram" << endl
+         << "    --compress-level N      compress surjected BAM or CRAM output at level N [0-9] (default: 9)" << endl
          << "    -Z, --buffer-size INT   buffer this many alignments together before outputting in GAM [512]" << endl
+         << "    --sorted-out FILE       write the alignments to FILE as a coordinate-sorted GAM, indexed in FILE.gai" << endl
+         << "                            as by vg gamsort -i, instead of to stdout" << endl
          << "    -X, --compare           realign GAM input (-G), writing alignment with \"correct\" field set to overlap with input" << endl
          << "    -v, --refpos-table      for efficient testing output a table of name, chr, pos, mq, score" << endl
          << "    -K, --keep-secondary    produce alignments for secondary input alignments in addition to primary ones" << endl
          << "    -M, --max-multimaps INT produce up to INT alignments for each read [1]" << endl
          << "    -B, --band-multi INT    consider this many alignments of each band in banded alignment [1]" << endl
          << "    -Q, --mq-max INT        cap the mapping quality at INT [60]" << endl
-         << "    -D, --debug             print debugging information about alignment to stderr" << endl;
+         << "    -D, --debug             print debugging information about alignment to stderr" << endl
+         << "    --profile               when done, print the time spent in and the work done by each mapping stage" << endl
+         << "                            to stderr as JSON" << endl
+         << "coverage:" << endl
+         << "    --pack-out FILE         also record the coverage of the alignments, writing it like vg pack -o" << endl
+         << "    --pack-only             with --pack-out, record coverage without writing the alignments" << endl
+         << "    --pack-no-edits         with --pack-out, don't record edits, just graph-matching coverage (like vg pack -n)" << endl
+         << "server:" << endl
+         << "    --serve SOCKET          load the indexes once, then map the reads sent to this Unix socket by" << endl
+         << "                            --connect clients until killed, learning one fragment model for all of them" << endl
+         << "    --connect SOCKET        send the -f or -G input to the server on this socket and write its output" << endl
+         << "                            to stdout (two -f files are sent interleaved, and must be 4-line FASTQ)" << endl;
 
 }
 
+/// Open a Unix socket listening at the given path, replacing any stale socket
+/// left there. Returns its file descriptor, or -1 if it couldn't be opened.
+static int listen_on_socket(const string& socket_name) {
+    sockaddr_un address;
+    if (socket_name.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_name.c_str());
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(socket_name.c_str());
+    if (::bind(fd, (sockaddr*) &address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// Connect to the Unix socket at the given path. Returns the connection's file
+/// descriptor, or -1 if there's nobody there.
+static int connect_to_socket(const string& socket_name) {
+    sockaddr_un address;
+    if (socket_name.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_name.c_str());
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// Write all of a buffer to a file descriptor. Returns false if it fails.
+static bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/// Read the line a client starts its request with, without reading any of the
+/// reads after it. Returns false if the client hung up first.
+static bool read_request_line(int fd, string& line) {
+    line.clear();
+    char c;
+    while (line.size() < 1024) {
+        ssize_t got = read(fd, &c, 1);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line.push_back(c);
+    }
+    return false;
+}
+
+/// Read one 4-line FASTQ record, newlines and all. Returns false at the end of the file.
+static bool read_fastq_record(gzFile in, string& record) {
+    record.clear();
+    char buffer[4096];
+    for (size_t lines = 0; lines < 4;) {
+        if (gzgets(in, buffer, sizeof(buffer)) == nullptr) {
+            return false;
+        }
+        record.append(buffer);
+        if (record.back() == '\n') {
+            lines++;
+        }
+    }
+    return true;
+}
+
+/// Be a client of a vg map --serve server: send it the reads from our inputs,
+/// and copy the alignments it sends back to stdout. Returns the exit code.
+static int run_map_client(const string& socket_name, const string& fastq1, const string& fastq2,
+                          const string& gam_input, bool interleaved_input) {
+    
+    int fd = connect_to_socket(socket_name);
+    if (fd < 0) {
+        cerr << "error:[vg map] could not connect to a mapping server at " << socket_name << endl;
+        return 1;
+    }
+    
+    // Tell the server what kind of reads are coming. Two FASTQs go over the
+    // one connection interleaved.
+    string request = gam_input.empty() ? "fastq" : "gam";
+    if (interleaved_input || !fastq2.empty()) {
+        request += " interleaved";
+    }
+    request += "\n";
+    
+    // The server starts sending alignments back before we are done sending
+    // reads, so we send from another thread to keep both ends moving
+    bool sent = true;
+    thread sender([&]() {
+        sent = write_all(fd, request.data(), request.size());
+        if (!gam_input.empty()) {
+            // GAM goes over as it is, still compressed
+            int in = (gam_input != "-") ? open(gam_input.c_str(), O_RDONLY) : STDIN_FILENO;
+            sent = sent && in >= 0;
+            char buffer[65536];
+            ssize_t got;
+            while (sent && (got = read(in, buffer, sizeof(buffer))) > 0) {
+                sent = write_all(fd, buffer, got);
+            }
+            if (in > STDIN_FILENO) {
+                close(in);
+            }
+        } else if (fastq2.empty()) {
+            gzFile in = (fastq1 != "-") ? gzopen(fastq1.c_str(), "r") : gzdopen(fileno(stdin), "r");
+            sent = sent && in != nullptr;
+            char buffer[65536];
+            int got;
+            while (sent && (got = gzread(in, buffer, sizeof(buffer))) > 0) {
+                sent = write_all(fd, buffer, got);
+            }
+            if (in != nullptr) {
+                gzclose(in);
+            }
+        } else {
+            gzFile in1 = gzopen(fastq1.c_str(), "r");
+            gzFile in2 = gzopen(fastq2.c_str(), "r");
+            sent = sent && in1 != nullptr && in2 != nullptr;
+            string record1, record2;
+            while (sent && read_fastq_record(in1, record1) && read_fastq_record(in2, record2)) {
+                sent = write_all(fd, record1.data(), record1.size()) && write_all(fd, record2.data(), record2.size());
+            }
+            if (in1 != nullptr) {
+                gzclose(in1);
+            }
+            if (in2 != nullptr) {
+                gzclose(in2);
+            }
+        }
+        // Let the server know that was everything
+        shutdown(fd, SHUT_WR);
+    });
+    
+    bool received = true;
+    char buffer[65536];
+    ssize_t got;
+    while ((got = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            received = false;
+            break;
+        }
+        received = write_all(STDOUT_FILENO, buffer, got);
+        if (!received) {
+            break;
+        }
+    }
+    
+    sender.join();
+    close(fd);
+    
+    if (!sent || !received) {
+        cerr << "error:[vg map] lost the connection to the mapping server at " << socket_name << endl;
+        return 1;
+    }
+    return 0;
+}
+
 int main_map(int argc, char** argv) {
 
     if (argc == 2) {
@@ -92,14 +324,20 @@ int main_map(int argc, char** argv) {
     string xg_name;
     string gcsa_name;
     string gbwt_name;
+    string distance_index_name;
+    string minimizer_name;
+    string serve_socket;
+    string connect_socket;
     string read_file;
     string hts_file;
     bool keep_secondary = false;
     int hit_max = 1024;
+    int hit_sample = 0;
     int max_multimaps = 1;
     int thread_count = 1;
     bool output_json = false;
     string surject_type;
+    int compress_level = 9;
     bool debug = false;
     float min_score = 0;
     string sample_name;
@@ -153,6 +391,33 @@ int main_map(int argc, char** argv) {
     bool acyclic_graph = false;
     bool refpos_table = false;
     bool patch_alignments = false;
+    bool profile_stages = false;
+    string pack_name;
+    bool pack_only = false;
+    bool pack_edits = true;
+    string sorted_name;
+    bool use_numa = false;
+    bool use_huge_pages = false;
+    bool use_sparse_chaining = false;
+    size_t max_chaining_hits = 4096;
+    int rescue_seed_length = 12;
+    bool long_read_chaining = false;
+    size_t duplicate_cache_size = 0;
+    
+    // long options with no short form
+    const int OPT_SPARSE_CHAIN = 1000;
+    const int OPT_CHAIN_MAX_HITS = 1001;
+    const int OPT_RESCUE_SEED_LEN = 1002;
+    const int OPT_LONG_READ_CHAIN = 1003;
+    const int OPT_HIT_SAMPLE = 1004;
+    const int OPT_MINIMIZER_NAME = 1005;
+    const int OPT_PACK_OUT = 1006;
+    const int OPT_PACK_ONLY = 1007;
+    const int OPT_PACK_NO_EDITS = 1008;
+    const int OPT_SORTED_OUT = 1009;
+    const int OPT_NUMA = 1010;
+    const int OPT_HUGEPAGES = 1011;
+    const int OPT_DUP_CACHE = 1012;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -168,6 +433,7 @@ int main_map(int argc, char** argv) {
                 {"xg-name", required_argument, 0, 'x'},
                 {"gcsa-name", required_argument, 0, 'g'},
                 {"gbwt-name", required_argument, 0, '1'},
+                {"dist-index", required_argument, 0, '2'},
                 {"reads", required_argument, 0, 'T'},
                 {"sample", required_argument, 0, 'N'},
                 {"read-group", required_argument, 0, 'R'},
@@ -217,12 +483,29 @@ int main_map(int argc, char** argv) {
                 {"id-mq-weight", required_argument, 0, '7'},
                 {"refpos-table", no_argument, 0, 'v'},
                 {"surject-to", required_argument, 0, '5'},
+                {"compress-level", required_argument, 0, '0'},
                 {"patch-alns", no_argument, 0, '8'},
+                {"profile", no_argument, 0, '9'},
+                {"sparse-chain", no_argument, 0, OPT_SPARSE_CHAIN},
+                {"chain-max-hits", required_argument, 0, OPT_CHAIN_MAX_HITS},
+                {"rescue-seed-len", required_argument, 0, OPT_RESCUE_SEED_LEN},
+                {"long-read-chain", no_argument, 0, OPT_LONG_READ_CHAIN},
+                {"hit-sample", required_argument, 0, OPT_HIT_SAMPLE},
+                {"minimizer-name", required_argument, 0, OPT_MINIMIZER_NAME},
+                {"pack-out", required_argument, 0, OPT_PACK_OUT},
+                {"pack-only", no_argument, 0, OPT_PACK_ONLY},
+                {"pack-no-edits", no_argument, 0, OPT_PACK_NO_EDITS},
+                {"sorted-out", required_argument, 0, OPT_SORTED_OUT},
+                {"numa", no_argument, 0, OPT_NUMA},
+                {"hugepages", no_argument, 0, OPT_HUGEPAGES},
+                {"dup-cache", required_argument, 0, OPT_DUP_CACHE},
+                {"serve", required_argument, 0, '3'},
+                {"connect", required_argument, 0, '4'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "s:J:Q:d:x:g:1:T:N:R:c:M:t:G:jb:Kf:iw:P:Dk:Y:r:W:6H:Z:q:z:o:y:Au:B:I:S:l:e:C:V:O:L:a:n:E:X:UpF:m7:v5:8",
+        c = getopt_long (argc, argv, "s:J:Q:d:x:g:1:2:3:4:T:N:R:c:M:t:G:jb:Kf:iw:P:Dk:Y:r:W:6H:Z:q:z:o:y:Au:B:I:S:l:e:C:V:O:L:a:n:E:X:UpF:m7:v5:890:",
                          long_options, &option_index);
 
 
@@ -251,6 +534,18 @@ int main_map(int argc, char** argv) {
         case '1':
             gbwt_name = optarg;
             break;
+            
+        case '2':
+            distance_index_name = optarg;
+            break;
+            
+        case '3':
+            serve_socket = optarg;
+            break;
+            
+        case '4':
+            connect_socket = optarg;
+            break;
 
         case 'V':
             seq_name = optarg;
@@ -427,10 +722,74 @@ int main_map(int argc, char** argv) {
             surject_type = optarg;
             break;
 
+        case '0':
+            compress_level = atoi(optarg);
+            if (compress_level < 0 || compress_level > 9) {
+                cerr << "error:[vg map] compression level must be between 0 and 9" << endl;
+                exit(1);
+            }
+            break;
+
         case '8':
             patch_alignments = true;
             break;
 
+        case '9':
+            profile_stages = true;
+            break;
+
+        case OPT_SPARSE_CHAIN:
+            use_sparse_chaining = true;
+            break;
+
+        case OPT_CHAIN_MAX_HITS:
+            max_chaining_hits = atoi(optarg);
+            break;
+
+        case OPT_RESCUE_SEED_LEN:
+            rescue_seed_length = atoi(optarg);
+            break;
+
+        case OPT_LONG_READ_CHAIN:
+            long_read_chaining = true;
+            break;
+
+        case OPT_HIT_SAMPLE:
+            hit_sample = atoi(optarg);
+            break;
+
+        case OPT_MINIMIZER_NAME:
+            minimizer_name = optarg;
+            break;
+
+        case OPT_PACK_OUT:
+            pack_name = optarg;
+            break;
+
+        case OPT_PACK_ONLY:
+            pack_only = true;
+            break;
+
+        case OPT_PACK_NO_EDITS:
+            pack_edits = false;
+            break;
+
+        case OPT_SORTED_OUT:
+            sorted_name = optarg;
+            break;
+
+        case OPT_NUMA:
+            use_numa = true;
+            break;
+
+        case OPT_HUGEPAGES:
+            use_huge_pages = true;
+            break;
+
+        case OPT_DUP_CACHE:
+            duplicate_cache_size = atoi(optarg);
+            break;
+
         case 'I':
         {
             vector<string> parts = split_delims(string(optarg), ":");
@@ -483,17 +842,55 @@ int main_map(int argc, char** argv) {
         }
     }
 
-    if (seq.empty() && read_file.empty() && hts_file.empty() && fastq1.empty() && gam_input.empty()) {
+    StageProfiler::set_enabled(profile_stages);
+    
+    if (!serve_socket.empty()) {
+        if (!seq.empty() || !read_file.empty() || !hts_file.empty() || !fastq1.empty() || !gam_input.empty()) {
+            cerr << "error:[vg map] A mapping server (--serve) takes its reads from its clients." << endl;
+            return 1;
+        }
+        if (print_fragment_model || output_json || refpos_table) {
+            cerr << "error:[vg map] A mapping server (--serve) only writes GAM or surjected alignments." << endl;
+            return 1;
+        }
+        if (!pack_name.empty() || !sorted_name.empty()) {
+            cerr << "error:[vg map] A mapping server (--serve) cannot record coverage (--pack-out) or sort (--sorted-out) for its clients." << endl;
+            return 1;
+        }
+        if (!connect_socket.empty()) {
+            cerr << "error:[vg map] Cannot both serve (--serve) and be a client (--connect)." << endl;
+            return 1;
+        }
+    } else if (seq.empty() && read_file.empty() && hts_file.empty() && fastq1.empty() && gam_input.empty()) {
         cerr << "error:[vg map] A sequence or read file is required when mapping." << endl;
         return 1;
     }
+    
+    if (!connect_socket.empty()) {
+        // Everything but the inputs is up to the server
+        if (!seq.empty() || !read_file.empty() || !hts_file.empty() || (fastq1.empty() && gam_input.empty())) {
+            cerr << "error:[vg map] A mapping client (--connect) sends FASTQ (-f) or GAM (-G) input." << endl;
+            return 1;
+        }
+        return run_map_client(connect_socket, fastq1, fastq2, gam_input, interleaved_input);
+    }
+
+    if (pack_name.empty() && (pack_only || !pack_edits)) {
+        cerr << "error:[vg map] Coverage pack options (--pack-only, --pack-no-edits) require a pack file (--pack-out)." << endl;
+        return 1;
+    }
+
+    if (!sorted_name.empty() && (pack_only || output_json || refpos_table || !surject_type.empty() || print_fragment_model)) {
+        cerr << "error:[vg map] Sorted GAM output (--sorted-out) cannot be combined with other output formats." << endl;
+        return 1;
+    }
 
     if (!qual.empty() && (seq.length() != qual.length())) {
         cerr << "error:[vg map] Sequence and base quality string must be the same length." << endl;
         return 1;
     }
 
-    if (qual_adjust_alignments && ((fastq1.empty() && hts_file.empty() && qual.empty() && gam_input.empty()) // must have some quality input
+    if (qual_adjust_alignments && ((serve_socket.empty() && fastq1.empty() && hts_file.empty() && qual.empty() && gam_input.empty()) // must have some quality input
                                    || (!seq.empty() && qual.empty())                                         // can't provide sequence without quality
                                    || !read_file.empty()))                                                   // can't provide sequence list without qualities
     {
@@ -533,11 +930,26 @@ int main_map(int argc, char** argv) {
     // Configure its temp directory to the system temp directory
     gcsa::TempFile::setDirectory(find_temp_dir());
 
+    if (use_numa) {
+        // Every thread reads the indexes, so give each NUMA node a share of their pages
+        if (!interleave_numa_allocations() && debug) {
+            cerr << "[vg map] : only one NUMA node, so not spreading the indexes" << endl;
+        }
+    }
+
+    // Watch what loading the indexes allocates, so it can go in huge pages
+    unique_ptr<HugePageLoader> huge_pages;
+    if (use_huge_pages) {
+        huge_pages = unique_ptr<HugePageLoader>(new HugePageLoader());
+    }
+
     // Load up our indexes.
     xg::XG* xgidx = nullptr;
     gcsa::GCSA* gcsa = nullptr;
     gcsa::LCPArray* lcp = nullptr;
     gbwt::GBWT* gbwt = nullptr;
+    DistanceIndex* distance_index = nullptr;
+    MinimizerIndex* minimizer_index = nullptr;
 
     // We try opening the file, and then see if it worked
     ifstream xg_stream(xg_name);
@@ -547,7 +959,8 @@ int main_map(int argc, char** argv) {
         if(debug) {
             cerr << "Loading xg index " << xg_name << "..." << endl;
         }
-        xgidx = new xg::XG(xg_stream);
+        xgidx = new xg::XG();
+        xgidx->load_mapped(xg_name);
     }
 
     ifstream gcsa_stream(gcsa_name);
@@ -579,22 +992,84 @@ int main_map(int argc, char** argv) {
         gbwt = new gbwt::GBWT();
         gbwt->load(gbwt_stream);
     }
+    
+    if (!distance_index_name.empty()) {
+        ifstream distance_index_stream(distance_index_name);
+        if (!distance_index_stream) {
+            cerr << "error:[vg map] could not open distance index " << distance_index_name << endl;
+            return 1;
+        }
+        if (xgidx == nullptr) {
+            cerr << "error:[vg map] distance index requires an xg index" << endl;
+            return 1;
+        }
+        if(debug) {
+            cerr << "Loading distance index " << distance_index_name << "..." << endl;
+        }
+        distance_index = new DistanceIndex(xgidx, distance_index_stream);
+    }
+    
+    if (!minimizer_name.empty()) {
+        ifstream minimizer_stream(minimizer_name);
+        if (!minimizer_stream) {
+            cerr << "error:[vg map] could not open minimizer index " << minimizer_name << endl;
+            return 1;
+        }
+        if(debug) {
+            cerr << "Loading minimizer index " << minimizer_name << "..." << endl;
+        }
+        minimizer_index = new MinimizerIndex();
+        minimizer_index->load(minimizer_stream);
+    }
+
+    if (huge_pages) {
+        if (huge_pages->back_new_mappings()) {
+            cerr << "[vg map] " << huge_pages->huge_page_bytes() / (1024 * 1024) << " of "
+                 << huge_pages->mapped_bytes() / (1024 * 1024) << " MB of index memory is in huge pages" << endl;
+        } else {
+            cerr << "warning:[vg map] transparent huge pages are not available, so the indexes are in normal pages" << endl;
+        }
+    }
 
     thread_count = get_thread_count();
 
+    if (use_numa) {
+        // Everything from here on belongs to one thread, or is written by one, so keep it local
+        local_numa_allocations();
+        if (!pin_omp_threads()) {
+            cerr << "warning:[vg map] could not pin threads to CPUs" << endl;
+        }
+    }
+
     vector<Mapper*> mapper;
     mapper.resize(thread_count);
     vector<vector<Alignment> > output_buffer;
     output_buffer.resize(thread_count);
+    // GAM output is compressed and written in the background
+    unique_ptr<stream::AsyncEmitter<Alignment>> emitter;
     vector<Alignment> empty_alns;
+    // all threads add coverage to one shared packer as they map, instead of it being read back out of the GAM
+    unique_ptr<Packer> packer;
+    if (!pack_name.empty()) {
+        packer = unique_ptr<Packer>(new Packer(xgidx, 0, thread_count > 1));
+    }
+    // sorted output is collected into sorted runs as the threads map, and merged at the end
+    unique_ptr<GAMSorter> sorter;
+    if (!sorted_name.empty()) {
+        sorter = unique_ptr<GAMSorter>(new GAMSorter());
+        sorter->begin_incremental_sort();
+    }
 
     // bam/sam/cram output
     samFile* sam_out = 0;
     int buffer_limit = 100;
     bam_hdr_t* hdr = nullptr;
-    int compress_level = 9; // hard coded
     map<string, string> rg_sample;
     string sam_header;
+    // the header's number for each path, to put in the BAM records
+    unordered_map<string, int32_t> path_tid;
+    // BAM records each thread encodes its surjections into, reused between batches
+    vector<vector<bam1_t*>> bam_records(thread_count);
 
     // if no paths were given take all of those in the index
     set<string> path_names;
@@ -605,7 +1080,7 @@ int main_map(int argc, char** argv) {
     }
 
     // for SAM header generation
-    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header] (void) {
+    auto setup_sam_header = [&hdr, &sam_out, &surject_type, &compress_level, &xgidx, &rg_sample, &sam_header, &path_tid] (void) {
 #pragma omp critical (hts_header)
         if (!hdr) {
             char out_mode[5];
@@ -627,10 +1102,17 @@ int main_map(int argc, char** argv) {
                 path_length[name] = xgidx->path_length(name);
             }
             hdr = hts_string_header(sam_header, path_length, rg_sample);
+            for (int32_t i = 0; i < hdr->n_targets; ++i) {
+                path_tid[hdr->target_name[i]] = i;
+            }
             if ((sam_out = sam_open("-", out_mode)) == 0) {
                 cerr << "[vg surject] failed to open stdout for writing HTS output" << endl;
                 exit(1);
             } else {
+                // compress BGZF blocks on all our threads
+                if (get_thread_count() > 1) {
+                    hts_set_threads(sam_out, get_thread_count());
+                }
                 // write the header
                 if (sam_hdr_write(sam_out, hdr) != 0) {
                     cerr << "[vg surject] error: failed to write the SAM header" << endl;
@@ -639,7 +1121,7 @@ int main_map(int argc, char** argv) {
         }
     };
 
-    auto surject_alignments = [&hdr, &sam_header, &mapper, &rg_sample, &setup_sam_header, &path_names, &sam_out] (const vector<Alignment>& alns) {
+    auto surject_alignments = [&hdr, &path_tid, &bam_records, &mapper, &rg_sample, &setup_sam_header, &path_names, &sam_out] (const vector<Alignment>& alns) {
         if (alns.empty()) return;
         setup_sam_header();
         vector<tuple<string, int64_t, bool, Alignment> > surjects;
@@ -654,27 +1136,34 @@ int main_map(int argc, char** argv) {
                 rg_sample[surj.read_group()] = surj.sample_name();
             }
         }
-        // write out the surjections
-        for (auto& s : surjects) {
-            auto& path_nom = get<0>(s);
-            auto& path_pos = get<1>(s);
-            auto& path_reverse = get<2>(s);
-            auto& surj = get<3>(s);
-            string cigar = cigar_against_path(surj, path_reverse);
-            bam1_t* b = alignment_to_bam(sam_header,
-                                         surj,
-                                         path_nom,
-                                         path_pos,
-                                         path_reverse,
-                                         cigar,
-                                         "=",
-                                         path_pos,
-                                         0);
-            int r = 0;
+        // encode the surjections on this thread, then write them out together
+        auto& records = bam_records[tid];
+        while (records.size() < surjects.size()) {
+            records.push_back(bam_init1());
+        }
+        vector<uint32_t> cigar;
+        for (size_t i = 0; i < surjects.size(); ++i) {
+            auto& path_nom = get<0>(surjects[i]);
+            auto& path_pos = get<1>(surjects[i]);
+            auto& path_reverse = get<2>(surjects[i]);
+            auto& surj = get<3>(surjects[i]);
+            auto found = path_tid.find(path_nom);
+            int32_t tid_in_header = found == path_tid.end() ? -1 : found->second;
+            cigar_against_path(surj, path_reverse, cigar);
+            alignment_to_bam(surj,
+                             tid_in_header,
+                             path_pos,
+                             path_reverse,
+                             cigar,
+                             tid_in_header,
+                             path_pos,
+                             0,
+                             records[i]);
+        }
 #pragma omp critical (cout)
-            r = sam_write1(sam_out, hdr, b);
+        for (size_t i = 0; i < surjects.size(); ++i) {
+            int r = sam_write1(sam_out, hdr, records[i]);
             if (r == 0) { cerr << "[vg surject] error: writing to stdout failed" << endl; exit(1); }
-            bam_destroy1(b);
         }
     };
 
@@ -702,14 +1191,36 @@ int main_map(int argc, char** argv) {
     // We have one function to dump alignments into
     // Make sure to flush the buffer at the end of the program!
     auto output_alignments = [&output_buffer,
+                              &emitter,
                               &output_json,
                               &surject_type,
                               &surject_alignments,
                               &buffer_size,
                               &refpos_table,
                               &write_json,
-                              &write_refpos](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
-        if (output_json) {
+                              &write_refpos,
+                              &packer,
+                              &sorter,
+                              &pack_only,
+                              &pack_edits](const vector<Alignment>& alns1, const vector<Alignment>& alns2) {
+        if (packer) {
+            for (auto& aln : alns1) {
+                packer->add(aln, pack_edits);
+            }
+            for (auto& aln : alns2) {
+                packer->add(aln, pack_edits);
+            }
+        }
+        if (pack_only) {
+            // coverage is all we want
+        } else if (sorter) {
+            for (auto& aln : alns1) {
+                sorter->add_to_sort(aln);
+            }
+            for (auto& aln : alns2) {
+                sorter->add_to_sort(aln);
+            }
+        } else if (output_json) {
             // If we want to convert to JSON, convert them all to JSON and dump them to cout.
 #pragma omp critical (cout)
             {
@@ -736,20 +1247,29 @@ int main_map(int argc, char** argv) {
             copy(alns1.begin(), alns1.end(), back_inserter(output_buf));
             copy(alns2.begin(), alns2.end(), back_inserter(output_buf));
 
-            stream::write_buffered(cout, output_buf, buffer_size);
+            emitter->emit_buffered(output_buf, buffer_size);
         }
+        
+        // Nothing built for these reads is needed any more
+        Mapper::reset_scratch_arena();
     };
 
-    for (int i = 0; i < thread_count; ++i) {
-        Mapper* m = nullptr;
-        if(xgidx && gcsa && lcp) {
-            // We have the xg and GCSA indexes, so use them
-            m = new Mapper(xgidx, gcsa, lcp, gbwt);
-        } else {
-            // Can't continue with null
-            throw runtime_error("Need XG, GCSA, and LCP to create a Mapper");
-        }
+    if (!(xgidx && ((gcsa && lcp) || minimizer_index))) {
+        // Can't continue with null
+        throw runtime_error("Need XG, and GCSA and LCP or a minimizer index, to create a Mapper");
+    }
+    // One cache of the results for duplicate reads, shared by all the threads' mappers
+    unique_ptr<DuplicateReadCache<vector<Alignment>>> duplicate_cache;
+    if (duplicate_cache_size > 0) {
+        duplicate_cache.reset(new DuplicateReadCache<vector<Alignment>>(duplicate_cache_size));
+    }
+    auto make_mapper = [&](int i) {
+        // We have the xg and GCSA indexes (or minimizers to seed with instead), so use them
+        Mapper* m = new Mapper(xgidx, gcsa, lcp, gbwt);
+        m->distance_index = distance_index;
+        m->minimizer_index = minimizer_index;
         m->hit_max = hit_max;
+        m->hit_max_sample = hit_sample;
         m->max_multimaps = max_multimaps;
         m->min_multimaps = min_multimaps;
         m->band_multimaps = band_multimaps;
@@ -757,6 +1277,9 @@ int main_map(int argc, char** argv) {
         m->debug = debug;
         m->min_identity = min_score;
         m->drop_chain = drop_chain;
+        m->use_sparse_chaining = use_sparse_chaining;
+        m->max_chaining_hits = max_chaining_hits;
+        m->long_read_chaining = long_read_chaining;
         m->mq_overlap = mq_overlap;
         m->min_mem_length = (min_mem_length > 0 ? min_mem_length
                              : m->random_match_length(chance_match));
@@ -788,171 +1311,99 @@ int main_map(int argc, char** argv) {
         m->frag_stats.fragment_model_update_interval = fragment_model_update;
         m->max_mapping_quality = max_mapping_quality;
         m->mate_rescues = mate_rescues;
+        m->rescue_seed_length = rescue_seed_length;
         m->max_band_jump = max_band_jump > -1 ? max_band_jump : band_width;
         m->identity_weight = identity_weight;
         m->assume_acyclic = acyclic_graph;
         m->context_depth = 3; // for surjection
         m->patch_alignments = patch_alignments;
+        m->duplicate_cache = duplicate_cache.get();
         mapper[i] = m;
-    }
-
-    if (!seq.empty()) {
-        int tid = omp_get_thread_num();
-
-        Alignment unaligned;
-        unaligned.set_sequence(seq);
-
-        if (!qual.empty()) {
-            unaligned.set_quality(qual);
-        }
-
-        vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width);
-        if(alignments.size() == 0) {
-            // If we didn't have any alignments, report the unaligned alignment
-            alignments.push_back(unaligned);
+    };
+    if (use_numa) {
+        // Each thread builds its own mapper, so its memory lands on the thread's node
+#pragma omp parallel for schedule(static, 1) num_threads(thread_count)
+        for (int i = 0; i < thread_count; ++i) {
+            make_mapper(i);
         }
-
-
-        for(auto& alignment : alignments) {
-            if (!sample_name.empty()) alignment.set_sample_name(sample_name);
-            if (!read_group.empty()) alignment.set_read_group(read_group);
-            if (!seq_name.empty()) alignment.set_name(seq_name);
+    } else {
+        for (int i = 0; i < thread_count; ++i) {
+            make_mapper(i);
         }
-
-        // Output the alignments in JSON or protobuf as appropriate.
-        output_alignments(alignments, empty_alns);
     }
 
-    if (!read_file.empty()) {
-        ifstream in(read_file);
-        bool more_data = in.good();
-#pragma omp parallel shared(in)
-        {
-            string line;
+    // Map all the reads in the inputs, and write out all their alignments
+    auto map_inputs = [&]() {
+        if (!output_json && !refpos_table && surject_type.empty() && !pack_only && !sorter) {
+            emitter = unique_ptr<stream::AsyncEmitter<Alignment>>(new stream::AsyncEmitter<Alignment>(cout));
+        }
+        
+        if (!seq.empty()) {
             int tid = omp_get_thread_num();
-            while (in.good()) {
-                line.clear();
-#pragma omp critical (readq)
-                {
-                    std::getline(in,line);
-                }
-                if (!line.empty()) {
-                    // Make an alignment
-                    Alignment unaligned;
-                    unaligned.set_sequence(line);
 
-                    vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width);
+            Alignment unaligned;
+            unaligned.set_sequence(seq);
 
-                    for(auto& alignment : alignments) {
-                        // Set the alignment metadata
-                        if (!sample_name.empty()) alignment.set_sample_name(sample_name);
-                        if (!read_group.empty()) alignment.set_read_group(read_group);
-                    }
+            if (!qual.empty()) {
+                unaligned.set_quality(qual);
+            }
 
+            vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width);
+            if(alignments.size() == 0) {
+                // If we didn't have any alignments, report the unaligned alignment
+                alignments.push_back(unaligned);
+            }
 
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments, empty_alns);
-                }
+
+            for(auto& alignment : alignments) {
+                if (!sample_name.empty()) alignment.set_sample_name(sample_name);
+                if (!read_group.empty()) alignment.set_read_group(read_group);
+                if (!seq_name.empty()) alignment.set_name(seq_name);
             }
+
+            // Output the alignments in JSON or protobuf as appropriate.
+            output_alignments(alignments, empty_alns);
         }
-    }
 
-    if (!hts_file.empty()) {
-        function<void(Alignment&)> lambda =
-            [&mapper,
-             &output_alignments,
-             &keep_secondary,
-             &kmer_size,
-             &kmer_stride,
-             &max_mem_length,
-             &band_width,
-             &empty_alns]
-                (Alignment& alignment) {
-
-                    if(alignment.is_secondary() && !keep_secondary) {
-                        // Skip over secondary alignments in the input; we don't want several output mappings for each input *mapping*.
-                        return;
+        if (!read_file.empty()) {
+            ifstream in(read_file);
+            bool more_data = in.good();
+    #pragma omp parallel shared(in)
+            {
+                string line;
+                int tid = omp_get_thread_num();
+                while (in.good()) {
+                    line.clear();
+    #pragma omp critical (readq)
+                    {
+                        std::getline(in,line);
                     }
+                    if (!line.empty()) {
+                        // Make an alignment
+                        Alignment unaligned;
+                        unaligned.set_sequence(line);
 
-                    int tid = omp_get_thread_num();
-                    vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
+                        vector<Alignment> alignments = mapper[tid]->align_multi(unaligned, kmer_size, kmer_stride, max_mem_length, band_width);
 
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alignments, empty_alns);
-                };
-        // run
-        hts_for_each_parallel(hts_file, lambda);
-    }
-
-    if (!fastq1.empty()) {
-        if (interleaved_input) {
-            // paired interleaved
-            auto output_func = [&output_alignments,
-                                &compare_gam,
-                                &print_fragment_model]
-                (Alignment& aln1,
-                 Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
-                if (!print_fragment_model) {
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    output_alignments(alnp.first, alnp.second);
-                }
-            };
-            function<void(Alignment&,Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &pair_window,
-                 &top_pairs_only,
-                 &print_fragment_model,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                bool queued_resolve_later = false;
-                auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->frag_stats.fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later,
-                                                                       max_mem_length,
-                                                                       top_pairs_only,
-                                                                       true);
-                            output_func(p.first, p.second, alnp);
+                        for(auto& alignment : alignments) {
+                            // Set the alignment metadata
+                            if (!sample_name.empty()) alignment.set_sample_name(sample_name);
+                            if (!read_group.empty()) alignment.set_read_group(read_group);
                         }
-                        our_mapper->imperfect_pairs_to_retry.clear();
+
+
+                        // Output the alignments in JSON or protobuf as appropriate.
+                        output_alignments(alignments, empty_alns);
                     }
                 }
-            };
-            fastq_paired_interleaved_for_each_parallel(fastq1, lambda);
-#pragma omp parallel
-            { // clean up buffered alignments that weren't perfect
-                auto our_mapper = mapper[omp_get_thread_num()];
-                // if we haven't yet computed these, assume we couldn't get an estimate for fragment size
-                our_mapper->frag_stats.fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                    bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later,
-                                                               max_mem_length,
-                                                               top_pairs_only,
-                                                               true);
-                    output_func(p.first, p.second, alnp);
-                }
-                our_mapper->imperfect_pairs_to_retry.clear();
             }
-        } else if (fastq2.empty()) {
-            // single
+        }
+
+        if (!hts_file.empty()) {
             function<void(Alignment&)> lambda =
                 [&mapper,
                  &output_alignments,
+                 &keep_secondary,
                  &kmer_size,
                  &kmer_stride,
                  &max_mem_length,
@@ -960,173 +1411,402 @@ int main_map(int argc, char** argv) {
                  &empty_alns]
                     (Alignment& alignment) {
 
+                        if(alignment.is_secondary() && !keep_secondary) {
+                            // Skip over secondary alignments in the input; we don't want several output mappings for each input *mapping*.
+                            return;
+                        }
+
                         int tid = omp_get_thread_num();
                         vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-                        //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
+
+                        // Output the alignments in JSON or protobuf as appropriate.
                         output_alignments(alignments, empty_alns);
                     };
-            fastq_unpaired_for_each_parallel(fastq1, lambda);
-        } else {
-            // paired two-file
-            auto output_func = [&output_alignments,
-                                &print_fragment_model]
-                (Alignment& aln1,
-                 Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
-                // Make sure we have unaligned "alignments" for things that don't align.
-                // Output the alignments in JSON or protobuf as appropriate.
-                if (!print_fragment_model) {
-                    output_alignments(alnp.first, alnp.second);
-                }
-            };
-            function<void(Alignment&,Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &pair_window,
-                 &top_pairs_only,
-                 &print_fragment_model,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                bool queued_resolve_later = false;
-                auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->frag_stats.fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later,
-                                                                       max_mem_length,
-                                                                       top_pairs_only,
-                                                                       true);
-                            output_func(p.first, p.second, alnp);
+            // run
+            hts_for_each_parallel(hts_file, lambda);
+        }
+
+        if (!fastq1.empty()) {
+            if (interleaved_input) {
+                // paired interleaved
+                auto output_func = [&output_alignments,
+                                    &compare_gam,
+                                    &print_fragment_model]
+                    (Alignment& aln1,
+                     Alignment& aln2,
+                     pair<vector<Alignment>, vector<Alignment>>& alnp) {
+                    if (!print_fragment_model) {
+                        // Output the alignments in JSON or protobuf as appropriate.
+                        output_alignments(alnp.first, alnp.second);
+                    } else {
+                        Mapper::reset_scratch_arena();
+                    }
+                };
+                function<void(Alignment&,Alignment&)> lambda =
+                    [&mapper,
+                     &output_alignments,
+                     &keep_secondary,
+                     &kmer_size,
+                     &kmer_stride,
+                     &max_mem_length,
+                     &band_width,
+                     &pair_window,
+                     &top_pairs_only,
+                     &print_fragment_model,
+                     &output_func](Alignment& aln1, Alignment& aln2) {
+                    auto our_mapper = mapper[omp_get_thread_num()];
+                    bool queued_resolve_later = false;
+                    auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
+                    if (!queued_resolve_later) {
+                        output_func(aln1, aln2, alnp);
+                        // check if we should try to align the queued alignments
+                        if (our_mapper->frag_stats.fragment_size != 0
+                            && !our_mapper->imperfect_pairs_to_retry.empty()) {
+                            int i = 0;
+                            for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                                auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                                           queued_resolve_later,
+                                                                           max_mem_length,
+                                                                           top_pairs_only,
+                                                                           true);
+                                output_func(p.first, p.second, alnp);
+                            }
+                            our_mapper->imperfect_pairs_to_retry.clear();
                         }
-                        our_mapper->imperfect_pairs_to_retry.clear();
                     }
+                };
+                fastq_paired_interleaved_for_each_parallel(fastq1, lambda);
+    #pragma omp parallel
+                { // clean up buffered alignments that weren't perfect
+                    auto our_mapper = mapper[omp_get_thread_num()];
+                    // if we haven't yet computed these, assume we couldn't get an estimate for fragment size
+                    if (!our_mapper->frag_stats.fragment_size) {
+                        our_mapper->frag_stats.fragment_size = fragment_max;
+                    }
+                    for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                        bool queued_resolve_later = false;
+                        auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                                   queued_resolve_later,
+                                                                   max_mem_length,
+                                                                   top_pairs_only,
+                                                                   true);
+                        output_func(p.first, p.second, alnp);
+                    }
+                    our_mapper->imperfect_pairs_to_retry.clear();
                 }
-            };
-            fastq_paired_two_files_for_each_parallel(fastq1, fastq2, lambda);
-#pragma omp parallel
-            {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                our_mapper->frag_stats.fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
+            } else if (fastq2.empty()) {
+                // single
+                function<void(Alignment&)> lambda =
+                    [&mapper,
+                     &output_alignments,
+                     &kmer_size,
+                     &kmer_stride,
+                     &max_mem_length,
+                     &band_width,
+                     &empty_alns]
+                        (Alignment& alignment) {
+
+                            int tid = omp_get_thread_num();
+                            vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
+                            //cerr << "This is just before output_alignments" << alignment.DebugString() << endl;
+                            output_alignments(alignments, empty_alns);
+                        };
+                fastq_unpaired_for_each_parallel(fastq1, lambda);
+            } else {
+                // paired two-file
+                auto output_func = [&output_alignments,
+                                    &print_fragment_model]
+                    (Alignment& aln1,
+                     Alignment& aln2,
+                     pair<vector<Alignment>, vector<Alignment>>& alnp) {
+                    // Make sure we have unaligned "alignments" for things that don't align.
+                    // Output the alignments in JSON or protobuf as appropriate.
+                    if (!print_fragment_model) {
+                        output_alignments(alnp.first, alnp.second);
+                    } else {
+                        Mapper::reset_scratch_arena();
+                    }
+                };
+                function<void(Alignment&,Alignment&)> lambda =
+                    [&mapper,
+                     &output_alignments,
+                     &keep_secondary,
+                     &kmer_size,
+                     &kmer_stride,
+                     &max_mem_length,
+                     &band_width,
+                     &pair_window,
+                     &top_pairs_only,
+                     &print_fragment_model,
+                     &output_func](Alignment& aln1, Alignment& aln2) {
+                    auto our_mapper = mapper[omp_get_thread_num()];
                     bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later,
-                                                               max_mem_length,
-                                                               top_pairs_only,
-                                                               true);
-                    output_func(p.first, p.second, alnp);
+                    auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
+                    if (!queued_resolve_later) {
+                        output_func(aln1, aln2, alnp);
+                        // check if we should try to align the queued alignments
+                        if (our_mapper->frag_stats.fragment_size != 0
+                            && !our_mapper->imperfect_pairs_to_retry.empty()) {
+                            int i = 0;
+                            for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                                auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                                           queued_resolve_later,
+                                                                           max_mem_length,
+                                                                           top_pairs_only,
+                                                                           true);
+                                output_func(p.first, p.second, alnp);
+                            }
+                            our_mapper->imperfect_pairs_to_retry.clear();
+                        }
+                    }
+                };
+                fastq_paired_two_files_for_each_parallel(fastq1, fastq2, lambda);
+    #pragma omp parallel
+                {
+                    auto our_mapper = mapper[omp_get_thread_num()];
+                    if (!our_mapper->frag_stats.fragment_size) {
+                        our_mapper->frag_stats.fragment_size = fragment_max;
+                    }
+                    for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                        bool queued_resolve_later = false;
+                        auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                                   queued_resolve_later,
+                                                                   max_mem_length,
+                                                                   top_pairs_only,
+                                                                   true);
+                        output_func(p.first, p.second, alnp);
+                    }
+                    our_mapper->imperfect_pairs_to_retry.clear();
                 }
-                our_mapper->imperfect_pairs_to_retry.clear();
             }
         }
-    }
 
-    if (!gam_input.empty()) {
-        ifstream gam_in(gam_input);
-        if (interleaved_input) {
-            auto output_func = [&output_alignments,
-                                &compare_gam,
-                                &print_fragment_model]
-                (Alignment& aln1,
-                 Alignment& aln2,
-                 pair<vector<Alignment>, vector<Alignment>>& alnp) {
-                if (print_fragment_model) {
-                    // do nothing
-                } else {
-                    // Output the alignments in JSON or protobuf as appropriate.
-                    if (compare_gam) {
-                        alnp.first.front().set_correct(overlap(aln1.path(), alnp.first.front().path()));
-                        alnp.second.front().set_correct(overlap(aln2.path(), alnp.second.front().path()));
-                    }
-                    output_alignments(alnp.first, alnp.second);
-                }
-            };
-            function<void(Alignment&,Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &compare_gam,
-                 &pair_window,
-                 &top_pairs_only,
-                 &print_fragment_model,
-                 &output_func](Alignment& aln1, Alignment& aln2) {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                bool queued_resolve_later = false;
-                auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
-                if (!queued_resolve_later) {
-                    output_func(aln1, aln2, alnp);
-                    // check if we should try to align the queued alignments
-                    if (our_mapper->frag_stats.fragment_size != 0
-                        && !our_mapper->imperfect_pairs_to_retry.empty()) {
-                        int i = 0;
-                        for (auto p : our_mapper->imperfect_pairs_to_retry) {
-                            auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                                       queued_resolve_later,
-                                                                       max_mem_length,
-                                                                       top_pairs_only,
-                                                                       true);
-                            output_func(p.first, p.second, alnp);
+        if (!gam_input.empty()) {
+            ifstream gam_file;
+            if (gam_input != "-") {
+                gam_file.open(gam_input);
+            }
+            istream& gam_in = (gam_input != "-") ? gam_file : cin;
+            if (interleaved_input) {
+                auto output_func = [&output_alignments,
+                                    &compare_gam,
+                                    &print_fragment_model]
+                    (Alignment& aln1,
+                     Alignment& aln2,
+                     pair<vector<Alignment>, vector<Alignment>>& alnp) {
+                    if (print_fragment_model) {
+                        // nothing to output, but we are done with this pair
+                        Mapper::reset_scratch_arena();
+                    } else {
+                        // Output the alignments in JSON or protobuf as appropriate.
+                        if (compare_gam) {
+                            alnp.first.front().set_correct(overlap(aln1.path(), alnp.first.front().path()));
+                            alnp.second.front().set_correct(overlap(aln2.path(), alnp.second.front().path()));
                         }
-                        our_mapper->imperfect_pairs_to_retry.clear();
+                        output_alignments(alnp.first, alnp.second);
                     }
-                }
-            };
-            stream::for_each_interleaved_pair_parallel(gam_in, lambda);
-#pragma omp parallel
-            {
-                auto our_mapper = mapper[omp_get_thread_num()];
-                our_mapper->frag_stats.fragment_size = fragment_max;
-                for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                };
+                function<void(Alignment&,Alignment&)> lambda =
+                    [&mapper,
+                     &output_alignments,
+                     &keep_secondary,
+                     &kmer_size,
+                     &kmer_stride,
+                     &max_mem_length,
+                     &band_width,
+                     &compare_gam,
+                     &pair_window,
+                     &top_pairs_only,
+                     &print_fragment_model,
+                     &output_func](Alignment& aln1, Alignment& aln2) {
+                    auto our_mapper = mapper[omp_get_thread_num()];
                     bool queued_resolve_later = false;
-                    auto alnp = our_mapper->align_paired_multi(p.first, p.second,
-                                                               queued_resolve_later,
-                                                               max_mem_length,
-                                                               top_pairs_only,
-                                                               true);
-                    output_func(p.first, p.second, alnp);
+                    auto alnp = our_mapper->align_paired_multi(aln1, aln2, queued_resolve_later, max_mem_length, top_pairs_only, false);
+                    if (!queued_resolve_later) {
+                        output_func(aln1, aln2, alnp);
+                        // check if we should try to align the queued alignments
+                        if (our_mapper->frag_stats.fragment_size != 0
+                            && !our_mapper->imperfect_pairs_to_retry.empty()) {
+                            int i = 0;
+                            for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                                auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                                           queued_resolve_later,
+                                                                           max_mem_length,
+                                                                           top_pairs_only,
+                                                                           true);
+                                output_func(p.first, p.second, alnp);
+                            }
+                            our_mapper->imperfect_pairs_to_retry.clear();
+                        }
+                    }
+                };
+                stream::for_each_interleaved_pair_parallel(gam_in, lambda);
+    #pragma omp parallel
+                {
+                    auto our_mapper = mapper[omp_get_thread_num()];
+                    if (!our_mapper->frag_stats.fragment_size) {
+                        our_mapper->frag_stats.fragment_size = fragment_max;
+                    }
+                    for (auto p : our_mapper->imperfect_pairs_to_retry) {
+                        bool queued_resolve_later = false;
+                        auto alnp = our_mapper->align_paired_multi(p.first, p.second,
+                                                                   queued_resolve_later,
+                                                                   max_mem_length,
+                                                                   top_pairs_only,
+                                                                   true);
+                        output_func(p.first, p.second, alnp);
+                    }
+                    our_mapper->imperfect_pairs_to_retry.clear();
                 }
-                our_mapper->imperfect_pairs_to_retry.clear();
+            } else {
+                function<void(Alignment&)> lambda =
+                    [&mapper,
+                     &output_alignments,
+                     &keep_secondary,
+                     &kmer_size,
+                     &kmer_stride,
+                     &max_mem_length,
+                     &band_width,
+                     &compare_gam,
+                     &empty_alns]
+                    (Alignment& alignment) {
+                    int tid = omp_get_thread_num();
+                    std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+                    vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
+                    std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
+                    std::chrono::duration<double> elapsed_seconds = end-start;
+                    // Output the alignments in JSON or protobuf as appropriate.
+                    if (compare_gam) {
+                        alignments.front().set_correct(overlap(alignment.path(), alignments.front().path()));
+                    }
+                    output_alignments(alignments, empty_alns);
+                };
+                stream::for_each_parallel(gam_in, lambda);
             }
-        } else {
-            function<void(Alignment&)> lambda =
-                [&mapper,
-                 &output_alignments,
-                 &keep_secondary,
-                 &kmer_size,
-                 &kmer_stride,
-                 &max_mem_length,
-                 &band_width,
-                 &compare_gam,
-                 &empty_alns]
-                (Alignment& alignment) {
-                int tid = omp_get_thread_num();
-                std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
-                vector<Alignment> alignments = mapper[tid]->align_multi(alignment, kmer_size, kmer_stride, max_mem_length, band_width);
-                std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
-                std::chrono::duration<double> elapsed_seconds = end-start;
-                // Output the alignments in JSON or protobuf as appropriate.
-                if (compare_gam) {
-                    alignments.front().set_correct(overlap(alignment.path(), alignments.front().path()));
+        }
+
+        if (emitter) {
+            // Flush what's left in the buffers, and let the background writes
+            // finish before anything else touches cout.
+            for (auto& output_buf : output_buffer) {
+                emitter->emit_buffered(output_buf, 0);
+            }
+            emitter->finish();
+        }
+        emitter.reset();
+        
+        // special cleanup for htslib outputs
+        if (sam_out != 0) {
+            sam_close(sam_out);
+            sam_out = 0;
+        }
+        if (hdr != nullptr) {
+            bam_hdr_destroy(hdr);
+            hdr = nullptr;
+        }
+        for (auto& records : bam_records) {
+            for (auto b : records) {
+                bam_destroy1(b);
+            }
+            records.clear();
+        }
+        cout.flush();
+    };
+    
+    if (serve_socket.empty()) {
+        map_inputs();
+    } else {
+        int server_fd = listen_on_socket(serve_socket);
+        if (server_fd < 0) {
+            cerr << "error:[vg map] could not listen on socket " << serve_socket << endl;
+            return 1;
+        }
+        // A client going away should only end its own request
+        signal(SIGPIPE, SIG_IGN);
+        
+        // Each client's connection stands in for stdin and stdout while we map its reads,
+        // so keep the real ones to put back
+        int real_stdin = dup(STDIN_FILENO);
+        int real_stdout = dup(STDOUT_FILENO);
+        cerr << "[vg map] serving on " << serve_socket << endl;
+        
+        while (true) {
+            int client_fd = accept(server_fd, nullptr, nullptr);
+            if (client_fd < 0) {
+                if (errno == EINTR) {
+                    continue;
                 }
-                output_alignments(alignments, empty_alns);
-            };
-            stream::for_each_parallel(gam_in, lambda);
+                cerr << "error:[vg map] could not accept connections on socket " << serve_socket << endl;
+                break;
+            }
+            
+            string request;
+            if (!read_request_line(client_fd, request)) {
+                close(client_fd);
+                continue;
+            }
+            stringstream request_stream(request);
+            string input_type, pairing;
+            request_stream >> input_type >> pairing;
+            if (input_type != "fastq" && input_type != "gam") {
+                cerr << "warning:[vg map] ignoring unknown request \"" << request << "\"" << endl;
+                close(client_fd);
+                continue;
+            }
+            fastq1 = (input_type == "fastq") ? "-" : "";
+            gam_input = (input_type == "gam") ? "-" : "";
+            interleaved_input = (pairing == "interleaved");
+            if (debug) {
+                cerr << "[vg map] mapping " << request << " request" << endl;
+            }
+            
+            dup2(client_fd, STDIN_FILENO);
+            dup2(client_fd, STDOUT_FILENO);
+            close(client_fd);
+            
+            map_inputs();
+            
+            // Hang up on the client by putting back the real stdin and stdout
+            fflush(stdout);
+            dup2(real_stdin, STDIN_FILENO);
+            dup2(real_stdout, STDOUT_FILENO);
+            clearerr(stdin);
+            cin.clear();
+            cout.clear();
+        }
+        
+        close(server_fd);
+        close(real_stdin);
+        close(real_stdout);
+    }
+
+    if (debug) {
+        auto arena_stats = Mapper::get_scratch_arena_stats();
+        cerr << "[vg map] scratch arenas: " << arena_stats.resets << " resets, "
+             << arena_stats.total_bytes << " bytes allocated, "
+             << arena_stats.peak_bytes << " bytes at peak" << endl;
+    }
+
+    if (packer) {
+        packer->save_to_file(pack_name);
+    }
+
+    if (sorter) {
+        {
+            // the index points at blocks, so write the sorted GAM in blocks
+            ofstream sorted_out(sorted_name);
+            if (!sorted_out) {
+                cerr << "error:[vg map] Cannot write sorted GAM " << sorted_name << endl;
+                return 1;
+            }
+            stream::set_output_blocked(true);
+            sorter->finish_incremental_sort(sorted_out);
         }
-        gam_in.close();
+        sorter->write_index(sorted_name, sorted_name + ".gai", true);
+    }
+
+    if (profile_stages) {
+        StageProfiler::write_json(cerr);
     }
 
     if (print_fragment_model) {
@@ -1141,19 +1821,16 @@ int main_map(int argc, char** argv) {
     // clean up
     for (int i = 0; i < thread_count; ++i) {
         delete mapper[i];
-        auto& output_buf = output_buffer[i];
-        if (!output_json && !refpos_table && surject_type.empty()) {
-            stream::write_buffered(cout, output_buf, 0);
-        }
     }
 
-    // special cleanup for htslib outputs
-    if (!surject_type.empty()) {
-        if (hdr != nullptr) bam_hdr_destroy(hdr);
-        sam_close(sam_out);
-        cout.flush();
+    if (distance_index) {
+        delete distance_index;
+        distance_index = nullptr;
+    }
+    if (minimizer_index) {
+        delete minimizer_index;
+        minimizer_index = nullptr;
     }
-
     if (gbwt) {
         delete gbwt;
         gbwt = nullptr;
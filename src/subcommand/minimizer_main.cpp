@@ -0,0 +1,175 @@
+/** \file minimizer_main.cpp
+ *
+ * Defines the "vg minimizer" subcommand, which builds a minimizer index of the
+ * paths or haplotypes in a graph, for seeding vg map and vg mpmap without a
+ * GCSA2 index.
+ */
+
+
+#include <omp.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <fstream>
+
+#include "subcommand.hpp"
+
+#include "../minimizer_index.hpp"
+#include "../utility.hpp"
+
+
+using namespace std;
+using namespace vg;
+using namespace vg::subcommand;
+
+void help_minimizer(char** argv) {
+    cerr << "usage: " << argv[0] << " minimizer [options] -x graph.xg -o graph.min" << endl
+         << "Index the minimizers of the paths or haplotypes in a graph." << endl
+         << endl
+         << "options:" << endl
+         << "    -x, --xg-name FILE      index the paths of the graph in this xg index (required)" << endl
+         << "    -g, --gbwt-name FILE    index the haplotypes in this GBWT instead of the xg paths" << endl
+         << "    -o, --output FILE       write the index to FILE (required)" << endl
+         << "    -k, --kmer-length N     length of the minimizer k-mers, at most 31 [21]" << endl
+         << "    -w, --window-length N   take one minimizer per window of N k-mers [11]" << endl
+         << "    -t, --threads N         number of threads to use" << endl
+         << "    -p, --progress          show progress" << endl;
+}
+
+int main_minimizer(int argc, char** argv) {
+
+    if (argc == 2) {
+        help_minimizer(argv);
+        return 1;
+    }
+
+    string xg_name;
+    string gbwt_name;
+    string output_name;
+    int kmer_length = 21;
+    int window_length = 11;
+    bool show_progress = false;
+
+    int c;
+    optind = 2; // force optind past command positional argument
+    while (true) {
+        static struct option long_options[] =
+        {
+            {"xg-name", required_argument, 0, 'x'},
+            {"gbwt-name", required_argument, 0, 'g'},
+            {"output", required_argument, 0, 'o'},
+            {"kmer-length", required_argument, 0, 'k'},
+            {"window-length", required_argument, 0, 'w'},
+            {"threads", required_argument, 0, 't'},
+            {"progress", no_argument, 0, 'p'},
+            {"help", no_argument, 0, 'h'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        c = getopt_long (argc, argv, "x:g:o:k:w:t:ph?",
+                         long_options, &option_index);
+
+        // Detect the end of the options.
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 'x':
+            xg_name = optarg;
+            break;
+
+        case 'g':
+            gbwt_name = optarg;
+            break;
+
+        case 'o':
+            output_name = optarg;
+            break;
+
+        case 'k':
+            kmer_length = atoi(optarg);
+            break;
+
+        case 'w':
+            window_length = atoi(optarg);
+            break;
+
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
+        case 'p':
+            show_progress = true;
+            break;
+
+        case 'h':
+        case '?':
+            help_minimizer(argv);
+            exit(1);
+            break;
+
+        default:
+            abort ();
+        }
+    }
+
+    if (xg_name.empty()) {
+        cerr << "error:[vg minimizer] an xg index is required (-x)" << endl;
+        return 1;
+    }
+    if (output_name.empty()) {
+        cerr << "error:[vg minimizer] an output file is required (-o)" << endl;
+        return 1;
+    }
+    if (kmer_length <= 0 || kmer_length > 31 || window_length <= 0) {
+        cerr << "error:[vg minimizer] k-mer length must be between 1 and 31, and window length must be positive" << endl;
+        return 1;
+    }
+
+    ifstream xg_stream(xg_name);
+    if (!xg_stream) {
+        cerr << "error:[vg minimizer] could not open xg index " << xg_name << endl;
+        return 1;
+    }
+    xg::XG xg_index;
+    xg_index.load(xg_stream);
+
+    MinimizerIndex index(kmer_length, window_length);
+    if (!gbwt_name.empty()) {
+        ifstream gbwt_stream(gbwt_name);
+        if (!gbwt_stream) {
+            cerr << "error:[vg minimizer] could not open GBWT " << gbwt_name << endl;
+            return 1;
+        }
+        gbwt::GBWT gbwt_index;
+        gbwt_index.load(gbwt_stream);
+        if (show_progress) {
+            cerr << "Indexing " << gbwt_index.sequences() / 2 << " haplotypes..." << endl;
+        }
+        index.add_haplotypes(xg_index, gbwt_index);
+    } else {
+        if (show_progress) {
+            cerr << "Indexing " << xg_index.max_path_rank() << " paths..." << endl;
+        }
+        index.add_paths(xg_index);
+    }
+    index.finish();
+    if (show_progress) {
+        cerr << "Indexed " << index.size() << " distinct minimizers" << endl;
+    }
+
+    ofstream out(output_name);
+    if (!out) {
+        cerr << "error:[vg minimizer] could not open " << output_name << " for writing" << endl;
+        return 1;
+    }
+    index.save(out);
+
+    return 0;
+}
+
+// Register subcommand
+static Subcommand vg_minimizer("minimizer", "build a minimizer index for seeding without GCSA2", main_minimizer);
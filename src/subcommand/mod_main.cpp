@@ -14,12 +14,42 @@
 #include "../cactus.hpp"
 #include "../stream.hpp"
 #include "../utility.hpp"
+#include "../flat_graph.hpp"
 #include "../algorithms/topological_sort.hpp"
 
 using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+/// Run a handle graph transform on a flat copy of the graph's nodes and edges,
+/// and replace them with the result. Paths are carried over. The transform
+/// returns the IDs of any nodes it reoriented, so their mappings can be turned
+/// around.
+static void transform_flat(VG* graph, const function<unordered_set<vg::id_t>(MutableHandleGraph*)>& transform) {
+    FlatGraph flat(graph->graph);
+    unordered_set<vg::id_t> flipped = transform(&flat);
+    
+    if (!flipped.empty()) {
+        auto node_length = [&](vg::id_t id) -> int64_t {
+            return flat.get_length(flat.get_handle(id, false));
+        };
+        graph->paths.for_each_mapping([&](Mapping* m) {
+            if (flipped.count(m->position().node_id())) {
+                reverse_complement_mapping_in_place(m, node_length);
+            }
+        });
+    }
+    
+    Graph transformed_graph;
+    flat.to_graph(transformed_graph);
+    graph->paths.to_graph(transformed_graph);
+    VG transformed;
+    transformed.extend(transformed_graph);
+    transformed.paths.sort_by_mapping_rank();
+    transformed.paths.rebuild_mapping_aux();
+    *graph = std::move(transformed);
+}
+
 void help_mod(char** argv) {
     cerr << "usage: " << argv[0] << " mod [options] <graph.vg> >[mod.vg]" << endl
          << "Modifies graph, outputs modified on stdout." << endl
@@ -79,6 +109,8 @@ void help_mod(char** argv) {
          << "    -a, --cactus            convert to cactus graph representation" << endl
          << "    -v, --sample-vcf FILE   for a graph with allele paths, compute the sample graph from the given VCF" << endl
          << "    -G, --sample-graph FILE subset an augmented graph to a sample graph using a Locus file" << endl
+         << "    -M, --flat-graph        do the sorting and reorienting for -z, -c, and -O on a compact" << endl
+         << "                            copy of the graph, which is faster and smaller for large graphs" << endl
          << "    -t, --threads N         for tasks that can be done in parallel, use this many threads" << endl;
 }
 
@@ -132,6 +164,7 @@ int main_mod(int argc, char** argv) {
     bool cactus = false;
     string vcf_filename;
     string loci_filename;
+    bool use_flat_graph = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -184,11 +217,12 @@ int main_mod(int argc, char** argv) {
             {"cactus", no_argument, 0, 'a'},
             {"sample-vcf", required_argument, 0, 'v'},
             {"sample-graph", required_argument, 0, 'G'},
+            {"flat-graph", no_argument, 0, 'M'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hk:oi:q:Q:cpl:e:mt:SX:KPsunzNAf:CDFr:Ig:x:RTU:Bbd:Ow:L:y:Z:Eav:G:",
+        c = getopt_long (argc, argv, "hk:oi:q:Q:cpl:e:mt:SX:KPsunzNAf:CDFr:Ig:x:RTU:Bbd:Ow:L:y:Z:Eav:G:M",
                 long_options, &option_index);
 
 
@@ -344,6 +378,10 @@ int main_mod(int argc, char** argv) {
             sort_graph = true;
             break;
 
+        case 'M':
+            use_flat_graph = true;
+            break;
+
         case 'b':
             break_cycles = true;
             break;
@@ -676,7 +714,13 @@ int main_mod(int argc, char** argv) {
     }
 
     if (orient_forward) {
-        algorithms::orient_nodes_forward(graph);
+        if (use_flat_graph) {
+            transform_flat(graph, [](MutableHandleGraph* g) -> unordered_set<vg::id_t> {
+                return algorithms::orient_nodes_forward(g);
+            });
+        } else {
+            algorithms::orient_nodes_forward(graph);
+        }
     }
 
     if (flip_doubly_reversed_edges) {
@@ -704,7 +748,14 @@ int main_mod(int argc, char** argv) {
     }
 
     if (sort_graph) {
-        algorithms::sort(graph);
+        if (use_flat_graph) {
+            transform_flat(graph, [](MutableHandleGraph* g) -> unordered_set<vg::id_t> {
+                algorithms::sort(g);
+                return unordered_set<vg::id_t>();
+            });
+        } else {
+            algorithms::sort(graph);
+        }
     }
 
     if (break_cycles) {
@@ -797,7 +848,14 @@ int main_mod(int argc, char** argv) {
 
     // and optionally compact ids
     if (compact_ids) {
-        algorithms::sort(graph);
+        if (use_flat_graph) {
+            transform_flat(graph, [](MutableHandleGraph* g) -> unordered_set<vg::id_t> {
+                algorithms::sort(g);
+                return unordered_set<vg::id_t>();
+            });
+        } else {
+            algorithms::sort(graph);
+        }
         graph->compact_ids();
     }
 
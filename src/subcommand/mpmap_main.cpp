@@ -5,11 +5,18 @@
 #include <omp.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/stat.h>
 
 #include "subcommand.hpp"
 
 #include "../multipath_mapper.hpp"
+#include "../packer.hpp"
+#include "../gamsorter.hpp"
 #include "../path.hpp"
+#include "../snarl_index.hpp"
+#include "../stream_emitter.hpp"
+#include "../numa.hpp"
+#include "../huge_pages.hpp"
 
 //#define record_read_run_times
 
@@ -23,6 +30,15 @@ using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+/// Describe an index file by its size and modification time, so we can tell when it has been rebuilt
+static string index_file_stamp(const string& file_name) {
+    struct stat file_stat;
+    if (file_name.empty() || stat(file_name.c_str(), &file_stat) != 0) {
+        return "-";
+    }
+    return to_string(file_stat.st_size) + "@" + to_string(file_stat.st_mtime);
+}
+
 void help_mpmap(char** argv) {
     cerr
     << "usage: " << argv[0] << " mpmap [options] -x index.xg -g index.gcsa [-f reads1.fq [-f reads2.fq] | -G reads.gam] > aln.gamp" << endl
@@ -32,6 +48,8 @@ void help_mpmap(char** argv) {
     << "graph/index:" << endl
     << "  -x, --xg-name FILE        use this xg index (required)" << endl
     << "  -g, --gcsa-name FILE      use this GCSA2/LCP index pair (required; both FILE and FILE.lcp)" << endl
+    << "  --minimizer-name FILE     seed with this minimizer index (from vg minimizer) instead of a GCSA2" << endl
+    << "  -X, --dist-index FILE     measure graph distances with this distance index (from vg snarls -d)" << endl
     << "input:" << endl
     << "  -f, --fastq FILE          input FASTQ (possibly compressed), can be given twice for paired ends (for stdin use -)" << endl
     << "  -G, --gam-input FILE      input GAM (for stdin, use -)" << endl
@@ -39,19 +57,29 @@ void help_mpmap(char** argv) {
     << "  -e, --same-strand         read pairs are from the same strand of the DNA molecule" << endl
     << "algorithm:" << endl
     << "  -S, --single-path-mode    produce single-path alignments (GAM) instead of multipath alignments (GAMP) (ignores -sua)" << endl
-    << "  -s, --snarls FILE         align to alternate paths in these snarls" << endl
+    << "  -s, --snarls FILE         align to alternate paths in these snarls (Snarls or a vg snarls -b index)" << endl
     << "scoring:" << endl
     << "  -A, --no-qual-adjust      do not perform base quality adjusted alignments (required if input does not have base qualities)" << endl
+    << "coverage:" << endl
+    << "  --pack-out FILE           also record the coverage of each read's optimal alignment, writing it like vg pack -o" << endl
+    << "  --pack-only               with --pack-out, record coverage without writing the alignments" << endl
+    << "  --pack-no-edits           with --pack-out, don't record edits, just graph-matching coverage (like vg pack -n)" << endl
     << endl
     << "advanced options:" << endl
     << "algorithm:" << endl
     << "  -U, --snarl-max-cut INT   do not align to alternate paths in a snarl if an exact match is at least this long (0 for no limit) [5]" << endl
     << "  -a, --alt-paths INT       align to (up to) this many alternate paths in between MEMs or in snarls [4]" << endl
     << "  -n, --unstranded          use lazy strand consistency when clustering MEMs" << endl
+    << "  --sparse-chain            cluster MEMs by sparse chaining along their approximate positions, which scales" << endl
+    << "                            better to reads with many hits (ignores -n)" << endl
+    << "  --chain-max-hits INT      chain at most this many of the highest scoring MEM hits of a read [4096]" << endl
+    << "  --max-cluster-pairs INT   consider at most this many pairs of clusters for a read pair [1024]" << endl
     << "  -b, --frag-sample INT     look for this many unambiguous mappings to estimate the fragment length distribution [1000]" << endl
     << "  -I, --frag-mean           mean for fixed fragment length distribution" << endl
     << "  -D, --frag-stddev         standard deviation for fixed fragment length distribution" << endl
     << "  -B, --no-calibrate        do not auto-calibrate mismapping dectection" << endl
+    << "  --calibration FILE        reuse the calibration saved in FILE if it matches the indexes and settings [XG.mpcal]" << endl
+    << "  --calibrate-only          calibrate against the indexes, save the calibration (see --calibration), and exit" << endl
     << "  -v, --mq-method OPT       mapping quality method: 0 - none, 1 - fast approximation, 2 - adaptive, 3 - exact [2]" << endl
     << "  -Q, --mq-max INT          cap mapping quality estimates at this much [60]" << endl
     << "  -p, --band-padding INT    pad dynamic programming bands in inter-MEM alignment by this much [2]" << endl
@@ -66,6 +94,8 @@ void help_mpmap(char** argv) {
     << "  -w, --approx-exp FLOAT    let the approximate likelihood miscalculate likelihood ratios by this power [6.5]" << endl
     << "  -C, --drop-subgraph FLOAT drop alignment subgraphs whose MEMs cover this fraction less of the read than the best subgraph [0.2]" << endl
     << "  -R, --prune-exp FLOAT     prune MEM anchors if their approximate likelihood is this root less than the optimal anchors [1.25]" << endl
+    << "  --dup-cache INT           reuse the mappings of up to this many recently seen read sequences for duplicate reads" << endl
+    << "                            (single-end only, 0 to not cache) [0]" << endl
     << "scoring:" << endl
     << "  -q, --match INT           use this match score [1]" << endl
     << "  -z, --mismatch INT        use this mismatch penalty [4]" << endl
@@ -75,7 +105,13 @@ void help_mpmap(char** argv) {
     << "  -m, --remove-bonuses      remove full length alignment bonuses in reported scores" << endl
     << "computational parameters:" << endl
     << "  -t, --threads INT         number of compute threads to use" << endl
-    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl;
+    << "  --numa                    on multi-socket machines, spread the indexes over the NUMA nodes and pin each thread to a CPU" << endl
+    << "  --hugepages               back the loaded indexes with transparent huge pages, for fewer TLB misses" << endl
+    << "  -Z, --buffer-size INT     buffer this many alignments together (per compute thread) before outputting to stdout [100]" << endl
+    << "  --sorted-out FILE         with -S, write the alignments to FILE as a coordinate-sorted GAM, indexed in FILE.gai" << endl
+    << "                            as by vg gamsort -i, instead of to stdout" << endl
+    << "  -T, --intra-read-tasks    align each read's subgraphs as separate tasks, so idle threads can help with slow reads" << endl
+    << "  --profile                 when done, print the time spent in and the work done by each mapping stage to stderr as JSON" << endl;
     
 }
 
@@ -90,6 +126,8 @@ int main_mpmap(int argc, char** argv) {
     string xg_name;
     string gcsa_name;
     string snarls_name;
+    string distance_index_name;
+    string minimizer_name;
     string fastq_name_1;
     string fastq_name_2;
     string gam_file_name;
@@ -132,6 +170,36 @@ int main_mpmap(int argc, char** argv) {
     bool unstranded_clustering = false;
     size_t order_length_repeat_hit_max = 3000;
     size_t sub_mem_count_thinning = 16;
+    bool intra_read_tasks = false;
+    bool use_numa = false;
+    bool use_huge_pages = false;
+    bool profile_stages = false;
+    bool use_sparse_chaining = false;
+    size_t max_chaining_hits = 4096;
+    size_t max_cluster_pairs = 1024;
+    string calibration_name;
+    bool calibrate_only = false;
+    string pack_name;
+    bool pack_only = false;
+    bool pack_edits = true;
+    string sorted_name;
+    size_t duplicate_cache_size = 0;
+    
+    // long options with no short form
+    const int OPT_PROFILE = 1000;
+    const int OPT_SPARSE_CHAIN = 1001;
+    const int OPT_CHAIN_MAX_HITS = 1002;
+    const int OPT_MAX_CLUSTER_PAIRS = 1003;
+    const int OPT_MINIMIZER_NAME = 1004;
+    const int OPT_CALIBRATION = 1005;
+    const int OPT_CALIBRATE_ONLY = 1006;
+    const int OPT_PACK_OUT = 1007;
+    const int OPT_PACK_ONLY = 1008;
+    const int OPT_PACK_NO_EDITS = 1009;
+    const int OPT_SORTED_OUT = 1010;
+    const int OPT_NUMA = 1011;
+    const int OPT_HUGEPAGES = 1012;
+    const int OPT_DUP_CACHE = 1013;
     
     int c;
     optind = 2; // force optind past command positional argument
@@ -141,6 +209,7 @@ int main_mpmap(int argc, char** argv) {
             {"help", no_argument, 0, 'h'},
             {"xg-name", required_argument, 0, 'x'},
             {"gcsa-name", required_argument, 0, 'g'},
+            {"dist-index", required_argument, 0, 'X'},
             {"fastq", required_argument, 0, 'f'},
             {"gam-input", required_argument, 0, 'G'},
             {"interleaved", no_argument, 0, 'i'},
@@ -177,11 +246,26 @@ int main_mpmap(int argc, char** argv) {
             {"no-qual-adjust", no_argument, 0, 'A'},
             {"threads", required_argument, 0, 't'},
             {"buffer-size", required_argument, 0, 'Z'},
+            {"intra-read-tasks", no_argument, 0, 'T'},
+            {"profile", no_argument, 0, OPT_PROFILE},
+            {"sparse-chain", no_argument, 0, OPT_SPARSE_CHAIN},
+            {"chain-max-hits", required_argument, 0, OPT_CHAIN_MAX_HITS},
+            {"max-cluster-pairs", required_argument, 0, OPT_MAX_CLUSTER_PAIRS},
+            {"minimizer-name", required_argument, 0, OPT_MINIMIZER_NAME},
+            {"calibration", required_argument, 0, OPT_CALIBRATION},
+            {"calibrate-only", no_argument, 0, OPT_CALIBRATE_ONLY},
+            {"pack-out", required_argument, 0, OPT_PACK_OUT},
+            {"pack-only", no_argument, 0, OPT_PACK_ONLY},
+            {"pack-no-edits", no_argument, 0, OPT_PACK_NO_EDITS},
+            {"sorted-out", required_argument, 0, OPT_SORTED_OUT},
+            {"numa", no_argument, 0, OPT_NUMA},
+            {"hugepages", no_argument, 0, OPT_HUGEPAGES},
+            {"dup-cache", required_argument, 0, OPT_DUP_CACHE},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:g:f:G:ieSs:u:a:nb:I:D:Bv:Q:p:M:r:W:k:K:c:d:w:C:R:q:z:o:y:L:mAt:Z:",
+        c = getopt_long (argc, argv, "hx:g:X:f:G:ieSs:u:a:nb:I:D:Bv:Q:p:M:r:W:k:K:c:d:w:C:R:q:z:o:y:L:mAt:Z:T",
                          long_options, &option_index);
 
 
@@ -244,6 +328,10 @@ int main_mpmap(int argc, char** argv) {
                 same_strand = true;
                 break;
                 
+            case 'X':
+                distance_index_name = optarg;
+                break;
+                
             case 'S':
                 single_path_alignment_mode = true;
                 break;
@@ -401,6 +489,78 @@ int main_mpmap(int argc, char** argv) {
                 buffer_size = atoi(optarg);
                 break;
                 
+            case 'T':
+                intra_read_tasks = true;
+                break;
+                
+            case OPT_PROFILE:
+                profile_stages = true;
+                break;
+                
+            case OPT_SPARSE_CHAIN:
+                use_sparse_chaining = true;
+                break;
+                
+            case OPT_CHAIN_MAX_HITS:
+                max_chaining_hits = atoi(optarg);
+                break;
+                
+            case OPT_MAX_CLUSTER_PAIRS:
+                max_cluster_pairs = atoi(optarg);
+                break;
+                
+            case OPT_MINIMIZER_NAME:
+                minimizer_name = optarg;
+                break;
+                
+            case OPT_CALIBRATION:
+                calibration_name = optarg;
+                if (calibration_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide calibration file with --calibration." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_CALIBRATE_ONLY:
+                calibrate_only = true;
+                break;
+                
+            case OPT_PACK_OUT:
+                pack_name = optarg;
+                if (pack_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide coverage pack file with --pack-out." << endl;
+                    exit(1);
+                }
+                break;
+                
+            case OPT_PACK_ONLY:
+                pack_only = true;
+                break;
+                
+            case OPT_PACK_NO_EDITS:
+                pack_edits = false;
+                break;
+                
+            case OPT_NUMA:
+                use_numa = true;
+                break;
+                
+            case OPT_HUGEPAGES:
+                use_huge_pages = true;
+                break;
+                
+            case OPT_DUP_CACHE:
+                duplicate_cache_size = atoi(optarg);
+                break;
+                
+            case OPT_SORTED_OUT:
+                sorted_name = optarg;
+                if (sorted_name.empty()) {
+                    cerr << "error:[vg mpmap] Must provide sorted GAM file with --sorted-out." << endl;
+                    exit(1);
+                }
+                break;
+                
             case 'h':
             case '?':
             default:
@@ -437,7 +597,27 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    if (fastq_name_1.empty() && gam_file_name.empty()) {
+    if (calibrate_only && !auto_calibrate_mismapping_detection) {
+        cerr << "error:[vg mpmap] Cannot both skip calibration (-B) and only calibrate (--calibrate-only)." << endl;
+        exit(1);
+    }
+    
+    if (pack_name.empty() && (pack_only || !pack_edits)) {
+        cerr << "error:[vg mpmap] Coverage pack options (--pack-only, --pack-no-edits) require a pack file (--pack-out)." << endl;
+        exit(1);
+    }
+    
+    if (!sorted_name.empty() && !single_path_alignment_mode) {
+        cerr << "error:[vg mpmap] Sorted output (--sorted-out) is only available for single path alignments (-S)." << endl;
+        exit(1);
+    }
+    
+    if (!sorted_name.empty() && pack_only) {
+        cerr << "error:[vg mpmap] Cannot both sort alignments (--sorted-out) and not write them (--pack-only)." << endl;
+        exit(1);
+    }
+    
+    if (fastq_name_1.empty() && gam_file_name.empty() && !calibrate_only) {
         cerr << "error:[vg mpmap] Must designate reads to map from either FASTQ (-f) or GAM (-G) file." << endl;
         exit(1);
     }
@@ -568,8 +748,8 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    if (gcsa_name.empty()) {
-        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 index, must provide GCSA2 file" << endl;
+    if (gcsa_name.empty() && minimizer_name.empty()) {
+        cerr << "error:[vg mpmap] Multipath mapping requires a GCSA2 or minimizer index, must provide GCSA2 file" << endl;
         exit(1);
     }
     
@@ -581,17 +761,30 @@ int main_mpmap(int argc, char** argv) {
         exit(1);
     }
     
-    ifstream gcsa_stream(gcsa_name);
-    if (!xg_stream) {
-        cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
-        exit(1);
+    ifstream gcsa_stream;
+    ifstream lcp_stream;
+    if (!gcsa_name.empty()) {
+        gcsa_stream.open(gcsa_name);
+        if (!gcsa_stream) {
+            cerr << "error:[vg mpmap] Cannot open GCSA2 file " << gcsa_name << endl;
+            exit(1);
+        }
+        
+        string lcp_name = gcsa_name + ".lcp";
+        lcp_stream.open(lcp_name);
+        if (!lcp_stream) {
+            cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
+            exit(1);
+        }
     }
     
-    string lcp_name = gcsa_name + ".lcp";
-    ifstream lcp_stream(lcp_name);
-    if (!xg_stream) {
-        cerr << "error:[vg mpmap] Cannot open LCP file " << lcp_name << endl;
-        exit(1);
+    ifstream minimizer_stream;
+    if (!minimizer_name.empty()) {
+        minimizer_stream.open(minimizer_name);
+        if (!minimizer_stream) {
+            cerr << "error:[vg mpmap] Cannot open minimizer index file " << minimizer_name << endl;
+            exit(1);
+        }
     }
     
     // Configure GCSA2 verbosity so it doesn't spit out loads of extra info
@@ -600,23 +793,76 @@ int main_mpmap(int argc, char** argv) {
     // Configure its temp directory to the system temp directory
     gcsa::TempFile::setDirectory(find_temp_dir());
     
-    xg::XG xg_index(xg_stream);
+    if (use_numa) {
+        // Every thread reads the indexes, so give each NUMA node a share of their pages
+        interleave_numa_allocations();
+    }
+    
+    // Watch what loading the indexes allocates, so it can go in huge pages
+    unique_ptr<HugePageLoader> huge_pages;
+    if (use_huge_pages) {
+        huge_pages = unique_ptr<HugePageLoader>(new HugePageLoader());
+    }
+    
+    xg::XG xg_index;
+    xg_index.load_mapped(xg_name);
+    // Share path occurrence lookups across reads, so hot nodes are only decoded once
+    xg_index.enable_path_memo(1 << 20);
     gcsa::GCSA gcsa_index;
-    gcsa_index.load(gcsa_stream);
     gcsa::LCPArray lcp_array;
-    lcp_array.load(lcp_stream);
+    if (!gcsa_name.empty()) {
+        gcsa_index.load(gcsa_stream);
+        lcp_array.load(lcp_stream);
+    }
+    MinimizerIndex* minimizer_index = nullptr;
+    if (!minimizer_name.empty()) {
+        minimizer_index = new MinimizerIndex();
+        minimizer_index->load(minimizer_stream);
+    }
+    
+    if (huge_pages) {
+        if (huge_pages->back_new_mappings()) {
+            cerr << "[vg mpmap] " << huge_pages->huge_page_bytes() / (1024 * 1024) << " of "
+                 << huge_pages->mapped_bytes() / (1024 * 1024) << " MB of index memory is in huge pages" << endl;
+        } else {
+            cerr << "warning:[vg mpmap] transparent huge pages are not available, so the indexes are in normal pages" << endl;
+        }
+    }
     
     SnarlManager* snarl_manager = nullptr;
     if (!snarls_name.empty()) {
-        ifstream snarl_stream(snarls_name);
-        if (!snarl_stream) {
-            cerr << "error:[vg mpmap] Cannot open Snarls file " << snarls_name << endl;
+        if (SnarlIndex::is_snarl_index(snarls_name)) {
+            // Load the precomputed tree and chains from a binary snarl index
+            SnarlIndex snarl_index(snarls_name);
+            if (!snarl_index.is_valid()) {
+                cerr << "error:[vg mpmap] Snarl index " << snarls_name << " is corrupt or from another version" << endl;
+                exit(1);
+            }
+            snarl_manager = new SnarlManager(snarl_index.to_snarl_manager());
+        } else {
+            ifstream snarl_stream(snarls_name);
+            if (!snarl_stream) {
+                cerr << "error:[vg mpmap] Cannot open Snarls file " << snarls_name << endl;
+                exit(1);
+            }
+            snarl_manager = new SnarlManager(snarl_stream);
+        }
+    }
+    
+    DistanceIndex* distance_index = nullptr;
+    if (!distance_index_name.empty()) {
+        ifstream distance_index_stream(distance_index_name);
+        if (!distance_index_stream) {
+            cerr << "error:[vg mpmap] Cannot open distance index file " << distance_index_name << endl;
             exit(1);
         }
-        snarl_manager = new SnarlManager(snarl_stream);
+        distance_index = new DistanceIndex(&xg_index, distance_index_stream);
     }
         
-    MultipathMapper multipath_mapper(&xg_index, &gcsa_index, &lcp_array, snarl_manager);
+    MultipathMapper multipath_mapper(&xg_index, gcsa_name.empty() ? nullptr : &gcsa_index,
+                                     gcsa_name.empty() ? nullptr : &lcp_array, snarl_manager);
+    multipath_mapper.distance_index = distance_index;
+    multipath_mapper.minimizer_index = minimizer_index;
     
     // set alignment parameters
     multipath_mapper.set_alignment_scores(match_score, mismatch_score, gap_open_score, gap_extension_score, full_length_bonus);
@@ -638,9 +884,6 @@ int main_mpmap(int argc, char** argv) {
     if (min_clustering_mem_length) {
         multipath_mapper.min_clustering_mem_length = min_clustering_mem_length;
     }
-    else {
-        multipath_mapper.set_automatic_min_clustering_length();
-    }
     
     // set mapping quality parameters
     multipath_mapper.mapping_quality_method = mapq_method;
@@ -652,20 +895,88 @@ int main_mpmap(int argc, char** argv) {
     multipath_mapper.log_likelihood_approx_factor = likelihood_approx_exp;
     multipath_mapper.num_mapping_attempts = max_map_attempts ? max_map_attempts : numeric_limits<int>::max();
     multipath_mapper.unstranded_clustering = unstranded_clustering;
+    multipath_mapper.use_sparse_chaining = use_sparse_chaining;
+    multipath_mapper.max_chaining_hits = max_chaining_hits;
+    multipath_mapper.max_cluster_pairs = max_cluster_pairs;
     
     // set multipath alignment topology parameters
     multipath_mapper.max_snarl_cut_size = snarl_cut_size;
     multipath_mapper.num_alt_alns = num_alt_alns;
     multipath_mapper.max_suboptimal_path_score_ratio = suboptimal_path_exponent;
     
-    // if directed to, auto calibrate the mismapping detection to the graph
-    if (auto_calibrate_mismapping_detection) {
-        multipath_mapper.calibrate_mismapping_detection(num_calibration_simulations, calibration_read_length);
+    // the automatic parameters depend only on the indexes and on the settings that change how the
+    // simulated reads map, so they can be saved from one run and reused by the next
+    if (calibration_name.empty()) {
+        calibration_name = xg_name + ".mpcal";
+    }
+    stringstream calibration_key;
+    calibration_key << "xg=" << index_file_stamp(xg_name)
+        << ";gcsa=" << index_file_stamp(gcsa_name)
+        << ";minimizer=" << index_file_stamp(minimizer_name)
+        << ";dist=" << index_file_stamp(distance_index_name)
+        << ";snarls=" << index_file_stamp(snarls_name)
+        << ";calibrate=" << auto_calibrate_mismapping_detection << "," << num_calibration_simulations << "," << calibration_read_length
+        << ";score=" << match_score << "," << mismatch_score << "," << gap_open_score << "," << gap_extension_score << "," << full_length_bonus
+        << ";mems=" << hit_max << "," << min_mem_length << "," << min_clustering_mem_length << "," << reseed_length << "," << reseed_diff
+        << "," << use_adaptive_reseed << "," << reseed_exp << "," << order_length_repeat_hit_max << "," << sub_mem_count_thinning
+        << ";cluster=" << max_dist_error << "," << cluster_ratio << "," << likelihood_approx_exp << "," << unstranded_clustering
+        << "," << use_sparse_chaining << "," << max_chaining_hits
+        << ";topology=" << band_padding << "," << snarl_cut_size << "," << num_alt_alns << "," << suboptimal_path_exponent
+        << "," << single_path_alignment_mode;
+    
+    bool loaded_calibration = false;
+    if (!calibrate_only) {
+        ifstream calibration_stream(calibration_name);
+        if (calibration_stream) {
+            loaded_calibration = multipath_mapper.load_calibration(calibration_stream, calibration_key.str());
+            if (!loaded_calibration) {
+                cerr << "warning:[vg mpmap] Calibration file " << calibration_name << " does not match the indexes and settings, recalibrating." << endl;
+                // we may have loaded some of it
+                multipath_mapper.min_clustering_mem_length = min_clustering_mem_length;
+            }
+        }
+    }
+    
+    if (!loaded_calibration) {
+        if (!min_clustering_mem_length) {
+            multipath_mapper.set_automatic_min_clustering_length();
+        }
+        
+        // if directed to, auto calibrate the mismapping detection to the graph
+        if (auto_calibrate_mismapping_detection) {
+            multipath_mapper.calibrate_mismapping_detection(num_calibration_simulations, calibration_read_length);
+        }
+    }
+    
+    if (calibrate_only) {
+        ofstream calibration_out(calibration_name);
+        if (!calibration_out) {
+            cerr << "error:[vg mpmap] Cannot write calibration file " << calibration_name << endl;
+            exit(1);
+        }
+        multipath_mapper.save_calibration(calibration_out, calibration_key.str());
+        return 0;
     }
     
     // set computational paramters
     int thread_count = get_thread_count();
+    if (use_numa) {
+        // The mapper's working memory is per thread, so keep it on the thread's own node
+        local_numa_allocations();
+        if (!pin_omp_threads()) {
+            cerr << "warning:[vg mpmap] could not pin threads to CPUs" << endl;
+        }
+    }
     multipath_mapper.set_alignment_threads(thread_count);
+    multipath_mapper.parallel_cluster_alignment = intra_read_tasks;
+    StageProfiler::set_enabled(profile_stages);
+    
+    // only cache the real reads' mappings, not the calibration's simulated ones
+    unique_ptr<DuplicateReadCache<vector<MultipathAlignment>>> duplicate_cache;
+    if (duplicate_cache_size > 0) {
+        duplicate_cache.reset(new DuplicateReadCache<vector<MultipathAlignment>>(duplicate_cache_size));
+        multipath_mapper.duplicate_cache = duplicate_cache.get();
+    }
     
     // are we doing paired ends?
     if (interleaved_input || !fastq_name_2.empty()) {
@@ -692,15 +1003,58 @@ int main_mpmap(int argc, char** argv) {
     
     // a buffer to hold read pairs that can't be unambiguously mapped before the fragment length distribution
     // is estimated
-    // note: sufficient to have only one buffer because multithreading code enforces single threaded mode
-    // during distribution estimation
+    // note: shared by all threads, since the mapper synchronizes additions to it and registers fragment
+    // lengths without blocking, so there's no need for a single threaded warm-up
     vector<pair<Alignment, Alignment>> ambiguous_pair_buffer;
     
     vector<vector<Alignment> > single_path_output_buffer(thread_count);
     vector<vector<MultipathAlignment> > multipath_output_buffer(thread_count);
     
+    // compress and write output in the background (only one kind of output is ever made,
+    // so only one emitter is ever writing to stdout)
+    unique_ptr<stream::AsyncEmitter<Alignment>> single_path_emitter;
+    unique_ptr<stream::AsyncEmitter<MultipathAlignment>> multipath_emitter;
+    if (pack_only || !sorted_name.empty()) {
+        // nothing goes to stdout
+    }
+    else if (single_path_alignment_mode) {
+        single_path_emitter = unique_ptr<stream::AsyncEmitter<Alignment>>(new stream::AsyncEmitter<Alignment>(cout));
+    }
+    else {
+        multipath_emitter = unique_ptr<stream::AsyncEmitter<MultipathAlignment>>(new stream::AsyncEmitter<MultipathAlignment>(cout));
+    }
+    
+    // all threads add coverage to one shared packer as they map, instead of it being read back out of the GAM
+    unique_ptr<Packer> packer;
+    if (!pack_name.empty()) {
+        packer = unique_ptr<Packer>(new Packer(&xg_index, 0, thread_count > 1));
+    }
+    
+    // sorted output is collected into sorted runs as the threads map, and merged at the end
+    unique_ptr<GAMSorter> sorter;
+    if (!sorted_name.empty()) {
+        sorter = unique_ptr<GAMSorter>(new GAMSorter());
+        sorter->begin_incremental_sort();
+    }
+    
+    // record the coverage of the optimal alignment of a multipath alignment
+    auto pack_multipath_alignment = [&](const MultipathAlignment& mp_aln) {
+        Alignment aln;
+        optimal_alignment(mp_aln, aln);
+        packer->add(aln, pack_edits);
+    };
+    
     // write unpaired multipath alignments to stdout buffer
     auto output_multipath_alignments = [&](vector<MultipathAlignment>& mp_alns) {
+        if (packer) {
+            for (const MultipathAlignment& mp_aln : mp_alns) {
+                pack_multipath_alignment(mp_aln);
+            }
+        }
+        if (!multipath_emitter) {
+            return;
+        }
+        
         auto& output_buf = multipath_output_buffer[omp_get_thread_num()];
         
         // move all the alignments over to the output buffer
@@ -708,7 +1062,7 @@ int main_mpmap(int argc, char** argv) {
             output_buf.emplace_back(move(mp_aln));
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        multipath_emitter->emit_buffered(output_buf, buffer_size);
     };
     
     // convert to unpaired single path alignments and write stdout buffer
@@ -720,13 +1074,37 @@ int main_mpmap(int argc, char** argv) {
             optimal_alignment(mp_aln, output_buf.back());
             // compute the Alignment identity to make vg call happy
             output_buf.back().set_identity(identity(output_buf.back().path()));
+            if (packer) {
+                packer->add(output_buf.back(), pack_edits);
+            }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        if (single_path_emitter) {
+            single_path_emitter->emit_buffered(output_buf, buffer_size);
+        }
+        else {
+            if (sorter) {
+                for (const Alignment& aln : output_buf) {
+                    sorter->add_to_sort(aln);
+                }
+            }
+            output_buf.clear();
+        }
     };
     
     // write paired multipath alignments to stdout buffer
     auto output_multipath_paired_alignments = [&](vector<pair<MultipathAlignment, MultipathAlignment>>& mp_aln_pairs) {
+        if (packer) {
+            // the second read's strand doesn't change which bases it covers
+            for (const pair<MultipathAlignment, MultipathAlignment>& mp_aln_pair : mp_aln_pairs) {
+                pack_multipath_alignment(mp_aln_pair.first);
+                pack_multipath_alignment(mp_aln_pair.second);
+            }
+        }
+        if (!multipath_emitter) {
+            return;
+        }
+        
         auto& output_buf = multipath_output_buffer[omp_get_thread_num()];
         
         // move all the alignments over to the output buffer
@@ -738,14 +1116,13 @@ int main_mpmap(int argc, char** argv) {
                 output_buf.emplace_back(move(mp_aln_pair.second));
             }
             else {
-                output_buf.emplace_back();
-                rev_comp_multipath_alignment(mp_aln_pair.second,
-                                             [&](vg::id_t node_id) { return xg_index.node_length(node_id); },
-                                             output_buf.back());
+                output_buf.emplace_back(move(mp_aln_pair.second));
+                rev_comp_multipath_alignment_in_place(&output_buf.back(),
+                                                      [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
             }
         }
         
-        stream::write_buffered(cout, output_buf, buffer_size);
+        multipath_emitter->emit_buffered(output_buf, buffer_size);
     };
     
     // convert to paired single path alignments and write stdout buffer
@@ -770,8 +1147,24 @@ int main_mpmap(int argc, char** argv) {
                 reverse_complement_alignment_in_place(&output_buf.back(),
                                                       [&](vg::id_t node_id) { return xg_index.node_length(node_id); });
             }
+            
+            if (packer) {
+                packer->add(output_buf[output_buf.size() - 2], pack_edits);
+                packer->add(output_buf.back(), pack_edits);
+            }
+        }
+        
+        if (single_path_emitter) {
+            single_path_emitter->emit_buffered(output_buf, buffer_size);
+        }
+        else {
+            if (sorter) {
+                for (const Alignment& aln : output_buf) {
+                    sorter->add_to_sort(aln);
+                }
+            }
+            output_buf.clear();
         }
-        stream::write_buffered(cout, output_buf, buffer_size);
     };
     
     // do unpaired multipath alignment and write to buffer
@@ -822,24 +1215,16 @@ int main_mpmap(int argc, char** argv) {
 #endif
     };
     
-    // for streaming paired input, don't spawn new tasks unless this evalutes to true
-    function<bool(void)> multi_threaded_condition = [&](void) {
-        return multipath_mapper.has_fixed_fragment_length_distr();
-    };
-    
-    
     // FASTQ input
     if (!fastq_name_1.empty()) {
         if (interleaved_input) {
-            fastq_paired_interleaved_for_each_parallel_after_wait(fastq_name_1, do_paired_alignments,
-                                                                  multi_threaded_condition);
+            fastq_paired_interleaved_for_each_parallel(fastq_name_1, do_paired_alignments);
         }
         else if (fastq_name_2.empty()) {
             fastq_unpaired_for_each_parallel(fastq_name_1, do_unpaired_alignments);
         }
         else {
-            fastq_paired_two_files_for_each_parallel_after_wait(fastq_name_1, fastq_name_2, do_paired_alignments,
-                                                                multi_threaded_condition);
+            fastq_paired_two_files_for_each_parallel(fastq_name_1, fastq_name_2, do_paired_alignments);
         }
     }
     
@@ -851,8 +1236,7 @@ int main_mpmap(int argc, char** argv) {
                 exit(1);
             }
             if (interleaved_input) {
-                stream::for_each_interleaved_pair_parallel_after_wait(gam_in, do_paired_alignments,
-                                                                      multi_threaded_condition);
+                stream::for_each_interleaved_pair_parallel(gam_in, do_paired_alignments);
             }
             else {
                 stream::for_each_parallel(gam_in, do_unpaired_alignments);
@@ -899,23 +1283,56 @@ int main_mpmap(int argc, char** argv) {
     
     // flush output buffers
     for (int i = 0; i < thread_count; i++) {
-        vector<Alignment>& single_path_buffer = single_path_output_buffer[i];
-        stream::write_buffered(cout, single_path_buffer, 0);
-        
-        vector<MultipathAlignment>& multipath_buffer = multipath_output_buffer[i];
-        stream::write_buffered(cout, multipath_buffer, 0);
+        if (single_path_emitter) {
+            single_path_emitter->emit_buffered(single_path_output_buffer[i], 0);
+        }
+        if (multipath_emitter) {
+            multipath_emitter->emit_buffered(multipath_output_buffer[i], 0);
+        }
+    }
+    // wait for the background writes
+    if (single_path_emitter) {
+        single_path_emitter->finish();
+    }
+    if (multipath_emitter) {
+        multipath_emitter->finish();
     }
     cout.flush();
     
+    if (packer) {
+        packer->save_to_file(pack_name);
+    }
+    
+    if (sorter) {
+        {
+            // the index points at blocks, so write the sorted GAM in blocks
+            ofstream sorted_out(sorted_name);
+            if (!sorted_out) {
+                cerr << "error:[vg mpmap] Cannot write sorted GAM " << sorted_name << endl;
+                exit(1);
+            }
+            stream::set_output_blocked(true);
+            sorter->finish_incremental_sort(sorted_out);
+        }
+        sorter->write_index(sorted_name, sorted_name + ".gai", true);
+    }
+    
 #ifdef record_read_run_times
     read_time_file.close();
 #endif
     
+    if (profile_stages) {
+        StageProfiler::write_json(cerr);
+    }
+    
     //cerr << "MEM length filtering efficiency: " << ((double) OrientedDistanceClusterer::MEM_FILTER_COUNTER) / OrientedDistanceClusterer::MEM_TOTAL << " (" << OrientedDistanceClusterer::MEM_FILTER_COUNTER << "/" << OrientedDistanceClusterer::MEM_TOTAL << ")" << endl;
     //cerr << "MEM cluster filtering efficiency: " << ((double) OrientedDistanceClusterer::PRUNE_COUNTER) / OrientedDistanceClusterer::CLUSTER_TOTAL << " (" << OrientedDistanceClusterer::PRUNE_COUNTER << "/" << OrientedDistanceClusterer::CLUSTER_TOTAL << ")" << endl;
     //cerr << "subgraph filtering efficiency: " << ((double) MultipathMapper::PRUNE_COUNTER) / MultipathMapper::SUBGRAPH_TOTAL << " (" << MultipathMapper::PRUNE_COUNTER << "/" << MultipathMapper::SUBGRAPH_TOTAL << ")" << endl;
+    //cerr << "ungapped tail alignment efficiency: " << ((double) MultipathMapper::UNGAPPED_TAIL_COUNTER) / MultipathMapper::TAIL_TOTAL << " (" << MultipathMapper::UNGAPPED_TAIL_COUNTER << "/" << MultipathMapper::TAIL_TOTAL << ")" << endl;
     
     delete snarl_manager;
+    delete distance_index;
+    delete minimizer_index;
     
     return 0;
 }
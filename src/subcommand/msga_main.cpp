@@ -59,6 +59,8 @@ void help_msga(char** argv) {
          << "    -Q, --idx-prune-subs N  prune subgraphs shorter than this length from input graph to GCSA (default: off)" << endl
          << "    -m, --node-max N        chop nodes to be shorter than this length (default: 2* --idx-kmer-size)" << endl
          << "    -X, --idx-doublings N   use this many doublings when building the GCSA indexes [2]" << endl
+         << "    --batch N               align N sequences to the same indexes and add them together," << endl
+         << "                            rebuilding the indexes once per N sequences [1]" << endl
          << "graph normalization:" << endl
          << "    -N, --normalize         normalize the graph after assembly" << endl
          << "    -Z, --circularize       the input sequences are from circular genomes, circularize them after inclusion" << endl
@@ -130,6 +132,10 @@ int main_msga(int argc, char** argv) {
     bool show_align_progress = false;
     bool bigger_first = true;
     bool patch_alignments = false;
+    size_t index_batch = 1;
+
+    // long options with no short form
+    const int OPT_BATCH = 1000;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -179,6 +185,7 @@ int main_msga(int argc, char** argv) {
                 {"align-progress", no_argument, 0, 'S'},
                 {"bigger-first", no_argument, 0, 'a'},
                 {"patch-alns", no_argument, 0, '8'},
+                {"batch", required_argument, 0, OPT_BATCH},
                 {0, 0, 0, 0}
             };
 
@@ -360,6 +367,14 @@ int main_msga(int argc, char** argv) {
             patch_alignments = true;
             break;
 
+        case OPT_BATCH:
+            if (atoi(optarg) < 1) {
+                cerr << "error:[vg msga] batch size must be at least 1" << endl;
+                exit(1);
+            }
+            index_batch = atoi(optarg);
+            break;
+
         case 'h':
         case '?':
             help_msga(argv);
@@ -597,117 +612,142 @@ int main_msga(int argc, char** argv) {
 
     // todo restructure so that we are trying to map everything
     // add alignment score/bp bounds to catch when we get a good alignment
-    int i = 0;
+
+    // Sequences are aligned in batches against the same indexes, and each
+    // batch is edited into the graph at once, so the indexes are rebuilt
+    // once per batch. Sequences in a batch can't see each other's novel
+    // sequence, so bigger batches trade some duplicated variation for fewer
+    // rebuilds.
+    vector<string> to_include;
     for (auto& name : names_in_order) {
-        ++i;
-        //cerr << "do... " << name << " ?" << endl;
         if (!base_seq_name.empty() && name == base_seq_name) continue; // already embedded
-        bool incomplete = true; // complete when we've fully included the sequence set
+        to_include.push_back(name);
+    }
+    for (size_t b = 0; b < to_include.size(); b += index_batch) {
+        // the sequences of this batch that aren't fully included yet
+        vector<string> pending(to_include.begin() + b,
+                               to_include.begin() + min(b + index_batch, to_include.size()));
         int iter = 0;
-        auto& seq = strings[name];
-        //cerr << "doing... " << name << endl;
-#ifdef debug
-        {
-            graph->serialize_to_file("msga-pre-" + name + ".vg");
-            ofstream db_out("msga-pre-" + name + ".xg");
-            xgidx->serialize(db_out);
-            db_out.close();
-        }
-#endif
-        while (incomplete && iter++ < iter_max) {
+        while (!pending.empty() && iter++ < iter_max) {
             stringstream s; s << iter; string iterstr = s.str();
-            if (debug) cerr << name << ": adding to graph " << i << "/" << names_in_order.size() << endl;
             vector<Path> paths;
+            vector<Alignment> alns;
             int j = 0;
-            // align to the graph
-            if (debug) cerr << name << ": aligning " << seq.size() << "bp -> g:"
-                            << graph->length() << "bp "
-                            << "n:" << graph->node_count() << " "
-                            << "e:" << graph->edge_count() << endl;
-            Alignment aln = mapper->align(seq, 0, 0, 0, band_width);
-            aln.set_name(name);
-            if (aln.path().mapping_size()) {
-                auto aln_seq = graph->path_string(aln.path());
-                if (aln_seq != seq) {
-                    cerr << "[vg msga] alignment corrupted, failed to obtain correct banded alignment (alignment seq != input seq)" << endl;
-                    cerr << "expected " << seq << endl;
-                    cerr << "got      " << aln_seq << endl;
-                    ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
-                    stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
-                    f.close();
-                    graph->serialize_to_file(name + "-corrupted-alignment.vg");
-                    exit(1);
+            for (auto& name : pending) {
+                auto& seq = strings[name];
+#ifdef debug
+                {
+                    graph->serialize_to_file("msga-pre-" + name + ".vg");
+                    ofstream db_out("msga-pre-" + name + ".xg");
+                    xgidx->serialize(db_out);
+                    db_out.close();
                 }
-            } else {
-                Edit* edit = aln.mutable_path()->add_mapping()->add_edit();
-                edit->set_sequence(aln.sequence());
-                edit->set_to_length(aln.sequence().size());
+#endif
+                if (debug) cerr << name << ": adding to graph " << b + paths.size() + 1 << "/" << to_include.size() << endl;
+                // align to the graph
+                if (debug) cerr << name << ": aligning " << seq.size() << "bp -> g:"
+                                << graph->length() << "bp "
+                                << "n:" << graph->node_count() << " "
+                                << "e:" << graph->edge_count() << endl;
+                Alignment aln = mapper->align(seq, 0, 0, 0, band_width);
+                aln.set_name(name);
+                if (aln.path().mapping_size()) {
+                    auto aln_seq = graph->path_string(aln.path());
+                    if (aln_seq != seq) {
+                        cerr << "[vg msga] alignment corrupted, failed to obtain correct banded alignment (alignment seq != input seq)" << endl;
+                        cerr << "expected " << seq << endl;
+                        cerr << "got      " << aln_seq << endl;
+                        ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
+                        stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
+                        f.close();
+                        graph->serialize_to_file(name + "-corrupted-alignment.vg");
+                        exit(1);
+                    }
+                } else {
+                    Edit* edit = aln.mutable_path()->add_mapping()->add_edit();
+                    edit->set_sequence(aln.sequence());
+                    edit->set_to_length(aln.sequence().size());
+                }
+                //if (debug) cerr << pb2json(aln) << endl; // huge in some cases
+                paths.push_back(aln.path());
+                paths.back().set_name(name); // cache name to trigger inclusion of path elements in graph by edit
+                alns.push_back(aln);
             }
-            //if (debug) cerr << pb2json(aln) << endl; // huge in some cases
-            paths.push_back(aln.path());
-            paths.back().set_name(name); // cache name to trigger inclusion of path elements in graph by edit
-
-            /*
-               ofstream f(name + "-pre-edit-" + convert(j) + ".gam");
-               stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
-               f.close();
-               */
 
             ++j;
 
-            // now take the alignment and modify the graph with it
-            if (debug) cerr << name << ": editing graph" << endl;
-            //graph->serialize_to_file(name + "-pre-edit.vg");
+            // now take the alignments and modify the graph with them
+            if (debug) cerr << "editing graph with " << paths.size() << " alignments" << endl;
+            size_t node_count = graph->node_count();
+            size_t edge_count = graph->edge_count();
             // Modify graph and embed paths
             graph->edit(paths, true);
             //if (!graph->is_valid()) cerr << "invalid after edit" << endl;
-            //graph->serialize_to_file(name + "-immed-post-edit.vg");
             if (normalize) graph->normalize(10, debug);
             graph->dice_nodes(node_max);
             //if (!graph->is_valid()) cerr << "invalid after dice" << endl;
-            //graph->serialize_to_file(name + "-post-dice.vg");
-            if (debug) cerr << name << ": sorting and compacting ids" << endl;
-            algorithms::sort(graph);
-            //if (!graph->is_valid()) cerr << "invalid after sort" << endl;
-            graph->compact_ids(); // xg can't work unless IDs are compacted.
-            //if (!graph->is_valid()) cerr << "invalid after compact" << endl;
+
+            // Editing only adds nodes and edges, so if there are no more of
+            // them the alignments just followed the graph and the indexes
+            // still describe it. Path-only indexes need the new paths, and
+            // normalizing and circularizing can change the graph anyway.
+            bool graph_changed = normalize || circularize || idx_path_only
+                || graph->node_count() != node_count || graph->edge_count() != edge_count;
+
+            if (graph_changed) {
+                if (debug) cerr << "sorting and compacting ids" << endl;
+                algorithms::sort(graph);
+                //if (!graph->is_valid()) cerr << "invalid after sort" << endl;
+                graph->compact_ids(); // xg can't work unless IDs are compacted.
+                //if (!graph->is_valid()) cerr << "invalid after compact" << endl;
+            }
             if (circularize) {
-                if (debug) cerr << name << ": circularizing" << endl;
-                graph->circularize({name});
-                //graph->serialize_to_file(name + "-post-circularize.vg");
+                if (debug) cerr << "circularizing" << endl;
+                graph->circularize(pending);
             }
 
             // the edit needs to cut nodes at mapping starts and ends
             // thus allowing paths to be included that map directly to entire nodes
             // XXX
 
-            //graph->serialize_to_file(name + "-pre-index.vg");
             // update the paths
             graph->graph.clear_path();
             graph->paths.to_graph(graph->graph);
-            // and rebuild the indexes
-            rebuild(graph);
-            //graph->serialize_to_file(name + "-post-index.vg");
+            if (graph_changed) {
+                // and rebuild the indexes
+                rebuild(graph);
+            } else {
+                if (debug) cerr << "graph is unchanged, keeping the indexes" << endl;
+                graph->rebuild_indexes();
+            }
 
-            // verfy validity of path
+            // verify validity of the paths, keeping the ones to retry
             bool is_valid = graph->is_valid();
-            auto path_seq = graph->path_string(graph->paths.path(name));
-            incomplete = !(path_seq == seq) || !is_valid;
-            if (incomplete) {
+            vector<string> failed;
+            for (size_t k = 0; k < pending.size(); k++) {
+                auto& name = pending[k];
+                auto& seq = strings[name];
+                auto path_seq = graph->path_string(graph->paths.path(name));
+                if (path_seq == seq && is_valid) continue;
+                failed.push_back(name);
                 cerr << "[vg msga] failed to include alignment, retrying " << endl
                     << "expected " << seq << endl
                     << "got      " << path_seq << endl
-                    << pb2json(aln.path()) << endl
+                    << pb2json(alns[k].path()) << endl
                     << pb2json(graph->paths.path(name)) << endl;
                 graph->serialize_to_file(name + "-post-edit.vg");
                 ofstream f(name + "-failed-alignment-" + convert(j) + ".gam");
+                Alignment& aln = alns[k];
                 stream::write(f, 1, (std::function<Alignment(uint64_t)>)([&aln](uint64_t n) { return aln; }));
                 f.close();
             }
+            pending = failed;
         }
         // if (debug && !graph->is_valid()) cerr << "graph is invalid" << endl;
-        if (incomplete && iter >= iter_max) {
-            cerr << "[vg msga] Error: failed to include path " << name << endl;
+        if (!pending.empty()) {
+            for (auto& name : pending) {
+                cerr << "[vg msga] Error: failed to include path " << name << endl;
+            }
             exit(1);
         }
     }
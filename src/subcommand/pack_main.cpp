@@ -3,6 +3,7 @@
 #include "../utility.hpp"
 #include "../packer.hpp"
 #include "../stream.hpp"
+#include "../columnar_gam.hpp"
 
 #include <unistd.h>
 #include <getopt.h>
@@ -20,6 +21,7 @@ void help_pack(char** argv) {
          << "    -d, --as-table         write table on stdout representing packs" << endl
          << "    -n, --no-edits         don't record or write edits, just graph-matching coverage" << endl
          << "    -b, --bin-size N       number of sequence bases per CSA bin [default: inf]" << endl
+         << "    -w, --window-size N    write mean and max coverage in windows of N bases along each path on stdout" << endl
          << "    -t, --threads N        use N threads (defaults to numCPUs)" << endl;
 }
 
@@ -33,6 +35,7 @@ int main_pack(int argc, char** argv) {
     int thread_count = 1;
     bool record_edits = true;
     size_t bin_size = 0;
+    size_t window_size = 0;
 
     if (argc == 2) {
         help_pack(argv);
@@ -53,11 +56,12 @@ int main_pack(int argc, char** argv) {
             {"threads", required_argument, 0, 't'},
             {"no-edits", no_argument, 0, 'n'},
             {"bin-size", required_argument, 0, 'b'},
+            {"window-size", required_argument, 0, 'w'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hx:o:i:g:dt:nb:",
+        c = getopt_long (argc, argv, "hx:o:i:g:dt:nb:w:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -92,6 +96,9 @@ int main_pack(int argc, char** argv) {
         case 'b':
             bin_size = atoll(optarg);
             break;
+        case 'w':
+            window_size = atoll(optarg);
+            break;
         case 't':
             thread_count = atoi(optarg);
             break;
@@ -112,9 +119,8 @@ int main_pack(int argc, char** argv) {
         xgidx.load(in);
     }
 
-    // todo one packer per thread and merge
-
-    vg::Packer packer(&xgidx, bin_size);
+    // all threads add to one shared packer, so memory stays flat as threads are added
+    vg::Packer packer(&xgidx, bin_size, thread_count > 1);
     if (packs_in.size() == 1) {
         packer.load_from_file(packs_in.front());
     } else if (packs_in.size() > 1) {
@@ -122,33 +128,19 @@ int main_pack(int argc, char** argv) {
     }
 
     if (!gam_in.empty()) {
-        vector<vg::Packer*> packers;
-        if (thread_count == 1) {
-            packers.push_back(&packer);
-        } else {
-            for (size_t i = 0; i < thread_count; ++i) {
-                packers.push_back(new Packer(&xgidx, bin_size));
-            }
-        }
-        std::function<void(Alignment&)> lambda = [&packer,&record_edits,&packers](Alignment& aln) {
-            packers[omp_get_thread_num()]->add(aln, record_edits);
+        // the packer only needs the path, so don't decode (or, from columnar
+        // GAM, even decompress) the rest of the read
+        std::vector<int> used_fields{Alignment::kPathFieldNumber};
+        std::function<void(Alignment&)> lambda = [&](Alignment& aln) {
+            packer.add(aln, record_edits);
         };
         if (gam_in == "-") {
-            stream::for_each_parallel(std::cin, lambda);
+            for_each_alignment_fields_parallel(std::cin, used_fields, lambda);
         } else {
             ifstream gam_stream(gam_in);
-            stream::for_each_parallel(gam_stream, lambda);
+            for_each_alignment_fields_parallel(gam_stream, used_fields, lambda);
             gam_stream.close();
         }
-        if (thread_count == 1) {
-            packers.clear();
-        } else {
-            packer.merge_from_dynamic(packers);
-            for (auto& p : packers) {
-                delete p;
-            }
-            packers.clear();
-        }
     }
 
     if (!packs_out.empty()) {
@@ -158,6 +150,20 @@ int main_pack(int argc, char** argv) {
         packer.make_compact();
         packer.as_table(cout, record_edits);
     }
+    if (window_size) {
+        packer.make_compact();
+        cout << "path\tstart\tend\tmean\tmax" << endl;
+        for (size_t rank = 1; rank <= xgidx.path_count; ++rank) {
+            string path_name = xgidx.path_name(rank);
+            size_t path_length = xgidx.path_length(rank);
+            for (size_t start = 0; start < path_length; start += window_size) {
+                size_t end = min(start + window_size, path_length);
+                CoverageSummary summary = packer.path_window_coverage(path_name, start, end);
+                cout << path_name << "\t" << start << "\t" << end << "\t"
+                     << summary.mean() << "\t" << summary.max << endl;
+            }
+        }
+    }
 
     return 0;
 }
@@ -42,7 +42,8 @@ void help_sim(char** argv) {
          << "    -v, --frag-std-dev FLOAT    use this standard deviation for fragment length estimation" << endl
          << "    -N, --allow-Ns              allow reads to be sampled from the graph with Ns in them" << endl
          << "    -a, --align-out             generate true alignments on stdout rather than reads" << endl
-         << "    -J, --json-out              write alignments in json" << endl;
+         << "    -J, --json-out              write alignments in json" << endl
+         << "    -t, --threads N             number of threads to simulate -F reads with (default: all)" << endl;
 }
 
 int main_sim(int argc, char** argv) {
@@ -95,11 +96,12 @@ int main_sim(int argc, char** argv) {
             {"scale-err", required_argument, 0, 'S'},
             {"frag-len", required_argument, 0, 'p'},
             {"frag-std-dev", required_argument, 0, 'v'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:I",
+        c = getopt_long (argc, argv, "hl:n:s:e:i:fax:Jp:v:Nd:F:P:S:It:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -125,6 +127,10 @@ int main_sim(int argc, char** argv) {
             path_names.push_back(optarg);
             break;
 
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'l':
             read_length = atoi(optarg);
             break;
@@ -336,47 +342,55 @@ int main_sim(int argc, char** argv) {
                              !reads_may_contain_Ns,
                              seed_val);
         
-        if (fragment_length) {
-            for (size_t i = 0; i < num_reads; i++) {
-                pair<Alignment, Alignment> read_pair = sampler.sample_read_pair();
-                read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
-                read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
-                        cout << pb2json(read_pair.first) << endl;
-                        cout << pb2json(read_pair.second) << endl;
-                    }
-                    else {
-                        function<Alignment(uint64_t)> lambda = [&read_pair](uint64_t n) {
-                            return n % 2 == 1 ? read_pair.first : read_pair.second;
-                        };
-                        stream::write(cout, 2, lambda);
-                    }
+        // Sample reads in parallel a batch at a time, and write each batch out
+        // in read order. Each read's randomness depends only on the seed and
+        // its number, so the output doesn't depend on the thread count.
+        size_t batch_size = 1024 * get_thread_count();
+        size_t reads_per_sample = fragment_length ? 2 : 1;
+        vector<Alignment> batch;
+        for (size_t batch_start = 0; batch_start < num_reads; batch_start += batch_size) {
+            size_t batch_end = min(batch_start + batch_size, (size_t) num_reads);
+            batch.resize((batch_end - batch_start) * reads_per_sample);
+            
+#pragma omp parallel for schedule(dynamic, 64)
+            for (size_t i = batch_start; i < batch_end; i++) {
+                size_t slot = (i - batch_start) * reads_per_sample;
+                if (fragment_length) {
+                    pair<Alignment, Alignment> read_pair = sampler.sample_read_pair(i);
+                    read_pair.first.set_score(aligner.score_ungapped_alignment(read_pair.first, strip_bonuses));
+                    read_pair.second.set_score(aligner.score_ungapped_alignment(read_pair.second, strip_bonuses));
+                    batch[slot] = std::move(read_pair.first);
+                    batch[slot + 1] = std::move(read_pair.second);
                 }
                 else {
-                    cout << read_pair.first.sequence() << "\t" << read_pair.second.sequence() << endl;
+                    batch[slot] = sampler.sample_read(i);
+                    batch[slot].set_score(aligner.score_ungapped_alignment(batch[slot], strip_bonuses));
                 }
             }
-        }
-        else {
-            for (size_t i = 0; i < num_reads; i++) {
-                Alignment read = sampler.sample_read();
-                read.set_score(aligner.score_ungapped_alignment(read, strip_bonuses));
-                
-                if (align_out) {
-                    if (json_out) {
+            
+            if (align_out) {
+                if (json_out) {
+                    for (auto& read : batch) {
                         cout << pb2json(read) << endl;
                     }
-                    else {
-                        function<Alignment(uint64_t)> lambda = [&read](uint64_t n) {
-                            return read;
-                        };
-                        stream::write(cout, 1, lambda);
-                    }
                 }
                 else {
-                    cout << read.sequence() << endl;
+                    if (fragment_length) {
+                        // pairs have always gone out second end first
+                        for (size_t i = 0; i < batch.size(); i += 2) {
+                            std::swap(batch[i], batch[i + 1]);
+                        }
+                    }
+                    stream::write_buffered(cout, batch, 0);
+                }
+            }
+            else {
+                for (size_t i = 0; i < batch.size(); i += reads_per_sample) {
+                    cout << batch[i].sequence();
+                    if (fragment_length) {
+                        cout << "\t" << batch[i + 1].sequence();
+                    }
+                    cout << endl;
                 }
             }
         }
@@ -13,6 +13,8 @@
 #include "../vg.hpp"
 #include "vg.pb.h"
 #include "../traversal_finder.hpp"
+#include "../distance_index.hpp"
+#include "../snarl_index.hpp"
 
 
 using namespace std;
@@ -28,8 +30,12 @@ void help_snarl(char** argv) {
          << "    -l, --leaf-only       restrict traversals to leaf ultrabubbles." << endl
          << "    -o, --top-level       restrict traversals to top level ultrabubbles" << endl
          << "    -m, --max-nodes N     only compute traversals for snarls with <= N nodes [10]" << endl
+         << "    -T, --max-traversals N stop after N traversals of a snarl (0 for no limit) [0]" << endl
          << "    -t, --filter-trivial  don't report snarls that consist of a single edge" << endl
-         << "    -s, --sort-snarls     return snarls in sorted order by node ID (for topologically ordered graphs)" << endl;
+         << "    -s, --sort-snarls     return snarls in sorted order by node ID (for topologically ordered graphs)" << endl
+         << "    -d, --dist-index FILE also write a snarl distance index for the graph to FILE" << endl
+         << "    -C, --by-component    decompose each weakly connected component separately, in parallel" << endl
+         << "    -b, --snarl-index FILE also write a memory-mappable binary snarl index to FILE" << endl;
 }
 
 int main_snarl(int argc, char** argv) {
@@ -42,12 +48,16 @@ int main_snarl(int argc, char** argv) {
     static const int buffer_size = 100;
     
     string traversal_file;
+    string distance_index_file;
+    string snarl_index_file;
     bool leaf_only = false;
     bool top_level_only = false;
     int max_nodes = 10;
+    size_t max_traversals = 0;
     bool filter_trivial_snarls = false;
     bool sort_snarls = false;
     bool fill_path_names = false;
+    bool by_component = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -59,14 +69,18 @@ int main_snarl(int argc, char** argv) {
                 {"leaf-only", no_argument, 0, 'l'},
                 {"top-level", no_argument, 0, 'o'},
                 {"max-nodes", required_argument, 0, 'm'},
+                {"max-traversals", required_argument, 0, 'T'},
                 {"filter-trivial", no_argument, 0, 't'},
                 {"sort-snarls", no_argument, 0, 's'},
+                {"dist-index", required_argument, 0, 'd'},
+                {"by-component", no_argument, 0, 'C'},
+                {"snarl-index", required_argument, 0, 'b'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
 
-        c = getopt_long (argc, argv, "sr:ltopm:h?",
+        c = getopt_long (argc, argv, "sr:ltopm:T:d:Cb:h?",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -92,6 +106,10 @@ int main_snarl(int argc, char** argv) {
             max_nodes = atoi(optarg);
             break;
             
+        case 'T':
+            max_traversals = atoi(optarg);
+            break;
+            
         case 't':
             filter_trivial_snarls = true;
             break;
@@ -103,6 +121,18 @@ int main_snarl(int argc, char** argv) {
             fill_path_names = true;
             break;
             
+        case 'd':
+            distance_index_file = optarg;
+            break;
+            
+        case 'C':
+            by_component = true;
+            break;
+            
+        case 'b':
+            snarl_index_file = optarg;
+            break;
+            
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -138,12 +168,37 @@ int main_snarl(int argc, char** argv) {
         exit(1);
     }
 
-    // The only implemented snarl finder:
-    SnarlFinder* snarl_finder = new CactusSnarlFinder(*graph);
+    SnarlFinder* snarl_finder;
+    if (by_component) {
+        snarl_finder = new ComponentCactusSnarlFinder(graph, &graph->paths);
+    } else {
+        snarl_finder = new CactusSnarlFinder(*graph);
+    }
     
     // Load up all the snarls
     SnarlManager snarl_manager = snarl_finder->find_snarls();
     vector<const Snarl*> snarl_roots = snarl_manager.top_level_snarls();
+    
+    if (!snarl_index_file.empty()) {
+        ofstream snarl_index_stream(snarl_index_file);
+        if (!snarl_index_stream) {
+            cerr << "error:[vg snarl]: Could not open \"" << snarl_index_file
+                 << "\" for writing" << endl;
+            return 1;
+        }
+        SnarlIndex::write(snarl_manager, snarl_index_stream);
+    }
+    
+    if (!distance_index_file.empty()) {
+        ofstream distance_index_stream(distance_index_file);
+        if (!distance_index_stream) {
+            cerr << "error:[vg snarl]: Could not open \"" << distance_index_file
+                 << "\" for writing" << endl;
+            return 1;
+        }
+        DistanceIndex distance_index(graph, &snarl_manager);
+        distance_index.save(distance_index_stream);
+    }
     if (fill_path_names){
         TraversalFinder* trav_finder = new PathBasedTraversalFinder(*graph, snarl_manager);
         for (const Snarl* snarl : snarl_roots ){
@@ -166,7 +221,7 @@ int main_snarl(int argc, char** argv) {
     }
 
 
-    TraversalFinder* trav_finder = new ExhaustiveTraversalFinder(*graph, snarl_manager);
+    TraversalFinder* trav_finder = new ExhaustiveTraversalFinder(*graph, snarl_manager, false, max_traversals);
     
     // Sort the top level Snarls
     if (sort_snarls) {
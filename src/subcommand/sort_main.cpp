@@ -25,9 +25,18 @@ void help_sort(char** argv){
          << "options: " << endl
          << "           -g, --gfa              input in GFA format" << endl
          << "           -i, --in               input file" << endl
-         << "           -r, --ref              reference name" << endl
+         << "           -r, --ref              reference name (may repeat with -c)" << endl
          << "           -w, --without-grooming no grooming mode" << endl
          << "           -f, --fast             sort using Eades algorithm, otherwise max-flow sorting is used" << endl   
+         << "           -c, --components       sort each connected component on its own, along the first" << endl
+         << "                                  reference that visits it, in parallel" << endl
+         << "           -t, --threads N        number of threads to use with -c" << endl
+         << "           -p, --progress         show progress over the components" << endl
+         << "           -O, --out-of-core      sort each connected component on its own, as with -c, streaming" << endl
+         << "                                  the graph through temporary files so only a bin of components" << endl
+         << "                                  is in memory at once, and renumber the nodes in sorted order" << endl
+         << "           -B, --bin-nodes N      put at most N nodes in each bin with -O, unless one component" << endl
+         << "                                  is bigger [1000000]" << endl
          << endl;
 }
 
@@ -36,9 +45,13 @@ int main_sort(int argc, char *argv[]) {
     //default input format is vg
     bool gfa_input = false;
     string file_name = "";
-    string reference_name = "";
+    vector<string> reference_names;
     bool without_grooming = false;
     bool use_fast_algorithm = false;
+    bool by_component = false;
+    bool show_progress = false;
+    bool out_of_core = false;
+    size_t bin_nodes = 1000000;
     int c;
     while (true) {
         static struct option long_options[] =
@@ -48,11 +61,16 @@ int main_sort(int argc, char *argv[]) {
                 {"ref", required_argument, 0, 'r'},
                 {"without-grooming", no_argument, 0, 'w'},
                 {"fast", no_argument, 0, 'f'},
+                {"components", no_argument, 0, 'c'},
+                {"threads", required_argument, 0, 't'},
+                {"progress", no_argument, 0, 'p'},
+                {"out-of-core", no_argument, 0, 'O'},
+                {"bin-nodes", required_argument, 0, 'B'},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "i:r:gwf",
+        c = getopt_long (argc, argv, "i:r:gwfct:pOB:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -65,7 +83,7 @@ int main_sort(int argc, char *argv[]) {
             gfa_input = true;
             break;
         case 'r':
-            reference_name = optarg;
+            reference_names.push_back(optarg);
             break;
         case 'i':
             file_name = optarg;
@@ -76,6 +94,21 @@ int main_sort(int argc, char *argv[]) {
         case 'f':
             use_fast_algorithm = true;
             break;
+        case 'c':
+            by_component = true;
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+        case 'p':
+            show_progress = true;
+            break;
+        case 'O':
+            out_of_core = true;
+            break;
+        case 'B':
+            bin_nodes = atoll(optarg);
+            break;
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -87,10 +120,28 @@ int main_sort(int argc, char *argv[]) {
         }
     }
   
-    if (reference_name.empty() || file_name.empty()) {
+    if (reference_names.empty() || file_name.empty()) {
         help_sort(argv);
         exit(1);
     }
+    if (reference_names.size() > 1 && !by_component && !out_of_core) {
+        cerr << "error:[vg sort] multiple references can only be used with -c or -O" << endl;
+        exit(1);
+    }
+    
+    if (out_of_core) {
+        if (gfa_input) {
+            cerr << "error:[vg sort] out-of-core sorting needs a .vg input, not GFA" << endl;
+            exit(1);
+        }
+        if (bin_nodes == 0) {
+            cerr << "error:[vg sort] bin size must be at least 1 node" << endl;
+            exit(1);
+        }
+        FlowSort::sort_out_of_core(file_name, std::cout, reference_names, use_fast_algorithm,
+                                   !without_grooming, bin_nodes, show_progress);
+        return 0;
+    }
     
     ifstream in;
     std::unique_ptr<VG> graph;
@@ -104,10 +155,13 @@ int main_sort(int argc, char *argv[]) {
         }
     }
     FlowSort flow_sort(*graph.get());
-    if (use_fast_algorithm) {
-        flow_sort.fast_linear_sort(reference_name, !without_grooming);
+    flow_sort.show_progress = show_progress;
+    if (by_component) {
+        flow_sort.sort_by_component(reference_names, use_fast_algorithm, !without_grooming);
+    } else if (use_fast_algorithm) {
+        flow_sort.fast_linear_sort(reference_names.front(), !without_grooming);
     } else {
-        flow_sort.max_flow_sort(reference_name);
+        flow_sort.max_flow_sort(reference_names.front());
     }
     
     graph->serialize_to_ostream(std::cout);
@@ -34,6 +34,9 @@ void help_srpe(char** argv){
     << "  -p / --ref-path" << endl
     << "  -x / --xg" << endl 
     << "  -g / --gcsa" << endl 
+    << "  -s / --signals       Print per-node read, depth, discordant pair, and split read counts" << endl
+    << "  -i / --interleaved   Reads are interleaved pairs (for -s)" << endl
+    << "  -t / --threads N     Use N threads" << endl
     << endl;
 }
 
@@ -62,6 +65,8 @@ int main_srpe(int argc, char** argv){
     bool remap = false;
 
     bool do_all = false;
+    bool do_signals = false;
+    bool interleaved = false;
 
     vector<string> search_types;
     search_types.push_back("DEL");
@@ -90,11 +95,13 @@ int main_srpe(int argc, char** argv){
             {"threads", required_argument, 0, 't'},
             {"ref-path", required_argument, 0, 'p'},
             {"remap", no_argument, 0, 'z'},
+            {"signals", no_argument, 0, 's'},
+            {"interleaved", no_argument, 0, 'i'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "hzx:g:m:S:RI:r:t:a:wp:",
+        c = getopt_long (argc, argv, "hzx:g:m:S:RI:r:t:a:wp:si",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -138,6 +145,12 @@ int main_srpe(int argc, char** argv){
             case 'p':
                 ref_path = optarg;
                 break;
+            case 's':
+                do_signals = true;
+                break;
+            case 'i':
+                interleaved = true;
+                break;
             case 'h':
             case '?':
             default:
@@ -159,6 +172,40 @@ int main_srpe(int argc, char** argv){
     //gam_index_name = argv[++optind];
     graph_name = argv[++optind];
 
+    if (do_signals){
+        // Depth, discordant pairs, and split reads all come from one pass
+        SVSignalCollector collector;
+        collector.max_fragment_length = max_frag_len;
+        collector.soft_clip_limit = min_soft_clip;
+        ifstream gamstream(alignment_file);
+        if (!gamstream){
+            cerr << "[vg srpe] error: could not open " << alignment_file << endl;
+            exit(1);
+        }
+        collector.add_reads(gamstream, interleaved);
+        collector.finish();
+
+        vector<int64_t> node_ids;
+        for (auto& node : collector.signals){
+            node_ids.push_back(node.first);
+        }
+        sort(node_ids.begin(), node_ids.end());
+        cout << "node\treads\tdepth\tdiscordant\tsplit" << endl;
+        for (auto node_id : node_ids){
+            NodeSignals& node_signals = collector.signals[node_id];
+            uint64_t covered_bases = 0;
+            auto found = collector.depth.node_depths.find(node_id);
+            if (found != collector.depth.node_depths.end()){
+                for (auto d : found->second){
+                    covered_bases += d;
+                }
+            }
+            cout << node_id << "\t" << node_signals.reads << "\t" << covered_bases << "\t"
+                 << node_signals.discordant << "\t" << node_signals.split << endl;
+        }
+        return 0;
+    }
+
     xg::XG* xg_ind = new xg::XG();
     Index gamind;
 
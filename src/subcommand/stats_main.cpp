@@ -18,6 +18,7 @@
 #include "../vg.hpp"
 #include "../distributions.hpp"
 #include "../genotypekit.hpp"
+#include "../columnar_gam.hpp"
 
 using namespace std;
 using namespace vg;
@@ -51,6 +52,107 @@ void help_stats(char** argv) {
          << "    -v, --verbose         output longer reports" << endl;
 }
 
+/// What one thread has seen of a graph streamed in as chunks. A node or edge
+/// can show up in more than one chunk, so they are kept as sets and only
+/// counted once every thread's stats have been merged.
+struct StreamedGraphStats {
+    /// The length of each node seen
+    unordered_map<vg::id_t, size_t> node_lengths;
+    /// Every edge seen, as a canonical pair of node sides
+    unordered_set<pair<NodeSide, NodeSide>> edges;
+    /// Only keep edges if something asked for them
+    bool keep_edges = false;
+
+    void add(const Graph& chunk) {
+        for (auto& node : chunk.node()) {
+            node_lengths[node.id()] = node.sequence().size();
+        }
+        if (keep_edges) {
+            for (auto& edge : chunk.edge()) {
+                edges.insert(NodeSide::pair_from_edge(edge));
+            }
+        }
+    }
+
+    void merge(StreamedGraphStats& other) {
+        node_lengths.insert(other.node_lengths.begin(), other.node_lengths.end());
+        edges.insert(other.edges.begin(), other.edges.end());
+        other.node_lengths.clear();
+        other.edges.clear();
+    }
+
+    /// Get the nodes with nothing attached to the given side, in ID order
+    vector<vg::id_t> nodes_with_free_side(bool is_end) const {
+        unordered_set<NodeSide> attached;
+        for (auto& edge : edges) {
+            attached.insert(edge.first);
+            attached.insert(edge.second);
+        }
+        vector<vg::id_t> free;
+        for (auto& node : node_lengths) {
+            if (!attached.count(NodeSide(node.first, is_end))) {
+                free.push_back(node.first);
+            }
+        }
+        sort(free.begin(), free.end());
+        return free;
+    }
+};
+
+/// One thread's tallies over the reads in a GAM, merged once all the reads
+/// are in so the threads never contend for shared counters.
+struct AlignmentStats {
+    size_t total_alignments = 0;
+    size_t total_aligned = 0;
+    size_t total_primary = 0;
+    size_t total_secondary = 0;
+    // Inserted bases also counts softclips
+    size_t total_insertions = 0;
+    size_t total_inserted_bases = 0;
+    size_t total_deletions = 0;
+    size_t total_deleted_bases = 0;
+    size_t total_substitutions = 0;
+    size_t total_substituted_bases = 0;
+    size_t total_softclips = 0;
+    size_t total_softclipped_bases = 0;
+    // Which nodes are covered and which are not
+    unordered_map<vg::id_t, size_t> node_visit_counts;
+    // Reads on each allele of each site
+    map<string, map<string, size_t>> reads_on_allele;
+    // In verbose mode, the details of each event
+    vector<pair<vg::id_t, Edit>> insertions;
+    vector<pair<vg::id_t, Edit>> deletions;
+    vector<pair<vg::id_t, Edit>> substitutions;
+    vector<pair<vg::id_t, Edit>> softclips;
+
+    void merge(AlignmentStats& other) {
+        total_alignments += other.total_alignments;
+        total_aligned += other.total_aligned;
+        total_primary += other.total_primary;
+        total_secondary += other.total_secondary;
+        total_insertions += other.total_insertions;
+        total_inserted_bases += other.total_inserted_bases;
+        total_deletions += other.total_deletions;
+        total_deleted_bases += other.total_deleted_bases;
+        total_substitutions += other.total_substitutions;
+        total_substituted_bases += other.total_substituted_bases;
+        total_softclips += other.total_softclips;
+        total_softclipped_bases += other.total_softclipped_bases;
+        for (auto& visits : other.node_visit_counts) {
+            node_visit_counts[visits.first] += visits.second;
+        }
+        for (auto& site : other.reads_on_allele) {
+            for (auto& allele : site.second) {
+                reads_on_allele[site.first][allele.first] += allele.second;
+            }
+        }
+        insertions.insert(insertions.end(), other.insertions.begin(), other.insertions.end());
+        deletions.insert(deletions.end(), other.deletions.begin(), other.deletions.end());
+        substitutions.insert(substitutions.end(), other.substitutions.begin(), other.substitutions.end());
+        softclips.insert(softclips.end(), other.softclips.begin(), other.softclips.end());
+    }
+};
+
 int main_stats(int argc, char** argv) {
 
     if (argc == 2) {
@@ -205,6 +307,70 @@ int main_stats(int argc, char** argv) {
         }
     }
 
+    // Counts, lengths, ID ranges, heads, and tails can all come from one
+    // parallel pass over the graph's chunks, without building the graph.
+    bool only_streamable = !stats_subgraphs && !show_sibs && !show_components && !is_acyclic
+        && !head_distance && !tail_distance && paths_to_overlap.empty() && !overlap_all_paths
+        && alignments_filename.empty() && !snarl_stats;
+    if (only_streamable) {
+        vector<StreamedGraphStats> thread_stats(get_thread_count());
+        for (auto& stats : thread_stats) {
+            stats.keep_edges = stats_size || edge_count || stats_heads || stats_tails;
+        }
+        function<void(Graph&)> lambda = [&](Graph& chunk) {
+            thread_stats[omp_get_thread_num()].add(chunk);
+        };
+        get_input_file(optind, argc, argv, [&](istream& in) {
+            stream::for_each_parallel(in, lambda);
+        });
+        StreamedGraphStats& stats = thread_stats.front();
+        for (size_t i = 1; i < thread_stats.size(); i++) {
+            stats.merge(thread_stats[i]);
+        }
+
+        if (stats_size) {
+            cout << "nodes" << "\t" << stats.node_lengths.size() << endl
+                << "edges" << "\t" << stats.edges.size() << endl;
+        }
+        if (node_count) {
+            cout << stats.node_lengths.size() << endl;
+        }
+        if (edge_count) {
+            cout << stats.edges.size() << endl;
+        }
+        if (stats_length) {
+            size_t total_length = 0;
+            for (auto& node : stats.node_lengths) {
+                total_length += node.second;
+            }
+            cout << "length" << "\t" << total_length << endl;
+        }
+        if (stats_heads) {
+            cout << "heads" << "\t";
+            for (auto id : stats.nodes_with_free_side(false)) {
+                cout << id << " ";
+            }
+            cout << endl;
+        }
+        if (stats_tails) {
+            cout << "tails" << "\t";
+            for (auto id : stats.nodes_with_free_side(true)) {
+                cout << id << " ";
+            }
+            cout << endl;
+        }
+        if (stats_range) {
+            vg::id_t min_id = numeric_limits<vg::id_t>::max();
+            vg::id_t max_id = 0;
+            for (auto& node : stats.node_lengths) {
+                min_id = min(min_id, node.first);
+                max_id = max(max_id, node.first);
+            }
+            cout << "node-id-range\t" << (stats.node_lengths.empty() ? 0 : min_id) << ":" << max_id << endl;
+        }
+        return 0;
+    }
+
     VG* graph;
     get_input_file(optind, argc, argv, [&](istream& in) {
         graph = new VG(in);
@@ -475,59 +641,32 @@ int main_stats(int argc, char** argv) {
         });
 
 
-        // These are the general stats we will compute.
-        size_t total_alignments = 0;
-        size_t total_aligned = 0;
-        size_t total_primary = 0;
-        size_t total_secondary = 0;
-
         // These are for counting significantly allele-biased hets
         size_t total_hets = 0;
         size_t significantly_biased_hets = 0;
 
-        // These are for tracking which nodes are covered and which are not
-        map<vg::id_t, size_t> node_visit_counts;
-
-        // And for counting indels
-        // Inserted bases also counts softclips
-        size_t total_insertions = 0;
-        size_t total_inserted_bases = 0;
-        size_t total_deletions = 0;
-        size_t total_deleted_bases = 0;
-        // And substitutions
-        size_t total_substitutions = 0;
-        size_t total_substituted_bases = 0;
-        // And softclips
-        size_t total_softclips = 0;
-        size_t total_softclipped_bases = 0;
-
-        // In verbose mode we want to report details of insertions, deletions,
-        // and substitutions, and soft clips.
-        vector<pair<vg::id_t, Edit>> insertions;
-        vector<pair<vg::id_t, Edit>> deletions;
-        vector<pair<vg::id_t, Edit>> substitutions;
-        vector<pair<vg::id_t, Edit>> softclips;
+        // Each thread tallies its own reads
+        vector<AlignmentStats> thread_stats(get_thread_count());
+        for (auto& stats : thread_stats) {
+            stats.reads_on_allele = reads_on_allele;
+        }
 
         function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            int tid = omp_get_thread_num();
+            AlignmentStats& stats = thread_stats[omp_get_thread_num()];
 
             // We ought to be able to do many stats on the alignments.
 
             // Now do all the non-mapping stats
-            #pragma omp critical (total_alignments)
-            total_alignments++;
+            stats.total_alignments++;
             if(aln.is_secondary()) {
-                #pragma omp critical (total_secondary)
-                total_secondary++;
+                stats.total_secondary++;
             } else {
-                #pragma omp critical (total_primary)
-                total_primary++;
+                stats.total_primary++;
                 if(aln.score() > 0) {
                     // We only count aligned primary reads in "total aligned";
                     // the primary can't be unaligned if the secondary is
                     // aligned.
-                    #pragma omp critical (total_aligned)
-                    total_aligned++;
+                    stats.total_aligned++;
                 }
 
                 // Which sites and alleles does this read support. TODO: if we hit
@@ -549,8 +688,7 @@ int main_stats(int argc, char** argv) {
                     }
 
                     // Record that there was a visit to this node.
-                    #pragma omp critical (node_visit_counts)
-                    node_visit_counts[node_id]++;
+                    stats.node_visit_counts[node_id]++;
 
                     for(size_t j = 0; j < mapping.edit_size(); j++) {
                         // Go through edits and look for each type.
@@ -559,50 +697,38 @@ int main_stats(int argc, char** argv) {
                         if(edit.to_length() > edit.from_length()) {
                             if((j == 0 && i == 0) || (j == mapping.edit_size() - 1 && i == aln.path().mapping_size() - 1)) {
                                 // We're at the very end of the path, so this is a soft clip.
-                                #pragma omp critical (total_softclipped_bases)
-                                total_softclipped_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_softclips)
-                                total_softclips++;
+                                stats.total_softclipped_bases += edit.to_length() - edit.from_length();
+                                stats.total_softclips++;
                                 if(verbose) {
                                     // Record the actual insertion
-                                    #pragma omp critical (softclips)
-                                    softclips.push_back(make_pair(node_id, edit));
+                                    stats.softclips.push_back(make_pair(node_id, edit));
                                 }
                             } else {
                                 // Record this insertion
-                                #pragma omp critical (total_inserted_bases)
-                                total_inserted_bases += edit.to_length() - edit.from_length();
-                                #pragma omp critical (total_insertions)
-                                total_insertions++;
+                                stats.total_inserted_bases += edit.to_length() - edit.from_length();
+                                stats.total_insertions++;
                                 if(verbose) {
                                     // Record the actual insertion
-                                    #pragma omp critical (insertions)
-                                    insertions.push_back(make_pair(node_id, edit));
+                                    stats.insertions.push_back(make_pair(node_id, edit));
                                 }
                             }
 
                         } else if(edit.from_length() > edit.to_length()) {
                             // Record this deletion
-                            #pragma omp critical (total_deleted_bases)
-                            total_deleted_bases += edit.from_length() - edit.to_length();
-                            #pragma omp critical (total_deletions)
-                            total_deletions++;
+                            stats.total_deleted_bases += edit.from_length() - edit.to_length();
+                            stats.total_deletions++;
                             if(verbose) {
                                 // Record the actual deletion
-                                #pragma omp critical (deletions)
-                                deletions.push_back(make_pair(node_id, edit));
+                                stats.deletions.push_back(make_pair(node_id, edit));
                             }
                         } else if(!edit.sequence().empty()) {
                             // Record this substitution
                             // TODO: a substitution might also occur as part of a deletion/insertion above!
-                            #pragma omp critical (total_substituted_bases)
-                            total_substituted_bases += edit.from_length();
-                            #pragma omp critical (total_substitutions)
-                            total_substitutions++;
+                            stats.total_substituted_bases += edit.from_length();
+                            stats.total_substitutions++;
                             if(verbose) {
                                 // Record the actual substitution
-                                #pragma omp critical (substitutions)
-                                substitutions.push_back(make_pair(node_id, edit));
+                                stats.substitutions.push_back(make_pair(node_id, edit));
                             }
                         }
 
@@ -612,15 +738,31 @@ int main_stats(int argc, char** argv) {
                 for(auto& site_and_allele : alleles_supported) {
                     // This read is informative for an allele of a site.
                     // Up the reads on that allele of that site.
-                    #pragma omp critical (reads_on_allele)
-                    reads_on_allele[site_and_allele.first][site_and_allele.second]++;
+                    stats.reads_on_allele[site_and_allele.first][site_and_allele.second]++;
                 }
             }
 
         };
 
+        // We only look at these fields, so don't decode the rest (or, from
+        // columnar GAM, even decompress it)
+        vector<int> used_fields{Alignment::kPathFieldNumber, Alignment::kScoreFieldNumber,
+            Alignment::kIsSecondaryFieldNumber};
+
         // Actually go through all the reads and count stuff up.
-        stream::for_each_parallel(alignment_stream, lambda);
+        for_each_alignment_fields_parallel(alignment_stream, used_fields, lambda);
+
+        // Then put all the threads' counts together
+        AlignmentStats& totals = thread_stats.front();
+        for (size_t i = 1; i < thread_stats.size(); i++) {
+            totals.merge(thread_stats[i]);
+        }
+        reads_on_allele = std::move(totals.reads_on_allele);
+        auto& node_visit_counts = totals.node_visit_counts;
+        auto& insertions = totals.insertions;
+        auto& deletions = totals.deletions;
+        auto& substitutions = totals.substitutions;
+        auto& softclips = totals.softclips;
 
         // Calculate stats about the reads per allele data
         for(auto& site_and_alleles : reads_on_allele) {
@@ -704,33 +846,33 @@ int main_stats(int argc, char** argv) {
             }
         });
 
-        cout << "Total alignments: " << total_alignments << endl;
-        cout << "Total primary: " << total_primary << endl;
-        cout << "Total secondary: " << total_secondary << endl;
-        cout << "Total aligned: " << total_aligned << endl;
+        cout << "Total alignments: " << totals.total_alignments << endl;
+        cout << "Total primary: " << totals.total_primary << endl;
+        cout << "Total secondary: " << totals.total_secondary << endl;
+        cout << "Total aligned: " << totals.total_aligned << endl;
 
-        cout << "Insertions: " << total_inserted_bases << " bp in " << total_insertions << " read events" << endl;
+        cout << "Insertions: " << totals.total_inserted_bases << " bp in " << totals.total_insertions << " read events" << endl;
         if(verbose) {
             for(auto& id_and_edit : insertions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Deletions: " << total_deleted_bases << " bp in " << total_deletions << " read events" << endl;
+        cout << "Deletions: " << totals.total_deleted_bases << " bp in " << totals.total_deletions << " read events" << endl;
         if(verbose) {
             for(auto& id_and_edit : deletions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.to_length()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Substitutions: " << total_substituted_bases << " bp in " << total_substitutions << " read events" << endl;
+        cout << "Substitutions: " << totals.total_substituted_bases << " bp in " << totals.total_substitutions << " read events" << endl;
         if(verbose) {
             for(auto& id_and_edit : substitutions) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
                     << " on " << id_and_edit.first << endl;
             }
         }
-        cout << "Softclips: " << total_softclipped_bases << " bp in " << total_softclips << " read events" << endl;
+        cout << "Softclips: " << totals.total_softclipped_bases << " bp in " << totals.total_softclips << " read events" << endl;
         if(verbose) {
             for(auto& id_and_edit : softclips) {
                 cout << "\t" << id_and_edit.second.from_length() << " -> " << id_and_edit.second.sequence()
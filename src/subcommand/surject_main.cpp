@@ -12,6 +12,7 @@
 
 #include "../vg.hpp"
 #include "../stream.hpp"
+#include "../stream_emitter.hpp"
 #include "../utility.hpp"
 #include "../mapper.hpp"
 
@@ -31,7 +32,7 @@ void help_surject(char** argv) {
          << "    -n, --context-depth N   expand this many steps when collecting graph for surjection (default: 3)" << endl
          << "    -b, --bam-output        write BAM to stdout" << endl
          << "    -s, --sam-output        write SAM to stdout" << endl
-         << "    -C, --compression N     level for compression [0-9]" << endl;
+         << "    -C, --compress N        level for BAM/CRAM compression [0-9] (default: 9)" << endl;
 }
 
 int main_surject(int argc, char** argv) {
@@ -127,6 +128,10 @@ int main_surject(int argc, char** argv) {
 
         case 'C':
             compress_level = atoi(optarg);
+            if (compress_level < 0 || compress_level > 9) {
+                cerr << "[vg surject] error: compression level must be between 0 and 9" << endl;
+                return 1;
+            }
             break;
 
         case 'n':
@@ -193,7 +198,9 @@ int main_surject(int argc, char** argv) {
             int thread_count = get_thread_count();
             vector<vector<Alignment> > buffer;
             buffer.resize(thread_count);
-            function<void(Alignment&)> lambda = [&xgidx, &path_names, &buffer, &mapper](Alignment& src) {
+            // compress and write in the background
+            stream::AsyncEmitter<Alignment> emitter(cout);
+            function<void(Alignment&)> lambda = [&xgidx, &path_names, &buffer, &mapper, &emitter](Alignment& src) {
                 int tid = omp_get_thread_num();
                 Alignment surj;
                 // Since we're outputting full GAM, we ignore all this info
@@ -203,14 +210,15 @@ int main_surject(int argc, char** argv) {
                 int64_t path_pos;
                 bool path_reverse;
                 buffer[tid].push_back(mapper[tid]->surject_alignment(src, path_names,path_name, path_pos, path_reverse));
-                stream::write_buffered(cout, buffer[tid], 100);
+                emitter.emit_buffered(buffer[tid], 100);
             };
             get_input_file(file_name, [&](istream& in) {
                 stream::for_each_parallel(in, lambda);
             });
             for (int i = 0; i < thread_count; ++i) {
-                stream::write_buffered(cout, buffer[i], 0); // flush
+                emitter.emit_buffered(buffer[i], 0); // flush
             }
+            emitter.finish();
         } else {
             char out_mode[5];
             string out_format = "";
@@ -233,8 +241,18 @@ int main_surject(int argc, char** argv) {
                */
             string header;
             int thread_count = get_thread_count();
-            vector<vector<tuple<string, int64_t, bool, Alignment> > > buffer;
+            // records are encoded by the threads that surject them
+            vector<vector<bam1_t*> > buffer;
             buffer.resize(thread_count);
+            // written records that each thread can encode into again
+            vector<vector<bam1_t*> > spare_records;
+            spare_records.resize(thread_count);
+            // the header lists the paths in name order, so we know their numbers before we make it
+            unordered_map<string, int32_t> path_tid;
+            for (auto& p : path_length) {
+                int32_t next_tid = path_tid.size();
+                path_tid[p.first] = next_tid;
+            }
             map<string, string> rg_sample;
 
             // bam/sam/cram output
@@ -249,7 +267,7 @@ int main_surject(int argc, char** argv) {
             // handles buffers, possibly opening the output file if we're on the first record
             auto handle_buffer =
                 [&hdr, &header, &path_length, &rg_sample, &buffer_limit,
-                &out_mode, &out, &output_lock, &fasta_filename](vector<tuple<string, int64_t, bool, Alignment> >& buf) {
+                &out_mode, &out, &output_lock, &fasta_filename, &thread_count](vector<bam1_t*>& buf, vector<bam1_t*>& spare) {
                     if (buf.size() >= buffer_limit) {
                         // do we have enough data to open the file?
 #pragma omp critical (hts_header)
@@ -266,6 +284,10 @@ int main_surject(int argc, char** argv) {
                                     cerr << "[vg surject] failed to open stdout for writing HTS output" << endl;
                                     exit(1);
                                 } else {
+                                    // compress BGZF blocks on all our threads
+                                    if (thread_count > 1) {
+                                        hts_set_threads(out, thread_count);
+                                    }
                                     // write the header
                                     if (sam_hdr_write(out, hdr) != 0) {
                                         cerr << "[vg surject] error: failed to write the SAM header" << endl;
@@ -275,26 +297,12 @@ int main_surject(int argc, char** argv) {
                         }
                         // try to get a lock, and force things if we've built up a huge buffer waiting
                         if (omp_test_lock(&output_lock) || buf.size() > 10*buffer_limit) {
-                            for (auto& s : buf) {
-                                auto& path_nom = get<0>(s);
-                                auto& path_pos = get<1>(s);
-                                auto& path_reverse = get<2>(s);
-                                auto& surj = get<3>(s);
-                                string cigar = cigar_against_path(surj, path_reverse);
-                                bam1_t* b = alignment_to_bam(header,
-                                        surj,
-                                        path_nom,
-                                        path_pos,
-                                        path_reverse,
-                                        cigar,
-                                        "=",
-                                        path_pos,
-                                        0);
+                            for (auto& b : buf) {
                                 int r = 0;
 #pragma omp critical (cout)
                                 r = sam_write1(out, hdr, b);
                                 if (r == 0) { cerr << "[vg surject] error: writing to stdout failed" << endl; exit(1); }
-                                bam_destroy1(b);
+                                spare.push_back(b);
                             }
                             omp_unset_lock(&output_lock);
                             buf.clear();
@@ -307,9 +315,10 @@ int main_surject(int argc, char** argv) {
                                                  &path_names,
                                                  &path_length,
                                                  &rg_sample,
-                                                 &header,
+                                                 &path_tid,
                                                  &out,
                                                  &buffer,
+                                                 &spare_records,
                                                  &count,
                                                  &hdr,
                                                  &out_mode,
@@ -328,8 +337,29 @@ int main_surject(int argc, char** argv) {
                         rg_sample[surj.read_group()] = surj.sample_name();
                     }
 
-                    buffer[tid].push_back(make_tuple(path_name, path_pos, path_reverse, surj));
-                    handle_buffer(buffer[tid]);
+                    // encode into a record we already wrote out, if we have one
+                    bam1_t* b;
+                    if (spare_records[tid].empty()) {
+                        b = bam_init1();
+                    } else {
+                        b = spare_records[tid].back();
+                        spare_records[tid].pop_back();
+                    }
+                    auto found = path_tid.find(path_name);
+                    int32_t tid_in_header = found == path_tid.end() ? -1 : found->second;
+                    vector<uint32_t> cigar;
+                    cigar_against_path(surj, path_reverse, cigar);
+                    alignment_to_bam(surj,
+                                     tid_in_header,
+                                     path_pos,
+                                     path_reverse,
+                                     cigar,
+                                     tid_in_header,
+                                     path_pos,
+                                     0,
+                                     b);
+                    buffer[tid].push_back(b);
+                    handle_buffer(buffer[tid], spare_records[tid]);
 
                 };
 
@@ -339,8 +369,11 @@ int main_surject(int argc, char** argv) {
                 stream::for_each_parallel(in, lambda);
             });
             buffer_limit = 0;
-            for (auto& buf : buffer) {
-                handle_buffer(buf);
+            for (int i = 0; i < thread_count; ++i) {
+                handle_buffer(buffer[i], spare_records[i]);
+                for (auto b : spare_records[i]) {
+                    bam_destroy1(b);
+                }
             }
             bam_hdr_destroy(hdr);
             sam_close(out);
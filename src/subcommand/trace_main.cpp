@@ -1,3 +1,4 @@
+#include <omp.h>
 #include <getopt.h>
 
 #include <string>
@@ -6,6 +7,8 @@
 #include "subcommand.hpp"
 
 #include "../vg.hpp"
+#include "../stream.hpp"
+#include "../region.hpp"
 #include "../haplotype_extracter.hpp"
 
 using namespace vg;
@@ -19,11 +22,15 @@ void help_trace(char** argv) {
          << "options:" << endl
          << "    -x, --index FILE           use this xg index" << endl
          << "    -n, --start-node INT       start at this node" << endl
+         << "    -e, --input-bed FILE       trace from the start of each (0-based end-exclusive) bed region" << endl
+         << "                               and write one subgraph per region, in order" << endl
+         << "    -g, --gbwt-name FILE       search for haplotypes in this GBWT instead of the xg's gPBWT" << endl
         //TODO: implement backwards iteration over graph
         // << "    -b, --backwards            iterate backwards over graph" << endl
          << "    -d, --extend-distance INT  extend search this many nodes [default=50]" << endl
          << "    -a, --annotation-path      output file for haplotype frequency annotations" << endl
-         << "    -j, --json                 output subgraph in json instead of protobuf" << endl;
+         << "    -j, --json                 output subgraph in json instead of protobuf" << endl
+         << "    -t, --threads N            trace this many bed regions in parallel [1]" << endl;
 }
 
 int main_trace(int argc, char** argv) {
@@ -34,6 +41,9 @@ int main_trace(int argc, char** argv) {
 
   string xg_name;
   string annotation_path;
+  string in_bed_file;
+  string gbwt_name;
+  int threads = 1;
   int64_t start_node = 0;
   int extend_distance = 50;
   bool backwards = false;
@@ -49,6 +59,9 @@ int main_trace(int argc, char** argv) {
             {"index", required_argument, 0, 'x'},
             {"annotation-path", required_argument, 0, 'a'},
             {"start-node", required_argument, 0, 'n'},
+            {"input-bed", required_argument, 0, 'e'},
+            {"gbwt-name", required_argument, 0, 'g'},
+            {"threads", required_argument, 0, 't'},
             {"extend-distance", required_argument, 0, 'd'},
             {"json", no_argument, 0, 'j'},
             //{"backwards", no_argument, 0, 'b'},
@@ -56,7 +69,7 @@ int main_trace(int argc, char** argv) {
         };
 
     int option_index = 0;
-    c = getopt_long (argc, argv, "x:a:n:d:jh",
+    c = getopt_long (argc, argv, "x:a:n:e:g:d:jt:h",
                      long_options, &option_index);
 
     /* Detect the end of the options. */
@@ -77,6 +90,18 @@ int main_trace(int argc, char** argv) {
         start_node = atoi(optarg);
         break;
 
+    case 'e':
+        in_bed_file = optarg;
+        break;
+
+    case 'g':
+        gbwt_name = optarg;
+        break;
+
+    case 't':
+        threads = atoi(optarg);
+        break;
+
     case 'd':
         extend_distance = atoi(optarg);
         break;
@@ -104,34 +129,97 @@ int main_trace(int argc, char** argv) {
     cerr << "[vg trace] xg index must be specified with -x" << endl;
     return 1;
   }
-  if (start_node < 1) {
-    cerr << "[vg trace] start node must be specified with -n" << endl;
+  if (start_node < 1 && in_bed_file.empty()) {
+    cerr << "[vg trace] start node must be specified with -n or regions with -e" << endl;
     return 1;
   }
+  if (start_node >= 1 && !in_bed_file.empty()) {
+    cerr << "[vg trace] only one of -n and -e may be given" << endl;
+    return 1;
+  }
+  omp_set_num_threads(threads);
+
   xg::XG xindex;  
   ifstream in(xg_name.c_str());
   xindex.load(in);
 
-  // trace out our graph and paths from the start node
-  Graph trace_graph;
-  map<string, int> haplotype_frequences;
-  trace_haplotypes_and_paths(xindex, start_node, extend_distance, trace_graph,
-                             haplotype_frequences);
-
-  // dump our graph to stdout
-  if (json) {
-    cout << pb2json(trace_graph);
-  } else {
-    VG vg_graph;
-    vg_graph.extend(trace_graph);
-    vg_graph.serialize_to_ostream(cout);
+  unique_ptr<gbwt::GBWT> gbwt_index;
+  if (!gbwt_name.empty()) {
+    ifstream gbwt_stream(gbwt_name);
+    if (!gbwt_stream) {
+      cerr << "[vg trace] unable to open GBWT index " << gbwt_name << endl;
+      return 1;
+    }
+    gbwt_index = unique_ptr<gbwt::GBWT>(new gbwt::GBWT());
+    gbwt_index->load(gbwt_stream);
   }
 
-  // if requested, write thread frequencies to a file
+  ofstream annotation_file;
   if (!annotation_path.empty()) {
-    ofstream annotation_file(annotation_path);
-    for (auto tf : haplotype_frequences) {
-      annotation_file << tf.first << "\t" << tf.second << endl;
+    annotation_file.open(annotation_path);
+  }
+
+  if (in_bed_file.empty()) {
+    // trace out our graph and paths from the start node
+    Graph trace_graph;
+    map<string, int> haplotype_frequences;
+    trace_haplotypes_and_paths(xindex, start_node, extend_distance, trace_graph,
+                               haplotype_frequences, true, gbwt_index.get());
+
+    // dump our graph to stdout
+    if (json) {
+      cout << pb2json(trace_graph);
+    } else {
+      VG vg_graph;
+      vg_graph.extend(trace_graph);
+      vg_graph.serialize_to_ostream(cout);
+    }
+
+    // if requested, write thread frequencies to a file
+    if (annotation_file.is_open()) {
+      for (auto tf : haplotype_frequences) {
+        annotation_file << tf.first << "\t" << tf.second << endl;
+      }
+    }
+    return 0;
+  }
+
+  vector<Region> regions;
+  parse_bed_regions(in_bed_file, regions);
+
+  // trace a batch of regions in parallel, then write them out in bed order before starting on the
+  // next batch, so that we don't hold every subgraph in memory at once
+  size_t batch_size = 64 * threads;
+  vector<Graph> trace_graphs;
+  vector<map<string, int>> haplotype_frequencies;
+  for (size_t batch_start = 0; batch_start < regions.size(); batch_start += batch_size) {
+    size_t batch_end = min(regions.size(), batch_start + batch_size);
+    trace_graphs.assign(batch_end - batch_start, Graph());
+    haplotype_frequencies.assign(batch_end - batch_start, map<string, int>());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = batch_start; i < batch_end; i++) {
+      Region& region = regions[i];
+      int64_t region_start_node = xindex.node_at_path_position(region.seq, region.start);
+      trace_haplotypes_and_paths(xindex, region_start_node, extend_distance, trace_graphs[i - batch_start],
+                                 haplotype_frequencies[i - batch_start], true, gbwt_index.get());
+    }
+
+    if (json) {
+      for (auto& trace_graph : trace_graphs) {
+        cout << pb2json(trace_graph) << endl;
+      }
+    } else {
+      stream::write_buffered(cout, trace_graphs, 0);
+    }
+
+    // label each region's frequencies with its coordinates
+    if (annotation_file.is_open()) {
+      for (size_t i = batch_start; i < batch_end; i++) {
+        for (auto& tf : haplotype_frequencies[i - batch_start]) {
+          annotation_file << regions[i].seq << ":" << regions[i].start << "-" << regions[i].end + 1 << "\t"
+                          << tf.first << "\t" << tf.second << endl;
+        }
+      }
     }
   }
 
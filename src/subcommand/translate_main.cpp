@@ -29,7 +29,37 @@ void help_translate(char** argv) {
          << "    -l, --loci FILE       project the input locus descriptions into the from-graph" << endl
          << "    -m, --mapping JSON    print the from-mapping corresponding to the given JSON mapping" << endl
          << "    -P, --position JSON   print the from-position corresponding to the given JSON position" << endl
-         << "    -o, --overlay FILE    overlay this translation on top of the one we are given" << endl;
+         << "    -o, --overlay FILE    overlay this translation on top of the one we are given" << endl
+         << "    -t, --threads N       number of threads to use [1]" << endl;
+}
+
+/// Translate everything in the input stream in parallel batches, and write the
+/// results to standard output in input order.
+template<typename T>
+static void translate_stream(istream& in, const function<T(const T&)>& translate) {
+    size_t batch_size = 1024 * get_thread_count();
+    vector<T> batch;
+    vector<T> buffer;
+    auto flush_batch = [&]() {
+#pragma omp parallel for schedule(dynamic, 16)
+        for (size_t i = 0; i < batch.size(); ++i) {
+            batch[i] = translate(batch[i]);
+        }
+        for (auto& item : batch) {
+            buffer.emplace_back(std::move(item));
+            stream::write_buffered(cout, buffer, 100);
+        }
+        batch.clear();
+    };
+    function<void(T&)> lambda = [&](T& item) {
+        batch.emplace_back(std::move(item));
+        if (batch.size() >= batch_size) {
+            flush_batch();
+        }
+    };
+    stream::for_each(in, lambda);
+    flush_batch();
+    stream::write_buffered(cout, buffer, 0);
 }
 
 int main_translate(int argc, char** argv) {
@@ -45,6 +75,7 @@ int main_translate(int argc, char** argv) {
     string aln_file;
     string loci_file;
     string overlay_file;
+    omp_set_num_threads(1); // default to 1 thread
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -58,11 +89,12 @@ int main_translate(int argc, char** argv) {
             {"alns", required_argument, 0, 'a'},
             {"loci", required_argument, 0, 'l'},
             {"overlay", required_argument, 0, 'o'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hp:m:P:a:o:l:",
+        c = getopt_long (argc, argv, "hp:m:P:a:o:l:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -95,6 +127,10 @@ int main_translate(int argc, char** argv) {
             overlay_file = optarg;
             break;
 
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
+
         case 'h':
         case '?':
             help_translate(argv);
@@ -126,43 +162,31 @@ int main_translate(int argc, char** argv) {
     }
 
     if (!path_file.empty()) {
-        vector<Path> buffer;
-        function<void(Path&)> lambda = [&](Path& path) {
-            buffer.push_back(translator->translate(path));
-            stream::write_buffered(cout, buffer, 100);
+        function<Path(const Path&)> translate = [&](const Path& path) {
+            return translator->translate(path);
         };
         ifstream path_in(path_file);
-        stream::for_each(path_in, lambda);
-        stream::write_buffered(cout, buffer, 0);
+        translate_stream(path_in, translate);
     } else if (!aln_file.empty()) {
-        vector<Alignment> buffer;
-        function<void(Alignment&)> lambda = [&](Alignment& aln) {
-            buffer.push_back(translator->translate(aln));
-            stream::write_buffered(cout, buffer, 100);
+        function<Alignment(const Alignment&)> translate = [&](const Alignment& aln) {
+            return translator->translate(aln);
         };
         ifstream aln_in(aln_file);
-        stream::for_each(aln_in, lambda);
-        stream::write_buffered(cout, buffer, 0);
+        translate_stream(aln_in, translate);
     } else if (!loci_file.empty()) {
-        vector<Locus> buffer;
-        function<void(Locus&)> lambda = [&](Locus& locus) {
-            buffer.push_back(translator->translate(locus));
-            stream::write_buffered(cout, buffer, 100);
+        function<Locus(const Locus&)> translate = [&](const Locus& locus) {
+            return translator->translate(locus);
         };
         ifstream loci_in(loci_file);
-        stream::for_each(loci_in, lambda);
-        stream::write_buffered(cout, buffer, 0);
+        translate_stream(loci_in, translate);
     }
 
     if (!overlay_file.empty()) {
-        vector<Translation> buffer;
-        function<void(Translation&)> lambda = [&](Translation& trans) {
-            buffer.push_back(translator->overlay(trans));
-            stream::write_buffered(cout, buffer, 100);
+        function<Translation(const Translation&)> overlay = [&](const Translation& trans) {
+            return translator->overlay(trans);
         };
         ifstream overlay_in(overlay_file);
-        stream::for_each(overlay_in, lambda);
-        stream::write_buffered(cout, buffer, 0);
+        translate_stream(overlay_in, overlay);
     }
 
     return 0;
@@ -27,7 +27,10 @@ void help_validate(char** argv) {
         << "    -n, --nodes    verify that we have the expected number of nodes" << endl
         << "    -e, --edges    verify that the graph contains all nodes that are referred to by edges" << endl
         << "    -p, --paths    verify that contiguous path segments are connected by edges" << endl
-        << "    -o, --orphans  verify that all nodes have edges" << endl;
+        << "    -o, --orphans  verify that all nodes have edges" << endl
+        << "    -f, --fail-fast    stop at the first problem instead of reporting all of them" << endl
+        << "    -T, --timing       report the time spent in each check" << endl
+        << "    -t, --threads N    number of threads to use [all available]" << endl;
 }
 
 int main_validate(int argc, char** argv) {
@@ -41,6 +44,8 @@ int main_validate(int argc, char** argv) {
     bool check_edges = false;
     bool check_orphans = false;
     bool check_paths = false;
+    bool fail_fast = false;
+    bool show_timing = false;
 
     int c;
     optind = 2; // force optind past command positional argument
@@ -50,13 +55,16 @@ int main_validate(int argc, char** argv) {
             {"help", no_argument, 0, 'h'},
             {"nodes", no_argument, 0, 'n'},
             {"edges", no_argument, 0, 'e'},
-            {"paths", no_argument, 0, 'o'},
-            {"orphans", no_argument, 0, 'p'},
+            {"paths", no_argument, 0, 'p'},
+            {"orphans", no_argument, 0, 'o'},
+            {"fail-fast", no_argument, 0, 'f'},
+            {"timing", no_argument, 0, 'T'},
+            {"threads", required_argument, 0, 't'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hneop",
+        c = getopt_long (argc, argv, "hneopfTt:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -82,6 +90,18 @@ int main_validate(int argc, char** argv) {
                 check_paths = true;
                 break;
 
+            case 'f':
+                fail_fast = true;
+                break;
+
+            case 'T':
+                show_timing = true;
+                break;
+
+            case 't':
+                omp_set_num_threads(atoi(optarg));
+                break;
+
             case 'h':
             case '?':
                 help_validate(argv);
@@ -98,19 +118,21 @@ int main_validate(int argc, char** argv) {
         graph = new VG(in);
     });
 
-    // if we chose a specific subset, do just them
-    if (check_nodes || check_edges || check_orphans || check_paths) {
-        if (graph->is_valid(check_nodes, check_edges, check_orphans, check_paths)) {
-            return 0;
-        } else {
-            return 1;
+    // if we chose a specific subset, do just them, otherwise do everything
+    if (!(check_nodes || check_edges || check_orphans || check_paths)) {
+        check_nodes = check_edges = check_orphans = check_paths = true;
+    }
+    map<string, double> check_seconds;
+    bool valid = graph->is_valid(check_nodes, check_edges, check_paths, check_orphans, fail_fast,
+                                 show_timing ? &check_seconds : nullptr);
+    if (show_timing) {
+        for (auto& check : check_seconds) {
+            cerr << "[vg validate] " << check.first << ": " << check.second << " s" << endl;
         }
-        // otherwise do everything
-    } else if (graph->is_valid()) {
-        return 0;
-    } else {
-        return 1;
     }
+    delete graph;
+
+    return valid ? 0 : 1;
 }
 
 // Register subcommand
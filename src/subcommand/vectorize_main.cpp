@@ -39,6 +39,9 @@ void help_vectorize(char** argv){
          << "  -p --mem-positions Add the positions to the MEM sketch of a given read based on the GCSA" << endl
          << "  -H --mem-hit-max N Ignore MEMs with this many hits when extracting poisitions" << endl
          << "  -i --identity-hot  Output a score vector based on percent identity and coverage" << endl
+         << "  -S --sparse FORMAT Output only the nonzero entries of each vector, as libsvm rows or COO" << endl
+         << "                     (row, column, value) triples; FORMAT is libsvm or coo. Works with -a and -i." << endl
+         << "  -t --threads N     Number of threads to use when making sparse output" << endl
          << endl;
 }
 
@@ -60,6 +63,7 @@ int main_vectorize(int argc, char** argv){
     bool mem_positions = false;
     bool mem_hit_max = 0;
     int max_mem_length = 0;
+    string sparse_format;
 
     if (argc <= 2) {
         help_vectorize(argv);
@@ -86,11 +90,12 @@ int main_vectorize(int argc, char** argv){
             {"identity-hot", no_argument, 0, 'i'},
             {"aln-label", required_argument, 0, 'l'},
             {"reads", required_argument, 0, 'r'},
+            {"sparse", required_argument, 0, 'S'},
             {0, 0, 0, 0}
 
         };
         int option_index = 0;
-        c = getopt_long (argc, argv, "AaihwM:fmpx:g:l:H:",
+        c = getopt_long (argc, argv, "AaihwM:fmpx:g:l:H:S:t:",
                 long_options, &option_index);
 
         // Detect the end of the options.
@@ -173,11 +178,26 @@ int main_vectorize(int argc, char** argv){
         case 'M':
             wabbit_mapping_file = optarg;
             break;
+        case 'S':
+            sparse_format = optarg;
+            break;
+        case 't':
+            omp_set_num_threads(atoi(optarg));
+            break;
         default:
             abort();
         }
     }
 
+    if (!sparse_format.empty() && sparse_format != "libsvm" && sparse_format != "coo") {
+        cerr << "[vg vectorize] error: sparse format must be libsvm or coo, not " << sparse_format << endl;
+        return 1;
+    }
+    if (!sparse_format.empty() && (mem_sketch || output_wabbit || format)) {
+        cerr << "[vg vectorize] error: sparse output cannot be combined with -m, -w, -f, or -A" << endl;
+        return 1;
+    }
+
     xg::XG* xg_index;
     if (!xg_name.empty()) {
         ifstream in(xg_name);
@@ -287,12 +307,56 @@ int main_vectorize(int argc, char** argv){
         }
     };
     
+    // Sparse rows are made a batch at a time in parallel and printed in input
+    // order, so memory use doesn't grow with the graph or the read count and
+    // COO row numbers match the order of the alignments.
+    size_t batch_size = 1024 * get_thread_count();
+    vector<Alignment> batch;
+    vector<string> rows;
+    size_t rows_done = 0;
+    auto flush_sparse = [&]() {
+        rows.resize(batch.size());
+        vector<int> classes(batch.size());
+        if (sparse_format == "libsvm") {
+            for (size_t i = 0; i < batch.size(); i++) {
+                classes[i] = vz.wabbit_class(aln_label == "" ? batch[i].name() : aln_label);
+            }
+        }
+#pragma omp parallel for schedule(dynamic, 16)
+        for (size_t i = 0; i < batch.size(); i++) {
+            auto entries = vz.alignment_to_sparse(batch[i], a_hot, use_identity_hot);
+            if (sparse_format == "libsvm") {
+                rows[i] = vz.libsvm_row(to_string(classes[i]), entries) + "\n";
+            } else {
+                rows[i] = vz.coo_rows(rows_done + i, entries);
+            }
+        }
+        for (auto& row : rows) {
+            cout << row;
+        }
+        rows_done += batch.size();
+        batch.clear();
+    };
+    function<void(Alignment&)> sparse_lambda = [&](Alignment& a) {
+        batch.emplace_back(std::move(a));
+        if (batch.size() >= batch_size) {
+            flush_sparse();
+        }
+    };
+
     get_input_file(optind, argc, argv, [&](istream& in) {
-        stream::for_each(in, lambda);
+        if (sparse_format.empty()) {
+            stream::for_each(in, lambda);
+        } else {
+            stream::for_each(in, sparse_lambda);
+        }
     });
+    if (!sparse_format.empty()) {
+        flush_sparse();
+    }
 
     string mapping_str = vz.output_wabbit_map();
-    if (output_wabbit){
+    if (output_wabbit || sparse_format == "libsvm"){
         if (!wabbit_mapping_file.empty()){
             ofstream ofi;
             ofi.open(wabbit_mapping_file);
@@ -15,17 +15,55 @@
 
 #include "../multipath_alignment.hpp"
 #include "../vg.hpp"
+#include "../gfa.hpp"
+#include "../columnar_gam.hpp"
 
 using namespace std;
 using namespace vg;
 using namespace vg::subcommand;
 
+/// How many messages each thread converts per batch when converting in parallel
+const size_t VIEW_BATCH_SIZE_PER_THREAD = 512;
+
+/// Convert each serialized message in the stream to text with the given
+/// function, on all threads, and write the text to cout in input order. Only a
+/// batch of messages is held at a time, so memory doesn't grow with the input.
+static void convert_parallel(istream& in, const function<string(string&)>& convert) {
+    size_t batch_size = VIEW_BATCH_SIZE_PER_THREAD * get_thread_count();
+    vector<string> batch;
+    batch.reserve(batch_size);
+    
+    auto flush = [&]() {
+#pragma omp parallel for schedule(dynamic, 64)
+        for (size_t i = 0; i < batch.size(); i++) {
+            // Replace the bytes with their conversion
+            string converted = convert(batch[i]);
+            batch[i].swap(converted);
+        }
+        for (auto& text : batch) {
+            cout << text;
+        }
+        batch.clear();
+    };
+    
+    stream::for_each_serialized(in, [&](string& bytes) {
+        batch.emplace_back();
+        batch.back().swap(bytes);
+        if (batch.size() == batch_size) {
+            flush();
+        }
+    });
+    flush();
+}
+
 
 void help_view(char** argv) {
     cerr << "usage: " << argv[0] << " view [options] [ <graph.vg> | <graph.json> | <aln.gam> | <read1.fq> [<read2.fq>] ]" << endl
          << "options:" << endl
          << "    -g, --gfa                  output GFA format (default)" << endl
          << "    -F, --gfa-in               input GFA format, reducing overlaps if they occur" << endl
+         << "    -u, --stream-gfa           convert GFA to VG (-F -v) or VG to GFA (-g) a chunk at a time," << endl
+         << "                               without loading the whole graph (GFA overlaps are not reduced)" << endl
 
          << "    -v, --vg                   output VG format" << endl
          << "    -V, --vg-in                input VG format (default)" << endl
@@ -44,7 +82,12 @@ void help_view(char** argv) {
          << "    -r, --rdf_base_uri         set base uri for the RDF output" << endl
 
          << "    -a, --align-in             input GAM format" << endl
+         << "    --fields LIST              with -a and -j, only decode and print these comma-separated" << endl
+         << "                               Alignment fields (e.g. name,mapping_quality,path)" << endl
          << "    -A, --aln-graph GAM        add alignments from GAM to the graph" << endl
+         << "    --columnar                 output columnar GAM, which compresses better and can be scanned" << endl
+         << "                               a column at a time (input defaults to GAM)" << endl
+         << "    --columnar-in              input columnar GAM (output defaults to GAM)" << endl
 
          << "    -q, --locus-in             input stream is Locus format" << endl
          << "    -z, --locus-out            output stream Locus format" << endl
@@ -78,7 +121,8 @@ void help_view(char** argv) {
          << "    -K, --multipath-in         input VG MultipathAlignment format (GAMP)" << endl
          << "    -k, --multipath            output VG MultipathAlignment format (GAMP)" << endl
          << "    -D, --expect-duplicates    don't warn if encountering the same node or edge multiple times" << endl
-         << "    --threads N                for parallel operations use this many threads [1]" << endl;
+         << "    --threads N                for parallel operations, like encoding GAM as JSON or FASTQ," << endl
+         << "                               use this many threads [1]; output stays in input order" << endl;
     
     // TODO: Can we regularize the option names for input and output types?
 
@@ -124,8 +168,14 @@ int main_view(int argc, char** argv) {
     bool ultrabubble_labeling = false;
     bool skip_missing_nodes = false;
     bool expect_duplicates = false;
+    bool stream_gfa = false;
     bool ascii_labels = false;
+    // Alignment field numbers to decode, or empty for all of them
+    vector<int> alignment_fields;
     omp_set_num_threads(1); // default to 1 thread
+    
+    const int OPT_COLUMNAR = 1000;
+    const int OPT_COLUMNAR_IN = 1001;
 
     int c;
     optind = 2; // force optind past "view" argument
@@ -139,6 +189,7 @@ int main_view(int argc, char** argv) {
                 {"turtle", no_argument, 0, 't'},
                 {"rdf-base-uri", no_argument, 0, 'r'},
                 {"gfa-in", no_argument, 0, 'F'},
+                {"stream-gfa", no_argument, 0, 'u'},
                 {"json",  no_argument, 0, 'j'},
                 {"json-in",  no_argument, 0, 'J'},
                 {"json-stream", no_argument, 0, 'c'},
@@ -175,11 +226,14 @@ int main_view(int argc, char** argv) {
                 {"multipath-in", no_argument, 0, 'K'},
                 {"ascii-labels", no_argument, 0, 'e'},
                 {"threads", required_argument, 0, '7'},
+                {"fields", required_argument, 0, '8'},
+                {"columnar", no_argument, 0, OPT_COLUMNAR},
+                {"columnar-in", no_argument, 0, OPT_COLUMNAR_IN},
                 {0, 0, 0, 0}
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "dgFjJhvVpaGbifA:s:wnlLIMcTtr:SCZYmqQ:zXREDkKe7:",
+        c = getopt_long (argc, argv, "dgFujJhvVpaGbifA:s:wnlLIMcTtr:SCZYmqQ:zXREDkKe7:8:",
                          long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -246,6 +300,10 @@ int main_view(int argc, char** argv) {
             input_type = "gfa";
             break;
 
+        case 'u':
+            stream_gfa = true;
+            break;
+
         case 'j':
             output_type = "json";
             break;
@@ -389,6 +447,33 @@ int main_view(int argc, char** argv) {
             omp_set_num_threads(atoi(optarg));
             break;
 
+        case '8':
+            for (auto& field_name : split_delims(optarg, ",")) {
+                auto field = Alignment::descriptor()->FindFieldByName(field_name);
+                if (field == nullptr) {
+                    cerr << "[vg view] error: Alignment has no field " << field_name << endl;
+                    return 1;
+                }
+                alignment_fields.push_back(field->number());
+            }
+            break;
+
+        case OPT_COLUMNAR:
+            output_type = "columnar";
+            if (input_type.empty()) {
+                // Default to GAM -> columnar GAM
+                input_type = "gam";
+            }
+            break;
+
+        case OPT_COLUMNAR_IN:
+            input_type = "columnar";
+            if (output_type.empty()) {
+                // Default to columnar GAM -> GAM
+                output_type = "gam";
+            }
+            break;
+
         case 'h':
         case '?':
             /* getopt_long already printed an error message. */
@@ -432,11 +517,39 @@ int main_view(int argc, char** argv) {
         exit(1);
     }
     string file_name = get_input_file_name(optind, argc, argv);
+    if (stream_gfa) {
+        if (input_type == "gfa" && output_type == "vg") {
+            size_t overlaps = 0;
+            get_input_file(file_name, [&](istream& in) {
+                overlaps = gfa_to_graph_stream(in, cout);
+            });
+            if (overlaps > 0) {
+                cerr << "[vg view] error: " << overlaps << " GFA links overlap, and overlaps cannot be"
+                     << " reduced when streaming; convert without -u instead" << endl;
+                return 1;
+            }
+        } else if (input_type == "vg" && output_type == "gfa") {
+            get_input_file(file_name, [&](istream& in) {
+                graph_stream_to_gfa(in, cout);
+            });
+        } else {
+            cerr << "[vg view] error: streaming GFA conversion (-u) only goes from GFA to VG (-F -v)"
+                 << " or from VG to GFA (-g)" << endl;
+            return 1;
+        }
+        return 0;
+    }
     if (input_type == "vg") {
         if (output_type == "stream") {
-            function<void(Graph&)> lambda = [&](Graph& g) { cout << pb2json(g) << endl; };
             get_input_file(file_name, [&](istream& in) {
-                stream::for_each(in, lambda);
+                convert_parallel(in, [](string& bytes) {
+                    Graph g;
+                    if (!g.ParseFromString(bytes)) {
+                        cerr << "[vg view] error: could not parse graph" << endl;
+                        exit(1);
+                    }
+                    return pb2json(g) + "\n";
+                });
             });
             return 0;
         } else {
@@ -466,33 +579,50 @@ int main_view(int argc, char** argv) {
         }
     } else if (input_type == "gam") {
         if (!input_json) {
+            // Decode only the chosen fields of each alignment, or all of them
+            auto decode = [](string& bytes, const vector<int>& fields, Alignment& a) {
+                bool ok = fields.empty() ? a.ParseFromString(bytes)
+                                         : stream::FieldView(bytes).project(fields, a);
+                if (!ok) {
+                    cerr << "[vg view] error: could not parse alignment" << endl;
+                    exit(1);
+                }
+            };
+            
             if (output_type == "json") {
-                // convert values to printable ones
-                function<void(Alignment&)> lambda = [](Alignment& a) {
-                    if(std::isnan(a.identity())) {
-                        // Fix up NAN identities that can't be serialized in
-                        // JSON. We shouldn't generate these any more, and they
-                        // are out of spec, but they can be in files.
-                        a.set_identity(0);
-                    }
-                    cout << pb2json(a) << "\n";
-                };
+                // Encode the alignments on all threads, but print them in order
                 get_input_file(file_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    convert_parallel(in, [&](string& bytes) {
+                        Alignment a;
+                        decode(bytes, alignment_fields, a);
+                        if(std::isnan(a.identity())) {
+                            // Fix up NAN identities that can't be serialized in
+                            // JSON. We shouldn't generate these any more, and they
+                            // are out of spec, but they can be in files.
+                            a.set_identity(0);
+                        }
+                        return pb2json(a) + "\n";
+                    });
                 });
             } else if (output_type == "fastq") {
-                function<void(Alignment&)> lambda = [](Alignment& a) {
-                    cout << "@" << a.name() << endl
-                         << a.sequence() << endl
-                    << "+" << endl;
-                    if (a.quality().empty()) {
-                        cout << string(a.sequence().size(), quality_short_to_char(30)) << endl;
-                    } else {
-                        cout << string_quality_short_to_char(a.quality()) << endl;
-                    }
-                };
+                // FASTQ only needs these
+                vector<int> fastq_fields{Alignment::kNameFieldNumber, Alignment::kSequenceFieldNumber,
+                        Alignment::kQualityFieldNumber};
                 get_input_file(file_name, [&](istream& in) {
-                    stream::for_each(in, lambda);
+                    convert_parallel(in, [&](string& bytes) {
+                        Alignment a;
+                        decode(bytes, fastq_fields, a);
+                        stringstream record;
+                        record << "@" << a.name() << "\n"
+                               << a.sequence() << "\n"
+                               << "+" << "\n";
+                        if (a.quality().empty()) {
+                            record << string(a.sequence().size(), quality_short_to_char(30)) << "\n";
+                        } else {
+                            record << string_quality_short_to_char(a.quality()) << "\n";
+                        }
+                        return record.str();
+                    });
                 });
             }
             else if (output_type == "multipath") {
@@ -507,9 +637,14 @@ int main_view(int argc, char** argv) {
                 });
                 stream::write_buffered(cout, buf, 0);
             }
+            else if (output_type == "columnar") {
+                get_input_file(file_name, [&](istream& in) {
+                    gam_to_columnar(in, cout);
+                });
+            }
             else {
                 // todo
-                cerr << "[vg view] error: (binary) GAM can only be converted to JSON, GAMP or FASTQ" << endl;
+                cerr << "[vg view] error: (binary) GAM can only be converted to JSON, GAMP, FASTQ or columnar GAM" << endl;
                 return 1;
             }
         } else {
@@ -534,6 +669,28 @@ int main_view(int argc, char** argv) {
         }
         cout.flush();
         return 0;
+    } else if (input_type == "columnar") {
+        if (output_type == "gam") {
+            get_input_file(file_name, [&](istream& in) {
+                columnar_to_gam(in, cout);
+            });
+        } else if (output_type == "json") {
+            // Only decompress the columns that hold the fields we print
+            get_input_file(file_name, [&](istream& in) {
+                for_each_columnar(in, columns_for_fields(alignment_fields), [&](Alignment& a) {
+                    if (std::isnan(a.identity())) {
+                        // NAN identities can't be serialized in JSON
+                        a.set_identity(0);
+                    }
+                    cout << pb2json(a) << "\n";
+                });
+            });
+        } else {
+            cerr << "[vg view] error: columnar GAM can only be converted to GAM or JSON" << endl;
+            return 1;
+        }
+        cout.flush();
+        return 0;
     } else if (input_type == "bam") {
         if (output_type == "gam") {
             //function<void(const Alignment&)>& lambda) {
@@ -33,6 +33,8 @@ void help_xg(char** argv) {
          << "    -V, --validate       validate compression" << endl
          << "    -o, --out FILE       serialize graph to FILE" << endl
          << "    -i, --in FILE        use index in FILE" << endl
+         << "    -a, --append-paths FILE    add the paths in vg FILE to the index, which must already" << endl
+         << "                         have their nodes and edges" << endl
          << "    -n, --node ID        graph neighborhood around node with ID" << endl
          << "    -c, --context N      steps of context to extract when building neighborhood" << endl
          << "    -s, --node-seq ID    provide node sequence for ID" << endl
@@ -84,6 +86,7 @@ int main_xg(int argc, char** argv) {
     bool is_sorted_dag = false;
     string report_name;
     string b_array_name;
+    string append_name;
     
     int c;
     optind = 2; // force optind past "xg" positional argument
@@ -94,6 +97,7 @@ int main_xg(int argc, char** argv) {
                 {"vg", required_argument, 0, 'v'},
                 {"out", required_argument, 0, 'o'},
                 {"in", required_argument, 0, 'i'},
+                {"append-paths", required_argument, 0, 'a'},
                 {"node", required_argument, 0, 'n'},
                 {"char", required_argument, 0, 'P'},
                 {"substr", required_argument, 0, 'F'},
@@ -118,7 +122,7 @@ int main_xg(int argc, char** argv) {
             };
 
         int option_index = 0;
-        c = getopt_long (argc, argv, "hv:o:i:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
+        c = getopt_long (argc, argv, "hv:o:i:a:f:t:s:c:n:p:DxrdTO:S:E:VR:P:F:b:",
                          long_options, &option_index);
 
         // Detect the end of the options.
@@ -164,6 +168,10 @@ int main_xg(int argc, char** argv) {
             in_name = optarg;
             break;
 
+        case 'a':
+            append_name = optarg;
+            break;
+
         case 'n':
             node_id = atol(optarg);
             node_context = true;
@@ -258,6 +266,39 @@ int main_xg(int argc, char** argv) {
         }
     }
 
+    if (!append_name.empty()) {
+        if (graph == nullptr) {
+            cerr << "[vg xg] error: an index is required to append paths to" << endl;
+            return 1;
+        }
+        // Paths may be split across chunks, so put them back together first
+        map<string, Path> new_paths;
+        ifstream in(append_name);
+        if (!in) {
+            cerr << "[vg xg] error: could not open " << append_name << endl;
+            return 1;
+        }
+        stream::for_each<Graph>(in, [&](Graph& g) {
+            for (auto& path : g.path()) {
+                Path& merged = new_paths[path.name()];
+                merged.set_name(path.name());
+                for (auto& mapping : path.mapping()) {
+                    *merged.add_mapping() = mapping;
+                }
+            }
+        });
+        vector<Path> to_append;
+        for (auto& p : new_paths) {
+            to_append.push_back(p.second);
+        }
+        try {
+            graph->append_paths(to_append);
+        } catch (runtime_error& e) {
+            cerr << "[vg xg] error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
     // Prepare structure tree for serialization
     unique_ptr<sdsl::structure_tree_node> structure;
     
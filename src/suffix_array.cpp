@@ -0,0 +1,278 @@
+//
+//  suffix_array.cpp
+//
+
+#include "suffix_array.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace vg {
+
+    SuffixArray::SuffixArray(string::const_iterator begin, string::const_iterator end) {
+        build(begin, end);
+    }
+
+    void SuffixArray::build(string::const_iterator begin, string::const_iterator end) {
+
+        size_t n = (end - begin) + 1;
+
+        // translate to symbols with a sentinel at the end
+        text.resize(n);
+        for (size_t i = 0; i + 1 < n; i++) {
+            text[i] = symbol(*(begin + i));
+        }
+        text[n - 1] = 0;
+
+        suffix_array.resize(n);
+        sais(text.data(), suffix_array.data(), n, 256);
+
+        // Kasai's algorithm for the LCP array
+        inverse_suffix_array.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            inverse_suffix_array[suffix_array[i]] = i;
+        }
+        lcp_array.assign(n, 0);
+        size_t h = 0;
+        for (size_t i = 0; i < n; i++) {
+            size_t rank = inverse_suffix_array[i];
+            if (rank > 0) {
+                // the unique sentinel ensures we stop before running off the end
+                size_t j = suffix_array[rank - 1];
+                while (text[i + h] == text[j + h]) {
+                    h++;
+                }
+                lcp_array[rank] = h;
+                if (h > 0) {
+                    h--;
+                }
+            }
+            else {
+                h = 0;
+            }
+        }
+    }
+
+    inline int64_t SuffixArray::symbol(char c) const {
+        return int64_t((unsigned char) c) + 1;
+    }
+
+    size_t SuffixArray::size() const {
+        return text.empty() ? 0 : text.size() - 1;
+    }
+
+    size_t SuffixArray::suffix_at(size_t rank) const {
+        // skip the sentinel suffix
+        return suffix_array[rank + 1];
+    }
+
+    size_t SuffixArray::lcp(size_t rank) const {
+        return lcp_array[rank + 1];
+    }
+
+    bool SuffixArray::narrow(size_t& range_begin, size_t& range_end, size_t depth, int64_t sym) const {
+        // the suffixes in the range are sorted by the symbol at this depth
+        auto first = suffix_array.begin() + range_begin;
+        auto last = suffix_array.begin() + range_end;
+        auto lower = lower_bound(first, last, sym, [&](int64_t suffix, int64_t value) {
+            return text[suffix + depth] < value;
+        });
+        auto upper = upper_bound(lower, last, sym, [&](int64_t value, int64_t suffix) {
+            return value < text[suffix + depth];
+        });
+        range_begin = lower - suffix_array.begin();
+        range_end = upper - suffix_array.begin();
+        return range_begin < range_end;
+    }
+
+    size_t SuffixArray::longest_overlap(const string& str) const {
+        return longest_overlap(str.begin(), str.end());
+    }
+
+    size_t SuffixArray::longest_overlap(string::const_iterator begin, string::const_iterator end) const {
+
+        if (text.empty()) {
+            return 0;
+        }
+
+        size_t overlap = 0;
+
+        size_t range_begin = 0;
+        size_t range_end = suffix_array.size();
+        size_t str_len = end - begin;
+        for (size_t depth = 0; ; depth++) {
+            // a suffix of exactly this length is a prefix of all the others in the
+            // range, so it sorts first
+            if (text[suffix_array[range_begin] + depth] == 0) {
+                overlap = depth;
+            }
+            if (depth == str_len || !narrow(range_begin, range_end, depth, symbol(*(begin + depth)))) {
+                break;
+            }
+        }
+
+        return overlap;
+    }
+
+    vector<size_t> SuffixArray::substring_locations(const string& str) const {
+        return substring_locations(str.begin(), str.end());
+    }
+
+    vector<size_t> SuffixArray::substring_locations(string::const_iterator begin, string::const_iterator end) const {
+
+        vector<size_t> locations;
+
+        // don't try to match empty string (else it matches everywhere)
+        size_t substr_len = end - begin;
+        if (substr_len > size() || substr_len == 0) {
+            return locations;
+        }
+
+        size_t range_begin = 0;
+        size_t range_end = suffix_array.size();
+        for (size_t depth = 0; depth < substr_len; depth++) {
+            if (!narrow(range_begin, range_end, depth, symbol(*(begin + depth)))) {
+                return locations;
+            }
+        }
+
+        locations.reserve(range_end - range_begin);
+        for (size_t i = range_begin; i < range_end; i++) {
+            locations.push_back(suffix_array[i]);
+        }
+
+        return locations;
+    }
+
+    // Bucket boundaries for each symbol, either the starts or the ends
+    static void get_buckets(const int64_t* s, size_t n, size_t max_symbol, vector<int64_t>& buckets, bool ends) {
+        buckets.assign(max_symbol + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            buckets[s[i]]++;
+        }
+        int64_t sum = 0;
+        for (size_t i = 0; i <= max_symbol; i++) {
+            sum += buckets[i];
+            buckets[i] = ends ? sum : sum - buckets[i];
+        }
+    }
+
+    // Is the suffix at i a leftmost S-type suffix?
+    static inline bool is_lms(const vector<bool>& s_type, int64_t i) {
+        return i > 0 && s_type[i] && !s_type[i - 1];
+    }
+
+    // Induce the order of the L-type suffixes, and then the S-type suffixes, from the LMS
+    // suffixes in the suffix array
+    static void induce(const int64_t* s, int64_t* sa, size_t n, size_t max_symbol,
+                       const vector<bool>& s_type, vector<int64_t>& buckets) {
+        get_buckets(s, n, max_symbol, buckets, false);
+        for (size_t i = 0; i < n; i++) {
+            int64_t j = sa[i] - 1;
+            if (sa[i] > 0 && !s_type[j]) {
+                sa[buckets[s[j]]++] = j;
+            }
+        }
+        get_buckets(s, n, max_symbol, buckets, true);
+        for (size_t i = n; i > 0; i--) {
+            int64_t j = sa[i - 1] - 1;
+            if (sa[i - 1] > 0 && s_type[j]) {
+                sa[--buckets[s[j]]] = j;
+            }
+        }
+    }
+
+    void SuffixArray::sais(const int64_t* s, int64_t* sa, size_t n, size_t max_symbol) {
+
+        if (n == 1) {
+            sa[0] = 0;
+            return;
+        }
+
+        // classify the suffixes, the sentinel is S-type and the one before it is L-type
+        vector<bool> s_type(n, false);
+        s_type[n - 1] = true;
+        for (size_t i = n - 2; i > 0; i--) {
+            s_type[i - 1] = s[i - 1] < s[i] || (s[i - 1] == s[i] && s_type[i]);
+        }
+
+        // sort the LMS substrings by inducing from the LMS suffixes in arbitrary order
+        vector<int64_t> buckets;
+        get_buckets(s, n, max_symbol, buckets, true);
+        fill(sa, sa + n, -1);
+        for (size_t i = 1; i < n; i++) {
+            if (is_lms(s_type, i)) {
+                sa[--buckets[s[i]]] = i;
+            }
+        }
+        induce(s, sa, n, max_symbol, s_type, buckets);
+
+        // compact the sorted LMS substrings into the front of the array
+        size_t n1 = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (is_lms(s_type, sa[i])) {
+                sa[n1++] = sa[i];
+            }
+        }
+
+        // name the LMS substrings, with equal substrings getting equal names, and store the
+        // names in the back half of the array in the order they occur in the string
+        fill(sa + n1, sa + n, -1);
+        int64_t name = 0;
+        int64_t prev = -1;
+        for (size_t i = 0; i < n1; i++) {
+            int64_t pos = sa[i];
+            bool diff = false;
+            for (int64_t d = 0; d < (int64_t) n; d++) {
+                if (prev == -1 || s[pos + d] != s[prev + d] || s_type[pos + d] != s_type[prev + d]) {
+                    diff = true;
+                    break;
+                }
+                else if (d > 0 && (is_lms(s_type, pos + d) || is_lms(s_type, prev + d))) {
+                    break;
+                }
+            }
+            if (diff) {
+                name++;
+                prev = pos;
+            }
+            sa[n1 + pos / 2] = name - 1;
+        }
+        for (size_t i = n, j = n; i > n1; i--) {
+            if (sa[i - 1] >= 0) {
+                sa[--j] = sa[i - 1];
+            }
+        }
+
+        // sort the reduced string, recursing if the names aren't unique yet
+        int64_t* s1 = sa + n - n1;
+        if (name < (int64_t) n1) {
+            sais(s1, sa, n1, name - 1);
+        }
+        else {
+            for (size_t i = 0; i < n1; i++) {
+                sa[s1[i]] = i;
+            }
+        }
+
+        // put the LMS suffixes in their sorted order at the ends of their buckets and induce
+        // the order of everything else from them
+        get_buckets(s, n, max_symbol, buckets, true);
+        for (size_t i = 1, j = 0; i < n; i++) {
+            if (is_lms(s_type, i)) {
+                s1[j++] = i;
+            }
+        }
+        for (size_t i = 0; i < n1; i++) {
+            sa[i] = s1[sa[i]];
+        }
+        fill(sa + n1, sa + n, -1);
+        for (size_t i = n1; i > 0; i--) {
+            int64_t j = sa[i - 1];
+            sa[i - 1] = -1;
+            sa[--buckets[s[j]]] = j;
+        }
+        induce(s, sa, n, max_symbol, s_type, buckets);
+    }
+}
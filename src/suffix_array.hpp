@@ -0,0 +1,89 @@
+//
+//  suffix_array.hpp
+//
+// Suffix array with an LCP array, built with the linear time SA-IS algorithm
+//
+
+
+#ifndef suffix_array_hpp
+#define suffix_array_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+namespace vg {
+
+    /**
+     * A suffix array with linear time and space complexity for construction. Answers the
+     * same queries as the SuffixTree, but keeps everything in a few flat arrays, which can
+     * be reused to index another string without reallocating.
+     *
+     */
+    class SuffixArray {
+
+    public:
+        /// Construct an empty suffix array, to be built later.
+        SuffixArray() = default;
+
+        /// Linear time constructor.
+        SuffixArray(string::const_iterator begin, string::const_iterator end);
+        ~SuffixArray() = default;
+
+        /// Index a new string in linear time, reusing the memory from the last string.
+        void build(string::const_iterator begin, string::const_iterator end);
+
+        /// Returns the length of the longest prefix of str that exactly matches
+        /// a suffix of the string used to construct the suffix array.
+        size_t longest_overlap(const string& str) const;
+        size_t longest_overlap(string::const_iterator begin, string::const_iterator end) const;
+
+        /// Retuns a vector of all of the indices where a string occurs as a substring
+        /// of the string used to construct the suffix array. Indices are ordered arbitrarily.
+        vector<size_t> substring_locations(const string& str) const;
+        vector<size_t> substring_locations(string::const_iterator begin, string::const_iterator end) const;
+
+        /// Returns the length of the string used to construct the suffix array
+        size_t size() const;
+
+        /// Returns the index in the string where the suffix at the given lexicographic rank starts
+        size_t suffix_at(size_t rank) const;
+
+        /// Returns the length of the longest common prefix of the suffixes at the given rank and
+        /// the rank before it, or 0 for the first rank
+        size_t lcp(size_t rank) const;
+
+    private:
+
+        /// The string, as symbols that are 1 more than the unsigned characters, followed by a
+        /// 0 sentinel
+        vector<int64_t> text;
+
+        /// The suffix array of the text, including the sentinel suffix at rank 0
+        vector<int64_t> suffix_array;
+
+        /// The LCP of each suffix in the suffix array with the one before it
+        vector<size_t> lcp_array;
+
+        /// The rank of each suffix, kept so rebuilding doesn't need to allocate it again
+        vector<size_t> inverse_suffix_array;
+
+        /// Get the symbol we use for a character of a string
+        inline int64_t symbol(char c) const;
+
+        /// Narrow the range of ranks [range_begin, range_end) of suffixes that share a prefix
+        /// of the given depth down to the ones that continue with the given symbol. Returns false
+        /// if there are none.
+        bool narrow(size_t& range_begin, size_t& range_end, size_t depth, int64_t sym) const;
+
+        /// Fill sa with the suffix array of the n symbols in s, from the alphabet [0, max_symbol],
+        /// which must end with a unique 0 (the SA-IS algorithm of Nong, Zhang and Chan)
+        static void sais(const int64_t* s, int64_t* sa, size_t n, size_t max_symbol);
+    };
+}
+
+
+#endif /* suffix_array_hpp */
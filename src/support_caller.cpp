@@ -8,6 +8,7 @@
 #include <unordered_set>
 #include <utility>
 #include <algorithm>
+#include <memory>
 #include <getopt.h>
 
 #include "vg.hpp"
@@ -216,9 +217,8 @@ string get_pileup_line(const map<int64_t, NodePileup>& node_pileups,
 SupportCaller::PrimaryPath::PrimaryPath(SupportAugmentedGraph& augmented, const string& ref_path_name, size_t ref_bin_size):
     ref_bin_size(ref_bin_size), index(augmented.graph, ref_path_name, true), name(ref_path_name)  {
 
-    // Follow the reference path and extract indexes we need: index by node ID,
-    // index by node start, and the reconstructed path sequence.
-    PathIndex index(augmented.graph, ref_path_name, true);
+    // The index (by node ID, by node start, and the reconstructed path
+    // sequence) was made in the initializer list.
 
     if (index.sequence.size() == 0) {
         // No empty reference paths allowed
@@ -232,35 +232,40 @@ SupportCaller::PrimaryPath::PrimaryPath(SupportAugmentedGraph& augmented, const
         // No zero-sized bins allowed
         throw runtime_error("Reference bin size must be 1 or larger");
     }
-    // Start out all the bins empty.
-    binned_support = vector<Support>(max(1, int(index.sequence.size() / ref_bin_size)), Support());
+    // Start out all the bins empty. We sum them up as PackedSupports, to avoid
+    // making protobuf messages for every node.
+    vector<PackedSupport> bin_sums(max(1, int(index.sequence.size() / ref_bin_size)));
     
     // Crunch the numbers on the reference and its read support. How much read
     // support in total (node length * aligned reads) does the primary path get?
-    total_support = Support();
+    PackedSupport total_sum;
     for(auto& pointerAndSupport : augmented.node_supports) {
-        if(index.by_id.count(pointerAndSupport.first->id())) {
+        auto found = index.by_id.find(pointerAndSupport.first->id());
+        if(found != index.by_id.end()) {
             // This is a primary path node. Add in the total read bases supporting it
-            total_support += pointerAndSupport.first->sequence().size() * pointerAndSupport.second;
+            PackedSupport node_total = (double) pointerAndSupport.first->sequence().size() *
+                PackedSupport(pointerAndSupport.second);
+            total_sum += node_total;
             
             // We also update the total for the appropriate bin
-            size_t bin = index.by_id[pointerAndSupport.first->id()].first / ref_bin_size;
-            if (bin == binned_support.size()) {
+            size_t bin = found->second.first / ref_bin_size;
+            if (bin == bin_sums.size()) {
                 --bin;
             }
-            binned_support[bin] = binned_support[bin] + 
-                pointerAndSupport.first->sequence().size() * pointerAndSupport.second;
+            bin_sums[bin] += node_total;
         }
     }
+    total_support = total_sum.to_support();
     
-    // Average out the support bins too (in place)
+    // Average out the support bins too
+    binned_support.resize(bin_sums.size());
     min_bin = 0;
     max_bin = 0;
     for (int i = 0; i < binned_support.size(); ++i) {
         // Compute the average over the bin's actual size
-        binned_support[i] = binned_support[i] / (
+        binned_support[i] = (bin_sums[i] / (
             i < binned_support.size() - 1 ? (double)ref_bin_size :
-            (double)(ref_bin_size + index.sequence.size() % ref_bin_size));
+            (double)(ref_bin_size + index.sequence.size() % ref_bin_size))).to_support();
             
         // See if it's a min or max
         if (binned_support[i] < binned_support[min_bin]) {
@@ -443,48 +448,58 @@ tuple<Support, Support, size_t> get_traversal_support(SupportAugmentedGraph& aug
     // number.
     size_t record_count = max(1, traversal.visit_size() - 2);
     // What's the min support observed at every visit (inclusing edges)?
-    vector<Support> min_supports(record_count, make_support(INFINITY, INFINITY, INFINITY));
+    // These are kept as PackedSupports, so we don't build protobuf messages
+    // for every sum and min along the way.
+    vector<PackedSupport> min_supports(record_count, PackedSupport(INFINITY, INFINITY, INFINITY));
     // And the total support (ignoring edges)?
-    vector<Support> total_supports(record_count, Support());
+    vector<PackedSupport> total_supports(record_count, PackedSupport());
     // And the bp size of each visit
     vector<size_t> visit_sizes(record_count, 0);
     
     // Don't count nodes shared between child snarls more than once.
     set<Node*> coverage_counted;
     
+    // Reuse one buffer for the contents of all the child snarls
+    SnarlContents child_contents;
+    
     trace_traversal(traversal, site, [&](size_t i, id_t node_id) {
         // Find the node
         Node* node = augmented.graph.get_node(node_id);
     
-        // Grab this node's total support along its length
-        // Make sure to only use half the support if the node is shared
-        total_supports[i] += augmented.get_support(node) * node->sequence().size() * (shared_nodes.count(node_id) ? 0.5 : 1.0);
+        // Grab this node's support, using only half of it if the node is shared
+        PackedSupport node_support = augmented.get_packed_support(node) * (shared_nodes.count(node_id) ? 0.5 : 1.0);
+        
+        // Add in its total support along its length
+        total_supports[i] += node_support * node->sequence().size();
         // And its size
         visit_sizes[i] += node->sequence().size();
         
         // And update its min support
-        min_supports[i] = support_min(min_supports[i], augmented.get_support(node) * (shared_nodes.count(node_id) ? 0.5 : 1.0));
+        min_supports[i] = support_min(min_supports[i], node_support);
         
     }, [&](size_t i, NodeSide end1, NodeSide end2) {
         // This is an edge
         Edge* edge = augmented.graph.get_edge(end1, end2);
         assert(edge != nullptr);
         
-        // Count as 1 base worth for the total/average support
         // Make sure to only use half the support if the edge is shared
-        total_supports[i] += augmented.get_support(edge) * (shared_edges.count(edge) ? 0.5 : 1.0);
+        PackedSupport edge_support = augmented.get_packed_support(edge) * (shared_edges.count(edge) ? 0.5 : 1.0);
+        
+        // Count as 1 base worth for the total/average support
+        total_supports[i] += edge_support;
         visit_sizes[i] += 1;
         
         // Min in its support
-        min_supports[i] = support_min(min_supports[i], augmented.get_support(edge) * (shared_edges.count(edge) ? 0.5 : 1.0));
+        min_supports[i] = support_min(min_supports[i], edge_support);
     }, [&](size_t i, Snarl child) {
         // This is a child snarl, so get its max support.
         
-        Support child_max;
+        PackedSupport child_max;
         size_t child_size = 0;
-        for (Node* node : snarl_manager.deep_contents(snarl_manager.manage(child),
-            augmented.graph, true).first) {
+        snarl_manager.deep_contents(snarl_manager.manage(child), augmented.graph, true, child_contents);
+        for (const handle_t& handle : child_contents.nodes) {
             // For every node in the child
+            Node* node = augmented.graph.get_node(augmented.graph.get_id(handle));
             
             if (coverage_counted.count(node)) {
                 // Already used by another child snarl on this traversal
@@ -494,14 +509,14 @@ tuple<Support, Support, size_t> get_traversal_support(SupportAugmentedGraph& aug
             coverage_counted.insert(node);
             
             // How many distinct reads must use the child, given the distinct reads on this node?
-            child_max = support_max(child_max, augmented.get_support(node));
+            child_max = support_max(child_max, augmented.get_packed_support(node));
             
             // Add in the node's size to the child
             child_size += node->sequence().size();
             
 #ifdef debug
             cerr << "From child snarl node " << node->id() << " get "
-                << augmented.get_support(node) << " for distinct " << child_max << endl;
+                << augmented.get_support(node) << " for distinct " << child_max.to_support() << endl;
 #endif
         }
         
@@ -524,7 +539,7 @@ tuple<Support, Support, size_t> get_traversal_support(SupportAugmentedGraph& aug
     // Now aggregate across visits and their edges
 
     // What's the total support for this traversal?
-    Support total_support;
+    PackedSupport total_support;
     for (auto& support : total_supports) {
         total_support += support;
     }
@@ -536,18 +551,18 @@ tuple<Support, Support, size_t> get_traversal_support(SupportAugmentedGraph& aug
     }
     
     // And the min support?
-    Support min_support = make_support(INFINITY, INFINITY, INFINITY);
+    PackedSupport min_support(INFINITY, INFINITY, INFINITY);
     for (auto& support : min_supports) {
         min_support = support_min(min_support, support);
     }
         
-    if (min_support.forward() == INFINITY || min_support.reverse() == INFINITY) {
+    if (min_support.forward == INFINITY || min_support.reverse == INFINITY) {
         // If we have actually no material, say we have actually no support
-        min_support = Support();
+        min_support = PackedSupport();
     }
         
     // Spit out the supports, the size in bases observed.
-    return tie(min_support, total_support, total_size);
+    return make_tuple(min_support.to_support(), total_support.to_support(), total_size);
         
 }
 
@@ -1039,7 +1054,9 @@ void SupportCaller::call(
     SupportAugmentedGraph& augmented,
     // Should we load a pileup and print out pileup info as comments after
     // variants?
-    string pileup_filename) {
+    string pileup_filename,
+    // Where to write the calls
+    ostream& out) {
 
     // Toggle support counter
     support_val = use_support_count ? total : support_quality;
@@ -1070,15 +1087,39 @@ void SupportCaller::call(
         
     }
     
+    for (auto& name : primary_path_names) {
+        if (!augmented.graph.paths.has_path(name)) {
+            throw runtime_error("Primary path " + name + " is not in the graph");
+        }
+    }
+    
+    // Index the primary paths and compute their binned supports, one path per
+    // thread.
+    vector<unique_ptr<PrimaryPath>> indexed_paths(primary_path_names.size());
+    // We can't throw out of the parallel loop, so remember the first error.
+    string path_error;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < primary_path_names.size(); i++) {
+        try {
+            indexed_paths[i] = unique_ptr<PrimaryPath>(new PrimaryPath(augmented, primary_path_names[i], ref_bin_size));
+        } catch (const exception& e) {
+#pragma omp critical (support_caller_error)
+            if (path_error.empty()) {
+                path_error = e.what();
+            }
+        }
+    }
+    if (!path_error.empty()) {
+        throw runtime_error(path_error);
+    }
+    
     // We'll fill this in with a PrimaryPath for every primary reference path
     // that is specified or detected.
     map<string, PrimaryPath> primary_paths;
-    for (auto& name : primary_path_names) {
-        // Make a PrimaryPath for every primary path we have.
-        // Index the primary path and compute the binned supports.   
-        primary_paths.emplace(std::piecewise_construct,
-            std::forward_as_tuple(name),
-            std::forward_as_tuple(augmented, name, ref_bin_size));
+    for (size_t i = 0; i < primary_path_names.size(); i++) {
+        auto& name = primary_path_names[i];
+        primary_paths.emplace(name, std::move(*indexed_paths[i]));
+        indexed_paths[i].reset();
     
         auto& primary_path = primary_paths.at(name);
     
@@ -1164,7 +1205,7 @@ void SupportCaller::call(
         assert(vcf.openForOutput(header_string));
         
         // Spit out the header
-        cout << header_stream.str();
+        out << header_stream.str();
     }
     
     // Find all the top-level sites
@@ -1241,11 +1282,36 @@ void SupportCaller::call(
         cerr << "Found " << sites.size() << " sites" << endl;
     }
     
-    // Now start looking for traversals of the sites.
-    RepresentativeTraversalFinder traversal_finder(augmented, site_manager, max_search_depth, max_search_width,
-        max_bubble_paths, [&] (const Snarl& site) -> PathIndex* {
-        
-        // When the TraversalFinder needs a primary path index for a site, it can look it up with this function.
+    {
+        // Put the sites in order along the primary paths, so the calls can
+        // come out in path order. Sites off the primary paths go last.
+        map<string, size_t> path_ranks;
+        for (size_t i = 0; i < primary_path_names.size(); i++) {
+            path_ranks.emplace(primary_path_names[i], i);
+        }
+        vector<pair<pair<size_t, size_t>, const Snarl*>> keyed_sites;
+        keyed_sites.reserve(sites.size());
+        for (const Snarl* site : sites) {
+            auto found = find_path(*site, primary_paths);
+            if (found != primary_paths.end()) {
+                auto& by_id = found->second.get_index().by_id;
+                keyed_sites.emplace_back(make_pair(path_ranks.at(found->first),
+                    min(by_id.at(site->start().node_id()).first, by_id.at(site->end().node_id()).first)), site);
+            } else {
+                keyed_sites.emplace_back(make_pair(numeric_limits<size_t>::max(), (size_t) 0), site);
+            }
+        }
+        stable_sort(keyed_sites.begin(), keyed_sites.end(), [](const pair<pair<size_t, size_t>, const Snarl*>& a,
+            const pair<pair<size_t, size_t>, const Snarl*>& b) {
+            return a.first < b.first;
+        });
+        for (size_t i = 0; i < sites.size(); i++) {
+            sites[i] = keyed_sites[i].second;
+        }
+    }
+    
+    // When the TraversalFinder needs a primary path index for a site, it can look it up with this function.
+    function<PathIndex*(const Snarl&)> get_primary_path_index = [&] (const Snarl& site) -> PathIndex* {
         auto found = find_path(site, primary_paths);
         if (found != primary_paths.end()) {
             // It's on a path
@@ -1254,7 +1320,7 @@ void SupportCaller::call(
             // It's not on a known primary path, so the TraversalFinder should make its own backbone path
             return nullptr;
         }
-    });
+    };
     
     // We're going to remember what nodes and edges are covered by sites, so we
     // will know which nodes/edges aren't in any sites and may need generic
@@ -1268,7 +1334,17 @@ void SupportCaller::call(
     // How many sites result in output?
     size_t called_loci = 0;
     
-    for(const Snarl* site : sites) {
+    // Sites are called in parallel, so each one collects what it found
+    // here, to be merged back in site order.
+    struct SiteCalls {
+        vector<vcflib::Variant> variants;
+        vector<Locus> loci;
+        vector<Node*> covered_nodes;
+        vector<Edge*> covered_edges;
+        size_t called_loci = 0;
+    };
+    
+    auto call_site = [&](const Snarl* site, SiteCalls& calls) {
         // For every site, we're going to make a bunch of Locus objects
         
         // See if the site is on a primary path, so we can use binned support.
@@ -1311,7 +1387,7 @@ void SupportCaller::call(
         // VCF. It needs to take the site as an argument because it may be
         // called for children of the site we're working on right now.
         auto emit_variant = [&contig_names_by_path_name, &vcf, &augmented,
-            &baseline_support, &global_baseline_support, this](
+            &baseline_support, &global_baseline_support, &calls, this](
             const Locus& locus, PrimaryPath& primary_path, const Snarl* site) {
         
             // Note that the locus paths will traverse our site forward, which
@@ -1522,6 +1598,7 @@ void SupportCaller::call(
                 string got_ref = sequences.front();
                 
                 if (real_ref != got_ref) {
+#pragma omp critical (cerr)
                     cerr << "Error: Ref should be " << real_ref << " but is " << got_ref << " at " << variant.position << endl;
                     throw runtime_error("Reference mismatch at site " + pb2json(*site));
                 }
@@ -1714,11 +1791,12 @@ void SupportCaller::call(
             
                 if(can_write_alleles(variant)) {
                     // No need to check for collisions because we assume sites are correctly found.
-                    // Output the created VCF variant.
-                    cout << variant << endl;
+                    // Keep the created VCF variant for output.
+                    calls.variants.push_back(variant);
             
                 } else {
                     if (verbose) {
+#pragma omp critical (cerr)
                         cerr << "Variant is too large" << endl;
                     }
                     // TODO: track bases lost again
@@ -1726,10 +1804,14 @@ void SupportCaller::call(
             }
         };
         
+        // Look for traversals of the site.
+        RepresentativeTraversalFinder traversal_finder(augmented, site_manager, max_search_depth, max_search_width,
+            max_bubble_paths, get_primary_path_index);
+        
         // Recursively type the site, using that support and an assumption of a diploid sample.
         find_best_traversals(augmented, site_manager, &traversal_finder, *site, baseline_support, 2,
-            [&locus_buffer, &emit_variant, &site_manager, &called_loci, &primary_paths, &augmented,
-            &covered_nodes, &covered_edges, this](const Locus& locus, const Snarl* site) {
+            [&calls, &emit_variant, &site_manager, &primary_paths, &augmented,
+            this](const Locus& locus, const Snarl* site) {
             
             // Now we have the Locus with call information, and the site (either
             // the root snarl we passed in or a child snarl) that the call is
@@ -1750,22 +1832,55 @@ void SupportCaller::call(
                 // TODO: update bases lost
             } else {
                 // Emit the locus itself
-                locus_buffer.push_back(locus);
-                stream::write_buffered(cout, locus_buffer, locus_buffer_size);
+                calls.loci.push_back(locus);
             }
             
             // We called a site
-            called_loci++;
+            calls.called_loci++;
             
             // Mark all the nodes and edges in the site as covered
             auto contents = site_manager.deep_contents(site, augmented.graph, true);
-            for (auto* node : contents.first) {
-                covered_nodes.insert(node);
+            calls.covered_nodes.insert(calls.covered_nodes.end(), contents.first.begin(), contents.first.end());
+            calls.covered_edges.insert(calls.covered_edges.end(), contents.second.begin(), contents.second.end());
+        });
+    };
+    
+    size_t batch_size = max(site_batch_size, (size_t) 1);
+    for (size_t batch_start = 0; batch_start < sites.size(); batch_start += batch_size) {
+        // Call a batch of sites in parallel
+        size_t batch_end = min(sites.size(), batch_start + batch_size);
+        vector<SiteCalls> batch_calls(batch_end - batch_start);
+        
+        // We can't throw out of the parallel loop, so remember the first error.
+        string site_error;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            try {
+                call_site(sites[i], batch_calls[i - batch_start]);
+            } catch (const exception& e) {
+#pragma omp critical (support_caller_error)
+                if (site_error.empty()) {
+                    site_error = e.what();
+                }
             }
-            for (auto* edge : contents.second) {
-                covered_edges.insert(edge);
+        }
+        if (!site_error.empty()) {
+            throw runtime_error(site_error);
+        }
+        
+        // Then write out what they found in order
+        for (auto& calls : batch_calls) {
+            for (auto& variant : calls.variants) {
+                out << variant << endl;
             }
-        });
+            for (auto& locus : calls.loci) {
+                locus_buffer.push_back(locus);
+                stream::write_buffered(out, locus_buffer, locus_buffer_size);
+            }
+            covered_nodes.insert(calls.covered_nodes.begin(), calls.covered_nodes.end());
+            covered_edges.insert(calls.covered_edges.begin(), calls.covered_edges.end());
+            called_loci += calls.called_loci;
+        }
     }
     
     if (verbose) {
@@ -1830,7 +1945,7 @@ void SupportCaller::call(
                 
                 // Send out the locus
                 locus_buffer.push_back(locus);
-                stream::write_buffered(cout, locus_buffer, locus_buffer_size);
+                stream::write_buffered(out, locus_buffer, locus_buffer_size);
                 
                 extra_loci++;
                 
@@ -1905,7 +2020,7 @@ void SupportCaller::call(
                     
                     // Send out the locus
                     locus_buffer.push_back(locus);
-                    stream::write_buffered(cout, locus_buffer, locus_buffer_size);
+                    stream::write_buffered(out, locus_buffer, locus_buffer_size);
                     
                     extra_loci++;
                     
@@ -1918,7 +2033,7 @@ void SupportCaller::call(
         }
         
         // Flush the buffer of Locus objects we have to write
-        stream::write_buffered(cout, locus_buffer, 0);
+        stream::write_buffered(out, locus_buffer, 0);
         
         if (verbose) {
             cerr << "Called " << extra_loci << " extra loci with copy number estimates" << endl;
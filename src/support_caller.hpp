@@ -134,9 +134,9 @@ public:
     /**
      * Produce calls for the given annotated augmented graph. If a
      * pileup_filename is provided, the pileup is loaded again and used to add
-     * comments describing variants
+     * comments describing variants. The calls are written to out.
      */
-    void call(SupportAugmentedGraph& augmented, string pileup_filename = "");
+    void call(SupportAugmentedGraph& augmented, string pileup_filename = "", ostream& out = cout);
 
     /** 
      * Get the support and size for each traversal in a list. Discount support
@@ -222,6 +222,9 @@ public:
         "output variants in binary Loci format instead of text VCF format"};
     /// How big should our output buffer be?
     size_t locus_buffer_size = 1000;
+    /// How many sites should we call in parallel before writing out their
+    /// calls in order?
+    size_t site_batch_size = 1000;
     
     /// What are the names of the reference paths, if any, in the graph?
     Option<vector<string>> ref_path_names{this, "ref", "r", {},
@@ -341,6 +344,16 @@ public:
     
 };
 
+/**
+ * Write a minimal VCF header for a file with the given samples, and the given
+ * contigs with the given lengths, declaring the filters with the given
+ * thresholds.
+ */
+void write_vcf_header(ostream& stream, const vector<string>& sample_names,
+    const vector<string>& contig_names, const vector<size_t>& contig_sizes,
+    int min_mad_for_filter, int max_dp_for_filter, double max_dp_multiple_for_filter,
+    double max_local_dp_multiple_for_filter, double min_ad_log_likelihood_for_filter);
+
 }
 
 #endif
@@ -25,44 +25,121 @@ void Translator::load(const vector<Translation>& trans) {
 }
 
 void Translator::build_position_table(void) {
-    //map<pos_t, Translation*> pos_to_trans;
-    for (auto& t : translations) {
+    position_table.clear();
+    node_starts.clear();
+    position_table.resize(translations.size());
+#pragma omp parallel for schedule(static, 1024)
+    for (size_t i = 0; i < translations.size(); ++i) {
         // map from the new positions to the corresponding translations
-        pos_to_trans[make_pos_t(t.to().mapping(0).position())] = &t;
+        const Position& to_pos = translations[i].to().mapping(0).position();
+        position_table[i] = TableEntry{to_pos.node_id(), (size_t) to_pos.offset(), to_pos.is_reverse(),
+                                       is_match(translations[i]), i};
+    }
+    
+    // Later translations of the same position win, as they did when we kept a map
+    stable_sort(position_table.begin(), position_table.end(), [](const TableEntry& a, const TableEntry& b) {
+        return make_tuple(a.node_id, a.is_reverse, a.offset) < make_tuple(b.node_id, b.is_reverse, b.offset);
+    });
+    auto same_position = [](const TableEntry& a, const TableEntry& b) {
+        return a.node_id == b.node_id && a.is_reverse == b.is_reverse && a.offset == b.offset;
+    };
+    size_t kept = 0;
+    for (size_t i = 0; i < position_table.size(); ++i) {
+        if (kept > 0 && same_position(position_table[kept - 1], position_table[i])) {
+            position_table[kept - 1] = position_table[i];
+        } else {
+            position_table[kept++] = position_table[i];
+        }
+    }
+    position_table.resize(kept);
+    
+    if (position_table.empty()) {
+        return;
+    }
+    
+    // Index the table by node ID if the IDs are dense enough
+    min_table_id = position_table.front().node_id;
+    size_t id_range = position_table.back().node_id - min_table_id + 1;
+    if (id_range <= 4 * position_table.size()) {
+        node_starts.resize(id_range + 1);
+        size_t entry = 0;
+        for (size_t i = 0; i <= id_range; ++i) {
+            while (entry < position_table.size() && position_table[entry].node_id < min_table_id + (id_t) i) {
+                ++entry;
+            }
+            node_starts[i] = entry;
+        }
     }
 }
 
-bool Translator::has_translation(const Position& position, bool ignore_strand) {
-    auto pos = make_pos_t(position);
-    pos_t node_only = pos;
-    get_offset(node_only) = 0;
-    get_is_rev(node_only) = ignore_strand ? false : position.is_reverse();
-    return pos_to_trans.find(node_only) != pos_to_trans.end();
+pair<const Translator::TableEntry*, const Translator::TableEntry*> Translator::node_entries(id_t node_id,
+                                                                                            bool is_reverse) const {
+    const TableEntry* begin = position_table.data();
+    const TableEntry* end = begin + position_table.size();
+    if (!node_starts.empty()) {
+        // Jump right to the node
+        if (node_id < min_table_id || node_id - min_table_id + 1 >= node_starts.size()) {
+            return make_pair(end, end);
+        }
+        end = begin + node_starts[node_id - min_table_id + 1];
+        begin = begin + node_starts[node_id - min_table_id];
+    }
+    auto key = make_pair(node_id, is_reverse);
+    auto first = lower_bound(begin, end, key, [](const TableEntry& e, const pair<id_t, bool>& k) {
+        return make_pair(e.node_id, e.is_reverse) < k;
+    });
+    auto last = upper_bound(first, end, key, [](const pair<id_t, bool>& k, const TableEntry& e) {
+        return k < make_pair(e.node_id, e.is_reverse);
+    });
+    return make_pair(first, last);
 }
 
-Translation Translator::get_translation(const Position& position) {
-    auto pos = make_pos_t(position);
+const Translator::TableEntry* Translator::find_entry(const Position& position, const TableEntry* hint) const {
+    if (hint != nullptr && hint->node_id == position.node_id() && hint->is_reverse == position.is_reverse()
+        && hint->offset <= position.offset()) {
+        // The hint covers us unless the next translation on the node starts by now
+        const TableEntry* next = hint + 1;
+        if (next == position_table.data() + position_table.size() || next->node_id != hint->node_id
+            || next->is_reverse != hint->is_reverse || next->offset > position.offset()) {
+            return hint;
+        }
+    }
+    
+    auto range = node_entries(position.node_id(), position.is_reverse());
     // check that the node is in the translation
-    pos_t node_only = pos;
-    get_offset(node_only) = 0;
-    get_is_rev(node_only) = position.is_reverse();
-    Translation translation;
-    if (pos_to_trans.find(node_only) == pos_to_trans.end()) {
-        cerr << "WARNING: node " << id(pos) << " is not in the translation table" << endl;
-    } else {
-        auto t = pos_to_trans.upper_bound(pos); --t;
-        translation = *t->second;
+    if (range.first == range.second || range.first->offset != 0) {
+        cerr << "WARNING: node " << position.node_id() << " is not in the translation table" << endl;
+        return nullptr;
     }
-    return translation;
+    // find the last translation starting at or before our offset
+    auto found = upper_bound(range.first, range.second, (size_t) position.offset(),
+                             [](size_t offset, const TableEntry& e) {
+        return offset < e.offset;
+    });
+    return found - 1;
+}
+
+bool Translator::has_translation(const Position& position, bool ignore_strand) const {
+    auto range = node_entries(position.node_id(), ignore_strand ? false : position.is_reverse());
+    return range.first != range.second && range.first->offset == 0;
 }
 
-Position Translator::translate(const Position& position) {
+Translation Translator::get_translation(const Position& position) const {
+    const TableEntry* entry = find_entry(position);
+    return entry == nullptr ? Translation() : translations[entry->translation];
+}
+
+Position Translator::translate(const Position& position) const {
     return translate(position, get_translation(position));
 }
 
-Position Translator::translate(const Position& position, const Translation& translation) {
+Position Translator::translate(const Position& position, const Translation& translation) const {
+    return translate(position, translation, is_match(translation));
+}
+
+Position Translator::translate(const Position& position, const Translation& translation, bool match) const {
     // what kind of translation is it?
-    if (is_match(translation)) {
+    if (match) {
         if (position.offset() >= mapping_from_length(translation.to().mapping(0))) {
             cerr << "ERROR: to-position offset is greater than translation length "
                  << mapping_from_length(translation.to().mapping(0)) << endl;
@@ -78,12 +155,20 @@ Position Translator::translate(const Position& position, const Translation& tran
     }
 }
 
-Mapping Translator::translate(const Mapping& mapping) {
+Mapping Translator::translate(const Mapping& mapping) const {
+    if (!mapping.has_position()) return mapping;
+    return translate(mapping, find_entry(mapping.position()));
+}
+
+Mapping Translator::translate(const Mapping& mapping, const TableEntry* entry) const {
     Mapping translated = mapping;
     if (!mapping.has_position()) return mapping;
-    Translation translation = get_translation(mapping.position());
-    *translated.mutable_position() = translate(mapping.position(), translation);
-    if (is_match(translation)) {
+    // untranslated nodes get an empty translation
+    static const Translation no_translation;
+    const Translation& translation = entry == nullptr ? no_translation : translations[entry->translation];
+    bool match = entry == nullptr ? is_match(translation) : entry->is_match;
+    *translated.mutable_position() = translate(mapping.position(), translation, match);
+    if (match) {
         return translated;
     } else {
         auto seq = translation.from().mapping(0).edit(0).sequence();
@@ -121,21 +206,27 @@ Mapping Translator::translate(const Mapping& mapping) {
     return translated;
 }
 
-Path Translator::translate(const Path& path) {
+Path Translator::translate(const Path& path) const {
     Path result;
+    // consecutive mappings are usually on the same translation
+    const TableEntry* entry = nullptr;
     for (int i = 0; i < path.mapping_size(); ++i) {
-        *result.add_mapping() = translate(path.mapping(i));
+        const Mapping& mapping = path.mapping(i);
+        if (mapping.has_position()) {
+            entry = find_entry(mapping.position(), entry);
+        }
+        *result.add_mapping() = translate(mapping, entry);
     }
     return simplify(result);
 }
 
-Alignment Translator::translate(const Alignment& aln) {
+Alignment Translator::translate(const Alignment& aln) const {
     Alignment result = aln;
     *result.mutable_path() = translate(aln.path());
     return result;
 }
 
-Locus Translator::translate(const Locus& locus) {
+Locus Translator::translate(const Locus& locus) const {
     Locus result = locus;
     for (int i = 0; i < locus.allele_size(); ++i) {
         *result.mutable_allele(i) = translate(locus.allele(i));
@@ -152,7 +243,7 @@ bool is_match(const Translation& translation) {
         && path_to_length(translation.from()) == path_to_length(translation.to());
 }
 
-Translation Translator::overlay(const Translation& trans) {
+Translation Translator::overlay(const Translation& trans) const {
     Translation result;
     *result.mutable_to() = trans.to();
     *result.mutable_from() = translate(trans.from());
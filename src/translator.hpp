@@ -27,22 +27,59 @@ class Translator {
 public:
 
     vector<Translation> translations;
-    map<pos_t, Translation*> pos_to_trans;
+    
+    /// Where a translation's to path starts, for looking translations up by
+    /// position. Plain data, so the table is just a flat array.
+    struct TableEntry {
+        id_t node_id;
+        size_t offset;
+        bool is_reverse;
+        /// Whether the translation is a simple match, as is_match() says
+        bool is_match;
+        /// Index of the translation in translations
+        size_t translation;
+    };
+    /// One entry per translation, sorted by node ID, strand, and offset
+    vector<TableEntry> position_table;
+    /// Where the entries for each node ID start in position_table, starting
+    /// with min_table_id, with a past-the-end value at the end. Empty if the
+    /// IDs are too sparse for it to pay off, in which case we binary search.
+    vector<size_t> node_starts;
+    id_t min_table_id = 0;
+    
     Translator(void);
     Translator(istream& in);
     Translator(const vector<Translation>& trans);
     void load(const vector<Translation>& trans);
     void build_position_table(void);
-    Translation get_translation(const Position& position);
-    bool has_translation(const Position& position, bool ignore_strand = true);
-    Position translate(const Position& position);
-    Position translate(const Position& position, const Translation& translation);
-    Edge translate(const Edge& edge);
-    Mapping translate(const Mapping& mapping);
-    Path translate(const Path& path);
-    Alignment translate(const Alignment& aln);
-    Locus translate(const Locus& locus);
-    Translation overlay(const Translation& trans);
+    Translation get_translation(const Position& position) const;
+    bool has_translation(const Position& position, bool ignore_strand = true) const;
+    Position translate(const Position& position) const;
+    Position translate(const Position& position, const Translation& translation) const;
+    Edge translate(const Edge& edge) const;
+    Mapping translate(const Mapping& mapping) const;
+    /// Translate a path. Runs of mappings that fall in the same translation
+    /// only look it up once.
+    Path translate(const Path& path) const;
+    Alignment translate(const Alignment& aln) const;
+    Locus translate(const Locus& locus) const;
+    Translation overlay(const Translation& trans) const;
+    
+private:
+    
+    /// Get the range of table entries on the given node and strand
+    pair<const TableEntry*, const TableEntry*> node_entries(id_t node_id, bool is_reverse) const;
+    
+    /// Find the table entry for the translation covering the given position,
+    /// or null (with a warning) if its node isn't translated. If hint is an
+    /// entry that covers the position, it is used without searching.
+    const TableEntry* find_entry(const Position& position, const TableEntry* hint = nullptr) const;
+    
+    /// Translate a position, given whether the translation is a simple match
+    Position translate(const Position& position, const Translation& translation, bool match) const;
+    
+    /// Translate a mapping, given the table entry for its position
+    Mapping translate(const Mapping& mapping, const TableEntry* entry) const;
 };
 
 bool is_match(const Translation& translation);
@@ -129,9 +129,11 @@ vector<SnarlTraversal> PathBasedTraversalFinder::find_traversals(const Snarl& si
 }
    
 ExhaustiveTraversalFinder::ExhaustiveTraversalFinder(VG& graph, SnarlManager& snarl_manager,
-                                                     bool include_reversing_traversals) :
+                                                     bool include_reversing_traversals,
+                                                     size_t max_traversals) :
     graph(graph), snarl_manager(snarl_manager),
-    include_reversing_traversals(include_reversing_traversals) {
+    include_reversing_traversals(include_reversing_traversals),
+    max_traversals(max_traversals) {
     // nothing more to do
 }
     
@@ -187,12 +189,83 @@ void ExhaustiveTraversalFinder::stack_up_valid_walks(NodeTraversal walk_head, ve
     }
 }
 
+const ExhaustiveTraversalFinder::Successors& ExhaustiveTraversalFinder::successors(NodeTraversal node_traversal,
+                                                                                   successor_memo_t& memo) {
+    auto found = memo.find(node_traversal);
+    if (found != memo.end()) {
+        return found->second;
+    }
+    Successors& entry = memo[node_traversal];
+    
+    // does this traversal point into a child snarl?
+    const Snarl* into_snarl = snarl_manager.into_which_snarl(node_traversal.node->id(),
+                                                             node_traversal.backward);
+                                                             
+#ifdef debug
+    cerr << "Traversal " << node_traversal.node->id() << " " << node_traversal.backward << " enters";
+    if (into_snarl != nullptr) {
+        cerr << " " << pb2json(*into_snarl) << endl;
+    } else {
+        cerr << " NULL" << endl; 
+    }
+#endif
+    
+    if (into_snarl == nullptr) {
+        // add all of the node traversals we can reach through valid walks
+        stack_up_valid_walks(node_traversal, entry.next);
+        return entry;
+    }
+    
+    entry.child = into_snarl;
+    
+    // which side of the snarl does the traversal point into?
+    if (into_snarl->start().node_id() == node_traversal.node->id()
+        && into_snarl->start().backward() == node_traversal.backward) {
+        // Into the start
+#ifdef debug
+        cerr << "Entered child through its start" << endl;
+#endif
+        if (into_snarl->start_end_reachable()) {
+            // skip to the other side and proceed in the orientation that the end node takes.
+            entry.next.push_back(to_node_traversal(into_snarl->end(), graph));
+        }
+        
+        // if the same side is also reachable, add it too
+        if (into_snarl->start_self_reachable()) {
+            // Make sure to flip it around so we come out of the snarl instead of going in again,
+            entry.next.push_back(to_rev_node_traversal(into_snarl->start(), graph).reverse());
+        }
+        
+    }
+    else {
+        // Into the end
+#ifdef debug
+        cerr << "Entered child through its end" << endl;
+#endif
+        if (into_snarl->start_end_reachable()) {
+            // skip to the other side and proceed in the orientation
+            // *opposite* what the start node takes (i.e. out of the
+            // snarl)
+            entry.next.push_back(to_node_traversal(into_snarl->start(), graph).reverse());
+        }
+        
+        // if the same side is also reachable, add it too
+        if (into_snarl->end_self_reachable()) {
+            entry.next.push_back(to_rev_node_traversal(into_snarl->end(), graph));
+        }
+    }
+    
+    return entry;
+}
+
 void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversals,
                                                NodeTraversal traversal_start,
                                                set<NodeTraversal>& stop_at,
-                                               set<NodeTraversal>& yield_at) {
-    // keeps track of the walk of the DFS traversal
-    list<Visit> path;
+                                               set<NodeTraversal>& yield_at,
+                                               successor_memo_t& memo) {
+    // keeps track of the walk of the DFS traversal, as node traversals and
+    // (with a null node) the child snarls skipped over
+    vector<pair<NodeTraversal, const Snarl*>> path;
     
     // these mark the start of the edges out of the node that is on the head of the path
     // they can be used to see how many nodes we need to peel off the path when we're
@@ -220,11 +293,24 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
                 traversals.emplace_back();
                 
                 // record the traversal in the return value
-                for (auto iter = path.begin(); iter != path.end(); iter++) {
-                    *traversals.back().add_visit() = *iter;
+                for (auto& step : path) {
+                    Visit* visit = traversals.back().add_visit();
+                    if (step.second != nullptr) {
+                        *visit->mutable_snarl()->mutable_start() = step.second->start();
+                        *visit->mutable_snarl()->mutable_end() = step.second->end();
+                    }
+                    else {
+                        visit->set_node_id(step.first.node->id());
+                        visit->set_backward(step.first.backward);
+                    }
                 }
                 // add the final visit
                 *traversals.back().add_visit() = to_visit(node_traversal);
+                
+                if (max_traversals && traversals.size() >= max_traversals) {
+                    // we've used up our budget
+                    return;
+                }
             }
             
             // don't proceed to add more onto the DFS stack
@@ -234,86 +320,24 @@ void ExhaustiveTraversalFinder::add_traversals(vector<SnarlTraversal>& traversal
         // mark the beginning of this node's edges forward in the stack
         stack.push_back(stack_sentinel);
         
-        // make a visit through the node traversal and add it to the path
-        path.emplace_back();
-        path.back().set_node_id(node_traversal.node->id());
-        path.back().set_backward(node_traversal.backward);
+        // add the node traversal to the path
+        path.emplace_back(node_traversal, nullptr);
         
-        // does this traversal point into a child snarl?
-        const Snarl* into_snarl = snarl_manager.into_which_snarl(node_traversal.node->id(),
-                                                                 node_traversal.backward);
-                                                                 
-#ifdef debug
-        cerr << "Traversal " << node_traversal.node->id() << " " << node_traversal.backward << " enters";
-        if (into_snarl != nullptr) {
-            cerr << " " << pb2json(*into_snarl) << endl;
-        } else {
-            cerr << " NULL" << endl; 
+        if (node_traversal == traversal_start) {
+            // we're leaving the boundary, so we don't skip over any snarl it points into
+            stack_up_valid_walks(node_traversal, stack);
+            continue;
         }
-#endif
-                                                                 
-        if (into_snarl && !(node_traversal == traversal_start)) {
+        
+        const Successors& next = successors(node_traversal, memo);
+        if (next.child != nullptr) {
             // add a visit for the child snarl
-            path.emplace_back();
-            *path.back().mutable_snarl()->mutable_start() = into_snarl->start();
-            *path.back().mutable_snarl()->mutable_end() = into_snarl->end();
+            path.emplace_back(stack_sentinel, next.child);
             
             // mark the beginning of this child snarls edges forward in the stack
             stack.push_back(stack_sentinel);
-            
-            // which side of the snarl does the traversal point into?
-            if (into_snarl->start().node_id() == node_traversal.node->id()
-                && into_snarl->start().backward() == node_traversal.backward) {
-                // Into the start
-#ifdef debug
-                cerr << "Entered child through its start" << endl;
-#endif
-                if (into_snarl->start_end_reachable()) {
-                    // skip to the other side and proceed in the orientation that the end node takes.
-                    stack.push_back(to_node_traversal(into_snarl->end(), graph));
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
-                }
-                
-                // if the same side is also reachable, add it to the stack too
-                if (into_snarl->start_self_reachable()) {
-                    // Make sure to flip it around so we come out of the snarl instead of going in again,
-                    stack.push_back(to_rev_node_traversal(into_snarl->start(), graph).reverse());
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
-                }
-                
-            }
-            else {
-                // Into the end
-#ifdef debug
-                cerr << "Entered child through its end" << endl;
-#endif
-                if (into_snarl->start_end_reachable()) {
-                    // skip to the other side and proceed in the orientation
-                    // *opposite* what the start node takes (i.e. out of the
-                    // snarl)
-                    stack.push_back(to_node_traversal(into_snarl->start(), graph).reverse());
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
-                }
-                
-                // if the same side is also reachable, add it to the stack too
-                if (into_snarl->end_self_reachable()) {
-                    stack.push_back(to_rev_node_traversal(into_snarl->end(), graph));
-#ifdef debug
-                    cerr << "Stack up " << stack.back().node->id() << " " << stack.back().backward << endl;
-#endif
-                }
-            }
-        }
-        else {
-            // add all of the node traversals we can reach through valid walks to stack
-            stack_up_valid_walks(node_traversal, stack);
         }
+        stack.insert(stack.end(), next.next.begin(), next.next.end());
     }
 }
     
@@ -337,20 +361,120 @@ vector<SnarlTraversal> ExhaustiveTraversalFinder::find_traversals(const Snarl& s
         yield_at.insert(site_rev_start);
     }
     
+    // the successors of the node traversals in the site, shared by both searches
+    successor_memo_t memo;
+    
     // search forward from the start and add any traversals that leave the indicated boundaries
-    add_traversals(to_return, site_start, stop_at, yield_at);
+    add_traversals(to_return, site_start, stop_at, yield_at, memo);
 
-    if (site.end_self_reachable() && include_reversing_traversals) {
+    if (site.end_self_reachable() && include_reversing_traversals
+        && (!max_traversals || to_return.size() < max_traversals)) {
         // if the end is reachable from itself, also look for traversals that both enter and
         // leave through the end
         yield_at.erase(site_rev_start);
         add_traversals(to_return, NodeTraversal(site_end.node, !site_end.backward),
-                       stop_at, yield_at);
+                       stop_at, yield_at, memo);
     }
     
     return to_return;
 }
 
+HandleTraversalFinder::HandleTraversalFinder(const HandleGraph& graph, const SnarlManager& snarl_manager,
+                                             size_t max_traversals) :
+    graph(graph), snarl_manager(snarl_manager), max_traversals(max_traversals) {
+    // nothing more to do
+}
+
+vector<SnarlTraversal> HandleTraversalFinder::find_traversals(const Snarl& site) {
+
+    vector<SnarlTraversal> to_return;
+
+    handle_t site_start = graph.get_handle(site.start().node_id(), site.start().backward());
+    handle_t site_end = graph.get_handle(site.end().node_id(), site.end().backward());
+    handle_t site_rev_start = graph.flip(site_start);
+
+    // The visits on the current walk of the DFS traversal
+    vector<Visit> path;
+
+    // Each handle still to explore, with how long the path was when it was
+    // found, so we know how much to peel off when we backtrack to it
+    vector<pair<handle_t, size_t>> stack{make_pair(site_start, (size_t) 0)};
+
+    auto make_visit = [&](const handle_t& handle) {
+        Visit visit;
+        visit.set_node_id(graph.get_id(handle));
+        visit.set_backward(graph.get_is_reverse(handle));
+        return visit;
+    };
+
+    while (!stack.empty()) {
+        handle_t handle = stack.back().first;
+        path.resize(stack.back().second);
+        stack.pop_back();
+
+        if (handle == site_end) {
+            // We finished a traversal through the site
+            to_return.emplace_back();
+            for (auto& visit : path) {
+                *to_return.back().add_visit() = visit;
+            }
+            *to_return.back().add_visit() = make_visit(handle);
+
+            if (max_traversals && to_return.size() >= max_traversals) {
+                // we've used up our budget
+                break;
+            }
+            continue;
+        }
+        if (handle == site_rev_start) {
+            // This walk leaves the site backward
+            continue;
+        }
+
+        path.push_back(make_visit(handle));
+
+        // We don't skip over the site itself when we leave its start
+        const Snarl* child = handle == site_start ? nullptr :
+            snarl_manager.into_which_snarl(graph.get_id(handle), graph.get_is_reverse(handle));
+
+        if (child == nullptr) {
+            graph.follow_edges(handle, false, [&](const handle_t& next) {
+                stack.emplace_back(next, path.size());
+            });
+            continue;
+        }
+
+        // Add a visit for the child snarl and come out of whichever of its
+        // sides we can reach
+        path.emplace_back();
+        *path.back().mutable_snarl()->mutable_start() = child->start();
+        *path.back().mutable_snarl()->mutable_end() = child->end();
+
+        const Visit& start = child->start();
+        const Visit& end = child->end();
+        if (graph.get_id(handle) == start.node_id() && graph.get_is_reverse(handle) == start.backward()) {
+            // Into the start
+            if (child->start_end_reachable()) {
+                stack.emplace_back(graph.get_handle(end.node_id(), end.backward()), path.size());
+            }
+            if (child->start_self_reachable()) {
+                stack.emplace_back(graph.get_handle(start.node_id(), !start.backward()), path.size());
+            }
+        }
+        else {
+            // Into the end
+            if (child->start_end_reachable()) {
+                stack.emplace_back(graph.get_handle(start.node_id(), !start.backward()), path.size());
+            }
+            if (child->end_self_reachable()) {
+                stack.emplace_back(graph.get_handle(end.node_id(), end.backward()), path.size());
+            }
+        }
+    }
+
+    return to_return;
+}
+
 PathRestrictedTraversalFinder::PathRestrictedTraversalFinder(VG& graph,
                                                              SnarlManager& snarl_manager,
                                                              map<string, const Alignment*>& reads_by_name,
@@ -968,8 +1092,8 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
     while(ref_node_start <= primary_max) {
     
         // Find the reference node starting here or later.
-        auto found = index.by_start.lower_bound(ref_node_start);
-        if(found == index.by_start.end()) {
+        auto found = index.find_start(ref_node_start);
+        if(found == index.end()) {
             throw runtime_error("No backbone node found when tracing through site!");
         }
 #ifdef debug
@@ -1019,8 +1143,8 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
                 // Advance
                 ref_node_start = found->first + here->sequence().size();
                 // And look at what we get
-                found = index.by_start.lower_bound(ref_node_start);
-                assert(found != index.by_start.end());
+                found = index.find_start(ref_node_start);
+                assert(found != index.end());
                 // And grab out the node
                 found_visit = found->second.to_visit();
                 here = augmented.graph.get_node(found_visit.node_id());
@@ -1035,8 +1159,8 @@ vector<SnarlTraversal> RepresentativeTraversalFinder::find_traversals(const Snar
                 if (snarl_manager.into_which_snarl(found_visit) == nullptr) {
                     // We don't have another child snarl immediately. Look at the node after this one.
                     ref_node_start = found->first + here->sequence().size();
-                    found = index.by_start.lower_bound(ref_node_start);
-                    assert(found != index.by_start.end());
+                    found = index.find_start(ref_node_start);
+                    assert(found != index.end());
                     found_visit = found->second.to_visit();
                     here = augmented.graph.get_node(found_visit.node_id());
                 } else {
@@ -1771,11 +1895,11 @@ Support RepresentativeTraversalFinder::min_support_in_path(const list<Visit>& pa
     // Have we found anything with a support yet?
     bool supportFound = false;
     // If we have, this holds the min support we have found.
-    Support minSupport;
+    PackedSupport minSupport;
     
     if (cur->node_id() != 0) {
         // We're at a node visit, so we have a support to start with
-        minSupport = augmented.get_support(augmented.graph.get_node(cur->node_id()));
+        minSupport = augmented.get_packed_support(augmented.graph.get_node(cur->node_id()));
         supportFound = true;
     }
     
@@ -1784,7 +1908,7 @@ Support RepresentativeTraversalFinder::min_support_in_path(const list<Visit>& pa
     
         if (next->node_id() != 0) {
             // The next visit is to a node, so get its support
-            Support nextSupport = augmented.get_support(augmented.graph.get_node(next->node_id()));
+            PackedSupport nextSupport = augmented.get_packed_support(augmented.graph.get_node(next->node_id()));
             
             if (supportFound) {
                 // Min it against existing support
@@ -1803,7 +1927,7 @@ Support RepresentativeTraversalFinder::min_support_in_path(const list<Visit>& pa
         
         if (edge != nullptr) {
             // The edge exists (because we aren't back-to-back child snarls)
-            Support edgeSupport = augmented.get_support(edge);
+            PackedSupport edgeSupport = augmented.get_packed_support(edge);
             
             if (supportFound) {
                 // Min it against existing support
@@ -1817,7 +1941,7 @@ Support RepresentativeTraversalFinder::min_support_in_path(const list<Visit>& pa
     }
 
     // This may be 0 if we hit no nodes or edges, but I guess that's OK...
-    return minSupport;
+    return minSupport.to_support();
 }
 
 set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit visit,
@@ -1828,16 +1952,41 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
     
     // Do a BFS
     
-    // This holds the paths to get to NodeTraversals to visit (all of which will
-    // end with the node we're starting with).
-    list<list<Visit>> toExtend;
+    // This holds the search tree: each step is a visit, with the step it
+    // extends left from and the length in visits and bp of the path back to
+    // the node we're starting with. Steps are added in BFS order, so the ones
+    // past the cursor are the queue of paths still to extend. The buffer is
+    // reused between searches on the same thread.
+    struct SearchStep {
+        Visit visit;
+        size_t parent;
+        size_t depth;
+        size_t length;
+    };
+    static thread_local vector<SearchStep> toExtend;
+    toExtend.clear();
+    size_t cursor = 0;
+    
+    // Turn a step into the path it represents, from the step back to the start
+    auto trace_path = [&](size_t step) {
+        list<Visit> path;
+        while (true) {
+            path.push_back(toExtend[step].visit);
+            if (toExtend[step].depth == 1) {
+                break;
+            }
+            step = toExtend[step].parent;
+        }
+        return path;
+    };
     
     // This keeps a set of all the oriented nodes we already got to and don't
     // need to queue again.
     set<Visit> alreadyQueued;
     
     // Start at this node at depth 0
-    toExtend.emplace_back(list<Visit> {visit});
+    toExtend.push_back(SearchStep{visit, 0, 1, visit.node_id() != 0 ?
+        augmented.graph.get_node(visit.node_id())->sequence().size() : 0});
     // Mark this traversal as already queued
     alreadyQueued.insert(visit);
     
@@ -1851,7 +2000,7 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
     // Track how many options we have because size may be O(n).
     size_t stillToExtend = toExtend.size();
     
-    while (!toExtend.empty()) {
+    while (cursor < toExtend.size()) {
         // Keep going until we've visited every node up to our max search depth.
         
         searchTicks++;
@@ -1864,9 +2013,11 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
 
         
         // Dequeue a path to extend.
-        // Make sure to move out of the list to avoid a useless copy.
-        list<Visit> path(move(toExtend.front()));
-        toExtend.pop_front();
+        size_t here = cursor++;
+        // Copy out the step, since extending may move the buffer
+        Visit front = toExtend[here].visit;
+        size_t depth = toExtend[here].depth;
+        size_t length = toExtend[here].length;
         stillToExtend--;
         
         // We can't just throw out longer paths, because shorter paths may need
@@ -1875,50 +2026,50 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
         
         // Look up and see if the front node on the path is on our reference
         // path
-        if (path.front().node_id() != 0 && index.by_id.count(path.front().node_id())) {
+        if (front.node_id() != 0 && index.by_id.count(front.node_id())) {
             // This visit is to a node, which is on the reference path.
             
 #ifdef debug
-            cerr << "Reached anchoring node " << path.front().node_id() << endl;
-            cerr << "Emit path of length " << path.size() << endl;
+            cerr << "Reached anchoring node " << front.node_id() << endl;
+            cerr << "Emit path of length " << depth << endl;
 #endif
             
             // Say we got to the right place
-            toReturn.emplace(bp_length(path), move(path));
+            toReturn.emplace(length, trace_path(here));
             
             // Don't bother looking for extensions, we already got there.
-        } else if (path.front().node_id() == 0 && !path.front().backward() &&
-                   index.by_id.count(path.front().snarl().start().node_id())) {
+        } else if (front.node_id() == 0 && !front.backward() &&
+                   index.by_id.count(front.snarl().start().node_id())) {
             // This visit is to a snarl, which is on the reference path on its
             // left end.
             
 #ifdef debug
-            cerr << "Reached start of anchoring snarl " << path.front().snarl() << endl;
+            cerr << "Reached start of anchoring snarl " << front.snarl() << endl;
 #endif
             
             // Say we got to the right place
-            toReturn.emplace(bp_length(path), move(path));
+            toReturn.emplace(length, trace_path(here));
             
             // Don't bother looking for extensions, we already got there.
-        } else if (path.front().node_id() == 0 && path.front().backward() &&
-                   index.by_id.count(path.front().snarl().end().node_id())) {
+        } else if (front.node_id() == 0 && front.backward() &&
+                   index.by_id.count(front.snarl().end().node_id())) {
             // This visit is to a snarl in reverse, which is on the reference
             // path on its right end.
             
 #ifdef debug
-            cerr << "Reached end of anchoring snarl " << path.front().snarl() << endl;
+            cerr << "Reached end of anchoring snarl " << front.snarl() << endl;
 #endif
             
             // Say we got to the right place
-            toReturn.emplace(bp_length(path), move(path));
+            toReturn.emplace(length, trace_path(here));
             
             // Don't bother looking for extensions, we already got there.
-        } else if (path.size() <= max_depth) {
+        } else if (depth <= max_depth) {
             // We haven't hit the reference path yet, but we also haven't hit
             // the max depth. Extend with all the possible extensions.
             
             // Look left, possibly entering child snarls
-            vector<Visit> prevVisits = snarl_manager.visits_left(path.front(), augmented.graph, in_snarl);
+            vector<Visit> prevVisits = snarl_manager.visits_left(front, augmented.graph, in_snarl);
             
 #ifdef debug
             cerr << "Consider " << prevVisits.size() << " prev visits" << endl;
@@ -1935,7 +2086,7 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
                     
                     // Make sure the edge is real, since it can't be a back-to-
                     // back site
-                    Edge* edge = augmented.graph.get_edge(to_right_side(prevVisit), to_left_side(path.front()));
+                    Edge* edge = augmented.graph.get_edge(to_right_side(prevVisit), to_left_side(front));
                     assert(edge != NULL);
                 
                     // Fetch the actual node
@@ -2004,16 +2155,18 @@ set<pair<size_t, list<Visit>>> RepresentativeTraversalFinder::bfs_left(Visit vis
 #endif
             
                 // Make a new path extended left with the node
-                list<Visit> extended(path);
-                extended.push_front(prevVisit);
-                toExtend.emplace_back(move(extended));
+                size_t extended_length = length;
+                if (prevVisit.node_id() != 0) {
+                    extended_length += augmented.graph.get_node(prevVisit.node_id())->sequence().size();
+                }
+                toExtend.push_back(SearchStep{prevVisit, here, depth + 1, extended_length});
                 stillToExtend++;
                 
                 // Remember we found a way to this node, so we don't try and
                 // visit it other ways.
                 alreadyQueued.insert(prevVisit);
             }
-        } else if (path.size() >= max_depth) {
+        } else if (depth >= max_depth) {
 #ifdef debug
             cerr << "Path has reached max depth! Aborting!" << endl;
 #endif
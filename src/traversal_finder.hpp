@@ -48,26 +48,74 @@ class ExhaustiveTraversalFinder : public TraversalFinder {
     VG& graph;
     SnarlManager& snarl_manager;
     bool include_reversing_traversals;
+    /// Stop after this many traversals of a site (0 for no limit)
+    size_t max_traversals;
     
 public:
     ExhaustiveTraversalFinder(VG& graph, SnarlManager& snarl_manager,
-                              bool include_reversing_traversals = false);
+                              bool include_reversing_traversals = false,
+                              size_t max_traversals = 0);
     
     virtual ~ExhaustiveTraversalFinder();
     
     /**
-     * Exhaustively enumerate all traversals through the site. Only valid for
-     * acyclic Snarls.
+     * Exhaustively enumerate all traversals through the site, up to the
+     * maximum number of traversals. Only valid for acyclic Snarls. Keeps no
+     * state between calls, so it is safe to call on different sites from
+     * different threads as long as the graph is not being modified.
      */
     virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
     
 private:
+    
+    /// Where the DFS can go next from a node traversal: the traversals that
+    /// follow it, and the child snarl it enters on the way, if any
+    struct Successors {
+        const Snarl* child = nullptr;
+        vector<NodeTraversal> next;
+    };
+    
+    /// The successors of each node traversal seen in the current search, so
+    /// that walks that share a node do not look up its edges or child snarl
+    /// again
+    typedef unordered_map<NodeTraversal, Successors> successor_memo_t;
+    
     void stack_up_valid_walks(NodeTraversal walk_head, vector<NodeTraversal>& stack);
+    const Successors& successors(NodeTraversal node_traversal, successor_memo_t& memo);
     void add_traversals(vector<SnarlTraversal>& traversals, NodeTraversal traversal_start,
-                        set<NodeTraversal>& stop_at, set<NodeTraversal>& yield_at);
-    
+                        set<NodeTraversal>& stop_at, set<NodeTraversal>& yield_at,
+                        successor_memo_t& memo);
+
 };
-    
+
+/**
+ * Enumerates the traversals through a site from its start to its end, like
+ * the ExhaustiveTraversalFinder, but on any HandleGraph, so it can run
+ * directly against an XG index. Child snarls are skipped over and reported
+ * as snarl visits.
+ */
+class HandleTraversalFinder : public TraversalFinder {
+
+    const HandleGraph& graph;
+    const SnarlManager& snarl_manager;
+    /// Stop after this many traversals of a site (0 for no limit)
+    size_t max_traversals;
+
+public:
+    HandleTraversalFinder(const HandleGraph& graph, const SnarlManager& snarl_manager,
+                          size_t max_traversals = 0);
+
+    virtual ~HandleTraversalFinder() = default;
+
+    /**
+     * Enumerate all traversals through the site from start to end, up to the
+     * maximum number of traversals. Only valid for acyclic Snarls. Keeps no
+     * state between calls, so it is safe to call on different sites from
+     * different threads.
+     */
+    virtual vector<SnarlTraversal> find_traversals(const Snarl& site);
+};
+
 class ReadRestrictedTraversalFinder : TraversalFinder {
 
     AugmentedGraph& aug;
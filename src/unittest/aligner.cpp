@@ -295,6 +295,178 @@ TEST_CASE("Full-length bonus can attach Ns to Ns", "[aligner][alignment][mapping
     
 }
    
+TEST_CASE("Aligner gives the same alignments when reusing an AlignableGraph", "[aligner][alignment][mapping]") {
+    
+    VG graph;
+    
+    Aligner aligner(1, 4, 6, 1, 5);
+    
+    Node* n0 = graph.create_node("AGTG");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGT");
+    
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+    
+    AlignableGraph alignable(graph.graph);
+    
+    SECTION("local alignments match repeatedly") {
+        for (string read : {"AGTGCTGAAGT", "GTGATGAA", "AGTGCTGAAGT"}) {
+            Alignment fresh, reused;
+            fresh.set_sequence(read);
+            reused.set_sequence(read);
+            
+            aligner.align(fresh, graph.graph, true, false);
+            aligner.align(reused, alignable, true, false);
+            
+            REQUIRE(reused.score() == fresh.score());
+            REQUIRE(pb2json(reused.path()) == pb2json(fresh.path()));
+        }
+    }
+    
+    SECTION("pinned alignments match in both directions repeatedly") {
+        for (bool pin_left : {true, false, true, false}) {
+            Alignment fresh, reused;
+            fresh.set_sequence("AGTGATGA");
+            reused.set_sequence("AGTGATGA");
+            
+            aligner.align_pinned(fresh, graph.graph, pin_left);
+            aligner.align_pinned(reused, alignable, pin_left);
+            
+            REQUIRE(reused.score() == fresh.score());
+            REQUIRE(pb2json(reused.path()) == pb2json(fresh.path()));
+        }
+    }
+    
+    SECTION("a different aligner can use the same AlignableGraph") {
+        QualAdjAligner qual_adj_aligner(1, 4, 6, 1, 5);
+        
+        Alignment first, second;
+        first.set_sequence("AGTGCTGAAGT");
+        second.set_sequence("AGTGCTGAAGT");
+        second.set_quality(string(11, 30));
+        
+        aligner.align(first, alignable, true, false);
+        qual_adj_aligner.align(second, alignable, true, false);
+        
+        Alignment fresh;
+        fresh.set_sequence(second.sequence());
+        fresh.set_quality(second.quality());
+        qual_adj_aligner.align(fresh, graph.graph, true, false);
+        
+        REQUIRE(second.score() == fresh.score());
+        REQUIRE(pb2json(second.path()) == pb2json(fresh.path()));
+    }
+}
+
+TEST_CASE("Aligner gives the same local alignments in a batch as one at a time", "[aligner][alignment][mapping]") {
+    
+    VG graph;
+    
+    Aligner aligner(1, 4, 6, 1, 5);
+    
+    Node* n0 = graph.create_node("AGTG");
+    Node* n1 = graph.create_node("C");
+    Node* n2 = graph.create_node("A");
+    Node* n3 = graph.create_node("TGAAGT");
+    
+    graph.create_edge(n0, n1);
+    graph.create_edge(n0, n2);
+    graph.create_edge(n1, n3);
+    graph.create_edge(n2, n3);
+    
+    AlignableGraph alignable(graph.graph);
+    
+    vector<string> reads {"AGTGCTGAAGT", "GTGATGAA", "AGTGTGAAGT", "AGTGCCTGAAGT", "TTTTAGTGC",
+                          "GAAGTCCCC", "AGTGATGAGGT", "CGTGCTGAAGA", "TGCTGA", "A"};
+    vector<Alignment> batched(reads.size());
+    vector<pair<Alignment*, AlignableGraph*>> jobs;
+    for (size_t i = 0; i < reads.size(); i++) {
+        batched[i].set_sequence(reads[i]);
+        jobs.emplace_back(&batched[i], &alignable);
+    }
+    aligner.align_batch(jobs, true);
+    
+    SECTION("every read gets the score gssw gives it, along a path with that score") {
+        for (size_t i = 0; i < reads.size(); i++) {
+            Alignment single;
+            single.set_sequence(reads[i]);
+            aligner.align(single, graph.graph, true, false);
+            
+            REQUIRE(batched[i].score() == single.score());
+            REQUIRE(aligner.score_ungapped_alignment(batched[i]) == batched[i].score());
+            REQUIRE((size_t) path_to_length(batched[i].path()) == reads[i].size());
+        }
+    }
+    
+    SECTION("an alignment with only one best path gets it") {
+        Alignment single;
+        single.set_sequence(reads[0]);
+        aligner.align(single, graph.graph, true, false);
+        REQUIRE(pb2json(batched[0].path()) == pb2json(single.path()));
+    }
+}
+
+TEST_CASE("Precomputed maximum mapping qualities match the approximation", "[aligner][mapping]") {
+    
+    Aligner aligner;
+    Aligner other_aligner;
+    
+    // aligners with the same parameters share their log base
+    REQUIRE(aligner.log_base == other_aligner.log_base);
+    
+    for (int length : {0, 1, 20, 150}) {
+        vector<double> scores{(double) length * aligner.match};
+        REQUIRE((int32_t) aligner.max_possible_mapping_quality(length) == aligner.compute_mapping_quality(scores, true));
+        
+        for (double diffs : {0.0, 1.0, 2.5}) {
+            for (double next_diffs : {0.0, 1.5, 4.0}) {
+                vector<double> pair_scores{(length - diffs) * aligner.match - diffs * aligner.mismatch,
+                                           (length - next_diffs) * aligner.match - next_diffs * aligner.mismatch};
+                double estimate = aligner.estimate_max_possible_mapping_quality(length, diffs, next_diffs);
+                REQUIRE(fabs(estimate - aligner.compute_mapping_quality(pair_scores, true)) < 1.0);
+            }
+        }
+    }
+}
+
+TEST_CASE("Rescoring an alignment only gives bonuses to the unclipped ends", "[aligner][alignment][mapping]") {
+    
+    Aligner aligner(1, 4, 6, 1, 5);
+    
+    // soft clip of 2 on the left, then a match, a substitution, and a split to a later offset
+    string aln_json = R"({"sequence": "GGACGCAC", "path": {"mapping": [
+        {"position": {"node_id": 1, "offset": 0}, "edit": [
+            {"to_length": 2, "sequence": "GG"},
+            {"from_length": 3, "to_length": 3},
+            {"from_length": 1, "to_length": 1, "sequence": "C"}]},
+        {"position": {"node_id": 1, "offset": 6}, "edit": [
+            {"from_length": 2, "to_length": 2}]}]}})";
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+    
+    SECTION("Only the right end gets a full length bonus") {
+        REQUIRE(aligner.score_ungapped_alignment(aln, true) == 5 * aligner.match - aligner.mismatch);
+        REQUIRE(aligner.score_ungapped_alignment(aln) == 5 * aligner.match - aligner.mismatch + aligner.full_length_bonus);
+        
+        aln.set_score(aligner.score_ungapped_alignment(aln));
+        REQUIRE(aligner.remove_bonuses(aln) == aligner.score_ungapped_alignment(aln, true));
+    }
+    
+    SECTION("Gaps between mappings are scored from where the first mapping ends") {
+        size_t distance = 0;
+        int32_t score = aligner.score_gappy_alignment(aln, [&](pos_t last, pos_t next, size_t max_search) {
+            distance = offset(next) - offset(last);
+            return distance;
+        }, true);
+        REQUIRE(distance == 2);
+        REQUIRE(score == 5 * aligner.match - aligner.mismatch - aligner.gap_open - aligner.gap_extension);
+    }
+}
+   
 }
 }
         
@@ -5,6 +5,9 @@
 
 #include <iostream>
 #include <string>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
 #include "../json2pb.h"
 #include "../vg.pb.h"
 #include "../alignment.hpp"
@@ -110,5 +113,174 @@ TEST_CASE("Alignment trimming works even on unaligned reads", "[alignment]") {
     
 }
 
+TEST_CASE("In place reverse complement matches the copying one", "[alignment]") {
+    
+    string alignment_string = R"(
+        {"sequence": "GATTACAT", "path": {"mapping": [
+            {"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 2, "to_length": 2}, {"to_length": 1, "sequence": "T"}], "rank": 1},
+            {"position": {"node_id": 2, "is_reverse": true}, "edit": [{"from_length": 1}, {"from_length": 3, "to_length": 3}], "rank": 2},
+            {"edit": [{"to_length": 2, "sequence": "AT"}], "rank": 3}]}}
+    )";
+    
+    Alignment a;
+    json2pb(a, alignment_string.c_str(), alignment_string.size());
+    
+    auto node_length = [](id_t id) -> int64_t {
+        return id == 1 ? 6 : 5;
+    };
+    
+    Alignment copied = reverse_complement_alignment(a, node_length);
+    Alignment flipped = a;
+    reverse_complement_alignment_in_place(&flipped, node_length);
+    
+    REQUIRE(pb2json(flipped) == pb2json(copied));
+    REQUIRE(flipped.sequence() == "ATGTAATC");
+    REQUIRE(flipped.path().mapping(0).edit(0).sequence() == "AT");
+    REQUIRE(flipped.path().mapping(1).position().node_id() == 2);
+    REQUIRE(flipped.path().mapping(1).position().offset() == 1);
+    REQUIRE(!flipped.path().mapping(1).position().is_reverse());
+    REQUIRE(flipped.path().mapping(2).position().node_id() == 1);
+    REQUIRE(flipped.path().mapping(2).position().offset() == 2);
+    REQUIRE(flipped.path().mapping(2).position().is_reverse());
+    REQUIRE(flipped.path().mapping(2).edit(0).sequence() == "A");
+    
+    // flipping back gets the original
+    reverse_complement_alignment_in_place(&flipped, node_length);
+    REQUIRE(pb2json(flipped) == pb2json(a));
+}
+
+TEST_CASE("Alignments are encoded straight into BAM records", "[alignment][bam]") {
+    
+    string alignment_string = R"(
+        {"name": "read/1", "sequence": "ACGTTN", "read_group": "grp", "mapping_quality": 60, "path": {"mapping": [
+            {"position": {"node_id": 1}, "edit": [{"to_length": 2, "sequence": "AC"}, {"from_length": 3, "to_length": 3}]},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1}, {"from_length": 2}]}]}}
+    )";
+    
+    Alignment a;
+    json2pb(a, alignment_string.c_str(), alignment_string.size());
+    
+    vector<uint32_t> cigar;
+    cigar_against_path(a, false, cigar);
+    REQUIRE(cigar_against_path(a, false) == "2S4M2D");
+    REQUIRE(cigar.size() == 3);
+    
+    bam1_t* b = bam_init1();
+    for (bool reverse : {false, true}) {
+        alignment_to_bam(a, 0, 100, reverse, cigar, 0, 100, 0, b);
+        
+        REQUIRE(string(bam_get_qname(b)) == "read");
+        REQUIRE(b->core.pos == 100);
+        REQUIRE(b->core.qual == 60);
+        REQUIRE(b->core.n_cigar == 3);
+        REQUIRE(bam_cigar_op(bam_get_cigar(b)[0]) == BAM_CSOFT_CLIP);
+        REQUIRE(bam_cigar2rlen(b->core.n_cigar, bam_get_cigar(b)) == 6);
+        REQUIRE(string((char*) (bam_aux_get(b, "RG") + 1)) == "grp");
+        
+        string sequence;
+        for (int i = 0; i < b->core.l_qseq; i++) {
+            sequence.push_back("=ACMGRSVTWYHKDBN"[bam_seqi(bam_get_seq(b), i)]);
+        }
+        REQUIRE(sequence == (reverse ? "NAACGT" : "ACGTTN"));
+        
+        // reading it back gets the read in its own orientation
+        Alignment read_back = bam_to_alignment(b, unordered_map<string, string>());
+        REQUIRE(read_back.sequence() == "ACGTTN");
+        REQUIRE(read_back.name() == "read");
+    }
+    bam_destroy1(b);
+}
+
+TEST_CASE("FASTQ readers parse every record, in parallel and in order", "[alignment][fastq]") {
+    
+    // Write out enough reads to span several batches, with no newline at the end
+    string filename = tmpfilename("vg-unittest-fastq");
+    size_t read_count = 2000;
+    {
+        ofstream out(filename);
+        for (size_t i = 0; i < read_count; i++) {
+            if (i > 0) {
+                out << endl;
+            }
+            out << "@read" << i << "/" << (i % 2 + 1) << endl
+                << string(50 + i % 100, "ACGT"[i % 4]) << endl
+                << "+" << endl
+                << string(50 + i % 100, 'I');
+        }
+    }
+    
+    SECTION("Unpaired reads come out in order when read serially") {
+        size_t seen = 0;
+        size_t count = fastq_unpaired_for_each(filename, [&](Alignment& aln) {
+            REQUIRE(aln.name() == "read" + to_string(seen) + "/" + to_string(seen % 2 + 1));
+            REQUIRE(aln.sequence() == string(50 + seen % 100, "ACGT"[seen % 4]));
+            REQUIRE(aln.quality() == string(50 + seen % 100, 'I' - 33));
+            seen++;
+        });
+        REQUIRE(count == read_count);
+        REQUIRE(seen == read_count);
+    }
+    
+    SECTION("Unpaired reads are all parsed when read in parallel") {
+        vector<bool> seen(read_count, false);
+        size_t count = fastq_unpaired_for_each_parallel(filename, [&](Alignment& aln) {
+            size_t i = stoull(aln.name().substr(4, aln.name().find('/') - 4));
+            bool good = aln.sequence().size() == 50 + i % 100 && aln.quality().size() == aln.sequence().size();
+#pragma omp critical
+            {
+                REQUIRE(good);
+                seen[i] = true;
+            }
+        });
+        REQUIRE(count == read_count);
+        REQUIRE(std::count(seen.begin(), seen.end(), true) == read_count);
+    }
+    
+    SECTION("Interleaved pairs keep their mates together") {
+        size_t pairs = 0;
+        size_t count = fastq_paired_interleaved_for_each_parallel(filename, [&](Alignment& mate1, Alignment& mate2) {
+            // Reads 2i and 2i + 1 make up each pair
+            size_t i = stoull(mate1.name().substr(4, mate1.name().find('/') - 4));
+            bool good = i % 2 == 0 && mate2.name() == "read" + to_string(i + 1) + "/2";
+#pragma omp critical
+            {
+                REQUIRE(good);
+                pairs++;
+            }
+        });
+        REQUIRE(count == read_count / 2);
+        REQUIRE(pairs == read_count / 2);
+    }
+    
+    unlink(filename.c_str());
+}
+
+TEST_CASE("Signature hashes agree with the string signatures", "[alignment]") {
+    
+    vector<string> alignment_strings{
+        R"({"sequence": "ACGT", "path": {"mapping": [{"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 4, "to_length": 4}]}]}})",
+        R"({"sequence": "ACGT", "path": {"mapping": [{"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 3, "to_length": 3, "sequence": "ACG"}, {"from_length": 1, "to_length": 1}]}]}})",
+        R"({"sequence": "ACGT", "path": {"mapping": [{"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 3, "to_length": 4}]}]}})",
+        R"({"sequence": "ACGT", "path": {"mapping": [{"position": {"node_id": 1, "offset": 2, "is_reverse": true}, "edit": [{"from_length": 4, "to_length": 4}]}]}})",
+        R"({"sequence": "ACGT", "path": {"mapping": [{"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 2, "to_length": 2}]},
+                                                   {"position": {"node_id": 2}, "edit": [{"from_length": 2, "to_length": 2}]}]}})",
+        R"({"sequence": "ACGT"})",
+        R"({"sequence": "GGGG"})"
+    };
+    
+    vector<Alignment> alns(alignment_strings.size());
+    for (size_t i = 0; i < alns.size(); i++) {
+        json2pb(alns[i], alignment_strings[i].c_str(), alignment_strings[i].size());
+    }
+    
+    for (size_t i = 0; i < alns.size(); i++) {
+        for (size_t j = 0; j < alns.size(); j++) {
+            REQUIRE((signature(alns[i]) == signature(alns[j])) == (signature_hash(alns[i]) == signature_hash(alns[j])));
+            REQUIRE((signature(alns[i], alns[j]) == signature(alns[j], alns[i]))
+                    == (signature_hash(alns[i], alns[j]) == signature_hash(alns[j], alns[i])));
+        }
+    }
+}
+
 }
 }
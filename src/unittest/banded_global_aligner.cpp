@@ -3438,6 +3438,48 @@ namespace vg {
                 }
             }
         }
+        
+        TEST_CASE( "Banded global aligner scores long reads without overflowing",
+                  "[alignment][banded][mapping]" ) {
+            
+            // long enough that the scores don't fit in 16 bits
+            string seq;
+            for (size_t i = 0; i < 40000; i++) {
+                seq.push_back("ACGT"[(i * 7 + i / 5) % 4]);
+            }
+            
+            VG graph;
+            Node* n0 = graph.create_node(seq.substr(0, 20000));
+            Node* n1 = graph.create_node(seq.substr(20000));
+            graph.create_edge(n0, n1);
+            
+            SECTION( "Banded global aligner scores a long exact match" ) {
+                
+                Aligner aligner;
+                
+                Alignment aln;
+                aln.set_sequence(seq);
+                
+                aligner.align_global_banded(aln, graph.graph, 1, true);
+                
+                REQUIRE(aln.score() == aligner.score_exact_match(seq));
+                REQUIRE(aln.path().mapping_size() == 2);
+            }
+            
+            SECTION( "Banded global aligner scores a long exact match with base quality adjustments" ) {
+                
+                QualAdjAligner aligner;
+                
+                Alignment aln;
+                aln.set_sequence(seq);
+                aln.set_quality(string(seq.size(), 40));
+                
+                aligner.align_global_banded(aln, graph.graph, 1, true);
+                
+                REQUIRE(aln.score() == aligner.score_exact_match(aln.sequence(), aln.quality()));
+                REQUIRE(aln.path().mapping_size() == 2);
+            }
+        }
     }
 }
 
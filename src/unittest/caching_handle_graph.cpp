@@ -0,0 +1,91 @@
+//
+//  caching_handle_graph.cpp
+//
+// Tests for the caching read-only view of a HandleGraph
+//
+
+#include <algorithm>
+#include "../caching_handle_graph.hpp"
+#include "../algorithms/extract_containing_graph.hpp"
+#include "../vg.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("CachingHandleGraph gives the same answers as its source", "[cache][handle]") {
+
+            VG graph;
+
+            Node* n1 = graph.create_node("GCA");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("GGCT");
+            Node* n4 = graph.create_node("CTGA");
+
+            graph.create_edge(n1, n2);
+            graph.create_edge(n1, n3, false, true);
+            graph.create_edge(n2, n4);
+            graph.create_edge(n3, n4, true, false);
+            graph.create_edge(n4, n4, false, true);
+
+            // Windows two IDs wide, and too few of them to hold everything
+            CachingHandleGraph cached(&graph, 2, 1);
+
+            auto neighbors = [](const HandleGraph& g, const handle_t& handle, bool go_left) {
+                vector<pair<id_t, bool>> found;
+                g.follow_edges(handle, go_left, [&](const handle_t& other) {
+                    found.emplace_back(g.get_id(other), g.get_is_reverse(other));
+                });
+                sort(found.begin(), found.end());
+                return found;
+            };
+
+            SECTION("Sequences and edges match in both orientations, even after eviction") {
+                for (size_t pass = 0; pass < 2; pass++) {
+                    for (id_t node_id = 1; node_id <= 4; node_id++) {
+                        for (bool is_reverse : {false, true}) {
+                            handle_t handle = graph.get_handle(node_id, is_reverse);
+                            REQUIRE(cached.get_sequence(handle) == graph.get_sequence(handle));
+                            REQUIRE(cached.get_length(handle) == graph.get_length(handle));
+                            REQUIRE(neighbors(cached, handle, false) == neighbors(graph, handle, false));
+                            REQUIRE(neighbors(cached, handle, true) == neighbors(graph, handle, true));
+                        }
+                    }
+                }
+                REQUIRE(cached.hits() > 0);
+                REQUIRE(cached.misses() > 4);
+            }
+
+            SECTION("Repeated lookups in one window come from the cache") {
+                CachingHandleGraph roomy(&graph);
+                roomy.get_sequence(graph.get_handle(3, false));
+                roomy.get_sequence(graph.get_handle(3, true));
+                roomy.get_length(graph.get_handle(3, false));
+                REQUIRE(roomy.misses() == 1);
+                REQUIRE(roomy.hits() == 2);
+
+                roomy.set_source(&graph);
+                roomy.get_sequence(graph.get_handle(3, false));
+                REQUIRE(roomy.misses() == 1);
+            }
+
+            SECTION("Subgraph extraction through the cache matches extraction from the source") {
+                vector<pos_t> positions{make_pos_t(n2->id(), false, 0)};
+
+                Graph direct;
+                algorithms::extract_containing_graph(&graph, direct, positions, 6);
+                Graph through_cache;
+                algorithms::extract_containing_graph(&cached, through_cache, positions, 6);
+
+                REQUIRE(through_cache.node_size() == direct.node_size());
+                REQUIRE(through_cache.edge_size() == direct.edge_size());
+                for (size_t i = 0; i < direct.node_size(); i++) {
+                    REQUIRE(through_cache.node(i).id() == direct.node(i).id());
+                    REQUIRE(through_cache.node(i).sequence() == direct.node(i).sequence());
+                }
+            }
+        }
+    }
+}
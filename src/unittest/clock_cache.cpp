@@ -0,0 +1,91 @@
+//
+//  clock_cache.cpp
+//
+// Tests for the fixed-size CLOCK cache
+//
+
+#include <string>
+#include "../clock_cache.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+        
+        TEST_CASE("ClockCache returns what was put into it", "[cache]") {
+            
+            ClockCache<int64_t, string> cache(16);
+            
+            REQUIRE(cache.capacity() == 16);
+            REQUIRE(!cache.retrieve(5).second);
+            
+            cache.put(5, "GATTACA");
+            auto found = cache.retrieve(5);
+            REQUIRE(found.second);
+            REQUIRE(found.first == "GATTACA");
+            
+            SECTION("Putting an existing key replaces its value") {
+                cache.put(5, "CAT");
+                REQUIRE(cache.retrieve(5).first == "CAT");
+            }
+            
+            SECTION("Clearing empties the cache") {
+                cache.clear();
+                REQUIRE(cache.find(5) == nullptr);
+            }
+        }
+        
+        TEST_CASE("ClockCache stays within its capacity and counts hits", "[cache]") {
+            
+            ClockCache<int64_t, int64_t> cache(32);
+            
+            for (int64_t i = 0; i < 1000; i++) {
+                const int64_t& stored = cache.put(i, i * 2);
+                REQUIRE(stored == i * 2);
+                // The most recent entry must always be available
+                REQUIRE(cache.retrieve(i).first == i * 2);
+            }
+            
+            size_t present = 0;
+            for (int64_t i = 0; i < 1000; i++) {
+                auto found = cache.retrieve(i);
+                if (found.second) {
+                    // Anything still cached must be correct
+                    REQUIRE(found.first == i * 2);
+                    present++;
+                }
+            }
+            REQUIRE(present <= cache.capacity());
+            REQUIRE(cache.hits() == 1000 + present);
+            REQUIRE(cache.misses() == 1000 - present);
+            
+            cache.reset_counters();
+            REQUIRE(cache.hits() == 0);
+            REQUIRE(cache.hit_rate() == 0.0);
+        }
+        
+        TEST_CASE("ClockCache keeps recently used entries over unused ones", "[cache]") {
+            
+            // Everything hashes to one probe window in a cache this small
+            ClockCache<int64_t, int64_t> cache(8);
+            for (int64_t i = 0; i < 8; i++) {
+                cache.put(i, i);
+            }
+            // Clear all the reference bits with one eviction, then touch one entry
+            cache.put(100, 100);
+            int64_t survivor = -1;
+            for (int64_t i = 0; i < 8; i++) {
+                if (cache.find(i) != nullptr) {
+                    survivor = i;
+                    break;
+                }
+            }
+            REQUIRE(survivor != -1);
+            
+            // The next eviction should not take the entry we just used
+            cache.put(101, 101);
+            REQUIRE(cache.find(survivor) != nullptr);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+//
+//  columnar_gam.cpp
+//
+// Tests for the columnar GAM container
+//
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../columnar_gam.hpp"
+#include "../stream.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        // Make some alignments that use every column, and some odd corners
+        static vector<Alignment> make_alignments() {
+            vector<Alignment> alns;
+            for (size_t i = 0; i < 7; i++) {
+                Alignment aln;
+                aln.set_name("read" + to_string(i));
+                aln.set_sequence(i == 3 ? "GATNNACAgt" : "GATTACA");
+                if (i % 2 == 0) {
+                    aln.set_quality(string(aln.sequence().size(), (char) (20 + i)));
+                }
+                aln.set_score(10 - (int) i * 4);
+                aln.set_mapping_quality(i * 10);
+                aln.set_identity(i / 7.0);
+                aln.set_is_secondary(i == 5);
+                for (int64_t node_id : {100 + (int64_t) i, 99 + (int64_t) i * 2}) {
+                    Mapping* mapping = aln.mutable_path()->add_mapping();
+                    mapping->mutable_position()->set_node_id(node_id);
+                    mapping->mutable_position()->set_offset(i % 3);
+                    mapping->mutable_position()->set_is_reverse(i == 4);
+                    mapping->set_rank(aln.path().mapping_size());
+                    Edit* edit = mapping->add_edit();
+                    edit->set_from_length(3);
+                    edit->set_to_length(i == 2 ? 4 : 3);
+                    if (i == 2) {
+                        edit->set_sequence("ACGT");
+                    }
+                }
+                if (i == 6) {
+                    // a path we can't model ourselves
+                    aln.mutable_path()->set_name("named");
+                    aln.mutable_path()->mutable_mapping(0)->mutable_position()->set_name("ref");
+                }
+                if (i == 1) {
+                    aln.set_read_group("group");
+                    aln.mutable_fragment_next()->set_name("mate");
+                }
+                alns.push_back(aln);
+            }
+            return alns;
+        }
+
+        TEST_CASE("Columnar GAM stores alignments exactly", "[columnar_gam]") {
+
+            vector<Alignment> alns = make_alignments();
+            stringstream out;
+            {
+                // Blocks of 3 put the last alignment in a block by itself
+                ColumnarGAMWriter writer(out, 3);
+                for (auto& aln : alns) {
+                    writer.write(aln);
+                }
+            }
+
+            SECTION("Every alignment reads back the same, in order") {
+                stringstream in(out.str());
+                REQUIRE(is_columnar_gam(in));
+                size_t i = 0;
+                for_each_columnar(in, ALL_COLUMNS, [&](Alignment& aln) {
+                    REQUIRE(i < alns.size());
+                    REQUIRE(aln.SerializeAsString() == alns[i].SerializeAsString());
+                    i++;
+                });
+                REQUIRE(i == alns.size());
+            }
+
+            SECTION("Concatenated files read as one") {
+                stringstream in(out.str() + out.str());
+                size_t count = 0;
+                for_each_columnar(in, ALL_COLUMNS, [&](Alignment& aln) {
+                    REQUIRE(aln.name() == alns[count % alns.size()].name());
+                    count++;
+                });
+                REQUIRE(count == 2 * alns.size());
+            }
+
+            SECTION("Reading only the path column leaves everything else out") {
+                stringstream in(out.str());
+                size_t i = 0;
+                for_each_columnar(in, columns_for_fields({Alignment::kPathFieldNumber}), [&](Alignment& aln) {
+                    REQUIRE(aln.name().empty());
+                    REQUIRE(aln.sequence().empty());
+                    REQUIRE(aln.score() == 0);
+                    REQUIRE(aln.read_group().empty());
+                    REQUIRE(aln.path().SerializeAsString() == alns[i].path().SerializeAsString());
+                    i++;
+                });
+                REQUIRE(i == alns.size());
+            }
+
+            SECTION("Columns can be decoded into a block's alignments one after another") {
+                stringstream in(out.str());
+                ColumnarGAMBlock block;
+                REQUIRE(block.read(in, ALL_COLUMNS));
+                REQUIRE(block.size() == 3);
+                vector<Alignment> decoded;
+                block.decode(COLUMN_SCORE, decoded);
+                REQUIRE(decoded.size() == 3);
+                REQUIRE(decoded[1].score() == alns[1].score());
+                REQUIRE(decoded[1].name().empty());
+                block.decode(ALL_COLUMNS & ~COLUMN_SCORE, decoded);
+                for (size_t i = 0; i < decoded.size(); i++) {
+                    REQUIRE(decoded[i].SerializeAsString() == alns[i].SerializeAsString());
+                }
+            }
+
+            SECTION("GAM converts to columnar GAM and back") {
+                // writing empties the buffer it is given
+                vector<Alignment> buffer = alns;
+                stringstream gam;
+                stream::write_buffered(gam, buffer, 0);
+                stringstream columnar;
+                gam_to_columnar(gam, columnar);
+                stringstream in(columnar.str());
+                stringstream back;
+                columnar_to_gam(in, back);
+                vector<Alignment> round_trip;
+                function<void(Alignment&)> collect = [&](Alignment& aln) {
+                    round_trip.push_back(aln);
+                };
+                stream::for_each(back, collect);
+                REQUIRE(round_trip.size() == alns.size());
+                for (size_t i = 0; i < alns.size(); i++) {
+                    REQUIRE(round_trip[i].SerializeAsString() == alns[i].SerializeAsString());
+                }
+            }
+
+            SECTION("GAM isn't mistaken for columnar GAM") {
+                vector<Alignment> buffer = alns;
+                stringstream gam;
+                stream::write_buffered(gam, buffer, 0);
+                REQUIRE(!is_columnar_gam(gam));
+            }
+        }
+
+    }
+}
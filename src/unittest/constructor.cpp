@@ -228,9 +228,11 @@ ConstructedChunk construct_test_chunk(string ref_sequence, string ref_name, stri
 }
 
 /**
- * Testing wrapper to build a whole graph from a VCF string. Adds alt paths by default.
+ * Testing wrapper to build a whole graph from a VCF string. Adds alt paths by
+ * default. Can also set the chunk size and how many chunks are built at once.
  */
-Graph construct_test_graph(string fasta_data, string vcf_data) {
+Graph construct_test_graph(string fasta_data, string vcf_data, size_t bases_per_chunk = 1024 * 1024,
+    size_t chunks_in_flight = 1) {
     
     // Merge all the graphs we get into this graph
     Graph built;
@@ -272,6 +274,8 @@ Graph construct_test_graph(string fasta_data, string vcf_data) {
     constructor.alt_paths = true;
     // Make sure we can test the node splitting behavior at reasonable sizes
     constructor.max_node_size = 50;
+    constructor.bases_per_chunk = bases_per_chunk;
+    constructor.chunks_in_flight = chunks_in_flight;
 
     // Construct the graph    
     constructor.construct_graph(fasta_pointers, vcf_pointers, ins_pointers, callback);
@@ -1264,5 +1268,39 @@ GATTACACATTAG
 
 }
 
+TEST_CASE( "Chunks built in parallel make the same graph as chunks built one at a time", "[constructor]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT
+ref1	2	.	A	T	29	PASS	.	GT
+ref1	9	.	C	G	29	PASS	.	GT
+ref1	17	.	TAG	T	29	PASS	.	GT
+ref1	23	.	C	A	29	PASS	.	GT
+ref2	5	.	A	T	29	PASS	.	GT
+ref2	11	.	TAG	T	29	PASS	.	GT
+)";
+
+    auto fasta_data = R"(>ref1
+GATTACACATTAGGATTACACATTAG
+>ref2
+GATTACACATTAG
+)";
+
+    // Use tiny chunks so each contig is cut into several
+    Graph serial = construct_test_graph(fasta_data, vcf_data, 4, 1);
+    Graph parallel = construct_test_graph(fasta_data, vcf_data, 4, 3);
+
+    REQUIRE(serial.node_size() > 0);
+    REQUIRE(pb2json(parallel) == pb2json(serial));
+
+}
+
 }
 }
@@ -0,0 +1,103 @@
+//
+//  dfs.cpp
+//
+// Tests for depth first search over handle graphs
+//
+
+#include <vector>
+#include <unordered_set>
+#include "../dfs.hpp"
+#include "../vg.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("handle_graph_dfs reports the search tree of a graph with a cycle", "[dfs]") {
+
+            string graph_json = R"({
+                "node": [{"id": 1, "sequence": "A"}, {"id": 2, "sequence": "C"},
+                         {"id": 3, "sequence": "G"}, {"id": 4, "sequence": "T"}],
+                "edge": [{"from": 1, "to": 2}, {"from": 2, "to": 3}, {"from": 3, "to": 1},
+                         {"from": 3, "to": 4}]
+            })";
+            Graph chunk;
+            json2pb(chunk, graph_json.c_str(), graph_json.size());
+            VG graph;
+            graph.extend(chunk);
+
+            handle_t start = graph.get_handle(1, false);
+            vector<handle_t> sources {start};
+            unordered_set<handle_t> no_sinks;
+
+            vector<id_t> discovered;
+            vector<id_t> finished;
+            size_t tree_edges = 0;
+            size_t back_edges = 0;
+            auto noop = [](const edge_t& edge) {};
+
+            SECTION("Nodes finish in the reverse of the order they are discovered along a path") {
+                DFSBuffer buffer;
+                handle_graph_dfs(graph, [&](const handle_t& handle) {
+                    discovered.push_back(graph.get_id(handle));
+                }, [&](const handle_t& handle) {
+                    finished.push_back(graph.get_id(handle));
+                }, []() {
+                    return false;
+                }, noop, [&](const edge_t& edge) {
+                    tree_edges++;
+                }, [&](const edge_t& edge) {
+                    back_edges++;
+                }, noop, sources, no_sinks, buffer);
+
+                REQUIRE(discovered == vector<id_t>({1, 2, 3, 4}));
+                REQUIRE(finished == vector<id_t>({4, 3, 2, 1}));
+                REQUIRE(tree_edges == 3);
+                REQUIRE(back_edges == 1);
+
+                SECTION("A reused buffer gives the same search") {
+                    vector<id_t> again;
+                    handle_graph_dfs(graph, [&](const handle_t& handle) {
+                        again.push_back(graph.get_id(handle));
+                    }, [](const handle_t& handle) {}, []() {
+                        return false;
+                    }, noop, noop, noop, noop, sources, no_sinks, buffer);
+                    REQUIRE(again == discovered);
+                }
+            }
+
+            SECTION("The search doesn't walk out of sinks") {
+                unordered_set<handle_t> sinks {graph.get_handle(3, false)};
+                handle_graph_dfs(graph, [&](const handle_t& handle) {
+                    discovered.push_back(graph.get_id(handle));
+                }, [](const handle_t& handle) {}, sources, sinks);
+                REQUIRE(discovered == vector<id_t>({1, 2, 3}));
+            }
+
+            SECTION("The break condition stops the whole search") {
+                DFSBuffer buffer;
+                bool stopped = handle_graph_dfs(graph, [&](const handle_t& handle) {
+                    discovered.push_back(graph.get_id(handle));
+                }, [](const handle_t& handle) {}, [&]() {
+                    return discovered.size() == 2;
+                }, noop, noop, noop, noop, vector<handle_t>(), no_sinks, buffer);
+                REQUIRE(stopped);
+                REQUIRE(discovered.size() == 2);
+            }
+
+            SECTION("Searching from every node visits both orientations of each") {
+                size_t visits = 0;
+                handle_graph_dfs(graph, [&](const handle_t& handle) {
+                    visits++;
+                }, [](const handle_t& handle) {}, []() {
+                    return false;
+                });
+                REQUIRE(visits == 8);
+            }
+        }
+
+    }
+}
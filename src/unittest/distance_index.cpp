@@ -0,0 +1,93 @@
+//
+//  distance_index.cpp
+//
+// Tests for the snarl tree distance index
+//
+
+#include <sstream>
+#include <limits>
+#include "../distance_index.hpp"
+#include "../genotypekit.hpp"
+#include "../vg.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("DistanceIndex finds minimum distances through nested snarls", "[distance][snarls]") {
+
+            // This graph will have a snarl from 1 to 8, a snarl from 2 to 7,
+            // and a snarl from 3 to 5, all nested in each other.
+            VG graph;
+
+            Node* n1 = graph.create_node("GCA");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("G");
+            Node* n4 = graph.create_node("CTGA");
+            Node* n5 = graph.create_node("GCA");
+            Node* n6 = graph.create_node("T");
+            Node* n7 = graph.create_node("G");
+            Node* n8 = graph.create_node("CTGA");
+
+            graph.create_edge(n1, n2);
+            graph.create_edge(n1, n8);
+            graph.create_edge(n2, n3);
+            graph.create_edge(n2, n6);
+            graph.create_edge(n3, n4);
+            graph.create_edge(n3, n5);
+            graph.create_edge(n4, n5);
+            graph.create_edge(n5, n7);
+            graph.create_edge(n6, n7);
+            graph.create_edge(n7, n8);
+
+            CactusSnarlFinder bubble_finder(graph);
+            SnarlManager snarl_manager = bubble_finder.find_snarls();
+
+            DistanceIndex index(&graph, &snarl_manager);
+            REQUIRE(index.snarl_count() == 3);
+
+            SECTION("Distances along a node are just offset differences") {
+                REQUIRE(index.min_distance(make_pos_t(4, false, 1), make_pos_t(4, false, 3)) == 2);
+                REQUIRE(index.min_distance(make_pos_t(4, false, 1), make_pos_t(4, false, 1)) == 0);
+            }
+
+            SECTION("Distances take the shortest route across snarls") {
+                REQUIRE(index.min_distance(make_pos_t(1, false, 0), make_pos_t(8, false, 0)) == 3);
+                REQUIRE(index.min_distance(make_pos_t(1, false, 0), make_pos_t(7, false, 0)) == 5);
+                REQUIRE(index.min_distance(make_pos_t(2, false, 0), make_pos_t(5, false, 2)) == 4);
+                REQUIRE(index.min_distance(make_pos_t(4, false, 0), make_pos_t(8, false, 1)) == 9);
+            }
+
+            SECTION("Unreachable and too distant positions have no distance") {
+                REQUIRE(index.min_distance(make_pos_t(5, false, 0), make_pos_t(3, false, 0)) == numeric_limits<int64_t>::max());
+                REQUIRE(index.min_distance(make_pos_t(4, false, 0), make_pos_t(8, false, 1), 8) == numeric_limits<int64_t>::max());
+            }
+
+            SECTION("Memoized queries respect the maximum") {
+                DistanceIndex::memo_t memo;
+                REQUIRE(index.min_distance(make_pos_t(4, false, 0), make_pos_t(8, false, 1), 8, &memo) == numeric_limits<int64_t>::max());
+                REQUIRE(index.min_distance(make_pos_t(4, false, 0), make_pos_t(8, false, 1), 20, &memo) == 9);
+                REQUIRE(index.min_distance(make_pos_t(4, false, 0), make_pos_t(8, false, 1), 8, &memo) == numeric_limits<int64_t>::max());
+                REQUIRE(memo.size() == 1);
+            }
+
+            SECTION("The index survives a save and load") {
+                stringstream saved;
+                index.save(saved);
+
+                DistanceIndex loaded(&graph, saved);
+                REQUIRE(loaded.snarl_count() == index.snarl_count());
+                REQUIRE(loaded.min_distance(make_pos_t(1, false, 0), make_pos_t(7, false, 0)) == 5);
+                REQUIRE(loaded.min_distance(make_pos_t(4, false, 0), make_pos_t(8, false, 1)) == 9);
+            }
+        }
+
+        TEST_CASE("DistanceIndex refuses streams that are not distance indexes", "[distance][snarls]") {
+            VG graph;
+            stringstream garbage("not an index");
+            REQUIRE_THROWS(DistanceIndex(&graph, garbage));
+        }
+    }
+}
@@ -16,6 +16,17 @@ TEST_CASE( "Factorials are computed", "[distributions][factorial]" ) {
     REQUIRE(factorial_ln(10) == Approx(log(3628800)).epsilon(1E-10));
 }
 
+TEST_CASE( "Factorials past the table agree with the table", "[distributions][factorial]" ) {
+    // Each factorial is the one before times n, on either side of the table's end
+    for (int n = FACTORIAL_LN_TABLE_SIZE - 2; n < FACTORIAL_LN_TABLE_SIZE + 2; n++) {
+        REQUIRE(factorial_ln(n) == Approx(factorial_ln(n - 1) + log(n)).epsilon(1E-12));
+    }
+    REQUIRE(factorial_ln(100000) == Approx(1051299.221899121).epsilon(1E-12));
+    REQUIRE(gamma_ln(11.0) == Approx(log(3628800)).epsilon(1E-10));
+    REQUIRE(gamma_ln(0.5) == Approx(log(sqrt(M_PI))).epsilon(1E-8));
+    REQUIRE(choose_ln(2000, 1000) == Approx(factorial_ln(2000) - 2 * factorial_ln(1000)).epsilon(1E-12));
+}
+
 TEST_CASE( "Ambiguous multinomial works", "[distributions][multinomial]" ) {
 
     SECTION("An empty case can be handled") {
@@ -126,6 +137,29 @@ TEST_CASE( "Ambiguous multinomial works", "[distributions][multinomial]" ) {
         REQUIRE(multinomial_censored_sampling_prob_ln(probs, obs) == Approx(logprob_sum(case_logprobs)).epsilon(1E-10));
     }
     
+    SECTION("Classes can be packed into bitmasks") {
+        
+        vector<double> probs{0.5, 0.20, 0.25, 0.05};
+        
+        unordered_map<vector<bool>, int> obs{
+            {{true, true, false, false}, 2},
+            {{false, true, true, false}, 1},
+            {{false, true, true, true}, 3}
+        };
+        unordered_map<uint64_t, int> packed_obs{
+            {0x3, 2},
+            {0x6, 1},
+            {0xE, 3}
+        };
+        
+        REQUIRE(multinomial_censored_sampling_prob_ln(probs, packed_obs) ==
+                Approx(multinomial_censored_sampling_prob_ln(probs, obs)).epsilon(1E-12));
+        
+        // Reads that match nothing are still impossible
+        packed_obs[0] = 1;
+        REQUIRE(logprob_to_prob(multinomial_censored_sampling_prob_ln(probs, packed_obs)) == 0.0);
+    }
+    
     SECTION("A class with a lot of reads can be handled") {
         vector<double> probs{0.5, 0.20, 0.25, 0.05};
         
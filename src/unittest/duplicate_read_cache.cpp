@@ -0,0 +1,83 @@
+//
+//  duplicate_read_cache.cpp
+//
+// Tests for the cache of mapping results for duplicate reads
+//
+
+#include <string>
+#include <vector>
+#include "../duplicate_read_cache.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("DuplicateReadCache keys reads by sequence and bucketed quality", "[cache]") {
+
+            Alignment read;
+            read.set_sequence("GATTACA");
+            read.set_quality(string{30, 31, 32, 33, 34, 35, 36});
+
+            Alignment near_duplicate = read;
+            near_duplicate.set_name("another");
+            near_duplicate.set_quality(string{29, 29, 33, 33, 34, 34, 37});
+
+            Alignment different = read;
+            different.set_sequence("GATTACT");
+
+            typedef DuplicateReadCache<vector<Alignment>> cache_t;
+
+            SECTION("Without qualities, only the sequence and settings matter") {
+                REQUIRE(cache_t::read_key(read, false, 4, "x") == cache_t::read_key(near_duplicate, false, 4, "x"));
+                REQUIRE(cache_t::read_key(read, false, 4, "x") != cache_t::read_key(different, false, 4, "x"));
+                REQUIRE(cache_t::read_key(read, false, 4, "x") != cache_t::read_key(read, false, 4, "y"));
+            }
+
+            SECTION("With qualities, reads in the same quality buckets share a key") {
+                REQUIRE(cache_t::read_key(read, true, 4, "") == cache_t::read_key(near_duplicate, true, 4, ""));
+                REQUIRE(cache_t::read_key(read, true, 1, "") != cache_t::read_key(near_duplicate, true, 1, ""));
+                near_duplicate.set_quality(string{30, 31, 32, 33, 34, 35, 40});
+                REQUIRE(cache_t::read_key(read, true, 4, "") != cache_t::read_key(near_duplicate, true, 4, ""));
+            }
+        }
+
+        TEST_CASE("DuplicateReadCache returns what was put into it", "[cache]") {
+
+            DuplicateReadCache<vector<Alignment>> cache(1000, 8);
+
+            vector<Alignment> mapped(2);
+            mapped[0].set_sequence("GATTACA");
+            mapped[0].set_score(7);
+            mapped[1].set_sequence("GATTACA");
+            mapped[1].set_score(3);
+            mapped[1].set_is_secondary(true);
+
+            vector<Alignment> found;
+            REQUIRE(!cache.retrieve("GATTACA", found));
+
+            cache.put("GATTACA", mapped);
+            REQUIRE(cache.retrieve("GATTACA", found));
+            REQUIRE(found.size() == 2);
+            REQUIRE(found[0].score() == 7);
+            REQUIRE(found[1].score() == 3);
+            REQUIRE(found[1].is_secondary());
+
+            // a lot of other reads spread over all the shards don't lose the results
+            // for the ones still within capacity
+            for (size_t i = 0; i < 200; i++) {
+                cache.put(to_string(i), mapped);
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < 200; i++) {
+                kept += cache.retrieve(to_string(i), found);
+            }
+            REQUIRE(kept > 150);
+
+            REQUIRE(cache.hits() == kept + 1);
+            REQUIRE(cache.misses() == 1 + 200 - kept);
+        }
+    }
+}
@@ -263,6 +263,64 @@ TEST_CASE("Complete deletions remove the feature", "[featureset][simplify]") {
 
 }
 
+TEST_CASE("Edits only move the features they reach", "[featureset][simplify]") {
+
+    // Make a BED stream with features before, around, and after the edits
+    stringstream in("seq1\t5\t10\tbefore\n"
+                    "seq1\t20\t30\taround\n"
+                    "seq1\t24\t26\tinside\n"
+                    "seq1\t40\t50\tafter\n"
+                    "seq2\t40\t50\tother\n");
+    stringstream out;
+    
+    FeatureSet features;
+    features.load_bed(in);
+    
+    // Delete the middle of the around feature, including all of the inside one
+    features.on_path_edit("seq1", 23, 5, 0);
+    // And insert a bit after everything
+    features.on_path_edit("seq1", 60, 0, 3);
+    // And before everything
+    features.on_path_edit("seq1", 1, 0, 2);
+    
+    features.save_bed(out);
+    
+    REQUIRE(out.str() == "seq1\t7\t12\tbefore\n"
+                         "seq1\t22\t27\taround\n"
+                         "seq1\t37\t47\tafter\n"
+                         "seq2\t40\t50\tother\n");
+
+}
+
+TEST_CASE("FeatureSet can find the features overlapping a range after edits", "[featureset][simplify]") {
+
+    stringstream in("seq1\t5\t10\tone\n"
+                    "seq1\t8\t30\ttwo\n"
+                    "seq1\t40\t50\tthree\n");
+    
+    FeatureSet features;
+    features.load_bed(in);
+    
+    // Push the third feature right
+    features.on_path_edit("seq1", 35, 0, 10);
+    
+    auto found = features.get_features("seq1", 12, 49);
+    REQUIRE(found.size() == 1);
+    REQUIRE(found[0].feature_name == "two");
+    
+    found = features.get_features("seq1", 10, 50);
+    REQUIRE(found.size() == 3);
+    REQUIRE(found[0].feature_name == "one");
+    REQUIRE(found[1].feature_name == "two");
+    REQUIRE(found[2].feature_name == "three");
+    REQUIRE(found[2].first == 50);
+    REQUIRE(found[2].last == 60);
+    
+    REQUIRE(features.get_features("seq1", 61, 100).empty());
+    REQUIRE(features.get_features("seq2", 0, 100).empty());
+
+}
+
 }
 }
 
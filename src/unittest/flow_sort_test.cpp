@@ -3,6 +3,8 @@
 #include "xg.hpp"
 #include "vg.pb.h"
 #include "flow_sort.hpp"
+#include "utility.hpp"
+#include <fstream>
 
 namespace vg {
 namespace unittest {
@@ -289,6 +291,105 @@ P	21	path12	3	+	1M)";
         }
         REQUIRE(res.str().compare("1 5 6 12 7 9 11 8 10 4 19 13 16 18 14 17 15 2 22 28 23 25 27 24 26 20 35 29 32 34 30 33 31 21 3") == 0);
     }
+    
+    SECTION("Sort each component along its own reference") {
+        const string graph_gfa = R"(H	VN:Z:0.1
+S	1	G
+L	1	+	2	+	0M
+L	1	+	4	+	0M
+S	2	T
+L	2	+	3	+	0M
+S	3	G
+S	4	C
+L	4	+	5	+	0M
+S	5	C
+L	5	+	2	+	0M
+L	5	+	6	+	0M
+S	6	T
+L	6	+	3	+	0M
+S	7	G
+L	7	+	8	+	0M
+L	7	+	10	+	0M
+S	8	T
+L	8	+	9	+	0M
+S	9	G
+S	10	C
+L	10	+	11	+	0M
+S	11	C
+L	11	+	8	+	0M
+L	11	+	12	+	0M
+S	12	T
+L	12	+	9	+	0M
+S	13	A
+P	1	ref	1	+	1M
+P	2	ref	2	+	1M
+P	3	ref	3	+	1M
+P	1	path1	1	+	1M
+P	4	path1	2	+	1M
+P	5	path1	3	+	1M
+P	2	path1	4	+	1M
+P	1	path2	1	+	1M
+P	4	path2	2	+	1M
+P	5	path2	3	+	1M
+P	6	path2	4	+	1M
+P	3	path2	5	+	1M
+P	7	ref2	1	+	1M
+P	8	ref2	2	+	1M
+P	9	ref2	3	+	1M
+P	7	path3	1	+	1M
+P	10	path3	2	+	1M
+P	11	path3	3	+	1M
+P	8	path3	4	+	1M
+P	7	path4	1	+	1M
+P	10	path4	2	+	1M
+P	11	path4	3	+	1M
+P	12	path4	4	+	1M
+P	9	path4	5	+	1M)";
+        
+        VG vg;
+        stringstream in(graph_gfa);
+        vg.from_gfa(in);
+        REQUIRE(vg.length() == 13);
+        
+        FlowSort flow_sort(vg);
+        flow_sort.sort_by_component({"ref", "ref2"});
+        
+        // Each copy sorts the way it does on its own, and the node no
+        // reference visits stays where it was
+        stringstream res;
+        for (int i =0; i < vg.graph.node_size(); ++i ) {
+            if (i > 0)
+               res << " ";
+            res << vg.graph.mutable_node(i)->id();
+        }
+        REQUIRE(res.str().compare("1 4 5 2 6 3 7 10 11 8 12 9 13") == 0);
+        REQUIRE(vg.graph.edge_size() == 18);
+        
+        SECTION("sorting out of core with one component per bin gives the same order, renumbered") {
+            VG original;
+            stringstream original_in(graph_gfa);
+            original.from_gfa(original_in);
+            string file_name = tmpfilename();
+            {
+                ofstream file_out(file_name);
+                original.serialize_to_ostream(file_out);
+            }
+            
+            stringstream sorted_out;
+            FlowSort::sort_out_of_core(file_name, sorted_out, {"ref", "ref2"}, false, true, 1);
+            remove(file_name.c_str());
+            
+            VG sorted(sorted_out);
+            REQUIRE(sorted.graph.node_size() == vg.graph.node_size());
+            for (int i = 0; i < sorted.graph.node_size(); i++) {
+                REQUIRE(sorted.graph.node(i).id() == i + 1);
+                REQUIRE(sorted.graph.node(i).sequence() == vg.graph.node(i).sequence());
+            }
+            REQUIRE(sorted.graph.edge_size() == 18);
+            REQUIRE(sorted.paths.get_path("ref").size() == 3);
+            REQUIRE(sorted.paths.get_path("path4").size() == 5);
+        }
+    }
 }
 }
 }
\ No newline at end of file
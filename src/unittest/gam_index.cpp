@@ -0,0 +1,126 @@
+//
+//  gam_index.cpp
+//
+// Tests for the node-range index of sorted GAM files
+//
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include "../gam_index.hpp"
+#include "../stream.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        // Make a read that visits the given nodes
+        static Alignment make_read(const string& name, const vector<id_t>& nodes) {
+            Alignment aln;
+            aln.set_name(name);
+            for (auto& node_id : nodes) {
+                aln.mutable_path()->add_mapping()->mutable_position()->set_node_id(node_id);
+            }
+            return aln;
+        }
+
+        // Write the reads in blocks of the given size
+        static string write_blocked(vector<Alignment>& reads, size_t block_size) {
+            stringstream out;
+            stream::set_output_blocked(true);
+            for (size_t i = 0; i < reads.size(); i += block_size) {
+                size_t count = min(block_size, reads.size() - i);
+                function<Alignment&(uint64_t)> lambda = [&](uint64_t n) -> Alignment& {
+                    return reads[i + n];
+                };
+                stream::write(out, count, lambda);
+            }
+            stream::set_output_blocked(false);
+            return out.str();
+        }
+
+        TEST_CASE("GAMIndex finds the reads touching a node range", "[gam][index]") {
+
+            // Sorted reads, two nodes each, plus an unmapped read at the end
+            vector<Alignment> reads;
+            for (id_t i = 1; i <= 100; i++) {
+                reads.push_back(make_read("read" + to_string(i), {i, i + 1}));
+            }
+            reads.push_back(make_read("unmapped", {}));
+
+            stringstream gam(write_blocked(reads, 10));
+
+            GAMIndex index;
+            index.index(gam);
+            REQUIRE(index.block_count() == 10);
+
+            SECTION("Range queries return exactly the reads touching the range") {
+                set<string> found;
+                index.for_alignment_in_range(gam, 25, 30, [&](const Alignment& aln) {
+                    found.insert(aln.name());
+                });
+
+                set<string> expected;
+                for (id_t i = 24; i <= 30; i++) {
+                    expected.insert("read" + to_string(i));
+                }
+                REQUIRE(found == expected);
+            }
+
+            SECTION("Only overlapping blocks are visited") {
+                REQUIRE(index.find(25, 30).size() == 1);
+                REQUIRE(index.find(10, 11).size() == 2);
+                REQUIRE(index.find(500, 600).empty());
+            }
+
+            SECTION("The index survives a save and load") {
+                stringstream saved;
+                index.save(saved);
+
+                GAMIndex loaded;
+                loaded.load(saved);
+                REQUIRE(loaded.block_count() == index.block_count());
+                REQUIRE(loaded.find(25, 30) == index.find(25, 30));
+            }
+        }
+
+        TEST_CASE("GAMIndex stays correct on unsorted GAMs", "[gam][index]") {
+
+            vector<Alignment> reads;
+            reads.push_back(make_read("far", {1000}));
+            reads.push_back(make_read("near", {5}));
+            reads.push_back(make_read("middle", {50}));
+            reads.push_back(make_read("spanning", {2, 2000}));
+
+            stringstream gam(write_blocked(reads, 1));
+
+            GAMIndex index;
+            index.index(gam);
+
+            vector<string> found;
+            index.for_alignment_in_range(gam, 2, 5, [&](const Alignment& aln) {
+                found.push_back(aln.name());
+            });
+            REQUIRE(found.size() == 2);
+            REQUIRE(found[0] == "near");
+            REQUIRE(found[1] == "spanning");
+        }
+
+        TEST_CASE("GAMIndex refuses GAMs that are not blocked", "[gam][index]") {
+
+            vector<Alignment> reads {make_read("read", {1})};
+            stringstream out;
+            function<Alignment&(uint64_t)> lambda = [&](uint64_t n) -> Alignment& {
+                return reads[n];
+            };
+            stream::write(out, reads.size(), lambda);
+
+            stringstream gam(out.str());
+            GAMIndex index;
+            REQUIRE_THROWS(index.index(gam));
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//
+//  gamsorter.cpp
+//
+// Tests for the external-memory GAM sort
+//
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../gamsorter.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("GAMSorter sorts GAMs bigger than its buffers", "[gamsort]") {
+
+            // Make some reads in a scrambled order, with some unmapped
+            vector<Alignment> reads(500);
+            for (size_t i = 0; i < reads.size(); i++) {
+                reads[i].set_name("read" + to_string(i));
+                if (i % 7 != 0) {
+                    auto* position = reads[i].mutable_path()->add_mapping()->mutable_position();
+                    position->set_node_id((i * 37) % 101 + 1);
+                    position->set_offset(i % 3);
+                }
+            }
+
+            stringstream unsorted;
+            function<Alignment&(uint64_t)> lambda = [&](uint64_t n) -> Alignment& {
+                return reads[n];
+            };
+            stream::write(unsorted, reads.size(), lambda);
+
+            // Force lots of runs and more than one merge pass
+            GAMSorter sorter;
+            sorter.max_buf_size = 20;
+            sorter.max_fan_in = 3;
+            sorter.output_chunk_size = 50;
+
+            stringstream sorted;
+            sorter.stream_sort(unsorted, sorted);
+
+            size_t count = 0;
+            bool in_order = true;
+            bool unmapped_last = true;
+            bool seen_unmapped = false;
+            GAMSorter::SortKey last_key {-1, -1};
+            stream::for_each<Alignment>(sorted, [&](Alignment& aln) {
+                auto key = GAMSorter::get_sort_key(aln);
+                in_order = in_order && !(key < last_key);
+                last_key = key;
+
+                if (aln.path().mapping_size() == 0) {
+                    seen_unmapped = true;
+                } else if (seen_unmapped) {
+                    unmapped_last = false;
+                }
+                count++;
+            });
+
+            REQUIRE(count == reads.size());
+            REQUIRE(in_order);
+            REQUIRE(unmapped_last);
+        }
+
+        TEST_CASE("GAMSorter sorts reads added from many threads", "[gamsort]") {
+
+            vector<Alignment> reads(500);
+            for (size_t i = 0; i < reads.size(); i++) {
+                reads[i].set_name("read" + to_string(i));
+                if (i % 7 != 0) {
+                    auto* position = reads[i].mutable_path()->add_mapping()->mutable_position();
+                    position->set_node_id((i * 37) % 101 + 1);
+                    position->set_offset(i % 3);
+                }
+            }
+
+            // Force lots of runs and more than one merge pass
+            GAMSorter sorter;
+            sorter.max_buf_size = 20;
+            sorter.max_fan_in = 3;
+            sorter.output_chunk_size = 50;
+
+            sorter.begin_incremental_sort();
+#pragma omp parallel for
+            for (size_t i = 0; i < reads.size(); i++) {
+                sorter.add_to_sort(reads[i]);
+            }
+            stringstream sorted;
+            sorter.finish_incremental_sort(sorted);
+
+            size_t count = 0;
+            bool in_order = true;
+            GAMSorter::SortKey last_key {-1, -1};
+            stream::for_each<Alignment>(sorted, [&](Alignment& aln) {
+                auto key = GAMSorter::get_sort_key(aln);
+                in_order = in_order && !(key < last_key);
+                last_key = key;
+                count++;
+            });
+
+            REQUIRE(count == reads.size());
+            REQUIRE(in_order);
+        }
+    }
+}
@@ -6,6 +6,7 @@
 #include "../genotypekit.hpp"
 #include "../snarls.hpp"
 #include "../traversal_finder.hpp"
+#include "../packer.hpp"
 
 namespace Catch {
 
@@ -301,6 +302,44 @@ TEST_CASE("fixed priors can be assigned to genotypes", "[genotype]") {
   delete calculator;
 }
 
+TEST_CASE("PackedSupport arithmetic agrees with Support arithmetic", "[genotype]") {
+    
+  Support a = make_support(3, 5, 20);
+  Support b = make_support(4, 1, 10);
+  PackedSupport packed_a(a);
+  PackedSupport packed_b(b);
+    
+  auto same = [](const Support& s1, const Support& s2) {
+    REQUIRE(s1.forward() == s2.forward());
+    REQUIRE(s1.reverse() == s2.reverse());
+    REQUIRE(s1.left() == s2.left());
+    REQUIRE(s1.right() == s2.right());
+    REQUIRE(s1.quality() == s2.quality());
+  };
+    
+  SECTION("converting to and from Support round trips") {
+    same(packed_a.to_support(), a);
+  }
+    
+  SECTION("sums agree") {
+    same((packed_a + packed_b).to_support(), a + b);
+    packed_a += packed_b;
+    same(packed_a.to_support(), a + b);
+  }
+    
+  SECTION("scaling agrees") {
+    same((packed_a * 0.5).to_support(), a * 0.5);
+    same((7.0 * packed_a).to_support(), 7.0 * a);
+    same((packed_a / 3.0).to_support(), a / 3.0);
+  }
+    
+  SECTION("min, max and total agree") {
+    same(support_min(packed_a, packed_b).to_support(), support_min(a, b));
+    same(support_max(packed_a, packed_b).to_support(), support_max(a, b));
+    REQUIRE(total(packed_a) == total(a));
+  }
+}
+
 TEST_CASE("TrivialTraversalFinder can find traversals", "[genotype]") {
   // Build a toy graph
   const string graph_json = R"(
@@ -424,6 +463,11 @@ TEST_CASE("ExhaustiveTraversalFinder finds all paths on a bubble with an inverte
     
   REQUIRE(found_trav_1);
   REQUIRE(found_trav_2);
+  
+  SECTION("The number of traversals can be limited") {
+    ExhaustiveTraversalFinder limited_finder(graph, manager, false, 1);
+    REQUIRE(limited_finder.find_traversals(*manager.top_level_snarls().front()).size() == 1);
+  }
 }
 
 TEST_CASE("SiteFinder can differntiate ultrabubbles from snarls", "[genotype]") {
@@ -551,6 +595,70 @@ TEST_CASE("SiteFinder can differntiate ultrabubbles from snarls", "[genotype]")
 
 }
 
+TEST_CASE("Supports can be taken from a pack without augmenting", "[genotype][pack]") {
+
+    // A deletion of node 2
+    const string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"A"},
+    {"id":3,"sequence":"CA"}],
+    "edge":[{"from":1,"to":2},{"from":2,"to":3},{"from":1,"to":3}]}
+    )";
+
+    Graph chunk;
+    json2pb(chunk, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(chunk);
+
+    // Make a read matching all of each of the given nodes
+    auto read_through = [&](const vector<id_t>& node_ids) {
+        Alignment aln;
+        for (id_t id : node_ids) {
+            Mapping* m = aln.mutable_path()->add_mapping();
+            m->mutable_position()->set_node_id(id);
+            Edit* e = m->add_edit();
+            e->set_from_length(xg_index.node_length(id));
+            e->set_to_length(xg_index.node_length(id));
+        }
+        return aln;
+    };
+
+    // Three reads take the reference and two the deletion
+    Packer packer(&xg_index, 0);
+    for (size_t i = 0; i < 3; i++) {
+        packer.add(read_through({1, 2, 3}));
+    }
+    for (size_t i = 0; i < 2; i++) {
+        packer.add(read_through({1, 3}));
+    }
+    packer.make_compact();
+
+    SupportAugmentedGraph augmented;
+    augmented.graph.merge(chunk);
+    augmented.load_pack_supports(packer);
+
+    auto edge_support = [&](id_t from, id_t to) {
+        return augmented.get_support(augmented.graph.get_edge(NodeSide(from, true), NodeSide(to, false)));
+    };
+
+    SECTION("Node supports are mean coverage split over the strands") {
+        Support support = augmented.get_support(augmented.graph.get_node(1));
+        REQUIRE(support.forward() == 2.5);
+        REQUIRE(support.reverse() == 2.5);
+        REQUIRE(support.quality() == 5);
+        REQUIRE(total(augmented.get_support(augmented.graph.get_node(2))) == 3);
+        REQUIRE(total(augmented.get_support(augmented.graph.get_node(3))) == 5);
+    }
+
+    SECTION("The edges through the deleted node take its coverage") {
+        REQUIRE(total(edge_support(1, 2)) == 3);
+        REQUIRE(total(edge_support(2, 3)) == 3);
+    }
+
+    SECTION("The deletion edge takes the coverage the other edges leave") {
+        REQUIRE(total(edge_support(1, 3)) == 2);
+    }
+}
+
 TEST_CASE("RepresentativeTraversalFinder finds traversals correctly", "[genotype][representativetraversalfinder]") {
 
   SECTION("Traversal-finding should work on a substitution inside a deletion") {
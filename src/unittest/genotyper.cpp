@@ -6,6 +6,8 @@
 #include "../genotyper.hpp"
 #include "../snarls.hpp"
 #include "../traversal_finder.hpp"
+#include "../gam_index.hpp"
+#include "../stream.hpp"
 
 namespace vg {
 namespace unittest {
@@ -140,7 +142,50 @@ TEST_CASE("traversals can be found from reads", "[genotyper]") {
         
     }
     
+    SECTION("Streaming genotyping does not depend on the window size") {
     
+        // Make some reads that take the alt allele of the second snarl
+        vector<Alignment> reads;
+        for (size_t i = 0; i < 6; i++) {
+            Alignment read = graph.align("GATTACA");
+            if (i % 2) {
+                // Put half of them on the reverse strand
+                read = reverse_complement_alignment(read, [&](id_t id) {
+                    return graph.get_node(id)->sequence().size();
+                });
+            }
+            read.set_name("read" + to_string(i));
+            reads.push_back(read);
+        }
+        
+        // Write them as a blocked GAM and index it
+        stringstream gam;
+        stream::set_output_blocked(true);
+        stream::write_buffered(gam, reads, 0);
+        stream::set_output_blocked(false);
+        GAMIndex gam_index;
+        gam_index.index(gam);
+        
+        vector<string> vcfs;
+        for (size_t window_bases : {1, 1000}) {
+            AugmentedGraph aug;
+            aug.graph = graph;
+            Genotyper streaming_genotyper;
+            streaming_genotyper.min_recurrence = 0;
+            
+            gam.clear();
+            stringstream vcf;
+            streaming_genotyper.run_streaming(aug, gam, gam_index, vcf, "hint", "", "", false, 0, 0, window_bases);
+            
+            // The reads don't stick around
+            REQUIRE(aug.get_alignments().empty());
+            
+            vcfs.push_back(vcf.str());
+        }
+        
+        REQUIRE(vcfs[0].substr(0, 16) == "##fileformat=VCF");
+        REQUIRE(vcfs[0] == vcfs[1]);
+    }
     
 }
 
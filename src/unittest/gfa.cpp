@@ -0,0 +1,85 @@
+//
+//  gfa.cpp
+//
+// Tests for streaming GFA conversion
+//
+
+#include <sstream>
+#include "../gfa.hpp"
+#include "../stream.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("GFA can be streamed to chunked graphs and back", "[gfa]") {
+
+            string gfa = "H\tVN:Z:1.0\n"
+                "S\t1\tGATT\n"
+                "S\t2\tACA\n"
+                "S\t3\tT\n"
+                "L\t1\t+\t2\t+\t0M\n"
+                "L\t2\t+\t3\t-\t0M\n"
+                "P\tx\t1+,2+,3-\t*\n";
+
+            SECTION("Small chunks split up the nodes, edges, and paths") {
+                istringstream gfa_in(gfa);
+                stringstream graph_stream;
+                REQUIRE(gfa_to_graph_stream(gfa_in, graph_stream, 2) == 0);
+
+                size_t chunks = 0;
+                size_t nodes = 0, edges = 0;
+                vector<Mapping> steps;
+                function<void(Graph&)> lambda = [&](Graph& graph) {
+                    chunks++;
+                    REQUIRE(graph.node_size() + graph.edge_size() + graph.path_size() > 0);
+                    nodes += graph.node_size();
+                    edges += graph.edge_size();
+                    for (size_t i = 0; i < graph.path_size(); i++) {
+                        REQUIRE(graph.path(i).name() == "x");
+                        for (size_t j = 0; j < graph.path(i).mapping_size(); j++) {
+                            steps.push_back(graph.path(i).mapping(j));
+                        }
+                    }
+                };
+                stream::for_each(graph_stream, lambda);
+
+                REQUIRE(chunks == 4);
+                REQUIRE(nodes == 3);
+                REQUIRE(edges == 2);
+                REQUIRE(steps.size() == 3);
+                for (size_t i = 0; i < steps.size(); i++) {
+                    REQUIRE(steps[i].rank() == i + 1);
+                }
+                REQUIRE(steps[2].position().node_id() == 3);
+                REQUIRE(steps[2].position().is_reverse());
+            }
+
+            SECTION("Converting back gives the same GFA") {
+                istringstream gfa_in(gfa);
+                stringstream graph_stream;
+                gfa_to_graph_stream(gfa_in, graph_stream, 2);
+                stringstream gfa_out;
+                graph_stream_to_gfa(graph_stream, gfa_out);
+                REQUIRE(gfa_out.str() == gfa);
+            }
+
+            SECTION("Overlapping links are counted") {
+                istringstream gfa_in("S\ta\tGATT\nS\tb\tTTACA\nL\ta\t+\tb\t+\t2M\n");
+                stringstream graph_stream;
+                REQUIRE(gfa_to_graph_stream(gfa_in, graph_stream) == 1);
+
+                function<void(Graph&)> lambda = [&](Graph& graph) {
+                    REQUIRE(graph.node_size() == 2);
+                    REQUIRE(graph.node(0).id() == 1);
+                    REQUIRE(graph.node(1).name() == "b");
+                    REQUIRE(graph.edge(0).to() == 2);
+                    REQUIRE(graph.edge(0).overlap() == 2);
+                };
+                stream::for_each(graph_stream, lambda);
+            }
+        }
+    }
+}
@@ -0,0 +1,51 @@
+//
+//  graph.cpp
+//
+// Tests for the utilities on protobuf Graphs
+//
+
+#include "catch.hpp"
+#include "../graph.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("Duplicate and orphaned elements are removed from a Graph", "[graph]") {
+
+            // Enough nodes that the sorts are split over the threads
+            size_t node_count = 300000;
+
+            Graph graph;
+            for (size_t i = 0; i < node_count; ++i) {
+                // add the nodes in reverse, each of the even ones twice
+                id_t id = node_count - i;
+                for (size_t j = 0; j < (id % 2 ? 1 : 2); ++j) {
+                    Node* node = graph.add_node();
+                    node->set_id(id);
+                    node->set_sequence("A");
+                }
+                // and an edge to the next node, which is missing for the last one
+                Edge* edge = graph.add_edge();
+                edge->set_from(id);
+                edge->set_to(id + 1);
+                if (id % 3 == 0) {
+                    *graph.add_edge() = *edge;
+                }
+            }
+
+            sort_by_id_dedup_and_clean(graph);
+
+            REQUIRE(graph.node_size() == node_count);
+            REQUIRE(graph.edge_size() == node_count - 1);
+            for (size_t i = 0; i < graph.node_size(); ++i) {
+                REQUIRE(graph.node(i).id() == i + 1);
+                REQUIRE(graph.node(i).sequence() == "A");
+            }
+            for (size_t i = 0; i < graph.edge_size(); ++i) {
+                REQUIRE(graph.edge(i).from() == i + 1);
+                REQUIRE(graph.edge(i).to() == i + 2);
+            }
+        }
+    }
+}
@@ -8,6 +8,7 @@
 #include "../handle.hpp"
 #include "../vg.hpp"
 #include "../xg.hpp"
+#include "../flat_graph.hpp"
 #include "../json2pb.h"
 
 #include <iostream>
@@ -219,7 +220,48 @@ TEST_CASE("VG and XG handle implementations are correct", "[handle][vg][xg]") {
             }
         }
     }
-    
+
+    SECTION("Inline edge iteration on the concrete graphs matches virtual edge iteration") {
+        for (Node* node : {n0, n1, n2, n3, n4, n5, n6, n7, n8, n9}) {
+            for (bool is_reverse : {false, true}) {
+                for (bool go_left : {false, true}) {
+
+                    vector<handle_t> virtual_vg, inline_vg, virtual_xg, inline_xg;
+
+                    handle_t vg_handle = vg.get_handle(node->id(), is_reverse);
+                    ((const HandleGraph&) vg).follow_edges(vg_handle, go_left, [&](const handle_t& next) {
+                        virtual_vg.push_back(next);
+                    });
+                    vg.follow_edges_inline(vg_handle, go_left, [&](const handle_t& next) {
+                        inline_vg.push_back(next);
+                        return true;
+                    });
+
+                    handle_t xg_handle = xg_index.get_handle(node->id(), is_reverse);
+                    ((const HandleGraph&) xg_index).follow_edges(xg_handle, go_left, [&](const handle_t& next) {
+                        virtual_xg.push_back(next);
+                    });
+                    xg_index.follow_edges_inline(xg_handle, go_left, [&](const handle_t& next) {
+                        inline_xg.push_back(next);
+                        return true;
+                    });
+
+                    REQUIRE(inline_vg == virtual_vg);
+                    REQUIRE(inline_xg == virtual_xg);
+
+                    // Stopping early works too
+                    size_t loop_count = 0;
+                    bool finished = xg_index.follow_edges_inline(xg_handle, go_left, [&](const handle_t& next) {
+                        loop_count++;
+                        return false;
+                    });
+                    REQUIRE(loop_count == min<size_t>(virtual_xg.size(), 1));
+                    REQUIRE(finished == virtual_xg.empty());
+                }
+            }
+        }
+    }
+
     SECTION("Converting handles to the forward strand works") {
         for (const HandleGraph* g : {(HandleGraph*) &vg, (HandleGraph*) &xg_index}) {
             // For each graph type
@@ -325,6 +367,10 @@ TEST_CASE("Mutable handle graphs work", "[handle][vg]") {
     VG vg;
     implementations.push_back(&vg);
     
+    // And the flat implementation
+    FlatGraph flat;
+    implementations.push_back(&flat);
+    
     for(auto* g : implementations) {
     
         SECTION("No nodes exist by default") {
@@ -516,5 +562,110 @@ TEST_CASE("Mutable handle graphs work", "[handle][vg]") {
     
 }
 
+TEST_CASE("FlatGraph round-trips a Protobuf graph", "[handle][flat]") {
+    
+    Graph graph;
+    for (id_t i = 1; i <= 4; i++) {
+        Node* node = graph.add_node();
+        node->set_id(i);
+        node->set_sequence(string(i, 'A') + "C");
+    }
+    // A forward edge, a reversing edge, and a self loop on a start
+    Edge* edge = graph.add_edge();
+    edge->set_from(1);
+    edge->set_to(2);
+    edge = graph.add_edge();
+    edge->set_from(2);
+    edge->set_to(3);
+    edge->set_to_end(true);
+    edge = graph.add_edge();
+    edge->set_from(4);
+    edge->set_from_start(true);
+    edge->set_to(4);
+    
+    FlatGraph flat(graph);
+    
+    REQUIRE(flat.node_size() == 4);
+    REQUIRE(flat.max_node_id() == 4);
+    REQUIRE(flat.get_sequence(flat.get_handle(3, true)) == "GTTT");
+    
+    vector<handle_t> found;
+    flat.follow_edges(flat.get_handle(3, false), false, [&](const handle_t& other) {
+        found.push_back(other);
+    });
+    REQUIRE(found.size() == 1);
+    REQUIRE(found.front() == flat.get_handle(2, true));
+    
+    found.clear();
+    flat.follow_edges(flat.get_handle(4, false), true, [&](const handle_t& other) {
+        found.push_back(other);
+    });
+    REQUIRE(found.size() == 1);
+    REQUIRE(found.front() == flat.get_handle(4, true));
+    
+    Graph round_trip;
+    flat.to_graph(round_trip);
+    
+    REQUIRE(round_trip.node_size() == 4);
+    REQUIRE(round_trip.edge_size() == 3);
+    for (size_t i = 0; i < round_trip.node_size(); i++) {
+        REQUIRE(round_trip.node(i).sequence() == graph.node(round_trip.node(i).id() - 1).sequence());
+    }
+    
+    vector<pair<handle_t, handle_t>> edges;
+    for (size_t i = 0; i < round_trip.edge_size(); i++) {
+        const Edge& e = round_trip.edge(i);
+        edges.push_back(flat.edge_handle(flat.get_handle(e.from(), e.from_start()),
+                                         flat.get_handle(e.to(), e.to_end())));
+    }
+    auto has_edge = [&](const handle_t& left, const handle_t& right) {
+        return find(edges.begin(), edges.end(), flat.edge_handle(left, right)) != edges.end();
+    };
+    REQUIRE(has_edge(flat.get_handle(1, false), flat.get_handle(2, false)));
+    REQUIRE(has_edge(flat.get_handle(2, false), flat.get_handle(3, true)));
+    REQUIRE(has_edge(flat.get_handle(4, true), flat.get_handle(4, false)));
+}
+
+TEST_CASE("Sequence views and single bases match get_sequence", "[handle][vg][xg][flat]") {
+    
+    VG vg;
+    vg.create_node("GATTACA");
+    vg.create_node("C");
+    vg.create_node("TNRAG");
+    xg::XG xg_index(vg.graph);
+    FlatGraph flat(vg.graph);
+    
+    for (const HandleGraph* g : {(HandleGraph*) &vg, (HandleGraph*) &xg_index, (HandleGraph*) &flat}) {
+        string buffer;
+        for (id_t id : {1, 2, 3}) {
+            for (bool is_rev : {false, true}) {
+                handle_t handle = g->get_handle(id, is_rev);
+                string expected = g->get_sequence(handle);
+                
+                sequence_view_t view = g->view_sequence(handle, buffer);
+                REQUIRE(view.size() == expected.size());
+                REQUIRE(view.substr(0) == expected);
+                REQUIRE(view.substr(1, 2) == expected.substr(1, 2));
+                
+                string copied(expected.size(), 'x');
+                g->copy_sequence(handle, &copied[0]);
+                REQUIRE(copied == expected);
+                
+                for (size_t i = 0; i < expected.size(); i++) {
+                    REQUIRE(view[i] == expected[i]);
+                    REQUIRE(g->get_base(handle, i) == expected[i]);
+                }
+            }
+        }
+    }
+    
+    // Graphs that store plain strings hand out views of them
+    sequence_view_t view;
+    REQUIRE(vg.get_sequence_view(vg.get_handle(1, true), view));
+    REQUIRE(view.is_reverse);
+    REQUIRE(flat.get_sequence_view(flat.get_handle(3, false), view));
+    REQUIRE(!xg_index.get_sequence_view(xg_index.get_handle(1, false), view));
+}
+
 }
 }
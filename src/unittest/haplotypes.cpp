@@ -250,6 +250,23 @@ TEST_CASE("We can score haplotypes using GBWT", "[haplo-score][gbwt]") {
   query_node_lengths = {node_lengths[1], node_lengths[8]};
   haplo::gbwt_thread_t empty_node(query_nodes, query_node_lengths);
   REQUIRE(!(haplo::haplo_DP::score(empty_node, *gbwt_index, memo).second));
+  
+  // scoring through a prefix cache gives the same answers, and reuses shared prefixes
+  haplo::haplo_DP_prefix_cache cache;
+  REQUIRE(haplo::haplo_DP::score(query, *gbwt_index, memo, cache).first == result_from_thread.first);
+  REQUIRE(cache.size() == 3);
+  
+  query_nodes = {tm[1], tm[2], tm[4], tm[5]};
+  query_node_lengths = {node_lengths[1], node_lengths[2], node_lengths[4], node_lengths[5]};
+  haplo::gbwt_thread_t longer_query(query_nodes, query_node_lengths);
+  double longer_score = haplo::haplo_DP::score(longer_query, *gbwt_index, memo).first;
+  REQUIRE(haplo::haplo_DP::score(longer_query, *gbwt_index, memo, cache).first == longer_score);
+  REQUIRE(cache.size() == 4);
+  
+  // scoring the shorter query again is a pure lookup, and the cached prefixes weren't disturbed
+  REQUIRE(haplo::haplo_DP::score(query, *gbwt_index, memo, cache).first == result_from_thread.first);
+  REQUIRE(cache.size() == 4);
+  REQUIRE(!(haplo::haplo_DP::score(empty_node, *gbwt_index, memo, cache).second));
   delete gbwt_index;
 }
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+/** \file
+ *
+ * Unit tests for the maps in hash_map.hpp.
+ */
+
+#include <map>
+#include <random>
+#include "../hash_map.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+TEST_CASE("id_map behaves like a map whether or not its IDs are dense", "[hashmap]") {
+    
+    for (bool dense : {false, true}) {
+        
+        id_map<int> map_under_test;
+        if (dense) {
+            // Plan for a range that only some of the IDs we use fall into
+            map_under_test.reserve_ids(10, 200, 150);
+        }
+        std::map<int64_t, int> truth;
+        
+        default_random_engine gen(dense ? 1 : 2);
+        uniform_int_distribution<int64_t> id_distr(1, 300);
+        uniform_int_distribution<int> op_distr(0, 2);
+        
+        for (int i = 0; i < 5000; i++) {
+            int64_t id = id_distr(gen);
+            switch (op_distr(gen)) {
+            case 0:
+                map_under_test[id] = i;
+                truth[id] = i;
+                break;
+            case 1:
+                REQUIRE(map_under_test.erase(id) == truth.erase(id));
+                break;
+            default:
+                {
+                    auto found = map_under_test.find(id);
+                    REQUIRE((found != nullptr) == (truth.count(id) != 0));
+                    if (found != nullptr) {
+                        REQUIRE(*found == truth[id]);
+                    }
+                }
+            }
+            REQUIRE(map_under_test.size() == truth.size());
+        }
+        
+        std::map<int64_t, int> seen;
+        map_under_test.for_each([&](int64_t id, const int& value) {
+            REQUIRE(seen.count(id) == 0);
+            seen[id] = value;
+        });
+        REQUIRE(seen == truth);
+        
+        map_under_test.clear();
+        REQUIRE(map_under_test.empty());
+        REQUIRE(map_under_test.count(50) == 0);
+    }
+}
+
+}
+}
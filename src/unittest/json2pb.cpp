@@ -0,0 +1,61 @@
+//
+//  json2pb.cpp
+//
+// Tests for reading JSON into protobuf messages
+//
+
+#include "catch.hpp"
+#include "../json2pb.h"
+#include "../vg.pb.h"
+
+#include <cstring>
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("JSON is read into nested messages", "[json]") {
+
+            string json = R"(
+            {"name": "read\n\"1\" é", "sequence": "ACGT", "quality": "KSs=",
+             "path": {"mapping": [{"position": {"node_id": 12, "offset": 3, "is_reverse": true},
+                                   "edit": [{"from_length": 2, "to_length": 2},
+                                            {"from_length": 1, "to_length": 1, "sequence": "T"}]}]},
+             "score": -5, "identity": 0.75, "is_secondary": false, "fragment": []}
+            )";
+
+            Alignment aln;
+            json2pb(aln, json.c_str(), json.size());
+
+            REQUIRE(aln.name() == "read\n\"1\" \xc3\xa9");
+            REQUIRE(aln.sequence() == "ACGT");
+            REQUIRE(aln.quality() == string("\x29\x2b"));
+            REQUIRE(aln.path().mapping_size() == 1);
+            REQUIRE(aln.path().mapping(0).position().node_id() == 12);
+            REQUIRE(aln.path().mapping(0).position().offset() == 3);
+            REQUIRE(aln.path().mapping(0).position().is_reverse());
+            REQUIRE(aln.path().mapping(0).edit_size() == 2);
+            REQUIRE(aln.path().mapping(0).edit(1).sequence() == "T");
+            REQUIRE(aln.score() == -5);
+            REQUIRE(aln.identity() == 0.75);
+            REQUIRE(!aln.is_secondary());
+
+            SECTION("It comes back the same through pb2json") {
+                string round_trip = pb2json(aln);
+                Alignment again;
+                json2pb(again, round_trip.c_str(), round_trip.size());
+                REQUIRE(pb2json(again) == round_trip);
+            }
+        }
+
+        TEST_CASE("JSON that does not fit the message is rejected", "[json]") {
+
+            for (const char* json : {"{\"nope\": 1}", "{\"score\": 1.5}", "{\"name\": 3}",
+                                     "[1]", "{\"score\": 1", "{\"path\": {\"mapping\": {}}}",
+                                     "{\"name\": \"x\"} {}"}) {
+                Alignment aln;
+                REQUIRE_THROWS(json2pb(aln, json, strlen(json)));
+            }
+        }
+    }
+}
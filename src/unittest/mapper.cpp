@@ -3,6 +3,7 @@
 /// unit tests for the mapper
 
 #include <iostream>
+#include <algorithm>
 #include "json2pb.h"
 #include "vg.pb.h"
 #include "../mapper.hpp"
@@ -295,6 +296,132 @@ TEST_CASE( "Mapper finds optimal mapping for read starting with node-border MEM"
     delete gcsaidx;
     delete lcpidx;
     
+TEST_CASE( "Mapper surjects reads already on a path without realigning them", "[mapping][mapper][surject]" ) {
+
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "A"},
+                 {"id": 3, "sequence": "C"}, {"id": 4, "sequence": "CAT"}],
+        "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4}],
+        "path": [{"name": "ref", "mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1}], "rank": 2},
+            {"position": {"node_id": 4}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 3}
+        ]}]
+    })";
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    Mapper mapper(&xg_index, nullptr, nullptr);
+
+    set<string> path_names{"ref"};
+    string path_name;
+    int64_t path_pos = -1;
+    bool path_reverse = true;
+
+    SECTION( "A forward read along the path is placed at its start" ) {
+        string aln_json = R"({"sequence": "TTAC", "path": {"mapping": [
+            {"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 2, "to_length": 2}]},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1}]},
+            {"position": {"node_id": 4}, "edit": [{"from_length": 1, "to_length": 1}]}
+        ]}})";
+        Alignment aln;
+        json2pb(aln, aln_json.c_str(), aln_json.size());
+
+        REQUIRE(mapper.alignment_on_path(aln, path_names, path_name, path_pos, path_reverse));
+        REQUIRE(path_name == "ref");
+        REQUIRE(path_pos == 2);
+        REQUIRE(!path_reverse);
+
+        Alignment surjected = mapper.surject_alignment(aln, path_names, path_name, path_pos, path_reverse);
+        REQUIRE(pb2json(surjected.path()) == pb2json(aln.path()));
+        REQUIRE(path_pos == 2);
+    }
+
+    SECTION( "A reverse read along the path is placed at its leftmost base" ) {
+        string aln_json = R"({"sequence": "TGTAA", "path": {"mapping": [
+            {"position": {"node_id": 4, "offset": 1, "is_reverse": true}, "edit": [{"from_length": 2, "to_length": 2}]},
+            {"position": {"node_id": 2, "is_reverse": true}, "edit": [{"from_length": 1, "to_length": 1}]},
+            {"position": {"node_id": 1, "is_reverse": true}, "edit": [{"from_length": 2, "to_length": 2}]}
+        ]}})";
+        Alignment aln;
+        json2pb(aln, aln_json.c_str(), aln_json.size());
+
+        REQUIRE(mapper.alignment_on_path(aln, path_names, path_name, path_pos, path_reverse));
+        REQUIRE(path_pos == 2);
+        REQUIRE(path_reverse);
+    }
+
+    SECTION( "Reads that leave the path or are soft-clipped need realigning" ) {
+        string off_json = R"({"sequence": "TCC", "path": {"mapping": [
+            {"position": {"node_id": 1, "offset": 3}, "edit": [{"from_length": 1, "to_length": 1}]},
+            {"position": {"node_id": 3}, "edit": [{"from_length": 1, "to_length": 1}]},
+            {"position": {"node_id": 4}, "edit": [{"from_length": 1, "to_length": 1}]}
+        ]}})";
+        Alignment off;
+        json2pb(off, off_json.c_str(), off_json.size());
+        REQUIRE(!mapper.alignment_on_path(off, path_names, path_name, path_pos, path_reverse));
+
+        string clipped_json = R"({"sequence": "GGGATT", "path": {"mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 0, "to_length": 2, "sequence": "GG"},
+                                                  {"from_length": 4, "to_length": 4}]}
+        ]}})";
+        Alignment clipped;
+        json2pb(clipped, clipped_json.c_str(), clipped_json.size());
+        REQUIRE(!mapper.alignment_on_path(clipped, path_names, path_name, path_pos, path_reverse));
+    }
+}
+
+TEST_CASE( "Mapper locates a bounded sample of a high-count range", "[mapping][mapper]" ) {
+
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "ACACACACACACACACACACACACACACAC"}]
+    })";
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    VG graph;
+    graph.extend(proto_graph);
+    
+    gcsa::TempFile::setDirectory(find_temp_dir());
+    gcsa::Verbosity::set(gcsa::Verbosity::SILENT);
+    gcsa::GCSA* gcsaidx = nullptr;
+    gcsa::LCPArray* lcpidx = nullptr;
+    build_gcsa_lcp(graph, gcsaidx, lcpidx, 16, 3);
+    xg::XG xg_index(proto_graph);
+    Mapper mapper(&xg_index, gcsaidx, lcpidx);
+    
+    gcsa::range_type range = gcsaidx->find(string("AC"));
+    vector<gcsa::node_type> all_hits;
+    gcsaidx->locate(range, all_hits);
+    REQUIRE(all_hits.size() > 4);
+    
+    SECTION( "An unbounded locate finds every hit" ) {
+        vector<gcsa::node_type> hits;
+        REQUIRE(mapper.locate_bounded(range, 0, hits) == gcsa::Range::length(range));
+        REQUIRE(hits == all_hits);
+    }
+    
+    SECTION( "A bounded locate finds distinct hits from the range, up to the bound" ) {
+        vector<gcsa::node_type> hits;
+        REQUIRE(mapper.locate_bounded(range, 4, hits) == gcsa::Range::length(range));
+        REQUIRE(!hits.empty());
+        REQUIRE(hits.size() <= 4);
+        REQUIRE(is_sorted(hits.begin(), hits.end()));
+        REQUIRE(adjacent_find(hits.begin(), hits.end()) == hits.end());
+        for (auto& hit : hits) {
+            REQUIRE(find(all_hits.begin(), all_hits.end(), hit) != all_hits.end());
+        }
+    }
+    
+    SECTION( "An empty range has no hits" ) {
+        vector<gcsa::node_type> hits{all_hits.front()};
+        REQUIRE(mapper.locate_bounded(gcsaidx->find(string("GG")), 4, hits) == 0);
+        REQUIRE(hits.empty());
+    }
+    
+    delete gcsaidx;
+    delete lcpidx;
+}
+
 }
 
 }
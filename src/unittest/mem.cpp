@@ -173,5 +173,137 @@ TEST_CASE( "ShuffledPairs loops over all pairs", "[mem]" ) {
     }
     
 }
+
+TEST_CASE( "SparseChainClusterer chains colinear hits", "[mem][cluster]" ) {
+    
+    auto make_hit = [](int64_t read_begin, int64_t read_end, int64_t position, size_t space) {
+        SparseChainClusterer::Hit hit;
+        hit.read_begin = read_begin;
+        hit.read_end = read_end;
+        hit.position = position;
+        hit.space = space;
+        hit.score = read_end - read_begin;
+        return hit;
+    };
+    
+    // Three hits in a row with a small deletion before the last, a repeat
+    // copy of the second far away, and a hit on the other strand
+    vector<SparseChainClusterer::Hit> hits{make_hit(0, 10, 100, 0), make_hit(12, 20, 112, 0), make_hit(25, 45, 128, 0),
+                                           make_hit(12, 20, 5000, 0), make_hit(0, 10, -900, 1)};
+    
+    SECTION( "Hits chain across gaps and not across strands or long distances" ) {
+        auto chains = SparseChainClusterer::chain_hits(hits, 1, 6, 1, 50);
+        REQUIRE(chains.size() == 3);
+        // the deletion of 3 costs the gap open and two extensions
+        REQUIRE(chains[0].first == 10 + 8 + 20 - 8);
+        REQUIRE(chains[0].second == vector<size_t>({0, 1, 2}));
+        REQUIRE(chains[1].first == 10);
+        REQUIRE(chains[1].second == vector<size_t>{4});
+        REQUIRE(chains[2].first == 8);
+        REQUIRE(chains[2].second == vector<size_t>{3});
+    }
+    
+    SECTION( "Overlapping hits only score for the new bases" ) {
+        vector<SparseChainClusterer::Hit> overlapping{make_hit(0, 10, 0, 0), make_hit(5, 15, 5, 0)};
+        auto chains = SparseChainClusterer::chain_hits(overlapping, 1, 6, 1, 50);
+        REQUIRE(chains.size() == 1);
+        REQUIRE(chains[0].first == 15);
+        REQUIRE(chains[0].second == vector<size_t>({0, 1}));
+    }
+    
+    SECTION( "Only the highest scoring hits are chained when there are too many" ) {
+        auto chains = SparseChainClusterer::chain_hits(hits, 1, 6, 1, 50, 2);
+        REQUIRE(chains.size() == 1);
+        REQUIRE(chains[0].first == 10 + 20 - 8);
+        REQUIRE(chains[0].second == vector<size_t>({0, 2}));
+    }
+    
+    SECTION( "Many repeated hits are chained without pairing them all up" ) {
+        // a read in 100 pieces, each with 50 copies spread across the genome
+        vector<SparseChainClusterer::Hit> repeats;
+        for (int64_t copy = 0; copy < 50; copy++) {
+            for (int64_t piece = 0; piece < 100; piece++) {
+                repeats.push_back(make_hit(piece * 10, piece * 10 + 10, copy * 100000 + piece * 10, 0));
+            }
+        }
+        auto chains = SparseChainClusterer::chain_hits(repeats, 1, 6, 1, 50, repeats.size());
+        REQUIRE(chains.size() == 50);
+        for (auto& chain : chains) {
+            REQUIRE(chain.first == 1000);
+            REQUIRE(chain.second.size() == 100);
+        }
+    }
+}
+
+
+TEST_CASE( "ChainModelDP finds the best chains first and does not reuse them", "[mem][cluster]" ) {
+    
+    // vertices 0 -> 1 -> 2 in one part, and 3 on its own in another
+    struct Vertex {
+        double weight;
+        vector<pair<Vertex*, double> > prev_cost;
+    };
+    vector<Vertex> model(4);
+    model[0].weight = 10;
+    model[1].weight = 5;
+    model[2].weight = 10;
+    model[3].weight = 12;
+    model[1].prev_cost.emplace_back(&model[0], -1);
+    model[2].prev_cost.emplace_back(&model[1], -1);
+    model[2].prev_cost.emplace_back(&model[0], -1);
+    model[3].prev_cost.emplace_back(&model[2], -30);
+    
+    SECTION( "Unpaired chains exclude their vertices" ) {
+        ChainModelDP<Vertex> dp(model);
+        auto traces = dp.traceback(5, false, [](size_t from, size_t to) { return false; });
+        REQUIRE(traces.size() == 2);
+        REQUIRE(traces[0] == vector<size_t>({0, 1, 2}));
+        REQUIRE(traces[1] == vector<size_t>({3}));
+    }
+    
+    SECTION( "Excluded vertices are never chained" ) {
+        ChainModelDP<Vertex> dp(model);
+        dp.exclude(1);
+        auto traces = dp.traceback(1, false, [](size_t from, size_t to) { return false; });
+        REQUIRE(traces.size() == 1);
+        REQUIRE(traces[0] == vector<size_t>({0, 2}));
+    }
+    
+    SECTION( "Paired chains only mask out the transitions they used" ) {
+        ChainModelDP<Vertex> dp(model);
+        auto traces = dp.traceback(2, true, [](size_t from, size_t to) { return false; });
+        REQUIRE(traces.size() == 2);
+        REQUIRE(traces[0] == vector<size_t>({0, 1, 2}));
+        REQUIRE(traces[1] == vector<size_t>({0, 2}));
+    }
+}
+
+TEST_CASE( "ChainModelDP finds later chains after rescoring only what earlier chains touched", "[mem][cluster]" ) {
+    
+    // the best chain 2 -> 3 comes after the next best 0 -> 1 in the model,
+    // and 4 can follow either of them
+    struct Vertex {
+        double weight;
+        vector<pair<Vertex*, double> > prev_cost;
+    };
+    vector<Vertex> model(5);
+    model[0].weight = 3;
+    model[1].weight = 2;
+    model[2].weight = 10;
+    model[3].weight = 10;
+    model[4].weight = 1;
+    model[1].prev_cost.emplace_back(&model[0], -1);
+    model[3].prev_cost.emplace_back(&model[2], -1);
+    model[4].prev_cost.emplace_back(&model[1], -1);
+    model[4].prev_cost.emplace_back(&model[3], -100);
+    
+    ChainModelDP<Vertex> dp(model);
+    auto traces = dp.traceback(5, false, [](size_t from, size_t to) { return false; });
+    REQUIRE(traces.size() == 3);
+    REQUIRE(traces[0] == vector<size_t>({2, 3}));
+    REQUIRE(traces[1] == vector<size_t>({0, 1}));
+    REQUIRE(traces[2] == vector<size_t>({4}));
+}
+
 }
 }
@@ -0,0 +1,125 @@
+//
+//  minimizer_index.cpp
+//
+// Tests for the minimizer index of graph paths
+//
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../minimizer_index.hpp"
+#include "../utility.hpp"
+#include "../json2pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("MinimizerIndex finds the minimizers of paths in both orientations", "[minimizer][mapping]") {
+
+            string graph_json = R"({
+                "node": [{"id": 1, "sequence": "GATTACAGATCCATGA"}, {"id": 2, "sequence": "CGTA"},
+                         {"id": 3, "sequence": "TTGACCAGGTACCGATTT"}],
+                "edge": [{"from": 1, "to": 2}, {"from": 2, "to": 3}],
+                "path": [{"name": "ref", "mapping": [
+                    {"position": {"node_id": 1}, "edit": [{"from_length": 16, "to_length": 16}], "rank": 1},
+                    {"position": {"node_id": 2}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 2},
+                    {"position": {"node_id": 3}, "edit": [{"from_length": 18, "to_length": 18}], "rank": 3}
+                ]}]
+            })";
+            Graph graph;
+            json2pb(graph, graph_json.c_str(), graph_json.size());
+            xg::XG xg_index(graph);
+
+            // where each node starts along the path
+            string path_sequence = "GATTACAGATCCATGA" "CGTA" "TTGACCAGGTACCGATTT";
+            vector<pair<id_t, size_t>> node_starts {{1, 0}, {2, 16}, {3, 20}};
+            auto position_of = [&](size_t offset) {
+                auto it = node_starts.rbegin();
+                while (it->second > offset) {
+                    ++it;
+                }
+                return gcsa::Node::encode(it->first, offset - it->second, false);
+            };
+
+            MinimizerIndex index(5, 4);
+            index.add_paths(xg_index);
+            index.finish();
+
+            REQUIRE(index.k() == 5);
+            REQUIRE(index.w() == 4);
+            REQUIRE(index.size() > 0);
+
+            SECTION("Every minimizer of the path is found at its position on the path") {
+                auto minimizers = index.minimizers(path_sequence.begin(), path_sequence.end());
+                REQUIRE(!minimizers.empty());
+                for (auto& minimizer : minimizers) {
+                    auto hits = index.find(minimizer.key);
+                    REQUIRE(hits.size() == index.count(minimizer.key));
+                    REQUIRE(find(hits.begin(), hits.end(), position_of(minimizer.offset)) != hits.end());
+                }
+            }
+
+            SECTION("Every window of the path has its minimizer reported") {
+                auto minimizers = index.minimizers(path_sequence.begin(), path_sequence.end());
+                for (size_t window = 0; window + 4 + 5 - 1 <= path_sequence.size(); window++) {
+                    bool covered = false;
+                    for (auto& minimizer : minimizers) {
+                        covered = covered || (minimizer.offset >= window && minimizer.offset < window + 4);
+                    }
+                    REQUIRE(covered);
+                }
+            }
+
+            SECTION("Minimizers of the reverse complement are found on the reverse strand") {
+                string reverse_sequence = reverse_complement(path_sequence);
+                auto minimizers = index.minimizers(reverse_sequence.begin(), reverse_sequence.end());
+                REQUIRE(!minimizers.empty());
+                for (auto& minimizer : minimizers) {
+                    bool found_reverse = false;
+                    for (auto& hit : index.find(minimizer.key)) {
+                        found_reverse = found_reverse || gcsa::Node::rc(hit);
+                    }
+                    REQUIRE(found_reverse);
+                }
+            }
+
+            SECTION("A read off the path shares no minimizers with it") {
+                string read = "CCCCCCCCCCCCCCCC";
+                for (auto& minimizer : index.minimizers(read.begin(), read.end())) {
+                    REQUIRE(index.count(minimizer.key) == 0);
+                }
+            }
+
+            SECTION("K-mers containing Ns are skipped") {
+                string read = "GATTNCAGAT";
+                auto minimizers = index.minimizers(read.begin(), read.end());
+                REQUIRE(minimizers.size() == 1);
+                REQUIRE(minimizers.front().offset == 5);
+            }
+
+            SECTION("The index survives a save and load") {
+                stringstream stream;
+                index.save(stream);
+                MinimizerIndex loaded;
+                loaded.load(stream);
+                REQUIRE(loaded.k() == index.k());
+                REQUIRE(loaded.w() == index.w());
+                REQUIRE(loaded.size() == index.size());
+                for (auto& minimizer : index.minimizers(path_sequence.begin(), path_sequence.end())) {
+                    REQUIRE(loaded.find(minimizer.key) == index.find(minimizer.key));
+                }
+            }
+
+            SECTION("Loading something else fails") {
+                stringstream stream("not an index");
+                MinimizerIndex loaded;
+                REQUIRE_THROWS(loaded.load(stream));
+            }
+        }
+
+    }
+}
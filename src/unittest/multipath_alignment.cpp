@@ -170,6 +170,7 @@ namespace vg {
                 identify_start_subpaths(multipath_aln);
                 Alignment aln;
                 optimal_alignment(multipath_aln, aln);
+                REQUIRE(optimal_alignment_score(multipath_aln) == aln.score());
                 
                 REQUIRE(aln.path().mapping_size() == multipath_aln.subpath(0).path().mapping_size());
                 for (int i = 0; i < aln.path().mapping_size(); i++) {
@@ -238,6 +239,7 @@ namespace vg {
                 identify_start_subpaths(multipath_aln);
                 Alignment aln;
                 optimal_alignment(multipath_aln, aln);
+                REQUIRE(optimal_alignment_score(multipath_aln) == aln.score());
                 
                 // follows correct path
                 REQUIRE(aln.path().mapping_size() == 3);
@@ -322,6 +324,7 @@ namespace vg {
                 identify_start_subpaths(multipath_aln);
                 Alignment aln;
                 optimal_alignment(multipath_aln, aln);
+                REQUIRE(optimal_alignment_score(multipath_aln) == aln.score());
                 
                 // follows correct path
                 REQUIRE(aln.path().mapping_size() == 3);
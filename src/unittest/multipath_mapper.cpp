@@ -436,6 +436,31 @@ TEST_CASE( "MultipathMapper can map to a one-node graph", "[multipath][mapping][
     
     }
     
+    SECTION( "MultipathMapper gives the same paired results when aligning cluster graphs as tasks" ) {
+        
+        Alignment read1, read2;
+        read1.set_sequence("GAT");
+        read2.set_sequence("ACA");
+        
+        vector<pair<MultipathAlignment, MultipathAlignment>> serial_results;
+        vector<pair<Alignment, Alignment>> buffer;
+        mapper.multipath_map_paired(read1, read2, serial_results, buffer, 1);
+        
+        mapper.parallel_cluster_alignment = true;
+        vector<pair<MultipathAlignment, MultipathAlignment>> task_results;
+#pragma omp parallel num_threads(2)
+        {
+#pragma omp single
+            mapper.multipath_map_paired(read1, read2, task_results, buffer, 1);
+        }
+        
+        REQUIRE(task_results.size() == serial_results.size());
+        for (size_t i = 0; i < task_results.size(); i++) {
+            REQUIRE(pb2json(task_results[i].first) == pb2json(serial_results[i].first));
+            REQUIRE(pb2json(task_results[i].second) == pb2json(serial_results[i].second));
+        }
+    }
+    
     // Clean up the GCSA/LCP index
     delete gcsaidx;
     delete lcpidx;
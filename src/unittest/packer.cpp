@@ -0,0 +1,245 @@
+//
+//  packer.cpp
+//
+// Tests for the coverage packer
+//
+
+#include "catch.hpp"
+#include "../packer.hpp"
+#include "../json2pb.h"
+#include "../utility.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+TEST_CASE("A shared packer counts the same coverage as a packer per thread", "[pack]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"}],
+    "edge":[{"to":2,"from":1}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Cover the end of node 1 and all of node 2, and the start of node 1 on
+    // the reverse strand, enough times to overflow a byte.
+    Alignment forward;
+    Mapping* m = forward.mutable_path()->add_mapping();
+    m->mutable_position()->set_node_id(1);
+    m->mutable_position()->set_offset(2);
+    Edit* e = m->add_edit();
+    e->set_from_length(2);
+    e->set_to_length(2);
+    m = forward.mutable_path()->add_mapping();
+    m->mutable_position()->set_node_id(2);
+    e = m->add_edit();
+    e->set_from_length(3);
+    e->set_to_length(3);
+
+    Alignment reverse;
+    m = reverse.mutable_path()->add_mapping();
+    m->mutable_position()->set_node_id(1);
+    m->mutable_position()->set_is_reverse(true);
+    m->mutable_position()->set_offset(2);
+    e = m->add_edit();
+    e->set_from_length(2);
+    e->set_to_length(2);
+
+    size_t copies = 300;
+
+    Packer separate(&xg_index, 0);
+    for (size_t i = 0; i < copies; i++) {
+        separate.add(forward, false);
+        separate.add(reverse, false);
+    }
+
+    Packer shared(&xg_index, 0, true);
+    REQUIRE(shared.is_shared());
+#pragma omp parallel for
+    for (size_t i = 0; i < copies; i++) {
+        shared.add(forward, false);
+        shared.add(reverse, false);
+    }
+
+    REQUIRE(shared.graph_length() == separate.graph_length());
+    for (size_t i = 0; i < separate.graph_length(); i++) {
+        REQUIRE(shared.coverage_at_position(i) == separate.coverage_at_position(i));
+    }
+    REQUIRE(shared.coverage_at_position(0) == copies);
+    REQUIRE(shared.coverage_at_position(2) == copies);
+    REQUIRE(shared.coverage_at_position(6) == copies);
+
+    // Compacting keeps the counts
+    shared.make_compact();
+    REQUIRE(shared.coverage_at_position(3) == copies);
+}
+
+TEST_CASE("Edits recorded by a packer can be found after it is compacted", "[pack]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"}],
+    "edge":[{"to":2,"from":1}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Match one base then substitute a C for the A on node 1
+    Alignment aln;
+    Mapping* m = aln.mutable_path()->add_mapping();
+    m->mutable_position()->set_node_id(1);
+    Edit* e = m->add_edit();
+    e->set_from_length(1);
+    e->set_to_length(1);
+    e = m->add_edit();
+    e->set_from_length(1);
+    e->set_to_length(1);
+    e->set_sequence("C");
+
+    // When shared, the threads will each compress their own runs of edits
+    size_t copies = 1000;
+
+    for (bool shared : {false, true}) {
+        Packer packer(&xg_index, 2, shared);
+#pragma omp parallel for if(shared)
+        for (size_t i = 0; i < copies; i++) {
+            packer.add(aln);
+        }
+        packer.make_compact();
+
+        REQUIRE(packer.coverage_at_position(0) == copies);
+        REQUIRE(packer.coverage_at_position(1) == 0);
+        vector<Edit> edits = packer.edits_at_position(1);
+        REQUIRE(edits.size() == copies);
+        REQUIRE(edits.front().sequence() == "C");
+        REQUIRE(packer.edits_at_position(2).empty());
+    }
+}
+
+TEST_CASE("Merging pack files sums their coverage and keeps their edits", "[pack]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"}],
+    "edge":[{"to":2,"from":1}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    // Match one base then substitute a C for the A on node 1
+    Alignment aln;
+    Mapping* m = aln.mutable_path()->add_mapping();
+    m->mutable_position()->set_node_id(1);
+    Edit* e = m->add_edit();
+    e->set_from_length(1);
+    e->set_to_length(1);
+    e = m->add_edit();
+    e->set_from_length(1);
+    e->set_to_length(1);
+    e->set_sequence("C");
+
+    // Write more packs than there are threads, so they merge in batches
+    size_t packs = get_thread_count() + 2;
+    vector<string> file_names;
+    for (size_t i = 0; i < packs; ++i) {
+        Packer packer(&xg_index, 2);
+        for (size_t j = 0; j <= i; ++j) {
+            packer.add(aln);
+        }
+        file_names.push_back(tmpfilename("packer-merge"));
+        packer.save_to_file(file_names.back());
+    }
+
+    Packer merged(&xg_index, 2);
+    merged.merge_from_files(file_names);
+    // alignments can still be added on top of the merged packs
+    merged.add(aln);
+    merged.make_compact();
+
+    size_t copies = packs * (packs + 1) / 2 + 1;
+    REQUIRE(merged.coverage_at_position(0) == copies);
+    REQUIRE(merged.coverage_at_position(1) == 0);
+    vector<Edit> edits = merged.edits_at_position(1);
+    REQUIRE(edits.size() == copies);
+    REQUIRE(edits.front().sequence() == "C");
+
+    for (auto& file_name : file_names) {
+        remove(file_name.c_str());
+    }
+}
+
+TEST_CASE("A compacted packer summarizes coverage over ranges, nodes, and path windows", "[pack]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"}],
+    "edge":[{"to":2,"from":1,"from_start":true}],
+    "path":[{"name":"x","mapping":[
+    {"position":{"node_id":1,"is_reverse":true},"rank":1},
+    {"position":{"node_id":2},"rank":2}]}]}
+    )";
+
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+
+    Packer packer(&xg_index, 0);
+    // Cover the last base of node 1 three times, and node 2 once
+    Alignment aln;
+    Mapping* m = aln.mutable_path()->add_mapping();
+    m->mutable_position()->set_node_id(1);
+    m->mutable_position()->set_offset(3);
+    Edit* e = m->add_edit();
+    e->set_from_length(1);
+    e->set_to_length(1);
+    for (size_t i = 0; i < 3; i++) {
+        packer.add(aln, false);
+    }
+    m->mutable_position()->set_node_id(2);
+    m->mutable_position()->set_offset(0);
+    e->set_from_length(3);
+    e->set_to_length(3);
+    packer.add(aln, false);
+    packer.make_compact();
+
+    SECTION("Basis ranges are summarized") {
+        CoverageSummary all = packer.coverage_in_range(0, packer.graph_length());
+        REQUIRE(all.bases == 7);
+        REQUIRE(all.total == 6);
+        REQUIRE(all.max == 3);
+        REQUIRE(packer.coverage_in_range(0, 3).total == 0);
+        REQUIRE(packer.coverage_in_range(5, 5).bases == 0);
+        REQUIRE(packer.coverage_in_range(5, 100).bases == 2);
+    }
+
+    SECTION("Nodes are summarized") {
+        CoverageSummary node = packer.node_coverage(1);
+        REQUIRE(node.bases == 4);
+        REQUIRE(node.total == 3);
+        REQUIRE(node.mean() == Approx(0.75));
+        REQUIRE(packer.node_coverage(2).max == 1);
+    }
+
+    SECTION("Path windows follow the path's orientation") {
+        // The path starts on the reverse of node 1, so its first base is the
+        // last base of node 1.
+        CoverageSummary first = packer.path_window_coverage("x", 0, 1);
+        REQUIRE(first.bases == 1);
+        REQUIRE(first.total == 3);
+        CoverageSummary crossing = packer.path_window_coverage("x", 3, 6);
+        REQUIRE(crossing.bases == 3);
+        REQUIRE(crossing.total == 2);
+        REQUIRE(crossing.max == 1);
+    }
+}
+
+    }
+}
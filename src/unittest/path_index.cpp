@@ -360,6 +360,61 @@ TEST_CASE("PathIndex translation can divide the last node", "[pathindex]") {
     }
     
 }
+
+TEST_CASE("PathIndex can apply a batch of translations from editing", "[pathindex]") {
+    
+    // Load the graph
+    Graph graph;
+    json2pb(graph, path_index_graph_1.c_str(), path_index_graph_1.size());
+    
+    // Make it into a VG
+    VG to_index;
+    to_index.extend(graph);
+    
+    // Make a PathIndex
+    PathIndex index(to_index, "cool", true);
+    
+    // Make a translation in the format VG::edit() produces, from part of one
+    // node to all of another
+    auto make_translation = [](id_t from_id, size_t offset, size_t length, id_t to_id) {
+        Translation t;
+        auto* from_mapping = t.mutable_from()->add_mapping();
+        from_mapping->mutable_position()->set_node_id(from_id);
+        from_mapping->mutable_position()->set_offset(offset);
+        auto* from_edit = from_mapping->add_edit();
+        from_edit->set_from_length(length);
+        from_edit->set_to_length(length);
+        auto* to_mapping = t.mutable_to()->add_mapping();
+        to_mapping->mutable_position()->set_node_id(to_id);
+        auto* to_edit = to_mapping->add_edit();
+        to_edit->set_from_length(length);
+        to_edit->set_to_length(length);
+        return t;
+    };
+    
+    // Divide node 4 (GGG) into 1337 (G) and 1338 (GG), rename node 9 to 20, and
+    // leave node 1 alone
+    index.apply_translations({make_translation(4, 1, 2, 1338), make_translation(1, 0, 1, 1),
+                              make_translation(9, 0, 5, 20), make_translation(4, 0, 1, 1337)});
+    
+    REQUIRE(index.at_position(0).node == 1);
+    REQUIRE(index.at_position(2).node == 1337);
+    REQUIRE(index.at_position(3).node == 1338);
+    REQUIRE(index.node_length(index.find_position(4)) == 2);
+    REQUIRE(index.at_position(12).node == 20);
+    REQUIRE(index.node_length(index.find_position(12)) == 5);
+    
+    REQUIRE(!index.by_id.count(4));
+    REQUIRE(!index.by_id.count(9));
+    REQUIRE(index.by_id.at(1338).first == 3);
+    REQUIRE(index.by_id.at(20).first == 8);
+    
+    SECTION("Node occurrences can be found by where they start") {
+        REQUIRE(index.find_start(3)->second.node == 1338);
+        REQUIRE(index.find_start(4)->second.node == 5);
+        REQUIRE(index.find_start(9) == index.end());
+    }
+}
    
 }
 }
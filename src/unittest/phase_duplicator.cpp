@@ -316,5 +316,56 @@ TEST_CASE("PhaseDuplicator can produce internal traversals", "[phaseduplicator][
     }
 }
     
+TEST_CASE("PhaseDuplicator gives the same results for many subgraphs at once as for each in turn", "[phaseduplicator][indexing]") {
+        
+    Graph graph;
+    json2pb(graph, duplicator_graph_1.c_str(), duplicator_graph_1.size());
+    xg::XG index(graph);
+    
+    vector<xg::XG::thread_t> threads {{
+        {1, false},
+        {2, false},
+        {3, false},
+        {5, false},
+        {6, false},
+        {7, false},
+        {9, false}
+    }, {
+        {1, false},
+        {2, false},
+        {4, false},
+        {5, false},
+        {6, false},
+        {8, false},
+        {9, false}
+    }};
+    index.insert_threads_into_dag(threads, {});
+    
+    PhaseDuplicator duplicator(index);
+    
+    vector<set<id_t>> subgraphs {{2, 3, 4, 5}, {7, 8}, {1}};
+    
+    // Duplicate each subgraph in turn
+    id_t serial_next_id = 10;
+    vector<pair<Graph, vector<Translation>>> serial;
+    for (auto& subgraph : subgraphs) {
+        serial.push_back(duplicator.duplicate(subgraph, serial_next_id));
+    }
+    
+    // And all at once
+    id_t batch_next_id = 10;
+    vector<pair<Graph, vector<Translation>>> batch = duplicator.duplicate(subgraphs, batch_next_id);
+    
+    REQUIRE(batch_next_id == serial_next_id);
+    REQUIRE(batch.size() == serial.size());
+    for (size_t i = 0; i < serial.size(); i++) {
+        REQUIRE(pb2json(batch[i].first) == pb2json(serial[i].first));
+        REQUIRE(batch[i].second.size() == serial[i].second.size());
+        for (size_t j = 0; j < serial[i].second.size(); j++) {
+            REQUIRE(pb2json(batch[i].second[j]) == pb2json(serial[i].second[j]));
+        }
+    }
+}
+
 }
 }
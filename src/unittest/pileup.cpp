@@ -0,0 +1,170 @@
+/**
+ * \file
+ * unittest/pileup.cpp: test cases for computing Pileups from alignments
+ */
+
+#include "catch.hpp"
+#include "../pileup.hpp"
+#include "../json2pb.h"
+
+#include <sstream>
+#include <memory>
+
+namespace vg {
+namespace unittest {
+
+// Make an alignment of a 7 bp read to node 1, optionally with a SNP to C at offset 3
+static Alignment make_pileup_read(bool snp, bool is_reverse = false) {
+    Alignment aln;
+    aln.set_sequence(snp ? "GATCACA" : "GATTACA");
+    aln.set_quality(string(7, (char) 30));
+    Mapping* mapping = aln.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(1);
+    mapping->mutable_position()->set_is_reverse(is_reverse);
+    mapping->set_rank(1);
+    if (snp) {
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(3);
+        edit->set_to_length(3);
+        edit = mapping->add_edit();
+        edit->set_from_length(1);
+        edit->set_to_length(1);
+        edit->set_sequence(is_reverse ? "G" : "C");
+        edit = mapping->add_edit();
+        edit->set_from_length(3);
+        edit->set_to_length(3);
+    } else {
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(7);
+        edit->set_to_length(7);
+    }
+    return aln;
+}
+
+TEST_CASE("Pileups count matches and SNPs and convert to protobuf", "[pileup]") {
+
+    VG graph;
+    graph.create_node("GATTACA", 1);
+
+    Pileups pileups(&graph);
+    Alignment match = make_pileup_read(false);
+    Alignment snp = make_pileup_read(true);
+    Alignment reverse_match = make_pileup_read(false, true);
+    pileups.compute_from_alignment(match);
+    pileups.compute_from_alignment(snp);
+    pileups.compute_from_alignment(reverse_match);
+
+    NodePileup node_pileup;
+    REQUIRE(!pileups.get_node_pileup(2, node_pileup));
+    REQUIRE(pileups.get_node_pileup(1, node_pileup));
+    REQUIRE(node_pileup.node_id() == 1);
+    REQUIRE(node_pileup.base_pileup_size() == 7);
+
+    SECTION("Each base has a token and a quality per read") {
+        for (size_t i = 0; i < 7; i++) {
+            auto& bp = node_pileup.base_pileup(i);
+            REQUIRE(bp.ref_base() == (int) graph.get_node(1)->sequence()[i]);
+            REQUIRE(bp.num_bases() == 3);
+            REQUIRE(bp.qualities() == string(3, (char) 30));
+            if (i == 3) {
+                REQUIRE(bp.bases() == ".,C");
+            } else {
+                REQUIRE(bp.bases() == "..,");
+            }
+        }
+    }
+
+    SECTION("The max depth is respected") {
+        Pileups shallow(&graph, 0, 1, 0, 2);
+        shallow.compute_from_alignment(match);
+        shallow.compute_from_alignment(snp);
+        shallow.compute_from_alignment(reverse_match);
+
+        NodePileup shallow_pileup;
+        REQUIRE(shallow.get_node_pileup(1, shallow_pileup));
+        for (size_t i = 0; i < 7; i++) {
+            REQUIRE(shallow_pileup.base_pileup(i).num_bases() == 2);
+            REQUIRE(shallow_pileup.base_pileup(i).qualities().size() == 2);
+        }
+        REQUIRE(shallow_pileup.base_pileup(3).bases() == ".C");
+    }
+
+    SECTION("Pileups survive writing and loading") {
+        stringstream stream;
+        pileups.write(stream);
+
+        Pileups loaded(&graph);
+        loaded.load(stream);
+
+        NodePileup loaded_pileup;
+        REQUIRE(loaded.get_node_pileup(1, loaded_pileup));
+        REQUIRE(pb2json(loaded_pileup) == pb2json(node_pileup));
+    }
+
+    SECTION("Merged pileups hold everything") {
+        Pileups other(&graph);
+        other.compute_from_alignment(snp);
+        pileups.merge(other);
+
+        NodePileup merged_pileup;
+        REQUIRE(pileups.get_node_pileup(1, merged_pileup));
+        REQUIRE(!other.get_node_pileup(1, node_pileup));
+        REQUIRE(merged_pileup.base_pileup(3).num_bases() == 4);
+        REQUIRE(merged_pileup.base_pileup(3).bases() == ".,CC");
+        REQUIRE(merged_pileup.base_pileup(0).bases() == "...,");
+    }
+}
+
+TEST_CASE("Sharded pileups match unsharded pileups", "[pileup]") {
+
+    VG graph;
+    Node* n1 = graph.create_node("GATTACA", 1);
+    Node* n2 = graph.create_node("CATG", 2);
+    graph.create_edge(n1, n2);
+
+    // A read that matches the end of node 1 and the start of node 2
+    Alignment spanning;
+    spanning.set_sequence("ACACA");
+    spanning.set_quality(string(5, (char) 30));
+    Mapping* mapping = spanning.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(1);
+    mapping->mutable_position()->set_offset(4);
+    mapping->set_rank(1);
+    Edit* edit = mapping->add_edit();
+    edit->set_from_length(3);
+    edit->set_to_length(3);
+    mapping = spanning.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(2);
+    mapping->set_rank(2);
+    edit = mapping->add_edit();
+    edit->set_from_length(2);
+    edit->set_to_length(2);
+
+    vector<Alignment> reads{make_pileup_read(false), make_pileup_read(true), spanning, spanning};
+
+    Pileups unsharded(&graph);
+    PileupShards shards(&graph, 2);
+    shards.queue_size = 1;
+    for (auto& read : reads) {
+        unsharded.compute_from_alignment(read);
+        shards.add_alignment(read);
+    }
+    unique_ptr<Pileups> sharded(shards.finish());
+
+    for (int64_t node_id : {1, 2}) {
+        NodePileup expected;
+        NodePileup found;
+        REQUIRE(unsharded.get_node_pileup(node_id, expected));
+        REQUIRE(sharded->get_node_pileup(node_id, found));
+        REQUIRE(pb2json(found) == pb2json(expected));
+    }
+
+    EdgePileup* edge_pileup = sharded->get_edge_pileup(make_pair(NodeSide(1, true), NodeSide(2, false)));
+    REQUIRE(edge_pileup != nullptr);
+    REQUIRE(edge_pileup->num_reads() == 2);
+    REQUIRE(sharded->_edge_pileups.size() == 1);
+    REQUIRE(sharded->_bases_count == unsharded._bases_count);
+}
+
+}
+}
@@ -0,0 +1,72 @@
+/**
+ * \file
+ * unittest/pileup_augmenter.cpp: test cases for dividing nodes when augmenting from pileups
+ */
+
+#include "catch.hpp"
+#include "../pileup_augmenter.hpp"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE("NodeDivider can divide a fragment at many places at once", "[pileup][augment]") {
+
+    VG base;
+    Node* orig = base.create_node("GATTACACAT", 1);
+
+    VG augmented;
+    int64_t max_id = 1;
+
+    NodeDivider divider;
+    divider._max_id = &max_id;
+    // a reference fragment with support, a SNP, and a reference fragment without
+    vector<StrandSupport> sup;
+    for (int i = 0; i < 4; ++i) {
+        sup.push_back(StrandSupport(i, 0));
+    }
+    divider.add_fragment(orig, 0, augmented.create_node("GATT", ++max_id), NodeDivider::EntryCat::Ref, sup);
+    divider.add_fragment(orig, 4, augmented.create_node("A", ++max_id), NodeDivider::EntryCat::Ref,
+                         vector<StrandSupport>(1, StrandSupport(4, 0)));
+    Node* snp = augmented.create_node("C", ++max_id);
+    divider.add_fragment(orig, 4, snp, NodeDivider::EntryCat::Alt1, vector<StrandSupport>(1, StrandSupport(1, 1)));
+    divider.add_fragment(orig, 5, augmented.create_node("CACAT", ++max_id), NodeDivider::EntryCat::Ref,
+                         vector<StrandSupport>());
+
+    divider.break_at(orig, &augmented, {0, 2, 3, 4, 5, 7, 10});
+
+    NodeDivider::NodeMap& node_map = divider.index[1];
+    vector<int> starts;
+    string sequence;
+    for (auto& entry : node_map) {
+        starts.push_back(entry.first);
+        sequence += entry.second.ref->sequence();
+    }
+    REQUIRE(starts == vector<int>({0, 2, 3, 4, 5, 7}));
+    REQUIRE(sequence == orig->sequence());
+
+    SECTION("Support is divided along with the sequence") {
+        REQUIRE(node_map[0].sup_ref.size() == 2);
+        REQUIRE(node_map[2].sup_ref.size() == 1);
+        REQUIRE(node_map[2].sup_ref[0].fs == 2);
+        REQUIRE(node_map[3].sup_ref[0].fs == 3);
+        REQUIRE(node_map[7].sup_ref.empty());
+    }
+
+    SECTION("Alt fragments stay where they are") {
+        REQUIRE(node_map[4].alt1 == snp);
+        REQUIRE(node_map[4].alt2 == nullptr);
+        REQUIRE(node_map[2].alt1 == nullptr);
+    }
+
+    SECTION("Ends at the new boundaries need no more dividing") {
+        size_t node_count = augmented.node_count();
+        NodeDivider::Entry left = divider.break_end(orig, &augmented, 7, true);
+        NodeDivider::Entry right = divider.break_end(orig, &augmented, 6, false);
+        REQUIRE(augmented.node_count() == node_count);
+        REQUIRE(left.ref->sequence() == "CAT");
+        REQUIRE(right.ref->sequence() == "CA");
+    }
+}
+
+}
+}
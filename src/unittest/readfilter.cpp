@@ -4,6 +4,10 @@
 
 #include "catch.hpp"
 #include "readfilter.hpp"
+#include "../stream.hpp"
+#include "../utility.hpp"
+
+#include <sstream>
 
 namespace vg {
 namespace unittest {
@@ -271,5 +275,76 @@ TEST_CASE("reads with ambiguous ends can be trimmed", "[filter]") {
 }
 
 
+TEST_CASE("reads are filtered the same way when only the needed fields are parsed", "[filter]") {
+    
+    // Make some reads to a single node, some of which get filtered
+    vector<Alignment> reads;
+    for (size_t i = 0; i < 6; i++) {
+        Alignment aln;
+        aln.set_name("read" + to_string(i));
+        aln.set_sequence("GATTACA");
+        aln.set_quality(string(7, (char) 40));
+        aln.set_mapping_quality(i % 3 ? 60 : 10);
+        aln.add_refpos()->set_name("ref");
+        Mapping* mapping = aln.mutable_path()->add_mapping();
+        mapping->mutable_position()->set_node_id(1);
+        // Mismatch the base at i
+        if (i > 0) {
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(i);
+            edit->set_to_length(i);
+        }
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(1);
+        edit->set_to_length(1);
+        edit->set_sequence("C");
+        edit = mapping->add_edit();
+        edit->set_from_length(6 - i);
+        edit->set_to_length(6 - i);
+        reads.push_back(aln);
+    }
+    
+    string serialized;
+    {
+        stringstream out;
+        vector<Alignment> buffer = reads;
+        stream::write_buffered(out, buffer, 0);
+        serialized = out.str();
+    }
+    
+    // Run the filter, and get back what it wrote to standard output
+    auto run_filter = [&](bool lazy_parse) {
+        ReadFilter filter;
+        filter.min_mapq = 30;
+        filter.min_end_matches = 2;
+        filter.lazy_parse = lazy_parse;
+        filter.threads = get_thread_count();
+        
+        stringstream in(serialized);
+        stringstream out;
+        streambuf* old_buffer = cout.rdbuf(out.rdbuf());
+        int status = filter.filter(&in);
+        cout.rdbuf(old_buffer);
+        REQUIRE(status == 0);
+        
+        vector<string> kept;
+        out.seekg(0);
+        stream::for_each_serialized(out, [&](string& bytes) {
+            kept.push_back(bytes);
+        });
+        sort(kept.begin(), kept.end());
+        return kept;
+    };
+    
+    vector<string> parsed = run_filter(false);
+    vector<string> lazy = run_filter(true);
+    
+    // Only the high-MAPQ reads with 2 matches on each end survive
+    vector<string> expected{reads[2].SerializeAsString(), reads[4].SerializeAsString()};
+    sort(expected.begin(), expected.end());
+    REQUIRE(parsed == expected);
+    REQUIRE(lazy == expected);
+}
+
 }
 }
@@ -4,11 +4,15 @@
 
 #include <iostream>
 #include <unordered_set>
+#include <set>
 #include <utility>
+#include <fstream>
+#include <cstdio>
 
 #include "json2pb.h"
 #include "vg.pb.h"
 #include "../sampler.hpp"
+#include "../utility.hpp"
 #include "catch.hpp"
 
 namespace vg {
@@ -293,6 +297,133 @@ TEST_CASE( "Sampler can across reversing edges", "[sampler]" ) {
     }
 }
 
+TEST_CASE( "NGSSimulator makes the same reads however many threads sample them", "[sampler]" ) {
+    
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACAGATTACAGATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CATTAGCATTAGCATTAGCC"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ]
+    })";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    // Train on a few short reads
+    string fastq_name = tmpfilename();
+    {
+        ofstream fastq(fastq_name);
+        for (size_t i = 0; i < 10; i++) {
+            fastq << "@read" << i << endl << "GATTACAGAT" << endl << "+" << endl
+                  << (i % 2 ? "IIIIIIIII5" : "IIIII5IIII") << endl;
+        }
+    }
+    
+    NGSSimulator simulator(xg_index, fastq_name, false, {}, 0.01, 0.002, 0.1,
+                           30.0, 1.0, 1.0, true, 1337);
+    
+    size_t read_count = 200;
+    vector<string> serial(read_count);
+    for (size_t i = 0; i < read_count; i++) {
+        serial[i] = pb2json(simulator.sample_read(i));
+    }
+    
+    vector<string> parallel(read_count);
+#pragma omp parallel for
+    for (size_t i = 0; i < read_count; i++) {
+        parallel[i] = pb2json(simulator.sample_read(i));
+    }
+    
+    // Going backward gives the same reads too
+    vector<string> backward(read_count);
+    for (size_t i = read_count; i > 0; i--) {
+        backward[i - 1] = pb2json(simulator.sample_read(i - 1));
+    }
+    
+    REQUIRE(parallel == serial);
+    REQUIRE(backward == serial);
+    // But not all the reads are the same
+    REQUIRE(serial[0] != serial[1]);
+    
+    remove(fastq_name.c_str());
+}
+
+}
+
+TEST_CASE( "NGSSimulator samples qualities and start positions like its training data", "[sampler]" ) {
+    
+    string graph_json = R"({
+        "node": [
+            {"id": 1, "sequence": "GATTACAGATTACAGATTACA"},
+            {"id": 2, "sequence": "C"},
+            {"id": 3, "sequence": "T"},
+            {"id": 4, "sequence": "CATTAGCATTAGCATTAGCC"},
+            {"id": 5, "sequence": "GGGGGGGGGGGG"}
+        ],
+        "edge": [
+            {"from": 1, "to": 2},
+            {"from": 1, "to": 3},
+            {"from": 2, "to": 4},
+            {"from": 3, "to": 4}
+        ],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "rank": 1},
+                {"position": {"node_id": 2}, "rank": 2},
+                {"position": {"node_id": 4}, "rank": 3}
+            ]}
+        ]
+    })";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    // The two kinds of reads differ at the middle base and the last base, on
+    // top of the same preceding qualities
+    string fastq_name = tmpfilename();
+    {
+        ofstream fastq(fastq_name);
+        for (size_t i = 0; i < 10; i++) {
+            fastq << "@read" << i << endl << "GATTACAGAT" << endl << "+" << endl
+                  << (i % 2 ? "IIIIIIIII5" : "IIIII5IIII") << endl;
+        }
+    }
+    
+    NGSSimulator simulator(xg_index, fastq_name, false, {"ref"}, 0.0, 0.0, 0.0,
+                           30.0, 1.0, 1.0, true, 1337);
+    
+    set<string> qualities;
+    for (size_t i = 0; i < 200; i++) {
+        Alignment aln = simulator.sample_read(i);
+        qualities.insert(aln.quality());
+        
+        // Reads only come from the path
+        for (size_t j = 0; j < aln.path().mapping_size(); j++) {
+            id_t node_id = aln.path().mapping(j).position().node_id();
+            REQUIRE(node_id != 3);
+            REQUIRE(node_id != 5);
+        }
+    }
+    
+    // Each place the qualities can go two ways is an even split, so we see
+    // all the combinations and nothing else
+    REQUIRE(qualities == set<string>({
+        string("IIIIIIIII5"), string("IIIII5IIII"), string("IIIIIIIIII"), string("IIIII5III5")
+    }));
+    
+    remove(fastq_name.c_str());
+}
+
 }
 
 }
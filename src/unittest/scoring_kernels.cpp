@@ -0,0 +1,52 @@
+//
+//  scoring_kernels.cpp
+//
+// Tests for the vectorized scoring kernels
+//
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "../scoring_kernels.hpp"
+#include "../utility.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("log_sum_exp matches summing in log space one value at a time", "[mapq][kernels]") {
+
+            SECTION("No values sum to the lowest double") {
+                REQUIRE(log_sum_exp(nullptr, 0) == numeric_limits<double>::lowest());
+            }
+
+            SECTION("One value sums to itself") {
+                double value = -12.5;
+                REQUIRE(log_sum_exp(&value, 1) == Approx(value));
+            }
+
+            SECTION("Sums of many spread out values stay accurate") {
+                // More values than a vector holds, with some far enough below the
+                // maximum to underflow
+                vector<double> values;
+                for (size_t i = 0; i < 37; i++) {
+                    values.push_back(50.0 - 31.0 * (i % 5) - 400.0 * (i % 3) + 0.25 * i);
+                }
+
+                double expected = numeric_limits<double>::lowest();
+                for (double value : values) {
+                    expected = add_log(expected, value);
+                }
+
+                REQUIRE(fabs(log_sum_exp(values.data(), values.size()) - expected) < 1e-12);
+            }
+
+            SECTION("Equal values add their counts") {
+                vector<double> values(10, 3.0);
+                REQUIRE(log_sum_exp(values.data(), values.size()) == Approx(3.0 + log(10.0)));
+            }
+        }
+    }
+}
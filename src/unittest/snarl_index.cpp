@@ -0,0 +1,118 @@
+//
+//  snarl_index.cpp
+//
+// Tests for the memory-mappable binary snarl index
+//
+
+#include <fstream>
+#include <cstdio>
+#include "../snarl_index.hpp"
+#include "../utility.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("A snarl index keeps the snarl tree and chains", "[snarls][snarlindex]") {
+
+            // Two bubbles in a chain, with a bubble nested in the first
+            VG graph;
+
+            Node* n1 = graph.create_node("GCA");
+            Node* n2 = graph.create_node("T");
+            Node* n3 = graph.create_node("G");
+            Node* n4 = graph.create_node("CTGA");
+            Node* n5 = graph.create_node("GCA");
+            Node* n6 = graph.create_node("T");
+            Node* n7 = graph.create_node("G");
+            Node* n8 = graph.create_node("CTGA");
+            Node* n9 = graph.create_node("A");
+
+            graph.create_edge(n1, n2);
+            graph.create_edge(n1, n6);
+            graph.create_edge(n2, n3);
+            graph.create_edge(n2, n4);
+            graph.create_edge(n3, n5);
+            graph.create_edge(n4, n5);
+            graph.create_edge(n5, n6);
+            graph.create_edge(n6, n7);
+            graph.create_edge(n6, n8);
+            graph.create_edge(n7, n9);
+            graph.create_edge(n8, n9);
+
+            SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+
+            string filename = tmpfilename();
+            {
+                ofstream out(filename);
+                SnarlIndex::write(snarl_manager, out);
+            }
+
+            REQUIRE(SnarlIndex::is_snarl_index(filename));
+            SnarlIndex index(filename);
+            REQUIRE(index.is_valid());
+
+            SECTION("The tree is stored") {
+                REQUIRE(index.snarl_count() == 3);
+                REQUIRE(index.chain_count() == 2);
+
+                // The root chain comes first and holds the two top-level snarls
+                REQUIRE(index.chain_parent(0) == SnarlIndex::NO_INDEX);
+                REQUIRE(index.chain_size(0) == 2);
+                REQUIRE(index.chain_size(1) == 1);
+
+                size_t child = index.chain_member(1, 0);
+                size_t parent = index.parent_of(child);
+                REQUIRE(parent != SnarlIndex::NO_INDEX);
+                REQUIRE(index.chain_parent(1) == parent);
+                REQUIRE(index.chain_of(parent) == 0);
+                REQUIRE(index.parent_of(parent) == SnarlIndex::NO_INDEX);
+
+                Snarl child_snarl = index.get_snarl(child);
+                REQUIRE(child_snarl.has_parent());
+                REQUIRE(child_snarl.parent().start() == index.get_snarl(parent).start());
+            }
+
+            SECTION("Boundaries can be looked up") {
+                for (size_t i = 0; i < index.snarl_count(); i++) {
+                    Snarl snarl = index.get_snarl(i);
+                    REQUIRE(index.into_which_snarl(snarl.start().node_id(), snarl.start().backward()) == i);
+                    REQUIRE(index.into_which_snarl(snarl.end().node_id(), !snarl.end().backward()) == i);
+                }
+                REQUIRE(index.into_which_snarl(n3->id(), false) == SnarlIndex::NO_INDEX);
+            }
+
+            SECTION("A SnarlManager can be made without recomputing chains") {
+                SnarlManager loaded = index.to_snarl_manager();
+                REQUIRE(loaded.top_level_snarls().size() == snarl_manager.top_level_snarls().size());
+                REQUIRE(loaded.chains_of(nullptr).size() == 1);
+                REQUIRE(loaded.chains_of(nullptr).front().size() == 2);
+                for (const Snarl* root : loaded.top_level_snarls()) {
+                    REQUIRE(*loaded.manage(*root) == *snarl_manager.manage(*root));
+                    REQUIRE(loaded.children_of(root).size() == snarl_manager.children_of(snarl_manager.manage(*root)).size());
+                    REQUIRE(loaded.chain_of(root) != nullptr);
+                }
+                REQUIRE(loaded.into_which_snarl(n1->id(), false) != nullptr);
+            }
+
+            SECTION("A Snarl stream is not a snarl index") {
+                string stream_filename = tmpfilename();
+                {
+                    ofstream out(stream_filename);
+                    vector<Snarl> buffer;
+                    snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                        buffer.push_back(*snarl);
+                    });
+                    stream::write_buffered(out, buffer, 0);
+                }
+                REQUIRE(!SnarlIndex::is_snarl_index(stream_filename));
+                REQUIRE(!SnarlIndex(stream_filename).is_valid());
+                remove(stream_filename.c_str());
+            }
+
+            remove(filename.c_str());
+        }
+    }
+}
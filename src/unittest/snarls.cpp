@@ -254,6 +254,30 @@ namespace vg {
                 }
             
             }
+            
+            SECTION( "A SnarlManager's net graph reuses its summary of the same connectivity" ) {
+                
+                vector<Snarl> all_snarls{top_snarl, nested_snarl1};
+                all_snarls.front().set_type(UNCLASSIFIED);
+                SnarlManager manager(all_snarls.begin(), all_snarls.end());
+                
+                NetGraph net_graph = manager.net_graph_of(manager.manage(top_snarl), &graph, true);
+                
+                unordered_set<pair<handle_t, handle_t>> edges;
+                for (auto& id : {1, 2, 8}) {
+                    handle_t handle = net_graph.get_handle(id, false);
+                    net_graph.follow_edges(handle, false, [&](const handle_t& other) {
+                        edges.insert(net_graph.edge_handle(handle, other));
+                    });
+                    net_graph.follow_edges(handle, true, [&](const handle_t& other) {
+                        edges.insert(net_graph.edge_handle(other, handle));
+                    });
+                }
+                
+                REQUIRE(edges.size() == 4);
+                REQUIRE(edges.count(net_graph.edge_handle(net_graph.get_handle(1, false),
+                    net_graph.get_handle(2, true))) == 1);
+            }
         
         }
         
@@ -2135,6 +2159,121 @@ namespace vg {
             }
         }
 
+        TEST_CASE("SnarlManager finds the same contents and visits through the HandleGraph interface", "[snarls]") {
+            
+            const string graph_json = R"(
+            {
+                "node": [
+                    {"id": 1, "sequence": "C"},
+                    {"id": 2, "sequence": "A"},
+                    {"id": 3, "sequence": "T"},
+                    {"id": 4, "sequence": "GGG"},
+                    {"id": 5, "sequence": "T"},
+                    {"id": 6, "sequence": "A"},
+                    {"id": 7, "sequence": "C"},
+                    {"id": 8, "sequence": "A"},
+                    {"id": 9, "sequence": "A"}
+                ],
+                "edge": [
+                    {"from": 1, "to": 2, "from_start": true},
+                    {"from": 1, "to": 6, "from_start": true},
+                    {"from": 2, "to": 3},
+                    {"from": 2, "to": 4},
+                    {"from": 3, "to": 5},
+                    {"from": 4, "to": 5},
+                    {"from": 5, "to": 6},
+                    {"from": 6, "to": 7},
+                    {"from": 6, "to": 8},
+                    {"from": 7, "to": 9},
+                    {"from": 8, "to": 9}
+                ]
+            }
+            )";
+            
+            VG graph;
+            Graph chunk;
+            json2pb(chunk, graph_json.c_str(), graph_json.size());
+            graph.extend(chunk);
+            
+            SnarlManager snarl_manager = CactusSnarlFinder(graph).find_snarls();
+            
+            // Get the IDs of the nodes found through VG
+            auto ids_of = [](const unordered_set<Node*>& nodes) {
+                set<id_t> ids;
+                for (Node* node : nodes) {
+                    ids.insert(node->id());
+                }
+                return ids;
+            };
+            
+            // And through the buffer
+            auto buffer_ids_of = [&](const SnarlContents& contents) {
+                set<id_t> ids;
+                for (auto& handle : contents.nodes) {
+                    ids.insert(graph.get_id(handle));
+                }
+                // Nothing is reported twice
+                REQUIRE(ids.size() == contents.nodes.size());
+                return ids;
+            };
+            
+            SECTION("Shallow and deep contents match the VG versions") {
+                SnarlContents contents;
+                snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                    for (bool include_boundary_nodes : {false, true}) {
+                        auto shallow = snarl_manager.shallow_contents(snarl, graph, include_boundary_nodes);
+                        snarl_manager.shallow_contents(snarl, graph, include_boundary_nodes, contents);
+                        REQUIRE(buffer_ids_of(contents) == ids_of(shallow.first));
+                        REQUIRE(contents.edges.size() == shallow.second.size());
+                        
+                        auto deep = snarl_manager.deep_contents(snarl, graph, include_boundary_nodes);
+                        snarl_manager.deep_contents(snarl, graph, include_boundary_nodes, contents);
+                        REQUIRE(buffer_ids_of(contents) == ids_of(deep.first));
+                        REQUIRE(contents.edges.size() == deep.second.size());
+                    }
+                });
+            }
+            
+            SECTION("Indexed deep contents match the VG version") {
+                snarl_manager.index_deep_contents(graph);
+                snarl_manager.for_each_snarl_preorder([&](const Snarl* snarl) {
+                    auto range = snarl_manager.deep_content_ids(snarl);
+                    set<id_t> indexed(range.first, range.second);
+                    REQUIRE(indexed.size() == range.second - range.first);
+                    REQUIRE(indexed == ids_of(snarl_manager.deep_contents(snarl, graph, false).first));
+                });
+            }
+            
+            SECTION("Unindexed snarls can't be looked up") {
+                const Snarl* snarl = snarl_manager.top_level_snarls().front();
+                REQUIRE_THROWS(snarl_manager.deep_content_ids(snarl));
+            }
+            
+            SECTION("Visits left and right match the VG versions") {
+                const HandleGraph& handle_graph = graph;
+                for (id_t id = 1; id <= 9; id++) {
+                    for (bool backward : {false, true}) {
+                        Visit visit;
+                        visit.set_node_id(id);
+                        visit.set_backward(backward);
+                        
+                        auto as_strings = [](const vector<Visit>& visits) {
+                            set<string> strings;
+                            for (auto& v : visits) {
+                                strings.insert(pb2json(v));
+                            }
+                            return strings;
+                        };
+                        
+                        REQUIRE(as_strings(snarl_manager.visits_right(visit, handle_graph, nullptr)) ==
+                                as_strings(snarl_manager.visits_right(visit, graph, nullptr)));
+                        REQUIRE(as_strings(snarl_manager.visits_left(visit, handle_graph, nullptr)) ==
+                                as_strings(snarl_manager.visits_left(visit, graph, nullptr)));
+                    }
+                }
+            }
+        }
+
         TEST_CASE("bubbles can be found when heads cannot reach tails", "[bubbles]") {
             
             // Build a toy graph
@@ -2919,6 +3058,120 @@ namespace vg {
             
         }
         
-        
+        TEST_CASE("snarls can be found one component at a time", "[snarls]") {
+    
+            // Two copies of the toy graph above, plus a lone node
+            const string graph_json = R"(
+            
+            {
+                "node": [
+                    {"id": 1, "sequence": "G"},
+                    {"id": 2, "sequence": "A"},
+                    {"id": 3, "sequence": "T"},
+                    {"id": 4, "sequence": "GGG"},
+                    {"id": 5, "sequence": "T"},
+                    {"id": 6, "sequence": "A"},
+                    {"id": 7, "sequence": "C"},
+                    {"id": 8, "sequence": "A"},
+                    {"id": 9, "sequence": "A"},
+                    {"id": 11, "sequence": "G"},
+                    {"id": 12, "sequence": "A"},
+                    {"id": 13, "sequence": "T"},
+                    {"id": 14, "sequence": "GGG"},
+                    {"id": 15, "sequence": "T"},
+                    {"id": 16, "sequence": "A"},
+                    {"id": 17, "sequence": "C"},
+                    {"id": 18, "sequence": "A"},
+                    {"id": 19, "sequence": "A"}
+                ],
+                "edge": [
+                    {"from": 1, "to": 2},
+                    {"from": 1, "to": 6},
+                    {"from": 2, "to": 3},
+                    {"from": 2, "to": 4},
+                    {"from": 3, "to": 5},
+                    {"from": 4, "to": 5},
+                    {"from": 5, "to": 6},
+                    {"from": 6, "to": 7},
+                    {"from": 6, "to": 8},
+                    {"from": 7, "to": 9},
+                    {"from": 8, "to": 9},
+                    {"from": 11, "to": 12},
+                    {"from": 11, "to": 16},
+                    {"from": 12, "to": 13},
+                    {"from": 12, "to": 14},
+                    {"from": 13, "to": 15},
+                    {"from": 14, "to": 15},
+                    {"from": 15, "to": 16},
+                    {"from": 16, "to": 17},
+                    {"from": 16, "to": 18},
+                    {"from": 17, "to": 19},
+                    {"from": 18, "to": 19}
+                ],
+                "path": [
+                    {"name": "hint", "mapping": [
+                        {"position": {"node_id": 1}, "rank" : 1 },
+                        {"position": {"node_id": 6}, "rank" : 2 },
+                        {"position": {"node_id": 8}, "rank" : 3 },
+                        {"position": {"node_id": 9}, "rank" : 4 }
+                    ]}
+                ]
+            }
+            
+            )";
+            
+            VG graph;
+            Graph chunk;
+            json2pb(chunk, graph_json.c_str(), graph_json.size());
+            graph.extend(chunk);
+            
+            // Collect the bounds and nesting depth of all the snarls, flipped
+            // to a consistent orientation
+            auto describe = [&](SnarlManager& snarl_manager) {
+                set<tuple<id_t, id_t, size_t>> found;
+                function<void(const Snarl*, size_t)> visit = [&](const Snarl* snarl, size_t depth) {
+                    if (snarl->start().node_id() > snarl->end().node_id()) {
+                        snarl_manager.flip(snarl);
+                    }
+                    found.emplace(snarl->start().node_id(), snarl->end().node_id(), depth);
+                    for (const Snarl* child : snarl_manager.children_of(snarl)) {
+                        visit(child, depth + 1);
+                    }
+                };
+                for (const Snarl* root : snarl_manager.top_level_snarls()) {
+                    visit(root, 0);
+                }
+                return found;
+            };
+            
+            SnarlManager by_component = ComponentCactusSnarlFinder(&graph, &graph.paths).find_snarls();
+            auto component_snarls = describe(by_component);
+            
+            SECTION("The snarls in both components are found") {
+                REQUIRE(by_component.top_level_snarls().size() == 4);
+                REQUIRE(component_snarls.size() == 6);
+                REQUIRE(component_snarls.count(make_tuple(1, 6, 0)));
+                REQUIRE(component_snarls.count(make_tuple(2, 5, 1)));
+                REQUIRE(component_snarls.count(make_tuple(16, 19, 0)));
+                REQUIRE(component_snarls.count(make_tuple(12, 15, 1)));
+            }
+            
+            SECTION("Chains are kept") {
+                for (const Snarl* root : by_component.top_level_snarls()) {
+                    REQUIRE(by_component.chain_of(root) != nullptr);
+                }
+            }
+            
+            SECTION("The same snarls are found as in the whole graph") {
+                SnarlManager whole = CactusSnarlFinder(graph).find_snarls();
+                REQUIRE(describe(whole) == component_snarls);
+            }
+            
+            SECTION("A lone node has no snarls and doesn't stop the rest") {
+                graph.create_node("GATTACA", 100);
+                SnarlManager with_lone = ComponentCactusSnarlFinder(&graph, &graph.paths).find_snarls();
+                REQUIRE(describe(with_lone) == component_snarls);
+            }
+        }
     }
 }
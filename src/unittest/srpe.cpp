@@ -0,0 +1,65 @@
+/** \file
+ * unittest/srpe.cpp: tests for collecting SV signals from reads
+ */
+
+#include "catch.hpp"
+#include "../srpe.hpp"
+
+namespace vg
+{
+namespace unittest
+{
+
+// Make a read matching 5 bases of a node and 2 of the next, optionally
+// soft-clipped on the left
+static Alignment make_signal_read(int64_t node_id, bool is_reverse, int clip){
+    Alignment aln;
+    Mapping* mapping = aln.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(node_id);
+    mapping->mutable_position()->set_is_reverse(is_reverse);
+    if (clip > 0){
+        Edit* edit = mapping->add_edit();
+        edit->set_to_length(clip);
+        edit->set_sequence(string(clip, 'A'));
+    }
+    Edit* edit = mapping->add_edit();
+    edit->set_from_length(5);
+    edit->set_to_length(5);
+    mapping = aln.mutable_path()->add_mapping();
+    mapping->mutable_position()->set_node_id(node_id + 1);
+    edit = mapping->add_edit();
+    edit->set_from_length(2);
+    edit->set_to_length(2);
+    return aln;
+}
+
+TEST_CASE("SV signals are collected in one pass", "[srpe]"){
+    SVSignalCollector collector;
+    collector.soft_clip_limit = 20;
+    collector.max_fragment_length = 500;
+
+    // A proper pair, a same-strand pair, and a pair with a long fragment
+    collector.add_pair(make_signal_read(1, false, 0), make_signal_read(1, true, 0));
+    collector.add_pair(make_signal_read(1, false, 0), make_signal_read(1, false, 0));
+    Alignment far = make_signal_read(1, false, 0);
+    far.add_fragment()->set_length(1000);
+    collector.add_pair(far, make_signal_read(1, true, 0));
+    // And a split read on its own
+    collector.add_read(make_signal_read(1, false, 30));
+    collector.finish();
+
+    REQUIRE(collector.signals[1].reads == 7);
+    REQUIRE(collector.signals[2].reads == 7);
+    REQUIRE(collector.signals[1].discordant == 4);
+    REQUIRE(collector.signals[1].split == 1);
+    REQUIRE(collector.signals[2].split == 0);
+    REQUIRE(collector.signals.count(3) == 0);
+
+    REQUIRE(collector.depth.get_depth(1, 4) == 7);
+    REQUIRE(collector.depth.get_depth(1, 5) == 0);
+    REQUIRE(collector.depth.get_depth(2, 1) == 7);
+    REQUIRE(collector.depth.get_depth(3, 0) == 0);
+}
+
+}
+}
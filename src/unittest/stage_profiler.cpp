@@ -0,0 +1,84 @@
+//
+//  stage_profiler.cpp
+//
+// Tests for the mapping stage timers and counters
+//
+
+#include <sstream>
+#include <thread>
+#include "../stage_profiler.hpp"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        TEST_CASE("StageProfiler totals the stages timed on every thread", "[profile]") {
+
+            StageProfiler::clear();
+
+            SECTION("Nothing is recorded when profiling is off") {
+                StageProfiler::set_enabled(false);
+                {
+                    StageTimer timer(MappingStage::Clustering);
+                    timer.add_items(3);
+                }
+                REQUIRE(StageProfiler::totals(MappingStage::Clustering).calls == 0);
+                REQUIRE(StageProfiler::totals(MappingStage::Clustering).items == 0);
+            }
+
+            SECTION("Timers on several threads add up") {
+                StageProfiler::set_enabled(true);
+                vector<thread> threads;
+                for (size_t i = 0; i < 4; i++) {
+                    threads.emplace_back([]() {
+                        for (size_t j = 0; j < 10; j++) {
+                            StageTimer timer(MappingStage::ClusterAlignment);
+                            timer.add_items(2);
+                        }
+                    });
+                }
+                for (auto& t : threads) {
+                    t.join();
+                }
+                StageProfiler::set_enabled(false);
+
+                StageProfiler::StageTotals totals = StageProfiler::totals(MappingStage::ClusterAlignment);
+                REQUIRE(totals.calls == 40);
+                REQUIRE(totals.items == 80);
+                REQUIRE(StageProfiler::totals(MappingStage::MEMs).calls == 0);
+            }
+
+            SECTION("A stopped timer records only once") {
+                StageProfiler::set_enabled(true);
+                {
+                    StageTimer timer(MappingStage::MappingQuality);
+                    timer.add_items(1);
+                    timer.stop();
+                    timer.add_items(5);
+                }
+                StageProfiler::set_enabled(false);
+
+                REQUIRE(StageProfiler::totals(MappingStage::MappingQuality).calls == 1);
+                REQUIRE(StageProfiler::totals(MappingStage::MappingQuality).items == 1);
+            }
+
+            SECTION("Every stage appears in the JSON") {
+                StageProfiler::set_enabled(true);
+                StageProfiler::record(MappingStage::Surjection, 2000000000, 7);
+                StageProfiler::set_enabled(false);
+
+                stringstream out;
+                StageProfiler::write_json(out);
+                string json = out.str();
+                for (size_t i = 0; i < (size_t) MappingStage::NumStages; i++) {
+                    REQUIRE(json.find(string("\"") + StageProfiler::stage_name((MappingStage) i) + "\"") != string::npos);
+                }
+                REQUIRE(json.find("\"surjection\": {\"calls\": 1, \"seconds\": 2, \"items\": 7}") != string::npos);
+            }
+
+            StageProfiler::clear();
+        }
+    }
+}
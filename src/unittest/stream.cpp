@@ -0,0 +1,122 @@
+//
+//  stream.cpp
+//
+// Tests for reading individual fields out of serialized protobuf messages
+//
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../stream.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        // Make an alignment with a bit of everything in it
+        static Alignment make_full_alignment() {
+            Alignment aln;
+            aln.set_name("read1");
+            aln.set_sequence("GATTACA");
+            aln.set_quality(string(7, (char) 30));
+            aln.set_mapping_quality(60);
+            aln.set_score(-3);
+            aln.set_identity(0.75);
+            aln.set_is_secondary(true);
+            for (int64_t node_id : {5, 6}) {
+                Mapping* mapping = aln.mutable_path()->add_mapping();
+                mapping->mutable_position()->set_node_id(node_id);
+                mapping->mutable_position()->set_offset(node_id == 5 ? 2 : 0);
+                mapping->set_rank(node_id - 4);
+                Edit* edit = mapping->add_edit();
+                edit->set_from_length(3);
+                edit->set_to_length(3);
+            }
+            aln.add_refpos()->set_name("ref");
+            return aln;
+        }
+
+        TEST_CASE("FieldView decodes only the fields asked for", "[stream]") {
+
+            Alignment aln = make_full_alignment();
+            string bytes = aln.SerializeAsString();
+            stream::FieldView view(bytes);
+
+            SECTION("Scalar fields can be read") {
+                REQUIRE(view.get_string(Alignment::kNameFieldNumber) == "read1");
+                REQUIRE(view.get_varint(Alignment::kMappingQualityFieldNumber) == 60);
+                REQUIRE((int32_t) view.get_varint(Alignment::kScoreFieldNumber) == -3);
+                REQUIRE(view.get_double(Alignment::kIdentityFieldNumber) == 0.75);
+                REQUIRE(view.get_varint(Alignment::kIsSecondaryFieldNumber) == 1);
+            }
+
+            SECTION("Missing fields get defaults") {
+                REQUIRE(!view.has(Alignment::kReadGroupFieldNumber));
+                REQUIRE(view.get_string(Alignment::kReadGroupFieldNumber).empty());
+                REQUIRE(view.get_varint(Alignment::kQueryPositionFieldNumber, 7) == 7);
+                REQUIRE(view.get_double(Alignment::kUniquenessFieldNumber, 0.5) == 0.5);
+                REQUIRE(!view.get_message(Alignment::kFragmentPrevFieldNumber).has(Alignment::kNameFieldNumber));
+            }
+
+            SECTION("Sub-messages can be viewed") {
+                stream::FieldView first_position = view.get_message(Alignment::kPathFieldNumber)
+                    .get_message(Path::kMappingFieldNumber)
+                    .get_message(Mapping::kPositionFieldNumber);
+                REQUIRE(first_position.get_varint(Position::kNodeIdFieldNumber) == 5);
+                REQUIRE(first_position.get_varint(Position::kOffsetFieldNumber) == 2);
+
+                vector<int64_t> node_ids;
+                view.get_message(Alignment::kPathFieldNumber).for_each_message(Path::kMappingFieldNumber,
+                                                                               [&](const stream::FieldView& mapping) {
+                    node_ids.push_back(mapping.get_message(Mapping::kPositionFieldNumber).get_varint(Position::kNodeIdFieldNumber));
+                });
+                REQUIRE(node_ids == vector<int64_t>({5, 6}));
+            }
+
+            SECTION("Fields can be projected into a message") {
+                Alignment projected;
+                REQUIRE(view.project({Alignment::kPathFieldNumber, Alignment::kScoreFieldNumber}, projected));
+                REQUIRE(projected.score() == -3);
+                REQUIRE(projected.path().SerializeAsString() == aln.path().SerializeAsString());
+                REQUIRE(projected.name().empty());
+                REQUIRE(projected.sequence().empty());
+                REQUIRE(projected.refpos_size() == 0);
+            }
+
+            SECTION("Corrupt messages are rejected") {
+                REQUIRE_THROWS(stream::FieldView(bytes.substr(0, bytes.size() - 3)));
+                REQUIRE_THROWS(stream::FieldView(bytes + string(1, (char) 0)));
+            }
+        }
+
+        TEST_CASE("SerializedMessages pass through streams unchanged", "[stream]") {
+
+            vector<Alignment> alns(10, make_full_alignment());
+            for (size_t i = 0; i < alns.size(); i++) {
+                alns[i].set_name("read" + to_string(i));
+            }
+
+            stringstream in;
+            {
+                vector<Alignment> buffer = alns;
+                stream::write_buffered(in, buffer, 0);
+            }
+
+            vector<stream::SerializedMessage> messages;
+            stream::for_each<stream::SerializedMessage>(in, [&](stream::SerializedMessage& message) {
+                messages.push_back(message);
+            });
+            REQUIRE(messages.size() == alns.size());
+            for (size_t i = 0; i < alns.size(); i++) {
+                REQUIRE(messages[i].bytes == alns[i].SerializeAsString());
+            }
+
+            stringstream out;
+            stream::write_buffered(out, messages, 0);
+            REQUIRE(out.str() == in.str());
+        }
+    }
+}
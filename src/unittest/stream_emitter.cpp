@@ -0,0 +1,108 @@
+//
+//  stream_emitter.cpp
+//
+// Tests for the background protobuf stream writer
+//
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../stream_emitter.hpp"
+#include "../vg.pb.h"
+
+#include "catch.hpp"
+
+namespace vg {
+    namespace unittest {
+        using namespace std;
+
+        // Read back the names of all the alignments in a stream
+        static vector<string> read_names(const string& data) {
+            vector<string> names;
+            stringstream in(data);
+            stream::for_each<Alignment>(in, [&](Alignment& aln) {
+                names.push_back(aln.name());
+            });
+            return names;
+        }
+
+        TEST_CASE("AsyncEmitter writes every batch it is given", "[stream]") {
+
+            stringstream out;
+            {
+                stream::AsyncEmitter<Alignment> emitter(out, false, 2, 4);
+
+#pragma omp parallel for schedule(dynamic)
+                for (size_t i = 0; i < 100; i++) {
+                    vector<Alignment> batch(i % 5);
+                    for (size_t j = 0; j < batch.size(); j++) {
+                        batch[j].set_name(to_string(i) + "." + to_string(j));
+                    }
+                    emitter.emit(std::move(batch));
+                }
+            }
+
+            auto names = read_names(out.str());
+
+            size_t expected = 0;
+            for (size_t i = 0; i < 100; i++) {
+                expected += i % 5;
+            }
+            REQUIRE(names.size() == expected);
+
+            // Each batch must come out contiguous and in its own order
+            for (size_t i = 0; i < names.size(); i++) {
+                size_t dot = names[i].find('.');
+                if (names[i].substr(dot + 1) != "0") {
+                    REQUIRE(i > 0);
+                    REQUIRE(names[i - 1].substr(0, dot + 1) == names[i].substr(0, dot + 1));
+                }
+            }
+        }
+
+        TEST_CASE("AsyncEmitter restores sequence order in ordered mode", "[stream]") {
+
+            stringstream out;
+            stream::AsyncEmitter<Alignment> emitter(out, true, 3, 2);
+
+#pragma omp parallel for schedule(dynamic)
+            for (size_t i = 0; i < 50; i++) {
+                // Hand in batches in a scrambled order
+                size_t sequence_number = (i % 2 == 0) ? i + 1 : i - 1;
+                if (sequence_number >= 50) {
+                    sequence_number = i;
+                }
+                vector<Alignment> batch(2);
+                batch[0].set_name(to_string(sequence_number * 2));
+                batch[1].set_name(to_string(sequence_number * 2 + 1));
+                emitter.emit(std::move(batch), sequence_number);
+            }
+            emitter.finish();
+
+            auto names = read_names(out.str());
+            REQUIRE(names.size() == 100);
+            for (size_t i = 0; i < names.size(); i++) {
+                REQUIRE(names[i] == to_string(i));
+            }
+        }
+
+        TEST_CASE("AsyncEmitter buffered emission only writes full buffers", "[stream]") {
+
+            stringstream out;
+            stream::AsyncEmitter<Alignment> emitter(out);
+
+            vector<Alignment> buffer(3);
+            for (auto& aln : buffer) {
+                aln.set_name("read");
+            }
+            emitter.emit_buffered(buffer, 5);
+            REQUIRE(buffer.size() == 3);
+
+            emitter.emit_buffered(buffer, 3);
+            REQUIRE(buffer.empty());
+
+            emitter.finish();
+            REQUIRE(read_names(out.str()).size() == 3);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+//
+//  suffix_array.cpp
+//
+// Tests for the SA-IS suffix array against brute force
+//
+
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "suffix_array.hpp"
+
+#include "catch.hpp"
+
+using namespace std;
+
+namespace vg {
+    namespace unittest {
+        
+        static string random_sa_string(default_random_engine& gen, const string& alphabet, size_t length) {
+            uniform_int_distribution<int> distr(0, alphabet.size() - 1);
+            string str;
+            for (size_t i = 0; i < length; i++) {
+                str.push_back(alphabet[distr(gen)]);
+            }
+            return str;
+        }
+        
+        TEST_CASE("Suffix array answers the same queries as a brute force search", "[suffix]") {
+            
+            random_device rd;
+            default_random_engine gen(rd());
+            uniform_int_distribution<int> len_distr(0, 40);
+            
+            // Reuse one suffix array for all the strings
+            SuffixArray suffix_array;
+            
+            for (string alphabet : {"AC", "ACGTN"}) {
+                for (int i = 0; i < 500; i++) {
+                    string str = random_sa_string(gen, alphabet, len_distr(gen));
+                    string query = random_sa_string(gen, alphabet, len_distr(gen) / 4);
+                    
+                    suffix_array.build(str.begin(), str.end());
+                    REQUIRE(suffix_array.size() == str.size());
+                    
+                    // Suffixes are sorted and the LCPs are right
+                    for (size_t rank = 1; rank < str.size(); rank++) {
+                        string prev = str.substr(suffix_array.suffix_at(rank - 1));
+                        string next = str.substr(suffix_array.suffix_at(rank));
+                        REQUIRE(prev < next);
+                        size_t lcp = 0;
+                        while (lcp < prev.size() && prev[lcp] == next[lcp]) {
+                            lcp++;
+                        }
+                        REQUIRE(suffix_array.lcp(rank) == lcp);
+                    }
+                    
+                    size_t overlap = 0;
+                    for (size_t len = 1; len <= min(str.size(), query.size()); len++) {
+                        if (str.compare(str.size() - len, len, query, 0, len) == 0) {
+                            overlap = len;
+                        }
+                    }
+                    REQUIRE(suffix_array.longest_overlap(query) == overlap);
+                    
+                    vector<size_t> locations;
+                    for (size_t j = 0; !query.empty() && j + query.size() <= str.size(); j++) {
+                        if (str.compare(j, query.size(), query) == 0) {
+                            locations.push_back(j);
+                        }
+                    }
+                    vector<size_t> found = suffix_array.substring_locations(query);
+                    sort(found.begin(), found.end());
+                    REQUIRE(found == locations);
+                }
+            }
+        }
+        
+        TEST_CASE("Suffix array handles hand-selected cases", "[suffix]") {
+            
+            string seq = "ACGTGACA";
+            SuffixArray suffix_array(seq.begin(), seq.end());
+            REQUIRE(suffix_array.longest_overlap("ACAGCCT") == 3);
+            REQUIRE(suffix_array.longest_overlap(seq) == seq.size());
+            REQUIRE(suffix_array.longest_overlap("") == 0);
+            REQUIRE(suffix_array.substring_locations("") == vector<size_t>());
+            
+            string empty = "";
+            SuffixArray empty_array(empty.begin(), empty.end());
+            REQUIRE(empty_array.size() == 0);
+            REQUIRE(empty_array.longest_overlap("ACGT") == 0);
+            REQUIRE(empty_array.substring_locations("A").empty());
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * \file
+ * unittest/translator.cpp: test cases for projecting paths through a Translator
+ */
+
+#include "catch.hpp"
+#include "../translator.hpp"
+#include "../json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+using namespace std;
+
+// Make a translation saying the to_length bases at the start of node to_id
+// came from node 1 at from_offset
+static Translation make_match_translation(id_t to_id, size_t from_offset, size_t length) {
+    Translation translation;
+    Mapping* from = translation.mutable_from()->add_mapping();
+    from->mutable_position()->set_node_id(1);
+    from->mutable_position()->set_offset(from_offset);
+    Edit* edit = from->add_edit();
+    edit->set_from_length(length);
+    edit->set_to_length(length);
+    Mapping* to = translation.mutable_to()->add_mapping();
+    to->mutable_position()->set_node_id(to_id);
+    edit = to->add_edit();
+    edit->set_from_length(length);
+    edit->set_to_length(length);
+    return translation;
+}
+
+TEST_CASE("Translator projects paths back into the base graph", "[translator]") {
+
+    for (id_t second_id : {11, 1000000}) {
+        // Node 1 of the base graph was divided into two nodes, with either
+        // dense IDs or sparse ones
+        Translator translator(vector<Translation>{make_match_translation(10, 0, 3),
+                                                  make_match_translation(second_id, 3, 2)});
+
+        Position position;
+        position.set_node_id(second_id);
+        REQUIRE(translator.has_translation(position));
+        position.set_node_id(12);
+        REQUIRE(!translator.has_translation(position));
+
+        position.set_node_id(second_id);
+        position.set_offset(1);
+        Position translated = translator.translate(position);
+        REQUIRE(translated.node_id() == 1);
+        REQUIRE(translated.offset() == 4);
+
+        // A path starting inside the first node and running into the second
+        string path_json = R"({"mapping": [
+            {"position": {"node_id": 10, "offset": 1}, "edit": [{"from_length": 1, "to_length": 1},
+                                                                {"from_length": 1, "to_length": 1}], "rank": 1},
+            {"position": {"node_id": )" + to_string(second_id) + R"(}, "edit": [{"from_length": 2, "to_length": 2}], "rank": 2}
+        ]})";
+        Path path;
+        json2pb(path, path_json.c_str(), path_json.size());
+
+        Path base_path = translator.translate(path);
+        REQUIRE(base_path.mapping_size() > 0);
+        REQUIRE(base_path.mapping(0).position().node_id() == 1);
+        REQUIRE(base_path.mapping(0).position().offset() == 1);
+        REQUIRE(path_from_length(base_path) == 4);
+        for (size_t i = 0; i < base_path.mapping_size(); i++) {
+            REQUIRE(base_path.mapping(i).position().node_id() == 1);
+        }
+    }
+}
+
+}
+}
@@ -119,6 +119,54 @@ ref	5	rs1337	A	G	29	PASS	.	GT	0/1
 
 }
 
+TEST_CASE( "Variants aligned in the same batch are all added", "[variantadder]" ) {
+
+    // Two SNPs whose contexts overlap, so they have to wait on each other
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##fileDate=20090805
+##source=myImputationProgramV3.1
+##reference=1000GenomesPilot-NCBI36
+##phasing=partial
+##FILTER=<ID=q10,Description="Quality below 10">
+##FILTER=<ID=s50,Description="Less than 50% of samples have data">
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT	SAMPLE1
+ref	5	rs1337	A	G	29	PASS	.	GT	0/1
+ref	33	rs1338	A	G	29	PASS	.	GT	0/1
+)";
+
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "GATTACAGATTACAGATTACAGATTACAGATTACAGATTACA"}],
+        "path": [
+            {"name": "ref", "mapping": [
+                {"position": {"node_id": 1}, "edit": [{"from_length": 42, "to_length": 42}]}
+            ]}
+        ]
+    })";
+    
+    for (size_t batch_size : {1, 256}) {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+    
+        Graph proto_graph;
+        json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+        VG graph;
+        graph.extend(proto_graph);
+        
+        VariantAdder adder(graph);
+        // Keep the variants out of each other's groups
+        adder.variant_range = 5;
+        adder.batch_size = batch_size;
+        adder.add_variants(&vcf);
+        
+        // Each SNP divides a reference node in 3 and adds an alt
+        REQUIRE(graph.size() == 7);
+        REQUIRE(graph.edge_count() == 8);
+    }
+
+}
+
 TEST_CASE( "A relatively long deletion can be added", "[variantadder]" ) {
 
     // We'll work on this tiny VCF
@@ -136,5 +136,78 @@ ref	18	rs1342	A	G	29	PASS	.	GT
     
 }
 
+TEST_CASE( "A prefetching VcfBuffer reads the same variants as a plain one", "[vcfbuffer][vcf]" ) {
+
+    auto vcf_data = R"(##fileformat=VCFv4.0
+##FORMAT=<ID=GT,Number=1,Type=String,Description="Genotype">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO	FORMAT	s1	s2
+ref	5	rs1337	A	G	29	PASS	.	GT	0|1	1|1
+ref	7	rs1338	A	G	29	PASS	.	GT	1|0	0|0
+ref	7	rs1339	A	T	29	PASS	.	GT	.|1	0/1
+ref2	8	rs1340	A	G	29	PASS	.	GT	0|0	1|0
+ref2	17	rs1341	A	G	29	PASS	.	GT	1|1	0|1
+)";
+
+    // Read all the variants from a fresh copy of the VCF through a buffer
+    auto read_ids = [&](size_t prefetch) {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        VcfBuffer buffer(&vcf, prefetch);
+        
+        vector<pair<string, long>> seen;
+        buffer.fill_buffer();
+        while (buffer.get() != nullptr) {
+            seen.emplace_back(buffer.get()->id, buffer.get()->position);
+            buffer.handle_buffer();
+            buffer.fill_buffer();
+        }
+        // Once we run out we stay out
+        buffer.fill_buffer();
+        REQUIRE(buffer.get() == nullptr);
+        return seen;
+    };
+    
+    auto plain = read_ids(0);
+    REQUIRE(plain.size() == 5);
+    // Positions are 0-based
+    REQUIRE(plain.front().second == 4);
+    
+    SECTION("a short prefetch queue sees the same variants") {
+        REQUIRE(read_ids(1) == plain);
+    }
+    
+    SECTION("a long prefetch queue sees the same variants") {
+        REQUIRE(read_ids(100) == plain);
+    }
+    
+    SECTION("a prefetching buffer can be destroyed before it is read through") {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        VcfBuffer buffer(&vcf, 1);
+        buffer.fill_buffer();
+        REQUIRE(buffer.get() != nullptr);
+        REQUIRE(buffer.get()->id == "rs1337");
+    }
+    
+    SECTION("prefetched variants have their genotypes parsed") {
+        std::stringstream vcf_stream(vcf_data);
+        vcflib::VariantCallFile vcf;
+        vcf.open(vcf_stream);
+        WindowedVcfBuffer buffer(&vcf, 10, 2);
+        
+        REQUIRE(buffer.next());
+        REQUIRE(buffer.next());
+        REQUIRE(buffer.next());
+        vcflib::Variant* current = get<1>(buffer.get());
+        REQUIRE(current->id == "rs1339");
+        auto& genotypes = buffer.get_parsed_genotypes(current);
+        REQUIRE(genotypes.size() == 2);
+        REQUIRE(genotypes[0] == vector<int>{vcflib::NULL_ALLELE, 1});
+        REQUIRE(genotypes[1] == vector<int>{0, 1});
+    }
+}
+
 }
 }
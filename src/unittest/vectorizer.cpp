@@ -0,0 +1,81 @@
+/**
+ * \file
+ * unittest/vectorizer.cpp: test cases for turning alignments into ML vectors
+ */
+
+#include "catch.hpp"
+#include "../vectorizer.hpp"
+#include "../json2pb.h"
+
+namespace vg {
+namespace unittest {
+
+TEST_CASE("Sparse vectors hold the nonzero entries of the dense ones", "[vectorize]") {
+
+    string graph_json = R"({
+        "node": [{"id": 1, "sequence": "GATT"}, {"id": 2, "sequence": "A"},
+                 {"id": 3, "sequence": "C"}, {"id": 4, "sequence": "CAT"}],
+        "edge": [{"from": 1, "to": 2}, {"from": 1, "to": 3}, {"from": 2, "to": 4}, {"from": 3, "to": 4}],
+        "path": [{"name": "ref", "mapping": [
+            {"position": {"node_id": 1}, "edit": [{"from_length": 4, "to_length": 4}], "rank": 1},
+            {"position": {"node_id": 2}, "edit": [{"from_length": 1, "to_length": 1}], "rank": 2},
+            {"position": {"node_id": 4}, "edit": [{"from_length": 3, "to_length": 3}], "rank": 3}
+        ]}]
+    })";
+    Graph graph;
+    json2pb(graph, graph_json.c_str(), graph_json.size());
+
+    // The vectorizer owns its index
+    Vectorizer vz(new xg::XG(graph));
+
+    // A read over the alt allele, with a mismatch on node 4
+    string aln_json = R"({"name": "read1", "sequence": "TTCGAT", "path": {"mapping": [
+        {"position": {"node_id": 1, "offset": 2}, "edit": [{"from_length": 2, "to_length": 2}], "rank": 1},
+        {"position": {"node_id": 3}, "edit": [{"from_length": 1, "to_length": 1}], "rank": 2},
+        {"position": {"node_id": 4}, "edit": [{"from_length": 1, "to_length": 1, "sequence": "G"},
+                                              {"from_length": 2, "to_length": 2}], "rank": 3}
+    ]}})";
+    Alignment aln;
+    json2pb(aln, aln_json.c_str(), aln_json.size());
+
+    SECTION("One-hot entries match the dense vector") {
+        bit_vector dense = vz.alignment_to_onehot(aln);
+        auto sparse = vz.alignment_to_sparse(aln);
+        vector<pair<size_t, double>> expected;
+        for (size_t i = 0; i < dense.size(); i++) {
+            if (dense[i]) {
+                expected.emplace_back(i, 1.0);
+            }
+        }
+        REQUIRE(sparse == expected);
+    }
+
+    SECTION("A-hot and identity-hot entries match the dense vectors") {
+        vector<int> a_hot = vz.alignment_to_a_hot(aln);
+        for (auto& entry : vz.alignment_to_sparse(aln, true, false)) {
+            REQUIRE(entry.second == a_hot[entry.first]);
+        }
+        vector<double> identity_hot = vz.alignment_to_identity_hot(aln);
+        auto sparse = vz.alignment_to_sparse(aln, false, true);
+        REQUIRE(sparse.size() == 3);
+        for (auto& entry : sparse) {
+            REQUIRE(entry.second == identity_hot[entry.first]);
+        }
+    }
+
+    SECTION("Sparse entries are formatted as libsvm and COO rows") {
+        vector<pair<size_t, double>> entries{{0, 1.0}, {3, 0.5}};
+        REQUIRE(vz.libsvm_row("2", entries) == "2 1:1 4:0.5");
+        REQUIRE(vz.coo_rows(7, entries) == "7\t0\t1\n7\t3\t0.5\n");
+        REQUIRE(vz.coo_rows(7, {}).empty());
+    }
+
+    SECTION("Class numbers start at 1 and are reused") {
+        REQUIRE(vz.wabbit_class("a") == 1);
+        REQUIRE(vz.wabbit_class("b") == 2);
+        REQUIRE(vz.wabbit_class("a") == 1);
+    }
+}
+
+}
+}
@@ -1758,6 +1758,141 @@ TEST_CASE("edit() should not get confused even under very confusing circumstance
     
 }
 
+TEST_CASE("edit() divides a node once for breakpoints from many paths", "[vg][edit]") {
+    
+    VG graph;
+    id_t original_id = graph.create_node("GATTACACATTAG")->id();
+    graph.paths.append_mapping("ref", original_id, 1);
+    
+    // Make a SNP path at each of a few offsets, each going along the whole node
+    vector<Path> paths;
+    for (size_t snp_offset : {2, 5, 9}) {
+        Path path;
+        Mapping* mapping = path.add_mapping();
+        mapping->mutable_position()->set_node_id(original_id);
+        mapping->set_rank(1);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(snp_offset);
+        edit->set_to_length(snp_offset);
+        edit = mapping->add_edit();
+        edit->set_from_length(1);
+        edit->set_to_length(1);
+        edit->set_sequence("C");
+        edit = mapping->add_edit();
+        edit->set_from_length(13 - snp_offset - 1);
+        edit->set_to_length(13 - snp_offset - 1);
+        paths.push_back(path);
+    }
+    
+    vector<Translation> translations = graph.edit(paths);
+    
+    // The node is in 7 pieces, with a new node for each SNP
+    REQUIRE(graph.node_count() == 10);
+    
+    // The reference path still spells the same thing
+    REQUIRE(graph.path_sequence(graph.paths.path("ref")) == "GATTACACATTAG");
+    
+    // The forward translations of the pieces cover all of the original node
+    map<size_t, size_t> covered;
+    for (auto& translation : translations) {
+        if (translation.from().mapping_size() == 0 ||
+            translation.from().mapping(0).position().node_id() != original_id ||
+            translation.from().mapping(0).position().is_reverse() ||
+            !mapping_is_match(translation.from().mapping(0))) {
+            continue;
+        }
+        const Mapping& from = translation.from().mapping(0);
+        covered[from.position().offset()] = mapping_from_length(from);
+    }
+    vector<size_t> starts;
+    size_t next = 0;
+    for (auto& piece : covered) {
+        REQUIRE(piece.first == next);
+        starts.push_back(piece.first);
+        next += piece.second;
+    }
+    REQUIRE(next == 13);
+    REQUIRE(starts == vector<size_t>({0, 2, 3, 5, 6, 9, 10}));
+}
+
+TEST_CASE("Graphs saved in many chunks on many threads load back the same", "[vg][serialize]") {
+    
+    VG graph;
+    string sequence;
+    Node* prev = nullptr;
+    for (size_t i = 0; i < 100; i++) {
+        Node* node = graph.create_node(string(1 + i % 5, "ACGT"[i % 4]));
+        sequence += node->sequence();
+        if (prev != nullptr) {
+            graph.create_edge(prev, node);
+        }
+        graph.paths.append_mapping("ref", node->id(), i + 1);
+        prev = node;
+    }
+    graph.paths.create_path("empty");
+    
+    int thread_count = get_thread_count();
+    omp_set_num_threads(4);
+    
+    for (size_t chunk_bytes : {size_t(1), size_t(4 * 1024 * 1024)}) {
+        stringstream saved;
+        graph.serialize_to_ostream(saved, 7, chunk_bytes);
+        VG loaded(saved);
+        
+        REQUIRE(loaded.node_count() == graph.node_count());
+        REQUIRE(loaded.edge_count() == graph.edge_count());
+        REQUIRE(loaded.paths.has_path("empty"));
+        REQUIRE(loaded.path_sequence(loaded.paths.path("ref")) == sequence);
+    }
+    
+    omp_set_num_threads(thread_count);
+}
+
+TEST_CASE("divide_node() keeps paths on both strands in order and indexed", "[vg][divide]") {
+    
+    VG graph;
+    Node* before = graph.create_node("AA");
+    Node* node = graph.create_node("GATTACA");
+    Node* after = graph.create_node("TT");
+    graph.create_edge(before, node);
+    graph.create_edge(node, after);
+    
+    graph.paths.append_mapping("fwd", before->id(), 1);
+    graph.paths.append_mapping("fwd", node->id(), 2);
+    graph.paths.append_mapping("fwd", after->id(), 3);
+    graph.paths.append_mapping("rev", after->id(), 1, true);
+    graph.paths.append_mapping("rev", node->id(), 2, true);
+    graph.paths.append_mapping("rev", before->id(), 3, true);
+    id_t divided_id = node->id();
+    
+    vector<int> positions{2, 5};
+    vector<Node*> parts;
+    graph.divide_node(node, positions, parts);
+    REQUIRE(parts.size() == 3);
+    
+    // Both paths still spell the same thing
+    REQUIRE(graph.path_sequence(graph.paths.path("fwd")) == "AAGATTACATT");
+    REQUIRE(graph.path_sequence(graph.paths.path("rev")) == "AATGTAATCTT");
+    
+    // Nothing is left on the old node
+    REQUIRE(!graph.paths.has_node_mapping(divided_id));
+    
+    for (auto& name : {string("fwd"), string("rev")}) {
+        // Walking each path through the indexes visits every mapping in order
+        list<Mapping>& path = graph.paths.get_path(name);
+        REQUIRE(path.size() == 5);
+        Mapping* here = &path.front();
+        for (auto& m : path) {
+            REQUIRE(here == &m);
+            REQUIRE(graph.paths.mapping_path_name(here) == name);
+            REQUIRE(graph.paths.get_node_mapping(m.position().node_id())[name].count(here));
+            here = graph.paths.traverse_right(here);
+        }
+        REQUIRE(here == nullptr);
+        REQUIRE(graph.paths.traverse_left(&path.front()) == nullptr);
+    }
+}
+
 TEST_CASE("is_directed_acyclic() should return whether the graph is directed acyclic", "[vg][cycles]") {
     
     SECTION("is_directed_acyclic() works on a single node") {
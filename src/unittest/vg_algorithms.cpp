@@ -14,8 +14,10 @@
 #include "algorithms/extract_extending_graph.hpp"
 #include "algorithms/topological_sort.hpp"
 #include "algorithms/weakly_connected_components.hpp"
+#include "algorithms/is_directed_acyclic.hpp"
 #include "algorithms/distance_to_head.hpp"
 #include "algorithms/distance_to_tail.hpp"
+#include "algorithms/xdrop_extension.hpp"
 #include "vg.hpp"
 #include "json2pb.h"
 
@@ -55,6 +57,18 @@ namespace vg {
             vg.create_edge(n1, n2);
             vg.create_edge(n2, n3);
             vg.create_edge(n2, n4);
+            SECTION( "algorithms::weakly_connected_component_ranks numbers components in ID order" ) {
+                auto components = algorithms::weakly_connected_component_ranks(&vg);
+                
+                REQUIRE(components.component_count == 2);
+                for (Node* node : {n0, n1, n2, n3, n4}) {
+                    REQUIRE(components.component(node->id()) == 0);
+                }
+                for (Node* node : {n5, n6, n7, n8, n9}) {
+                    REQUIRE(components.component(node->id()) == 1);
+                }
+            }
+            
             vg.create_edge(n3, n5);
             vg.create_edge(n4, n5);
             vg.create_edge(n5, n6);
@@ -1941,6 +1955,39 @@ namespace vg {
                     REQUIRE(found_edge_1);
                 }
             }
+            
+            SECTION("Reusing scratch space gives the same graphs as extracting without it") {
+                
+                // the order of nodes and edges isn't specified, so compare them as sets
+                auto contents = [](const Graph& g) {
+                    set<string> found;
+                    for (int i = 0; i < g.node_size(); i++) {
+                        found.insert("n" + to_string(g.node(i).id()) + g.node(i).sequence());
+                    }
+                    for (int i = 0; i < g.edge_size(); i++) {
+                        const Edge& e = g.edge(i);
+                        found.insert("e" + to_string(e.from()) + (e.from_start() ? "-" : "+")
+                                     + to_string(e.to()) + (e.to_end() ? "-" : "+"));
+                    }
+                    return found;
+                };
+                
+                algorithms::ConnectingGraphScratch scratch;
+                for (int64_t max_len : {3, 6, 10, 40}) {
+                    for (int option = 0; option < 4; option++) {
+                        Graph g, scratch_g;
+                        pos_t pos_1 = make_pos_t(n1->id(), false, 1);
+                        pos_t pos_2 = make_pos_t(n6->id(), false, 0);
+                        auto trans = algorithms::extract_connecting_graph(&vg, g, max_len, pos_1, pos_2, false, true,
+                                                                          option >= 1, option >= 2, option >= 3);
+                        auto scratch_trans = algorithms::extract_connecting_graph(&vg, scratch_g, max_len, pos_1, pos_2,
+                                                                                  scratch, false, true,
+                                                                                  option >= 1, option >= 2, option >= 3);
+                        REQUIRE(contents(scratch_g) == contents(g));
+                        REQUIRE(scratch_trans == trans);
+                    }
+                }
+            }
         }
         
         TEST_CASE( "Containing graph extraction algorithm produces expected results", "[algorithms]" ) {
@@ -2908,6 +2955,41 @@ namespace vg {
             
             }
         }
+        TEST_CASE( "Topological sort can work one component at a time",
+                  "[algorithms][topologicalsort]" ) {
+            
+            // One component with dense IDs and one with sparse IDs
+            string graph_json = R"(
+            {"node": [{"id": 1, "sequence": "GAT"}, {"id": 2, "sequence": "T"}, {"id": 3, "sequence": "ACA"},
+                      {"id": 1000, "sequence": "CAT"}, {"id": 5000, "sequence": "G"}, {"id": 9000, "sequence": "TAG"}],
+             "edge": [{"from": 1, "to": 2}, {"from": 2, "to": 3}, {"from": 9000, "to": 5000}, {"from": 5000, "to": 1000}]}
+            )";
+            
+            Graph proto_graph;
+            json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+            VG vg;
+            vg.extend(proto_graph);
+            
+            vector<id_t> expected{1, 2, 3, 9000, 5000, 1000};
+            
+            SECTION( "Sorting by component matches sorting the whole graph" ) {
+                for (auto& handle_sort : {algorithms::topological_sort(&vg), algorithms::topological_sort_by_component(&vg)}) {
+                    vector<id_t> order;
+                    for (auto& handle : handle_sort) {
+                        REQUIRE(!vg.get_is_reverse(handle));
+                        order.push_back(vg.get_id(handle));
+                    }
+                    REQUIRE(order == expected);
+                }
+            }
+            
+            SECTION( "algorithms::is_directed_acyclic finds cycles among sparse IDs" ) {
+                REQUIRE(algorithms::is_directed_acyclic(&vg));
+                vg.create_edge(vg.get_node(1000), vg.get_node(9000));
+                REQUIRE(!algorithms::is_directed_acyclic(&vg));
+            }
+        }
+        
         TEST_CASE("distance_to_head() using HandleGraph produces expected results", "[vg]") {
             VG vg;
             Node* n0 = vg.create_node("AA");
@@ -3249,6 +3331,86 @@ namespace vg {
             }
         }
 
+        TEST_CASE("xdrop_extend_ungapped() finds the best ungapped alignment through a graph", "[algorithms][xdrop]") {
+            VG vg;
+            Node* n1 = vg.create_node("GATTACA");
+            Node* n2 = vg.create_node("CTG");
+            Node* n3 = vg.create_node("CAG");
+            Node* n4 = vg.create_node("TTT");
+            vg.create_edge(n1, n2);
+            vg.create_edge(n1, n3);
+            vg.create_edge(n2, n4);
+            vg.create_edge(n3, n4);
+            
+            SECTION("An exact match through a bubble gets the end bonus") {
+                auto extension = algorithms::xdrop_extend_ungapped(&vg, make_pos_t(n1->id(), false, 4), false,
+                                                                   "ACACTGTTT", 1, 4, 5, 6);
+                REQUIRE(extension.complete);
+                REQUIRE(!extension.tied);
+                REQUIRE(extension.length == 9);
+                REQUIRE(extension.mismatches == 0);
+                REQUIRE(extension.score == 14);
+                REQUIRE(extension.path.mapping_size() == 3);
+                REQUIRE(extension.path.mapping(0).position().node_id() == n1->id());
+                REQUIRE(extension.path.mapping(0).position().offset() == 4);
+                REQUIRE(extension.path.mapping(1).position().node_id() == n2->id());
+                REQUIRE(extension.path.mapping(2).position().node_id() == n4->id());
+            }
+            
+            SECTION("Mismatches are recorded as substitutions on the best branch") {
+                auto extension = algorithms::xdrop_extend_ungapped(&vg, make_pos_t(n1->id(), false, 4), false,
+                                                                   "ACACTCTTT", 1, 4, 5, 6);
+                REQUIRE(extension.complete);
+                REQUIRE(!extension.tied);
+                REQUIRE(extension.length == 9);
+                REQUIRE(extension.mismatches == 1);
+                REQUIRE(extension.score == 9);
+                const Mapping& mapping = extension.path.mapping(1);
+                REQUIRE(mapping.position().node_id() == n2->id());
+                REQUIRE(mapping.edit_size() == 2);
+                REQUIRE(mapping.edit(1).from_length() == 1);
+                REQUIRE(mapping.edit(1).to_length() == 1);
+                REQUIRE(mapping.edit(1).sequence() == "C");
+            }
+            
+            SECTION("Equally good branches are reported as a tie") {
+                auto extension = algorithms::xdrop_extend_ungapped(&vg, make_pos_t(n1->id(), false, 4), false,
+                                                                   "ACAC", 1, 4, 5, 6);
+                REQUIRE(extension.tied);
+                REQUIRE(extension.length == 4);
+            }
+            
+            SECTION("The extension stops where the score drops too far") {
+                auto extension = algorithms::xdrop_extend_ungapped(&vg, make_pos_t(n1->id(), false, 4), false,
+                                                                   "ACAGGGGGGGGGG", 1, 4, 5, 6);
+                REQUIRE(extension.complete);
+                REQUIRE(extension.length == 3);
+                REQUIRE(extension.score == 3);
+                REQUIRE(extension.path.mapping_size() == 1);
+            }
+            
+            SECTION("A backward extension ends just before the position") {
+                auto extension = algorithms::xdrop_extend_ungapped(&vg, make_pos_t(n2->id(), false, 1), true,
+                                                                   "TAC", 1, 4, 5, 6);
+                REQUIRE(extension.length == 3);
+                REQUIRE(extension.mismatches == 1);
+                REQUIRE(extension.score == 3);
+                REQUIRE(extension.path.mapping_size() == 2);
+                REQUIRE(extension.path.mapping(0).position().node_id() == n1->id());
+                REQUIRE(!extension.path.mapping(0).position().is_reverse());
+                REQUIRE(extension.path.mapping(0).position().offset() == 5);
+                REQUIRE(extension.path.mapping(0).edit(0).sequence() == "T");
+                REQUIRE(extension.path.mapping(1).position().node_id() == n2->id());
+                REQUIRE(extension.path.mapping(1).position().offset() == 0);
+            }
+            
+            SECTION("Ns make the search incomplete") {
+                auto extension = algorithms::xdrop_extend_ungapped(&vg, make_pos_t(n1->id(), false, 4), false,
+                                                                   "ACNCTG", 1, 4, 5, 6);
+                REQUIRE(!extension.complete);
+            }
+        }
+
         
 }
     
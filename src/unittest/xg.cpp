@@ -8,7 +8,10 @@
 #include "vg.hpp"
 #include "xg.hpp"
 #include "graph.hpp"
+#include "utility.hpp"
+#include <sstream>
 #include <stdio.h>
+#include <unistd.h>
 
 namespace vg {
     namespace unittest {
@@ -664,5 +667,735 @@ TEST_CASE("Path component memoization produces expected results", "[xg]") {
     }
 }
 
+TEST_CASE("An xg index loaded through a memory mapping matches the original", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"TTG"}],
+    "edge":[{"to":2,"from":1},{"to":3,"from":1},{"to":3,"from":2}],
+    "path":[{"name":"ref","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":3},"rank":2}]}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    // Save the index to a temporary file
+    string filename = find_temp_dir() + "/vg-unittest-xg-XXXXXX";
+    int fd = mkstemp(&filename[0]);
+    REQUIRE(fd != -1);
+    close(fd);
+    {
+        ofstream out(filename);
+        xg_index.serialize(out);
+    }
+    
+    xg::XG mapped_index;
+    mapped_index.load_mapped(filename);
+    unlink(filename.c_str());
+    
+    REQUIRE(mapped_index.node_count == xg_index.node_count);
+    REQUIRE(mapped_index.edge_count == xg_index.edge_count);
+    REQUIRE(mapped_index.node_sequence(1) == "GATT");
+    REQUIRE(mapped_index.node_sequence(3) == "TTG");
+    REQUIRE(mapped_index.has_edge(1, false, 3, false));
+    REQUIRE(mapped_index.path_length("ref") == 7);
+    REQUIRE(mapped_index.node_at_path_position("ref", 5) == 3);
+
+}
+
+TEST_CASE("Batch node queries on an xg index agree with single lookups", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"TTG"}],
+    "edge":[{"to":2,"from":1},{"to":3,"from":1},{"to":3,"from":2,"to_end":true}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    vector<int64_t> ids{1, 2, 3};
+    
+    SECTION("Sequences come out concatenated in query order") {
+        string sequences;
+        vector<size_t> starts;
+        xg_index.get_sequences(ids, sequences, starts);
+        
+        REQUIRE(sequences == "GATTACATTG");
+        REQUIRE(starts == vector<size_t>({0, 4, 7, 10}));
+    }
+    
+    SECTION("Adjacencies match follow_edges") {
+        vector<handle_t> left, right;
+        vector<size_t> left_starts, right_starts;
+        xg_index.get_adjacencies(ids, left, left_starts, right, right_starts);
+        
+        REQUIRE(left_starts.size() == ids.size() + 1);
+        REQUIRE(right_starts.size() == ids.size() + 1);
+        
+        for (size_t i = 0; i < ids.size(); i++) {
+            handle_t handle = xg_index.get_handle(ids[i], false);
+            for (bool go_left : {true, false}) {
+                vector<handle_t> expected;
+                xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+                    expected.push_back(next);
+                    return true;
+                });
+                auto& found = go_left ? left : right;
+                auto& starts = go_left ? left_starts : right_starts;
+                vector<handle_t> batched(found.begin() + starts[i], found.begin() + starts[i + 1]);
+                REQUIRE(batched == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("Rank-keyed path position callbacks agree with the name-keyed queries", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"ACA"},
+    {"id":3,"sequence":"TTG"},
+    {"id":4,"sequence":"C"}],
+    "edge":[{"to":2,"from":1},{"to":3,"from":1},{"to":3,"from":2},{"to":4,"from":3}],
+    "path":[
+    {"name":"alt","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":3},"rank":2}]},
+    {"name":"ref","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":2},"rank":2},{"position":{"node_id":3},"rank":3}]}
+    ]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    SECTION("Offsets come out by path rank") {
+        for (int64_t id : {1, 2, 3}) {
+            for (bool rev : {false, true}) {
+                pos_t pos = make_pos_t(id, rev, 1);
+                map<string, vector<pair<size_t, bool> > > by_rank;
+                xg_index.for_each_offset_in_paths(pos, [&](size_t rank, size_t off, bool is_rev) {
+                    by_rank[xg_index.path_name(rank)].push_back(make_pair(off, is_rev));
+                });
+                REQUIRE(by_rank == xg_index.offsets_in_paths(pos));
+                
+                map<string, vector<size_t> > positions;
+                xg_index.for_each_position_in_paths(id, rev, 1, [&](size_t rank, size_t p) {
+                    positions[xg_index.path_name(rank)].push_back(p);
+                });
+                REQUIRE(positions == xg_index.position_in_paths(id, rev, 1));
+            }
+        }
+        
+        vector<size_t> ranks;
+        xg_index.for_each_offset_in_paths(make_pos_t(3, false, 0), [&](size_t rank, size_t off, bool is_rev) {
+            ranks.push_back(rank);
+            REQUIRE(off == (rank == xg_index.path_rank("ref") ? 7 : 4));
+            REQUIRE(!is_rev);
+        });
+        REQUIRE(ranks == vector<size_t>({xg_index.path_rank("alt"), xg_index.path_rank("ref")}));
+    }
+    
+    SECTION("Nodes off the paths find the nearest path position") {
+        REQUIRE(!xg_index.node_on_any_path(4));
+        REQUIRE(xg_index.node_on_any_path(2));
+        size_t found = 0;
+        xg_index.for_each_nearest_offset_in_paths(make_pos_t(4, false, 0), 10, [&](size_t rank, size_t off, bool is_rev) {
+            found++;
+        });
+        REQUIRE(found == xg_index.nearest_offsets_in_paths(make_pos_t(4, false, 0), 10).size());
+        REQUIRE(found == 2);
+    }
+    
+    SECTION("Minimum path distance matches the full distance query") {
+        REQUIRE(xg_index.min_distance_in_paths(3, false, 0, 1, false, 0) == 4);
+        REQUIRE(xg_index.min_distance_in_paths(3, false, 0, 1, true, 0) ==
+                (int64_t) std::numeric_limits<size_t>::max());
+    }
+}
+
+TEST_CASE("Sampled path position lookups agree with unsampled ones", "[xg]") {
+
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"A"},
+    {"id":3,"sequence":"TTGCA"},
+    {"id":4,"sequence":"CC"}],
+    "edge":[{"to":2,"from":1},{"to":3,"from":2},{"to":4,"from":3},{"to":3,"from":4,"to_end":true}],
+    "path":[{"name":"ref","mapping":[{"position":{"node_id":1},"rank":1},{"position":{"node_id":2},"rank":2},
+                                     {"position":{"node_id":3},"rank":3},{"position":{"node_id":4},"rank":4},
+                                     {"position":{"node_id":3,"is_reverse":true},"rank":5}]}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG plain(proto_graph);
+    
+    for (size_t rate : {1, 2, 3, 7, 100}) {
+        xg::XG sampled;
+        sampled.path_sample_rate = rate;
+        sampled.from_graph(proto_graph);
+        
+        // and a copy that went through serialization
+        stringstream stream;
+        sampled.serialize(stream);
+        xg::XG loaded;
+        loaded.load(stream);
+        REQUIRE(loaded.get_path("ref").sample_rate == rate);
+        
+        for (size_t pos = 0; pos < plain.path_length("ref"); pos++) {
+            for (xg::XG* index : {&sampled, &loaded}) {
+                REQUIRE(index->node_at_path_position("ref", pos) == plain.node_at_path_position("ref", pos));
+                REQUIRE(index->graph_pos_at_path_position("ref", pos) == plain.graph_pos_at_path_position("ref", pos));
+                Mapping m = index->mapping_at_path_position("ref", pos);
+                Mapping expected = plain.mapping_at_path_position("ref", pos);
+                REQUIRE(m.position().node_id() == expected.position().node_id());
+                REQUIRE(m.position().is_reverse() == expected.position().is_reverse());
+                REQUIRE(m.rank() == expected.rank());
+            }
+        }
+    }
+}
+
+TEST_CASE("Packed xg sequences keep N and IUPAC codes", "[xg]") {
+
+    vector<string> sequences{"GATTACAGATTACAGATTACAGATTACAGATTACAGATTACA", "ACNNRT", "CATTAGYGCAK", "A"};
+    Graph proto_graph;
+    for (size_t i = 0; i < sequences.size(); i++) {
+        Node* node = proto_graph.add_node();
+        node->set_id(i + 1);
+        node->set_sequence(sequences[i]);
+    }
+    // pos_substr looks for the start of the next node, so put one after the rest
+    Node* last = proto_graph.add_node();
+    last->set_id(sequences.size() + 1);
+    last->set_sequence("GGG");
+    xg::XG xg_index(proto_graph);
+    
+    stringstream stream;
+    xg_index.serialize(stream);
+    xg::XG loaded;
+    loaded.load(stream);
+    
+    for (xg::XG* index : {&xg_index, &loaded}) {
+        for (size_t i = 0; i < sequences.size(); i++) {
+            const string& seq = sequences[i];
+            int64_t id = i + 1;
+            REQUIRE(index->node_sequence(id) == seq);
+            
+            for (bool is_rev : {false, true}) {
+                handle_t handle = index->get_handle(id, is_rev);
+                string expected = is_rev ? reverse_complement(seq) : seq;
+                REQUIRE(index->get_sequence(handle) == expected);
+                string buffer(seq.size(), 'x');
+                index->copy_sequence(handle, &buffer[0]);
+                REQUIRE(buffer == expected);
+                
+                for (size_t off = 0; off < seq.size(); off++) {
+                    REQUIRE(index->pos_char(id, is_rev, off) == expected[off]);
+                    REQUIRE(index->pos_substr(id, is_rev, off, 3) == expected.substr(off, 3));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Threads inserted into a DAG come back out by name", "[xg][gpbwt]") {
+
+    // Two bubbles in a row
+    Graph proto_graph;
+    for (int64_t id = 1; id <= 6; id++) {
+        Node* node = proto_graph.add_node();
+        node->set_id(id);
+        node->set_sequence("GAT");
+    }
+    for (auto& edge : vector<pair<int64_t, int64_t>>{{1, 2}, {1, 3}, {2, 4}, {3, 4}, {4, 5}, {4, 6}}) {
+        Edge* e = proto_graph.add_edge();
+        e->set_from(edge.first);
+        e->set_to(edge.second);
+    }
+    xg::XG xg_index(proto_graph);
+    
+    auto make_thread = [](const vector<int64_t>& ids) {
+        xg::XG::thread_t thread;
+        for (auto id : ids) {
+            thread.push_back({id, false});
+        }
+        return thread;
+    };
+    vector<xg::XG::thread_t> threads{make_thread({1, 2, 4, 5}), make_thread({1, 3, 4, 6}),
+                                     make_thread({2, 4, 5}), make_thread({1, 2, 4, 6}),
+                                     make_thread({3, 4})};
+    vector<string> names{"_thread_A_x_0_0", "_thread_A_x_1_0", "_thread_B_x_0_0",
+                         "_thread_B_x_1_0", "_thread_C_x_0_0"};
+    xg_index.insert_threads_into_dag(threads, names);
+    
+    auto same_ids = [](const xg::XG::thread_t& a, const xg::XG::thread_t& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].node_id != b[i].node_id) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    SECTION("Every thread is extracted under its own name") {
+        auto forward = xg_index.extract_threads(false);
+        auto reverse = xg_index.extract_threads(true);
+        REQUIRE(forward.size() == names.size());
+        REQUIRE(reverse.size() == names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            REQUIRE(forward[names[i]].size() == 1);
+            REQUIRE(same_ids(forward[names[i]].front(), threads[i]));
+            REQUIRE(reverse[names[i]].size() == 1);
+            xg::XG::thread_t backward(threads[i].rbegin(), threads[i].rend());
+            REQUIRE(same_ids(reverse[names[i]].front(), backward));
+            for (auto& mapping : reverse[names[i]].front()) {
+                REQUIRE(mapping.is_reverse);
+            }
+        }
+    }
+    
+    SECTION("Threads can be extracted by name prefix") {
+        auto found = xg_index.extract_threads_matching("_thread_B", false);
+        REQUIRE(found.size() == 2);
+        REQUIRE(same_ids(found["_thread_B_x_0_0"].front(), threads[2]));
+        REQUIRE(same_ids(found["_thread_B_x_1_0"].front(), threads[3]));
+    }
+}
+
+TEST_CASE("The xg edge cache gives the same neighbors as decoding", "[xg]") {
+
+    // A chain with some reversing edges, and a hub with too many neighbors
+    // to cache
+    Graph proto_graph;
+    for (int64_t id = 1; id <= 20; id++) {
+        Node* node = proto_graph.add_node();
+        node->set_id(id);
+        node->set_sequence("GATTACA");
+    }
+    auto add_edge = [&](int64_t from, int64_t to, bool from_start, bool to_end) {
+        Edge* edge = proto_graph.add_edge();
+        edge->set_from(from);
+        edge->set_to(to);
+        edge->set_from_start(from_start);
+        edge->set_to_end(to_end);
+    };
+    for (int64_t id = 1; id < 20; id++) {
+        add_edge(id, id + 1, false, false);
+    }
+    add_edge(3, 5, false, true);
+    add_edge(6, 8, true, false);
+    add_edge(9, 9, false, true);
+    for (int64_t id = 12; id <= 20; id++) {
+        add_edge(10, id, false, false);
+    }
+    xg::XG xg_index(proto_graph);
+    
+    auto neighbors = [&](const handle_t& handle, bool go_left) {
+        vector<handle_t> found;
+        xg_index.follow_edges(handle, go_left, [&](const handle_t& next) {
+            found.push_back(next);
+            return true;
+        });
+        return found;
+    };
+    
+    // Get the right answers
+    map<tuple<int64_t, bool, bool>, vector<handle_t>> expected;
+    for (int64_t id = 1; id <= 20; id++) {
+        for (bool is_rev : {false, true}) {
+            for (bool go_left : {false, true}) {
+                expected[make_tuple(id, is_rev, go_left)] = neighbors(xg_index.get_handle(id, is_rev), go_left);
+            }
+        }
+    }
+    
+    // Asking for more nodes than there are caches them all
+    xg_index.enable_edge_cache(100);
+    REQUIRE(xg_index.edge_cache_hits() == 0);
+    REQUIRE(xg_index.edge_cache_misses() == 0);
+    
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (auto& entry : expected) {
+            handle_t handle = xg_index.get_handle(get<0>(entry.first), get<1>(entry.first));
+            REQUIRE(neighbors(handle, get<2>(entry.first)) == entry.second);
+        }
+    }
+    
+    // Stopping early still works from the cache
+    size_t seen = 0;
+    REQUIRE(!xg_index.follow_edges(xg_index.get_handle(4, false), true, [&](const handle_t& next) {
+        seen++;
+        return false;
+    }));
+    REQUIRE(seen == 1);
+    
+    // Every other node is decoded once, but the hub always has to be decoded
+    size_t lookups = expected.size() * 2 + 1;
+    REQUIRE(xg_index.edge_cache_hits() + xg_index.edge_cache_misses() == lookups);
+    REQUIRE(xg_index.edge_cache_misses() == 19 + 8);
+    
+    xg_index.enable_edge_cache(0);
+    REQUIRE(xg_index.edge_cache_hits() == 0);
+    REQUIRE(neighbors(xg_index.get_handle(10, false), false) == expected[make_tuple(10, false, false)]);
+}
+
+TEST_CASE("Two-pass xg construction builds the same index as one pass", "[xg]") {
+
+    // Two chunks that share a node and an edge, with a path split between them
+    vector<Graph> chunks(2);
+    auto add_node = [](Graph& graph, int64_t id, const string& seq) {
+        Node* node = graph.add_node();
+        node->set_id(id);
+        node->set_sequence(seq);
+    };
+    auto add_edge = [](Graph& graph, int64_t from, int64_t to, bool from_start, bool to_end) {
+        Edge* edge = graph.add_edge();
+        edge->set_from(from);
+        edge->set_to(to);
+        edge->set_from_start(from_start);
+        edge->set_to_end(to_end);
+    };
+    auto add_step = [](Graph& graph, const string& name, int64_t id, bool is_reverse, int64_t rank) {
+        Path* path = graph.path_size() > 0 ? graph.mutable_path(0) : graph.add_path();
+        path->set_name(name);
+        Mapping* mapping = path->add_mapping();
+        mapping->mutable_position()->set_node_id(id);
+        mapping->mutable_position()->set_is_reverse(is_reverse);
+        mapping->set_rank(rank);
+    };
+    add_node(chunks[0], 3, "GATTACA");
+    add_node(chunks[0], 1, "CAT");
+    add_node(chunks[0], 2, "RNA");
+    add_edge(chunks[0], 1, 2, false, false);
+    add_edge(chunks[0], 2, 3, false, true);
+    add_edge(chunks[0], 1, 3, false, false);
+    add_step(chunks[0], "p", 1, false, 1);
+    add_step(chunks[0], "p", 2, false, 2);
+    add_node(chunks[1], 3, "GATTACA");
+    add_node(chunks[1], 5, "TTN");
+    add_edge(chunks[1], 1, 2, false, false);
+    add_edge(chunks[1], 5, 3, true, true);
+    add_edge(chunks[1], 5, 5, false, false);
+    add_step(chunks[1], "p", 3, true, 3);
+    add_step(chunks[1], "p", 5, false, 4);
+    
+    auto get_chunks = [&](function<void(Graph&)> callback) {
+        for (auto& chunk : chunks) {
+            // Pass copies, since callers are allowed to change the chunks
+            Graph copy = chunk;
+            callback(copy);
+        }
+    };
+    
+    xg::XG one_pass;
+    one_pass.from_callback(get_chunks);
+    xg::XG two_pass;
+    two_pass.from_callback_two_pass(get_chunks);
+    
+    REQUIRE(two_pass.node_count == 4);
+    REQUIRE(two_pass.edge_count == 5);
+    REQUIRE(two_pass.node_sequence(2) == "RNA");
+    REQUIRE(two_pass.node_sequence(5) == "TTN");
+    REQUIRE(two_pass.path_length("p") == 16);
+    
+    stringstream one_pass_bytes;
+    one_pass.serialize(one_pass_bytes);
+    stringstream two_pass_bytes;
+    two_pass.serialize(two_pass_bytes);
+    REQUIRE(one_pass_bytes.str() == two_pass_bytes.str());
+}
+
+TEST_CASE("The path anchor table finds the same nearest path nodes as searching", "[xg]") {
+
+    // Two components with paths, and a lone node without one
+    Graph proto_graph;
+    for (int64_t id = 1; id <= 8; id++) {
+        Node* node = proto_graph.add_node();
+        node->set_id(id);
+        node->set_sequence("GATTACA");
+    }
+    for (auto& edge : vector<pair<int64_t, int64_t>>{{1, 2}, {2, 3}, {3, 4}, {4, 5}, {6, 7}}) {
+        Edge* e = proto_graph.add_edge();
+        e->set_from(edge.first);
+        e->set_to(edge.second);
+    }
+    for (auto& step : vector<pair<string, int64_t>>{{"a", 3}, {"b", 5}, {"c", 7}}) {
+        Path* path = proto_graph.add_path();
+        path->set_name(step.first);
+        Mapping* mapping = path->add_mapping();
+        mapping->mutable_position()->set_node_id(step.second);
+        mapping->set_rank(1);
+        Edit* edit = mapping->add_edit();
+        edit->set_from_length(7);
+        edit->set_to_length(7);
+    }
+    xg::XG built(proto_graph);
+    
+    stringstream stream;
+    built.serialize(stream);
+    xg::XG loaded;
+    loaded.load(stream);
+    
+    for (xg::XG* index : {&built, &loaded}) {
+        for (int64_t id = 1; id <= 8; id++) {
+            // Asking for a different number of steps goes around the table
+            auto searched = index->nearest_path_node(id, xg::XG::PATH_ANCHOR_STEPS + 1);
+            REQUIRE(index->nearest_path_node(id) == searched);
+        }
+        REQUIRE(index->nearest_path_node(1).first == 3);
+        REQUIRE(index->nearest_path_node(4).first == 3);
+        REQUIRE(index->nearest_path_node(6).first == 7);
+        REQUIRE(index->nearest_path_node(8).second.empty());
+        
+        REQUIRE(index->closest_shared_path_unstranded_distance(1, 0, false, 6, 0, false, 100) == numeric_limits<int64_t>::max());
+        REQUIRE(index->closest_shared_path_unstranded_distance(3, 0, false, 3, 4, false, 100) == 4);
+    }
+}
+
+
+TEST_CASE("The shared path memo gives the same occurrences as querying", "[xg]") {
+
+    // Two overlapping paths, one of which goes through node 3 backward
+    Graph proto_graph;
+    for (int64_t id = 1; id <= 5; id++) {
+        Node* node = proto_graph.add_node();
+        node->set_id(id);
+        node->set_sequence("GATTACA");
+    }
+    for (int64_t id = 1; id < 5; id++) {
+        Edge* edge = proto_graph.add_edge();
+        edge->set_from(id);
+        edge->set_to(id + 1);
+    }
+    auto add_path = [&](const string& name, const vector<pair<int64_t, bool>>& steps) {
+        Path* path = proto_graph.add_path();
+        path->set_name(name);
+        for (size_t i = 0; i < steps.size(); i++) {
+            Mapping* mapping = path->add_mapping();
+            mapping->mutable_position()->set_node_id(steps[i].first);
+            mapping->mutable_position()->set_is_reverse(steps[i].second);
+            mapping->set_rank(i + 1);
+            Edit* edit = mapping->add_edit();
+            edit->set_from_length(7);
+            edit->set_to_length(7);
+        }
+    };
+    add_path("a", {{1, false}, {2, false}, {3, false}});
+    add_path("b", {{4, true}, {3, true}, {2, true}});
+    xg::XG xg_index(proto_graph);
+    
+    map<int64_t, vector<pair<size_t, vector<pair<size_t, bool>>>>> expected;
+    for (int64_t id = 1; id <= 5; id++) {
+        expected[id] = xg_index.oriented_paths_of_node(id);
+    }
+    REQUIRE(expected[5].empty());
+    REQUIRE(expected[2].size() == 2);
+    
+    for (size_t max_entries : {1000, 1}) {
+        xg_index.enable_path_memo(max_entries);
+        
+        // Query from many threads at once, with and without private memos
+        vector<char> correct(100, false);
+#pragma omp parallel for
+        for (size_t i = 0; i < correct.size(); i++) {
+            int64_t id = i % 5 + 1;
+            unordered_map<int64_t, vector<size_t>> paths_of_node_memo;
+            unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>> oriented_occurrences_memo;
+            bool use_memo = i % 2;
+            correct[i] = (xg_index.memoized_oriented_paths_of_node(id, use_memo ? &paths_of_node_memo : nullptr,
+                                                                   use_memo ? &oriented_occurrences_memo : nullptr) == expected[id]
+                          && xg_index.memoized_paths_of_node(id) == xg_index.paths_of_node(id));
+        }
+        for (char is_correct : correct) {
+            REQUIRE(is_correct);
+        }
+        
+        if (max_entries == 1) {
+            // Every shard holds one result, so they keep getting cleared
+            REQUIRE(xg_index.path_memo_evictions() > 0);
+        }
+        else {
+            REQUIRE(xg_index.path_memo_evictions() == 0);
+        }
+    }
+    
+    xg_index.enable_path_memo(0);
+    REQUIRE(xg_index.path_memo_evictions() == 0);
+    REQUIRE(xg_index.memoized_oriented_paths_of_node(3) == expected[3]);
+}
+
+
+TEST_CASE("Paths appended to an xg index match paths built in from the start", "[xg]") {
+
+    // A bubble, with a reference path and an alt path to add later
+    auto make_graph = [](bool with_alt) {
+        Graph graph;
+        for (int64_t id = 1; id <= 4; id++) {
+            Node* node = graph.add_node();
+            node->set_id(id);
+            node->set_sequence(id == 3 ? "C" : "GATTACA");
+        }
+        for (auto& edge : vector<pair<int64_t, int64_t>>{{1, 2}, {1, 3}, {2, 4}, {3, 4}}) {
+            Edge* e = graph.add_edge();
+            e->set_from(edge.first);
+            e->set_to(edge.second);
+        }
+        vector<pair<string, vector<int64_t>>> paths{{"alt", {1, 3, 4}}, {"ref", {1, 2, 4}}};
+        for (auto& named : paths) {
+            if (named.first == "alt" && !with_alt) {
+                continue;
+            }
+            Path* path = graph.add_path();
+            path->set_name(named.first);
+            for (size_t i = 0; i < named.second.size(); i++) {
+                Mapping* mapping = path->add_mapping();
+                mapping->mutable_position()->set_node_id(named.second[i]);
+                mapping->set_rank(i + 1);
+            }
+        }
+        return graph;
+    };
+    
+    Graph without_alt = make_graph(false);
+    Graph with_alt = make_graph(true);
+    xg::XG appended(without_alt);
+    xg::XG built(with_alt);
+    
+    REQUIRE(appended.path_count == 1);
+    appended.append_paths({with_alt.path(0)});
+    REQUIRE(appended.path_count == 2);
+    REQUIRE(appended.path_rank("ref") == 1);
+    REQUIRE(appended.path_rank("alt") == 2);
+    REQUIRE(appended.path_length("alt") == 15);
+    REQUIRE(appended.paths_of_node(3) == vector<size_t>{2});
+    REQUIRE(appended.paths_of_node(1) == vector<size_t>({1, 2}));
+    REQUIRE(appended.paths_on_same_component(1, 2));
+    
+    SECTION("The appended index agrees with a fresh build") {
+        for (int64_t id = 1; id <= 4; id++) {
+            REQUIRE(appended.oriented_paths_of_node(id).size() == built.oriented_paths_of_node(id).size());
+            REQUIRE(appended.nearest_path_node(id).first == built.nearest_path_node(id).first);
+        }
+        REQUIRE(appended.path("alt").SerializeAsString() == built.path("alt").SerializeAsString());
+    }
+    
+    SECTION("The appended index survives serialization") {
+        stringstream stream;
+        appended.serialize(stream);
+        xg::XG loaded;
+        loaded.load(stream);
+        REQUIRE(loaded.path_rank("alt") == 2);
+        REQUIRE(loaded.paths_of_node(3) == vector<size_t>{2});
+    }
+    
+    SECTION("Paths that do not fit the graph are refused") {
+        Path repeated = with_alt.path(1);
+        REQUIRE_THROWS(appended.append_paths({repeated}));
+        
+        Path skipping;
+        skipping.set_name("skip");
+        for (int64_t id : {1, 4}) {
+            Mapping* mapping = skipping.add_mapping();
+            mapping->mutable_position()->set_node_id(id);
+            mapping->set_rank(skipping.mapping_size());
+        }
+        REQUIRE_THROWS(appended.append_paths({skipping}));
+        
+        skipping.mutable_mapping(1)->mutable_position()->set_node_id(5);
+        REQUIRE_THROWS(appended.append_paths({skipping}));
+        REQUIRE(appended.path_count == 2);
+TEST_CASE("An xg index counts the bases in its sequence and saves the counts", "[xg]") {
+
+    // Enough sequence to fill a few words of the packed sequence vector
+    string sequence;
+    for (size_t i = 0; i < 25; i++) {
+        sequence += "GATTACA";
+    }
+    
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":")" + sequence + R"("},
+    {"id":2,"sequence":"NNCG"}],
+    "edge":[{"to":2,"from":1}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    auto check_counts = [](const xg::XG& index) {
+        auto& counts = index.base_counts();
+        REQUIRE(counts[0] == 75);
+        REQUIRE(counts[1] == 26);
+        REQUIRE(counts[2] == 26);
+        REQUIRE(counts[3] == 50);
+        REQUIRE(counts[4] == 2);
+        REQUIRE(index.gc_content() == Approx(52.0 / 177.0));
+        REQUIRE(index.sequence_entropy() > 1.5);
+        REQUIRE(index.sequence_entropy() < 2.5);
+    };
+    
+    check_counts(xg_index);
+    
+    stringstream serialized;
+    xg_index.serialize(serialized);
+    xg::XG loaded;
+    loaded.load(serialized);
+    check_counts(loaded);
+
+}
+
+TEST_CASE("Two-sided context extraction matches merging the one-sided contexts", "[xg]") {
+    
+    // includes a reversing edge, a self loop, and a tip
+    string graph_json = R"(
+    {"node":[{"id":1,"sequence":"GATT"},
+    {"id":2,"sequence":"A"},
+    {"id":3,"sequence":"CAT"},
+    {"id":4,"sequence":"TTAGGC"},
+    {"id":5,"sequence":"G"},
+    {"id":6,"sequence":"ACCA"}],
+    "edge":[{"from":1,"to":2},
+    {"from":1,"to":3},
+    {"from":2,"to":4},
+    {"from":3,"to":4,"to_end":true},
+    {"from":4,"to":4},
+    {"from":4,"to":5},
+    {"from":6,"to":5,"from_start":true},
+    {"from":5,"to":6}]}
+    )";
+    
+    Graph proto_graph;
+    json2pb(proto_graph, graph_json.c_str(), graph_json.size());
+    xg::XG xg_index(proto_graph);
+    
+    for (id_t node_id = 1; node_id <= 6; node_id++) {
+        for (bool is_reverse : {false, true}) {
+            for (int64_t forward_length : {0, 3, 8, 50}) {
+                for (int64_t backward_length : {0, 2, 10}) {
+                    pos_t pos = make_pos_t(node_id, is_reverse, 0);
+                    pos_t rev = reverse(pos, xg_index.node_length(node_id));
+                    Graph merged = xg_index.graph_context_id(pos, forward_length);
+                    merged.MergeFrom(xg_index.graph_context_id(rev, backward_length));
+                    sort_by_id_dedup_and_clean(merged);
+                    
+                    Graph extracted = xg_index.graph_context_id(pos, forward_length, backward_length);
+                    REQUIRE(pb2json(extracted) == pb2json(merged));
+                }
+            }
+        }
+    }
+}
+
+    }
+}
+
 }
 }
@@ -1,6 +1,8 @@
 #include "variant_adder.hpp"
 #include "mapper.hpp"
 
+#include <exception>
+
 //#define debug
 
 namespace vg {
@@ -55,6 +57,60 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
     // We report when we skip contigs, but only once.
     set<string> skipped_contigs;
     
+    // We read groups of variants from the VCF into a batch, and then align the
+    // whole batch in parallel.
+    vector<VariantGroup> batch;
+    
+    // This aligns and adds in all the groups in the batch.
+    auto flush_batch = [&]() {
+        // If any thread throws, we hold on to the exception and throw it once
+        // all the threads are done.
+        exception_ptr failure;
+        
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < batch.size(); i++) {
+            try {
+                add_variant_group(batch[i]);
+            } catch (...) {
+                #pragma omp critical (failure)
+                failure = current_exception();
+            }
+        }
+        
+        batch.clear();
+        
+        if (failure) {
+            rethrow_exception(failure);
+        }
+        
+#ifdef debug
+        // Count our current heads and tails
+        graph.head_nodes(to_count);
+        size_t head_count = to_count.size();
+        cerr << "Heads: ";
+        for(auto head : to_count) {
+            cerr << head->id() << " ";
+        }
+        cerr << endl;
+        to_count.clear();
+        graph.tail_nodes(to_count);
+        cerr << "Tails: ";
+        for(auto tail : to_count) {
+            cerr << tail->id() << " ";
+        }
+        cerr << endl;
+        size_t tail_count = to_count.size();
+        to_count.clear();
+        
+        cerr << "Heads count: " << head_count << ", Tail count: " << tail_count << endl;
+
+        if (head_count != head_expected || tail_count != tail_expected) {
+            cerr << "Error! Count mismatch!" << endl;
+            throw runtime_error("Head and tail counts changed");
+        }
+#endif
+    };
+    
     while(buffer.next()) {
         // For each variant in its context of nonoverlapping variants
         vcflib::Variant* variant;
@@ -108,307 +164,303 @@ void VariantAdder::add_variants(vcflib::VariantCallFile* vcf) {
         }
         update_progress(variant_path_offset);
         
-        // Figure out what the actual bounds of this variant are. For big
-        // deletions, the variant itself may be bigger than the window we're
-        // using when looking for other local variants. For big insertions, we
-        // might need to get a big subgraph to ensure we have all the existing
-        // alts if they exist.
-        
         // Make the list of all the local variants in one vector
         vector<vcflib::Variant*> local_variants = filter_local_variants(before, variant, after);
         
-        // Get the unique haplotypes
-        auto haplotypes = get_unique_haplotypes(local_variants, &buffer);
-        
-        // Track the total bp of haplotypes
-        size_t total_haplotype_bases = 0;
-        
-        // Track the total graph size for the alignments
-        size_t total_graph_bases = 0;
+        // Save copies of them, and their unique haplotypes, while the buffer
+        // still has them.
+        batch.emplace_back();
+        VariantGroup& group = batch.back();
+        group.path_name = variant_path_name;
+        group.contig = variant->sequenceName;
+        group.position = variant->position;
+        group.number = ++variants_processed;
+        for (auto* local_variant : local_variants) {
+            group.variants.push_back(*local_variant);
+        }
+        group.haplotypes = get_unique_haplotypes(local_variants, &buffer);
         
-        // How many haplotypes actually pass any haplotype filtering?
-        size_t used_haplotypes = 0;
-            
+        if (batch.size() >= batch_size) {
+            flush_batch();
+        }
+    }
+    
+    // Do the last partial batch
+    flush_batch();
+
+    // Clean up after the last contig.
+    destroy_progress();
+    
+}
+
+void VariantAdder::add_variant_group(VariantGroup& group) {
+    
+    const string& variant_path_name = group.path_name;
+    
+    vector<vcflib::Variant*> local_variants;
+    for (auto& local_variant : group.variants) {
+        local_variants.push_back(&local_variant);
+    }
+    
+    // Grab the sequence of the path, which won't change
+    const string& path_sequence = sync.get_path_sequence(variant_path_name);
+    
+    // Figure out what the actual bounds of this variant are. For big
+    // deletions, the variant itself may be bigger than the window we're
+    // using when looking for other local variants. For big insertions, we
+    // might need to get a big subgraph to ensure we have all the existing
+    // alts if they exist.
+    
+    auto& haplotypes = group.haplotypes;
+    
+    // Track the total bp of haplotypes
+    size_t total_haplotype_bases = 0;
+    
+    // Track the total graph size for the alignments
+    size_t total_graph_bases = 0;
+    
+    // How many haplotypes actually pass any haplotype filtering?
+    size_t used_haplotypes = 0;
+    
 #ifdef debug
-        cerr << "Have " << haplotypes.size() << " haplotypes for variant "
-            << variant->sequenceName << ":" << variant->position << endl;
+    cerr << "Have " << haplotypes.size() << " haplotypes for variant "
+        << group.contig << ":" << group.position << endl;
 #endif
-        
-        // Where does the group of nearby variants start?
-        size_t group_start = local_variants.front()->position;
-        // And where does it end (exclusive)? This is the latest ending point of any variant in the group...
-        size_t group_end = local_variants.back()->position + local_variants.back()->ref.size();
-        
-        // We need to make sure we also grab this much extra graph context,
-        // since we count 2 radiuses + flank out from the ends of the group.
-        size_t group_width = group_end - group_start;
-        
-        // Find the center and radius of the group of variants, so we know what graph part to grab.
-        size_t overall_center;
-        size_t overall_radius;
-        tie(overall_center, overall_radius) = get_center_and_radius(local_variants);
-
-        // Get the leading and trailing ref sequence on either side of this
-        // group of variants (to pin the outside variants down).
-
-        // On the left we want either flank_range bases, or all the bases before
-        // the first base in the group.
-        size_t left_context_length = min((int64_t) flank_range, (int64_t) group_start);
-        // On the right we want either flank_range bases, or all the bases after
-        // the last base in the group. We know nothing will overlap the end of
-        // the last variant, because we grabbed nonoverlapping variants.
-        size_t right_context_length = min(path_sequence.size() - group_end, (size_t) flank_range);
     
-        // Turn those into desired substring bounds.
-        // TODO: this is sort of just undoing some math we already did
-        size_t left_context_start = group_start - left_context_length;
-        size_t right_context_past_end = group_end + right_context_length;
-            
+    // Where does the group of nearby variants start?
+    size_t group_start = local_variants.front()->position;
+    // And where does it end (exclusive)? This is the latest ending point of any variant in the group...
+    size_t group_end = local_variants.back()->position + local_variants.back()->ref.size();
+    
+    // Find the center and radius of the group of variants, so we know what graph part to grab.
+    size_t overall_center;
+    size_t overall_radius;
+    tie(overall_center, overall_radius) = get_center_and_radius(local_variants);
+
+    // Get the leading and trailing ref sequence on either side of this
+    // group of variants (to pin the outside variants down).
+
+    // On the left we want either flank_range bases, or all the bases before
+    // the first base in the group.
+    size_t left_context_length = min((int64_t) flank_range, (int64_t) group_start);
+    // On the right we want either flank_range bases, or all the bases after
+    // the last base in the group. We know nothing will overlap the end of
+    // the last variant, because we grabbed nonoverlapping variants.
+    size_t right_context_length = min(path_sequence.size() - group_end, (size_t) flank_range);
+
+    // Turn those into desired substring bounds.
+    // TODO: this is sort of just undoing some math we already did
+    size_t left_context_start = group_start - left_context_length;
+    size_t right_context_past_end = group_end + right_context_length;
+        
 #ifdef debug
-            cerr << "Original context bounds: " << left_context_start << " - " << right_context_past_end << endl;
+        cerr << "Original context bounds: " << left_context_start << " - " << right_context_past_end << endl;
 #endif
 
-        // Find the reference sequence
-        const string& ref_sequence = sync.get_path_sequence(vcf_to_fasta(variant->sequenceName));
+    // Find the reference sequence
+    const string& ref_sequence = path_sequence;
 
-        for (auto& haplotype : haplotypes) {
-            // For each haplotype
-            
-            // TODO: since we lock repeatedly, neighboring variants will come in
-            // in undefined order and our result is nondeterministic.
-            
-            // Only look at haplotypes that aren't pure reference.
-            bool has_nonreference = false;
-            for (auto& allele : haplotype) {
-                if (allele != 0) {
-                    has_nonreference = true;
-                    break;
-                }
+    for (auto& haplotype : haplotypes) {
+        // For each haplotype
+        
+        // TODO: since we lock repeatedly, and groups in a batch are aligned
+        // in parallel, neighboring variants will come in in undefined order
+        // and our result is nondeterministic.
+        
+        // Only look at haplotypes that aren't pure reference.
+        bool has_nonreference = false;
+        for (auto& allele : haplotype) {
+            if (allele != 0) {
+                has_nonreference = true;
+                break;
             }
-            if (!has_nonreference) {
-                // Don't bother aligning all-ref haplotypes to the graph.
-                // They're there already.
+        }
+        if (!has_nonreference) {
+            // Don't bother aligning all-ref haplotypes to the graph.
+            // They're there already.
 #ifdef debug
-                cerr << "Skip all-reference haplotype." << endl;
+            cerr << "Skip all-reference haplotype." << endl;
 #endif
-                continue;
-            }
-            
+            continue;
+        }
+        
 #ifdef debug
-            cerr << "Haplotype ";
-            for (auto& allele_number : haplotype) {
-                cerr << allele_number << " ";
-            }
-            cerr << endl;
+        cerr << "Haplotype ";
+        for (auto& allele_number : haplotype) {
+            cerr << allele_number << " ";
+        }
+        cerr << endl;
 #endif
 
-            // This lets us know if we need to walk out more to find matchable sequence
-            bool have_dangling_ends;
-            do {
-                // We need to be able to increase our bounds until we haven't
-                // shifted an indel to the border of our context.
-                
-                // Round bounds to node start and endpoints.
-                // This haplotype and all subsequent ones will be aligned with this wider context.
-                sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
-                    tie(left_context_start, right_context_past_end) = index.round_outward(left_context_start,
-                        right_context_past_end);
-                });
-                
+        // This lets us know if we need to walk out more to find matchable sequence
+        bool have_dangling_ends;
+        do {
+            // We need to be able to increase our bounds until we haven't
+            // shifted an indel to the border of our context.
+            
+            // Round bounds to node start and endpoints.
+            // This haplotype and all subsequent ones will be aligned with this wider context.
+            tie(left_context_start, right_context_past_end) = sync.round_outward(variant_path_name,
+                left_context_start, right_context_past_end);
+            
 #ifdef debug
-                cerr << "New context bounds: " << left_context_start << " - " << right_context_past_end << endl;
+            cerr << "New context bounds: " << left_context_start << " - " << right_context_past_end << endl;
 #endif
-                
-                // Recalculate context lengths
-                left_context_length = group_start - left_context_start;
-                right_context_length = right_context_past_end - group_end;
-                
-                // Make sure we pull out out to the ends of the contexts
-                overall_radius = max(overall_radius, max(overall_center - left_context_start,
-                    right_context_past_end - overall_center));
-                
-                // Get actual context strings
-                string left_context = path_sequence.substr(group_start - left_context_length, left_context_length);
-                string right_context = path_sequence.substr(group_end, right_context_length);
-                
-                // Make the haplotype's combined string
-                stringstream to_align;
-                to_align << left_context << haplotype_to_string(haplotype, local_variants) << right_context;
-                
+            
+            // Recalculate context lengths
+            left_context_length = group_start - left_context_start;
+            right_context_length = right_context_past_end - group_end;
+            
+            // Make sure we pull out out to the ends of the contexts
+            overall_radius = max(overall_radius, max(overall_center - left_context_start,
+                right_context_past_end - overall_center));
+            
+            // Get actual context strings
+            string left_context = path_sequence.substr(group_start - left_context_length, left_context_length);
+            string right_context = path_sequence.substr(group_end, right_context_length);
+            
+            // Make the haplotype's combined string
+            stringstream to_align;
+            to_align << left_context << haplotype_to_string(haplotype, local_variants) << right_context;
+            
 #ifdef debug
-                cerr << "Align " << to_align.str() << endl;
+            cerr << "Align " << to_align.str() << endl;
 #endif
 
-                // Make a request to lock the subgraph, leaving the nodes we rounded
-                // to (or the child nodes they got broken into) as heads/tails.
-                GraphSynchronizer::Lock lock(sync, variant_path_name, left_context_start, right_context_past_end);
-                
+            // Make a request to lock the subgraph, leaving the nodes we rounded
+            // to (or the child nodes they got broken into) as heads/tails.
+            GraphSynchronizer::Lock lock(sync, variant_path_name, left_context_start, right_context_past_end);
+            
 #ifdef debug
-                cerr << "Waiting for lock on " << variant_path_name << ":"
-                    << left_context_start << "-" << right_context_past_end << endl;
+            cerr << "Waiting for lock on " << variant_path_name << ":"
+                << left_context_start << "-" << right_context_past_end << endl;
 #endif
-                
-                // Block until we get it
-                lock_guard<GraphSynchronizer::Lock> guard(lock);
-                
+            
+            // Block until we get it
+            lock_guard<GraphSynchronizer::Lock> guard(lock);
+            
 #ifdef debug
-                cerr << "Got lock on " << variant_path_name << ":"
-                    << left_context_start << "-" << right_context_past_end << endl;
+            cerr << "Got lock on " << variant_path_name << ":"
+                << left_context_start << "-" << right_context_past_end << endl;
 #endif            
-                    
+                
 #ifdef debug
-                cerr << "Got " << lock.get_subgraph().length() << " bp in " << lock.get_subgraph().size() << " nodes" << endl;
+            cerr << "Got " << lock.get_subgraph().length() << " bp in " << lock.get_subgraph().size() << " nodes" << endl;
 #endif
-
 #ifdef debug
-                ofstream seq_dump("seq_dump.txt");
-                seq_dump << to_align.str();
-                seq_dump.close();
-
-                sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
-                    // Make sure we actually have the endpoints we wanted
-                    auto found_left = index.find_position(left_context_start);
-                    auto found_right = index.find_position(right_context_past_end - 1);
-                    assert(left_context_start == found_left->first);
-                    assert(right_context_past_end == found_right->first + index.node_length(found_right));
-                    
-                    cerr << "Group runs " << group_start << "-" << group_end << endl;
-                    cerr << "Context runs " << left_context_start << "-" << right_context_past_end << ": "
-                        << right_context_past_end - left_context_start  << " bp" << endl;
-                    cerr << "Sequence is " << to_align.str().size() << " bp" << endl;
-                    cerr << "Leftmost node is " << found_left->second << endl;
-                    cerr << "Leftmost Sequence: " << lock.get_subgraph().get_node(found_left->second.node)->sequence() << endl;
-                    cerr << "Rightmost node is " << found_right->second << endl;
-                    cerr << "Rightmost Sequence: " << lock.get_subgraph().get_node(found_right->second.node)->sequence() << endl;
-                    cerr << "Left context: " << left_context << endl;
-                    cerr << "Right context: " << right_context << endl;
-                    
-                    lock.get_subgraph().for_each_node([&](Node* node) {
-                        // Look at nodes
-                        if (index.by_id.count(node->id())) {
-                            cerr << "Node " << node->id() << " at " << index.by_id.at(node->id()).first
-                                << " orientation " << index.by_id.at(node->id()).second << endl;
-                        } else {
-                            cerr << "Node " << node->id() << " not on path" << endl;
-                        }
-                    });
-                    
-                    if (lock.get_subgraph().is_acyclic()) {
-                        cerr << "Subgraph is acyclic" << endl;
+            ofstream seq_dump("seq_dump.txt");
+            seq_dump << to_align.str();
+            seq_dump.close();
+
+            sync.with_path_index(variant_path_name, [&](const PathIndex& index) {
+                // Make sure we actually have the endpoints we wanted
+                auto found_left = index.find_position(left_context_start);
+                auto found_right = index.find_position(right_context_past_end - 1);
+                assert(left_context_start == found_left->first);
+                assert(right_context_past_end == found_right->first + index.node_length(found_right));
+                
+                cerr << "Group runs " << group_start << "-" << group_end << endl;
+                cerr << "Context runs " << left_context_start << "-" << right_context_past_end << ": "
+                    << right_context_past_end - left_context_start  << " bp" << endl;
+                cerr << "Sequence is " << to_align.str().size() << " bp" << endl;
+                cerr << "Leftmost node is " << found_left->second << endl;
+                cerr << "Leftmost Sequence: " << lock.get_subgraph().get_node(found_left->second.node)->sequence() << endl;
+                cerr << "Rightmost node is " << found_right->second << endl;
+                cerr << "Rightmost Sequence: " << lock.get_subgraph().get_node(found_right->second.node)->sequence() << endl;
+                cerr << "Left context: " << left_context << endl;
+                cerr << "Right context: " << right_context << endl;
+                
+                lock.get_subgraph().for_each_node([&](Node* node) {
+                    // Look at nodes
+                    if (index.by_id.count(node->id())) {
+                        cerr << "Node " << node->id() << " at " << index.by_id.at(node->id()).first
+                            << " orientation " << index.by_id.at(node->id()).second << endl;
                     } else {
-                        cerr << "Subgraph is cyclic" << endl;
+                        cerr << "Node " << node->id() << " not on path" << endl;
                     }
                 });
-#endif
-                
-                // Work out how far we would have to unroll the graph to account for
-                // a giant deletion. We also want to account for alts that may
-                // already be in the graph and need unrolling for a long insert.
-                size_t max_span = max(right_context_past_end - left_context_start, to_align.str().size());
                 
-                // Do the alignment, dispatching cleverly on size
-                Alignment aln = smart_align(lock.get_subgraph(), lock.get_endpoints(), to_align.str(), max_span);
-                
-#ifdef debug
-                cerr << "Postprocessed: " << pb2json(aln) << endl;
+                if (lock.get_subgraph().is_acyclic()) {
+                    cerr << "Subgraph is acyclic" << endl;
+                } else {
+                    cerr << "Subgraph is cyclic" << endl;
+                }
+            });
 #endif
-                
-                // Look at the ends of the alignment
-                assert(aln.path().mapping_size() > 0);
-                auto& last_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
-                assert(last_mapping.edit_size() > 0);
-                auto& last_edit = last_mapping.edit(last_mapping.edit_size() - 1);
-                auto& first_mapping = aln.path().mapping(0);
-                assert(first_mapping.edit_size() > 0);
-                auto& first_edit = first_mapping.edit(0);
-                
-                // Assume they aren't dangling
-                have_dangling_ends = false;
-                
-                if (!edit_is_match(first_edit) && left_context_start > 0) {
-                    // Actually the left end is dangling, so try looking left
-                    have_dangling_ends = true;
-                    left_context_start--;
+            
+            // Work out how far we would have to unroll the graph to account for
+            // a giant deletion. We also want to account for alts that may
+            // already be in the graph and need unrolling for a long insert.
+            size_t max_span = max(right_context_past_end - left_context_start, to_align.str().size());
+            
+            // Do the alignment, dispatching cleverly on size
+            Alignment aln = smart_align(lock.get_subgraph(), lock.get_endpoints(), to_align.str(), max_span);
+            
 #ifdef debug
-                    cerr << "Left end dangled!" << endl;
+            cerr << "Postprocessed: " << pb2json(aln) << endl;
 #endif
-                }
-                
-                if (!edit_is_match(last_edit) && right_context_past_end < ref_sequence.size()) {
-                    // Actually the right end is dangling, so try looking right
-                    have_dangling_ends = true;
-                    right_context_past_end++;
+            
+            // Look at the ends of the alignment
+            assert(aln.path().mapping_size() > 0);
+            auto& last_mapping = aln.path().mapping(aln.path().mapping_size() - 1);
+            assert(last_mapping.edit_size() > 0);
+            auto& last_edit = last_mapping.edit(last_mapping.edit_size() - 1);
+            auto& first_mapping = aln.path().mapping(0);
+            assert(first_mapping.edit_size() > 0);
+            auto& first_edit = first_mapping.edit(0);
+            
+            // Assume they aren't dangling
+            have_dangling_ends = false;
+            
+            if (!edit_is_match(first_edit) && left_context_start > 0) {
+                // Actually the left end is dangling, so try looking left
+                have_dangling_ends = true;
+                left_context_start--;
 #ifdef debug
-                    cerr << "Right end dangled!" << endl;
+                cerr << "Left end dangled!" << endl;
 #endif
-                }
-                
-                if (!have_dangling_ends) {
-                    
-                    // Make this path's edits to the original graph. We don't need to do
-                    // anything with the translations.
-                    lock.apply_full_length_edit(aln.path());
-                    
-                    // Count all the bases in the haplotype
-                    total_haplotype_bases += to_align.str().size();
-                    // Record the size of graph we're aligning to in bases
-                    total_graph_bases += lock.get_subgraph().length();
-                    // Record the haplotype as used
-                    used_haplotypes++;
-                    
-                    
-                } else {
+            }
+            
+            if (!edit_is_match(last_edit) && right_context_past_end < ref_sequence.size()) {
+                // Actually the right end is dangling, so try looking right
+                have_dangling_ends = true;
+                right_context_past_end++;
 #ifdef debug
-                    cerr << "Expand context and retry" << endl;
+                cerr << "Right end dangled!" << endl;
 #endif
-                }
-                // If we have dangling ends, we try again with our expanded context
+            }
+            
+            if (!have_dangling_ends) {
                 
-            } while (have_dangling_ends);
-        }
-        
-        if (print_updates && (variants_processed++ % 1000 == 0 || true)) {
-            #pragma omp critical (cerr)
-            cerr << "Variant " << variants_processed << ": " << haplotypes.size() << " haplotypes at "
-                << variant->sequenceName << ":" << variant->position << ": "
-                << (used_haplotypes ? (total_haplotype_bases / used_haplotypes) : 0) << " bp vs. "
-                << (used_haplotypes ? (total_graph_bases / used_haplotypes) : 0) << " bp haplotypes vs. graphs average" << endl;
-        }
-        
-        
+                // Make this path's edits to the original graph. We don't need to do
+                // anything with the translations.
+                lock.apply_full_length_edit(aln.path());
+                
+                // Count all the bases in the haplotype
+                total_haplotype_bases += to_align.str().size();
+                // Record the size of graph we're aligning to in bases
+                total_graph_bases += lock.get_subgraph().length();
+                // Record the haplotype as used
+                used_haplotypes++;
+                
+                
+            } else {
 #ifdef debug
-        // Count our current heads and tails
-        graph.head_nodes(to_count);
-        size_t head_count = to_count.size();
-        cerr << "Heads: ";
-        for(auto head : to_count) {
-            cerr << head->id() << " ";
-        }
-        cerr << endl;
-        to_count.clear();
-        graph.tail_nodes(to_count);
-        cerr << "Tails: ";
-        for(auto tail : to_count) {
-            cerr << tail->id() << " ";
-        }
-        cerr << endl;
-        size_t tail_count = to_count.size();
-        to_count.clear();
-        
-        cerr << "Heads count: " << head_count << ", Tail count: " << tail_count << endl;
-
-        if (head_count != head_expected || tail_count != tail_expected) {
-            cerr << "Error! Count mismatch!" << endl;
-            // Bail out but serialize the graph
-            return;
-        }
+                cerr << "Expand context and retry" << endl;
 #endif
-        
+            }
+            // If we have dangling ends, we try again with our expanded context
+            
+        } while (have_dangling_ends);
     }
-
-    // Clean up after the last contig.
-    destroy_progress();
     
+    if (print_updates) {
+        #pragma omp critical (cerr)
+        cerr << "Variant " << group.number << ": " << haplotypes.size() << " haplotypes at "
+            << group.contig << ":" << group.position << ": "
+            << (used_haplotypes ? (total_haplotype_bases / used_haplotypes) : 0) << " bp vs. "
+            << (used_haplotypes ? (total_graph_bases / used_haplotypes) : 0) << " bp haplotypes vs. graphs average" << endl;
+    }
 }
 
 void VariantAdder::align_ns(vg::VG& graph, Alignment& aln) {
@@ -37,7 +37,8 @@ public:
      * freshly opened. The variants in the file must be sorted.
      *
      * May be called from multiple threads. Synchronizes internally on the
-     * graph.
+     * graph. Reads groups of nearby variants in batches of batch_size, and
+     * aligns the groups in each batch in parallel.
      */
     void add_variants(vcflib::VariantCallFile* vcf);
     
@@ -135,6 +136,10 @@ public:
     /// processed?
     bool print_updates = false;
     
+    /// How many groups of nearby variants should we read from the VCF before
+    /// aligning them all in parallel?
+    size_t batch_size = 256;
+    
 protected:
     /// The graph we are modifying
     VG& graph;
@@ -147,6 +152,30 @@ protected:
     /// without locking the graph.
     set<string> path_names;
     
+    /**
+     * A group of nearby variants read from the VCF, with everything needed to
+     * add its haplotypes after the VCF buffer has moved on.
+     */
+    struct VariantGroup {
+        /// The graph path the variants are on
+        string path_name;
+        /// The VCF contig and position of the main variant, for reporting
+        string contig;
+        size_t position;
+        /// The number of the main variant in the VCF, for reporting
+        size_t number;
+        /// Copies of the main variant and the local variants around it, in order
+        vector<vcflib::Variant> variants;
+        /// The unique haplotypes over the variants
+        set<vector<int>> haplotypes;
+    };
+    
+    /**
+     * Align all the non-reference haplotypes of a group of variants to the
+     * graph and edit them in. May be called from multiple threads.
+     */
+    void add_variant_group(VariantGroup& group);
+    
     /**
      * Get all the unique combinations of variant alts represented by actual
      * haplotypes. Arbitrarily phases unphased variants.
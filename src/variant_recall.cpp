@@ -106,7 +106,146 @@ void genotype_svs(VG* graph,
     };
 }
 
-    
+
+/// Get the header of the VCF that variant recall writes
+static string recall_vcf_header() {
+    stringstream stream;
+    stream << "##fileformat=VCFv4.2" << endl;
+    stream << "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Total Depth\">" << endl;
+    stream << "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Read Depth\">" << endl;
+    stream << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">" << endl;
+    stream << "##FORMAT=<ID=GP,Number=1,Type=String,Description=\"Genotype Probability\">" << endl;
+    stream << "##INFO=<ID=AD,Number=.,Type=Integer,Description=\"Allelic depths for the ref and alt alleles in the order listed\">" << endl;
+    stream << "##INFO=<ID=SVLEN,Number=1,Type=Integer,Description=\"SV length\">" << endl;
+    stream << "##INFO=<ID=SVTYPE,Number=1,Type=String,Description=\"SV Type\">" << endl;
+    stream << "##INFO=<ID=END,Number=1,Type=Integer,Description=\"SV End\">" << endl;
+    stream << "##FORMAT=<ID=SB,Number=4,Type=Integer,Description=\"Forward and reverse support for ref and alt alleles.\">" << endl;
+    stream << "##FORMAT=<ID=XAAD,Number=1,Type=Integer,Description=\"Alt allele read count.\">" << endl;
+    stream << "##FORMAT=<ID=AL,Number=.,Type=Float,Description=\"Allelic likelihoods for the ref and alt alleles in the order listed\">" << endl;
+
+    stream << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\t" << "Sample" << endl;
+    return stream.str();
+}
+
+/// Genotype a biallelic site from its ref and alt read counts, and record the
+/// genotype and its probability on the variant
+static void record_recalled_genotype(vcflib::Variant& variant, int64_t ref_count, int64_t alt_count) {
+    std::function<long double(int64_t)> fac = [](int64_t t){
+        long double result = 1.0;
+        for (int64_t i = 1; i <= t; ++i){
+            result *= (long double) i; 
+        }
+        return result;
+    };
+
+
+    std::function<long double(int64_t)> big_fac = [](int64_t t){
+        long double result = 1.0;
+        int64_t to_calc = t;
+        if (t > 15){
+            // Screw calculating anything and return a big number.
+            to_calc = 15;
+        }
+        for (int64_t i = 1; i <= to_calc; ++i){
+            result *= (long double) i; 
+        }
+        return result;
+    };
+
+
+
+    // Creates a three-element vector, ref, het, alt
+    std::function<long double(int64_t, int64_t, double)> get_binoms = [fac, big_fac](int64_t ref_count, int64_t alt_count, long double geno_prior){
+        long double top_term = ( big_fac(alt_count + ref_count) );
+        long double bottom_term = (big_fac(ref_count) * big_fac(alt_count));
+
+        long double dat_binom = top_term / bottom_term;
+        return dat_binom * pow(geno_prior, alt_count) * pow((1.0 - geno_prior), ref_count);
+    };
+
+    std::function<pair<long double, int>(int64_t, int64_t, double)> do_math = [get_binoms, fac](int64_t ref_count, int64_t alt_count, double allele_prior = 0.333){
+
+        // Genotype priors: HOMOZYOUS REF : HET : HOMOZYGOUS ALT
+        vector<double> geno_priors {0.1, 0.4, 0.8};
+        vector<long double> data_probs (geno_priors.size());
+        vector<long double> geno_probs (geno_priors.size());
+
+#ifdef DEBUG
+//cerr << "Ref count " << ref_count << endl;
+        //           cerr << "Alt count " << alt_count << endl;
+#endif
+        // calculate genotype data probs
+        for (int i = 0; i < geno_priors.size(); i++){
+            long double x = get_binoms(ref_count, alt_count, geno_priors[i]) * allele_prior; 
+#ifdef DEBUG
+//                cerr << "Prob: " << x << endl;
+#endif
+            data_probs[i] = x;
+        }
+        long double sum_data_probs = std::accumulate(data_probs.begin(), data_probs.end(), 0.0);
+
+
+        long double big_prob = 0.0;
+        // 0 = ref, 1 = het, 2 = alt
+        int geno_index = -1;
+
+
+        vector<long double> prob_cache;
+        for (int i = 0; i < geno_priors.size(); ++i){
+            double tmp_binom = data_probs[i];
+            double prob = tmp_binom / sum_data_probs;
+            prob_cache.push_back(prob);
+            if (prob > big_prob ){
+                big_prob = prob;
+                geno_index = i;
+            }
+            else if (prob == big_prob){
+                cerr << "EQUAL PROBABILITIES OF GENOTYPES." << endl;
+                geno_index = -1;
+                break;
+            }
+        }
+
+#ifdef DEBUG
+        //          cerr << "Big prob: " << big_prob << endl
+        //             <<  "geno_index " << geno_index << endl;
+#endif
+
+        return std::make_pair(big_prob, geno_index);
+    };
+
+    auto& genotype_vector = variant.samples["Sample"]["GT"];
+    pair<double, int> prob_and_geno_index = do_math(ref_count, alt_count, 0.333);
+    if (prob_and_geno_index.second == 0){
+        genotype_vector.push_back("0/0");
+    }
+    else if (prob_and_geno_index.second == 1){
+        genotype_vector.push_back("0/1");
+    }
+    else if(prob_and_geno_index.second == 2){
+        genotype_vector.push_back("1/1");
+    }
+    else{
+        genotype_vector.push_back("./.");
+    }
+
+    variant.info["GP"].push_back(std::to_string(prob_and_geno_index.first));
+}
+
+/// Does most of a mapping match its node, so we can trust which node it is on?
+static bool sufficient_matches(const Mapping& m) {
+    int matches = 0;
+    int tot_len = 0;
+    for (int i = 0; i < m.edit_size(); ++i){
+        const Edit& e = m.edit(i);
+        if (e.to_length() == e.from_length() && e.sequence().empty()){
+            matches += e.to_length();
+        }
+        tot_len += e.to_length();
+    }
+    return ( (double) matches / (double) tot_len) > 0.85;
+}
+
 /**
  * run with : vg genotype -L -V v.vcf -I i.fa -R ref.fa 
  */
@@ -205,39 +344,10 @@ void variant_recall(VG* graph,
     }
 
     vcflib::VariantCallFile outvcf;
-    stringstream stream;
-    stream << "##fileformat=VCFv4.2" << endl;
-    stream << "##INFO=<ID=DP,Number=1,Type=Integer,Description=\"Total Depth\">" << endl;
-    stream << "##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Read Depth\">" << endl;
-    stream << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">" << endl;
-    stream << "##FORMAT=<ID=GP,Number=1,Type=String,Description=\"Genotype Probability\">" << endl;
-    stream << "##INFO=<ID=AD,Number=.,Type=Integer,Description=\"Allelic depths for the ref and alt alleles in the order listed\">" << endl;
-    stream << "##INFO=<ID=SVLEN,Number=1,Type=Integer,Description=\"SV length\">" << endl;
-    stream << "##INFO=<ID=SVTYPE,Number=1,Type=String,Description=\"SV Type\">" << endl;
-    stream << "##INFO=<ID=END,Number=1,Type=Integer,Description=\"SV End\">" << endl;
-    stream << "##FORMAT=<ID=SB,Number=4,Type=Integer,Description=\"Forward and reverse support for ref and alt alleles.\">" << endl;
-    stream << "##FORMAT=<ID=XAAD,Number=1,Type=Integer,Description=\"Alt allele read count.\">" << endl;
-    stream << "##FORMAT=<ID=AL,Number=.,Type=Float,Description=\"Allelic likelihoods for the ref and alt alleles in the order listed\">" << endl;
-
-    stream << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\t" << "Sample" << endl;
-
-    string hstr = stream.str();
+    string hstr = recall_vcf_header();
     assert(outvcf.openForOutput(hstr));
     cout << outvcf.header << endl;
 
-    std::function<bool(const Mapping& m)> sufficient_matches = [&](const Mapping& m){
-        int matches = 0;
-        int tot_len = 0;
-        for (int i = 0; i < m.edit_size(); ++i){
-            Edit e = m.edit(i);
-            if (e.to_length() == e.from_length() && e.sequence().empty()){
-                matches += e.to_length();
-            }
-            tot_len += e.to_length();
-        }
-        return ( (double) matches / (double) tot_len) > 0.85;
-    };
-
     std::function<bool(const Mapping& m)> perfect_matches = [&](const Mapping& m){
 
         for (int i = 0; i < m.edit_size(); i++){
@@ -283,7 +393,7 @@ void variant_recall(VG* graph,
         }
     };
 
-    std::function<void(const Alignment&)> index_incr = [&allele_name_to_alignment_name, &sufficient_matches, &node_to_variant, &variant_nodes](const Alignment& a){
+    std::function<void(const Alignment&)> index_incr = [&allele_name_to_alignment_name, &node_to_variant, &variant_nodes](const Alignment& a){
         bool anchored = false;
         bool contained = false;
         int64_t node_for_var = 0;
@@ -377,96 +487,10 @@ void variant_recall(VG* graph,
     }
 
 
-    std::function<long double(int64_t)> fac = [](int64_t t){
-        long double result = 1.0;
-        for (int64_t i = 1; i <= t; ++i){
-            result *= (long double) i; 
-        }
-        return result;
-    };
-
-
-    std::function<long double(int64_t)> big_fac = [](int64_t t){
-        long double result = 1.0;
-        int64_t to_calc = t;
-        if (t > 15){
-            // Screw calculating anything and return a big number.
-            to_calc = 15;
-        }
-        for (int64_t i = 1; i <= to_calc; ++i){
-            result *= (long double) i; 
-        }
-        return result;
-    };
-
-
-
-    // Creates a three-element vector, ref, het, alt
-    std::function<long double(int64_t, int64_t, double)> get_binoms = [fac, big_fac](int64_t ref_count, int64_t alt_count, long double geno_prior){
-        long double top_term = ( big_fac(alt_count + ref_count) );
-        long double bottom_term = (big_fac(ref_count) * big_fac(alt_count));
-
-        long double dat_binom = top_term / bottom_term;
-        return dat_binom * pow(geno_prior, alt_count) * pow((1.0 - geno_prior), ref_count);
-    };
-
-    std::function<pair<long double, int>(int64_t, int64_t, double)> do_math = [get_binoms, fac](int64_t ref_count, int64_t alt_count, double allele_prior = 0.333){
-
-        // Genotype priors: HOMOZYOUS REF : HET : HOMOZYGOUS ALT
-        vector<double> geno_priors {0.1, 0.4, 0.8};
-        vector<long double> data_probs (geno_priors.size());
-        vector<long double> geno_probs (geno_priors.size());
-
-#ifdef DEBUG
-//cerr << "Ref count " << ref_count << endl;
-        //           cerr << "Alt count " << alt_count << endl;
-#endif
-        // calculate genotype data probs
-        for (int i = 0; i < geno_priors.size(); i++){
-            long double x = get_binoms(ref_count, alt_count, geno_priors[i]) * allele_prior; 
-#ifdef DEBUG
-//                cerr << "Prob: " << x << endl;
-#endif
-            data_probs[i] = x;
-        }
-        long double sum_data_probs = std::accumulate(data_probs.begin(), data_probs.end(), 0.0);
-
-
-        long double big_prob = 0.0;
-        // 0 = ref, 1 = het, 2 = alt
-        int geno_index = -1;
-
-
-        vector<long double> prob_cache;
-        for (int i = 0; i < geno_priors.size(); ++i){
-            double tmp_binom = data_probs[i];
-            double prob = tmp_binom / sum_data_probs;
-            prob_cache.push_back(prob);
-            if (prob > big_prob ){
-                big_prob = prob;
-                geno_index = i;
-            }
-            else if (prob == big_prob){
-                cerr << "EQUAL PROBABILITIES OF GENOTYPES." << endl;
-                geno_index = -1;
-                break;
-            }
-        }
-
-#ifdef DEBUG
-        //          cerr << "Big prob: " << big_prob << endl
-        //             <<  "geno_index " << geno_index << endl;
-#endif
-
-        return std::make_pair(big_prob, geno_index);
-    };
-
-    string sampleName = "Sample";
     for (auto it : hash_to_var){
         //cerr << it.second.position << " ";
         it.second.setVariantCallFile(outvcf);
         it.second.format.push_back("GT");
-        auto& genotype_vector = it.second.samples[sampleName]["GT"];
         vector<int64_t> read_counts(it.second.alt.size() + 1, 0);
         for (int i = 0; i <= it.second.alt.size(); ++i){
             int64_t readsum = 0;
@@ -481,27 +505,124 @@ void variant_recall(VG* graph,
             it.second.info["AD"].push_back(std::to_string(readsum));
         }
 
-        pair<double, int> prob_and_geno_index = do_math(  read_counts[0], read_counts[1], 0.333);
-        if (prob_and_geno_index.second == 0){
-            genotype_vector.push_back("0/0");
+        record_recalled_genotype(it.second, read_counts[0], read_counts[1]);
+
+
+        cout << it.second << endl;
+
+    }
+
+}
+
+void variant_recall_xg(const xg::XG& xg_index,
+                       const string& vcf_file,
+                       FastaReference* ref_genome,
+                       vector<FastaReference*> insertions,
+                       const string& gamfile) {
+
+    // Canonicalize a variant the way the alt paths were named when the graph was built
+    auto prepare_variant = [&](vcflib::Variant& var) {
+        var.position -= 1;
+        var.canonicalize_sv(*ref_genome, insertions, -1);
+    };
+
+    // Walk the VCF once to index the nodes on each variant's alt paths. Every
+    // allele gets a number, in VCF order, so all the counting can be done in
+    // flat vectors.
+    unordered_map<int64_t, uint32_t> node_to_allele;
+    size_t allele_count = 0;
+    {
+        vcflib::VariantCallFile vars;
+        vars.open(vcf_file);
+        if (!vars.is_open()) {
+            cerr << "error:[vg genotype] could not open VCF " << vcf_file << endl;
+            exit(1);
         }
-        else if (prob_and_geno_index.second == 1){
-            genotype_vector.push_back("0/1");
+        vcflib::Variant var(vars);
+        while (vars.getNextVariant(var)) {
+            prepare_variant(var);
+            string var_id = make_variant_id(var);
+            for (int alt_ind = 0; alt_ind <= var.alt.size(); alt_ind++) {
+                string alt_id = "_alt_" + var_id + "_" + std::to_string(alt_ind);
+                if (xg_index.path_rank(alt_id) != 0) {
+                    for (auto& mapping : xg_index.path(alt_id).mapping()) {
+                        node_to_allele[mapping.position().node_id()] = allele_count;
+                    }
+                }
+                allele_count++;
+            }
         }
-        else if(prob_and_geno_index.second == 2){
-            genotype_vector.push_back("1/1");
+    }
+
+    // Stream the reads in parallel. A read supports an allele if it is
+    // anchored off the variant nodes and confidently on one of them. Each
+    // thread remembers a hash of each supporting read's name, so that reads
+    // appearing more than once are only counted once per allele.
+    vector<vector<pair<uint32_t, size_t>>> thread_support(get_thread_count());
+    function<void(Alignment&)> count_read = [&](Alignment& a) {
+        bool anchored = false;
+        bool contained = false;
+        int64_t node_for_var = 0;
+        for (int i = 0; i < a.path().mapping_size(); i++){
+            int64_t node_id = a.path().mapping(i).position().node_id();
+            bool on_variant = node_to_allele.count(node_id);
+            if (on_variant && a.mapping_quality() > 20 && sufficient_matches(a.path().mapping(i))){
+                contained = true;
+                node_for_var = node_id;
+            }
+            else if (!on_variant){
+                anchored = true;
+            }
         }
-        else{
-            genotype_vector.push_back("./.");
+        if (contained && anchored) {
+            thread_support[omp_get_thread_num()].emplace_back(node_to_allele.at(node_for_var),
+                                                              std::hash<string>()(a.name()));
         }
+    };
+    ifstream gamstream(gamfile);
+    if (!gamstream.good()) {
+        cerr << "GAM stream is bad " << gamfile << endl;
+        exit(9);
+    }
+    stream::for_each_parallel(gamstream, count_read);
+    gamstream.close();
+
+    // Count the distinct reads for each allele
+    vector<pair<uint32_t, size_t>> support;
+    for (auto& supported : thread_support) {
+        support.insert(support.end(), supported.begin(), supported.end());
+        vector<pair<uint32_t, size_t>>().swap(supported);
+    }
+    sort(support.begin(), support.end());
+    support.erase(unique(support.begin(), support.end()), support.end());
+    vector<int64_t> allele_reads(allele_count, 0);
+    for (auto& supported : support) {
+        allele_reads[supported.first]++;
+    }
+    vector<pair<uint32_t, size_t>>().swap(support);
 
-        it.second.info["GP"].push_back(std::to_string(prob_and_geno_index.first));
-
-
-        cout << it.second << endl;
+    // Walk the VCF again, writing out each variant's genotype as we reach it
+    vcflib::VariantCallFile outvcf;
+    string hstr = recall_vcf_header();
+    assert(outvcf.openForOutput(hstr));
+    cout << outvcf.header << endl;
 
+    vcflib::VariantCallFile vars;
+    vars.open(vcf_file);
+    vcflib::Variant var(vars);
+    size_t allele = 0;
+    while (vars.getNextVariant(var)) {
+        prepare_variant(var);
+        var.setVariantCallFile(outvcf);
+        var.format.push_back("GT");
+        vector<int64_t> read_counts(var.alt.size() + 1, 0);
+        for (int i = 0; i <= var.alt.size(); ++i){
+            read_counts[i] = allele_reads.at(allele++);
+            var.info["AD"].push_back(std::to_string(read_counts[i]));
+        }
+        record_recalled_genotype(var, read_counts[0], read_counts.size() > 1 ? read_counts[1] : 0);
+        cout << var << endl;
     }
-
 }
 
 // void genotype(void variant_recall(VG* graph,
@@ -14,6 +14,7 @@
 #include <list>
 #include "vg.pb.h"
 #include "vg.hpp"
+#include "xg.hpp"
 #include "translator.hpp"
 #include "deconstructor.hpp"
 #include "srpe.hpp"
@@ -37,6 +38,15 @@ void variant_recall(VG* graph,
                     FastaReference* ref_genome,
                     vector<FastaReference*> insertions,
                     string gamfile, bool isIndex = false);
+// Genotype known variants from a VCF file using an xg index with their alt
+// paths, instead of the whole graph. The reads are streamed from the GAM in
+// parallel, only reads on the variants' alleles are counted, and genotypes are
+// written in VCF order.
+void variant_recall_xg(const xg::XG& xg_index,
+                       const string& vcf_file,
+                       FastaReference* ref_genome,
+                       vector<FastaReference*> insertions,
+                       const string& gamfile);
 // Genotype new SVs from a GAM
 void genotype_svs(VG* graph, 
                   string gamfile, string refpath);
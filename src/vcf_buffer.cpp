@@ -27,6 +27,36 @@ void VcfBuffer::handle_buffer() {
 }
 
 void VcfBuffer::fill_buffer() {
+    if (prefetch > 0) {
+        if(file != nullptr && file->is_open() && !has_buffer && safe_to_get) {
+            if (!prefetcher.joinable()) {
+                // Start reading ahead from here
+                start_prefetch();
+            }
+            
+            // Wait for the next variant, or the end of the file
+            unique_lock<mutex> lock(prefetch_mutex);
+            prefetch_ready.wait(lock, [&]() {
+                return !prefetched.empty() || prefetch_done;
+            });
+            
+            if (!prefetched.empty()) {
+                // Already converted to 0-based
+                buffer = std::move(prefetched.front());
+                prefetched.pop_front();
+                has_buffer = true;
+                prefetch_room.notify_one();
+            } else {
+                // The prefetch thread ran out, so we can't get any more
+                safe_to_get = false;
+            }
+#ifdef debug
+            cerr << "Variant in buffer: " << buffer << endl;
+#endif
+        }
+        return;
+    }
+
     if(file != nullptr && file->is_open() && !has_buffer && safe_to_get) {
         // Put a new variant in the buffer if we have a file and the buffer was empty.
         has_buffer = safe_to_get = file->getNextVariant(buffer);
@@ -51,6 +81,9 @@ bool VcfBuffer::set_region(const string& contig, int64_t start, int64_t end) {
         return false;
     }
 
+    // Stop reading ahead from the old position
+    stop_prefetch();
+
     // Discard any variants we had.
     has_buffer = false;
     
@@ -67,7 +100,7 @@ bool VcfBuffer::set_region(const string& contig, int64_t start, int64_t end) {
     }
 }
 
-VcfBuffer::VcfBuffer(vcflib::VariantCallFile* file) : file(file) {
+VcfBuffer::VcfBuffer(vcflib::VariantCallFile* file, size_t prefetch) : file(file), prefetch(prefetch) {
     // Our buffer needs to know about the VCF file it is reading from, because
     // it cares about the sample names. If it's not associated properely, we
     // can't getNextVariant into it.
@@ -77,8 +110,66 @@ VcfBuffer::VcfBuffer(vcflib::VariantCallFile* file) : file(file) {
     }
 }
 
+VcfBuffer::~VcfBuffer() {
+    stop_prefetch();
+}
+
+void VcfBuffer::start_prefetch() {
+    prefetch_done = false;
+    prefetch_stop = false;
+    prefetcher = thread(&VcfBuffer::run_prefetch, this);
+}
 
-WindowedVcfBuffer::WindowedVcfBuffer(vcflib::VariantCallFile* file, size_t window_size): reader(file), window_size(window_size) {
+void VcfBuffer::stop_prefetch() {
+    if (prefetcher.joinable()) {
+        {
+            lock_guard<mutex> lock(prefetch_mutex);
+            prefetch_stop = true;
+        }
+        prefetch_room.notify_all();
+        prefetcher.join();
+    }
+    // Anything read ahead is from the old position
+    prefetched.clear();
+    prefetch_done = false;
+    prefetch_stop = false;
+}
+
+void VcfBuffer::run_prefetch() {
+    while (true) {
+        // Parse the next variant without holding the lock, since that is the
+        // slow part.
+        vcflib::Variant variant(*file);
+        bool got_variant = file->getNextVariant(variant);
+        if (got_variant) {
+            // Convert to 0-based positions.
+            variant.position -= 1;
+        }
+        
+        unique_lock<mutex> lock(prefetch_mutex);
+        if (!got_variant) {
+            // We can't call getNextVariant again until set_region.
+            prefetch_done = true;
+            prefetch_ready.notify_all();
+            return;
+        }
+        
+        // Wait for room in the queue
+        prefetch_room.wait(lock, [&]() {
+            return prefetched.size() < prefetch || prefetch_stop;
+        });
+        if (prefetch_stop) {
+            return;
+        }
+        
+        prefetched.emplace_back(std::move(variant));
+        prefetch_ready.notify_one();
+    }
+}
+
+
+WindowedVcfBuffer::WindowedVcfBuffer(vcflib::VariantCallFile* file, size_t window_size, size_t prefetch):
+    reader(file, prefetch), window_size(window_size) {
     // Nothing to do!
 }
 
@@ -251,24 +342,42 @@ const vector<vector<int>>& WindowedVcfBuffer::get_parsed_genotypes(vcflib::Varia
         assert(result.second);
         auto& genotypes = result.first->second;
         
-        // Track what entry we're on in the map from sample to FORMAT values
-        size_t map_index = 0;
+        // Collect the parsed FORMAT fields for each sample, in map order, so
+        // we can decode them in parallel.
+        vector<const map<string, vector<string>>*> sample_fields;
+        sample_fields.reserve(variant->samples.size());
         for (auto& kv : variant->samples) {
-            // Go through all the parsed FORMAT fields for each sample
-            
+            sample_fields.push_back(&kv.second);
+        }
+        
+        // We can't throw out of the parallel loop, so remember the first error
+        string error;
+        
+#pragma omp parallel for schedule(static) if(sample_fields.size() >= PARALLEL_GENOTYPE_MIN_SAMPLES)
+        for (size_t map_index = 0; map_index < sample_fields.size(); map_index++) {
             // Figure out where in the vector by original sample index our
             // result goes.
             size_t original_index = map_order_to_original.at(map_index);
             
-            // Pull out the GT value. Explode if there isn't one (though
-            // something like "." is acceptable)
-            auto& gt_string = kv.second.at("GT").at(0);
-            
-            // Decompose it and fill in the genotype slot for this sample.
-            genotypes[original_index] = decompose_genotype_fast(gt_string);
-            
-            // Next we'll look at the next sample in map order.
-            map_index++;
+            try {
+                // Pull out the GT value. Explode if there isn't one (though
+                // something like "." is acceptable)
+                auto& gt_string = sample_fields[map_index]->at("GT").at(0);
+                
+                // Decompose it and fill in the genotype slot for this sample.
+                genotypes[original_index] = decompose_genotype_fast(gt_string);
+            } catch (const exception& e) {
+#pragma omp critical (genotype_error)
+                if (error.empty()) {
+                    error = e.what();
+                }
+            }
+        }
+        
+        if (!error.empty()) {
+            // Don't keep the half-decoded genotypes around
+            cached_genotypes.erase(variant);
+            throw runtime_error(error);
         }
     }
     return cached_genotypes.at(variant);
@@ -8,6 +8,10 @@
 
 #include <list>
 #include <tuple>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // We need vcflib
 #include "Variant.h"
@@ -17,6 +21,10 @@ namespace vg {
 
 using namespace std;
 
+/// How many samples a variant needs before WindowedVcfBuffer decodes its
+/// genotypes in parallel
+const size_t PARALLEL_GENOTYPE_MIN_SAMPLES = 256;
+
 /**
  * Provides a one-variant look-ahead buffer on a vcflib::VariantFile. Lets
  * construction functions peek and see if they want the next variant, or lets
@@ -24,6 +32,14 @@ using namespace std;
  * handle. Ought not to be copied.
  *
  * Handles conversion from 1-based vcflib coordinates to 0-based vg coordinates.
+ *
+ * Can optionally read and parse variants ahead on a background thread, so
+ * that parsing (which is slow for VCFs with many samples) overlaps with
+ * whatever the caller does with each variant. While prefetching, the
+ * VariantCallFile belongs to the buffer and must not be used by anything
+ * else. Each worker that wants to read its own region in parallel should open
+ * its own VariantCallFile on the tabix-indexed VCF and set_region on its own
+ * buffer.
  */
 class VcfBuffer {
 
@@ -77,9 +93,16 @@ public:
     
     /**
      * Make a new VcfBuffer buffering the file at the given pointer (which must
-     * outlive the buffer, but which may be null).
+     * outlive the buffer, but which may be null). If prefetch is nonzero, up
+     * to that many variants are read ahead on a background thread, starting
+     * with the first fill_buffer() call.
+     */
+    VcfBuffer(vcflib::VariantCallFile* file = nullptr, size_t prefetch = 0);
+    
+    /**
+     * Stop any background reading.
      */
-    VcfBuffer(vcflib::VariantCallFile* file = nullptr);
+    ~VcfBuffer();
     
 protected:
     
@@ -95,6 +118,32 @@ protected:
     // We can wrap the null file (and never have any variants) with a null here.
     vcflib::VariantCallFile* const file;
     
+    // How many variants to read ahead, or 0 to read on the calling thread
+    const size_t prefetch;
+    // Variants read ahead and waiting to go into the buffer, 0-based
+    deque<vcflib::Variant> prefetched;
+    // Set by the prefetch thread when it has run out of variants
+    bool prefetch_done = false;
+    // Set to ask the prefetch thread to stop early
+    bool prefetch_stop = false;
+    // Protects the prefetch state
+    mutex prefetch_mutex;
+    // Signaled when a variant is prefetched, or the prefetching is done
+    condition_variable prefetch_ready;
+    // Signaled when there is room for another prefetched variant, or the
+    // prefetch thread should stop
+    condition_variable prefetch_room;
+    // The thread doing the reading ahead
+    thread prefetcher;
+    
+    /// Start reading ahead from wherever the file is now.
+    void start_prefetch();
+    
+    /// Stop reading ahead and throw out anything that was read ahead.
+    void stop_prefetch();
+    
+    /// Main loop of the prefetch thread.
+    void run_prefetch();
     
 
 private:
@@ -118,9 +167,11 @@ public:
     /**
      * Make a new WindowedVcfBuffer buffering the file at the given pointer
      * (which must outlive the buffer, but which may be null). The VCF in the
-     * file must be sorted, but may contain overlapping variants.
+     * file must be sorted, but may contain overlapping variants. If prefetch
+     * is nonzero, that many variants are read ahead in the background, as in
+     * VcfBuffer.
      */
-    WindowedVcfBuffer(vcflib::VariantCallFile* file, size_t window_size);
+    WindowedVcfBuffer(vcflib::VariantCallFile* file, size_t window_size, size_t prefetch = 0);
     
     /**
      * Advance to the next variant, making it the current variant. Returns true
@@ -153,7 +204,8 @@ public:
      * for all the samples, in the order the samples appear in the VCF file.
      *
      * Returns a reference which is valid until the variant passed in is
-     * scrolled out of the buffer.
+     * scrolled out of the buffer. Variants with many samples have their
+     * genotypes decoded in parallel.
      */
     const vector<vector<int>>& get_parsed_genotypes(vcflib::Variant* variant);
     
@@ -21,6 +21,17 @@ string Vectorizer::output_wabbit_map(){
     return sout.str();
 }
 
+int Vectorizer::wabbit_class(const string& name){
+    auto found = wabbit_map.find(name);
+    if (found != wabbit_map.end()){
+        return found->second;
+    }
+    // Classes are numbered from 1, as vowpal wabbit's multiclass labels are
+    int next_class = wabbit_map.size() + 1;
+    wabbit_map[name] = next_class;
+    return next_class;
+}
+
 void Vectorizer::emit(ostream &out, bool r_format=false, bool annotate=false){
     /**TODO print header*/
     //size_t ent_size = my_xg.node_count + my_xg.edge_count;
@@ -104,30 +115,34 @@ vector<double> Vectorizer::alignment_to_identity_hot(Alignment a){
         int64_t node_id = pos.node_id();
         int64_t key = my_xg->id_to_rank(node_id);
 
-        //Calculate % identity by walking the edits and counting matches.
-        double pct_id = 0.0;
-        double match_len = 0.0;
-        double total_len = 0.0;
-
-        for (int j = 0; j < mapping.edit_size(); j++){
-            Edit e = mapping.edit(j);
-            total_len += e.from_length();
-            if (e.from_length() == e.to_length() && e.sequence() == ""){
-                match_len += (double) e.to_length();
-            }
-            else if (e.from_length() == e.to_length() && e.sequence() != ""){
-                // TODO if we map but don't match exactly, add half the average length to match_length
-                //match_len += (double) (0.5 * ((double) e.to_length()));
-            }
-            else{
-                
-            }
+        ret[key - 1] = mapping_identity(mapping);
+    }
+    return ret;
+}
+
+double Vectorizer::mapping_identity(const Mapping& mapping){
+    //Calculate % identity by walking the edits and counting matches.
+    double pct_id = 0.0;
+    double match_len = 0.0;
+    double total_len = 0.0;
+
+    for (int j = 0; j < mapping.edit_size(); j++){
+        Edit e = mapping.edit(j);
+        total_len += e.from_length();
+        if (e.from_length() == e.to_length() && e.sequence() == ""){
+            match_len += (double) e.to_length();
+        }
+        else if (e.from_length() == e.to_length() && e.sequence() != ""){
+            // TODO if we map but don't match exactly, add half the average length to match_length
+            //match_len += (double) (0.5 * ((double) e.to_length()));
+        }
+        else{
             
         }
-        pct_id = (match_len == 0.0 && total_len == 0.0) ? 0.0 : (match_len / total_len);
-        ret[key - 1] = pct_id;
+        
     }
-    return ret;
+    pct_id = (match_len == 0.0 && total_len == 0.0) ? 0.0 : (match_len / total_len);
+    return pct_id;
 }
 
 bit_vector Vectorizer::alignment_to_onehot(Alignment a){
@@ -148,6 +163,60 @@ bit_vector Vectorizer::alignment_to_onehot(Alignment a){
     return ret;
 }
 
+vector<pair<size_t, double>> Vectorizer::alignment_to_sparse(const Alignment& a, bool a_hot, bool identity_hot){
+    vector<pair<size_t, double>> ret;
+    const Path& path = a.path();
+    for (int i = 0; i < path.mapping_size(); i++){
+        const Mapping& mapping = path.mapping(i);
+        if(! mapping.has_position()){
+            continue;
+        }
+        int64_t node_id = mapping.position().node_id();
+        size_t key = my_xg->id_to_rank(node_id);
+        double value = 1.0;
+        if (a_hot){
+            value = my_xg->paths_of_node(node_id).empty() ? 1.0 : 2.0;
+        }
+        else if (identity_hot){
+            value = mapping_identity(mapping);
+        }
+        ret.emplace_back(key - 1, value);
+    }
+    // A path may visit a node more than once; like the dense vectors, keep
+    // the value from the last visit.
+    stable_sort(ret.begin(), ret.end(), [](const pair<size_t, double>& x, const pair<size_t, double>& y){
+        return x.first < y.first;
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < ret.size(); i++){
+        if (kept > 0 && ret[kept - 1].first == ret[i].first){
+            ret[kept - 1] = ret[i];
+        }
+        else{
+            ret[kept++] = ret[i];
+        }
+    }
+    ret.resize(kept);
+    return ret;
+}
+
+string Vectorizer::libsvm_row(const string& label, const vector<pair<size_t, double>>& entries){
+    stringstream sout;
+    sout << label;
+    for (auto& entry : entries){
+        sout << " " << entry.first + 1 << ":" << entry.second;
+    }
+    return sout.str();
+}
+
+string Vectorizer::coo_rows(size_t row, const vector<pair<size_t, double>>& entries){
+    stringstream sout;
+    for (auto& entry : entries){
+        sout << row << "\t" << entry.first << "\t" << entry.second << "\n";
+    }
+    return sout.str();
+}
+
 vector<double> Vectorizer::alignment_to_custom_score(Alignment a, std::function<double(Alignment)> lambda ){
     vector<double> ret;
     
@@ -31,6 +31,20 @@ class Vectorizer{
     vector<int> alignment_to_a_hot(Alignment a);
     vector<double> alignment_to_custom_score(Alignment a, std::function<double(Alignment)> lambda);
     vector<double> alignment_to_identity_hot(Alignment a);
+    /// Get only the nonzero entries of an alignment's one-hot vector (or its
+    /// a-hot or identity-hot vector), as (entity index, value) pairs sorted by
+    /// index, without allocating a vector the size of the graph. Safe to call
+    /// from several threads at once.
+    vector<pair<size_t, double>> alignment_to_sparse(const Alignment& a, bool a_hot = false, bool identity_hot = false);
+    /// Format sparse entries as a libsvm row: the label, then "index:value"
+    /// for each entry with 1-based indices.
+    string libsvm_row(const string& label, const vector<pair<size_t, double>>& entries);
+    /// Format sparse entries as COO triples, one "row\tcolumn\tvalue" line
+    /// per entry with 0-based indices.
+    string coo_rows(size_t row, const vector<pair<size_t, double>>& entries);
+    /// Get the class number vowpal wabbit and libsvm output use for a name,
+    /// assigning the next one if the name is new.
+    int wabbit_class(const string& name);
     string output_wabbit_map();
     template<typename T> string format(T v){
         stringstream sout;
@@ -44,10 +58,7 @@ class Vectorizer{
     }
     template<typename T> string wabbitize(string name, T v){
         stringstream sout;
-        if (!(wabbit_map.count(name) > 0)){
-            wabbit_map[name] = wabbit_map.size();
-        }
-        sout << wabbit_map[name] << " " << "1.0" << " " << "'" << name
+        sout << wabbit_class(name) << " " << "1.0" << " " << "'" << name
             << " " << "|" << " " << "vectorspace" << " ";
         for (int i = 0; i < v.size(); i++){
             sout << i << ":" << v[i];
@@ -58,6 +69,9 @@ class Vectorizer{
         return sout.str();
     }
   private:
+    /// Get the fraction of a mapping's bases that match the graph exactly
+    double mapping_identity(const Mapping& mapping);
+
     xg::XG* my_xg;
     //We use vectors for both names and bit vectors because we want to allow the use of duplicate
     // names. This allows things like generating simulated data with true cluster as the name.
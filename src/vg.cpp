@@ -4,6 +4,7 @@
 // We need to use ultrabubbles for dot output
 #include "genotypekit.hpp"
 #include "algorithms/topological_sort.hpp"
+#include <chrono>
 #include <raptor2/raptor2.h>
 #include <stPinchGraphs.h>
 
@@ -15,6 +16,9 @@ using namespace std;
 using namespace gfak;
 
 
+// How many graph chunks each thread decodes at a time while loading
+const size_t LOAD_CHUNKS_PER_THREAD = 16;
+
 // construct from a stream of protobufs
 VG::VG(istream& in, bool showp, bool warn_on_duplicates) {
 
@@ -26,15 +30,56 @@ VG::VG(istream& in, bool showp, bool warn_on_duplicates) {
         create_progress("loading graph", count);
     };
 
-    // the graph is read in chunks, which are attached to this graph
+    // the graph is read in chunks, which are decoded in parallel a batch at a
+    // time and then attached to this graph in the order they were written
+    size_t batch_size = LOAD_CHUNKS_PER_THREAD * get_thread_count();
+    vector<stream::SerializedMessage> serialized;
+    serialized.reserve(batch_size);
+    vector<Graph> chunks;
     uint64_t i = 0;
-    function<void(Graph&)> lambda = [this, &i, &warn_on_duplicates](Graph& g) {
-        update_progress(++i);
-        // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
-        extend(g, warn_on_duplicates);
+    auto attach_batch = [&]() {
+        chunks.resize(serialized.size());
+        bool parsed = true;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t j = 0; j < serialized.size(); j++) {
+            if (!chunks[j].ParseFromString(serialized[j].bytes)) {
+                parsed = false;
+            }
+            string().swap(serialized[j].bytes);
+        }
+        if (!parsed) {
+            throw runtime_error("[VG] obsolete, invalid, or corrupt graph chunk");
+        }
+        
+        // Size the indexes for the whole batch up front, so they don't rehash
+        // as the chunks go in
+        size_t node_count = graph.node_size();
+        size_t edge_count = graph.edge_size();
+        for (auto& chunk : chunks) {
+            node_count += chunk.node_size();
+            edge_count += chunk.edge_size();
+        }
+        reserve_indexes(node_count, edge_count);
+        
+        for (auto& chunk : chunks) {
+            update_progress(++i);
+            // We usually expect these to not overlap in nodes or edges, so complain unless we've been told not to.
+            extend(chunk, warn_on_duplicates);
+        }
+        serialized.clear();
+        chunks.clear();
+    };
+    
+    function<void(stream::SerializedMessage&)> lambda = [&](stream::SerializedMessage& message) {
+        serialized.emplace_back();
+        serialized.back().bytes.swap(message.bytes);
+        if (serialized.size() == batch_size) {
+            attach_batch();
+        }
     };
 
     stream::for_each(in, lambda, handle_count);
+    attach_batch();
 
     // Collate all the path mappings we got from all the different chunks. A
     // mapping from any chunk might fall anywhere in a path (because paths may
@@ -128,30 +173,28 @@ string VG::get_sequence(const handle_t& handle) const {
     
 }
 
-bool VG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
-    // Are we reverse?
-    bool is_reverse = get_is_reverse(handle);
-    
-    // Which edges will we look at?
-    auto& edge_set = (go_left != is_reverse) ? edges_on_start : edges_on_end;
-    
-    // Look up edges of this node specifically
-    auto found = edge_set.find(get_id(handle));
-    if (found != edge_set.end()) {
-        // There are (or may be) edges
-        for (auto& id_and_flip : found->second) {
-            // For each edge destination and the flag that says if we flip orientation or not
-            bool new_reverse = (is_reverse != id_and_flip.second);
-            if (!iteratee(get_handle(id_and_flip.first, new_reverse))) {
-                // Iteratee said to stop
-                return false;
-            }
-        }
+bool VG::get_sequence_view(const handle_t& handle, sequence_view_t& view_out) const {
+    auto found = node_by_id.find(get_id(handle));
+    if (found == node_by_id.end()) {
+        throw runtime_error("No node " + to_string(get_id(handle)) + " in graph");
     }
-    
+    const string& sequence = (*found).second->sequence();
+    view_out.bases = sequence.data();
+    view_out.length = sequence.size();
+    view_out.is_reverse = as_integer(handle) & HIGH_BIT;
     return true;
 }
 
+char VG::get_base(const handle_t& handle, size_t index) const {
+    sequence_view_t view;
+    get_sequence_view(handle, view);
+    return view[index];
+}
+
+bool VG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    return follow_edges_inline(handle, go_left, iteratee);
+}
+
 void VG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
     if (parallel) {
 #pragma omp parallel for schedule(dynamic,1)
@@ -338,7 +381,10 @@ void VG::sync_paths(void) {
     paths.rebuild_mapping_aux();
 }
 
-void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
+// How many chunks each thread builds and compresses at a time while saving
+const size_t SAVE_CHUNKS_PER_THREAD = 4;
+
+void VG::serialize_to_ostream(ostream& out, id_t chunk_size, size_t chunk_bytes) {
 
     // This makes sure mapping ranks are updated to reflect their actual
     // positions along their paths.
@@ -346,7 +392,8 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
     
     create_progress("saving graph", graph.node_size());
     
-    // Have a function to grab the chunk for the given range of nodes
+    // Have a function to grab the chunk for the given range of nodes. It only
+    // reads from this graph, so chunks can be built in parallel.
     function<Graph(uint64_t, uint64_t)> lambda = [this](uint64_t element_start, uint64_t element_length) -> Graph {
     
         VG g;
@@ -358,9 +405,12 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
             // Grab the node and only the edges where it has the lower ID.
             // This prevents duplication of edges in the serialized output.
             nonoverlapping_node_context_without_paths(node, g);
-            auto& mappings = paths.get_node_mapping(node);
+            auto found = paths.node_mapping.find(node->id());
+            if (found == paths.node_mapping.end()) {
+                continue;
+            }
             //cerr << "getting node mappings for " << node->id() << endl;
-            for (auto m : mappings) {
+            for (auto& m : found->second) {
                 auto& name = m.first;
                 auto& mappings = m.second;
                 for (auto& mapping : mappings) {
@@ -383,13 +433,13 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
         if (element_start == 0) {
             // The first chunk will always include all the 0-length paths.
             // TODO: if there are too many, this chunk may grow too large!
-            paths.for_each_name([&](const string& name) {
+            for (auto& path : paths._paths) {
                 // For every path
-                if (paths.get_path(name).empty()) {
+                if (path.second.empty()) {
                     // If its mapping list has no mappings, make it in the chunk
-                    g.paths.create_path(name);
+                    g.paths.create_path(path.first);
                 }
-            });
+            }
         }
 
         // record our circular paths
@@ -398,21 +448,77 @@ void VG::serialize_to_ostream(ostream& out, id_t chunk_size) {
         // the nodes they cross are stored in graph.nodes
         g.paths.to_graph(g.graph);
 
-        update_progress(element_start);
         return g.graph;
     
     };
-
-    // Write all the dynamically sized chunks, starting with our selected chunk
-    // size as a guess.
-    stream::write(out, graph.node_size(), chunk_size, lambda);
+    
+    if (graph.node_size() == 0) {
+        // Still write an empty stream
+        stream::write(out, 0, chunk_size, lambda);
+        destroy_progress();
+        return;
+    }
+    
+    // Cut the nodes into chunks of at most chunk_size nodes, ending a chunk
+    // early once we guess it has grown past chunk_bytes
+    vector<pair<uint64_t, uint64_t>> chunks;
+    size_t chunk_start = 0;
+    size_t estimated_bytes = 0;
+    for (size_t j = 0; j < graph.node_size(); ++j) {
+        const Node& node = graph.node(j);
+        estimated_bytes += node.sequence().size() + 16;
+        estimated_bytes += 16 * (edges_start(node.id()).size() + edges_end(node.id()).size());
+        auto found = paths.node_mapping.find(node.id());
+        if (found != paths.node_mapping.end()) {
+            for (auto& m : found->second) {
+                estimated_bytes += 32 * m.second.size();
+            }
+        }
+        if (j + 1 - chunk_start >= (size_t) chunk_size || estimated_bytes >= chunk_bytes) {
+            chunks.emplace_back(chunk_start, j + 1 - chunk_start);
+            chunk_start = j + 1;
+            estimated_bytes = 0;
+        }
+    }
+    if (chunk_start < graph.node_size()) {
+        chunks.emplace_back(chunk_start, graph.node_size() - chunk_start);
+    }
+    
+    // Build and compress the chunks in parallel, each as its own stream, and
+    // write them in order. Concatenated streams make a valid stream.
+    size_t batch_size = SAVE_CHUNKS_PER_THREAD * get_thread_count();
+    vector<string> compressed;
+    for (size_t batch_start = 0; batch_start < chunks.size(); batch_start += batch_size) {
+        size_t batch_end = min(chunks.size(), batch_start + batch_size);
+        compressed.clear();
+        compressed.resize(batch_end - batch_start);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = batch_start; i < batch_end; i++) {
+            uint64_t start = chunks[i].first;
+            uint64_t length = chunks[i].second;
+            function<Graph(uint64_t, uint64_t)> chunk_lambda = [&](uint64_t offset, uint64_t count) -> Graph {
+                return lambda(start + offset, count);
+            };
+            // This still splits up the chunk if our guess let it get too big
+            stringstream chunk_out;
+            stream::write(chunk_out, length, length, chunk_lambda);
+            compressed[i - batch_start] = chunk_out.str();
+        }
+        for (size_t i = batch_start; i < batch_end; i++) {
+            out.write(compressed[i - batch_start].data(), compressed[i - batch_start].size());
+            update_progress(chunks[i].first + chunks[i].second);
+        }
+        if (!out) {
+            throw runtime_error("[VG] I/O error writing graph");
+        }
+    }
 
     destroy_progress();
 }
 
-void VG::serialize_to_file(const string& file_name, id_t chunk_size) {
+void VG::serialize_to_file(const string& file_name, id_t chunk_size, size_t chunk_bytes) {
     ofstream f(file_name);
-    serialize_to_ostream(f);
+    serialize_to_ostream(f, chunk_size, chunk_bytes);
     f.close();
 }
 
@@ -1641,6 +1747,11 @@ bool VG::nodes_are_perfect_path_neighbors(NodeTraversal left, NodeTraversal righ
     // they do not have exactly the same counts of paths
     if (paths.of_node(left.node->id()) != paths.of_node(right.node->id())) return false;
     // now we know that the paths are identical in count and name between the two nodes
+    
+    // If either node has no mapping index entry, neither has any paths. Don't
+    // make entries for them, so this only reads the graph and can be called
+    // from many threads.
+    if (!paths.has_node_mapping(left.node->id()) || !paths.has_node_mapping(right.node->id())) return true;
 
     // get the mappings for each node
     auto& m1 = paths.get_node_mapping(left.node->id());
@@ -1716,10 +1827,53 @@ bool VG::nodes_are_perfect_path_neighbors(NodeTraversal left, NodeTraversal righ
 // respects stored paths
 set<list<NodeTraversal>> VG::simple_components(int min_size) {
 
-    // go around and establish groupings
+    // Checking whether neighbors can be merged needs the paths on both of
+    // them, which is the expensive part, and only reads the graph. So for each
+    // node in its forward orientation, find the traversal it can be merged
+    // with on each side in parallel. A null node means it can't be merged.
+    // Backward traversals are rare here, and are checked when we get to them.
+    vector<NodeTraversal> mergeable_prev(graph.node_size());
+    vector<NodeTraversal> mergeable_next(graph.node_size());
+    
+    // go left and right through each as far as we have only single edges connecting us
+    // to nodes that have only single edges coming in or out
+    // that go to other nodes, without breaking stored paths
+    auto find_mergeable_prev = [this](NodeTraversal here) {
+        vector<NodeTraversal> prev = nodes_prev(here);
+        if (prev.size() == 1 && node_count_next(prev.front()) == 1
+            && nodes_are_perfect_path_neighbors(prev.front(), here)) {
+            return prev.front();
+        }
+        return NodeTraversal();
+    };
+    auto find_mergeable_next = [this](NodeTraversal here) {
+        vector<NodeTraversal> next = nodes_next(here);
+        if (next.size() == 1 && node_count_prev(next.front()) == 1
+            && nodes_are_perfect_path_neighbors(here, next.front())) {
+            return next.front();
+        }
+        return NodeTraversal();
+    };
+    
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < graph.node_size(); ++i) {
+        NodeTraversal here(graph.mutable_node(i), false);
+        mergeable_prev[i] = find_mergeable_prev(here);
+        mergeable_next[i] = find_mergeable_next(here);
+    }
+    
+    auto step_left = [&](NodeTraversal here) {
+        return here.backward ? find_mergeable_prev(here) : mergeable_prev[node_index[here.node]];
+    };
+    auto step_right = [&](NodeTraversal here) {
+        return here.backward ? find_mergeable_next(here) : mergeable_next[node_index[here.node]];
+    };
+
+    // go around and establish groupings, visiting the nodes in order so the
+    // components come out the same every time
     set<Node*> seen;
     set<list<NodeTraversal>> components;
-    for_each_node([this, min_size, &components, &seen](Node* n) {
+    for_each_node([&](Node* n) {
             if (seen.count(n)) return;
             
 #ifdef debug
@@ -1727,98 +1881,33 @@ set<list<NodeTraversal>> VG::simple_components(int min_size) {
 #endif
             
             seen.insert(n);
-            // go left and right through each as far as we have only single edges connecting us
-            // to nodes that have only single edges coming in or out
-            // that go to other nodes
             list<NodeTraversal> c;
             // go left
             {
-                NodeTraversal l(n, false);
-                vector<NodeTraversal> prev = nodes_prev(l);
-#ifdef debug
-                cerr << "\tLeft: ";
-                for (auto& x : prev) {
-                    cerr << x << "(" << node_count_next(x) << " edges right) ";
-                }
-                cerr << endl;
-#endif
-                while (prev.size() == 1
-                       && node_count_next(prev.front()) == 1) {   
-                       
-                    // While there's only one node left of here, and one node right of that node...
-                    auto last = l;
-                    // Move over left to that node
-                    l = prev.front();
-                    // avoid merging if it breaks stored paths
-                    if (!nodes_are_perfect_path_neighbors(l, last)) {
-#ifdef debug
-                        cerr << "\tNot perfect neighbors!" << endl;
-#endif
-                        break;
-                    }
-                    // avoid merging if it's already in this or any other component (catch self loops)
-                    if (seen.count(l.node)) {
+                NodeTraversal l = step_left(NodeTraversal(n, false));
+                // avoid merging if it's already in this or any other component (catch self loops)
+                while (l.node != nullptr && !seen.count(l.node)) {
 #ifdef debug
-                        cerr << "\tAlready seen!" << endl;
-#endif
-                        break;
-                    }
-                    prev = nodes_prev(l);
-#ifdef debug
-                    cerr << "\tLeft: ";
-                    for (auto& x : prev) {
-                        cerr << x << "(" << node_count_next(x) << " edges right) ";
-                    }
-                    cerr << endl;
+                    cerr << "\tLeft: " << l << endl;
 #endif
                     c.push_front(l);
                     seen.insert(l.node);
+                    l = step_left(l);
                 }
             }
             // add the node (in the middle)
             c.push_back(NodeTraversal(n, false));
             // go right
             {
-                NodeTraversal r(n, false);
-                vector<NodeTraversal> next = nodes_next(r);
-#ifdef debug
-                cerr << "\tRight: ";
-                for (auto& x : next) {
-                    cerr << x << "(" << node_count_prev(x) << " edges left) ";
-                }
-                cerr << endl;
-#endif
-                while (next.size() == 1
-                       && node_count_prev(next.front()) == 1) {   
-                       
-                    // While there's only one node right of here, and one node left of that node...
-                    auto last = r;
-                    // Move over right to that node
-                    r = next.front();
-                    // avoid merging if it breaks stored paths
-                    if (!nodes_are_perfect_path_neighbors(last, r)) {
-#ifdef debug
-                        cerr << "\tNot perfect neighbors!" << endl;
-#endif
-                        break;
-                    }
-                    // avoid merging if it's already in this or any other component (catch self loops)
-                    if (seen.count(r.node)) {
-#ifdef debug
-                        cerr << "\tAlready seen!" << endl;
-#endif
-                        break;
-                    }
-                    next = nodes_next(r);
+                NodeTraversal r = step_right(NodeTraversal(n, false));
+                // avoid merging if it's already in this or any other component (catch self loops)
+                while (r.node != nullptr && !seen.count(r.node)) {
 #ifdef debug
-                    cerr << "\tRight: ";
-                    for (auto& x : next) {
-                        cerr << x << "(" << node_count_prev(x) << " edges left) ";
-                    }
-                    cerr << endl;
+                    cerr << "\tRight: " << r << endl;
 #endif
                     c.push_back(r);
                     seen.insert(r.node);
+                    r = step_right(r);
                 }
             }
             if (c.size() >= min_size) {
@@ -2167,6 +2256,17 @@ void VG::resize_indexes(void) {
     edges_on_end.resize(graph.node_size());
 }
 
+void VG::reserve_indexes(size_t node_count, size_t edge_count) {
+    graph.mutable_node()->Reserve(node_count);
+    graph.mutable_edge()->Reserve(edge_count);
+    node_index.resize(node_count);
+    node_by_id.resize(node_count);
+    edge_by_sides.resize(edge_count);
+    edge_index.resize(edge_count);
+    edges_on_start.resize(node_count);
+    edges_on_end.resize(node_count);
+}
+
 void VG::rebuild_indexes(void) {
     clear_indexes_no_resize();
     build_indexes_no_init_size();
@@ -2493,17 +2593,28 @@ id_t VG::min_node_id(void) {
 }
 
 void VG::compact_ids(void) {
+    // nodes are numbered from 1 in the order they are stored
     hash_map<id_t, id_t> new_id;
-    id_t id = 1; // start at 1
-    for_each_node([&id, &new_id](Node* n) {
-            new_id[n->id()] = id++; });
-//#pragma omp parallel for
-    for_each_node([&new_id](Node* n) {
-            n->set_id(new_id[n->id()]); });
-//#pragma omp parallel for
-    for_each_edge([&new_id](Edge* e) {
-            e->set_from(new_id[e->from()]);
-            e->set_to(new_id[e->to()]); });
+    new_id.resize(graph.node_size());
+    for (id_t i = 0; i < graph.node_size(); ++i) {
+        new_id[graph.node(i).id()] = i + 1;
+    }
+    // The table is only read from here on, so the rewrite can be parallel.
+    // Ids not in the table (dangling edges) are left alone.
+    auto lookup = [&new_id](id_t id) {
+        auto found = new_id.find(id);
+        return found == new_id.end() ? id : found->second;
+    };
+#pragma omp parallel for
+    for (id_t i = 0; i < graph.node_size(); ++i) {
+        graph.mutable_node(i)->set_id(i + 1);
+    }
+#pragma omp parallel for
+    for (id_t i = 0; i < graph.edge_size(); ++i) {
+        Edge* e = graph.mutable_edge(i);
+        e->set_from(lookup(e->from()));
+        e->set_to(lookup(e->to()));
+    }
     paths.swap_node_ids(new_id);
     rebuild_indexes();
 }
@@ -2627,9 +2738,12 @@ void VG::dice_nodes(int max_node_size) {
             [this, &nodes](Node* n) {
                 nodes.push_back(n);
             });
-        auto lambda =
-            [this, max_node_size](Node* n) {
-            int node_size = n->sequence().size();
+        
+        // Work out where to cut every node in parallel
+        vector<vector<int>> divisions(nodes.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            int node_size = nodes[i]->sequence().size();
             if (node_size > max_node_size) {
                 int div = 2;
                 while (node_size/div > max_node_size) {
@@ -2638,28 +2752,28 @@ void VG::dice_nodes(int max_node_size) {
                 int segment_size = node_size/div;
 
                 // Make up all the positions to divide at
-                vector<int> divisions;
                 int last_division = 0;
                 while(last_division + segment_size < node_size) {
                     // We can fit another division point
                     last_division += segment_size;
-                    divisions.push_back(last_division);
+                    divisions[i].push_back(last_division);
                 }
-
-                // What segments are we making?
-                vector<Node*> segments;
-
-                // Do the actual division
-                divide_node(n, divisions, segments);
             }
-        };
-        for (int i = 0; i < nodes.size(); ++i) {
-            lambda(nodes[i]);
+        }
+        
+        // and then do the actual division, in node order
+        vector<Node*> segments;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!divisions[i].empty()) {
+                segments.clear();
+                divide_node(nodes[i], divisions[i], segments);
+            }
+            vector<int>().swap(divisions[i]);
         }
     }
 
-    // Set the ranks again
-    paths.rebuild_mapping_aux();
+    // Set the ranks again. The new mappings are all in path order, so this
+    // just numbers them.
     paths.compact_ranks();
 }
 
@@ -3703,13 +3817,10 @@ void VG::set_edge(Edge* edge) {
 
 void VG::for_each_edge_parallel(function<void(Edge*)> lambda) {
     create_progress(graph.edge_size());
-    id_t completed = 0;
-#pragma omp parallel for shared(completed)
+#pragma omp parallel for
     for (id_t i = 0; i < graph.edge_size(); ++i) {
         lambda(graph.mutable_edge(i));
-        if (completed++ % 1000 == 0) {
-            update_progress(completed);
-        }
+        increment_progress();
     }
     destroy_progress();
 }
@@ -3911,13 +4022,10 @@ Node* VG::create_node(const string& seq, id_t id) {
 
 void VG::for_each_node_parallel(function<void(Node*)> lambda) {
     create_progress(graph.node_size());
-    id_t completed = 0;
-    #pragma omp parallel for schedule(dynamic,1) shared(completed)
+    #pragma omp parallel for schedule(dynamic,1)
     for (id_t i = 0; i < graph.node_size(); ++i) {
         lambda(graph.mutable_node(i));
-        if (completed++ % 1000 == 0) {
-            update_progress(completed);
-        }
+        increment_progress();
     }
     destroy_progress();
 }
@@ -4308,7 +4416,6 @@ void VG::divide_node(Node* node, vector<int>& positions, vector<Node*>& parts) {
             cerr << omp_get_thread_num() << ": dividing mapping " << pb2json(*m) << endl;
 #endif
 
-            string path_name = paths.mapping_path_name(m);
             // OK, we're somewhat N^2 in mapping division, if there are edits to
             // copy. But we're nearly linear!
 
@@ -4361,22 +4468,13 @@ void VG::divide_node(Node* node, vector<int>& positions, vector<Node*>& parts) {
             remainder.mutable_position()->set_offset(0);
             mapping_parts.push_back(remainder);
 
-            //divide_mapping
-            // with the mapping divided, insert the pieces where the old one was
-            bool is_rev = m->position().is_reverse();
-            auto mpit = paths.remove_mapping(m);
-            if (is_rev) {
-                // insert left then right in the path, since we're going through
-                // this node backward (insert puts *before* the iterator)
-                for(auto i = mapping_parts.begin(); i != mapping_parts.end(); ++i) {
-                    mpit = paths.insert_mapping(mpit, path_name, *i);
-                }
-            } else {
-                // insert right then left (insert puts *before* the iterator)
-                for(auto i = mapping_parts.rbegin(); i != mapping_parts.rend(); ++i) {
-                    mpit = paths.insert_mapping(mpit, path_name, *i);
-                }
+            // with the mapping divided, put the pieces where the old one was,
+            // in the order the path visits them
+            if (m->position().is_reverse()) {
+                // we're going through this node backward
+                reverse(mapping_parts.begin(), mapping_parts.end());
             }
+            paths.replace_mapping(m, mapping_parts);
 
 
 
@@ -4881,20 +4979,30 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     }
 #endif
 
-    std::vector<Path> simplified_paths;
-
-    for(auto path : paths_to_add) {
-        // Simplify the path, just to eliminate adjacent match Edits in the same
-        // Mapping (because we don't have or want a breakpoint there)
-        simplified_paths.push_back(simplify(path));
-    }
+    std::vector<Path> simplified_paths(paths_to_add.size());
 
     // If we are going to actually add the paths to the graph, we need to break at path ends
     break_at_ends |= save_paths;
 
-    for(auto path : simplified_paths) {
+    // Neither simplifying nor finding breakpoints touches the graph, so do
+    // them in parallel, with a breakpoint map per thread.
+    vector<map<id_t, set<pos_t>>> thread_breakpoints(get_thread_count());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < paths_to_add.size(); i++) {
+        // Simplify the path, just to eliminate adjacent match Edits in the same
+        // Mapping (because we don't have or want a breakpoint there)
+        simplified_paths[i] = simplify(paths_to_add[i]);
         // Add in breakpoints from each path
-        find_breakpoints(path, breakpoints, break_at_ends);
+        find_breakpoints(simplified_paths[i], thread_breakpoints[omp_get_thread_num()], break_at_ends);
+    }
+    for (auto& found : thread_breakpoints) {
+        if (breakpoints.empty()) {
+            swap(breakpoints, found);
+            continue;
+        }
+        for (auto& kv : found) {
+            breakpoints[kv.first].insert(kv.second.begin(), kv.second.end());
+        }
     }
 
     // Invert the breakpoints that are on the reverse strand
@@ -4969,6 +5077,79 @@ vector<Translation> VG::edit(vector<Path>& paths_to_add, bool save_paths, bool u
     return make_translation(node_translation, added_nodes, orig_node_sizes);
 }
 
+vector<Translation> VG::edit(const function<void(const function<void(Path&)>&, bool parallel)>& for_each_path,
+                             bool update_paths, bool break_at_ends) {
+    // Collect the breakpoints in parallel, with a breakpoint map per thread.
+    // Their number is bounded by the size of the graph, not the number of
+    // paths.
+    vector<map<id_t, set<pos_t>>> thread_breakpoints(get_thread_count());
+    for_each_path([&](Path& path) {
+        // Simplify the path, just to eliminate adjacent match Edits in the same
+        // Mapping (because we don't have or want a breakpoint there)
+        find_breakpoints(simplify(path), thread_breakpoints[omp_get_thread_num()], break_at_ends);
+    }, true);
+    map<id_t, set<pos_t>> breakpoints;
+    for (auto& found : thread_breakpoints) {
+        if (breakpoints.empty()) {
+            swap(breakpoints, found);
+            continue;
+        }
+        for (auto& kv : found) {
+            breakpoints[kv.first].insert(kv.second.begin(), kv.second.end());
+        }
+        map<id_t, set<pos_t>>().swap(found);
+    }
+
+    // Invert the breakpoints that are on the reverse strand
+    breakpoints = forwardize_breakpoints(breakpoints);
+
+    // Clear existing path ranks.
+    paths.clear_mapping_ranks();
+
+    // get the node sizes, for use when making the translation
+    map<id_t, size_t> orig_node_sizes;
+    for_each_node([&](Node* node) {
+            orig_node_sizes[node->id()] = node->sequence().size();
+        });
+
+    // Break all the nodes at once
+    auto node_translation = ensure_breakpoints(breakpoints);
+    map<id_t, set<pos_t>>().swap(breakpoints);
+
+    // Novel sequences that many paths agree on are only added once, since
+    // added_seqs remembers what we added where
+    map<pair<pos_t, string>, vector<Node*>> added_seqs;
+    map<Node*, Path> added_nodes;
+    for_each_path([&](Path& path) {
+        Path added = add_nodes_and_edges(simplify(path), node_translation, added_seqs, added_nodes, orig_node_sizes);
+        if (update_paths) {
+            path = std::move(added);
+        }
+    }, false);
+
+    // Rebuild path ranks, aux mapping, etc. by compacting the path ranks
+    paths.compact_ranks();
+
+    // make sure the embedded paths still have all their edges
+    paths.for_each([&](const Path& path) {
+            for (size_t i = 1; i < path.mapping_size(); ++i) {
+                auto& m1 = path.mapping(i-1);
+                auto& m2 = path.mapping(i);
+                auto s1 = NodeSide(m1.position().node_id(), (m1.position().is_reverse() ? false : true));
+                auto s2 = NodeSide(m2.position().node_id(), (m2.position().is_reverse() ? true : false));
+                if (!has_edge(s1, s2)) {
+                    create_edge(s1, s2);
+                }
+            }
+        });
+
+    // execute a semi partial order sort on the nodes
+    algorithms::sort(this);
+
+    // make the translation
+    return make_translation(node_translation, added_nodes, orig_node_sizes);
+}
+
 // The not quite as robust (TODO: how?) but actually efficient way to edit the graph.
 vector<Translation> VG::edit_fast(const Path& path, set<NodeSide>& dangling) {
     // Collect the breakpoints
@@ -5283,25 +5464,17 @@ map<pos_t, Node*> VG::ensure_breakpoints(const map<id_t, set<pos_t>>& breakpoint
     for(auto& kv : breakpoints) {
         // Go through all the nodes we need to break up
         auto original_node_id = kv.first;
+        Node* original_node = get_node(original_node_id);
 
         // Save the original node length. We don't want to break here (or later)
         // because that would be off the end.
-        id_t original_node_length = get_node(original_node_id)->sequence().size();
-
-        // We are going through the breakpoints left to right, so we need to
-        // keep the node pointer for the right part that still needs further
-        // dividing.
-        Node* right_part = get_node(original_node_id);
-        Node* left_part = nullptr;
-
-        pos_t last_bp = make_pos_t(original_node_id, false, 0);
-        // How far into the original node does our right part start?
-        id_t current_offset = 0;
+        id_t original_node_length = original_node->sequence().size();
 
+        // Collect all the interior breakpoints, so we can divide the node in
+        // one pass instead of re-dividing the right part once per breakpoint
+        // (which rewires its edges and paths every time).
+        vector<int> positions;
         for(auto breakpoint : kv.second) {
-            // For every point at which we need to make a new node, in ascending
-            // order (due to the way sets store ints)...
-
             // ensure that we're on the forward strand (should be the case due to forwardize_breakpoints)
             assert(!is_rev(breakpoint));
 
@@ -5311,52 +5484,43 @@ map<pos_t, Node*> VG::ensure_breakpoints(const map<id_t, set<pos_t>>& breakpoint
                 continue;
             }
 
-            // How far in do we need to break the remaining right part? And how
-            // many bases will be in this new left part?
-            id_t divide_offset = offset(breakpoint) - current_offset;
-
-
-#ifdef debug
-            cerr << "Need to divide original " << original_node_id << " at " << breakpoint << "/" <<
-
-                original_node_length << endl;
-            cerr << "Translates to " << right_part->id() << " at " << divide_offset << "/" <<
-                right_part->sequence().size() << endl;
-            cerr << "divide offset is " << divide_offset << endl;
-#endif
-
-            if (offset(breakpoint) <= 0) { cerr << "breakpoint is " << breakpoint << endl; }
+            if (offset(breakpoint) < 0) { cerr << "breakpoint is " << breakpoint << endl; }
             assert(offset(breakpoint) > 0);
-            if (offset(breakpoint) >= original_node_length) { cerr << "breakpoint is " << breakpoint << endl; }
+            if (offset(breakpoint) > original_node_length) { cerr << "breakpoint is " << breakpoint << endl; }
             assert(offset(breakpoint) < original_node_length);
 
-            // Make a new left part and right part. This updates all the
-            // existing perfect match paths in the graph.
-            divide_node(right_part, divide_offset, left_part, right_part);
+            // The set is sorted, so these come out in ascending order
+            positions.push_back(offset(breakpoint));
+        }
 
 #ifdef debug
-
-            cerr << "Produced " << left_part->id() << " (" << left_part->sequence().size() << " bp)" << endl;
-            cerr << "Left " << right_part->id() << " (" << right_part->sequence().size() << " bp)" << endl;
+        cerr << "Need to divide original " << original_node_id << " at " << positions.size()
+             << " positions" << endl;
 #endif
 
-            // The left part is now done. We know it started at current_offset
-            // and ended before breakpoint, so record it by start position.
-
-            // record forward and reverse
-            toReturn[last_bp] = left_part;
-            toReturn[reverse(breakpoint, original_node_length)] = left_part;
+        vector<Node*> parts;
+        if (positions.empty()) {
+            // The node stays as it is
+            parts.push_back(original_node);
+        } else {
+            // Make all the parts at once. This updates all the existing
+            // perfect match paths in the graph.
+            divide_node(original_node, positions, parts);
+        }
 
-            // Record that more sequence has been consumed
-            current_offset += divide_offset;
+        // Record each part by its start position, on both strands
+        pos_t last_bp = make_pos_t(original_node_id, false, 0);
+        for (size_t i = 0; i < positions.size(); i++) {
+            pos_t breakpoint = make_pos_t(original_node_id, false, positions[i]);
+            toReturn[last_bp] = parts[i];
+            toReturn[reverse(breakpoint, original_node_length)] = parts[i];
             last_bp = breakpoint;
-
         }
 
         // Now the right part is done too. It's going to be the part
         // corresponding to the remainder of the original node.
-        toReturn[last_bp] = right_part;
-        toReturn[make_pos_t(original_node_id, true, 0)] = right_part;
+        toReturn[last_bp] = parts.back();
+        toReturn[make_pos_t(original_node_id, true, 0)] = parts.back();
 
         // and record the start and end of the node
         toReturn[make_pos_t(original_node_id, true, original_node_length)] = nullptr;
@@ -5819,10 +5983,9 @@ Alignment VG::random_read(size_t read_len,
     uniform_int_distribution<int> binary_dist(0, 1);
     if (either_strand && binary_dist(rng) == 1) {
         // We can flip to the other strand (i.e. node's local reverse orientation).
-        aln = reverse_complement_alignment(aln,
-                                           (function<id_t(id_t)>) ([this](id_t id) {
-                                                   return get_node(id)->sequence().size();
-                                               }));
+        reverse_complement_alignment_in_place(&aln, [this](id_t id) {
+                return (int64_t) get_node(id)->sequence().size();
+            });
     }
     return aln;
 }
@@ -5830,257 +5993,272 @@ Alignment VG::random_read(size_t read_len,
 bool VG::is_valid(bool check_nodes,
                   bool check_edges,
                   bool check_paths,
-                  bool check_orphans) {
-
-    if (check_nodes) {
+                  bool check_orphans,
+                  bool fail_fast,
+                  map<string, double>* check_seconds) {
 
-        if (node_by_id.size() != graph.node_size()) {
-            cerr << "graph invalid: node count is not equal to that found in node by-id index" << endl;
+    // set once any check fails, so the others can stop early when failing fast
+    bool valid = true;
+    auto fail = [&](const string& message) {
+#pragma omp critical (cerr)
+        cerr << message << endl;
+#pragma omp atomic write
+        valid = false;
+    };
+    auto stop = [&]() {
+        if (!fail_fast) {
             return false;
         }
-
-        for (int i = 0; i < graph.node_size(); ++i) {
-            Node* n = graph.mutable_node(i);
-            if (node_by_id.find(n->id()) == node_by_id.end()) {
-                cerr << "graph invalid: node " << n->id() << " missing from by-id index" << endl;
-                return false;
-            }
+        bool ok;
+#pragma omp atomic read
+        ok = valid;
+        return !ok;
+    };
+    // run a check, timing it if asked to
+    auto run_check = [&](const string& name, const function<void(void)>& check) {
+        if (stop()) {
+            return;
         }
-    }
-
-    if (check_edges) {
-        for (int i = 0; i < graph.edge_size(); ++i) {
-            Edge* e = graph.mutable_edge(i);
-            id_t f = e->from();
-            id_t t = e->to();
-
-            //cerr << "edge " << e << " " << e->from() << "->" << e->to() << endl;
-
-            if (node_by_id.find(f) == node_by_id.end()) {
-                cerr << "graph invalid: edge index=" << i
-                     << " (" << f << "->" << t << ") cannot find node (from) " << f << endl;
-                return false;
-            }
-            if (node_by_id.find(t) == node_by_id.end()) {
-                cerr << "graph invalid: edge index=" << i
-                     << " (" << f << "->" << t << ") cannot find node (to) " << t << endl;
-                return false;
-            }
-
-            if (!edges_on_start.count(f) && !edges_on_end.count(f)) {
-                // todo check if it's in the vector
-                cerr << "graph invalid: edge index=" << i
-                     << " could not find entry in either index for 'from' node " << f << endl;
-                return false;
-            }
-
-            if (!edges_on_start.count(t) && !edges_on_end.count(t)) {
-                // todo check if it's in the vector
-                cerr << "graph invalid: edge index=" << i
-                     << " could not find entry in either index for 'to' node " << t << endl;
-                return false;
-            }
+        auto start = chrono::steady_clock::now();
+        check();
+        if (check_seconds) {
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            (*check_seconds)[name] += elapsed.count();
         }
+    };
 
-        for (pair<const id_t, vector<pair<id_t, bool>>>& start_and_edges : edges_on_start) {
-            for (auto& edge_destination : start_and_edges.second) {
-                // We're on the start, so we go to the end if we aren't a reversing edge
-                Edge* e = get_edge(NodeSide::pair_from_start_edge(start_and_edges.first, edge_destination));
-                if (!e) {
-                    cerr << "graph invalid, edge is null" << endl;
-                    return false;
-                }
-                if(start_and_edges.first != e->to() && start_and_edges.first != e->from()) {
-                    // It needs to be attached to the node we looked up
-                    cerr << "graph invalid: edge " << e->from() << "->" << e->to()
-                         << " doesn't have start-indexed node in " << start_and_edges.first << "<->"
-                         << edge_destination.first << endl;
-                    return false;
-                }
-                if(edge_destination.first != e->to() && edge_destination.first != e->from()) {
-                    // It also needs to be attached to the node it says it goes to
-                    cerr << "graph invalid: edge " << e->from() << "->" << e->to()
-                         << " doesn't have non-start-indexed node in " << start_and_edges.first << "<->"
-                         << edge_destination.first << endl;
-                    return false;
-                }
-                if(!((start_and_edges.first == e->to() && !e->to_end()) ||
-                     (start_and_edges.first == e->from() && e->from_start()))) {
-
-                    // The edge needs to actually attach to the start of the node we looked it up for.
-                    // So at least one of its ends has to be to the start of the correct node.
-                    // It may also be attached to the end.
-                    cerr << "graph invalid: edge " << e->from() << "->" << e->to()
-                         << " doesn't attach to start of " << start_and_edges.first << endl;
-                    return false;
+    if (check_nodes) {
+        run_check("nodes", [&]() {
+            if (node_by_id.size() != graph.node_size()) {
+                fail("graph invalid: node count is not equal to that found in node by-id index");
+                if (fail_fast) {
+                    return;
                 }
-                if (!has_node(e->from())) {
-                    cerr << "graph invalid: edge from a non-existent node " << e->from() << "->" << e->to() << endl;
-                    return false;
+            }
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (int i = 0; i < graph.node_size(); ++i) {
+                if (stop()) {
+                    continue;
                 }
-                if (!has_node(e->to())) {
-                    cerr << "graph invalid: edge to a non-existent node " << e->from() << "->" << e->to() << endl;
-                    return false;
+                const Node& n = graph.node(i);
+                if (node_by_id.find(n.id()) == node_by_id.end()) {
+                    fail("graph invalid: node " + to_string(n.id()) + " missing from by-id index");
                 }
             }
-        }
+        });
+    }
 
-        for (pair<const id_t, vector<pair<id_t, bool>>>& end_and_edges : edges_on_end) {
-            for (auto& edge_destination : end_and_edges.second) {
-                Edge* e = get_edge(NodeSide::pair_from_end_edge(end_and_edges.first, edge_destination));
-                if (!e) {
-                    cerr << "graph invalid, edge is null" << endl;
-                    return false;
+    if (check_edges) {
+        run_check("edges", [&]() {
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (int i = 0; i < graph.edge_size(); ++i) {
+                if (stop()) {
+                    continue;
                 }
-                if(end_and_edges.first != e->to() && end_and_edges.first != e->from()) {
-                    // It needs to be attached to the node we looked up
-                    cerr << "graph invalid: edge " << e->from() << "->" << e->to()
-                         << " doesn't have end-indexed node in " << end_and_edges.first << "<->"
-                         << edge_destination.first << endl;
-                    return false;
+                const Edge& e = graph.edge(i);
+                id_t f = e.from();
+                id_t t = e.to();
+                string edge_desc = "graph invalid: edge index=" + to_string(i);
+                string edge_sides = " (" + to_string(f) + "->" + to_string(t) + ")";
+
+                if (node_by_id.find(f) == node_by_id.end()) {
+                    fail(edge_desc + edge_sides + " cannot find node (from) " + to_string(f));
+                    continue;
                 }
-                if(edge_destination.first != e->to() && edge_destination.first != e->from()) {
-                    // It also needs to be attached to the node it says it goes to
-                    cerr << "graph invalid: edge " << e->from() << "->" << e->to()
-                         << " doesn't have non-end-indexed node in " << end_and_edges.first << "<->"
-                         << edge_destination.first << endl;
-                    return false;
+                if (node_by_id.find(t) == node_by_id.end()) {
+                    fail(edge_desc + edge_sides + " cannot find node (to) " + to_string(t));
+                    continue;
                 }
-                if(!((end_and_edges.first == e->to() && e->to_end()) ||
-                     (end_and_edges.first == e->from() && !e->from_start()))) {
-
-                    // The edge needs to actually attach to the end of the node we looked it up for.
-                    // So at least one of its ends has to be to the end of the correct node.
-                    // It may also be attached to the start.
-                    cerr << "graph invalid: edge " << e->from() << "->" << e->to()
-                         << " doesn't attach to end of " << end_and_edges.first << endl;
-                    return false;
+                if (!edges_on_start.count(f) && !edges_on_end.count(f)) {
+                    // todo check if it's in the vector
+                    fail(edge_desc + " could not find entry in either index for 'from' node " + to_string(f));
+                    continue;
                 }
-                if (!has_node(e->from())) {
-                    cerr << "graph invalid: edge from a non-existent node " << e->from() << "->" << e->to() << endl;
-                    return false;
+                if (!edges_on_start.count(t) && !edges_on_end.count(t)) {
+                    // todo check if it's in the vector
+                    fail(edge_desc + " could not find entry in either index for 'to' node " + to_string(t));
+                    continue;
                 }
-                if (!has_node(e->to())) {
-                    cerr << "graph invalid: edge to a non-existent node " << e->from() << "->" << e->to() << endl;
-                    return false;
+            }
+        });
+
+        run_check("edge indexes", [&]() {
+            // gather the index entries up front so we can split them between threads
+            vector<pair<id_t, const vector<pair<id_t, bool>>*>> entries;
+            entries.reserve(edges_on_start.size() + edges_on_end.size());
+            for (auto& start_and_edges : edges_on_start) {
+                entries.emplace_back(start_and_edges.first, &start_and_edges.second);
+            }
+            size_t num_on_start = entries.size();
+            for (auto& end_and_edges : edges_on_end) {
+                entries.emplace_back(end_and_edges.first, &end_and_edges.second);
+            }
+
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (stop()) {
+                    continue;
+                }
+                id_t indexed = entries[i].first;
+                bool on_start = i < num_on_start;
+                string side_name = on_start ? "start" : "end";
+                for (auto& edge_destination : *entries[i].second) {
+                    // We're on the start, so we go to the end if we aren't a reversing edge
+                    Edge* e = get_edge(on_start ? NodeSide::pair_from_start_edge(indexed, edge_destination)
+                                                : NodeSide::pair_from_end_edge(indexed, edge_destination));
+                    if (!e) {
+                        fail("graph invalid, edge is null");
+                        break;
+                    }
+                    string edge_desc = "graph invalid: edge " + to_string(e->from()) + "->" + to_string(e->to());
+                    if (indexed != e->to() && indexed != e->from()) {
+                        // It needs to be attached to the node we looked up
+                        fail(edge_desc + " doesn't have " + side_name + "-indexed node in " + to_string(indexed)
+                             + "<->" + to_string(edge_destination.first));
+                        break;
+                    }
+                    if (edge_destination.first != e->to() && edge_destination.first != e->from()) {
+                        // It also needs to be attached to the node it says it goes to
+                        fail(edge_desc + " doesn't have non-" + side_name + "-indexed node in " + to_string(indexed)
+                             + "<->" + to_string(edge_destination.first));
+                        break;
+                    }
+                    // The edge needs to actually attach to the correct side of the node we looked it
+                    // up for. So at least one of its ends has to be on that side of the node. It may
+                    // also be attached to the other side.
+                    bool attached = on_start ? ((indexed == e->to() && !e->to_end()) ||
+                                                (indexed == e->from() && e->from_start()))
+                                             : ((indexed == e->to() && e->to_end()) ||
+                                                (indexed == e->from() && !e->from_start()));
+                    if (!attached) {
+                        fail(edge_desc + " doesn't attach to " + side_name + " of " + to_string(indexed));
+                        break;
+                    }
+                    if (!has_node(e->from())) {
+                        fail("graph invalid: edge from a non-existent node " + to_string(e->from()) + "->" + to_string(e->to()));
+                        break;
+                    }
+                    if (!has_node(e->to())) {
+                        fail("graph invalid: edge to a non-existent node " + to_string(e->from()) + "->" + to_string(e->to()));
+                        break;
+                    }
                 }
             }
-        }
+        });
     }
 
     if (check_paths) {
-        bool paths_ok = true;
-        function<void(const Path&)> lambda =
-            [this, &paths_ok]
-            (const Path& path) {
-            if (!paths_ok) {
-                return;
-            }
-            if (path.mapping_size() == 1) {
-                // handle the single-entry case
-                if (!path.mapping(0).has_position()) {
-                    cerr << "graph path " << path.name() << " has no position in mapping "
-                         << pb2json(path.mapping(0)) << endl;
-                    paths_ok = false;
-                    return;
-                }
+        run_check("paths", [&]() {
+            vector<const string*> path_names;
+            for (auto& p : paths._paths) {
+                path_names.push_back(&p.first);
             }
 
-            for (size_t i = 1; i < path.mapping_size(); ++i) {
-                auto& m1 = path.mapping(i-1);
-                auto& m2 = path.mapping(i);
-                if (!m1.has_position()) {
-                    cerr << "graph path " << path.name() << " has no position in mapping "
-                         << pb2json(m1) << endl;
-                    paths_ok = false;
-                    return;
+#pragma omp parallel for schedule(dynamic, 1)
+            for (size_t path_idx = 0; path_idx < path_names.size(); ++path_idx) {
+                if (stop()) {
+                    continue;
                 }
-                if (!m2.has_position()) {
-                    cerr << "graph path " << path.name() << " has no position in mapping "
-                         << pb2json(m2) << endl;
-                    paths_ok = false;
-                    return;
+                Path path = paths.path(*path_names[path_idx]);
+                string path_desc = "graph path '" + path.name() + "'";
+
+                // check that the mappings are all on nodes in the graph
+                bool nodes_ok = true;
+                for (size_t i = 0; i < path.mapping_size(); ++i) {
+                    auto& m = path.mapping(i);
+                    if (!m.has_position()) {
+                        fail("graph path " + path.name() + " has no position in mapping " + pb2json(m));
+                        nodes_ok = false;
+                        break;
+                    }
+                    if (!has_node(m.position().node_id())) {
+                        fail(path_desc + " invalid: mapping to a non-existent node " + pb2json(m));
+                        nodes_ok = false;
+                        break;
+                    }
                 }
-                if (!adjacent_mappings(m1, m2)) continue; // the path is completely represented here
-                auto s1 = NodeSide(m1.position().node_id(), (m1.position().is_reverse() ? false : true));
-                auto s2 = NodeSide(m2.position().node_id(), (m2.position().is_reverse() ? true : false));
-                // check that we always have an edge between the two nodes in the correct direction
-                if (!has_edge(s1, s2)) {
-                    cerr << "graph path '" << path.name() << "' invalid: edge from "
-                         << s1 << " to " << s2 << " does not exist" << endl;
-                    paths_ok = false;
-                    //return;;
+                if (!nodes_ok) {
+                    continue;
                 }
 
-                // in the four cases below, we check that edges always incident the tips of nodes
-                // when edit length, offsets and strand flipping of mappings are taken into account:
-
-                // NOTE: Because of the !adjacent_mappings check above, mappings that are out of order
-                //       will be ignored.  If they are invalid, it won't be caught.  Solution is
-                //       to sort by rank, but I'm not sure if any of this is by design or not...
-
-                auto& p1 = m1.position();
-                auto& n1 = *get_node(p1.node_id());
-                auto& p2 = m2.position();
-                auto& n2 = *get_node(p2.node_id());
-                // count up how many bases of the node m1 covers.
-                id_t m1_edit_length = m1.edit_size() == 0 ? n1.sequence().length() : 0;
-                for (size_t edit_idx = 0; edit_idx < m1.edit_size(); ++edit_idx) {
-                    m1_edit_length += m1.edit(edit_idx).from_length();
-                }
+                bool path_ok = true;
+                for (size_t i = 1; i < path.mapping_size() && path_ok; ++i) {
+                    auto& m1 = path.mapping(i-1);
+                    auto& m2 = path.mapping(i);
+                    if (!adjacent_mappings(m1, m2)) continue; // the path is completely represented here
+                    auto s1 = NodeSide(m1.position().node_id(), (m1.position().is_reverse() ? false : true));
+                    auto s2 = NodeSide(m2.position().node_id(), (m2.position().is_reverse() ? true : false));
+                    // check that we always have an edge between the two nodes in the correct direction
+                    if (!has_edge(s1, s2)) {
+                        stringstream ss;
+                        ss << path_desc << " invalid: edge from " << s1 << " to " << s2 << " does not exist";
+                        fail(ss.str());
+                    }
 
-                // verify that m1 ends at offset length-1 for forward mapping
-                if (p1.offset() + m1_edit_length != n1.sequence().length()) {
-                    cerr << "graph path '" << path.name() << "' has invalid mapping " << pb2json(m1)
-                    << ": offset (" << p1.offset() << ") + from_length (" << m1_edit_length << ")"
-                    << " != node length (" << n1.sequence().length() << ")" << endl;
-                    paths_ok = false;
-                    return;
+                    // in the four cases below, we check that edges always incident the tips of nodes
+                    // when edit length, offsets and strand flipping of mappings are taken into account:
+
+                    // NOTE: Because of the !adjacent_mappings check above, mappings that are out of order
+                    //       will be ignored.  If they are invalid, it won't be caught.  Solution is
+                    //       to sort by rank, but I'm not sure if any of this is by design or not...
+
+                    auto& p1 = m1.position();
+                    auto& n1 = *get_node(p1.node_id());
+                    auto& p2 = m2.position();
+                    // count up how many bases of the node m1 covers.
+                    id_t m1_edit_length = m1.edit_size() == 0 ? n1.sequence().length() : 0;
+                    for (size_t edit_idx = 0; edit_idx < m1.edit_size(); ++edit_idx) {
+                        m1_edit_length += m1.edit(edit_idx).from_length();
+                    }
+
+                    // verify that m1 ends at offset length-1 for forward mapping
+                    if (p1.offset() + m1_edit_length != n1.sequence().length()) {
+                        fail(path_desc + " has invalid mapping " + pb2json(m1)
+                             + ": offset (" + to_string(p1.offset()) + ") + from_length (" + to_string(m1_edit_length) + ")"
+                             + " != node length (" + to_string(n1.sequence().length()) + ")");
+                        path_ok = false;
+                    }
+                    // verify that m2 starts at offset 0 for forward mapping
+                    else if (p2.offset() > 0) {
+                        fail(path_desc + " has invalid mapping " + pb2json(m2)
+                             + ": offset=" + to_string(p2.offset()) + " found when offset=0 expected");
+                        path_ok = false;
+                    }
                 }
-                // verify that m2 starts at offset 0 for forward mapping
-                if (p2.offset() > 0) {
-                    cerr << "graph path '" << path.name() << "' has invalid mapping " << pb2json(m2)
-                    << ": offset=" << p2.offset() << " found when offset=0 expected" << endl;
-                    paths_ok = false;
-                        return;
+                if (!path_ok) {
+                    continue;
                 }
-            }
 
-            // check that the mappings have the right length
-            for (size_t i = 0; i < path.mapping_size(); ++i) {
-                auto& m = path.mapping(i);
-                // get the node
-                auto n = get_node(m.position().node_id());
-                if (mapping_from_length(m) + m.position().offset() > n->sequence().size()) {
-                    cerr << "graph path " << path.name() << " has a mapping which "
-                         << "matches sequence outside of the node it maps to "
-                         << pb2json(m)
-                         << " vs "
-                         << pb2json(*n) << endl;
-                    paths_ok = false;
-                    return;
+                // check that the mappings have the right length
+                for (size_t i = 0; i < path.mapping_size(); ++i) {
+                    auto& m = path.mapping(i);
+                    // get the node
+                    auto n = get_node(m.position().node_id());
+                    if (mapping_from_length(m) + m.position().offset() > n->sequence().size()) {
+                        fail("graph path " + path.name() + " has a mapping which "
+                             + "matches sequence outside of the node it maps to "
+                             + pb2json(m) + " vs " + pb2json(*n));
+                        break;
+                    }
                 }
-            }
 
-            // check that the mappings all match the graph
-            /*
-            for (size_t i = 0; i < path.mapping_size(); ++i) {
-                auto& m = path.mapping(i);
-                if (!mapping_is_total_match(m)) {
-                    cerr << "graph path " << path.name() << " has an imperfect mapping "
-                         << pb2json(m) << endl;
-                    paths_ok = false;
-                    return;
+                // check that the mappings all match the graph
+                /*
+                for (size_t i = 0; i < path.mapping_size(); ++i) {
+                    auto& m = path.mapping(i);
+                    if (!mapping_is_total_match(m)) {
+                        cerr << "graph path " << path.name() << " has an imperfect mapping "
+                             << pb2json(m) << endl;
+                        paths_ok = false;
+                        return;
+                    }
                 }
+                */
             }
-            */
-
-        };
-        paths.for_each(lambda);
-        if (!paths_ok) return false;
+        });
     }
 
-    return true;
+    return valid;
 }
 
 void VG::to_dot(ostream& out,
@@ -86,35 +86,68 @@ public:
     ////////////////////////////////////////////////////////////////////////////
     
     /// Look up the handle for the node with the given ID in the given orientation
-    virtual handle_t get_handle(const id_t& node_id, bool is_reverse) const;
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse) const final;
     
     // Copy over the visit version which would otherwise be shadowed.
     using HandleGraph::get_handle;
     
     /// Get the ID from a handle
-    virtual id_t get_id(const handle_t& handle) const;
+    virtual id_t get_id(const handle_t& handle) const final;
     
     /// Get the orientation of a handle
-    virtual bool get_is_reverse(const handle_t& handle) const;
+    virtual bool get_is_reverse(const handle_t& handle) const final;
     
     /// Invert the orientation of a handle (potentially without getting its ID)
-    virtual handle_t flip(const handle_t& handle) const;
+    virtual handle_t flip(const handle_t& handle) const final;
     
     /// Get the length of a node
-    virtual size_t get_length(const handle_t& handle) const;
+    virtual size_t get_length(const handle_t& handle) const final;
     
     /// Get the sequence of a node, presented in the handle's local forward
     /// orientation.
     virtual string get_sequence(const handle_t& handle) const;
     
+    /// Point the view at the node's stored sequence, without copying it.
+    virtual bool get_sequence_view(const handle_t& handle, sequence_view_t& view_out) const;
+    
+    /// Get the base at the given offset in the handle's local forward orientation.
+    virtual char get_base(const handle_t& handle, size_t index) const;
+    
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue. Returns true if we finished and false if we stopped early.
-    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const final;
     
     // Copy over the template for nice calls
     using HandleGraph::follow_edges;
     
+    /// Loop over all the handles to next/previous (right/left) nodes with an
+    /// iteratee of any type that returns false to stop, without going through
+    /// a virtual call or a std::function. Hides the HandleGraph version for
+    /// algorithms templated on the graph type.
+    template <typename Iteratee>
+    inline bool follow_edges_inline(const handle_t& handle, bool go_left, Iteratee&& iteratee) const {
+        // Are we reverse?
+        bool is_reverse = VG::get_is_reverse(handle);
+        
+        // Which edges will we look at?
+        auto& edge_set = (go_left != is_reverse) ? edges_on_start : edges_on_end;
+        
+        // Look up edges of this node specifically
+        auto found = edge_set.find(VG::get_id(handle));
+        if (found != edge_set.end()) {
+            for (auto& id_and_flip : found->second) {
+                // For each edge destination and the flag that says if we flip orientation or not
+                if (!iteratee(VG::get_handle(id_and_flip.first, is_reverse != id_and_flip.second))) {
+                    // Iteratee said to stop
+                    return false;
+                }
+            }
+        }
+        
+        return true;
+    }
+    
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
@@ -423,6 +456,9 @@ public:
     void clear_indexes(void);
     void clear_indexes_no_resize(void);
     void resize_indexes(void);
+    /// Make room in the graph and its indexes for this many nodes and edges in
+    /// total, so that adding them does not rehash.
+    void reserve_indexes(size_t node_count, size_t edge_count);
     void rebuild_indexes(void);
     void rebuild_edge_indexes(void);
 
@@ -449,9 +485,11 @@ public:
     void prune_complex_paths(int length, int edge_max, Node* head_node, Node* tail_node);
     void prune_short_subgraphs(size_t min_size);
 
-    /// Write to a stream in chunked graphs.
-    void serialize_to_ostream(ostream& out, id_t chunk_size = 1000);
-    void serialize_to_file(const string& file_name, id_t chunk_size = 1000);
+    /// Write the graph as a stream of Graph chunks of at most chunk_size
+    /// nodes, ending chunks early once they are estimated to be chunk_bytes
+    /// long. Chunks are built and compressed in parallel and written in order.
+    void serialize_to_ostream(ostream& out, id_t chunk_size = 1000, size_t chunk_bytes = 4 * 1024 * 1024);
+    void serialize_to_file(const string& file_name, id_t chunk_size = 1000, size_t chunk_bytes = 4 * 1024 * 1024);
 
     // can we handle this with merge?
     //void concatenate(VG& g);
@@ -518,6 +556,18 @@ public:
     vector<Translation> edit(vector<Path>& paths_to_add, bool save_paths = false,
         bool update_paths = false, bool break_at_ends = false);
     
+    /// %Edit the graph to include the paths produced by for_each_path, as
+    /// above, without holding them all in memory. for_each_path is called
+    /// twice and must call the lambda it gets on the same paths, in the same
+    /// order, each time. The first time, parallel is true and the lambda may
+    /// be called from several threads at once, to collect breakpoints. The
+    /// second time, parallel is false and the lambda must be called from one
+    /// thread at a time; new sequence is added then, and if update_paths is
+    /// true each path is rewritten in place to its embedding in the edited
+    /// graph before the lambda returns. Paths are not saved in the graph.
+    vector<Translation> edit(const function<void(const function<void(Path&)>&, bool parallel)>& for_each_path,
+        bool update_paths = false, bool break_at_ends = false);
+    
     /// %Edit the graph to include all the sequences and edges added by the
     /// given path. Returns a vector of Translations, one per original-node
     /// fragment. Completely novel nodes are not mentioned, and nodes with no
@@ -938,11 +988,16 @@ public:
     void to_gfa(ostream& out);
     /// Convert the graph to Turtle format.
     void to_turtle(ostream& out, const string& rdf_base_uri, bool precompress);
-    /// Determine if the graph is valid or not, according to the specified criteria.
+    /// Determine if the graph is valid or not, according to the specified criteria. Each check
+    /// is split between threads over the nodes, edges or paths. With fail_fast, stop at the first
+    /// problem found, otherwise report all of them. If check_seconds is given, add the time spent
+    /// in each check to it, by the name of the check.
     bool is_valid(bool check_nodes = true,
                   bool check_edges = true,
                   bool check_paths = true,
-                  bool check_orphans = true);
+                  bool check_orphans = true,
+                  bool fail_fast = true,
+                  map<string, double>* check_seconds = nullptr);
 
     /// Topologically order the nodes in the Protobuf graph. Only valid if the graph is a DAG with all
     /// no reversing edges or doubly reversing edges. No guarantee of system independent behavior, but
@@ -1,5 +1,6 @@
 #include "vg_set.hpp"
 #include "stream.hpp"
+#include "gfa.hpp"
 
 namespace vg {
 // sets of VGs on disk
@@ -63,13 +64,113 @@ id_t VGset::get_max_id(void) {
     return max_id;
 }
 
+// How many graph chunks to hold at once per file while shifting ids
+const size_t MERGE_ID_CHUNK_BATCH = 64;
+
 int64_t VGset::merge_id_space(void) {
-    int64_t max_node_id = 0;
-    auto lambda = [&max_node_id](VG* g) {
-        if (max_node_id > 0) g->increment_node_ids(max_node_id);
-        max_node_id = g->max_node_id();
-    };
-    transform(lambda);
+    
+    for (auto& name : filenames) {
+        if (name == "-") {
+            throw runtime_error("[VGset::merge_id_space] graphs must be files, since they are read twice and rewritten");
+        }
+    }
+    
+    // First find the largest id in each file, looking only at the nodes
+    vector<id_t> max_ids(filenames.size(), 0);
+    vector<string> errors(filenames.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); i++) {
+        try {
+            ifstream in(filenames[i]);
+            if (!in) throw ifstream::failure("failed to open " + filenames[i]);
+            function<void(stream::SerializedMessage&)> lambda = [&](stream::SerializedMessage& message) {
+                Graph nodes;
+                if (!stream::FieldView(message.bytes).project({Graph::kNodeFieldNumber}, nodes)) {
+                    throw runtime_error("[VGset::merge_id_space] could not parse graph chunk in " + filenames[i]);
+                }
+                for (size_t j = 0; j < nodes.node_size(); j++) {
+                    max_ids[i] = max(max_ids[i], nodes.node(j).id());
+                }
+            };
+            stream::for_each(in, lambda);
+        } catch (const exception& e) {
+            errors[i] = e.what();
+        }
+    }
+    for (auto& error : errors) {
+        if (!error.empty()) throw runtime_error(error);
+    }
+    
+    // Each graph goes after the one before it, as shifted
+    vector<id_t> offsets(filenames.size(), 0);
+    id_t max_node_id = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+        offsets[i] = max_node_id;
+        max_node_id = max_ids[i] + offsets[i];
+    }
+    
+    // Then rewrite each file that has to move a chunk at a time, through a
+    // temporary file next to it so it is only replaced once it is all written
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < filenames.size(); i++) {
+        id_t offset = offsets[i];
+        if (offset == 0) {
+            continue;
+        }
+        try {
+            string temp_name = filenames[i] + ".ids.tmp";
+            {
+                ifstream in(filenames[i]);
+                if (!in) throw ifstream::failure("failed to open " + filenames[i]);
+                ofstream out(temp_name);
+                if (!out) throw ofstream::failure("failed to open " + temp_name);
+                
+                vector<Graph> batch;
+                auto flush = [&]() {
+                    function<Graph(uint64_t)> get_chunk = [&](uint64_t n) { return batch[n]; };
+                    stream::write(out, batch.size(), get_chunk);
+                    batch.clear();
+                };
+                function<void(Graph&)> lambda = [&](Graph& graph) {
+                    for (size_t j = 0; j < graph.node_size(); j++) {
+                        Node* node = graph.mutable_node(j);
+                        node->set_id(node->id() + offset);
+                    }
+                    for (size_t j = 0; j < graph.edge_size(); j++) {
+                        Edge* edge = graph.mutable_edge(j);
+                        edge->set_from(edge->from() + offset);
+                        edge->set_to(edge->to() + offset);
+                    }
+                    for (size_t j = 0; j < graph.path_size(); j++) {
+                        Path* path = graph.mutable_path(j);
+                        for (size_t k = 0; k < path->mapping_size(); k++) {
+                            Position* pos = path->mutable_mapping(k)->mutable_position();
+                            pos->set_node_id(pos->node_id() + offset);
+                        }
+                    }
+                    batch.emplace_back();
+                    batch.back().Swap(&graph);
+                    if (batch.size() == MERGE_ID_CHUNK_BATCH) {
+                        flush();
+                    }
+                };
+                stream::for_each(in, lambda);
+                // Always finish with a write, so an empty graph stays a valid stream
+                flush();
+                out.close();
+                if (!out) throw ofstream::failure("failed to write " + temp_name);
+            }
+            if (rename(temp_name.c_str(), filenames[i].c_str()) != 0) {
+                throw runtime_error("[VGset::merge_id_space] could not replace " + filenames[i]);
+            }
+        } catch (const exception& e) {
+            errors[i] = e.what();
+        }
+    }
+    for (auto& error : errors) {
+        if (!error.empty()) throw runtime_error(error);
+    }
+    
     return max_node_id;
 }
 
@@ -86,8 +187,10 @@ void VGset::to_xg(xg::XG& index, bool store_threads, const regex& paths_to_take,
     // from path anme and then rank to Mapping.
     map<string, map<int64_t, Mapping>> mappings;
     
-    // Set up an XG index
-    index.from_callback([&](function<void(Graph&)> callback) {
+    // Set up an XG index. It reads the files more than once, so we start the
+    // siphoned-off paths over each time.
+    index.from_callback_two_pass([&](function<void(Graph&)> callback) {
+        mappings.clear();
         for (auto& name : filenames) {
 #ifdef debug
             cerr << "Loading chunks from " << name << endl;
@@ -160,7 +263,17 @@ void VGset::to_xg(xg::XG& index, bool store_threads, const regex& paths_to_take,
                 callback(graph);
             };
             
-            stream::for_each(in, handle_graph);
+            if (name.size() > 4 && name.substr(name.size() - 4) == ".gfa") {
+                // Read GFA a line at a time instead of in chunks
+                size_t overlaps = gfa_to_graph_callback(in, handle_graph);
+                if (overlaps > 0) {
+                    cerr << "error:[vg::VGset] " << overlaps << " links in " << name
+                         << " overlap, and overlaps cannot be reduced when streaming" << endl;
+                    exit(1);
+                }
+            } else {
+                stream::for_each(in, handle_graph);
+            }
             
             // Now that we got all the chunks, reconstitute any siphoned-off paths into Path objects and return them.
             for(auto& kv : mappings) {
@@ -214,6 +327,80 @@ void VGset::write_gcsa_kmers_ascii(ostream& out, int kmer_size,
         });
 }
 
+void VGset::prune_for_gcsa(VG& graph) {
+    // Before cutting anything, copy out the nodes and edges that the
+    // haplotypes and paths walk through, so we can put them back after.
+    // Many haplotypes share each node, so keep each thing only once per thread.
+    vector<unordered_map<id_t, Node>> thread_nodes(omp_get_max_threads());
+    vector<set<pair<NodeSide, NodeSide>>> thread_edges(omp_get_max_threads());
+    auto keep_walk = [&](const vector<NodeTraversal>& walk) {
+        size_t thread_num = omp_get_thread_num();
+        for (size_t i = 0; i < walk.size(); i++) {
+            if (!thread_nodes[thread_num].count(walk[i].node->id())) {
+                thread_nodes[thread_num][walk[i].node->id()] = *walk[i].node;
+            }
+            if (i + 1 < walk.size()) {
+                Edge* edge = graph.get_edge(walk[i], walk[i + 1]);
+                if (edge != nullptr) {
+                    thread_edges[thread_num].insert(NodeSide::pair_from_edge(edge));
+                }
+            }
+        }
+    };
+    if (restore_gbwt != nullptr) {
+        // Haplotypes are stored in both orientations, so take every other
+        // sequence. Only the parts of them in this graph matter.
+#pragma omp parallel for schedule(dynamic,1)
+        for (gbwt::size_type sequence = 0; sequence < restore_gbwt->sequences(); sequence += 2) {
+            vector<NodeTraversal> walk;
+            for (auto node : restore_gbwt->extract(sequence)) {
+                id_t node_id = gbwt::Node::id(node);
+                if (graph.has_node(node_id)) {
+                    walk.emplace_back(graph.get_node(node_id), gbwt::Node::is_reverse(node));
+                } else if (!walk.empty()) {
+                    keep_walk(walk);
+                    walk.clear();
+                }
+            }
+            keep_walk(walk);
+        }
+    }
+    if (restore_paths) {
+        graph.paths.for_each([&](const Path& path) {
+                vector<NodeTraversal> walk;
+                for (size_t i = 0; i < path.mapping_size(); i++) {
+                    const Position& position = path.mapping(i).position();
+                    walk.emplace_back(graph.get_node(position.node_id()), position.is_reverse());
+                }
+                keep_walk(walk);
+            });
+    }
+
+    graph.prune_complex_with_head_tail(prune_length, prune_edge_max);
+    graph.prune_short_subgraphs(prune_length);
+
+    // Put back what the walks need
+    size_t restored_nodes = 0;
+    for (auto& nodes : thread_nodes) {
+        for (auto& id_and_node : nodes) {
+            if (!graph.has_node(id_and_node.first)) {
+                graph.add_node(id_and_node.second);
+                restored_nodes++;
+            }
+        }
+    }
+    for (auto& edges : thread_edges) {
+        for (auto& sides : edges) {
+            if (!graph.has_edge(sides)) {
+                graph.create_edge(sides.first, sides.second);
+            }
+        }
+    }
+    if (show_progress && (restore_gbwt != nullptr || restore_paths)) {
+        cerr << "restored " << restored_nodes << " pruned nodes of " << graph.name << endl;
+    }
+}
+
 // writes to a specific output stream
 void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size,
                                     id_t head_id, id_t tail_id) {
@@ -223,6 +410,9 @@ void VGset::write_gcsa_kmers_binary(ostream& out, int kmer_size,
         tail_id = max_id + 2;
     }
     for_each([&](VG* g) {
+            if (prune_length > 0) {
+                prune_for_gcsa(*g);
+            }
             // set up the graph with the head/tail nodes
             Node* head_node = nullptr; Node* tail_node = nullptr;
             g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
@@ -235,13 +425,14 @@ vector<string> VGset::write_gcsa_kmers_binary(int kmer_size,
                                               id_t head_id, id_t tail_id) {
     vector<string> tmpnames;
     for_each([&](VG* g) {
+            if (prune_length > 0) {
+                prune_for_gcsa(*g);
+            }
             Node* head_node = nullptr; Node* tail_node = nullptr;
             g->add_start_end_markers(kmer_size, '#', '$', head_node, tail_node, head_id, tail_id);
-            tmpnames.push_back(
-                write_gcsa_kmers_to_tmpfile(*g,
-                                            kmer_size,
-                                            head_id,
-                                            tail_id));
+            for (auto& tmpname : write_gcsa_kmers_to_tmpfiles(*g, kmer_size, head_id, tail_id)) {
+                tmpnames.push_back(tmpname);
+            }
         });
     return tmpnames;
 }
@@ -5,6 +5,7 @@
 #include <regex>
 #include <stdlib.h>
 #include <gcsa/gcsa.h>
+#include <gbwt/gbwt.h>
 #include "vg.hpp"
 #include "index.hpp"
 #include "xg.hpp"
@@ -34,9 +35,13 @@ public:
     
     /// merges the id space of a set of graphs on-disk
     /// necessary when storing many graphs in the same index
+    /// Finds each file's largest id and then shifts the ids in each file past
+    /// those of the files before it, streaming the files a chunk at a time on
+    /// all threads. Returns the largest id.
     int64_t merge_id_space(void);
 
-    /// Transforms to a succinct, queryable representation
+    /// Transforms to a succinct, queryable representation. The files are read
+    /// twice, so they can't be pipes. Files ending in .gfa are read as GFA.
     void to_xg(xg::XG& index, bool store_threads = false);
     /// As above, except paths with names matching the given regex are removed
     /// and returned separately by inserting them into the provided map.
@@ -62,6 +67,26 @@ public:
     // Should we show our progress running through each graph?             
     bool show_progress = false;
 
+    /// If prune_length is set, write_gcsa_kmers_binary prunes each graph
+    /// before enumerating its kmers, the way vg mod -p and -S would: nodes
+    /// reached by paths of prune_length bases making more than prune_edge_max
+    /// edge choices are cut away, and then subgraphs shorter than prune_length
+    /// are dropped. This keeps GCSA2 doubling from blowing up in complex
+    /// regions. The graph files themselves are not changed.
+    int prune_length = 0;
+    int prune_edge_max = 3;
+    /// After pruning, put back the nodes and edges used by the haplotypes in
+    /// this GBWT, if set, so that they can still be found in the GCSA2 index
+    const gbwt::GBWT* restore_gbwt = nullptr;
+    /// After pruning, put back the nodes and edges used by the graph's own
+    /// embedded paths
+    bool restore_paths = false;
+
+private:
+
+    /// Prune a graph for GCSA2 indexing as set up above
+    void prune_for_gcsa(VG& graph);
+
 };
 
 }
@@ -1,7 +1,10 @@
 #include "xg.hpp"
 #include "stream.hpp"
+#include "mapped_file.hpp"
 
 #include <bitset>
+#include <cstring>
+#include <cmath>
 #include <arpa/inet.h>
 
 //#define VERBOSE_DEBUG
@@ -68,6 +71,24 @@ char revdna3bit(int i) {
     }
 }
 
+// Decode tables taking a byte of four packed 2-bit bases, first base in the
+// low bits, to their characters forward and reverse complemented
+struct PackedBaseTables {
+    char forward[256][4];
+    char reverse_complement[256][4];
+    PackedBaseTables(void) {
+        for (size_t b = 0; b < 256; ++b) {
+            for (size_t j = 0; j < 4; ++j) {
+                int code = (b >> (2 * j)) & 3;
+                forward[b][j] = revdna3bit(code);
+                // complementing swaps A/T and C/G, which flips the low bit
+                reverse_complement[b][3 - j] = revdna3bit(code ^ 1);
+            }
+        }
+    }
+};
+static const PackedBaseTables packed_bases;
+
 const XG::destination_t XG::BS_SEPARATOR = 1;
 const XG::destination_t XG::BS_NULL = 0;
 
@@ -163,7 +184,11 @@ void XG::load(istream& in) {
         case 6:
             cerr << "warning:[XG] Loading an out-of-date XG format. In-memory conversion between versions can be time-consuming. For better performance over repeated loads, consider recreating this XG with 'vg index'." << endl;
             // Fall through
-        case 7:
+        case 7: // Fall through
+        case 8: // Fall through
+        case 9: // Fall through
+        case 10: // Fall through
+        case 11:
             {
                 sdsl::read_member(seq_length, in);
                 sdsl::read_member(node_count, in);
@@ -182,7 +207,38 @@ void XG::load(istream& in) {
                 g_bv_rank.load(in, &g_bv);
                 g_bv_select.load(in, &g_bv);
 
-                s_iv.load(in);
+                if (file_version >= 9) {
+                    s_iv.load(in);
+                    sx_bv.load(in);
+                    sx_bv_rank.load(in, &sx_bv);
+                    sx_bv_select.load(in, &sx_bv);
+                    sx_iv.load(in);
+                    if (file_version >= 11) {
+                        for (auto& count : s_counts) {
+                            sdsl::read_member(count, in);
+                        }
+                    }
+                } else {
+                    // repack the 3-bit sequence vector of older versions
+                    int_vector<> old_s_iv;
+                    old_s_iv.load(in);
+                    util::assign(s_iv, int_vector<2>(old_s_iv.size(), 0));
+                    bit_vector exceptions_bv(old_s_iv.size());
+                    string exception_chars;
+                    for (size_t i = 0; i < old_s_iv.size(); ++i) {
+                        if (old_s_iv[i] < 4) {
+                            s_iv[i] = old_s_iv[i];
+                        } else {
+                            exceptions_bv[i] = 1;
+                            exception_chars.push_back(revdna3bit(old_s_iv[i]));
+                        }
+                    }
+                    index_sequence_exceptions(exceptions_bv, exception_chars);
+                }
+                if (file_version < 11) {
+                    // Base counts were added in version 11
+                    count_bases();
+                }
                 s_bv.load(in);
                 s_bv_rank.load(in, &s_bv);
                 s_bv_select.load(in, &s_bv);
@@ -213,7 +269,7 @@ void XG::load(istream& in) {
                 sdsl::read_member(path_count, in);
                 for (size_t i = 0; i < path_count; ++i) {
                     auto path = new XGPath;
-                    path->load(in);
+                    path->load(in, file_version);
                     paths.push_back(path);
                 }
                 np_iv.load(in);
@@ -233,6 +289,11 @@ void XG::load(istream& in) {
                     index_component_path_sets();
                 }
                 
+                if (file_version >= 10) {
+                    pa_iv.load(in);
+                }
+                // Otherwise nearest_path_node searches as it always did
+                
                 h_civ.load(in);
                 ts_civ.load(in);
 
@@ -263,7 +324,18 @@ void XG::load(istream& in) {
 
 }
 
-void XGPath::load(istream& in) {
+void XG::load_mapped(const string& filename) {
+    vg::MappedFileStream mapped_in(filename);
+    if (mapped_in.is_mapped()) {
+        load(mapped_in);
+    } else {
+        // Not something we can map; read it the old-fashioned way.
+        ifstream in(filename);
+        load(in);
+    }
+}
+
+void XGPath::load(istream& in, uint32_t file_version) {
     nodes.load(in);
     nodes_rank.load(in, &nodes);
     nodes_select.load(in, &nodes);
@@ -274,6 +346,12 @@ void XGPath::load(istream& in) {
     offsets.load(in);
     offsets_rank.load(in, &offsets);
     offsets_select.load(in, &offsets);
+    if (file_version >= 8) {
+        // sampled offset lookups were added in version 8
+        sdsl::read_member(sample_rate, in);
+        sampled_steps.load(in);
+        sampled_ids.load(in);
+    }
 }
 
 size_t XGPath::serialize(std::ostream& out,
@@ -291,6 +369,9 @@ size_t XGPath::serialize(std::ostream& out,
     written += offsets.serialize(out, child, "path_node_starts_" + name);
     written += offsets_rank.serialize(out, child, "path_node_starts_rank_" + name);
     written += offsets_select.serialize(out, child, "path_node_starts_select_" + name);
+    written += sdsl::write_member(sample_rate, out, child, "path_sample_rate_" + name);
+    written += sampled_steps.serialize(out, child, "path_sampled_steps_" + name);
+    written += sampled_ids.serialize(out, child, "path_sampled_ids_" + name);
     
     sdsl::structure_tree::add_size(child, written);
     
@@ -301,7 +382,8 @@ XGPath::XGPath(const string& path_name,
                const vector<trav_t>& path,
                size_t node_count,
                XG& graph,
-               size_t* unique_member_count_out) {
+               size_t* unique_member_count_out,
+               size_t sample_rate) : sample_rate(sample_rate) {
 
     // nodes in the path
     bit_vector nodes_bv;
@@ -332,6 +414,10 @@ XGPath::XGPath(const string& path_name,
 
     // make the bitvector for path offsets
     util::assign(offsets, bit_vector(path_length));
+    // and the sampled lookup table, if we want one
+    size_t sample_count = (sample_rate && path_length) ? (path_length - 1) / sample_rate + 1 : 0;
+    util::assign(sampled_steps, int_vector<>(sample_count));
+    util::assign(sampled_ids, int_vector<>(sample_count));
     set<int64_t> uniq_nodes;
     //cerr << "path " << path_name << " has " << path.size() << endl;
     for (size_t i = 0; i < path.size(); ++i) {
@@ -354,6 +440,14 @@ XGPath::XGPath(const string& path_name,
         offsets[path_off] = 1;
         // and update the offset counter
         path_off += graph.node_length(node_id);
+        // sample the node at every sampled offset it covers
+        if (sample_rate) {
+            for (size_t k = (path_off - graph.node_length(node_id) + sample_rate - 1) / sample_rate;
+                 k < sample_count && k * sample_rate < path_off; ++k) {
+                sampled_steps[k] = i;
+                sampled_ids[k] = node_id;
+            }
+        }
     }
     //cerr << uniq_nodes.size() << " vs " << path.size() << endl;
     if(unique_member_count_out) {
@@ -374,6 +468,9 @@ XGPath::XGPath(const string& path_name,
     util::bit_compress(positions);
     // bit compress mapping ranks
     util::bit_compress(ranks);
+    // and the samples
+    util::bit_compress(sampled_steps);
+    util::bit_compress(sampled_ids);
 
     // and set up rank/select dictionary on them
     util::assign(offsets_rank, rank_support_v<1>(&offsets));
@@ -390,6 +487,30 @@ Mapping XGPath::mapping(size_t offset) const {
     return m;
 }
 
+size_t XGPath::step_at_position(size_t pos) const {
+    return offsets_rank(pos+1)-1;
+}
+
+int64_t XGPath::node_at_step(size_t step, size_t pos) const {
+    if (sample_rate) {
+        size_t k = pos / sample_rate;
+        if (sampled_steps[k] == step) {
+            // the sampled node covers this offset too
+            return sampled_ids[k];
+        }
+    }
+    return ids[step];
+}
+
+Mapping XGPath::mapping_at_position(size_t pos) const {
+    size_t step = step_at_position(pos);
+    Mapping m;
+    m.mutable_position()->set_node_id(node_at_step(step, pos));
+    m.mutable_position()->set_is_reverse(directions[step]);
+    m.set_rank(ranks[step]);
+    return m;
+}
+
 size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string name) {
 
     sdsl::structure_tree_node* child = sdsl::structure_tree::add_child(s, name, sdsl::util::class_name(*this));
@@ -428,6 +549,13 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     written += g_bv_select.serialize(out, child, "graph_bit_vector_select");
     
     written += s_iv.serialize(out, child, "seq_vector");
+    written += sx_bv.serialize(out, child, "seq_exceptions");
+    written += sx_bv_rank.serialize(out, child, "seq_exceptions_rank");
+    written += sx_bv_select.serialize(out, child, "seq_exceptions_select");
+    written += sx_iv.serialize(out, child, "seq_exception_chars");
+    for (size_t i = 0; i < s_counts.size(); i++) {
+        written += sdsl::write_member(s_counts[i], out, child, string("seq_count_") + "ACGTN"[i]);
+    }
     written += s_bv.serialize(out, child, "seq_node_starts");
     written += s_bv_rank.serialize(out, child, "seq_node_starts_rank");
     written += s_bv_select.serialize(out, child, "seq_node_starts_select");
@@ -471,6 +599,7 @@ size_t XG::serialize(ostream& out, sdsl::structure_tree_node* s, std::string nam
     create_succinct_component_path_sets(path_ranks_iv, path_ranks_bv);
     paths_written += path_ranks_iv.serialize(out, paths_child, "component_path_set_path_ranks");
     paths_written += path_ranks_bv.serialize(out, paths_child, "component_path_set_bit_vector");
+    paths_written += pa_iv.serialize(out, paths_child, "path_anchors");
     
     sdsl::structure_tree::add_size(paths_child, paths_written);
     written += paths_written;
@@ -587,7 +716,77 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
     }
 
     path_count = path_nodes.size();
+    sort_path_steps(path_nodes);
+
+    build(node_label, from_to, to_from, path_nodes, validate_graph, print_graph,
+        store_threads, is_sorted_dag);
+    
+}
+
+void XG::append_paths(const vector<Path>& new_paths) {
+    // Collect and check the new paths before touching anything
+    map<string, vector<trav_t> > path_nodes;
+    for (auto& path : new_paths) {
+        if (path.name().empty() || path_rank(path.name()) != 0 || path_nodes.count(path.name())) {
+            throw runtime_error("[xg] cannot append path \"" + path.name() + "\": its name is empty or already used");
+        }
+        vector<trav_t>& steps = path_nodes[path.name()];
+        for (auto& mapping : path.mapping()) {
+            if (!has_node(mapping.position().node_id())) {
+                throw runtime_error("[xg] cannot append path " + path.name() + ": node "
+                                    + to_string(mapping.position().node_id()) + " is not in the index");
+            }
+            steps.push_back(make_trav(mapping.position().node_id(), mapping.position().is_reverse(), mapping.rank()));
+        }
+    }
+    sort_path_steps(path_nodes);
+    for (auto& p : path_nodes) {
+        for (size_t i = 1; i < p.second.size(); ++i) {
+            handle_t prev = get_handle(trav_id(p.second[i - 1]), trav_is_rev(p.second[i - 1]));
+            handle_t next = get_handle(trav_id(p.second[i]), trav_is_rev(p.second[i]));
+            bool found = !follow_edges_inline(prev, false, [&](const handle_t& other) {
+                return other != next;
+            });
+            if (!found) {
+                throw runtime_error("[xg] cannot append path " + p.first + ": there is no edge from node "
+                                    + to_string(trav_id(p.second[i - 1])) + " to node " + to_string(trav_id(p.second[i])));
+            }
+        }
+    }
+    if (path_nodes.empty()) {
+        return;
+    }
+    
+    // The existing paths keep their ranks, and the new ones go after them
+    vector<string> path_names;
+    for (size_t i = 1; i <= path_count; ++i) {
+        path_names.push_back(path_name(i));
+    }
+    vector<map<string, vector<trav_t> >::iterator> path_records;
+    for (auto it = path_nodes.begin(); it != path_nodes.end(); ++it) {
+        path_records.push_back(it);
+        path_names.push_back(it->first);
+    }
+    size_t first_new = paths.size();
+    paths.resize(first_new + path_records.size(), nullptr);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_records.size(); ++i) {
+        paths[first_new + i] = new XGPath(path_records[i]->first, path_records[i]->second, node_count, *this,
+                                          nullptr, path_sample_rate);
+    }
+    path_count = paths.size();
+    
+    index_path_membership(path_names);
+    index_component_path_sets();
+    index_path_anchors();
     
+    if (path_memo_shard_entries != 0) {
+        // Memoized results may be missing the new paths
+        enable_path_memo(path_memo_shard_entries * PATH_MEMO_SHARDS);
+    }
+}
+
+void XG::sort_path_steps(map<string, vector<trav_t> >& path_nodes) {
     // sort the paths using mapping rank
     // and remove duplicates
     for (auto& p : path_nodes) {
@@ -608,10 +807,238 @@ void XG::from_callback(function<void(function<void(Graph&)>)> get_chunks,
             exit(1);
         }
     }
+}
 
-    build(node_label, from_to, to_from, path_nodes, validate_graph, print_graph,
-        store_threads, is_sorted_dag);
+void XG::from_callback_two_pass(function<void(function<void(Graph&)>)> get_chunks,
+    bool validate_graph, bool print_graph, bool store_threads, bool is_sorted_dag) {
+
+    // An edge as it appears in the chunks, canonicalized, with the order it
+    // was first seen in, so we can lay the edges out as from_callback would
+    struct EdgeRecord {
+        id_t from;
+        id_t to;
+        bool from_start;
+        bool to_end;
+        size_t order;
+    };
+    
+    // First pass: collect everything but the sequences
+    vector<pair<id_t, size_t> > node_lengths;
+    vector<EdgeRecord> edges;
+    map<string, vector<trav_t> > path_nodes;
+    get_chunks([&](Graph& graph) {
+        for (int64_t i = 0; i < graph.node_size(); ++i) {
+            const Node& n = graph.node(i);
+            node_lengths.emplace_back(n.id(), n.sequence().size());
+        }
+        for (int64_t i = 0; i < graph.edge_size(); ++i) {
+            // Canonicalize every edge, so only canonical edges are in the index.
+            Edge e = canonicalize(graph.edge(i));
+            edges.push_back({e.from(), e.to(), e.from_start(), e.to_end(), edges.size()});
+        }
+        for (int64_t i = 0; i < graph.path_size(); ++i) {
+            const Path& p = graph.path(i);
+            vector<trav_t>& path = path_nodes[p.name()];
+            for (int64_t j = 0; j < p.mapping_size(); ++j) {
+                const Mapping& m = p.mapping(j);
+                path.push_back(make_trav(m.position().node_id(), m.position().is_reverse(), m.rank()));
+            }
+        }
+    });
+    
+    if (node_lengths.empty()) {
+        cerr << "[xg] error: cannot build an index of a graph with no nodes" << endl;
+        exit(1);
+    }
+    
+    // sort the nodes and remove any duplicates
+    std::sort(node_lengths.begin(), node_lengths.end());
+    node_lengths.erase(std::unique(node_lengths.begin(), node_lengths.end(),
+                                   [](const pair<id_t, size_t>& a, const pair<id_t, size_t>& b) {
+                                       return a.first == b.first;
+                                   }), node_lengths.end());
+    node_count = node_lengths.size();
+    seq_length = 0;
+    for (auto& node : node_lengths) {
+        seq_length += node.second;
+    }
+    
+    // remove duplicate edges, keeping the first copy of each
+    auto same_edge = [](const EdgeRecord& a, const EdgeRecord& b) {
+        return tie(a.from, a.from_start, a.to, a.to_end) == tie(b.from, b.from_start, b.to, b.to_end);
+    };
+    std::sort(edges.begin(), edges.end(), [](const EdgeRecord& a, const EdgeRecord& b) {
+        return tie(a.from, a.from_start, a.to, a.to_end, a.order) < tie(b.from, b.from_start, b.to, b.to_end, b.order);
+    });
+    edges.erase(std::unique(edges.begin(), edges.end(), same_edge), edges.end());
+    edge_count = edges.size();
+    
+    path_count = path_nodes.size();
+    sort_path_steps(path_nodes);
+    
+    // Now we know how big everything is
+    min_id = node_lengths.front().first;
+    max_id = node_lengths.back().first;
+    util::assign(s_iv, int_vector<2>(seq_length, 0));
+    util::assign(s_bv, bit_vector(seq_length));
+    util::assign(i_iv, int_vector<>(node_count));
+    util::assign(r_iv, int_vector<>(max_id-min_id+1)); // note possibly discontiguous
+    
+    size_t seq_pos = 0;
+    for (size_t r = 1; r <= node_count; ++r) {
+        int64_t id = node_lengths[r - 1].first;
+        s_bv[seq_pos] = 1; // record node start
+        i_iv[r-1] = id;
+        // store ids to rank mapping
+        r_iv[id-min_id] = r;
+        seq_pos += node_lengths[r - 1].second;
+    }
+    vector<pair<id_t, size_t> >().swap(node_lengths);
+    
+    util::bit_compress(i_iv);
+    util::bit_compress(r_iv);
+    util::assign(s_bv_rank, rank_support_v<1>(&s_bv));
+    util::assign(s_bv_select, bit_vector::select_1_type(&s_bv));
+    
+    // Second pass: write the sequences into place. Anything but A, C, G and T
+    // goes in the exception list.
+    bit_vector exceptions_bv(seq_length);
+    vector<pair<size_t, char> > exceptions;
+    get_chunks([&](Graph& graph) {
+        for (int64_t i = 0; i < graph.node_size(); ++i) {
+            const Node& n = graph.node(i);
+            size_t start = node_start(n.id());
+            for (size_t j = 0; j < n.sequence().size(); ++j) {
+                char c = n.sequence()[j];
+                int code = dna3bit(c);
+                if (code < 4) {
+                    s_iv[start + j] = code;
+                } else {
+                    // keep IUPAC codes, and make anything else an N as before
+                    exceptions_bv[start + j] = 1;
+                    exceptions.emplace_back(start + j, strchr("RYSWKMBDHVN", c) && c ? c : 'N');
+                }
+            }
+        }
+    });
+    // Duplicate nodes repeat their exceptions
+    std::sort(exceptions.begin(), exceptions.end());
+    exceptions.erase(std::unique(exceptions.begin(), exceptions.end(),
+                                 [](const pair<size_t, char>& a, const pair<size_t, char>& b) {
+                                     return a.first == b.first;
+                                 }), exceptions.end());
+    string exception_chars;
+    exception_chars.reserve(exceptions.size());
+    for (auto& exception : exceptions) {
+        exception_chars.push_back(exception.second);
+    }
+    vector<pair<size_t, char> >().swap(exceptions);
+    index_sequence_exceptions(exceptions_bv, exception_chars);
+    count_bases();
+    
+    // Count up the edges on each node, so we know where each g_iv record goes
+    vector<size_t> to_counts(node_count, 0);
+    vector<size_t> from_counts(node_count, 0);
+    for (auto& e : edges) {
+        size_t from_rank = id_to_rank(e.from);
+        size_t to_rank = id_to_rank(e.to);
+        if (from_rank == 0 || to_rank == 0) {
+            cerr << "[xg] error: edge from " << e.from << " to " << e.to << " refers to a missing node" << endl;
+            exit(1);
+        }
+        ++from_counts[from_rank - 1];
+        ++to_counts[to_rank - 1];
+    }
+    
+    // Edges leaving each side, and edges arriving at each side, in the order
+    // they were first seen
+    std::sort(edges.begin(), edges.end(), [](const EdgeRecord& a, const EdgeRecord& b) {
+        return tie(a.from, a.from_start, a.order) < tie(b.from, b.from_start, b.order);
+    });
+    vector<size_t> edges_by_to(edges.size());
+    for (size_t i = 0; i < edges_by_to.size(); ++i) {
+        edges_by_to[i] = i;
+    }
+    std::sort(edges_by_to.begin(), edges_by_to.end(), [&](size_t a, size_t b) {
+        return tie(edges[a].to, edges[a].to_end, edges[a].order) < tie(edges[b].to, edges[b].to_end, edges[b].order);
+    });
+    
+    // Ranks follow ID order, so each node's edges are the next run of each list
+    vector<size_t> g_record_starts(node_count + 1, 0);
+    vector<size_t> from_starts(node_count + 1, 0);
+    vector<size_t> to_starts(node_count + 1, 0);
+    for (size_t i = 0; i < node_count; ++i) {
+        g_record_starts[i + 1] = g_record_starts[i] + G_NODE_HEADER_LENGTH
+            + G_EDGE_LENGTH * (to_counts[i] + from_counts[i]);
+        from_starts[i + 1] = from_starts[i] + from_counts[i];
+        to_starts[i + 1] = to_starts[i] + to_counts[i];
+    }
+    vector<size_t>().swap(to_counts);
+    vector<size_t>().swap(from_counts);
     
+    size_t g_iv_size = g_record_starts.back();
+    util::assign(g_iv, int_vector<>(g_iv_size));
+    util::assign(g_bv, bit_vector(g_iv_size));
+    
+    // Neighboring bits of g_bv share words, so mark the record starts first
+    // on one thread.
+    for (int64_t i = 0; i < node_count; ++i) {
+        g_bv[g_record_starts[i]] = 1; // mark record start for later query
+    }
+    
+    // g_iv has full-width entries until we compress it, so each thread can
+    // write its own records without interfering with its neighbors.
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t i = 0; i < node_count; ++i) {
+        int64_t id = i_iv[i];
+        int64_t g = g_record_starts[i]; // pointer into g_iv
+        // now build up the record
+        g_iv[g++] = id; // save id
+        g_iv[g++] = node_start(id);
+        g_iv[g++] = node_length(id); // sequence length
+        g_iv[g++] = to_starts[i + 1] - to_starts[i];
+        g_iv[g++] = from_starts[i + 1] - from_starts[i];
+        // write the edges in id-based format
+        // we will next convert these into relative format
+        for (size_t j = to_starts[i]; j < to_starts[i + 1]; ++j) {
+            auto& e = edges[edges_by_to[j]];
+            g_iv[g++] = e.from;
+            g_iv[g++] = edge_type(e.from_start, e.to_end);
+        }
+        for (size_t j = from_starts[i]; j < from_starts[i + 1]; ++j) {
+            auto& e = edges[j];
+            g_iv[g++] = e.to;
+            g_iv[g++] = edge_type(e.from_start, e.to_end);
+        }
+    }
+    vector<EdgeRecord>().swap(edges);
+    vector<size_t>().swap(edges_by_to);
+    vector<size_t>().swap(from_starts);
+    vector<size_t>().swap(to_starts);
+    
+    relativize_graph_vector(g_record_starts);
+    
+    finish_build(path_nodes, print_graph, store_threads, is_sorted_dag);
+    
+    if (validate_graph) {
+        // We didn't keep the sequences, so read them all again
+        cerr << "validating graph sequence" << endl;
+        get_chunks([&](Graph& graph) {
+            for (int64_t i = 0; i < graph.node_size(); ++i) {
+                const Node& n = graph.node(i);
+                string s = node_sequence(n.id());
+                bool matches = s.size() == n.sequence().size();
+                for (size_t j = 0; matches && j < s.size(); ++j) {
+                    matches = dna3bit(n.sequence()[j]) == dna3bit(s[j]);
+                }
+                if (!matches) {
+                    cerr << n.sequence() << " != " << endl << s << endl << " for node " << n.id() << endl;
+                    assert(false);
+                }
+            }
+        });
+        cerr << "graph ok" << endl;
+    }
 }
 
 void XG::build(vector<pair<id_t, string> >& node_label,
@@ -638,8 +1065,11 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     max_id = node_label.rbegin()->first;
     
     // set up our compressed representation
-    util::assign(s_iv, int_vector<>(seq_length, 0, 3));
+    util::assign(s_iv, int_vector<2>(seq_length, 0));
     util::assign(s_bv, bit_vector(seq_length));
+    // anything but A, C, G and T goes in the exception list
+    bit_vector exceptions_bv(seq_length);
+    string exception_chars;
     util::assign(i_iv, int_vector<>(node_count));
     util::assign(r_iv, int_vector<>(max_id-min_id+1)); // note possibly discontiguous
     
@@ -659,9 +1089,19 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         r_iv[id-min_id] = r;
         ++r;
         for (auto c : l) {
-            s_iv[i++] = dna3bit(c); // store sequence
+            int code = dna3bit(c);
+            if (code < 4) {
+                s_iv[i] = code; // store sequence
+            } else {
+                // keep IUPAC codes, and make anything else an N as before
+                exceptions_bv[i] = 1;
+                exception_chars.push_back(strchr("RYSWKMBDHVN", c) && c ? c : 'N');
+            }
+            ++i;
         }
     }
+    index_sequence_exceptions(exceptions_bv, exception_chars);
+    count_bases();
     // keep only if we need to validate the graph
     if (!validate_graph) node_label.clear();
 
@@ -744,7 +1184,6 @@ void XG::build(vector<pair<id_t, string> >& node_label,
     */
 
     // to label the paths we'll need to compress and index our vectors
-    util::bit_compress(s_iv);
     util::assign(s_bv_rank, rank_support_v<1>(&s_bv));
     util::assign(s_bv_select, bit_vector::select_1_type(&s_bv));
     
@@ -755,15 +1194,46 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         + edge_count * 2 * G_EDGE_LENGTH; // edges (stored twice)
     util::assign(g_iv, int_vector<>(g_iv_size));
     util::assign(g_bv, bit_vector(g_iv_size));
-    int64_t g = 0; // pointer into g_iv and g_bv
-    // for each node
+    
+    // Work out where each node's record starts, so the records can be filled
+    // in independently. The record sizes only depend on the edge counts.
+    vector<size_t> g_record_starts(i_iv.size() + 1, 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t i = 0; i < i_iv.size(); ++i) {
+        int64_t id = i_iv[i];
+        size_t record_length = G_NODE_HEADER_LENGTH;
+        for (auto end : { false, true }) {
+            auto to_found = to_from.find(make_side(id, end));
+            if (to_found != to_from.end()) {
+                record_length += G_EDGE_LENGTH * to_found->second.size();
+            }
+            auto from_found = from_to.find(make_side(id, end));
+            if (from_found != from_to.end()) {
+                record_length += G_EDGE_LENGTH * from_found->second.size();
+            }
+        }
+        g_record_starts[i + 1] = record_length;
+    }
+    for (size_t i = 1; i < g_record_starts.size(); ++i) {
+        g_record_starts[i] += g_record_starts[i - 1];
+    }
+    
+    // Neighboring bits of g_bv share words, so mark the record starts first
+    // on one thread.
     for (int64_t i = 0; i < i_iv.size(); ++i) {
-        Node n = node(i_iv[i]);
+        g_bv[g_record_starts[i]] = 1; // mark record start for later query
+    }
+    
+    // g_iv has full-width entries until we compress it, so each thread can
+    // write its own records without interfering with its neighbors.
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t i = 0; i < i_iv.size(); ++i) {
+        int64_t id = i_iv[i];
+        int64_t g = g_record_starts[i]; // pointer into g_iv
         // now build up the record
-        g_bv[g] = 1; // mark record start for later query
-        g_iv[g++] = n.id(); // save id
-        g_iv[g++] = node_start(n.id());
-        g_iv[g++] = n.sequence().size(); // sequence length
+        g_iv[g++] = id; // save id
+        g_iv[g++] = node_start(id);
+        g_iv[g++] = node_length(id); // sequence length
         size_t to_edge_count = 0;
         size_t from_edge_count = 0;
         size_t to_edge_count_idx = g++;
@@ -771,8 +1241,9 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         // write the edges in id-based format
         // we will next convert these into relative format
         for (auto end : { false, true }) {
-            auto& to_sides = to_from[make_side(n.id(), end)];
-            for (auto& e : to_sides) {
+            auto found = to_from.find(make_side(id, end));
+            if (found == to_from.end()) continue;
+            for (auto& e : found->second) {
                 g_iv[g++] = side_id(e);
                 g_iv[g++] = edge_type(side_is_end(e), end);
                 ++to_edge_count;
@@ -780,8 +1251,9 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         }
         g_iv[to_edge_count_idx] = to_edge_count;
         for (auto end : { false, true }) {
-            auto& from_sides = from_to[make_side(n.id(), end)];
-            for (auto& e : from_sides) {
+            auto found = from_to.find(make_side(id, end));
+            if (found == from_to.end()) continue;
+            for (auto& e : found->second) {
                 g_iv[g++] = side_id(e);
                 g_iv[g++] = edge_type(end, side_is_end(e));
                 ++from_edge_count;
@@ -790,102 +1262,347 @@ void XG::build(vector<pair<id_t, string> >& node_label,
         g_iv[from_edge_count_idx] = from_edge_count;
     }
 
-    // set up rank and select supports on g_bv so we can locate nodes in g_iv
-    util::assign(g_bv_rank, rank_support_v<1>(&g_bv));
-    util::assign(g_bv_select, bit_vector::select_1_type(&g_bv));
-
-    // convert the edges in g_iv to relativistic form
-    for (int64_t i = 0; i < i_iv.size(); ++i) {
-        int64_t id = i_iv[i];
-        // find the start of the node's record in g_iv
-        int64_t g = g_bv_select(id_to_rank(id));
-        // get to the edges to
-        int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
-        int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
-        int64_t t = g + G_NODE_HEADER_LENGTH;
-        int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
-        for (int64_t j = t; j < f; ) {
-            g_iv[j] = g_bv_select(id_to_rank(g_iv[j])) - g;
-            j += 2;
-        }
-        for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
-            g_iv[j] = g_bv_select(id_to_rank(g_iv[j])) - g;
-            j += 2;
-        }
-    }
-
-    util::bit_compress(g_iv);
-
-#if GPBWT_MODE == MODE_SDSL
-    // We have one B_s array for every side, but the first 2 numbers for sides
-    // are unused. But max node rank is inclusive, so it evens out...
-    bs_arrays.resize(max_node_rank() * 2);
-#endif
+    relativize_graph_vector(g_record_starts);
 
-#ifdef VERBOSE_DEBUG
-    cerr << "storing paths" << endl;
-#endif
-    // paths
-    string path_names;
-    size_t path_node_count = 0; // count of node path memberships
-    for (auto& pathpair : path_nodes) {
-        // add path name
-        const string& path_name = pathpair.first;
-        //cerr << path_name << endl;
-        path_names += start_marker + path_name + end_marker;
-        // The path constructor helpfully counts unique path members for us
-        size_t unique_member_count;
-        XGPath* path = new XGPath(path_name, pathpair.second, node_count, *this, &unique_member_count);
-        paths.push_back(path);
-        path_node_count += unique_member_count;
-    }
+    finish_build(path_nodes, print_graph, store_threads, is_sorted_dag);
 
-    // handle path names
-    util::assign(pn_iv, int_vector<>(path_names.size()));
-    util::assign(pn_bv, bit_vector(path_names.size()));
-    // now record path name starts
-    for (size_t i = 0; i < path_names.size(); ++i) {
-        pn_iv[i] = path_names[i];
-        if (path_names[i] == start_marker) {
-            pn_bv[i] = 1; // register name start
-        }
-    }
-    util::assign(pn_bv_rank, rank_support_v<1>(&pn_bv));
-    util::assign(pn_bv_select, bit_vector::select_1_type(&pn_bv));
-    
-    //util::bit_compress(pn_iv);
-    string path_name_file = "@pathnames.iv";
-    store_to_file((const char*)path_names.c_str(), path_name_file);
-    construct(pn_csa, path_name_file, 1);
+    if (validate_graph) {
+        cerr << "validating graph sequence" << endl;
+        int max_id = s_bv_rank(s_bv.size());
+        for (auto& p : node_label) {
+            int64_t id = p.first;
+            const string& l = p.second;
+            //size_t rank = node_rank[id];
+            size_t rank = id_to_rank(id);
+            //cerr << rank << endl;
+            // find the node in the array
+            //cerr << "id = " << id << " rank = " << s_bv_select(rank) << endl;
+            // this should be true given how we constructed things
+            if (rank != s_bv_rank(s_bv_select(rank)+1)) {
+                cerr << rank << " != " << s_bv_rank(s_bv_select(rank)+1) << " for node " << id << endl;
+                assert(false);
+            }
+            // get the sequence from the s_iv
+            string s = node_sequence(id);
 
-    // node -> paths
-    util::assign(np_iv, int_vector<>(path_node_count+node_count));
-    util::assign(np_bv, bit_vector(path_node_count+node_count));
-    size_t np_off = 0;
-    for (size_t i = 0; i < node_count; ++i) {
-        np_bv[np_off] = 1;
-        np_iv[np_off] = 0; // null so we can detect entities with no path membership
-        ++np_off;
-        for (size_t j = 0; j < paths.size(); ++j) {
-            if (paths[j]->nodes[i] == 1) {
-                np_iv[np_off++] = j+1;
+            string ltmp, stmp;
+            if (l.size() != s.size()) {
+                cerr << l << " != " << endl << s << endl << " for node " << id << endl;
+                assert(false);
+            } else {
+                int j = 0;
+                for (auto c : l) {
+                    if (dna3bit(c) != dna3bit(s[j++])) {
+                        cerr << l << " != " << endl << s << endl << " for node " << id << endl;
+                        assert(false);
+                    }
+                }
             }
         }
-    }
-
-    util::bit_compress(np_iv);
-    //cerr << ep_off << " " << path_entities << " " << entity_count << endl;
-    assert(np_off <= path_node_count+node_count);
-    util::assign(np_bv_rank, rank_support_v<1>(&np_bv));
-    util::assign(np_bv_select, bit_vector::select_1_type(&np_bv));
+        node_label.clear();
 
-#ifdef VERBOSE_DEBUG
-    cerr << "indexing component path sets" << endl;
-#endif
-    
+        // -1 here seems weird
+        // what?
+        /*
+        cerr << "validating forward edge table" << endl;
+        for (size_t j = 0; j < f_iv.size()-1; ++j) {
+            if (f_bv[j] == 1) continue;
+            // from id == rank
+            size_t fid = i_iv[f_bv_rank(j)-1];
+            // to id == f_cbv[j]
+            size_t tid = i_iv[f_iv[j]-1];
+            bool from_start = f_from_start_bv[j];
+            // get the to_end
+            bool to_end = false;
+            for (auto& side : from_to[make_side(fid, from_start)]) {
+                if (side_id(side) == tid) {
+                    to_end = side_is_end(side);
+                }
+            }
+            bool has_edge = false;
+            for (auto& side : from_to[make_side(fid, from_start)]) {
+                if (side == make_side(tid, to_end)) { has_edge = true; break; }
+            }
+            if (!has_edge) {
+                cerr << "could not find edge (f) "
+                     << fid << (from_start ? "+" : "-")
+                     << " -> "
+                     << tid << (to_end ? "+" : "-")
+                     << endl;
+                assert(false);
+            }
+        }
+
+        cerr << "validating reverse edge table" << endl;
+        for (size_t j = 0; j < t_iv.size()-1; ++j) {
+            //cerr << j << endl;
+            if (t_bv[j] == 1) continue;
+            // from id == rank
+            size_t tid = i_iv[t_bv_rank(j)-1];
+            // to id == f_cbv[j]
+            size_t fid = i_iv[t_iv[j]-1];
+            //cerr << tid << " " << fid << endl;
+
+            bool to_end = t_to_end_bv[j];
+            // get the to_end
+            bool from_start = false;
+            for (auto& side : to_from[make_side(tid, to_end)]) {
+                if (side_id(side) == fid) {
+                    from_start = side_is_end(side);
+                }
+            }
+            bool has_edge = false;
+            for (auto& side : to_from[make_side(tid, to_end)]) {
+                if (side == make_side(fid, from_start)) { has_edge = true; break; }
+            }
+            if (!has_edge) {
+                cerr << "could not find edge (t) "
+                     << fid << (from_start ? "+" : "-")
+                     << " -> "
+                     << tid << (to_end ? "+" : "-")
+                     << endl;
+                assert(false);
+            }
+        }
+        */
+
+        /*
+        cerr << "validating paths" << endl;
+        for (auto& pathpair : path_nodes) {
+            const string& name = pathpair.first;
+            auto& path = pathpair.second;
+            size_t prank = path_rank(name);
+            //cerr << path_name(prank) << endl;
+            assert(path_name(prank) == name);
+            rrr_vector<>& pe_bv = paths[prank-1]->nodes;
+            int_vector<>& pp_iv = paths[prank-1]->positions;
+            sd_vector<>& dir_bv = paths[prank-1]->directions;
+            // check each entity in the nodes is present
+            // and check node reported at the positions in it
+            size_t pos = 0;
+            size_t in_path = 0;
+            for (auto& m : path) {
+                int64_t id = trav_id(m);
+                bool rev = trav_is_rev(m);
+                // todo rank
+                assert(pe_bv[node_rank_as_entity(id)-1]);
+                assert(dir_bv[in_path] == rev);
+                Node n = node(id);
+                //cerr << id << " in " << name << endl;
+                auto p = position_in_path(id, name);
+                assert(std::find(p.begin(), p.end(), pos) != p.end());
+                for (size_t k = 0; k < n.sequence().size(); ++k) {
+                    //cerr << "id " << id << " ==? " << node_at_path_position(name, pos+k) << endl;
+                    assert(id == node_at_path_position(name, pos+k));
+                    assert(id == mapping_at_path_position(name, pos+k).position().node_id());
+                }
+                pos += n.sequence().size();
+                ++in_path;
+            }
+            //cerr << path_name << " rank = " << prank << endl;
+            // check membership now for each entity in the path
+        }
+        */
+        
+#if GPBWT_MODE == MODE_SDSL
+        if(store_threads && is_sorted_dag) {
+#elif GPBWT_MODE == MODE_DYNAMIC
+        if(store_threads) {
+#endif
+        
+            cerr << "validating threads" << endl;
+            
+            // How many thread orientations are in the index?
+            size_t threads_found = 0;
+            // And how many shoukd we have inserted?
+            size_t threads_expected = 0;
+            list<thread_t> threads;
+            for (auto& t : extract_threads(false)) {
+                for (auto& k : t.second) threads.push_back(k);
+            }
+            for (auto& t : extract_threads(true)) {
+                for (auto& k : t.second) threads.push_back(k);
+            }
+            for(auto thread : threads) {
+#ifdef VERBOSE_DEBUG
+                cerr << "Thread: ";
+                for(size_t i = 0; i < thread.size(); i++) {
+                    ThreadMapping mapping = thread[i];
+                    cerr << mapping.node_id * 2 + mapping.is_reverse << "; ";
+                }
+                cerr << endl;
+#endif
+                // Make sure we can search all the threads we find present in the index
+                assert(count_matches(thread) > 0);
+                
+                // Flip the thread around
+                reverse(thread.begin(), thread.end());
+                for(auto& mapping : thread) {
+                    mapping.is_reverse = !mapping.is_reverse;
+                }
+                
+                // We need to be able to find it backwards as well
+                assert(count_matches(thread) > 0);
+                
+                threads_found++;
+            }
+            
+            for (auto& pathpair : path_nodes) {
+                Path reconstructed;
+                
+                // Grab the name
+                reconstructed.set_name(pathpair.first);
+                
+                // This path should have been inserted. Look for it.
+                assert(count_matches(reconstructed) > 0);
+                
+                threads_expected += 2;
+                
+            }
+            
+            // Make sure we have the right number of threads.
+            assert(threads_found == threads_expected);
+        }
+
+        cerr << "graph ok" << endl;
+    }
+}
+
+void XG::relativize_graph_vector(vector<size_t>& g_record_starts) {
+    // set up rank and select supports on g_bv so we can locate nodes in g_iv
+    util::assign(g_bv_rank, rank_support_v<1>(&g_bv));
+    util::assign(g_bv_select, bit_vector::select_1_type(&g_bv));
+
+    // convert the edges in g_iv to relativistic form
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int64_t i = 0; i < i_iv.size(); ++i) {
+        // find the start of the node's record in g_iv
+        int64_t g = g_record_starts[i];
+        // get to the edges to
+        int edges_to_count = g_iv[g+G_NODE_TO_COUNT_OFFSET];
+        int edges_from_count = g_iv[g+G_NODE_FROM_COUNT_OFFSET];
+        int64_t t = g + G_NODE_HEADER_LENGTH;
+        int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+        for (int64_t j = t; j < f; ) {
+            g_iv[j] = g_record_starts[id_to_rank(g_iv[j]) - 1] - g;
+            j += 2;
+        }
+        for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
+            g_iv[j] = g_record_starts[id_to_rank(g_iv[j]) - 1] - g;
+            j += 2;
+        }
+    }
+    
+    // Free the record starts before we go on to the paths
+    vector<size_t>().swap(g_record_starts);
+
+    util::bit_compress(g_iv);
+}
+
+void XG::index_path_membership(const vector<string>& path_name_list) {
+    string path_names;
+    for (auto& path_name : path_name_list) {
+        // add path name
+        path_names += start_marker + path_name + end_marker;
+    }
+
+    // handle path names
+    util::assign(pn_iv, int_vector<>(path_names.size()));
+    util::assign(pn_bv, bit_vector(path_names.size()));
+    // now record path name starts
+    for (size_t i = 0; i < path_names.size(); ++i) {
+        pn_iv[i] = path_names[i];
+        if (path_names[i] == start_marker) {
+            pn_bv[i] = 1; // register name start
+        }
+    }
+    util::assign(pn_bv_rank, rank_support_v<1>(&pn_bv));
+    util::assign(pn_bv_select, bit_vector::select_1_type(&pn_bv));
+    
+    //util::bit_compress(pn_iv);
+    string path_name_file = "@pathnames.iv";
+    store_to_file((const char*)path_names.c_str(), path_name_file);
+    construct(pn_csa, path_name_file, 1);
+
+    // node -> paths
+    // Find which paths touch each node in parallel, and then lay the
+    // memberships out in node order.
+    vector<vector<size_t> > node_path_ranks(node_count);
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (size_t i = 0; i < node_count; ++i) {
+        for (size_t j = 0; j < paths.size(); ++j) {
+            if (paths[j]->nodes[i] == 1) {
+                node_path_ranks[i].push_back(j+1);
+            }
+        }
+    }
+    size_t path_node_count = 0; // count of node path memberships
+    for (auto& ranks : node_path_ranks) {
+        path_node_count += ranks.size();
+    }
+    util::assign(np_iv, int_vector<>(path_node_count+node_count));
+    util::assign(np_bv, bit_vector(path_node_count+node_count));
+    size_t np_off = 0;
+    for (size_t i = 0; i < node_count; ++i) {
+        np_bv[np_off] = 1;
+        np_iv[np_off] = 0; // null so we can detect entities with no path membership
+        ++np_off;
+        for (auto& path_rank : node_path_ranks[i]) {
+            np_iv[np_off++] = path_rank;
+        }
+        // Free memory as we go
+        vector<size_t>().swap(node_path_ranks[i]);
+    }
+
+    util::bit_compress(np_iv);
+    assert(np_off == path_node_count+node_count);
+    util::assign(np_bv_rank, rank_support_v<1>(&np_bv));
+    util::assign(np_bv_select, bit_vector::select_1_type(&np_bv));
+}
+
+void XG::finish_build(map<string, vector<trav_t> >& path_nodes,
+                      bool print_graph,
+                      bool store_threads,
+                      bool is_sorted_dag) {
+
+#if GPBWT_MODE == MODE_SDSL
+    // We have one B_s array for every side, but the first 2 numbers for sides
+    // are unused. But max node rank is inclusive, so it evens out...
+    bs_arrays.resize(max_node_rank() * 2);
+#endif
+
+#ifdef VERBOSE_DEBUG
+    cerr << "storing paths" << endl;
+#endif
+    // paths
+    // The paths are independent, so build their indexes in parallel. We need
+    // random access to the path records to do that.
+    vector<map<string, vector<trav_t> >::iterator> path_records;
+    for (auto it = path_nodes.begin(); it != path_nodes.end(); ++it) {
+        path_records.push_back(it);
+    }
+    paths.resize(path_records.size(), nullptr);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < path_records.size(); ++i) {
+        paths[i] = new XGPath(path_records[i]->first, path_records[i]->second, node_count, *this,
+                              nullptr, path_sample_rate);
+    }
+    vector<string> path_names;
+    for (size_t i = 0; i < path_records.size(); ++i) {
+        path_names.push_back(path_records[i]->first);
+    }
+    index_path_membership(path_names);
+
+#ifdef VERBOSE_DEBUG
+    cerr << "indexing component path sets" << endl;
+#endif
+    
     // memoize which paths co-occur on connected components
     index_component_path_sets();
     
+    // and find the nearest path node to every node
+    index_path_anchors();
+    
     if(store_threads) {
 
 // Prepare empty vectors for path indexing
@@ -1020,258 +1737,57 @@ void XG::build(vector<pair<id_t, string> >& node_label,
             size_t seq_start = g_iv[g+G_NODE_SEQ_START_OFFSET];
             cerr << id << " ";
             for (int64_t j = seq_start; j < seq_start+sequence_size; ++j) {
-                cerr << revdna3bit(s_iv[j]);
-            } cerr << " : ";
-            int64_t t = g + G_NODE_HEADER_LENGTH;
-            int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
-            cerr << " from ";
-            for (int64_t j = t; j < f; ) {
-                cerr << i_iv[g_bv_rank(g+g_iv[j])] << " ";
-                j += 2;
-            }
-            cerr << "to ";
-            for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
-                cerr << i_iv[g_bv_rank(g+g_iv[j])] << " ";
-                j += 2;
-            }
-            cerr << endl;
-        }
-        cerr << s_iv << endl;
-        for (size_t i = 0; i < s_iv.size(); ++i) {
-            cerr << revdna3bit(s_iv[i]);
-        } cerr << endl;
-        cerr << s_bv << endl;
-        cerr << i_iv << endl;
-        cerr << "paths (" << paths.size() << ")" << endl;
-        for (size_t i = 0; i < paths.size(); i++) {
-            // Go through paths by number, so we can determine rank
-            XGPath* path = paths[i];
-            
-            cerr << path_name(i + 1) << endl;
-            cerr << path->nodes << endl;
-            // manually print IDs because simplified wavelet tree doesn't support ostream for some reason
-            for (size_t j = 0; j + 1 < path->ids.size(); j++) {
-                cerr << path->ids[j] << " ";
-            }
-            if (path->ids.size() > 0) {
-                cerr << path->ids[path->ids.size() - 1];
-            }
-            cerr << endl;
-            cerr << path->ranks << endl;
-            cerr << path->directions << endl;
-            cerr << path->positions << endl;
-            cerr << path->offsets << endl;
-        }
-        cerr << np_bv << endl;
-        cerr << np_iv << endl;
-        
-        // output the succinct representations of the component path set indexes
-        int_vector<> path_ranks_iv;
-        bit_vector path_ranks_bv;
-        create_succinct_component_path_sets(path_ranks_iv, path_ranks_bv);
-        cerr << path_ranks_iv << endl;
-        cerr << path_ranks_bv << endl;
-    }
-
-    if (validate_graph) {
-        cerr << "validating graph sequence" << endl;
-        int max_id = s_bv_rank(s_bv.size());
-        for (auto& p : node_label) {
-            int64_t id = p.first;
-            const string& l = p.second;
-            //size_t rank = node_rank[id];
-            size_t rank = id_to_rank(id);
-            //cerr << rank << endl;
-            // find the node in the array
-            //cerr << "id = " << id << " rank = " << s_bv_select(rank) << endl;
-            // this should be true given how we constructed things
-            if (rank != s_bv_rank(s_bv_select(rank)+1)) {
-                cerr << rank << " != " << s_bv_rank(s_bv_select(rank)+1) << " for node " << id << endl;
-                assert(false);
-            }
-            // get the sequence from the s_iv
-            string s = node_sequence(id);
-
-            string ltmp, stmp;
-            if (l.size() != s.size()) {
-                cerr << l << " != " << endl << s << endl << " for node " << id << endl;
-                assert(false);
-            } else {
-                int j = 0;
-                for (auto c : l) {
-                    if (dna3bit(c) != dna3bit(s[j++])) {
-                        cerr << l << " != " << endl << s << endl << " for node " << id << endl;
-                        assert(false);
-                    }
-                }
-            }
-        }
-        node_label.clear();
-
-        // -1 here seems weird
-        // what?
-        /*
-        cerr << "validating forward edge table" << endl;
-        for (size_t j = 0; j < f_iv.size()-1; ++j) {
-            if (f_bv[j] == 1) continue;
-            // from id == rank
-            size_t fid = i_iv[f_bv_rank(j)-1];
-            // to id == f_cbv[j]
-            size_t tid = i_iv[f_iv[j]-1];
-            bool from_start = f_from_start_bv[j];
-            // get the to_end
-            bool to_end = false;
-            for (auto& side : from_to[make_side(fid, from_start)]) {
-                if (side_id(side) == tid) {
-                    to_end = side_is_end(side);
-                }
-            }
-            bool has_edge = false;
-            for (auto& side : from_to[make_side(fid, from_start)]) {
-                if (side == make_side(tid, to_end)) { has_edge = true; break; }
-            }
-            if (!has_edge) {
-                cerr << "could not find edge (f) "
-                     << fid << (from_start ? "+" : "-")
-                     << " -> "
-                     << tid << (to_end ? "+" : "-")
-                     << endl;
-                assert(false);
-            }
-        }
-
-        cerr << "validating reverse edge table" << endl;
-        for (size_t j = 0; j < t_iv.size()-1; ++j) {
-            //cerr << j << endl;
-            if (t_bv[j] == 1) continue;
-            // from id == rank
-            size_t tid = i_iv[t_bv_rank(j)-1];
-            // to id == f_cbv[j]
-            size_t fid = i_iv[t_iv[j]-1];
-            //cerr << tid << " " << fid << endl;
-
-            bool to_end = t_to_end_bv[j];
-            // get the to_end
-            bool from_start = false;
-            for (auto& side : to_from[make_side(tid, to_end)]) {
-                if (side_id(side) == fid) {
-                    from_start = side_is_end(side);
-                }
-            }
-            bool has_edge = false;
-            for (auto& side : to_from[make_side(tid, to_end)]) {
-                if (side == make_side(fid, from_start)) { has_edge = true; break; }
-            }
-            if (!has_edge) {
-                cerr << "could not find edge (t) "
-                     << fid << (from_start ? "+" : "-")
-                     << " -> "
-                     << tid << (to_end ? "+" : "-")
-                     << endl;
-                assert(false);
+                cerr << sequence_char(j);
+            } cerr << " : ";
+            int64_t t = g + G_NODE_HEADER_LENGTH;
+            int64_t f = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+            cerr << " from ";
+            for (int64_t j = t; j < f; ) {
+                cerr << i_iv[g_bv_rank(g+g_iv[j])] << " ";
+                j += 2;
             }
-        }
-        */
-
-        /*
-        cerr << "validating paths" << endl;
-        for (auto& pathpair : path_nodes) {
-            const string& name = pathpair.first;
-            auto& path = pathpair.second;
-            size_t prank = path_rank(name);
-            //cerr << path_name(prank) << endl;
-            assert(path_name(prank) == name);
-            rrr_vector<>& pe_bv = paths[prank-1]->nodes;
-            int_vector<>& pp_iv = paths[prank-1]->positions;
-            sd_vector<>& dir_bv = paths[prank-1]->directions;
-            // check each entity in the nodes is present
-            // and check node reported at the positions in it
-            size_t pos = 0;
-            size_t in_path = 0;
-            for (auto& m : path) {
-                int64_t id = trav_id(m);
-                bool rev = trav_is_rev(m);
-                // todo rank
-                assert(pe_bv[node_rank_as_entity(id)-1]);
-                assert(dir_bv[in_path] == rev);
-                Node n = node(id);
-                //cerr << id << " in " << name << endl;
-                auto p = position_in_path(id, name);
-                assert(std::find(p.begin(), p.end(), pos) != p.end());
-                for (size_t k = 0; k < n.sequence().size(); ++k) {
-                    //cerr << "id " << id << " ==? " << node_at_path_position(name, pos+k) << endl;
-                    assert(id == node_at_path_position(name, pos+k));
-                    assert(id == mapping_at_path_position(name, pos+k).position().node_id());
-                }
-                pos += n.sequence().size();
-                ++in_path;
+            cerr << "to ";
+            for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; ) {
+                cerr << i_iv[g_bv_rank(g+g_iv[j])] << " ";
+                j += 2;
             }
-            //cerr << path_name << " rank = " << prank << endl;
-            // check membership now for each entity in the path
+            cerr << endl;
         }
-        */
-        
-#if GPBWT_MODE == MODE_SDSL
-        if(store_threads && is_sorted_dag) {
-#elif GPBWT_MODE == MODE_DYNAMIC
-        if(store_threads) {
-#endif
-        
-            cerr << "validating threads" << endl;
+        cerr << s_iv << endl;
+        for (size_t i = 0; i < s_iv.size(); ++i) {
+            cerr << sequence_char(i);
+        } cerr << endl;
+        cerr << s_bv << endl;
+        cerr << i_iv << endl;
+        cerr << "paths (" << paths.size() << ")" << endl;
+        for (size_t i = 0; i < paths.size(); i++) {
+            // Go through paths by number, so we can determine rank
+            XGPath* path = paths[i];
             
-            // How many thread orientations are in the index?
-            size_t threads_found = 0;
-            // And how many shoukd we have inserted?
-            size_t threads_expected = 0;
-            list<thread_t> threads;
-            for (auto& t : extract_threads(false)) {
-                for (auto& k : t.second) threads.push_back(k);
-            }
-            for (auto& t : extract_threads(true)) {
-                for (auto& k : t.second) threads.push_back(k);
-            }
-            for(auto thread : threads) {
-#ifdef VERBOSE_DEBUG
-                cerr << "Thread: ";
-                for(size_t i = 0; i < thread.size(); i++) {
-                    ThreadMapping mapping = thread[i];
-                    cerr << mapping.node_id * 2 + mapping.is_reverse << "; ";
-                }
-                cerr << endl;
-#endif
-                // Make sure we can search all the threads we find present in the index
-                assert(count_matches(thread) > 0);
-                
-                // Flip the thread around
-                reverse(thread.begin(), thread.end());
-                for(auto& mapping : thread) {
-                    mapping.is_reverse = !mapping.is_reverse;
-                }
-                
-                // We need to be able to find it backwards as well
-                assert(count_matches(thread) > 0);
-                
-                threads_found++;
+            cerr << path_name(i + 1) << endl;
+            cerr << path->nodes << endl;
+            // manually print IDs because simplified wavelet tree doesn't support ostream for some reason
+            for (size_t j = 0; j + 1 < path->ids.size(); j++) {
+                cerr << path->ids[j] << " ";
             }
-            
-            for (auto& pathpair : path_nodes) {
-                Path reconstructed;
-                
-                // Grab the name
-                reconstructed.set_name(pathpair.first);
-                
-                // This path should have been inserted. Look for it.
-                assert(count_matches(reconstructed) > 0);
-                
-                threads_expected += 2;
-                
+            if (path->ids.size() > 0) {
+                cerr << path->ids[path->ids.size() - 1];
             }
-            
-            // Make sure we have the right number of threads.
-            assert(threads_found == threads_expected);
+            cerr << endl;
+            cerr << path->ranks << endl;
+            cerr << path->directions << endl;
+            cerr << path->positions << endl;
+            cerr << path->offsets << endl;
         }
-
-        cerr << "graph ok" << endl;
+        cerr << np_bv << endl;
+        cerr << np_iv << endl;
+        
+        // output the succinct representations of the component path set indexes
+        int_vector<> path_ranks_iv;
+        bit_vector path_ranks_bv;
+        create_succinct_component_path_sets(path_ranks_iv, path_ranks_bv);
+        cerr << path_ranks_iv << endl;
+        cerr << path_ranks_bv << endl;
     }
 }
     
@@ -1355,6 +1871,73 @@ void XG::index_component_path_sets() {
     }
 }
     
+void XG::index_path_anchors() {
+    util::assign(pa_iv, int_vector<>(node_count, 0));
+    
+    // Every node on a path is its own anchor, and starts the search
+    vector<size_t> frontier;
+    for (size_t rank = 1; rank <= node_count; rank++) {
+        if (node_on_any_path(rank_to_id(rank))) {
+            pa_iv[rank - 1] = rank;
+            frontier.push_back(rank);
+        }
+    }
+    sdsl::bit_vector settled(node_count, 0);
+    for (size_t rank : frontier) {
+        settled[rank - 1] = 1;
+    }
+    
+    // Then go out a step at a time. A node first reached at some step takes
+    // the lowest ranked anchor of its neighbors from the step before, which
+    // is the lowest ID among the path nodes that many steps away, just as
+    // the search in nearest_path_node picks.
+    for (int step = 1; step < PATH_ANCHOR_STEPS && !frontier.empty(); step++) {
+        vector<size_t> next;
+        for (size_t rank : frontier) {
+            size_t anchor = pa_iv[rank - 1];
+            handle_t handle = get_handle(rank_to_id(rank), false);
+            for (bool go_left : {false, true}) {
+                follow_edges(handle, go_left, [&](const handle_t& other) {
+                    size_t other_rank = id_to_rank(get_id(other));
+                    if (!settled[other_rank - 1]) {
+                        if (pa_iv[other_rank - 1] == 0) {
+                            next.push_back(other_rank);
+                            pa_iv[other_rank - 1] = anchor;
+                        } else if (anchor < pa_iv[other_rank - 1]) {
+                            pa_iv[other_rank - 1] = anchor;
+                        }
+                    }
+                    return true;
+                });
+            }
+        }
+        for (size_t rank : next) {
+            settled[rank - 1] = 1;
+        }
+        frontier = std::move(next);
+    }
+    
+    util::bit_compress(pa_iv);
+}
+
+bool XG::path_anchors_rule_out(int64_t id1, int64_t id2) const {
+    if (pa_iv.size() != node_count || paths.empty() || id_to_rank(id1) == 0 || id_to_rank(id2) == 0) {
+        return false;
+    }
+    size_t anchor_1 = pa_iv[id_to_rank(id1) - 1];
+    size_t anchor_2 = pa_iv[id_to_rank(id2) - 1];
+    if (anchor_1 == 0 || anchor_2 == 0) {
+        // We don't know where one of them is
+        return false;
+    }
+    // Each node is connected to its anchor, which is connected to all the
+    // paths on it, so if those paths are on different components so are the
+    // nodes.
+    size_t path_1 = paths_of_node(rank_to_id(anchor_1)).front();
+    size_t path_2 = paths_of_node(rank_to_id(anchor_2)).front();
+    return !paths_on_same_component(path_1, path_2);
+}
+
 void XG::create_succinct_component_path_sets(int_vector<>& path_ranks_iv_out, bit_vector& path_ranks_bv_out) const {
 #ifdef debug_component_index
     cerr << "creating serializable component path sets for " << paths.size() << " paths and " << component_path_sets.size() << " components" << endl;
@@ -1432,6 +2015,30 @@ const size_t XG::sequence_bit_size(void) const {
     return s_iv.bit_size();
 }
 
+const array<size_t, 5>& XG::base_counts(void) const {
+    return s_counts;
+}
+
+double XG::gc_content(void) const {
+    size_t acgt = s_counts[0] + s_counts[1] + s_counts[2] + s_counts[3];
+    return acgt ? (double) (s_counts[1] + s_counts[2]) / acgt : 0;
+}
+
+double XG::sequence_entropy(void) const {
+    size_t total = 0;
+    for (auto count : s_counts) {
+        total += count;
+    }
+    double ent = 0;
+    for (auto count : s_counts) {
+        if (count) {
+            double freq = (double) count / total;
+            ent -= freq * log2(freq);
+        }
+    }
+    return ent;
+}
+
 bool XG::has_node(int64_t id) const {
     return id_to_rank(id) != 0;
 }
@@ -1450,9 +2057,7 @@ string XG::node_sequence(int64_t id) const {
     size_t start = s_bv_select(rank);
     size_t end = rank == node_count ? s_bv.size() : s_bv_select(rank+1);
     string s; s.resize(end-start);
-    for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-        s[i-start] = revdna3bit(s_iv[i]);
-    }
+    extract_sequence(start, end-start, &s[0]);
     return s;
 }
 
@@ -1469,14 +2074,12 @@ char XG::pos_char(int64_t id, bool is_rev, size_t off) const {
         size_t rank = id_to_rank(id);
         size_t pos = s_bv_select(rank) + off;
         assert(pos < s_iv.size());
-        char c = revdna3bit(s_iv[pos]);
-        return c;
+        return sequence_char(pos);
     } else {
         size_t rank = id_to_rank(id);
         size_t pos = s_bv_select(rank+1) - (off+1);
         assert(pos < s_iv.size());
-        char c = revdna3bit(s_iv[pos]);
-        return reverse_complement(c);
+        return reverse_complement(sequence_char(pos));
     }
 }
 
@@ -1494,9 +2097,7 @@ string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
         }
         assert(end < s_iv.size());
         string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
-        }
+        extract_sequence(start, end-start, &s[0]);
         return s;
     } else {
         size_t rank = id_to_rank(id);
@@ -1511,10 +2112,89 @@ string XG::pos_substr(int64_t id, bool is_rev, size_t off, size_t len) const {
         }
         assert(end < s_iv.size());
         string s; s.resize(end-start);
-        for (size_t i = start; i < s_bv.size() && i < end; ++i) {
-            s[i-start] = revdna3bit(s_iv[i]);
+        extract_reverse_complement(start, end-start, &s[0]);
+        return s;
+    }
+}
+
+void XG::get_sequences(const vector<int64_t>& ids, string& sequences_out,
+                       vector<size_t>& sequence_starts_out) const {
+    sequences_out.clear();
+    sequence_starts_out.clear();
+    sequence_starts_out.reserve(ids.size() + 1);
+    
+    // Size the output first so we only allocate once
+    vector<size_t> g_starts;
+    g_starts.reserve(ids.size());
+    size_t total_length = 0;
+    for (auto& id : ids) {
+        size_t g = g_bv_select(id_to_rank(id));
+        g_starts.push_back(g);
+        total_length += g_iv[g + G_NODE_LENGTH_OFFSET];
+    }
+    sequences_out.resize(total_length);
+    
+    size_t written = 0;
+    for (auto& g : g_starts) {
+        sequence_starts_out.push_back(written);
+        size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
+        size_t sequence_length = g_iv[g + G_NODE_LENGTH_OFFSET];
+        // Blit the sequence out
+        extract_sequence(sequence_start, sequence_length, &sequences_out[written]);
+        written += sequence_length;
+    }
+    sequence_starts_out.push_back(written);
+}
+
+void XG::get_adjacencies(const vector<int64_t>& ids,
+                         vector<handle_t>& left_out, vector<size_t>& left_starts_out,
+                         vector<handle_t>& right_out, vector<size_t>& right_starts_out) const {
+    left_out.clear();
+    left_starts_out.clear();
+    right_out.clear();
+    right_starts_out.clear();
+    left_starts_out.reserve(ids.size() + 1);
+    right_starts_out.reserve(ids.size() + 1);
+    
+    for (auto& id : ids) {
+        size_t g = g_bv_select(id_to_rank(id));
+        left_starts_out.push_back(left_out.size());
+        right_starts_out.push_back(right_out.size());
+        
+        size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+        size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+        size_t to_start = g + G_NODE_HEADER_LENGTH;
+        size_t from_start = to_start + G_EDGE_LENGTH * edges_to_count;
+        
+        // Walk the node's edge records directly, sorting each edge onto the
+        // side of the forward strand it attaches to.
+        for (size_t i = 0; i < edges_to_count + edges_from_count; i++) {
+            bool is_to = i < edges_to_count;
+            size_t record = is_to ? to_start + i * G_EDGE_LENGTH : from_start + (i - edges_to_count) * G_EDGE_LENGTH;
+            int type = g_iv[record + G_EDGE_TYPE_OFFSET];
+            int64_t offset = g_iv[record + G_EDGE_OFFSET_OFFSET];
+            bool new_reverse = (type == 2 || type == 3);
+            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
+            if (edge_filter(type, is_to, true, false)) {
+                left_out.push_back(next_handle);
+            }
+            if (edge_filter(type, is_to, false, false)) {
+                right_out.push_back(next_handle);
+            }
         }
-        return reverse_complement(s);
+    }
+    left_starts_out.push_back(left_out.size());
+    right_starts_out.push_back(right_out.size());
+}
+
+void XG::add_nodes_to_graph(const vector<int64_t>& ids, Graph& g) const {
+    string sequences;
+    vector<size_t> sequence_starts;
+    get_sequences(ids, sequences, sequence_starts);
+    for (size_t i = 0; i < ids.size(); i++) {
+        Node* node = g.add_node();
+        node->set_id(ids[i]);
+        node->set_sequence(sequences.substr(sequence_starts[i], sequence_starts[i + 1] - sequence_starts[i]));
     }
 }
 
@@ -1609,10 +2289,7 @@ Graph XG::node_subgraph_g(int64_t g) const {
     int sequence_size = g_iv[g+G_NODE_LENGTH_OFFSET];
     size_t seq_start = g_iv[g+G_NODE_SEQ_START_OFFSET];
     string sequence; sequence.resize(sequence_size);
-    int i = 0;
-    for (int64_t j = seq_start; j < seq_start+sequence_size; ++j, ++i) {
-        sequence[i] = revdna3bit(s_iv[j]);
-    }
+    extract_sequence(seq_start, sequence_size, &sequence[0]);
     Node* node = graph.add_node();
     node->set_sequence(sequence);
     node->set_id(g);
@@ -1698,6 +2375,103 @@ Graph XG::graph_context_g(const pos_t& g_pos, int64_t length) const {
     return graph;
 }
 
+Graph XG::graph_context_id(const pos_t& pos, int64_t forward_length, int64_t backward_length) const {
+    int64_t g = g_bv_select(id_to_rank(id(pos)));
+    pos_t g_pos = make_pos_t(g, is_rev(pos), offset(pos));
+    unordered_set<int64_t> nodes_g;
+    graph_context_nodes_g(g_pos, forward_length, nodes_g);
+    graph_context_nodes_g(reverse(g_pos, g_iv[g + G_NODE_LENGTH_OFFSET]), backward_length, nodes_g);
+    
+    // put the nodes in ID order
+    vector<pair<int64_t, int64_t>> ids_and_g;
+    ids_and_g.reserve(nodes_g.size());
+    for (int64_t node_g : nodes_g) {
+        ids_and_g.emplace_back(g_iv[node_g + G_NODE_ID_OFFSET], node_g);
+    }
+    sort(ids_and_g.begin(), ids_and_g.end());
+    
+    Graph graph;
+    graph.mutable_node()->Reserve(ids_and_g.size());
+    for (auto& id_and_g : ids_and_g) {
+        int64_t node_g = id_and_g.second;
+        Node* node = graph.add_node();
+        node->set_id(id_and_g.first);
+        string* sequence = node->mutable_sequence();
+        sequence->resize(g_iv[node_g + G_NODE_LENGTH_OFFSET]);
+        extract_sequence(g_iv[node_g + G_NODE_SEQ_START_OFFSET], sequence->size(), &(*sequence)[0]);
+        
+        // every edge is in the from list of exactly one node, so taking the edges from there finds
+        // each edge between the nodes once
+        int64_t edges_to_count = g_iv[node_g + G_NODE_TO_COUNT_OFFSET];
+        int64_t edges_from_count = g_iv[node_g + G_NODE_FROM_COUNT_OFFSET];
+        int64_t f = node_g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+        for (int64_t j = f; j < f + G_EDGE_LENGTH * edges_from_count; j += G_EDGE_LENGTH) {
+            int64_t to_g = node_g + g_iv[j + G_EDGE_OFFSET_OFFSET];
+            if (nodes_g.count(to_g)) {
+                Edge* edge = graph.add_edge();
+                *edge = edge_from_encoding(id_and_g.first, g_iv[to_g + G_NODE_ID_OFFSET], g_iv[j + G_EDGE_TYPE_OFFSET]);
+            }
+        }
+    }
+    sort_edges_by_id(graph);
+    
+    return graph;
+}
+
+void XG::graph_context_nodes_g(const pos_t& g_pos, int64_t length, unordered_set<int64_t>& nodes_g) const {
+    // the same walk as graph_context_g, but read straight out of the graph vector
+    set<pos_t> seen;
+    set<pos_t> nexts;
+    nexts.insert(g_pos);
+    int64_t distance = -offset(g_pos); // don't count what we won't traverse
+    while (!nexts.empty()) {
+        set<pos_t> todo;
+        int nextd = 0;
+        for (auto& next : nexts) {
+            if (seen.count(next)) {
+                continue;
+            }
+            seen.insert(next);
+            int64_t g = id(next);
+            nodes_g.insert(g);
+            int node_length = g_iv[g + G_NODE_LENGTH_OFFSET];
+            nextd = nextd == 0 ? node_length : min(nextd, node_length);
+            
+            int64_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+            int64_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+            int64_t t = g + G_NODE_HEADER_LENGTH;
+            int64_t f = t + G_EDGE_LENGTH * edges_to_count;
+            for (int64_t j = t; j < f + G_EDGE_LENGTH * edges_from_count; j += G_EDGE_LENGTH) {
+                // decode the edge as node_subgraph_g would have it
+                bool is_to_edge = j < f;
+                int64_t other = g + g_iv[j + G_EDGE_OFFSET_OFFSET];
+                int64_t from = is_to_edge ? other : g;
+                int64_t to = is_to_edge ? g : other;
+                int type = g_iv[j + G_EDGE_TYPE_OFFSET];
+                bool from_start = type == 3 || type == 4;
+                bool to_end = type == 2 || type == 4;
+                bool inverting = from_start != to_end;
+                if (!is_rev(next)) {
+                    // we are on the forward strand, the next things from this node come off the end
+                    if ((to == g && to_end) || (from == g && !from_start)) {
+                        todo.insert(make_pos_t(from == g ? to : from, inverting, 0));
+                    }
+                } else {
+                    // we are on the reverse strand, the next things from this node come off the start
+                    if ((to == g && !to_end) || (from == g && from_start)) {
+                        todo.insert(make_pos_t(to == g ? from : to, !inverting, 0));
+                    }
+                }
+            }
+        }
+        distance += nextd;
+        if (distance > length) {
+            break;
+        }
+        nexts = todo;
+    }
+}
+
 handle_t XG::get_handle(const id_t& node_id, bool is_reverse) const {
     // Handles will be g vector index with is_reverse in the high bit
     
@@ -1731,113 +2505,241 @@ string XG::get_sequence(const handle_t& handle) const {
     size_t sequence_size = get_length(handle);
     // Allocate the sequence string
     string sequence(sequence_size, '\0');
+    copy_sequence(handle, &sequence[0]);
+    return sequence;
+}
+
+void XG::copy_sequence(const handle_t& handle, char* buffer) const {
     // Extract the node record start
     size_t g = as_integer(handle) & LOW_BITS;
     // Figure out where the sequence starts
     size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
-    for (int64_t i = 0; i < sequence_size; i++) {
-        // Blit the sequence out
-        sequence[i] = revdna3bit(s_iv[sequence_start + i]);
+    size_t sequence_size = g_iv[g + G_NODE_LENGTH_OFFSET];
+    if (as_integer(handle) & HIGH_BIT) {
+        extract_reverse_complement(sequence_start, sequence_size, buffer);
+    } else {
+        extract_sequence(sequence_start, sequence_size, buffer);
+    }
+}
+
+char XG::get_base(const handle_t& handle, size_t index) const {
+    size_t g = as_integer(handle) & LOW_BITS;
+    size_t sequence_start = g_iv[g + G_NODE_SEQ_START_OFFSET];
+    if (as_integer(handle) & HIGH_BIT) {
+        size_t sequence_size = g_iv[g + G_NODE_LENGTH_OFFSET];
+        return reverse_complement(sequence_char(sequence_start + sequence_size - 1 - index));
+    } else {
+        return sequence_char(sequence_start + index);
+    }
+}
+
+void XG::index_sequence_exceptions(const bit_vector& exceptions_bv, const string& exception_chars) {
+    util::assign(sx_bv, sd_vector<>(exceptions_bv));
+    util::assign(sx_bv_rank, sd_vector<>::rank_1_type(&sx_bv));
+    util::assign(sx_bv_select, sd_vector<>::select_1_type(&sx_bv));
+    util::assign(sx_iv, int_vector<8>(exception_chars.size()));
+    for (size_t i = 0; i < exception_chars.size(); ++i) {
+        sx_iv[i] = (unsigned char) exception_chars[i];
+    }
+}
+
+void XG::count_bases(void) {
+    // Count the 2-bit codes 32 at a time in the full words, by finding the
+    // slots where the word matches the code repeated in every slot
+    const uint64_t* words = s_iv.data();
+    size_t full_words = s_iv.size() / 32;
+    const uint64_t low_bits = 0x5555555555555555ull;
+    size_t a = 0, t = 0, c = 0;
+#pragma omp parallel for schedule(static) reduction(+:a,t,c)
+    for (size_t i = 0; i < full_words; ++i) {
+        uint64_t word = words[i];
+        uint64_t not_a = word;
+        uint64_t not_t = word ^ low_bits;
+        uint64_t not_c = word ^ (low_bits << 1);
+        a += sdsl::bits::cnt(~(not_a | (not_a >> 1)) & low_bits);
+        t += sdsl::bits::cnt(~(not_t | (not_t >> 1)) & low_bits);
+        c += sdsl::bits::cnt(~(not_c | (not_c >> 1)) & low_bits);
+    }
+    size_t counts[4] = {a, t, c, full_words * 32 - a - t - c};
+    for (size_t i = full_words * 32; i < s_iv.size(); ++i) {
+        ++counts[s_iv[i]];
+    }
+    
+    // Exceptions hold an A in s_iv
+    size_t exceptions = sx_iv.size();
+    s_counts = {{counts[0] - exceptions, counts[2], counts[3], counts[1], exceptions}};
+}
+
+void XG::extract_sequence(size_t start, size_t len, char* out) const {
+    const uint64_t* words = s_iv.data();
+    size_t end = start + len;
+    size_t p = start;
+    size_t i = 0;
+    // decode single bases up to a byte boundary, then whole bytes of 4 bases
+    for (; p < end && p % 4; ++p) {
+        out[i++] = revdna3bit(s_iv[p]);
+    }
+    for (; p + 4 <= end; p += 4, i += 4) {
+        memcpy(out + i, packed_bases.forward[(words[p / 32] >> (p % 32 * 2)) & 0xFF], 4);
+    }
+    for (; p < end; ++p) {
+        out[i++] = revdna3bit(s_iv[p]);
+    }
+    // then patch in the exceptions
+    if (sx_iv.size()) {
+        for (size_t k = sx_bv_rank(start); k < sx_iv.size(); ++k) {
+            size_t pos = sx_bv_select(k + 1);
+            if (pos >= end) break;
+            out[pos - start] = sx_iv[k];
+        }
+    }
+}
+
+void XG::extract_reverse_complement(size_t start, size_t len, char* out) const {
+    const uint64_t* words = s_iv.data();
+    size_t end = start + len;
+    size_t p = end;
+    size_t i = 0;
+    // as for the forward strand, but walking back from the end
+    for (; p > start && p % 4; --p) {
+        out[i++] = revdna3bit(s_iv[p - 1] ^ 1);
     }
-    
-    if (as_integer(handle) & HIGH_BIT) {
-        return reverse_complement(sequence);
-    } else {
-        return sequence;
+    for (; p >= start + 4; p -= 4, i += 4) {
+        memcpy(out + i, packed_bases.reverse_complement[(words[(p - 4) / 32] >> ((p - 4) % 32 * 2)) & 0xFF], 4);
+    }
+    for (; p > start; --p) {
+        out[i++] = revdna3bit(s_iv[p - 1] ^ 1);
+    }
+    if (sx_iv.size()) {
+        for (size_t k = sx_bv_rank(start); k < sx_iv.size(); ++k) {
+            size_t pos = sx_bv_select(k + 1);
+            if (pos >= end) break;
+            out[end - 1 - pos] = reverse_complement((char) sx_iv[k]);
+        }
     }
 }
 
-bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
-    // Return true if we want an edge of the given type, where we are the from
-    // or to node (according to is_to), when we are looking off the right or
-    // left side of the node (according to want_left), and when the node is
-    // forward or reverse (accoridng to is_reverse).
-    
-    // Edge type encoding:
-    // 1: end to start
-    // 2: end to end
-    // 3: start to start
-    // 4: start to end
-    
-    // First compute what we want looking off the right of a node in the forward direction.
-    bool wanted = !is_to && (type == 1 || type == 2) || is_to && (type == 2 || type == 4);
+bool XG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
+    return follow_edges_inline(handle, go_left, iteratee);
+}
+
+XG::EdgeCache::~EdgeCache() {
+    free(lines);
+}
+
+void XG::enable_edge_cache(size_t max_nodes) {
+    edge_caches.clear();
+    edge_cache_nodes = 0;
+    edge_cache_first = 0;
+    if (max_nodes == 0 || node_count == 0) {
+        return;
+    }
+    max_nodes = min<size_t>(max_nodes, node_count);
     
-    // We computed whether we wanted it assuming we were looking off the right. The complement is what we want looking off the left.
-    wanted = wanted != want_left;
+    // Count up the edges on each node, in rank order
+    vector<size_t> degree;
+    degree.reserve(node_count);
+    for (size_t g = 0; g < g_iv.size(); ) {
+        size_t edge_count = g_iv[g + G_NODE_TO_COUNT_OFFSET] + g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+        degree.push_back(edge_count);
+        g += G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edge_count;
+    }
     
-    // We computed whether we wanted ot assuming we were in the forward orientation. The complement is what we want in the reverse orientation.
-    wanted = wanted != is_reverse;
+    // Slide a window along to find the run with the most edges
+    size_t window_edges = 0;
+    for (size_t i = 0; i < max_nodes; i++) {
+        window_edges += degree[i];
+    }
+    size_t best_edges = window_edges;
+    for (size_t i = max_nodes; i < degree.size(); i++) {
+        window_edges = window_edges + degree[i] - degree[i - max_nodes];
+        if (window_edges > best_edges) {
+            best_edges = window_edges;
+            edge_cache_first = i + 1 - max_nodes;
+        }
+    }
     
-    return wanted;
+    edge_cache_nodes = max_nodes;
+    // Threads make their own caches when they first need them
+    edge_caches.resize(omp_get_max_threads());
 }
 
-bool XG::do_edges(const size_t& g, const size_t& start, const size_t& count, bool is_to,
-    bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const {
-    
-    // OK go over all those edges
-    for (size_t i = 0; i < count; i++) {
-        // What edge type is the edge?
-        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
-        
-        // Make sure we got a valid edge type and we haven't wandered off into non-edge data.
-        assert(type >= 0);
-        assert(type <= 3);
-        
-        if (edge_filter(type, is_to, want_left, is_reverse)) {
-            
-            // What's the offset to the other node?
-            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
-            
-            // Make sure we haven't gone off the rails into non-edge data.
-            assert((int64_t) g + offset >= 0);
-            assert(g + offset < g_iv.size());
-            
-            // Should we invert?
-            // We only invert if we cross an end to end edge. Or a start to start edge
-            bool new_reverse = is_reverse != (type == 2 || type == 3);
-            
-            // Compose the handle for where we are going
-            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
-            
-            // We want this edge
-            
-            if (!iteratee(next_handle)) {
-                // Stop iterating
-                return false;
-            }
-        }
-        else {
-            // TODO: delete this after using it to debug
-            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
-            bool new_reverse = is_reverse != (type == 2 || type == 3);
-            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
+size_t XG::edge_cache_hits() const {
+    size_t total = 0;
+    for (auto& cache : edge_caches) {
+        if (cache) {
+            total += cache->hits;
         }
     }
-    // Iteratee didn't stop us.
-    return true;
+    return total;
 }
 
-bool XG::follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const {
-
-    // Unpack the handle
-    size_t g = as_integer(handle) & LOW_BITS;
-    bool is_reverse = get_is_reverse(handle);
+size_t XG::edge_cache_misses() const {
+    size_t total = 0;
+    for (auto& cache : edge_caches) {
+        if (cache) {
+            total += cache->misses;
+        }
+    }
+    return total;
+}
 
-    // How many edges are there of each type?
-    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
-    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+const XG::EdgeCacheLine* XG::cached_edges(size_t g) const {
+    size_t thread_num = omp_get_thread_num();
+    if (thread_num >= edge_caches.size()) {
+        // Nested parallelism can give us more threads than we planned for
+        return nullptr;
+    }
+    auto& cache = edge_caches[thread_num];
+    if (!cache) {
+        // Only this thread touches its slot, so no locking is needed
+        cache.reset(new EdgeCache());
+        void* memory = nullptr;
+        if (posix_memalign(&memory, sizeof(EdgeCacheLine), sizeof(EdgeCacheLine) * edge_cache_nodes) != 0) {
+            throw bad_alloc();
+        }
+        memset(memory, 0, sizeof(EdgeCacheLine) * edge_cache_nodes);
+        cache->lines = (EdgeCacheLine*) memory;
+    }
     
-    // Where does each edge run start?
-    size_t to_start = g + G_NODE_HEADER_LENGTH;
-    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+    size_t rank = g_bv_rank(g);
+    if (rank < edge_cache_first || rank >= edge_cache_first + edge_cache_nodes) {
+        // Not in the cached region
+        cache->misses++;
+        return nullptr;
+    }
     
-    // We will look for all the edges on the appropriate side, which means we have to check the from and to edges
-    if (do_edges(g, to_start, edges_to_count, true, go_left, is_reverse, iteratee)) {
-        // All the edges where we're to were accepted, so do the edges where we're from
-        return do_edges(g, from_start, edges_from_count, false, go_left, is_reverse, iteratee);
-    } else {
-        return false;
+    EdgeCacheLine& line = cache->lines[rank - edge_cache_first];
+    if (line.filled) {
+        if (line.overflow) {
+            cache->misses++;
+            return nullptr;
+        }
+        cache->hits++;
+        return &line;
+    }
+    
+    // Decode the node's edges into the line
+    cache->misses++;
+    line.filled = true;
+    size_t count = 0;
+    size_t capacity = sizeof(line.neighbors) / sizeof(handle_t);
+    auto record = [&](const handle_t& next) {
+        if (count == capacity) {
+            line.overflow = true;
+            return false;
+        }
+        line.neighbors[count++] = next;
+        return true;
+    };
+    handle_t handle = as_handle(g);
+    if (decode_edges(handle, true, record)) {
+        line.left_count = count;
+        decode_edges(handle, false, record);
+        line.right_count = count - line.left_count;
     }
+    
+    return line.overflow ? nullptr : &line;
 }
 
 void XG::for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel) const {
@@ -1975,6 +2877,13 @@ size_t XG::node_start(int64_t id) const {
     return s_bv_select(id_to_rank(id));
 }
 
+char XG::sequence_char(size_t seq_offset) const {
+    if (sx_iv.size() && sx_bv[seq_offset]) {
+        return sx_iv[sx_bv_rank(seq_offset)];
+    }
+    return revdna3bit(s_iv[seq_offset]);
+}
+
 size_t XG::max_path_rank(void) const {
     //cerr << pn_bv << endl;
     //cerr << "..." << pn_bv_rank(pn_bv.size()) << endl;
@@ -2511,7 +3420,7 @@ pair<pos_t, int64_t> XG::next_path_position(pos_t pos, int64_t max_search) const
     pair<pos_t, int64_t> rev_next = make_pair(make_pos_t(0,false,0), numeric_limits<int64_t>::max());
     follow_edges(h_fwd, false, [&](const handle_t& n) {
             id_t id = get_id(n);
-            if (!paths_of_node(id).empty()) {
+            if (node_on_any_path(id)) {
                 fwd_next = make_pair(make_pos_t(id, get_is_reverse(n), 0), fwd_seen);
                 return false;
             } else {
@@ -2521,7 +3430,7 @@ pair<pos_t, int64_t> XG::next_path_position(pos_t pos, int64_t max_search) const
         });
     follow_edges(h_rev, false, [&](const handle_t& n) {
             id_t id = get_id(n);
-            if (!paths_of_node(id).empty()) {
+            if (node_on_any_path(id)) {
                 rev_next = make_pair(make_pos_t(id, !get_is_reverse(n), 0), rev_seen);
                 return false;
             } else {
@@ -2538,6 +3447,15 @@ pair<pos_t, int64_t> XG::next_path_position(pos_t pos, int64_t max_search) const
 }
 
 pair<int64_t, vector<size_t> > XG::nearest_path_node(int64_t id, int max_steps) const {
+    if (max_steps == PATH_ANCHOR_STEPS && pa_iv.size() == node_count && id_to_rank(id) != 0) {
+        // We looked this up already
+        size_t anchor_rank = pa_iv[id_to_rank(id) - 1];
+        if (anchor_rank == 0) {
+            return make_pair(id, vector<size_t>());
+        }
+        int64_t anchor_id = rank_to_id(anchor_rank);
+        return make_pair(anchor_id, paths_of_node(anchor_id));
+    }
     set<int64_t> todo;
     set<int64_t> seen;
     todo.insert(id);
@@ -2589,20 +3507,78 @@ int64_t XG::min_approx_path_distance(int64_t id1, int64_t id2) const {
     return min_distance;
 }
     
+void XG::enable_path_memo(size_t max_entries) {
+    path_memo_shards.clear();
+    path_memo_shard_entries = 0;
+    if (max_entries == 0) {
+        return;
+    }
+    path_memo_shard_entries = max<size_t>(1, max_entries / PATH_MEMO_SHARDS);
+    for (size_t i = 0; i < PATH_MEMO_SHARDS; i++) {
+        path_memo_shards.emplace_back(new PathMemoShard());
+    }
+}
+
+size_t XG::path_memo_evictions() const {
+    size_t total = 0;
+    for (auto& shard : path_memo_shards) {
+        lock_guard<mutex> guard(shard->lock);
+        total += shard->epoch;
+    }
+    return total;
+}
+
+XG::PathMemoShard& XG::path_memo_shard(int64_t id) const {
+    // Mix the ID so runs of consecutive nodes spread over the shards
+    uint64_t mixed = (uint64_t) id * 0x9E3779B97F4A7C15ull;
+    return *path_memo_shards[(mixed >> 32) % PATH_MEMO_SHARDS];
+}
+
+void XG::make_path_memo_room(PathMemoShard& shard) const {
+    if (shard.paths_of_node.size() + shard.oriented_occurrences.size() >= path_memo_shard_entries) {
+        // Start a new epoch instead of tracking recency for every entry
+        shard.paths_of_node.clear();
+        shard.oriented_occurrences.clear();
+        shard.epoch++;
+    }
+}
+
 vector<size_t> XG::memoized_paths_of_node(int64_t id, unordered_map<int64_t, vector<size_t>>* paths_of_node_memo) const {
     if (paths_of_node_memo) {
         auto iter = paths_of_node_memo->find(id);
         if (iter != paths_of_node_memo->end()) {
             return iter->second;
         }
-        else {
-            (*paths_of_node_memo)[id] = paths_of_node(id);
-            return paths_of_node_memo->at(id);
+    }
+    
+    vector<size_t> paths;
+    if (path_memo_shard_entries != 0) {
+        PathMemoShard& shard = path_memo_shard(id);
+        bool found = false;
+        {
+            lock_guard<mutex> guard(shard.lock);
+            auto iter = shard.paths_of_node.find(id);
+            if (iter != shard.paths_of_node.end()) {
+                paths = iter->second;
+                found = true;
+            }
+        }
+        if (!found) {
+            // Decode outside the lock so other threads can use the shard
+            paths = paths_of_node(id);
+            lock_guard<mutex> guard(shard.lock);
+            make_path_memo_room(shard);
+            shard.paths_of_node[id] = paths;
         }
     }
     else {
-        return paths_of_node(id);
+        paths = paths_of_node(id);
+    }
+    
+    if (paths_of_node_memo) {
+        (*paths_of_node_memo)[id] = paths;
     }
+    return paths;
 }
 
 vector<pair<size_t, bool>> XG::memoized_oriented_occurrences_on_path(int64_t id, size_t path,
@@ -2612,14 +3588,35 @@ vector<pair<size_t, bool>> XG::memoized_oriented_occurrences_on_path(int64_t id,
         if (iter != oriented_occurrences_memo->end()) {
             return iter->second;
         }
-        else {
-            (*oriented_occurrences_memo)[make_pair(id, path)] = oriented_occurrences_on_path(id, path);
-            return oriented_occurrences_memo->at(make_pair(id, path));
+    }
+    
+    vector<pair<size_t, bool>> occurrences;
+    if (path_memo_shard_entries != 0) {
+        PathMemoShard& shard = path_memo_shard(id);
+        bool found = false;
+        {
+            lock_guard<mutex> guard(shard.lock);
+            auto iter = shard.oriented_occurrences.find(make_pair(id, path));
+            if (iter != shard.oriented_occurrences.end()) {
+                occurrences = iter->second;
+                found = true;
+            }
+        }
+        if (!found) {
+            occurrences = oriented_occurrences_on_path(id, path);
+            lock_guard<mutex> guard(shard.lock);
+            make_path_memo_room(shard);
+            shard.oriented_occurrences[make_pair(id, path)] = occurrences;
         }
     }
     else {
-        return oriented_occurrences_on_path(id, path);
+        occurrences = oriented_occurrences_on_path(id, path);
+    }
+    
+    if (oriented_occurrences_memo) {
+        (*oriented_occurrences_memo)[make_pair(id, path)] = occurrences;
     }
+    return occurrences;
 }
     
     
@@ -2628,7 +3625,7 @@ vector<pair<size_t, vector<pair<size_t, bool>>>> XG::memoized_oriented_paths_of_
                                                                                      unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo) const {
     vector<pair<size_t, vector<pair<size_t, bool>>>> oriented_path_occurrences;
     for (size_t path : memoized_paths_of_node(id, paths_of_node_memo)) {
-        oriented_path_occurrences.emplace_back(path, memoized_oriented_occurrences_on_path(id, path));
+        oriented_path_occurrences.emplace_back(path, memoized_oriented_occurrences_on_path(id, path, oriented_occurrences_memo));
     }
     return oriented_path_occurrences;
 }
@@ -2657,6 +3654,11 @@ int64_t XG::closest_shared_path_unstranded_distance(int64_t id1, size_t offset1,
                                                     unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
                                                     unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
     
+    // positions on different components are never anywhere near each other
+    if (path_anchors_rule_out(id1, id2)) {
+        return numeric_limits<int64_t>::max();
+    }
+    
     unordered_map<size_t, tuple<int64_t, bool, int64_t>> path_dists_1, path_dists_2;
     unordered_set<size_t> shared_paths;
     
@@ -2865,6 +3867,11 @@ int64_t XG::closest_shared_path_oriented_distance(int64_t id1, size_t offset1, b
                                                   unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>>* oriented_occurrences_memo,
                                                   unordered_map<pair<int64_t, bool>, handle_t>* handle_memo) const {
     
+    // positions on different components are never anywhere near each other
+    if (path_anchors_rule_out(id1, id2)) {
+        return numeric_limits<int64_t>::max();
+    }
+    
 #ifdef debug_algorithms
     cerr << "[XG] estimating oriented distance between " << id1 << "[" << offset1 << "]" << (rev1 ? "-" : "+") << " and " << id2 << "[" << offset2 << "]" << (rev2 ? "-" : "+") << " with max search distance of " << max_search_dist << endl;
 #endif
@@ -3559,66 +4566,86 @@ vector<size_t> XG::position_in_path(int64_t id, size_t rank) const {
     return pos_in_path;
 }
 
-map<string, vector<size_t> > XG::position_in_paths(int64_t id, bool is_rev, size_t offset) const {
-    map<string, vector<size_t> > positions;
-    for (auto& prank : paths_of_node(id)) {
+bool XG::node_on_any_path(int64_t id) const {
+    size_t off = np_bv_select(id_to_rank(id)) + 1;
+    return off < np_bv.size() && np_bv[off] == 0;
+}
+
+void XG::for_each_path_occurrence(int64_t id, const function<void(size_t, size_t, bool)>& lambda) const {
+    size_t off = np_bv_select(id_to_rank(id));
+    assert(np_bv[off++]);
+    while (off < np_bv.size() ? np_bv[off] == 0 : false) {
+        size_t prank = np_iv[off++];
         auto& path = *paths[prank-1];
-        auto& pos_in_path = positions[path_name(prank)];
-        for (auto i : node_ranks_in_path(id, prank)) {
-            size_t pos = offset + (is_rev ?
-                                   path_length(prank) - path.positions[i] - node_length(id)
-                                   : path.positions[i]);
-            pos_in_path.push_back(pos);
+        size_t occs = path.ids.rank(path.ids.size(), id);
+        for (size_t j = 1; j <= occs; ++j) {
+            size_t i = path.ids.select(j, id);
+            lambda(prank, path.positions[i], path.directions[i]);
         }
     }
-    return positions;
 }
 
-map<string, vector<pair<size_t, bool> > > XG::offsets_in_paths(pos_t pos) const {
-    map<string, vector<pair<size_t, bool> > > positions;
-    id_t node_id = id(pos);
-    for (auto& prank : paths_of_node(node_id)) {
-        auto& path = *paths[prank-1];
-        auto& pos_in_path = positions[path_name(prank)];
-        for (auto i : node_ranks_in_path(node_id, prank)) {
+void XG::for_each_position_in_paths(int64_t id, bool is_rev, size_t offset,
+                                    const function<void(size_t, size_t)>& lambda) const {
+    size_t len = is_rev ? node_length(id) : 0;
+    for_each_path_occurrence(id, [&](size_t prank, size_t path_pos, bool path_rev) {
+            lambda(prank, offset + (is_rev ? path_length(prank) - path_pos - len : path_pos));
+        });
+}
+
+void XG::for_each_offset_in_paths(pos_t pos, const function<void(size_t, size_t, bool)>& lambda) const {
+    for_each_path_occurrence(id(pos), [&](size_t prank, size_t path_pos, bool path_rev) {
             // relative direction to this traversal
-            bool dir = path.directions[i] != is_rev(pos);
-            size_t off = path.positions[i] + offset(pos);
-            
-            pos_in_path.push_back(make_pair(off, dir));
-        }
-    }
-    return positions;
+            lambda(prank, path_pos + offset(pos), path_rev != is_rev(pos));
+        });
 }
 
-map<string, vector<pair<size_t, bool> > > XG::nearest_offsets_in_paths(pos_t pos, int64_t max_search) const {
+void XG::for_each_nearest_offset_in_paths(pos_t pos, int64_t max_search,
+                                          const function<void(size_t, size_t, bool)>& lambda) const {
     pair<pos_t, int64_t> pz = next_path_position(pos, max_search);
     auto& path_pos = pz.first;
     auto& diff = pz.second;
     if (id(path_pos)) {
         // TODO apply approximate offset, second in pair returned by next_path_position
-        auto offsets = offsets_in_paths(path_pos);
-        for (auto& o : offsets) {
-            for (auto& p : o.second) {
-                p.first += diff;
-            }
-        }
-        return offsets;
-    } else {
-        map<string, vector<pair<size_t, bool> > > empty;
-        return empty;
+        for_each_offset_in_paths(path_pos, [&](size_t prank, size_t off, bool dir) {
+                lambda(prank, off + diff, dir);
+            });
     }
 }
 
+map<string, vector<size_t> > XG::position_in_paths(int64_t id, bool is_rev, size_t offset) const {
+    map<string, vector<size_t> > positions;
+    for_each_position_in_paths(id, is_rev, offset, [&](size_t prank, size_t pos) {
+            positions[path_name(prank)].push_back(pos);
+        });
+    return positions;
+}
+
+map<string, vector<pair<size_t, bool> > > XG::offsets_in_paths(pos_t pos) const {
+    map<string, vector<pair<size_t, bool> > > positions;
+    for_each_offset_in_paths(pos, [&](size_t prank, size_t off, bool dir) {
+            positions[path_name(prank)].push_back(make_pair(off, dir));
+        });
+    return positions;
+}
+
+map<string, vector<pair<size_t, bool> > > XG::nearest_offsets_in_paths(pos_t pos, int64_t max_search) const {
+    map<string, vector<pair<size_t, bool> > > positions;
+    for_each_nearest_offset_in_paths(pos, max_search, [&](size_t prank, size_t off, bool dir) {
+            positions[path_name(prank)].push_back(make_pair(off, dir));
+        });
+    return positions;
+}
+
 map<string, vector<size_t> > XG::distance_in_paths(int64_t id1, bool is_rev1, size_t offset1,
                                                    int64_t id2, bool is_rev2, size_t offset2) const {
-    auto pos1 = position_in_paths(id1, is_rev1, offset1);
-    auto pos2 = position_in_paths(id2, is_rev2, offset2);
     map<string, vector<size_t> > dist;
     // position in a path is undefined in inversion
     if (is_rev1 != is_rev2) {
         return dist;
     }
+    auto pos1 = position_in_paths(id1, is_rev1, offset1);
+    auto pos2 = position_in_paths(id2, is_rev2, offset2);
     for (auto& c1 : pos1) {
         auto c2 = pos2.find(c1.first);
         if (c2 != pos2.end()) {
@@ -3636,27 +4663,31 @@ map<string, vector<size_t> > XG::distance_in_paths(int64_t id1, bool is_rev1, si
 
 int64_t XG::min_distance_in_paths(int64_t id1, bool is_rev1, size_t offset1,
                                   int64_t id2, bool is_rev2, size_t offset2) const {
-    auto dist = distance_in_paths(id1, is_rev1, offset1,
-                                  id2, is_rev2, offset2);
     size_t min_dist = std::numeric_limits<size_t>::max();
-    for (auto& c : dist) {
-        for (auto& o : c.second) {
-            if (o <  min_dist) {
-                min_dist = o;
-            }
-        }
-    }
+    // position in a path is undefined in inversion
+    if (is_rev1 != is_rev2) {
+        return min_dist;
+    }
+    // cross the positions of the second node with those of the first on the
+    // same path, without collecting either by name
+    for_each_position_in_paths(id1, is_rev1, offset1, [&](size_t prank1, size_t o1) {
+            for_each_position_in_paths(id2, is_rev2, offset2, [&](size_t prank2, size_t o2) {
+                    if (prank1 == prank2 && o1 - o2 < min_dist) {
+                        min_dist = o1 - o2;
+                    }
+                });
+        });
     return min_dist;
 }
 
 int64_t XG::node_at_path_position(const string& name, size_t pos) const {
     size_t p = path_rank(name)-1;
-    return paths[p]->ids[paths[p]->offsets_rank(pos+1)-1];
+    return paths[p]->node_at_step(paths[p]->step_at_position(pos), pos);
 }
 
 Mapping XG::mapping_at_path_position(const string& name, size_t pos) const {
     size_t p = path_rank(name)-1;
-    return paths[p]->mapping(paths[p]->offsets_rank(pos+1)-1);
+    return paths[p]->mapping_at_position(pos);
 }
 
 size_t XG::node_start_at_path_position(const string& name, size_t pos) const {
@@ -3668,9 +4699,9 @@ size_t XG::node_start_at_path_position(const string& name, size_t pos) const {
 pos_t XG::graph_pos_at_path_position(const string& name, size_t path_pos) const {
     auto& path = get_path(name);
     path_pos = min((size_t)path.offsets.size()-1, path_pos);
-    size_t trav_idx = path.offsets_rank(path_pos+1)-1;
+    size_t trav_idx = path.step_at_position(path_pos);
     int64_t offset = path_pos - path.positions[trav_idx];
-    id_t node_id = path.ids[trav_idx];
+    id_t node_id = path.node_at_step(trav_idx, path_pos);
     bool is_rev = path.directions[trav_idx];
     return make_pos_t(node_id, is_rev, offset);
 }
@@ -3939,15 +4970,19 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
     util::assign(h_iv, int_vector<>(g_iv.size() * 2, 0));
     util::assign(ts_iv, int_vector<>((node_count + 1) * 2, 0));
 
-    set_thread_names(names);
-
     // store the sides in order of their addition to the threads
     int_vector<> sides_ordered_by_thread_id(t.size()*2); // fwd and reverse
 
     // store the start+offset for each thread and its reverse complement
     int_vector<> tin_iv(t.size()*2+2);
     int_vector<> tio_iv(t.size()*2+2);
-    int thread_count = 0;
+    
+    // Forward thread starts are numbered first, then reverse ones, so the
+    // reverse pass needs to know where to begin counting.
+    size_t nonempty_threads = 0;
+    for (auto& thread : t) {
+        nonempty_threads += !thread.empty();
+    }
     
     auto emit_destinations = [&](int64_t node_id, bool is_reverse, vector<size_t> destinations) {
         // We have to take this destination vector and store it in whatever B_s
@@ -3987,7 +5022,7 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
         h_iv[edge_orientation_number]++; 
     };
     
-    auto emit_thread_start = [&](int64_t node_id, bool is_reverse) {
+    auto emit_thread_start = [&](int64_t node_id, bool is_reverse, size_t& thread_count) {
         // Record that an (orientation of) a thread starts at this node in this
         // orientation. We have to update our thread start succinct data
         // structure.
@@ -4011,6 +5046,9 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
     // then again backward through the DAG.
     auto insert_in_direction = [&](bool insert_reverse) {
 
+        // Number the thread starts in this direction
+        size_t thread_count = insert_reverse ? nonempty_threads : 0;
+
         // First sort out the thread numbers by the node they start at.
         // We know all the threads go the same direction through each node.
         map<int64_t, list<size_t>> thread_numbers_by_start_node;
@@ -4029,7 +5067,7 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
                 tio_iv[k] = thread_numbers_by_start_node[mapping.node_id].size()-1;
                 // Say a thread starts here, going in the orientation determined
                 // by how the node is visited and how we're traversing the path.
-                emit_thread_start(mapping.node_id, mapping.is_reverse != insert_reverse);
+                emit_thread_start(mapping.node_id, mapping.is_reverse != insert_reverse, thread_count);
             }
         }
         
@@ -4175,15 +5213,33 @@ void XG::insert_threads_into_dag(const vector<thread_t>& t, const vector<string>
         // in this direction.
     };
     
-    // Actually call the inserts
+    // Actually call the inserts. Since all the threads go the same way
+    // through each node, the forward and reverse passes leave from opposite
+    // sides and take edges in opposite orientations, so they write disjoint
+    // entries and can run alongside each other and the name compression. The
+    // dynamic B_s storage is shared between sides, so it has to go serially.
+    bool parallel_inserts = (GPBWT_MODE == MODE_SDSL);
+#pragma omp parallel sections if(parallel_inserts)
+    {
+#pragma omp section
+        {
+            set_thread_names(names);
+        }
+#pragma omp section
+        {
 #ifdef VERBOSE_DEBUG
-    cerr << "Inserting threads forwards..." << endl;
+            cerr << "Inserting threads forwards..." << endl;
 #endif
-    insert_in_direction(false);
+            insert_in_direction(false);
+        }
+#pragma omp section
+        {
 #ifdef VERBOSE_DEBUG
-    cerr << "Inserting threads backwards..." << endl;
+            cerr << "Inserting threads backwards..." << endl;
 #endif
-    insert_in_direction(true);
+            insert_in_direction(true);
+        }
+    }
     
     // Actually build the B_s arrays for rank and select.
 #ifdef VERBOSE_DEBUG
@@ -4392,6 +5448,70 @@ void XG::insert_thread(const thread_t& t, const string& name) {
     names_str.append("$" + name);
 }
 
+XG::thread_t XG::walk_thread(int64_t side, int64_t offset) const {
+    
+    thread_t path;
+    
+    while(true) {
+        
+        // Unpack the side into a node traversal
+        ThreadMapping m = {rank_to_id(side / 2), (bool) (side % 2)};
+        
+        // Add the mapping to the thread
+        path.push_back(m);
+        
+#ifdef VERBOSE_DEBUG
+        cerr << "At side " << side << endl;
+#endif
+        // Work out where we go
+        
+        // What edge of the available edges do we take?
+        int64_t edge_index = bs_get(side, offset);
+        
+        // If we find a separator, we're very broken.
+        assert(edge_index != BS_SEPARATOR);
+        
+        if(edge_index == BS_NULL) {
+            // Path ends here.
+            break;
+        } else {
+            // Convert to an actual edge index
+            edge_index -= 2;
+        }
+        
+#ifdef VERBOSE_DEBUG
+        cerr << "Taking edge #" << edge_index << " from " << side << endl;
+#endif
+
+        // We also should not have negative edges.
+        assert(edge_index >= 0);
+        
+        // Look at the edges we could have taken next
+        vector<Edge> edges_out = side % 2 ? edges_on_start(rank_to_id(side / 2)) : edges_on_end(rank_to_id(side / 2));
+        
+        assert(edge_index < edges_out.size());
+        
+        Edge& taken = edges_out[edge_index];
+        
+        // Follow the edge
+        int64_t other_node = taken.from() == rank_to_id(side / 2) ? taken.to() : taken.from();
+        bool other_orientation = (side % 2) != taken.from_start() != taken.to_end();
+        
+        // Get the side 
+        int64_t other_side = id_to_rank(other_node) * 2 + other_orientation;
+        
+#ifdef VERBOSE_DEBUG
+        cerr << "Go to side " << other_side << endl;
+#endif
+        
+        // Go there with where_to
+        offset = where_to(side, offset, other_side);
+        side = other_side;
+    }
+    
+    return path;
+}
+
 auto XG::extract_threads_matching(const string& pattern, bool reverse) const -> map<string, list<thread_t>> {
 
     map<string, list<thread_t> > found;
@@ -4399,68 +5519,22 @@ auto XG::extract_threads_matching(const string& pattern, bool reverse) const ->
     // get the set of threads that match the given pattern
     // for each thread, get its start position
     vector<int64_t> threads = threads_named_starting(pattern);
-    for (auto& id : threads) {
-        // For every thread starting there
-        // make a new thread
-        thread_t path;
-
+    
+    // Walk all the threads in parallel, and then file them in order
+    vector<string> path_names(threads.size());
+    vector<thread_t> paths(threads.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (size_t i = 0; i < threads.size(); i++) {
         // Get the name of this thread
-        string path_name = thread_name(id);
-
-        // Start the side at i and the offset at j
-        auto p = thread_start(id, reverse);
-        int64_t side = id_rev_to_side(p.first, reverse);
-        int64_t offset = p.second;
-
-        while(true) {
-                
-            // Unpack the side into a node traversal
-            ThreadMapping m = {rank_to_id(side/2), (bool) (side % 2)};
+        path_names[i] = thread_name(threads[i]);
 
-            // Add the mapping to the thread
-            path.push_back(m);
-                
-            // Work out where we go
-                
-            // What edge of the available edges do we take?
-            int64_t edge_index = bs_get(side, offset);
-                
-            // If we find a separator, we're very broken.
-            assert(edge_index != BS_SEPARATOR);
-                
-            if(edge_index == BS_NULL) {
-                // Path ends here.
-                break;
-            } else {
-                // Convert to an actual edge index
-                edge_index -= 2;
-            }
-                
-            // We also should not have negative edges.
-            assert(edge_index >= 0);
-                
-            // Look at the edges we could have taken next
-            vector<Edge> edges_out = side % 2 ? edges_on_start(rank_to_id(side / 2)) : edges_on_end(rank_to_id(side / 2));
-                
-            assert(edge_index < edges_out.size());
-                
-            Edge& taken = edges_out[edge_index];
-                
-            // Follow the edge
-            int64_t other_node = taken.from() == rank_to_id(side / 2) ? taken.to() : taken.from();
-            bool other_orientation = (side % 2) != taken.from_start() != taken.to_end();
-                
-            // Get the side 
-            int64_t other_side = id_to_rank(other_node) * 2 + other_orientation;
-                
-            // Go there with where_to
-            offset = where_to(side, offset, other_side);
-            side = other_side;
+        // Start at the thread's start side and offset
+        auto p = thread_start(threads[i], reverse);
+        paths[i] = walk_thread(id_rev_to_side(p.first, reverse), p.second);
+    }
     
-        }
-            
-        found[path_name].push_back(path);
-            
+    for (size_t i = 0; i < threads.size(); i++) {
+        found[path_names[i]].push_back(std::move(paths[i]));
     }
     
     return found;
@@ -4480,100 +5554,36 @@ auto XG::extract_threads(bool extract_reverse) const -> map<string, list<thread_
     // We know sides 0 and 1 are unused, so the smallest side is 2.
     int64_t begin = !extract_reverse ? 2 : 3;
     int64_t end = !extract_reverse ? ts_civ.size()-1 : ts_civ.size();
+    
+    // Collect the side and offset each thread starts at
+    vector<pair<int64_t, int64_t>> starts;
     for(int64_t i = begin; i < end; i+=2) {
         // For every other real side
     
 #ifdef VERBOSE_DEBUG
         cerr << ts_civ[i] << " threads start at side " << i << endl;
 #endif
-        // For each side
-        if(ts_civ[i] == 0) {
-            // Skip it if no threads start at it
-            continue;
-        }
-
         for(int64_t j = 0; j < ts_civ[i]; j++) {
             // For every thread starting there
-      
+            starts.emplace_back(i, j);
+        }
+    }
+    
+    // Walk all the threads in parallel, and then file them in order
+    vector<string> path_names(starts.size());
+    vector<thread_t> paths(starts.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for(size_t k = 0; k < starts.size(); k++) {
 #ifdef debug    
-            cerr << "Extracting thread " << j << endl;
-#endif
-            
-            // make a new thread
-            thread_t path;
-            
-            // Start the side at i and the offset at j
-            int64_t side = i;
-            int64_t offset = j;
-
-            // Get the name of this thread
-            string path_name = thread_name(thread_starting_at(side, offset));
-
-            while(true) {
-                
-                // Unpack the side into a node traversal
-                ThreadMapping m = {rank_to_id(side / 2), (bool) (side % 2)};
-                
-                // Add the mapping to the thread
-                path.push_back(m);
-                
-#ifdef VERBOSE_DEBUG
-                cerr << "At side " << side << endl;
-                
+        cerr << "Extracting thread " << starts[k].second << " at side " << starts[k].first << endl;
 #endif
-                // Work out where we go
-                
-                // What edge of the available edges do we take?
-                int64_t edge_index = bs_get(side, offset);
-                
-                // If we find a separator, we're very broken.
-                assert(edge_index != BS_SEPARATOR);
-                
-                if(edge_index == BS_NULL) {
-                    // Path ends here.
-                    break;
-                } else {
-                    // Convert to an actual edge index
-                    edge_index -= 2;
-                }
-                
-#ifdef VERBOSE_DEBUG
-                cerr << "Taking edge #" << edge_index << " from " << side << endl;
-#endif
-
-                // We also should not have negative edges.
-                assert(edge_index >= 0);
-                
-                // Look at the edges we could have taken next
-                vector<Edge> edges_out = side % 2 ? edges_on_start(rank_to_id(side / 2)) : edges_on_end(rank_to_id(side / 2));
-                
-                assert(edge_index < edges_out.size());
-                
-                Edge& taken = edges_out[edge_index];
-                
-#ifdef VERBOSE_DEBUG
-                cerr << edges_out.size() << " edges possible." << endl;
-#endif
-                // Follow the edge
-                int64_t other_node = taken.from() == rank_to_id(side / 2) ? taken.to() : taken.from();
-                bool other_orientation = (side % 2) != taken.from_start() != taken.to_end();
-                
-                // Get the side 
-                int64_t other_side = id_to_rank(other_node) * 2 + other_orientation;
-                
-#ifdef VERBOSE_DEBUG
-                cerr << "Go to side " << other_side << endl;
-#endif
-                
-                // Go there with where_to
-                offset = where_to(side, offset, other_side);
-                side = other_side;
+        // Get the name of this thread
+        path_names[k] = thread_name(thread_starting_at(starts[k].first, starts[k].second));
+        paths[k] = walk_thread(starts[k].first, starts[k].second);
+    }
     
-            }
-            
-            found[path_name].push_back(path);
-            
-        }
+    for(size_t k = 0; k < starts.size(); k++) {
+        found[path_names[k]].push_back(std::move(paths[k]));
     }
     
     return found;
@@ -4684,11 +5694,13 @@ void XG::bs_insert(int64_t side, int64_t offset, destination_t value) {
 
 void XG::bs_bake() {
 #if GPBWT_MODE == MODE_SDSL
-    // First pass: determine required size
+    // First pass: determine required size, and where each side's range goes
+    vector<size_t> range_starts(bs_arrays.size());
     size_t total_visits = 1;
-    for(auto& bs_array : bs_arrays) {
+    for(size_t i = 0; i < bs_arrays.size(); i++) {
+        range_starts[i] = total_visits;
         total_visits += 1; // For the separator
-        total_visits += bs_array.size();
+        total_visits += bs_arrays[i].size();
     }
 
 #ifdef VERBOSE_DEBUG
@@ -4697,25 +5709,22 @@ void XG::bs_bake() {
     // Move over to a single array which is big enough to start out with.
     string all_bs_arrays(total_visits, 0);
     
-    // Where are we writing to?
-    size_t pos = 0;
-    
     // Start with a separator for sides 0 and 1.
     // We don't start at run 0 because we can't select(0, BS_SEPARATOR).
-    all_bs_arrays[pos++] = BS_SEPARATOR;
+    all_bs_arrays[0] = BS_SEPARATOR;
     
 #ifdef VERBOSE_DEBUG
     cerr << "Baking " << bs_arrays.size() << " sides' arrays..." << endl;
 #endif
     
-    for(auto& bs_array : bs_arrays) {
+    // The ranges don't overlap, so we can fill them in parallel.
+#pragma omp parallel for schedule(dynamic, 1024)
+    for(size_t i = 0; i < bs_arrays.size(); i++) {
         // Stick everything together with a separator at the front of every
         // range.
-        all_bs_arrays[pos++] = BS_SEPARATOR;
-        for(size_t i = 0; i < bs_array.size(); i++) {
-            all_bs_arrays[pos++] = bs_array[i];
-        }
-        bs_array.clear();
+        all_bs_arrays[range_starts[i]] = BS_SEPARATOR;
+        copy(bs_arrays[i].begin(), bs_arrays[i].end(), all_bs_arrays.begin() + range_starts[i] + 1);
+        bs_arrays[i].clear();
     }
     
 #ifdef VERBOSE_DEBUG
@@ -4965,12 +5974,14 @@ void XG::count_haplotypes() {
     // Go through the thread names, which we assume are like _thread_<sample>_<contig>_<phase>_<chunk>.
     // Count the total unique samples and assume diploid.
     
-    // We will just count unique sample names
-    unordered_set<string> sample_names;
+    // We will just count unique sample names, collecting them per thread
+    vector<unordered_set<string>> thread_sample_names(omp_get_max_threads());
     auto thread_ids = threads_named_starting("_thread_");
-    for (auto thread_id : thread_ids) {
+#pragma omp parallel for schedule(dynamic, 64)
+    for (size_t i = 0; i < thread_ids.size(); i++) {
+        auto& sample_names = thread_sample_names[omp_get_thread_num()];
         // For each thread, get its full name.
-        auto name = thread_name(thread_id);
+        auto name = thread_name(thread_ids[i]);
         
         // Find where the sample name should start
         size_t sample_start = strlen("_thread_");
@@ -4990,6 +6001,11 @@ void XG::count_haplotypes() {
         sample_names.insert(sample_name);
     }
     
+    unordered_set<string> sample_names;
+    for (auto& names : thread_sample_names) {
+        sample_names.insert(names.begin(), names.end());
+    }
+    
     // Now we have a count
     // TODO: this assumes diploid
     set_haplotype_count(sample_names.size() * 2);
@@ -4,6 +4,9 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <array>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <omp.h>
 #include <unordered_map>
@@ -102,6 +105,24 @@ public:
     void from_callback(function<void(function<void(Graph&)>)> get_chunks,
         bool validate_graph = false, bool print_graph = false,
         bool store_threads = false, bool is_sorted_dag = false); 
+    // Load the graph in two passes over the chunks, so the function passed in
+    // must be able to produce them all again each time it is called (three
+    // times if validating). The first pass collects node lengths, edges, and
+    // paths, and sizes the succinct vectors; the second writes the sequences
+    // straight into them. Neither the node sequences nor the edge hash tables
+    // are held in memory along the way, so peak memory stays near the size of
+    // the finished index plus the paths. Builds the same index as
+    // from_callback.
+    void from_callback_two_pass(function<void(function<void(Graph&)>)> get_chunks,
+        bool validate_graph = false, bool print_graph = false,
+        bool store_threads = false, bool is_sorted_dag = false);
+    // Add new paths to a finished index without rebuilding it. The paths
+    // must have names not already in the index, and may only visit nodes and
+    // follow edges that are already there. Only the path name and node to
+    // path indexes are rebuilt; sequences, edges, and threads are untouched.
+    // Throws a runtime_error, leaving the index unchanged, if a path does not
+    // fit. Must not be called while other threads are querying the index.
+    void append_paths(const vector<Path>& new_paths);
     void build(vector<pair<id_t, string> >& node_label,
                unordered_map<side_t, vector<side_t> >& from_to,
                unordered_map<side_t, vector<side_t> >& to_from,
@@ -112,13 +133,19 @@ public:
                bool is_sorted_dag);
                
     // What's the maximum XG version number we can read with this code?
-    const static uint32_t MAX_INPUT_VERSION = 7;
+    const static uint32_t MAX_INPUT_VERSION = 11;
     // What's the version we serialize?
-    const static uint32_t OUTPUT_VERSION = 7;
+    const static uint32_t OUTPUT_VERSION = 11;
                
     // Load this XG index from a stream. Throw an XGFormatError if the stream
     // does not produce a valid XG file.
     void load(istream& in);
+    // Load this XG index from the named file. The file is memory-mapped and
+    // read straight out of the page cache when possible, so concurrent loads
+    // of one index on one machine share a single cached copy. Falls back to a
+    // normal file stream for things that can't be mapped, like pipes. Throw
+    // an XGFormatError if the file does not contain a valid XG index.
+    void load_mapped(const string& filename);
     size_t serialize(std::ostream& out,
                      sdsl::structure_tree_node* v = NULL,
                      std::string name = "");
@@ -133,9 +160,23 @@ public:
     size_t node_count = 0;
     size_t edge_count = 0;
     size_t path_count = 0;
+    // If nonzero when the index is built, each path gets a table recording the
+    // node covering every path_sample_rate-th base, which answers most path
+    // offset to node queries without touching the wavelet tree. Costs two
+    // entries per path_sample_rate bases of path.
+    size_t path_sample_rate = 0;
     
     const uint64_t* sequence_data(void) const;
     const size_t sequence_bit_size(void) const;
+    /// Get how many times A, C, G and T occur in the forward strand of the
+    /// sequence, in that order, followed by how many other characters there
+    /// are. Stored in the index, and counted on load for older indexes.
+    const array<size_t, 5>& base_counts(void) const;
+    /// Get the fraction of the A, C, G and T bases in the sequence that are G
+    /// or C, or 0 if there are none.
+    double gc_content(void) const;
+    /// Get the entropy of the sequence's base composition, in bits per base.
+    double sequence_entropy(void) const;
     size_t id_to_rank(int64_t id) const;
     int64_t rank_to_id(size_t rank) const;
     size_t max_node_rank(void) const;
@@ -143,11 +184,43 @@ public:
     /// Get the node ID at the given sequence position. Works in 1-based coordinates.
     int64_t node_at_seq_pos(size_t pos) const;
     size_t node_start(int64_t id) const;
+    /// Get the forward strand base at the given 0-based offset in the
+    /// concatenated node sequence vector (see node_start()).
+    char sequence_char(size_t seq_offset) const;
     Node node(int64_t id) const; // gets node sequence
     string node_sequence(int64_t id) const;
     size_t node_length(int64_t id) const;
     char pos_char(int64_t id, bool is_rev, size_t off) const; // character at position
     string pos_substr(int64_t id, bool is_rev, size_t off, size_t len = 0) const; // substring in range
+    /// Write the sequence of the given oriented node into the buffer, which
+    /// must have room for get_length(handle) characters.
+    virtual void copy_sequence(const handle_t& handle, char* buffer) const;
+    /// Get the base at the given offset in the handle's local forward
+    /// orientation, decoding only that base.
+    virtual char get_base(const handle_t& handle, size_t index) const;
+    
+    /// Get the forward strand sequences of a batch of nodes in one pass over
+    /// the graph and sequence vectors, without building Node objects. IDs
+    /// should be sorted in ascending order for the best locality, but need not
+    /// be. The sequences are concatenated into sequences_out, and
+    /// sequence_starts_out gets the offset of each node's sequence, plus a
+    /// final past-the-end offset. Both outputs are cleared first, so they can
+    /// be reused across batches without reallocating.
+    void get_sequences(const vector<int64_t>& ids, string& sequences_out,
+                       vector<size_t>& sequence_starts_out) const;
+    /// Get the neighbors of a batch of nodes in one pass over the graph
+    /// vector, without building Edge objects. For each node's forward strand,
+    /// the handles reachable off its left and right sides are concatenated
+    /// into left_out and right_out, with left_starts_out and right_starts_out
+    /// giving the offset of each node's run, plus a final past-the-end offset.
+    /// All outputs are cleared first.
+    void get_adjacencies(const vector<int64_t>& ids,
+                         vector<handle_t>& left_out, vector<size_t>& left_starts_out,
+                         vector<handle_t>& right_out, vector<size_t>& right_starts_out) const;
+    /// Add Nodes for a batch of IDs to a Graph, extracting all their sequences
+    /// in one pass.
+    void add_nodes_to_graph(const vector<int64_t>& ids, Graph& g) const;
+    
     // these provide a way to get an index for each node and edge in the g_iv structure and are used by gPBWT
     size_t node_graph_idx(int64_t id) const;
     size_t edge_graph_idx(const Edge& edge) const;
@@ -184,6 +257,10 @@ public:
     /// provide the graph context up to a given length from the current position; step by nodes
     Graph graph_context_id(const pos_t& pos, int64_t length) const;
     Graph graph_context_g(const pos_t& pos, int64_t length) const;
+    /// provide the graph context up to forward_length from the position and up to backward_length
+    /// from its reverse, as if the two contexts were merged and passed to sort_by_id_dedup_and_clean,
+    /// but building each node and edge message only once
+    Graph graph_context_id(const pos_t& pos, int64_t forward_length, int64_t backward_length) const;
     
     /// return an edge from the three-part encoding used in the graph vector
     /// Edge type encoding:
@@ -203,24 +280,42 @@ public:
     ////////////////////////////////////////////////////////////////////////////
     
     /// Look up the handle for the node with the given ID in the given orientation
-    virtual handle_t get_handle(const id_t& node_id, bool is_reverse) const;
+    virtual handle_t get_handle(const id_t& node_id, bool is_reverse) const final;
     // Copy over the visit version which would otherwise be shadowed.
     using HandleGraph::get_handle;
     /// Get the ID from a handle
-    virtual id_t get_id(const handle_t& handle) const;
+    virtual id_t get_id(const handle_t& handle) const final;
     /// Get the orientation of a handle
-    virtual bool get_is_reverse(const handle_t& handle) const;
+    virtual bool get_is_reverse(const handle_t& handle) const final;
     /// Invert the orientation of a handle (potentially without getting its ID)
-    virtual handle_t flip(const handle_t& handle) const;
+    virtual handle_t flip(const handle_t& handle) const final;
     /// Get the length of a node
-    virtual size_t get_length(const handle_t& handle) const;
+    virtual size_t get_length(const handle_t& handle) const final;
     /// Get the sequence of a node, presented in the handle's local forward
     /// orientation.
     virtual string get_sequence(const handle_t& handle) const;
     /// Loop over all the handles to next/previous (right/left) nodes. Passes
     /// them to a callback which returns false to stop iterating and true to
     /// continue.
-    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const;
+    virtual bool follow_edges(const handle_t& handle, bool go_left, const function<bool(const handle_t&)>& iteratee) const final;
+    /// Loop over all the handles to next/previous (right/left) nodes with an
+    /// iteratee of any type that returns false to stop, without going through
+    /// a virtual call or a std::function. Hides the HandleGraph version for
+    /// algorithms templated on the graph type.
+    template <typename Iteratee>
+    inline bool follow_edges_inline(const handle_t& handle, bool go_left, Iteratee&& iteratee) const;
+    /// Keep decoded copies of the edges of up to max_nodes nodes, taken from
+    /// the run of consecutive node ranks with the most edges, so follow_edges
+    /// on those nodes does not have to decode g_iv. Each OpenMP thread fills
+    /// its own copy as it goes. Pass 0 to turn the cache off. Must not be
+    /// called while other threads are querying the index.
+    void enable_edge_cache(size_t max_nodes);
+    /// Return the number of follow_edges calls answered from the edge cache,
+    /// summed over threads, since it was enabled.
+    size_t edge_cache_hits() const;
+    /// Return the number of follow_edges calls that had to decode g_iv while
+    /// the edge cache was enabled, summed over threads.
+    size_t edge_cache_misses() const;
     /// Loop over all the nodes in the graph in their local forward
     /// orientations, in their internal stored order. Stop if the iteratee returns false.
     virtual void for_each_handle(const function<bool(const handle_t&)>& iteratee, bool parallel = false) const;
@@ -283,6 +378,23 @@ public:
     vector<size_t> node_ranks_in_path(int64_t id, size_t rank) const;
     vector<size_t> position_in_path(int64_t id, const string& name) const;
     vector<size_t> position_in_path(int64_t id, size_t rank) const;
+    /// Return true if any path visits the node.
+    bool node_on_any_path(int64_t id) const;
+    /// Call the callback with the path rank, offset of the node start in the
+    /// path, and path orientation of each visit of a path to the node, in
+    /// path rank order. Nothing is allocated.
+    void for_each_path_occurrence(int64_t id, const function<void(size_t, size_t, bool)>& lambda) const;
+    /// Like position_in_paths, but pass each (path rank, position) pair to
+    /// the callback instead of collecting them by path name.
+    void for_each_position_in_paths(int64_t id, bool is_rev, size_t offset,
+                                    const function<void(size_t, size_t)>& lambda) const;
+    /// Like offsets_in_paths, but pass each (path rank, offset, relative
+    /// orientation) to the callback instead of collecting them by path name.
+    void for_each_offset_in_paths(pos_t pos, const function<void(size_t, size_t, bool)>& lambda) const;
+    /// Like nearest_offsets_in_paths, but pass each (path rank, offset,
+    /// relative orientation) to the callback.
+    void for_each_nearest_offset_in_paths(pos_t pos, int64_t max_search,
+                                          const function<void(size_t, size_t, bool)>& lambda) const;
     map<string, vector<size_t> > position_in_paths(int64_t id, bool is_rev = false, size_t offset = 0) const;
     map<string, vector<pair<size_t, bool> > > offsets_in_paths(pos_t pos) const;
     map<string, vector<pair<size_t, bool> > > nearest_offsets_in_paths(pos_t pos, int64_t max_search) const;
@@ -302,7 +414,11 @@ public:
     size_t path_length(const string& name) const;
     size_t path_length(size_t rank) const;
     // nearest node (in steps) that is in a path, and the paths
-    pair<int64_t, vector<size_t> > nearest_path_node(int64_t id, int max_steps = 16) const;
+    // with the default max_steps this is a table lookup in indexes that have
+    // the path anchor table
+    pair<int64_t, vector<size_t> > nearest_path_node(int64_t id, int max_steps = PATH_ANCHOR_STEPS) const;
+    // how many steps out from each node the path anchor table looks
+    const static int PATH_ANCHOR_STEPS = 16;
     int64_t min_approx_path_distance(int64_t id1, int64_t id2) const;
     /// nearest position that is in a path and the distance between it and the current position
     pair<pos_t, int64_t> next_path_position(pos_t pos, int64_t max_search) const;
@@ -321,6 +437,19 @@ public:
     /// orientation as in the path, true indicates.
     vector<pair<size_t, vector<pair<size_t, bool>>>> oriented_paths_of_node(int64_t id) const;
     
+    /// Keep up to about max_entries results of paths_of_node and
+    /// oriented_occurrences_on_path in a memo shared by all threads, which the
+    /// memoized_* queries consult when the caller's own memo misses. This lets
+    /// nodes that are queried over and over, as in repetitive regions, be
+    /// decoded once per job instead of once per read. The memo is split into
+    /// shards with their own locks, and a full shard is cleared wholesale to
+    /// start a new epoch. Pass 0 to turn it off. Must not be called while
+    /// other threads are querying the index.
+    void enable_path_memo(size_t max_entries);
+    /// Return how many times a full shard of the shared path memo has been
+    /// cleared since it was enabled.
+    size_t path_memo_evictions() const;
+    
     /// same as paths_of_node, but with an optional memo to avoid repeated recalculation
     vector<size_t> memoized_paths_of_node(int64_t id, unordered_map<int64_t, vector<size_t>>* paths_of_node_memo = nullptr) const;
     
@@ -594,22 +723,100 @@ private:
     /// want to visit an edge depending on its type, whether we're the to or
     /// from node, whether we want to look left or right, and whether we're
     /// forward or reverse on the node.
-    bool edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const;
+    inline bool edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const;
     
     // This loops over the given number of edge records for the given g node,
     // starting at the given start g vector position. For all the edges that are
     // wanted by edge_filter given the is_to, want_left, and is_reverse flags,
     // the iteratee is called. Returns true if the iteratee never returns false,
     // or false (and stops iteration) as soon as the iteratee returns false.
-    bool do_edges(const size_t& g, const size_t& start, const size_t& count,
-        bool is_to, bool want_left, bool is_reverse, const function<bool(const handle_t&)>& iteratee) const;
+    template <typename Iteratee>
+    inline bool do_edges(const size_t& g, const size_t& start, const size_t& count,
+        bool is_to, bool want_left, bool is_reverse, Iteratee& iteratee) const;
+    
+    /// Loop over the edges off one side of a handle by decoding its g_iv
+    /// record, without consulting the edge cache.
+    template <typename Iteratee>
+    inline bool decode_edges(const handle_t& handle, bool go_left, Iteratee& iteratee) const;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Decoded edge cache
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// The decoded edges of one node, filling one cache line. Neighbors are
+    /// stored for the node's forward orientation, left ones first. Nodes with
+    /// more neighbors than fit are marked as overflowing and always decoded.
+    struct alignas(64) EdgeCacheLine {
+        uint8_t filled;
+        uint8_t overflow;
+        uint8_t left_count;
+        uint8_t right_count;
+        handle_t neighbors[7];
+    };
+    
+    /// One thread's copy of the cached edges, with its statistics
+    struct EdgeCache {
+        EdgeCacheLine* lines = nullptr;
+        size_t hits = 0;
+        size_t misses = 0;
+        ~EdgeCache();
+    };
+    
+    /// Get the cached edges for the node at the given g_iv offset, filling
+    /// them in if needed, or null if they have to be decoded. Counts the
+    /// lookup in the calling thread's statistics.
+    const EdgeCacheLine* cached_edges(size_t g) const;
+    
+    /// How many nodes have their edges cached (0 if the cache is off)
+    size_t edge_cache_nodes = 0;
+    /// The 0-based rank of the first node with cached edges
+    size_t edge_cache_first = 0;
+    /// The cache for each OpenMP thread, created on its first lookup
+    mutable vector<unique_ptr<EdgeCache>> edge_caches;
+    
+    ////////////////////////////////////////////////////////////////////////////
+    // Shared path occurrence memo
+    ////////////////////////////////////////////////////////////////////////////
+    
+    /// One lockable piece of the shared path memo. Nodes are assigned to
+    /// shards by ID, so both kinds of result for a node live together.
+    struct PathMemoShard {
+        mutex lock;
+        unordered_map<int64_t, vector<size_t>> paths_of_node;
+        unordered_map<pair<int64_t, size_t>, vector<pair<size_t, bool>>> oriented_occurrences;
+        /// How many times this shard has been cleared
+        size_t epoch = 0;
+    };
+    
+    /// How many shards to split the shared path memo into
+    const static size_t PATH_MEMO_SHARDS = 64;
+    
+    /// Get the shard of the shared path memo that holds results for a node
+    PathMemoShard& path_memo_shard(int64_t id) const;
+    
+    /// Make room for one more result in a shard, whose lock must be held, by
+    /// clearing it if it is full
+    void make_path_memo_room(PathMemoShard& shard) const;
+    
+    /// How many results each shard may hold (0 if the memo is off)
+    size_t path_memo_shard_entries = 0;
+    /// The shards, all present while the memo is on
+    mutable vector<unique_ptr<PathMemoShard>> path_memo_shards;
     
     ////////////////////////////////////////////////////////////////////////////
     // Here are the bits we need to keep around to talk about the sequence
     ////////////////////////////////////////////////////////////////////////////
     
-    // sequence/integer vector
-    int_vector<> s_iv;
+    // sequence/integer vector, 2 bits per base
+    int_vector<2> s_iv;
+    // positions in s_iv holding something other than A, C, G or T, and the
+    // characters really there (s_iv holds a placeholder)
+    sd_vector<> sx_bv;
+    sd_vector<>::rank_1_type sx_bv_rank;
+    sd_vector<>::select_1_type sx_bv_select;
+    int_vector<8> sx_iv;
+    // counts of A, C, G, T and other characters in the sequence
+    array<size_t, 5> s_counts = {{0, 0, 0, 0, 0}};
     // node starts in sequence, provides id schema
     // rank_1(i) = id
     // select_1(id) = i
@@ -741,11 +948,49 @@ private:
 
     // Fill the component path sets indexes
     void index_component_path_sets();
+    
+    // For each node rank, the rank of the nearest node on a path (the one
+    // nearest_path_node would find), or 0 if there is none within
+    // PATH_ANCHOR_STEPS. Empty for indexes from before version 10.
+    int_vector<> pa_iv;
+    // Fill the path anchor table with a breadth-first search out from all
+    // the path nodes at once
+    void index_path_anchors();
+    // Returns true if the path anchor table shows that the two nodes are on
+    // different connected components, without searching
+    bool path_anchors_rule_out(int64_t id1, int64_t id2) const;
     // Create a representation of the component path set indexes in serializable sdsl types
     void create_succinct_component_path_sets(int_vector<>& path_ranks_iv_out, bit_vector& path_ranks_bv_out) const;
     // Convert the serializable sdsl representation of the component path set indexes into the in-memory class members
     void unpack_succinct_component_path_sets(const int_vector<>& path_ranks_iv, const bit_vector& path_ranks_bv);
     
+    /// Index the non-ACGT characters at the marked positions of s_iv.
+    void index_sequence_exceptions(const bit_vector& exceptions_bv, const string& exception_chars);
+    /// Fill in s_counts from s_iv and its exceptions, on all threads.
+    void count_bases(void);
+    
+    // Sort the steps of each path by rank, and stop if any rank is repeated
+    void sort_path_steps(map<string, vector<trav_t> >& path_nodes);
+    // Once the edges in g_iv hold node IDs, set up the g_bv supports and turn
+    // the IDs into offsets between records. Frees the record starts.
+    void relativize_graph_vector(vector<size_t>& g_record_starts);
+    // Build the path name index and the node to path index from the XGPaths
+    // in paths, which must be named, in rank order, in path_name_list.
+    void index_path_membership(const vector<string>& path_name_list);
+    // Build everything that comes after the sequences and g_iv: the paths,
+    // the node to path index, and the threads, if requested.
+    void finish_build(map<string, vector<trav_t> >& path_nodes,
+                      bool print_graph,
+                      bool store_threads,
+                      bool is_sorted_dag);
+    
+    /// Write the forward strand of len bases of s_iv, from start, into out.
+    void extract_sequence(size_t start, size_t len, char* out) const;
+    /// collect the graph vector offsets of the nodes that graph_context_g would visit
+    void graph_context_nodes_g(const pos_t& g_pos, int64_t length, unordered_set<int64_t>& nodes_g) const;
+    /// Write the reverse complement of len bases of s_iv, from start, into out.
+    void extract_reverse_complement(size_t start, size_t len, char* out) const;
+    
     // A "destination" is either a local edge number + 2, BS_NULL for stopping,
     // or possibly BS_SEPARATOR for cramming multiple Benedict arrays into one.
     using destination_t = size_t;
@@ -774,6 +1019,10 @@ private:
     
     // Prepare the succinct thread name representation for queries
     void tn_bake();
+    
+    // Follow a thread from the visit at the given offset on the given side
+    // until it ends. Safe to call from multiple threads once baked.
+    thread_t walk_thread(int64_t side, int64_t offset) const;
 };
 
 class XGPath {
@@ -787,7 +1036,8 @@ public:
            const vector<trav_t>& path,
            size_t node_count,
            XG& graph,
-           size_t* unique_member_count_out = nullptr);
+           size_t* unique_member_count_out = nullptr,
+           size_t sample_rate = 0);
     // Path names are stored in the XG object, in a compressed fashion, and are
     // not duplicated here.
     
@@ -808,12 +1058,25 @@ public:
     bit_vector offsets;
     rank_support_v<1> offsets_rank;
     bit_vector::select_1_type offsets_select;
-    void load(istream& in);
+    // Sampled lookup table from every sample_rate-th path offset to the step
+    // covering it and that step's node ID. Empty if sample_rate is 0.
+    size_t sample_rate = 0;
+    int_vector<> sampled_steps;
+    int_vector<> sampled_ids;
+    // Load the path, expecting the serialization of the given XG version.
+    void load(istream& in, uint32_t file_version = XG::OUTPUT_VERSION);
     size_t serialize(std::ostream& out,
                      sdsl::structure_tree_node* v = NULL,
                      std::string name = "") const;
     // Get a mapping. Note that the mapping will not have its lengths filled in.
     Mapping mapping(size_t offset) const; // 0-based
+    // Get the step covering the given 0-based path offset.
+    size_t step_at_position(size_t pos) const;
+    // Get the node ID at the given step, which must cover the given 0-based
+    // path offset. Uses the sample table when the sample covers the step.
+    int64_t node_at_step(size_t step, size_t pos) const;
+    // Get the mapping covering the given 0-based path offset.
+    Mapping mapping_at_position(size_t pos) const;
 };
 
 
@@ -857,6 +1120,126 @@ string reverse_complement(const string& seq);
 void extract_pos(const string& pos_str, int64_t& id, bool& is_rev, size_t& off);
 void extract_pos_substr(const string& pos_str, int64_t& id, bool& is_rev, size_t& off, size_t& len);
 
+// Edge traversal is defined here so that it can be inlined into algorithms
+// that are templated on the graph type.
+
+inline bool XG::edge_filter(int type, bool is_to, bool want_left, bool is_reverse) const {
+    // Return true if we want an edge of the given type, where we are the from
+    // or to node (according to is_to), when we are looking off the right or
+    // left side of the node (according to want_left), and when the node is
+    // forward or reverse (accoridng to is_reverse).
+    
+    // Edge type encoding:
+    // 1: end to start
+    // 2: end to end
+    // 3: start to start
+    // 4: start to end
+    
+    // First compute what we want looking off the right of a node in the forward direction.
+    bool wanted = !is_to && (type == 1 || type == 2) || is_to && (type == 2 || type == 4);
+    
+    // We computed whether we wanted it assuming we were looking off the right. The complement is what we want looking off the left.
+    wanted = wanted != want_left;
+    
+    // We computed whether we wanted ot assuming we were in the forward orientation. The complement is what we want in the reverse orientation.
+    wanted = wanted != is_reverse;
+    
+    return wanted;
+}
+
+template <typename Iteratee>
+inline bool XG::do_edges(const size_t& g, const size_t& start, const size_t& count, bool is_to,
+    bool want_left, bool is_reverse, Iteratee& iteratee) const {
+    
+    // OK go over all those edges
+    for (size_t i = 0; i < count; i++) {
+        // What edge type is the edge?
+        int type = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_TYPE_OFFSET];
+        
+        // Make sure we got a valid edge type and we haven't wandered off into non-edge data.
+        assert(type >= 0);
+        assert(type <= 3);
+        
+        if (edge_filter(type, is_to, want_left, is_reverse)) {
+            
+            // What's the offset to the other node?
+            int64_t offset = g_iv[start + i * G_EDGE_LENGTH + G_EDGE_OFFSET_OFFSET];
+            
+            // Make sure we haven't gone off the rails into non-edge data.
+            assert((int64_t) g + offset >= 0);
+            assert(g + offset < g_iv.size());
+            
+            // Should we invert?
+            // We only invert if we cross an end to end edge. Or a start to start edge
+            bool new_reverse = is_reverse != (type == 2 || type == 3);
+            
+            // Compose the handle for where we are going
+            handle_t next_handle = as_handle((g + offset) | (new_reverse ? HIGH_BIT : 0));
+            
+            // We want this edge
+            
+            if (!iteratee(next_handle)) {
+                // Stop iterating
+                return false;
+            }
+        }
+    }
+    // Iteratee didn't stop us.
+    return true;
+}
+
+template <typename Iteratee>
+inline bool XG::follow_edges_inline(const handle_t& handle, bool go_left, Iteratee&& iteratee) const {
+
+    if (edge_cache_nodes != 0) {
+        // See if we have this node's edges already decoded
+        const EdgeCacheLine* line = cached_edges(as_integer(handle) & LOW_BITS);
+        if (line != nullptr) {
+            bool is_reverse = as_integer(handle) & HIGH_BIT;
+            // Going one way on the reverse strand is going the other way on
+            // the forward strand, and everything we reach is flipped.
+            size_t begin = (go_left != is_reverse) ? 0 : line->left_count;
+            size_t end = (go_left != is_reverse) ? line->left_count : line->left_count + line->right_count;
+            for (size_t i = begin; i < end; i++) {
+                handle_t next_handle = line->neighbors[i];
+                if (is_reverse) {
+                    next_handle = as_handle(as_integer(next_handle) ^ HIGH_BIT);
+                }
+                if (!iteratee(next_handle)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    
+    return decode_edges(handle, go_left, iteratee);
+}
+
+template <typename Iteratee>
+inline bool XG::decode_edges(const handle_t& handle, bool go_left, Iteratee& iteratee) const {
+
+    // Unpack the handle
+    size_t g = as_integer(handle) & LOW_BITS;
+    bool is_reverse = as_integer(handle) & HIGH_BIT;
+
+    // How many edges are there of each type?
+    size_t edges_to_count = g_iv[g + G_NODE_TO_COUNT_OFFSET];
+    size_t edges_from_count = g_iv[g + G_NODE_FROM_COUNT_OFFSET];
+    
+    // Where does each edge run start?
+    size_t to_start = g + G_NODE_HEADER_LENGTH;
+    size_t from_start = g + G_NODE_HEADER_LENGTH + G_EDGE_LENGTH * edges_to_count;
+    
+    // We will look for all the edges on the appropriate side, which means we have to check the from and to edges
+    if (do_edges(g, to_start, edges_to_count, true, go_left, is_reverse, iteratee)) {
+        // All the edges where we're to were accepted, so do the edges where we're from
+        return do_edges(g, from_start, edges_from_count, false, go_left, is_reverse, iteratee);
+    } else {
+        return false;
+    }
+}
+
 }
 
 #endif
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+perf.py: run a fixed vg workload over the test data and report performance
+
+Runs construct, index (xg and GCSA2), map, mpmap, pack, augment/call and
+gamsort over test/1mb1kgp (or test/small with --small), recording wall time,
+peak RSS, and reads per second for the mapping steps. Results are written as
+JSON, and compared against a stored baseline, with any step that got slower
+or bigger than the tolerance allows reported as a regression.
+
+Usage (from the root of the repo):
+
+    test/bench/perf.py --out perf.json                  # run and compare to the baseline
+    test/bench/perf.py --out perf.json --update-baseline  # run and store the baseline
+
+Timings are only comparable between runs on the same machine with the same
+thread count, so the baseline records both and refuses to compare otherwise.
+"""
+
+import argparse
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+TEST_DIR = os.path.dirname(BENCH_DIR)
+DEFAULT_BASELINE = os.path.join(BENCH_DIR, "perf-baseline.json")
+
+# Steps to run, in order. Each has a name, a command run by bash in the work
+# directory, whether it is timed, and whether it maps the simulated reads (for
+# reads/s). Untimed steps are setup and aren't reported.
+def workload():
+    return [
+        ("construct", "vg construct -r {fa} -v {vcf} -t {t} > graph.vg", True, False),
+        ("index", "vg index -x graph.xg -g graph.gcsa -k 16 -t {t} graph.vg", True, False),
+        ("sim", "vg sim -s 1337 -n {n} -l 150 -e 0.01 -i 0.002 -x graph.xg -a > reads.gam", False, False),
+        ("map", "vg map -x graph.xg -g graph.gcsa -G reads.gam -t {t} > mapped.gam", True, True),
+        ("mpmap", "vg mpmap -x graph.xg -g graph.gcsa -G reads.gam -t {t} > mapped.gamp", True, True),
+        ("pack", "vg pack -x graph.xg -g mapped.gam -o mapped.pack -t {t}", True, False),
+        ("augment", "vg augment graph.vg mapped.gam -Z aug.trans -S aug.support > aug.vg", True, False),
+        ("call", "vg call aug.vg -z aug.trans -s aug.support -b graph.vg > calls.vcf", True, False),
+        ("gamsort", "vg gamsort mapped.gam > sorted.gam", True, False),
+    ]
+
+def peak_rss_bytes(rusage):
+    # Linux reports kilobytes, and macOS bytes
+    if platform.system() == "Darwin":
+        return rusage.ru_maxrss
+    return rusage.ru_maxrss * 1024
+
+def run_step(command, work_dir):
+    """
+    Run a command and return its wall time in seconds and peak RSS in bytes.
+    """
+    start = time.time()
+    proc = subprocess.Popen(["bash", "-c", "set -o pipefail; " + command], cwd=work_dir)
+    # wait4 gets us the resource usage of just this command and what it ran
+    _, status, rusage = os.wait4(proc.pid, 0)
+    wall = time.time() - start
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        raise RuntimeError("command failed with status {}: {}".format(status, command))
+    return wall, peak_rss_bytes(rusage)
+
+def run_workload(args):
+    data = os.path.join(TEST_DIR, "small" if args.small else "1mb1kgp")
+    fa = os.path.join(data, "x.fa" if args.small else "z.fa")
+    vcf = os.path.join(data, "x.vcf.gz" if args.small else "z.vcf.gz")
+
+    work_dir = tempfile.mkdtemp(prefix="vg-perf-")
+    results = {"dataset": os.path.basename(data), "threads": args.threads,
+               "reads": args.reads, "host": platform.node(), "steps": {}}
+    try:
+        for name, command, timed, maps_reads in workload():
+            command = command.format(fa=fa, vcf=vcf, t=args.threads, n=args.reads)
+            sys.stderr.write("[perf] {}: {}\n".format(name, command))
+            # Take the best of the repeats, to keep noise down
+            best = None
+            for _ in range(args.repeats if timed else 1):
+                wall, rss = run_step(command, work_dir)
+                if best is None or wall < best[0]:
+                    best = (wall, rss)
+            if not timed:
+                continue
+            step = {"wall_seconds": round(best[0], 3), "peak_rss_bytes": best[1]}
+            if maps_reads:
+                step["reads_per_second"] = round(args.reads / max(best[0], 1e-6), 1)
+            results["steps"][name] = step
+    finally:
+        if args.keep:
+            sys.stderr.write("[perf] kept outputs in {}\n".format(work_dir))
+        else:
+            shutil.rmtree(work_dir)
+    return results
+
+def compare(results, baseline, tolerance):
+    """
+    Return a list of regressions of results against baseline, as strings.
+    """
+    regressions = []
+    for name, step in sorted(results["steps"].items()):
+        if name not in baseline["steps"]:
+            continue
+        base = baseline["steps"][name]
+        # Times too short to measure reliably only regress past a floor
+        if step["wall_seconds"] > max(base["wall_seconds"], 0.1) * (1 + tolerance):
+            regressions.append("{}: wall time {}s vs {}s".format(name, step["wall_seconds"], base["wall_seconds"]))
+        if step["peak_rss_bytes"] > base["peak_rss_bytes"] * (1 + tolerance):
+            regressions.append("{}: peak RSS {} vs {} bytes".format(name, step["peak_rss_bytes"], base["peak_rss_bytes"]))
+        if "reads_per_second" in base and step["reads_per_second"] < base["reads_per_second"] / (1 + tolerance):
+            regressions.append("{}: {} reads/s vs {} reads/s".format(name, step["reads_per_second"], base["reads_per_second"]))
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the vg performance regression workload")
+    parser.add_argument("--out", default="-", help="write JSON results here [stdout]")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE, help="baseline JSON to compare against [%(default)s]")
+    parser.add_argument("--update-baseline", action="store_true", help="store the results as the new baseline")
+    parser.add_argument("--tolerance", type=float, default=0.2, help="allowed fractional slowdown or growth [%(default)s]")
+    parser.add_argument("--threads", type=int, default=1, help="threads for each step [%(default)s]")
+    parser.add_argument("--reads", type=int, default=10000, help="number of reads to simulate and map [%(default)s]")
+    parser.add_argument("--repeats", type=int, default=3, help="runs of each step, keeping the fastest [%(default)s]")
+    parser.add_argument("--small", action="store_true", help="use test/small instead of test/1mb1kgp")
+    parser.add_argument("--keep", action="store_true", help="keep the working directory")
+    args = parser.parse_args()
+
+    results = run_workload(args)
+
+    text = json.dumps(results, indent=2, sort_keys=True) + "\n"
+    if args.out == "-":
+        sys.stdout.write(text)
+    else:
+        with open(args.out, "w") as out:
+            out.write(text)
+
+    if args.update_baseline:
+        with open(args.baseline, "w") as out:
+            out.write(text)
+        sys.stderr.write("[perf] stored baseline in {}\n".format(args.baseline))
+        return 0
+
+    if not os.path.exists(args.baseline):
+        sys.stderr.write("[perf] no baseline at {}, run with --update-baseline to make one\n".format(args.baseline))
+        return 0
+    with open(args.baseline) as base_file:
+        baseline = json.load(base_file)
+    for key in ("dataset", "threads", "reads", "host"):
+        if baseline[key] != results[key]:
+            sys.stderr.write("[perf] baseline {} is {} but this run used {}, not comparing\n".format(key, baseline[key], results[key]))
+            return 1
+
+    regressions = compare(results, baseline, args.tolerance)
+    for regression in regressions:
+        sys.stderr.write("[perf] regression in {}\n".format(regression))
+    if regressions:
+        return 1
+    sys.stderr.write("[perf] no regressions against {}\n".format(args.baseline))
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
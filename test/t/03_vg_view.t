@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 14
+plan tests 16
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -d - | wc -l) 505 "view produces the expected number of lines of dot output"
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg view -g - | wc -l) 503 "view produces the expected number of lines of GFA output"
@@ -31,6 +31,12 @@ is $(samtools view -u minigiab/NA12878.chr22.tiny.bam | vg view -bG - | vg view
 
 is $(vg view -f ./small/x.fa_1.fastq  ./small/x.fa_2.fastq | vg view -a - | wc -l) 2000 "view can handle fastq input"
 
+vg view -f ./small/x.fa_1.fastq  ./small/x.fa_2.fastq > x.gam
+is "$(vg view -a x.gam --threads 4 | md5sum)" "$(vg view -a x.gam | md5sum)" "view converts GAM to JSON in input order with multiple threads"
+vg view -a x.gam --columnar > x.cgam
+is "$(vg view --columnar-in x.cgam | vg view -a - | md5sum)" "$(vg view -a x.gam | md5sum)" "view round-trips GAM through columnar GAM"
+rm -f x.gam x.cgam
+
 is $(vg view -Jv ./cyclic/two_node.json | vg view -j - | jq ".edge | length") 4 "view can translate graphs with 2-node cycles"
 
 is $(vg view -g ./cyclic/all.vg | tr '\t' ' ' | grep "4 + 4 -" | wc -l) 1 "view outputs properly oriented GFA"
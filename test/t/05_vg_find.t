@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 23
+plan tests 24
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 is $? 0 "construction"
@@ -13,6 +13,9 @@ is $? 0 "construction"
 vg index -x x.xg x.vg 2>/dev/null
 is $(vg find -x x.xg -p x:200-300 -c 2 | vg view - | grep CTACTGACAGCAGA | cut -f 2) 72 "a path can be queried from the xg index"
 is $(vg find -x x.xg -n 203 -c 1 | vg view - | grep CTACCCAGGCCATTTTAAGTTTCCTGT | wc -l) 1 "a node near another can be obtained using context from the xg index"
+printf "203\n17 20\n" > batch_ids.txt
+is $(vg find -x x.xg -I batch_ids.txt -c 1 --threads 2 | md5sum | cut -f 1 -d " ") $( (vg find -x x.xg -n 203 -c 1; vg find -x x.xg -n 17 -c 1; vg find -x x.xg -n 20 -c 1) | md5sum | cut -f 1 -d " ") "batch node queries produce one chunk per node in input order"
+rm -f batch_ids.txt
 
 vg index -x x.xg -g x.gcsa -k 16 x.vg
 is $(( for seq in $(vg sim -l 50 -n 100 -x x.xg); do vg find -M $seq -g x.gcsa; done ) | jq length | grep ^1$ | wc -l) 100 "each perfect read contains one maximal exact match"
@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="en_US.utf8" # force ekg's favorite sort order 
 
-plan tests 34
+plan tests 35
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 
@@ -75,7 +75,10 @@ vg construct -r small/xy.fa -v small/xy.vcf.gz -a >xy.vg
 vg index -x xy.xg -v small/xy.vcf.gz xy.vg
 is $(vg find -x xy.xg -t | vg paths -L - | wc -l) 4 "a thread is stored per haplotype, sample, and reference sequence"
 is $(vg find -x xy.xg -q _thread_1_y | vg paths -L - | wc -l) 2 "we have the expected number of threads per chromosome"
-rm -f xy.vg xy.xg
+vg index -x xy.xg -v small/xy.vcf.gz -G serial.gbwt -t 1 xy.vg
+vg index -x xy.xg -v small/xy.vcf.gz -G contigs.gbwt -t 2 --gbwt-buffer 1 --gbwt-merge-batch 1 xy.vg
+is $(du -b contigs.gbwt | cut -f 1) $(du -b serial.gbwt | cut -f 1) "per-contig GBWTs merge into the same GBWT as serial construction"
+rm -f xy.vg xy.xg serial.gbwt contigs.gbwt
 
 vg construct -r small/x.fa -v small/x.vcf.gz -a >x.vg
 vg index -x x.xg -v small/x.vcf.gz -H haps.bin x.vg
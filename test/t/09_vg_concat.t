@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 1
+plan tests 4
 
 vg construct -r small/x.fa -v small/x.vcf.gz >x.vg
 
@@ -15,4 +15,9 @@ num_nodes=$(vg view -g x.vg | grep ^S | wc -l)
 
 is $(vg concat x.vg x.vg | vg view -g - | grep ^S | wc -l) $(echo "$num_nodes * 2" | bc) "concat doubles the number of nodes"
 
+num_edges=$(vg view -g x.vg | grep ^L | wc -l)
+is $(vg concat x.vg x.vg | vg view -g - | grep ^L | wc -l) $(echo "$num_edges * 2 + 1" | bc) "concat joins the tail of the first graph to the head of the second"
+is $(vg concat x.vg x.vg | vg paths -x - | vg view -a - | jq '.path.mapping | length') $(vg paths -x x.vg | vg view -a - | jq '.path.mapping | length * 2') "concat concatenates paths with the same name"
+is $(cat x.vg | vg join - | vg view -g - | grep ^S | wc -l) $(echo "$num_nodes + 1" | bc) "join adds a root node"
+
 rm -f x.vg
@@ -7,7 +7,7 @@ PATH=../bin:$PATH # for vg
 
 export LC_ALL="C" # force a consistent sort order 
 
-plan tests 11
+plan tests 13
 
 is $(vg construct -r small/x.fa -v small/x.vcf.gz | vg kmers -k 11 - | cut -f 1 | sort | uniq | wc -l) \
     4250 \
@@ -33,6 +33,13 @@ is "$(vg kmers -g -k 11 -t 1 x.vg | grep AATAAGGCTTG | cut -f 4,5)" "$(printf 'A
 
 is "$(vg kmers -g -k 11 -t 1 x.vg | grep CATATTAGCCA | cut -f 3)" "G,A" "GCSA2 output works when previous characters are multiple"
 
+is $(( ($(vg kmers -c -k 11 -t 4 x.vg | wc -c) - 8) / 12 )) 4250 "counting finds every distinct kmer"
+
+vg kmers -c -k 11 -t 4 x.vg > x.counts
+vg kmers -c -k 11 -t 4 --count-partitions 5 x.vg > x.disk.counts
+is $(cmp x.counts x.disk.counts && echo same) same "counting with temporary files gives the same table"
+rm -f x.counts x.disk.counts
+
 rm x.vg
 rm -rf x.vg.index
 
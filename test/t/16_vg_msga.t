@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 13
+plan tests 14
 
 is $(vg msga -f GRCh38_alts/FASTA/HLA/V-352962.fa -t 4 -k 16 | vg mod -U 10 - | vg mod -c - | vg view - | grep ^S | cut -f 3 | sort | md5sum | cut -f 1 -d\ ) $(vg msga -f GRCh38_alts/FASTA/HLA/V-352962.fa -t 1 -k 16 | vg mod -U 10 - | vg mod -c - | vg view - | grep ^S | cut -f 3 | sort | md5sum | cut -f 1 -d\ ) "graph for GRCh38 HLA-V is unaffected by the number of alignment threads"
 
@@ -29,6 +29,9 @@ is $((for seq in $(vg msga -f msgas/w.fa -b x -K 16 | vg paths -x - | vg view -a
 vg msga -f msgas/w.fa -b x -K 16 -w 20 | vg validate -
 is $? 0 "even when banding the paths of the graph encode the original sequences used to build it"
 
+vg msga -f msgas/w.fa -b x -K 16 --batch 4 | vg validate -
+is $? 0 "sequences aligned in a batch against the same indexes all get included"
+
 vg msga -f GRCh38_alts/FASTA/HLA/K-3138.fa -w 256 -W 64 -E 4 | vg validate -
 is $? 0 "HLA K-3138 correctly includes all input paths"
 
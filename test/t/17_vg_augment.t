@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 5
+plan tests 6
 
 vg view -J -v pileup/tiny.json > tiny.vg
 
@@ -26,6 +26,7 @@ vg augment -a direct tiny.vg edits.gam -A edits-embedded.gam > augmented.vg
 # We want 3 edits with no sequence per read, and we have 12 reads in this file.
 is "$(vg view -aj edits-embedded.gam | jq -c '.path.mapping[].edit[].sequence' | grep null | wc -l)" "36" "direct augmentation embeds reads fully for well-supported SNPs"
 is "$(vg stats -N augmented.vg)" "18" "adding a well-supported SNP by direct augmentation adds 3 more nodes"
+is "$(cat edits.gam | vg augment -a direct tiny.vg - | vg stats -N -)" "18" "direct augmentation can stream reads from standard input"
 
 rm -f edits.gam edits-embedded.gam augmented.vg
 
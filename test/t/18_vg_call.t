@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 4
+plan tests 5
 
 # Toy example of hand-made pileup (and hand inspected truth) to make sure some
 # obvious (and only obvious) SNPs are detected by vg call
@@ -33,7 +33,13 @@ EMPTY_LOCUS_COUNT="$(vg view --locus-in -j calls.loci | jq -c 'select(.genotype[
 
 is "${EMPTY_LOCUS_COUNT}" "${LOCUS_COUNT}" "all loci on an empty pileup in coverage-calling mode are called deleted"
 
-rm -f tiny.vg empty.vgpu calls.loci sample.vg empty.aug.trans empty.aug.support empty.aug.vg
+vg index -x tiny.xg tiny.vg
+vg gamsort -s -i empty.gam
+vg call --xg tiny.xg --gam empty.gam -r x --chunk-size 20 --overlap 4 > chunked.vcf
+
+is "$(grep -v '^#' chunked.vcf | wc -l)" "0" "chunked calling on an empty pileup makes no calls"
+
+rm -f tiny.vg tiny.xg empty.gam empty.gam.gai chunked.vcf empty.vgpu calls.loci sample.vg empty.aug.trans empty.aug.support empty.aug.vg
 
 echo '{"node": [{"id": 1, "sequence": "CGTAGCGTGGTCGCATAAGTACAGTAGATCCTCCCCGCGCATCCTATTTATTAAGTTAAT"}]}' | vg view -Jv - > test.vg
 vg index -x test.xg -g test.gcsa -k 16 test.vg
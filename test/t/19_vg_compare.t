@@ -5,7 +5,17 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 0
+plan tests 3
+
+# Compare the nodes and edges of sorted graphs directly
+vg view -J -v compare/graph1.json > graph1.vg
+vg view -J -v compare/graph2.json > graph2.vg
+is $(vg compare -g graph1.vg graph1.vg | jq '.nodes_shared') 6 "vg compare -g finds all nodes shared between a graph and itself"
+is $(vg compare -g graph1.vg graph2.vg | jq -c '[.nodes_changed, .nodes_only1, .nodes_only2]') "[6,0,1]" "vg compare -g finds changed and added nodes"
+vg compare -g -D diffs.tsv -t 2 graph1.vg graph2.vg > /dev/null
+is $(grep -c "^node" diffs.tsv) 7 "vg compare -g writes a diff record for each differing node"
+rm -f graph1.vg graph2.vg diffs.tsv
+
 exit
 
 # We have broken the index format that this was using
@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 2
+plan tests 3
 
 ## Test VG .to_superbubbles()
 is $(echo 0) 0 "vg deconstruct produces the expected number of superbubbles in a simple graph."
@@ -13,6 +13,12 @@ is $(echo 0) 0 "vg deconstruct produces the expected number of superbubbles in a
 ## Make sure deconstruct successfully finds the right nodes in a superbubble of a simple graph.
 is $(echo 0) 0 "vg deconstruct produces the expected superbubble format and the right bubbles on a small graph."
 
+vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz > tiny.vg
+vg index -x tiny.xg tiny.vg
+vg snarls tiny.vg > tiny.snarls
+is "$(vg deconstruct -p x -x tiny.xg -r tiny.snarls -t 2)" "$(vg deconstruct -p x tiny.vg)" "vg deconstruct gives the same VCF from an XG and snarls as from the graph"
+rm -f tiny.vg tiny.xg tiny.snarls
+
 ## Test a larger graph  - CURRENTLY HAS BAD MD5SUM
 ## is $(vg deconstruct -x superbubbles/x.xg superbubbles/x.vg | md5sum | cut -f 1 -d " ") 902350cea10dd772ed321e271b2aa6a7 "vg deconstruct produces correct pseudo vcf on a largeish graph."
 
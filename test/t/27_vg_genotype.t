@@ -6,7 +6,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 PATH=../bin:$PATH # for vg
 
 
-plan tests 6
+plan tests 7
 
 vg construct -v tiny/tiny.vcf.gz -r tiny/tiny.fa > tiny.vg
 vg index -x tiny.vg.xg -g tiny.vg.gcsa -k 16 tiny.vg
@@ -22,6 +22,16 @@ is "$?" "0" "vg genotype runs successfully when emitting vcf"
 
 rm -Rf tiny.vg tiny.vg.xg tiny.gam.index tiny.gam reads.txt
 
+vg construct -a -v tiny/tiny.vcf.gz -r tiny/tiny.fa > tiny.vg
+vg index -x tiny.vg.xg -g tiny.vg.gcsa -k 16 tiny.vg
+vg sim -s 1337 -n 100 -x tiny.vg.xg -l 30 > reads.txt
+vg map -T reads.txt -g tiny.vg.gcsa -x tiny.vg.xg > tiny.gam
+vg genotype tiny.vg -V tiny/tiny.vcf.gz -F tiny/tiny.fa -G tiny.gam | grep -v "^#" | sort > recall.vcf
+vg genotype -X tiny.vg.xg -V tiny/tiny.vcf.gz -F tiny/tiny.fa -G tiny.gam -t 2 | grep -v "^#" | sort > recall_xg.vcf
+is "$(md5sum < recall_xg.vcf)" "$(md5sum < recall.vcf)" "recalling variants against an xg index matches recalling against the graph"
+
+rm -Rf tiny.vg tiny.vg.xg tiny.vg.gcsa tiny.vg.gcsa.lcp tiny.gam reads.txt recall.vcf recall_xg.vcf
+
 vg construct -v tiny/tiny.vcf.gz -r tiny/tiny.fa > tiny.vg
 vg index -x tiny.vg.xg -g tiny.vg.gcsa -k 16 tiny.vg
 # Simulate 0 reads
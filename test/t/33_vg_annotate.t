@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 1
+plan tests 3
 
 vg construct -r tiny/tiny.fa -v tiny/tiny.vcf.gz >t.vg
 
@@ -15,4 +15,8 @@ vg index -x t.ref.xg t.ref.vg
 
 is $(vg sim -s 7331 -n 10 -l 50 -x t.xg -a | vg annotate -n -x t.ref.xg -a - | awk '{ if ($5 < 50) print }' | wc -l) 10 "we can detect when reads contain non-reference variation"
 
-rm -f t.vg t.ref.vg t.xg t.ref.xg
+printf "x\t0\t50\twhole\nx\t100\t200\tbeyond\n" >features.bed
+is $(vg sim -s 7331 -n 10 -l 20 -x t.xg -a | vg annotate -x t.xg -a - -f features.bed -t 2 | vg view -aj - | jq -c '.locus[].name' | grep -c whole) 10 "every read is annotated with a feature covering the whole path"
+is $(vg sim -s 7331 -n 10 -l 20 -x t.xg -a | vg annotate -x t.xg -a - -f features.bed | vg view -aj - | grep -c beyond) 0 "reads are not annotated with features they do not overlap"
+
+rm -f t.vg t.ref.vg t.xg t.ref.xg features.bed
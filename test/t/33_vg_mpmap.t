@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 3
+plan tests 5
 
 vg index -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa -k 16 graphs/refonly-lrc_kir.vg
 
@@ -24,4 +24,10 @@ is $(printf "%s\t%s\n" $paired_range $distant_range | awk '{if ($1 < $2) print 1
 
 rm temp_paired_alignment.json temp_independent_alignment.json
 
+vg mpmap -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa --calibration temp.mpcal --calibrate-only
+is $(vg mpmap -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa --calibration temp.mpcal -f reads/grch38_lrc_kir_paired.fq -i -S 2>&1 >/dev/null | grep -c "does not match") 0 "a saved calibration is reused by a run with the same indexes and settings"
+is $(vg mpmap -x graphs/refonly-lrc_kir.vg.xg -g graphs/refonly-lrc_kir.vg.gcsa --calibration temp.mpcal -f reads/grch38_lrc_kir_paired.fq -i -S -c 128 2>&1 >/dev/null | grep -c "does not match") 1 "a saved calibration is not reused when the settings change"
+
+rm -f temp.mpcal temp_distant_alignment.json
+
 rm -f graphs/refonly-lrc_kir.vg.xg graphs/refonly-lrc_kir.vg.gcsa graphs/refonly-lrc_kir.vg.gcsa.lcp
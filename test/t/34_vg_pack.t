@@ -5,7 +5,7 @@ BASH_TAP_ROOT=../deps/bash-tap
 
 PATH=../bin:$PATH # for vg
 
-plan tests 6
+plan tests 7
 
 vg construct -r tiny/tiny.fa >flat.vg
 vg view flat.vg| sed 's/CAAATAAGGCTTGGAAATTTTCTGGAGTTCTATTATATTCCAACTCTCTG/CAAATAAGGCTTGGAAATTTTCTGGAGATCTATTATACTCCAACTCTCTG/' | vg view -Fv - >2snp.vg
@@ -39,4 +39,8 @@ y=$(vg pack -x flat.xg -di 2snp.gam.cx.3x | wc -c)
 
 is $x $y "pack index merging produces the expected result"
 
-rm -f flat.vg 2snp.vg 2snp.xg 2snp.sim flat.gcsa flat.gcsa.lcp flat.xg 2snp.xg 2snp.gam 2snp.gam.cx 2snp.gam.cx.3x 2snp.gam.vgpu
+vg map -g flat.gcsa -x flat.xg -G 2snp.sim -k 8 --pack-out 2snp.map.cx >2snp.gam
+vg pack -x flat.xg -o 2snp.gam.cx -g 2snp.gam
+is $(vg pack -x flat.xg -di 2snp.map.cx | md5sum | cut -f 1 -d\ ) $(vg pack -x flat.xg -di 2snp.gam.cx | md5sum | cut -f 1 -d\ ) "packing while mapping gives the same coverage as packing the GAM"
+
+rm -f flat.vg 2snp.vg 2snp.xg 2snp.sim flat.gcsa flat.gcsa.lcp flat.xg 2snp.xg 2snp.gam 2snp.gam.cx 2snp.gam.cx.3x 2snp.gam.vgpu 2snp.map.cx